@@ -9,6 +9,7 @@ LIBARCH_SOURCES := \
 	exception.cc \
 	exception_handler.cc \
 	backtrace.cc \
+	sampling_profiler.cc \
 	format.cc \
 	fslock.cc \
 	gpgpu.cc \
@@ -22,7 +23,7 @@ LIBARCH_SOURCES := \
 	spinlock.cc \
 
 ifeq ($(ARCH),x86_64)
-LIBARCH_SOURCES += simd_vector_avx.cc
+LIBARCH_SOURCES += simd_vector_avx.cc simd_vector_avx2.cc simd_vector_avx512.cc
 endif
 
 LIBARCH_LINK := dl
@@ -42,6 +43,8 @@ $(eval $(call library,gc,$(LIBGC_SOURCES),rt arch))
 # Note: we should be able to get away without this, but we get a segfault on
 # shared library loading if it's not here.
 $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -mfma -mf16c -ffp-contract=off))
+$(eval $(call set_single_compile_option,simd_vector_avx512.cc,-mavx512f))
 
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
@@ -10,6 +10,11 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 
 using namespace std;
@@ -46,5 +51,110 @@ void init_num_cpus()
     //cerr << "num_cpus_result = " << num_cpus_result << endl;
 }
 
-} // namespace MLDB
+namespace {
+
+/// Parse a Linux CPU list, like "0-23,48-71"
+std::vector<int> parseCpuList(const std::string & list)
+{
+    std::vector<int> result;
+    std::istringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty())
+            continue;
+        int first = 0, last = 0;
+        size_t dash = range.find('-');
+        try {
+            first = std::stoi(range.substr(0, dash));
+            last = dash == std::string::npos
+                ? first : std::stoi(range.substr(dash + 1));
+        } catch (const std::exception &) {
+            continue;
+        }
+        for (int cpu = first;  cpu <= last;  ++cpu)
+            result.push_back(cpu);
+    }
+    return result;
+}
+
+NumaTopology readNumaTopology()
+{
+    NumaTopology result;
+
+    for (int node = 0;  ;  ++node) {
+        ifstream stream("/sys/devices/system/node/node"
+                        + std::to_string(node) + "/cpulist");
+        if (!stream)
+            break;
+        std::string list;
+        getline(stream, list);
+        result.nodeCpus.emplace_back(parseCpuList(list));
+    }
+
+    // Fall back to a single node with every CPU
+    if (result.nodeCpus.empty()) {
+        result.nodeCpus.emplace_back();
+        for (int cpu = 0;  cpu < num_cpus();  ++cpu)
+            result.nodeCpus[0].push_back(cpu);
+    }
+
+    for (size_t node = 0;  node < result.nodeCpus.size();  ++node) {
+        for (int cpu: result.nodeCpus[node]) {
+            if (cpu >= result.cpuNode.size())
+                result.cpuNode.resize(cpu + 1, 0);
+            result.cpuNode[cpu] = node;
+        }
+    }
+
+    return result;
+}
 
+} // file scope
+
+const NumaTopology & numaTopology()
+{
+    static const NumaTopology result = readNumaTopology();
+    return result;
+}
+
+int currentNumaNode()
+{
+    const NumaTopology & topology = numaTopology();
+    if (topology.numNodes() == 1)
+        return 0;
+    return topology.nodeOfCpu(sched_getcpu());
+}
+
+int numaNodeOfAddress(const void * address)
+{
+#if defined(SYS_move_pages)
+    if (numaTopology().numNodes() == 1)
+        return 0;
+
+    // move_pages() with no target nodes returns the node of each page
+    static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    void * page = (void *)((uintptr_t)address & ~(pageSize - 1));
+    int status = -1;
+    if (syscall(SYS_move_pages, 0, 1UL, &page, nullptr, &status, 0) != 0
+        || status < 0)
+        return -1;
+    return status;
+#else
+    return -1;
+#endif
+}
+
+bool pinThreadToNumaNode(int node)
+{
+    const NumaTopology & topology = numaTopology();
+    if (node < 0 || node >= topology.numNodes())
+        return false;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu: topology.nodeCpus[node])
+        CPU_SET(cpu, &cpus);
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+} // namespace MLDB
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "mldb/compiler/compiler.h"
+#include <vector>
 
 namespace MLDB {
 
@@ -24,4 +25,44 @@ MLDB_ALWAYS_INLINE int num_cpus()
     return num_cpus_result;
 }
 
+
+/** NUMA topology of the system, as read from /sys.  A system without NUMA,
+    or where the topology can't be read, has a single node with all of
+    the CPUs in it.
+*/
+
+struct NumaTopology {
+    /// CPUs in each node
+    std::vector<std::vector<int> > nodeCpus;
+
+    /// Node of each CPU
+    std::vector<int> cpuNode;
+
+    int numNodes() const { return nodeCpus.size(); }
+
+    /// Return the node of the given CPU, or 0 if it's not known
+    int nodeOfCpu(int cpu) const
+    {
+        if (cpu < 0 || cpu >= cpuNode.size())
+            return 0;
+        return cpuNode[cpu];
+    }
+};
+
+/** Return the NUMA topology of the system, which is read once. */
+const NumaTopology & numaTopology();
+
+/** Return the NUMA node of the CPU that the calling thread is running on. */
+int currentNumaNode();
+
+/** Return the NUMA node whose memory holds the given address, or -1 if
+    it's not known (for example if the page isn't yet mapped).
+*/
+int numaNodeOfAddress(const void * address);
+
+/** Restrict the calling thread to run on the CPUs of the given NUMA node.
+    Returns false if that wasn't possible.
+*/
+bool pinThreadToNumaNode(int node);
+
 } // namespace MLDB
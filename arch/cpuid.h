@@ -157,6 +157,48 @@ struct CPU_Info {
         uint32_t amd;
     };
 
+    // Structured extended feature flags (leaf 7, subleaf 0, ebx)
+    union {
+        struct {
+            uint32_t fsgsbase:1;  // 0
+            uint32_t tsc_adjust:1;
+            uint32_t sgx:1;
+            uint32_t bmi1:1;
+            uint32_t hle:1;       // 4
+            uint32_t avx2:1;
+            uint32_t fdp_excptn_only:1;
+            uint32_t smep:1;
+            uint32_t bmi2:1;      // 8
+            uint32_t erms:1;
+            uint32_t invpcid:1;
+            uint32_t rtm:1;
+            uint32_t pqm:1;       // 12
+            uint32_t fpu_cs_ds:1;
+            uint32_t mpx:1;
+            uint32_t pqe:1;
+            uint32_t avx512f:1;   // 16
+            uint32_t avx512dq:1;
+            uint32_t rdseed:1;
+            uint32_t adx:1;
+            uint32_t smap:1;      // 20
+            uint32_t avx512ifma:1;
+            uint32_t pcommit:1;
+            uint32_t clflushopt:1;
+            uint32_t clwb:1;      // 24
+            uint32_t intel_pt:1;
+            uint32_t avx512pf:1;
+            uint32_t avx512er:1;
+            uint32_t avx512cd:1;  // 28
+            uint32_t sha:1;
+            uint32_t avx512bw:1;
+            uint32_t avx512vl:1;
+        };
+        uint32_t structured;
+    };
+
+    /// Register state enabled by the OS (XCR0); zero if not available
+    uint64_t xcr0;
+
     std::string print_flags();
 };
 
@@ -181,6 +223,11 @@ struct Regs {
 
 Regs cpuid(uint32_t request, uint32_t ecx = 0);
 
+/** Read the given extended control register.  Only valid if the osxsave
+    flag is set.
+*/
+uint64_t xgetbv(uint32_t index);
+
 #endif // __i686__
 
 } // namespace MLDB
@@ -21,6 +21,8 @@
 #include <iostream>
 #include <map>
 #include <cstring>
+#include <cstdlib>
+#include <thread>
 
 
 using namespace std;
@@ -238,6 +240,113 @@ struct GcLockBase::Deferred {
     }
 };
 
+
+/*****************************************************************************/
+/* EPOCH DATA                                                                */
+/*****************************************************************************/
+
+/* In the epoch mode, each thread has a slot that only it writes to.  A
+   thread entering a critical section copies the global epoch into its slot,
+   and a thread leaving stores QUIESCENT.
+
+   The global epoch can move on from e to e + 1 once every slot is either
+   quiescent or has published e, so the threads in a critical section are
+   always in the global epoch or the one before.  Work deferred while the
+   global epoch is e goes on the list for e, and can be run once the global
+   epoch has reached e + 2, as by then every thread that could have seen the
+   old value has left its critical section.
+*/
+
+namespace {
+
+constexpr int64_t QUIESCENT = -1;
+
+/// Try to reclaim each time a deferred list gets this many more entries
+constexpr size_t EPOCH_BATCH_SIZE = 64;
+
+/// Readers try to reclaim on one in this many exits with work pending
+constexpr unsigned EPOCH_EXITS_PER_RECLAIM = 16;
+
+int32_t epochPlus(int32_t epoch, int n)
+{
+    return (int32_t)((uint32_t)epoch + n);
+}
+
+bool epochModeByDefault()
+{
+    static const bool result = [] ()
+        {
+            const char * mode = ::getenv("MLDB_GC_LOCK_MODE");
+            return mode && strcmp(mode, "epoch") == 0;
+        } ();
+    return result;
+}
+
+} // file scope
+
+struct GcLockBase::EpochSlot {
+    EpochSlot()
+        : epoch(QUIESCENT), inUse(true)
+    {
+    }
+
+    std::atomic<int64_t> epoch;   ///< Published epoch, or QUIESCENT
+    std::atomic<bool> inUse;      ///< Owned by a thread?
+    char padding[48];             ///< Keep slots on different cache lines
+};
+
+struct GcLockBase::EpochData {
+    EpochData()
+        : epoch(gcLockStartingEpoch), exclusiveFutex(0), pending(0)
+    {
+    }
+
+    std::atomic<int32_t> epoch;           ///< The global epoch
+    std::atomic<int32_t> exclusiveFutex;  ///< 1 when exclusively locked
+    std::atomic<size_t> pending;          ///< Number of deferred entries
+
+    mutable Spinlock slotsLock;
+    std::vector<std::shared_ptr<EpochSlot> > slots;
+
+    /** Return a slot for a new thread, reusing one from a thread that has
+        exited if there is one.
+    */
+    std::shared_ptr<EpochSlot> allocateSlot()
+    {
+        std::lock_guard<Spinlock> guard(slotsLock);
+        for (auto & slot: slots) {
+            bool expected = false;
+            if (slot->inUse.compare_exchange_strong(expected, true))
+                return slot;
+        }
+        slots.emplace_back(std::make_shared<EpochSlot>());
+        return slots.back();
+    }
+
+    /** Is every thread that's in a critical section in the given epoch? */
+    bool allInEpoch(int32_t e) const
+    {
+        std::lock_guard<Spinlock> guard(slotsLock);
+        for (auto & slot: slots) {
+            int64_t val = slot->epoch.load(std::memory_order_acquire);
+            if (val != QUIESCENT && (int32_t)val != e)
+                return false;
+        }
+        return true;
+    }
+
+    /** Is any thread in a critical section? */
+    bool anyIn() const
+    {
+        std::lock_guard<Spinlock> guard(slotsLock);
+        for (auto & slot: slots) {
+            if (slot->epoch.load(std::memory_order_acquire) != QUIESCENT)
+                return true;
+        }
+        return false;
+    }
+};
+
 std::string
 GcLockBase::ThreadGcInfoEntry::
 print() const
@@ -255,7 +364,7 @@ GcLockBase::ThreadGcInfoEntry::
 ThreadGcInfoEntry()
     : inEpoch(-1), readLocked(0), writeLocked(0),
       specLocked(0), specUnlocked(0),
-      owner(0)
+      owner(0), epochExits(0)
 {
 }
 
@@ -276,7 +385,12 @@ GcLockBase::ThreadGcInfoEntry::
         unlockShared(RD_YES);
         specUnlocked = 0;
     }
-           
+
+    // Give our slot back so that another thread can use it
+    if (epochSlot) {
+        epochSlot->epoch.store(QUIESCENT, std::memory_order_release);
+        epochSlot->inUse.store(false, std::memory_order_release);
+    }
 } 
 
 
@@ -448,6 +562,16 @@ GcLockBase()
 GcLockBase::
 ~GcLockBase()
 {
+    if (epochs) {
+        // Nothing can be in a critical section any more, so the work that
+        // was still waiting for a batch can be run.
+        for (auto & entry: deferred->entries) {
+            entry.second->runAll();
+            delete entry.second;
+        }
+        deferred->entries.clear();
+    }
+
     if (!deferred->empty()) {
         dump();
     }
@@ -455,6 +579,14 @@ GcLockBase::
     delete deferred;
 }
 
+void
+GcLockBase::
+useEpochReclamation()
+{
+    ExcAssert(!epochs);
+    epochs.reset(new EpochData());
+}
+
 bool
 GcLockBase::
 updateAtomic(Atomic & oldValue, Atomic & newValue, RunDefer runDefer)
@@ -507,6 +639,11 @@ void
 GcLockBase::
 runDefers()
 {
+    if (epochs) {
+        reclaimEpochs();
+        return;
+    }
+
     std::vector<DeferredList *> toRun;
     {
         std::lock_guard<Spinlock> guard(deferred->lock);
@@ -559,6 +696,11 @@ enterCS(ThreadGcInfoEntry * entry, RunDefer runDefer)
         
     ExcAssertEqual(entry->inEpoch, -1);
 
+    if (epochs) {
+        enterCSEpoch(entry);
+        return;
+    }
+
     Atomic current = data->atomic;
 
     for (;;) {
@@ -598,6 +740,11 @@ exitCS(ThreadGcInfoEntry * entry, RunDefer runDefer /* = true */)
     ExcCheck(entry->inEpoch == 0 || entry->inEpoch == 1,
             "Invalid inEpoch");
 
+    if (epochs) {
+        exitCSEpoch(entry, runDefer);
+        return;
+    }
+
 #if 0
     // Fast path
     if (data->atomic.decrementInAtomic(entry->inEpoch) > 1) {
@@ -625,6 +772,11 @@ enterCSExclusive(ThreadGcInfoEntry * entry)
 {
     ExcAssertEqual(entry->inEpoch, -1);
 
+    if (epochs) {
+        enterCSExclusiveEpoch(entry);
+        return;
+    }
+
     Atomic current = data->atomic, newValue;
 
     for (;;) {
@@ -703,6 +855,13 @@ exitCSExclusive(ThreadGcInfoEntry * entry)
         throw;
     }
 #endif
+    if (epochs) {
+        epochs->exclusiveFutex.store(0, std::memory_order_release);
+        futex_wake(epochs->exclusiveFutex);
+        entry->inEpoch = -1;
+        return;
+    }
+
     data->atomic.resetExclusiveAtomic();
     
     // Wake everything waiting on the exclusive lock
@@ -712,6 +871,136 @@ exitCSExclusive(ThreadGcInfoEntry * entry)
     entry->inEpoch = -1;
 }
 
+void
+GcLockBase::
+enterCSEpoch(ThreadGcInfoEntry * entry)
+{
+    if (MLDB_UNLIKELY(!entry->epochSlot))
+        entry->epochSlot = epochs->allocateSlot();
+
+    EpochSlot & slot = *entry->epochSlot;
+
+    for (;;) {
+        int32_t epoch = epochs->epoch.load(std::memory_order_relaxed);
+        slot.epoch.store((uint32_t)epoch, std::memory_order_relaxed);
+
+        // Our epoch must be visible before we look at the exclusive flag or
+        // at anything protected by the lock.  Pairs with the fences in
+        // tryAdvanceEpoch() and enterCSExclusiveEpoch().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (MLDB_LIKELY(epochs->exclusiveFutex.load(std::memory_order_relaxed)
+                        == 0)) {
+            entry->inEpoch = epoch & 1;
+            return;
+        }
+
+        // Exclusively locked; get out of the way until it's released
+        slot.epoch.store(QUIESCENT, std::memory_order_release);
+        futex_wait(epochs->exclusiveFutex, 1);
+    }
+}
+
+void
+GcLockBase::
+exitCSEpoch(ThreadGcInfoEntry * entry, RunDefer runDefer)
+{
+    entry->epochSlot->epoch.store(QUIESCENT, std::memory_order_release);
+    entry->inEpoch = -1;
+
+    // Readers only help with reclamation now and again, so that it is
+    // mostly paid for by those that defer work.
+    if (runDefer
+        && epochs->pending.load(std::memory_order_relaxed) != 0
+        && entry->epochExits++ % EPOCH_EXITS_PER_RECLAIM == 0) {
+        reclaimEpochs();
+    }
+}
+
+void
+GcLockBase::
+enterCSExclusiveEpoch(ThreadGcInfoEntry * entry)
+{
+    for (;;) {
+        int32_t expected = 0;
+        if (epochs->exclusiveFutex.compare_exchange_strong(expected, 1))
+            break;
+        futex_wait(epochs->exclusiveFutex, 1);
+    }
+
+    // New readers will now back off; wait for the ones already in
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    while (epochs->anyIn())
+        std::this_thread::yield();
+
+    entry->inEpoch = epochs->epoch.load() & 1;
+}
+
+bool
+GcLockBase::
+tryAdvanceEpoch()
+{
+    // Anything unlinked before this call must be invisible to a thread
+    // that we don't see in a critical section.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    int32_t epoch = epochs->epoch.load();
+    if (!epochs->allInEpoch(epoch))
+        return false;
+
+    // If this fails, someone else moved it on for us
+    epochs->epoch.compare_exchange_strong(epoch, epochPlus(epoch, 1));
+    return true;
+}
+
+void
+GcLockBase::
+waitForEpochs()
+{
+    int32_t target = epochPlus(epochs->epoch.load(), 2);
+
+    while (compareEpochs(epochs->epoch.load(), target) < 0) {
+        if (!tryAdvanceEpoch())
+            std::this_thread::yield();
+    }
+}
+
+void
+GcLockBase::
+reclaimEpochs()
+{
+    if (tryAdvanceEpoch())
+        tryAdvanceEpoch();
+
+    std::vector<DeferredList *> toRun;
+    {
+        std::lock_guard<Spinlock> guard(deferred->lock);
+
+        // Work deferred in this epoch or the one before it may still be
+        // visible.
+        int32_t oldestVisible = epochPlus(epochs->epoch.load(), -1);
+
+        // Epochs may have wrapped around, so we can't rely on the map order
+        for (auto it = deferred->entries.begin(),
+                 end = deferred->entries.end();
+             it != end;  /* no inc */) {
+            if (compareEpochs(it->first, oldestVisible) >= 0) {
+                ++it;
+                continue;
+            }
+            epochs->pending -= it->second->size();
+            toRun.push_back(it->second);
+            it = deferred->entries.erase(it);
+        }
+    }
+
+    for (auto list: toRun) {
+        list->runAll();
+        delete list;
+    }
+}
+
 void
 GcLockBase::
 visibleBarrier()
@@ -724,6 +1013,12 @@ visibleBarrier()
         throw MLDB::Exception("visibleBarrier called in critical section will "
                             "deadlock");
 
+    if (epochs) {
+        if (epochs->anyIn())
+            waitForEpochs();
+        return;
+    }
+
     Atomic current = data->atomic;
     int startEpoch = data->atomic.epoch;
     
@@ -766,6 +1061,17 @@ deferBarrier()
 
     ThreadGcInfoEntry & entry = getEntry();
 
+    if (epochs) {
+        // If we're in a critical section, we'll wait forever...
+        ExcAssertEqual(entry.inEpoch, -1);
+
+        // Everything deferred so far is on the list of the current epoch or
+        // an earlier one, which can all be run once we've moved on by two.
+        waitForEpochs();
+        reclaimEpochs();
+        return;
+    }
+
     visibleBarrier();
 
     // Do it twice to make sure that everything is cycled over two different
@@ -841,6 +1147,28 @@ doDefer(void (fn) (Args...), Args... args)
     //
     // If there are threads in the current epoch (irrespective of the old
     // epoch) then we need to wait until the current epoch is done.
+    //
+    // In the epoch mode, we don't know which threads are in a critical
+    // section without scanning them all, so the work always goes on the
+    // list for the current epoch and we only try to reclaim once per batch.
+
+    if (epochs) {
+        bool reclaim;
+        {
+            std::lock_guard<Spinlock> guard(deferred->lock);
+            int32_t epoch = epochs->epoch.load();
+            DeferredList * & list = deferred->entries[epoch];
+            if (!list)
+                list = new DeferredList();
+            list->addDeferred(epoch, fn, std::forward<Args>(args)...);
+            epochs->pending += 1;
+            reclaim = list->size() % EPOCH_BATCH_SIZE == 0;
+        }
+
+        if (reclaim)
+            reclaimEpochs();
+        return;
+    }
 
     Atomic current = data->atomic;
 
@@ -931,10 +1259,18 @@ void
 GcLockBase::
 dump()
 {
-    Atomic current = data->atomic;
-    cerr << "epoch " << current.epoch << " in " << current.anyInCurrent()
-         << " in-1 " << current.anyInOld() << " vis " << current.visibleEpoch()
-         << " excl " << current.exclusive() << endl;
+    if (epochs) {
+        cerr << "epoch " << epochs->epoch.load() << " (epoch mode) in "
+             << epochs->anyIn() << " excl " << epochs->exclusiveFutex.load()
+             << " pending " << epochs->pending.load() << endl;
+    }
+    else {
+        Atomic current = data->atomic;
+        cerr << "epoch " << current.epoch << " in " << current.anyInCurrent()
+             << " in-1 " << current.anyInOld()
+             << " vis " << current.visibleEpoch()
+             << " excl " << current.exclusive() << endl;
+    }
     cerr << "deferred: ";
     {
         std::lock_guard<Spinlock> guard(deferred->lock);
@@ -953,6 +1289,8 @@ int
 GcLockBase::
 currentEpoch() const
 {
+    if (epochs)
+        return epochs->epoch.load();
     return data->atomic.epoch;
 }
 
@@ -960,6 +1298,8 @@ bool
 GcLockBase::
 isLockedByAnyThread() const
 {
+    if (epochs)
+        return epochs->anyIn();
     return data->atomic.in[0] || data->atomic.in[1] ;
 }
 
@@ -982,10 +1322,13 @@ uninitializedConstructData(void * memory)
 /*****************************************************************************/
 
 GcLock::
-GcLock()
+GcLock(Mode mode)
     : localData(new Data())
 {
     data = localData.get();
+
+    if (mode == GC_EPOCH || (mode == GC_DEFAULT && epochModeByDefault()))
+        useEpochReclamation();
 }
 
 GcLock::
@@ -38,6 +38,24 @@
     Further details is available in the documentation of each respective
     operand.
 
+    There are two ways of keeping track of who is in a critical section:
+
+    - Counted (the default): a single word holds the current epoch and the
+      number of threads in each of the two live epochs.  Entering and
+      exiting a critical section are compare-and-swaps on that word, which
+      makes defer() and visibleBarrier() cheap but means that every reader
+      bounces the same cache line under heavy concurrency.
+    - Epoch: each thread publishes the epoch it entered in into its own
+      slot with a plain store and a fence, so the read side writes to no
+      shared memory.  defer() adds to a batched list for the current epoch,
+      which is run once every thread has moved on by two epochs; working
+      out when that is requires scanning the slots, which is paid for by
+      writers and only occasionally by readers.
+
+    The epoch mode can be selected by passing GC_EPOCH to the GcLock
+    constructor, or for all locks constructed with GC_DEFAULT by setting
+    MLDB_GC_LOCK_MODE=epoch in the environment.  It can't be used with a
+    SharedGcLock, as the slots live in the memory of a single process.
 */
 
 namespace MLDB {
@@ -64,6 +82,17 @@ public:
         RD_YES = 1      ///< Potentially run deferred work on this call
     };
 
+    /** Which mechanism is used to track critical sections; see the comment
+        at the top of the file.
+    */
+    enum Mode {
+        GC_DEFAULT = 0,  ///< GC_EPOCH if MLDB_GC_LOCK_MODE=epoch, else counted
+        GC_COUNTED = 1,  ///< Counters of threads in each epoch
+        GC_EPOCH = 2     ///< Per-thread epochs with batched deferred work
+    };
+
+    struct EpochSlot;
+
     /// A thread's bookkeeping info about each GC area
     struct ThreadGcInfoEntry {
         ThreadGcInfoEntry();
@@ -78,6 +107,11 @@ public:
 
         GcLockBase *owner;
 
+        /// Epoch mode only: the slot we publish our epoch in
+        std::shared_ptr<EpochSlot> epochSlot;
+        /// Epoch mode only: exits with deferred work pending
+        unsigned epochExits;
+
         void init(const GcLockBase * const self);
         void lockShared(RunDefer runDefer);
         void unlockShared(RunDefer runDefer);
@@ -326,9 +360,20 @@ protected:
     static size_t dataBytesRequired();
     /// Placement construct a data instance
     static Data* uninitializedConstructData(void * memory);
+
+    /** Switch to the epoch mode.  Must be called from the constructor of
+        the derived class, before anything else can use the lock.
+    */
+    void useEpochReclamation();
+
 private:
     struct Deferred;
     struct DeferredList;
+    struct EpochData;
+
+    /// Epoch mode state; null when in counted mode.  Declared before gcInfo
+    /// as the thread entries refer to it as they're destroyed.
+    std::unique_ptr<EpochData> epochs;
 
     GcInfo gcInfo;
 
@@ -353,6 +398,27 @@ private:
         called with deferred locked.
     */
     std::vector<DeferredList *> checkDefers();
+
+    /** Epoch mode versions of the critical section entry and exit. */
+    void enterCSEpoch(ThreadGcInfoEntry * entry);
+    void exitCSEpoch(ThreadGcInfoEntry * entry, RunDefer runDefer);
+    void enterCSExclusiveEpoch(ThreadGcInfoEntry * entry);
+
+    /** Epoch mode: move the global epoch forward by one if every thread in
+        a critical section has caught up with it.  Returns true if the epoch
+        moved on, whether or not it was this call that did it.
+    */
+    bool tryAdvanceEpoch();
+
+    /** Epoch mode: wait until the global epoch has moved on by two, which
+        means that every thread that was in a critical section has left it.
+    */
+    void waitForEpochs();
+
+    /** Epoch mode: advance the epoch as far as possible and run the
+        deferred work that is no longer visible.
+    */
+    void reclaimEpochs();
 };
 
 
@@ -364,7 +430,7 @@ private:
 
 struct GcLock : public GcLockBase
 {
-    GcLock();
+    GcLock(Mode mode = GC_DEFAULT);
     virtual ~GcLock();
 
     virtual void unlink();
@@ -6,6 +6,7 @@
    Delayed initialization of GPGPU runtimes.
 */
 
+#include "gpgpu.h"
 #include <dlfcn.h>
 #include <iostream>
 #include "mldb/jml/utils/environment.h"
@@ -67,4 +68,14 @@ struct Load_CAL {
 
 } load_cal;
 
+bool cudaAvailable()
+{
+    return load_cuda.handle != 0;
+}
+
+bool calAvailable()
+{
+    return load_cal.handle != 0;
+}
+
 } // namespace MLDB
@@ -10,8 +10,20 @@
 #ifndef __arch__gpgpu_h__
 #define __arch__gpgpu_h__
 
-namespace ML {
+namespace MLDB {
 
-} // namespace ML
+/** Returns true if the CUDA runtime was requested (with USE_CUDA=1 in the
+    environment) and libarch_cuda.so was loaded.  Code with a GPU
+    implementation should check this, and use the CPU implementation when
+    it returns false.
+*/
+bool cudaAvailable();
+
+/** Returns true if the CAL runtime was requested (with USE_CAL=1 in the
+    environment) and libarch_cal.so was loaded.
+*/
+bool calAvailable();
+
+} // namespace MLDB
 
-#endif /* __arch__cuda_h__ */
+#endif /* __arch__gpgpu_h__ */
@@ -0,0 +1,268 @@
+/** sampling_profiler.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Profiler that samples the stacks of the threads of the process.
+*/
+
+#include "sampling_profiler.h"
+#include "backtrace.h"
+#include "exception.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+constexpr int MAX_FRAMES = 64;
+constexpr int MAX_ACTIVITY = 96;
+
+/// Largest number of samples kept by one profile, to bound its memory
+constexpr size_t MAX_SAMPLES = 200000;
+
+/** One sample, written by the signal handler into memory allocated before
+    the profile starts, as a signal handler can't allocate.
+*/
+struct Sample {
+    void * frames[MAX_FRAMES];
+    int depth;
+    char activity[MAX_ACTIVITY];
+    std::atomic<bool> done;
+};
+
+__thread const char * currentActivityLabel = nullptr;
+
+// State shared with the signal handler.  Samples are only taken while
+// samples is set.
+std::atomic<Sample *> samples(nullptr);
+std::atomic<size_t> maxSamples(0);
+std::atomic<size_t> numSamples(0);
+std::atomic<size_t> numDropped(0);
+std::atomic<int> numInHandler(0);
+
+// Only one profile at a time
+std::mutex profilerMutex;
+std::once_flag handlerInstalled;
+
+void onSample(int, siginfo_t *, void *)
+{
+    int savedErrno = errno;
+    numInHandler.fetch_add(1);
+
+    Sample * buffer = samples.load();
+    if (buffer) {
+        size_t n = numSamples.fetch_add(1);
+        if (n < maxSamples.load()) {
+            Sample & sample = buffer[n];
+            sample.depth = ::backtrace(sample.frames, MAX_FRAMES);
+
+            const char * activity = currentActivityLabel;
+            int i = 0;
+            for (; activity && activity[i] && i < MAX_ACTIVITY - 1;  ++i)
+                sample.activity[i] = activity[i];
+            sample.activity[i] = 0;
+
+            sample.done.store(true, std::memory_order_release);
+        }
+        else numDropped.fetch_add(1);
+    }
+
+    numInHandler.fetch_sub(1);
+    errno = savedErrno;
+}
+
+/** The handler stays installed once a profile has been taken, as a
+    SIGPROF that is still pending when the timer is turned off would
+    otherwise kill the process.  It does nothing between profiles.
+*/
+void installHandler()
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = onSample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) == -1)
+        throw Exception(errno, "sigaction", "SamplingProfiler");
+}
+
+void setTimer(int samplesPerSecond)
+{
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    if (samplesPerSecond > 0) {
+        timer.it_interval.tv_usec = 1000000 / samplesPerSecond;
+        timer.it_value = timer.it_interval;
+    }
+    if (setitimer(ITIMER_PROF, &timer, nullptr) == -1)
+        throw Exception(errno, "setitimer", "SamplingProfiler");
+}
+
+/** Frame names can't contain the separators of the collapsed format. */
+std::string cleanFrameName(std::string name)
+{
+    for (auto & c: name) {
+        if (c == ';' || c == '\n')
+            c = ' ';
+    }
+    return name;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER                                                         */
+/*****************************************************************************/
+
+std::string
+SamplingProfiler::
+collapsedStacks(double seconds, int samplesPerSecond)
+{
+    if (!(seconds > 0) || seconds > 3600)
+        throw Exception("Profiling time must be between 0 and 3600 seconds");
+    if (samplesPerSecond <= 0 || samplesPerSecond > 10000)
+        throw Exception("Profiling frequency must be between 1 and 10000 "
+                        "samples per second");
+
+    std::unique_lock<std::mutex> guard(profilerMutex, std::try_to_lock);
+    if (!guard)
+        throw Exception("A profile is already being taken");
+
+    std::call_once(handlerInstalled, installHandler);
+
+    // The first call to backtrace() loads the unwinder, which isn't
+    // safe in a signal handler, so make sure that's done here
+    void * warmup[2];
+    ::backtrace(warmup, 2);
+
+    size_t numCpus = std::max(1U, std::thread::hardware_concurrency());
+    size_t capacity = std::min<double>(MAX_SAMPLES,
+                                       seconds * samplesPerSecond * numCpus
+                                       + 1);
+    std::unique_ptr<Sample[]> buffer(new Sample[capacity]);
+    for (size_t i = 0;  i < capacity;  ++i)
+        buffer[i].done.store(false, std::memory_order_relaxed);
+
+    maxSamples = capacity;
+    numSamples = 0;
+    numDropped = 0;
+    samples = buffer.get();
+
+    auto stop = [&] ()
+        {
+            samples = nullptr;
+            while (numInHandler.load() > 0)
+                std::this_thread::yield();
+        };
+
+    try {
+        setTimer(samplesPerSecond);
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        setTimer(0);
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+
+    // Symbolize each address once.  Except for the innermost, frames are
+    // return addresses, which may be just after the end of the calling
+    // function; looking up the address before gives the call itself.
+    std::unordered_map<const void *, std::string> names;
+    auto getName = [&] (const void * address) -> const std::string &
+        {
+            auto it = names.find(address);
+            if (it == names.end()) {
+                BacktraceFrame frame(0, address);
+                it = names.emplace(address,
+                                   cleanFrameName(frame.print_for_trace()))
+                    .first;
+            }
+            return it->second;
+        };
+
+    std::map<std::string, size_t> stacks;
+    size_t numTaken = std::min<size_t>(numSamples.load(), capacity);
+
+    for (size_t i = 0;  i < numTaken;  ++i) {
+        const Sample & sample = buffer[i];
+        if (!sample.done.load(std::memory_order_acquire))
+            continue;
+
+        std::string stack;
+        if (sample.activity[0])
+            stack = cleanFrameName(sample.activity);
+
+        // Skip the frames of the handler and the signal trampoline
+        static constexpr int SKIP_FRAMES = 2;
+        for (int j = sample.depth - 1;  j >= SKIP_FRAMES;  --j) {
+            const char * address = (const char *)sample.frames[j];
+            if (j > SKIP_FRAMES)
+                address -= 1;
+            if (!stack.empty())
+                stack += ';';
+            stack += getName(address);
+        }
+
+        stacks[stack] += 1;
+    }
+
+    if (numDropped.load())
+        stacks["[dropped samples]"] += numDropped.load();
+
+    std::string result;
+    for (auto & s: stacks) {
+        result += s.first;
+        result += ' ';
+        result += std::to_string(s.second);
+        result += '\n';
+    }
+
+    return result;
+}
+
+const char *
+SamplingProfiler::
+currentActivity()
+{
+    return currentActivityLabel;
+}
+
+const char *
+SamplingProfiler::
+setCurrentActivity(const char * label)
+{
+    const char * previous = currentActivityLabel;
+    currentActivityLabel = label;
+    return previous;
+}
+
+SamplingProfiler::Activity::
+Activity(std::string label)
+    : label(std::move(label)),
+      previous(setCurrentActivity(this->label.c_str()))
+{
+}
+
+SamplingProfiler::Activity::
+~Activity()
+{
+    setCurrentActivity(previous);
+}
+
+} // namespace MLDB
@@ -0,0 +1,73 @@
+/** sampling_profiler.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Profiler that samples the stacks of the threads of the process.
+*/
+
+#pragma once
+
+#include <string>
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SAMPLING PROFILER                                                         */
+/*****************************************************************************/
+
+/** Profiler that samples the stacks of the running threads of the process
+    on a timer signal (SIGPROF), so that it can be turned on in a running
+    server without attaching a debugger or perf.  The timer counts the CPU
+    time of the process, so each thread is sampled in proportion to the
+    CPU that it uses and idle threads don't show up.
+
+    Each sample is tagged with the activity of the thread that it came from
+    (see Activity), so that the stacks of different queries and procedures
+    can be told apart.
+*/
+
+struct SamplingProfiler {
+
+    /** Sample for the given number of seconds, at the given number of samples
+        per CPU second, and return the samples as collapsed stacks: one line
+        per distinct stack, with its frames from the outermost down separated
+        by semicolons, then a space and the number of samples.  This is the
+        input format of the usual flame graph tools.  The activity, if any,
+        is the outermost frame.
+
+        Only one profile can be taken at a time; this throws if another is
+        running.  The calling thread sleeps while the samples are taken.
+    */
+    static std::string collapsedStacks(double seconds,
+                                       int samplesPerSecond = 99);
+
+    /** Label the work done by the current thread for the lifetime of the
+        object, for example "query SELECT ...".  Activities nest; the
+        previous one is restored on destruction.
+    */
+    struct Activity {
+        Activity(std::string label);
+        ~Activity();
+
+        Activity(const Activity &) = delete;
+        void operator = (const Activity &) = delete;
+
+    private:
+        std::string label;
+        const char * previous;
+    };
+
+    /** Return the label of the current thread's activity, or null.  The
+        pointer stays valid for as long as the activity does.
+    */
+    static const char * currentActivity();
+
+    /** Make the given label the current thread's activity, returning the
+        previous one.  This is used by threads that do part of the work of
+        another thread to take on its activity; the label must outlive its
+        use.
+    */
+    static const char * setCurrentActivity(const char * label);
+};
+
+} // namespace MLDB
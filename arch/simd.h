@@ -50,7 +50,19 @@ MLDB_ALWAYS_INLINE bool has_avx()
 
 MLDB_ALWAYS_INLINE bool has_avx2()
 {
-    return cpuid(7, 0).ebx & (1 << 5);
+    return cpu_info().avx2 && has_avx();
+}
+
+MLDB_ALWAYS_INLINE bool has_fma() { return cpu_info().fma && has_avx(); }
+
+MLDB_ALWAYS_INLINE bool has_f16c() { return cpu_info().f16c && has_avx(); }
+
+MLDB_ALWAYS_INLINE bool has_avx512f()
+{
+    // The OS needs to save the opmask and both halves of the zmm registers
+    // (XCR0 bits 5, 6 and 7) as well as the avx state.
+    const CPU_Info & info = cpu_info();
+    return info.avx512f && has_avx() && (info.xcr0 & 0xe6) == 0xe6;
 }
 
 #endif // __i686__
@@ -12,6 +12,7 @@
 #include "exception.h"
 #include <iostream>
 #include <cmath>
+#include <cstring>
 #if MLDB_INTEL_ISA
 # include "simd_vector.h"
 # include "simd_vector_avx.h"
@@ -35,6 +36,13 @@ int ptr_align(const X * p)
 
 void vec_scale(const float * x, float k, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_scale(x, k, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -71,6 +79,13 @@ void vec_scale(const float * x, float k, float * r, size_t n)
 
 void vec_add(const float * x, const float * y, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_add(x, y, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -112,6 +127,13 @@ void vec_add(const float * x, const float * y, float * r, size_t n)
 
 void vec_prod(const float * x, const float * y, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_prod(x, y, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -207,6 +229,13 @@ void vec_prod(const double * x, const double * y, float * r, size_t n)
 
 void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_add(x, k, y, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 
     //bool alignment_unimportant = true;  // nehalem?
@@ -372,6 +401,13 @@ float vec_dotprod(const float * x, const float * y, size_t n)
 
 void vec_scale(const double * x, double k, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_scale(x, k, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 
         if (false)
@@ -409,6 +445,13 @@ void vec_scale(const double * x, double k, double * r, size_t n)
 void vec_add(const double * x, double k, const double * y, double * r,
              size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_add(x, k, y, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -675,7 +718,13 @@ double vec_euclid(const float * x, const float * y, size_t n)
         ;
 
 #if MLDB_INTEL_ISA
-    if (has_avx()) {
+    else if (has_avx512f()) {
+        return Avx512::vec_euclid(x, y, n);
+    }
+    else if (has_avx2() && has_fma()) {
+        return Avx2::vec_euclid(x, y, n);
+    }
+    else if (has_avx()) {
         return Avx::vec_euclid(x, y, n);
     }
     else if (true) /* sse2 */ {
@@ -817,6 +866,13 @@ double vec_accum_prod3(const float * x, const float * y, const double * z,
 
 void vec_minus(const double * x, const double * y, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_minus(x, y, r, n);
+        return;
+    }
+#endif
+
     for (size_t i = 0;  i < n;  ++i) r[i] = x[i] - y[i];
 }
 
@@ -925,6 +981,11 @@ double vec_accum_prod3(const double * x, const double * y, const float * z,
 
 double vec_sum(const double * x, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma())
+        return Avx2::vec_sum(x, n);
+#endif
+
     double res = 0.0;
     for (size_t i = 0;  i < n;  ++i)
         res += x[i];
@@ -1073,6 +1134,12 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
         ;
 
 #if MLDB_INTEL_ISA
+    else if (has_avx512f()) {
+        return Avx512::vec_dotprod_dp(x, y, n);
+    }
+    else if (has_avx2() && has_fma()) {
+        return Avx2::vec_dotprod_dp(x, y, n);
+    }
     else if (has_avx()) {
         return Avx::vec_dotprod_dp(x, y, n);
     }
@@ -1087,8 +1154,53 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
     }
 }
 
+void vec_dotprod_dp_batch(const float * x, const float * const * ys,
+                          size_t nrows, size_t n, double * r)
+{
+    // Interrogate the cpuid flags directly to decide which one to use
+    if (false)
+        ;
+#if MLDB_INTEL_ISA
+    else if (has_avx512f()) {
+        Avx512::vec_dotprod_dp_batch(x, ys, nrows, n, r);
+    }
+    else if (has_avx2() && has_fma()) {
+        Avx2::vec_dotprod_dp_batch(x, ys, nrows, n, r);
+    }
+#endif
+    else {
+        for (size_t i = 0;  i < nrows;  ++i)
+            r[i] = vec_dotprod_dp(x, ys[i], n);
+    }
+}
+
+void vec_euclid_batch(const float * x, const float * const * ys,
+                      size_t nrows, size_t n, double * r)
+{
+    // Interrogate the cpuid flags directly to decide which one to use
+    if (false)
+        ;
+#if MLDB_INTEL_ISA
+    else if (has_avx512f()) {
+        Avx512::vec_euclid_batch(x, ys, nrows, n, r);
+    }
+    else if (has_avx2() && has_fma()) {
+        Avx2::vec_euclid_batch(x, ys, nrows, n, r);
+    }
+#endif
+    else {
+        for (size_t i = 0;  i < nrows;  ++i)
+            r[i] = vec_euclid(x, ys[i], n);
+    }
+}
+
 double vec_sum_dp(const float * x, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma())
+        return Avx2::vec_sum_dp(x, n);
+#endif
+
     double res = 0.0;
     for (size_t i = 0;  i < n;  ++i)
         res += x[i];
@@ -1097,6 +1209,13 @@ double vec_sum_dp(const float * x, size_t n)
 
 void vec_add(const double * x, const double * y, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_add(x, y, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -1203,6 +1322,13 @@ void vec_add(const double * x, const float * y, double * r, size_t n)
 
 void vec_prod(const double * x, const double * y, double * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_prod(x, y, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -1742,12 +1868,26 @@ void vec_add(const double * x, const float * k, const double * y, double * r,
 
 void vec_exp(const float * x, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_exp(x, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)x[i]);
 }
 
 void vec_exp(const float * x, float k, float * r, size_t n)
 {
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_exp(x, k, r, n);
+        return;
+    }
+#endif
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)(k * x[i]));
 }
@@ -1814,6 +1954,237 @@ double vec_kl(const float * p, const float * q, size_t n)
     return total;
 }
 
+void vec_min(const float * x, const float * y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_min(x, y, r, n);
+        return;
+    }
+#endif
+
+    size_t i = 0;
+
+#if MLDB_INTEL_ISA
+    for (; i + 4 <= n;  i += 4) {
+        v4sf xxxx0 = _mm_loadu_ps(x + i + 0);
+        v4sf yyyy0 = _mm_loadu_ps(y + i + 0);
+        // Operands swapped so that a NaN in y is ignored, like std::min
+        xxxx0      = __builtin_ia32_minps(yyyy0, xxxx0);
+        __builtin_ia32_storeups(r + i + 0, xxxx0);
+    }
+#endif
+
+    for (; i < n;  ++i)
+        r[i] = std::min(x[i], y[i]);
+}
+
+void vec_max(const float * x, const float * y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_max(x, y, r, n);
+        return;
+    }
+#endif
+
+    size_t i = 0;
+
+#if MLDB_INTEL_ISA
+    for (; i + 4 <= n;  i += 4) {
+        v4sf xxxx0 = _mm_loadu_ps(x + i + 0);
+        v4sf yyyy0 = _mm_loadu_ps(y + i + 0);
+        // Operands swapped so that a NaN in y is ignored, like std::max
+        xxxx0      = __builtin_ia32_maxps(yyyy0, xxxx0);
+        __builtin_ia32_storeups(r + i + 0, xxxx0);
+    }
+#endif
+
+    for (; i < n;  ++i)
+        r[i] = std::max(x[i], y[i]);
+}
+
+void vec_min(const float * x, float y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_min(x, y, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = std::min(x[i], y);
+}
+
+void vec_max(const float * x, float y, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_max(x, y, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = std::max(x[i], y);
+}
+
+void vec_min(const double * x, const double * y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_min(x, y, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = std::min(x[i], y[i]);
+}
+
+void vec_min(const double * x, double y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_min(x, y, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = std::min(x[i], y);
+}
+
+void vec_max(const double * x, const double * y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_max(x, y, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = std::max(x[i], y[i]);
+}
+
+void vec_max(const double * x, double y, double * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_max(x, y, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = std::max(x[i], y);
+}
+
+namespace {
+
+uint16_t float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t absx = x & 0x7fffffff;
+
+    // Infinities, and NaNs which are made quiet like F16C does
+    if (absx >= 0x7f800000) {
+        if (absx == 0x7f800000)
+            return sign | 0x7c00;
+        return sign | 0x7e00 | ((absx >> 13) & 0x3ff);
+    }
+
+    // Rounds to 65536 or more
+    if (absx >= 0x477ff000)
+        return sign | 0x7c00;
+
+    // Normal halves; rebias the exponent and round the mantissa
+    if (absx >= 0x38800000) {
+        uint32_t r = absx - 0x38000000;
+        return sign | ((r + 0x0fff + ((r >> 13) & 1)) >> 13);
+    }
+
+    // Smaller than half of the smallest subnormal half
+    if (absx <= 0x33000000)
+        return sign;
+
+    // Subnormal halves, which are multiples of 2^-24
+    uint32_t mantissa = (absx & 0x7fffff) | 0x800000;
+    int shift = 126 - (absx >> 23);
+    uint32_t result = mantissa >> shift;
+    uint32_t rest = mantissa & ((1U << shift) - 1);
+    uint32_t halfway = 1U << (shift - 1);
+    if (rest > halfway || (rest == halfway && (result & 1)))
+        ++result;
+    return sign | result;
+}
+
+float half_to_float(uint16_t h)
+{
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+
+    if (exponent == 0) {
+        // Zero or subnormal, which is exact as a float
+        float result = mantissa * (1.0f / 16777216.0f);
+        return sign ? -result : result;
+    }
+    else if (exponent == 31)
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float result;
+    memcpy(&result, &x, 4);
+    return result;
+}
+
+} // file scope
+
+void vec_float_to_half(const float * x, uint16_t * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma() && has_f16c()) {
+        Avx2::vec_float_to_half(x, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = float_to_half(x[i]);
+}
+
+void vec_half_to_float(const uint16_t * x, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma() && has_f16c()) {
+        Avx2::vec_half_to_float(x, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = half_to_float(x[i]);
+}
+
+void vec_scale(const int8_t * x, float k, float * r, size_t n)
+{
+#if MLDB_INTEL_ISA
+    if (has_avx2() && has_fma()) {
+        Avx2::vec_scale(x, k, r, n);
+        return;
+    }
+#endif
+
+    for (size_t i = 0;  i < n;  ++i)
+        r[i] = k * x[i];
+}
+
 void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n)
 {
     size_t i = 0;
@@ -10,6 +10,7 @@
 
 #include "simd.h"
 #include "mldb/arch/arch.h"
+#include <cstdint>
 
 namespace MLDB {
 namespace SIMD {
@@ -170,6 +171,21 @@ void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n);
 // Euclidean distance squared: sum((p - q)^2)
 double vec_euclid(const float * p, const float * q, size_t n);
 
+// Conversion to and from IEEE half precision floats, rounding to nearest
+// even.  Values too large for a half become infinities.
+void vec_float_to_half(const float * x, uint16_t * r, size_t n);
+void vec_half_to_float(const uint16_t * x, float * r, size_t n);
+
+// r = k x, for bytes holding quantized values
+void vec_scale(const int8_t * x, float k, float * r, size_t n);
+
+// Batched versions, comparing x with each of the nrows vectors in ys.
+// r[i] is exactly the same as the result of the single vector version.
+void vec_dotprod_dp_batch(const float * x, const float * const * ys,
+                          size_t nrows, size_t n, double * r);
+void vec_euclid_batch(const float * x, const float * const * ys,
+                      size_t nrows, size_t n, double * r);
+
 } // namespace Generic
 
 #if MLDB_USE_SSE1
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 namespace MLDB {
 namespace SIMD {
@@ -30,5 +31,101 @@ void vec_minus(const float * x, const float * y, float * r, size_t n);
 double vec_euclid(const float * x, const float * y, size_t n);
 
 } // namespace Avx
+
+/* The AVX2 and AVX-512 kernels are used for the distance calculations in
+   nearest neighbour searches.  The batch versions compare one vector with
+   several others, sharing the loads of x between them; each result is
+   bit for bit identical to that of the single vector version.
+
+   There are also AVX2 versions of the element-wise operations used by
+   distribution<float> and distribution<double>, which give exactly the
+   same results as the generic versions, and of the sums and exp, which
+   differ only by rounding.
+*/
+
+namespace Avx2 {
+
+/// r = k x
+void vec_scale(const float * x, float k, float * r, size_t n);
+void vec_scale(const double * x, double k, double * r, size_t n);
+
+/// r = x + y
+void vec_add(const float * x, const float * y, float * r, size_t n);
+void vec_add(const double * x, const double * y, double * r, size_t n);
+
+/// r = x + k y
+void vec_add(const float * x, float k, const float * y, float * r, size_t n);
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n);
+
+/// r = x * y
+void vec_prod(const float * x, const float * y, float * r, size_t n);
+void vec_prod(const double * x, const double * y, double * r, size_t n);
+
+/// r = x - y
+void vec_minus(const double * x, const double * y, double * r, size_t n);
+
+/// r = std::min(x, y) and r = std::max(x, y), element by element
+void vec_min(const float * x, const float * y, float * r, size_t n);
+void vec_min(const float * x, float y, float * r, size_t n);
+void vec_min(const double * x, const double * y, double * r, size_t n);
+void vec_min(const double * x, double y, double * r, size_t n);
+void vec_max(const float * x, const float * y, float * r, size_t n);
+void vec_max(const float * x, float y, float * r, size_t n);
+void vec_max(const double * x, const double * y, double * r, size_t n);
+void vec_max(const double * x, double y, double * r, size_t n);
+
+/// Sum of the elements, in double precision
+double vec_sum(const double * x, size_t n);
+double vec_sum_dp(const float * x, size_t n);
+
+/// r = exp(k x), calculated in double precision and within one unit in the
+/// last place of the generic version
+void vec_exp(const float * x, float * r, size_t n);
+void vec_exp(const float * x, float k, float * r, size_t n);
+
+/// Half precision conversions.  These use the F16C instructions, so can
+/// only be called once has_f16c() has been checked too.
+void vec_float_to_half(const float * x, uint16_t * r, size_t n);
+void vec_half_to_float(const uint16_t * x, float * r, size_t n);
+
+/// r = k x, for bytes
+void vec_scale(const int8_t * x, float k, float * r, size_t n);
+
+/// Single precision vector dot product with internal summation in dp,
+/// avx2 + fma version
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+
+/// Single precision vector euclidean distance squared, avx2 + fma version
+double vec_euclid(const float * x, const float * y, size_t n);
+
+/// r[i] = vec_dotprod_dp(x, ys[i], n) for i in 0..nrows-1
+void vec_dotprod_dp_batch(const float * x, const float * const * ys,
+                          size_t nrows, size_t n, double * r);
+
+/// r[i] = vec_euclid(x, ys[i], n) for i in 0..nrows-1
+void vec_euclid_batch(const float * x, const float * const * ys,
+                      size_t nrows, size_t n, double * r);
+
+} // namespace Avx2
+
+namespace Avx512 {
+
+/// Single precision vector dot product with internal summation in dp,
+/// avx512f version
+double vec_dotprod_dp(const float * x, const float * y, size_t n);
+
+/// Single precision vector euclidean distance squared, avx512f version
+double vec_euclid(const float * x, const float * y, size_t n);
+
+/// r[i] = vec_dotprod_dp(x, ys[i], n) for i in 0..nrows-1
+void vec_dotprod_dp_batch(const float * x, const float * const * ys,
+                          size_t nrows, size_t n, double * r);
+
+/// r[i] = vec_euclid(x, ys[i], n) for i in 0..nrows-1
+void vec_euclid_batch(const float * x, const float * const * ys,
+                      size_t nrows, size_t n, double * r);
+
+} // namespace Avx512
 } // namespace SIMD
 } // namespace MLDB
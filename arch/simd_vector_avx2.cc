@@ -0,0 +1,532 @@
+/** simd_vector_avx2.cc
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX2 + FMA specializations.  This file must be
+    compiled with -mavx2 -mfma -mf16c -ffp-contract=off, and the functions
+    only called once the CPU has been checked for support.
+*/
+
+#include "simd_vector_avx.h"
+#include "mldb/compiler/compiler.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx2 {
+
+namespace {
+
+/// Number of rows processed together by the batch functions
+constexpr size_t BATCH_ROWS = 4;
+
+inline double horiz_sum(__m256d v)
+{
+    double results[4];
+    _mm256_storeu_pd(results, v);
+    return (results[0] + results[1]) + (results[2] + results[3]);
+}
+
+inline double horiz_sum(__m256 v)
+{
+    float results[8];
+    _mm256_storeu_ps(results, v);
+    double result = 0.0;
+    for (unsigned i = 0;  i < 8;  ++i)
+        result += results[i];
+    return result;
+}
+
+/** Dot product of x with each of the R vectors in ys.  Each row has its
+    own accumulators, and the operations done on each of them don't depend
+    upon R, so that the result for a row is the same whether it's
+    calculated alone or in a batch.
+*/
+template<size_t R>
+MLDB_ALWAYS_INLINE void
+dotprod_dp_rows(const float * x, const float * const * ys, size_t n,
+                double * r)
+{
+    __m256d acc0[R], acc1[R];
+    for (size_t k = 0;  k < R;  ++k)
+        acc0[k] = acc1[k] = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 8 <= n;  i += 8) {
+        __m256d xx0 = _mm256_cvtps_pd(_mm_loadu_ps(x + i));
+        __m256d xx1 = _mm256_cvtps_pd(_mm_loadu_ps(x + i + 4));
+        for (size_t k = 0;  k < R;  ++k) {
+            __m256d yy0 = _mm256_cvtps_pd(_mm_loadu_ps(ys[k] + i));
+            __m256d yy1 = _mm256_cvtps_pd(_mm_loadu_ps(ys[k] + i + 4));
+            acc0[k] = _mm256_fmadd_pd(xx0, yy0, acc0[k]);
+            acc1[k] = _mm256_fmadd_pd(xx1, yy1, acc1[k]);
+        }
+    }
+
+    for (size_t k = 0;  k < R;  ++k) {
+        double res = horiz_sum(_mm256_add_pd(acc0[k], acc1[k]));
+        for (size_t j = i;  j < n;  ++j)
+            res += (double)x[j] * ys[k][j];
+        r[k] = res;
+    }
+}
+
+/** Squared euclidean distance of x to each of the R vectors in ys.  As
+    for the dot product, the result for a row doesn't depend upon R.
+*/
+template<size_t R>
+MLDB_ALWAYS_INLINE void
+euclid_rows(const float * x, const float * const * ys, size_t n,
+            double * r)
+{
+    __m256 acc0[R], acc1[R];
+    for (size_t k = 0;  k < R;  ++k)
+        acc0[k] = acc1[k] = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= n;  i += 16) {
+        __m256 xx0 = _mm256_loadu_ps(x + i);
+        __m256 xx1 = _mm256_loadu_ps(x + i + 8);
+        for (size_t k = 0;  k < R;  ++k) {
+            __m256 dd0 = _mm256_sub_ps(xx0, _mm256_loadu_ps(ys[k] + i));
+            __m256 dd1 = _mm256_sub_ps(xx1, _mm256_loadu_ps(ys[k] + i + 8));
+            acc0[k] = _mm256_fmadd_ps(dd0, dd0, acc0[k]);
+            acc1[k] = _mm256_fmadd_ps(dd1, dd1, acc1[k]);
+        }
+    }
+
+    for (; i + 8 <= n;  i += 8) {
+        __m256 xx0 = _mm256_loadu_ps(x + i);
+        for (size_t k = 0;  k < R;  ++k) {
+            __m256 dd0 = _mm256_sub_ps(xx0, _mm256_loadu_ps(ys[k] + i));
+            acc0[k] = _mm256_fmadd_ps(dd0, dd0, acc0[k]);
+        }
+    }
+
+    for (size_t k = 0;  k < R;  ++k) {
+        double res = horiz_sum(_mm256_add_ps(acc0[k], acc1[k]));
+        for (size_t j = i;  j < n;  ++j) {
+            float d = x[j] - ys[k][j];
+            res += d * d;
+        }
+        r[k] = res;
+    }
+}
+
+/** Operations on a register of floats or doubles, so that the
+    element-wise kernels can be written once for both.
+*/
+template<typename F> struct Reg;
+
+template<>
+struct Reg<float> {
+    typedef __m256 V;
+    static constexpr size_t N = 8;
+    static V load(const float * p) { return _mm256_loadu_ps(p); }
+    static void store(float * p, V v) { _mm256_storeu_ps(p, v); }
+    static V splat(float k) { return _mm256_set1_ps(k); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V max(V a, V b) { return _mm256_max_ps(a, b); }
+};
+
+template<>
+struct Reg<double> {
+    typedef __m256d V;
+    static constexpr size_t N = 4;
+    static V load(const double * p) { return _mm256_loadu_pd(p); }
+    static void store(double * p, V v) { _mm256_storeu_pd(p, v); }
+    static V splat(double k) { return _mm256_set1_pd(k); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V min(V a, V b) { return _mm256_min_pd(a, b); }
+    static V max(V a, V b) { return _mm256_max_pd(a, b); }
+};
+
+/** r[i] = op(x[i], y[i]), two registers at a time.  This file is compiled
+    without contraction of multiplies and adds into FMAs, so that these
+    give exactly the same results as the generic versions.
+*/
+template<typename F, typename VecOp, typename ScalarOp>
+MLDB_ALWAYS_INLINE void
+binary_op(const F * x, const F * y, F * r, size_t n,
+          VecOp vecOp, ScalarOp scalarOp)
+{
+    typedef Reg<F> R;
+    size_t i = 0;
+    for (; i + 2 * R::N <= n;  i += 2 * R::N) {
+        auto r0 = vecOp(R::load(x + i), R::load(y + i));
+        auto r1 = vecOp(R::load(x + i + R::N), R::load(y + i + R::N));
+        R::store(r + i, r0);
+        R::store(r + i + R::N, r1);
+    }
+    for (; i + R::N <= n;  i += R::N)
+        R::store(r + i, vecOp(R::load(x + i), R::load(y + i)));
+    for (; i < n;  ++i)
+        r[i] = scalarOp(x[i], y[i]);
+}
+
+/// r[i] = op(x[i]), two registers at a time
+template<typename F, typename VecOp, typename ScalarOp>
+MLDB_ALWAYS_INLINE void
+unary_op(const F * x, F * r, size_t n, VecOp vecOp, ScalarOp scalarOp)
+{
+    typedef Reg<F> R;
+    size_t i = 0;
+    for (; i + 2 * R::N <= n;  i += 2 * R::N) {
+        auto r0 = vecOp(R::load(x + i));
+        auto r1 = vecOp(R::load(x + i + R::N));
+        R::store(r + i, r0);
+        R::store(r + i + R::N, r1);
+    }
+    for (; i + R::N <= n;  i += R::N)
+        R::store(r + i, vecOp(R::load(x + i)));
+    for (; i < n;  ++i)
+        r[i] = scalarOp(x[i]);
+}
+
+// The minimum and maximum have the semantics of std::min and std::max:
+// when one of the two is a NaN, the first is returned.
+
+template<typename F>
+MLDB_ALWAYS_INLINE void
+min_op(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Reg<F> R;
+    binary_op(x, y, r, n,
+              [] (typename R::V a, typename R::V b) { return R::min(b, a); },
+              [] (F a, F b) { return b < a ? b : a; });
+}
+
+template<typename F>
+MLDB_ALWAYS_INLINE void
+max_op(const F * x, const F * y, F * r, size_t n)
+{
+    typedef Reg<F> R;
+    binary_op(x, y, r, n,
+              [] (typename R::V a, typename R::V b) { return R::max(b, a); },
+              [] (F a, F b) { return a < b ? b : a; });
+}
+
+template<typename F>
+MLDB_ALWAYS_INLINE void
+min_op(const F * x, F k, F * r, size_t n)
+{
+    typedef Reg<F> R;
+    auto kk = R::splat(k);
+    unary_op(x, r, n,
+             [=] (typename R::V a) { return R::min(kk, a); },
+             [=] (F a) { return k < a ? k : a; });
+}
+
+template<typename F>
+MLDB_ALWAYS_INLINE void
+max_op(const F * x, F k, F * r, size_t n)
+{
+    typedef Reg<F> R;
+    auto kk = R::splat(k);
+    unary_op(x, r, n,
+             [=] (typename R::V a) { return R::max(kk, a); },
+             [=] (F a) { return a < k ? k : a; });
+}
+
+/** exp(x) of four doubles, for x between -708 and 709.  The argument is
+    reduced to x = n log(2) + t with |t| <= log(2) / 2, and exp(t) is
+    calculated with its Taylor series (the error of the 13 terms is below
+    1e-17 over that range).
+*/
+inline __m256d exp_pd(__m256d x)
+{
+    const __m256d log2e = _mm256_set1_pd(1.4426950408889634074);
+    const __m256d ln2_hi = _mm256_set1_pd(6.93145751953125e-1);
+    const __m256d ln2_lo = _mm256_set1_pd(1.42860682030941723212e-6);
+
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, log2e),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d t = _mm256_fnmadd_pd(n, ln2_hi, x);
+    t = _mm256_fnmadd_pd(n, ln2_lo, t);
+
+    // 1/13! ... 1/1!, 1
+    static const double coeffs[14] = {
+        1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0,
+        1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+        1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0
+    };
+
+    __m256d p = _mm256_set1_pd(coeffs[0]);
+    for (unsigned i = 1;  i < 14;  ++i)
+        p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(coeffs[i]));
+
+    // Multiply by 2^n, which is built directly from its exponent bits
+    __m256i bits = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    bits = _mm256_add_epi64(bits, _mm256_set1_epi64x(1023));
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52)));
+}
+
+/** r = exp(k * x) for floats, calculated in double precision like the
+    generic version.  Blocks with an argument outside of the range where
+    the result is a normal float (or a NaN) are done one at a time with
+    exp() so that underflow, overflow and NaNs behave the same.
+*/
+inline void exp_ps(const float * x, float k, float * r, size_t n)
+{
+    const __m256d lo = _mm256_set1_pd(-87.0);
+    const __m256d hi = _mm256_set1_pd(88.0);
+
+    size_t i = 0;
+    for (; i + 4 <= n;  i += 4) {
+        // k * x is calculated in float precision as in the generic version
+        __m256d xx = _mm256_cvtps_pd(_mm_mul_ps(_mm_set1_ps(k),
+                                               _mm_loadu_ps(x + i)));
+        __m256d inRange = _mm256_and_pd(_mm256_cmp_pd(xx, lo, _CMP_GE_OQ),
+                                        _mm256_cmp_pd(xx, hi, _CMP_LE_OQ));
+        if (MLDB_UNLIKELY(_mm256_movemask_pd(inRange) != 15)) {
+            for (size_t j = i;  j < i + 4;  ++j)
+                r[j] = exp((double)(k * x[j]));
+            continue;
+        }
+        _mm_storeu_ps(r + i, _mm256_cvtpd_ps(exp_pd(xx)));
+    }
+
+    for (; i < n;  ++i)
+        r[i] = exp((double)(k * x[i]));
+}
+
+} // file scope
+
+void vec_scale(const float * x, float k, float * r, size_t n)
+{
+    typedef Reg<float> R;
+    auto kk = R::splat(k);
+    unary_op(x, r, n,
+             [=] (__m256 a) { return R::mul(kk, a); },
+             [=] (float a) { return k * a; });
+}
+
+void vec_scale(const double * x, double k, double * r, size_t n)
+{
+    typedef Reg<double> R;
+    auto kk = R::splat(k);
+    unary_op(x, r, n,
+             [=] (__m256d a) { return R::mul(kk, a); },
+             [=] (double a) { return k * a; });
+}
+
+void vec_add(const float * x, const float * y, float * r, size_t n)
+{
+    binary_op(x, y, r, n, Reg<float>::add,
+              [] (float a, float b) { return a + b; });
+}
+
+void vec_add(const double * x, const double * y, double * r, size_t n)
+{
+    binary_op(x, y, r, n, Reg<double>::add,
+              [] (double a, double b) { return a + b; });
+}
+
+void vec_add(const float * x, float k, const float * y, float * r, size_t n)
+{
+    typedef Reg<float> R;
+    auto kk = R::splat(k);
+    binary_op(x, y, r, n,
+              [=] (__m256 a, __m256 b) { return R::add(a, R::mul(kk, b)); },
+              [=] (float a, float b) { return a + k * b; });
+}
+
+void vec_add(const double * x, double k, const double * y, double * r,
+             size_t n)
+{
+    typedef Reg<double> R;
+    auto kk = R::splat(k);
+    binary_op(x, y, r, n,
+              [=] (__m256d a, __m256d b) { return R::add(a, R::mul(kk, b)); },
+              [=] (double a, double b) { return a + k * b; });
+}
+
+void vec_prod(const float * x, const float * y, float * r, size_t n)
+{
+    binary_op(x, y, r, n, Reg<float>::mul,
+              [] (float a, float b) { return a * b; });
+}
+
+void vec_prod(const double * x, const double * y, double * r, size_t n)
+{
+    binary_op(x, y, r, n, Reg<double>::mul,
+              [] (double a, double b) { return a * b; });
+}
+
+void vec_minus(const double * x, const double * y, double * r, size_t n)
+{
+    binary_op(x, y, r, n, Reg<double>::sub,
+              [] (double a, double b) { return a - b; });
+}
+
+void vec_min(const float * x, const float * y, float * r, size_t n)
+{
+    min_op(x, y, r, n);
+}
+
+void vec_min(const float * x, float y, float * r, size_t n)
+{
+    min_op(x, y, r, n);
+}
+
+void vec_min(const double * x, const double * y, double * r, size_t n)
+{
+    min_op(x, y, r, n);
+}
+
+void vec_min(const double * x, double y, double * r, size_t n)
+{
+    min_op(x, y, r, n);
+}
+
+void vec_max(const float * x, const float * y, float * r, size_t n)
+{
+    max_op(x, y, r, n);
+}
+
+void vec_max(const float * x, float y, float * r, size_t n)
+{
+    max_op(x, y, r, n);
+}
+
+void vec_max(const double * x, const double * y, double * r, size_t n)
+{
+    max_op(x, y, r, n);
+}
+
+void vec_max(const double * x, double y, double * r, size_t n)
+{
+    max_op(x, y, r, n);
+}
+
+double vec_sum(const double * x, size_t n)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n;  i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(x + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(x + i + 4));
+    }
+    double result = horiz_sum(_mm256_add_pd(acc0, acc1));
+    for (; i < n;  ++i)
+        result += x[i];
+    return result;
+}
+
+double vec_sum_dp(const float * x, size_t n)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n;  i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm_loadu_ps(x + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm_loadu_ps(x + i + 4)));
+    }
+    double result = horiz_sum(_mm256_add_pd(acc0, acc1));
+    for (; i < n;  ++i)
+        result += x[i];
+    return result;
+}
+
+void vec_exp(const float * x, float * r, size_t n)
+{
+    exp_ps(x, 1.0f, r, n);
+}
+
+void vec_exp(const float * x, float k, float * r, size_t n)
+{
+    exp_ps(x, k, r, n);
+}
+
+void vec_float_to_half(const float * x, uint16_t * r, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n;  i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(x + i),
+                                    _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(r + i), h);
+    }
+    if (i < n) {
+        float in[8] = { 0 };
+        uint16_t out[8];
+        std::copy(x + i, x + n, in);
+        _mm_storeu_si128((__m128i *)out,
+                         _mm256_cvtps_ph(_mm256_loadu_ps(in),
+                                         _MM_FROUND_TO_NEAREST_INT));
+        std::copy(out, out + (n - i), r + i);
+    }
+}
+
+void vec_half_to_float(const uint16_t * x, float * r, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n;  i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(x + i));
+        _mm256_storeu_ps(r + i, _mm256_cvtph_ps(h));
+    }
+    if (i < n) {
+        uint16_t in[8] = { 0 };
+        float out[8];
+        std::copy(x + i, x + n, in);
+        _mm256_storeu_ps(out, _mm256_cvtph_ps
+                         (_mm_loadu_si128((const __m128i *)in)));
+        std::copy(out, out + (n - i), r + i);
+    }
+}
+
+void vec_scale(const int8_t * x, float k, float * r, size_t n)
+{
+    __m256 kk = _mm256_set1_ps(k);
+    size_t i = 0;
+    for (; i + 8 <= n;  i += 8) {
+        __m128i b = _mm_loadl_epi64((const __m128i *)(x + i));
+        __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+        _mm256_storeu_ps(r + i, _mm256_mul_ps(kk, f));
+    }
+    for (; i < n;  ++i)
+        r[i] = k * x[i];
+}
+
+double vec_dotprod_dp(const float * x, const float * y, size_t n)
+{
+    double result;
+    dotprod_dp_rows<1>(x, &y, n, &result);
+    return result;
+}
+
+double vec_euclid(const float * x, const float * y, size_t n)
+{
+    double result;
+    euclid_rows<1>(x, &y, n, &result);
+    return result;
+}
+
+void vec_dotprod_dp_batch(const float * x, const float * const * ys,
+                          size_t nrows, size_t n, double * r)
+{
+    size_t i = 0;
+    for (; i + BATCH_ROWS <= nrows;  i += BATCH_ROWS)
+        dotprod_dp_rows<BATCH_ROWS>(x, ys + i, n, r + i);
+    for (; i < nrows;  ++i)
+        dotprod_dp_rows<1>(x, ys + i, n, r + i);
+}
+
+void vec_euclid_batch(const float * x, const float * const * ys,
+                      size_t nrows, size_t n, double * r)
+{
+    size_t i = 0;
+    for (; i + BATCH_ROWS <= nrows;  i += BATCH_ROWS)
+        euclid_rows<BATCH_ROWS>(x, ys + i, n, r + i);
+    for (; i < nrows;  ++i)
+        euclid_rows<1>(x, ys + i, n, r + i);
+}
+
+} // namespace Avx2
+} // namespace SIMD
+} // namespace MLDB
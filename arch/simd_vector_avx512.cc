@@ -0,0 +1,158 @@
+/** simd_vector_avx512.cc
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX-512 specializations.  This file must be
+    compiled with -mavx512f, and the functions only called once the CPU
+    has been checked for support.
+*/
+
+#include "simd_vector_avx.h"
+#include "mldb/compiler/compiler.h"
+#include <immintrin.h>
+
+namespace MLDB {
+namespace SIMD {
+namespace Avx512 {
+
+namespace {
+
+/// Number of rows processed together by the batch functions
+constexpr size_t BATCH_ROWS = 4;
+
+inline double horiz_sum(__m512d v)
+{
+    double results[8];
+    _mm512_storeu_pd(results, v);
+    return ((results[0] + results[1]) + (results[2] + results[3]))
+        + ((results[4] + results[5]) + (results[6] + results[7]));
+}
+
+inline double horiz_sum(__m512 v)
+{
+    float results[16];
+    _mm512_storeu_ps(results, v);
+    double result = 0.0;
+    for (unsigned i = 0;  i < 16;  ++i)
+        result += results[i];
+    return result;
+}
+
+/** Dot product of x with each of the R vectors in ys.  The result for
+    each row is independent of R; see simd_vector_avx2.cc.
+*/
+template<size_t R>
+MLDB_ALWAYS_INLINE void
+dotprod_dp_rows(const float * x, const float * const * ys, size_t n,
+                double * r)
+{
+    __m512d acc0[R], acc1[R];
+    for (size_t k = 0;  k < R;  ++k)
+        acc0[k] = acc1[k] = _mm512_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 16 <= n;  i += 16) {
+        __m512d xx0 = _mm512_cvtps_pd(_mm256_loadu_ps(x + i));
+        __m512d xx1 = _mm512_cvtps_pd(_mm256_loadu_ps(x + i + 8));
+        for (size_t k = 0;  k < R;  ++k) {
+            __m512d yy0 = _mm512_cvtps_pd(_mm256_loadu_ps(ys[k] + i));
+            __m512d yy1 = _mm512_cvtps_pd(_mm256_loadu_ps(ys[k] + i + 8));
+            acc0[k] = _mm512_fmadd_pd(xx0, yy0, acc0[k]);
+            acc1[k] = _mm512_fmadd_pd(xx1, yy1, acc1[k]);
+        }
+    }
+
+    for (; i + 8 <= n;  i += 8) {
+        __m512d xx0 = _mm512_cvtps_pd(_mm256_loadu_ps(x + i));
+        for (size_t k = 0;  k < R;  ++k) {
+            __m512d yy0 = _mm512_cvtps_pd(_mm256_loadu_ps(ys[k] + i));
+            acc0[k] = _mm512_fmadd_pd(xx0, yy0, acc0[k]);
+        }
+    }
+
+    for (size_t k = 0;  k < R;  ++k) {
+        double res = horiz_sum(_mm512_add_pd(acc0[k], acc1[k]));
+        for (size_t j = i;  j < n;  ++j)
+            res += (double)x[j] * ys[k][j];
+        r[k] = res;
+    }
+}
+
+/** Squared euclidean distance of x to each of the R vectors in ys. */
+template<size_t R>
+MLDB_ALWAYS_INLINE void
+euclid_rows(const float * x, const float * const * ys, size_t n,
+            double * r)
+{
+    __m512 acc0[R], acc1[R];
+    for (size_t k = 0;  k < R;  ++k)
+        acc0[k] = acc1[k] = _mm512_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 32 <= n;  i += 32) {
+        __m512 xx0 = _mm512_loadu_ps(x + i);
+        __m512 xx1 = _mm512_loadu_ps(x + i + 16);
+        for (size_t k = 0;  k < R;  ++k) {
+            __m512 dd0 = _mm512_sub_ps(xx0, _mm512_loadu_ps(ys[k] + i));
+            __m512 dd1 = _mm512_sub_ps(xx1, _mm512_loadu_ps(ys[k] + i + 16));
+            acc0[k] = _mm512_fmadd_ps(dd0, dd0, acc0[k]);
+            acc1[k] = _mm512_fmadd_ps(dd1, dd1, acc1[k]);
+        }
+    }
+
+    // The tail is done with a masked load rather than a scalar loop
+    while (i < n) {
+        size_t todo = n - i < 16 ? n - i : 16;
+        __mmask16 mask = (__mmask16)((1U << todo) - 1);
+        __m512 xx0 = _mm512_maskz_loadu_ps(mask, x + i);
+        for (size_t k = 0;  k < R;  ++k) {
+            __m512 dd0 = _mm512_sub_ps
+                (xx0, _mm512_maskz_loadu_ps(mask, ys[k] + i));
+            acc0[k] = _mm512_fmadd_ps(dd0, dd0, acc0[k]);
+        }
+        i += todo;
+    }
+
+    for (size_t k = 0;  k < R;  ++k)
+        r[k] = horiz_sum(_mm512_add_ps(acc0[k], acc1[k]));
+}
+
+} // file scope
+
+double vec_dotprod_dp(const float * x, const float * y, size_t n)
+{
+    double result;
+    dotprod_dp_rows<1>(x, &y, n, &result);
+    return result;
+}
+
+double vec_euclid(const float * x, const float * y, size_t n)
+{
+    double result;
+    euclid_rows<1>(x, &y, n, &result);
+    return result;
+}
+
+void vec_dotprod_dp_batch(const float * x, const float * const * ys,
+                          size_t nrows, size_t n, double * r)
+{
+    size_t i = 0;
+    for (; i + BATCH_ROWS <= nrows;  i += BATCH_ROWS)
+        dotprod_dp_rows<BATCH_ROWS>(x, ys + i, n, r + i);
+    for (; i < nrows;  ++i)
+        dotprod_dp_rows<1>(x, ys + i, n, r + i);
+}
+
+void vec_euclid_batch(const float * x, const float * const * ys,
+                      size_t nrows, size_t n, double * r)
+{
+    size_t i = 0;
+    for (; i + BATCH_ROWS <= nrows;  i += BATCH_ROWS)
+        euclid_rows<BATCH_ROWS>(x, ys + i, n, r + i);
+    for (; i < nrows;  ++i)
+        euclid_rows<1>(x, ys + i, n, r + i);
+}
+
+} // namespace Avx512
+} // namespace SIMD
+} // namespace MLDB
@@ -357,3 +357,116 @@ BOOST_AUTO_TEST_CASE ( test_defer_race )
 }
 
 #endif
+
+
+/*****************************************************************************/
+/* EPOCH MODE                                                                */
+/*****************************************************************************/
+
+struct EpochGcLock : public GcLock {
+    EpochGcLock()
+        : GcLock(GC_EPOCH)
+    {
+    }
+};
+
+BOOST_AUTO_TEST_CASE ( test_gc_epoch )
+{
+    EpochGcLock gc;
+
+    gc.lockShared();
+
+    BOOST_CHECK(gc.isLockedShared());
+    BOOST_CHECK(gc.isLockedByAnyThread());
+
+    std::atomic<int> deferred(false);
+
+    gc.defer([&] () { deferred = true; });
+
+    // Can't be run while we're still in the critical section
+    BOOST_CHECK(!deferred);
+
+    gc.unlockShared();
+
+    BOOST_CHECK(!gc.isLockedShared());
+    BOOST_CHECK(!gc.isLockedByAnyThread());
+    BOOST_CHECK(deferred);
+}
+
+BOOST_AUTO_TEST_CASE ( test_gc_epoch_batched_defer )
+{
+    EpochGcLock gc;
+
+    std::atomic<int> numRun(0);
+
+    // With nothing in a critical section, deferred work is run a batch at
+    // a time
+    for (unsigned i = 0;  i < 1000;  ++i)
+        gc.defer([&] () { numRun += 1; });
+
+    BOOST_CHECK_GT(numRun, 0);
+
+    gc.deferBarrier();
+
+    BOOST_CHECK_EQUAL(numRun, 1000);
+}
+
+BOOST_AUTO_TEST_CASE ( test_gc_epoch_exclusion )
+{
+    EpochGcLock lock;
+    std::atomic<bool> finished(false);
+    std::atomic<int> numExclusive(0);
+    std::atomic<int> numShared(0);
+    std::atomic<int> errors(0);
+
+    auto sharedThread = [&] ()
+        {
+            while (!finished) {
+                GcLock::SharedGuard guard(lock);
+                numShared += 1;
+                if (numExclusive > 0)
+                    errors += 1;
+                numShared -= 1;
+            }
+        };
+
+    auto exclusiveThread = [&] ()
+        {
+            while (!finished) {
+                GcLock::ExclusiveGuard guard(lock);
+                numExclusive += 1;
+                if (numExclusive > 1 || numShared > 0)
+                    errors += 1;
+                numExclusive -= 1;
+            }
+        };
+
+    ThreadGroup tg;
+    for (unsigned i = 0;  i < 4;  ++i)
+        tg.create_thread(sharedThread);
+    for (unsigned i = 0;  i < 2;  ++i)
+        tg.create_thread(exclusiveThread);
+    sleep(1);
+    finished = true;
+    tg.join_all();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE ( test_gc_epoch_sync_many_threads )
+{
+    cerr << "testing synchronized epoch GcLock with many threads" << endl;
+
+    TestBase<EpochGcLock> test(8, 2);
+    test.run(std::bind(&TestBase<EpochGcLock>::allocThreadSync, &test,
+                       std::placeholders::_1));
+}
+
+BOOST_AUTO_TEST_CASE ( test_gc_epoch_deferred_contention )
+{
+    cerr << "testing contended deferred epoch GcLock" << endl;
+
+    TestBase<EpochGcLock> test(8, 2);
+    test.run(std::bind(&TestBase<EpochGcLock>::allocThreadDefer, &test,
+                       std::placeholders::_1));
+}
@@ -21,6 +21,8 @@
 #include <set>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <functional>
 
 
 using namespace MLDB;
@@ -896,3 +898,196 @@ BOOST_AUTO_TEST_CASE( vec_min_max_el_test )
     }
 }
 
+
+void vec_distance_batch_test_case(int nvals, int nrows)
+{
+    cerr << "testing distance batches with " << nvals << " values and "
+         << nrows << " rows" << endl;
+
+    float x[nvals];
+    std::vector<std::vector<float> > rows(nrows, std::vector<float>(nvals));
+    std::vector<const float *> ptrs;
+
+    for (unsigned i = 0; i < nvals;  ++i)
+        x[i] = rand() / 16384.0 / 65536.0 - 0.5;
+    for (auto & r: rows) {
+        for (auto & v: r)
+            v = rand() / 16384.0 / 65536.0 - 0.5;
+        ptrs.push_back(r.data());
+    }
+
+    double dots[nrows], euclids[nrows];
+    SIMD::vec_dotprod_dp_batch(x, ptrs.data(), nrows, nvals, dots);
+    SIMD::vec_euclid_batch(x, ptrs.data(), nrows, nvals, euclids);
+
+    for (unsigned i = 0;  i < nrows;  ++i) {
+        double dot = 0.0, euclid = 0.0;
+        for (unsigned j = 0;  j < nvals;  ++j) {
+            dot += (double)x[j] * rows[i][j];
+            euclid += (double)(x[j] - rows[i][j]) * (x[j] - rows[i][j]);
+        }
+
+        // Must be exactly the same as the single versions
+        BOOST_CHECK_EQUAL(dots[i], SIMD::vec_dotprod_dp(x, ptrs[i], nvals));
+        BOOST_CHECK_EQUAL(euclids[i], SIMD::vec_euclid(x, ptrs[i], nvals));
+
+        BOOST_CHECK_SMALL(dots[i] - dot, 1e-6);
+        BOOST_CHECK_SMALL(euclids[i] - euclid, 1e-4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vec_distance_batch_test )
+{
+#if MLDB_INTEL_ISA
+    cerr << "avx2 " << has_avx2() << " fma " << has_fma()
+         << " avx512f " << has_avx512f() << endl;
+#endif
+
+    for (auto x : {1, 2, 7, 8, 9, 15, 16, 17, 31, 32, 33, 123, 300}) {
+        for (auto r : {1, 3, 4, 5, 9})
+            vec_distance_batch_test_case(x, r);
+    }
+}
+
+template<typename T>
+void vec_elementwise_test_case(int nvals)
+{
+    cerr << "testing element-wise operations " << demangle(typeid(T).name())
+         << " with " << nvals << endl;
+
+    T x[nvals], y[nvals], r[nvals];
+    T k = 0.37;
+
+    for (unsigned i = 0; i < nvals;  ++i) {
+        x[i] = rand() / 16384.0 / 65536.0 - 0.5;
+        y[i] = rand() / 16384.0 / 65536.0 - 0.5;
+    }
+    if (nvals > 3)
+        x[3] = NAN;
+
+    // These must be exactly the same as the scalar versions
+    auto check = [&] (const char * what, std::function<T (int)> expected)
+        {
+            for (unsigned i = 0;  i < nvals;  ++i) {
+                T e = expected(i);
+                if (memcmp(&r[i], &e, sizeof(T)) != 0) {
+                    cerr << what << " element " << i << ": " << r[i]
+                         << " != " << e << endl;
+                    BOOST_CHECK_EQUAL(r[i], e);
+                }
+            }
+        };
+
+    SIMD::vec_scale(x, k, r, nvals);
+    check("scale", [&] (int i) -> T { return k * x[i]; });
+    SIMD::vec_add(x, y, r, nvals);
+    check("add", [&] (int i) -> T { return x[i] + y[i]; });
+    SIMD::vec_add(x, k, y, r, nvals);
+    check("add k", [&] (int i) -> T { return x[i] + k * y[i]; });
+    SIMD::vec_prod(x, y, r, nvals);
+    check("prod", [&] (int i) -> T { return x[i] * y[i]; });
+    SIMD::vec_minus(x, y, r, nvals);
+    check("minus", [&] (int i) -> T { return x[i] - y[i]; });
+    SIMD::vec_min(x, y, r, nvals);
+    check("min", [&] (int i) -> T { return std::min(x[i], y[i]); });
+    SIMD::vec_min(y, x, r, nvals);
+    check("min nan", [&] (int i) -> T { return std::min(y[i], x[i]); });
+    SIMD::vec_max(x, y, r, nvals);
+    check("max", [&] (int i) -> T { return std::max(x[i], y[i]); });
+    SIMD::vec_min(x, k, r, nvals);
+    check("min k", [&] (int i) -> T { return std::min(x[i], k); });
+    SIMD::vec_max(x, k, r, nvals);
+    check("max k", [&] (int i) -> T { return std::max(x[i], k); });
+}
+
+BOOST_AUTO_TEST_CASE( vec_elementwise_test )
+{
+    for (auto x : {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 123}) {
+        vec_elementwise_test_case<float>(x);
+        vec_elementwise_test_case<double>(x);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vec_exp_ulp_test )
+{
+    // Within one unit in the last place of exp() in double precision, and
+    // the same for values that overflow, underflow or are NaN
+    int nvals = 10000;
+    float x[nvals], r[nvals];
+    for (unsigned i = 0;  i < nvals;  ++i)
+        x[i] = (rand() / 16384.0 / 65536.0 - 0.5) * 220.0;
+    x[0] = NAN;  x[1] = INFINITY;  x[2] = -INFINITY;  x[3] = 0.0;
+
+    SIMD::vec_exp(x, r, nvals);
+
+    int numDifferent = 0;
+    for (unsigned i = 0;  i < nvals;  ++i) {
+        float expected = exp((double)x[i]);
+        if (std::isnan(expected)) {
+            BOOST_CHECK(std::isnan(r[i]));
+            continue;
+        }
+        if (r[i] == expected)
+            continue;
+        ++numDifferent;
+        BOOST_CHECK(r[i] == nextafterf(expected, INFINITY)
+                    || r[i] == nextafterf(expected, -INFINITY));
+    }
+
+    BOOST_CHECK_LT(numDifferent, nvals / 1000);
+}
+
+BOOST_AUTO_TEST_CASE( vec_half_test )
+{
+    // Every half converts to a float and back to itself
+    vector<uint16_t> halves(65536), back(65536);
+    vector<float> floats(65536);
+    for (unsigned i = 0;  i < 65536;  ++i)
+        halves[i] = i;
+    SIMD::vec_half_to_float(halves.data(), floats.data(), 65536);
+    SIMD::vec_float_to_half(floats.data(), back.data(), 65536);
+
+    for (unsigned i = 0;  i < 65536;  ++i) {
+        if (std::isnan(floats[i])) {
+            BOOST_CHECK_EQUAL(back[i] & 0x7e00, 0x7e00);
+            continue;
+        }
+        if (back[i] != halves[i])
+            BOOST_CHECK_EQUAL(back[i], halves[i]);
+    }
+
+    BOOST_CHECK_EQUAL(floats[0x3c00], 1.0f);
+    BOOST_CHECK_EQUAL(floats[0xc000], -2.0f);
+    BOOST_CHECK_EQUAL(floats[0x0001], 1.0f / 16777216);
+    BOOST_CHECK_EQUAL(floats[0x7bff], 65504.0f);
+    BOOST_CHECK_EQUAL(floats[0x7c00], INFINITY);
+
+    // Floats round to the nearest half, and to even on a tie, for all sizes
+    // of values as well as the odd numbers of values that aren't a multiple
+    // of the vector width
+    float x[] = { 1.0f + 1.0f / 2048, 1.0f + 3.0f / 2048, 65519.0f, 65520.0f,
+                  1e10f, -1e-10f, 1.0f / 33554432, 3.0f / 33554432,
+                  0.333333f, -0.1f, 1000.3f };
+    uint16_t expected[] = { 0x3c00, 0x3c02, 0x7bff, 0x7c00, 0x7c00,
+                            0x8000, 0x0000, 0x0002, 0x3555, 0xae66, 0x63d1 };
+    for (unsigned n = 1;  n <= 11;  ++n) {
+        uint16_t r[11];
+        SIMD::vec_float_to_half(x, r, n);
+        for (unsigned i = 0;  i < n;  ++i)
+            BOOST_CHECK_EQUAL(r[i], expected[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vec_scale_int8_test )
+{
+    int8_t x[123];
+    float r[123];
+    for (unsigned i = 0;  i < 123;  ++i)
+        x[i] = (int)i * 37 % 255 - 127;
+
+    for (unsigned n: { 1, 7, 8, 9, 123 }) {
+        SIMD::vec_scale(x, 0.25f, r, n);
+        for (unsigned i = 0;  i < n;  ++i)
+            BOOST_CHECK_EQUAL(r[i], x[i] * 0.25f);
+    }
+}
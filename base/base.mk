@@ -5,7 +5,13 @@ LIBBASE_SOURCES := \
         parse_context.cc \
 	thread_pool.cc \
 	parallel.cc \
-	optimized_path.cc
+	cancellation.cc \
+	memory_account.cc \
+	storage_allocator.cc \
+	metrics.cc \
+	trace_events.cc \
+	optimized_path.cc \
+	fast_float_parsing.cc
 
 LIBBASE_LINK :=	arch gc
 
@@ -0,0 +1,203 @@
+/** cancellation.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Cooperative cancellation and deadlines.
+*/
+
+#include "cancellation.h"
+#include <chrono>
+#include <limits>
+
+
+namespace MLDB {
+
+namespace {
+
+thread_local const CancellationToken * currentToken = nullptr;
+
+constexpr int64_t NO_DEADLINE = std::numeric_limits<int64_t>::max();
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* CANCELLATION EXCEPTION                                                    */
+/*****************************************************************************/
+
+CancellationException::
+CancellationException(const std::string & message)
+    : message(message)
+{
+}
+
+CancellationException::
+~CancellationException() throw()
+{
+}
+
+const char *
+CancellationException::
+what() const throw()
+{
+    return message.c_str();
+}
+
+
+/*****************************************************************************/
+/* DEADLINE EXCEEDED EXCEPTION                                               */
+/*****************************************************************************/
+
+DeadlineExceededException::
+DeadlineExceededException(const std::string & message)
+    : CancellationException(message)
+{
+}
+
+
+/*****************************************************************************/
+/* CANCELLATION TOKEN                                                        */
+/*****************************************************************************/
+
+CancellationToken::
+CancellationToken(const CancellationToken * parent)
+    : parent_(parent), state_(ACTIVE), deadline_(NO_DEADLINE),
+      pollInterval_(0), nextPoll_(0)
+{
+}
+
+void
+CancellationToken::
+cancel()
+{
+    int expected = ACTIVE;
+    state_.compare_exchange_strong(expected, CANCELLED);
+}
+
+void
+CancellationToken::
+setTimeout(double seconds)
+{
+    deadline_ = nowNs() + (int64_t)(seconds * 1000000000.0);
+}
+
+void
+CancellationToken::
+setPoll(std::function<bool ()> stillWanted, double pollInterval)
+{
+    stillWanted_ = std::move(stillWanted);
+    pollInterval_ = pollInterval * 1000000000.0;
+}
+
+CancellationToken::State
+CancellationToken::
+getState() const
+{
+    int state = state_.load(std::memory_order_relaxed);
+    if (state != ACTIVE)
+        return (State)state;
+
+    if (parent_) {
+        State parentState = parent_->getState();
+        if (parentState != ACTIVE)
+            return parentState;
+    }
+
+    int64_t deadline = deadline_.load(std::memory_order_relaxed);
+    if (deadline == NO_DEADLINE && !stillWanted_)
+        return ACTIVE;
+
+    // Past here, we need to look at the clock
+    int64_t now = nowNs();
+    if (now >= deadline) {
+        int expected = ACTIVE;
+        state_.compare_exchange_strong(expected, EXPIRED);
+        return (State)state_.load();
+    }
+
+    if (stillWanted_) {
+        // Only one thread gets to poll in each interval
+        int64_t nextPoll = nextPoll_.load(std::memory_order_relaxed);
+        if (now >= nextPoll
+            && nextPoll_.compare_exchange_strong(nextPoll,
+                                                 now + pollInterval_)
+            && !stillWanted_()) {
+            int expected = ACTIVE;
+            state_.compare_exchange_strong(expected, CANCELLED);
+            return (State)state_.load();
+        }
+    }
+
+    return ACTIVE;
+}
+
+bool
+CancellationToken::
+isCancelled() const
+{
+    return getState() != ACTIVE;
+}
+
+void
+CancellationToken::
+check() const
+{
+    switch (getState()) {
+    case ACTIVE:
+        return;
+    case CANCELLED:
+        throw CancellationException("Operation was cancelled");
+    case EXPIRED:
+        throw DeadlineExceededException("Operation exceeded its deadline");
+    }
+}
+
+const CancellationToken * currentCancellationToken()
+{
+    return currentToken;
+}
+
+bool isCancelled()
+{
+    return currentToken && currentToken->isCancelled();
+}
+
+void checkCancelled()
+{
+    if (currentToken)
+        currentToken->check();
+}
+
+
+/*****************************************************************************/
+/* CANCELLATION SCOPE                                                        */
+/*****************************************************************************/
+
+CancellationScope::
+CancellationScope(const CancellationToken * token)
+    : previous(currentToken)
+{
+    if (token)
+        currentToken = token;
+}
+
+CancellationScope::
+CancellationScope(std::shared_ptr<const CancellationToken> token)
+    : owned(std::move(token)), previous(currentToken)
+{
+    if (owned)
+        currentToken = owned.get();
+}
+
+CancellationScope::
+~CancellationScope()
+{
+    currentToken = previous;
+}
+
+} // namespace MLDB
@@ -0,0 +1,151 @@
+/** cancellation.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Cooperative cancellation and deadlines for long running work.
+
+    A CancellationToken is made current for a thread with a
+    CancellationScope.  Code doing a lot of work calls checkCancelled()
+    every so often, which costs a thread local load when there is no
+    token.  parallelMap() and friends pass the token on to the threads
+    that they run work on, and check it before each job.
+*/
+
+#pragma once
+
+#include "mldb/arch/exception.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* CANCELLATION EXCEPTION                                                    */
+/*****************************************************************************/
+
+/** Exception thrown when work is abandoned because it was cancelled. */
+
+struct CancellationException: public SilentException {
+
+    CancellationException(const std::string & message);
+
+    ~CancellationException() throw();
+
+    virtual const char * what() const throw();
+
+private:
+    std::string message;
+};
+
+
+/*****************************************************************************/
+/* DEADLINE EXCEEDED EXCEPTION                                               */
+/*****************************************************************************/
+
+/** Exception thrown when work is abandoned because its deadline passed. */
+
+struct DeadlineExceededException: public CancellationException {
+    DeadlineExceededException(const std::string & message);
+};
+
+
+/*****************************************************************************/
+/* CANCELLATION TOKEN                                                        */
+/*****************************************************************************/
+
+/** Tells work that it's no longer wanted, because it was cancelled, its
+    deadline passed, its poll function said so or its parent was
+    cancelled.  It may be checked from any number of threads at once.
+*/
+
+struct CancellationToken {
+
+    /** Create a token.  If parent is given, the token is also cancelled
+        when the parent is; the parent must outlive it.
+    */
+    CancellationToken(const CancellationToken * parent = nullptr);
+
+    CancellationToken(const CancellationToken &) = delete;
+    void operator = (const CancellationToken &) = delete;
+
+    /// Cancel the work
+    void cancel();
+
+    /// Cancel the work once the given number of seconds has passed
+    void setTimeout(double seconds);
+
+    /** Set a function to be called from time to time (at most once every
+        pollInterval seconds) while the token is checked, which returns
+        false once the work is no longer wanted; for example when the
+        client that asked for it has disconnected.  It must be set before
+        the token is shared with other threads.
+    */
+    void setPoll(std::function<bool ()> stillWanted,
+                 double pollInterval = 0.01);
+
+    /// Is the work still wanted?
+    bool isCancelled() const;
+
+    /** Throw a CancellationException if the token is cancelled, or a
+        DeadlineExceededException if its deadline has passed.
+    */
+    void check() const;
+
+private:
+    enum State {
+        ACTIVE,
+        CANCELLED,
+        EXPIRED
+    };
+
+    State getState() const;
+
+    const CancellationToken * parent_;
+    mutable std::atomic<int> state_;
+    std::atomic<int64_t> deadline_;      ///< Steady clock nanoseconds
+    std::function<bool ()> stillWanted_;
+    int64_t pollInterval_;
+    mutable std::atomic<int64_t> nextPoll_;
+};
+
+/** Return the cancellation token of the current thread, or null if there
+    is none.
+*/
+const CancellationToken * currentCancellationToken();
+
+/// Is the work on the current thread no longer wanted?
+bool isCancelled();
+
+/** Throw if the work on the current thread is no longer wanted (see
+    CancellationToken::check()).
+*/
+void checkCancelled();
+
+
+/*****************************************************************************/
+/* CANCELLATION SCOPE                                                        */
+/*****************************************************************************/
+
+/** Makes the given token the current one for the thread while the object
+    exists.  A null token leaves the current one as it is.
+*/
+
+struct CancellationScope {
+    explicit CancellationScope(const CancellationToken * token);
+
+    /// Same as above, but also keeps the token alive
+    explicit CancellationScope(std::shared_ptr<const CancellationToken> token);
+
+    ~CancellationScope();
+
+    CancellationScope(const CancellationScope &) = delete;
+    void operator = (const CancellationScope &) = delete;
+
+private:
+    std::shared_ptr<const CancellationToken> owned;
+    const CancellationToken * previous;
+};
+
+} // namespace MLDB
@@ -1,85 +1,127 @@
 /* fast_float_parsing.h                                            -*- C++ -*-
    Jeremy Barnes, 25 February 2005
    Copyright (c) 2005 Jeremy Barnes.  All rights reserved.
-   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.   
+   This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
    Fast inline float parsing routines.
+
+   The decimal digits are converted to binary with the algorithm of
+   Eisel and Lemire ("Number Parsing at a Gigabyte per Second", 2021),
+   which is correctly rounded like strtod() but doesn't need a copy of the
+   text.  The rare inputs that it can't decide on go through strtod().
 */
 
 #pragma once
 
 #include "mldb/base/parse_context.h"
 #include <limits>
+#include <cstdint>
 #include <errno.h>
 
 namespace MLDB {
 
-double binary_exp10 [10] = {
-    10,
-    100,
-    1e4,
-    1e8,
-    1e16,
-    1e32,
-    1e64,
-    1e128,
-    1e256,
-    INFINITY
-};
 
-double binary_exp10_neg [10] = {
-    0.1,
-    0.01,
-    1e-4,
-    1e-8,
-    1e-16,
-    1e-32,
-    1e-64,
-    1e-128,
-    1e-256,
-    0.0
-};
+/*****************************************************************************/
+/* DECIMAL NUMBER                                                            */
+/*****************************************************************************/
 
-double
-exp10_int(int val)
-{
-    double result = 1.0;
-
-    if (val >= 0) {
-        for (unsigned i = 0;  val;  ++i) {
-            if (i >= 9)
-                return INFINITY;
-            if (val & 1)
-                result *= binary_exp10[i];
-            val >>= 1;
+/** A number in decimal, as mantissa * 10^exponent, built up one digit at a
+    time.  Only the first 19 significant digits are kept, which is all that
+    fits in the mantissa; truncated says that one of the ones after that
+    wasn't a zero.
+*/
+
+struct DecimalNumber {
+    uint64_t mantissa = 0;
+    int64_t exponent = 0;
+    int numDigits = 0;        ///< Significant digits in the mantissa
+    bool negative = false;
+    bool truncated = false;
+
+    static constexpr int MAX_DIGITS = 19;
+
+    void addIntegerDigit(int digit)
+    {
+        if (numDigits < MAX_DIGITS) {
+            if (mantissa || digit) {
+                mantissa = mantissa * 10 + digit;
+                ++numDigits;
+            }
+        }
+        else {
+            truncated = truncated || digit;
+            ++exponent;
         }
     }
-    else {
-        val = -val;
-        for (unsigned i = 0;  val;  ++i) {
-            if (i >= 9)
-                return 0.0;
-            if (val & 1)
-                result *= binary_exp10_neg[i];
-            val >>= 1;
+
+    void addFractionDigit(int digit)
+    {
+        if (numDigits < MAX_DIGITS) {
+            if (mantissa || digit) {
+                mantissa = mantissa * 10 + digit;
+                ++numDigits;
+            }
+            --exponent;
         }
+        else truncated = truncated || digit;
     }
 
-    return result;
+    /// Add the exponent written after the 'e'
+    void addExponent(int64_t exp10)
+    {
+        exponent += exp10;
+    }
+};
+
+/** Convert to the nearest double.  Returns false in the rare cases where
+    that can't be decided from the digits kept, in which case the text
+    needs to go through strtod().
+*/
+bool decimalToDouble(const DecimalNumber & number, double & result);
+
+/** Convert to the nearest float, rounding only once.  Returns false as for
+    decimalToDouble().
+*/
+bool decimalToFloat(const DecimalNumber & number, float & result);
+
+inline bool decimalToFloat(const DecimalNumber & number, double & result)
+{
+    return decimalToDouble(number, result);
 }
 
+/** Parse a decimal number from the characters between start and end, with
+    the syntax of strtod() except for leading whitespace, hexadecimal,
+    infinities and NaNs: an optional sign, digits with an optional decimal
+    point, and an optional exponent.  Returns a pointer to the character
+    after the number, or nullptr (and leaves result alone) if there is no
+    number there.  isInteger is set to whether the number has neither a
+    decimal point nor an exponent.
+
+    The result is correctly rounded.  The text doesn't need to be null
+    terminated, and nothing is allocated except for numbers with hundreds
+    of digits.
+*/
+const char * parseDecimalDouble(const char * start, const char * end,
+                                double & result, bool * isInteger = nullptr);
+
+/// Same as parseDecimalDouble(), but for a float
+const char * parseDecimalFloat(const char * start, const char * end,
+                               float & result, bool * isInteger = nullptr);
+
+
 /* Floating point parsing is not so easy...
    We assume that the parse context will be at the beginning of the float decimal
-   representation, that is, there is no attempt to trim whitespaces.  The parsing 
+   representation, that is, there is no attempt to trim whitespaces.  The parsing
    will stop at the last character matching a float decimal representation irrespective
    of the following characters (e.g. 1.0e-100somegargagehere will parse as
    1.0e-100).
 
    If lenient is set to false, the function will not accept integers.
 
-   The user is responsible for setting the locale before this function is called;
-   its output is undefined if the system locale is set to anything other than
-   LC_NUMERIC=C.
+   The digits are converted as they are read; the text is also kept for
+   NaN, infinity and the few numbers that have to go through strtod(),
+   whose output is undefined if the system locale is set to anything other
+   than LC_NUMERIC=C.
 */
 
 template<typename Float>
@@ -93,17 +135,21 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
     char buf[256];
     size_t from = c.get_offset();
     bool some_digits = true;
+    bool special = false;
+    DecimalNumber number;
 
     // sign
     if (*c == '+' || *c == '-') {
         buf[0] = *c;
+        number.negative = *c == '-';
         ++c;
     }
 
     if (c.eof()) return false;
-    
+
     // special cases NaN and Inf
     if (*c == 'n' || *c == 'N') {
+        special = true;
         buf[c.get_offset() - from] = 'N';
         ++c;
         if (!c.eof() && (*c == 'a' || *c == 'A')) {
@@ -115,6 +161,7 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
             } else return false;
         } else return false;
     } else if (!c.eof() && (*c == 'i' || *c == 'I')) {
+        special = true;
         buf[c.get_offset() - from] = 'I';
         ++c;
         if (!c.eof() && (*c == 'n' || *c == 'N')) {
@@ -131,12 +178,13 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
             for (; c.get_offset() - from < 255 && !c.eof() && isdigit(*c); c++) {
                 some_digits = true;
                 buf[c.get_offset() - from] = *c;
+                number.addIntegerDigit(*c - '0');
             }
         }
         else return false;
-        
+
         bool is_a_float = false;
-        
+
         // . and more digit
         if (!c.eof() && *c == '.') {
             buf[c.get_offset() - from] = '.';
@@ -145,11 +193,12 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
             if (isdigit(*c)) {
                 for(; c.get_offset() - from < 255 && !c.eof() && isdigit(*c); c++) {
                     buf[c.get_offset() - from] = *c;
+                    number.addFractionDigit(*c - '0');
                     is_a_float = true;
                 }
             }
             else return false;
-        } 
+        }
 
         // exponential marker
         if (!c.eof() && (*c == 'e' || *c == 'E')) {
@@ -157,15 +206,22 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
             ParseContext::Revert_Token token(c);
             buf[c.get_offset() - from] = 'e';
             ++c;
-        
+
+            bool negativeExponent = false;
             if (!c.eof() && (*c == '+' || *c == '-')) {
                 buf[c.get_offset() - from] = *c;
+                negativeExponent = *c == '-';
                 ++c;
             }
 
             if (isdigit(*c)) {
-                for(; c.get_offset() - from < 255 && !c.eof() && isdigit(*c); c++)
+                int64_t exp10 = 0;
+                for(; c.get_offset() - from < 255 && !c.eof() && isdigit(*c); c++) {
                     buf[c.get_offset() - from] = *c;
+                    if (exp10 < 100000)
+                        exp10 = exp10 * 10 + (*c - '0');
+                }
+                number.addExponent(negativeExponent ? -exp10 : exp10);
                 token.ignore();
                 is_a_float = true;
             }
@@ -175,13 +231,21 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
         if (!is_a_float && !lenient)
             return false;
     }
-    
+
+    // The usual case: no need for the text
+    if (!special && decimalToFloat(number, result)) {
+        tok.ignore();
+        return true;
+    }
+
     buf[c.get_offset() - from] = 0;
     char * endptr = nullptr;
     //const char* previous = setlocale(LC_NUMERIC, "C");
-    double parsed = strtod(buf, &endptr);
+    // strtof() for a float, so that it's only rounded once
+    Float parsed = sizeof(Float) == sizeof(float)
+        ? strtof(buf, &endptr) : strtod(buf, &endptr);
     //setlocale(LC_NUMERIC, previous);
-    
+
     if (!endptr && !parsed)
         return false;
 
@@ -190,7 +254,7 @@ inline bool match_float(Float & result, ParseContext & c, bool lenient = true)
 
     tok.ignore();
     result = parsed;
-    return true;        
+    return true;
 }
 
 template<typename Float>
@@ -10,6 +10,8 @@
 
 #include "mldb/base/parse_context.h"
 #include <iostream>
+#include <cstdint>
+#include <cstring>
 
 
 using namespace std;
@@ -186,5 +188,66 @@ inline bool match_long_long(long long int & result, ParseContext & c)
     return true;
 }
 
+
+/*****************************************************************************/
+/* EIGHT DIGITS AT A TIME                                                    */
+/*****************************************************************************/
+
+/* Long runs of digits go faster when eight of them are loaded into a
+   64 bit word and checked and converted together, rather than looking at
+   them one by one.
+*/
+
+/// Load eight characters into a word, with the first in the low byte
+inline uint64_t loadEightBytes(const char * p)
+{
+    uint64_t result;
+    std::memcpy(&result, p, sizeof(result));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    result = __builtin_bswap64(result);
+#endif
+    return result;
+}
+
+/// Are all eight characters loaded by loadEightBytes() digits?
+inline bool isEightDigits(uint64_t val)
+{
+    return (((val & 0xF0F0F0F0F0F0F0F0)
+             | (((val + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+            == 0x3333333333333333);
+}
+
+/// Value of eight digits loaded by loadEightBytes(), from 0 to 99999999
+inline uint32_t parseEightDigits(uint64_t val)
+{
+    const uint64_t mask = 0x000000FF000000FF;
+    const uint64_t mul1 = 0x000F424000000064; // 100 + (1000000ULL << 32)
+    const uint64_t mul2 = 0x0000271000000001; // 1 + (10000ULL << 32)
+    val -= 0x3030303030303030;
+    val = (val * 10) + (val >> 8);
+    val = (((val & mask) * mul1) + (((val >> 16) & mask) * mul2)) >> 32;
+    return uint32_t(val);
+}
+
+/** Parse the unsigned decimal number between start and end, eight digits at
+    a time when there are that many.  Returns a pointer to the first
+    character that isn't a digit; overflow isn't detected.
+*/
+inline const char * parseDecimalDigits(const char * start, const char * end,
+                                       uint64_t & val)
+{
+    const char * p = start;
+    while (end - p >= 8) {
+        uint64_t word = loadEightBytes(p);
+        if (!isEightDigits(word))
+            break;
+        val = val * 100000000 + parseEightDigits(word);
+        p += 8;
+    }
+    for (;  p < end && *p >= '0' && *p <= '9';  ++p)
+        val = val * 10 + (*p - '0');
+    return p;
+}
+
 } // namespace MLDB
 
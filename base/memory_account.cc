@@ -0,0 +1,273 @@
+/** memory_account.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Accounting of the memory used by a query or procedure run.
+*/
+
+#include "memory_account.h"
+#include "mldb/base/metrics.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+
+
+namespace MLDB {
+
+namespace {
+
+thread_local MemoryAccount * currentMemoryAccount = nullptr;
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Existing accounts, by order of creation.  Never destroyed, as accounts
+/// may outlive static destruction.
+struct Accounts {
+    std::mutex mutex;
+    uint64_t nextSerial = 0;
+    std::map<uint64_t, const MemoryAccount *> accounts;
+};
+
+Accounts & accounts()
+{
+    static Accounts * result = new Accounts();
+    return *result;
+}
+
+std::string formatBytes(uint64_t bytes)
+{
+    return std::to_string(bytes / 1000000) + "MB";
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MEMORY BUDGET EXCEEDED EXCEPTION                                          */
+/*****************************************************************************/
+
+MemoryBudgetExceededException::
+MemoryBudgetExceededException(const std::string & message)
+    : CancellationException(message)
+{
+}
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT                                                            */
+/*****************************************************************************/
+
+MemoryAccount::
+MemoryAccount(std::string description,
+              uint64_t budget,
+              MemoryAccount * parent)
+    : description_(std::move(description)),
+      budget_(budget),
+      parent_(parent),
+      bytesUsed_(0),
+      peakBytes_(0),
+      startNs_(nowNs())
+{
+    Accounts & all = accounts();
+    std::unique_lock<std::mutex> guard(all.mutex);
+    serial_ = all.nextSerial++;
+    all.accounts[serial_] = this;
+}
+
+MemoryAccount::
+~MemoryAccount()
+{
+    {
+        Accounts & all = accounts();
+        std::unique_lock<std::mutex> guard(all.mutex);
+        all.accounts.erase(serial_);
+    }
+
+    // Anything that wasn't released is no longer held by the parent
+    uint64_t remaining = bytesUsed_.load();
+    if (parent_ && remaining)
+        parent_->release(remaining);
+}
+
+uint64_t
+MemoryAccount::
+chargeOne(uint64_t bytes)
+{
+    return bytesUsed_.fetch_add(bytes) + bytes;
+}
+
+void
+MemoryAccount::
+notePeak(uint64_t used)
+{
+    uint64_t peak = peakBytes_.load();
+    while (used > peak && !peakBytes_.compare_exchange_weak(peak, used))
+        ;
+}
+
+bool
+MemoryAccount::
+tryCharge(uint64_t bytes)
+{
+    bool withinBudget = true;
+    for (MemoryAccount * a = this;  a;  a = a->parent_) {
+        uint64_t used = a->chargeOne(bytes);
+        a->notePeak(used);
+        withinBudget = withinBudget && (a->budget_ == 0 || used <= a->budget_);
+    }
+    return withinBudget;
+}
+
+void
+MemoryAccount::
+charge(uint64_t bytes)
+{
+    // The peak is only updated once we know that the charge is kept
+    const MemoryAccount * exceeded = nullptr;
+    uint64_t exceededUsed = 0;
+    for (MemoryAccount * a = this;  a;  a = a->parent_) {
+        uint64_t used = a->chargeOne(bytes);
+        if (!exceeded && a->budget_ != 0 && used > a->budget_) {
+            exceeded = a;
+            exceededUsed = used - bytes;
+        }
+    }
+
+    if (!exceeded) {
+        for (MemoryAccount * a = this;  a;  a = a->parent_)
+            a->notePeak(a->bytesUsed());
+        return;
+    }
+
+    release(bytes);
+
+    static MetricCounter & numExceeded
+        = Metrics::counter("mldb_memory_budget_exceeded_total",
+                           "Number of times that a query or procedure was "
+                           "stopped for going over its memory budget");
+    numExceeded.add();
+
+    throw MemoryBudgetExceededException
+        ("Memory budget of " + formatBytes(exceeded->budget_)
+         + " exceeded by " + exceeded->description_
+         + ", which was using " + formatBytes(exceededUsed)
+         + " and needed " + formatBytes(bytes) + " more");
+}
+
+void
+MemoryAccount::
+release(uint64_t bytes)
+{
+    for (MemoryAccount * a = this;  a;  a = a->parent_)
+        a->bytesUsed_.fetch_sub(bytes);
+}
+
+double
+MemoryAccount::
+secondsRunning() const
+{
+    return (nowNs() - startNs_) / 1000000000.0;
+}
+
+std::vector<MemoryAccount::Info>
+MemoryAccount::
+running()
+{
+    Accounts & all = accounts();
+    std::unique_lock<std::mutex> guard(all.mutex);
+
+    std::vector<Info> result;
+    for (auto & a: all.accounts) {
+        const MemoryAccount & account = *a.second;
+        result.push_back({ account.description_, account.bytesUsed(),
+                           account.peakBytes(), account.budget_,
+                           account.secondsRunning() });
+    }
+    return result;
+}
+
+MemoryAccount *
+MemoryAccount::
+currentAccount()
+{
+    return currentMemoryAccount;
+}
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT SCOPE                                                      */
+/*****************************************************************************/
+
+MemoryAccountScope::
+MemoryAccountScope(MemoryAccount * account)
+    : previous(currentMemoryAccount)
+{
+    if (account)
+        currentMemoryAccount = account;
+}
+
+MemoryAccountScope::
+~MemoryAccountScope()
+{
+    currentMemoryAccount = previous;
+}
+
+
+/*****************************************************************************/
+/* MEMORY RESERVATION                                                        */
+/*****************************************************************************/
+
+MemoryReservation::
+MemoryReservation()
+    : account_(currentMemoryAccount), bytes_(0)
+{
+}
+
+MemoryReservation::
+~MemoryReservation()
+{
+    if (account_)
+        account_->release(bytes_.load());
+}
+
+void
+MemoryReservation::
+add(uint64_t bytes)
+{
+    if (account_)
+        account_->charge(bytes);
+    bytes_.fetch_add(bytes);
+}
+
+void
+MemoryReservation::
+resize(uint64_t bytes)
+{
+    uint64_t old = bytes_.load();
+    if (bytes > old)
+        add(bytes - old);
+    else if (bytes < old) {
+        if (account_)
+            account_->release(old - bytes);
+        bytes_.store(bytes);
+    }
+}
+
+bool
+MemoryReservation::
+tryResize(uint64_t bytes)
+{
+    uint64_t old = bytes_.exchange(bytes);
+    if (!account_)
+        return true;
+    if (bytes < old) {
+        account_->release(old - bytes);
+        return account_->tryCharge(0);
+    }
+    return account_->tryCharge(bytes - old);
+}
+
+} // namespace MLDB
@@ -0,0 +1,188 @@
+/** memory_account.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Accounting of the memory used by a query or procedure run, with an
+    optional budget.
+
+    A MemoryAccount is made current for a thread with a MemoryAccountScope,
+    the same way as a cancellation token, and parallelMap() and friends
+    pass it on to the threads that they run work on.  The parts of the
+    engine that hold a lot of data at once (sorts, GROUP BY, hash joins)
+    charge the current account for what they keep, via a MemoryReservation,
+    and release it when they are done.  The amounts are estimates of the
+    data held, not a count of every allocation.
+
+    Once an account would go over its budget, the charge throws a
+    MemoryBudgetExceededException, which cancels the work cleanly instead
+    of letting the process run out of memory.  Work that can spill to disk
+    instead checks with tryResize().
+*/
+
+#pragma once
+
+#include "mldb/base/cancellation.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MEMORY BUDGET EXCEEDED EXCEPTION                                          */
+/*****************************************************************************/
+
+/** Exception thrown when work is abandoned because it needed more memory
+    than its budget allows.
+*/
+
+struct MemoryBudgetExceededException: public CancellationException {
+    MemoryBudgetExceededException(const std::string & message);
+};
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT                                                            */
+/*****************************************************************************/
+
+/** Memory used by a piece of work such as a query.  Charges to an account
+    are also charged to its parent, so that the queries run by a procedure
+    count against the budget of the procedure.  It may be charged from any
+    number of threads at once.
+
+    Accounts are listed by running() for as long as they exist.
+*/
+
+struct MemoryAccount {
+
+    /** Create an account, described for example as "query SELECT ...".  A
+        budget of zero means no limit.  The parent, which defaults to the
+        current account of the thread, must outlive it.
+    */
+    MemoryAccount(std::string description,
+                  uint64_t budget = 0,
+                  MemoryAccount * parent = currentAccount());
+
+    ~MemoryAccount();
+
+    MemoryAccount(const MemoryAccount &) = delete;
+    void operator = (const MemoryAccount &) = delete;
+
+    /** Charge the given number of bytes.  If that takes this account or one
+        of its parents over budget, the charge is undone and a
+        MemoryBudgetExceededException is thrown.
+    */
+    void charge(uint64_t bytes);
+
+    /** Charge the given number of bytes, returning false instead of
+        throwing if that takes this account or a parent over budget.  The
+        bytes are charged either way.
+    */
+    bool tryCharge(uint64_t bytes);
+
+    /// Release bytes that were previously charged
+    void release(uint64_t bytes);
+
+    const std::string & description() const { return description_; }
+    uint64_t budget() const { return budget_; }
+    uint64_t bytesUsed() const { return bytesUsed_.load(); }
+    uint64_t peakBytes() const { return peakBytes_.load(); }
+
+    /// Number of seconds since the account was created
+    double secondsRunning() const;
+
+    /// State of an account, as listed by running()
+    struct Info {
+        std::string description;
+        uint64_t bytesUsed;
+        uint64_t peakBytes;
+        uint64_t budget;
+        double secondsRunning;
+    };
+
+    /// Return all existing accounts, oldest first
+    static std::vector<Info> running();
+
+    /// Return the current account of the thread, or null
+    static MemoryAccount * currentAccount();
+
+private:
+    /// Charge only this account, returning the bytes that it now uses
+    uint64_t chargeOne(uint64_t bytes);
+
+    /// Record that the account used the given number of bytes
+    void notePeak(uint64_t used);
+
+    std::string description_;
+    uint64_t budget_;
+    MemoryAccount * parent_;
+    std::atomic<uint64_t> bytesUsed_;
+    std::atomic<uint64_t> peakBytes_;
+    int64_t startNs_;
+    uint64_t serial_;   ///< Order of creation, for running()
+};
+
+
+/*****************************************************************************/
+/* MEMORY ACCOUNT SCOPE                                                      */
+/*****************************************************************************/
+
+/** Makes the given account the current one for the thread while the object
+    exists.  A null account leaves the current one as it is.
+*/
+
+struct MemoryAccountScope {
+    explicit MemoryAccountScope(MemoryAccount * account);
+    ~MemoryAccountScope();
+
+    MemoryAccountScope(const MemoryAccountScope &) = delete;
+    void operator = (const MemoryAccountScope &) = delete;
+
+private:
+    MemoryAccount * previous;
+};
+
+
+/*****************************************************************************/
+/* MEMORY RESERVATION                                                        */
+/*****************************************************************************/
+
+/** Memory held by one part of a piece of work, charged to the account
+    that was current when it was created (if any) and released when it's
+    destroyed.  It may be added to from any number of threads at once.
+    With no current account it only keeps count, which costs an atomic
+    add.
+*/
+
+struct MemoryReservation {
+    MemoryReservation();
+    ~MemoryReservation();
+
+    MemoryReservation(const MemoryReservation &) = delete;
+    void operator = (const MemoryReservation &) = delete;
+
+    /** Add the given number of bytes, throwing a
+        MemoryBudgetExceededException if that goes over budget.
+    */
+    void add(uint64_t bytes);
+
+    /** Set the number of bytes held, throwing if that goes over budget.
+        Unlike add(), this is for reservations updated by one thread.
+    */
+    void resize(uint64_t bytes);
+
+    /** Set the number of bytes held, returning false instead of throwing
+        if that goes over budget; for work that can then spill some of its
+        memory and try again.  Also for use by one thread.
+    */
+    bool tryResize(uint64_t bytes);
+
+    uint64_t bytes() const { return bytes_.load(); }
+
+private:
+    MemoryAccount * account_;
+    std::atomic<uint64_t> bytes_;
+};
+
+} // namespace MLDB
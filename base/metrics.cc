@@ -0,0 +1,358 @@
+/** metrics.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Counters and histograms of what the engine is doing.
+*/
+
+#include "metrics.h"
+#include "mldb/arch/exception.h"
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+
+
+namespace MLDB {
+
+__thread int currentMetricSlot = -1;
+
+int chooseMetricSlot()
+{
+    static std::atomic<int> nextSlot(0);
+    currentMetricSlot = nextSlot.fetch_add(1) % METRIC_SLOTS;
+    return currentMetricSlot;
+}
+
+namespace {
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Bounds of the exported histogram buckets, as powers of two of ns
+constexpr int MIN_EXPORTED_EXPONENT = 10;  // about a microsecond
+constexpr int MAX_EXPORTED_EXPONENT = 36;  // about a minute
+
+std::string formatValue(double value)
+{
+    if (std::isnan(value))
+        return "NaN";
+    if (std::isinf(value))
+        return value > 0 ? "+Inf" : "-Inf";
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    return buf;
+}
+
+std::string escapeLabelValue(const std::string & value)
+{
+    std::string result;
+    for (char c: value) {
+        if (c == '\\')
+            result += "\\\\";
+        else if (c == '"')
+            result += "\\\"";
+        else if (c == '\n')
+            result += "\\n";
+        else result += c;
+    }
+    return result;
+}
+
+/** Print labels as {name="value",...}, with extra ones (such as the bucket
+    of a histogram) at the end.
+*/
+std::string formatLabels(const MetricLabels & labels,
+                         const MetricLabels & extra = {})
+{
+    if (labels.empty() && extra.empty())
+        return std::string();
+    std::string result = "{";
+    bool first = true;
+    for (auto * ls: { &labels, &extra }) {
+        for (auto & l: *ls) {
+            if (!first)
+                result += ',';
+            first = false;
+            result += l.first + "=\"" + escapeLabelValue(l.second) + "\"";
+        }
+    }
+    result += '}';
+    return result;
+}
+
+enum MetricType {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+};
+
+const char * typeName(MetricType type)
+{
+    switch (type) {
+    case COUNTER:   return "counter";
+    case GAUGE:     return "gauge";
+    case HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+
+struct Entry {
+    MetricLabels labels;
+    std::unique_ptr<MetricCounter> counter;
+    std::unique_ptr<MetricHistogram> histogram;
+    std::function<double ()> callback;
+};
+
+struct Family {
+    std::string help;
+    MetricType type;
+    std::map<std::string, Entry> entries;  ///< Keyed by printed labels
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, Family> families;
+
+    /// Return the entry for the metric, creating it if needed.  The lock
+    /// must be held.
+    Entry & getEntry(const std::string & name,
+                     const std::string & help,
+                     MetricType type,
+                     const MetricLabels & labels)
+    {
+        auto it = families.find(name);
+        if (it == families.end()) {
+            it = families.emplace(name, Family()).first;
+            it->second.help = help;
+            it->second.type = type;
+        }
+        else if (it->second.type != type) {
+            throw Exception("Metric " + name + " is already registered as a "
+                            + typeName(it->second.type));
+        }
+        Entry & entry = it->second.entries[formatLabels(labels)];
+        entry.labels = labels;
+        return entry;
+    }
+};
+
+/// Never destroyed, as metrics may be updated until the program exits
+Registry & registry()
+{
+    static Registry * result = new Registry();
+    return *result;
+}
+
+/** Handle returned by addCallback(), which removes the metric. */
+struct CallbackRegistration {
+    std::string name;
+    std::string labels;
+
+    ~CallbackRegistration()
+    {
+        Registry & reg = registry();
+        std::unique_lock<std::mutex> guard(reg.mutex);
+        auto it = reg.families.find(name);
+        if (it == reg.families.end())
+            return;
+        it->second.entries.erase(labels);
+        if (it->second.entries.empty())
+            reg.families.erase(it);
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* METRIC COUNTER                                                            */
+/*****************************************************************************/
+
+MetricCounter::
+MetricCounter()
+{
+    for (auto & s: slots)
+        s.value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t
+MetricCounter::
+value() const
+{
+    uint64_t result = 0;
+    for (auto & s: slots)
+        result += s.value.load(std::memory_order_relaxed);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* METRIC HISTOGRAM                                                          */
+/*****************************************************************************/
+
+MetricHistogram::
+MetricHistogram()
+    : slots(new Slot[METRIC_SLOTS])
+{
+    for (int i = 0;  i < METRIC_SLOTS;  ++i) {
+        for (auto & b: slots[i].buckets)
+            b.store(0, std::memory_order_relaxed);
+        slots[i].sumNs.store(0, std::memory_order_relaxed);
+    }
+}
+
+MetricHistogram::Snapshot
+MetricHistogram::
+snapshot() const
+{
+    uint64_t buckets[NUM_BUCKETS] = { 0 };
+    uint64_t sumNs = 0;
+    for (int i = 0;  i < METRIC_SLOTS;  ++i) {
+        for (int j = 0;  j < NUM_BUCKETS;  ++j)
+            buckets[j] += slots[i].buckets[j].load(std::memory_order_relaxed);
+        sumNs += slots[i].sumNs.load(std::memory_order_relaxed);
+    }
+
+    // The buckets with a given exponent hold exactly the values between
+    // two powers of two, so the counts below each power of two are exact
+    Snapshot result;
+    uint64_t below = 0;
+    int bucket = 0;
+    for (int e = MIN_EXPORTED_EXPONENT;  e <= MAX_EXPORTED_EXPONENT;  ++e) {
+        for (;  bucket < (e << SUB_BUCKET_BITS);  ++bucket)
+            below += buckets[bucket];
+        result.cumulative.emplace_back(std::ldexp(1.0, e) / 1000000000.0,
+                                       below);
+    }
+    for (int j = 0;  j < NUM_BUCKETS;  ++j)
+        result.count += buckets[j];
+    result.sum = sumNs / 1000000000.0;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* METRICS                                                                   */
+/*****************************************************************************/
+
+MetricCounter &
+Metrics::
+counter(const std::string & name,
+        const std::string & help,
+        const MetricLabels & labels)
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.mutex);
+    Entry & entry = reg.getEntry(name, help, COUNTER, labels);
+    if (entry.callback)
+        throw Exception("Metric " + name + " is read from a callback");
+    if (!entry.counter)
+        entry.counter.reset(new MetricCounter());
+    return *entry.counter;
+}
+
+MetricHistogram &
+Metrics::
+histogram(const std::string & name,
+          const std::string & help,
+          const MetricLabels & labels)
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.mutex);
+    Entry & entry = reg.getEntry(name, help, HISTOGRAM, labels);
+    if (!entry.histogram)
+        entry.histogram.reset(new MetricHistogram());
+    return *entry.histogram;
+}
+
+std::shared_ptr<void>
+Metrics::
+addCallback(const std::string & name,
+            const std::string & help,
+            std::function<double ()> getValue,
+            const MetricLabels & labels,
+            bool isCounter)
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.mutex);
+    Entry & entry = reg.getEntry(name, help, isCounter ? COUNTER : GAUGE,
+                                 labels);
+    if (entry.counter || entry.callback)
+        throw Exception("Metric " + name + formatLabels(labels)
+                        + " is already registered");
+    entry.callback = std::move(getValue);
+
+    auto result = std::make_shared<CallbackRegistration>();
+    result->name = name;
+    result->labels = formatLabels(labels);
+    return result;
+}
+
+std::string
+Metrics::
+prometheusText()
+{
+    Registry & reg = registry();
+    std::unique_lock<std::mutex> guard(reg.mutex);
+
+    std::string result;
+    for (auto & f: reg.families) {
+        const std::string & name = f.first;
+        const Family & family = f.second;
+        result += "# HELP " + name + " " + family.help + "\n";
+        result += "# TYPE " + name + " " + typeName(family.type) + "\n";
+
+        for (auto & e: family.entries) {
+            const Entry & entry = e.second;
+            if (entry.histogram) {
+                auto snapshot = entry.histogram->snapshot();
+                for (auto & b: snapshot.cumulative) {
+                    result += name + "_bucket"
+                        + formatLabels(entry.labels,
+                                       {{"le", formatValue(b.first)}})
+                        + " " + std::to_string(b.second) + "\n";
+                }
+                result += name + "_bucket"
+                    + formatLabels(entry.labels, {{"le", "+Inf"}})
+                    + " " + std::to_string(snapshot.count) + "\n";
+                result += name + "_sum" + e.first + " "
+                    + formatValue(snapshot.sum) + "\n";
+                result += name + "_count" + e.first + " "
+                    + std::to_string(snapshot.count) + "\n";
+            }
+            else if (entry.counter) {
+                result += name + e.first + " "
+                    + std::to_string(entry.counter->value()) + "\n";
+            }
+            else if (entry.callback) {
+                result += name + e.first + " "
+                    + formatValue(entry.callback()) + "\n";
+            }
+        }
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* METRIC TIMER                                                              */
+/*****************************************************************************/
+
+MetricTimer::
+MetricTimer(MetricHistogram & histogram)
+    : histogram(histogram), startNs(nowNs())
+{
+}
+
+MetricTimer::
+~MetricTimer()
+{
+    histogram.record((nowNs() - startNs) / 1000000000.0);
+}
+
+} // namespace MLDB
@@ -0,0 +1,200 @@
+/** metrics.h                                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Counters and histograms of what the engine is doing, exported in the
+    Prometheus text format.
+
+    Metrics are registered once by name, typically into a function-level
+    static, and then updated from hot paths.  Updating one costs a relaxed
+    atomic add into a cache line chosen by the calling thread, so that
+    threads counting at the same time don't contend; the slots are only
+    summed when the metrics are read.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MLDB {
+
+/// Labels of a metric, for example {{"scheme", "s3"}}
+typedef std::vector<std::pair<std::string, std::string> > MetricLabels;
+
+/// Number of slots that the updates of a metric are spread over
+constexpr int METRIC_SLOTS = 16;
+
+/// Slot of the calling thread, or -1 until it has been chosen
+extern __thread int currentMetricSlot;
+
+/// Choose the slot of the calling thread
+int chooseMetricSlot();
+
+/** Return the slot that the calling thread updates metrics in. */
+inline int metricSlot()
+{
+    int slot = currentMetricSlot;
+    if (slot < 0)
+        slot = chooseMetricSlot();
+    return slot;
+}
+
+
+/*****************************************************************************/
+/* METRIC COUNTER                                                            */
+/*****************************************************************************/
+
+/** Counter that only goes up. */
+
+struct MetricCounter {
+    MetricCounter();
+
+    void add(uint64_t n = 1)
+    {
+        slots[metricSlot()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /// Total added over all threads
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value;
+    };
+
+    Slot slots[METRIC_SLOTS];
+};
+
+
+/*****************************************************************************/
+/* METRIC HISTOGRAM                                                          */
+/*****************************************************************************/
+
+/** Histogram of durations.  Like an HDR histogram, its buckets are spaced
+    logarithmically with linear sub-buckets, so that a value is kept to
+    within 25% over the whole range from nanoseconds to hours while
+    recording is just an index computation and an add.
+*/
+
+struct MetricHistogram {
+    MetricHistogram();
+
+    /// Record a duration in seconds
+    void record(double seconds)
+    {
+        uint64_t ns = seconds > 0 ? uint64_t(seconds * 1000000000.0) : 0;
+        Slot & slot = slots[metricSlot()];
+        slot.buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        slot.sumNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /** Sum over threads of the histogram: the number of recorded values
+        below each of the bounds, in seconds, then the total number and sum
+        of the values.
+    */
+    struct Snapshot {
+        std::vector<std::pair<double, uint64_t> > cumulative;
+        uint64_t count = 0;
+        double sum = 0;
+    };
+
+    /** Return the histogram summed over threads, with cumulative counts
+        at each power of two of nanoseconds from one microsecond to about a
+        minute.
+    */
+    Snapshot snapshot() const;
+
+    static constexpr int SUB_BUCKET_BITS = 2;
+    static constexpr int NUM_BUCKETS = 64 << SUB_BUCKET_BITS;
+
+    /** Bucket for a value: the position of its highest bit, then the next
+        SUB_BUCKET_BITS bits below it.
+    */
+    static int bucketFor(uint64_t ns)
+    {
+        if (ns < (1 << SUB_BUCKET_BITS))
+            return ns;
+        int exponent = 63 - __builtin_clzll(ns);
+        int sub = (ns >> (exponent - SUB_BUCKET_BITS))
+            & ((1 << SUB_BUCKET_BITS) - 1);
+        return (exponent << SUB_BUCKET_BITS) + sub;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> buckets[NUM_BUCKETS];
+        std::atomic<uint64_t> sumNs;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+};
+
+
+/*****************************************************************************/
+/* METRICS                                                                   */
+/*****************************************************************************/
+
+/** Registry of all of the metrics of the process. */
+
+struct Metrics {
+
+    /** Return the counter with the given name and labels, creating it if
+        needed.  The counter lives until the program exits, so the
+        reference can be kept, which avoids the lookup on the hot path.
+        By Prometheus convention, the name of a counter ends in _total.
+    */
+    static MetricCounter & counter(const std::string & name,
+                                   const std::string & help,
+                                   const MetricLabels & labels = {});
+
+    /** Return the histogram with the given name and labels, creating it
+        if needed.  It lives until the program exits.  By convention, the
+        name ends in _seconds.
+    */
+    static MetricHistogram & histogram(const std::string & name,
+                                       const std::string & help,
+                                       const MetricLabels & labels = {});
+
+    /** Add a metric whose value is read by calling a function, for values
+        that are already kept elsewhere.  A gauge can go up and down; with
+        isCounter the value is a count that only goes up.  It is removed
+        when the returned handle is destroyed.
+    */
+    static std::shared_ptr<void>
+    addCallback(const std::string & name,
+                const std::string & help,
+                std::function<double ()> getValue,
+                const MetricLabels & labels = {},
+                bool isCounter = false);
+
+    /** Return all metrics in the Prometheus text exposition format. */
+    static std::string prometheusText();
+};
+
+
+/*****************************************************************************/
+/* METRIC TIMER                                                              */
+/*****************************************************************************/
+
+/** Records the time between its construction and destruction into a
+    histogram.
+*/
+
+struct MetricTimer {
+    MetricTimer(MetricHistogram & histogram);
+    ~MetricTimer();
+
+    MetricTimer(const MetricTimer &) = delete;
+    void operator = (const MetricTimer &) = delete;
+
+private:
+    MetricHistogram & histogram;
+    int64_t startNs;
+};
+
+} // namespace MLDB
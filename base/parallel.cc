@@ -9,11 +9,24 @@
 #include "mldb/compiler/compiler.h"
 #include "mldb/base/exc_assert.h"
 #include "thread_pool.h"
+#include "mldb/arch/cpu_info.h"
+#include "cancellation.h"
+#include "memory_account.h"
+#include "trace_events.h"
 #include <atomic>
 #include <mutex>
+#include <vector>
+#include <memory>
 
 namespace MLDB {
 
+size_t parallelGrainSize(size_t n, size_t minGrain)
+{
+    // About eight jobs per CPU gives work stealing enough to balance
+    size_t numJobs = std::max<size_t>(1, numCpus() * 8);
+    size_t grain = (n + numJobs - 1) / numJobs;
+    return std::max<size_t>(std::max<size_t>(grain, minGrain), 1);
+}
 
 void parallelMap(size_t first, size_t last,
                  const std::function<void (size_t)> & doWork,
@@ -35,13 +48,23 @@ void parallelMap(size_t first, size_t last,
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
+    // The jobs run on other threads are cancelled along with this one,
+    // and charge their memory to the same account
+    const CancellationToken * token = currentCancellationToken();
+    MemoryAccount * account = MemoryAccount::currentAccount();
+
     auto worker = [&] ()
         {
+            CancellationScope scope(token);
+            MemoryAccountScope accountScope(account);
             while (!hasException.load(std::memory_order_relaxed)) {
                 size_t myindex = index.fetch_add(1);
                 if (myindex >= last)
                     return;
                 try {
+                    if (token)
+                        token->check();
+                    TraceSpan span("parallel", "parallelMap job");
                     doWork(myindex);
                 } MLDB_CATCH_ALL {
                     if (hasException.fetch_add(1) == 0) {
@@ -87,14 +110,24 @@ bool parallelMapHaltable(size_t first, size_t last,
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
+    // The jobs run on other threads are cancelled along with this one,
+    // and charge their memory to the same account
+    const CancellationToken * token = currentCancellationToken();
+    MemoryAccount * account = MemoryAccount::currentAccount();
+
     auto worker = [&] ()
         {
+            CancellationScope scope(token);
+            MemoryAccountScope accountScope(account);
             while (!stop.load(std::memory_order_relaxed)
                    && !hasException.load(std::memory_order_relaxed)) {
                 size_t myindex = index.fetch_add(1);
                 if (myindex >= last)
                     return;
                 try {
+                    if (token)
+                        token->check();
+                    TraceSpan span("parallel", "parallelMapHaltable job");
                     if (!doWork(myindex)) {
                         stop = true;
                         return;
@@ -147,14 +180,24 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
     if (occupancyLimit > (last - first + chunkSize - 1) / chunkSize)
         occupancyLimit = (last - first + chunkSize - 1) / chunkSize;
 
+    // The jobs run on other threads are cancelled along with this one,
+    // and charge their memory to the same account
+    const CancellationToken * token = currentCancellationToken();
+    MemoryAccount * account = MemoryAccount::currentAccount();
+
     auto worker = [&] ()
         {
+            CancellationScope scope(token);
+            MemoryAccountScope accountScope(account);
             while (!hasException.load(std::memory_order_relaxed)) {
                 size_t myindex = index.fetch_add(chunkSize);
                 if (myindex >= last)
                     return;
                 size_t indexEnd = std::min(last, myindex + chunkSize);
                 try {
+                    if (token)
+                        token->check();
+                    TraceSpan span("parallel", "parallelMapChunked job");
                     doWork(myindex, indexEnd);
                 } MLDB_CATCH_ALL {
                     if (hasException.fetch_add(1) == 0) {
@@ -179,4 +222,95 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
         std::rethrow_exception(exc);
 }
 
+void parallelMapNuma(size_t first, size_t last,
+                     const std::function<int (size_t)> & nodeOf,
+                     const std::function<void (size_t)> & doWork,
+                     int occupancyLimit)
+{
+    ExcAssertGreaterEqual(last, first);
+    ExcAssertLess((last - first), 1ULL << 31);
+
+    int numNodes = numaTopology().numNodes();
+    if (numNodes == 1) {
+        parallelMap(first, last, doWork, occupancyLimit);
+        return;
+    }
+
+    // Partition the work by node
+    struct NodeWork {
+        NodeWork()
+            : index(0)
+        {
+        }
+
+        std::vector<size_t> items;
+        std::atomic<size_t> index;
+    };
+
+    std::unique_ptr<NodeWork[]> nodeWork(new NodeWork[numNodes]);
+    for (size_t i = first;  i < last;  ++i) {
+        int node = nodeOf(i);
+        if (node < 0 || node >= numNodes)
+            node = i % numNodes;
+        nodeWork[node].items.push_back(i);
+    }
+
+    std::atomic<int> hasException(0);
+    std::exception_ptr exc;
+
+    // This creates a thread pool that runs jobs on the default thread pool
+    ThreadPool tp;
+
+    if (occupancyLimit == -1)
+        occupancyLimit = numCpus();
+    if (occupancyLimit > (last - first))
+        occupancyLimit = (last - first);
+
+    // The jobs run on other threads are cancelled along with this one,
+    // and charge their memory to the same account
+    const CancellationToken * token = currentCancellationToken();
+    MemoryAccount * account = MemoryAccount::currentAccount();
+
+    auto worker = [&] ()
+        {
+            CancellationScope scope(token);
+            MemoryAccountScope accountScope(account);
+            int myNode = currentNumaNode();
+
+            // Our own node first, then the others in turn
+            for (int i = 0;  i < numNodes;  ++i) {
+                NodeWork & work = nodeWork[(myNode + i) % numNodes];
+                while (!hasException.load(std::memory_order_relaxed)) {
+                    size_t myindex = work.index.fetch_add(1);
+                    if (myindex >= work.items.size())
+                        break;
+                    try {
+                        if (token)
+                            token->check();
+                        TraceSpan span("parallel", "parallelMapNuma job");
+                        doWork(work.items[myindex]);
+                    } MLDB_CATCH_ALL {
+                        if (hasException.fetch_add(1) == 0) {
+                            ExcAssert(!exc);
+                            exc = std::current_exception();
+                        }
+                    }
+                }
+            }
+        };
+
+    // Leave one set of work for this thread to do directly
+    for (int i = 0;  i < occupancyLimit - 1;  ++i)
+        tp.add(worker);
+
+    // Do work until there is nothing left to do
+    worker();
+
+    // Wait for the rest of the work to be done
+    tp.waitForAll();
+
+    if (exc)
+        std::rethrow_exception(exc);
+}
+
 } // namespace MLDB
@@ -8,6 +8,9 @@
 #pragma once
 
 #include <functional>
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 namespace MLDB {
 
@@ -34,6 +37,13 @@ namespace MLDB {
     Different behaviour can be obtained by using a try block inside the
     doWork function, or by using another mechanism apart from exceptions
     to signal errors.
+
+    If the calling thread has a cancellation token (see cancellation.h),
+    it's made current for the threads doing the work, and checked before
+    each doWork() call.  Cancellation is then handled as an exception
+    thrown by doWork().  The calling thread's memory account (see
+    memory_account.h) is passed on in the same way.  The same goes for all
+    of the functions below.
 */
 void parallelMap(size_t first, size_t last,
                  const std::function<void (size_t)> & doWork,
@@ -55,4 +65,214 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
                         const std::function<void (size_t, size_t)> & doWork,
                         int occupancyLimit = -1);
 
+/** Same as parallelMap, except that the work is partitioned by the NUMA
+    node that owns its data, as returned by nodeOf() (for example using
+    numaNodeOfAddress()).  Each thread first does the work for its own
+    node, and then helps out with the others.  A node of -1 means unknown,
+    and such work is spread over the nodes.  On a machine with a single
+    node, this is simply parallelMap.
+*/
+void parallelMapNuma(size_t first, size_t last,
+                     const std::function<int (size_t)> & nodeOf,
+                     const std::function<void (size_t)> & doWork,
+                     int occupancyLimit = -1);
+
+/** Return the number of items that each job should handle when splitting
+    a range of n items over the thread pool.  There are enough jobs to
+    keep all of the CPUs busy even if the work is uneven, but never fewer
+    than minGrain items per job, so that small ranges don't pay for more
+    scheduling than they're worth.
+*/
+size_t parallelGrainSize(size_t n, size_t minGrain = 1);
+
+namespace ParallelDetail {
+
+/// Holds a value, so that a vector of them never becomes vector<bool>
+template<typename T>
+struct Slot {
+    T value;
+};
+
+} // namespace ParallelDetail
+
+/** Reduce the range [first, last) in parallel.
+
+    The range is split into chunks (see parallelGrainSize()), and each
+    chunk is accumulated into its own copy of init by calling
+    accumulate(T & accum, size_t index) for each of its indexes.  The
+    partial results are then merged in a tree, in parallel, by calling
+    combine(T & into, T & from) on pairs of neighbouring chunks.  The
+    order of the chunks is respected, so combine needs to be associative
+    but not commutative.
+
+    There are no locks involved, as each partial result only ever has one
+    thread working on it.  Exceptions are handled as for parallelMap().
+*/
+template<typename T, typename Accumulate, typename Combine>
+T parallelReduce(size_t first, size_t last, const T & init,
+                 const Accumulate & accumulate,
+                 const Combine & combine,
+                 size_t minGrain = 1)
+{
+    if (last <= first)
+        return init;
+
+    size_t n = last - first;
+    size_t grain = parallelGrainSize(n, minGrain);
+    size_t numChunks = (n + grain - 1) / grain;
+
+    std::vector<ParallelDetail::Slot<T> > partials
+        (numChunks, ParallelDetail::Slot<T>{init});
+
+    auto doChunk = [&] (size_t chunk)
+        {
+            T & accum = partials[chunk].value;
+            size_t begin = first + chunk * grain;
+            size_t end = std::min(last, begin + grain);
+            for (size_t i = begin;  i < end;  ++i)
+                accumulate(accum, i);
+        };
+
+    if (numChunks == 1)
+        doChunk(0);
+    else parallelMap(0, numChunks, doChunk);
+
+    for (size_t stride = 1;  stride < numChunks;  stride *= 2) {
+        auto doPair = [&] (size_t pair)
+            {
+                size_t into = pair * 2 * stride;
+                size_t from = into + stride;
+                if (from < numChunks)
+                    combine(partials[into].value, partials[from].value);
+            };
+
+        size_t numPairs = (numChunks + 2 * stride - 1) / (2 * stride);
+        if (numPairs == 1)
+            doPair(0);
+        else parallelMap(0, numPairs, doPair);
+    }
+
+    return std::move(partials[0].value);
+}
+
+/** Inclusive prefix scan in parallel, so that out[i] is made from in[0]
+    through in[i] combined with op, which must be associative and for
+    which identity must be an identity element.  Both in and out are
+    random access iterators, and may be the same to scan in place.
+
+    The scan is done in two passes over the data: the first sums up each
+    chunk, and the second scans each chunk starting from the sum of the
+    chunks before it.
+*/
+template<typename InputIt, typename OutputIt, typename T, typename Op>
+void parallelScan(InputIt in, InputIt inEnd, OutputIt out,
+                  const T & identity, const Op & op,
+                  size_t minGrain = 1024)
+{
+    size_t n = inEnd - in;
+    if (n == 0)
+        return;
+
+    size_t grain = parallelGrainSize(n, minGrain);
+    size_t numChunks = (n + grain - 1) / grain;
+
+    if (numChunks == 1) {
+        T accum = identity;
+        for (size_t i = 0;  i < n;  ++i)
+            out[i] = accum = op(accum, in[i]);
+        return;
+    }
+
+    std::vector<ParallelDetail::Slot<T> > offsets
+        (numChunks, ParallelDetail::Slot<T>{identity});
+
+    auto sumChunk = [&] (size_t chunk)
+        {
+            size_t begin = chunk * grain;
+            size_t end = std::min(n, begin + grain);
+            T accum = identity;
+            for (size_t i = begin;  i < end;  ++i)
+                accum = op(accum, in[i]);
+            offsets[chunk].value = std::move(accum);
+        };
+
+    parallelMap(0, numChunks, sumChunk);
+
+    // Turn the chunk sums into the sum of everything before each chunk
+    T running = identity;
+    for (auto & offset: offsets) {
+        T sum = std::move(offset.value);
+        offset.value = running;
+        running = op(running, sum);
+    }
+
+    auto scanChunk = [&] (size_t chunk)
+        {
+            size_t begin = chunk * grain;
+            size_t end = std::min(n, begin + grain);
+            T accum = offsets[chunk].value;
+            for (size_t i = begin;  i < end;  ++i)
+                out[i] = accum = op(accum, in[i]);
+        };
+
+    parallelMap(0, numChunks, scanChunk);
+}
+
+/** Sort the range in parallel.  Chunks of the range are sorted in
+    parallel, and then merged in a tree of in-place merges, each level of
+    which is also done in parallel.  The sort is not stable.
+*/
+template<typename RandomIt, typename Compare>
+void parallelSort(RandomIt first, RandomIt last, const Compare & compare,
+                  size_t minGrain = 4096)
+{
+    size_t n = last - first;
+    if (n < 2)
+        return;
+
+    size_t grain = parallelGrainSize(n, minGrain);
+    size_t numChunks = (n + grain - 1) / grain;
+
+    auto chunkStart = [&] (size_t chunk)
+        {
+            return first + std::min(n, chunk * grain);
+        };
+
+    if (numChunks == 1) {
+        std::sort(first, last, compare);
+        return;
+    }
+
+    auto sortChunk = [&] (size_t chunk)
+        {
+            std::sort(chunkStart(chunk), chunkStart(chunk + 1), compare);
+        };
+
+    parallelMap(0, numChunks, sortChunk);
+
+    for (size_t stride = 1;  stride < numChunks;  stride *= 2) {
+        auto mergePair = [&] (size_t pair)
+            {
+                size_t into = pair * 2 * stride;
+                size_t from = into + stride;
+                if (from >= numChunks)
+                    return;
+                std::inplace_merge(chunkStart(into), chunkStart(from),
+                                   chunkStart(from + stride), compare);
+            };
+
+        size_t numPairs = (numChunks + 2 * stride - 1) / (2 * stride);
+        if (numPairs == 1)
+            mergePair(0);
+        else parallelMap(0, numPairs, mergePair);
+    }
+}
+
+template<typename RandomIt>
+void parallelSort(RandomIt first, RandomIt last)
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type Value;
+    parallelSort(first, last, std::less<Value>());
+}
+
 } // namespace MLDB
@@ -0,0 +1,271 @@
+/** storage_allocator.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Allocation of storage arrays, backed by huge pages where possible.
+*/
+
+#include "storage_allocator.h"
+#include "mldb/arch/cpu_info.h"
+#include "mldb/base/metrics.h"
+#include "mldb/jml/utils/environment.h"
+#include <cstdlib>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#  define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#  define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#  define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* STORAGE ACCOUNT                                                           */
+/*****************************************************************************/
+
+StorageAccountStats
+StorageAccount::
+getStats() const
+{
+    StorageAccountStats result;
+    result.bytes = bytes;
+    result.hugePageBytes = hugePageBytes;
+    result.mappedBytes = mappedBytes;
+    result.arrays = arrays;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* STORAGE ALLOCATION                                                        */
+/*****************************************************************************/
+
+namespace {
+
+enum HugePages {
+    HUGEPAGES_NONE,
+    HUGEPAGES_TRANSPARENT,
+    HUGEPAGES_2MB,
+    HUGEPAGES_1GB
+};
+
+/// Options, read on first use so that they don't depend on the order of
+/// static initialization
+struct StorageOptions {
+    StorageOptions()
+    {
+        EnvOption<std::string> hugePagesOption("MLDB_HUGEPAGES",
+                                               "transparent");
+        EnvOption<size_t> minBytesOption("MLDB_HUGEPAGE_MIN_BYTES",
+                                         2 * 1024 * 1024);
+
+        std::string mode = hugePagesOption;
+        if (mode == "none")
+            hugePages = HUGEPAGES_NONE;
+        else if (mode == "transparent")
+            hugePages = HUGEPAGES_TRANSPARENT;
+        else if (mode == "2mb")
+            hugePages = HUGEPAGES_2MB;
+        else if (mode == "1gb")
+            hugePages = HUGEPAGES_1GB;
+        else {
+            cerr << "unknown MLDB_HUGEPAGES value '" << mode
+                 << "'; using transparent huge pages" << endl;
+            hugePages = HUGEPAGES_TRANSPARENT;
+        }
+
+        minMappedBytes = minBytesOption;
+        pageSize = sysconf(_SC_PAGESIZE);
+    }
+
+    HugePages hugePages;
+    size_t minMappedBytes;
+    size_t pageSize;
+};
+
+const StorageOptions & options()
+{
+    static const StorageOptions result;
+    return result;
+}
+
+/// Storage over all accounts, for the gauges
+std::atomic<int64_t> totalBytes(0);
+std::atomic<int64_t> totalHugePageBytes(0);
+
+MetricCounter & hugePageFallbacksMetric
+    = Metrics::counter("mldb_storage_hugepage_fallbacks_total",
+                       "Storage arrays that asked for reserved huge pages "
+                       "but had to use normal ones");
+std::shared_ptr<void> bytesMetric
+    = Metrics::addCallback("mldb_storage_bytes",
+                           "Bytes held in storage arrays of datasets and "
+                           "indexes",
+                           [] () -> double { return totalBytes; });
+std::shared_ptr<void> hugePageBytesMetric
+    = Metrics::addCallback("mldb_storage_hugepage_bytes",
+                           "Bytes held in storage arrays that are in "
+                           "reserved huge pages",
+                           [] () -> double { return totalHugePageBytes; });
+
+/** Header at the start of a mapped array, to know how to unmap it.  It
+    takes a cache line, so that the data is still aligned.
+*/
+struct alignas(64) MappedHeader {
+    size_t mappedLength;
+    bool hugePages;
+};
+
+size_t roundUp(size_t bytes, size_t multiple)
+{
+    return (bytes + multiple - 1) / multiple * multiple;
+}
+
+/** Prefer the memory of the given node for the range.  It must be done
+    before the pages are touched, since it only applies to pages that are
+    faulted in afterwards.
+*/
+void preferNumaNode(void * data, size_t length, int node)
+{
+#if defined(SYS_mbind)
+    if (node < 0 || node >= 8 * sizeof(unsigned long))
+        return;
+    static constexpr int MPOL_PREFERRED_ = 1;
+    unsigned long nodeMask = 1UL << node;
+    // Failing is only a loss of locality, so the result is ignored
+    syscall(SYS_mbind, data, length, MPOL_PREFERRED_, &nodeMask,
+            8 * sizeof(nodeMask), 0);
+#endif
+}
+
+/** Map the given length, from the pool of reserved huge pages if asked
+    and possible.  Returns null if no memory can be mapped.
+*/
+void * mapStorage(size_t & length, bool & hugePages)
+{
+    const StorageOptions & opts = options();
+
+    if (opts.hugePages == HUGEPAGES_2MB || opts.hugePages == HUGEPAGES_1GB) {
+        bool gb = opts.hugePages == HUGEPAGES_1GB;
+        size_t hugeLength = roundUp(length, gb ? 1ULL << 30 : 1ULL << 21);
+        void * result = mmap(nullptr, hugeLength, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+                             | (gb ? MAP_HUGE_1GB : MAP_HUGE_2MB),
+                             -1, 0);
+        if (result != MAP_FAILED) {
+            length = hugeLength;
+            hugePages = true;
+            return result;
+        }
+        hugePageFallbacksMetric.add();
+    }
+
+    hugePages = false;
+    length = roundUp(length, opts.pageSize);
+    void * result = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+        return nullptr;
+
+#if defined(MADV_HUGEPAGE)
+    if (opts.hugePages != HUGEPAGES_NONE)
+        madvise(result, length, MADV_HUGEPAGE);
+#endif
+
+    return result;
+}
+
+} // file scope
+
+void *
+allocateStorageBytes(size_t bytes, StorageAccount * account, int numaNode)
+{
+    if (bytes == 0)
+        return nullptr;
+
+    const StorageOptions & opts = options();
+    void * result;
+    size_t hugePageBytes = 0;
+
+    if (bytes < opts.minMappedBytes) {
+        // Small enough that the heap does a better job
+        result = calloc(1, bytes);
+        if (!result)
+            throw std::bad_alloc();
+    }
+    else {
+        size_t length = bytes + sizeof(MappedHeader);
+        bool hugePages = false;
+        void * mapped = mapStorage(length, hugePages);
+        if (!mapped)
+            throw std::bad_alloc();
+
+        // Only worth it when there is more than one node to choose from
+        if (numaTopology().numNodes() > 1)
+            preferNumaNode(mapped, length,
+                           numaNode == -1 ? currentNumaNode() : numaNode);
+
+        MappedHeader * header = (MappedHeader *)mapped;
+        header->mappedLength = length;
+        header->hugePages = hugePages;
+        result = header + 1;
+        if (hugePages)
+            hugePageBytes = bytes;
+    }
+
+    totalBytes += bytes;
+    totalHugePageBytes += hugePageBytes;
+    if (account) {
+        account->bytes += bytes;
+        account->hugePageBytes += hugePageBytes;
+        if (bytes >= opts.minMappedBytes)
+            account->mappedBytes += bytes;
+        account->arrays += 1;
+    }
+
+    return result;
+}
+
+void
+freeStorageBytes(void * data, size_t bytes, StorageAccount * account)
+{
+    if (!data)
+        return;
+
+    const StorageOptions & opts = options();
+    size_t hugePageBytes = 0;
+
+    if (bytes < opts.minMappedBytes) {
+        free(data);
+    }
+    else {
+        MappedHeader * header = (MappedHeader *)data - 1;
+        if (header->hugePages)
+            hugePageBytes = bytes;
+        munmap(header, header->mappedLength);
+    }
+
+    totalBytes -= bytes;
+    totalHugePageBytes -= hugePageBytes;
+    if (account) {
+        account->bytes -= bytes;
+        account->hugePageBytes -= hugePageBytes;
+        if (bytes >= opts.minMappedBytes)
+            account->mappedBytes -= bytes;
+        account->arrays -= 1;
+    }
+}
+
+} // namespace MLDB
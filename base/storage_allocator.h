@@ -0,0 +1,163 @@
+/** storage_allocator.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Allocation of the large, long lived arrays that datasets and indexes
+    store their data in.
+
+    Arrays of at least MLDB_HUGEPAGE_MIN_BYTES (2MB by default) are mapped
+    directly rather than taken from the heap, so that they can be backed by
+    huge pages, which cuts the TLB misses of random accesses over them.
+    MLDB_HUGEPAGES chooses how:
+
+    - "transparent" (the default) asks for transparent huge pages with
+      madvise(), which the kernel gives when it can;
+    - "2mb" or "1gb" maps them from the reserved pool of huge pages of
+      that size, falling back to transparent huge pages when the pool
+      can't provide them;
+    - "none" uses normal pages.
+
+    On machines with more than one NUMA node, the memory of a mapped array
+    is preferably taken from the node of the thread that allocates it.
+    Since the worker threads of the thread pool stay on their node, an
+    array built by a job is local to the threads that run the jobs of that
+    node.
+
+    The bytes of each array can be counted in a StorageAccount, so that
+    each dataset can report how much memory it's using.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* STORAGE ACCOUNT                                                           */
+/*****************************************************************************/
+
+struct StorageAccountStats {
+    uint64_t bytes = 0;           ///< Bytes of the arrays currently held
+    uint64_t hugePageBytes = 0;   ///< Of those, bytes in huge pages
+    uint64_t mappedBytes = 0;     ///< Of those, bytes that were mapped
+    uint64_t arrays = 0;          ///< Number of arrays currently held
+};
+
+/** Memory used by the storage arrays of something (typically a dataset).
+    It needs to live as long as the arrays, which is why they hold a
+    shared pointer to it.
+*/
+
+struct StorageAccount {
+    StorageAccountStats getStats() const;
+
+private:
+    friend void * allocateStorageBytes(size_t, StorageAccount *, int);
+    friend void freeStorageBytes(void *, size_t, StorageAccount *);
+
+    std::atomic<uint64_t> bytes { 0 };
+    std::atomic<uint64_t> hugePageBytes { 0 };
+    std::atomic<uint64_t> mappedBytes { 0 };
+    std::atomic<uint64_t> arrays { 0 };
+};
+
+
+/*****************************************************************************/
+/* STORAGE ALLOCATION                                                        */
+/*****************************************************************************/
+
+/** Allocate bytes of storage, zero filled, counting them in the account
+    if one is given.  The memory is placed on the given NUMA node, or with
+    -1 on the node of the calling thread.  Throws std::bad_alloc if no
+    memory could be obtained.
+*/
+void * allocateStorageBytes(size_t bytes, StorageAccount * account = nullptr,
+                            int numaNode = -1);
+
+/** Free storage that came from allocateStorageBytes(), with the same
+    number of bytes and account.
+*/
+void freeStorageBytes(void * data, size_t bytes,
+                      StorageAccount * account = nullptr);
+
+/** Allocate an array of n zero filled Ts with allocateStorageBytes(),
+    which is freed when the last reference to it goes.  T must be
+    trivially constructible and destructible.
+*/
+template<typename T>
+std::shared_ptr<T>
+allocateStorageArray(size_t n,
+                     std::shared_ptr<StorageAccount> account = nullptr,
+                     int numaNode = -1)
+{
+    size_t bytes = n * sizeof(T);
+    T * data = (T *)allocateStorageBytes(bytes, account.get(), numaNode);
+    return std::shared_ptr<T>(data, [=] (T * p)
+                              {
+                                  freeStorageBytes(p, bytes, account.get());
+                              });
+}
+
+
+/*****************************************************************************/
+/* STORAGE ALLOCATOR                                                         */
+/*****************************************************************************/
+
+/** Allocator for standard containers whose elements live in storage
+    arrays, such as a std::vector holding the coordinates of an embedding.
+    The memory is counted in the allocator's account.
+*/
+
+template<typename T>
+struct StorageAllocator {
+    typedef T value_type;
+
+    StorageAllocator(std::shared_ptr<StorageAccount> account = nullptr) noexcept
+        : account(std::move(account))
+    {
+    }
+
+    template<typename U>
+    StorageAllocator(const StorageAllocator<U> & other) noexcept
+        : account(other.account)
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+        return (T *)allocateStorageBytes(n * sizeof(T), account.get());
+    }
+
+    void deallocate(T * p, size_t n) noexcept
+    {
+        freeStorageBytes(p, n * sizeof(T), account.get());
+    }
+
+    template<typename U>
+    bool operator == (const StorageAllocator<U> & other) const noexcept
+    {
+        return account == other.account;
+    }
+
+    template<typename U>
+    bool operator != (const StorageAllocator<U> & other) const noexcept
+    {
+        return account != other.account;
+    }
+
+    // Containers that are copied or swapped keep the account they have
+    // throughout their life
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    std::shared_ptr<StorageAccount> account;
+};
+
+} // namespace MLDB
@@ -1,3 +1,9 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
 $(eval $(call test,thread_pool_test,base,boost timed))
+$(eval $(call test,parallel_test,base,boost))
+$(eval $(call test,metrics_test,base,boost))
+$(eval $(call test,trace_events_test,base,boost))
+$(eval $(call test,memory_account_test,base,boost))
+$(eval $(call test,fast_float_parsing_test,base,boost))
+$(eval $(call test,storage_allocator_test,base,boost))
@@ -0,0 +1,157 @@
+/** fast_float_parsing_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test that decimal numbers are converted exactly as strtod() does.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/fast_float_parsing.h"
+#include "mldb/base/fast_int_parsing.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace MLDB;
+
+namespace {
+
+/// Check that str parses to the same bits and length as with strtod()
+bool sameAsStrtod(const std::string & str)
+{
+    char * strtodEnd = nullptr;
+    double expected = strtod(str.c_str(), &strtodEnd);
+    float expectedFloat = strtof(str.c_str(), nullptr);
+
+    double result = 0.0;
+    const char * end
+        = parseDecimalDouble(str.data(), str.data() + str.size(), result);
+    if (!end)
+        return strtodEnd == str.c_str();
+
+    float resultFloat = 0.0;
+    parseDecimalFloat(str.data(), str.data() + str.size(), resultFloat);
+
+    bool same = end == strtodEnd
+        && memcmp(&result, &expected, sizeof(result)) == 0
+        && memcmp(&resultFloat, &expectedFloat, sizeof(resultFloat)) == 0;
+    if (!same)
+        BOOST_TEST_MESSAGE("different from strtod: " << str);
+    return same;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_edge_cases )
+{
+    const char * cases[] = {
+        "0", "-0", "1", "-1.5", "0.1", ".5", "5.", "1.e5", "0e1000",
+        "1e23", "9007199254740993", "9007199254740992.5",
+        "1.7976931348623157e308", "1.7976931348623159e308", "2e308",
+        "2.2250738585072011e-308", "2.2250738585072012e-308",
+        "4.9e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "1e-400", "3.4028235e38", "3.4028236e38", "1.4e-45",
+        "1.00000005960464477539062499", "1.000000059604644775390625",
+        "1.00000005960464477539062501",
+        "123456789012345678901234567890",
+        "00000000000000000000000000001", "0.000000000000000000000000001234",
+        "1e", "1e+", "1e-x", "-", ".", "-.", "abc", "12abc"
+    };
+
+    for (auto c: cases)
+        BOOST_CHECK(sameAsStrtod(c));
+}
+
+BOOST_AUTO_TEST_CASE( test_random_numbers )
+{
+    std::mt19937_64 rng(1);
+    char buf[64];
+    int numWrong = 0;
+
+    for (int i = 0;  i < 200000;  ++i) {
+        // Random doubles, printed with a random number of digits
+        double d;
+        uint64_t bits = rng();
+        memcpy(&d, &bits, sizeof(d));
+        if (std::isfinite(d)) {
+            snprintf(buf, sizeof(buf), "%.*g", int(rng() % 20) + 1, d);
+            numWrong += !sameAsStrtod(buf);
+        }
+
+        // Exactly half way between two doubles
+        bits &= 0x7fefffffffffffff;
+        memcpy(&d, &bits, sizeof(d));
+        long double halfway
+            = ((long double)d + (long double)nextafter(d, INFINITY)) / 2;
+        snprintf(buf, sizeof(buf), "%.40Lg", halfway);
+        numWrong += !sameAsStrtod(buf);
+
+        // Random strings of digits, which are often too long to be exact
+        std::string str;
+        for (int j = rng() % 30;  j >= 0;  --j)
+            str += char('0' + rng() % 10);
+        if (rng() % 2)
+            str.insert(rng() % str.size(), ".");
+        if (rng() % 2)
+            str += "e" + std::to_string(int(rng() % 700) - 350);
+        numWrong += !sameAsStrtod(str);
+    }
+
+    BOOST_CHECK_EQUAL(numWrong, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_integer_flag )
+{
+    const char * str = "12345";
+    double result;
+    bool isInteger = false;
+    BOOST_CHECK(parseDecimalDouble(str, str + 5, result, &isInteger));
+    BOOST_CHECK(isInteger);
+
+    str = "1e5";
+    BOOST_CHECK(parseDecimalDouble(str, str + 3, result, &isInteger));
+    BOOST_CHECK(!isInteger);
+
+    // Only the characters before the end are looked at
+    str = "1.5";
+    BOOST_CHECK_EQUAL(parseDecimalDouble(str, str + 1, result, &isInteger),
+                      str + 1);
+    BOOST_CHECK(isInteger);
+    BOOST_CHECK_EQUAL(result, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_match_float )
+{
+    const char * str = "1.00000005960464477539062501e0 x";
+    ParseContext context("test", str, strlen(str));
+    float f;
+    BOOST_CHECK(match_float(f, context));
+    BOOST_CHECK_EQUAL(f, strtof("1.00000005960464477539062501", nullptr));
+
+    str = "-0.38860246539115906e-3e";
+    ParseContext context2("test", str, strlen(str));
+    double d;
+    BOOST_CHECK(match_float(d, context2));
+    BOOST_CHECK_EQUAL(d, -0.38860246539115906e-3);
+    BOOST_CHECK_EQUAL(*context2, 'e');
+}
+
+BOOST_AUTO_TEST_CASE( test_eight_digits )
+{
+    BOOST_CHECK(isEightDigits(loadEightBytes("01234567")));
+    BOOST_CHECK(!isEightDigits(loadEightBytes("0123456:")));
+    BOOST_CHECK(!isEightDigits(loadEightBytes("/1234567")));
+    BOOST_CHECK(!isEightDigits(loadEightBytes("0123 567")));
+    BOOST_CHECK_EQUAL(parseEightDigits(loadEightBytes("01234567")), 1234567);
+    BOOST_CHECK_EQUAL(parseEightDigits(loadEightBytes("99999999")), 99999999);
+
+    const char * str = "123456789012345678x";
+    uint64_t val = 0;
+    BOOST_CHECK_EQUAL(parseDecimalDigits(str, str + 19, val), str + 18);
+    BOOST_CHECK_EQUAL(val, 123456789012345678ULL);
+}
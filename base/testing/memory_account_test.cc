@@ -0,0 +1,141 @@
+/** memory_account_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the accounting of memory against a budget.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/memory_account.h"
+#include "mldb/base/parallel.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_charge_and_release )
+{
+    MemoryAccount account("test", 1000);
+    account.charge(600);
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 600);
+
+    // Going over undoes the charge
+    BOOST_CHECK_THROW(account.charge(500), MemoryBudgetExceededException);
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 600);
+
+    account.release(200);
+    account.charge(500);
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 900);
+    BOOST_CHECK_EQUAL(account.peakBytes(), 900);
+
+    // It's a cancellation, so that it stops work the same way
+    BOOST_CHECK_THROW(account.charge(500), CancellationException);
+
+    // tryCharge() keeps the bytes even when over
+    BOOST_CHECK(!account.tryCharge(200));
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 1100);
+    account.release(1100);
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 0);
+    BOOST_CHECK_EQUAL(account.peakBytes(), 1100);
+}
+
+BOOST_AUTO_TEST_CASE( test_no_budget )
+{
+    MemoryAccount account("test");
+    account.charge(uint64_t(1) << 40);
+    BOOST_CHECK(account.tryCharge(1));
+    BOOST_CHECK_EQUAL(account.bytesUsed(), (uint64_t(1) << 40) + 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_parent )
+{
+    MemoryAccount parent("procedure", 1000, nullptr);
+    {
+        // The child has no budget of its own, but its parent does
+        MemoryAccount child("query", 0, &parent);
+        child.charge(800);
+        BOOST_CHECK_EQUAL(parent.bytesUsed(), 800);
+        BOOST_CHECK_THROW(child.charge(300), MemoryBudgetExceededException);
+        BOOST_CHECK_EQUAL(child.bytesUsed(), 800);
+        BOOST_CHECK_EQUAL(parent.bytesUsed(), 800);
+    }
+
+    // What the child still held is released from the parent
+    BOOST_CHECK_EQUAL(parent.bytesUsed(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_running )
+{
+    size_t before = MemoryAccount::running().size();
+    {
+        MemoryAccount account("listed", 100);
+        account.charge(10);
+        auto running = MemoryAccount::running();
+        BOOST_REQUIRE_EQUAL(running.size(), before + 1);
+        BOOST_CHECK_EQUAL(running.back().description, "listed");
+        BOOST_CHECK_EQUAL(running.back().bytesUsed, 10);
+        BOOST_CHECK_EQUAL(running.back().budget, 100);
+        BOOST_CHECK_GE(running.back().secondsRunning, 0);
+    }
+    BOOST_CHECK_EQUAL(MemoryAccount::running().size(), before);
+}
+
+BOOST_AUTO_TEST_CASE( test_reservation )
+{
+    MemoryAccount account("test", 1000);
+
+    {
+        // With no current account, it only counts
+        MemoryReservation unaccounted;
+        unaccounted.add(5000);
+        BOOST_CHECK_EQUAL(unaccounted.bytes(), 5000);
+        BOOST_CHECK_EQUAL(account.bytesUsed(), 0);
+    }
+
+    MemoryAccountScope scope(&account);
+    BOOST_CHECK_EQUAL(MemoryAccount::currentAccount(), &account);
+
+    {
+        MemoryReservation reserved;
+        reserved.add(300);
+        reserved.resize(700);
+        BOOST_CHECK_EQUAL(account.bytesUsed(), 700);
+        BOOST_CHECK_THROW(reserved.resize(1200),
+                          MemoryBudgetExceededException);
+        BOOST_CHECK_EQUAL(reserved.bytes(), 700);
+
+        BOOST_CHECK(!reserved.tryResize(1200));
+        BOOST_CHECK_EQUAL(account.bytesUsed(), 1200);
+        BOOST_CHECK(reserved.tryResize(400));
+        BOOST_CHECK_EQUAL(account.bytesUsed(), 400);
+    }
+
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_map_passes_account )
+{
+    MemoryAccount account("test", 100000);
+    MemoryAccountScope scope(&account);
+    MemoryReservation reserved;
+
+    std::atomic<int> numAccounted(0);
+    auto doWork = [&] (size_t i)
+        {
+            if (MemoryAccount::currentAccount() == &account)
+                ++numAccounted;
+            reserved.add(10);
+        };
+
+    parallelMap(0, 1000, doWork);
+    BOOST_CHECK_EQUAL(numAccounted, 1000);
+    BOOST_CHECK_EQUAL(account.bytesUsed(), 10000);
+
+    // Going over the budget stops the work
+    BOOST_CHECK_THROW(parallelMap(0, 100000, doWork),
+                      MemoryBudgetExceededException);
+}
@@ -0,0 +1,101 @@
+/** metrics_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the metrics registry.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/metrics.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE (test_counter_over_threads)
+{
+    MetricCounter & counter
+        = Metrics::counter("test_things_total", "Things counted");
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < 8;  ++i) {
+        threads.emplace_back([&] ()
+                             {
+                                 for (int j = 0;  j < 10000;  ++j)
+                                     counter.add();
+                             });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(counter.value(), 80000);
+    BOOST_CHECK_EQUAL(&counter,
+                      &Metrics::counter("test_things_total", "Things counted"));
+
+    string text = Metrics::prometheusText();
+    BOOST_CHECK(text.find("# TYPE test_things_total counter\n")
+                != string::npos);
+    BOOST_CHECK(text.find("\ntest_things_total 80000\n") != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE (test_histogram_buckets)
+{
+    // Buckets go up with the value, and split each power of two into four
+    for (uint64_t ns = 1;  ns < 100000;  ++ns) {
+        BOOST_REQUIRE_LE(MetricHistogram::bucketFor(ns - 1),
+                         MetricHistogram::bucketFor(ns));
+    }
+    BOOST_CHECK_EQUAL(MetricHistogram::bucketFor(896),
+                      MetricHistogram::bucketFor(1023));
+    BOOST_CHECK_EQUAL(MetricHistogram::bucketFor(895) + 1,
+                      MetricHistogram::bucketFor(896));
+    BOOST_CHECK_EQUAL(MetricHistogram::bucketFor(1023) + 1,
+                      MetricHistogram::bucketFor(1024));
+
+    MetricHistogram & histogram
+        = Metrics::histogram("test_wait_seconds", "Time waited",
+                             {{"kind", "test"}});
+    histogram.record(0.000002);
+    histogram.record(0.003);
+    histogram.record(0.003);
+    histogram.record(1000);
+
+    auto snapshot = histogram.snapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 4);
+    BOOST_CHECK_CLOSE(snapshot.sum, 1000.006002, 1e-6);
+
+    for (auto & b: snapshot.cumulative) {
+        uint64_t expected = (b.first > 0.000002) + 2 * (b.first > 0.003)
+            + (b.first > 1000);
+        BOOST_CHECK_EQUAL(b.second, expected);
+    }
+
+    string text = Metrics::prometheusText();
+    BOOST_CHECK(text.find("test_wait_seconds_bucket{kind=\"test\",le=\"+Inf\"} 4\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_wait_seconds_count{kind=\"test\"} 4\n")
+                != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE (test_callback)
+{
+    double value = 3;
+    {
+        auto handle = Metrics::addCallback("test_level", "Level",
+                                           [&] () { return value; });
+        BOOST_CHECK(Metrics::prometheusText().find("\ntest_level 3\n")
+                    != string::npos);
+        value = 4.5;
+        BOOST_CHECK(Metrics::prometheusText().find("\ntest_level 4.5\n")
+                    != string::npos);
+
+        BOOST_CHECK_THROW(Metrics::counter("test_level", "Level"),
+                          std::exception);
+    }
+    BOOST_CHECK(Metrics::prometheusText().find("test_level")
+                == string::npos);
+}
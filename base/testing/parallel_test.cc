@@ -0,0 +1,167 @@
+/** parallel_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the parallel reduce, scan and sort primitives, and of
+    cancellation of parallel work.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
+
+#include <boost/test/unit_test.hpp>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_grain_size )
+{
+    BOOST_CHECK_EQUAL(parallelGrainSize(0), 1);
+    BOOST_CHECK_EQUAL(parallelGrainSize(10, 100), 100);
+    BOOST_CHECK_GE(parallelGrainSize(1000000), 1);
+    BOOST_CHECK_LE(parallelGrainSize(1000000), 1000000);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_reduce )
+{
+    for (size_t n: { 0, 1, 7, 1000, 123457 }) {
+        auto accum = [] (uint64_t & total, size_t i) { total += i; };
+        auto combine = [] (uint64_t & into, uint64_t & from) { into += from; };
+        uint64_t total = parallelReduce(0, n, uint64_t(0), accum, combine);
+        BOOST_CHECK_EQUAL(total, uint64_t(n) * (n - (n > 0)) / 2);
+    }
+
+    // Reduce with an empty range returns the initial value
+    BOOST_CHECK_EQUAL(parallelReduce(5, 5, 42,
+                                     [] (int &, size_t) {},
+                                     [] (int &, int &) {}),
+                      42);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_reduce_order )
+{
+    // String concatenation is associative but not commutative, so this
+    // only works if the chunks are combined in order
+    size_t n = 10000;
+    auto accum = [] (string & s, size_t i) { s += char('a' + i % 26); };
+    auto combine = [] (string & into, string & from) { into += from; };
+    string result = parallelReduce(0, n, string(), accum, combine, 7);
+
+    string expected;
+    for (size_t i = 0;  i < n;  ++i)
+        expected += char('a' + i % 26);
+    BOOST_CHECK(result == expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_reduce_bool )
+{
+    auto accum = [] (bool & any, size_t i) { any = any || i == 9999; };
+    auto combine = [] (bool & into, bool & from) { into = into || from; };
+    BOOST_CHECK(parallelReduce(0, 10000, false, accum, combine));
+    BOOST_CHECK(!parallelReduce(0, 9999, false, accum, combine));
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_scan )
+{
+    for (size_t n: { 0, 1, 1000, 100001 }) {
+        vector<int64_t> in(n);
+        for (size_t i = 0;  i < n;  ++i)
+            in[i] = i % 17;
+
+        vector<int64_t> expected(n);
+        std::partial_sum(in.begin(), in.end(), expected.begin());
+
+        vector<int64_t> out(n);
+        parallelScan(in.begin(), in.end(), out.begin(), int64_t(0),
+                     std::plus<int64_t>(), 100);
+        BOOST_CHECK(out == expected);
+
+        // In place
+        parallelScan(in.begin(), in.end(), in.begin(), int64_t(0),
+                     std::plus<int64_t>(), 100);
+        BOOST_CHECK(in == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_sort )
+{
+    std::mt19937 rng(1);
+
+    for (size_t n: { 0, 1, 2, 1000, 200003 }) {
+        vector<uint32_t> v(n);
+        for (auto & x: v)
+            x = rng() % 1000;
+
+        vector<uint32_t> expected = v;
+        std::sort(expected.begin(), expected.end());
+
+        parallelSort(v.begin(), v.end(), std::less<uint32_t>(), 100);
+        BOOST_CHECK(v == expected);
+
+        std::reverse(v.begin(), v.end());
+        parallelSort(v.begin(), v.end(), std::greater<uint32_t>());
+        std::reverse(expected.begin(), expected.end());
+        BOOST_CHECK(v == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_map_cancellation )
+{
+    BOOST_CHECK(!isCancelled());
+    BOOST_CHECK_NO_THROW(checkCancelled());
+
+    CancellationToken token;
+    CancellationScope scope(&token);
+
+    std::atomic<size_t> numDone(0);
+    auto doWork = [&] (size_t i)
+        {
+            // The token is visible on the worker threads
+            BOOST_REQUIRE(currentCancellationToken() == &token);
+            if (i == 100)
+                token.cancel();
+            ++numDone;
+        };
+
+    BOOST_CHECK_THROW(parallelMap(0, 1000000, doWork), CancellationException);
+    BOOST_CHECK_LT(numDone.load(), 1000000);
+    BOOST_CHECK(isCancelled());
+
+    // A child is cancelled along with its parent
+    CancellationToken child(&token);
+    BOOST_CHECK(child.isCancelled());
+}
+
+BOOST_AUTO_TEST_CASE( test_cancellation_deadline )
+{
+    CancellationToken token;
+    token.setTimeout(0.05);
+    CancellationScope scope(&token);
+
+    auto doWork = [&] (size_t i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        };
+
+    BOOST_CHECK_THROW(parallelMap(0, 100000, doWork),
+                      DeadlineExceededException);
+
+    // Once the poll function says so, the token is cancelled
+    bool wanted = true;
+    CancellationToken polled;
+    polled.setPoll([&] () { return wanted; }, 0.0);
+    BOOST_CHECK(!polled.isCancelled());
+    wanted = false;
+    BOOST_CHECK(polled.isCancelled());
+    BOOST_CHECK_THROW(polled.check(), CancellationException);
+}
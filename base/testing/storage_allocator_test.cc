@@ -0,0 +1,97 @@
+/** storage_allocator_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the allocation and accounting of storage arrays.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/storage_allocator.h"
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_small_arrays_are_counted )
+{
+    auto account = std::make_shared<StorageAccount>();
+
+    {
+        auto array = allocateStorageArray<uint32_t>(1000, account);
+        BOOST_REQUIRE(array);
+        BOOST_CHECK(std::all_of(array.get(), array.get() + 1000,
+                                [] (uint32_t v) { return v == 0; }));
+
+        auto stats = account->getStats();
+        BOOST_CHECK_EQUAL(stats.bytes, 4000);
+        BOOST_CHECK_EQUAL(stats.mappedBytes, 0);
+        BOOST_CHECK_EQUAL(stats.arrays, 1);
+    }
+
+    auto stats = account->getStats();
+    BOOST_CHECK_EQUAL(stats.bytes, 0);
+    BOOST_CHECK_EQUAL(stats.arrays, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_large_arrays_are_mapped )
+{
+    auto account = std::make_shared<StorageAccount>();
+    size_t n = 3 * 1024 * 1024;
+
+    auto array = allocateStorageArray<uint64_t>(n, account);
+    BOOST_REQUIRE(array);
+
+    // Zero filled, usable over its whole length and cache line aligned
+    BOOST_CHECK_EQUAL(array.get()[0], 0);
+    BOOST_CHECK_EQUAL(array.get()[n - 1], 0);
+    std::fill(array.get(), array.get() + n, 0xdeadbeef);
+    BOOST_CHECK_EQUAL((uintptr_t)array.get() % 64, 0);
+
+    auto stats = account->getStats();
+    BOOST_CHECK_EQUAL(stats.bytes, n * 8);
+    BOOST_CHECK_EQUAL(stats.mappedBytes, n * 8);
+    BOOST_CHECK_LE(stats.hugePageBytes, stats.bytes);
+
+    // The account lives until the last of its arrays goes
+    std::weak_ptr<StorageAccount> weak = account;
+    account.reset();
+    BOOST_CHECK(!weak.expired());
+    array.reset();
+    BOOST_CHECK(weak.expired());
+}
+
+BOOST_AUTO_TEST_CASE( test_empty_array )
+{
+    auto account = std::make_shared<StorageAccount>();
+    auto array = allocateStorageArray<float>(0, account);
+    BOOST_CHECK_EQUAL(account->getStats().arrays, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_vector_allocator )
+{
+    auto account = std::make_shared<StorageAccount>();
+    typedef std::vector<int8_t, StorageAllocator<int8_t> > Vec;
+
+    {
+        Vec vec { Vec::allocator_type(account) };
+        vec.resize(5 * 1024 * 1024, 3);
+        BOOST_CHECK_EQUAL(account->getStats().bytes, vec.capacity());
+
+        // A copy into another account is counted there
+        auto account2 = std::make_shared<StorageAccount>();
+        Vec vec2(vec, Vec::allocator_type(account2));
+        BOOST_CHECK_EQUAL(account2->getStats().bytes, vec2.capacity());
+        BOOST_CHECK(vec2 == vec);
+
+        vec.clear();
+        vec.shrink_to_fit();
+        BOOST_CHECK_EQUAL(account->getStats().bytes, 0);
+    }
+
+    BOOST_CHECK_EQUAL(account->getStats().arrays, 0);
+}
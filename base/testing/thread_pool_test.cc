@@ -15,6 +15,7 @@
 #include "mldb/arch/timers.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/cpu_info.h"
 
 #include <boost/test/unit_test.hpp>
 #include <atomic>
@@ -165,6 +166,90 @@ BOOST_AUTO_TEST_CASE(thread_pool_test)
     BOOST_CHECK_EQUAL(jobsDone.load(), numJobs);
 }
 
+BOOST_AUTO_TEST_CASE(thread_pool_resource_groups)
+{
+    BOOST_CHECK(ThreadPool::getResourceGroup("interactive"));
+    BOOST_CHECK(ThreadPool::getResourceGroup("batch"));
+    BOOST_CHECK(!ThreadPool::getResourceGroup("nonexistent"));
+    BOOST_CHECK_THROW(ResourceGroupScope("nonexistent"), std::exception);
+    BOOST_CHECK_THROW(ThreadPool::createResourceGroup("batch", 1.0,
+                                                      PRIORITY_BATCH),
+                      std::exception);
+
+    ThreadPool & group
+        = ThreadPool::createResourceGroup("test", 0.5, PRIORITY_BATCH);
+    BOOST_CHECK_EQUAL(&ThreadPool::current(), &ThreadPool::instance());
+
+    std::atomic<uint64_t> jobsDone(0);
+    std::atomic<uint64_t> jobsInGroup(0);
+
+    {
+        ResourceGroupScope scope("test");
+        BOOST_CHECK_EQUAL(&ThreadPool::current(), &group);
+
+        // Nested pools, as created by parallelMap, attach to the group,
+        // and work running in them sees the group as current
+        auto work = [&] (size_t)
+            {
+                ++jobsDone;
+                if (&ThreadPool::current() == &group)
+                    ++jobsInGroup;
+            };
+
+        parallelMap(0, 10000, work);
+
+        {
+            // An empty name doesn't change the group
+            ResourceGroupScope scope2("");
+            BOOST_CHECK_EQUAL(&ThreadPool::current(), &group);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(&ThreadPool::current(), &ThreadPool::instance());
+    BOOST_CHECK_EQUAL(jobsDone.load(), 10000);
+    BOOST_CHECK_EQUAL(jobsInGroup.load(), 10000);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_map_numa)
+{
+    const NumaTopology & topology = numaTopology();
+    BOOST_REQUIRE_GE(topology.numNodes(), 1);
+    size_t numCpusInNodes = 0;
+    for (auto & cpus: topology.nodeCpus)
+        numCpusInNodes += cpus.size();
+    BOOST_CHECK_GE(numCpusInNodes, 1);
+    BOOST_CHECK_GE(currentNumaNode(), 0);
+    BOOST_CHECK_LT(currentNumaNode(), topology.numNodes());
+
+    std::vector<int> data(100000);
+    int node = numaNodeOfAddress(data.data());
+    BOOST_CHECK_LT(node, topology.numNodes());
+
+    // Every item is done exactly once, whatever the nodes say
+    std::vector<std::atomic<int> > done(1000);
+    for (auto & d: done)
+        d = 0;
+
+    auto nodeOf = [&] (size_t i) -> int
+        {
+            return i % 3 == 0 ? -1 : i % (topology.numNodes() + 1);
+        };
+
+    parallelMapNuma(0, done.size(), nodeOf,
+                    [&] (size_t i) { done[i] += 1; });
+
+    for (auto & d: done)
+        BOOST_CHECK_EQUAL(d.load(), 1);
+
+    BOOST_CHECK_THROW(parallelMapNuma(0, 100, nodeOf,
+                                      [&] (size_t i)
+                                      {
+                                          if (i == 50)
+                                              throw std::runtime_error("50");
+                                      }),
+                      std::runtime_error);
+}
+
 // For the purposes of the tests, we make integers pass
 // for pointers to avoid having to actually run jobs.
 // The value zero is reserved for "no value was available".
@@ -0,0 +1,88 @@
+/** trace_events_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the recording of trace spans.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/trace_events.h"
+#include "mldb/base/parallel.h"
+
+#include <boost/test/unit_test.hpp>
+#include <set>
+#include <thread>
+
+using namespace std;
+using namespace MLDB;
+
+static size_t countOf(const string & str, const string & what)
+{
+    size_t result = 0;
+    for (size_t pos = str.find(what);  pos != string::npos;
+         pos = str.find(what, pos + what.size()))
+        ++result;
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE (test_spans_only_while_recording)
+{
+    {
+        TraceSpan span("test", "before");
+    }
+
+    TraceEvents::start();
+    BOOST_CHECK(TraceEvents::enabled());
+    BOOST_CHECK_THROW(TraceEvents::start(), std::exception);
+
+    {
+        TraceSpan span("test", "outer", "with \"quotes\"\n");
+        TraceSpan span2("test", "inner");
+    }
+
+    string trace = TraceEvents::stop();
+    BOOST_CHECK(!TraceEvents::enabled());
+    {
+        TraceSpan span("test", "after");
+    }
+
+    BOOST_CHECK_EQUAL(trace.find("{\"traceEvents\":["), 0);
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"outer\""), 1);
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"inner\""), 1);
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"before\""), 0);
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"after\""), 0);
+    BOOST_CHECK_EQUAL(countOf(trace, "with \\\"quotes\\\"\\u000a"), 1);
+
+    // Nothing from the last trace is in the next one
+    TraceEvents::start();
+    trace = TraceEvents::stop();
+    BOOST_CHECK_EQUAL(countOf(trace, "\"ph\":\"X\""), 0);
+}
+
+BOOST_AUTO_TEST_CASE (test_spans_over_threads)
+{
+    TraceEvents::start();
+    parallelMap(0, 100, [] (size_t i)
+                {
+                    TraceSpan span("test", "work");
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                });
+    string trace = TraceEvents::stop();
+
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"work\""), 100);
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"parallelMap job\""), 100);
+}
+
+BOOST_AUTO_TEST_CASE (test_ring_buffer)
+{
+    TraceEvents::start();
+    size_t n = TraceEvents::MAX_SPANS_PER_THREAD + 100;
+    for (size_t i = 0;  i < n;  ++i) {
+        TraceSpan span("test", "many");
+    }
+    string trace = TraceEvents::stop();
+
+    BOOST_CHECK_EQUAL(countOf(trace, "\"name\":\"many\""),
+                      TraceEvents::MAX_SPANS_PER_THREAD);
+}
@@ -12,11 +12,16 @@
 #include "mldb/arch/thread_specific.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/jml/utils/environment.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/cpu_info.h"
+#include "mldb/base/metrics.h"
 #include <atomic>
 #include <condition_variable>
 #include <vector>
 #include <thread>
 #include <iostream>
+#include <map>
+#include <cmath>
 
 
 using namespace std;
@@ -32,6 +37,21 @@ int numCpus()
     return NUM_CPUS;
 }
 
+namespace {
+
+/// Resource group the current thread is running in, if any
+thread_local ThreadPool * currentResourceGroup = nullptr;
+
+/// Number of jobs enqueued or running within interactive resource groups
+std::atomic<int64_t> interactiveJobs(0);
+
+/// Pin each worker thread to a NUMA node on machines with more than one
+EnvOption<bool> MLDB_NUMA_PIN_THREADS("MLDB_NUMA_PIN_THREADS", true);
+
+void addPoolMetrics(const ThreadPool & pool, const std::string & name);
+
+} // file scope
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -67,6 +87,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         /// thread pool's epoch number, we can see if the list is out of
         /// date or not.
         uint64_t epoch;
+
+        /// NUMA node of the thread owning each queue
+        std::vector<int> nodes;
     };
 
     struct ThreadEntry {
@@ -74,7 +97,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
             : owner(owner), workerNum(workerNum),
               queue(new ThreadQueue<ThreadJob>()),
               queues(new Queues(0)),
-              lastFound(-1)
+              lastFound(-1),
+              numaNode(0)
         {
         }
 
@@ -113,6 +137,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
         /// The last queue number we found work in
         int lastFound;
+
+        /// The NUMA node that the thread runs on.  Worker threads are
+        /// pinned to it; for others it's where they were first seen.
+        int numaNode;
     };
 
     /// This allows us to have one threadEntry per thread
@@ -168,6 +196,16 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /// The maximum number of parallel jobs in the parent
     size_t maxParentJobs;
 
+    /// Number of NUMA nodes.  With more than one, stealing looks for work
+    /// on the thread's own node before the others.
+    int numNodes;
+
+    /// The resource group we're part of, or null if none
+    ThreadPool * group;
+
+    /// Priority class of our resource group
+    ResourcePriority priority;
+
     /** Return the number of jobs running.  If there are more than
         2^31 jobs running, this may give the wrong answer.
     */
@@ -201,7 +239,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
           queues(new Queues(threadCreationEpoch)),
           parent(nullptr),
           parentJobs(0),
-          maxParentJobs(0)
+          maxParentJobs(0),
+          numNodes(numaTopology().numNodes()),
+          group(nullptr),
+          priority(PRIORITY_INTERACTIVE)
     {
         submitted = 0;
         finished = 0;
@@ -223,7 +264,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
           queues(new Queues(threadCreationEpoch)),
           parent(&parent),
           parentJobs(0),
-          maxParentJobs(maxParentJobs)
+          maxParentJobs(maxParentJobs),
+          numNodes(numaTopology().numNodes()),
+          group(parent.group),
+          priority(parent.priority)
     {
         submitted = 0;
         finished = 0;
@@ -257,16 +301,56 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         if (!threadEntry->owner) {
             threadEntry->owner = this;
             threadEntry->workerNum = workerNum;
+            threadEntry->numaNode = currentNumaNode();
             publishThread(threadEntry);
         }
 
         return *threadEntry;
     }
 
+    /// Are our jobs counted as interactive work?
+    bool isInteractive() const
+    {
+        return group && priority == PRIORITY_INTERACTIVE;
+    }
+
+    /** Return the number of jobs that we may currently have running on
+        the parent.  A batch group is cut down to one whenever there is
+        interactive work, so that it keeps progressing but otherwise
+        leaves the CPUs to the interactive groups.
+    */
+    size_t parentJobLimit() const
+    {
+        if (priority == PRIORITY_BATCH
+            && interactiveJobs.load(std::memory_order_relaxed) > 0)
+            return 1;
+        return maxParentJobs;
+    }
+
     void runParentWorker()
     {
-        while (!shutdown && (this->work())) ;
+        ThreadPool * oldGroup = currentResourceGroup;
+        if (group)
+            currentResourceGroup = group;
+
+        while (!shutdown) {
+            // Give back our thread if we're over the limit, unless we're
+            // the last one running (which guarantees progress).
+            size_t numActive = parentJobs.load();
+            if (numActive > 1 && numActive > parentJobLimit()) {
+                if (parentJobs.compare_exchange_weak(numActive,
+                                                     numActive - 1)) {
+                    currentResourceGroup = oldGroup;
+                    return;
+                }
+                continue;
+            }
+            if (!this->work())
+                break;
+        }
         --this->parentJobs;
+
+        currentResourceGroup = oldGroup;
     }
 
     /** Add a new job to be run.  This is lock-free except for the very
@@ -280,6 +364,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     void add(ThreadJob job)
     {
         submitted += 1;
+        if (isInteractive())
+            interactiveJobs += 1;
 
         std::unique_ptr<ThreadJob> overflow
             (getEntry().queue->push(new ThreadJob(std::move(job))));
@@ -289,7 +375,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
                 // If there aren't enough jobs alredy, we submit a new
                 // one.
                 size_t numWereActive = parentJobs.fetch_add(1);
-                if (numWereActive >= maxParentJobs) {
+                if (numWereActive >= parentJobLimit()) {
                     --parentJobs;
                 }
                 else {
@@ -402,15 +488,25 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
             stealFrom(entry.lastFound);
         }
 
-        for (unsigned i = 0;  i < nq && !shutdown;  ++i) {
-            // Try to avoid all threads starting looking for work at the
-            // same place.
-            int n = entry.lastFound + i;
-            while (n < 0)
-                n += nq;
-            while (n >= nq)
-                n -= nq;
-            stealFrom(n);
+        // On a NUMA machine, the first pass only looks at queues of threads
+        // on our node, whose work is likely to use memory local to us.
+        // Only if there is nothing there do we look at the other nodes.
+        int numPasses = numNodes > 1 ? 2 : 1;
+
+        for (int pass = 0;  pass < numPasses && !foundWork;  ++pass) {
+            for (unsigned i = 0;  i < nq && !shutdown;  ++i) {
+                // Try to avoid all threads starting looking for work at the
+                // same place.
+                int n = entry.lastFound + i;
+                while (n < 0)
+                    n += nq;
+                while (n >= nq)
+                    n -= nq;
+                if (numPasses > 1
+                    && (entry.queues->nodes[n] == entry.numaNode) != (pass == 0))
+                    continue;
+                stealFrom(n);
+            }
         }
         
         return foundWork;
@@ -422,6 +518,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         try {
             job();
             finished += 1;
+            if (isInteractive())
+                interactiveJobs -= 1;
         } catch (const std::exception & exc) {
             finished += 1;
             cerr << "ERROR: job submitted to ThreadPool of type "
@@ -475,6 +573,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /** Run a worker thread. */
     void runWorker(int workerNum)
     {
+        // Spread the workers over the NUMA nodes, keeping each on one
+        if (numNodes > 1 && MLDB_NUMA_PIN_THREADS)
+            pinThreadToNumaNode(workerNum % numNodes);
+
         ThreadEntry & entry = getEntry(workerNum);
 
         int itersWithNoWork = 0;
@@ -559,6 +661,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         } while (newQueues->epoch == 0);
 
         newQueues->emplace_back(thread->queue);
+        newQueues->nodes.push_back(thread->numaNode);
         queues = std::move(newQueues);
     }
 
@@ -593,6 +696,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         for (auto it = newQueues->begin(), end = newQueues->end();
              !foundThreadToUnpublish && it != end;  ++it) {
             if (*it == thread->queue) {
+                newQueues->nodes.erase(newQueues->nodes.begin()
+                                       + (it - newQueues->begin()));
                 newQueues->erase(it);
                 foundThreadToUnpublish = true;
             }
@@ -714,7 +819,210 @@ ThreadPool::
 instance()
 {
     static ThreadPool result(numCpus());
+    static bool metricsAdded = (addPoolMetrics(result, "default"), true);
+    (void)metricsAdded;
     return result;
 }
 
+ThreadPool &
+ThreadPool::
+current()
+{
+    if (currentResourceGroup)
+        return *currentResourceGroup;
+    return instance();
+}
+
+
+/*****************************************************************************/
+/* RESOURCE GROUPS                                                           */
+/*****************************************************************************/
+
+namespace {
+
+EnvOption<std::string> MLDB_RESOURCE_GROUPS("MLDB_RESOURCE_GROUPS", "");
+
+struct ResourceGroups {
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<ThreadPool> > groups;
+};
+
+ResourcePriority parseResourcePriority(const std::string & str)
+{
+    if (str == "interactive")
+        return PRIORITY_INTERACTIVE;
+    else if (str == "batch")
+        return PRIORITY_BATCH;
+    throw MLDB::Exception("Unknown resource group priority class '" + str
+                          + "': accepted are 'interactive' and 'batch'");
+}
+
+ResourceGroups & getResourceGroups()
+{
+    // Never destroyed, as jobs may still be running in the groups when
+    // static objects are destroyed.
+    static ResourceGroups * result = new ResourceGroups();
+    return *result;
+}
+
+/** Export the statistics of a pool, which lives until the program exits,
+    as metrics labelled with its name.
+*/
+void addPoolMetrics(const ThreadPool & pool, const std::string & name)
+{
+    static std::mutex mutex;
+    static auto * handles = new std::vector<std::shared_ptr<void> >();
+
+    MetricLabels labels{{"pool", name}};
+    const ThreadPool * p = &pool;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    handles->push_back(Metrics::addCallback
+        ("mldb_thread_pool_threads", "Number of threads of the pool",
+         [=] () { return p->numThreads(); }, labels));
+    handles->push_back(Metrics::addCallback
+        ("mldb_thread_pool_jobs", "Number of jobs queued or running",
+         [=] () { return p->jobsRunning(); }, labels));
+    handles->push_back(Metrics::addCallback
+        ("mldb_thread_pool_jobs_stolen_total",
+         "Jobs run by a thread other than the one that queued them",
+         [=] () { return p->jobsStolen(); }, labels, true /* counter */));
+    handles->push_back(Metrics::addCallback
+        ("mldb_thread_pool_jobs_with_full_queue_total",
+         "Jobs that were submitted when the queue was full",
+         [=] () { return p->jobsWithFullQueue(); }, labels, true));
+    handles->push_back(Metrics::addCallback
+        ("mldb_thread_pool_jobs_run_locally_total",
+         "Jobs run by the thread that submitted them",
+         [=] () { return p->jobsRunLocally(); }, labels, true));
+}
+
+} // file scope
+
+/// Create the built in groups and those from the environment
+void
+ThreadPool::
+initResourceGroups()
+{
+    static std::once_flag once;
+    auto init = [] ()
+        {
+            ThreadPool::addResourceGroup("interactive", 1.0,
+                                         PRIORITY_INTERACTIVE);
+            ThreadPool::addResourceGroup("batch", 1.0, PRIORITY_BATCH);
+
+            std::string spec = MLDB_RESOURCE_GROUPS;
+            size_t pos = 0;
+            while (pos < spec.size()) {
+                size_t end = spec.find(',', pos);
+                if (end == std::string::npos)
+                    end = spec.size();
+                std::string entry(spec, pos, end - pos);
+                pos = end + 1;
+                if (entry.empty())
+                    continue;
+
+                size_t colon1 = entry.find(':');
+                size_t colon2 = colon1 == std::string::npos
+                    ? colon1 : entry.find(':', colon1 + 1);
+                if (colon2 == std::string::npos)
+                    throw MLDB::Exception("Resource group '" + entry
+                                          + "' in MLDB_RESOURCE_GROUPS "
+                                          "should be name:share:class");
+                ThreadPool::addResourceGroup
+                    (entry.substr(0, colon1),
+                     std::stod(entry.substr(colon1 + 1, colon2 - colon1 - 1)),
+                     parseResourcePriority(entry.substr(colon2 + 1)));
+            }
+        };
+    std::call_once(once, init);
+}
+
+ThreadPool &
+ThreadPool::
+createResourceGroup(const std::string & name,
+                    double cpuShare,
+                    ResourcePriority priority)
+{
+    initResourceGroups();
+    return addResourceGroup(name, cpuShare, priority);
+}
+
+ThreadPool &
+ThreadPool::
+addResourceGroup(const std::string & name,
+                 double cpuShare,
+                 ResourcePriority priority)
+{
+    if (name.empty())
+        throw MLDB::Exception("Resource groups need a name");
+    if (!(cpuShare > 0.0))
+        throw MLDB::Exception("Resource group '" + name
+                              + "' needs a positive CPU share");
+
+    ResourceGroups & groups = getResourceGroups();
+    std::unique_lock<std::mutex> guard(groups.mutex);
+    if (groups.groups.count(name))
+        throw MLDB::Exception("Resource group '" + name + "' already exists");
+
+    int maxJobs = std::max<int>(1, std::lround(cpuShare * numCpus()));
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(instance(), maxJobs));
+    pool->itl->group = pool.get();
+    pool->itl->priority = priority;
+
+    ThreadPool & result = *pool;
+    groups.groups[name] = std::move(pool);
+    addPoolMetrics(result, name);
+    return result;
+}
+
+ThreadPool *
+ThreadPool::
+getResourceGroup(const std::string & name)
+{
+    initResourceGroups();
+    ResourceGroups & groups = getResourceGroups();
+    std::unique_lock<std::mutex> guard(groups.mutex);
+    auto it = groups.groups.find(name);
+    if (it == groups.groups.end())
+        return nullptr;
+    return it->second.get();
+}
+
+std::vector<std::string>
+ThreadPool::
+resourceGroups()
+{
+    initResourceGroups();
+    ResourceGroups & groups = getResourceGroups();
+    std::unique_lock<std::mutex> guard(groups.mutex);
+    std::vector<std::string> result;
+    for (auto & g: groups.groups)
+        result.push_back(g.first);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* RESOURCE GROUP SCOPE                                                      */
+/*****************************************************************************/
+
+ResourceGroupScope::
+ResourceGroupScope(const std::string & name)
+    : previous(currentResourceGroup)
+{
+    if (name.empty())
+        return;
+    ThreadPool * group = ThreadPool::getResourceGroup(name);
+    if (!group)
+        throw MLDB::Exception("Unknown resource group '" + name + "'");
+    currentResourceGroup = group;
+}
+
+ResourceGroupScope::
+~ResourceGroupScope()
+{
+    currentResourceGroup = previous;
+}
+
 } // namespace MLDB
@@ -12,6 +12,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace MLDB {
 
@@ -20,6 +22,15 @@ typedef std::function<void () noexcept> ThreadJob;
 /** Return the number of CPUs in the system. */
 int numCpus();
 
+/** Priority class of a resource group (see ThreadPool::createResourceGroup).
+    Batch groups give up all but one of their threads whenever there is
+    work running in an interactive group.
+*/
+enum ResourcePriority {
+    PRIORITY_INTERACTIVE,
+    PRIORITY_BATCH
+};
+
 
 /*****************************************************************************/
 /* THREAD POOL                                                               */
@@ -30,7 +41,7 @@ int numCpus();
 */
 
 struct ThreadPool {
-    ThreadPool(ThreadPool & parent = instance(), int numThreads = numCpus());
+    ThreadPool(ThreadPool & parent = current(), int numThreads = numCpus());
     ThreadPool(int numThreads);
     ~ThreadPool();
 
@@ -68,10 +79,69 @@ struct ThreadPool {
     uint64_t jobsRunLocally() const;
 
     static ThreadPool & instance();
-    
+
+    /** Return the pool that new pools created without an explicit parent
+        (for example those of parallelMap) run their work on.  This is the
+        resource group of the current thread (see ResourceGroupScope), or
+        instance() if it's not in one.
+    */
+    static ThreadPool & current();
+
+    /** Create a named resource group: a pool attached to instance() that
+        runs at most cpuShare * numCpus() jobs (and at least one) on it
+        at once, and has the given priority class.  Resource groups live
+        until the program exits.
+
+        The groups "interactive" and "batch" always exist, each with a
+        share of 1.  Others can be created on startup with the
+        MLDB_RESOURCE_GROUPS environment variable, which is a comma
+        separated list of name:share:class, for example
+        "online:0.25:interactive,training:0.75:batch".
+
+        Throws if there is already a group with that name.
+    */
+    static ThreadPool & createResourceGroup(const std::string & name,
+                                            double cpuShare,
+                                            ResourcePriority priority);
+
+    /** Return the resource group with the given name, or null if there is
+        none.
+    */
+    static ThreadPool * getResourceGroup(const std::string & name);
+
+    /** Return the names of all resource groups. */
+    static std::vector<std::string> resourceGroups();
+
 private:
     struct Itl;
     std::shared_ptr<Itl> itl;
+
+    static void initResourceGroups();
+    static ThreadPool & addResourceGroup(const std::string & name,
+                                         double cpuShare,
+                                         ResourcePriority priority);
+};
+
+
+/*****************************************************************************/
+/* RESOURCE GROUP SCOPE                                                      */
+/*****************************************************************************/
+
+/** Makes the current thread run in the named resource group for as long as
+    the object exists, so that parallel work it starts is accounted to
+    that group.  An empty name leaves the current group as it is.  Throws
+    if there is no group with that name.
+*/
+
+struct ResourceGroupScope {
+    explicit ResourceGroupScope(const std::string & name);
+    ~ResourceGroupScope();
+
+    ResourceGroupScope(const ResourceGroupScope &) = delete;
+    void operator = (const ResourceGroupScope &) = delete;
+
+private:
+    ThreadPool * previous;
 };
 
 } // namespace MLDB
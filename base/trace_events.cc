@@ -0,0 +1,323 @@
+/** trace_events.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Timeline of what each thread is doing.
+*/
+
+#include "trace_events.h"
+#include "mldb/arch/exception.h"
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+
+namespace MLDB {
+
+std::atomic<bool> traceEventsEnabled(false);
+
+namespace {
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Span {
+    const char * category;
+    const char * name;
+    std::string detail;
+    int64_t startNs;
+    int64_t endNs;
+};
+
+/** Spans recorded by one thread.  Only its thread writes to it, except
+    that stop() reads it, so the lock is never contended while tracing.
+*/
+struct ThreadSpans {
+    std::mutex mutex;
+    std::vector<Span> spans;    ///< Ring buffer, once it's full
+    uint64_t numRecorded = 0;
+    uint64_t session = 0;       ///< Session that the spans belong to
+    int tid = 0;
+    std::string threadName;
+    bool finished = false;      ///< The thread has exited
+
+    void add(uint64_t currentSession, Span span)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (session != currentSession) {
+            spans.clear();
+            numRecorded = 0;
+            session = currentSession;
+        }
+        if (spans.size() < TraceEvents::MAX_SPANS_PER_THREAD)
+            spans.emplace_back(std::move(span));
+        else spans[numRecorded % TraceEvents::MAX_SPANS_PER_THREAD]
+                 = std::move(span);
+        ++numRecorded;
+    }
+};
+
+/// Everything about the recording that isn't per thread
+struct Recording {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadSpans> > threads;
+    int nextTid = 1;
+    std::atomic<uint64_t> session { 0 };
+    int64_t startNs = 0;
+};
+
+Recording & recording()
+{
+    static Recording * result = new Recording();
+    return *result;
+}
+
+/// Marks the spans of a thread as finished when the thread exits, so that
+/// they can be dropped once they've been read
+struct ThreadSpansHolder {
+    std::shared_ptr<ThreadSpans> spans;
+
+    ~ThreadSpansHolder()
+    {
+        if (!spans)
+            return;
+        std::unique_lock<std::mutex> guard(spans->mutex);
+        spans->finished = true;
+    }
+};
+
+thread_local ThreadSpansHolder currentThreadSpans;
+
+ThreadSpans & threadSpans()
+{
+    if (!currentThreadSpans.spans) {
+        auto spans = std::make_shared<ThreadSpans>();
+        char name[64];
+        if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0)
+            spans->threadName = name;
+
+        Recording & rec = recording();
+        std::unique_lock<std::mutex> guard(rec.mutex);
+        spans->tid = rec.nextTid++;
+        rec.threads.push_back(spans);
+        currentThreadSpans.spans = std::move(spans);
+    }
+    return *currentThreadSpans.spans;
+}
+
+void appendJsonString(std::string & out, const char * str, size_t len)
+{
+    out += '"';
+    for (size_t i = 0;  i < len;  ++i) {
+        char c = str[i];
+        if (c == '"')
+            out += "\\\"";
+        else if (c == '\\')
+            out += "\\\\";
+        else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+            out += buf;
+        }
+        else out += c;
+    }
+    out += '"';
+}
+
+void appendJsonString(std::string & out, const std::string & str)
+{
+    appendJsonString(out, str.data(), str.size());
+}
+
+void appendJsonString(std::string & out, const char * str)
+{
+    appendJsonString(out, str, strlen(str));
+}
+
+/// Is a trace being recorded (or being read by stop())?
+std::atomic<bool> recordingInProgress(false);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* TRACE EVENTS                                                              */
+/*****************************************************************************/
+
+constexpr size_t TraceEvents::MAX_SPANS_PER_THREAD;
+
+std::string
+TraceEvents::
+record(double seconds)
+{
+    if (!(seconds > 0 && seconds <= 3600))
+        throw Exception("Tracing time must be between 0 and 3600 seconds");
+
+    start();
+    try {
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    } catch (...) {
+        stop();
+        throw;
+    }
+    return stop();
+}
+
+void
+TraceEvents::
+start()
+{
+    if (recordingInProgress.exchange(true))
+        throw Exception("A trace is already being recorded");
+
+    Recording & rec = recording();
+    {
+        std::unique_lock<std::mutex> guard(rec.mutex);
+        rec.startNs = nowNs();
+    }
+    // Spans recorded under an older session are thrown away when their
+    // thread next records one
+    rec.session.fetch_add(1);
+    traceEventsEnabled.store(true);
+}
+
+std::string
+TraceEvents::
+stop()
+{
+    if (!enabled())
+        throw Exception("No trace is being recorded");
+
+    traceEventsEnabled.store(false);
+
+    Recording & rec = recording();
+    uint64_t session = rec.session.load();
+
+    std::vector<std::shared_ptr<ThreadSpans> > threads;
+    int64_t startNs;
+    {
+        std::unique_lock<std::mutex> guard(rec.mutex);
+        threads = rec.threads;
+        startNs = rec.startNs;
+    }
+
+    std::string result = "{\"traceEvents\":[";
+    bool first = true;
+    char buf[128];
+    int pid = getpid();
+
+    auto addSpan = [&] (const ThreadSpans & thread, const Span & span)
+        {
+            if (!first)
+                result += ",\n";
+            first = false;
+            result += "{\"ph\":\"X\",\"cat\":";
+            appendJsonString(result, span.category);
+            result += ",\"name\":";
+            appendJsonString(result, span.name);
+            snprintf(buf, sizeof(buf),
+                     ",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                     pid, thread.tid,
+                     (span.startNs - startNs) / 1000.0,
+                     (span.endNs - span.startNs) / 1000.0);
+            result += buf;
+            if (!span.detail.empty()) {
+                result += ",\"args\":{\"detail\":";
+                appendJsonString(result, span.detail);
+                result += "}";
+            }
+            result += "}";
+        };
+
+    for (auto & thread: threads) {
+        std::unique_lock<std::mutex> guard(thread->mutex);
+        if (thread->session != session || thread->spans.empty()) {
+            thread->spans.clear();
+            continue;
+        }
+
+        if (!first)
+            result += ",\n";
+        first = false;
+        snprintf(buf, sizeof(buf),
+                 "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+                 "\"tid\":%d,\"args\":{\"name\":", pid, thread->tid);
+        result += buf;
+        appendJsonString(result, thread->threadName.empty()
+                         ? "thread " + std::to_string(thread->tid)
+                         : thread->threadName);
+        result += "}}";
+
+        // Oldest first
+        size_t n = thread->spans.size();
+        size_t firstIndex = thread->numRecorded % n;
+        if (thread->numRecorded <= n)
+            firstIndex = 0;
+        for (size_t i = 0;  i < n;  ++i)
+            addSpan(*thread, thread->spans[(firstIndex + i) % n]);
+
+        // Give back the memory until the next trace
+        thread->spans.clear();
+        thread->spans.shrink_to_fit();
+        thread->numRecorded = 0;
+    }
+
+    result += "],\"displayTimeUnit\":\"ms\"}\n";
+
+    // Drop the threads that have gone
+    {
+        std::unique_lock<std::mutex> guard(rec.mutex);
+        std::vector<std::shared_ptr<ThreadSpans> > live;
+        for (auto & thread: rec.threads) {
+            std::unique_lock<std::mutex> guard2(thread->mutex);
+            if (!thread->finished)
+                live.push_back(thread);
+        }
+        rec.threads.swap(live);
+    }
+
+    recordingInProgress.store(false);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* TRACE SPAN                                                                */
+/*****************************************************************************/
+
+void
+TraceSpan::
+begin(const char * category, const char * name, const std::string * detail)
+{
+    this->category = category;
+    this->name = name;
+    if (detail)
+        this->detail = *detail;
+    session = recording().session.load(std::memory_order_relaxed);
+    startNs = nowNs();
+}
+
+void
+TraceSpan::
+end()
+{
+    int64_t endNs = nowNs();
+
+    // Spans that were still open when the trace stopped are left out
+    if (!TraceEvents::enabled()
+        || recording().session.load(std::memory_order_relaxed) != session)
+        return;
+
+    threadSpans().add(session,
+                      Span{category, name, std::move(detail), startNs, endNs});
+}
+
+} // namespace MLDB
@@ -0,0 +1,109 @@
+/** trace_events.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Timeline of what each thread is doing, exported as Chrome trace events.
+
+    Code marks the work it does with a TraceSpan on the stack.  While no
+    trace is being recorded a span costs a relaxed load of a flag; while
+    one is, it reads the clock when it starts and ends and then writes into
+    a ring buffer that belongs to its thread, so that threads don't contend
+    with each other.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace MLDB {
+
+/// Is a trace being recorded?
+extern std::atomic<bool> traceEventsEnabled;
+
+
+/*****************************************************************************/
+/* TRACE EVENTS                                                              */
+/*****************************************************************************/
+
+/** Recording of the spans of all threads of the process. */
+
+struct TraceEvents {
+
+    /** Record for the given number of seconds, and return what was recorded
+        (see stop()).  The calling thread sleeps while the trace is taken.
+    */
+    static std::string record(double seconds);
+
+    /** Start recording.  Only one trace can be recorded at a time; this
+        throws if another is.
+    */
+    static void start();
+
+    /** Stop recording, and return the spans that finished while it was
+        going on as a trace event JSON object, which can be loaded into
+        chrome://tracing or Perfetto.  Each span is a complete ("X") event
+        on the thread that it was on, with its time in microseconds since
+        start() was called.
+    */
+    static std::string stop();
+
+    /** Is a trace being recorded? */
+    static bool enabled()
+    {
+        return traceEventsEnabled.load(std::memory_order_relaxed);
+    }
+
+    /// Number of spans kept for each thread; after that, the oldest go
+    static constexpr size_t MAX_SPANS_PER_THREAD = 1 << 16;
+};
+
+
+/*****************************************************************************/
+/* TRACE SPAN                                                                */
+/*****************************************************************************/
+
+/** Records the time between its construction and destruction as a span
+    in the trace, if one is being recorded.  The category and name must be
+    string literals (or otherwise outlive the trace); the detail, which
+    goes into the event's arguments, is copied, but only while tracing.
+*/
+
+struct TraceSpan {
+    TraceSpan(const char * category, const char * name)
+        : category(nullptr)
+    {
+        if (TraceEvents::enabled())
+            begin(category, name, nullptr);
+    }
+
+    TraceSpan(const char * category, const char * name,
+              const std::string & detail)
+        : category(nullptr)
+    {
+        if (TraceEvents::enabled())
+            begin(category, name, &detail);
+    }
+
+    ~TraceSpan()
+    {
+        if (category)
+            end();
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    void operator = (const TraceSpan &) = delete;
+
+private:
+    void begin(const char * category, const char * name,
+               const std::string * detail);
+    void end();
+
+    const char * category;   ///< Null if the span isn't being recorded
+    const char * name;
+    std::string detail;
+    uint64_t session;
+    int64_t startNs;
+};
+
+} // namespace MLDB
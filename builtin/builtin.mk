@@ -8,6 +8,10 @@ LIBMLDB_BUILTIN_SOURCES:= \
 	filtered_dataset.cc \
 	sampled_dataset.cc \
 	union_dataset.cc \
+	partitioned_dataset.cc \
+	materialized_dataset.cc \
+	distributed_dataset.cc \
+	replica_dataset.cc \
 
 LIBMLDB_BUILTIN_LINK:= mldb_core runner
 
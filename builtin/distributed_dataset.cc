@@ -0,0 +1,368 @@
+/** distributed_dataset.cc                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Dataset made of shards on peers, with scatter-gather query execution.
+*/
+
+#include "distributed_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/sql/sql_expression.h"
+#include "sub_dataset.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET CONFIG                                                */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(DistributedShardConfig);
+
+DistributedShardConfigDescription::
+DistributedShardConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("peer", &DistributedShardConfig::peer,
+             "Name of the MLDB peer holding the shard.  If empty, the shard "
+             "is on this server.");
+    addField("dataset", &DistributedShardConfig::dataset,
+             "Name of the dataset holding the shard on the peer");
+    addField("replicas", &DistributedShardConfig::replicas,
+             "Other peers that hold a copy of the same dataset, under the "
+             "same name.  Each query of the shard is sent to whichever of "
+             "the peer and its replicas is the least loaded and closest, "
+             "and to another one if it can't be reached.");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(DistributedDatasetConfig);
+
+DistributedDatasetConfigDescription::
+DistributedDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("shards", &DistributedDatasetConfig::shards,
+             "Shards of the dataset");
+    addField("timeout", &DistributedDatasetConfig::timeout,
+             "Number of seconds to wait for a shard to answer a query",
+             600.0);
+}
+
+
+namespace {
+
+/// Can the ORDER BY be run on the rows of a shard instead of on the output
+/// of the SELECT?  That's not the case when it reads a column that the
+/// SELECT renames or calculates.
+bool orderByReadsInput(const SelectExpression & select,
+                       const UnboundEntities & orderByUnbound)
+{
+    if (!orderByUnbound.tables.empty() || !orderByUnbound.wildcards.empty())
+        return false;
+
+    for (auto & clause: select.clauses) {
+        if (auto wildcard
+            = dynamic_cast<const WildcardExpression *>(clause.get())) {
+            if (wildcard->prefix != wildcard->asPrefix)
+                return false;
+            continue;
+        }
+
+        auto named = dynamic_cast<const NamedColumnExpression *>(clause.get());
+        if (!named)
+            return false;
+
+        auto read = dynamic_cast<const ReadColumnExpression *>
+            (named->expression.get());
+        if (read && read->columnName == named->alias)
+            continue;
+
+        for (auto & v: orderByUnbound.vars) {
+            if (v.first.startsWith(named->alias)
+                || named->alias.startsWith(v.first))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET                                                       */
+/*****************************************************************************/
+
+struct DistributedDataset::Itl {
+
+    Itl(MldbServer * server, const DistributedDatasetConfig & config)
+        : server(server), config(config)
+    {
+        if (config.shards.empty())
+            throw HttpReturnException
+                (400, "Distributed dataset needs at least one shard");
+        for (auto & s: config.shards) {
+            if (s.dataset.empty())
+                throw HttpReturnException
+                    (400, "Shard of distributed dataset needs a dataset name",
+                     "peer", s.peer);
+        }
+    }
+
+    MldbServer * server;
+    DistributedDatasetConfig config;
+
+    mutable std::mutex snapshotMutex;
+    mutable std::shared_ptr<Dataset> snapshot;
+
+    /** Run the query on each shard in parallel, and return all of the
+        rows.  The query text is given the FROM clause of the shard.
+    */
+    std::vector<NamedRowValue>
+    gather(const Utf8String & select, const Utf8String & alias,
+           const Utf8String & rest) const
+    {
+        std::vector<std::vector<NamedRowValue> > shardRows(config.shards.size());
+
+        auto doShard = [&] (size_t i)
+            {
+                auto & shard = config.shards[i];
+                Utf8String query = "SELECT " + select + " NAMED rowPath() FROM "
+                    + PathElement(shard.dataset).toEscapedUtf8String();
+                if (!alias.empty())
+                    query += " AS " + PathElement(alias).toEscapedUtf8String();
+                query += rest;
+                std::vector<std::string> peers = { shard.peer };
+                peers.insert(peers.end(), shard.replicas.begin(),
+                             shard.replicas.end());
+                shardRows[i] = server->queryReplicas(peers, query,
+                                                     config.timeout);
+            };
+
+        parallelMap(0, config.shards.size(), doShard);
+
+        std::vector<NamedRowValue> result;
+        for (auto & rows: shardRows) {
+            for (auto & r: rows)
+                result.emplace_back(std::move(r));
+        }
+        return result;
+    }
+
+    /** Return a dataset holding the rows of the shards that the query
+        needs to see, so that running the query on it gives the same
+        result as running it on all of the rows.
+    */
+    std::shared_ptr<Dataset>
+    scatter(const SelectExpression & select,
+            const WhenExpression & when,
+            const SqlExpression & where,
+            const OrderByExpression & orderBy,
+            const TupleExpression & groupBy,
+            const std::shared_ptr<SqlExpression> & having,
+            const std::shared_ptr<SqlExpression> & rowName,
+            ssize_t offset,
+            ssize_t limit,
+            const Utf8String & alias) const
+    {
+        UnboundEntities unbound = select.getUnbound();
+        unbound.merge(when.getUnbound());
+        unbound.merge(where.getUnbound());
+        unbound.merge(orderBy.getUnbound());
+        unbound.merge(groupBy.getUnbound());
+        unbound.merge(having->getUnbound());
+        unbound.merge(rowName->getUnbound());
+
+        // Query parameters are only known here, so nothing that could read
+        // one is sent to the shards
+        bool canPushDown = unbound.params.empty();
+
+        // Only the columns that the query reads are fetched, unless it
+        // reads them through a wildcard, a table name or the whole row
+        Utf8String columns = "*";
+        if (unbound.wildcards.empty() && unbound.tables.empty()
+            && !unbound.hasRowFunctions()) {
+            columns = "";
+            for (auto & v: unbound.vars) {
+                if (v.first.empty())
+                    continue;
+                if (!columns.empty())
+                    columns += ", ";
+                columns += v.first.toUtf8String();
+            }
+            if (columns.empty())
+                columns = "*";
+        }
+
+        Utf8String rest;
+
+        // Rows that fail the WHERE on the shard would fail it here too, so
+        // it's safe to filter them out there as well
+        if (canPushDown && !where.isConstantTrue() && !where.surface.empty())
+            rest += " WHERE " + where.surface;
+
+        // The first offset + limit rows of each shard include the first
+        // offset + limit rows overall, as the shards and this dataset
+        // break ties in the ordering the same way (by row hash).
+        bool isGrouped = !groupBy.clauses.empty()
+            || !select.findAggregators(false).empty();
+        if (canPushDown && limit != -1 && !isGrouped
+            && when.when->isConstantTrue()
+            && !orderBy.surface.empty() && !orderBy.clauses.empty()
+            && orderByReadsInput(select, orderBy.getUnbound())) {
+            rest += " ORDER BY " + orderBy.surface
+                + " LIMIT " + std::to_string(offset + limit);
+        }
+
+        return std::make_shared<SubDataset>(server,
+                                            gather(columns, alias, rest));
+    }
+
+    /// Return a copy of all of the rows of all of the shards
+    std::shared_ptr<Dataset> getSnapshot() const
+    {
+        std::unique_lock<std::mutex> guard(snapshotMutex);
+        if (!snapshot)
+            snapshot = std::make_shared<SubDataset>(server,
+                                                    gather("*", "", ""));
+        return snapshot;
+    }
+};
+
+DistributedDataset::
+DistributedDataset(MldbServer * owner,
+                   PolyConfig config,
+                   const ProgressFunc & onProgress)
+    : Dataset(owner)
+{
+    auto distributedConfig = config.params.convert<DistributedDatasetConfig>();
+    itl.reset(new Itl(server, distributedConfig));
+}
+
+DistributedDataset::
+~DistributedDataset()
+{
+}
+
+Any
+DistributedDataset::
+getStatus() const
+{
+    Json::Value result;
+    result["numShards"] = (Json::UInt)itl->config.shards.size();
+    return result;
+}
+
+void
+DistributedDataset::
+commit()
+{
+    // The shards are committed on their own peers; this just makes sure
+    // that anything that works on a copy of the rows sees the new ones.
+    {
+        std::unique_lock<std::mutex> guard(itl->snapshotMutex);
+        itl->snapshot.reset();
+    }
+    Dataset::commit();
+}
+
+std::shared_ptr<MatrixView>
+DistributedDataset::
+getMatrixView() const
+{
+    return itl->getSnapshot()->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+DistributedDataset::
+getColumnIndex() const
+{
+    return itl->getSnapshot()->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+DistributedDataset::
+getRowStream() const
+{
+    return itl->getSnapshot()->getRowStream();
+}
+
+ExpressionValue
+DistributedDataset::
+getRowExpr(const RowPath & row) const
+{
+    return itl->getSnapshot()->getRowExpr(row);
+}
+
+std::pair<Date, Date>
+DistributedDataset::
+getTimestampRange() const
+{
+    return itl->getSnapshot()->getTimestampRange();
+}
+
+std::shared_ptr<ExpressionValueInfo>
+DistributedDataset::
+queryStructuredStream(const std::function<bool (NamedRowValue &)> & onRow,
+                      const SelectExpression & select,
+                      const WhenExpression & when,
+                      const SqlExpression & where,
+                      const OrderByExpression & orderBy,
+                      const TupleExpression & groupBy,
+                      const std::shared_ptr<SqlExpression> having,
+                      const std::shared_ptr<SqlExpression> rowName,
+                      ssize_t offset,
+                      ssize_t limit,
+                      Utf8String alias,
+                      const ProgressFunc & onProgress) const
+{
+    auto rows = itl->scatter(select, when, where, orderBy, groupBy,
+                             having, rowName, offset, limit, alias);
+    return rows->queryStructuredStream(onRow, select, when, where, orderBy,
+                                       groupBy, having, rowName,
+                                       offset, limit, alias, onProgress);
+}
+
+bool
+DistributedDataset::
+queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                           const SelectExpression & select,
+                           const WhenExpression & when,
+                           const SqlExpression & where,
+                           const OrderByExpression & orderBy,
+                           const TupleExpression & groupBy,
+                           const std::shared_ptr<SqlExpression> having,
+                           const std::shared_ptr<SqlExpression> rowName,
+                           ssize_t offset,
+                           ssize_t limit,
+                           Utf8String alias,
+                           const ProgressFunc & onProgress) const
+{
+    auto rows = itl->scatter(select, when, where, orderBy, groupBy,
+                             having, rowName, offset, limit, alias);
+    return rows->queryStructuredIncremental(onRow, select, when, where,
+                                            orderBy, groupBy, having, rowName,
+                                            offset, limit, alias, onProgress);
+}
+
+static RegisterDatasetType<DistributedDataset, DistributedDatasetConfig>
+regDistributed(builtinPackage(),
+               "distributed",
+               "Dataset made of shards on other MLDB servers, whose queries "
+               "are run on the shards and their results merged",
+               "datasets/DistributedDataset.md.html");
+
+} // namespace MLDB
@@ -0,0 +1,125 @@
+/** distributed_dataset.h                                          -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Dataset whose shards live on other MLDB servers, which are queried over
+    the peer to peer links.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* DISTRIBUTED SHARD CONFIG                                                  */
+/*****************************************************************************/
+
+/** Configuration of a single shard: a dataset on a peer. */
+
+struct DistributedShardConfig {
+    /// Name of the peer holding the shard.  Empty means this server.
+    std::string peer;
+
+    /// Name of the dataset on the peer
+    Utf8String dataset;
+
+    /// Other peers with a copy of the same dataset under the same name.
+    /// Each query of the shard goes to one of them or to the peer.
+    std::vector<std::string> replicas;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(DistributedShardConfig);
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET CONFIG                                                */
+/*****************************************************************************/
+
+struct DistributedDatasetConfig {
+    std::vector<DistributedShardConfig> shards;
+
+    /// Number of seconds to wait for a shard to answer a query
+    double timeout = 600.0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(DistributedDatasetConfig);
+
+
+/*****************************************************************************/
+/* DISTRIBUTED DATASET                                                       */
+/*****************************************************************************/
+
+/** Dataset made of shards on other MLDB servers.  A query of the dataset
+    is planned here; the WHERE clause, the columns it needs and, where it's
+    safe, the ORDER BY and LIMIT are sent to each shard, and the rows they
+    return are put together and the query finished off here.  A row must
+    only be in one shard.
+
+    Anything else that needs the rows (joins, the matrix view, etc) works
+    on a copy of all of the shards, which is taken the first time that it's
+    needed and dropped by commit().
+*/
+
+struct DistributedDataset: public Dataset {
+
+    DistributedDataset(MldbServer * owner,
+                       PolyConfig config,
+                       const ProgressFunc & onProgress);
+
+    virtual ~DistributedDataset();
+
+    virtual Any getStatus() const;
+    virtual void recordRowItl(const RowPath & rowName,
+          const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+    {
+        throw MLDB::Exception("Dataset type doesn't allow recording");
+    }
+
+    virtual void commit();
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
+    virtual std::shared_ptr<RowStream> getRowStream() const;
+
+    virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    virtual std::pair<Date, Date> getTimestampRange() const;
+
+    virtual std::shared_ptr<ExpressionValueInfo>
+    queryStructuredStream(const std::function<bool (NamedRowValue &)> & onRow,
+                          const SelectExpression & select,
+                          const WhenExpression & when,
+                          const SqlExpression & where,
+                          const OrderByExpression & orderBy,
+                          const TupleExpression & groupBy,
+                          const std::shared_ptr<SqlExpression> having,
+                          const std::shared_ptr<SqlExpression> rowName,
+                          ssize_t offset,
+                          ssize_t limit,
+                          Utf8String alias = "",
+                          const ProgressFunc & onProgress = nullptr) const;
+
+    virtual bool
+    queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
+                               const SelectExpression & select,
+                               const WhenExpression & when,
+                               const SqlExpression & where,
+                               const OrderByExpression & orderBy,
+                               const TupleExpression & groupBy,
+                               const std::shared_ptr<SqlExpression> having,
+                               const std::shared_ptr<SqlExpression> rowName,
+                               ssize_t offset,
+                               ssize_t limit,
+                               Utf8String alias = "",
+                               const ProgressFunc & onProgress = nullptr) const;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -210,8 +210,14 @@ struct IdHashes {
 
         }
 
-        const_iterator(const IdHashes* source) : source(source), bucket(0)
+        /** Iterator at the first entry of the given bucket or of the next
+            non-empty one after it, or at the end if there are none.
+        */
+        const_iterator(const IdHashes* source, size_t bucket = 0)
+            : source(source), bucket(bucket)
         {
+            if (bucket == NBUCKETS)
+                return;
             bucketIter = source->buckets[bucket].begin();
             while (bucketIter == source->buckets[bucket].end())
             {
@@ -249,6 +255,14 @@ struct IdHashes {
     {
         return const_iterator(this);
     }
+
+    /** Iterator at the first entry of the given bucket; see
+        const_iterator.
+    */
+    const_iterator beginBucket(size_t bucket) const
+    {
+        return const_iterator(this, bucket);
+    }
 };
 
 } // namespace MLDB
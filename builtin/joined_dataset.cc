@@ -15,6 +15,9 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/jml/utils/profile.h"
 #include "mldb/sql/join_utils.h"
+#include "mldb/sql/sketches.h"
+#include "mldb/sql/geo_index.h"
+#include "mldb/base/parallel.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/vector_description.h"
@@ -230,6 +233,8 @@ struct JoinedDataset::Itl
             return;
         }
 
+        GeoJoinCondition geoCondition;
+
         if (!condition.crossWhere || condition.crossWhere->isConstant()) {
             if (condition.crossWhere
                 && !condition.crossWhere->constantValue().isTrue())
@@ -240,7 +245,13 @@ struct JoinedDataset::Itl
             makeJoinConstantWhere(condition, scope, left, right,
                                   qualification);            
 
-        } else {
+        }
+        else if (getGeoJoinCondition(condition, qualification, geoCondition)) {
+            // Proximity join; use a spatial index rather than comparing
+            // every pair of rows
+            makeJoinGeo(condition, geoCondition, scope, left, right);
+        }
+        else {
 
             // Complex join condition.  We need to generate the full set of
             // values.  To do this, we use the new executor.
@@ -481,13 +492,14 @@ struct JoinedDataset::Itl
                     sorted.emplace_back(value, r.rowName, r.rowHash);
                 }
 
-                parallelQuickSortRecursive(sorted);
                 parallelQuickSortRecursive(outerRows);
 
                 for (auto & r: outerRows) {
                     recordOuterRow(std::get<0>(r), std::get<1>(r));
                 }
 
+                // The rows on the side are sorted below, once we know if
+                // they will be merged or hashed
                 return sorted;
             };
 
@@ -507,6 +519,13 @@ struct JoinedDataset::Itl
         leftRows = runSide(condition.left, *left.dataset, outerLeft,
                            recordOuterLeft);
 
+        if (canLookupRightRows(condition, qualification)) {
+            // The right rows are found by name, without scanning them
+            parallelQuickSortRecursive(leftRows);
+            lookupJoin(leftRows, *right.dataset, outerLeft);
+            return;
+        }
+
         rightRows = runSide(condition.right, *right.dataset, outerRight,
                             recordOuterRight);
 
@@ -524,7 +543,22 @@ struct JoinedDataset::Itl
             break;
         }
         case AnnotatedJoinCondition::EQUIJOIN: {
-            // Join on f(leftrow) = f(rightrow)
+            // Join on f(leftrow) = f(rightrow).  Inner joins of a small side
+            // with a large one are quicker to run by hashing the small side
+            // than by sorting both.
+            if (qualification != JOIN_INNER)
+                break;
+
+            JoinPlan plan = planEquiJoin(getSideStats(leftRows),
+                                         getSideStats(rightRows),
+                                         true /* sortOutput */);
+            if (debug)
+                cerr << "join plan " << jsonEncodeStr(plan) << endl;
+
+            if (plan.strategy == JOIN_STRATEGY_HASH) {
+                hashJoin(leftRows, rightRows, plan.buildLeft);
+                return;
+            }
             break;
         }
         default:
@@ -533,6 +567,9 @@ struct JoinedDataset::Itl
                                       "condition", condition);
         }
 
+        parallelQuickSortRecursive(leftRows);
+        parallelQuickSortRecursive(rightRows);
+
         // Finally, perform the join
         // We keep a list of the row hashes of those that join up
         auto it1 = leftRows.begin(), end1 = leftRows.end();
@@ -628,6 +665,381 @@ struct JoinedDataset::Itl
         }
     }
 
+    typedef std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
+        JoinSideRows;
+
+    /// Row count and estimated number of distinct keys of one side of an
+    /// equijoin, for planning it.
+    static JoinSideStats getSideStats(const JoinSideRows & rows)
+    {
+        HyperLogLog distinct;
+        for (auto & r: rows)
+            distinct.add(std::get<0>(r).hash());
+
+        JoinSideStats result;
+        result.rows = rows.size();
+        result.distinctKeys = distinct.estimate();
+        return result;
+    }
+
+    /** Parts of a join ON geo_within(l.lat, l.lon, r.lat, r.lon, radius),
+        with the latitude and longitude of each side ready to run on that
+        side.
+    */
+    struct GeoJoinCondition {
+        std::shared_ptr<SqlExpression> lat[JOIN_SIDE_MAX];
+        std::shared_ptr<SqlExpression> lon[JOIN_SIDE_MAX];
+        double radius = 0.0;
+    };
+
+    /** Is the join an inner join whose only condition across the two
+        sides is a geo_within() of a point on each side, with a constant
+        radius?  If so, fill in the condition.
+    */
+    static bool getGeoJoinCondition(const AnnotatedJoinCondition & condition,
+                                    JoinQualification qualification,
+                                    GeoJoinCondition & result)
+    {
+        if (condition.style != AnnotatedJoinCondition::CROSS_JOIN
+            || qualification != JOIN_INNER
+            || condition.crossConditions.size() != 1)
+            return false;
+
+        auto call = std::dynamic_pointer_cast<FunctionCallExpression>
+            (condition.crossConditions[0].expr);
+        if (!call || call->functionName != "geo_within"
+            || !call->tableName.empty() || call->args.size() != 5
+            || !call->args[4]->isConstant())
+            return false;
+
+        std::set<Utf8String> leftTables = condition.left.table->getTableNames();
+        std::set<Utf8String> rightTables = condition.right.table->getTableNames();
+
+        auto role = [&] (int arg)
+            {
+                return AnnotatedClause(call->args[arg], leftTables, rightTables)
+                    .role;
+            };
+
+        // Index of the argument with the latitude of the left and the right
+        // point; the longitude follows it
+        int leftArg, rightArg;
+        if (role(0) == AnnotatedClause::LEFT && role(1) == AnnotatedClause::LEFT
+            && role(2) == AnnotatedClause::RIGHT
+            && role(3) == AnnotatedClause::RIGHT) {
+            leftArg = 0;  rightArg = 2;
+        }
+        else if (role(0) == AnnotatedClause::RIGHT
+                 && role(1) == AnnotatedClause::RIGHT
+                 && role(2) == AnnotatedClause::LEFT
+                 && role(3) == AnnotatedClause::LEFT) {
+            leftArg = 2;  rightArg = 0;
+        }
+        else return false;
+
+        auto localExpr = [&] (int arg, const AnnotatedJoinCondition::Side & side)
+            {
+                return removeTableNameFromExpression(*call->args[arg],
+                                                     side.table->getAs());
+            };
+
+        result.lat[JOIN_SIDE_LEFT] = localExpr(leftArg, condition.left);
+        result.lon[JOIN_SIDE_LEFT] = localExpr(leftArg + 1, condition.left);
+        result.lat[JOIN_SIDE_RIGHT] = localExpr(rightArg, condition.right);
+        result.lon[JOIN_SIDE_RIGHT] = localExpr(rightArg + 1, condition.right);
+
+        // A null radius matches nothing, like geo_within() returning null
+        ExpressionValue radius = call->args[4]->constantValue();
+        result.radius = radius.empty()
+            ? std::numeric_limits<double>::quiet_NaN()
+            : radius.getAtom().toDouble();
+
+        return true;
+    }
+
+    struct GeoJoinRow {
+        double lat, lon;
+        RowPath rowName;
+        RowHash rowHash;
+    };
+
+    /** Join the rows on each side whose points are within the radius of
+        each other.  The smaller side is put in a GeoIndex and the other
+        side probes it in parallel.  The joined rows are recorded in order
+        of the left then the right row name.
+    */
+    void makeJoinGeo(const AnnotatedJoinCondition & condition,
+                     const GeoJoinCondition & geo,
+                     SqlBindingScope & scope,
+                     BoundTableExpression & left,
+                     BoundTableExpression & right)
+    {
+        auto runSide = [&] (const AnnotatedJoinCondition::Side & side,
+                            const Dataset & dataset,
+                            JoinSide joinSide)
+            -> std::vector<GeoJoinRow>
+            {
+                std::vector<std::shared_ptr<SqlExpression> > clauses
+                    = { geo.lat[joinSide], geo.lon[joinSide] };
+                auto embedding = std::make_shared<EmbeddingLiteralExpression>
+                    (clauses);
+
+                SelectExpression queryExpression;
+                queryExpression.clauses.push_back
+                    (std::make_shared<NamedColumnExpression>
+                     (PathElement("var"), embedding));
+
+                auto generator = dataset.queryBasic
+                    (scope, queryExpression, side.when, *side.where,
+                     side.orderBy, 0, -1);
+
+                SqlRowScope rowScope;
+                auto rows = generator(-1, rowScope);
+
+                std::vector<GeoJoinRow> result;
+                result.reserve(rows.size());
+
+                for (auto & r: rows) {
+                    ExcAssertEqual(r.columns.size(), 1);
+
+                    const ExpressionValue & point = std::get<1>(r.columns[0]);
+                    ExpressionValue lat = point.getColumn(0);
+                    ExpressionValue lon = point.getColumn(1);
+
+                    // geo_within() of a null is null, which doesn't join
+                    if (lat.empty() || lon.empty())
+                        continue;
+
+                    result.push_back({ lat.getAtom().toDouble(),
+                                       lon.getAtom().toDouble(),
+                                       r.rowName, r.rowHash });
+                }
+
+                std::sort(result.begin(), result.end(),
+                          [] (const GeoJoinRow & r1, const GeoJoinRow & r2)
+                          {
+                              return r1.rowName < r2.rowName;
+                          });
+
+                return result;
+            };
+
+        std::vector<GeoJoinRow> leftRows
+            = runSide(condition.left, *left.dataset, JOIN_SIDE_LEFT);
+        std::vector<GeoJoinRow> rightRows
+            = runSide(condition.right, *right.dataset, JOIN_SIDE_RIGHT);
+
+        bool buildLeft = leftRows.size() < rightRows.size();
+        const std::vector<GeoJoinRow> & build = buildLeft ? leftRows : rightRows;
+        const std::vector<GeoJoinRow> & probe = buildLeft ? rightRows : leftRows;
+
+        GeoIndex index;
+        for (uint32_t i = 0;  i < build.size();  ++i)
+            index.add(build[i].lat, build[i].lon, i);
+        index.finish();
+
+        static constexpr size_t PROBE_BATCH_SIZE = 1024;
+        size_t numBatches
+            = (probe.size() + PROBE_BATCH_SIZE - 1) / PROBE_BATCH_SIZE;
+
+        // (left row, right row) of each match, for each batch
+        std::vector<std::vector<std::pair<uint32_t, uint32_t> > >
+            batchMatches(numBatches);
+
+        auto probeBatch = [&] (size_t batch)
+            {
+                size_t begin = batch * PROBE_BATCH_SIZE;
+                size_t end = std::min(begin + PROBE_BATCH_SIZE, probe.size());
+                auto & matches = batchMatches[batch];
+
+                for (uint32_t i = begin;  i < end;  ++i) {
+                    auto onPoint = [&] (uint32_t j)
+                        {
+                            if (buildLeft)
+                                matches.emplace_back(j, i);
+                            else matches.emplace_back(i, j);
+                        };
+                    index.forEachWithin(probe[i].lat, probe[i].lon,
+                                        geo.radius, onPoint);
+                }
+            };
+
+        parallelMap(0, numBatches, probeBatch);
+
+        std::vector<std::pair<uint32_t, uint32_t> > matches;
+        for (auto & m: batchMatches)
+            matches.insert(matches.end(), m.begin(), m.end());
+
+        // Both sides are sorted by row name, so this sorts on the names
+        std::sort(matches.begin(), matches.end());
+
+        for (auto & m: matches) {
+            const GeoJoinRow & l = leftRows[m.first];
+            const GeoJoinRow & r = rightRows[m.second];
+            recordJoinRow(l.rowName, l.rowHash, r.rowName, r.rowHash);
+        }
+    }
+
+    /** Can the rows of the right side be looked up by name instead of
+        being scanned and sorted?  That's the case for joins ON x =
+        right.rowName() with nothing else restricting the right side.
+        Right and full outer joins need to scan the right side anyway.
+    */
+    static bool canLookupRightRows(const AnnotatedJoinCondition & condition,
+                                   JoinQualification qualification)
+    {
+        if (condition.style != AnnotatedJoinCondition::EQUIJOIN)
+            return false;
+        if (qualification != JOIN_INNER && qualification != JOIN_LEFT)
+            return false;
+
+        const AnnotatedJoinCondition::Side & side = condition.right;
+        auto key = std::dynamic_pointer_cast<FunctionCallExpression>
+            (side.selectExpression);
+        if (!key || key->functionName != "rowName" || !key->args.empty())
+            return false;
+        if (side.where && !side.where->isConstantTrue())
+            return false;
+        if (side.when.when && !side.when.when->isConstantTrue())
+            return false;
+        return true;
+    }
+
+    /** Join the left rows, sorted on their key, with the right rows whose
+        rowName() is equal to the key.  The lookups into the right
+        dataset's row index are done in parallel batches, and the joined
+        rows recorded in the same order as the merge join would.
+    */
+    void lookupJoin(const JoinSideRows & leftRows,
+                    const Dataset & rightDataset,
+                    bool outerLeft)
+    {
+        static constexpr size_t LOOKUP_BATCH_SIZE = 1024;
+
+        auto matrix = rightDataset.getMatrixView();
+
+        // Name of the right row joined with each left row, or empty
+        std::vector<RowPath> rightNames(leftRows.size());
+
+        auto lookupBatch = [&] (size_t batch)
+            {
+                size_t begin = batch * LOOKUP_BATCH_SIZE;
+                size_t end = std::min(begin + LOOKUP_BATCH_SIZE,
+                                      leftRows.size());
+
+                std::vector<RowPath> names;
+                std::vector<size_t> indexes;
+
+                for (size_t i = begin;  i < end;  ++i) {
+                    // rowName() is a string, which only compares equal
+                    // to the same string
+                    const ExpressionValue & val = std::get<0>(leftRows[i]);
+                    if (!val.isString())
+                        continue;
+
+                    // It must also be how the row name is written, since
+                    // different strings can parse to the same path
+                    Utf8String name = val.toUtf8String();
+                    auto parsed = Path::tryParse(name);
+                    if (!parsed.second || parsed.first.empty()
+                        || parsed.first.toUtf8String() != name)
+                        continue;
+
+                    names.emplace_back(std::move(parsed.first));
+                    indexes.push_back(i);
+                }
+
+                if (names.empty())
+                    return;
+
+                std::vector<bool> known = matrix->knownRows(names);
+                for (size_t j = 0;  j < names.size();  ++j) {
+                    if (known[j])
+                        rightNames[indexes[j]] = std::move(names[j]);
+                }
+            };
+
+        size_t numBatches
+            = (leftRows.size() + LOOKUP_BATCH_SIZE - 1) / LOOKUP_BATCH_SIZE;
+        parallelMap(0, numBatches, lookupBatch);
+
+        for (size_t i = 0;  i < leftRows.size();  ++i) {
+            const RowPath & leftName = std::get<1>(leftRows[i]);
+            const RowHash & leftHash = std::get<2>(leftRows[i]);
+            const RowPath & rightName = rightNames[i];
+
+            if (!rightName.empty())
+                recordJoinRow(leftName, leftHash, rightName, RowHash(rightName));
+            else if (outerLeft)
+                recordJoinRow(leftName, leftHash, RowPath(), RowHash());
+        }
+    }
+
+    /** Inner equijoin by indexing the rows of one side on their key and
+        looking up the rows of the other.  The matches are sorted so that
+        they are recorded in the same order as the merge join would have
+        recorded them, which keeps the row numbers of the joined dataset
+        the same whichever way it's run.
+    */
+    void hashJoin(const JoinSideRows & leftRows,
+                  const JoinSideRows & rightRows,
+                  bool buildLeft)
+    {
+        const JoinSideRows & build = buildLeft ? leftRows : rightRows;
+        const JoinSideRows & probe = buildLeft ? rightRows : leftRows;
+
+        std::unordered_map<uint64_t, compact_vector<uint32_t, 1> > index;
+        index.reserve(build.size());
+        for (uint32_t i = 0;  i < build.size();  ++i) {
+            const ExpressionValue & val = std::get<0>(build[i]);
+            if (val.empty())
+                continue;
+            index[val.hash()].push_back(i);
+        }
+
+        // (left row, right row) of each match
+        std::vector<std::pair<uint32_t, uint32_t> > matches;
+
+        for (uint32_t i = 0;  i < probe.size();  ++i) {
+            const ExpressionValue & val = std::get<0>(probe[i]);
+            if (val.empty())
+                continue;
+            auto it = index.find(val.hash());
+            if (it == index.end())
+                continue;
+            for (uint32_t j: it->second) {
+                if (std::get<0>(build[j]) != val)
+                    continue;
+                if (buildLeft)
+                    matches.emplace_back(j, i);
+                else matches.emplace_back(i, j);
+            }
+        }
+
+        // Sort on the (key, name, hash) of the left then the right row,
+        // which is the order of the merge join
+        auto compareMatches = [&] (const std::pair<uint32_t, uint32_t> & m1,
+                                   const std::pair<uint32_t, uint32_t> & m2)
+            {
+                const auto & l1 = leftRows[m1.first];
+                const auto & l2 = leftRows[m2.first];
+                if (l1 < l2)
+                    return true;
+                if (l2 < l1)
+                    return false;
+                return rightRows[m1.second] < rightRows[m2.second];
+            };
+
+        std::sort(matches.begin(), matches.end(), compareMatches);
+
+        for (auto & m: matches) {
+            const auto & l = leftRows[m.first];
+            const auto & r = rightRows[m.second];
+            recordJoinRow(std::get<1>(l), std::get<2>(l),
+                          std::get<1>(r), std::get<2>(r));
+        }
+    }
+
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
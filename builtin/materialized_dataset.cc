@@ -0,0 +1,374 @@
+/** materialized_dataset.cc                                        -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Materialized query over a dataset, with incremental refresh.
+*/
+
+#include "materialized_dataset.h"
+#include "merged_dataset.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/rest/rest_request_binding.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MATERIALIZED DATASET CONFIG                                               */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(MaterializedDatasetConfig);
+
+MaterializedDatasetConfig::
+MaterializedDatasetConfig()
+    : autoRefresh(true)
+{
+}
+
+MaterializedDatasetConfigDescription::
+MaterializedDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("query", &MaterializedDatasetConfig::query,
+             "Query whose output is materialized.  The SELECT, NAMED, WHEN "
+             "and WHERE clauses are applied to each row of the dataset in "
+             "the FROM clause; GROUP BY, ORDER BY, OFFSET and LIMIT are not "
+             "allowed.");
+    addField("autoRefresh", &MaterializedDatasetConfig::autoRefresh,
+             "If true, the dataset is refreshed when it's accessed after "
+             "the input dataset has been committed.  If false, it's only "
+             "refreshed when it's committed or through the refresh route.",
+             true);
+}
+
+
+/*****************************************************************************/
+/* MATERIALIZED DATASET INTERNAL                                             */
+/*****************************************************************************/
+
+struct MaterializedDataset::Itl {
+
+    /// Materialized rows.  This is never modified once it's made, so that
+    /// queries can keep using it during a refresh.
+    struct State {
+        /// One tabular dataset per refresh that found new rows
+        std::vector<std::shared_ptr<Dataset> > parts;
+        std::shared_ptr<Dataset> merged;  ///< Merge of all of the parts
+        uint64_t generation = 0;          ///< Input generation materialized
+        size_t rowsEvaluated = 0;         ///< Total input rows evaluated
+        size_t rowsEvaluatedLast = 0;     ///< Input rows in last refresh
+        size_t refreshes = 0;             ///< Refreshes that found new rows
+    };
+
+    Itl(MldbServer * server,
+        MaterializedDataset * owner,
+        const MaterializedDatasetConfig & config,
+        const ProgressFunc & onProgress)
+        : server(server), owner(owner), stm(config.query.stm),
+          autoRefresh(config.autoRefresh)
+    {
+        if (!stm || !stm->from)
+            throw HttpReturnException
+                (400, "Materialized dataset needs a query with a FROM clause");
+        if (!stm->groupBy.empty())
+            throw HttpReturnException
+                (400, "Materialized dataset query can't have GROUP BY",
+                 "query", stm->surface);
+        if (!stm->orderBy.clauses.empty())
+            throw HttpReturnException
+                (400, "Materialized dataset query can't have ORDER BY",
+                 "query", stm->surface);
+        if (stm->offset != 0 || stm->limit != -1)
+            throw HttpReturnException
+                (400, "Materialized dataset query can't have OFFSET or LIMIT",
+                 "query", stm->surface);
+
+        SqlExpressionMldbScope context(server);
+        auto bound = stm->from->bind(context, onProgress);
+        if (!bound.dataset)
+            throw HttpReturnException
+                (400, "FROM clause of materialized dataset query must be "
+                 "a dataset", "query", stm->surface);
+        input = bound.dataset;
+        alias = bound.asName;
+
+        refresh();
+
+        addRouteSyncJsonReturn(router, "/refresh", {"POST"},
+                               "Evaluate the rows that were added to the "
+                               "input dataset since the last refresh",
+                               "Status of the dataset",
+                               &Itl::refresh,
+                               this);
+    }
+
+    MldbServer * server;
+    MaterializedDataset * owner;
+    std::shared_ptr<SelectStatement> stm;
+    bool autoRefresh;
+    std::shared_ptr<Dataset> input;
+    Utf8String alias;
+    RestRequestRouter router;
+
+    /// Protects current
+    mutable std::mutex stateMutex;
+    std::shared_ptr<const State> current;
+
+    /// Serializes refreshes, and protects evaluated
+    std::mutex refreshMutex;
+
+    /// Hashes of the input rows that were already evaluated
+    Lightweight_Hash_Set<uint64_t> evaluated;
+
+    std::shared_ptr<const State> state() const
+    {
+        std::unique_lock<std::mutex> guard(stateMutex);
+        return current;
+    }
+
+    /** State to use for an access, refreshing first if the input has been
+        committed and we refresh automatically.
+    */
+    std::shared_ptr<const State> getState()
+    {
+        auto result = state();
+        if (autoRefresh && input->getGeneration() != result->generation) {
+            refresh();
+            result = state();
+        }
+        return result;
+    }
+
+    /** Apply the query to the given input rows, and record the output into
+        a new tabular dataset.
+    */
+    std::shared_ptr<Dataset> materialize(const std::vector<RowPath> & rows)
+    {
+        PolyConfig partConfig;
+        partConfig.type = "tabular";
+        auto part = constructDataset(server, partConfig);
+
+        SqlExpressionDatasetScope context(*input, alias);
+        SqlExpressionWhenScope whenContext(context);
+        auto whenBound = stm->when.bind(whenContext);
+        auto whereBound = stm->where->bind(context);
+        auto selectBound = stm->select.bind(context);
+        auto namedBound = stm->rowName->bind(context);
+        bool whenTrue = stm->when.when->isConstantTrue();
+
+        auto doRow = [&] (size_t i)
+            {
+                const RowPath & rowName = rows[i];
+                auto row = input->getRowExpr(rowName);
+                auto rowContext = context.getRowScope(rowName, row);
+
+                if (!whereBound(rowContext, GET_LATEST).isTrue())
+                    return;
+
+                if (!whenTrue)
+                    whenBound.filterInPlace(row, rowContext);
+
+                ExpressionValue output = selectBound(rowContext, GET_ALL);
+                RowPath outputName
+                    = namedBound(rowContext, GET_LATEST).coerceToPath();
+                part->recordRowExpr(outputName, output);
+            };
+
+        parallelMap(0, rows.size(), doRow);
+
+        part->commit();
+        return part;
+    }
+
+    Any refresh()
+    {
+        std::unique_lock<std::mutex> guard(refreshMutex);
+
+        auto oldState = state();
+
+        // Read the generation before the rows, so that a commit that
+        // happens during the refresh will cause another refresh
+        uint64_t generation = input->getGeneration();
+        if (oldState && oldState->generation == generation)
+            return getStatus();
+
+        std::vector<RowPath> newRows;
+        for (auto & r: input->getMatrixView()->getRowPaths()) {
+            if (evaluated.insert(r.hash()).second)
+                newRows.emplace_back(std::move(r));
+        }
+
+        auto newState = std::make_shared<State>();
+        if (oldState)
+            *newState = *oldState;
+        newState->generation = generation;
+        newState->rowsEvaluated = evaluated.size();
+        newState->rowsEvaluatedLast = newRows.size();
+
+        // The first refresh always makes a part, even if empty, so that
+        // there is something to query
+        bool changed = !newRows.empty() || !oldState;
+        if (changed) {
+            newState->parts.emplace_back(materialize(newRows));
+            if (newState->parts.size() == 1)
+                newState->merged = newState->parts[0];
+            else newState->merged
+                     = std::make_shared<MergedDataset>(server, newState->parts);
+            ++newState->refreshes;
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(stateMutex);
+            current = std::move(newState);
+        }
+
+        // Queries over us now see different data
+        if (changed && oldState)
+            owner->Dataset::commit();
+
+        return getStatus();
+    }
+
+    Any getStatus() const
+    {
+        auto myState = state();
+        Json::Value result;
+        result["rowCount"] = myState->merged->getRowCount();
+        result["parts"] = myState->parts.size();
+        result["rowsEvaluated"] = myState->rowsEvaluated;
+        result["rowsEvaluatedLastRefresh"] = myState->rowsEvaluatedLast;
+        result["refreshes"] = myState->refreshes;
+        return result;
+    }
+};
+
+
+/*****************************************************************************/
+/* MATERIALIZED DATASET                                                      */
+/*****************************************************************************/
+
+MaterializedDataset::
+MaterializedDataset(MldbServer * owner,
+                    PolyConfig config,
+                    const ProgressFunc & onProgress)
+    : Dataset(owner)
+{
+    itl = std::make_shared<Itl>
+        (server, this, config.params.convert<MaterializedDatasetConfig>(),
+         onProgress);
+}
+
+MaterializedDataset::
+~MaterializedDataset()
+{
+}
+
+Any
+MaterializedDataset::
+getStatus() const
+{
+    return itl->getStatus();
+}
+
+void
+MaterializedDataset::
+commit()
+{
+    itl->refresh();
+}
+
+std::shared_ptr<MatrixView>
+MaterializedDataset::
+getMatrixView() const
+{
+    return itl->getState()->merged->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+MaterializedDataset::
+getColumnIndex() const
+{
+    return itl->getState()->merged->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+MaterializedDataset::
+getRowStream() const
+{
+    return itl->getState()->merged->getRowStream();
+}
+
+ExpressionValue
+MaterializedDataset::
+getRowExpr(const RowPath & row) const
+{
+    return itl->getState()->merged->getRowExpr(row);
+}
+
+std::pair<Date, Date>
+MaterializedDataset::
+getTimestampRange() const
+{
+    return itl->getState()->merged->getTimestampRange();
+}
+
+KnownColumn
+MaterializedDataset::
+getKnownColumnInfo(const ColumnPath & columnName) const
+{
+    return itl->getState()->merged->getKnownColumnInfo(columnName);
+}
+
+GenerateRowsWhereFunction
+MaterializedDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String& alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    // The state is kept with the generator, as a refresh may replace the
+    // merged dataset that it refers to
+    auto state = itl->getState();
+    GenerateRowsWhereFunction result
+        = state->merged->generateRowsWhere(context, alias, where,
+                                           offset, limit);
+    auto exec = std::move(result.exec);
+    result.exec = [=] (ssize_t numToGenerate, Any token,
+                       const BoundParameters & params,
+                       const ProgressFunc & onProgress)
+        {
+            ExcAssert(state);
+            return exec(numToGenerate, std::move(token), params, onProgress);
+        };
+    return result;
+}
+
+RestRequestMatchResult
+MaterializedDataset::
+handleRequest(RestConnection & connection,
+              const RestRequest & request,
+              RestRequestParsingContext & context) const
+{
+    return itl->router.processRequest(connection, request, context);
+}
+
+static RegisterDatasetType<MaterializedDataset, MaterializedDatasetConfig>
+regMaterialized(builtinPackage(),
+                "materialized",
+                "Dataset holding the output of a query over another dataset, "
+                "which is refreshed incrementally when that dataset commits",
+                "datasets/MaterializedDataset.md.html");
+
+} // namespace MLDB
@@ -0,0 +1,98 @@
+/** materialized_dataset.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Dataset that holds the result of a row by row query over another
+    dataset, and that is kept up to date as the other dataset is committed.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* MATERIALIZED DATASET CONFIG                                               */
+/*****************************************************************************/
+
+struct MaterializedDatasetConfig {
+    MaterializedDatasetConfig();
+
+    /// Query whose output is materialized.  Each output row must come from
+    /// a single row of the input, so no GROUP BY, ORDER BY, OFFSET or LIMIT.
+    InputQuery query;
+
+    /// Refresh on access once the input has been committed since the last
+    /// refresh.  Otherwise it's only done on commit or by the refresh route.
+    bool autoRefresh;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(MaterializedDatasetConfig);
+
+
+/*****************************************************************************/
+/* MATERIALIZED DATASET                                                      */
+/*****************************************************************************/
+
+/** Dataset that stores the output of the SELECT, WHEN and WHERE clauses of
+    a query over its input in tabular datasets, rather than recalculating it
+    each time that it's accessed like a FilteredDataset or keeping the
+    whole query output in memory like a SubDataset.
+
+    As each output row depends only on the input row of the same name, a
+    refresh only evaluates the input rows that haven't been seen before.
+    The output for those rows goes into a new tabular dataset, which is
+    merged with those from the previous refreshes.  Changes to input rows
+    that were already evaluated are not picked up.
+*/
+
+struct MaterializedDataset: public Dataset {
+
+    MaterializedDataset(MldbServer * owner,
+                        PolyConfig config,
+                        const ProgressFunc & onProgress);
+
+    virtual ~MaterializedDataset();
+
+    virtual Any getStatus() const;
+    virtual void recordRowItl(const RowPath & rowName,
+          const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+    {
+        throw MLDB::Exception("Dataset type doesn't allow recording");
+    }
+
+    /** Refresh from the input dataset. */
+    virtual void commit();
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
+    virtual std::shared_ptr<RowStream> getRowStream() const;
+
+    virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    virtual std::pair<Date, Date> getTimestampRange() const;
+
+    virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const;
+
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const;
+
+    virtual RestRequestMatchResult
+    handleRequest(RestConnection & connection,
+                  const RestRequest & request,
+                  RestRequestParsingContext & context) const;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
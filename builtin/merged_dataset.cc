@@ -211,23 +211,93 @@ struct MergedDataset::Itl
         /* set where the stream should start*/
         virtual void initAt(size_t start) override
         {
-            it = source->rowIndex.begin();
+            // Skip whole buckets of the row index, and then walk within
+            // the one that contains start
+            size_t bucket = 0;
+            while (bucket < IdHashes::NBUCKETS
+                   && start >= source->rowIndex.buckets[bucket].size()) {
+                start -= source->rowIndex.buckets[bucket].size();
+                ++bucket;
+            }
+
+            it = source->rowIndex.beginBucket(bucket);
             for (size_t i = 0; i < start; ++i)
                 ++it;
         }
 
+        /// Parallelize bucket by bucket of the row index, as a row can
+        /// come from several of the datasets and so we can't split along
+        /// their streams.  Each stream starts without a walk.
+        virtual std::vector<std::shared_ptr<RowStream> >
+        parallelize(int64_t rowStreamTotalRows,
+                    ssize_t approxNumberOfChildStreams,
+                    std::vector<size_t> * streamOffsets) const override
+        {
+            std::vector<std::shared_ptr<RowStream> > streams;
+            if (streamOffsets)
+                streamOffsets->clear();
+
+            size_t startAt = 0;
+            for (size_t i = 0;  i < IdHashes::NBUCKETS;  ++i) {
+                size_t n = source->rowIndex.buckets[i].size();
+                if (n == 0)
+                    continue;
+                if (streamOffsets)
+                    streamOffsets->push_back(startAt);
+                startAt += n;
+
+                auto stream = std::make_shared<MergedRowStream>(source);
+                stream->it = source->rowIndex.beginBucket(i);
+                streams.emplace_back(std::move(stream));
+            }
+
+            if (streamOffsets)
+                streamOffsets->push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return streams;
+        }
+
+        /// Morsels never cross a bucket of the row index, so that initAt()
+        /// only needs to walk within one bucket
+        virtual std::vector<size_t>
+        getMorselOffsets(int64_t rowStreamTotalRows,
+                         ssize_t maxRowsPerMorsel) const override
+        {
+            if (maxRowsPerMorsel == AUTO)
+                maxRowsPerMorsel = defaultRowsPerMorsel(rowStreamTotalRows);
+            ExcAssertGreater(maxRowsPerMorsel, 0);
+
+            std::vector<size_t> result;
+            size_t startAt = 0;
+            for (auto & bucket: source->rowIndex.buckets) {
+                size_t n = bucket.size();
+                size_t numMorsels = (n + maxRowsPerMorsel - 1) / maxRowsPerMorsel;
+                for (size_t i = 0;  i < numMorsels;  ++i)
+                    result.push_back(startAt + n * i / numMorsels);
+                startAt += n;
+            }
+            result.push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return result;
+        }
+
         virtual RowPath next() override
         {
-            uint64_t hash = (*it).first;
+            IdHashBucket entry = *it;
             ++it;
 
-            return source->getRowPath(RowHash(hash));
+            return source->getRowPath(RowHash(entry.first), entry.second);
         }
 
         virtual const RowPath & rowName(RowPath & storage) const override
         {
-            uint64_t hash = (*it).first;
-            return storage = source->getRowPath(RowHash(hash));
+            IdHashBucket entry = *it;
+            return storage = source->getRowPath(RowHash(entry.first),
+                                                entry.second);
         }
 
         virtual bool supportsExtendedInterface() const override
@@ -367,7 +437,7 @@ struct MergedDataset::Itl
                     return true;
                 }
 
-                if (limit != -1 && result.size() >= index)
+                if (limit != -1 && result.size() >= limit)
                     return false;
 
                 RowHash rowHash(hash);
@@ -395,7 +465,14 @@ struct MergedDataset::Itl
 
     virtual RowPath getRowPath(const RowHash & rowHash) const
     {
-        uint32_t bitmap = getRowBitmap(rowHash);
+        return getRowPath(rowHash, getRowBitmap(rowHash));
+    }
+
+    /** Return the path of the row, given its bitmap in the row index.
+        This saves a lookup when the bitmap is already known.
+    */
+    RowPath getRowPath(const RowHash & rowHash, uint32_t bitmap) const
+    {
         if (!bitmap)
             throw MLDB::Exception("Row not known");
 
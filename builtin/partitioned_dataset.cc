@@ -0,0 +1,645 @@
+/** partitioned_dataset.cc                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Dataset made of partitions, with partition pruning on the WHERE clause.
+*/
+
+#include "partitioned_dataset.h"
+#include "merged_dataset.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/rest/rest_request_binding.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include <algorithm>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARTITIONED DATASET CONFIG                                                */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(PartitionConfig);
+
+PartitionConfigDescription::
+PartitionConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("dataset", &PartitionConfig::dataset,
+             "Dataset holding the rows of the partition");
+    addField("earliest", &PartitionConfig::earliest,
+             "Earliest timestamp in the partition.  If neither this nor "
+             "`latest` is set, the timestamp range of the dataset is used.",
+             Date::notADate());
+    addField("latest", &PartitionConfig::latest,
+             "Latest timestamp in the partition.  If neither this nor "
+             "`earliest` is set, the timestamp range of the dataset is used.",
+             Date::notADate());
+    addField("minKey", &PartitionConfig::minKey,
+             "Smallest value of the key column in the partition.  If "
+             "neither this nor `maxKey` is set, the values of the column "
+             "in the dataset are used.");
+    addField("maxKey", &PartitionConfig::maxKey,
+             "Largest value of the key column in the partition.  If "
+             "neither this nor `minKey` is set, the values of the column "
+             "in the dataset are used.");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(PartitionedDatasetConfig);
+
+PartitionedDatasetConfigDescription::
+PartitionedDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("partitions", &PartitionedDatasetConfig::partitions,
+             "Partitions of the dataset");
+    addField("keyColumn", &PartitionedDatasetConfig::keyColumn,
+             "Column whose range of values in each partition is used to "
+             "skip partitions.  If empty, only the timestamps are used.");
+}
+
+
+namespace {
+
+/// Are the two values ordered in the same way as a comparison in SQL
+/// would order them?
+bool comparable(const CellValue & v1, const CellValue & v2)
+{
+    return (v1.isNumber() && v2.isNumber())
+        || (v1.isString() && v2.isString())
+        || (v1.isTimestamp() && v2.isTimestamp());
+}
+
+/// Return the atom that the expression always evaluates to, if it's a
+/// non-null constant
+bool getConstant(const SqlExpression & expr, CellValue & value)
+{
+    if (!expr.isConstant())
+        return false;
+    try {
+        ExpressionValue v = expr.constantValue();
+        if (!v.isAtom())
+            return false;
+        value = v.getAtom();
+        return !value.empty();
+    } catch (const std::exception & exc) {
+        return false;
+    }
+}
+
+/// Is the expression made only of columns read from the row, so that
+/// all of its timestamps come from the row?
+bool onlyReadsColumns(const SqlExpression & expr)
+{
+    if (dynamic_cast<const ReadColumnExpression *>(&expr)
+        || dynamic_cast<const WildcardExpression *>(&expr))
+        return true;
+    if (dynamic_cast<const SelectWithinExpression *>(&expr)
+        || dynamic_cast<const SelectExpression *>(&expr)
+        || dynamic_cast<const NamedColumnExpression *>(&expr)) {
+        for (auto & c: expr.getChildren()) {
+            if (!onlyReadsColumns(*c))
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+/// Comparison that gives the same result with its arguments swapped
+std::string flipComparison(const std::string & op)
+{
+    if (op == "<")
+        return ">";
+    if (op == "<=")
+        return ">=";
+    if (op == ">")
+        return "<";
+    if (op == ">=")
+        return "<=";
+    return op;
+}
+
+/** Range of the values that something read from the rows of a
+    partition can take.
+*/
+struct ValueRange {
+    enum Kind {
+        UNKNOWN,      ///< Nothing is known about the values
+        BOUNDED,      ///< Values are between lower and upper
+        ALWAYS_NULL   ///< Values are always null
+    };
+
+    ValueRange(Kind kind = UNKNOWN)
+        : kind(kind)
+    {
+    }
+
+    Kind kind;
+    CellValue lower;  ///< Lower bound, or null if unbounded
+    CellValue upper;  ///< Upper bound, or null if unbounded
+
+    /** Could "value op constant" be true for a value in the range?  A
+        comparison with null is never true.
+    */
+    bool mayCompare(const std::string & op, const CellValue & constant) const
+    {
+        if (kind == ALWAYS_NULL)
+            return false;
+        if (kind == UNKNOWN)
+            return true;
+        if ((!lower.empty() && !comparable(lower, constant))
+            || (!upper.empty() && !comparable(upper, constant)))
+            return true;
+
+        bool hasLower = !lower.empty(), hasUpper = !upper.empty();
+
+        if (op == "=" || op == "==")
+            return !(hasLower && constant < lower)
+                && !(hasUpper && upper < constant);
+        if (op == "!=")
+            return !(hasLower && hasUpper
+                     && lower == constant && upper == constant);
+        if (op == "<")
+            return !hasLower || lower < constant;
+        if (op == "<=")
+            return !hasLower || !(constant < lower);
+        if (op == ">")
+            return !hasUpper || constant < upper;
+        if (op == ">=")
+            return !hasUpper || !(upper < constant);
+        return true;
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PARTITIONED DATASET INTERNAL                                              */
+/*****************************************************************************/
+
+struct PartitionedDataset::Itl {
+
+    struct Partition {
+        PartitionConfig config;
+        std::shared_ptr<Dataset> dataset;
+        ValueRange timestamps;  ///< Range of the timestamps of the values
+        ValueRange keys;        ///< Range of the values of the key column
+    };
+
+    /// Set of partitions.  This is never modified once it's made, so that
+    /// queries can keep using it while partitions are added or dropped.
+    struct State {
+        std::vector<std::shared_ptr<const Partition> > partitions;
+        std::shared_ptr<Dataset> merged;  ///< Merge of all of the partitions
+    };
+
+    Itl(MldbServer * server, const PartitionedDatasetConfig & config)
+        : server(server), keyColumn(config.keyColumn)
+    {
+        if (config.partitions.empty())
+            throw HttpReturnException
+                (400, "Partitioned dataset needs at least one partition");
+
+        std::vector<std::shared_ptr<const Partition> > partitions
+            (config.partitions.size());
+
+        auto doPartition = [&] (size_t i)
+            {
+                partitions[i] = makePartition(config.partitions[i]);
+            };
+
+        parallelMap(0, partitions.size(), doPartition);
+
+        current = makeState(std::move(partitions));
+
+        addRouteSyncJsonReturn(router, "/partitions", {"POST"},
+                               "Add a partition to the dataset",
+                               "Status of the dataset",
+                               &Itl::addPartition,
+                               this,
+                               JsonParam<PartitionConfig>
+                               ("partition", "Partition to add"));
+
+        addRouteSyncJsonReturn(router, "/partitions", {"DELETE"},
+                               "Drop a partition from the dataset",
+                               "Status of the dataset",
+                               &Itl::dropPartition,
+                               this,
+                               RestParam<std::string>
+                               ("dataset",
+                                "Name of the dataset of the partition"));
+    }
+
+    MldbServer * server;
+    ColumnPath keyColumn;
+    RestRequestRouter router;
+
+    /// Protects current
+    mutable std::mutex stateMutex;
+    std::shared_ptr<const State> current;
+
+    /// Serializes the changes to the partitions
+    std::mutex changeMutex;
+
+    std::shared_ptr<const State> state() const
+    {
+        std::unique_lock<std::mutex> guard(stateMutex);
+        return current;
+    }
+
+    std::shared_ptr<const Partition>
+    makePartition(const PartitionConfig & config) const
+    {
+        auto result = std::make_shared<Partition>();
+        result->config = config;
+        result->dataset = obtainDataset(server, config.dataset);
+
+        if (config.earliest.isADate() || config.latest.isADate()) {
+            // Declared bounds; a missing one is unbounded
+            result->timestamps = ValueRange(ValueRange::BOUNDED);
+            if (config.earliest.isADate())
+                result->timestamps.lower = config.earliest;
+            if (config.latest.isADate())
+                result->timestamps.upper = config.latest;
+        }
+        else {
+            Date earliest, latest;
+            std::tie(earliest, latest) = result->dataset->getTimestampRange();
+            if (earliest.isADate() && latest.isADate()) {
+                result->timestamps = ValueRange(ValueRange::BOUNDED);
+                result->timestamps.lower = earliest;
+                result->timestamps.upper = latest;
+            }
+            else result->timestamps = ValueRange(ValueRange::ALWAYS_NULL);
+        }
+
+        if (keyColumn.empty())
+            return result;
+
+        if (!config.minKey.empty() || !config.maxKey.empty()) {
+            result->keys = ValueRange(ValueRange::BOUNDED);
+            result->keys.lower = config.minKey;
+            result->keys.upper = config.maxKey;
+        }
+        else if (!result->dataset->getMatrixView()->knownColumn(keyColumn)) {
+            result->keys = ValueRange(ValueRange::ALWAYS_NULL);
+        }
+        else {
+            std::vector<CellValue> values
+                = result->dataset->getColumnIndex()
+                ->getColumnDistinctValues(keyColumn);
+            values.erase(std::remove_if(values.begin(), values.end(),
+                                        [] (const CellValue & v)
+                                        { return v.empty(); }),
+                         values.end());
+            if (values.empty()) {
+                result->keys = ValueRange(ValueRange::ALWAYS_NULL);
+            }
+            else {
+                // Only usable if all of the values are ordered the same way
+                // by SQL comparisons
+                bool allComparable = true;
+                for (auto & v: values)
+                    allComparable = allComparable && comparable(v, values[0]);
+                if (allComparable) {
+                    result->keys = ValueRange(ValueRange::BOUNDED);
+                    result->keys.lower
+                        = *std::min_element(values.begin(), values.end());
+                    result->keys.upper
+                        = *std::max_element(values.begin(), values.end());
+                }
+            }
+        }
+
+        return result;
+    }
+
+    std::shared_ptr<const State>
+    makeState(std::vector<std::shared_ptr<const Partition> > partitions) const
+    {
+        auto result = std::make_shared<State>();
+        std::vector<std::shared_ptr<Dataset> > datasets;
+        for (auto & p: partitions)
+            datasets.push_back(p->dataset);
+        result->partitions = std::move(partitions);
+        result->merged = std::make_shared<MergedDataset>(server, datasets);
+        return result;
+    }
+
+    void setState(std::shared_ptr<const State> newState)
+    {
+        std::unique_lock<std::mutex> guard(stateMutex);
+        current = std::move(newState);
+    }
+
+    Any addPartition(const PartitionConfig & config)
+    {
+        // Load the partition before taking the lock, so that other changes
+        // don't wait for it
+        auto partition = makePartition(config);
+
+        std::unique_lock<std::mutex> guard(changeMutex);
+        auto partitions = state()->partitions;
+        partitions.emplace_back(std::move(partition));
+        setState(makeState(std::move(partitions)));
+        return getStatus();
+    }
+
+    Any dropPartition(const std::string & datasetName)
+    {
+        std::unique_lock<std::mutex> guard(changeMutex);
+        auto partitions = state()->partitions;
+        auto it = std::find_if(partitions.begin(), partitions.end(),
+                               [&] (const std::shared_ptr<const Partition> & p)
+                               {
+                                   return p->config.dataset.id == datasetName;
+                               });
+        if (it == partitions.end())
+            throw HttpReturnException(404, "Partition not found",
+                                      "dataset", datasetName);
+        if (partitions.size() == 1)
+            throw HttpReturnException
+                (400, "Can't drop the last partition of a partitioned dataset");
+        partitions.erase(it);
+        setState(makeState(std::move(partitions)));
+        return getStatus();
+    }
+
+    Any getStatus() const
+    {
+        auto myState = state();
+        Json::Value result;
+        result["rowCount"] = myState->merged->getRowCount();
+        for (auto & p: myState->partitions) {
+            Json::Value partition;
+            partition["dataset"] = p->config.dataset.id;
+            partition["rowCount"] = p->dataset->getRowCount();
+            result["partitions"].append(partition);
+        }
+        return result;
+    }
+
+    /** Range of the values that the expression takes over the rows of
+        the partition, if it's the key column or a timestamp function of
+        the columns.
+    */
+    ValueRange getRange(const Partition & partition,
+                        const SqlExpression & expr,
+                        const Utf8String & alias) const
+    {
+        if (auto column = dynamic_cast<const ReadColumnExpression *>(&expr)) {
+            if (!keyColumn.empty()
+                && (column->columnName == keyColumn
+                    || (!alias.empty()
+                        && column->columnName == PathElement(alias) + keyColumn)))
+                return partition.keys;
+            return ValueRange();
+        }
+
+        if (auto fn = dynamic_cast<const FunctionCallExpression *>(&expr)) {
+            if ((fn->functionName == "latest_timestamp"
+                 || fn->functionName == "earliest_timestamp")
+                && fn->args.size() == 1
+                && (fn->tableName.empty() || fn->tableName == alias)
+                && onlyReadsColumns(*fn->args[0]))
+                return partition.timestamps;
+        }
+
+        return ValueRange();
+    }
+
+    /** Could any row of the partition satisfy the where expression?  This
+        returns true unless it's certain that none can.
+    */
+    bool canMatch(const Partition & partition,
+                  const SqlExpression & where,
+                  const Utf8String & alias) const
+    {
+        if (auto boolean
+            = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+            if (boolean->op == "AND")
+                return canMatch(partition, *boolean->lhs, alias)
+                    && canMatch(partition, *boolean->rhs, alias);
+            if (boolean->op == "OR")
+                return canMatch(partition, *boolean->lhs, alias)
+                    || canMatch(partition, *boolean->rhs, alias);
+            return true;
+        }
+
+        if (auto comparison
+            = dynamic_cast<const ComparisonExpression *>(&where)) {
+            CellValue constant;
+            if (getConstant(*comparison->rhs, constant))
+                return getRange(partition, *comparison->lhs, alias)
+                    .mayCompare(comparison->op, constant);
+            if (getConstant(*comparison->lhs, constant))
+                return getRange(partition, *comparison->rhs, alias)
+                    .mayCompare(flipComparison(comparison->op), constant);
+            return true;
+        }
+
+        if (auto between = dynamic_cast<const BetweenExpression *>(&where)) {
+            CellValue lower, upper;
+            if (between->notBetween
+                || !getConstant(*between->lower, lower)
+                || !getConstant(*between->upper, upper))
+                return true;
+            ValueRange range = getRange(partition, *between->expr, alias);
+            return range.mayCompare(">=", lower)
+                && range.mayCompare("<=", upper);
+        }
+
+        if (auto in = dynamic_cast<const InExpression *>(&where)) {
+            if (in->isNegative || !in->tuple)
+                return true;
+            ValueRange range = getRange(partition, *in->expr, alias);
+            for (auto & clause: in->tuple->clauses) {
+                CellValue constant;
+                if (!getConstant(*clause, constant)
+                    || range.mayCompare("=", constant))
+                    return true;
+            }
+            return false;
+        }
+
+        return true;
+    }
+};
+
+
+/*****************************************************************************/
+/* PARTITIONED DATASET                                                       */
+/*****************************************************************************/
+
+PartitionedDataset::
+PartitionedDataset(MldbServer * owner,
+                   PolyConfig config,
+                   const ProgressFunc & onProgress)
+    : Dataset(owner)
+{
+    auto partitionedConfig = config.params.convert<PartitionedDatasetConfig>();
+    itl.reset(new Itl(server, partitionedConfig));
+}
+
+PartitionedDataset::
+~PartitionedDataset()
+{
+}
+
+Any
+PartitionedDataset::
+getStatus() const
+{
+    return itl->getStatus();
+}
+
+std::shared_ptr<MatrixView>
+PartitionedDataset::
+getMatrixView() const
+{
+    return itl->state()->merged->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+PartitionedDataset::
+getColumnIndex() const
+{
+    return itl->state()->merged->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+PartitionedDataset::
+getRowStream() const
+{
+    return itl->state()->merged->getRowStream();
+}
+
+ExpressionValue
+PartitionedDataset::
+getRowExpr(const RowPath & row) const
+{
+    return itl->state()->merged->getRowExpr(row);
+}
+
+std::pair<Date, Date>
+PartitionedDataset::
+getTimestampRange() const
+{
+    return itl->state()->merged->getTimestampRange();
+}
+
+GenerateRowsWhereFunction
+PartitionedDataset::
+generateRowsWhere(const SqlBindingScope & context,
+                  const Utf8String& alias,
+                  const SqlExpression & where,
+                  ssize_t offset,
+                  ssize_t limit) const
+{
+    auto state = itl->state();
+
+    std::vector<std::shared_ptr<Dataset> > selected;
+    for (auto & p: state->partitions) {
+        if (itl->canMatch(*p, where, alias))
+            selected.push_back(p->dataset);
+    }
+
+    if (selected.size() == state->partitions.size()) {
+        // Nothing to skip; the merged dataset knows how to do it all.  The
+        // state is kept with the generator, as it refers to the merged
+        // dataset.
+        GenerateRowsWhereFunction result
+            = state->merged->generateRowsWhere(context, alias, where,
+                                               offset, limit);
+        auto exec = std::move(result.exec);
+        result.exec = [=] (ssize_t numToGenerate, Any token,
+                           const BoundParameters & params,
+                           const ProgressFunc & onProgress)
+            {
+                ExcAssert(state);
+                return exec(numToGenerate, std::move(token), params,
+                            onProgress);
+            };
+        return result;
+    }
+
+    // As each row is in only one partition, the rows that match in the
+    // dataset are those that match in each of the partitions
+    std::vector<GenerateRowsWhereFunction> generators;
+    for (auto & d: selected) {
+        generators.emplace_back(d->generateRowsWhere(context, alias, where,
+                                                     0, -1));
+    }
+
+    Utf8String explain
+        = "partitioned dataset using " + std::to_string(selected.size())
+        + " of " + std::to_string(state->partitions.size()) + " partitions";
+
+    return {[=] (ssize_t numToGenerate, Any token,
+                 const BoundParameters & params,
+                 const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                ExcAssert(state);
+
+                std::vector<std::vector<RowPath> > rows(generators.size());
+                auto doPartition = [&] (size_t i)
+                    {
+                        rows[i] = generators[i](-1, Any(), params).first;
+                    };
+
+                parallelMap(0, generators.size(), doPartition);
+
+                std::vector<RowPath> result;
+                ssize_t skipped = 0;
+                for (auto & partitionRows: rows) {
+                    for (auto & row: partitionRows) {
+                        if (skipped < offset) {
+                            ++skipped;
+                            continue;
+                        }
+                        if (limit != -1 && result.size() >= limit)
+                            break;
+                        result.emplace_back(std::move(row));
+                    }
+                }
+
+                return { std::move(result), Any() };
+            },
+            explain,
+            selected.empty()
+            ? GenerateRowsWhereFunction::CONSTANT
+            : GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN};
+}
+
+RestRequestMatchResult
+PartitionedDataset::
+handleRequest(RestConnection & connection,
+              const RestRequest & request,
+              RestRequestParsingContext & context) const
+{
+    return itl->router.processRequest(connection, request, context);
+}
+
+static RegisterDatasetType<PartitionedDataset, PartitionedDatasetConfig>
+regPartitioned(builtinPackage(),
+               "partitioned",
+               "Dataset made of partitions, which skips those that can't "
+               "match the WHERE clause of a query",
+               "datasets/PartitionedDataset.md.html");
+
+} // namespace MLDB
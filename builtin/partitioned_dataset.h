@@ -0,0 +1,110 @@
+/** partitioned_dataset.h                                          -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Dataset that is made of partitions, each of which holds the rows
+    within a declared range of timestamps and keys.  Partitions that can't
+    match a WHERE clause are skipped when the query is run.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/sql/cell_value.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARTITION CONFIG                                                          */
+/*****************************************************************************/
+
+/** Configuration of a single partition.  Bounds that aren't given are
+    calculated from the partition's dataset.
+*/
+
+struct PartitionConfig {
+    PolyConfigT<const Dataset> dataset;
+
+    /// Earliest and latest timestamp in the partition.  If both are
+    /// notADate(), getTimestampRange() of the dataset is used.
+    Date earliest;
+    Date latest;
+
+    /// Smallest and largest value of the key column in the partition.  If
+    /// both are null, they are calculated from the values of the column.
+    CellValue minKey;
+    CellValue maxKey;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(PartitionConfig);
+
+
+/*****************************************************************************/
+/* PARTITIONED DATASET CONFIG                                                */
+/*****************************************************************************/
+
+struct PartitionedDatasetConfig {
+    std::vector<PartitionConfig> partitions;
+
+    /// Column that the partitions are split on, if any
+    ColumnPath keyColumn;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(PartitionedDatasetConfig);
+
+
+/*****************************************************************************/
+/* PARTITIONED DATASET                                                       */
+/*****************************************************************************/
+
+/** Dataset that merges together its partitions like a MergedDataset, but
+    that only looks at the partitions whose bounds can satisfy the WHERE
+    clause of a query.  A row must only be in one partition.
+
+    Partitions are added with POST and dropped with DELETE on the
+    /routes/partitions route; the other partitions aren't touched.
+*/
+
+struct PartitionedDataset: public Dataset {
+
+    PartitionedDataset(MldbServer * owner,
+                       PolyConfig config,
+                       const ProgressFunc & onProgress);
+
+    virtual ~PartitionedDataset();
+
+    virtual Any getStatus() const;
+    virtual void recordRowItl(const RowPath & rowName,
+          const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+    {
+        throw MLDB::Exception("Dataset type doesn't allow recording");
+    }
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
+    virtual std::shared_ptr<RowStream> getRowStream() const;
+
+    virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    virtual std::pair<Date, Date> getTimestampRange() const;
+
+    virtual GenerateRowsWhereFunction
+    generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String& alias,
+                      const SqlExpression & where,
+                      ssize_t offset,
+                      ssize_t limit) const;
+
+    virtual RestRequestMatchResult
+    handleRequest(RestConnection & connection,
+                  const RestRequest & request,
+                  RestRequestParsingContext & context) const;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -0,0 +1,190 @@
+/** replica_dataset.cc                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Local copy of a dataset that lives on peers.
+*/
+
+#include "replica_dataset.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/sql/sql_expression.h"
+#include "sub_dataset.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/vector_description.h"
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* REPLICA DATASET CONFIG                                                    */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(ReplicaDatasetConfig);
+
+ReplicaDatasetConfigDescription::
+ReplicaDatasetConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("peers", &ReplicaDatasetConfig::peers,
+             "MLDB peers that hold the dataset.  The copy is taken from "
+             "whichever of them is the least loaded and closest, or from "
+             "another if it can't be reached.  An empty name is this "
+             "server.");
+    addField("dataset", &ReplicaDatasetConfig::dataset,
+             "Name of the dataset on the peers");
+    addField("timeout", &ReplicaDatasetConfig::timeout,
+             "Number of seconds to wait for the copy of the dataset",
+             600.0);
+}
+
+
+/*****************************************************************************/
+/* REPLICA DATASET                                                           */
+/*****************************************************************************/
+
+struct ReplicaDataset::Itl {
+
+    Itl(MldbServer * server, const ReplicaDatasetConfig & config)
+        : server(server), config(config)
+    {
+        if (config.peers.empty())
+            throw HttpReturnException
+                (400, "Replica dataset needs at least one peer");
+        if (config.dataset.empty())
+            throw HttpReturnException
+                (400, "Replica dataset needs a dataset name");
+        reload();
+    }
+
+    MldbServer * server;
+    ReplicaDatasetConfig config;
+
+    mutable std::mutex copyMutex;
+    std::shared_ptr<Dataset> copy_;
+    Date copied;
+
+    /// Take a new copy of the rows, leaving the old one alone for the
+    /// queries that are using it
+    void reload()
+    {
+        Utf8String query = "SELECT * NAMED rowPath() FROM "
+            + PathElement(config.dataset).toEscapedUtf8String();
+        auto rows = server->queryReplicas(config.peers, query, config.timeout);
+        auto newCopy = std::make_shared<SubDataset>(server, std::move(rows));
+
+        std::unique_lock<std::mutex> guard(copyMutex);
+        copy_ = std::move(newCopy);
+        copied = Date::now();
+    }
+
+    std::shared_ptr<Dataset> copy() const
+    {
+        std::unique_lock<std::mutex> guard(copyMutex);
+        return copy_;
+    }
+};
+
+ReplicaDataset::
+ReplicaDataset(MldbServer * owner,
+               PolyConfig config,
+               const ProgressFunc & onProgress)
+    : Dataset(owner)
+{
+    auto replicaConfig = config.params.convert<ReplicaDatasetConfig>();
+    itl.reset(new Itl(server, replicaConfig));
+}
+
+ReplicaDataset::
+~ReplicaDataset()
+{
+}
+
+Any
+ReplicaDataset::
+getStatus() const
+{
+    Json::Value result;
+    std::unique_lock<std::mutex> guard(itl->copyMutex);
+    result["copied"] = jsonEncode(itl->copied);
+    return result;
+}
+
+void
+ReplicaDataset::
+commit()
+{
+    itl->reload();
+    Dataset::commit();
+}
+
+std::shared_ptr<MatrixView>
+ReplicaDataset::
+getMatrixView() const
+{
+    return itl->copy()->getMatrixView();
+}
+
+std::shared_ptr<ColumnIndex>
+ReplicaDataset::
+getColumnIndex() const
+{
+    return itl->copy()->getColumnIndex();
+}
+
+std::shared_ptr<RowStream>
+ReplicaDataset::
+getRowStream() const
+{
+    return itl->copy()->getRowStream();
+}
+
+KnownColumn
+ReplicaDataset::
+getKnownColumnInfo(const ColumnPath & columnName) const
+{
+    return itl->copy()->getKnownColumnInfo(columnName);
+}
+
+std::vector<ColumnPath>
+ReplicaDataset::
+getFlattenedColumnNames() const
+{
+    return itl->copy()->getFlattenedColumnNames();
+}
+
+size_t
+ReplicaDataset::
+getFlattenedColumnCount() const
+{
+    return itl->copy()->getFlattenedColumnCount();
+}
+
+ExpressionValue
+ReplicaDataset::
+getRowExpr(const RowPath & row) const
+{
+    return itl->copy()->getRowExpr(row);
+}
+
+std::pair<Date, Date>
+ReplicaDataset::
+getTimestampRange() const
+{
+    return itl->copy()->getTimestampRange();
+}
+
+static RegisterDatasetType<ReplicaDataset, ReplicaDatasetConfig>
+regReplica(builtinPackage(),
+           "replica",
+           "Local copy of a dataset on other MLDB servers, taken over the "
+           "peer to peer links",
+           "datasets/ReplicaDataset.md.html");
+
+} // namespace MLDB
@@ -0,0 +1,81 @@
+/** replica_dataset.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Dataset that holds a local copy of a dataset on other MLDB servers,
+    taken over the peer to peer links.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* REPLICA DATASET CONFIG                                                    */
+/*****************************************************************************/
+
+struct ReplicaDatasetConfig {
+    /// Peers that hold the dataset.  The copy is taken from one of them.
+    std::vector<std::string> peers;
+
+    /// Name of the dataset on the peers
+    Utf8String dataset;
+
+    /// Number of seconds to wait for the copy of the dataset
+    double timeout = 600.0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ReplicaDatasetConfig);
+
+
+/*****************************************************************************/
+/* REPLICA DATASET                                                           */
+/*****************************************************************************/
+
+/** Read-only dataset that copies all of the rows of a dataset on one of its
+    peers when it's created, so that it doesn't need to be loaded again
+    from where the peer got it.  commit() takes a new copy, for when the
+    dataset on the peers has changed.
+
+    Queries of the copy are run here and never go to the peers.
+*/
+
+struct ReplicaDataset: public Dataset {
+
+    ReplicaDataset(MldbServer * owner,
+                   PolyConfig config,
+                   const ProgressFunc & onProgress);
+
+    virtual ~ReplicaDataset();
+
+    virtual Any getStatus() const;
+    virtual void recordRowItl(const RowPath & rowName,
+          const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+    {
+        throw MLDB::Exception("Dataset type doesn't allow recording");
+    }
+
+    virtual void commit();
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const;
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const;
+    virtual std::shared_ptr<RowStream> getRowStream() const;
+
+    virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const;
+    virtual std::vector<ColumnPath> getFlattenedColumnNames() const;
+    virtual size_t getFlattenedColumnCount() const;
+
+    virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    virtual std::pair<Date, Date> getTimestampRange() const;
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
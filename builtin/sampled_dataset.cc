@@ -11,8 +11,11 @@
 #include "mldb/types/structure_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/base/exc_assert.h"
 #include <random>
 #include <unordered_set>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -29,7 +32,7 @@ std::random_device rd;
 
 SampledDatasetConfig::
 SampledDatasetConfig() :
-        rows(0), fraction(0), withReplacement(false)
+        rows(0), fraction(0), withReplacement(false), blockSampling(false)
 {
     seed = rd();
 }
@@ -53,6 +56,10 @@ void validateConfig(SampledDatasetConfig * config)
         throw MLDB::Exception(SampledDataset::getErrorMsg(MLDB::format("The 'fraction' parameter needs to "
                     "be between 0 and 1. Value provided is '%0.4f'", config->fraction)));
     }
+    if (config->blockSampling && config->withReplacement) {
+        throw MLDB::Exception(SampledDataset::getErrorMsg("The 'blockSampling' "
+                    "parameter cannot be used with 'withReplacement'."));
+    }
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(SampledDatasetConfig);
@@ -80,6 +87,13 @@ SampledDatasetConfigDescription()
               "this parameter is to permit reproducible random samples. "
               "This parameter is optional, with the default value being "
               "selected randomly for each sample.");
+    addField("blockSampling", &SampledDatasetConfig::blockSampling,
+             "Sample whole blocks of consecutive rows instead of single "
+             "rows.  This only reads the rows that are sampled, which is "
+             "much faster on large datasets, but the sampled rows are "
+             "not independent of each other: rows that are stored "
+             "together are sampled together.  Cannot be used with "
+             "`withReplacement`.", false);
 
     onPostValidate = [] (SampledDatasetConfig * config,
                          JsonParsingContext & context)
@@ -89,6 +103,139 @@ SampledDatasetConfigDescription()
 }
 
 
+/*****************************************************************************/
+/* SAMPLING                                                                  */
+/*****************************************************************************/
+
+namespace {
+
+/** Sample numRows distinct rows of the stream, which has totalRows rows,
+    using reservoir sampling.  This uses Algorithm L (Li, 1994), which
+    calculates how many rows to skip before the next one that goes into
+    the reservoir, so that only O(numRows * (1 + log(totalRows / numRows)))
+    rows need to be read, and the rest are skipped with advanceBy().
+*/
+std::vector<RowPath>
+reservoirSample(RowStream & stream, size_t totalRows, size_t numRows,
+                std::mt19937 & gen)
+{
+    std::vector<RowPath> result;
+    result.reserve(numRows);
+
+    stream.initAt(0);
+    while (result.size() < numRows && result.size() < totalRows)
+        result.emplace_back(stream.next());
+
+    if (totalRows <= numRows || numRows == 0)
+        return result;
+
+    // Uniform in (0, 1], so that we never take the log of zero
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    auto random = [&] () { return 1.0 - dist(gen); };
+    std::uniform_int_distribution<size_t> slot(0, numRows - 1);
+
+    double w = exp(log(random()) / numRows);
+    size_t pos = numRows;  // position of the stream
+
+    for (;;) {
+        double skip = floor(log(random()) / log1p(-w));
+        if (!(pos + skip < totalRows))
+            break;
+        stream.advanceBy(skip);
+        pos += skip;
+        result[slot(gen)] = stream.next();
+        ++pos;
+        w *= exp(log(random()) / numRows);
+    }
+
+    return result;
+}
+
+/** Sample numRows rows of the stream, which has totalRows rows, with
+    replacement.  The positions are chosen up front and then read in
+    order, skipping the rows in between.
+*/
+std::vector<RowPath>
+sampleWithReplacement(RowStream & stream, size_t totalRows, size_t numRows,
+                      std::mt19937 & gen)
+{
+    std::uniform_int_distribution<size_t> dist(0, totalRows - 1);
+    std::vector<size_t> positions(numRows);
+    for (auto & p: positions)
+        p = dist(gen);
+    std::sort(positions.begin(), positions.end());
+
+    std::vector<RowPath> result;
+    result.reserve(numRows);
+
+    stream.initAt(0);
+    size_t pos = 0;
+    for (size_t i = 0;  i < positions.size();  ++i) {
+        if (i > 0 && positions[i] == positions[i - 1]) {
+            result.push_back(result.back());
+            continue;
+        }
+        stream.advanceBy(positions[i] - pos);
+        result.emplace_back(stream.next());
+        pos = positions[i] + 1;
+    }
+
+    // Don't give the rows in the order of the underlying dataset
+    std::shuffle(result.begin(), result.end(), gen);
+
+    return result;
+}
+
+/** Sample numRows distinct rows of the stream, which has totalRows rows,
+    by taking whole morsels of the stream in a random order.  The morsels
+    follow the natural boundaries of the dataset (for example the chunks of
+    a tabular dataset), and are small enough that there are at least a few
+    dozen in the sample.  Only the rows that are sampled are read.
+*/
+std::vector<RowPath>
+blockSample(const RowStream & stream, size_t totalRows, size_t numRows,
+            std::mt19937 & gen)
+{
+    std::vector<RowPath> result;
+    if (totalRows == 0 || numRows == 0)
+        return result;
+    result.reserve(numRows);
+
+    // Between about 32 morsels in the sample and 64k morsels in total
+    size_t rowsPerMorsel = std::max<size_t>(numRows / 32, 1);
+    rowsPerMorsel = std::max<size_t>(rowsPerMorsel, totalRows / 65536);
+
+    std::vector<size_t> offsets
+        = stream.getMorselOffsets(totalRows, rowsPerMorsel);
+    ExcAssertGreaterEqual(offsets.size(), 1);
+    ExcAssertEqual(offsets.back(), totalRows);
+
+    // Partial Fisher-Yates shuffle: just as many morsels as we need
+    size_t numMorsels = offsets.size() - 1;
+    std::vector<size_t> order(numMorsels);
+    for (size_t i = 0;  i < numMorsels;  ++i)
+        order[i] = i;
+
+    for (size_t i = 0;  i < numMorsels && result.size() < numRows;  ++i) {
+        std::uniform_int_distribution<size_t> dist(i, numMorsels - 1);
+        std::swap(order[i], order[dist(gen)]);
+
+        size_t start = offsets[order[i]], end = offsets[order[i] + 1];
+        if (start == end)
+            continue;
+
+        auto morsel = stream.clone();
+        morsel->initAt(start);
+        for (size_t j = start;  j < end && result.size() < numRows;  ++j)
+            result.emplace_back(morsel->next());
+    }
+
+    return result;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* SAMPLED INTERNAL REPRESENTATION                                        */
 /*****************************************************************************/
@@ -102,7 +249,6 @@ struct SampledDataset::Itl
 
     std::shared_ptr<MatrixView> matrix;
     std::shared_ptr<ColumnIndex> index;
-    size_t columnCount;
 
     std::unordered_set<RowPath> sampledRowsIndex;
     std::vector<RowPath> sampledRows;
@@ -112,24 +258,60 @@ struct SampledDataset::Itl
             const SampledDatasetConfig config)
         : dataset(dataset),
           matrix(dataset->getMatrixView()),
-          index(dataset->getColumnIndex()),
-          columnCount(matrix->getColumnPaths().size())
+          index(dataset->getColumnIndex())
     {
-        // get all existing rows
-        auto rows = matrix->getRowHashes();
+        size_t totalRows = matrix->getRowCount();
 
         unsigned numRows = config.rows != 0 ? config.rows
-                                            : rows.size() * config.fraction;
+                                            : totalRows * config.fraction;
+
+        if(!config.withReplacement && numRows > totalRows) {
+            throw MLDB::Exception("Requested more rows without replacement than "
+                    "available number of rows in original dataset.");
+        }
+
+        std::mt19937 gen(config.seed);
+
+        // Stream the row names, rather than getting all of them up front,
+        // if the dataset can
+        std::shared_ptr<RowStream> stream = dataset->getRowStream();
+
+        if (stream && totalRows > 0) {
+            if (config.blockSampling)
+                sampledRows = blockSample(*stream, totalRows, numRows, gen);
+            else if (config.withReplacement)
+                sampledRows = sampleWithReplacement(*stream, totalRows,
+                                                    numRows, gen);
+            else sampledRows = reservoirSample(*stream, totalRows, numRows,
+                                               gen);
+        }
+        else if (numRows > 0) {
+            sampleFromRowHashes(numRows, config, gen);
+        }
+
+        sampledRowsHash.reserve(sampledRows.size());
+        for (auto & rowName: sampledRows) {
+            sampledRowsHash.emplace_back(rowName);
+            sampledRowsIndex.insert(rowName);
+        }
+    }
+
+    /** Sample from the list of all rows, for datasets that can't stream
+        their rows.
+    */
+    void sampleFromRowHashes(unsigned numRows,
+                             const SampledDatasetConfig & config,
+                             std::mt19937 & gen)
+    {
+        // get all existing rows
+        auto rows = matrix->getRowHashes();
 
         if(!config.withReplacement && numRows > rows.size()) {
             throw MLDB::Exception("Requested more rows without replacement than "
                     "available number of rows in original dataset.");
         }
-        sampledRowsHash.reserve(numRows);
         sampledRows.reserve(numRows);
 
-        // do the sampling
-        std::mt19937 gen(config.seed);
         std::uniform_int_distribution<> dis(0, rows.size() - 1);
 
         unordered_set<unsigned> sampledIndexes;
@@ -145,11 +327,7 @@ struct SampledDataset::Itl
                 sampledIndexes.insert(sample_index);
             }
 
-            sampledRowsHash.emplace_back(rows[sample_index]);
-
-            auto rowName = matrix->getRowPath(rows[sample_index]);
-            sampledRows.emplace_back(rowName);
-            sampledRowsIndex.insert(rowName);
+            sampledRows.emplace_back(matrix->getRowPath(rows[sample_index]));
         }
     }
 
@@ -252,20 +430,13 @@ struct SampledDataset::Itl
     {
         auto col = index->getColumn(column);
 
+        // Keep the values of the sampled rows; the others don't have the
+        // column in the sample
         std::vector<std::tuple<RowPath, CellValue, Date> > allRows = std::move(col.rows);
-        map<RowPath, unsigned> rowIndex;
-        for(int i=0; i<allRows.size(); i++) {
-            rowIndex.insert(make_pair(get<0>(allRows[i]), i));
-        }
-
-
-        // std::vector<std::tuple<RowPath, CellValue, Date> > rows;
-        for(auto rowName : sampledRows) {
-            auto it = rowIndex.find(rowName);
-            if(it == rowIndex.end())
-                throw MLDB::Exception("Unknown row in index");
-
-            col.rows.emplace_back(allRows[it->second]);
+        col.rows.clear();
+        for (auto & r: allRows) {
+            if (sampledRowsIndex.count(get<0>(r)))
+                col.rows.emplace_back(std::move(r));
         }
 
         return col;
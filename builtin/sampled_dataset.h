@@ -27,6 +27,7 @@ struct SampledDatasetConfig {
     unsigned rows;
     float fraction;
     bool withReplacement;
+    bool blockSampling;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(SampledDatasetConfig);
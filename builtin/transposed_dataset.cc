@@ -10,6 +10,7 @@
 #include "transposed_dataset.h"
 #include "mldb/builtin/sub_dataset.h"
 #include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/base/exc_assert.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 
@@ -49,54 +50,121 @@ struct TransposedDataset::Itl
 
     std::shared_ptr<MatrixView> matrix;
     std::shared_ptr<ColumnIndex> index;
-    size_t columnCount;
 
+    // Nothing is transposed up front; each row (column of the underlying
+    // dataset) is read from its column index when it's asked for.
     Itl(MldbServer * server, std::shared_ptr<Dataset> dataset)
         : dataset(dataset),
           matrix(dataset->getMatrixView()),
-          index(dataset->getColumnIndex()),
-          columnCount(dataset->getFlattenedColumnCount())
+          index(dataset->getColumnIndex())
     {
     }
 
+    /** Names of the rows, which are the flattened column names of the
+        underlying dataset.  This is a list of the columns (not the rows)
+        of the underlying dataset, and is shared between the row streams.
+    */
+    std::shared_ptr<const std::vector<RowPath> > getRowList() const
+    {
+        return std::make_shared<const std::vector<RowPath> >
+            (dataset->getFlattenedColumnNames());
+    }
+
     struct TransposedRowStream : public RowStream {
 
-        TransposedRowStream(TransposedDataset::Itl* source) : source(source)
+        TransposedRowStream(const TransposedDataset::Itl* source)
+            : source(source), rows(source->getRowList()), pos(0)
+        {
+        }
+
+        TransposedRowStream(const TransposedDataset::Itl* source,
+                            std::shared_ptr<const std::vector<RowPath> > rows)
+            : source(source), rows(std::move(rows)), pos(0)
+        {
+        }
+
+        virtual std::shared_ptr<RowStream> clone() const override
+        {
+            // Clones share the list of rows, so that parallelizing the
+            // stream doesn't ask for the list once per clone
+            return std::make_shared<TransposedRowStream>(source, rows);
+        }
+
+        virtual void initAt(size_t start) override
+        {
+            pos = start;
+        }
+
+        virtual RowPath next() override
         {
-            matrix = source->matrix;
-            columns = matrix->getColumnPaths();
-            column_iterator = columns.begin();
+            return (*rows)[pos++];
         }
 
-        virtual std::shared_ptr<RowStream> clone() const{
-            auto ptr = std::make_shared<TransposedRowStream>(source);
-            return ptr;
+        virtual const RowPath & rowName(RowPath & storage) const override
+        {
+            return (*rows)[pos];
         }
 
-        virtual void initAt(size_t start){
-            column_iterator = column_iterator + start;
+        virtual bool supportsExtendedInterface() const override
+        {
+            return true;
         }
 
-        virtual RowPath next() {
-            return TransposedDataset::Itl::colToRow(*(column_iterator++));
+        virtual void advance() override
+        {
+            ++pos;
         }
 
-        virtual const RowPath & rowName(RowPath & storage) const
+        virtual void advanceBy(size_t n) override
         {
-            return storage = TransposedDataset::Itl::colToRow(*column_iterator);
+            pos += n;
         }
 
-        virtual void advance() {
-            column_iterator++;
+        /** The values for the requested columns are in the rows of the
+            underlying dataset with the same name, so we read each of those
+            rows once for the whole block instead of reading the entire
+            underlying column for each of our rows.
+        */
+        virtual void
+        extractColumns(size_t numValues,
+                       const std::vector<ColumnPath> & columnNames,
+                       CellValue * output) override
+        {
+            ExcAssertLessEqual(pos + numValues, rows->size());
+
+            Lightweight_Hash<ColumnHash, size_t> rowPositions;
+            for (size_t i = 0;  i < numValues;  ++i)
+                rowPositions[ColumnHash(rowToCol((*rows)[pos + i]))] = i;
+
+            size_t numColumns = columnNames.size();
+            std::fill(output, output + numValues * numColumns, CellValue());
+            std::vector<Date> latest(numValues * numColumns,
+                                     Date::negativeInfinity());
+
+            for (size_t j = 0;  j < numColumns;  ++j) {
+                const RowPath & underlyingRow = colToRow(columnNames[j]);
+                if (!source->matrix->knownRow(underlyingRow))
+                    continue;
+                MatrixNamedRow row = source->matrix->getRow(underlyingRow);
+                for (auto & c: row.columns) {
+                    auto it = rowPositions.find(ColumnHash(std::get<0>(c)));
+                    if (it == rowPositions.end())
+                        continue;
+                    // Keep the latest value, like a row's columns do
+                    size_t n = it->second * numColumns + j;
+                    if (std::get<2>(c) < latest[n])
+                        continue;
+                    latest[n] = std::get<2>(c);
+                    output[n] = std::move(std::get<1>(c));
+                }
+            }
+
+            pos += numValues;
         }
 
-        //todo: suboptimal for large number of columns
-        //need a column iter interface
-        //or cache this in the transposed dataset
-        vector<ColumnPath>::const_iterator column_iterator;
-        vector<ColumnPath> columns;
-        std::shared_ptr<MatrixView> matrix;
-        TransposedDataset::Itl* source;
+        const TransposedDataset::Itl* source;
+        std::shared_ptr<const std::vector<RowPath> > rows;
+        size_t pos;
     };
 
     static RowHash colToRow(ColumnHash col)
@@ -125,15 +193,12 @@ struct TransposedDataset::Itl
         return result;
     }
     
+    // Row and column paths are the same type, so an rvalue can be passed
+    // through without copying each element
     static std::vector<std::tuple<RowPath, CellValue, Date> >
     colToRow(std::vector<std::tuple<ColumnPath, CellValue, Date> > && vals)
     {
-        std::vector<std::tuple<RowPath, CellValue, Date> > result;
-        result.reserve(vals.size());
-        for (auto & v: vals)
-            result.emplace_back(colToRow(std::move(std::get<0>(v))),
-                                std::move(std::get<1>(v)), std::get<2>(v));
-        return result;
+        return std::move(vals);
     }
     
     static std::vector<std::tuple<ColumnPath, CellValue, Date> >
@@ -150,12 +215,7 @@ struct TransposedDataset::Itl
     static std::vector<std::tuple<ColumnPath, CellValue, Date> >
     rowToCol(std::vector<std::tuple<RowPath, CellValue, Date> > && vals)
     {
-        std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
-        result.reserve(vals.size());
-        for (auto & v: vals)
-            result.emplace_back(rowToCol(std::move(std::get<0>(v))),
-                                std::move(std::get<1>(v)), std::get<2>(v));
-        return result;
+        return std::move(vals);
     }
     
     static ColumnHash rowToCol(RowHash row)
@@ -177,22 +237,24 @@ struct TransposedDataset::Itl
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const
     {
         vector<ColumnPath> cols = dataset->getFlattenedColumnNames();
+        if (start == 0 && limit == -1)
+            return cols;
 
         vector<RowPath> result;
-        for (unsigned i = start; i < cols.size();  ++i) {
+        for (size_t i = start;  i < cols.size();  ++i) {
             if (limit != -1 && result.size() >= limit)
                 break;
-            result.push_back(colToRow(cols[i]));
+            result.push_back(colToRow(std::move(cols[i])));
         }
         
-        return cols;
+        return result;
     }
 
     virtual std::vector<RowHash>
     getRowHashes(ssize_t start = 0, ssize_t limit = -1) const
     {
         vector<RowHash> result;
-        for (auto & n: getRowPaths()) {
+        for (auto & n: getRowPaths(start, limit)) {
             result.emplace_back(n);
         }
         return result;
@@ -6,10 +6,12 @@
 #include "union_dataset.h"
 
 #include <thread>
+#include <algorithm>
 #include <math.h>
 
 #include "mldb/builtin/id_hash.h"
 #include "mldb/builtin/merge_hash_entries.h"
+#include "mldb/base/parallel.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/vector_description.h"
@@ -50,13 +52,35 @@ std::shared_ptr<Dataset> createUnionDataset(
 struct UnionDataset::Itl
     : public MatrixView, public ColumnIndex {
 
+    /// Routes each row of the union to its dataset and its hash there
     Lightweight_Hash<RowHash, pair<int, RowHash> > rowIndex;
+
+    /// Bitmap of the datasets that have each column.  Bit 31 stands for
+    /// all of the datasets from the 31st on; see getColumnDatasets().
     IdHashes columnIndex;
 
+    /// Sorted column hashes of each of the datasets from the 31st on, for
+    /// those columns that have bit 31 set in the column index.
+    vector<vector<uint64_t> > overflowColumns;
+
     // Datasets that it was constructed with
     vector<std::shared_ptr<Dataset> > datasets;
 
-    Itl(MldbServer * server, vector<std::shared_ptr<Dataset> > datasets) {
+    /// Position of the first row of each dataset in the union, and then
+    /// the total number of rows.  Length is datasets.size() + 1.
+    vector<size_t> rowOffsets;
+
+    /// Do all of the row streams of the datasets support the extended
+    /// interface?
+    bool extendedInterface;
+
+    enum {
+        OVERFLOW_BIT = 31  ///< Bit shared by the datasets from the 31st on
+    };
+
+    Itl(MldbServer * server, vector<std::shared_ptr<Dataset> > datasets)
+        : extendedInterface(true)
+    {
         if (datasets.empty()) {
             throw MLDB::Exception("Attempt to unify no datasets together");
         }
@@ -65,11 +89,50 @@ struct UnionDataset::Itl
         if (indexWidth > 31) {
             throw MLDB::Exception("Too many datasets in the union");
         }
+
+        // Each dataset is indexed on its own thread, and they are then put
+        // together
+        vector<vector<pair<RowHash, RowHash> > > rowHashes(datasets.size());
+
+        auto getRowHashes = [&] (int datasetIndex)
+            {
+                auto & result = rowHashes[datasetIndex];
+                auto rowPaths
+                    = datasets[datasetIndex]->getMatrixView()->getRowPaths();
+                result.reserve(rowPaths.size());
+                for (const auto & rowPath: rowPaths) {
+                    result.emplace_back(RowHash(PathElement(datasetIndex)
+                                                + rowPath),
+                                        RowHash(rowPath));
+                }
+            };
+
+        parallelMap(0, datasets.size(), getRowHashes);
+
+        rowOffsets.reserve(datasets.size() + 1);
+        rowOffsets.push_back(0);
+        for (auto & h: rowHashes) {
+            rowOffsets.push_back(rowOffsets.back() + h.size());
+        }
+
+        rowIndex.reserve(rowOffsets.back());
         for (int i = 0; i < datasets.size(); ++i) {
-            for (const auto & rowPath: datasets[i]->getMatrixView()->getRowPaths()) {
-                rowIndex[RowHash(PathElement(i) + rowPath)] =
-                    make_pair(i, RowHash(rowPath));
+            for (auto & h: rowHashes[i]) {
+                rowIndex[h.first] = make_pair(i, h.second);
             }
+            rowHashes[i] = vector<pair<RowHash, RowHash> >();
+        }
+
+        for (auto & d: datasets) {
+            auto stream = d->getRowStream();
+            if (!stream || !stream->supportsExtendedInterface()) {
+                extendedInterface = false;
+                break;
+            }
+        }
+
+        if (datasets.size() > OVERFLOW_BIT) {
+            overflowColumns.resize(datasets.size() - OVERFLOW_BIT);
         }
 
         auto getColumnHashes = [&] (int datasetIndex)
@@ -80,8 +143,18 @@ struct UnionDataset::Itl
                 std::sort(cols.begin(), cols.end());
                 ExcAssert(std::unique(cols.begin(), cols.end()) == cols.end());
                 result.reserve(cols.size());
+                int bit = std::min<int>(datasetIndex, OVERFLOW_BIT);
                 for (auto c: cols)
-                    result.add(c.hash(), 1ULL << datasetIndex);
+                    result.add(c.hash(), 1ULL << bit);
+
+                if (datasetIndex >= OVERFLOW_BIT) {
+                    auto & overflow
+                        = overflowColumns[datasetIndex - OVERFLOW_BIT];
+                    overflow.reserve(cols.size());
+                    for (auto & c: cols)
+                        overflow.push_back(c.hash());
+                    std::sort(overflow.begin(), overflow.end());
+                }
                 return result;
             };
 
@@ -114,16 +187,23 @@ struct UnionDataset::Itl
             return -1;
         }
         int idx = static_cast<int>(rowPath.at(0).toIndex());
-        if (idx > datasets.size()) {
+        if (idx >= (int)datasets.size()) {
             return -1;
         }
-        ExcAssert(idx == -1 || idx <= datasets.size());
+        ExcAssert(idx == -1 || idx < datasets.size());
         return idx;
     }
 
+    /// Number of rows in the given dataset
+    size_t datasetRowCount(int datasetIndex) const
+    {
+        return rowOffsets[datasetIndex + 1] - rowOffsets[datasetIndex];
+    }
+
     struct UnionRowStream : public RowStream {
 
-        UnionRowStream(const UnionDataset::Itl* source) : source(source), datasetIndex(0)
+        UnionRowStream(const UnionDataset::Itl* source)
+            : source(source), datasetIndex(0), subRowIndex(0), subNumRow(0)
         {
         }
 
@@ -135,35 +215,111 @@ struct UnionDataset::Itl
         /* set where the stream should start*/
         virtual void initAt(size_t start) override
         {
-            datasetIndex = 0;
-            size_t currentTotal = 0;
-            std::shared_ptr<Dataset> currentDataset = source->datasets[0];
-            size_t currentRowCount = currentDataset->getRowCount();
-            while (currentTotal + currentRowCount < start) {
-                currentTotal += currentRowCount;
-                ++datasetIndex;
-                currentDataset = source->datasets[datasetIndex];
-                currentRowCount = currentDataset->getRowCount();
+            // The first dataset whose range contains start; empty datasets
+            // have an empty range and are skipped.
+            const auto & offsets = source->rowOffsets;
+            datasetIndex
+                = std::upper_bound(offsets.begin(), offsets.end(), start)
+                - offsets.begin() - 1;
+
+            if (datasetIndex >= source->datasets.size()) {
+                currentSubRowStream.reset();
+                subRowIndex = subNumRow = 0;
+                return;
             }
-            currentSubRowStream = currentDataset->getRowStream();
-            subRowIndex = start - currentTotal;
-            currentSubRowStream->initAt(subRowIndex);
-            subNumRow = currentRowCount;
+
+            openDataset(start - offsets[datasetIndex]);
         }
 
-        virtual RowPath next() override
+        /// Split along the child streams' own split, in proportion to the
+        /// size of each dataset, so that each child stream is scanned in
+        /// parallel with the others
+        virtual std::vector<std::shared_ptr<RowStream> >
+        parallelize(int64_t rowStreamTotalRows,
+                    ssize_t approxNumberOfChildStreams,
+                    std::vector<size_t> * streamOffsets) const override
         {
-            RowPath mynext = PathElement(datasetIndex) + currentSubRowStream->next();
-            ++subRowIndex;
-            if (subRowIndex == subNumRow) {
-                ++datasetIndex;
-                if (datasetIndex < source->datasets.size()) {
-                    currentSubRowStream = source->datasets[datasetIndex]->getRowStream();
-                    currentSubRowStream->initAt(0);
-                    subRowIndex = 0;
-                    subNumRow = source->datasets[datasetIndex]->getRowCount();
+            ExcAssertGreater(rowStreamTotalRows, 0);
+            ExcAssertEqual(rowStreamTotalRows, source->rowOffsets.back());
+
+            std::vector<std::shared_ptr<RowStream> > streams;
+            if (streamOffsets)
+                streamOffsets->clear();
+
+            for (size_t i = 0;  i < source->datasets.size();  ++i) {
+                size_t numRows = source->datasetRowCount(i);
+                if (numRows == 0)
+                    continue;
+
+                ssize_t numChildStreams = AUTO;
+                if (approxNumberOfChildStreams != AUTO) {
+                    numChildStreams
+                        = std::max<ssize_t>
+                        (1, approxNumberOfChildStreams * numRows
+                         / rowStreamTotalRows);
+                }
+
+                std::vector<size_t> childOffsets;
+                auto childStreams
+                    = getChildStream(i)->parallelize(numRows,
+                                                     numChildStreams,
+                                                     &childOffsets);
+                ExcAssertEqual(childOffsets.size(), childStreams.size() + 1);
+
+                for (size_t j = 0;  j < childStreams.size();  ++j) {
+                    auto stream = std::make_shared<UnionRowStream>(source);
+                    stream->datasetIndex = i;
+                    stream->subRowIndex = childOffsets[j];
+                    stream->subNumRow = numRows;
+                    stream->currentSubRowStream = std::move(childStreams[j]);
+                    streams.emplace_back(std::move(stream));
+
+                    if (streamOffsets)
+                        streamOffsets->push_back(source->rowOffsets[i]
+                                                 + childOffsets[j]);
                 }
             }
+
+            if (streamOffsets)
+                streamOffsets->push_back(rowStreamTotalRows);
+
+            return streams;
+        }
+
+        /// Morsels follow those of the child streams, and so never cross
+        /// from one dataset to the next
+        virtual std::vector<size_t>
+        getMorselOffsets(int64_t rowStreamTotalRows,
+                         ssize_t maxRowsPerMorsel) const override
+        {
+            ExcAssertEqual(rowStreamTotalRows, source->rowOffsets.back());
+
+            if (maxRowsPerMorsel == AUTO)
+                maxRowsPerMorsel = defaultRowsPerMorsel(rowStreamTotalRows);
+            ExcAssertGreater(maxRowsPerMorsel, 0);
+
+            std::vector<size_t> result;
+            for (size_t i = 0;  i < source->datasets.size();  ++i) {
+                size_t numRows = source->datasetRowCount(i);
+                if (numRows == 0)
+                    continue;
+                std::vector<size_t> childOffsets
+                    = getChildStream(i)->getMorselOffsets(numRows,
+                                                          maxRowsPerMorsel);
+                ExcAssertEqual(childOffsets.back(), numRows);
+                for (size_t j = 0;  j + 1 < childOffsets.size();  ++j)
+                    result.push_back(source->rowOffsets[i] + childOffsets[j]);
+            }
+            result.push_back(rowStreamTotalRows);
+
+            return result;
+        }
+
+        virtual RowPath next() override
+        {
+            RowPath mynext = PathElement(datasetIndex) + currentSubRowStream->next();
+            if (++subRowIndex == subNumRow)
+                nextDataset();
             return mynext;
         }
 
@@ -173,6 +329,122 @@ struct UnionDataset::Itl
             return storage = PathElement(datasetIndex) + sub;
         }
 
+        virtual bool supportsExtendedInterface() const override
+        {
+            return source->extendedInterface;
+        }
+
+        virtual void advance() override
+        {
+            currentSubRowStream->advance();
+            if (++subRowIndex == subNumRow)
+                nextDataset();
+        }
+
+        virtual void advanceBy(size_t n) override
+        {
+            // Skip whole datasets without touching their streams
+            while (n > 0) {
+                ExcAssert(currentSubRowStream);
+                size_t left = subNumRow - subRowIndex;
+                if (n < left) {
+                    currentSubRowStream->advanceBy(n);
+                    subRowIndex += n;
+                    return;
+                }
+                n -= left;
+                nextDataset();
+            }
+        }
+
+        virtual void
+        extractColumns(size_t numValues,
+                       const std::vector<ColumnPath> & columnNames,
+                       CellValue * output) override
+        {
+            while (numValues > 0) {
+                ExcAssert(currentSubRowStream);
+                size_t n = std::min(numValues, subNumRow - subRowIndex);
+
+                // Only ask the dataset for the columns it knows about, as
+                // the others are null for all of its rows
+                const MatrixView & matrix
+                    = *source->datasets[datasetIndex]->getMatrixView();
+                std::vector<ColumnPath> known;
+                std::vector<int> knownPositions;
+                for (size_t i = 0;  i < columnNames.size();  ++i) {
+                    if (matrix.knownColumn(columnNames[i])) {
+                        known.push_back(columnNames[i]);
+                        knownPositions.push_back(i);
+                    }
+                }
+
+                if (known.size() == columnNames.size()) {
+                    currentSubRowStream->extractColumns(n, columnNames, output);
+                }
+                else if (known.empty()) {
+                    currentSubRowStream->advanceBy(n);
+                    std::fill(output, output + n * columnNames.size(),
+                              CellValue());
+                }
+                else {
+                    std::vector<CellValue> knownValues(n * known.size());
+                    currentSubRowStream->extractColumns(n, known,
+                                                        knownValues.data());
+                    for (size_t r = 0;  r < n;  ++r) {
+                        CellValue * row = output + r * columnNames.size();
+                        std::fill(row, row + columnNames.size(), CellValue());
+                        for (size_t i = 0;  i < known.size();  ++i) {
+                            row[knownPositions[i]]
+                                = std::move(knownValues[r * known.size() + i]);
+                        }
+                    }
+                }
+
+                output += n * columnNames.size();
+                numValues -= n;
+                subRowIndex += n;
+                if (subRowIndex == subNumRow)
+                    nextDataset();
+            }
+        }
+
+        std::shared_ptr<RowStream> getChildStream(size_t index) const
+        {
+            auto result = source->datasets[index]->getRowStream();
+            if (!result) {
+                throw MLDB::Exception("Dataset %d of the union doesn't "
+                                      "support row streams", (int)index);
+            }
+            return result;
+        }
+
+        /// Open the stream of the current dataset at the given row
+        void openDataset(size_t row)
+        {
+            currentSubRowStream = getChildStream(datasetIndex);
+            subRowIndex = row;
+            subNumRow = source->datasetRowCount(datasetIndex);
+            currentSubRowStream->initAt(subRowIndex);
+        }
+
+        /// Move on to the first row of the next non-empty dataset
+        void nextDataset()
+        {
+            ++datasetIndex;
+            while (datasetIndex < source->datasets.size()
+                   && source->datasetRowCount(datasetIndex) == 0)
+                ++datasetIndex;
+
+            if (datasetIndex < source->datasets.size()) {
+                openDataset(0);
+            }
+            else {
+                currentSubRowStream.reset();
+                subRowIndex = subNumRow = 0;
+            }
+        }
+
         const UnionDataset::Itl* source;
         size_t datasetIndex;
         size_t subRowIndex;
@@ -185,13 +457,24 @@ struct UnionDataset::Itl
     {
         // Row names are idx.rowPath where idx is the index of the dataset
         // in the union and rowPath is the original rowPath.
+        size_t end = rowOffsets.back();
+        if (limit != -1)
+            end = std::min<size_t>(end, start + limit);
+
         vector<RowPath> result;
         for (int i = 0; i < datasets.size(); ++i) {
+            // Only the datasets that overlap [start, end)
+            size_t first = std::max<size_t>(start, rowOffsets[i]);
+            size_t last = std::min(end, rowOffsets[i + 1]);
+            if (first >= last) {
+                continue;
+            }
             const auto & d = datasets[i];
-            for (const auto & name: d->getMatrixView()->getRowPaths()) {
+            for (const auto & name:
+                     d->getMatrixView()->getRowPaths(first - rowOffsets[i],
+                                                     last - first)) {
                 result.emplace_back(PathElement(i) + name);
             }
-
         }
         return result;
     }
@@ -200,8 +483,16 @@ struct UnionDataset::Itl
     getRowHashes(ssize_t start = 0, ssize_t limit = -1) const
     {
         std::vector<RowHash> result;
-        for (const auto & it: rowIndex) {
-            result.emplace_back(it.first);
+        if (start == 0 && limit == -1) {
+            result.reserve(rowIndex.size());
+            for (const auto & it: rowIndex) {
+                result.emplace_back(it.first);
+            }
+            return result;
+        }
+
+        for (const auto & rowPath: getRowPaths(start, limit)) {
+            result.emplace_back(rowPath);
         }
         return result;
     }
@@ -230,7 +521,7 @@ struct UnionDataset::Itl
         }
         const auto & idxAndHash = it->second;
         Path subRowName = datasets[idxAndHash.first]->getMatrixView()->getRowPath(idxAndHash.second);
-        return PathElement(idxAndHash.second) + subRowName;
+        return PathElement(idxAndHash.first) + subRowName;
     }
 
     // DEPRECATED
@@ -246,12 +537,7 @@ struct UnionDataset::Itl
 
     virtual bool knownColumn(const Path & column) const
     {
-        for (const auto & d: datasets) {
-            if (d->getMatrixView()->knownColumn(column)) {
-                return true;
-            }
-        }
-        return false;
+        return getColumnBitmap(column) != 0;
     }
 
     uint32_t getColumnBitmap(ColumnHash columnHash) const
@@ -259,27 +545,57 @@ struct UnionDataset::Itl
         return columnIndex.getDefault(columnHash, 0);
     }
 
-    virtual ColumnPath getColumnPath(ColumnHash columnHash) const
+    /** Return the indexes of the datasets that have the given column, in
+        order.
+    */
+    vector<int> getColumnDatasets(ColumnHash columnHash) const
     {
+        vector<int> result;
         uint32_t bitmap = getColumnBitmap(columnHash);
+        while (bitmap) {
+            int bit = ML::lowest_bit(bitmap, -1);
+            bitmap = bitmap & ~(1U << bit);
+            if (bit != OVERFLOW_BIT) {
+                result.push_back(bit);
+                continue;
+            }
+            for (size_t i = 0;  i < overflowColumns.size();  ++i) {
+                if (std::binary_search(overflowColumns[i].begin(),
+                                       overflowColumns[i].end(),
+                                       columnHash.hash())) {
+                    result.push_back(i + OVERFLOW_BIT);
+                }
+            }
+        }
+        return result;
+    }
 
-        if (bitmap == 0)
-            throw MLDB::Exception("Column not found in union dataset");
+    virtual ColumnPath getColumnPath(ColumnHash columnHash) const
+    {
+        vector<int> columnDatasets = getColumnDatasets(columnHash);
 
-        int bit = ML::lowest_bit(bitmap, -1);
+        if (columnDatasets.empty())
+            throw MLDB::Exception("Column not found in union dataset");
 
-        return datasets[bit]->getMatrixView()->getColumnPath(columnHash);
+        return datasets[columnDatasets[0]]->getMatrixView()->getColumnPath(columnHash);
     }
 
     /** Return a list of all columns. */
     virtual vector<ColumnPath> getColumnPaths() const
     {
-        std::set<ColumnPath> preResult;
-        for (const auto & d: datasets) {
-            auto columnPaths = d->getColumnPaths();
-            preResult.insert(columnPaths.begin(), columnPaths.end());
-        }
-        return vector<ColumnPath>(preResult.begin(), preResult.end());
+        vector<ColumnPath> result;
+        result.reserve(columnIndex.size());
+
+        auto onColumn = [&] (uint64_t hash, uint32_t bitmap)
+            {
+                result.push_back(getColumnPath(ColumnHash(hash)));
+                return true;
+            };
+
+        columnIndex.forEach(onColumn);
+
+        std::sort(result.begin(), result.end());
+        return result;
     }
 
     virtual MatrixColumn getColumn(const ColumnPath & columnPath) const
@@ -287,13 +603,24 @@ struct UnionDataset::Itl
         MatrixColumn result;
         result.columnName = columnPath;
         result.columnHash = columnPath;
-        vector<std::tuple<RowPath, CellValue> > res;
-        for (int i = 0; i < datasets.size(); ++i) {
-            const auto & d = datasets[i];
-            const auto & subCol = d->getColumnIndex()->getColumn(columnPath);
-            for (const auto & curr: subCol.rows) {
-                result.rows.emplace_back(PathElement(i) + std::get<0>(curr),
-                                         std::get<1>(curr),
+
+        // Only the datasets with the column are asked for it, all at once
+        vector<int> columnDatasets = getColumnDatasets(ColumnHash(columnPath));
+        vector<MatrixColumn> subColumns(columnDatasets.size());
+
+        auto getSubColumn = [&] (int i)
+            {
+                subColumns[i] = datasets[columnDatasets[i]]->getColumnIndex()
+                    ->getColumn(columnPath);
+            };
+
+        parallelMap(0, columnDatasets.size(), getSubColumn);
+
+        for (int i = 0; i < columnDatasets.size(); ++i) {
+            for (auto & curr: subColumns[i].rows) {
+                result.rows.emplace_back(PathElement(columnDatasets[i])
+                                         + std::get<0>(curr),
+                                         std::move(std::get<1>(curr)),
                                          std::get<2>(curr));
             }
         }
@@ -305,15 +632,24 @@ struct UnionDataset::Itl
     getColumnValues(const ColumnPath & columnPath,
                     const std::function<bool (const CellValue &)> & filter) const
     {
+        vector<int> columnDatasets = getColumnDatasets(ColumnHash(columnPath));
+        vector<vector<std::tuple<RowPath, CellValue> > >
+            subValues(columnDatasets.size());
+
+        auto getSubValues = [&] (int i)
+            {
+                subValues[i] = datasets[columnDatasets[i]]->getColumnIndex()
+                    ->getColumnValues(columnPath, filter);
+            };
+
+        parallelMap(0, columnDatasets.size(), getSubValues);
+
         vector<std::tuple<RowPath, CellValue> > res;
-        for (int i = 0; i < datasets.size(); ++i) {
-            const auto & d = datasets[i];
-            for (const auto curr: d->getColumnIndex()->getColumnValues(columnPath)) {
-                if (filter(std::get<1>(curr))) {
-                    res.emplace_back(
-                        PathElement(i) + std::get<0>(curr).toUtf8String().rawString(),
-                        std::get<1>(curr));
-                }
+        for (int i = 0; i < columnDatasets.size(); ++i) {
+            for (auto & curr: subValues[i]) {
+                res.emplace_back(PathElement(columnDatasets[i])
+                                 + std::get<0>(curr),
+                                 std::move(std::get<1>(curr)));
             }
         }
         return res;
@@ -321,11 +657,7 @@ struct UnionDataset::Itl
 
     virtual size_t getRowCount() const
     {
-        size_t count = 0;
-        for (const auto & d: datasets) {
-            count += d->getRowCount();
-        }
-        return count;
+        return rowOffsets.back();
     }
 
     virtual size_t getColumnCount() const
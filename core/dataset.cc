@@ -30,6 +30,8 @@
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/rest/cancellation_exception.h"
 #include <mutex>
+#include <map>
+#include <algorithm>
 
 
 using namespace std;
@@ -74,6 +76,16 @@ struct SortByRowHash {
 /* ROW STREAM                                                                */
 /*****************************************************************************/
 
+size_t
+RowStream::
+defaultRowsPerMorsel(int64_t rowStreamTotalRows)
+{
+    // Enough morsels for each thread to take a few dozen, but not so
+    // small that opening them costs more than scanning them
+    int64_t result = rowStreamTotalRows / (numCpus() * 32);
+    return std::max<int64_t>(result, 1024);
+}
+
 std::vector<std::shared_ptr<RowStream> >
 RowStream::
 parallelize(int64_t rowStreamTotalRows,
@@ -115,6 +127,51 @@ parallelize(int64_t rowStreamTotalRows,
     return streams;
 }
 
+std::vector<size_t>
+RowStream::
+getMorselOffsets(int64_t rowStreamTotalRows,
+                 ssize_t maxRowsPerMorsel) const
+{
+    ExcAssertGreaterEqual(rowStreamTotalRows, 0);
+
+    if (maxRowsPerMorsel == AUTO)
+        maxRowsPerMorsel = defaultRowsPerMorsel(rowStreamTotalRows);
+    ExcAssertGreater(maxRowsPerMorsel, 0);
+
+    std::vector<size_t> result;
+    for (int64_t i = 0;  i < rowStreamTotalRows;  i += maxRowsPerMorsel)
+        result.push_back(i);
+    result.push_back(rowStreamTotalRows);
+    return result;
+}
+
+bool
+RowStream::
+forEachMorsel(int64_t rowStreamTotalRows,
+              const std::function<bool (RowStream & stream,
+                                        size_t start,
+                                        size_t end)> & onMorsel,
+              ssize_t maxRowsPerMorsel) const
+{
+    std::vector<size_t> offsets
+        = getMorselOffsets(rowStreamTotalRows, maxRowsPerMorsel);
+    ExcAssertGreaterEqual(offsets.size(), 1);
+    ExcAssertEqual(offsets.back(), rowStreamTotalRows);
+
+    // parallelMapHaltable hands out the indexes one at a time to whichever
+    // thread asks next, which is our shared queue of morsels
+    auto doMorsel = [&] (size_t i) -> bool
+        {
+            if (offsets[i] == offsets[i + 1])
+                return true;
+            std::shared_ptr<RowStream> stream = clone();
+            stream->initAt(offsets[i]);
+            return onMorsel(*stream, offsets[i], offsets[i + 1]);
+        };
+
+    return parallelMapHaltable(0, offsets.size() - 1, doMorsel);
+}
+
 void
 RowStream::
 advance()
@@ -268,6 +325,28 @@ MatrixView::
 {
 }
 
+std::vector<bool>
+MatrixView::
+knownRows(const std::vector<RowPath> & rows) const
+{
+    std::vector<bool> result(rows.size());
+    for (size_t i = 0;  i < rows.size();  ++i)
+        result[i] = knownRow(rows[i]);
+    return result;
+}
+
+std::vector<MatrixNamedRow>
+MatrixView::
+getRows(const std::vector<RowPath> & rows) const
+{
+    std::vector<MatrixNamedRow> result(rows.size());
+    for (size_t i = 0;  i < rows.size();  ++i) {
+        if (knownRow(rows[i]))
+            result[i] = getRow(rows[i]);
+    }
+    return result;
+}
+
 uint64_t
 MatrixView::
 getRowColumnCount(const RowPath & row) const
@@ -279,6 +358,30 @@ getRowColumnCount(const RowPath & row) const
 }
 
 
+/*****************************************************************************/
+/* COLUMN SUMMARY                                                            */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(ColumnSummary);
+
+ColumnSummaryDescription::
+ColumnSummaryDescription()
+{
+    addField("rowCount", &ColumnSummary::rowCount,
+             "Number of rows that have a value in the column");
+    addField("distinctValues", &ColumnSummary::distinctValues,
+             "Number of distinct values of the column");
+    addField("minValue", &ColumnSummary::minValue,
+             "Smallest value of the column, or null if it has none");
+    addField("maxValue", &ColumnSummary::maxValue,
+             "Largest value of the column, or null if it has none");
+    addField("isNumeric", &ColumnSummary::isNumeric,
+             "True if all of the values of the column are numbers");
+    addField("atMostOne", &ColumnSummary::atMostOne,
+             "True if no row has more than one value in the column");
+}
+
+
 /*****************************************************************************/
 /* COLUMN INDEX                                                              */
 /*****************************************************************************/
@@ -415,12 +518,12 @@ getColumnDistinctValues(const ColumnPath & column) const
     return vals;
 }
 
+namespace {
+
+/** Bucketize a dense column, as the default getColumnBuckets() does. */
 std::tuple<BucketList, BucketDescriptions>
-ColumnIndex::
-getColumnBuckets(const ColumnPath & column,
-                 int maxNumBuckets) const
+bucketizeDenseColumn(std::vector<CellValue> vals, int maxNumBuckets)
 {
-    auto vals = getColumnDense(column);
     std::vector<std::pair<CellValue, uint32_t> > vals2;
     vals2.reserve(vals.size());
     for (size_t i = 0;  i < vals.size();  ++i) {
@@ -469,6 +572,133 @@ getColumnBuckets(const ColumnPath & column,
     return std::make_tuple(std::move(buckets), std::move(descriptions));
 }
 
+/** Position of each row in getRowPaths(), shared between the columns
+    extracted by getColumnsDense() and getColumnsBuckets() so that the
+    rows are only listed once.
+*/
+struct DenseRowPositions {
+    DenseRowPositions(const ColumnIndex & index)
+    {
+        auto rowNames = index.getRowPaths();
+        numRows = rowNames.size();
+        positions.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i)
+            positions.insert({ RowHash(rowNames[i]), i });
+    }
+
+    /** Turn the given column into a dense one, keeping the latest value of
+        each row like getColumnDense().
+    */
+    std::vector<CellValue> makeDense(MatrixColumn column) const
+    {
+        std::vector<CellValue> result(numRows);
+        std::vector<Date> latest(numRows);
+        std::vector<bool> found(numRows, false);
+
+        for (auto & c: column.rows) {
+            auto it = positions.find(RowHash(std::get<0>(c)));
+            if (it == positions.end())
+                continue;
+            size_t i = it->second;
+            if (found[i] && std::get<2>(c) <= latest[i])
+                continue;
+            result[i] = std::move(std::get<1>(c));
+            latest[i] = std::get<2>(c);
+            found[i] = true;
+        }
+
+        return result;
+    }
+
+    size_t numRows;
+    Lightweight_Hash<RowHash, size_t> positions;
+};
+
+} // file scope
+
+std::tuple<BucketList, BucketDescriptions>
+ColumnIndex::
+getColumnBuckets(const ColumnPath & column,
+                 int maxNumBuckets) const
+{
+    return bucketizeDenseColumn(getColumnDense(column), maxNumBuckets);
+}
+
+std::vector<std::vector<CellValue> >
+ColumnIndex::
+getColumnsDense(const std::vector<ColumnPath> & columns) const
+{
+    DenseRowPositions rows(*this);
+    std::vector<std::vector<CellValue> > result(columns.size());
+
+    auto doColumn = [&] (size_t i)
+        {
+            result[i] = rows.makeDense(getColumn(columns[i]));
+        };
+
+    parallelMap(0, columns.size(), doColumn);
+
+    return result;
+}
+
+std::vector<std::tuple<BucketList, BucketDescriptions> >
+ColumnIndex::
+getColumnsBuckets(const std::vector<ColumnPath> & columns,
+                  int maxNumBuckets) const
+{
+    DenseRowPositions rows(*this);
+    std::vector<std::tuple<BucketList, BucketDescriptions> >
+        result(columns.size());
+
+    // Only one dense column per thread exists at once
+    auto doColumn = [&] (size_t i)
+        {
+            result[i] = bucketizeDenseColumn
+                (rows.makeDense(getColumn(columns[i])), maxNumBuckets);
+        };
+
+    parallelMap(0, columns.size(), doColumn);
+
+    return result;
+}
+
+
+std::vector<std::vector<CellValue> >
+ColumnIndex::
+getEachColumnDense(const std::vector<ColumnPath> & columns) const
+{
+    std::vector<std::vector<CellValue> > result(columns.size());
+
+    auto doColumn = [&] (size_t i)
+        {
+            result[i] = getColumnDense(columns[i]);
+        };
+
+    parallelMap(0, columns.size(), doColumn);
+
+    return result;
+}
+
+std::vector<std::tuple<BucketList, BucketDescriptions> >
+ColumnIndex::
+getEachColumnBuckets(const std::vector<ColumnPath> & columns,
+                     int maxNumBuckets) const
+{
+    std::vector<std::tuple<BucketList, BucketDescriptions> >
+        result(columns.size());
+
+    auto doColumn = [&] (size_t i)
+        {
+            result[i] = getColumnBuckets(columns[i], maxNumBuckets);
+        };
+
+    parallelMap(0, columns.size(), doColumn);
+
+    return result;
+}
+
+
+
 
 /*****************************************************************************/
 /* DATASET RECORDER                                                          */
@@ -520,14 +750,133 @@ recordRowsExpr(const std::vector<std::pair<RowPath, ExpressionValue > > & rows)
 }
 
 
+/*****************************************************************************/
+/* COLUMN PROJECTION                                                         */
+/*****************************************************************************/
+
+ColumnProjection::
+ColumnProjection(const std::vector<ColumnPath> & columns)
+    : all(false)
+{
+    for (auto & c: columns) {
+        if (c.empty())
+            all = true;
+        else heads.push_back(c[0]);
+    }
+    std::sort(heads.begin(), heads.end());
+    heads.erase(std::unique(heads.begin(), heads.end()), heads.end());
+}
+
+bool
+ColumnProjection::
+isNeeded(const ColumnPath & column) const
+{
+    if (all)
+        return true;
+    if (column.empty())
+        return false;
+    return std::binary_search(heads.begin(), heads.end(), column[0]);
+}
+
+
 /*****************************************************************************/
 /* DATASET                                                                   */
 /*****************************************************************************/
 
+namespace {
+
+/// Incremented on every commit, creation and destruction of a dataset
+std::atomic<uint64_t> globalGeneration(0);
+
+} // file scope
+
+/** Statistics of a dataset, valid for one generation.  Each is calculated
+    without holding the lock, and kept only if no commit happened in the
+    meantime.
+*/
+struct Dataset::StatisticsCache {
+    std::mutex mutex;
+    uint64_t generation = 0;
+    bool hasRowCount = false;
+    uint64_t rowCount = 0;
+    bool hasFlattenedColumnCount = false;
+    size_t flattenedColumnCount = 0;
+    std::shared_ptr<const std::vector<ColumnPath> > columnPaths;
+    std::map<ColumnPath, std::shared_ptr<const ColumnStats> > columnStats;
+
+    /// Forget everything if the dataset was committed since it was added
+    void moveToGeneration(uint64_t newGeneration)
+    {
+        if (newGeneration == generation)
+            return;
+        hasRowCount = false;
+        hasFlattenedColumnCount = false;
+        columnPaths.reset();
+        columnStats.clear();
+        generation = newGeneration;
+    }
+};
+
 Dataset::
 Dataset(MldbServer * server)
-    : server(server)
+    : server(server), generation_(0)
 {
+    ++globalGeneration;
+}
+
+void
+Dataset::
+enableStatisticsCache()
+{
+    if (!statisticsCache_)
+        statisticsCache_.reset(new StatisticsCache());
+}
+
+std::shared_ptr<const ColumnStats>
+Dataset::
+getCachedColumnStats(const ColumnPath & column) const
+{
+    uint64_t generation = generation_;
+    if (statisticsCache_) {
+        std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+        statisticsCache_->moveToGeneration(generation);
+        auto it = statisticsCache_->columnStats.find(column);
+        if (it != statisticsCache_->columnStats.end())
+            return it->second;
+    }
+
+    auto stats = std::make_shared<ColumnStats>();
+    getColumnIndex()->getColumnStats(column, *stats);
+
+    if (statisticsCache_) {
+        std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+        if (statisticsCache_->generation == generation)
+            statisticsCache_->columnStats[column] = stats;
+    }
+
+    return stats;
+}
+
+ColumnSummary
+Dataset::
+getColumnSummary(const ColumnPath & column) const
+{
+    auto stats = getCachedColumnStats(column);
+
+    ColumnSummary result;
+    result.rowCount = stats->rowCount();
+    result.isNumeric = stats->isNumeric();
+    result.atMostOne = stats->atMostOne();
+    for (auto & v: stats->values) {
+        if (v.first.empty())
+            continue;
+        ++result.distinctValues;
+        // The values are in order, so the last one is the largest
+        if (result.minValue.empty())
+            result.minValue = v.first;
+        result.maxValue = v.first;
+    }
+    return result;
 }
 
 EnvOption<int> RETURN_OS_MEMORY("RETURN_OS_MEMORY", 1);
@@ -537,6 +886,8 @@ EnvOption<int> PRINT_OS_MEMORY("PRINT_OS_MEMORY", 0);
 Dataset::
 ~Dataset()
 {
+    ++globalGeneration;
+
     // MLDBFB-329
     // Once a dataset is deleted, try to free its memory from the system
     if (PRINT_OS_MEMORY) {
@@ -784,6 +1135,14 @@ getRowExpr(const RowPath & row) const
     return std::move(flattened.columns);
 }
 
+ExpressionValue
+Dataset::
+getProjectedRowExpr(const RowPath & row,
+                    const std::vector<ColumnPath> & columns) const
+{
+    return getRowExpr(row);
+}
+
 std::vector<MatrixNamedRow>
 Dataset::
 queryStructured(const SelectExpression & select,
@@ -831,11 +1190,42 @@ queryStructuredExpr(const SelectExpression & select,
                     Utf8String alias,
                     const ProgressFunc & onProgress
                     ) const
+{
+    std::vector<NamedRowValue> output;
+
+    auto onRow = [&] (NamedRowValue & row)
+        {
+            output.push_back(std::move(row));
+            return true;
+        };
+
+    std::shared_ptr<ExpressionValueInfo> structureInfo
+        = queryStructuredStream(onRow, select, when, where, orderBy, groupBy,
+                                having, rowName, offset, limit, alias,
+                                onProgress);
+
+    return make_tuple<std::vector<NamedRowValue>, 
+                      std::shared_ptr<ExpressionValueInfo> >(std::move(output), std::move(structureInfo));
+}
+
+std::shared_ptr<ExpressionValueInfo>
+Dataset::
+queryStructuredStream(const std::function<bool (NamedRowValue &)> & onRow,
+                      const SelectExpression & select,
+                      const WhenExpression & when,
+                      const SqlExpression & where,
+                      const OrderByExpression & orderBy,
+                      const TupleExpression & groupBy,
+                      const std::shared_ptr<SqlExpression> having,
+                      const std::shared_ptr<SqlExpression> rowName,
+                      ssize_t offset,
+                      ssize_t limit,
+                      Utf8String alias,
+                      const ProgressFunc & onProgress
+                      ) const
 {
     ExcAssert(having);
     ExcAssert(rowName);
-    std::mutex lock;
-    std::vector<NamedRowValue> output;
     std::shared_ptr<ExpressionValueInfo> structureInfo;
 
     if (!having->isConstantTrue() && groupBy.clauses.empty())
@@ -857,10 +1247,10 @@ queryStructuredExpr(const SelectExpression & select,
         auto processor = [&] (NamedRowValue & row_,
                                const std::vector<ExpressionValue> & calc)
             {
+                checkCancelled();
                 row_.rowName = getValidatedRowName(calc.at(0));
                 row_.rowHash = row_.rowName;
-                output.push_back(std::move(row_));
-                return true;
+                return onRow(row_);
             };
 
         //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
@@ -879,8 +1269,8 @@ queryStructuredExpr(const SelectExpression & select,
         // Otherwise do it grouped...
         auto processor = [&] (NamedRowValue & row_)
             {
-                output.push_back(std::move(row_));
-                return true;
+                checkCancelled();
+                return onRow(row_);
             };
 
          //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
@@ -890,8 +1280,7 @@ queryStructuredExpr(const SelectExpression & select,
                               onProgress).second;
     }
 
-    return make_tuple<std::vector<NamedRowValue>, 
-                      std::shared_ptr<ExpressionValueInfo> >(std::move(output), std::move(structureInfo));
+    return structureInfo;
 }
 
 bool
@@ -1176,6 +1565,16 @@ generateRowPathIsExpression(const Dataset & dataset,
             "generate single row matching rowPath() expression"};
 }
 
+/** Set to make unordered queries with a LIMIT return the same rows every
+    time they are run.  Otherwise, the threads scanning for the rows that
+    match the where clause stop as soon as enough of them have been found
+    between them, and which ones those are depends on the timing.
+*/
+static EnvOption<bool> DETERMINISTIC_LIMIT("MLDB_DETERMINISTIC_LIMIT", false);
+
+/// Number of rows looked at in each step when DETERMINISTIC_LIMIT is set
+static constexpr ssize_t ROWS_PER_LIMIT_BLOCK = 65536;
+
 /*
     Must return the *exact* set of rows or a stream that will do the same
     because the where expression will not be evaluated outside of this method
@@ -1890,102 +2289,170 @@ generateRowsWhere(const SqlBindingScope & scope,
 
     //no need to check for where == true, it was checked above...
 
-    return {[=] (ssize_t numToGenerate, Any token,
-                 const BoundParameters & params,
-                 const ProgressFunc & onProgress)
-            {
-                ssize_t start = 0;
-                ssize_t limit = numToGenerate;
+    // Filter the given rows, stopping once quota of them have matched.
+    // Returns false if it stopped before looking at all of them.
+    auto filterRows = [=] (const std::vector<RowPath> & rows,
+                           size_t quota,
+                           std::vector<RowPath> & rowsToKeep,
+                           const BoundParameters & params,
+                           const ProgressFunc & onProgress) -> bool
+        {
+            auto matrix = this->getMatrixView();
 
-                ExcAssertNotEqual(limit, 0);
+            PerThreadAccumulator<std::vector<RowPath> > accum;
             
-                if (!token.empty())
-                    start = token.convert<size_t>();
+            size_t numRows = rows.size();
+            std::atomic_ulong rowCount(0);
+            std::atomic<size_t> numMatched(0);
+            std::atomic<bool> quotaReached(false);
+
+            ProgressState whereProgress(numRows);
+            auto onRow = [&] (size_t n)
+                {
+                    // Shared by all of the threads, so that they all stop
+                    // as soon as enough rows have been found
+                    if (numMatched.load(std::memory_order_relaxed) >= quota) {
+                        quotaReached = true;
+                        return false;
+                    }
 
-                auto matrix = this->getMatrixView();
+                    ++rowCount;
 
-                //Row names can be returned in an arbitrary order as long as it is deterministic.
-                //TODO - review if and how we should report progress here
-                auto rows = matrix->getRowPaths(start, limit);
+                    if (rowCount % PROGRESS_RATE == 0) {
+                        if (onProgress) {
+                            whereProgress = rowCount;
+                            if (!onProgress(whereProgress)) {
+                                return false;
+                            }
+                        }
+                    }
 
-                std::vector<RowPath> rowsToKeep;
+                    const RowPath & r = rows[n];
 
-                PerThreadAccumulator<std::vector<RowPath> > accum;
-                
-                size_t numRows = rows.size();
-                std::atomic_ulong rowCount(0);
+                    MatrixNamedRow row;
+                    if (needsColumns)
+                        row = matrix->getRow(r);
+                    else {
+                        row.rowHash = row.rowName = r;
+                    }
 
-                ProgressState whereProgress(numRows);
-                auto onRow = [&] (size_t n)
-                    {
-                        ++rowCount;
+                    auto rowScope = dsScope.getRowScope(row, &params);
+                    
+                    bool keep = whereBound(rowScope, GET_LATEST).isTrue();
+                    
+                    if (keep) {
+                        accum.get().push_back(r);
+                        numMatched.fetch_add(1, std::memory_order_relaxed);
+                    }
 
-                        if (rowCount % PROGRESS_RATE == 0) {
-                            if (onProgress) {
-                                whereProgress = rowCount;
-                                if (!onProgress(whereProgress)) {
-                                    return false;
-                                }
-                            }
-                        }
+                    return true;
+                };
+
+            bool needSort = false;
+            if (rows.size() >= 1000) {
+                // Scan the whole lot with the when in parallel
+                if (!parallelMapHaltable(0, rows.size(), onRow)
+                    && !quotaReached)
+                    throw CancellationException("row where generation was cancelled");
+
+                needSort = true;
+            } else {
+                // Serial, since probably it's not worth the overhead
+                // to run them in parallel.
+                for (unsigned i = 0;  i < rows.size() && !quotaReached;  ++i)
+                    if (!onRow(i) && !quotaReached)
+                        throw CancellationException("row where generation was cancelled");
+            }
 
-                        const RowPath & r = rows[n];
+            // Now merge together the results of all the threads
+            size_t firstNew = rowsToKeep.size();
+            auto onThreadOutput = [&] (std::vector<RowPath> * vec)
+                {
+                    rowsToKeep.insert(rowsToKeep.end(),
+                                      std::make_move_iterator(vec->begin()),
+                                      std::make_move_iterator(vec->end()));
+                };
+            
+            accum.forEach(onThreadOutput);
 
-                        MatrixNamedRow row;
-                        if (needsColumns)
-                            row = matrix->getRow(r);
-                        else {
-                            row.rowHash = row.rowName = r;
-                        }
+            //Need sorting because the parallelisation breaks determinism
+            if (needSort) 
+                parallelQuickSortRecursive<RowPath, SortByRowHash>
+                    (rowsToKeep.begin() + firstNew, rowsToKeep.end());
 
-                        auto rowScope = dsScope.getRowScope(row, &params);
-                        
-                        bool keep = whereBound(rowScope, GET_LATEST).isTrue();
-                        
-                        if (keep)
-                            accum.get().push_back(r);
+            return !quotaReached;
+        };
 
-                        return true;
-                    };
+    auto exec = [=] (ssize_t numToGenerate, Any token,
+                     const BoundParameters & params,
+                     const ProgressFunc & onProgress)
+        {
+            ssize_t start = 0;
+            ssize_t limit = numToGenerate;
 
-                bool needSort = false;
-                if (rows.size() >= 1000) {
-                    // Scan the whole lot with the when in parallel
-                    if (!parallelMapHaltable(0, rows.size(), onRow))
-                        throw CancellationException("row where generation was cancelled");
+            ExcAssertNotEqual(limit, 0);
+        
+            if (!token.empty())
+                start = token.convert<size_t>();
 
-                    needSort = true;
-                } else {
-                    // Serial, since probably it's not worth the overhead
-                    // to run them in parallel.
-                    for (unsigned i = 0;  i < rows.size();  ++i)
-                        if (!onRow(i))
-                            throw CancellationException("row where generation was cancelled");
-                }
+            auto matrix = this->getMatrixView();
 
-                // Now merge together the results of all the threads
-                auto onThreadOutput = [&] (std::vector<RowPath> * vec)
-                    {
-                        rowsToKeep.insert(rowsToKeep.end(),
-                                          std::make_move_iterator(vec->begin()),
-                                          std::make_move_iterator(vec->end()));
-                    };
-                
-                accum.forEach(onThreadOutput);
+            //Row names can be returned in an arbitrary order as long as it is deterministic.
+            //TODO - review if and how we should report progress here
+            auto rows = matrix->getRowPaths(start, limit);
 
-                //Need sorting because the parallelisation breaks determinism
-                if (needSort) 
-                    parallelQuickSortRecursive<RowPath, SortByRowHash>(rowsToKeep.begin(), rowsToKeep.end());
+            std::vector<RowPath> rowsToKeep;
+            filterRows(rows, (size_t)-1, rowsToKeep, params, onProgress);
 
-                start += rows.size();
-                Any newToken;
-                if (rows.size() == limit)
-                    newToken = start;
-                
-                return make_pair(std::move(rowsToKeep),
-                                 std::move(newToken));
-            },
-            "scan table filtering by where expression"};
+            start += rows.size();
+            Any newToken;
+            if (rows.size() == limit)
+                newToken = start;
+            
+            return make_pair(std::move(rowsToKeep),
+                             std::move(newToken));
+        };
+
+    auto execUntilMatched = [=] (ssize_t numToGenerate, Any token,
+                                 const BoundParameters & params,
+                                 const ProgressFunc & onProgress)
+        {
+            ExcAssertGreater(numToGenerate, 0);
+            ExcAssert(token.empty());
+
+            auto matrix = this->getMatrixView();
+            std::vector<RowPath> rowsToKeep;
+
+            if (!DETERMINISTIC_LIMIT) {
+                // All of the scan threads share the quota, and stop as
+                // soon as it's been met.  Which rows are found first
+                // depends on how the threads are scheduled.
+                auto rows = matrix->getRowPaths(0, -1);
+                filterRows(rows, numToGenerate, rowsToKeep, params,
+                           onProgress);
+            }
+            else {
+                // Look at fixed blocks of rows in order, each completely,
+                // until one makes up the quota, so that the same rows are
+                // found every time.
+                for (ssize_t start = 0;  ;  start += ROWS_PER_LIMIT_BLOCK) {
+                    auto rows = matrix->getRowPaths(start,
+                                                    ROWS_PER_LIMIT_BLOCK);
+                    filterRows(rows, (size_t)-1, rowsToKeep, params,
+                               onProgress);
+                    if (rowsToKeep.size() >= (size_t)numToGenerate
+                        || rows.size() < (size_t)ROWS_PER_LIMIT_BLOCK)
+                        break;
+                }
+            }
+
+            return make_pair(std::move(rowsToKeep), Any());
+        };
+
+    GenerateRowsWhereFunction result
+        (exec, "scan table filtering by where expression");
+    result.execUntilMatched = execUntilMatched;
+    return result;
 }
 
 /**
@@ -2273,8 +2740,29 @@ std::vector<ColumnPath>
 Dataset::
 getColumnPaths(ssize_t offset, ssize_t limit) const
 {
-    auto names = getMatrixView()->getColumnPaths();
-    return frame(names, offset, limit);
+    if (!statisticsCache_) {
+        auto names = getMatrixView()->getColumnPaths();
+        return frame(names, offset, limit);
+    }
+
+    uint64_t generation = generation_;
+    std::shared_ptr<const std::vector<ColumnPath> > names;
+    {
+        std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+        statisticsCache_->moveToGeneration(generation);
+        names = statisticsCache_->columnPaths;
+    }
+
+    if (!names) {
+        names = std::make_shared<std::vector<ColumnPath> >
+            (getMatrixView()->getColumnPaths());
+        std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+        if (statisticsCache_->generation == generation)
+            statisticsCache_->columnPaths = names;
+    }
+
+    auto result = *names;
+    return frame(result, offset, limit);
 }
 
 std::vector<ColumnPath>
@@ -2292,13 +2780,47 @@ getFlattenedColumnCount() const
 {
     //Most dataset are not structured
     //Notable exception is the sub query dataset
-    return getMatrixView()->getColumnCount();
+    if (!statisticsCache_)
+        return getMatrixView()->getColumnCount();
+
+    uint64_t generation = generation_;
+    {
+        std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+        statisticsCache_->moveToGeneration(generation);
+        if (statisticsCache_->hasFlattenedColumnCount)
+            return statisticsCache_->flattenedColumnCount;
+    }
+
+    size_t result = getMatrixView()->getColumnCount();
+
+    std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+    if (statisticsCache_->generation == generation) {
+        statisticsCache_->flattenedColumnCount = result;
+        statisticsCache_->hasFlattenedColumnCount = true;
+    }
+    return result;
 }
 
 void
 Dataset::
 commit()
 {
+    ++generation_;
+    ++globalGeneration;
+}
+
+uint64_t
+Dataset::
+getGeneration() const
+{
+    return generation_;
+}
+
+uint64_t
+Dataset::
+getGlobalGeneration()
+{
+    return globalGeneration;
 }
 
 BoundFunction
@@ -2321,7 +2843,25 @@ uint64_t
 Dataset::
 getRowCount() const
 {
-    return getMatrixView()->getRowCount();
+    if (!statisticsCache_)
+        return getMatrixView()->getRowCount();
+
+    uint64_t generation = generation_;
+    {
+        std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+        statisticsCache_->moveToGeneration(generation);
+        if (statisticsCache_->hasRowCount)
+            return statisticsCache_->rowCount;
+    }
+
+    uint64_t result = getMatrixView()->getRowCount();
+
+    std::unique_lock<std::mutex> guard(statisticsCache_->mutex);
+    if (statisticsCache_->generation == generation) {
+        statisticsCache_->rowCount = result;
+        statisticsCache_->hasRowCount = true;
+    }
+    return result;
 }
 
 } // namespace MLDB
@@ -16,6 +16,7 @@
 #include "mldb/core/recorder.h"
 #include "mldb/utils/progress.h"
 #include <set>
+#include <atomic>
 
 // NOTE TO MLDB DEVELOPERS: This is an API header file.  No includes
 // should be added, especially value_description.h.
@@ -89,6 +90,22 @@ struct MatrixView {
     
     virtual MatrixNamedRow getRow(const RowPath & row) const = 0;
 
+    /** Bulk version of knownRow(), returning for each of the given rows
+        whether it is known.  The default calls knownRow() for each one;
+        backends that can look up a batch of rows at once should override
+        it.
+    */
+    virtual std::vector<bool> knownRows(const std::vector<RowPath> & rows) const;
+
+    /** Bulk version of getRow(), returning the given rows in the same
+        order.  Rows that aren't known are returned empty, with an empty
+        rowName.  The default calls knownRow() and getRow() for each one;
+        backends that can look up a batch of rows at once should override
+        it.
+    */
+    virtual std::vector<MatrixNamedRow>
+    getRows(const std::vector<RowPath> & rows) const;
+
     virtual RowPath getRowPath(const RowHash & row) const = 0;
 
     //virtual bool knownColumn(ColumnHash column) const = 0;
@@ -146,6 +163,20 @@ struct ColumnStats {
     uint64_t rowCount_;
 };
 
+/** Summary of the values of a column, which is what the planner and the
+    schema browser need to know about it without looking at the values.
+*/
+struct ColumnSummary {
+    uint64_t rowCount = 0;        ///< Number of rows with a value
+    uint64_t distinctValues = 0;  ///< Number of distinct values
+    CellValue minValue;           ///< Smallest value, null if there are none
+    CellValue maxValue;           ///< Largest value, null if there are none
+    bool isNumeric = false;       ///< Are all of the values numbers?
+    bool atMostOne = false;       ///< Does each row have at most one value?
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ColumnSummary);
+
 /*****************************************************************************/
 /* COLUMN INDEX                                                              */
 /*****************************************************************************/
@@ -191,6 +222,27 @@ struct ColumnIndex {
     getColumnBuckets(const ColumnPath & column,
                      int maxNumBuckets = -1) const;
 
+    /** Return the dense columns for each of the given columns, as
+        getColumnDense() would.
+
+        Default lists the rows just once for all of the columns, and
+        builds the columns in parallel on top of getColumn().
+    */
+    virtual std::vector<std::vector<CellValue> >
+    getColumnsDense(const std::vector<ColumnPath> & columns) const;
+
+    /** Return the bucketed dense columns for each of the given columns,
+        as getColumnBuckets() would.
+
+        Default lists the rows just once for all of the columns, and
+        builds and bucketizes the columns in parallel on top of
+        getColumn().  Datasets that store their columns natively should
+        override it to bucketize from their own storage.
+    */
+    virtual std::vector<std::tuple<BucketList, BucketDescriptions> >
+    getColumnsBuckets(const std::vector<ColumnPath> & columns,
+                      int maxNumBuckets = -1) const;
+
     /** Return the value of the column for all rows, ignoring timestamps. 
         Default implementation is based on getColumn
         Will throw if column is unknown
@@ -212,6 +264,22 @@ struct ColumnIndex {
 
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const = 0;
+
+protected:
+    /** Call getColumnDense() for each of the columns in parallel.  For
+        datasets with their own getColumnDense() to implement
+        getColumnsDense() with.
+    */
+    std::vector<std::vector<CellValue> >
+    getEachColumnDense(const std::vector<ColumnPath> & columns) const;
+
+    /** Call getColumnBuckets() for each of the columns in parallel.  For
+        datasets with their own getColumnBuckets() to implement
+        getColumnsBuckets() with.
+    */
+    std::vector<std::tuple<BucketList, BucketDescriptions> >
+    getEachColumnBuckets(const std::vector<ColumnPath> & columns,
+                         int maxNumBuckets) const;
 };
 
 
@@ -280,6 +348,40 @@ struct RowStream {
                 ssize_t approxNumberOfChildStreams = AUTO,
                 std::vector<size_t> * streamOffsets = nullptr) const;
 
+    /** Split the stream into many small morsels of at most
+        maxRowsPerMorsel rows (AUTO means enough for every thread to get
+        several), returning the offset of each morsel followed by the
+        total number of rows.  Unlike parallelize(), there are meant to be
+        many more morsels than threads, so that threads that get through
+        their morsels quickly can take more of them.
+
+        Default implementation splits evenly; specializations should make
+        the morsels follow the natural boundaries in their data, as each
+        morsel is opened with clone() and initAt().
+    */
+    virtual std::vector<size_t>
+    getMorselOffsets(int64_t rowStreamTotalRows,
+                     ssize_t maxRowsPerMorsel = AUTO) const;
+
+    /** Scan the stream in parallel, by calling onMorsel for each of the
+        morsels from getMorselOffsets() with a stream positioned at its
+        start and the range of rows it covers.  Morsels are handed out
+        from a shared queue to the threads as they become free, so that
+        a few dense morsels don't leave the other threads idle.  The order
+        in which morsels are processed is undefined.
+
+        Returns false if and only if onMorsel returned false, in which
+        case the remaining morsels are skipped.
+    */
+    bool forEachMorsel(int64_t rowStreamTotalRows,
+                       const std::function<bool (RowStream & stream,
+                                                 size_t start,
+                                                 size_t end)> & onMorsel,
+                       ssize_t maxRowsPerMorsel = AUTO) const;
+
+    /** Number of rows per morsel used for AUTO. */
+    static size_t defaultRowsPerMorsel(int64_t rowStreamTotalRows);
+
     /** Return the rowName() at the current position of the
         stream.  This may be called as many times as required.
         Undefined behaviour if it is called on a stream without
@@ -370,6 +472,30 @@ private:
 
 
 
+/*****************************************************************************/
+/* COLUMN PROJECTION                                                         */
+/*****************************************************************************/
+
+/** The columns passed to Dataset::getProjectedRowExpr(), in a form that
+    makes it quick to check whether each column of a row is needed: those
+    whose first element is the first element of one of them.
+*/
+
+struct ColumnProjection {
+    ColumnProjection(const std::vector<ColumnPath> & columns);
+
+    /// Does the projection need the given column?
+    bool isNeeded(const ColumnPath & column) const;
+
+    /// First elements of the projected columns, sorted and unique
+    std::vector<PathElement> heads;
+
+    /// Is every column needed?  This is the case when one of the
+    /// projected columns is empty, which stands for the whole row.
+    bool all;
+};
+
+
 /*****************************************************************************/
 /* DATASET                                                                   */
 /*****************************************************************************/
@@ -508,8 +634,22 @@ struct Dataset: public MldbEntity {
     */
     virtual ExpressionValue getRowExpr(const RowPath & row) const;
 
+    /** Return a row as an expression value, for a query that only reads
+        the given columns.  The result must contain at least the columns
+        whose name is one of them, or starts with the first element of one
+        of them; other columns may be left out.  This allows datasets that
+        read their rows from elsewhere to only transfer what is needed.
+
+        Default returns getRowExpr(row).
+    */
+    virtual ExpressionValue
+    getProjectedRowExpr(const RowPath & row,
+                        const std::vector<ColumnPath> & columns) const;
+
 
-    /** Commit changes to the database.  Default is a no-op.
+    /** Commit changes to the database.  The default increments the
+        generation of the dataset.  Datasets that override it must call
+        Dataset::commit() once their changes are visible to queries.
 
         This function must be thread safe with respect to concurrent calls to
         all other functions.  In particular, it must be safe to call commit()
@@ -518,7 +658,23 @@ struct Dataset: public MldbEntity {
     */
     virtual void commit();
 
-    /** Select from the database. */
+    /** Return the generation of the dataset, which is incremented each
+        time it's committed.  Two queries run at the same generation see
+        the same data.
+    */
+    uint64_t getGeneration() const;
+
+    /** Return a number that changes whenever any dataset is committed,
+        created or destroyed.  While it stays the same, the result of a
+        query over any combination of datasets won't change, which is
+        what's needed for caching query results.
+    */
+    static uint64_t getGlobalGeneration();
+
+    /** Select from the database.  Stops with a CancellationException as
+        soon as the current thread's cancellation token is cancelled (see
+        mldb/base/cancellation.h).
+    */
     virtual std::vector<MatrixNamedRow>
     queryStructured(const SelectExpression & select,
                     const WhenExpression & when,
@@ -544,6 +700,28 @@ struct Dataset: public MldbEntity {
                         Utf8String alias = "",
                         const ProgressFunc & onProgress = nullptr) const;
 
+    /** Select from the database, passing each output row to onRow as
+        it's produced rather than accumulating them.  The rows are passed
+        in the same order as queryStructuredExpr() would return them, and
+        onRow is never called from more than one thread at once.  Stops
+        early if onRow returns false.
+
+        Returns information about the structure of the output rows.
+    */
+    virtual std::shared_ptr<ExpressionValueInfo>
+    queryStructuredStream(const std::function<bool (NamedRowValue &)> & onRow,
+                          const SelectExpression & select,
+                          const WhenExpression & when,
+                          const SqlExpression & where,
+                          const OrderByExpression & orderBy,
+                          const TupleExpression & groupBy,
+                          const std::shared_ptr<SqlExpression> having,
+                          const std::shared_ptr<SqlExpression> rowName,
+                          ssize_t offset,
+                          ssize_t limit,
+                          Utf8String alias = "",
+                          const ProgressFunc & onProgress = nullptr) const;
+
     /** Select from the database. */
     virtual bool
     queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
@@ -569,7 +747,8 @@ struct Dataset: public MldbEntity {
                         const Utf8String & where) const;
 
     /** Return a list of the column names in the dataset, with the given offset
-        and limit.
+        and limit.  Default uses the matrix view, and is kept in the
+        statistics cache if it's enabled.
     */
     virtual std::vector<ColumnPath>
     getColumnPaths(ssize_t offset = 0, ssize_t limit = -1) const;
@@ -580,10 +759,23 @@ struct Dataset: public MldbEntity {
     getFlattenedColumnNames() const;
 
     /** Return the number of distinct flattened known columns
-        Defaults to getColumnCount (in matrix interface)
+        Defaults to getColumnCount (in matrix interface), kept in the
+        statistics cache if it's enabled.
     */
     virtual size_t getFlattenedColumnCount() const;
 
+    /** Return the statistics of the given column, as the column index's
+        getColumnStats() would.  For datasets that enabled the statistics
+        cache, they are only calculated once per commit.
+    */
+    std::shared_ptr<const ColumnStats>
+    getCachedColumnStats(const ColumnPath & column) const;
+
+    /** Return a summary of the values of the given column, based on
+        getCachedColumnStats().
+    */
+    ColumnSummary getColumnSummary(const ColumnPath & column) const;
+
     /** Return whether or not all columns names and info are known.
         Defaults to true
     */
@@ -708,7 +900,24 @@ struct Dataset: public MldbEntity {
     virtual RowPath getOriginalRowName(const Utf8String& tableName,
                                        const RowPath & name) const;
 
+    /** Return the number of rows.  Default uses the matrix view, and is
+        kept in the statistics cache if it's enabled.
+    */
     virtual uint64_t getRowCount() const;
+
+protected:
+    /** Keep the row count, column names and column statistics between
+        calls, until the next commit().  Only datasets whose data doesn't
+        change until they are committed may call this, typically from
+        their constructor.
+    */
+    void enableStatisticsCache();
+
+private:
+    std::atomic<uint64_t> generation_;
+
+    struct StatisticsCache;
+    std::unique_ptr<StatisticsCache> statisticsCache_;
 };
 
 
@@ -742,6 +951,17 @@ createDataset(MldbServer * server,
               = nullptr,
               bool overwrite = false);
 
+/** Create a dataset from the given config without adding it to the
+    server's collection of datasets.  This is for datasets that are only
+    used internally by another entity, and so shouldn't be visible through
+    the REST interface.
+*/
+std::shared_ptr<Dataset>
+constructDataset(MldbServer * server,
+                 const PolyConfig & config,
+                 const std::function<bool (const Json::Value & progress)> & onProgress
+                 = nullptr);
+
 
 DECLARE_STRUCTURE_DESCRIPTION_NAMED(DatasetPolyConfigDescription, PolyConfigT<Dataset>);
 DECLARE_STRUCTURE_DESCRIPTION_NAMED(ConstDatasetPolyConfigDescription, PolyConfigT<const Dataset>);
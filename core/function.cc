@@ -15,6 +15,12 @@
 #include "mldb/types/map_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/base/metrics.h"
+#include "mldb/base/trace_events.h"
+#include <unordered_map>
+#include <array>
+#include <mutex>
+#include <atomic>
 
 
 using namespace std;
@@ -59,6 +65,17 @@ FunctionPolyConfigDescription()
              " even if the arguments are not row-dependent. If true, then it is assumed for optimization purposes "
              " that calling the function with the same input will always return the same value for a single SQL query"
              , false);
+    addField("resultCacheBytes", &PolyConfig::resultCacheBytes,
+             "If non-zero, the results of the function are cached, keyed on "
+             "its input, using up to approximately this many bytes of "
+             "memory.  A call with the same input as a cached one returns "
+             "the cached result without calling the function.  This must "
+             "only be used for functions whose output depends only upon "
+             "their input.", (uint64_t)0);
+    addField("resultCacheTtl", &PolyConfig::resultCacheTtl,
+             "Number of seconds for which a cached result can be used.  If "
+             "zero, results stay cached until they are evicted to make "
+             "space for others.", 0.0);
 
     setTypeName("FunctionConfig");
     documentationUri = "/doc/builtin/functions/FunctionConfig.md";
@@ -89,6 +106,241 @@ checkInputCompatibility(const std::vector<std::shared_ptr<ExpressionValueInfo> >
 }
 
 
+/*****************************************************************************/
+/* FUNCTION RESULT CACHE                                                     */
+/*****************************************************************************/
+
+namespace {
+
+/** Approximate number of bytes of memory used by the value. */
+size_t approximateMemusage(const ExpressionValue & val)
+{
+    size_t result = sizeof(ExpressionValue);
+    if (val.isAtom())
+        return result + val.getAtom().memusage();
+    if (val.isEmbedding())
+        return result + val.rowLength() * sizeof(double);
+    if (!val.isRow())
+        return result;
+
+    auto onColumn = [&] (const PathElement & columnName,
+                         const ExpressionValue & columnVal)
+        {
+            result += columnName.memusage() + approximateMemusage(columnVal);
+            return true;
+        };
+    val.forEachColumn(onColumn);
+    return result;
+}
+
+} // file scope
+
+/** Cache of the results of applying a function, keyed on the input value
+    and its effective timestamp.  It's split into shards each with its own
+    lock, so that calls from many threads don't all contend on the same
+    one.  Each shard evicts with the CLOCK algorithm: a hit sets the
+    referenced bit of the entry, and the clock hand clears the bit of
+    referenced entries and evicts the first unreferenced one that it finds,
+    which approximates LRU without needing to move entries on a hit.
+*/
+struct FunctionResultCache {
+
+    static constexpr size_t NUM_SHARDS = 16;
+
+    FunctionResultCache(uint64_t maxBytes, double ttl)
+        : shardMaxBytes(std::max<uint64_t>(maxBytes / NUM_SHARDS, 1)),
+          ttl(ttl), hits(0), misses(0), expirations(0), evictions(0)
+    {
+    }
+
+    /// Hits and misses summed over the caches of all functions
+    static MetricCounter & totalHits()
+    {
+        static MetricCounter & result
+            = Metrics::counter("mldb_function_result_cache_hits_total",
+                               "Calls to functions answered from their "
+                               "result cache");
+        return result;
+    }
+
+    static MetricCounter & totalMisses()
+    {
+        static MetricCounter & result
+            = Metrics::counter("mldb_function_result_cache_misses_total",
+                               "Calls to functions with a result cache "
+                               "that weren't in it");
+        return result;
+    }
+
+    template<typename Fn>
+    ExpressionValue apply(const ExpressionValue & input, Fn && calculate)
+    {
+        uint64_t hash = input.hash();
+        Date ts = input.getEffectiveTimestamp();
+        Shard & shard = shards[hash % NUM_SHARDS];
+        Date now = ttl > 0 ? Date::now() : Date();
+
+        {
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            auto range = shard.index.equal_range(hash);
+            for (auto it = range.first;  it != range.second;  ++it) {
+                Entry & entry = shard.entries[it->second];
+                if (entry.ts != ts || entry.input != input)
+                    continue;
+                if (ttl > 0 && entry.expiry < now) {
+                    shard.evict(it->second);
+                    ++expirations;
+                    break;
+                }
+                entry.referenced = true;
+                ++hits;
+                totalHits().add();
+                return entry.output;
+            }
+        }
+
+        ++misses;
+        totalMisses().add();
+
+        // Calculated without the lock held; if two threads miss at the same
+        // time they both calculate, and only the first one is inserted
+        ExpressionValue output = calculate();
+
+        Entry entry;
+        entry.hash = hash;
+        entry.ts = ts;
+        entry.input = input;
+        entry.output = output;
+        entry.expiry = now.plusSeconds(ttl);
+        entry.bytes = approximateMemusage(input) + approximateMemusage(output)
+            + sizeof(Entry);
+
+        if (entry.bytes <= shardMaxBytes) {
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            if (!shard.contains(entry))
+                evictions += shard.insert(std::move(entry), shardMaxBytes);
+        }
+
+        return output;
+    }
+
+    Json::Value getStats() const
+    {
+        size_t numEntries = 0, numBytes = 0;
+        for (auto & shard: shards) {
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            numEntries += shard.index.size();
+            numBytes += shard.bytes;
+        }
+
+        uint64_t numHits = hits, numMisses = misses;
+
+        Json::Value result;
+        result["entries"] = numEntries;
+        result["bytes"] = numBytes;
+        result["maxBytes"] = shardMaxBytes * NUM_SHARDS;
+        result["ttl"] = ttl;
+        result["hits"] = numHits;
+        result["misses"] = numMisses;
+        result["hitRate"] = numHits + numMisses == 0
+            ? 0.0 : 1.0 * numHits / (numHits + numMisses);
+        result["expirations"] = (uint64_t)expirations;
+        result["evictions"] = (uint64_t)evictions;
+        return result;
+    }
+
+private:
+    struct Entry {
+        uint64_t hash = 0;
+        Date ts;
+        ExpressionValue input;
+        ExpressionValue output;
+        Date expiry;
+        size_t bytes = 0;        ///< Zero for an empty slot
+        bool referenced = false;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;   ///< Ring that the clock hand goes around
+        std::vector<size_t> free;     ///< Empty slots in entries
+        std::unordered_multimap<uint64_t, size_t> index;  ///< hash -> slot
+        size_t hand = 0;
+        size_t bytes = 0;
+
+        bool contains(const Entry & entry) const
+        {
+            auto range = index.equal_range(entry.hash);
+            for (auto it = range.first;  it != range.second;  ++it) {
+                const Entry & current = entries[it->second];
+                if (current.ts == entry.ts && current.input == entry.input)
+                    return true;
+            }
+            return false;
+        }
+
+        void evict(size_t slot)
+        {
+            Entry & entry = entries[slot];
+            auto range = index.equal_range(entry.hash);
+            for (auto it = range.first;  it != range.second;  ++it) {
+                if (it->second == slot) {
+                    index.erase(it);
+                    break;
+                }
+            }
+            bytes -= entry.bytes;
+            entry = Entry();
+            free.push_back(slot);
+        }
+
+        /** Insert the entry, evicting others to keep within maxBytes.
+            Returns the number evicted.
+        */
+        size_t insert(Entry entry, size_t maxBytes)
+        {
+            size_t numEvicted = 0;
+            while (bytes + entry.bytes > maxBytes && !index.empty()) {
+                if (hand >= entries.size())
+                    hand = 0;
+                Entry & current = entries[hand];
+                if (current.bytes != 0) {
+                    if (current.referenced)
+                        current.referenced = false;
+                    else {
+                        evict(hand);
+                        ++numEvicted;
+                    }
+                }
+                ++hand;
+            }
+
+            size_t slot;
+            if (!free.empty()) {
+                slot = free.back();
+                free.pop_back();
+            }
+            else {
+                slot = entries.size();
+                entries.emplace_back();
+            }
+
+            bytes += entry.bytes;
+            index.emplace(entry.hash, slot);
+            entries[slot] = std::move(entry);
+            return numEvicted;
+        }
+    };
+
+    std::array<Shard, NUM_SHARDS> shards;
+    uint64_t shardMaxBytes;
+    double ttl;
+    std::atomic<uint64_t> hits, misses, expirations, evictions;
+};
+
+constexpr size_t FunctionResultCache::NUM_SHARDS;
+
+
 /*****************************************************************************/
 /* FUNCTION APPLIER                                                          */
 /*****************************************************************************/
@@ -97,7 +349,24 @@ ExpressionValue
 FunctionApplier::
 apply(const ExpressionValue & input) const
 { 
+    static MetricCounter & applications
+        = Metrics::counter("mldb_function_applications_total",
+                           "Number of times that a function was applied "
+                           "to a single input");
+    applications.add();
+
     ExcAssert(function);
+
+    // The id is only copied when a trace is being recorded
+    static const std::string noId;
+    TraceSpan span("function", "apply",
+                   function->config_ ? function->config_->id.rawString()
+                   : noId);
+
+    if (function->resultCache) {
+        return function->resultCache->apply
+            (input, [&] () { return function->apply(*this, input); });
+    }
     return function->apply(*this, input);
 }
 
@@ -111,6 +380,10 @@ Function(MldbServer * server, const PolyConfig& config)
     : server(server)
 {
     config_ = make_shared<PolyConfig>(config);
+    if (config.resultCacheBytes > 0) {
+        resultCache = std::make_shared<FunctionResultCache>
+            (config.resultCacheBytes, config.resultCacheTtl);
+    }
 }
 
 Function::
@@ -148,6 +421,24 @@ bind(SqlBindingScope & outerContext,
     return result;
 }
 
+BoundSqlExpression
+Function::
+bindInline(SqlBindingScope & scope,
+           const std::shared_ptr<SqlExpression> & arg,
+           const BoundSqlExpression & boundArg) const
+{
+    return BoundSqlExpression();
+}
+
+Json::Value
+Function::
+getResultCacheStats() const
+{
+    if (!resultCache)
+        return Json::Value();
+    return resultCache->getStats();
+}
+
 FunctionInfo
 Function::
 getFunctionInfo() const
@@ -156,6 +447,17 @@ getFunctionInfo() const
                         + " needs to override getFunctionInfo()");
 }
 
+void
+Function::
+applyBatch(const FunctionApplier & applier,
+           const ExpressionValue * inputs,
+           ExpressionValue * outputs,
+           size_t n) const
+{
+    for (size_t i = 0;  i < n;  ++i)
+        outputs[i] = apply(applier, inputs[i]);
+}
+
 RestRequestMatchResult
 Function::
 handleRequest(RestConnection & connection,
@@ -34,6 +34,7 @@ struct SqlRowExpression;
 struct ExpressionValueInfo;
 struct RowValueInfo;
 struct KnownColumn;
+struct FunctionResultCache;
 
 typedef EntityType<Function> FunctionType;
 
@@ -206,7 +207,42 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Apply the function to n inputs at once, writing the results to
+        outputs[0] to outputs[n - 1].  The default calls apply() for each
+        of them; functions that can amortize work over a batch, such as
+        scoring a model, may override.  If an exception is thrown, the
+        contents of outputs are undefined.
+    */
+    virtual void applyBatch(const FunctionApplier & applier,
+                            const ExpressionValue * inputs,
+                            ExpressionValue * outputs,
+                            size_t n) const;
+
+    /** Bind a call to the function with the given single argument directly
+        into the calling scope, so that the function is evaluated as part of
+        the calling expression rather than by packing its input and calling
+        apply().  The argument is given both as an expression and as bound
+        into the scope.  Returns an empty bound expression if the call can't
+        be inlined, in which case bind() and apply() are used as normal.
+        The default never inlines.
+    */
+    virtual BoundSqlExpression
+    bindInline(SqlBindingScope & scope,
+               const std::shared_ptr<SqlExpression> & arg,
+               const BoundSqlExpression & boundArg) const;
+
+    /** Return the statistics of the cache of the results of apply(), or
+        null if the function's configuration doesn't ask for results to
+        be cached.
+    */
+    Json::Value getResultCacheStats() const;
+
     friend class FunctionApplier;
+
+private:
+    /// Results of earlier calls to apply(), keyed on their input.  This is
+    /// only there if resultCacheBytes is set in the configuration.
+    std::shared_ptr<FunctionResultCache> resultCache;
 };
 
 
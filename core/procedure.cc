@@ -17,8 +17,13 @@
 #include "mldb/core/plugin.h"
 #include "mldb/core/function.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/memory_account.h"
+#include "mldb/types/vector_description.h"
 #include "mldb/rest/cancellation_exception.h"
 #include "mldb/utils/progress.h"
+#include "mldb/arch/sampling_profiler.h"
+#include "mldb/base/trace_events.h"
 
 
 using namespace std;
@@ -41,6 +46,14 @@ ProcedureRunConfigDescription()
 
     addField("id", &ProcedureRunConfig::id, "ID of run");
     addField("params", &ProcedureRunConfig::params, "Parameters of run");
+    addField("resourceGroup", &ProcedureRunConfig::resourceGroup,
+             "Name of the thread pool resource group that the run's work is "
+             "done in, for example 'batch'.  If empty, the run is done in "
+             "the group of the request that started it.");
+    addField("maxMemory", &ProcedureRunConfig::maxMemory,
+             "Maximum number of bytes of memory that the run, including the "
+             "queries that it runs, can hold at once before it fails.  Zero "
+             "means no limit.", (uint64_t)0);
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRunState);
@@ -72,6 +85,26 @@ ProcedureRun(Procedure * owner,
     ExcAssert(owner);
     this->config.reset(new ProcedureRunConfig(std::move(config)));
     try {
+        const std::string & groupName = this->config->resourceGroup.rawString();
+        if (!groupName.empty() && !ThreadPool::getResourceGroup(groupName))
+            throw HttpReturnException(400, "Unknown resource group for "
+                                      "procedure run",
+                                      "resourceGroup", groupName,
+                                      "knownGroups",
+                                      ThreadPool::resourceGroups());
+        ResourceGroupScope group(groupName);
+
+        auto ownerConfig = owner->getConfigPtr();
+        std::string description
+            = "procedure "
+            + (ownerConfig ? ownerConfig->id.rawString() : std::string());
+        SamplingProfiler::Activity activity(description);
+
+        MemoryAccount account(description, this->config->maxMemory);
+        MemoryAccountScope accountScope(&account);
+
+        TraceSpan span("procedure", "run", description);
+
         RunOutput output = owner->run(*this->config, onProgress);
         this->results = std::move(output.results);
         this->details = std::move(output.details);
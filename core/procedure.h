@@ -45,6 +45,8 @@ constexpr char GENERIC_OUTPUT_DS_DESC[] =
 struct ProcedureRunConfig {
     Utf8String id;
     Any params;
+    Utf8String resourceGroup;  ///< Thread pool resource group to run in
+    uint64_t maxMemory = 0;    ///< Memory budget of the run; 0 is no limit
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ProcedureRunConfig);
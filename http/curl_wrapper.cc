@@ -12,7 +12,9 @@
 #include "compiler/compiler.h"
 #include "http/http_header.h"
 
+#include <mutex>
 #include <numeric>
+#include <stdlib.h>
 
 using namespace std;
 
@@ -22,6 +24,72 @@ namespace MLDB {
 namespace CurlWrapper {
 
 
+    namespace {
+
+    long getEnvLong(const char * name, long def)
+    {
+        const char * value = ::getenv(name);
+        if (!value || !*value)
+            return def;
+        return atol(value);
+    }
+
+    /// Share handle holding the DNS and TLS session caches used by all of
+    /// our handles, along with the locks that curl needs to use it from
+    /// several threads.
+    struct SharedCaches {
+        SharedCaches()
+            : share(curl_share_init())
+        {
+            ExcAssert(share);
+            curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &lock);
+            curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &unlock);
+            curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+            curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(share, CURLSHOPT_SHARE,
+                              CURL_LOCK_DATA_SSL_SESSION);
+        }
+
+        static void lock(CURL *, curl_lock_data data, curl_lock_access,
+                         void * userptr)
+        {
+            ((SharedCaches *)userptr)->mutexes[data].lock();
+        }
+
+        static void unlock(CURL *, curl_lock_data data, void * userptr)
+        {
+            ((SharedCaches *)userptr)->mutexes[data].unlock();
+        }
+
+        CURLSH * share;
+        std::mutex mutexes[CURL_LOCK_DATA_LAST];
+    };
+
+    SharedCaches & getSharedCaches()
+    {
+        // Never destroyed, as handles may still be cleaned up during
+        // static destruction
+        static SharedCaches * caches = new SharedCaches();
+        return *caches;
+    }
+
+    } // file scope
+
+    ConnectionReuse::ConnectionReuse()
+        : dnsCacheSeconds(getEnvLong("MLDB_HTTP_DNS_CACHE_SECONDS", 300)),
+          idleConnectionSeconds
+              (getEnvLong("MLDB_HTTP_IDLE_CONNECTION_SECONDS", 60)),
+          maxIdleConnectionsPerHost
+              (getEnvLong("MLDB_HTTP_MAX_IDLE_CONNECTIONS_PER_HOST", 16))
+    {
+    }
+
+    const ConnectionReuse & connectionReuse()
+    {
+        static const ConnectionReuse result;
+        return result;
+    }
+
     RuntimeError::RuntimeError(const std::string & what, CURLcode code) :
         MLDB::Exception(what), code(code)
     {}
@@ -47,6 +115,17 @@ namespace CurlWrapper {
           header_list(nullptr)
     {
         ExcAssert(curl.get());
+        set_shared_options();
+    }
+
+    void Easy::set_shared_options()
+    {
+        const ConnectionReuse & reuse = connectionReuse();
+        add_data_option(CURLOPT_SHARE, getSharedCaches().share);
+        add_option(CURLOPT_DNS_CACHE_TIMEOUT, reuse.dnsCacheSeconds);
+#if LIBCURL_VERSION_NUM >= 0x074100  // 7.65.0
+        add_option(CURLOPT_MAXAGE_CONN, reuse.idleConnectionSeconds);
+#endif
     }
     
     void Easy::add_data_option(CURLoption option, const void * data)
@@ -117,6 +196,7 @@ namespace CurlWrapper {
         }
         
         curl_easy_reset(curl.get());
+        set_shared_options();
     }
 
 void Easy::CurlCleanup::operator () (CURL * c)
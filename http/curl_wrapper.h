@@ -24,6 +24,28 @@ namespace MLDB
 namespace CurlWrapper {
     class Easy;
 
+    /**
+     * Process-wide settings for the reuse of connections and DNS lookups
+     * between the handles created by this wrapper.  They are read once from
+     * the environment:
+     *
+     * - MLDB_HTTP_DNS_CACHE_SECONDS: how long a DNS lookup is cached, in a
+     *   cache that's shared by all handles (default 300);
+     * - MLDB_HTTP_IDLE_CONNECTION_SECONDS: how long an idle connection is
+     *   kept for reuse (default 60);
+     * - MLDB_HTTP_MAX_IDLE_CONNECTIONS_PER_HOST: how many idle connections
+     *   to a single host are kept for reuse (default 16).
+     */
+    struct ConnectionReuse {
+        ConnectionReuse();
+
+        long dnsCacheSeconds;
+        long idleConnectionSeconds;
+        int maxIdleConnectionsPerHost;
+    };
+
+    const ConnectionReuse & connectionReuse();
+
     class RuntimeError : public MLDB::Exception
     {
     public:
@@ -68,7 +90,8 @@ namespace CurlWrapper {
         CURLcode perform();
 
         /** reset the options while keeping the handle.  there could be a speed 
-           advantage to reuse the same Easy object */
+           advantage to reuse the same Easy object, as it keeps its open
+           connections */
         void reset();
 
         /* get the info of the session */
@@ -92,6 +115,10 @@ namespace CurlWrapper {
         /// whenever we call reset().
         struct curl_slist *header_list;
         
+        /// Set the options that make the handle use the process-wide DNS
+        /// and TLS session caches, which curl_easy_reset() clears.
+        void set_shared_options();
+
         /// To be called after an attempt.  This will create an error if
         /// it failed with the given error text.
         inline void attempt(CURLcode res, const std::string errortext)
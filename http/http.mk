@@ -11,7 +11,8 @@ LIBHTTP_SOURCES := \
 	http_client_callbacks.cc \
 	http_request.cc \
 	http_client_impl.cc \
-	http_client_impl_v1.cc
+	http_client_impl_v1.cc \
+	http_fetch.cc
 
 
 LIBHTTP_LINK := curl io_base arch jsoncpp types boost_system value_description boost_filesystem cityhash watch
@@ -0,0 +1,204 @@
+/** http_fetch.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Non-blocking fetch of a URL over HTTP.
+*/
+
+#include "mldb/http/http_fetch.h"
+#include "mldb/http/http_client.h"
+#include "mldb/io/legacy_event_loop.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <map>
+#include <mutex>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+constexpr int MAX_REDIRECTS = 5;
+
+struct FetchGlobals {
+    FetchGlobals()
+        : numConnections(32)
+    {
+        char * value = ::getenv("MLDB_HTTP_FETCH_CONNECTIONS");
+        if (value && atoi(value) > 0)
+            numConnections = atoi(value);
+
+        loop.start();
+    }
+
+    /* Return the client for the given scheme://host[:port], which is kept
+       alive until the end of the process.  Thread-safe. */
+    HttpClient & getClient(const string & baseUrl)
+    {
+        unique_lock<mutex> guard(clientsLock);
+        auto it = clients.find(baseUrl);
+        if (it == clients.end()) {
+            HttpClient newClient(loop, baseUrl, numConnections);
+            it = clients.insert(std::make_pair(baseUrl, std::move(newClient)))
+                .first;
+        }
+        return it->second;
+    }
+
+    int numConnections;
+    LegacyEventLoop loop;
+
+private:
+    mutex clientsLock;
+    map<string, HttpClient> clients;
+};
+
+FetchGlobals &
+getFetchGlobals()
+{
+    static FetchGlobals globals;
+    return globals;
+}
+
+/* Return the value of the given header, looking through the raw header
+   lines of a response. */
+string findHeader(const string & headers, const char * name)
+{
+    size_t nameLen = strlen(name);
+    size_t pos = 0;
+    while (pos < headers.size()) {
+        size_t eol = headers.find('\n', pos);
+        if (eol == string::npos)
+            eol = headers.size();
+        if (eol - pos > nameLen
+            && strncasecmp(headers.c_str() + pos, name, nameLen) == 0
+            && headers[pos + nameLen] == ':') {
+            size_t start = pos + nameLen + 1;
+            while (start < eol && headers[start] == ' ')
+                ++start;
+            size_t end = eol;
+            while (end > start
+                   && (headers[end - 1] == '\r' || headers[end - 1] == ' '))
+                --end;
+            return headers.substr(start, end - start);
+        }
+        pos = eol + 1;
+    }
+    return string();
+}
+
+// Same parsing as for the synchronous http:// handler
+Date parseLastModified(const string & lastModified)
+{
+    if (lastModified.empty())
+        return Date();
+    static const char format[] = "%a, %d %b %Y %H:%M:%S %Z"; // rfc 1123
+    struct tm tm;
+    bzero(&tm, sizeof(tm));
+    if (!strptime(lastModified.c_str(), format, &tm))
+        return Date();
+    return Date(1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday,
+                tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+void startGet(const string & url,
+              std::shared_ptr<std::promise<HttpFetchResult> > promise,
+              int timeoutSeconds,
+              int redirectsLeft)
+{
+    // Split into scheme://host[:port] and the resource
+    size_t hostStart = url.find("://") + 3;
+    size_t resourceStart = url.find('/', hostStart);
+    string baseUrl = url.substr(0, resourceStart);
+    string resource = resourceStart == string::npos
+        ? string("/") : url.substr(resourceStart);
+
+    auto onResponse = [=] (const HttpRequest & rq,
+                           HttpClientError error,
+                           int status,
+                           std::string && headers,
+                           std::string && body)
+        {
+            HttpFetchResult result;
+            result.responseCode = status;
+
+            if (error != HttpClientError::None) {
+                result.error = HttpClientCallbacks::errorMessage(error)
+                    + " fetching " + url;
+            }
+            else if (status >= 300 && status < 400) {
+                string location = findHeader(headers, "location");
+                if (location.empty() || redirectsLeft == 0) {
+                    result.error = "Unable to follow redirect with HTTP code "
+                        + to_string(status) + " fetching " + url;
+                }
+                else {
+                    if (location[0] == '/')
+                        location = baseUrl + location;
+                    if (isAsyncHttpUrl(location)) {
+                        startGet(location, promise, timeoutSeconds,
+                                 redirectsLeft - 1);
+                        return;
+                    }
+                    result.error = "Unable to follow redirect to "
+                        + location + " fetching " + url;
+                }
+            }
+            else if (status < 200 || status >= 300) {
+                result.error = "HTTP code " + to_string(status)
+                    + " fetching " + url;
+            }
+            else {
+                result.body = std::move(body);
+                result.lastModified
+                    = parseLastModified(findHeader(headers, "last-modified"));
+            }
+
+            promise->set_value(std::move(result));
+        };
+
+    auto callbacks = std::make_shared<HttpClientSimpleCallbacks>(onResponse);
+
+    HttpClient & client = getFetchGlobals().getClient(baseUrl);
+    if (!client.get(resource, callbacks, {}, {}, timeoutSeconds)) {
+        HttpFetchResult result;
+        result.error = "Unable to queue request fetching " + url;
+        promise->set_value(std::move(result));
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ASYNC HTTP GET                                                            */
+/*****************************************************************************/
+
+bool isAsyncHttpUrl(const std::string & url)
+{
+    return url.compare(0, 7, "http://") == 0
+        || url.compare(0, 8, "https://") == 0;
+}
+
+std::future<HttpFetchResult>
+asyncHttpGet(const std::string & url, int timeoutSeconds)
+{
+    auto promise = std::make_shared<std::promise<HttpFetchResult> >();
+    auto result = promise->get_future();
+
+    if (!isAsyncHttpUrl(url)) {
+        HttpFetchResult error;
+        error.error = "URL " + url + " is not an http:// or https:// URL";
+        promise->set_value(std::move(error));
+        return result;
+    }
+
+    startGet(url, std::move(promise), timeoutSeconds, MAX_REDIRECTS);
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,48 @@
+/** http_fetch.h                                                   -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Non-blocking fetch of a URL over HTTP, for callers that want to have
+    lots of requests outstanding without a thread waiting on each one.
+*/
+
+#pragma once
+
+#include "mldb/types/date.h"
+#include <future>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HTTP FETCH RESULT                                                         */
+/*****************************************************************************/
+
+struct HttpFetchResult {
+    int responseCode = 0;
+    std::string body;
+    Date lastModified;          ///< From the Last-Modified header, if any
+    std::string error;          ///< Empty if and only if the fetch worked
+};
+
+
+/*****************************************************************************/
+/* ASYNC HTTP GET                                                            */
+/*****************************************************************************/
+
+/** Return true if the URL is one that asyncHttpGet() can fetch. */
+bool isAsyncHttpUrl(const std::string & url);
+
+/** Fetch the given http:// or https:// URL with a GET request, following
+    redirects.  This never blocks: the request is run on an event loop
+    that is shared by the whole process, and the future is set once it has
+    finished.  A response that's not a 2xx is returned as an error.
+
+    There is one client per host, with up to MLDB_HTTP_FETCH_CONNECTIONS
+    connections; further requests are queued until one is free.
+*/
+std::future<HttpFetchResult>
+asyncHttpGet(const std::string & url, int timeoutSeconds = -1);
+
+} // namespace MLDB
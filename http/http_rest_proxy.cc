@@ -10,8 +10,10 @@
 #include <curl/curl.h>
 #include "mldb/arch/threads.h"
 #include <chrono>
+#include <map>
 #include <thread>
 #include "mldb/types/structure_description.h"
+#include "mldb/types/date.h"
 #include "curl_wrapper.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/ext/jsoncpp/json.h"
@@ -178,43 +180,115 @@ struct HttpRestProxy::Itl {
 
     HttpRestProxy * owner;
 
-    /** Lock for connection pool. */
-    mutable std::mutex lock;
+    std::vector<std::string> cookies;
 
-    /** List of inactive handles.  These can be selected from when a new
-        connection needs to be made.
+    /** Process-wide pool of inactive handles, by the scheme://host[:port]
+        that they last talked to.  A handle keeps its connection to that
+        host open across requests, so taking one whose key matches saves
+        the TCP (and TLS) handshakes.  As proxies are often created for a
+        single request, the pool is shared between all of them.
     */
-    mutable std::vector<Connection> inactive;
+    struct Pool {
+        struct Idle {
+            ConnectionHandler * conn;
+            Date since;
+        };
+
+        std::mutex lock;
+        std::map<std::string, std::vector<Idle> > idle;
+
+        ConnectionHandler * get(const std::string & key)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            Date now = Date::now();
+            expire(now);
+
+            auto it = idle.find(key);
+            if (it != idle.end() && !it->second.empty()) {
+                // The most recently used is the most likely to still be
+                // connected
+                ConnectionHandler * result = it->second.back().conn;
+                it->second.pop_back();
+                return result;
+            }
+            return nullptr;
+        }
 
-    std::vector<std::string> cookies;
+        void put(ConnectionHandler * conn)
+        {
+            conn->reset();
 
-    HttpRestProxy::Connection
-    getConnection() const
-    {
-        std::unique_lock<std::mutex> guard(lock);
+            // Handles without a key can't be matched to a host again
+            if (conn->poolKey.empty()) {
+                delete conn;
+                return;
+            }
 
-        if (inactive.empty()) {
-            return Connection(new ConnectionHandler, owner);
+            ConnectionHandler * toDelete = nullptr;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                auto & entries = idle[conn->poolKey];
+                size_t maxIdle = std::max(0, CurlWrapper::connectionReuse()
+                                          .maxIdleConnectionsPerHost);
+                if (entries.size() >= maxIdle)
+                    toDelete = conn;
+                else entries.push_back({ conn, Date::now() });
+            }
+            delete toDelete;
         }
-        else {
-            Connection res(std::move(inactive.back()));
-            inactive.pop_back();
 
-            // Set proxy to this, so when it's destroyed it's put on our list
-            ExcAssert(res.proxy == nullptr);
-            res.proxy = owner;
-            return res;
+        /** Close the handles that have been idle for too long.  Called
+            with the lock held. */
+        void expire(Date now)
+        {
+            double maxIdle = CurlWrapper::connectionReuse()
+                .idleConnectionSeconds;
+            for (auto it = idle.begin(); it != idle.end();) {
+                auto & entries = it->second;
+                size_t numKept = 0;
+                for (auto & e: entries) {
+                    if (now.secondsSince(e.since) > maxIdle)
+                        delete e.conn;
+                    else entries[numKept++] = e;
+                }
+                entries.resize(numKept);
+                if (entries.empty())
+                    it = idle.erase(it);
+                else ++it;
+            }
         }
+    };
+
+    static Pool & getPool()
+    {
+        // Never destroyed, as curl may already be shut down by then
+        static Pool * pool = new Pool();
+        return *pool;
+    }
+
+    /** Return the scheme://host[:port] part of the given URI. */
+    static std::string getPoolKey(const std::string & uri)
+    {
+        size_t hostStart = uri.find("://");
+        if (hostStart == std::string::npos)
+            return std::string();
+        return uri.substr(0, uri.find('/', hostStart + 3));
+    }
+
+    HttpRestProxy::Connection
+    getConnection(const std::string & uri) const
+    {
+        std::string key = getPoolKey(uri);
+        ConnectionHandler * conn = getPool().get(key);
+        if (!conn)
+            conn = new ConnectionHandler();
+        conn->poolKey = std::move(key);
+        return Connection(conn, owner);
     }
     
     void doneConnection(ConnectionHandler * conn)
     {
-        std::unique_lock<std::mutex> guard(lock);
-        conn->reset();
-
-        // Put a Connection with a null handler on the list so it's
-        // destroyed when done
-        inactive.emplace_back(conn, nullptr);
+        getPool().put(conn);
     }
 };
 
@@ -320,11 +394,11 @@ perform(const std::string & verb,
         responseHeaders.clear();
         body.clear();
 
-        Connection connection = getConnection();
+        uri = itl->serviceUri + resource + queryParams.uriEscaped();
 
-        CurlWrapper::Easy & myRequest = *connection;
+        Connection connection = getConnection(uri);
 
-        uri = itl->serviceUri + resource + queryParams.uriEscaped();
+        CurlWrapper::Easy & myRequest = *connection;
 
         myRequest.add_option(CURLOPT_CUSTOMREQUEST, verb);
 
@@ -416,6 +490,11 @@ perform(const std::string & verb,
         for (auto & cookie: itl->cookies)
             myRequest.add_option(CURLOPT_COOKIELIST, cookie);
 
+        // Cookies stay with the handle across a reset, so it can't be
+        // shared with other proxies afterwards
+        if (!itl->cookies.empty())
+            connection->poolKey.clear();
+
         if (content.data) {
             myRequest.add_option(CURLOPT_POSTFIELDSIZE, content.size);
             myRequest.add_data_option(CURLOPT_POSTFIELDS, content.data);
@@ -472,7 +551,14 @@ HttpRestProxy::Connection
 HttpRestProxy::
 getConnection() const
 {
-    return itl->getConnection();
+    return itl->getConnection(itl->serviceUri);
+}
+
+HttpRestProxy::Connection
+HttpRestProxy::
+getConnection(const std::string & uri) const
+{
+    return itl->getConnection(uri);
 }
 
 void
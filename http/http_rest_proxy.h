@@ -222,10 +222,16 @@ struct HttpRestProxy {
                      bool abortOnSlowConnection = false) const;
     
 public:
-    /** Get a connection. */
+    /** Get a connection.  Connections come from a process-wide pool, shared
+        by all proxies, of handles that keep their connections open to the
+        host they last talked to (see CurlWrapper::ConnectionReuse).
+    */
     struct Connection;
     Connection getConnection() const;
 
+    /** Get a connection that last talked to the host of the given URI. */
+    Connection getConnection(const std::string & uri) const;
+
 private:
     /** Private type that implements a connection handler. */
     struct ConnectionHandler;
@@ -16,6 +16,9 @@
 namespace MLDB {
 
 struct HttpRestProxy::ConnectionHandler: public CurlWrapper::Easy {
+    /// scheme://host[:port] that the handle's open connections go to, under
+    /// which it's put back in the process-wide pool once done with
+    std::string poolKey;
 };
 
 struct HttpRestProxy::Connection {
@@ -105,13 +105,21 @@ onReceivedData(const char * data, size_t size)
 {
     try {
         parser_.feed(data, size);
-        requestReceive();
+        if (shouldReceiveMore())
+            requestReceive();
     }
     catch (const MLDB::Exception & exc) {
         requestClose();
     }
 }
 
+bool
+HttpSocketHandler::
+shouldReceiveMore()
+{
+    return true;
+}
+
 void
 HttpSocketHandler::
 onReceiveError(const boost::system::error_code & ec, size_t bufferSize)
@@ -132,7 +140,10 @@ onReceiveError(const boost::system::error_code & ec, size_t bufferSize)
 
 HttpLegacySocketHandler::
 HttpLegacySocketHandler(TcpSocket && socket)
-    : HttpSocketHandler(std::move(socket)), bodyStarted_(false)
+    : HttpSocketHandler(std::move(socket)), bodyStarted_(false),
+      requestInProgress_(false), closeAfterResponse_(false),
+      dispatching_(false), receiveStalled_(false), closing_(false),
+      writing_(false), writesClosed_(false)
 {
 }
 
@@ -141,22 +152,65 @@ HttpLegacySocketHandler::
 send(std::string str,
      NextAction action, OnWriteFinished onWriteFinished)
 {
-    if (str.size() > 0) {
+    {
+        std::unique_lock<std::mutex> guard(writeLock_);
+        writes_.push_back({ std::move(str), action,
+                            std::move(onWriteFinished) });
+        if (!writing_)
+            startNextWrite(guard);
+    }
+
+    if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
+        onResponseComplete(true /* closing */);
+    }
+}
+
+void
+HttpLegacySocketHandler::
+startNextWrite(std::unique_lock<std::mutex> & guard)
+{
+    while (!writes_.empty()) {
+        PendingWrite write = std::move(writes_.front());
+        writes_.pop_front();
+
+        bool closes = write.action == NEXT_CLOSE
+            || write.action == NEXT_RECYCLE;
+
+        if (write.data.empty() || writesClosed_) {
+            // Nothing to put on the wire, but the callbacks still need to
+            // be called in order; requestClose() only closes once the
+            // outstanding writes are done with
+            if (closes && !writesClosed_) {
+                writesClosed_ = true;
+                requestClose();
+            }
+            guard.unlock();
+            if (write.onWriteFinished) {
+                write.onWriteFinished();
+            }
+            guard.lock();
+            continue;
+        }
+
+        writing_ = true;
+        if (closes)
+            writesClosed_ = true;
+
+        OnWriteFinished onWriteFinished = std::move(write.onWriteFinished);
         auto onWritten = [=] (const boost::system::error_code & ec,
                               size_t) {
             if (onWriteFinished) {
                 onWriteFinished();
             }
-            if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
+            if (closes) {
                 requestClose();
             }
+            std::unique_lock<std::mutex> guard(writeLock_);
+            writing_ = false;
+            startNextWrite(guard);
         };
-        requestWrite(str, onWritten);
-    }
-    else {
-        if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
-            requestClose();
-        }
+        requestWrite(std::move(write.data), onWritten);
+        return;
     }
 }
 
@@ -166,6 +220,16 @@ putResponseOnWire(const HttpResponse & response,
                   std::function<void ()> onSendFinished,
                   NextAction next)
 {
+    bool closeAfter;
+    {
+        std::unique_lock<std::mutex> guard(requestsLock_);
+        closeAfter = closeAfterResponse_;
+    }
+    if (closeAfter && response.sendBody && next == NEXT_CONTINUE) {
+        // The client asked for the connection to be closed after this one
+        next = NEXT_CLOSE;
+    }
+
     string responseStr;
     responseStr.reserve(16384 + response.body.length());
 
@@ -185,7 +249,9 @@ putResponseOnWire(const HttpResponse & response,
         responseStr.append("Content-Length: ");
         responseStr.append(to_string(response.body.length()));
         responseStr.append("\r\n");
-        responseStr.append("Connection: Keep-Alive\r\n");
+        if (next == NEXT_CONTINUE)
+            responseStr.append("Connection: Keep-Alive\r\n");
+        else responseStr.append("Connection: close\r\n");
     }
 
     for (auto & h: response.extraHeaders) {
@@ -198,7 +264,13 @@ putResponseOnWire(const HttpResponse & response,
     responseStr.append("\r\n");
     responseStr.append(response.body);
 
-    send(std::move(responseStr), std::move(next), std::move(onSendFinished));
+    send(std::move(responseStr), next, std::move(onSendFinished));
+
+    // A response with a body is complete; the next pipelined request can
+    // go (closing responses were already dealt with by send())
+    if (response.sendBody && next == NEXT_CONTINUE) {
+        onResponseComplete(false /* closing */);
+    }
 }
 
 void
@@ -231,6 +303,16 @@ onExpect100Continue()
 
     HttpHeader header;
     header.parse(headerPayload);
+
+    {
+        // An interim response can't be sent in the middle of the response
+        // to an earlier pipelined request.  Clients don't wait forever for
+        // it and we'll read the body anyway, so just skip it.
+        std::unique_lock<std::mutex> guard(requestsLock_);
+        if (requestInProgress_ || !requests_.empty())
+            return true;
+    }
+
     if (shouldReturn100Continue(header)) {
         send("HTTP/1.1 100 Continue\r\n\r\n");
         result = true;
@@ -265,12 +347,89 @@ void
 HttpLegacySocketHandler::
 onDone(bool requireClose)
 {
-    HttpHeader header;
-    header.parse(headerPayload);
-    handleHttpPayload(header, bodyPayload);
+    {
+        std::unique_lock<std::mutex> guard(requestsLock_);
+        requests_.push_back({ std::move(headerPayload),
+                              std::move(bodyPayload),
+                              requireClose });
+    }
     headerPayload.clear();
     bodyPayload.clear();
     bodyStarted_ = false;
+
+    dispatchRequests();
+}
+
+void
+HttpLegacySocketHandler::
+dispatchRequests()
+{
+    std::unique_lock<std::mutex> guard(requestsLock_);
+
+    // Only one thread dispatches at a time; if another one is in the
+    // loop below, it will pick up whatever we queued
+    if (dispatching_)
+        return;
+    dispatching_ = true;
+
+    while (!requestInProgress_ && !closing_ && !requests_.empty()) {
+        PendingRequest request = std::move(requests_.front());
+        requests_.pop_front();
+        requestInProgress_ = true;
+        closeAfterResponse_ = request.requireClose;
+        guard.unlock();
+
+        HttpHeader header;
+        header.parse(request.header);
+        handleHttpPayload(header, request.body);
+
+        guard.lock();
+    }
+
+    dispatching_ = false;
+
+    // We stopped reading when too many requests were queued up; start
+    // again now that we've caught up
+    bool resume = receiveStalled_ && !closing_
+        && requests_.size() < MAX_PIPELINED_REQUESTS;
+    if (resume)
+        receiveStalled_ = false;
+    guard.unlock();
+
+    if (resume)
+        requestReceive();
+}
+
+void
+HttpLegacySocketHandler::
+onResponseComplete(bool closing)
+{
+    {
+        std::unique_lock<std::mutex> guard(requestsLock_);
+        requestInProgress_ = false;
+        closeAfterResponse_ = false;
+        if (closing) {
+            closing_ = true;
+            requests_.clear();
+            return;
+        }
+    }
+
+    dispatchRequests();
+}
+
+bool
+HttpLegacySocketHandler::
+shouldReceiveMore()
+{
+    std::unique_lock<std::mutex> guard(requestsLock_);
+    if (closing_)
+        return false;
+    if (requests_.size() >= MAX_PIPELINED_REQUESTS) {
+        receiveStalled_ = true;
+        return false;
+    }
+    return true;
 }
 
 } // namespace MLDB
@@ -11,6 +11,8 @@
 #include "mldb/http/http_header.h"
 #include "mldb/http/http_parsers.h"
 #include "mldb/io/tcp_socket_handler.h"
+#include <deque>
+#include <mutex>
 
 
 namespace MLDB {
@@ -45,6 +47,13 @@ struct HttpSocketHandler : public TcpSocketHandler {
     /* Callback used to report the end of a response. */
     virtual void onDone(bool requireClose) = 0;
 
+protected:
+    /* Overridable method returning whether more data should be read from
+       the socket once a buffer has been parsed.  When it returns false,
+       the subclass must call requestReceive() itself once it is ready for
+       more.  The default implementation returns "true". */
+    virtual bool shouldReceiveMore();
+
 private:
     /* TcpSocketHandler interface */
     virtual void bootstrap();
@@ -99,7 +108,15 @@ struct HttpResponse {
 
 /* A drop-in replacement class for PassiveSocketHandler. So that old
  * handler code can easily plugged into the recent versions of the service
- * classes. */
+ * classes.
+ *
+ * Pipelined requests are handled one at a time, in the order in which they
+ * were received: a request is only passed to handleHttpPayload once the
+ * response to the previous one is complete, which can happen on another
+ * thread.  A response is complete once a response with a body has been
+ * put on the wire, or once something has been sent with NEXT_CLOSE or
+ * NEXT_RECYCLE.  Writes are queued so that only one is outstanding on the
+ * socket at a time, and they reach the wire in the order they were sent. */
 
 struct HttpLegacySocketHandler : public HttpSocketHandler {
     /** Action to perform once we've finished sending. */
@@ -125,12 +142,18 @@ struct HttpLegacySocketHandler : public HttpSocketHandler {
               NextAction action = NEXT_CONTINUE,
               OnWriteFinished onWriteFinished = nullptr);
 
+    /* Maximum number of received requests waiting for the one in progress
+       to be answered before we stop reading from the socket. */
+    static constexpr size_t MAX_PIPELINED_REQUESTS = 64;
+
 protected:
     /* Overridable method returning whether the given request should be
        accepted for processing or not. The default implementation returns
        "true". */
     virtual bool shouldReturn100Continue(const HttpHeader & header);
 
+    virtual bool shouldReceiveMore();
+
 private:
     virtual void onRequestStart(const char * methodData, size_t methodSize,
                                 const char * urlData, size_t urlSize,
@@ -143,11 +166,46 @@ private:
 
     void handleExpect100Continue();
 
+    /* A request that has been fully received. */
+    struct PendingRequest {
+        std::string header;
+        std::string body;
+        bool requireClose;
+    };
+
+    /* A write waiting for the previous ones to go out. */
+    struct PendingWrite {
+        std::string data;
+        NextAction action;
+        OnWriteFinished onWriteFinished;
+    };
+
+    /* Pass the received requests to handleHttpPayload, one at a time, for
+       as long as their responses are completed synchronously. */
+    void dispatchRequests();
+
+    /* Called once the response to the current request is complete. */
+    void onResponseComplete(bool closing);
+
+    /* Start the next queued write, if any.  Called with writeLock_ held. */
+    void startNextWrite(std::unique_lock<std::mutex> & guard);
+
     std::string headerPayload;
     std::string bodyPayload;
     bool bodyStarted_;
 
-    std::string writeData_;
+    std::mutex requestsLock_;               ///< Protects the fields below
+    std::deque<PendingRequest> requests_;   ///< Received, not yet handled
+    bool requestInProgress_;                ///< Waiting for a response?
+    bool closeAfterResponse_;               ///< Current one needs close?
+    bool dispatching_;                      ///< A thread is dispatching
+    bool receiveStalled_;                   ///< Stopped reading (queue full)
+    bool closing_;                          ///< No more requests handled
+
+    std::mutex writeLock_;                  ///< Protects the fields below
+    std::deque<PendingWrite> writes_;       ///< Waiting to go out
+    bool writing_;                          ///< A write is outstanding
+    bool writesClosed_;                     ///< Socket closing, drop data
 };
 
 } // namespace MLDB
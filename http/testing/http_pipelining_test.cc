@@ -0,0 +1,137 @@
+// This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+/* http_pipelining_test.cc
+
+   Test that pipelined HTTP/1.1 requests are answered in order, even when
+   the responses are produced asynchronously.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/utils/testing/watchdog.h"
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/io/port_range_service.h"
+#include "mldb/io/tcp_acceptor.h"
+#include "mldb/http/http_header.h"
+#include "mldb/http/http_socket_handler.h"
+
+using namespace std;
+using namespace ML;
+using namespace MLDB;
+
+
+namespace {
+
+/* Answers /slow/... requests from another thread after a delay, and
+   everything else straight away, with the resource as the body. */
+struct PipeliningHandler : public HttpLegacySocketHandler {
+    PipeliningHandler(TcpSocket && socket)
+        : HttpLegacySocketHandler(std::move(socket))
+    {
+    }
+
+    virtual void handleHttpPayload(const HttpHeader & header,
+                                   const std::string & payload)
+    {
+        string resource = header.resource;
+        if (resource.find("/slow/") == 0) {
+            auto self = acceptor().findHandlerPtr(this);
+            std::thread([=] () {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    putResponseOnWire(HttpResponse(200, "text/plain",
+                                                   resource));
+                    (void)self;
+                }).detach();
+        }
+        else {
+            putResponseOnWire(HttpResponse(200, "text/plain", resource));
+        }
+    }
+};
+
+string readAll(int fd)
+{
+    string result;
+    char buf[16384];
+    for (;;) {
+        ssize_t res = read(fd, buf, sizeof(buf));
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw MLDB::Exception(errno, "read()");
+        if (res == 0)
+            break;
+        result.append(buf, res);
+    }
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_pipelined_requests_answered_in_order )
+{
+    signal(SIGPIPE, SIG_IGN);
+    Watchdog watchdog(30.0);
+
+    auto onMakeNewHandler = [&] (TcpSocket && socket) {
+        return std::make_shared<PipeliningHandler>(std::move(socket));
+    };
+
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+    TcpAcceptor acceptor(eventLoop, onMakeNewHandler);
+
+    acceptor.listen(0, "127.0.0.1");
+    int port = acceptor.effectiveTCPv4Port();
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    ExcAssertNotEqual(s, -1);
+
+    struct sockaddr_in addr = { AF_INET, htons(port), { htonl(INADDR_LOOPBACK) } };
+    int res = connect(s, reinterpret_cast<const sockaddr *>(&addr),
+                      sizeof(addr));
+    ExcAssertEqual(res, 0);
+
+    // All of the requests go out in a single write, the last one asking
+    // for the connection to be closed once it's answered
+    vector<string> resources = { "/slow/1", "/fast/2", "/slow/3", "/fast/4" };
+    string requests;
+    for (unsigned i = 0;  i < resources.size();  ++i) {
+        requests += "GET " + resources[i] + " HTTP/1.1\r\n"
+            "Host: localhost\r\n";
+        if (i == resources.size() - 1)
+            requests += "Connection: close\r\n";
+        requests += "\r\n";
+    }
+    res = write(s, requests.c_str(), requests.size());
+    ExcAssertEqual(res, (int)requests.size());
+
+    // The server closes once the last one is answered
+    string received = readAll(s);
+    close(s);
+
+    cerr << "received " << received << endl;
+
+    size_t pos = 0;
+    for (auto & r: resources) {
+        size_t statusPos = received.find("HTTP/1.1 200", pos);
+        BOOST_REQUIRE(statusPos != string::npos);
+        size_t bodyPos = received.find("\r\n\r\n", statusPos);
+        BOOST_REQUIRE(bodyPos != string::npos);
+        BOOST_CHECK_EQUAL(received.substr(bodyPos + 4, r.size()), r);
+        pos = bodyPos + 4 + r.size();
+    }
+    BOOST_CHECK_EQUAL(pos, received.size());
+    BOOST_CHECK(received.find("Connection: close") != string::npos);
+
+    threadPool.shutdown();
+}
@@ -5,6 +5,7 @@ $(eval $(call test,MLDB-1016-http-connection-overflow,http,boost))
 $(eval $(call test,http_parsers_test,http,boost valgrind))
 $(eval $(call test,tcp_acceptor_test+http,http,boost))
 $(eval $(call test,tcp_acceptor_threaded_test+http,http,boost))
+$(eval $(call test,http_pipelining_test,http,boost))
 $(eval $(call program,http_service_bench,boost_program_options http))
 $(eval $(call library,test_services,test_http_services.cc,http io_base))
 $(eval $(call program,http_client_bench,boost_program_options http test_services value_description))
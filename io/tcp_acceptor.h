@@ -42,10 +42,15 @@ struct TcpAcceptor {
     ~TcpAcceptor();
 
     /* Starts listening on either of the given ports (in ascending order) and
-     * interface. Returns the effective port of the listening socket. */
+     * interface. Returns the effective port of the listening socket.
+     * If reusePort is true, the socket is bound with SO_REUSEPORT so that
+     * several acceptors (each normally on its own event loop) can listen on
+     * the same port, with the kernel spreading the connections between
+     * them. */
     void listen(const PortRange & portRange,
                 const std::string & hostname = "localhost",
-                int backlog = 128);
+                int backlog = 128,
+                bool reusePort = false);
 
     /* Shutdowns the worker threads (except the main listening thread) as well
      * as the listening socket. */
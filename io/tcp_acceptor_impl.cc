@@ -53,7 +53,8 @@ TcpAcceptorImpl::
 
 void
 TcpAcceptorImpl::
-listen(const PortRange & portRange, const string & hostname, int backlog)
+listen(const PortRange & portRange, const string & hostname, int backlog,
+       bool reusePort)
 {
     ExcAssert(!hostname.empty());
 
@@ -68,13 +69,13 @@ listen(const PortRange & portRange, const string & hostname, int backlog)
         auto ep = result.endpoint();
         if (ep.protocol() == asio::ip::tcp::v4()) {
             if (!v4Endpoint_.isOpen()) {
-                v4Endpoint_.open(ep, portRange, backlog);
+                v4Endpoint_.open(ep, portRange, backlog, reusePort);
                 accept(v4Endpoint_);
             }
         }
         else if (ep.protocol() == asio::ip::tcp::v6()) {
             if (!v6Endpoint_.isOpen()) {
-                v6Endpoint_.open(ep, portRange, backlog);
+                v6Endpoint_.open(ep, portRange, backlog, reusePort);
                 accept(v6Endpoint_);
             }
         }
@@ -137,7 +138,7 @@ TcpAcceptorImpl::Endpoint::
 void
 TcpAcceptorImpl::Endpoint::
 open(const asio::ip::tcp::endpoint & asioEndpoint,
-     const PortRange & portRange, int backlog)
+     const PortRange & portRange, int backlog, bool reusePort)
 {
     /* Exception safety: we close the socket if we could not bind it
        appropriately */
@@ -152,6 +153,16 @@ open(const asio::ip::tcp::endpoint & asioEndpoint,
             acceptorPtr.reset(new asio::ip::tcp::acceptor(ioService_));
             acceptorPtr->open(bindEndpoint.protocol());
             acceptorPtr->set_option(asio::socket_base::reuse_address(true));
+            if (reusePort) {
+#ifdef SO_REUSEPORT
+                typedef asio::detail::socket_option
+                    ::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePort;
+                acceptorPtr->set_option(ReusePort(true));
+#else
+                throw MLDB::Exception("SO_REUSEPORT is not supported on "
+                                      "this platform");
+#endif
+            }
             bindEndpoint.port(i);
             system::error_code ec;
             acceptorPtr->bind(bindEndpoint, ec);
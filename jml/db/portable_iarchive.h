@@ -241,7 +241,7 @@ public:
     {
         compact_size_t sz(*this);
 
-        std::vector<T, A> v;
+        std::vector<T, A> v(vec.get_allocator());
         v.reserve(sz);
         for (unsigned i = 0;  i < sz;  ++i) {
             T t;
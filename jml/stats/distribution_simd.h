@@ -169,6 +169,97 @@ operator += (const distribution<float, std::vector<float> > & d)
     return *this;
 }
 
+#define DIST_SIMD_OPS(F) \
+template<> \
+inline distribution<F> \
+distribution<F, std::vector<F> >:: \
+operator * (F val) const \
+{ \
+    distribution<F> result(this->size()); \
+    SIMD::vec_scale(this->data(), val, result.data(), this->size()); \
+    return result; \
+} \
+ \
+template<> \
+template<> \
+inline distribution<F> & \
+distribution<F, std::vector<F> >:: \
+operator += (const distribution<F, std::vector<F> > & d) \
+{ \
+    if (this->size() != d.size()) \
+        wrong_sizes_exception("+=", this->size(), d.size()); \
+    SIMD::vec_add(this->data(), d.data(), this->data(), d.size()); \
+    return *this; \
+} \
+ \
+template<> \
+template<> \
+inline distribution<F> & \
+distribution<F, std::vector<F> >:: \
+operator -= (const distribution<F, std::vector<F> > & d) \
+{ \
+    if (this->size() != d.size()) \
+        wrong_sizes_exception("-=", this->size(), d.size()); \
+    SIMD::vec_minus(this->data(), d.data(), this->data(), d.size()); \
+    return *this; \
+} \
+ \
+template<> \
+template<> \
+inline distribution<F> & \
+distribution<F, std::vector<F> >:: \
+operator *= (const distribution<F, std::vector<F> > & d) \
+{ \
+    if (this->size() != d.size()) \
+        wrong_sizes_exception("*=", this->size(), d.size()); \
+    SIMD::vec_prod(this->data(), d.data(), this->data(), d.size()); \
+    return *this; \
+} \
+ \
+inline distribution<F> \
+max(const distribution<F> & dist, F val) \
+{ \
+    distribution<F> result(dist.size()); \
+    SIMD::vec_max(dist.data(), val, result.data(), dist.size()); \
+    return result; \
+} \
+ \
+inline distribution<F> \
+max(const distribution<F> & dist1, const distribution<F> & dist2) \
+{ \
+    if (dist1.size() != dist2.size()) \
+        wrong_sizes_exception("max", dist1.size(), dist2.size()); \
+    distribution<F> result(dist1.size()); \
+    SIMD::vec_max(dist1.data(), dist2.data(), result.data(), dist1.size()); \
+    return result; \
+} \
+ \
+inline distribution<F> \
+min(const distribution<F> & dist, F val) \
+{ \
+    distribution<F> result(dist.size()); \
+    SIMD::vec_min(dist.data(), val, result.data(), dist.size()); \
+    return result; \
+} \
+ \
+inline distribution<F> \
+min(const distribution<F> & dist1, const distribution<F> & dist2) \
+{ \
+    if (dist1.size() != dist2.size()) \
+        wrong_sizes_exception("min", dist1.size(), dist2.size()); \
+    distribution<F> result(dist1.size()); \
+    SIMD::vec_min(dist1.data(), dist2.data(), result.data(), dist1.size()); \
+    return result; \
+}
+
+DIST_SIMD_OPS(float)
+DIST_SIMD_OPS(double)
+#undef DIST_SIMD_OPS
+
+// So that the overloads above don't hide these
+using std::max;
+using std::min;
+
 template<>
 template<>
 inline void
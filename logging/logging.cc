@@ -10,10 +10,16 @@
 #include "mldb/logging/logging.h"
 #include "mldb/base/exc_check.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
+#include <stdlib.h>
 #include <sys/time.h>
 
 
@@ -100,6 +106,254 @@ void Logging::JsonWriter::body(std::string const & content) {
 
 namespace {
 
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Format the current time as the timestamp of a message
+void formatTimestamp(char (& text)[64])
+{
+    timeval now;
+    gettimeofday(&now, 0);
+    tm local;
+    localtime_r(&now.tv_sec, &local);
+    auto count = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    int ms = now.tv_usec / 1000;
+    snprintf(text + count, sizeof(text) - count, ".%03d", ms);
+}
+
+/// Message queued by an AsyncWriter
+struct AsyncMessage {
+    int64_t ns = 0;                 ///< When it was logged, for ordering
+    std::string timestamp;
+    char const * name = nullptr;
+    char const * function = nullptr;
+    char const * file = nullptr;
+    int line = 0;
+    std::string content;
+};
+
+/** Ring buffer of the messages of one thread for an AsyncWriter.  Only the
+    thread that owns it adds to it and only the flusher takes from it, so
+    the two indexes are enough to synchronize them.
+*/
+struct AsyncBuffer {
+    AsyncBuffer(size_t capacity)
+        : messages(capacity), head(0), tail(0), abandoned(false)
+    {
+    }
+
+    std::vector<AsyncMessage> messages;
+    std::atomic<uint64_t> head;     ///< Next message to take
+    std::atomic<uint64_t> tail;     ///< Next message to add
+    AsyncMessage pending;           ///< Between head() and body()
+    std::atomic<bool> abandoned;    ///< Owning thread has exited
+
+    /// Add the pending message, returning false if the buffer is full
+    bool push()
+    {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= messages.size())
+            return false;
+        messages[t % messages.size()] = std::move(pending);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Move all of the messages that have been added into output
+    void drain(std::vector<AsyncMessage> & output)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        for (;  h < t;  ++h)
+            output.emplace_back(std::move(messages[h % messages.size()]));
+        head.store(t, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return head.load() == tail.load();
+    }
+};
+
+/// The buffers of the calling thread, for each AsyncWriter it logged to
+struct ThreadAsyncBuffers {
+    ~ThreadAsyncBuffers()
+    {
+        for (auto & e: entries)
+            e.second->abandoned = true;
+    }
+
+    std::vector<std::pair<uint64_t, std::shared_ptr<AsyncBuffer> > > entries;
+};
+
+thread_local ThreadAsyncBuffers threadAsyncBuffers;
+
+std::atomic<uint64_t> nextAsyncWriterSerial(0);
+
+} // file scope
+
+struct Logging::AsyncWriter::Itl {
+    Itl(std::shared_ptr<Writer> writer, size_t capacity)
+        : writer(std::move(writer)),
+          capacity(std::max<size_t>(capacity, 1)),
+          serial(nextAsyncWriterSerial++),
+          numDropped(0)
+    {
+        thread = std::thread([this] () { run(); });
+    }
+
+    ~Itl()
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            shutdown = true;
+        }
+        wakeup.notify_all();
+        thread.join();
+    }
+
+    std::shared_ptr<Writer> writer;
+    const size_t capacity;
+    const uint64_t serial;        ///< Identifies it in threadAsyncBuffers
+
+    std::mutex mutex;             ///< Protects everything below
+    std::condition_variable wakeup, flushed;
+    std::vector<std::shared_ptr<AsyncBuffer> > buffers;
+    uint64_t flushRequested = 0, flushDone = 0;
+    bool shutdown = false;
+
+    std::atomic<uint64_t> numDropped;
+    uint64_t numDroppedWritten = 0;  ///< Only used by the flusher
+    std::thread thread;
+
+    /// Return the buffer of the calling thread, creating it if needed
+    AsyncBuffer & threadBuffer()
+    {
+        for (auto & e: threadAsyncBuffers.entries) {
+            if (e.first == serial)
+                return *e.second;
+        }
+
+        auto buffer = std::make_shared<AsyncBuffer>(capacity);
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            buffers.push_back(buffer);
+        }
+        threadAsyncBuffers.entries.emplace_back(serial, buffer);
+        return *buffer;
+    }
+
+    void write(const AsyncMessage & message)
+    {
+        writer->head(message.timestamp.c_str(), message.name,
+                     message.function, message.file, message.line);
+        writer->body(message.content);
+    }
+
+    /// Body of the flusher thread
+    void run()
+    {
+        std::vector<AsyncMessage> messages;
+
+        std::unique_lock<std::mutex> guard(mutex);
+        for (;;) {
+            uint64_t requested = flushRequested;
+            bool stopping = shutdown;
+            auto toDrain = buffers;
+            guard.unlock();
+
+            messages.clear();
+            for (auto & b: toDrain)
+                b->drain(messages);
+
+            std::stable_sort(messages.begin(), messages.end(),
+                             [] (const AsyncMessage & m1,
+                                 const AsyncMessage & m2)
+                             {
+                                 return m1.ns < m2.ns;
+                             });
+            for (auto & m: messages)
+                write(m);
+
+            uint64_t dropped = numDropped.load();
+            if (dropped > numDroppedWritten) {
+                char text[64];
+                formatTimestamp(text);
+                writer->head(text, "logging", __PRETTY_FUNCTION__,
+                             __FILE__, __LINE__);
+                writer->body(std::to_string(dropped - numDroppedWritten)
+                             + " log messages were dropped because the "
+                             "buffer was full\n");
+                numDroppedWritten = dropped;
+            }
+
+            guard.lock();
+
+            // Once its thread has gone, a buffer can't get any more
+            // messages
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                         [] (const std::shared_ptr<AsyncBuffer> & b)
+                                         {
+                                             return b->abandoned && b->empty();
+                                         }),
+                          buffers.end());
+
+            flushDone = requested;
+            flushed.notify_all();
+
+            if (stopping)
+                break;
+            if (flushRequested == requested && !shutdown)
+                wakeup.wait_for(guard, std::chrono::milliseconds(10));
+        }
+    }
+};
+
+Logging::AsyncWriter::AsyncWriter(std::shared_ptr<Writer> writer,
+                                  size_t capacity)
+    : itl(new Itl(std::move(writer), capacity)) {
+}
+
+Logging::AsyncWriter::~AsyncWriter() {
+}
+
+void Logging::AsyncWriter::head(char const * timestamp,
+                                char const * name,
+                                char const * function,
+                                char const * file,
+                                int line) {
+    AsyncMessage & pending = itl->threadBuffer().pending;
+    pending.ns = nowNs();
+    pending.timestamp = timestamp;
+    pending.name = name;
+    pending.function = function;
+    pending.file = file;
+    pending.line = line;
+}
+
+void Logging::AsyncWriter::body(std::string const & content) {
+    AsyncBuffer & buffer = itl->threadBuffer();
+    buffer.pending.content = content;
+    if (!buffer.push())
+        ++itl->numDropped;
+}
+
+void Logging::AsyncWriter::flush() {
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    uint64_t requested = ++itl->flushRequested;
+    itl->wakeup.notify_all();
+    itl->flushed.wait(guard, [&] () { return itl->flushDone >= requested; });
+}
+
+uint64_t Logging::AsyncWriter::numDropped() const {
+    return itl->numDropped.load();
+}
+
+namespace {
+
 struct Registry {
     std::mutex lock;
     std::unordered_map<std::string, std::shared_ptr<Logging::CategoryData> > categories;
@@ -163,6 +417,13 @@ std::shared_ptr<Logging::CategoryData> Logging::CategoryData::getRoot() {
     getRegistry().categories["*"] = root;
     root->parent = root.get();
     root->writer = std::make_shared<ConsoleWriter>();
+    if (getenv("MLDB_LOGGING_ASYNC")) {
+        // Never destroyed, so flush what's queued on exit
+        static Logging::AsyncWriter * writer
+            = new AsyncWriter(root->writer);
+        root->writer.reset(writer, [] (Writer *) {});
+        atexit([] () { writer->flush(); });
+    }
 
     return root;
 }
@@ -322,19 +583,36 @@ void Logging::Category::writeTo(std::shared_ptr<Writer> output, bool recurse) {
 // threads. Note that this lock should either eventually be removed or replaced
 // by a per category lock. Unfortunately the current setup makes it very
 // difficult to pass the header information to the operator& so that everything
-// can be dumped in the stream in one go.
-namespace { std::mutex loggingMutex; }
+// can be dumped in the stream in one go.  Writers that are concurrent don't
+// need it, and their messages are built in a stream of the thread instead of
+// the category.
+namespace {
+
+std::mutex loggingMutex;
+thread_local bool holdingLoggingMutex = false;
+thread_local std::stringstream threadLoggingStream;
+
+void endWrite() {
+    if (holdingLoggingMutex) {
+        holdingLoggingMutex = false;
+        loggingMutex.unlock();
+    }
+}
+
+} // file scope
 
 std::ostream & Logging::Category::beginWrite(char const * fct, char const * file, int line) {
-    loggingMutex.lock();
+    bool concurrent = data->writer->isConcurrent();
+    if (!concurrent) {
+        loggingMutex.lock();
+        holdingLoggingMutex = true;
+    }
 
-    timeval now;
-    gettimeofday(&now, 0);
     char text[64];
-    auto count = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&now.tv_sec));
-    int ms = now.tv_usec / 1000;
-    sprintf(text + count, ".%03d", ms);
+    formatTimestamp(text);
     data->writer->head(text, data->name, fct, file, line);
+    if (concurrent)
+        return threadLoggingStream;
     return data->stream;
 }
 
@@ -343,7 +621,7 @@ void Logging::Printer::operator&(std::ostream & stream) {
     category.getWriter()->body(text.str());
     text.str("");
 
-    loggingMutex.unlock();
+    endWrite();
 }
 
 void Logging::Thrower::operator&(std::ostream & stream) {
@@ -351,7 +629,7 @@ void Logging::Thrower::operator&(std::ostream & stream) {
     std::stringstream & text = (std::stringstream &) stream;
     std::string message(text.str());
     text.str("");
-    loggingMutex.unlock();
+    endWrite();
 
     throw MLDB::Exception(message);
 }
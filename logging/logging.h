@@ -47,14 +47,28 @@
      Logging::Category print("print");
      print.writeTo(std::make_shared<CustomWriter>());
 
-   At the moment, there are 3 types of writers that are usable:
+   At the moment, there are 4 types of writers that are usable:
 
      - ConsoleWriter
      - FileWriter
      - JsonWriter
+     - AsyncWriter
 
-  NOTE: Those writers aren't thread-safe at the moment. Use with care
-  accross threads.
+  NOTE: The first three writers aren't thread-safe, so messages written to
+  them are serialized by a global lock, and written out by the thread that
+  logs them.
+
+  An AsyncWriter wraps another writer, and makes logging safe to turn on in
+  hot code: each thread queues its messages into its own lock-free ring
+  buffer without taking the lock, and a single background thread formats
+  them with the wrapped writer and writes them out.  When a buffer is full,
+  messages are dropped and counted rather than blocking.
+
+     print.writeTo(std::make_shared<Logging::AsyncWriter>
+                   (std::make_shared<Logging::FileWriter>("log.txt")));
+
+  Setting the MLDB_LOGGING_ASYNC environment variable makes the default
+  writer of the root category an asynchronous console writer.
 
 */
 
@@ -62,6 +76,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <sstream>
 #include <unistd.h>
 #include "mldb/types/date.h"
@@ -83,6 +99,15 @@ struct Logging
 
         virtual void body(std::string const & content) {
         }
+
+        /** True if head() and body() can be called by several threads at
+            once, in which case messages are written without the global
+            logging lock.  Each thread calls head() then body() for each of
+            its messages.
+        */
+        virtual bool isConcurrent() const {
+            return false;
+        }
     };
 
     struct ConsoleWriter : public Writer {
@@ -145,6 +170,44 @@ struct Logging
         std::stringstream stream;
     };
 
+    /** Writer that queues messages to be written by another writer on a
+        background thread.  The calling thread only copies the message into
+        its ring buffer, which holds up to capacity messages; messages that
+        don't fit are dropped, and a count of them is written once there is
+        room again.  Messages from different threads are written in the
+        order that they were logged, as closely as the flush interval
+        allows.  Destroying the writer writes out everything queued.
+    */
+    struct AsyncWriter : public Writer {
+        AsyncWriter(std::shared_ptr<Writer> writer,
+                    size_t capacity = 4096);
+
+        ~AsyncWriter();
+
+        void head(char const * timestamp,
+                  char const * name,
+                  char const * function,
+                  char const * file,
+                  int line);
+
+        void body(std::string const & content);
+
+        bool isConcurrent() const {
+            return true;
+        }
+
+        /// Wait until all of the messages logged so far have been written
+        void flush();
+
+        /// Number of messages dropped because a buffer was full
+        uint64_t numDropped() const;
+
+        struct Itl;
+
+    private:
+        std::unique_ptr<Itl> itl;
+    };
+
     struct CategoryData;
 
     struct Category {
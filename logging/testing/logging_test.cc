@@ -13,6 +13,10 @@
 #include "mldb/logging/logging.h"
 
 #include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace MLDB;
@@ -48,3 +52,89 @@ BOOST_AUTO_TEST_CASE(blah)
     BOOST_CHECK(!d.isEnabled());
     BOOST_CHECK(!e.isEnabled());
 }
+
+/// Writer that keeps the messages written to it
+struct RecordingWriter : public Logging::Writer {
+    void head(char const * timestamp,
+              char const * name,
+              char const * function,
+              char const * file,
+              int line)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        names.push_back(name);
+    }
+
+    void body(std::string const & content)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        contents.push_back(content);
+    }
+
+    std::mutex mutex;
+    std::vector<std::string> names, contents;
+};
+
+BOOST_AUTO_TEST_CASE(test_async_writer)
+{
+    auto recording = std::make_shared<RecordingWriter>();
+    auto async = std::make_shared<Logging::AsyncWriter>(recording);
+
+    Logging::Category category("async");
+    category.activate();
+    category.writeTo(async);
+
+    LOG(category) << "hello " << 1 << endl;
+    LOG(category) << "world" << endl;
+    async->flush();
+
+    BOOST_REQUIRE_EQUAL(recording->contents.size(), 2);
+    BOOST_CHECK_EQUAL(recording->names[0], "async");
+    BOOST_CHECK_EQUAL(recording->contents[0], "hello 1\n");
+    BOOST_CHECK_EQUAL(recording->contents[1], "world\n");
+    BOOST_CHECK_EQUAL(async->numDropped(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_writer_threads)
+{
+    auto recording = std::make_shared<RecordingWriter>();
+    size_t numThreads = 8, numMessages = 10000;
+
+    {
+        // A small buffer, so that some messages are dropped
+        auto async = std::make_shared<Logging::AsyncWriter>(recording, 16);
+        Logging::Category category("async_threads");
+        category.activate();
+        category.writeTo(async);
+
+        auto doThread = [&] (int threadNum)
+            {
+                for (size_t i = 0;  i < numMessages;  ++i)
+                    LOG(category) << threadNum << " " << i << endl;
+            };
+
+        std::vector<std::thread> threads;
+        for (int i = 0;  i < numThreads;  ++i)
+            threads.emplace_back(doThread, i);
+        for (auto & t: threads)
+            t.join();
+
+        async->flush();
+
+        // The messages from each thread come through in order
+        std::vector<int> lastSeen(numThreads, -1);
+        size_t numWritten = 0;
+        for (auto & c: recording->contents) {
+            int threadNum, i;
+            if (sscanf(c.c_str(), "%d %d", &threadNum, &i) != 2)
+                continue;  // count of dropped messages
+            BOOST_CHECK_GT(i, lastSeen.at(threadNum));
+            lastSeen[threadNum] = i;
+            ++numWritten;
+        }
+
+        BOOST_CHECK_EQUAL(numWritten + async->numDropped(),
+                          numThreads * numMessages);
+        category.writeTo(std::make_shared<Logging::ConsoleWriter>());
+    }
+}
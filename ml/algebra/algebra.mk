@@ -3,6 +3,7 @@
 LIBALGEBRA_SOURCES := \
         least_squares.cc \
         irls.cc \
+        sparse_glz.cc \
         lapack.cc \
 	ilaenv.c \
         svd.cc \
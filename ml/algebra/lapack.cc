@@ -135,16 +135,16 @@ extern "C" {
                  int * info);
 
     /* Matrix multiply */
-    void sgemm_(const int * m, const int * n, const int * k, const float * alpha,
+    void sgemm_(const char * transa, const char * transb,
+                const int * m, const int * n, const int * k, const float * alpha,
                 const float * A, const int * lda, const float * b,
-                const int * ldb, const float * beta, float * c, const int * ldc,
-                int * info);
+                const int * ldb, const float * beta, float * c, const int * ldc);
 
     /* Matrix multiply */
-    void dgemm_(const int * m, const int * n, const int * k, const double * alpha,
+    void dgemm_(const char * transa, const char * transb,
+                const int * m, const int * n, const int * k, const double * alpha,
                 const double * A, const int * lda, const double * b,
-                const int * ldb, const double * beta, double * c, const int * ldc,
-                int * info);
+                const int * ldb, const double * beta, double * c, const int * ldc);
 
     /* Elementary reflector.  Used to detect version 3.2 of the LAPACK.  Most
        important thing is that if n < 0, it will return zero in tau. */
@@ -573,6 +573,24 @@ int geqp3(int m, int n, double * A, int lda, int * jpvt, double * tau)
     return info;
 }
 
+int gemm(char transa, char transb, int m, int n, int k, float alpha,
+         const float * A, int lda, const float * b, int ldb,
+         float beta, float * C, int ldc)
+{
+    sgemm_(&transa, &transb, &m, &n, &k, &alpha, A, &lda, b, &ldb,
+           &beta, C, &ldc);
+    return 0;
+}
+
+int gemm(char transa, char transb, int m, int n, int k, double alpha,
+         const double * A, int lda, const double * b, int ldb,
+         double beta, double * C, int ldc)
+{
+    dgemm_(&transa, &transb, &m, &n, &k, &alpha, A, &lda, b, &ldb,
+           &beta, C, &ldc);
+    return 0;
+}
+
 } // namespace LAPack
 } // namespace ML
 
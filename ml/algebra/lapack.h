@@ -120,7 +120,9 @@ int geqp3(int m, int n, float * A, int lda, int * jpvt, float * tau);
 int geqp3(int m, int n, double * A, int lda, int * jpvt, double * tau);
 
 
-/** Generalized matrix multiply */
+/** Generalized matrix multiply, C = alpha * op(A) * op(b) + beta * C, with
+    column major matrices as in BLAS.  op() is the transpose when its
+    trans argument is 'T'. */
 int gemm(char transa, char transb, int m, int n, int k, float alpha,
          const float * A, int lda, const float * b, int ldb,
          float beta, float * C, int ldc);
@@ -0,0 +1,353 @@
+/* sparse_glz.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Training of generalized linear models over sparse data.
+*/
+
+#include "sparse_glz.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include <deque>
+#include <cmath>
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* CSR_MATRIX                                                                */
+/*****************************************************************************/
+
+CSR_Matrix::
+CSR_Matrix(int num_cols)
+    : num_cols(num_cols), row_starts(1, 0)
+{
+}
+
+void
+CSR_Matrix::
+add_row(const std::vector<std::pair<int, float> > & row)
+{
+    for (auto & entry: row) {
+        ExcAssertGreaterEqual(entry.first, 0);
+        ExcAssertLess(entry.first, num_cols);
+        columns.push_back(entry.first);
+        values.push_back(entry.second);
+    }
+    row_starts.push_back(values.size());
+}
+
+CSR_Matrix
+CSR_Matrix::
+transpose() const
+{
+    CSR_Matrix result(row_count());
+    result.row_starts.assign(num_cols + 1, 0);
+
+    for (int c: columns)
+        ++result.row_starts[c + 1];
+    for (int c = 0;  c < num_cols;  ++c)
+        result.row_starts[c + 1] += result.row_starts[c];
+
+    result.columns.resize(nonzero_count());
+    result.values.resize(nonzero_count());
+
+    // Where the next value of each column goes
+    std::vector<size_t> next(result.row_starts.begin(),
+                             result.row_starts.end() - 1);
+
+    for (size_t r = 0;  r < row_count();  ++r) {
+        for (size_t i = row_starts[r];  i < row_starts[r + 1];  ++i) {
+            size_t pos = next[columns[i]]++;
+            result.columns[pos] = r;
+            result.values[pos] = values[i];
+        }
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SPARSE GLZ                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/** The smooth part of the objective (the loss and L2 term), with its
+    gradient.
+*/
+struct Sparse_Objective {
+    Sparse_Objective(const distribution<double> & correct,
+                     const CSR_Matrix & X,
+                     const distribution<double> & w,
+                     Link_Function link,
+                     double l2,
+                     bool add_bias)
+        : correct(correct), X(X), XT(X.transpose()), w(w), link(link),
+          l2(l2), add_bias(add_bias), residuals(X.row_count())
+    {
+        double total_weight = w.total();
+        if (total_weight <= 0.0)
+            throw Exception("train_sparse_glz(): no weight on any example");
+        weight_recip = 1.0 / total_weight;
+    }
+
+    const distribution<double> & correct;
+    const CSR_Matrix & X;
+    CSR_Matrix XT;
+    const distribution<double> & w;
+    Link_Function link;
+    double l2;
+    bool add_bias;
+    double weight_recip;
+
+    /// Derivative of the weighted loss of each example by its output
+    std::vector<double> residuals;
+
+    /** Return the objective at beta, and put its gradient in grad. */
+    double operator () (const distribution<double> & beta,
+                        distribution<double> & grad)
+    {
+        size_t nx = X.row_count();
+        int nf = X.num_cols;
+        double bias = add_bias ? beta[nf] : 0.0;
+
+        auto onRow = [&] (double & loss, size_t x)
+            {
+                double eta = X.row_dotprod(x, &beta[0]) + bias;
+                double y = correct[x];
+                double l, d;
+
+                if (link == LOGIT) {
+                    // log(1 + exp(eta)), without overflowing
+                    l = (eta > 0.0
+                         ? eta + log1p(exp(-eta))
+                         : log1p(exp(eta)))
+                        - y * eta;
+                    d = 1.0 / (1.0 + exp(-eta)) - y;
+                }
+                else {
+                    l = 0.5 * (eta - y) * (eta - y);
+                    d = eta - y;
+                }
+
+                loss += w[x] * l;
+                residuals[x] = w[x] * d * weight_recip;
+            };
+
+        double loss
+            = MLDB::parallelReduce(0, nx, 0.0, onRow,
+                                   [] (double & into, double & from)
+                                   { into += from; },
+                                   1024)
+            * weight_recip;
+
+        auto onColumns = [&] (size_t first, size_t last)
+            {
+                for (size_t j = first;  j < last;  ++j)
+                    grad[j] = XT.row_dotprod(j, residuals.data())
+                        + l2 * beta[j];
+            };
+
+        MLDB::parallelMapChunked(0, nf, MLDB::parallelGrainSize(nf, 1024),
+                                 onColumns);
+
+        if (add_bias) {
+            double total = 0.0;
+            for (double r: residuals)
+                total += r;
+            grad[nf] = total;
+        }
+
+        if (l2 != 0.0) {
+            double total = 0.0;
+            for (int j = 0;  j < nf;  ++j)
+                total += beta[j] * beta[j];
+            loss += 0.5 * l2 * total;
+        }
+
+        return loss;
+    }
+};
+
+/// One of the steps remembered by L-BFGS
+struct Step {
+    distribution<double> s;   ///< Change in the weights
+    distribution<double> y;   ///< Change in the gradient
+    double rho;               ///< 1 / s.y
+    double alpha;             ///< Working storage for the two-loop recursion
+};
+
+inline double sign(double x)
+{
+    return (x > 0.0) - (x < 0.0);
+}
+
+double max_abs(const distribution<double> & x)
+{
+    double result = 0.0;
+    for (double v: x)
+        result = std::max(result, fabs(v));
+    return result;
+}
+
+} // file scope
+
+distribution<double>
+train_sparse_glz(const distribution<double> & correct,
+                 const CSR_Matrix & X,
+                 const distribution<double> & w,
+                 Link_Function link,
+                 Regularization regularization,
+                 double regularization_factor,
+                 bool add_bias,
+                 int max_iter,
+                 double epsilon,
+                 int history)
+{
+    size_t nx = X.row_count();
+    int nf = X.num_cols;
+    int nv = nf + add_bias;
+
+    if (correct.size() != nx || w.size() != nx)
+        throw Exception("train_sparse_glz(): wrong number of examples");
+    if (link != LOGIT && link != LINEAR)
+        throw Exception("train_sparse_glz(): only the logit and linear link "
+                        "functions are supported, not " + print(link));
+    if (regularization != Regularization_none && regularization_factor < 0.0)
+        throw Exception("train_sparse_glz(): the regularization factor "
+                        "must be given");
+
+    double l1 = 0.0, l2 = 0.0;
+    if (regularization == Regularization_l1)
+        l1 = regularization_factor;
+    else if (regularization == Regularization_l2)
+        l2 = regularization_factor;
+    else if (regularization != Regularization_none)
+        throw Exception("train_sparse_glz(): unknown regularization");
+
+    Sparse_Objective objective(correct, X, w, link, l2, add_bias);
+
+    auto l1norm = [&] (const distribution<double> & beta)
+        {
+            double result = 0.0;
+            for (int j = 0;  j < nf;  ++j)
+                result += fabs(beta[j]);
+            return result;
+        };
+
+    distribution<double> beta(nv, 0.0), grad(nv), pgrad(nv), dir(nv);
+    distribution<double> newBeta(nv), newGrad(nv);
+    double f = objective(beta, grad) + l1 * l1norm(beta);
+
+    std::deque<Step> steps;
+
+    for (int iter = 0;  iter < max_iter;  ++iter) {
+
+        // Pseudo-gradient: the gradient of the smooth part, plus that of
+        // the L1 term in the direction that reduces the objective.
+        for (int j = 0;  j < nv;  ++j) {
+            double g = grad[j];
+            if (l1 == 0.0 || j == nf)
+                pgrad[j] = g;
+            else if (beta[j] != 0.0)
+                pgrad[j] = g + l1 * sign(beta[j]);
+            else if (g + l1 < 0.0)
+                pgrad[j] = g + l1;
+            else if (g - l1 > 0.0)
+                pgrad[j] = g - l1;
+            else pgrad[j] = 0.0;
+        }
+
+        if (max_abs(pgrad) == 0.0)
+            break;
+
+        // Two-loop recursion to multiply by the inverse Hessian estimate
+        dir = pgrad;
+        for (auto it = steps.rbegin();  it != steps.rend();  ++it) {
+            it->alpha = it->rho * it->s.dotprod(dir);
+            dir -= it->alpha * it->y;
+        }
+        if (!steps.empty()) {
+            const Step & last = steps.back();
+            dir *= 1.0 / (last.rho * last.y.dotprod(last.y));
+        }
+        for (auto & step: steps) {
+            double b = step.rho * step.y.dotprod(dir);
+            dir += (step.alpha - b) * step.s;
+        }
+        dir *= -1.0;
+
+        // Stay in the orthant that the pseudo-gradient points to
+        if (l1 != 0.0) {
+            for (int j = 0;  j < nf;  ++j)
+                if (dir[j] * pgrad[j] >= 0.0)
+                    dir[j] = 0.0;
+        }
+
+        if (dir.dotprod(pgrad) >= 0.0) {
+            // Not a descent direction; start again from steepest descent
+            steps.clear();
+            dir = -1.0 * pgrad;
+        }
+
+        // Backtracking line search.  The first step is scaled, as we have
+        // no idea of the curvature yet.
+        double step = steps.empty() ? 1.0 / sqrt(pgrad.dotprod(pgrad)) : 1.0;
+        double newF = INFINITY;
+        bool accepted = false;
+
+        for (int i = 0;  i < 40 && !accepted;  ++i, step *= 0.5) {
+            for (int j = 0;  j < nv;  ++j) {
+                newBeta[j] = beta[j] + step * dir[j];
+
+                // Coordinates that cross zero are clipped to it
+                if (l1 != 0.0 && j != nf) {
+                    double orthant = beta[j] != 0.0
+                        ? sign(beta[j]) : -sign(pgrad[j]);
+                    if (newBeta[j] * orthant <= 0.0)
+                        newBeta[j] = 0.0;
+                }
+            }
+
+            newF = objective(newBeta, newGrad) + l1 * l1norm(newBeta);
+
+            double expected = 0.0;
+            for (int j = 0;  j < nv;  ++j)
+                expected += pgrad[j] * (newBeta[j] - beta[j]);
+
+            accepted = newF <= f + 1e-4 * expected;
+        }
+
+        if (!accepted)
+            break;  // no more progress is possible
+
+        Step newStep;
+        newStep.s = newBeta - beta;
+        newStep.y = newGrad - grad;
+        double sy = newStep.s.dotprod(newStep.y);
+        double maxChange = max_abs(newStep.s);
+
+        if (sy > 1e-20) {
+            newStep.rho = 1.0 / sy;
+            steps.emplace_back(std::move(newStep));
+            if (steps.size() > history)
+                steps.pop_front();
+        }
+
+        beta.swap(newBeta);
+        grad.swap(newGrad);
+        f = newF;
+
+        if (maxChange < epsilon)
+            break;
+    }
+
+    return beta;
+}
+
+} // namespace ML
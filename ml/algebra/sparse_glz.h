@@ -0,0 +1,97 @@
+/* sparse_glz.h                                                    -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Training of generalized linear models over sparse data.
+*/
+
+#pragma once
+
+#include "irls.h"
+#include <vector>
+#include <utility>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* CSR_MATRIX                                                                */
+/*****************************************************************************/
+
+/** A sparse matrix in compressed sparse row format.  The non-zero values
+    of row i are in values[row_starts[i]] up to values[row_starts[i + 1]],
+    with the column of each in the same position of columns.  The columns
+    within a row don't need to be sorted, but must not be repeated.
+*/
+struct CSR_Matrix {
+    CSR_Matrix(int num_cols = 0);
+
+    int num_cols;
+    std::vector<size_t> row_starts;
+    std::vector<int> columns;
+    std::vector<float> values;
+
+    size_t row_count() const { return row_starts.size() - 1; }
+
+    size_t nonzero_count() const { return values.size(); }
+
+    /** Add a row with the given (column, value) pairs to the end. */
+    void add_row(const std::vector<std::pair<int, float> > & row);
+
+    /** Dot product of a row with the dense vector x, which has num_cols
+        entries. */
+    double row_dotprod(size_t row, const double * x) const
+    {
+        double result = 0.0;
+        for (size_t i = row_starts[row], e = row_starts[row + 1];  i < e;  ++i)
+            result += values[i] * x[columns[i]];
+        return result;
+    }
+
+    /** Return the transpose, which is the same matrix in compressed sparse
+        column format: its rows are our columns. */
+    CSR_Matrix transpose() const;
+};
+
+
+/*****************************************************************************/
+/* SPARSE GLZ                                                                */
+/*****************************************************************************/
+
+/** Train a generalized linear model over the rows of the sparse matrix X
+    by directly minimizing
+
+        sum_x w[x] loss(correct[x], X[x] . beta + bias) / sum_x w[x]
+          + regularization_factor * (|beta|_2^2 / 2  or  |beta|_1)
+
+    with L-BFGS, or with its orthant-wise variant OWL-QN (Andrew and Gao,
+    2007) for L1 regularization.  The loss is the negative log-likelihood
+    of the binomial distribution for the LOGIT link, and the squared error
+    for the LINEAR link; other links are not supported.  The bias is not
+    regularized.
+
+    Unlike IRLS, X is never densified and no nv x nv system is solved, so
+    the memory and time per iteration are linear in the number of
+    non-zeros.  The objective and gradient are evaluated in parallel, over
+    the rows and then over the columns of X.
+
+    Training stops after max_iter iterations, or once no weight changed by
+    more than epsilon in an iteration.  history is the number of steps
+    that L-BFGS remembers.
+
+    Returns X.num_cols weights, plus the bias as the last one if add_bias
+    is true.
+*/
+distribution<double>
+train_sparse_glz(const distribution<double> & correct,
+                 const CSR_Matrix & X,
+                 const distribution<double> & w,
+                 Link_Function link,
+                 Regularization regularization,
+                 double regularization_factor,
+                 bool add_bias = true,
+                 int max_iter = 1000,
+                 double epsilon = 1e-4,
+                 int history = 10);
+
+} // namespace ML
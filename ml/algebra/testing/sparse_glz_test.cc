@@ -0,0 +1,114 @@
+/* sparse_glz_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the training of GLZs over sparse matrices.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <iostream>
+
+#include "mldb/ml/algebra/sparse_glz.h"
+
+using namespace ML;
+using namespace std;
+
+
+/* nx examples over nf binary features, each present with probability
+   0.2, of which only the first five have a non-zero weight.
+*/
+struct Problem {
+    Problem(Link_Function link, int nx = 5000, int nf = 50)
+        : truth(nf), X(nf), correct(nx), w(nx, 1.0)
+    {
+        std::mt19937 rng(1);
+        std::normal_distribution<double> normal;
+        std::uniform_real_distribution<double> uniform;
+
+        for (int j = 0;  j < 5;  ++j)
+            truth[j] = normal(rng) * 2.0;
+
+        for (int x = 0;  x < nx;  ++x) {
+            std::vector<std::pair<int, float> > row;
+            double eta = bias;
+            for (int j = 0;  j < nf;  ++j) {
+                if (uniform(rng) < 0.2) {
+                    row.emplace_back(j, 1.0);
+                    eta += truth[j];
+                }
+            }
+            X.add_row(row);
+
+            if (link == LOGIT)
+                correct[x] = uniform(rng) < 1.0 / (1.0 + exp(-eta));
+            else correct[x] = eta;
+        }
+    }
+
+    double bias = 0.5;
+    distribution<double> truth;
+    CSR_Matrix X;
+    distribution<double> correct, w;
+};
+
+BOOST_AUTO_TEST_CASE( test_csr_transpose )
+{
+    CSR_Matrix X(3);
+    X.add_row({ { 0, 1.0 }, { 2, 2.0 } });
+    X.add_row({});
+    X.add_row({ { 1, 3.0 }, { 0, 4.0 } });
+
+    CSR_Matrix T = X.transpose();
+    BOOST_REQUIRE_EQUAL(T.row_count(), 3);
+    BOOST_CHECK_EQUAL(T.num_cols, 3);
+    BOOST_CHECK_EQUAL(T.nonzero_count(), 4);
+
+    double x[3] = { 1.0, 10.0, 100.0 };
+    BOOST_CHECK_EQUAL(T.row_dotprod(0, x), 401.0);
+    BOOST_CHECK_EQUAL(T.row_dotprod(1, x), 300.0);
+    BOOST_CHECK_EQUAL(T.row_dotprod(2, x), 2.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_linear )
+{
+    Problem problem(LINEAR);
+
+    distribution<double> trained
+        = train_sparse_glz(problem.correct, problem.X, problem.w, LINEAR,
+                           Regularization_none, 0.0, true, 1000, 1e-8);
+
+    BOOST_REQUIRE_EQUAL(trained.size(), problem.truth.size() + 1);
+    for (unsigned j = 0;  j < problem.truth.size();  ++j)
+        BOOST_CHECK_SMALL(trained[j] - problem.truth[j], 1e-4);
+    BOOST_CHECK_SMALL(trained.back() - problem.bias, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_logit )
+{
+    Problem problem(LOGIT);
+
+    distribution<double> trained
+        = train_sparse_glz(problem.correct, problem.X, problem.w, LOGIT,
+                           Regularization_l2, 1e-4, true, 1000, 1e-6);
+
+    cerr << "truth " << problem.truth << endl;
+    cerr << "trained " << trained << endl;
+
+    for (unsigned j = 0;  j < problem.truth.size();  ++j)
+        BOOST_CHECK_SMALL(trained[j] - problem.truth[j], 0.5);
+
+    // L1 regularization gets rid of the features that don't matter
+    trained = train_sparse_glz(problem.correct, problem.X, problem.w, LOGIT,
+                               Regularization_l1, 1e-2, true, 1000, 1e-6);
+
+    cerr << "L1 trained " << trained << endl;
+
+    for (unsigned j = 0;  j < problem.truth.size();  ++j) {
+        if (problem.truth[j] == 0.0)
+            BOOST_CHECK_EQUAL(trained[j], 0.0);
+        else BOOST_CHECK_NE(trained[j], 0.0);
+    }
+}
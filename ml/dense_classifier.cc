@@ -8,6 +8,7 @@
 
 #include "dense_classifier.h"
 #include "mldb/jml/utils/vector_utils.h"
+#include "mldb/ml/jml/compiled_tree_ensemble.h"
 
 
 using namespace ML;
@@ -82,6 +83,8 @@ explanationToJson(const ML::Explanation & expl,
 /* DENSE CLASSIFIER                                                          */
 /*****************************************************************************/
 
+constexpr size_t DenseClassifier::BATCH_SIZE;
+
 void
 DenseClassifier::
 load(const std::string & filename,
@@ -135,6 +138,8 @@ init(std::shared_ptr<ML::Classifier_Impl> classifier,
     //cerr << "mapping_.num_vars_expected = " << mapping_.num_vars_expected_ << endl;
 
     opt_info_ = classifier_->optimize(classifier_fs_->dense_features());
+    compiled_ = ML::Compiled_Tree_Ensemble::compile
+        (*classifier_, classifier_fs_->dense_features());
 }
 
 void
@@ -182,6 +187,52 @@ scoreUnbiased(const distribution<float> & features,
     return classifier_->predict(1, mapper_output, opt_info_, &context);
 }
 
+void
+DenseClassifier::
+scoreBatch(const float * features, size_t numRows, size_t rowStride,
+           float * output) const
+{
+    static thread_local std::vector<float> scores;
+
+    int nl = labelCount();
+    scores.resize(nl * std::min<size_t>(numRows, BATCH_SIZE));
+
+    for (size_t i = 0;  i < numRows;  i += BATCH_SIZE) {
+        size_t n = std::min<size_t>(numRows - i, BATCH_SIZE);
+        labelScoresBatch(features + i * rowStride, n, rowStride,
+                         scores.data());
+        for (size_t j = 0;  j < n;  ++j)
+            output[i + j] = scores[j * nl + 1];
+    }
+}
+
+void
+DenseClassifier::
+labelScoresBatch(const float * features, size_t numRows, size_t rowStride,
+                 float * output) const
+{
+    static thread_local std::vector<float> encoded;
+
+    int nl = labelCount();
+    size_t nv = mapping_.num_vars_expected_;
+    encoded.resize(nv * std::min<size_t>(numRows, BATCH_SIZE));
+
+    for (size_t i = 0;  i < numRows;  i += BATCH_SIZE) {
+        size_t n = std::min<size_t>(numRows - i, BATCH_SIZE);
+
+        for (size_t j = 0;  j < n;  ++j)
+            classifier_fs_->encode(features + (i + j) * rowStride,
+                                   encoded.data() + j * nv,
+                                   *input_fs_,
+                                   mapping_);
+
+        if (compiled_)
+            compiled_->predict(encoded.data(), n, nv, output + i * nl);
+        else classifier_->predict_batch(encoded.data(), n, nv, opt_info_,
+                                        output + i * nl);
+    }
+}
+
 ML::Label_Dist
 DenseClassifier::
 labelScores(const distribution<float> & features) const
@@ -17,6 +17,10 @@
 #include "mldb/ext/jsoncpp/json.h"
 #include "pipeline_execution_context.h"
 
+namespace ML {
+struct Compiled_Tree_Ensemble;
+} // namespace ML
+
 namespace MLDB {
 
 /** Return a JSON rendering of an explanation of a given feature set. */
@@ -76,6 +80,35 @@ struct DenseClassifier {
     labelScoresUnbiased(const distribution<float> & features,
                         PipelineExecutionContext & context) const;
 
+    /** Calculate the score for each of numRows feature vectors, the
+        first of which starts at features and each of which is rowStride
+        floats after the previous one.  One score per row is written to
+        output.
+
+        This and labelScoresBatch() use buffers that belong to the calling
+        thread and are reused from call to call, so that there is no
+        memory allocation per row in steady state.
+    */
+    void scoreBatch(const float * features, size_t numRows, size_t rowStride,
+                    float * output) const;
+
+    /** Calculate the label scores for each of numRows feature vectors,
+        as for scoreBatch().  labelCount() floats per row are written to
+        output.
+    */
+    void labelScoresBatch(const float * features, size_t numRows,
+                          size_t rowStride, float * output) const;
+
+    /** Number of rows that are encoded and scored together by the batch
+        methods, which bounds the size of their buffers. */
+    static constexpr size_t BATCH_SIZE = 256;
+
+    /** Number of label scores for each row. */
+    int labelCount() const
+    {
+        return classifier_->label_count();
+    }
+
     std::shared_ptr<ML::Classifier_Impl> classifier() const
     {
         return classifier_;
@@ -130,6 +163,9 @@ private:
     std::shared_ptr<ML::Dense_Feature_Space> input_fs_;
     ML::Dense_Feature_Space::Mapping mapping_;
     ML::Optimization_Info opt_info_;
+
+    /// Flattened form of the classifier if it's a tree ensemble
+    std::shared_ptr<const ML::Compiled_Tree_Ensemble> compiled_;
 };
 
 } // namespace MLDB
@@ -20,6 +20,8 @@
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/ml/algebra/least_squares.h"
 #include "mldb/types/jml_serialization.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 
 using namespace std;
 using namespace MLDB;
@@ -34,69 +36,150 @@ double distance(const distribution<double> & x,
     return (x - y).two_norm();
 }
 
-double gaussianDistance(const distribution<double> & pt,
-                        const distribution<double> & origin,
-                        const MatrixType& covarianceMatrix, 
-                        const  MatrixType & invertCovarianceMatrix,
-                        float determinant)
+/// Threshold below which a singular value of a covariance matrix is zero
+constexpr double MIN_SINGULAR_VALUE = 0.0001;
+
+/** Log of the density at pt of the Gaussian with the given centroid and
+    (pseudo) inverse covariance and determinant.
+*/
+double logGaussianDensity(const distribution<double> & pt,
+                          const distribution<double> & origin,
+                          const MatrixType & invertCovarianceMatrix,
+                          double determinant)
 {
-    auto xToU = pt - origin;
-    auto variance = invertCovarianceMatrix * xToU ;
+    size_t dim = pt.size();
+    distribution<double> xToU(dim);
+    SIMD::vec_minus(pt.data(), origin.data(), xToU.data(), dim);
+
+    double mahalanobis = 0;
+    for (size_t i = 0;  i < dim;  ++i) {
+        mahalanobis += xToU[i]
+            * SIMD::vec_dotprod_dp(&invertCovarianceMatrix[i][0],
+                                   xToU.data(), dim);
+    }
 
-    double value_exponent = -0.5f*xToU.dotprod(variance);
-    double determinantCovMatrix = determinant;
+    return -0.5 * (mahalanobis + dim * log(2.0 * M_PI)
+                   + log(fabs(determinant)));
+}
 
-    if (determinantCovMatrix < 0)
-      determinantCovMatrix = fabs(determinantCovMatrix);
+/** Turn the log densities of a point under each cluster into the
+    responsibilities of each cluster for the point, which sum to one, and
+    return the most likely cluster.  Works in the log domain so that points
+    far from all clusters are still shared out.
+*/
+int responsibilities(double * logDensities, size_t numClusters)
+{
+    int best = 0;
+    for (size_t i = 1;  i < numClusters;  ++i) {
+        if (logDensities[i] > logDensities[best])
+            best = i;
+    }
 
-    double distance
-        = (1.0f / (pow(2.0f * 3.14159, pt.size() / 2.0f)
-                   * sqrt(determinantCovMatrix))) 
-        * exp(value_exponent);
-    
-    return distance;
+    double maxLog = logDensities[best];
+    if (!std::isfinite(maxLog)) {
+        std::fill(logDensities, logDensities + numClusters, 0.0);
+        return 0;
+    }
 
+    double total = 0;
+    for (size_t i = 0;  i < numClusters;  ++i) {
+        logDensities[i] = exp(logDensities[i] - maxLog);
+        total += logDensities[i];
+    }
+    SIMD::vec_scale(logDensities, 1.0 / total, logDensities, numClusters);
+    return best;
 }
 
+/** What's needed to evaluate the log density of a cluster's Gaussian
+    quickly during training, worked out once per iteration.
 
-boost::multi_array<double, 2>
-EstimateCovariance(int i,
-                   const std::vector<distribution<double>> & points, 
-                   const  MatrixType& distanceMatrix,
-                   double totalWeight,
-                   distribution<double> average)
-{
-    boost::multi_array<double, 2> variant;
+    The (pseudo) inverse of the covariance C = V S V' is V S^-1 V', so the
+    Mahalanobis distance of x is the squared norm of S^-1/2 V' (x - mu).
+    The factor S^-1/2 V' has one row per non-negligible singular value and
+    plays the part of the inverse Cholesky factor, but copes with singular
+    covariances as the pseudo inverse does.  With diagonal covariances it's
+    a single row of 1 / stddev.
+*/
+struct DensityFactor {
+    distribution<double> centroid;
+    std::vector<double> factor;   ///< rank x dim, row major, or dim if diagonal
+    size_t rank = 0;
+    bool diagonal = false;
+    double logNormalizer = 0;     ///< -0.5 * log((2 pi)^d * pseudo det)
+
+    /// Log density at x, with diff a buffer of the dimension of x
+    double logDensity(const double * x, double * diff) const
+    {
+        // Clusters without any members have nothing to evaluate
+        if (logNormalizer == -INFINITY)
+            return logNormalizer;
 
-    if (totalWeight < 0.000001f)
-      return variant;
+        size_t dim = centroid.size();
+        SIMD::vec_minus(x, centroid.data(), diff, dim);
 
-    variant.resize(boost::extents[average.size()][average.size()]);
-    for (int n = 0; n < distanceMatrix.shape()[0]; ++n)
-    {
-        distribution<double> pt = points[n] - average;
-        double distance = distanceMatrix[n][i];
-        int dim = average.size();
-        MatrixType variantPt(boost::extents[dim][dim]);
-
-	    for (unsigned i = 0;  i < dim;  ++i)
-	    {
-	        for (unsigned j = 0;  j < dim;  ++j)
-	        {
-	            variantPt[i][j] = pt[i]*pt[j] * distance;    
-	        }
-	    }
-
-        if (n == 0) {                                    
-            variant = std::move(variantPt);
+        double mahalanobis = 0;
+        if (diagonal) {
+            SIMD::vec_prod(diff, factor.data(), diff, dim);
+            mahalanobis = SIMD::vec_dotprod_dp(diff, diff, dim);
         }
         else {
-            variant = std::move(variant + variantPt);
+            for (size_t r = 0;  r < rank;  ++r) {
+                double proj = SIMD::vec_dotprod_dp(&factor[r * dim], diff, dim);
+                mahalanobis += proj * proj;
+            }
         }
+        return -0.5 * mahalanobis + logNormalizer;
     }
+};
 
-    variant = variant / totalWeight;
-    return variant;
+/** Factor of a Gaussian with identity covariance, as at the start. */
+DensityFactor identityFactor(const distribution<double> & centroid,
+                             bool diagonal)
+{
+    size_t dim = centroid.size();
+    DensityFactor result;
+    result.centroid = centroid;
+    result.diagonal = diagonal;
+    if (diagonal) {
+        result.factor.resize(dim, 1.0);
+    }
+    else {
+        result.rank = dim;
+        result.factor.resize(dim * dim, 0.0);
+        for (size_t i = 0;  i < dim;  ++i)
+            result.factor[i * dim + i] = 1.0;
+    }
+    result.logNormalizer = -0.5 * dim * log(2.0 * M_PI);
+    return result;
+}
+
+/** Sufficient statistics of the points of each cluster, weighted by the
+    responsibility of the cluster for each point.  Each chunk of points
+    accumulates its own, and they are added together for the M step.
+*/
+struct ClusterStats {
+    ClusterStats(size_t numClusters = 0, size_t size = 0)
+        : weights(numClusters, 0.0), sums(numClusters * size, 0.0)
+    {
+    }
+
+    std::vector<double> weights;   ///< Total responsibility per cluster
+    std::vector<double> sums;      ///< Weighted sums, size values per cluster
+
+    void add(const ClusterStats & other)
+    {
+        SIMD::vec_add(weights.data(), other.weights.data(), weights.data(),
+                      weights.size());
+        SIMD::vec_add(sums.data(), other.sums.data(), sums.data(),
+                      sums.size());
+    }
+};
+
+/// Number of points per chunk of the parallel passes over the points,
+/// chosen so that there's about one set of statistics per CPU
+size_t statsGrain(size_t npoints)
+{
+    return std::max<size_t>(256, (npoints + MLDB::numCpus() - 1) / MLDB::numCpus());
 }
 
 void
@@ -105,7 +188,8 @@ train(const std::vector<distribution<double>> & points,
       std::vector<int> & in_cluster,
       int nbClusters,
       int maxIterations,
-      int randomSeed) 
+      int randomSeed,
+      bool diagonalCovariance)
 {
     using namespace std;
 
@@ -161,6 +245,7 @@ train(const std::vector<distribution<double>> & points,
     }
 
     int numdimensions = points[0].size();
+    std::vector<DensityFactor> factors;
     for (int i=0; i < nbClusters; ++i) {
 
         ML::setIdentity<double>(numdimensions, clusters[i].covarianceMatrix);
@@ -168,102 +253,208 @@ train(const std::vector<distribution<double>> & points,
             .resize(boost::extents[numdimensions][numdimensions]);
         clusters[i].invertCovarianceMatrix = clusters[i].covarianceMatrix;
         clusters[i].pseudoDeterminant = 1.0f; 
+        factors.emplace_back(identityFactor(clusters[i].centroid,
+                                            diagonalCovariance));
     }
 
+    size_t grain = statsGrain(npoints);
+
     for (int iter = 0;  iter < maxIterations;  ++iter) {
 
         // How many have changed cluster?  Used to know when the cluster
         // contents are stable
         std::atomic<int> changes(0);
 
-        //Step 1: assign each point to a distribution in the mixture
+        //Step 1: assign each point to a distribution in the mixture, and
+        // add it to the weight and weighted sum of each cluster
 
-        auto findNewCluster = [&] (int i) {
-            
-            int best_cluster = this->assign(points[i], distanceMatrix, i);
+        auto accumulateMeans = [&] (ClusterStats & stats, size_t i)
+            {
+                thread_local std::vector<double> diff;
+                diff.resize(numdimensions);
 
-            if (best_cluster != in_cluster[i]) {
-                ++changes;
-                in_cluster[i] = best_cluster;
-            }
-        };
+                double * resp = &distanceMatrix[i][0];
+                for (int c = 0;  c < nbClusters;  ++c)
+                    resp[c] = factors[c].logDensity(points[i].data(),
+                                                    diff.data());
 
-        for (int i = 0; i < points.size(); ++i)
-            findNewCluster(i);
+                int best_cluster = responsibilities(resp, nbClusters);
+                if (best_cluster != in_cluster[i]) {
+                    ++changes;
+                    in_cluster[i] = best_cluster;
+                }
 
-        //Step 2: maximizing distribution's parameters 
-        for (auto & c : clusters) {
-            // If no member, we want to leave it there
-            std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-            c.totalWeight = 0.0f;
-        }
+                for (int c = 0;  c < nbClusters;  ++c) {
+                    if (resp[c] == 0)
+                        continue;
+                    stats.weights[c] += resp[c];
+                    SIMD::vec_add(&stats.sums[c * numdimensions], resp[c],
+                                  points[i].data(),
+                                  &stats.sums[c * numdimensions],
+                                  numdimensions);
+                }
+            };
 
-        std::vector<std::mutex> locks(clusters.size());
+        auto combine = [] (ClusterStats & into, ClusterStats & from)
+            {
+                into.add(from);
+            };
 
-        auto addToMeanForPoint = [&] (int i) {
+        ClusterStats means
+            = MLDB::parallelReduce(0, npoints,
+                                   ClusterStats(nbClusters, numdimensions),
+                                   accumulateMeans, combine, grain);
 
-            auto point = points[i];
-            for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-                double distance = distanceMatrix[i][cluster];
-                clusters[cluster].centroid += point * distance;
-                clusters[cluster].totalWeight += distance;
+        //Step 2: maximizing distribution's parameters 
+        for (int c = 0;  c < nbClusters;  ++c) {
+            auto & cluster = clusters[c];
+            cluster.totalWeight = means.weights[c];
+            // If no member, we want to leave it there
+            if (cluster.totalWeight > 0.000001f) {
+                cluster.centroid = distribution<double>
+                    (&means.sums[c * numdimensions],
+                     &means.sums[(c + 1) * numdimensions]);
+                cluster.centroid /= cluster.totalWeight;
+            }
+            else {
+                std::fill(cluster.centroid.begin(), cluster.centroid.end(),
+                          0.0);
             }
-        };
-
-        // calculate mean
-        for (int i = 0; i < points.size(); ++i) {
-            addToMeanForPoint(i);
         }
 
-        //normalizeMean
-        for (int cluster = 0; cluster < clusters.size(); ++cluster) {
-            if (clusters[cluster].totalWeight > 0.000001f)
-                {
-                    clusters[cluster].centroid
-                        = clusters[cluster].centroid
-                        / clusters[cluster].totalWeight;
+        // Weighted scatter about the new centroids: only the variances
+        // with diagonal covariances, or the upper triangle otherwise
+        size_t statsSize = diagonalCovariance
+            ? numdimensions : numdimensions * (numdimensions + 1) / 2;
+
+        auto accumulateScatter = [&] (ClusterStats & stats, size_t i)
+            {
+                thread_local std::vector<double> diff;
+                diff.resize(numdimensions);
+
+                for (int c = 0;  c < nbClusters;  ++c) {
+                    double w = distanceMatrix[i][c];
+                    if (w == 0 || clusters[c].totalWeight <= 0.000001f)
+                        continue;
+                    SIMD::vec_minus(points[i].data(),
+                                    clusters[c].centroid.data(),
+                                    diff.data(), numdimensions);
+                    double * out = &stats.sums[c * statsSize];
+                    if (diagonalCovariance) {
+                        for (int j = 0;  j < numdimensions;  ++j)
+                            out[j] += w * diff[j] * diff[j];
+                    }
+                    else {
+                        for (int j = 0;  j < numdimensions;  ++j) {
+                            double wj = w * diff[j];
+                            SIMD::vec_add(out, wj, diff.data() + j, out,
+                                          numdimensions - j);
+                            out += numdimensions - j;
+                        }
+                    }
                 }
-        }
-	     
+            };
+
+        ClusterStats scatter
+            = MLDB::parallelReduce(0, npoints,
+                                   ClusterStats(nbClusters, statsSize),
+                                   accumulateScatter, combine, grain);
+
         //calculate covariant matrix
-        for (int i = 0; i < clusters.size(); ++i) {
-            clusters[i].covarianceMatrix
-                = EstimateCovariance(i, points, distanceMatrix,
-                                     clusters[i].totalWeight,
-                                     clusters[i].centroid);
-            ExcAssertEqual(clusters[i].covarianceMatrix.shape()[0],
-                           clusters[i].covarianceMatrix.shape()[1]);
-
-            auto svdMatrix = clusters[i].covarianceMatrix;
-            MatrixType VT,U;
-            distribution<double> svalues;
-            ML::svd_square(svdMatrix, VT, U, svalues);
-
-            //Remove small values and calculate pseudo determinant
-            double pseudoDeterminant = 1.0f;
-            auto invertSingularValues = svalues;
-            for (int i = 0; i < svalues.size(); ++i) {
-
-                if (svalues[i] < 0.0001f) {
-                    svalues[i] = 0.0f;
-                    invertSingularValues[i] = 0.0f;
+        auto updateCluster = [&] (size_t c)
+            {
+                auto & cluster = clusters[c];
+                DensityFactor & factor = factors[c];
+                factor.centroid = cluster.centroid;
+                factor.diagonal = diagonalCovariance;
+
+                MatrixType & cov = cluster.covarianceMatrix;
+                if (cluster.totalWeight < 0.000001f) {
+                    // No members; nothing can be calculated
+                    cov.resize(boost::extents[0][0]);
+                    cluster.invertCovarianceMatrix.resize(boost::extents[0][0]);
+                    cluster.pseudoDeterminant = 1.0;
+                    factor.rank = 0;
+                    factor.factor.clear();
+                    factor.logNormalizer = -INFINITY;
+                    return;
+                }
+
+                cov.resize(boost::extents[numdimensions][numdimensions]);
+                const double * sums = &scatter.sums[c * statsSize];
+                if (diagonalCovariance) {
+                    for (int i = 0;  i < numdimensions;  ++i)
+                        for (int j = 0;  j < numdimensions;  ++j)
+                            cov[i][j] = i == j
+                                ? sums[i] / cluster.totalWeight : 0.0;
                 }
                 else {
-                    pseudoDeterminant *= svalues[i];
-                    invertSingularValues[i] = 1.0f / svalues[i];
+                    for (int i = 0;  i < numdimensions;  ++i) {
+                        for (int j = i;  j < numdimensions;  ++j) {
+                            cov[i][j] = cov[j][i]
+                                = *sums++ / cluster.totalWeight;
+                        }
+                    }
                 }
-            }
 
-            // calculate pseudo inverse and pseudo determinant
+                //Remove small values and calculate pseudo determinant
+                double pseudoDeterminant = 1.0f;
+                MatrixType & invert = cluster.invertCovarianceMatrix;
+
+                if (diagonalCovariance) {
+                    invert.resize(boost::extents[numdimensions][numdimensions]);
+                    std::fill(invert.data(), invert.data() + invert.num_elements(),
+                              0.0);
+                    factor.factor.assign(numdimensions, 0.0);
+                    for (int i = 0;  i < numdimensions;  ++i) {
+                        double variance = cov[i][i];
+                        if (variance < MIN_SINGULAR_VALUE)
+                            continue;
+                        pseudoDeterminant *= variance;
+                        invert[i][i] = 1.0 / variance;
+                        factor.factor[i] = 1.0 / sqrt(variance);
+                    }
+                }
+                else {
+                    auto svdMatrix = cov;
+                    MatrixType VT,U;
+                    distribution<double> svalues;
+                    ML::svd_square(svdMatrix, VT, U, svalues);
+
+                    auto invertSingularValues = svalues;
+                    factor.factor.clear();
+                    factor.rank = 0;
+                    for (int i = 0; i < svalues.size(); ++i) {
+                        if (svalues[i] < MIN_SINGULAR_VALUE) {
+                            svalues[i] = 0.0f;
+                            invertSingularValues[i] = 0.0f;
+                            continue;
+                        }
+                        pseudoDeterminant *= svalues[i];
+                        invertSingularValues[i] = 1.0f / svalues[i];
+
+                        double scale = 1.0 / sqrt(svalues[i]);
+                        for (int j = 0;  j < numdimensions;  ++j)
+                            factor.factor.push_back(VT[i][j] * scale);
+                        ++factor.rank;
+                    }
+
+                    // calculate pseudo inverse and pseudo determinant
+
+                    // We dont actually need the pseudo covariant but it sould look
+                    // like this
+                    // MatrixType pseudoCovariant = U * diag(svalues) * VT;
+                    invert = transpose(VT) * diag(invertSingularValues)
+                        * transpose(U);
+                }
 
-            // We dont actually need the pseudo covariant but it sould look
-            // like this
-            // MatrixType pseudoCovariant = U * diag(svalues) * VT;
-            
-            clusters[i].invertCovarianceMatrix
-                = transpose(VT) * diag(invertSingularValues) * transpose(U);
-            clusters[i].pseudoDeterminant = pseudoDeterminant;
-        }
+                cluster.pseudoDeterminant = pseudoDeterminant;
+                factor.logNormalizer
+                    = -0.5 * (numdimensions * log(2.0 * M_PI)
+                              + log(pseudoDeterminant));
+            };
+
+        MLDB::parallelMap(0, nbClusters, updateCluster);
     }
 }
 
@@ -285,45 +476,26 @@ assign(const distribution<double> & point,
     if (clusters.size() == 0)
         throw MLDB::Exception("Did you train your em?");
 
-    distribution<double> distances(clusters.size());
+    distribution<double> logDensities(clusters.size());
     for (int i=0; i < clusters.size(); ++i) {
-        distances[i]
-            = gaussianDistance(point, clusters[i].centroid,
-                               clusters[i].covarianceMatrix,
-                               clusters[i].invertCovarianceMatrix,
-                               clusters[i].pseudoDeterminant);
+        const Cluster & c = clusters[i];
+        // A cluster that never had any members can't be assigned to
+        logDensities[i]
+            = c.invertCovarianceMatrix.num_elements() == 0
+            ? -INFINITY
+            : logGaussianDensity(point, c.centroid,
+                                 c.invertCovarianceMatrix,
+                                 c.pseudoDeterminant);
     }
 
-    double distMin = 0;
-    int best_cluster = -1;
-    double totalWeight = 0.0f;
-
-    for (int i=0; i < clusters.size(); ++i) {
-
-        double distance = distances[i];
-
-        if (pIndex >= 0) {
-            totalWeight += distance;
-            distanceMatrix[pIndex][i] = distance;
-        }	    
-        
-        if (distances[i] > distMin) {
-            distMin = distances[i];
-            best_cluster = i;
-        }
-    }
+    int best_cluster = responsibilities(logDensities.data(), clusters.size());
 
-    if (pIndex >= 0 && totalWeight > 0) {
+    if (pIndex >= 0) {
         for (int i=0; i < clusters.size(); ++i) {
-            distanceMatrix[pIndex][i] /= totalWeight;
+            distanceMatrix[pIndex][i] = logDensities[i];
         }
     }
 
-    // Most likely these are points with all distance at 0, often during the
-    // first iteration
-    if (best_cluster == -1)
-        best_cluster = 0;
-    
     return best_cluster;
 }
 
@@ -27,12 +27,19 @@ struct EstimationMaximisation
     std::vector<Cluster> clusters;
     std::vector<MLDB::Utf8String> columnNames;
 
+    /** Fit a mixture of nbClusters Gaussians to the points.  The E step
+        and the sufficient statistics are computed in parallel over the
+        points.  With diagonalCovariance, only the variance of each
+        dimension is estimated, which is much cheaper and needs far fewer
+        points in high dimensions.
+    */
     void
     train(const std::vector<distribution<double>> & points,
           std::vector<int> & in_cluster,
           int nbClusters,
           int maxIterations,
-          int randomSeed); 
+          int randomSeed,
+          bool diagonalCovariance = false);
 
     int
     assign(const distribution<double> & point,
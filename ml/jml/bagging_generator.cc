@@ -237,6 +237,13 @@ generate(Thread_Context & context,
 
     bool local_thread_only = true;  //(num_bags > num_threads() * 2);
 
+    /* Build the sorted feature index once, up front.  The bags are just
+       weight vectors over the same training data, so they all share it
+       read-only (filtered copies are derived from it without sorting
+       again), rather than all but one waiting while the first bag to get
+       there builds it. */
+    training_data.index();
+
     vector<std::shared_ptr<Classifier_Impl> > results(num_bags);
     vector<Thread_Context> contexts(num_bags);
     for (unsigned i = 0;  i < num_bags;  ++i)
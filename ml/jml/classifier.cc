@@ -543,6 +543,37 @@ predict(int label,
     return optimized_predict_impl(label, fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * features,
+              size_t numRows,
+              size_t rowStride,
+              const Optimization_Info & info,
+              float * output) const
+{
+    int nl = label_count();
+
+    if (!predict_is_optimized() || !info) {
+        for (size_t i = 0;  i < numRows;  ++i) {
+            Dense_Feature_Set fset(make_unowned_sp(info.to_features),
+                                   features + i * rowStride);
+            Label_Dist result = predict(fset);
+            std::copy(result.begin(), result.end(), output + i * nl);
+        }
+        return;
+    }
+
+    float fv[info.features_out()];
+    double accum[nl];
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        info.apply(features + i * rowStride, fv);
+        std::fill(accum, accum + nl, 0.0);
+        optimized_predict_impl(fv, info, accum, 1.0);
+        std::copy(accum, accum + nl, output + i * nl);
+    }
+}
+
 bool
 Classifier_Impl::
 optimize_impl(Optimization_Info & info)
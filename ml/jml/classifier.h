@@ -360,6 +360,23 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Predict all labels for numRows dense feature vectors at once.  The
+        first row starts at features and each row is rowStride floats after
+        the previous one; each is in the order of info.from_features as for
+        predict(const float *, info).  The label_count() outputs of each row
+        are written one row after the other to output.
+
+        The default calls the accumulating optimized_predict_impl() for each
+        row from a stack buffer, which doesn't allocate memory for the
+        classifiers that override it.  Classifiers that can do better over a
+        whole batch override this.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t numRows,
+                               size_t rowStride,
+                               const Optimization_Info & info,
+                               float * output) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
@@ -0,0 +1,384 @@
+/* compiled_tree_ensemble.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Flattened form of a tree ensemble, for fast prediction.
+*/
+
+#include "compiled_tree_ensemble.h"
+#include "decision_tree.h"
+#include "committee.h"
+#include "mldb/jml/utils/file_functions.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED_TREE_ENSEMBLE                                                    */
+/*****************************************************************************/
+
+constexpr int Compiled_Tree_Ensemble::BATCH_SIZE;
+constexpr int32_t Compiled_Tree_Ensemble::NULL_LEAF;
+constexpr int32_t Compiled_Tree_Ensemble::INVALID;
+
+namespace {
+
+/** Header of a file written by save().  Each of the arrays is at the given
+    offset from the start of the file, which is a multiple of ALIGNMENT.
+*/
+struct File_Header {
+    char magic[8];
+    uint32_t byte_order;    ///< BYTE_ORDER_MARK, as written by this machine
+    uint32_t version;
+    uint32_t node_size;     ///< sizeof(Node), to check the layout
+    uint32_t tree_size;     ///< sizeof(Tree)
+    int32_t nl;
+    int32_t unused;
+    uint64_t num_features;  ///< Of three int32 each
+    uint64_t num_nodes;
+    uint64_t num_leaves;    ///< Of nl floats each
+    uint64_t num_trees;
+    uint64_t features_offset;
+    uint64_t nodes_offset;
+    uint64_t leaves_offset;
+    uint64_t trees_offset;
+    uint64_t bias_offset;   ///< nl doubles
+    uint64_t file_size;
+};
+
+const char MAGIC[8] = { 'J', 'M', 'L', 'C', 'T', 'E', 'N', 'S' };
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr uint32_t VERSION = 1;
+constexpr uint64_t ALIGNMENT = 64;
+
+uint64_t align(uint64_t offset)
+{
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+} // file scope
+
+Compiled_Tree_Ensemble::
+Compiled_Tree_Ensemble(int nl)
+    : nl(nl), leaves(nl, 0.0), bias(nl, 0.0),
+      node_data(nullptr), num_nodes(0), leaf_data(nullptr), num_leaves(0),
+      tree_data(nullptr), num_trees(0), bias_data(nullptr)
+{
+}
+
+void
+Compiled_Tree_Ensemble::
+use_own_arrays()
+{
+    node_data = nodes.data();
+    num_nodes = nodes.size();
+    leaf_data = leaves.data();
+    num_leaves = leaves.size() / nl;
+    tree_data = trees.data();
+    num_trees = trees.size();
+    bias_data = bias.data();
+}
+
+std::shared_ptr<Compiled_Tree_Ensemble>
+Compiled_Tree_Ensemble::
+compile(const Classifier_Impl & classifier,
+        const std::vector<Feature> & features)
+{
+    std::map<Feature, int> featureIndexes;
+    for (unsigned i = 0;  i < features.size();  ++i)
+        featureIndexes.insert({ features[i], i });
+
+    std::shared_ptr<Compiled_Tree_Ensemble> result
+        (new Compiled_Tree_Ensemble(classifier.label_count()));
+
+    if (!result->add(classifier, 1.0, featureIndexes))
+        return nullptr;
+
+    result->features = features;
+    result->use_own_arrays();
+    return result;
+}
+
+void
+Compiled_Tree_Ensemble::
+save(const std::string & filename) const
+{
+    File_Header header;
+    memset(&header, 0, sizeof(header));
+    std::copy(MAGIC, MAGIC + 8, header.magic);
+    header.byte_order = BYTE_ORDER_MARK;
+    header.version = VERSION;
+    header.node_size = sizeof(Node);
+    header.tree_size = sizeof(Tree);
+    header.nl = nl;
+    header.num_features = features.size();
+    header.num_nodes = num_nodes;
+    header.num_leaves = num_leaves;
+    header.num_trees = num_trees;
+
+    header.features_offset = align(sizeof(header));
+    header.nodes_offset
+        = align(header.features_offset + features.size() * 3 * sizeof(int32_t));
+    header.leaves_offset = align(header.nodes_offset + num_nodes * sizeof(Node));
+    header.trees_offset
+        = align(header.leaves_offset + num_leaves * nl * sizeof(float));
+    header.bias_offset = align(header.trees_offset + num_trees * sizeof(Tree));
+    header.file_size = header.bias_offset + nl * sizeof(double);
+
+    std::vector<int32_t> featureArgs;
+    for (const Feature & f: features)
+        featureArgs.insert(featureArgs.end(), f.args_, f.args_ + 3);
+
+    MLDB::filter_ostream stream(filename);
+    uint64_t written = 0;
+
+    auto write = [&] (uint64_t offset, const void * data, size_t length)
+        {
+            static const char padding[ALIGNMENT] = { 0 };
+            ExcAssertLessEqual(written, offset);
+            stream.write(padding, offset - written);
+            stream.write((const char *)data, length);
+            written = offset + length;
+        };
+
+    write(0, &header, sizeof(header));
+    write(header.features_offset, featureArgs.data(),
+          featureArgs.size() * sizeof(int32_t));
+    write(header.nodes_offset, node_data, num_nodes * sizeof(Node));
+    write(header.leaves_offset, leaf_data, num_leaves * nl * sizeof(float));
+    write(header.trees_offset, tree_data, num_trees * sizeof(Tree));
+    write(header.bias_offset, bias_data, nl * sizeof(double));
+
+    stream.close();
+}
+
+std::shared_ptr<Compiled_Tree_Ensemble>
+Compiled_Tree_Ensemble::
+map(const std::string & filename,
+    const std::vector<Feature> & features)
+{
+    File_Read_Buffer buffer(filename);
+    const char * start = buffer.start();
+
+    auto error = [&] (const std::string & what)
+        {
+            throw MLDB::Exception("Compiled tree ensemble file " + filename
+                                  + " " + what);
+        };
+
+    File_Header header;
+    if (buffer.size() < sizeof(header))
+        error("is too short");
+    memcpy(&header, start, sizeof(header));
+
+    if (!std::equal(MAGIC, MAGIC + 8, header.magic))
+        error("isn't a compiled tree ensemble");
+    if (header.byte_order != BYTE_ORDER_MARK)
+        error("was written on a machine with a different byte order");
+    if (header.version != VERSION || header.node_size != sizeof(Node)
+        || header.tree_size != sizeof(Tree))
+        error("has an unknown version or layout");
+    if (header.file_size > buffer.size() || header.nl <= 0)
+        error("is truncated or corrupt");
+
+    // Check that we're predicting from the same features
+    const int32_t * featureArgs
+        = (const int32_t *)(start + header.features_offset);
+    if (header.num_features != features.size())
+        return nullptr;
+    for (unsigned i = 0;  i < features.size();  ++i) {
+        if (!std::equal(features[i].args_, features[i].args_ + 3,
+                        featureArgs + i * 3))
+            return nullptr;
+    }
+
+    std::shared_ptr<Compiled_Tree_Ensemble> result
+        (new Compiled_Tree_Ensemble(header.nl));
+    result->features = features;
+    result->node_data = (const Node *)(start + header.nodes_offset);
+    result->num_nodes = header.num_nodes;
+    result->leaf_data = (const float *)(start + header.leaves_offset);
+    result->num_leaves = header.num_leaves;
+    result->tree_data = (const Tree *)(start + header.trees_offset);
+    result->num_trees = header.num_trees;
+    result->bias_data = (const double *)(start + header.bias_offset);
+    result->mapping = buffer.region;
+
+    // Prediction follows the children without checking them, so make sure
+    // that they all refer to something in the file
+    auto validChild = [&] (int32_t child)
+        {
+            return child >= 0 ? child < (int64_t)result->num_nodes
+                : ~child < (int64_t)result->num_leaves;
+        };
+
+    for (size_t i = 0;  i < result->num_nodes;  ++i) {
+        const Node & node = result->node_data[i];
+        if (node.feature < 0 || node.feature >= (int64_t)features.size())
+            error("has a node with an invalid feature");
+        for (int32_t child: node.children) {
+            if (!validChild(child))
+                error("has a node with an invalid child");
+        }
+    }
+    for (size_t i = 0;  i < result->num_trees;  ++i) {
+        if (!validChild(result->tree_data[i].root))
+            error("has a tree with an invalid root");
+    }
+
+    return result;
+}
+
+bool
+Compiled_Tree_Ensemble::
+add(const Classifier_Impl & classifier, double weight,
+    const std::map<Feature, int> & featureIndexes)
+{
+    if (classifier.label_count() != nl)
+        return false;
+
+    if (auto committee = dynamic_cast<const Committee *>(&classifier)) {
+        for (unsigned i = 0;  i < nl && i < committee->bias.size();  ++i)
+            bias[i] += weight * committee->bias[i];
+
+        for (unsigned i = 0;  i < committee->classifiers.size();  ++i) {
+            if (committee->weights[i] == 0.0)
+                continue;
+            if (!add(*committee->classifiers[i],
+                     weight * committee->weights[i],
+                     featureIndexes))
+                return false;
+        }
+
+        return true;
+    }
+
+    if (auto tree = dynamic_cast<const Decision_Tree *>(&classifier)) {
+        int32_t root = add_tree(tree->tree.root, featureIndexes);
+        if (root == INVALID)
+            return false;
+        trees.push_back({ root, weight });
+        return true;
+    }
+
+    return false;
+}
+
+int32_t
+Compiled_Tree_Ensemble::
+add_tree(const ML::Tree::Ptr & ptr,
+         const std::map<Feature, int> & featureIndexes)
+{
+    if (!ptr)
+        return NULL_LEAF;
+
+    if (!ptr.node()) {
+        const distribution<float> & pred = ptr.leaf()->pred;
+        int32_t leaf = leaves.size() / nl;
+        leaves.resize(leaves.size() + nl, 0.0);
+        std::copy(pred.begin(), pred.begin() + std::min<size_t>(nl, pred.size()),
+                  leaves.begin() + leaf * nl);
+        return ~leaf;
+    }
+
+    const ML::Tree::Node & node = *ptr.node();
+
+    auto it = featureIndexes.find(node.split.feature());
+    if (it == featureIndexes.end())
+        return INVALID;
+
+    // Parent goes before its children, and the true side right after it
+    int32_t result = nodes.size();
+    nodes.emplace_back();
+    nodes[result].split_val = node.split.split_val();
+    nodes[result].feature = it->second;
+    nodes[result].op_mask = 1 << node.split.op();
+
+    const ML::Tree::Ptr * children[3]
+        = { &node.child_false, &node.child_true, &node.child_missing };
+    int32_t childNodes[3];
+    childNodes[1] = add_tree(*children[1], featureIndexes);
+    childNodes[0] = add_tree(*children[0], featureIndexes);
+    childNodes[2] = add_tree(*children[2], featureIndexes);
+
+    for (unsigned i = 0;  i < 3;  ++i) {
+        if (childNodes[i] == INVALID)
+            return INVALID;
+        nodes[result].children[i] = childNodes[i];
+    }
+
+    return result;
+}
+
+Label_Dist
+Compiled_Tree_Ensemble::
+predict(const float * features) const
+{
+    double accum[nl];
+    std::copy(bias_data, bias_data + nl, accum);
+
+    for (size_t t = 0;  t < num_trees;  ++t) {
+        const Tree & tree = tree_data[t];
+        const float * leaf = leaf_data + find_leaf(tree.root, features) * nl;
+        for (unsigned i = 0;  i < nl;  ++i)
+            accum[i] += leaf[i] * tree.weight;
+    }
+
+    return Label_Dist(accum, accum + nl);
+}
+
+void
+Compiled_Tree_Ensemble::
+predict(const float * features, size_t numRows, size_t rowStride,
+        float * output) const
+{
+    double accum[BATCH_SIZE * nl];
+    int32_t current[BATCH_SIZE];
+
+    for (size_t first = 0;  first < numRows;  first += BATCH_SIZE) {
+        int n = std::min<size_t>(BATCH_SIZE, numRows - first);
+        const float * rows = features + first * rowStride;
+
+        for (int r = 0;  r < n;  ++r)
+            std::copy(bias_data, bias_data + nl, accum + r * nl);
+
+        for (size_t t = 0;  t < num_trees;  ++t) {
+            const Tree & tree = tree_data[t];
+            std::fill(current, current + n, tree.root);
+
+            // Take all rows down one level at a time until they have all
+            // reached a leaf.  The rows are independent, so the loads and
+            // comparisons for the different rows can overlap.
+            for (bool more = tree.root >= 0;  more;) {
+                more = false;
+                for (int r = 0;  r < n;  ++r) {
+                    int32_t node = current[r];
+                    if (node < 0)
+                        continue;
+                    const Node & nd = node_data[node];
+                    node = nd.children[side(nd, rows[r * rowStride + nd.feature])];
+                    current[r] = node;
+                    more |= node >= 0;
+                }
+            }
+
+            for (int r = 0;  r < n;  ++r) {
+                const float * leaf = leaf_data + ~current[r] * nl;
+                double * out = accum + r * nl;
+                for (unsigned i = 0;  i < nl;  ++i)
+                    out[i] += leaf[i] * tree.weight;
+            }
+        }
+
+        std::copy(accum, accum + n * nl, output + first * nl);
+    }
+}
+
+} // namespace ML
@@ -0,0 +1,168 @@
+/* compiled_tree_ensemble.h                                        -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Flattened form of a tree ensemble, for fast prediction.
+*/
+
+#pragma once
+
+#include "classifier.h"
+#include "tree.h"
+#include <map>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED_TREE_ENSEMBLE                                                    */
+/*****************************************************************************/
+
+/** A decision tree, or a committee (boosting, bagging, random forest,
+    gbdt) of decision trees and committees, compiled into a form that is
+    only good for prediction from dense features.
+
+    All of the nodes of all of the trees are in a single contiguous array
+    of small fixed-size records, with each tree laid out depth first,
+    and the leaves are in another.  Predicting walks the arrays, with a
+    branch-free comparison at each node, instead of chasing the pointers
+    of the Tree and going through a Feature_Set.  The committee weights
+    are folded into the trees and the biases summed up front.
+
+    The batch form of predict() takes a block of rows down each tree
+    together, so that the tree's nodes are read from cache for all but
+    the first row, and the comparisons for the rows of the block are
+    independent of each other.
+
+    Since the arrays are flat, they can be saved to a file as they are
+    (see save()), and map() will use them in place from a memory mapping
+    of that file.  Loading is then just the mapping, and the pages are
+    shared by all of the processes serving the same model.
+*/
+
+struct Compiled_Tree_Ensemble {
+
+    /** Compile the given classifier for dense feature vectors whose
+        values are for the given features, in order.  Returns a null
+        pointer if the classifier isn't made of only decision trees and
+        committees, or it uses features that aren't in the list.
+    */
+    static std::shared_ptr<Compiled_Tree_Ensemble>
+    compile(const Classifier_Impl & classifier,
+            const std::vector<Feature> & features);
+
+    /** Save the ensemble, along with the features it was compiled for,
+        in a file whose arrays are aligned so that map() can use them in
+        place.  The file is only readable on machines with the same byte
+        order.
+    */
+    void save(const std::string & filename) const;
+
+    /** Map a file written by save() into memory, and return the ensemble
+        that it contains.  Nothing is copied; only the pages that are used
+        are read, and they are shared with any other process that maps
+        the same file.  Returns a null pointer if the ensemble was compiled
+        for different features.  Throws if the file isn't one written by
+        save().
+    */
+    static std::shared_ptr<Compiled_Tree_Ensemble>
+    map(const std::string & filename,
+        const std::vector<Feature> & features);
+
+    /** Number of labels in the output. */
+    int label_count() const { return nl; }
+
+    /** Number of trees in the ensemble. */
+    size_t tree_count() const { return num_trees; }
+
+    /** Predict for a single row.  Returns the same as the classifier's
+        predict(), up to rounding. */
+    Label_Dist predict(const float * features) const;
+
+    /** Predict for numRows rows, the first of which starts at features
+        and each of which is rowStride floats after the previous one.
+        The output (label_count() floats per row) is written to output.
+    */
+    void predict(const float * features, size_t numRows, size_t rowStride,
+                 float * output) const;
+
+    /** Number of rows that are taken down a tree together. */
+    static constexpr int BATCH_SIZE = 32;
+
+    /** A node of a tree.  Children are the index of a node if positive,
+        or the one's complement of the index of a leaf otherwise.
+    */
+    struct Node {
+        float split_val;
+        int32_t feature;        ///< Index of the feature to test
+        uint8_t op_mask;        ///< Bit set for which of less, equal is true
+        int32_t children[3];    ///< false, true and missing
+    };
+
+    /** A tree, with the output weight of its leaves. */
+    struct Tree {
+        int32_t root;
+        double weight;
+    };
+
+private:
+    Compiled_Tree_Ensemble(int nl);
+
+    int nl;
+    std::vector<Feature> features;    ///< Features compiled for
+
+    // Filled in by compile(); empty if mapped from a file
+    std::vector<Node> nodes;
+    std::vector<float> leaves;        ///< nl floats per leaf
+    std::vector<Tree> trees;
+    std::vector<double> bias;
+
+    // Where prediction reads the arrays from, either the vectors above or
+    // the mapping of a file
+    const Node * node_data;
+    size_t num_nodes;
+    const float * leaf_data;
+    size_t num_leaves;
+    const Tree * tree_data;
+    size_t num_trees;
+    const double * bias_data;
+
+    /// Keeps the mapped file alive
+    std::shared_ptr<const void> mapping;
+
+    /// Point the arrays used for prediction at the vectors
+    void use_own_arrays();
+
+    /// Index of leaf that contributes nothing, for null children
+    static constexpr int32_t NULL_LEAF = ~0;
+
+    /// Returned when the classifier can't be compiled
+    static constexpr int32_t INVALID = INT32_MIN;
+
+    bool add(const Classifier_Impl & classifier, double weight,
+             const std::map<Feature, int> & featureIndexes);
+
+    int32_t add_tree(const ML::Tree::Ptr & ptr,
+                     const std::map<Feature, int> & featureIndexes);
+
+    /// Which child of node to go to for the given feature value
+    static int side(const Node & node, float value)
+    {
+        int all = (value < node.split_val)
+            | ((value == node.split_val) << 1)
+            | 4;
+        return value != value ? 2 : ((all & node.op_mask) != 0);
+    }
+
+    /// Leaf that the row lands in, starting from the given node
+    int32_t find_leaf(int32_t node, const float * features) const
+    {
+        while (node >= 0) {
+            const Node & n = node_data[node];
+            node = n.children[side(n, features[n.feature])];
+        }
+        return ~node;
+    }
+};
+
+} // namespace ML
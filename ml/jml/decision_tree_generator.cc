@@ -21,6 +21,7 @@
 #include "binary_symmetric.h"
 #include "mldb/jml/utils/smart_ptr_utils.h"
 #include "mldb/base/thread_pool.h"
+#include "mldb/base/parallel.h"
 
 #include <random>
 #include <mutex>
@@ -43,6 +44,10 @@ static constexpr int COMPACT_SPARSENESS_RATIO=8;
 /// we compact the dataset.
 static constexpr float COMPACT_INITIAL_DENSITY=0.5;
 
+/// Nodes with at least this many examples train their branches in
+/// parallel
+static constexpr double PARALLEL_BRANCH_EXAMPLES=4096;
+
 
 
 /// Glue code to allow the templated version of compactDataset to find
@@ -798,8 +803,7 @@ struct TreeTrainer {
                    const distribution<float> & new_in_class,
                    double total_in_class,
                    int new_depth, int max_depth,
-                   Tree & tree,
-                   MLDB::ThreadPool & tp) const
+                   Tree & tree) const
     {
 #if 0
         if (total_in_class > 1024) {
@@ -1056,24 +1060,38 @@ struct TreeTrainer {
         node->examples = total_weight;
         node->pred = leaf.pred;
 
-        MLDB::ThreadPool tp;
-        
-        do_branch(node->child_true,
-                  context, data, weights, binary_weights, advance, features,
-                  class_true, total_true, depth + 1, max_depth,
-                  tree, tp);
-
-        do_branch(node->child_false,
-                  context, data, weights, binary_weights, advance, features,
-                  class_false, total_false, depth + 1, max_depth,
-                  tree, tp);
-    
-        do_branch(node->child_missing,
-                  context, data, weights, binary_weights, advance, features,
-                  class_missing, total_missing, depth + 1, max_depth,
-                  tree, tp);
-
-        tp.waitForAll();
+        Tree::Ptr * branch_ptrs[3] = {
+            &node->child_true, &node->child_false, &node->child_missing };
+        const distribution<float> * branch_in_class[3] = {
+            &class_true, &class_false, &class_missing };
+        double branch_totals[3] = { total_true, total_false, total_missing };
+
+        if (total_weight >= PARALLEL_BRANCH_EXAMPLES) {
+            // Big enough to be worth training the branches at once.  This
+            // nests inside whatever is running the tree (eg the bags of a
+            // bagging generator), as it goes through the same thread pool.
+            vector<Thread_Context> contexts;
+            for (unsigned i = 0;  i < 3;  ++i)
+                contexts.push_back(context.child());
+
+            auto onBranch = [&] (size_t i)
+                {
+                    do_branch(*branch_ptrs[i],
+                              contexts[i], data, weights, binary_weights,
+                              advance, features,
+                              *branch_in_class[i], branch_totals[i],
+                              depth + 1, max_depth, tree);
+                };
+
+            MLDB::parallelMap(0, 3, onBranch);
+        }
+        else {
+            for (unsigned i = 0;  i < 3;  ++i)
+                do_branch(*branch_ptrs[i],
+                          context, data, weights, binary_weights, advance,
+                          features, *branch_in_class[i], branch_totals[i],
+                          depth + 1, max_depth, tree);
+        }
         
         return node;
     }
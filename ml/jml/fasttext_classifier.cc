@@ -8,6 +8,8 @@
 #include <boost/progress.hpp>
 #include <boost/timer.hpp>
 #include <functional>
+#include <memory>
+#include <algorithm>
 #include "mldb/jml/utils/vector_utils.h"
 #include "mldb/ml/jml/registry.h"
 
@@ -64,6 +66,8 @@ swap(FastTest_Classifier & other)
     std::swap(fastText_, other.fastText_);
     std::swap(features, other.features);
     std::swap(featureMap, other.featureMap);    
+    std::swap(optimizedIndexes, other.optimizedIndexes);
+    std::swap(optimized, other.optimized);
 }
 
 float
@@ -75,6 +79,33 @@ predict(int label, const Feature_Set & infeatures,
     return results[label];
 }
 
+void
+FastTest_Classifier::
+predictWords(const std::vector<int32_t> & words, float * output) const
+{
+    int nl = label_count();
+    std::fill(output, output + nl, 0.0f);
+    if (words.empty())
+        return;
+
+    // Reused from call to call, so that there is no allocation once a
+    // thread has seen a model of this size
+    static thread_local std::unique_ptr<fasttext::Vector> hidden, scores;
+    static thread_local std::vector<std::pair<fasttext::real,int32_t>>
+        modelPredictions;
+
+    int dims = fastText_->args_->dim;
+    if (!hidden || hidden->m_ != dims)
+        hidden.reset(new fasttext::Vector(dims));
+    if (!scores || scores->m_ != nl)
+        scores.reset(new fasttext::Vector(nl));
+
+    modelPredictions.clear();
+    fastText_->model_->predict(words, nl, modelPredictions, *hidden, *scores);
+    for (auto & p: modelPredictions)
+        output[p.second] = p.first;
+}
+
 Label_Dist
 FastTest_Classifier::
 predict(const Feature_Set & infeatures,
@@ -85,7 +116,8 @@ predict(const Feature_Set & infeatures,
     Label_Dist results;
     results.resize(label_count());   
 
-    std::vector<int32_t> words;
+    static thread_local std::vector<int32_t> words;
+    words.clear();
   
     for (const auto& feature : infeatures) {
         auto it = featureMap.find(feature.first);
@@ -96,17 +128,81 @@ predict(const Feature_Set & infeatures,
         }
     }
 
-    if (!words.empty()) {
-        fasttext::Vector hidden(fastText_->args_->dim);
-        fasttext::Vector output(label_count());
-        std::vector<std::pair<fasttext::real,int32_t>> modelPredictions;
-        fastText_->model_->predict(words, label_count(), modelPredictions, hidden, output);
-        for (auto it = modelPredictions.cbegin(); it != modelPredictions.cend(); it++) {
-            results[it->second] = it->first;
+    predictWords(words, &results[0]);
+
+    return results;
+}
+
+void
+FastTest_Classifier::
+predict_batch(const float * features,
+              size_t numRows,
+              size_t rowStride,
+              const Optimization_Info & info,
+              float * output) const
+{
+    if (!optimized || !info) {
+        Classifier_Impl::predict_batch(features, numRows, rowStride,
+                                       info, output);
+        return;
+    }
+
+    ExcAssert(fastText_);
+    ExcAssert(fastText_->model_);
+
+    int nl = label_count();
+
+    static thread_local std::vector<float> mapped;
+    static thread_local std::vector<int32_t> words;
+    mapped.resize(info.features_out());
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        info.apply(features + i * rowStride, mapped.data());
+
+        words.clear();
+        for (size_t f = 0;  f < optimizedIndexes.size();  ++f) {
+            float count = mapped[optimizedIndexes[f]];
+            // Missing values are NaN, which is never positive
+            for (int j = 0;  j < count;  ++j)
+                words.push_back(f);
         }
+
+        predictWords(words, output + i * nl);
     }
+}
 
-    return results;
+Label_Dist
+FastTest_Classifier::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    Label_Dist result(label_count());
+    predict_batch(features, 1, info.features_in(), info, &result[0]);
+    return result;
+}
+
+void
+FastTest_Classifier::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       double * accum,
+                       double weight,
+                       PredictionContext * context) const
+{
+    Label_Dist result = optimized_predict_impl(features, info, context);
+    for (unsigned l = 0;  l < result.size();  ++l)
+        accum[l] += weight * result[l];
+}
+
+float
+FastTest_Classifier::
+optimized_predict_impl(int label,
+                       const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    return optimized_predict_impl(features, info, context).at(label);
 }
 
 Explanation 
@@ -153,21 +249,30 @@ bool
 FastTest_Classifier::
 optimization_supported() const
 {
-    return false;
+    return true;
 }
 
 bool
 FastTest_Classifier::
 predict_is_optimized() const
 {
-    return false;
+    return optimized;
 }
 
 bool
 FastTest_Classifier::
 optimize_impl(Optimization_Info & info)
 {
-    return false;
+    optimizedIndexes.clear();
+
+    for (auto & f: features) {
+        auto it = info.feature_to_optimized_index.find(f);
+        if (it == info.feature_to_optimized_index.end())
+            throw Exception("FastTest_Classifier::optimize(): feature not found");
+        optimizedIndexes.push_back(it->second);
+    }
+
+    return optimized = true;
 }
 
 std::string
@@ -68,7 +68,35 @@ public:
     */
     virtual bool
     optimize_impl(Optimization_Info & info);
-    
+
+    /** Predict a batch of dense rows, whose values are the number of times
+        that each feature occurs.  The buffers used by the model are reused
+        from row to row and call to call on each thread.
+    */
+    virtual void predict_batch(const float * features,
+                               size_t numRows,
+                               size_t rowStride,
+                               const Optimization_Info & info,
+                               float * output) const;
+
+    virtual Label_Dist
+    optimized_predict_impl(const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_impl(const float * features,
+                           const Optimization_Info & info,
+                           double * accum,
+                           double weight = 1.0,
+                           PredictionContext * context = 0) const;
+
+    virtual float
+    optimized_predict_impl(int label,
+                           const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
 
     virtual std::string print() const;
 
@@ -101,6 +129,17 @@ public:
     //I suspect either some compiler const optimization 
     //*or* a bug in the judy array const overload but I haven't found the root cause yet.
     mutable Feature_Map<size_t> featureMap;
+
+    /// Once optimized, the index in the dense vector of each of features
+    std::vector<int> optimizedIndexes;
+    bool optimized = false;
+
+private:
+    /** Run the model over the given words, and write the score of each
+        label into output.
+    */
+    void predictWords(const std::vector<int32_t> & words,
+                      float * output) const;
 };
 
 
@@ -21,6 +21,8 @@
 
 #include <random>
 #include <mutex>
+#include <memory>
+#include <algorithm>
 
 
 using namespace std;
@@ -141,7 +143,7 @@ FastText_Generator::
     }
 
     args_->model = fasttext::model_name::sup;
-    args_->thread = training_data.example_count() < numCpus() ? 1 : numCpus();
+    args_->thread = 1;  // the work is split into jobs below instead
     args_->bucket = 0;
     args_->dim = dims;
     args_->epoch = epoch;
@@ -158,26 +160,59 @@ FastText_Generator::
 
     //Note that we skip Fasttext's dictionary because the strings are already abstracted in our features  
 
+    // Each epoch is split into blocks of examples, which are jobs on the
+    // thread pool, so that training runs on as many threads as the
+    // current resource group allows and gives them back between blocks.
+    // As with fastText's own threads, the jobs update the shared matrices
+    // without locking.  A model holds the buffers and sampling tables for
+    // one job at a time; there are only as many as ran at once.
+    std::mutex modelsMutex;
+    std::vector<std::unique_ptr<fasttext::Model> > freeModels;
+    int numModels = 0;
+
+    auto getModel = [&] () -> std::unique_ptr<fasttext::Model>
+        {
+            std::unique_lock<std::mutex> guard(modelsMutex);
+            if (!freeModels.empty()) {
+                auto result = std::move(freeModels.back());
+                freeModels.pop_back();
+                return result;
+            }
+            int seed = numModels++;
+            guard.unlock();
+
+            std::unique_ptr<fasttext::Model> result
+                (new fasttext::Model(input_, output_, args_, seed));
+            result->setTargetCounts(labelCount);
+            return result;
+        };
+
+    auto putModel = [&] (std::unique_ptr<fasttext::Model> model)
+        {
+            std::unique_lock<std::mutex> guard(modelsMutex);
+            freeModels.emplace_back(std::move(model));
+        };
+
+    size_t numExamples = training_data.example_count();
+    size_t blockSize = parallelGrainSize(numExamples, 64);
+    size_t numBlocks = (numExamples + blockSize - 1) / blockSize;
+
     std::atomic<int64_t> tokenCount(0);
-    auto trainThread = [&] (size_t threadId) {
+    auto trainBlock = [&] (size_t block) {
 
-      int32_t start = threadId * training_data.example_count() / args_->thread;
+      std::unique_ptr<fasttext::Model> model = getModel();
 
-      fasttext::Model model(input_, output_, args_, threadId);
-      model.setTargetCounts(labelCount);
-    
       int64_t localTokenCount = 0;
-      std::vector<int32_t> line, labels;
-      while (tokenCount < args_->epoch * ntokens) {
+      static thread_local std::vector<int32_t> line, labels;
 
-        //if we reach the end we wrap around
-        if (start >= training_data.example_count())
-            start = 0;
+      size_t end = std::min(numExamples, (block + 1) * blockSize);
+      for (size_t ex = block * blockSize;  ex < end;  ++ex) {
 
-        fasttext::real progress = fasttext::real(tokenCount) / (args_->epoch * ntokens);
+        fasttext::real progress = std::min<fasttext::real>
+            (1.0, fasttext::real(tokenCount) / (args_->epoch * ntokens));
         fasttext::real lr = args_->lr * (1.0 - progress);
 
-        const Feature_Set & lineFeatureSet = training_data[start];
+        const Feature_Set & lineFeatureSet = training_data[ex];
         auto it = lineFeatureSet.begin();
         auto itEnd = lineFeatureSet.end();
 
@@ -197,34 +232,41 @@ FastText_Generator::
                         line.push_back(f);        
                 }
             }
-            localTokenCount++;
             ++it;
         }       
 
-        start++;        
+        localTokenCount += line.size();
         if (labels.size() != 0 && line.size() > 0) {
 
             //This for future multicategorical support
             std::uniform_int_distribution<> uniform(0, labels.size() - 1);
-            int32_t i = uniform(model.rng); 
-            model.update(line, labels[i], lr);
+            int32_t i = uniform(model->rng); 
+            model->update(line, labels[i], lr);
         }
      
         if (localTokenCount > args_->lrUpdateRate) {
             tokenCount += localTokenCount;
             localTokenCount = 0;
-            if (threadId == 0 && args_->verbose > 1) {
-                fastTextModel.printInfo(progress, model.getLoss());
-            }
         }
       }
-      if (threadId == 0 && args_->verbose > 0) {
-        fastTextModel.printInfo(1.0, model.getLoss());
-        std::cout << std::endl;
-      }
+
+      tokenCount += localTokenCount;
+      putModel(std::move(model));
     };
 
-    parallelMap(0, args_->thread, trainThread);
+    for (int e = 0;  e < args_->epoch;  ++e) {
+        parallelMap(0, numBlocks, trainBlock);
+
+        if (args_->verbose > 1 && !freeModels.empty()) {
+            fastTextModel.printInfo(fasttext::real(e + 1) / args_->epoch,
+                                    freeModels[0]->getLoss());
+        }
+    }
+
+    if (args_->verbose > 0 && !freeModels.empty()) {
+        fastTextModel.printInfo(1.0, freeModels[0]->getLoss());
+        std::cout << std::endl;
+    }
 
     //for prediction
     fastTextModel.model_ = std::make_shared<fasttext::Model>(fastTextModel.input_, fastTextModel.output_, fastTextModel.args_, 0);
@@ -0,0 +1,719 @@
+/* gbdt_generator.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Generator for histogram-based gradient boosted decision trees.
+*/
+
+#include "gbdt_generator.h"
+#include "committee.h"
+#include "training_data.h"
+#include "training_index.h"
+#include "mldb/ml/jml/registry.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/format.h"
+#include <boost/timer.hpp>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+namespace {
+
+/// Below this number of (example, feature) pairs, the work on a node is
+/// done in the calling thread as it's not worth farming out
+static constexpr size_t MIN_PARALLEL_WORK = 1 << 16;
+
+/// Smallest hessian we allow, so that confident examples still count
+static constexpr double MIN_HESSIAN = 1e-16;
+
+/// Sum of the gradients and hessians over a set of examples
+struct GradPair {
+    double g = 0.0;
+    double h = 0.0;
+
+    GradPair & operator += (const GradPair & other)
+    {
+        g += other.g;
+        h += other.h;
+        return *this;
+    }
+
+    GradPair & operator -= (const GradPair & other)
+    {
+        g -= other.g;
+        h -= other.h;
+        return *this;
+    }
+};
+
+GradPair operator - (GradPair p1, const GradPair & p2)
+{
+    return p1 -= p2;
+}
+
+/** The training data, bucketized feature by feature.  Bin numbers for a
+    feature are stored contiguously so that the histograms are built by
+    streaming through memory.  For feature f, there are splits[f].size()
+    + 1 bins for values, and bin number splits[f].size() is for the
+    examples where the feature is missing.
+*/
+struct Binned_Data {
+    size_t nx = 0;
+    size_t nf = 0;
+    std::vector<uint8_t> bins;                ///< nf x nx bin numbers
+    std::vector<std::vector<float> > splits;  ///< per feature split points
+    std::vector<size_t> offsets;              ///< histogram offset per feature
+    size_t histogramSize = 0;
+
+    const uint8_t * column(size_t f) const { return bins.data() + f * nx; }
+    int missingBin(size_t f) const { return splits[f].size(); }
+};
+
+/** Return a split point that is strictly greater than lower and no
+    greater than upper, so that "value < split" separates the two. */
+float splitBetween(float lower, float upper)
+{
+    float result = lower + 0.5f * (upper - lower);
+    if (!(result > lower) || result > upper)
+        result = upper;
+    return result;
+}
+
+/** Choose the split points of a feature from its values, so that each of
+    the (at most maxBins) bins has about the same number of examples. */
+std::vector<float>
+findSplits(std::vector<float> & values, int maxBins)
+{
+    std::sort(values.begin(), values.end());
+
+    // Distinct values and their counts
+    std::vector<std::pair<float, size_t> > distinct;
+    for (float v: values) {
+        if (distinct.empty() || distinct.back().first != v)
+            distinct.emplace_back(v, 0);
+        ++distinct.back().second;
+    }
+
+    std::vector<float> result;
+
+    if (distinct.size() <= (size_t)maxBins) {
+        for (size_t i = 1;  i < distinct.size();  ++i)
+            result.push_back(splitBetween(distinct[i - 1].first,
+                                          distinct[i].first));
+        return result;
+    }
+
+    double perBin = 1.0 * values.size() / maxBins;
+    double next = perBin;
+    size_t cumulative = 0;
+    for (size_t i = 0;  i + 1 < distinct.size()
+             && result.size() + 1 < (size_t)maxBins;  ++i) {
+        cumulative += distinct[i].second;
+        if (cumulative < next)
+            continue;
+        result.push_back(splitBetween(distinct[i].first,
+                                      distinct[i + 1].first));
+        while (next <= cumulative)
+            next += perBin;
+    }
+
+    return result;
+}
+
+Binned_Data
+bucketize(const Training_Data & data,
+          const std::vector<Feature> & features,
+          const Feature & predicted,
+          int maxBins)
+{
+    Binned_Data result;
+    result.nx = data.example_count();
+    result.nf = features.size();
+
+    size_t nx = result.nx, nf = result.nf;
+
+    std::vector<std::pair<Feature, int> > featureNums;
+    for (size_t f = 0;  f < nf;  ++f)
+        featureNums.emplace_back(features[f], f);
+    std::sort(featureNums.begin(), featureNums.end());
+
+    // Extract the values into a dense matrix; only the first value of a
+    // feature in each example is used
+    std::vector<float> values(nx * nf, NAN);
+
+    auto extractExamples = [&] (size_t first, size_t last)
+        {
+            for (size_t x = first;  x < last;  ++x) {
+                const Feature_Set & fset = data[x];
+                for (auto it = fset.begin(), end = fset.end();
+                     it != end;  ++it) {
+                    std::pair<Feature, float> fv = *it;
+                    if (fv.first == predicted)
+                        continue;
+                    auto found
+                        = std::lower_bound(featureNums.begin(), featureNums.end(),
+                                           std::make_pair(fv.first, -1));
+                    if (found == featureNums.end() || found->first != fv.first)
+                        continue;
+                    float & val = values[found->second * nx + x];
+                    if (std::isnan(val))
+                        val = fv.second;
+                }
+            }
+        };
+
+    parallelMapChunked(0, nx, parallelGrainSize(nx, 1024), extractExamples);
+
+    result.bins.resize(nx * nf);
+    result.splits.resize(nf);
+
+    auto bucketizeFeature = [&] (size_t f)
+        {
+            const float * column = values.data() + f * nx;
+
+            std::vector<float> present;
+            for (size_t x = 0;  x < nx;  ++x)
+                if (!std::isnan(column[x]))
+                    present.push_back(column[x]);
+
+            std::vector<float> & splits = result.splits[f];
+            splits = findSplits(present, maxBins);
+
+            uint8_t * bins = result.bins.data() + f * nx;
+            for (size_t x = 0;  x < nx;  ++x) {
+                if (std::isnan(column[x]))
+                    bins[x] = splits.size();
+                else bins[x] = std::upper_bound(splits.begin(), splits.end(),
+                                                column[x])
+                         - splits.begin();
+            }
+        };
+
+    parallelMap(0, nf, bucketizeFeature);
+
+    for (size_t f = 0;  f < nf;  ++f) {
+        result.offsets.push_back(result.histogramSize);
+        result.histogramSize += result.splits[f].size() + 2;
+    }
+
+    return result;
+}
+
+/// Run the function for each feature, in parallel if there is enough work
+void forEachFeature(size_t nf, size_t workPerFeature,
+                    const std::function<void (size_t)> & doFeature)
+{
+    if (workPerFeature * nf < MIN_PARALLEL_WORK) {
+        for (size_t f = 0;  f < nf;  ++f)
+            doFeature(f);
+    }
+    else parallelMap(0, nf, doFeature);
+}
+
+/// Node of a tree being grown.  Leaves have a feature of -1.
+struct Grow_Node {
+    int feature = -1;
+    int bin = -1;              ///< Examples in bins <= this one go left
+    int children[3] = { -1, -1, -1 };  ///< true, false and missing
+    double value = 0.0;        ///< Value of the node, before the learning rate
+    double examples = 0.0;
+    double gain = 0.0;
+};
+
+/** Grows a single tree from the gradients of a set of examples. */
+struct Tree_Grower {
+    Tree_Grower(const GBDT_Generator & generator,
+                const Binned_Data & data,
+                const std::vector<GradPair> & grads)
+        : generator(generator), data(data), grads(grads)
+    {
+    }
+
+    const GBDT_Generator & generator;
+    const Binned_Data & data;
+    const std::vector<GradPair> & grads;
+    std::vector<Grow_Node> nodes;
+
+    double score(const GradPair & p) const
+    {
+        return p.g * p.g / (p.h + generator.lambda);
+    }
+
+    std::vector<GradPair> buildHistogram(const std::vector<int> & rows) const
+    {
+        std::vector<GradPair> result(data.histogramSize);
+
+        auto doFeature = [&] (size_t f)
+            {
+                GradPair * hist = result.data() + data.offsets[f];
+                const uint8_t * bins = data.column(f);
+                for (int x: rows)
+                    hist[bins[x]] += grads[x];
+            };
+
+        forEachFeature(data.nf, rows.size(), doFeature);
+
+        return result;
+    }
+
+    /// Grow the node for the given examples, returning its index
+    int grow(std::vector<int> rows, std::vector<GradPair> hist, int depth)
+    {
+        GradPair total;
+        if (data.nf > 0) {
+            for (int b = 0;  b <= data.missingBin(0);  ++b)
+                total += hist[b];
+        }
+        else {
+            for (int x: rows)
+                total += grads[x];
+        }
+
+        int result = nodes.size();
+        nodes.emplace_back();
+        nodes[result].value = -total.g / (total.h + generator.lambda);
+        nodes[result].examples = rows.size();
+
+        if (depth >= generator.max_depth
+            || total.h < 2 * generator.min_child_weight)
+            return result;
+
+        // Find the best split of each feature
+        std::vector<std::pair<double, int> > best(data.nf, { 0.0, -1 });
+        double parentScore = score(total);
+
+        auto doFeature = [&] (size_t f)
+            {
+                const GradPair * fhist = hist.data() + data.offsets[f];
+                int missing = data.missingBin(f);
+                GradPair present = total - fhist[missing];
+                double missingScore = score(fhist[missing]);
+
+                GradPair left;
+                for (int b = 0;  b + 1 < missing;  ++b) {
+                    left += fhist[b];
+                    GradPair right = present - left;
+                    if (left.h < generator.min_child_weight || left.h <= 0.0)
+                        continue;
+                    if (right.h < generator.min_child_weight || right.h <= 0.0)
+                        break;
+                    double gain = score(left) + score(right) + missingScore
+                        - parentScore;
+                    if (gain > best[f].first)
+                        best[f] = { gain, b };
+                }
+            };
+
+        forEachFeature(data.nf, data.histogramSize / std::max<size_t>(data.nf, 1),
+                       doFeature);
+
+        int feature = -1;
+        for (size_t f = 0;  f < data.nf;  ++f) {
+            if (best[f].second != -1
+                && (feature == -1 || best[f].first > best[feature].first))
+                feature = f;
+        }
+
+        if (feature == -1)
+            return result;
+
+        int bin = best[feature].second;
+        int missing = data.missingBin(feature);
+
+        // Partition the examples
+        std::vector<int> partitions[3];
+        const uint8_t * bins = data.column(feature);
+        for (int x: rows) {
+            int b = bins[x];
+            partitions[b == missing ? 2 : (b <= bin ? 0 : 1)].push_back(x);
+        }
+
+        rows.clear();
+        rows.shrink_to_fit();
+
+        // Histogram of the largest partition is obtained by subtraction
+        int largest = 0;
+        for (int i = 1;  i < 3;  ++i)
+            if (partitions[i].size() > partitions[largest].size())
+                largest = i;
+
+        std::vector<GradPair> hists[3];
+        for (int i = 0;  i < 3;  ++i) {
+            if (i == largest || partitions[i].empty())
+                continue;
+            hists[i] = buildHistogram(partitions[i]);
+            for (size_t j = 0;  j < data.histogramSize;  ++j)
+                hist[j] -= hists[i][j];
+        }
+        hists[largest] = std::move(hist);
+
+        nodes[result].feature = feature;
+        nodes[result].bin = bin;
+        nodes[result].gain = best[feature].first;
+
+        for (int i = 0;  i < 3;  ++i) {
+            int child;
+            if (partitions[i].empty()) {
+                // Examples with nowhere to go get the parent's value
+                child = nodes.size();
+                nodes.emplace_back();
+                nodes[child].value = nodes[result].value;
+            }
+            else child = grow(std::move(partitions[i]), std::move(hists[i]),
+                              depth + 1);
+            nodes[result].children[i] = child;
+        }
+
+        return result;
+    }
+
+    /// Value of the leaf that the example ends up in
+    double predict(size_t x) const
+    {
+        const Grow_Node * node = &nodes[0];
+        while (node->feature != -1) {
+            int b = data.column(node->feature)[x];
+            int child = b == data.missingBin(node->feature)
+                ? 2 : (b <= node->bin ? 0 : 1);
+            node = &nodes[node->children[child]];
+        }
+        return node->value;
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* GBDT_GENERATOR                                                            */
+/*****************************************************************************/
+
+GBDT_Generator::
+GBDT_Generator()
+{
+    defaults();
+}
+
+GBDT_Generator::~GBDT_Generator()
+{
+}
+
+void
+GBDT_Generator::
+configure(const Configuration & config, vector<string> & unparsedKeys)
+{
+    Classifier_Generator::configure(config, unparsedKeys);
+
+    config.findAndRemove(max_iter, "max_iter", unparsedKeys);
+    config.findAndRemove(learning_rate, "learning_rate", unparsedKeys);
+    config.findAndRemove(max_depth, "max_depth", unparsedKeys);
+    config.findAndRemove(max_bins, "max_bins", unparsedKeys);
+    config.findAndRemove(min_child_weight, "min_child_weight", unparsedKeys);
+    config.findAndRemove(lambda, "lambda", unparsedKeys);
+    config.findAndRemove(top_rate, "top_rate", unparsedKeys);
+    config.findAndRemove(other_rate, "other_rate", unparsedKeys);
+}
+
+void
+GBDT_Generator::
+defaults()
+{
+    Classifier_Generator::defaults();
+    max_iter = 100;
+    learning_rate = 0.1;
+    max_depth = 6;
+    max_bins = 255;
+    min_child_weight = 1.0;
+    lambda = 1.0;
+    top_rate = 1.0;
+    other_rate = 0.0;
+}
+
+Config_Options
+GBDT_Generator::
+options() const
+{
+    Config_Options result = Classifier_Generator::options();
+    result
+        .add("max_iter", max_iter, "1+",
+             "number of boosting iterations")
+        .add("learning_rate", learning_rate, "0.0-1.0",
+             "shrinkage applied to the output of each tree")
+        .add("max_depth", max_depth, "1+",
+             "maximum depth of the trees")
+        .add("max_bins", max_bins, "2-255",
+             "maximum number of histogram bins for each feature")
+        .add("min_child_weight", min_child_weight, "0.0-",
+             "minimum sum of the hessians of the examples in a child")
+        .add("lambda", lambda, "0.0-",
+             "L2 regularization of the leaf values")
+        .add("top_rate", top_rate, "0.0-1.0",
+             "proportion of the examples with the largest gradients that "
+             "are kept for each iteration (gradient-based one-side sampling)")
+        .add("other_rate", other_rate, "0.0-1.0",
+             "proportion of the examples sampled from the rest for each "
+             "iteration; one-side sampling is only done when top_rate + "
+             "other_rate < 1");
+
+    return result;
+}
+
+void
+GBDT_Generator::
+init(std::shared_ptr<const Feature_Space> fs, Feature predicted)
+{
+    Classifier_Generator::init(fs, predicted);
+    model = Decision_Tree(fs, predicted);
+}
+
+std::shared_ptr<Classifier_Impl>
+GBDT_Generator::
+generate(Thread_Context & context,
+         const Training_Data & training_data,
+         const distribution<float> & weights,
+         const std::vector<Feature> & features,
+         int) const
+{
+    boost::timer timer;
+
+    Feature predicted = model.predicted();
+    int nl = model.label_count();
+    size_t nx = training_data.example_count();
+
+    bool regression = feature_space->info(predicted).type() == REAL;
+
+    /* Binary problems need a single margin, others one per label. */
+    int nk = (regression || nl == 2) ? 1 : nl;
+
+    if (max_depth < 1)
+        throw Exception("GBDT_Generator: max_depth must be at least 1");
+    if (max_bins < 2 || max_bins > 255)
+        throw Exception("GBDT_Generator: max_bins must be between 2 and 255");
+
+    Binned_Data data = bucketize(training_data, features, predicted,
+                                 max_bins);
+
+    if (verbosity > 0)
+        cerr << "gbdt: bucketized " << data.nf << " features in "
+             << timer.elapsed() << "s" << endl;
+
+    const std::vector<Label> & labels = training_data.index().labels(predicted);
+
+    /* Normalize the weights to have a mean of one, so that
+       min_child_weight is in units of examples. */
+    double totalWeight = weights.total();
+    if (totalWeight <= 0.0)
+        throw Exception("GBDT_Generator: no weight in the training data");
+    std::vector<float> exampleWeights(nx);
+    for (size_t x = 0;  x < nx;  ++x)
+        exampleWeights[x] = weights[x] * nx / totalWeight;
+
+    /* Initial scores from the label distribution */
+    distribution<float> bias(nl, 0.0);
+    std::vector<double> initial(nk, 0.0);
+    if (regression) {
+        double total = 0.0;
+        for (size_t x = 0;  x < nx;  ++x)
+            total += exampleWeights[x] * labels[x].value();
+        initial[0] = bias[0] = total / nx;
+    }
+    else {
+        std::vector<double> freqs(nl, 1e-6);
+        for (size_t x = 0;  x < nx;  ++x)
+            freqs[labels[x]] += exampleWeights[x];
+        if (nk == 1) {
+            initial[0] = 0.5 * std::log(freqs[1] / freqs[0]);
+            bias[1] = initial[0];
+            bias[0] = -initial[0];
+        }
+        else {
+            for (int k = 0;  k < nk;  ++k)
+                initial[k] = bias[k] = std::log(freqs[k] / nx);
+        }
+    }
+
+    std::vector<double> scores(nx * nk);
+    for (size_t x = 0;  x < nx;  ++x)
+        std::copy(initial.begin(), initial.end(), scores.begin() + x * nk);
+
+    /* Gradients and hessians of each score of each example */
+    std::vector<GradPair> gradients(nx * nk);
+
+    auto calcGradients = [&] (size_t first, size_t last)
+        {
+            for (size_t x = first;  x < last;  ++x) {
+                const double * s = scores.data() + x * nk;
+                GradPair * g = gradients.data() + x * nk;
+                double w = exampleWeights[x];
+                if (regression) {
+                    g[0].g = w * (s[0] - labels[x].value());
+                    g[0].h = w;
+                }
+                else if (nk == 1) {
+                    // Margin of s[0] on each side means logit of 2 * s[0]
+                    double p = 1.0 / (1.0 + exp(-2.0 * s[0]));
+                    double y = labels[x] == 1;
+                    g[0].g = w * 2.0 * (p - y);
+                    g[0].h = w * std::max(4.0 * p * (1.0 - p), MIN_HESSIAN);
+                }
+                else {
+                    double maxScore = *std::max_element(s, s + nk);
+                    double total = 0.0;
+                    for (int k = 0;  k < nk;  ++k)
+                        total += exp(s[k] - maxScore);
+                    for (int k = 0;  k < nk;  ++k) {
+                        double p = exp(s[k] - maxScore) / total;
+                        double y = labels[x] == k;
+                        g[k].g = w * (p - y);
+                        g[k].h = w * std::max(p * (1.0 - p), MIN_HESSIAN);
+                    }
+                }
+            }
+        };
+
+    bool goss = top_rate + other_rate < 1.0 && other_rate > 0.0;
+    size_t grain = parallelGrainSize(nx, 1024);
+
+    auto result = std::make_shared<Committee>(feature_space, predicted);
+
+    std::vector<int> rows;
+    std::vector<float> amplification(nx, 1.0);
+    std::vector<GradPair> grads(nx);
+
+    for (int iter = 0;  iter < max_iter;  ++iter) {
+        parallelMapChunked(0, nx, grain, calcGradients);
+
+        /* Select the examples for this iteration */
+        rows.clear();
+        if (goss) {
+            std::vector<std::pair<float, int> > sizes(nx);
+            for (size_t x = 0;  x < nx;  ++x) {
+                double size = 0.0;
+                for (int k = 0;  k < nk;  ++k)
+                    size += fabs(gradients[x * nk + k].g);
+                sizes[x] = std::make_pair(-size, (int)x);
+            }
+
+            size_t numTop = std::min<size_t>(nx, ceil(top_rate * nx));
+            size_t numOther = std::min<size_t>(nx - numTop, other_rate * nx);
+
+            std::nth_element(sizes.begin(), sizes.begin() + numTop,
+                             sizes.end());
+
+            std::fill(amplification.begin(), amplification.end(), 0.0);
+            for (size_t i = 0;  i < numTop;  ++i)
+                amplification[sizes[i].second] = 1.0;
+
+            // Sample the rest without replacement, and scale them up so
+            // that the gradient sums are unbiased
+            float scale = (1.0 - top_rate) / other_rate;
+            for (size_t i = 0;  i < numOther;  ++i) {
+                size_t j = numTop + i
+                    + context.random() % (nx - numTop - i);
+                std::swap(sizes[numTop + i], sizes[j]);
+                amplification[sizes[numTop + i].second] = scale;
+            }
+
+            for (size_t x = 0;  x < nx;  ++x)
+                if (amplification[x] > 0.0)
+                    rows.push_back(x);
+        }
+        else {
+            for (size_t x = 0;  x < nx;  ++x)
+                rows.push_back(x);
+        }
+
+        for (int k = 0;  k < nk;  ++k) {
+            for (int x: rows) {
+                grads[x] = gradients[x * nk + k];
+                grads[x].g *= amplification[x];
+                grads[x].h *= amplification[x];
+            }
+
+            Tree_Grower grower(*this, data, grads);
+            grower.grow(rows, grower.buildHistogram(rows), 0 /* depth */);
+
+            /* Update the scores of all examples, sampled or not */
+            auto updateScores = [&] (size_t first, size_t last)
+                {
+                    for (size_t x = first;  x < last;  ++x)
+                        scores[x * nk + k]
+                            += learning_rate * grower.predict(x);
+                };
+            parallelMapChunked(0, nx, grain, updateScores);
+
+            /* Convert to a decision tree */
+            Decision_Tree tree = model;
+            tree.encoding = OE_PM_INF;
+
+            auto makePred = [&] (double value)
+                {
+                    distribution<float> pred(nl, 0.0);
+                    if (nk == 1 && !regression) {
+                        pred[0] = -value;
+                        pred[1] = value;
+                    }
+                    else pred[k] = value;
+                    return pred;
+                };
+
+            std::function<Tree::Ptr (int)> convert = [&] (int n) -> Tree::Ptr
+                {
+                    const Grow_Node & gnode = grower.nodes[n];
+                    if (gnode.feature == -1)
+                        return tree.tree.new_leaf(makePred(gnode.value),
+                                                  gnode.examples);
+
+                    Tree::Node * node = tree.tree.new_node();
+                    node->split = Split(features[gnode.feature],
+                                        data.splits[gnode.feature][gnode.bin],
+                                        Split::LESS);
+                    node->z = gnode.gain;
+                    node->examples = gnode.examples;
+                    node->pred = makePred(gnode.value);
+                    node->child_true = convert(gnode.children[0]);
+                    node->child_false = convert(gnode.children[1]);
+                    node->child_missing = convert(gnode.children[2]);
+                    return node;
+                };
+
+            tree.tree.root = convert(0);
+
+            result->add(std::make_shared<Decision_Tree>(std::move(tree)),
+                        learning_rate);
+        }
+
+        if (verbosity > 1) {
+            double loss = 0.0;
+            for (size_t x = 0;  x < nx;  ++x)
+                for (int k = 0;  k < nk;  ++k)
+                    loss += fabs(gradients[x * nk + k].g);
+            cerr << format("gbdt: iteration %d: mean abs gradient %.6f "
+                           "(%zd examples) at %.2fs",
+                           iter, loss / nx, rows.size(), timer.elapsed())
+                 << endl;
+        }
+    }
+
+    result->bias = bias;
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* REGISTRATION                                                              */
+/*****************************************************************************/
+
+namespace {
+
+Register_Factory<Classifier_Generator, GBDT_Generator>
+    GBDT_REGISTER("gbdt");
+
+} // file scope
+
+} // namespace ML
@@ -0,0 +1,85 @@
+/* gbdt_generator.h                                                -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Generator for histogram-based gradient boosted decision trees.
+*/
+
+#pragma once
+
+#include "classifier_generator.h"
+#include "decision_tree.h"
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* GBDT_GENERATOR                                                            */
+/*****************************************************************************/
+
+/** Generator for an ensemble of gradient boosted decision trees.
+
+    Each feature is bucketized once into at most max_bins quantile bins
+    (and a bin for missing values), after which the trees are grown from
+    histograms of the gradients over the bins rather than by sorting the
+    examples.  The histogram of the largest child of a split is obtained
+    by subtracting those of the others from the parent's, and histograms
+    are built and split points searched in parallel over the features.
+
+    Binary classification uses the logistic loss, multi-class the softmax
+    loss with one tree per label per iteration, and regression the squared
+    loss.  Gradient-based one-side sampling (GOSS) can be used to train
+    each iteration on the examples with the largest gradients plus a
+    sample of the rest.
+
+    The result is a Committee of Decision_Tree objects whose leaves hold
+    the margins.
+*/
+
+class GBDT_Generator : public Classifier_Generator {
+public:
+    GBDT_Generator();
+
+    virtual ~GBDT_Generator();
+
+    /** Configure the generator with its parameters. */
+    virtual void
+    configure(const Configuration & config,
+              std::vector<std::string> & unparsedKeys) override;
+
+    /** Return to the default configuration. */
+    virtual void defaults() override;
+
+    /** Return possible configuration options. */
+    virtual Config_Options options() const override;
+
+    /** Initialize the generator, given the feature space to be used for
+        generation. */
+    virtual void init(std::shared_ptr<const Feature_Space> fs,
+                      Feature predicted) override;
+
+    using Classifier_Generator::generate;
+
+    /** Generate a classifier from one training set. */
+    virtual std::shared_ptr<Classifier_Impl>
+    generate(Thread_Context & context,
+             const Training_Data & training_data,
+             const distribution<float> & weights,
+             const std::vector<Feature> & features,
+             int recursion) const override;
+
+    int max_iter;
+    float learning_rate;
+    int max_depth;
+    int max_bins;
+    float min_child_weight;
+    float lambda;
+    float top_rate;
+    float other_rate;
+
+    /* Once init has been called, we clone our trees from this one. */
+    Decision_Tree model;
+};
+
+
+} // namespace ML
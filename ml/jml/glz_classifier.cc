@@ -16,9 +16,11 @@
 #include "training_index.h"
 
 #include <limits>
+#include <mutex>
 #include "mldb/jml/utils/vector_utils.h"
 #include "mldb/compiler/compiler.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/arch/simd_vector.h"
 
 using namespace std;
 using namespace ML::DB;
@@ -156,10 +158,109 @@ decode(const Feature_Set & feature_set) const
     return result;
 }
 
+const GLZ_Classifier::Variable_Index &
+GLZ_Classifier::
+variable_index() const
+{
+    static std::mutex mutex;
+
+    std::shared_ptr<const Variable_Index> index
+        = std::atomic_load(&variable_index_);
+    if (index && index->num_variables == features.size())
+        return *index;
+
+    // Only one thread builds it, as it can be huge
+    std::unique_lock<std::mutex> guard(mutex);
+    index = std::atomic_load(&variable_index_);
+    if (index && index->num_variables == features.size())
+        return *index;
+
+    auto newIndex = std::make_shared<Variable_Index>();
+    newIndex->num_variables = features.size();
+    newIndex->num_value_specs = 0;
+    for (unsigned i = 0;  i < features.size();  ++i) {
+        newIndex->variables[features[i].feature].push_back(i);
+        newIndex->num_value_specs += features[i].type == Feature_Spec::VALUE;
+    }
+
+    std::atomic_store(&variable_index_,
+                      std::shared_ptr<const Variable_Index>(newIndex));
+    return *newIndex;
+}
+
+void
+GLZ_Classifier::
+decode_sparse(const Feature_Set & feature_set,
+              std::vector<std::pair<int, float> > & result) const
+{
+    const Variable_Index & index = variable_index();
+
+    result.clear();
+
+    size_t valuesFound = 0;
+    bool valueError = false;
+
+    // The feature set is sorted, so the occurrences of each feature are
+    // together.  As for extract(), only the first one is used.
+    for (auto it = feature_set.begin(), end = feature_set.end();  it != end;) {
+        const Feature & feature = it.feature();
+        float value = it.value();
+
+        int occurrences = 0;
+        do {
+            ++it;
+            ++occurrences;
+        } while (it != end && it.feature() == feature);
+
+        auto found = index.variables.find(feature);
+        if (found == index.variables.end())
+            continue;
+
+        for (int i: found->second) {
+            const Feature_Spec & spec = features[i];
+            if (spec.type == Feature_Spec::VALUE) {
+                if (occurrences != 1 || isnan(value))
+                    valueError = true;
+                else ++valuesFound;
+            }
+
+            float decoded = decode_value(value, spec);
+            if (decoded != 0.0)
+                result.emplace_back(i, decoded);
+        }
+    }
+
+    if (valueError || valuesFound != index.num_value_specs) {
+        // Let extract() find and describe the problem
+        extract(feature_set);
+        throw Exception("GLZ_Classifier::decode_sparse(): "
+                        "features are missing or repeated");
+    }
+}
+
 Label_Dist
 GLZ_Classifier::predict(const Feature_Set & features,
                         PredictionContext * context) const
 {
+    // When the model has many more variables than there are features in
+    // the set, only look at the variables that are there.
+    if (this->features.size() > 4 * features.size()) {
+        static thread_local std::vector<std::pair<int, float> > decoded;
+        decode_sparse(features, decoded);
+
+        int nl = label_count();
+        size_t nf = this->features.size();
+        Label_Dist result(nl);
+        for (unsigned l = 0;  l < nl;  ++l) {
+            double accum = 0.0;
+            for (auto & v: decoded)
+                accum += v.second * weights[l][v.first];
+            if (add_bias) accum += weights[l][nf];
+            result[l] = apply_link_inverse(accum, link);
+        }
+        return result;
+    }
+
     distribution<float> features_c = extract(features);
     Label_Dist result = predict(features_c);
     return result;
@@ -236,6 +337,52 @@ optimized_predict_impl(int label,
     return do_predict_impl(label, features_c, &feature_indexes[0]);
 }
 
+void
+GLZ_Classifier::
+predict_batch(const float * features_c,
+              size_t numRows,
+              size_t rowStride,
+              const Optimization_Info & info,
+              float * output) const
+{
+    if (!optimized_ || !info) {
+        Classifier_Impl::predict_batch(features_c, numRows, rowStride,
+                                       info, output);
+        return;
+    }
+
+    int nl = label_count();
+    size_t nf = features.size();
+
+    // Reused from call to call, so that there is no allocation once a
+    // thread has seen a model of this size
+    static thread_local std::vector<float> mapped, decoded;
+    mapped.resize(info.features_out());
+    decoded.resize(nf);
+
+    const float * labelWeights[nl];
+    double accum[nl];
+    for (unsigned l = 0;  l < nl;  ++l)
+        labelWeights[l] = &weights[l][0];
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        info.apply(features_c + i * rowStride, mapped.data());
+
+        for (unsigned j = 0;  j < nf;  ++j)
+            decoded[j] = decode_value(mapped[feature_indexes[j]], features[j]);
+
+        SIMD::vec_dotprod_dp_batch(decoded.data(), labelWeights, nl, nf,
+                                   accum);
+
+        float * out = output + i * nl;
+        for (unsigned l = 0;  l < nl;  ++l) {
+            double val = accum[l];
+            if (add_bias) val += weights[l][nf];
+            out[l] = apply_link_inverse(val, link);
+        }
+    }
+}
+
 float
 GLZ_Classifier::
 decode_value(float feat_val, const Feature_Spec & spec) const
@@ -428,6 +575,8 @@ void GLZ_Classifier::serialize(DB::Store_Writer & store) const
 void GLZ_Classifier::
 reconstitute(DB::Store_Reader & store)
 {
+    variable_index_.reset();
+
     string magic;
     compact_size_t version;
     store >> magic >> version;
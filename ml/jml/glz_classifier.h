@@ -14,6 +14,7 @@
 
 #include "mldb/ml/jml/classifier.h"
 #include "mldb/ml/algebra/irls.h"
+#include <unordered_map>
 
 
 namespace ML {
@@ -98,6 +99,14 @@ public:
     /** Turn a feature set into a decoded dense vector */
     distribution<float> decode(const Feature_Set & features) const;
 
+    /** Turn a feature set into the (variable, value) pairs of the non-zero
+        entries of decode(), in the order of the features in the set.  The
+        work is in the size of the feature set rather than the number of
+        variables, which is what makes models over millions of sparse
+        features practical.  Errors are the same as for decode(). */
+    void decode_sparse(const Feature_Set & features,
+                       std::vector<std::pair<int, float> > & result) const;
+
     using Classifier_Impl::predict;
 
     /** Predict the score for all classes. */
@@ -150,6 +159,14 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    /** Batch predict, which decodes each row into a per-thread buffer and
+        takes the dot products with the weights of all labels at once. */
+    virtual void predict_batch(const float * features,
+                               size_t numRows,
+                               size_t rowStride,
+                               const Optimization_Info & info,
+                               float * output) const;
+
 #ifndef MLDB_TESTING_GLZ_CLASSIFIER
 protected:
 #endif
@@ -179,6 +196,22 @@ protected:
 
     float decode_value(float feat_val, const Feature_Spec & spec) const;
 
+    /** For each feature, the variables decoded from it.  Built on the
+        first call to decode_sparse(). */
+    struct Variable_Index {
+        struct Hash {
+            size_t operator () (const Feature & f) const { return f.hash(); }
+        };
+
+        std::unordered_map<Feature, std::vector<int>, Hash> variables;
+        size_t num_variables;      ///< Size of features when built
+        size_t num_value_specs;    ///< Number of VALUE variables
+    };
+
+    mutable std::shared_ptr<const Variable_Index> variable_index_;
+
+    const Variable_Index & variable_index() const;
+
 public:
     virtual Explanation explain(const Feature_Set & feature_set,
                                 const ML::Label & label,
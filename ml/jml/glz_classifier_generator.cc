@@ -17,6 +17,7 @@
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/ml/algebra/lapack.h"
 #include "mldb/ml/algebra/least_squares.h"
+#include "mldb/ml/algebra/sparse_glz.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parallel.h"
 #include "mldb/jml/utils/string_functions.h"
@@ -57,6 +58,7 @@ configure(const Configuration & config, vector<string> & unparsedKeys)
     config.findAndRemove(max_regularization_iteration, "max_regularization_iteration", unparsedKeys);
     config.findAndRemove(regularization_epsilon, "regularization_epsilon", unparsedKeys);
     config.findAndRemove(feature_proportion, "feature_proportion", unparsedKeys);
+    config.findAndRemove(solver, "solver", unparsedKeys);
 }
 
 void
@@ -74,6 +76,7 @@ defaults()
     max_regularization_iteration = 1000;
     regularization_epsilon = 1e-4;
     feature_proportion = 1.0;
+    solver = GLZ_SOLVER_IRLS;
 }
 
 Config_Options
@@ -110,7 +113,15 @@ options() const
              " stability (but much slower training)")
         .add("feature_proportion", feature_proportion, "0 to 1",
              "use only a (random) portion of available features when training"
-             " classifier");
+             " classifier")
+        .add("solver", solver,
+             "irls solves dense least squares problems (with all features"
+             " for all examples) and supports all options; lbfgs keeps the"
+             " features sparse and scales to millions of them, but supports"
+             " only the logit and linear link functions, a fixed"
+             " regularization factor and no normalize or condition.  For"
+             " lbfgs, max_regularization_iteration and regularization_epsilon"
+             " control the convergence");
 
     return result;
 }
@@ -292,34 +303,15 @@ train_weighted(Thread_Context & thread_context,
     /* Get the labels by example. */
     const vector<Label> & labels = data.index().labels(predicted);
     
-    // Use double precision, we have enough memory (<= 1GB)
-    // NOTE: always on due to issues with convergence
-    boost::multi_array<double, 2> dense_data(boost::extents[nv][nx2]);  // training data, dense
-        
     distribution<double> model(nx2, 0.0);  // to initialise weights, correct
     vector<distribution<double> > w(nl, model);       // weights for each label
     vector<distribution<double> > correct(nl, model); // correct values
 
-    cerr << "setup: " << t.elapsed() << endl;
-    t.restart();
-        
-    auto onIndex = [&] (int index)
+    /* Record the correct label and weights of an example. */
+    auto recordLabel = [&] (int index)
         {
             int x = indexes[index];
 
-            distribution<float> decoded = result.decode(data[x]);
-            if (add_bias) decoded.push_back(1.0);
-            
-            //cerr << "x = " << x << "  decoded = " << decoded << endl;
-            
-            /* Record the values of the variables. */
-            assert(decoded.size() == nv);
-            for (unsigned v = 0;  v < decoded.size();  ++v) {
-                if (!isfinite(decoded[v])) decoded[v] = 0.0;
-                dense_data[v][index] = decoded[v];
-            }
-            
-            /* Record the correct label. */
             if (regression_problem) {
                 correct[0][index] = labels[x].value();
                 w[0][index] = weights[x][0];
@@ -336,6 +328,77 @@ train_weighted(Thread_Context & thread_context,
                 }
             }
         };
+
+    int nlr = nl;
+    if (nl == 2) nlr = 1;
+
+    if (solver == GLZ_SOLVER_LBFGS) {
+        // The examples are decoded straight into a sparse matrix, the same
+        // representation as decode_sparse() uses for prediction, and
+        // never densified.
+        std::vector<std::vector<std::pair<int, float> > > rows(nx2);
+
+        auto onIndex = [&] (int index)
+            {
+                result.decode_sparse(data[indexes[index]], rows[index]);
+                recordLabel(index);
+            };
+
+        MLDB::parallelMap(0, indexes.size(), onIndex);
+
+        CSR_Matrix X(result.features.size());
+        for (auto & row: rows) {
+            X.add_row(row);
+            std::vector<std::pair<int, float> >().swap(row);
+        }
+
+        cerr << "marshalling: " << t.elapsed() << " for "
+             << X.nonzero_count() << " non-zeros" << endl;
+        t.restart();
+
+        result.weights.clear();
+        for (unsigned l = 0;  l < nlr;  ++l) {
+            distribution<double> trained
+                = train_sparse_glz(correct[l], X, w[l], link_function,
+                                   regularization, regularization_factor,
+                                   add_bias, max_regularization_iteration,
+                                   regularization_epsilon);
+            result.weights.push_back(trained.cast<float>());
+        }
+
+        cerr << "lbfgs: " << t.elapsed() << endl;
+
+        if (nl == 2)
+            result.weights.push_back(-1.0F * result.weights.front());
+
+        return 0.0;
+    }
+
+    // Use double precision, we have enough memory (<= 1GB)
+    // NOTE: always on due to issues with convergence
+    boost::multi_array<double, 2> dense_data(boost::extents[nv][nx2]);  // training data, dense
+        
+    cerr << "setup: " << t.elapsed() << endl;
+    t.restart();
+        
+    auto onIndex = [&] (int index)
+        {
+            int x = indexes[index];
+
+            distribution<float> decoded = result.decode(data[x]);
+            if (add_bias) decoded.push_back(1.0);
+            
+            //cerr << "x = " << x << "  decoded = " << decoded << endl;
+            
+            /* Record the values of the variables. */
+            assert(decoded.size() == nv);
+            for (unsigned v = 0;  v < decoded.size();  ++v) {
+                if (!isfinite(decoded[v])) decoded[v] = 0.0;
+                dense_data[v][index] = decoded[v];
+            }
+
+            recordLabel(index);
+        };
     
     MLDB::parallelMap(0, indexes.size(), onIndex);
 
@@ -381,9 +444,6 @@ train_weighted(Thread_Context & thread_context,
     cerr << "normalization: " << t.elapsed() << endl;
     t.restart();
 
-    int nlr = nl;
-    if (nl == 2) nlr = 1;
-        
     /* Perform a GLZ for each label. */
     result.weights.clear();
     double extra_bias = 0.0;
@@ -426,6 +486,15 @@ train_weighted(Thread_Context & thread_context,
 }
 
 
+const Enum_Opt<ML::GLZ_Solver>
+Enum_Info<ML::GLZ_Solver>::OPT[2] = {
+    { "irls",   ML::GLZ_SOLVER_IRLS  },
+    { "lbfgs",  ML::GLZ_SOLVER_LBFGS } };
+
+const char * Enum_Info<ML::GLZ_Solver>::NAME
+   = "GLZ_Solver";
+
+
 /*****************************************************************************/
 /* REGISTRATION                                                              */
 /*****************************************************************************/
@@ -19,6 +19,13 @@
 namespace ML {
 
 
+/** Algorithm used to find the weights of a GLZ. */
+enum GLZ_Solver {
+    GLZ_SOLVER_IRLS,    ///< Iteratively reweighted least squares; dense
+    GLZ_SOLVER_LBFGS    ///< L-BFGS (or OWL-QN for L1) over sparse features
+};
+
+
 /*****************************************************************************/
 /* GLZ_CLASSIFIER_GENERATOR                                                  */
 /*****************************************************************************/
@@ -71,6 +78,7 @@ public:
 
     Link_Function link_function;
     float feature_proportion;
+    GLZ_Solver solver;       ///< How do we find the weights?
 
     /* Once init has been called, we clone our potential models from this
        one. */
@@ -87,5 +95,7 @@ public:
 
 } // namespace ML
 
+DECLARE_ENUM_INFO(ML::GLZ_Solver, 2);
+
 
 #endif /* __boosting__glz_classifier_generator_h__ */
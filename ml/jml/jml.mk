@@ -47,10 +47,12 @@ LIBBOOSTING_SOURCES := \
         feature_transform.cc \
         transform_list.cc \
         committee.cc \
+        compiled_tree_ensemble.cc \
         boosting_training.cc \
         null_classifier_generator.cc \
         fasttext_classifier.cc \
         fasttext_generator.cc \
+        gbdt_generator.cc \
         onevsall.cc \
         onevsall_generator.cc \
         tree.cc \
@@ -64,7 +66,7 @@ LIBBOOSTING_SOURCES := \
         multilabel_training_data.cc
 
 
-LIBBOOSTING_LINK :=	utils db algebra arch judy boost_regex fasttext log
+LIBBOOSTING_LINK :=	utils db algebra arch base judy boost_regex fasttext log
 
 #$(eval $(call set_compile_option,perceptron_generator.cc perceptron.cc,-ffast-math))
 
@@ -0,0 +1,185 @@
+/* compiled_tree_ensemble_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that compiled tree ensembles predict the same as the classifiers
+   they were compiled from.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+
+#include "mldb/ml/jml/compiled_tree_ensemble.h"
+#include "mldb/ml/jml/gbdt_generator.h"
+#include "mldb/ml/jml/decision_tree_generator.h"
+#include "mldb/ml/jml/glz_classifier.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/arch/format.h"
+#include "mldb/vfs/filter_streams.h"
+#include <cmath>
+#include <cstdio>
+
+using namespace ML;
+using namespace std;
+
+
+static std::string makeDataset()
+{
+    std::string result = "LABEL X Y Z\n";
+    for (unsigned i = 0;  i < 500;  ++i) {
+        float x = (i % 20) / 20.0;
+        float y = (i / 20) / 25.0;
+        float z = (i * 7919) % 13;
+        int label = ((x < 0.3) != (y < 0.6)) ^ (z > 10);
+        result += format("%d %f %f %f\n", label, x, y, z);
+    }
+    return result;
+}
+
+/** Check the predictions of the compiled form against the classifier's,
+    row by row and in batches of a few sizes. */
+static void checkCompiled(const Classifier_Impl & classifier,
+                          const Dense_Training_Data & data,
+                          const vector<Feature> & features)
+{
+    auto compiled = Compiled_Tree_Ensemble::compile(classifier, features);
+    BOOST_REQUIRE(compiled);
+
+    int nl = classifier.label_count();
+    BOOST_CHECK_EQUAL(compiled->label_count(), nl);
+
+    size_t nx = data.example_count();
+    vector<float> dense(nx * features.size(), NAN);
+    for (size_t x = 0;  x < nx;  ++x) {
+        for (unsigned f = 0;  f < features.size();  ++f) {
+            dense[x * features.size() + f] = data[x][features[f]];
+        }
+    }
+
+    // Leave some values missing
+    for (size_t x = 0;  x < nx;  x += 17)
+        dense[x * features.size() + x % features.size()] = NAN;
+
+    vector<float> batch(nx * nl);
+    compiled->predict(dense.data(), nx, features.size(), batch.data());
+
+    for (size_t x = 0;  x < nx;  ++x) {
+        Dense_Feature_Set fset(make_unowned_sp(features),
+                               dense.data() + x * features.size());
+        Label_Dist expected = classifier.predict(fset);
+        Label_Dist single = compiled->predict(dense.data() + x * features.size());
+
+        BOOST_REQUIRE_EQUAL(single.size(), nl);
+        for (int l = 0;  l < nl;  ++l) {
+            BOOST_CHECK_SMALL(single[l] - expected[l], 1e-4f);
+            BOOST_CHECK_EQUAL(batch[x * nl + l], single[l]);
+        }
+    }
+
+    // Fewer rows than a batch
+    vector<float> few(3 * nl);
+    compiled->predict(dense.data(), 3, features.size(), few.data());
+    for (unsigned i = 0;  i < few.size();  ++i)
+        BOOST_CHECK_EQUAL(few[i], batch[i]);
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_tree_ensemble )
+{
+    std::string dataset = makeDataset();
+
+    Dense_Feature_Space fs;
+    Dense_Training_Data data;
+    data.init(dataset.c_str(), dataset.c_str() + dataset.size(),
+              make_unowned_sp(fs));
+    guess_all_info(data, fs, true);
+
+    Feature predicted = fs.features()[0];
+    vector<Feature> features = data.all_features();
+    features.erase(std::remove(features.begin(), features.end(), predicted),
+                   features.end());
+
+    Thread_Context context;
+    distribution<float> weights(data.example_count(), 1.0);
+
+    // Single decision tree
+    {
+        Decision_Tree_Generator generator;
+        generator.init(data.feature_space(), predicted);
+        generator.max_depth = 5;
+        auto tree = generator.generate(context, data, weights, features, 0);
+        checkCompiled(*tree, data, features);
+    }
+
+    // Committee of boosted trees, with a bias
+    {
+        GBDT_Generator generator;
+        generator.init(data.feature_space(), predicted);
+        generator.max_iter = 30;
+        generator.max_depth = 4;
+        auto gbdt = generator.generate(context, data, weights, features, 0);
+        checkCompiled(*gbdt, data, features);
+
+        // Needs all of the features it uses
+        vector<Feature> notAll(features.begin(), features.end() - 1);
+        BOOST_CHECK(!Compiled_Tree_Ensemble::compile(*gbdt, notAll));
+    }
+
+    // Saved and mapped back in
+    {
+        GBDT_Generator generator;
+        generator.init(data.feature_space(), predicted);
+        generator.max_iter = 10;
+        generator.max_depth = 3;
+        auto gbdt = generator.generate(context, data, weights, features, 0);
+        auto compiled = Compiled_Tree_Ensemble::compile(*gbdt, features);
+        BOOST_REQUIRE(compiled);
+
+        string filename = "build/x86_64/tmp/compiled_tree_ensemble_test.cte";
+        compiled->save(filename);
+        auto mapped = Compiled_Tree_Ensemble::map(filename, features);
+        BOOST_REQUIRE(mapped);
+        BOOST_CHECK_EQUAL(mapped->label_count(), compiled->label_count());
+        BOOST_CHECK_EQUAL(mapped->tree_count(), compiled->tree_count());
+
+        int nl = compiled->label_count();
+        size_t nx = data.example_count();
+        vector<float> dense(nx * features.size());
+        for (size_t x = 0;  x < nx;  ++x)
+            for (unsigned f = 0;  f < features.size();  ++f)
+                dense[x * features.size() + f] = data[x][features[f]];
+
+        vector<float> expected(nx * nl), found(nx * nl);
+        compiled->predict(dense.data(), nx, features.size(), expected.data());
+        mapped->predict(dense.data(), nx, features.size(), found.data());
+        BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                      expected.begin(), expected.end());
+
+        // Compiled for other features
+        vector<Feature> reversed(features.rbegin(), features.rend());
+        BOOST_CHECK(!Compiled_Tree_Ensemble::map(filename, reversed));
+
+        // Not a compiled ensemble
+        string other = "build/x86_64/tmp/compiled_tree_ensemble_test.txt";
+        {
+            MLDB::filter_ostream stream(other);
+            stream << string(1000, 'x');
+        }
+        BOOST_CHECK_THROW(Compiled_Tree_Ensemble::map(other, features),
+                          std::exception);
+
+        remove(filename.c_str());
+        remove(other.c_str());
+    }
+
+    // Not a tree ensemble
+    {
+        GLZ_Classifier glz(data.feature_space(), predicted);
+        BOOST_CHECK(!Compiled_Tree_Ensemble::compile(glz, features));
+    }
+}
@@ -0,0 +1,106 @@
+/* gbdt_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the histogram-based gradient boosted decision trees.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+
+#include "mldb/ml/jml/gbdt_generator.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/arch/format.h"
+
+using namespace ML;
+using namespace std;
+
+
+/* A 20x20 grid of points, with a label that is either an (unbalanced)
+   XOR of the two coordinates, or a function of them for regression.
+*/
+static std::string makeDataset(bool regression)
+{
+    std::string result = "LABEL X Y\n";
+    for (unsigned i = 0;  i < 400;  ++i) {
+        float x = (i % 20) / 20.0 + 0.025;
+        float y = (i / 20) / 20.0 + 0.025;
+        float label;
+        if (regression)
+            label = 2.0 * x + (y < 0.5 ? 0.25 : 1.5);
+        else label = (x < 0.3) != (y < 0.6);
+        result += format("%f %f %f\n", label, x, y);
+    }
+    return result;
+}
+
+static std::shared_ptr<Classifier_Impl>
+train(Dense_Training_Data & data, Dense_Feature_Space & fs,
+      const std::string & config_options)
+{
+    Configuration config;
+    config.parse_string(config_options, "inbuilt config file");
+
+    GBDT_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    BOOST_CHECK(unparsedKeys.empty());
+    generator.init(data.feature_space(), fs.features()[0]);
+
+    Thread_Context context;
+    distribution<float> weights(data.example_count(), 1.0);
+
+    vector<Feature> features = data.all_features();
+    features.erase(std::remove(features.begin(), features.end(),
+                               fs.features()[0]),
+                   features.end());
+
+    return generator.generate(context, data, weights, features, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_gbdt_classification )
+{
+    std::string dataset = makeDataset(false /* regression */);
+
+    Dense_Feature_Space fs;
+    Dense_Training_Data data;
+    data.init(dataset.c_str(), dataset.c_str() + dataset.size(),
+              make_unowned_sp(fs));
+    guess_all_info(data, fs, true);
+
+    auto classifier = train(data, fs, "max_iter=20\nmax_depth=3\n");
+
+    BOOST_CHECK_EQUAL(dynamic_cast<Committee &>(*classifier).classifiers.size(),
+                      20);
+    BOOST_CHECK_EQUAL(classifier->accuracy(data).first, 1.0);
+
+    // Gradient-based one-side sampling still learns the function
+    auto sampled = train(data, fs,
+                         "max_iter=50\nmax_depth=3\n"
+                         "top_rate=0.2\nother_rate=0.3\n");
+    BOOST_CHECK_GE(sampled->accuracy(data).first, 0.95);
+}
+
+BOOST_AUTO_TEST_CASE( test_gbdt_regression )
+{
+    std::string dataset = makeDataset(true /* regression */);
+
+    Dense_Feature_Space fs;
+    Dense_Training_Data data;
+    data.init(dataset.c_str(), dataset.c_str() + dataset.size(),
+              make_unowned_sp(fs));
+    guess_all_info(data, fs, true);
+
+    auto classifier = train(data, fs, "max_iter=100\nmax_depth=4\nmax_bins=32\n");
+
+    float rmse = classifier->accuracy(data).first;
+    cerr << "rmse = " << rmse << endl;
+    BOOST_CHECK_LT(rmse, 0.1);
+}
@@ -167,6 +167,26 @@ BOOST_AUTO_TEST_CASE( test_glz_classifier_missing )
     Optimization_Info info = classifier->optimize(fs.features());
 
     BOOST_CHECK(info);
+
+    // Batch prediction gives the same as one row at a time
+    int nf = fs.features().size();
+    int nl = classifier->label_count();
+    vector<float> rows;
+    for (unsigned i = 0;  i < 10;  ++i) {
+        rows.push_back(i % 3 == 0);
+        rows.push_back(i % 2 == 0 ? (i % 3 == 0) : NaN);
+        rows.push_back(i % 2 == 0 ? NaN : (i % 3 == 0));
+        rows.push_back(i % 5 == 0);
+    }
+
+    vector<float> batch(10 * nl);
+    classifier->predict_batch(&rows[0], 10, nf, info, &batch[0]);
+
+    for (unsigned i = 0;  i < 10;  ++i) {
+        Label_Dist single = classifier->predict(&rows[i * nf], info);
+        for (unsigned l = 0;  l < nl;  ++l)
+            BOOST_CHECK_SMALL(batch[i * nl + l] - single[l], 1e-5f);
+    }
 }
 
 BOOST_AUTO_TEST_CASE( test_glz_classifier_missing2 )
@@ -240,6 +260,86 @@ BOOST_AUTO_TEST_CASE( test_glz_classifier_missing2 )
     BOOST_CHECK(info);
 }
 
+BOOST_AUTO_TEST_CASE( test_glz_classifier_lbfgs )
+{
+    /* Same data as the missing test, but trained with the sparse solver. */
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1a", REAL);
+    fs.add_feature("feature1b", REAL);
+    fs.add_feature("feature2",  REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+    
+    float NaN = std::numeric_limits<float>::quiet_NaN();
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        distribution<float> features;
+
+        features.push_back(i % 3  == 0);
+        if (i % 2 == 0) {
+            features.push_back(i % 3  == 0);
+            features.push_back(NaN);
+        }
+        else {
+            features.push_back(NaN);
+            features.push_back(i % 3  == 0);
+        }
+        features.push_back(i % 5  == 0);
+
+        data.add_example(fs.encode(features));
+    }
+
+    Configuration config;
+    config.parse_string("verbosity=3\nsolver=lbfgs\n"
+                        "regularization_factor=1e-3\n",
+                        "inbuilt config file");
+
+    GLZ_Classifier_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    BOOST_CHECK(unparsedKeys.empty());
+    BOOST_CHECK_EQUAL(generator.solver, GLZ_SOLVER_LBFGS);
+    generator.init(fsp, fs.features()[0]);
+
+    distribution<float> training_weights(nfv, 1);
+
+    vector<Feature> features = fs.features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    Thread_Context context;
+
+    std::shared_ptr<Classifier_Impl> classifier
+        = generator.generate(context, data, training_weights, features);
+
+    float accuracy = classifier->accuracy(data).first;
+
+    cerr << "accuracy = " << accuracy << endl;
+
+    BOOST_CHECK_EQUAL(accuracy, 1);
+
+    // The sparse decoding gives the same variables as the dense one
+    const GLZ_Classifier & glz
+        = dynamic_cast<const GLZ_Classifier &>(*classifier);
+
+    vector<pair<int, float> > sparse;
+    for (unsigned i = 0;  i < 20;  ++i) {
+        distribution<float> dense = glz.decode(data[i]);
+        glz.decode_sparse(data[i], sparse);
+
+        distribution<float> fromSparse(dense.size());
+        for (auto & v: sparse) {
+            BOOST_CHECK_NE(v.second, 0.0);
+            fromSparse[v.first] = v.second;
+        }
+
+        BOOST_CHECK_EQUAL_COLLECTIONS(dense.begin(), dense.end(),
+                                      fromSparse.begin(), fromSparse.end());
+    }
+}
+
 #define do_decode(val, type)                           \
     classifier.decode_value(val, \
                             GLZ_Classifier::Feature_Spec(Feature(1),    \
@@ -545,8 +545,11 @@ const Dataset_Index & Training_Data::generate_index() const
     if (!dirty_ && index_) return *index_;
 
     //boost::timer timer;
-    index_.reset(new Dataset_Index());
-    index_->init(*this);
+    // Only publish the index once it's complete, as index() looks at it
+    // without taking the lock
+    std::shared_ptr<Dataset_Index> new_index(new Dataset_Index());
+    new_index->init(*this);
+    index_ = std::move(new_index);
     dirty_ = false;
     //cerr << "generate_index(): " << timer.elapsed() << "s for "
     //     << example_count() << " examples" << endl;
@@ -14,28 +14,161 @@
 
 namespace ML {
 
+
+/*****************************************************************************/
+/* METRICS FOR K-MEANS                                                       */
+/*****************************************************************************/
+
 void
-KMeans::
-train(const std::vector<distribution<float>> & points,
-      std::vector<int> & in_cluster,
-      int nbClusters,
-      int maxIterations,
-      int randomSeed
-      )
+KMeansMetric::
+distances(const distribution<float> & x,
+          const distribution<float> * ys,
+          size_t n, float * output) const
+{
+    for (size_t i = 0;  i < n;  ++i)
+        output[i] = distance(x, ys[i]);
+}
+
+void
+KMeansEuclideanMetric::
+distances(const distribution<float> & x,
+          const distribution<float> * ys,
+          size_t n, float * output) const
+{
+    // Reused from call to call; these are called once per point
+    static thread_local std::vector<const float *> ptrs;
+    static thread_local std::vector<double> results;
+    ptrs.resize(n);
+    results.resize(n);
+
+    for (size_t i = 0;  i < n;  ++i)
+        ptrs[i] = ys[i].data();
+
+    SIMD::vec_euclid_batch(x.data(), ptrs.data(), n, x.size(), results.data());
+
+    for (size_t i = 0;  i < n;  ++i)
+        output[i] = sqrt(results[i]);
+}
+
+
+/*****************************************************************************/
+/* KMEANS                                                                    */
+/*****************************************************************************/
+
+namespace {
+
+/** Find the closest of the n centroids to the point, returning its index
+    and setting dist to its distance and secondDist to that of the next
+    closest.  Points with only infinite or nan distances go in cluster 0,
+    as for KMeans::assign().
+*/
+int closest(const KMeansMetric & metric,
+            const distribution<float> & point,
+            const std::vector<distribution<float> > & centroids,
+            float & dist, float & secondDist)
+{
+    static thread_local std::vector<float> distances;
+    distances.resize(centroids.size());
+    metric.distances(point, centroids.data(), centroids.size(),
+                     distances.data());
+
+    int best = -1;
+    dist = secondDist = INFINITY;
+    for (unsigned i = 0;  i < centroids.size();  ++i) {
+        if (distances[i] < dist) {
+            secondDist = dist;
+            dist = distances[i];
+            best = i;
+        }
+        else if (distances[i] < secondDist)
+            secondDist = distances[i];
+    }
+
+    return best == -1 ? 0 : best;
+}
+
+std::vector<distribution<float> >
+getCentroids(const std::vector<KMeans::Cluster> & clusters)
+{
+    std::vector<distribution<float> > result;
+    result.reserve(clusters.size());
+    for (auto & c: clusters)
+        result.push_back(c.centroid);
+    return result;
+}
+
+/** Recalculate the number of members and the centroid of each cluster from
+    the assignment of the points.  A cluster without members keeps its
+    centroid.
+*/
+void updateCentroids(const KMeansMetric & metric,
+                     const std::vector<distribution<float> > & points,
+                     const std::vector<int> & in_cluster,
+                     std::vector<KMeans::Cluster> & clusters)
+{
+    for (auto & c: clusters)
+        c.nbMembers = 0;
+    for (int c: in_cluster)
+        ++clusters[c].nbMembers;
+
+    size_t dim = points[0].size();
+
+    // Each chunk of points accumulates its own copy of the centroids, which
+    // are then added together
+    std::vector<distribution<float> > init(clusters.size(),
+                                           distribution<float>(dim, 0.0));
+
+    auto accumulate = [&] (std::vector<distribution<float> > & sums,
+                           size_t i)
+        {
+            int c = in_cluster[i];
+            metric.contributeToAverage(sums[c], points[i],
+                                       1.0 / clusters[c].nbMembers);
+        };
+
+    auto combine = [] (std::vector<distribution<float> > & into,
+                       std::vector<distribution<float> > & from)
+        {
+            for (unsigned c = 0;  c < into.size();  ++c)
+                into[c] += from[c];
+        };
+
+    auto sums = MLDB::parallelReduce(0, points.size(), init,
+                                     accumulate, combine,
+                                     std::max<size_t>(4096, clusters.size()));
+
+    for (unsigned c = 0;  c < clusters.size();  ++c) {
+        // If no member, we want to leave it there
+        if (clusters[c].nbMembers > 0)
+            clusters[c].centroid = std::move(sums[c]);
+    }
+}
+
+void printIteration(int iter, int changes,
+                    const std::vector<KMeans::Cluster> & clusters)
 {
     using namespace std;
 
-    if (nbClusters < 2)
-        throw MLDB::Exception("kmeans training requires at least 2 clusters");
-    if (points.size() == 0)
-        throw MLDB::Exception("kmeans training requires at least 1 datapoint");
+    cerr << "done clustering iter " << iter
+         << ": " << changes << " changes" << endl;
 
-    mt19937 rng;
-    rng.seed(randomSeed);
+    cerr << "nb of items per cluster" << endl << "[ ";
+    for (auto & c : clusters)
+        cerr << c.nbMembers << " ";
+    cerr << "]" << endl;
+}
 
-    int npoints = points.size();
-    in_cluster.resize(npoints, -1);
-    clusters.resize(nbClusters);
+/** Choose the initial centroids as the farthest of a random sample of
+    points from those already chosen.
+*/
+void initFarthest(const KMeansMetric & metric,
+                  const std::vector<distribution<float> > & points,
+                  std::vector<KMeans::Cluster> & clusters,
+                  std::mt19937 & rng)
+{
+    using namespace std;
+
+    int nbClusters = clusters.size();
 
     // Smart initialization of the centroids
     // FIXME http://en.wikipedia.org/wiki/K-means%2B%2B#Initialization_algorithm
@@ -56,15 +189,11 @@ train(const std::vector<distribution<float>> & points,
             // For each cluster
             for (int k=0; k < i; ++k) {
 
-                float dist = metric->distance(points[randomIdx], clusters[k].centroid);
+                float dist = metric.distance(points[randomIdx], clusters[k].centroid);
 
                 if (dist < distMin) {
                     distMin = dist;
-                    // cerr << "NEW MIN" << endl;
                 }
-                // cerr << "point " << j << " norm " << points[randomIdx].two_norm() << endl;
-                // cerr << "cluster " << k << " norm " << clusters[k].centroid.two_norm() << endl;
-                // cerr << "distance " << dist << endl;
             }
             if (distMin > distMax) {
                 distMax = distMin;
@@ -76,119 +205,380 @@ train(const std::vector<distribution<float>> & points,
             bestPoint = rng() % points.size();
         }
         clusters[i].centroid = points[bestPoint];
-        // cerr << "norm of best init centroid " << clusters[i].centroid.two_norm() << endl;
     }
+}
 
+/** k-means|| initialization (Bahmani et al., "Scalable K-Means++").  A
+    few rounds each sample around 2k points with a probability that grows
+    with their distance from the candidates so far.  The candidates are
+    then weighted by the number of points closest to them, and k of them
+    are chosen by k-means++ over the weighted candidates.
+*/
+void initParallel(const KMeansMetric & metric,
+                  const std::vector<distribution<float> > & points,
+                  std::vector<KMeans::Cluster> & clusters,
+                  std::mt19937 & rng)
+{
+    static constexpr int NUM_ROUNDS = 5;
 
-    for (int iter = 0;  iter < maxIterations;  ++iter) {
+    size_t npoints = points.size();
+    size_t nbClusters = clusters.size();
+    double oversampling = 2.0 * nbClusters;
 
-        // How many have changed cluster?  Used to know when the cluster
-        // contents are stable
-        std::atomic<int> changes(0);
+    std::vector<distribution<float> > candidates;
+    candidates.push_back(points[rng() % npoints]);
 
-        // Unfortunately, std::atomic can't be copied or moved, so we need
-        // a wrapper to put it in a vector
-        struct AI: public std::atomic<int> {
-            AI(int n = 0)
-                : std::atomic<int>(n)
-            {
+    // Sampling weight of each point from its closest candidate
+    std::vector<double> cost(npoints, INFINITY);
+    std::vector<int> nearest(npoints, 0);
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    for (int round = 0;  round <= NUM_ROUNDS;  ++round) {
+        size_t firstNew = round == 0 ? 0 : candidates.size();
+
+        if (round > 0) {
+            double total = 0.0;
+            for (double c: cost)
+                total += c;
+            if (total == 0.0)
+                break;
+
+            for (size_t i = 0;  i < npoints;  ++i) {
+                if (uniform(rng) * total < oversampling * cost[i])
+                    candidates.push_back(points[i]);
             }
+            if (candidates.size() == firstNew)
+                continue;
+        }
 
-            AI & operator = (const AI & other) noexcept
+        // Only the new candidates can be closer than before
+        auto updateCost = [&] (size_t i)
             {
-                store(other.load());
-                return *this;
+                static thread_local std::vector<float> distances;
+                size_t n = candidates.size() - firstNew;
+                distances.resize(n);
+                metric.distances(points[i], candidates.data() + firstNew, n,
+                                 distances.data());
+                for (size_t j = 0;  j < n;  ++j) {
+                    double c = metric.samplingWeight(distances[j]);
+                    if (c < cost[i]) {
+                        cost[i] = c;
+                        nearest[i] = firstNew + j;
+                    }
+                }
+            };
+
+        MLDB::parallelMap(0, npoints, updateCost);
+    }
+
+    if (candidates.size() <= nbClusters) {
+        for (size_t i = 0;  i < nbClusters;  ++i) {
+            clusters[i].centroid = i < candidates.size()
+                ? candidates[i] : points[rng() % npoints];
+        }
+        return;
+    }
+
+    std::vector<double> weights(candidates.size(), 0.0);
+    for (int n: nearest)
+        weights[n] += 1.0;
+
+    // Weighted k-means++ over the candidates
+    auto sample = [&] (const std::vector<double> & w) -> size_t
+        {
+            double total = 0.0;
+            for (double x: w)
+                total += x;
+            double r = uniform(rng) * total;
+            for (size_t i = 0;  i < w.size();  ++i) {
+                r -= w[i];
+                if (r < 0.0)
+                    return i;
             }
+            return rng() % w.size();
         };
 
-        std::vector<AI> clusterNumMembers(nbClusters);
+    std::vector<double> minCost(candidates.size(), INFINITY);
+    std::vector<double> score = weights;
+
+    for (size_t c = 0;  c < nbClusters;  ++c) {
+        size_t chosen = sample(score);
+        clusters[c].centroid = candidates[chosen];
+
+        for (size_t i = 0;  i < candidates.size();  ++i) {
+            double d = metric.samplingWeight
+                (metric.distance(candidates[i], candidates[chosen]));
+            minCost[i] = std::min(minCost[i], d);
+            score[i] = weights[i] * minCost[i];
+        }
+        score[chosen] = 0.0;
+    }
+}
+
+void trainLloyd(const KMeans & kmeans,
+                const std::vector<distribution<float> > & points,
+                std::vector<int> & in_cluster,
+                std::vector<KMeans::Cluster> & clusters,
+                int maxIterations)
+{
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+
+        // How many have changed cluster?  Used to know when the cluster
+        // contents are stable
+        std::atomic<int> changes(0);
 
         auto findNewCluster = [&] (int i) {
 
-            int best_cluster = this->assign(points[i]);
+            int best_cluster = kmeans.assign(points[i]);
 
             if (best_cluster != in_cluster[i]) {
                 ++changes;
                 in_cluster[i] = best_cluster;
             }
-
-            ++clusterNumMembers[best_cluster];
         };
 
         MLDB::parallelMap(0, points.size(), findNewCluster);
 
-        for (unsigned i = 0;  i < nbClusters;  ++i)
-            clusters[i].nbMembers = clusterNumMembers[i];
+        // Calculate means
+        updateCentroids(*kmeans.metric, points, in_cluster, clusters);
 
-#if KMEANS_DEBUG
-        auto printDebug = [&] (const string & step, int iter) {
-            filter_ostream stream(MLDB::format("kmeans_debug_%i_%s.csv", iter, step));
-            stream << "x,y,group,type\n";
-
-            for (int i=0; i < clusters.size(); ++i) {
-                auto & cluster = clusters[i];
-                stream << cluster.centroid[0] << ","
-                             << cluster.centroid[1] << ","
-                             << i << ",centroid\n";
-            }
-            for (int i=0; i< npoints; ++i)
-                stream << points[i][0] << ","
-                              << points[i][1] << ","
-                              << in_cluster[i] << ",point\n";
-        };
-        printDebug("assoc", iter);
-#endif
+        printIteration(iter, changes, clusters);
 
-        // std::cerr << "\niter " << iter << std::endl;
+        if (changes == 0)
+            break;
+    }
+}
 
-        // Calculate means
-        for (auto & c : clusters)
-            // If no member, we want to leave it there
-            if (c.nbMembers > 0)
-                std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
+/** Lloyd's iterations with the bounds of Hamerly ("Making k-means even
+    faster", 2010).  Each point keeps an upper bound on the distance to
+    its centroid and a lower bound on the distance to any other, which
+    are loosened by how far the centroids move.  A point can't change
+    cluster if its upper bound is below either its lower bound or half of
+    the distance from its centroid to the closest other centroid, and
+    then nothing needs to be calculated for it.
+*/
+void trainHamerly(const KMeansMetric & metric,
+                  const std::vector<distribution<float> > & points,
+                  std::vector<int> & in_cluster,
+                  std::vector<KMeans::Cluster> & clusters,
+                  int maxIterations)
+{
+    size_t npoints = points.size();
+    int nbClusters = clusters.size();
 
-        std::vector<std::mutex> locks(clusters.size());
+    std::vector<float> upper(npoints), lower(npoints);
+    std::vector<float> moved(nbClusters, 0.0), halfClosest(nbClusters);
+    auto centroids = getCentroids(clusters);
 
-        auto addToMeanForPoint = [&] (int i) {
-            int cluster = in_cluster[i];
-            auto point = points[i];
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+
+        std::atomic<int> changes(0);
 
+        auto assignPoint = [&] (size_t i)
             {
-                // cerr << "cluster du point i " << cluster << endl;
-                std::unique_lock<std::mutex> guard(locks[cluster]);
-                // cerr << "patate pour mich" << endl;
-                metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
-            }
-        };
+                int best = closest(metric, points[i], centroids,
+                                   upper[i], lower[i]);
+                if (best != in_cluster[i]) {
+                    ++changes;
+                    in_cluster[i] = best;
+                }
+            };
 
-        MLDB::parallelMap(0, points.size(), addToMeanForPoint);
+        if (iter == 0) {
+            MLDB::parallelMap(0, npoints, assignPoint);
+        }
+        else {
+            // Half the distance from each centroid to its closest neighbour
+            auto calcHalfClosest = [&] (size_t c)
+                {
+                    static thread_local std::vector<float> distances;
+                    distances.resize(nbClusters);
+                    metric.distances(centroids[c], centroids.data(),
+                                     nbClusters, distances.data());
+                    distances[c] = INFINITY;
+                    halfClosest[c] = 0.5 * *std::min_element(distances.begin(),
+                                                             distances.end());
+                };
+
+            MLDB::parallelMap(0, nbClusters, calcHalfClosest);
+
+            // The lower bound is loosened by the most that any other
+            // centroid moved
+            int mostMoved = std::max_element(moved.begin(), moved.end())
+                - moved.begin();
+            float secondMostMoved = 0.0;
+            for (int c = 0;  c < nbClusters;  ++c)
+                if (c != mostMoved)
+                    secondMostMoved = std::max(secondMostMoved, moved[c]);
+
+            auto boundPoint = [&] (size_t i)
+                {
+                    int c = in_cluster[i];
+                    upper[i] += moved[c];
+                    lower[i] -= (c == mostMoved
+                                 ? secondMostMoved : moved[mostMoved]);
+
+                    float bound = std::max(halfClosest[c], lower[i]);
+                    if (upper[i] <= bound)
+                        return;
+
+                    // Tighten the upper bound and try again
+                    upper[i] = metric.distance(points[i], centroids[c]);
+                    if (upper[i] <= bound)
+                        return;
+
+                    assignPoint(i);
+                };
+
+            MLDB::parallelMapChunked(0, npoints, 1024,
+                                     [&] (size_t begin, size_t end)
+                                     {
+                                         for (size_t i = begin;  i < end;  ++i)
+                                             boundPoint(i);
+                                     });
+        }
 
-        // for (int i=0; i < clusters.size(); ++i) {
-            // cerr << "cluster " << i << " had " << clusters[i].nbMembers
-                 // << " members\n";
-            // cerr << "centroid " << clusters[i].centroid << endl;
-        // }
+        updateCentroids(metric, points, in_cluster, clusters);
 
-        cerr << "done clustering iter " << iter
-             << ": " << changes << " changes" << endl;
+        for (int c = 0;  c < nbClusters;  ++c) {
+            moved[c] = metric.distance(centroids[c], clusters[c].centroid);
+            centroids[c] = clusters[c].centroid;
+        }
 
-        cerr << "nb of items per cluster" << endl << "[ ";
-        for (auto & c : clusters)
-            cerr << c.nbMembers << " ";
-        cerr << "]" << endl;
+        printIteration(iter, changes, clusters);
 
         if (changes == 0)
             break;
-        else
-            for (auto & c : clusters)
-                c.nbMembers = 0;
+    }
+}
+
+/** Mini-batch k-means (Sculley, "Web-scale k-means clustering", 2010).
+    Each iteration assigns batchSize random points to their closest
+    centroid, and moves each centroid towards its points with a learning
+    rate of one over the number of points it has been given so far.
+*/
+void trainMiniBatch(const KMeansMetric & metric,
+                    const std::vector<distribution<float> > & points,
+                    std::vector<int> & in_cluster,
+                    std::vector<KMeans::Cluster> & clusters,
+                    int maxIterations,
+                    int batchSize,
+                    std::mt19937 & rng)
+{
+    if (batchSize < 1)
+        throw MLDB::Exception("kmeans mini-batch size must be at least 1");
+
+    auto centroids = getCentroids(clusters);
+    std::vector<size_t> counts(clusters.size(), 0);
+    std::vector<size_t> batch(batchSize);
+    std::vector<int> batchCluster(batchSize);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+        for (auto & b: batch)
+            b = rng() % points.size();
 
+        auto assignBatch = [&] (size_t i)
+            {
+                float dist, secondDist;
+                batchCluster[i] = closest(metric, points[batch[i]], centroids,
+                                          dist, secondDist);
+            };
+
+        MLDB::parallelMap(0, batchSize, assignBatch);
+
+        for (size_t i = 0;  i < batch.size();  ++i) {
+            int c = batchCluster[i];
+            double rate = 1.0 / ++counts[c];
+            centroids[c] *= (1.0 - rate);
+            metric.contributeToAverage(centroids[c], points[batch[i]], rate);
+        }
+    }
+
+    for (unsigned c = 0;  c < clusters.size();  ++c)
+        clusters[c].centroid = centroids[c];
+
+    auto assignPoint = [&] (size_t i)
+        {
+            float dist, secondDist;
+            in_cluster[i] = closest(metric, points[i], centroids,
+                                    dist, secondDist);
+        };
+
+    MLDB::parallelMap(0, points.size(), assignPoint);
+
+    for (auto & c: clusters)
+        c.nbMembers = 0;
+    for (int c: in_cluster)
+        ++clusters[c].nbMembers;
+
+    printIteration(maxIterations, 0 /* changes */, clusters);
+}
+
+} // file scope
+
+void
+KMeans::
+train(const std::vector<distribution<float>> & points,
+      std::vector<int> & in_cluster,
+      int nbClusters,
+      int maxIterations,
+      int randomSeed
+      )
+{
+    using namespace std;
+
+    if (nbClusters < 2)
+        throw MLDB::Exception("kmeans training requires at least 2 clusters");
+    if (points.size() == 0)
+        throw MLDB::Exception("kmeans training requires at least 1 datapoint");
+
+    mt19937 rng;
+    rng.seed(randomSeed);
+
+    int npoints = points.size();
+    in_cluster.resize(npoints, -1);
+    clusters.resize(nbClusters);
+
+    if (initialization == KMEANS_INIT_PARALLEL)
+        initParallel(*metric, points, clusters, rng);
+    else initFarthest(*metric, points, clusters, rng);
+
+    // The bounds need the triangle inequality
+    KMeansAlgorithm algo = algorithm;
+    if (algo == KMEANS_HAMERLY && !metric->isMetric())
+        algo = KMEANS_LLOYD;
+
+    switch (algo) {
+    case KMEANS_MINIBATCH:
+        trainMiniBatch(*metric, points, in_cluster, clusters, maxIterations,
+                       batchSize, rng);
+        break;
+    case KMEANS_HAMERLY:
+        trainHamerly(*metric, points, in_cluster, clusters, maxIterations);
+        break;
+    case KMEANS_LLOYD:
+        trainLloyd(*this, points, in_cluster, clusters, maxIterations);
+        break;
+    default:
+        throw MLDB::Exception("unknown kmeans algorithm");
+    }
 
 #if KMEANS_DEBUG
-        printDebug("average", iter);
-#endif
+    MLDB::filter_ostream stream("kmeans_debug.csv");
+    stream << "x,y,group,type\n";
 
+    for (int i=0; i < clusters.size(); ++i) {
+        auto & cluster = clusters[i];
+        stream << cluster.centroid[0] << ","
+               << cluster.centroid[1] << ","
+               << i << ",centroid\n";
     }
+    for (int i=0; i< npoints; ++i)
+        stream << points[i][0] << ","
+               << points[i][1] << ","
+               << in_cluster[i] << ",point\n";
+#endif
 }
 
 distribution<float>
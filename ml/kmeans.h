@@ -13,6 +13,7 @@
 #include "mldb/jml/db/persistent.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/simd_vector.h"
 #include <boost/math/special_functions/fpclassify.hpp>
 
 
@@ -41,6 +42,24 @@ public:
     virtual void contributeToAverage(distribution<float> & average,
                                      const distribution<float> & point, double weight) const = 0;
 
+    // Distance between x and each of the n points starting at ys, into
+    // output.  The default calls distance() for each of them.
+    virtual void distances(const distribution<float> & x,
+                           const distribution<float> * ys,
+                           size_t n, float * output) const;
+
+    // Does the distance satisfy the triangle inequality?  If so, the
+    // bounds that let training skip most distance calculations are valid.
+    virtual bool isMetric() const { return false; }
+
+    // Weight with which a point at the given distance from the closest
+    // centroid is sampled to become a centroid during initialization.
+    // Must be non-negative, and zero for a point that is a centroid.
+    virtual double samplingWeight(double distance) const
+    {
+        return distance * distance;
+    }
+
     // For serialization
     virtual std::string tag() const = 0;
 };
@@ -49,7 +68,14 @@ class KMeansEuclideanMetric : public KMeansMetric {
 public:
     double distance(const distribution<float> & x,
                     const distribution<float> & y) const
-    { return (x - y).two_norm(); }
+    { return sqrt(SIMD::vec_euclid(x.data(), y.data(), x.size())); }
+
+    // Uses the batched SIMD kernel
+    void distances(const distribution<float> & x,
+                   const distribution<float> * ys,
+                   size_t n, float * output) const;
+
+    bool isMetric() const { return true; }
 
     distribution<float>
     average(const std::vector<distribution<float>> & points) const
@@ -122,6 +148,12 @@ public:
             average += point/point.two_norm() * weight; 
     }
 
+    // The distance starts at -1 for identical directions
+    double samplingWeight(double distance) const
+    {
+        return std::max(0.0, 1.0 + distance);
+    }
+
     std::string tag() const { return "CosineMetric"; }
 };
 
@@ -130,10 +162,26 @@ public:
 /* KMEANS                                                                    */
 /*****************************************************************************/
 
+/** How the clusters are found. */
+enum KMeansAlgorithm {
+    KMEANS_LLOYD,       ///< Lloyd's iterations over all distances
+    KMEANS_HAMERLY,     ///< Lloyd's iterations, skipping distances by bounds
+    KMEANS_MINIBATCH    ///< Mini-batch k-means over random samples
+};
+
+/** How the initial centroids are chosen. */
+enum KMeansInitialization {
+    KMEANS_INIT_FARTHEST,   ///< Farthest of a random sample, one at a time
+    KMEANS_INIT_PARALLEL    ///< k-means|| oversampling
+};
+
 struct KMeans {
 
     KMeans(KMeansMetric * metric = new KMeansEuclideanMetric())
-        : metric(metric)
+        : metric(metric),
+          algorithm(KMEANS_LLOYD),
+          initialization(KMEANS_INIT_FARTHEST),
+          batchSize(1000)
     {
     }
 
@@ -144,7 +192,25 @@ struct KMeans {
 
     std::vector<Cluster> clusters;
     std::shared_ptr<KMeansMetric> metric;
-    
+
+    /** Algorithm used by train().  KMEANS_HAMERLY gives the same result
+        as KMEANS_LLOYD, but keeps an upper bound on the distance of each
+        point to its centroid and a lower bound on that to the next
+        closest, so that most points don't need any distances calculated
+        once the clusters settle down.  It needs the metric to satisfy the
+        triangle inequality, and falls back to KMEANS_LLOYD otherwise.
+        KMEANS_MINIBATCH moves the centroids towards batchSize random
+        points per iteration, and only goes over all the points once at
+        the end to assign them.
+    */
+    KMeansAlgorithm algorithm;
+
+    /** How train() chooses the initial centroids. */
+    KMeansInitialization initialization;
+
+    /** Number of points sampled per iteration by KMEANS_MINIBATCH. */
+    int batchSize;
+
     void train(const std::vector<distribution<float> > & points,
                std::vector<int> & in_cluster,
                int nclusters=100,
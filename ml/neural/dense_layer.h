@@ -205,7 +205,31 @@ struct Dense_Layer : public Layer {
                 Parameters & gradient,
                 Parameters * dgradient,
                 double example_weight) const;    
-    
+
+
+    /*************************************************************************/
+    /* MINIBATCH                                                             */
+    /*************************************************************************/
+
+    /* These do the minibatch as matrix products through BLAS.  Minibatches
+       with missing inputs go one example at a time instead. */
+
+    virtual void
+    fprop_batch(int n,
+                const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    virtual void
+    bprop_batch(int n,
+                const float * inputs,
+                const float * outputs,
+                const float * temp_space, size_t temp_space_size,
+                const float * output_errors,
+                float * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
     /** Add in our parameters to the params object. */
     virtual void add_parameters(Parameters & params);
 
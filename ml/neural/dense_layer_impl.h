@@ -14,6 +14,7 @@
 #include "mldb/jml/db/persistent.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/ml/algebra/matrix_ops.h"
+#include "mldb/ml/algebra/lapack.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/ml/jml/registry.h"
@@ -666,6 +667,145 @@ bbprop(const double * inputs,
 
 namespace {
 
+/// Values of a minibatch in the precision of the weights, which are only
+/// copied if they differ from the single precision of the minibatch
+inline const float *
+batch_values(const float * values, size_t n, std::vector<float> & storage)
+{
+    return values;
+}
+
+inline const double *
+batch_values(const float * values, size_t n, std::vector<double> & storage)
+{
+    storage.assign(values, values + n);
+    return &storage[0];
+}
+
+inline bool any_missing(const float * values, size_t n)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        if (isnan(values[i]))
+            return true;
+    return false;
+}
+
+} // file scope
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+fprop_batch(int n,
+            const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    int ni = this->inputs(), no = this->outputs();
+
+    if (temp_space_size != 0)
+        throw Exception("Dense_Layer::fprop_batch(): wrong temp space size");
+    if (n == 0)
+        return;
+    if (ni == 0 || any_missing(inputs, (size_t)n * ni)) {
+        Layer::fprop_batch(n, inputs, temp_space, temp_space_size, outputs);
+        return;
+    }
+
+    std::vector<Float> input_storage;
+    const Float * x = batch_values(inputs, (size_t)n * ni, input_storage);
+
+    // Activations are row major n x no, and so are the weights (ni x no).
+    // BLAS is column major, so we calculate the transpose:
+    // activations' = weights' * inputs'
+    std::vector<Float> act((size_t)n * no);
+    for (int e = 0;  e < n;  ++e)
+        std::copy(bias.begin(), bias.end(), &act[(size_t)e * no]);
+
+    LAPack::gemm('N', 'N', no, n, ni, 1.0, &weights[0][0], no, x, ni,
+                 1.0, &act[0], no);
+
+    Float out[no];
+    for (int e = 0;  e < n;  ++e) {
+        transfer_function->transfer(&act[(size_t)e * no], out, no);
+        std::copy(out, out + no, outputs + (size_t)e * no);
+    }
+}
+
+template<typename Float>
+void
+Dense_Layer<Float>::
+bprop_batch(int n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    int ni = this->inputs(), no = this->outputs();
+
+    if (temp_space_size != 0)
+        throw Exception("Dense_Layer::bprop_batch(): wrong temp size");
+    if (n == 0)
+        return;
+    if (ni == 0 || any_missing(inputs, (size_t)n * ni)) {
+        Layer::bprop_batch(n, inputs, outputs, temp_space, temp_space_size,
+                           output_errors, input_errors, gradient,
+                           example_weights);
+        return;
+    }
+
+    std::vector<Float> input_storage;
+    const Float * x = batch_values(inputs, (size_t)n * ni, input_storage);
+
+    // Derivative of the error with respect to the activations, as is and
+    // multiplied by the example weight, both n x no
+    std::vector<Float> dact((size_t)n * no), wdact((size_t)n * no);
+    distribution<double> dbias(no, 0.0);
+
+    float derivs[no];
+    for (int e = 0;  e < n;  ++e) {
+        size_t offset = (size_t)e * no;
+        transfer_function->derivative(outputs + offset, derivs, no);
+        SIMD::vec_prod(derivs, output_errors + offset, derivs, no);
+
+        double w = example_weights[e];
+        std::copy(derivs, derivs + no, &dact[offset]);
+        for (int o = 0;  o < no;  ++o) {
+            wdact[offset + o] = w * derivs[o];
+            dbias[o] += wdact[offset + o];
+        }
+    }
+
+    gradient.vector(1, "bias").update(&dbias[0], 1.0);
+
+    // dweights (ni x no) = inputs' * wdact, or in column major terms
+    // dweights' = wdact' * inputs
+    std::vector<Float> dweights((size_t)ni * no);
+    LAPack::gemm('N', 'T', no, ni, n, 1.0, &wdact[0], no, x, ni,
+                 0.0, &dweights[0], no);
+
+    Matrix_Parameter & gweights = gradient.matrix(0, "weights");
+    for (int i = 0;  i < ni;  ++i)
+        gweights.update_row(i, &dweights[(size_t)i * no], 1.0);
+
+    if (!input_errors)
+        return;
+
+    // input_errors (n x ni) = dact * weights', or in column major terms
+    // input_errors' = weights * dact'
+    std::vector<Float> errors((size_t)n * ni);
+    LAPack::gemm('T', 'N', ni, n, no, 1.0, &weights[0][0], no, &dact[0], no,
+                 0.0, &errors[0], ni);
+
+    // As for bprop(), inputs that were zero get no error
+    for (size_t i = 0;  i < (size_t)n * ni;  ++i)
+        input_errors[i] = inputs[i] == 0.0 ? 0.0 : errors[i];
+}
+
+namespace {
+
 template<typename Float>
 void random_fill_range(Float * start, size_t size, float limit,
                        Thread_Context & context)
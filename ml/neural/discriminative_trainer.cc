@@ -122,8 +122,52 @@ train_example(const float * data,
     return make_pair(sqrt(error), outputs[0]);
 }
 
+double
+Discriminative_Trainer::
+train_batch(int n,
+            const float * data,
+            const float * labels,
+            const float * weights,
+            Parameters_Copy<double> & updates,
+            float * outputs) const
+{
+    size_t no = layer->outputs();
+    size_t temp_space_size = n * layer->fprop_temporary_space_required();
+
+    std::vector<float> temp_space(temp_space_size);
+    std::vector<float> batch_outputs(n * no);
+
+    layer->fprop_batch(n, data, &temp_space[0], temp_space_size,
+                       &batch_outputs[0]);
+
+    // TODO: get the loss function to do this...
+    std::vector<float> derrors(n * no);
+    double total_rmse = 0.0;
+    for (int x = 0;  x < n;  ++x) {
+        double error = 0.0;
+        for (size_t o = 0;  o < no;  ++o) {
+            float e = labels[x * no + o] - batch_outputs[x * no + o];
+            error += e * e;
+            derrors[x * no + o] = -2.0 * e;
+        }
+        total_rmse += sqrt(error);
+        outputs[x] = batch_outputs[x * no];
+    }
+
+    layer->bprop_batch(n, data, &batch_outputs[0],
+                       &temp_space[0], temp_space_size,
+                       &derrors[0],
+                       0 /* don't calculate input errors */,
+                       updates, weights);
+
+    return total_rmse;
+}
+
 namespace {
 
+/// Number of examples that a job fprops and bprops at once
+enum { TRAIN_BATCH_SIZE = 64 };
+
 struct Train_Examples_Job {
 
     const Discriminative_Trainer & trainer;
@@ -174,27 +218,31 @@ struct Train_Examples_Job {
 
         //cerr << "training from " << first << " to " << last << endl;
 
-        for (unsigned ix = first; ix < last;  ++ix) {
-            int x = examples[ix];
+        size_t ni = trainer.layer->inputs(), no = trainer.layer->outputs();
 
-            double rmse_contribution;
-            double output;
+        // The examples are gathered into contiguous minibatches, so that
+        // the layers can work on them with matrix products
+        std::vector<float> batch_data(TRAIN_BATCH_SIZE * ni);
+        std::vector<float> batch_labels(TRAIN_BATCH_SIZE * no);
+        std::vector<float> batch_weights(TRAIN_BATCH_SIZE);
 
-            float weight = 1.0;
-            if (weights.size())
-                weight = weights.at(x);
+        for (int ix0 = first;  ix0 < last;  ix0 += TRAIN_BATCH_SIZE) {
+            int n = std::min<int>(TRAIN_BATCH_SIZE, last - ix0);
 
-            //cerr << "x " << x << " weight " << weight << endl;
+            for (int b = 0;  b < n;  ++b) {
+                int x = examples[ix0 + b];
+                std::copy(data[x], data[x] + ni, &batch_data[b * ni]);
 
-            std::tie(rmse_contribution, output)
-                = trainer.train_example(data[x],
-                                        labels[x],
-                                        local_updates,
-                                        output_encoder,
-                                        weight);
-            
-            outputs[ix] = output;
-            total_rmse_local += rmse_contribution;
+                distribution<float> label = output_encoder.target(labels[x]);
+                std::copy(label.begin(), label.end(), &batch_labels[b * no]);
+
+                batch_weights[b] = weights.size() ? weights.at(x) : 1.0;
+            }
+
+            total_rmse_local
+                += trainer.train_batch(n, &batch_data[0], &batch_labels[0],
+                                       &batch_weights[0], local_updates,
+                                       &outputs[ix0]);
         }
 
         Guard guard(updates_lock);
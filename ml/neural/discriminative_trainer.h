@@ -52,6 +52,19 @@ public:
                   Parameters_Copy<double> & updates,
                   float weight = 1.0) const;
 
+    /** Train the n examples of a minibatch at once, through the layer's
+        fprop_batch() and bprop_batch().  The data and labels are stored one
+        example after the other.  Returns the sum of the RMSE over the
+        examples, and puts the first output of each into outputs.
+    */
+    double
+    train_batch(int n,
+                const float * data,
+                const float * labels,
+                const float * weights,
+                Parameters_Copy<double> & updates,
+                float * outputs) const;
+
     std::pair<double, double>
     train_iter(const std::vector<distribution<float> > & data,
                const std::vector<Label> & labels,
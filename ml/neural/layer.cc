@@ -267,6 +267,45 @@ bprop(const distribution<double> & inputs,
                          output_errors, gradient, example_weight);
 }
 
+void
+Layer::
+fprop_batch(int n,
+            const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t nt = fprop_temporary_space_required();
+    if (temp_space_size != n * nt)
+        throw Exception("Layer::fprop_batch(): wrong temp space size");
+
+    for (int x = 0;  x < n;  ++x)
+        fprop(inputs + x * ni, temp_space + x * nt, nt, outputs + x * no);
+}
+
+void
+Layer::
+bprop_batch(int n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    size_t ni = this->inputs(), no = this->outputs();
+    size_t nt = fprop_temporary_space_required();
+    if (temp_space_size != n * nt)
+        throw Exception("Layer::bprop_batch(): wrong temp space size");
+
+    for (int x = 0;  x < n;  ++x)
+        bprop(inputs + x * ni, outputs + x * no, temp_space + x * nt, nt,
+              output_errors + x * no,
+              input_errors ? input_errors + x * ni : 0,
+              gradient, example_weights[x]);
+}
+
 namespace {
 
 template<typename F>
@@ -602,6 +602,55 @@ public:
     ///@}
 
 
+    /*************************************************************************/
+    /* MINIBATCH                                                             */
+    /*************************************************************************/
+
+    /** \name Minibatch Propagation
+
+        These functions perform fprop() and bprop() over a minibatch of
+        examples at once, so that a layer can do the work as matrix
+        products rather than one example at a time.  The inputs, outputs
+        and errors are stored one example after the other, so that for
+        example the inputs of example x start at inputs + x * inputs().
+
+        The temporary space has n * fprop_temporary_space_required()
+        elements, laid out however the layer chooses; it is only ever read
+        by the bprop_batch() of the same layer.
+
+        The default implementations call fprop() and bprop() for each
+        example in turn.
+
+        @{
+    */
+
+    /** Forward propagate the n examples in the minibatch.  Apart from
+        being over n examples, this is the same as fprop().
+    */
+    virtual void
+    fprop_batch(int n,
+                const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    /** Back propagate the n examples in the minibatch.  Apart from being
+        over n examples and having an array of n example weights, this is
+        the same as bprop().  The gradient receives the sum over all of
+        the examples.
+    */
+    virtual void
+    bprop_batch(int n,
+                const float * inputs,
+                const float * outputs,
+                const float * temp_space, size_t temp_space_size,
+                const float * output_errors,
+                float * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
+    ///@}
+
+
 protected:
     std::string name_;
     size_t inputs_, outputs_;
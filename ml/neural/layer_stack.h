@@ -271,6 +271,27 @@ struct Layer_Stack : public Layer {
                         Parameters * dgradient,
                         double example_weight) const;
 
+    /* The temporary space of a minibatch holds, for each layer in turn, the
+       temporary space of that layer for the whole minibatch followed by its
+       outputs for the whole minibatch, so that each layer can work on the
+       whole minibatch at once. */
+
+    virtual void
+    fprop_batch(int n,
+                const float * inputs,
+                float * temp_space, size_t temp_space_size,
+                float * outputs) const;
+
+    virtual void
+    bprop_batch(int n,
+                const float * inputs,
+                const float * outputs,
+                const float * temp_space, size_t temp_space_size,
+                const float * output_errors,
+                float * input_errors,
+                Parameters & gradient,
+                const float * example_weights) const;
+
     virtual void random_fill(float limit, Thread_Context & context);
 
     virtual void zero_fill();
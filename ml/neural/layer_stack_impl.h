@@ -477,6 +477,97 @@ bprop(const double * inputs,
                   output_errors, input_errors, gradient, example_weight);
 }
 
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+fprop_batch(int n,
+            const float * inputs,
+            float * temp_space, size_t temp_space_size,
+            float * outputs) const
+{
+    float * temp_space_end = temp_space + temp_space_size;
+
+    const float * curr_inputs = inputs;
+
+    for (unsigned i = 0;  i < size();  ++i) {
+        size_t layer_temp_space_size
+            = n * layers_[i]->fprop_temporary_space_required();
+
+        float * curr_outputs
+            = (i == size() - 1
+               ? outputs
+               : temp_space + layer_temp_space_size);
+
+        layers_[i]->fprop_batch(n, curr_inputs, temp_space,
+                                layer_temp_space_size, curr_outputs);
+
+        curr_inputs = curr_outputs;
+
+        temp_space += layer_temp_space_size;
+        if (i != size() - 1) temp_space += n * layers_[i]->outputs();
+
+        if (temp_space > temp_space_end
+            || (i == size() - 1 && temp_space != temp_space_end))
+            throw Exception("temp space out of sync");
+    }
+}
+
+template<class LayerT>
+void
+Layer_Stack<LayerT>::
+bprop_batch(int n,
+            const float * inputs,
+            const float * outputs,
+            const float * temp_space, size_t temp_space_size,
+            const float * output_errors,
+            float * input_errors,
+            Parameters & gradient,
+            const float * example_weights) const
+{
+    const float * temp_space_start = temp_space;
+    const float * curr_temp_space = temp_space + temp_space_size;
+
+    const float * curr_outputs = outputs;
+
+    // Errors kept between the layers.  A layer's input errors can't go
+    // where its output errors are, as the rows have different widths.
+    std::vector<float> error_storage[2];
+    error_storage[0].resize((size_t)n * max_internal_width());
+    error_storage[1].resize((size_t)n * max_internal_width());
+    const float * curr_output_errors = output_errors;
+
+    for (int i = size() - 1;  i >= 0;  --i) {
+        size_t layer_temp_space_size
+            = n * layers_[i]->fprop_temporary_space_required();
+
+        curr_temp_space -= layer_temp_space_size;
+
+        if (curr_temp_space < temp_space_start)
+            throw Exception("Layer temp space was out of sync");
+
+        const float * curr_inputs
+            = (i == 0
+               ? inputs
+               : curr_temp_space - n * layers_[i]->inputs());
+
+        float * curr_input_errors
+            = (i == 0 ? input_errors : &error_storage[i % 2][0]);
+
+        layers_[i]->bprop_batch(n, curr_inputs, curr_outputs, curr_temp_space,
+                                layer_temp_space_size, curr_output_errors,
+                                curr_input_errors,
+                                gradient.subparams(i, layers_[i]->name()),
+                                example_weights);
+
+        curr_outputs = curr_inputs;
+        curr_output_errors = curr_input_errors;
+        if (i != 0) curr_temp_space -= n * layers_[i]->inputs();
+    }
+
+    if (curr_temp_space != temp_space_start)
+        throw Exception("Layer_Stack::bprop_batch(): out of sync");
+}
+
 template<class LayerT>
 template<typename F>
 void
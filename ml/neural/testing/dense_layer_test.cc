@@ -547,3 +547,64 @@ BOOST_AUTO_TEST_CASE( test_bbprop_tanh_double_none2 )
     bbprop_test<double>(layer, context);
 }
 
+
+template<typename Float>
+void batch_test(Missing_Values missing_values)
+{
+    Thread_Context context;
+    context.seed(123);
+    Dense_Layer<Float> layer("test", 20, 10, TF_TANH, missing_values, context);
+
+    int n = 7, ni = layer.inputs(), no = layer.outputs();
+
+    distribution<float> inputs(n * ni), output_errors(n * no), weights(n);
+    for (unsigned i = 0;  i < inputs.size();  ++i)
+        inputs[i] = context.random01() - 0.5;
+    for (unsigned i = 0;  i < output_errors.size();  ++i)
+        output_errors[i] = context.random01() - 0.5;
+    for (unsigned i = 0;  i < n;  ++i)
+        weights[i] = context.random01();
+    inputs[3] = 0.0;
+    if (missing_values != MV_NONE)
+        inputs[5] = std::numeric_limits<float>::quiet_NaN();
+
+    // One example at a time
+    distribution<float> outputs(n * no), input_errors(n * ni);
+    Parameters_Copy<double> gradient(layer, 0.0);
+    for (unsigned x = 0;  x < n;  ++x) {
+        layer.fprop(&inputs[x * ni], 0, 0, &outputs[x * no]);
+        layer.bprop(&inputs[x * ni], &outputs[x * no], 0, 0,
+                    &output_errors[x * no], &input_errors[x * ni],
+                    gradient, weights[x]);
+    }
+
+    // The whole minibatch at once
+    distribution<float> batch_outputs(n * no), batch_input_errors(n * ni);
+    Parameters_Copy<double> batch_gradient(layer, 0.0);
+    layer.fprop_batch(n, &inputs[0], 0, 0, &batch_outputs[0]);
+    layer.bprop_batch(n, &inputs[0], &batch_outputs[0], 0, 0,
+                      &output_errors[0], &batch_input_errors[0],
+                      batch_gradient, &weights[0]);
+
+    for (unsigned i = 0;  i < outputs.size();  ++i)
+        BOOST_CHECK_SMALL(outputs[i] - batch_outputs[i], 1e-5f);
+    for (unsigned i = 0;  i < input_errors.size();  ++i)
+        BOOST_CHECK_SMALL(input_errors[i] - batch_input_errors[i], 1e-5f);
+    for (unsigned i = 0;  i < gradient.values.size();  ++i)
+        BOOST_CHECK_SMALL(gradient.values[i] - batch_gradient.values[i], 1e-5);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_float_none )
+{
+    batch_test<float>(MV_NONE);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_double_none )
+{
+    batch_test<double>(MV_NONE);
+}
+
+BOOST_AUTO_TEST_CASE( test_batch_float_input )
+{
+    batch_test<float>(MV_INPUT);
+}
@@ -20,6 +20,7 @@
 #include "mldb/base/thread_pool.h"
 #include "mldb/server/column_scope.h"
 #include "mldb/server/bucket.h"
+#include <climits>
 
 namespace MLDB {
 
@@ -130,14 +131,22 @@ struct PartitionData {
                     
                     auto writer = featureBuckets[f].atOffset(offset);
 
+                    // The bucket numbers are looked up a block at a time
+                    int exampleNums[BLOCK_SIZE];
+                    uint32_t buckets[BLOCK_SIZE];
                     size_t n = 0;
-                    for (size_t i = start;  i < end;  ++i) {
-                        if (weights[i] == 0)
-                            continue;
-                        
-                        uint32_t bucket = features[f].buckets[rows[i].exampleNum];
-                        writer.write(bucket);
-                        ++n;
+                    for (size_t i = start;  i < end;) {
+                        size_t numInBlock = 0;
+                        for (; i < end && numInBlock < BLOCK_SIZE;  ++i) {
+                            if (weights[i] != 0)
+                                exampleNums[numInBlock++] = rows[i].exampleNum;
+                        }
+
+                        features[f].buckets.gather(exampleNums, numInBlock,
+                                                   buckets);
+                        for (size_t j = 0;  j < numInBlock;  ++j)
+                            writer.write(buckets[j]);
+                        n += numInBlock;
                     }
                     
                     ExcAssertEqual(n, trancheCounts[tr]);
@@ -153,6 +162,9 @@ struct PartitionData {
 
     std::shared_ptr<const DatasetFeatureSpace> fs;
 
+    /// Number of rows whose bucket numbers are looked up at once
+    static constexpr size_t BLOCK_SIZE = 256;
+
     /// Entry for an individual row
     struct Row {
         bool label;                 ///< Label associated with
@@ -247,326 +259,202 @@ struct PartitionData {
 
     typedef WT<ML::FixedPointAccum64> W;
 
-    /** Split the partition here. */
-    std::pair<PartitionData, PartitionData>
-    split(int featureToSplitOn, int splitValue, const W & wLeft, const W & wRight, const W & wAll)
-    {
-     //   std::cerr << "spliting on feature " << featureToSplitOn << " bucket " << splitValue << std::endl;
-
-        ExcAssertGreaterEqual(featureToSplitOn, 0);
-        ExcAssertLess(featureToSplitOn, features.size());
-
-        PartitionData sides[2];
-        PartitionData & left = sides[0];
-        PartitionData & right = sides[1];
-
-        left.fs = fs;
-        right.fs = fs;
-        left.features = features;
-        right.features = features;
-
-        bool ordinal = features[featureToSplitOn].ordinal;
-
-        double useRatio = 1.0 * rows.size() / rows.back().exampleNum;
-
-        //todo: Re-index when usable data fits inside cache
-        bool reIndex = useRatio < 0.1;
-        //reIndex = false;
-        //cerr << "useRatio = " << useRatio << endl;
-
-        if (!reIndex) {
-
-            sides[0].rows.reserve(rows.size());
-            sides[1].rows.reserve(rows.size());
-
-            //this is for debug only
-            //int maxBucket = 0;
-            //int minBucket = INFINITY;
-
-            for (size_t i = 0;  i < rows.size();  ++i) {
-                int bucket = features[featureToSplitOn].buckets[rows[i].exampleNum];
-                //maxBucket = std::max(maxBucket, bucket);
-                //minBucket = std::min(minBucket, bucket);
-                int side = ordinal ? bucket > splitValue : bucket != splitValue;
-                sides[side].addRow(rows[i]);
-            }
-
-            rows.clear();
-            rows.shrink_to_fit();
-            features.clear();
-
-            /*if (right.rows.size() == 0 || left.rows.size() == 0)
-            {
-                std::cerr << wLeft[0] << "," << wLeft[1] << "," << wRight[0] << "," << wRight[1] << std::endl;
-                std::cerr << wAll[0] << "," << wAll[1] << std::endl;
-                std::cerr << "splitValue: " << splitValue << std::endl;
-                std::cerr << "isordinal: " << ordinal << std::endl;
-                std::cerr << "max bucket" << maxBucket << std::endl;
-                std::cerr << "min bucket" << minBucket << std::endl;
-            }
-
-            ExcAssert(left.rows.size() > 0);
-            ExcAssert(right.rows.size() > 0);*/
-        }
-        else {
-
-            int nf = features.size();
-
-            // For each example, it goes either in left or right, depending
-            // upon the value of the chosen feature.
-
-            std::vector<uint8_t> lr(rows.size());
-            bool ordinal = features[featureToSplitOn].ordinal;
-            size_t numOnSide[2] = { 0, 0 };
-
-            // TODO: could reserve less than this...
-            sides[0].rows.reserve(rows.size());
-            sides[1].rows.reserve(rows.size());
-
-            for (size_t i = 0;  i < rows.size();  ++i) {
-                int bucket = features[featureToSplitOn].buckets[rows[i].exampleNum];
-                int side = ordinal ? bucket > splitValue : bucket != splitValue;
-                lr[i] = side;
-                sides[side].addRow(rows[i].label, rows[i].weight, numOnSide[side]++);
-            }
-
-            for (unsigned i = 0;  i < nf;  ++i) {
-                if (!features[i].active)
-                    continue;
-
-                WritableBucketList newFeatures[2];
-                newFeatures[0].init(numOnSide[0], features[i].info->distinctValues);
-                newFeatures[1].init(numOnSide[1], features[i].info->distinctValues);
-                size_t index[2] = { 0, 0 };
-
-                for (size_t j = 0;  j < rows.size();  ++j) {
-                    int side = lr[j];
-                    newFeatures[side].write(features[i].buckets[rows[j].exampleNum]);
-                    ++index[side];
-                }
-
-                sides[0].features[i].buckets = newFeatures[0];
-                sides[1].features[i].buckets = newFeatures[1];
-            }
+    /// Range of rows that belong to a node of the level being grown
+    struct LevelNode {
+        size_t begin;           ///< First row of the node
+        size_t end;             ///< One past the last row of the node
+        ML::Tree::Ptr * slot;   ///< Where the node goes in the tree
+    };
 
-            rows.clear();
-            rows.shrink_to_fit();
-            features.clear();
-        }
+    /// Best split found for a node
+    struct NodeSplit {
+        double score = INFINITY;
+        int feature = -1;
+        int split = -1;
+        W left;
+        W right;
+    };
 
-        return { std::move(left), std::move(right) };
+    /** Score of a split; lower is better. */
+    static double score(const W & wFalse, const W & wTrue)
+    {
+        return 2.0 * (  sqrt(wFalse[0] * wFalse[1])
+                      + sqrt(wTrue[0] * wTrue[1]));
     }
 
-    /** Test all features for a split.  Returns the feature number,
-        the bucket number and the goodness of the split.
-
-        Outputs
-        - Z score of split
-        - Feature number
-        - Split point
-        - W for the left side of the split
-        - W from the right side of the split
-        - W total (in case no split is found)
-    */
-    std::tuple<double, int, int, W, W, W>
-    testAll(int depth)
+    /** Side of the split that the bucket goes to (0 is left, which is
+        the true side of the split). */
+    static int sideOf(bool ordinal, int bucket, int splitValue)
     {
-        bool debug = false;
-
-        int nf = features.size();
+        return ordinal ? bucket > splitValue : bucket != splitValue;
+    }
 
-        // For each feature, for each bucket, for each label
-        // weight for each bucket and last valid bucket
-        std::vector< std::vector<W> > w(nf);
-        std::vector< int > maxSplits(nf);
+    /** Find the best split of each of the nodes of a level.  The rows of
+        each node are contiguous, so a single pass over the rows for each
+        feature accumulates the histograms of all of the nodes, and the
+        histogram for a node is only as large as the range of buckets that
+        its rows occupy.
 
-        size_t totalNumBuckets = 0;
-        size_t activeFeatures = 0;
+        The work is divided up into chunks of nodes with about the same
+        number of rows and into chunks of features, so that there are
+        enough jobs to keep all cores busy whether the level has one huge
+        node or thousands of small ones.  Ties are broken in favour of the
+        lowest feature number, whatever the division.
 
-        for (unsigned i = 0;  i < nf;  ++i) {
-            if (!features[i].active)
-                continue;
-            ++activeFeatures;
-            w[i].resize(features[i].buckets.numBuckets);
-            totalNumBuckets += features[i].buckets.numBuckets;
+        wAll must contain the total weight of each node; nodes for which
+        it has no impurity are not split.
+    */
+    std::vector<NodeSplit>
+    findSplits(const std::vector<LevelNode> & level,
+               const std::vector<W> & wAll) const
+    {
+        size_t nn = level.size();
+        size_t nf = features.size();
+
+        size_t numRows = 0;
+        for (auto & n: level)
+            numRows += n.end - n.begin;
+
+        size_t targetJobs = 4 * numCpus();
+
+        // Chunks of nodes, each with at least rowsPerChunk rows, unless
+        // there aren't any more nodes
+        size_t rowsPerChunk = std::max<size_t>(numRows / targetJobs, 4096);
+        std::vector<size_t> nodeChunks = { 0 };
+        size_t rowsInChunk = 0;
+        for (size_t i = 0;  i < nn;  ++i) {
+            rowsInChunk += level[i].end - level[i].begin;
+            if (rowsInChunk >= rowsPerChunk || i == nn - 1) {
+                nodeChunks.push_back(i + 1);
+                rowsInChunk = 0;
+            }
         }
+        size_t numNodeChunks = nodeChunks.size() - 1;
 
-        if (debug) {
-            std::cerr << "total of " << totalNumBuckets << " buckets" << std::endl;
-            std::cerr << activeFeatures << " of " << nf << " features active"
-                 << std::endl;
-        }
+        size_t numFeatureChunks
+            = std::max<size_t>(1, std::min<size_t>(nf, targetJobs / numNodeChunks));
+        size_t featuresPerChunk
+            = (nf + numFeatureChunks - 1) / std::max<size_t>(numFeatureChunks, 1);
 
-        W wAll;
+        // Best split for each node for each chunk of features
+        std::vector<NodeSplit> candidates(nn * numFeatureChunks);
 
-        auto doFeature = [&] (int i)
+        auto doJob = [&] (size_t job)
             {
-                int maxBucket = -1;
-
-                if (i == nf) {
-                    for (auto & r: rows) {
-                        wAll[r.label] += r.weight;
-                    }
-                    return;
-                }
-
-                if (!features[i].active)
-                    return;
-                bool twoBuckets = false;
-                int lastBucket = -1;
-
-                for (size_t j = 0;  j < rows.size();  ++j) {
-                    auto & r = rows[j];
-                    int bucket = features[i].buckets[r.exampleNum];
-
-                    twoBuckets = twoBuckets
-                        || (lastBucket != -1 && bucket != lastBucket);
-                    lastBucket = bucket;
-
-                    w[i][bucket][r.label] += r.weight;
-                    maxBucket = std::max(maxBucket, bucket);
-                }
+                size_t nc = job / numFeatureChunks;
+                size_t fc = job % numFeatureChunks;
 
-                // If all examples were in a single bucket, then the
-                // feature is no longer active.
-                if (!twoBuckets)
-                    features[i].active = false;
+                size_t fBegin = fc * featuresPerChunk;
+                size_t fEnd = std::min(nf, fBegin + featuresPerChunk);
 
-                maxSplits[i] = maxBucket;
-            };
-
-        if (depth < 4 || true) {
-            parallelMap(0, nf + 1, doFeature);
-        }
-        else {
-            for (unsigned i = 0;  i <= nf;  ++i)
-                doFeature(i);
-        }
+                std::vector<W> w;
+                int exampleNums[BLOCK_SIZE];
+                uint32_t buckets[BLOCK_SIZE];
 
-        // We have no impurity in our bucket.  Time to stop
-        if (wAll[0] == 0 || wAll[1] == 0)
-            return std::make_tuple(1.0, -1, -1, wAll, W(), wAll);
-
-        double bestScore = INFINITY;
-        int bestFeature = -1;
-        int bestSplit = -1;
-        
-        W bestLeft;
-        W bestRight;
-
-        int bucketsEmpty = 0;
-        int bucketsOne = 0;
-        int bucketsBoth = 0;
-
-        // Score each feature
-        for (unsigned i = 0;  i < nf;  ++i) {
-            if (!features[i].active)
-                continue;
-
-            W wAll; // TODO: do we need this?
-            for (auto & wt: w[i]) {
-                wAll += wt;
-                bucketsEmpty += wt[0] == 0 && wt[1] == 0;
-                bucketsBoth += wt[0] != 0 && wt[1] != 0;
-                bucketsOne += (wt[0] == 0) ^ (wt[1] == 0);
-            }
-
-            auto score = [] (const W & wFalse, const W & wTrue) -> double
-                {
-                    double score
-                    = 2.0 * (  sqrt(wFalse[0] * wFalse[1])
-                             + sqrt(wTrue[0] * wTrue[1]));
-                    return score;
-                };
-            
-            if (debug) {
-                std::cerr << "feature " << i << " " << features[i].info->columnName
-                     << std::endl;
-                std::cerr << "    all: " << wAll[0] << " " << wAll[1] << std::endl;
-            }
-
-            int maxBucket = maxSplits[i];
-
-            if (features[i].ordinal) {
-                // Calculate best split point for ordered values
-                W wFalse = wAll, wTrue;
-
-                // Now test split points one by one
-                for (unsigned j = 0;  j < maxBucket;  ++j) {
-                    if (w[i][j].empty())
-                        continue;                   
-
-                    double s = score(wFalse, wTrue);
-
-                    if (debug) {
-                        std::cerr << "  ord split " << j << " "
-                             << features[i].info->bucketDescriptions.getValue(j)
-                             << " had score " << s << std::endl;
-                        std::cerr << "    false: " << wFalse[0] << " " << wFalse[1] << std::endl;
-                        std::cerr << "    true:  " << wTrue[0] << " " << wTrue[1] << std::endl;
-                    }
-
-                    if (s < bestScore) {
-                        bestScore = s;
-                        bestFeature = i;
-                        bestSplit = j;
-                        bestRight = wFalse;
-                        bestLeft = wTrue;
-                    }
-
-                   wFalse -= w[i][j];
-                   wTrue += w[i][j];
-
-                }
-            }
-            else {
-                // Calculate best split point for non-ordered values
-                // Now test split points one by one
-
-                for (unsigned j = 0;  j <= maxBucket;  ++j) {
-
-                    if (w[i][j].empty())
+                for (size_t f = fBegin;  f < fEnd;  ++f) {
+                    const Feature & feature = features[f];
+                    if (!feature.active)
                         continue;
 
-                    W wFalse = wAll;
-                    wFalse -= w[i][j];                    
+                    if (w.size() < feature.buckets.numBuckets)
+                        w.resize(feature.buckets.numBuckets);
 
-                    double s = score(wFalse, w[i][j]);
+                    for (size_t n = nodeChunks[nc];  n < nodeChunks[nc + 1];  ++n) {
+                        const W & nodeAll = wAll[n];
+                        if (nodeAll[0] == 0 || nodeAll[1] == 0)
+                            continue;
 
-                    if (debug) {
-                        std::cerr << "  non ord split " << j << " "
-                             << features[i].info->bucketDescriptions.getValue(j)
-                             << " had score " << s << std::endl;
-                        std::cerr << "    false: " << wFalse[0] << " " << wFalse[1] << std::endl;
-                        std::cerr << "    true:  " << w[i][j][0] << " " << w[i][j][1] << std::endl;
-                    }
-             
-                    if (s < bestScore) {
-                        bestScore = s;
-                        bestFeature = i;
-                        bestSplit = j;
-                        bestRight = wFalse;
-                        bestLeft = w[i][j];
+                        int minBucket = INT_MAX, maxBucket = -1;
+
+                        // Look up the buckets of a block of rows at a
+                        // time, so that the loads are independent of the
+                        // histogram updates
+                        for (size_t b = level[n].begin;  b < level[n].end;
+                             b += BLOCK_SIZE) {
+                            size_t e = std::min(b + BLOCK_SIZE, level[n].end);
+                            for (size_t j = b;  j < e;  ++j)
+                                exampleNums[j - b] = rows[j].exampleNum;
+                            feature.buckets.gather(exampleNums, e - b, buckets);
+
+                            for (size_t j = b;  j < e;  ++j) {
+                                const Row & r = rows[j];
+                                int bucket = buckets[j - b];
+                                w[bucket][r.label] += r.weight;
+                                minBucket = std::min(minBucket, bucket);
+                                maxBucket = std::max(maxBucket, bucket);
+                            }
+                        }
+
+                        NodeSplit & best = candidates[n * numFeatureChunks + fc];
+
+                        // If all examples are in a single bucket, then the
+                        // feature can't be split on
+                        if (minBucket != maxBucket && feature.ordinal) {
+                            // Calculate best split point for ordered values
+                            W wFalse = nodeAll, wTrue;
+
+                            // Now test split points one by one
+                            for (int j = minBucket;  j < maxBucket;  ++j) {
+                                if (w[j].empty())
+                                    continue;
+
+                                double s = score(wFalse, wTrue);
+                                if (s < best.score) {
+                                    best.score = s;
+                                    best.feature = f;
+                                    best.split = j;
+                                    best.right = wFalse;
+                                    best.left = wTrue;
+                                }
+
+                                wFalse -= w[j];
+                                wTrue += w[j];
+                            }
+                        }
+                        else if (minBucket != maxBucket) {
+                            // Calculate best split point for non-ordered
+                            // values
+                            for (int j = minBucket;  j <= maxBucket;  ++j) {
+                                if (w[j].empty())
+                                    continue;
+
+                                W wFalse = nodeAll;
+                                wFalse -= w[j];
+
+                                double s = score(wFalse, w[j]);
+                                if (s < best.score) {
+                                    best.score = s;
+                                    best.feature = f;
+                                    best.split = j;
+                                    best.right = wFalse;
+                                    best.left = w[j];
+                                }
+                            }
+                        }
+
+                        // Leave the histogram cleared for the next node
+                        if (maxBucket != -1)
+                            std::fill(w.begin() + minBucket,
+                                      w.begin() + maxBucket + 1, W());
                     }
                 }
+            };
 
+        parallelMap(0, numNodeChunks * numFeatureChunks, doJob);
+
+        std::vector<NodeSplit> result(nn);
+        for (size_t n = 0;  n < nn;  ++n) {
+            for (size_t fc = 0;  fc < numFeatureChunks;  ++fc) {
+                const NodeSplit & candidate = candidates[n * numFeatureChunks + fc];
+                if (candidate.score < result[n].score)
+                    result[n] = candidate;
             }
         }
-        
-        if (debug) {
-            std::cerr << "buckets: empty " << bucketsEmpty << " one " << bucketsOne
-                 << " both " << bucketsBoth << std::endl;
-            std::cerr << "bestScore " << bestScore << std::endl;
-            std::cerr << "bestFeature " << bestFeature << " "
-                 << features[bestFeature].info->columnName << std::endl;
-            std::cerr << "bestSplit " << bestSplit << " "
-                 << features[bestFeature].info->bucketDescriptions.getValue(bestSplit)
-                 << std::endl;
-        }
 
-        return std::make_tuple(bestScore, bestFeature, bestSplit, bestLeft, bestRight, wAll);
+        return result;
     }
 
+
     static void fillinBase(ML::Tree::Base * node, const W & wAll)
     {
 
@@ -584,116 +472,138 @@ struct PartitionData {
         return node;
     }
 
-    ML::Tree::Ptr getLeaf(ML::Tree & tree)
+
+    ML::Tree::Ptr getLeaf(ML::Tree & tree, const LevelNode & node)
     {
         W wAll;
-        for (auto & r: rows) {
+        for (size_t i = node.begin;  i < node.end;  ++i) {
+            const Row & r = rows[i];
             int label = r.label;
             ExcAssert(label >= 0 && label < 2);
             ExcAssert(r.weight > 0);
             wAll[r.label] += r.weight;
         }
-        
+
        return getLeaf(tree, wAll);
-    }  
+    }
+
+    /** Train a decision tree on the partition.
 
+        The tree is grown breadth first: all of the nodes of a level are
+        split together, with the split search over all of them sharing one
+        pass over the rows for each feature (see findSplits()).  This
+        keeps all of the cores busy until the bottom of the tree, instead
+        of tailing out on the few deep subtrees that are left when
+        recursing.
+
+        The rows of each node are kept contiguous (and in the order of
+        their example number, so that accessing the bucket lists stays
+        sequential) by a stable partition of the node's rows when it is
+        split.  The rows are left in an unspecified order afterwards.
+    */
     ML::Tree::Ptr train(int depth, int maxDepth,
                         ML::Tree & tree)
     {
         if (rows.empty())
             return ML::Tree::Ptr();
-        if (rows.size() < 2)
-            return getLeaf(tree);
 
-        if (depth >= maxDepth)
-            return getLeaf(tree);
+        ML::Tree::Ptr root;
+        std::vector<LevelNode> level = { { 0, rows.size(), &root } };
 
-        double bestScore;
-        int bestFeature;
-        int bestSplit;
-        W wLeft;
-        W wRight;
-        W wAll;
-        
-        std::tie(bestScore, bestFeature, bestSplit, wLeft, wRight, wAll)
-            = testAll(depth);
-
-        if (bestFeature == -1) {
-            ML::Tree::Leaf * leaf = tree.new_leaf();
-            fillinBase(leaf, /*wLeft + wRight*/ wAll);
-            
-            return leaf;
-        }
+        for (;  !level.empty();  ++depth) {
 
-        std::pair<PartitionData, PartitionData> splits
-            = split(bestFeature, bestSplit, wLeft, wRight, wAll);
+            // Nodes that are made into a leaf without looking for a split
+            std::vector<LevelNode> toSplit;
+            for (auto & node: level) {
+                if (node.end - node.begin < 2 || depth >= maxDepth)
+                    *node.slot = getLeaf(tree, node);
+                else toSplit.push_back(node);
+            }
+            level.clear();
 
-        //cerr << "done split in " << timer.elapsed() << endl;
+            if (toSplit.empty())
+                break;
 
-        //cerr << "left had " << splits.first.rows.size() << " rows" << endl;
-        //cerr << "right had " << splits.second.rows.size() << " rows" << endl;
+            std::vector<W> wAll(toSplit.size());
+            auto doWeights = [&] (size_t n)
+                {
+                    for (size_t i = toSplit[n].begin;  i < toSplit[n].end;  ++i)
+                        wAll[n][rows[i].label] += rows[i].weight;
+                };
+            parallelMap(0, toSplit.size(), doWeights);
 
-        ML::Tree::Ptr left, right;
-        auto runLeft = [&] () { left = splits.first.train(depth + 1, maxDepth, tree); };
-        auto runRight = [&] () { right = splits.second.train(depth + 1, maxDepth, tree); };
+            std::vector<NodeSplit> splits = findSplits(toSplit, wAll);
 
-        size_t leftRows = splits.first.rows.size();
-        size_t rightRows = splits.second.rows.size();
+            // Split the rows of each node into its left and right sides
+            std::vector<size_t> middles(toSplit.size());
+            auto doPartition = [&] (size_t n)
+                {
+                    const NodeSplit & split = splits[n];
+                    if (split.feature == -1)
+                        return;
+
+                    const Feature & feature = features[split.feature];
+                    auto it = std::stable_partition
+                        (rows.begin() + toSplit[n].begin,
+                         rows.begin() + toSplit[n].end,
+                         [&] (const Row & r)
+                         {
+                             int bucket = feature.buckets[r.exampleNum];
+                             return sideOf(feature.ordinal, bucket,
+                                           split.split) == 0;
+                         });
+                    middles[n] = it - rows.begin();
+                };
+            parallelMap(0, toSplit.size(), doPartition);
 
-        if (leftRows == 0 || rightRows == 0)
-            throw MLDB::Exception("Invalid split in random forest");
+            for (size_t n = 0;  n < toSplit.size();  ++n) {
+                const LevelNode & current = toSplit[n];
+                const NodeSplit & split = splits[n];
 
-        ThreadPool tp;
-        // Put the smallest one on the thread pool, so that we have the highest
-        // probability of running both on our thread in case of lots of work.
-        if (leftRows < rightRows) {
-            tp.add(runLeft);
-            runRight();
-        }
-        else {
-            tp.add(runRight);
-            runLeft();
-        }
-        
-        tp.waitForAll();
-
-        if (left && right) {
-            ML::Tree::Node * node = tree.new_node();
-            ML::Feature feature = fs->getFeature(features[bestFeature].info->columnName);
-            float splitVal = 0;
-            if (features[bestFeature].ordinal) {
-                auto splitCell = features[bestFeature].info->bucketDescriptions
-                    .getSplit(bestSplit);
-                if (splitCell.isNumeric())
-                    splitVal = splitCell.toDouble();
-                else splitVal = bestSplit;
-            }
-            else {
-                splitVal = bestSplit;
-            }
+                if (split.feature == -1) {
+                    ML::Tree::Leaf * leaf = tree.new_leaf();
+                    fillinBase(leaf, wAll[n]);
+                    *current.slot = leaf;
+                    continue;
+                }
 
-            ML::Split split(feature, splitVal,
-                            features[bestFeature].ordinal
-                            ? ML::Split::LESS : ML::Split::EQUAL);
-            
-            node->split = split;
-            node->child_true = left;
-            node->child_false = right;
-            W wMissing;
-            wMissing[0] = 0.0f;
-            wMissing[1] = 0.0f;
-            node->child_missing = getLeaf(tree, wMissing);
-            node->z = bestScore;            
-            fillinBase(node, wLeft + wRight);
-
-            return node;
-        }
-        else {
-            ML::Tree::Leaf * leaf = tree.new_leaf();
-            fillinBase(leaf, wLeft + wRight);
+                if (middles[n] == current.begin || middles[n] == current.end)
+                    throw MLDB::Exception("Invalid split in random forest");
+
+                const Feature & feature = features[split.feature];
 
-            return leaf;
+                ML::Tree::Node * node = tree.new_node();
+                ML::Feature mlFeature = fs->getFeature(feature.info->columnName);
+                float splitVal = 0;
+                if (feature.ordinal) {
+                    auto splitCell = feature.info->bucketDescriptions
+                        .getSplit(split.split);
+                    if (splitCell.isNumeric())
+                        splitVal = splitCell.toDouble();
+                    else splitVal = split.split;
+                }
+                else {
+                    splitVal = split.split;
+                }
+
+                node->split = ML::Split(mlFeature, splitVal,
+                                        feature.ordinal
+                                        ? ML::Split::LESS : ML::Split::EQUAL);
+                W wMissing;
+                wMissing[0] = 0.0f;
+                wMissing[1] = 0.0f;
+                node->child_missing = getLeaf(tree, wMissing);
+                node->z = split.score;
+                fillinBase(node, split.left + split.right);
+
+                *current.slot = node;
+
+                level.push_back({ current.begin, middles[n], &node->child_true });
+                level.push_back({ middles[n], current.end, &node->child_false });
+            }
         }
+
+        return root;
     }
 };
 
@@ -11,6 +11,7 @@
 #include "mldb/base/exc_assert.h"
 #include <boost/utility.hpp>
 #include "mldb/vfs/filter_streams.h"
+#include <cstring>
 
 
 using namespace std;
@@ -267,8 +268,8 @@ calculate()
         current.counts[label][false] -= weight;
         current.counts[label][true] += weight;
 
-        current.unweighted_counts[label][false] -= 1;
-        current.unweighted_counts[label][true] += 1;
+        current.unweighted_counts[label][false] -= entry.count;
+        current.unweighted_counts[label][true] += entry.count;
 
     }
     
@@ -379,4 +380,92 @@ toJson() const
     return result;
 }
 
+
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+ScoreHistogram::
+ScoreHistogram(int significantBits)
+    : significantBits(significantBits)
+{
+    if (significantBits < 0 || significantBits > 24)
+        throw MLDB::Exception("Score histogram significant bits must be "
+                              "between 0 and 24");
+}
+
+uint32_t
+ScoreHistogram::
+getKey(float score) const
+{
+    // Both zeros compare equal, so they must have the same key
+    if (score == 0.0f)
+        score = 0.0f;
+
+    uint32_t bits;
+    std::memcpy(&bits, &score, sizeof(bits));
+
+    if (significantBits == 0 || !std::isfinite(score))
+        return bits;
+
+    // Round the mantissa to nearest, which may carry into the exponent
+    // (and give infinity for the very largest scores) but always keeps
+    // the order of the scores.
+    int dropped = 24 - significantBits;
+    if (dropped == 0)
+        return bits;
+    uint32_t sign = bits & 0x80000000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    magnitude += 1U << (dropped - 1);
+    magnitude &= ~((1U << dropped) - 1);
+    magnitude = std::min<uint32_t>(magnitude, 0x7f800000);
+    return sign | magnitude;
+}
+
+void
+ScoreHistogram::
+add(const ScoreHistogram & other)
+{
+    if (other.significantBits != significantBits)
+        throw MLDB::Exception("Attempt to add score histograms with "
+                              "different precisions");
+
+    for (auto & c: other.counts) {
+        Counts & mine = counts[c.first];
+        for (int label = 0;  label < 2;  ++label) {
+            mine.weight[label] += c.second.weight[label];
+            mine.count[label] += c.second.count[label];
+        }
+    }
+}
+
+ScoredStats
+ScoreHistogram::
+toScoredStats() const
+{
+    ScoredStats result;
+    result.entries.reserve(counts.size() * 2);
+
+    for (auto & c: counts) {
+        float score;
+        std::memcpy(&score, &c.first, sizeof(score));
+
+        for (int label = 0;  label < 2;  ++label) {
+            if (c.second.count[label] == 0)
+                continue;
+            ScoredStats::ScoredEntry entry;
+            entry.label = label;
+            entry.score = score;
+            entry.weight = c.second.weight[label];
+            entry.count = c.second.count[label];
+            result.entries.emplace_back(std::move(entry));
+        }
+    }
+
+    // There are only as many entries to sort as distinct scores
+    result.sort();
+    result.calculate();
+    return result;
+}
+
 } // namespace MLDB
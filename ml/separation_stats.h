@@ -14,6 +14,7 @@
 #include "mldb/jml/utils/rng.h"
 #include "mldb/ext/jsoncpp/json.h"
 #include <cmath>
+#include <unordered_map>
 #include <boost/any.hpp>
 
 
@@ -213,7 +214,8 @@ struct ScoredStats {
         boost::any key;  ///< What this applies to
         bool label;      ///< Label for the entry
         float score;     ///< Score for the entry
-        float weight;
+        double weight;
+        uint64_t count = 1;  ///< Number of examples the entry stands for
 
         bool operator < (const ScoredEntry & other) const
         {
@@ -266,4 +268,60 @@ struct ScoredStats {
     Json::Value toJson() const;
 };
 
+
+/*****************************************************************************/
+/* SCORE HISTOGRAM                                                           */
+/*****************************************************************************/
+
+/** Accumulates the weight and number of examples of each label for each
+    distinct score, which is all that ScoredStats needs.  Unlike
+    ScoredStats, the examples themselves are neither kept nor sorted, and
+    histograms accumulated on different threads are simply merged
+    together, so evaluating a huge number of examples is a single
+    streaming pass.
+
+    With significantBits set to zero, the histogram is exact, and gives
+    the same stats as ScoredStats would.  Otherwise scores are first
+    rounded to that many significant bits (from 1 to 24), which keeps the
+    histogram small when nearly all scores are different, at the expense
+    of merging the thresholds that are very close together.
+*/
+
+struct ScoreHistogram {
+    ScoreHistogram(int significantBits = 0);
+
+    void update(bool label, float score, double weight = 1.0)
+    {
+        Counts & c = counts[getKey(score)];
+        c.weight[label] += weight;
+        c.count[label] += 1;
+    }
+
+    /** Add the counts from the other histogram to this one.  They must
+        have the same number of significant bits.
+    */
+    void add(const ScoreHistogram & other);
+
+    /** Return scored stats, with calculate() already called, with an
+        entry for each label of each distinct score.
+    */
+    ScoredStats toScoredStats() const;
+
+    /// Number of distinct (rounded) scores seen
+    size_t size() const { return counts.size(); }
+
+    int significantBits;
+
+    struct Counts {
+        double weight[2] = { 0, 0 };
+        uint64_t count[2] = { 0, 0 };
+    };
+
+    /// Counts of each score, keyed by the bits of the rounded score
+    std::unordered_map<uint32_t, Counts> counts;
+
+private:
+    uint32_t getKey(float score) const;
+};
+
 } // namespace MLDB
@@ -12,7 +12,12 @@
 #include "mldb/types/enum_description.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/ml/algebra/lapack.h"
+#include "mldb/arch/simd_vector.h"
+#include "mldb/base/parallel.h"
+#include <cmath>
 #include <mutex>
+#include <random>
 
 #if MLDB_INTEL_ISA
 #include <smmintrin.h>
@@ -33,6 +38,97 @@ SvdSpaceDescription()
              "Pythagorean space encoding");
 }
 
+DEFINE_ENUM_DESCRIPTION(SvdSolver);
+
+SvdSolverDescription::
+SvdSolverDescription()
+{
+    addValue("lanczos", SVD_LANCZOS,
+             "Lanczos iterations, using svdlibc.  This is accurate but "
+             "single threaded between its matrix-vector products.");
+    addValue("randomized", SVD_RANDOMIZED,
+             "Randomized SVD (Halko, Martinsson and Tropp).  The basis is "
+             "projected onto a few more random vectors than there are "
+             "singular values, followed by `numPowerIterations` power "
+             "iterations, and the SVD of the small projected matrix is "
+             "taken.  The products are multithreaded, and this is much "
+             "faster for large numbers of dense basis vectors at the cost of "
+             "some accuracy in the smallest singular values.");
+}
+
+std::pair<std::vector<double>, std::vector<std::vector<double> > >
+randomizedSvd(int n, int numSingularValues,
+              int oversampling, int numPowerIterations,
+              const std::function<void (const double * in, double * out,
+                                        int l)> & multiply)
+{
+    int k = std::min(numSingularValues, n);
+    int l = std::min(k + std::max(oversampling, 0), n);
+
+    // Matrices are n by l, column major as LAPACK wants them, so that each
+    // column is contiguous.
+
+    // Replace the columns of y by an orthonormal basis of their span
+    auto orthonormalize = [&] (std::vector<double> & y)
+        {
+            std::vector<double> s(l), u(n * l), vt(l * l);
+            int res = ML::LAPack::gesdd("S", n, l, &y[0], n, &s[0],
+                                        &u[0], n, &vt[0], l);
+            if (res != 0)
+                throw MLDB::Exception("gesdd returned %d in randomized SVD",
+                                      res);
+            y.swap(u);
+        };
+
+    // Random test matrix, with a fixed seed so that runs are repeatable
+    std::mt19937 rng(1);
+    std::normal_distribution<double> normal;
+    std::vector<double> q(n * l), y(n * l);
+    for (auto & v: q)
+        v = normal(rng);
+
+    multiply(&q[0], &y[0], l);
+    orthonormalize(y);
+    q.swap(y);
+
+    for (int i = 0;  i < numPowerIterations;  ++i) {
+        multiply(&q[0], &y[0], l);
+        orthonormalize(y);
+        q.swap(y);
+    }
+
+    // Project B onto the basis: t = Q' B Q, which is l by l
+    multiply(&q[0], &y[0], l);
+    std::vector<double> t(l * l);
+    parallelMap(0, l, [&] (size_t j)
+                {
+                    for (unsigned i = 0;  i < l;  ++i)
+                        t[j * l + i] = SIMD::vec_dotprod_dp
+                            (&q[i * n], &y[j * n], n);
+                });
+
+    // B is symmetric positive semi-definite, so the SVD of t gives its
+    // eigenvectors and eigenvalues in decreasing order
+    std::vector<double> eigenvalues(l), w(l * l), wt(l * l);
+    int res = ML::LAPack::gesdd("S", l, l, &t[0], l, &eigenvalues[0],
+                                &w[0], l, &wt[0], l);
+    if (res != 0)
+        throw MLDB::Exception("gesdd returned %d in randomized SVD", res);
+
+    // Right singular vectors are V = Q W
+    std::vector<double> v(n * k);
+    ML::LAPack::gemm('N', 'N', n, k, l, 1.0, &q[0], n, &w[0], l,
+                     0.0, &v[0], n);
+
+    std::pair<std::vector<double>, std::vector<std::vector<double> > > result;
+    for (unsigned j = 0;  j < k;  ++j) {
+        result.first.push_back(sqrt(eigenvalues[j]));
+        result.second.emplace_back(&v[j * n], &v[j * n] + n);
+    }
+
+    return result;
+}
+
 
 static inline int rowToBucket(uint64_t rowHash)
 {
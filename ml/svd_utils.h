@@ -12,6 +12,8 @@
 #include "mldb/types/hash_wrapper.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/base/exc_assert.h"
+#include <functional>
+#include <vector>
 
 namespace MLDB {
 
@@ -23,6 +25,32 @@ enum SvdSpace {
 
 DECLARE_ENUM_DESCRIPTION(SvdSpace);
 
+/** Which solver calculates the singular vectors of a dense basis. */
+enum SvdSolver {
+    SVD_LANCZOS,     ///< Lanczos iterations of svdlibc
+    SVD_RANDOMIZED   ///< Randomized range finder of Halko et al
+};
+
+DECLARE_ENUM_DESCRIPTION(SvdSolver);
+
+/** Randomized SVD (Halko, Martinsson and Tropp) of a matrix A that's only
+    seen through its n by n correlation matrix B = A'A, like svdlibc's
+    svdLAS2A() with its opb function.
+
+    multiply(in, out, l) must set out = B * in, where in and out are n by
+    l and column major.  It's called numPowerIterations + 2 times, and
+    should be parallel itself; the rest is done in parallel here.
+
+    Returns the first numSingularValues singular values of A (the square
+    roots of the eigenvalues of B), and the right singular vectors one
+    after the other.
+*/
+std::pair<std::vector<double>, std::vector<std::vector<double> > >
+randomizedSvd(int n, int numSingularValues,
+              int oversampling, int numPowerIterations,
+              const std::function<void (const double * in, double * out,
+                                        int l)> & multiply);
+
 
 int
 intersectionCountBasic(const uint16_t * it1, const uint16_t * end1,
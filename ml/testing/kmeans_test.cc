@@ -15,6 +15,8 @@
 #include "mldb/utils/testing/fixtures.h"
 #include <iostream>
 #include <stdlib.h>
+#include <random>
+#include <set>
 
 using namespace MLDB;
 using namespace ML;
@@ -103,3 +105,53 @@ BOOST_FIXTURE_TEST_CASE( test_kmeans, kmeans_test )
     test();
 
 }
+
+BOOST_AUTO_TEST_CASE( test_kmeans_algorithms )
+{
+    // Four well separated blobs
+    vector<distribution<float>> data;
+    int nbPerClass = 50;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-1.0, 1.0);
+    float centers[4][2] = { { 0, 5 }, { -20, 0 }, { 10, -20 }, { -20, -20 } };
+    for (int k = 0;  k < 4;  ++k) {
+        for (int i = 0;  i < nbPerClass;  ++i) {
+            distribution<float> point(2);
+            point[0] = centers[k][0] + noise(rng);
+            point[1] = centers[k][1] + noise(rng);
+            data.push_back(point);
+        }
+    }
+
+    auto train = [&] (KMeansAlgorithm algorithm,
+                      KMeansInitialization initialization,
+                      int nclusters)
+        {
+            KMeans kmeans(new KMeansEuclideanMetric());
+            kmeans.algorithm = algorithm;
+            kmeans.initialization = initialization;
+            kmeans.batchSize = 20;
+            vector<int> in_cluster;
+            kmeans.train(data, in_cluster, nclusters, 100);
+            return in_cluster;
+        };
+
+    // The bounds only skip distances; the clusters are exactly the same
+    BOOST_CHECK(train(KMEANS_HAMERLY, KMEANS_INIT_FARTHEST, 8)
+                == train(KMEANS_LLOYD, KMEANS_INIT_FARTHEST, 8));
+    BOOST_CHECK(train(KMEANS_HAMERLY, KMEANS_INIT_PARALLEL, 8)
+                == train(KMEANS_LLOYD, KMEANS_INIT_PARALLEL, 8));
+
+    // With the right number of clusters, each blob is found
+    for (auto algorithm: { KMEANS_LLOYD, KMEANS_HAMERLY, KMEANS_MINIBATCH }) {
+        auto in_cluster = train(algorithm, KMEANS_INIT_PARALLEL, 4);
+        std::set<int> seen;
+        for (int k = 0;  k < 4;  ++k) {
+            int cluster = in_cluster[k * nbPerClass];
+            seen.insert(cluster);
+            for (int i = 0;  i < nbPerClass;  ++i)
+                BOOST_CHECK_EQUAL(in_cluster[k * nbPerClass + i], cluster);
+        }
+        BOOST_CHECK_EQUAL(seen.size(), 4);
+    }
+}
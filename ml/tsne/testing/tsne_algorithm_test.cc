@@ -29,6 +29,7 @@
 #include "mldb/jml/utils/pair_utils.h"
 #include <iomanip>
 #include <set>
+#include <random>
 
 using namespace ML;
 using namespace std;
@@ -588,3 +589,45 @@ BOOST_AUTO_TEST_CASE( test_distance_to_probability_big )
 
 }
 #endif
+
+BOOST_AUTO_TEST_CASE( test_interpolated_repulsion )
+{
+    int nx = 1000;
+
+    std::mt19937 rng(1);
+    std::normal_distribution<float> normal(0.0, 5.0);
+
+    boost::multi_array<float, 2> Y(boost::extents[nx][2]);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        // Three clusters of different sizes
+        Y[x][0] = normal(rng) * (x % 3 + 1) * 0.5 + (x % 3) * 10;
+        Y[x][1] = normal(rng) * (x % 3 + 1) * 0.5 - (x % 3) * 5;
+    }
+
+    boost::multi_array<double, 2> FrepZ(boost::extents[nx][2]);
+    double Z = tsneInterpolatedRepulsion(Y, 50, FrepZ);
+
+    double exactZ = 0.0, maxFrep = 0.0, maxError = 0.0;
+    for (unsigned x = 0;  x < nx;  ++x) {
+        double exactFrepZ[2] = { 0.0, 0.0 };
+        for (unsigned j = 0;  j < nx;  ++j) {
+            if (j == x)
+                continue;
+            double d0 = Y[x][0] - Y[j][0], d1 = Y[x][1] - Y[j][1];
+            double q = 1.0 / (1.0 + d0 * d0 + d1 * d1);
+            exactZ += q;
+            exactFrepZ[0] += q * q * d0;
+            exactFrepZ[1] += q * q * d1;
+        }
+        for (unsigned i = 0;  i < 2;  ++i) {
+            maxFrep = std::max(maxFrep, fabs(exactFrepZ[i]));
+            maxError = std::max(maxError, fabs(exactFrepZ[i] - FrepZ[x][i]));
+        }
+    }
+
+    cerr << "Z " << Z << " exact " << exactZ << " max Frep error "
+         << maxError << " of " << maxFrep << endl;
+
+    BOOST_CHECK_CLOSE(Z, exactZ, 0.1 /* percent */);
+    BOOST_CHECK_LT(maxError, 0.01 * maxFrep);
+}
@@ -16,13 +16,14 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/ml/algebra/matrix_ops.h"
 #include "mldb/arch/simd_vector.h"
-#include "mldb/arch/spinlock.h"
 
 #include "mldb/ml/algebra/lapack.h"
 #include <cmath>
 #include <random>
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
+#include "mldb/base/scope.h"
+#include "mldb/ext/pffft/pffft.h"
 #include <boost/timer.hpp>
 #include "mldb/arch/timers.h"
 #if MLDB_INTEL_ISA
@@ -1685,6 +1686,245 @@ void calcRep(const QuadtreeNode & node,
     context.calc(node, depth, inside, pointsOfInterest);
 }
 
+namespace {
+
+/// Number of interpolation nodes in each interval of the grid
+constexpr int INTERP_NODES = 3;
+
+/** Smallest number of intervals >= n for which the FFT of the padded
+    grid (2 * INTERP_NODES * n points) is a size that pffft can do: a
+    multiple of 16 with no prime factors other than 2, 3 and 5.
+*/
+int fftFriendlyIntervals(int n)
+{
+    for (;;  ++n) {
+        if (n % 8 != 0)
+            continue;
+        int m = n;
+        for (int f: { 2, 3, 5 })
+            while (m % f == 0)
+                m /= f;
+        if (m == 1)
+            return n;
+    }
+}
+
+/** In-place FFT of an n x n grid of complex numbers, stored as
+    interleaved real and imaginary parts, by transforming the rows and
+    then the columns in parallel.  The backward transform is not scaled.
+*/
+void fft2d(PFFFT_Setup * setup, float * data, int n,
+           pffft_direction_t direction)
+{
+    auto doRows = [&] (size_t first, size_t last)
+        {
+            float * work = (float *)pffft_aligned_malloc(n * 2 * sizeof(float));
+            Scope_Exit(pffft_aligned_free(work));
+
+            for (size_t i = first;  i < last;  ++i) {
+                float * row = data + i * n * 2;
+                pffft_transform_ordered(setup, row, row, work, direction);
+            }
+        };
+
+    auto doColumns = [&] (size_t first, size_t last)
+        {
+            float * work = (float *)pffft_aligned_malloc(n * 4 * sizeof(float));
+            Scope_Exit(pffft_aligned_free(work));
+            float * column = work + n * 2;
+
+            for (size_t j = first;  j < last;  ++j) {
+                for (int i = 0;  i < n;  ++i) {
+                    column[i * 2] = data[(i * n + j) * 2];
+                    column[i * 2 + 1] = data[(i * n + j) * 2 + 1];
+                }
+                pffft_transform_ordered(setup, column, column, work, direction);
+                for (int i = 0;  i < n;  ++i) {
+                    data[(i * n + j) * 2] = column[i * 2];
+                    data[(i * n + j) * 2 + 1] = column[i * 2 + 1];
+                }
+            }
+        };
+
+    size_t grain = MLDB::parallelGrainSize(n, 8);
+    MLDB::parallelMapChunked(0, n, grain, doRows);
+    MLDB::parallelMapChunked(0, n, grain, doColumns);
+}
+
+} // file scope
+
+double
+tsneInterpolatedRepulsion(const boost::multi_array<float, 2> & Y,
+                          int minIntervals,
+                          boost::multi_array<double, 2> & FrepZ)
+{
+    int nx = Y.shape()[0];
+    ExcAssertEqual(Y.shape()[1], 2);
+
+    // The grid is a square covering all of the points, with its center
+    // used as the origin of the charges so that they stay small.
+    float minc = INFINITY, maxc = -INFINITY;
+    for (unsigned x = 0;  x < nx;  ++x) {
+        for (unsigned i = 0;  i < 2;  ++i) {
+            minc = std::min(minc, Y[x][i]);
+            maxc = std::max(maxc, Y[x][i]);
+        }
+    }
+    double center = 0.5 * (minc + maxc);
+    double width = std::max<double>(maxc - minc, 1e-5) * (1.0 + 1e-5);
+    double lo = center - 0.5 * width;
+
+    // The kernel varies on a unit scale, and intervals of half that keep
+    // the interpolation error well under 1%.  Past 256 intervals the FFTs
+    // get too expensive for what they gain.
+    int numIntervals
+        = fftFriendlyIntervals(std::max(minIntervals,
+                                        std::min<int>(ceil(2.0 * width), 256)));
+    double h = width / numIntervals;
+    int G = numIntervals * INTERP_NODES;   // grid points per dimension
+    int N = 2 * G;                         // padded for a linear convolution
+    double spacing = h / INTERP_NODES;
+
+    // Position of the interpolation nodes within an interval, in units of h
+    double nodePos[INTERP_NODES];
+    for (int k = 0;  k < INTERP_NODES;  ++k)
+        nodePos[k] = (k + 0.5) / INTERP_NODES;
+
+    // For each point and dimension, the first grid point it interpolates
+    // from and the Lagrange weights for it and the following ones.
+    std::vector<int> firstNode(nx * 2);
+    std::vector<float> weights(nx * 2 * INTERP_NODES);
+
+    auto calcWeights = [&] (size_t x)
+        {
+            for (unsigned i = 0;  i < 2;  ++i) {
+                double u = (Y[x][i] - lo) / h;
+                int box = std::min<int>(u, numIntervals - 1);
+                u -= box;
+                firstNode[x * 2 + i] = box * INTERP_NODES;
+                float * w = &weights[(x * 2 + i) * INTERP_NODES];
+                for (int k = 0;  k < INTERP_NODES;  ++k) {
+                    double l = 1.0;
+                    for (int m = 0;  m < INTERP_NODES;  ++m) {
+                        if (m != k)
+                            l *= (u - nodePos[m]) / (nodePos[k] - nodePos[m]);
+                    }
+                    w[k] = l;
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, nx, calcWeights);
+
+    PFFFT_Setup * setup = pffft_new_setup(N, PFFFT_COMPLEX);
+    if (!setup)
+        throw MLDB::Exception("tsneInterpolatedRepulsion(): couldn't set up "
+                              "FFT of size %d", N);
+    Scope_Exit(pffft_destroy_setup(setup));
+
+    auto allocGrid = [&] ()
+        {
+            float * grid = (float *)pffft_aligned_malloc(N * N * 2 * sizeof(float));
+            std::fill(grid, grid + N * N * 2, 0.0f);
+            return std::shared_ptr<float>(grid, pffft_aligned_free);
+        };
+
+    // Transform of the kernel 1 / (1 + d^2)^2, circularly embedded so that
+    // negative offsets wrap around.
+    std::shared_ptr<float> kernel = allocGrid();
+    for (int i = 0;  i < N;  ++i) {
+        double di = (i < G ? i : i - N) * spacing;
+        for (int j = 0;  j < N;  ++j) {
+            double dj = (j < G ? j : j - N) * spacing;
+            double q = 1.0 / (1.0 + di * di + dj * dj);
+            kernel.get()[(i * N + j) * 2] = q * q;
+        }
+    }
+    fft2d(setup, kernel.get(), N, PFFFT_FORWARD);
+
+    // Four sets of charges (1, y0, y1, |y|^2) give everything we need
+    // from the one kernel:
+    //   sum_j q^2 (y[x] - y[j]) = y[x] phi0 - phi_{1,2}
+    //   sum_j q = sum_j q^2 (1 + |y[x]|^2 - 2 y[x].y[j] + |y[j]|^2)
+    constexpr int NCHARGES = 4;
+    std::shared_ptr<float> potentials[NCHARGES];
+
+    auto charge = [&] (int x, int c) -> double
+        {
+            double y0 = Y[x][0] - center, y1 = Y[x][1] - center;
+            switch (c) {
+            case 0: return 1.0;
+            case 1: return y0;
+            case 2: return y1;
+            default: return y0 * y0 + y1 * y1;
+            }
+        };
+
+    auto doCharge = [&] (size_t c)
+        {
+            potentials[c] = allocGrid();
+            float * grid = potentials[c].get();
+
+            // Spread the charges onto the grid nodes around each point
+            for (unsigned x = 0;  x < nx;  ++x) {
+                double q = charge(x, c);
+                const float * w0 = &weights[(x * 2) * INTERP_NODES];
+                const float * w1 = &weights[(x * 2 + 1) * INTERP_NODES];
+                int n0 = firstNode[x * 2], n1 = firstNode[x * 2 + 1];
+                for (int k0 = 0;  k0 < INTERP_NODES;  ++k0)
+                    for (int k1 = 0;  k1 < INTERP_NODES;  ++k1)
+                        grid[((n0 + k0) * N + n1 + k1) * 2]
+                            += q * w0[k0] * w1[k1];
+            }
+
+            // Convolve with the kernel
+            fft2d(setup, grid, N, PFFFT_FORWARD);
+            const float * k = kernel.get();
+            for (size_t i = 0;  i < N * N;  ++i) {
+                float re = grid[i * 2] * k[i * 2] - grid[i * 2 + 1] * k[i * 2 + 1];
+                float im = grid[i * 2] * k[i * 2 + 1] + grid[i * 2 + 1] * k[i * 2];
+                grid[i * 2] = re;
+                grid[i * 2 + 1] = im;
+            }
+            fft2d(setup, grid, N, PFFFT_BACKWARD);
+        };
+
+    MLDB::parallelMap(0, NCHARGES, doCharge);
+
+    double scale = 1.0 / ((double)N * N);
+
+    // Interpolate the potentials back from the grid to the points
+    auto calcPoint = [&] (double & Z, size_t x)
+        {
+            double phi[NCHARGES] = { 0.0, 0.0, 0.0, 0.0 };
+            const float * w0 = &weights[(x * 2) * INTERP_NODES];
+            const float * w1 = &weights[(x * 2 + 1) * INTERP_NODES];
+            int n0 = firstNode[x * 2], n1 = firstNode[x * 2 + 1];
+            for (int k0 = 0;  k0 < INTERP_NODES;  ++k0) {
+                for (int k1 = 0;  k1 < INTERP_NODES;  ++k1) {
+                    size_t node = ((n0 + k0) * N + n1 + k1) * 2;
+                    double w = w0[k0] * w1[k1] * scale;
+                    for (int c = 0;  c < NCHARGES;  ++c)
+                        phi[c] += w * potentials[c].get()[node];
+                }
+            }
+
+            double y0 = Y[x][0] - center, y1 = Y[x][1] - center;
+            FrepZ[x][0] = y0 * phi[0] - phi[1];
+            FrepZ[x][1] = y1 * phi[0] - phi[2];
+            Z += (1.0 + y0 * y0 + y1 * y1) * phi[0]
+                - 2.0 * (y0 * phi[1] + y1 * phi[2]) + phi[3];
+        };
+
+    double Z = MLDB::parallelReduce(0, nx, 0.0, calcPoint,
+                                    [] (double & into, double & from)
+                                    { into += from; },
+                                    256);
+
+    // Remove the contribution of each point to itself
+    return Z - nx;
+}
+
 boost::multi_array<float, 2>
 tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                      int num_dims,
@@ -1729,6 +1969,9 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
     bool forceExactSolution = false;
     //forceExactSolution = true;
 
+    // Do we interpolate the repulsive forces instead of using Barnes-Hut?
+    bool interpolate = params.repulsion == TSNE_INTERPOLATION && nd == 2;
+
     // Z * Frep
     boost::multi_array<double, 2> FrepZ(boost::extents[nx][nd]);
 
@@ -1829,13 +2072,13 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 #endif     
    
         // Create a new coordinate for each neighbour
-        std::vector<QCoord> pointCoords(nx);
+        std::vector<QCoord> pointCoords(interpolate ? 0 : nx);
 
-        for (unsigned i = 0;  i < nx;  ++i) {
+        for (unsigned i = 0;  i < pointCoords.size();  ++i) {
             pointCoords[i] = QCoord(&Y[i][0], &Y[i][0] + nd);
         }
 
-        Quadtree & qtree = updateQtree();
+        Quadtree * qtree = interpolate ? nullptr : &updateQtree();
 
         // This accumulates the sum_j p[x][j] log Z*q[x][j] for each example.  From this and
         // Z, we can calculate the cost of each example.  Only relevant if calcC is true.
@@ -1850,10 +2093,15 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         bool calcC = iter < 10 || (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
         //calcC = true;
 
-        // Approximation for Z, accumulated here
-        Spinlock Zmutex;
-        std::vector<double> ZApproxValues;
-        ZApproxValues.reserve(nx);
+        // Approximation for Z, accumulated here for each example
+        std::vector<double> exampleZs(nx, 0.0);
+
+        // When interpolating, the repulsive forces and Z are calculated
+        // up front for all of the examples.
+        double ZInterpolated = 0.0;
+        if (interpolate)
+            ZInterpolated = tsneInterpolatedRepulsion
+                (Y, params.min_num_intervals, FrepZ);
 
 
         auto calcExample = [&] (int x)
@@ -1861,7 +2109,8 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                 // Clear the updates
                 for (unsigned i = 0;  i < nd;  ++i) {
                     dY[x][i] = 0.0;
-                    FrepZ[x][i] = 0.0;
+                    if (!interpolate)
+                        FrepZ[x][i] = 0.0;
                     FattrApprox[x][i] = 0.0;
                     FrepApprox[x][i] = 0.0;
                 }
@@ -1901,6 +2150,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
                     double factorAttr = pFactor * neighbours.probs[q] / (1.0 + D);
 
+                    // Without the quadtree, the cost is calculated exactly
+                    // from the neighbour distances.
+                    if (interpolate && calcC)
+                        exampleCFactorPtr[x]
+                            -= pFactor * neighbours.probs[q] * log1p(D);
+
                     if (nd == 2) {
                         float dYj0 = y[0] - Y[j][0];
                         float dYj1 = y[1] - Y[j][1];
@@ -1915,6 +2170,9 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     }
                 }
 
+                if (interpolate)
+                    return;
+
                 // Working storage for onNode
                 distribution<double> com(nd);
 
@@ -1967,7 +2225,7 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     for (unsigned i = 0;  i < neighbours.indexes.size();  ++i)
                         pointsOfInterest.push_back(i);
 
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtree->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             onNode, pointsOfInterest, getPointCoord,
                             params.min_distance_ratio);
@@ -1985,15 +2243,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     //    cerr << "x = " << x << " factor " << exampleCFactor[x] << endl;
                     ExcAssert(isfinite(exampleCFactorPtr[x]));
                 } else {
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtree->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             nullptr, {}, nullptr, params.min_distance_ratio);
                 }
 
-                {
-                    std::unique_lock<Spinlock> guard(Zmutex);
-                    ZApproxValues.push_back(exampleZ);
-                }
+                exampleZs[x] = exampleZ;
 
                 //if (x == 1026)
                 //    cerr << "touched " << nodesTouched << " of " << numNodes << " nodes"
@@ -2001,26 +2256,16 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
             };
 
 #if 1
-        int totalThreads = std::max(1, std::min(16, MLDB::numCpus() / 2));
-
-        auto doThread = [&] (int n)
+        // Chunks are small enough that the thread pool can even out
+        // the uneven work of the examples in dense and sparse regions.
+        auto doChunk = [&] (size_t first, size_t last)
             {
-                int perThread = nx / totalThreads;
-                int start = n * perThread;
-                int end = start + perThread;
-                if (n == totalThreads)
-                    end = nx;
-
-                for (unsigned x = start;  x < end;  ++x)
+                for (size_t x = first;  x < last;  ++x)
                     calcExample(x);
-
-                //for (unsigned x = n;  x < nx;  x += totalThreads) {
-                //    calcExample(x);
-                //}
             };
 
-        MLDB::parallelMap(0, totalThreads, doThread);
-        //parallelMap(0, nx, calcExample);
+        MLDB::parallelMapChunked(0, nx, MLDB::parallelGrainSize(nx, 64),
+                                 doChunk);
 #else
         // Each example proceeds more or less independently
         for (unsigned x = 0;  x < nx;  ++x) {
@@ -2029,12 +2274,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 #endif
 
         // Sort from smallest to largest to accumulate.  This minimises
-        // rounding errors and makes the result independent of the order
-        // in which threads finish.
-        std::sort(ZApproxValues.begin(), ZApproxValues.end());
-        double ZApprox = std::accumulate(ZApproxValues.begin(),
-                                         ZApproxValues.end(),
-                                         0.0);
+        // rounding errors.
+        double ZApprox = ZInterpolated;
+        if (!interpolate) {
+            std::sort(exampleZs.begin(), exampleZs.end());
+            ZApprox = std::accumulate(exampleZs.begin(), exampleZs.end(), 0.0);
+        }
 
         ExcAssert(isfinite(ZApprox));
         ExcAssertNotEqual(0.0, ZApprox);
@@ -2061,11 +2306,11 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
             double logZapprox = log(ZApprox);
             double logpFactor = log(pFactor);
 
-            for (unsigned x = 0;  x < nx;  ++x) {
-
+            auto addExample = [&] (double & total, size_t x)
+            {
                 const TsneSparseProbs & neighbours = exampleNeighbours[x];
 
-                double CExample = -exampleCFactor[x];
+                double CExample = -exampleCFactorPtr[x];
 
                 //cerr << "CExample1 = " << CExample << endl;
 
@@ -2093,10 +2338,15 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
                 //cerr << "CExample2 = " << CExample << endl;
 
-                Capprox += CExample;
+                total += CExample;
 
-                ExcAssert(isfinite(Capprox));
-            }
+                ExcAssert(isfinite(total));
+            };
+
+            Capprox = MLDB::parallelReduce(0, nx, 0.0, addExample,
+                                           [] (double & into, double & from)
+                                           { into += from; },
+                                           1024);
         }
 
 #if 0  // exact calculations for verification        
@@ -118,6 +118,12 @@ distances_to_probabilities(boost::multi_array<float, 2> & D,
 boost::multi_array<float, 2>
 pca(boost::multi_array<float, 2> & coords, int num_dims = 50);
 
+/** How the repulsive forces of the approximate t-SNE are calculated. */
+enum TSNE_Repulsion {
+    TSNE_BARNES_HUT,      ///< Barnes-Hut approximation over a quadtree
+    TSNE_INTERPOLATION    ///< Interpolation onto a grid and FFT; 2D only
+};
+
 struct TSNE_Params {
     
     TSNE_Params()
@@ -133,7 +139,9 @@ struct TSNE_Params {
           min_gain(0.01),
           min_prob(1e-12),
           min_distance_ratio(0.6),
-          max_coord_change(0.0005)
+          max_coord_change(0.0005),
+          repulsion(TSNE_BARNES_HUT),
+          min_num_intervals(50)
     {
     }
 
@@ -153,6 +161,9 @@ struct TSNE_Params {
 
     double min_distance_ratio;  // 0 means never approximate; 1 means approximate everything
     double max_coord_change;    // stop once no coordinate has changed its relative pos by this
+
+    TSNE_Repulsion repulsion;   // how to approximate the repulsive forces
+    int min_num_intervals;      // minimum grid intervals per dim for TSNE_INTERPOLATION
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -188,6 +199,23 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & neighbours,
                      const TSNE_Callback & callback = TSNE_Callback(),
                      std::unique_ptr<Quadtree> * qtreeOut = nullptr);
 
+/** Calculate the (unnormalized) repulsive forces on each point of a two
+    dimensional embedding Y, as in FIt-SNE (Linderman et al, 2017,
+    https://arxiv.org/abs/1712.09005).  The kernel sums over all pairs
+    of points are approximated by polynomial interpolation onto an
+    equispaced grid of at least minIntervals intervals per dimension,
+    with the convolution of the grid by the kernel done with FFTs.  The
+    cost is linear in the number of points.
+
+    On return, FrepZ[x] holds sum_j (y[x] - y[j]) / (1 + |y[x] - y[j]|^2)^2,
+    which is Z times the repulsive force.  The return value is
+    Z = sum_{x != j} 1 / (1 + |y[x] - y[j]|^2).
+*/
+double
+tsneInterpolatedRepulsion(const boost::multi_array<float, 2> & Y,
+                          int minIntervals,
+                          boost::multi_array<double, 2> & FrepZ);
+
 boost::multi_array<float, 2>
 tsneApproxFromDense(const boost::multi_array<float, 2> & probs,
                     int num_dims,
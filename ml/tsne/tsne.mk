@@ -8,7 +8,7 @@ LIBTSNE_SOURCES := \
         tsne.cc \
 	quadtree.cc
 
-LIBTSNE_LINK :=	utils algebra arch stats
+LIBTSNE_LINK :=	utils algebra arch stats pffft
 
 $(eval $(call library,tsne,$(LIBTSNE_SOURCES),$(LIBTSNE_LINK)))
 
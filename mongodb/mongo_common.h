@@ -20,7 +20,6 @@ namespace MLDB {
 struct CellValue;
 struct PathElement;
 struct ExpressionValue;
-typedef std::vector<std::tuple<PathElement, ExpressionValue>> StructValue;
 
 namespace Mongo {
 
@@ -3,20 +3,25 @@
  * Mich, 2016-08-05
  * This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
  **/
+#include <map>
 #include <memory>
+#include <set>
 #include <thread>
 #include <mutex>
 
 #include "bsoncxx/oid.hpp"
 #include "bsoncxx/builder/stream/document.hpp"
 #include "bsoncxx/builder/stream/array.hpp"
+#include "bsoncxx/builder/core.hpp"
 #include "mongocxx/client.hpp"
+#include "mongocxx/options/find.hpp"
 
 #include "mldb/core/function.h"
 #include "mldb/core/dataset.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/sql/sql_expression_operations.h"
 
 #include "mongo_common.h"
 
@@ -28,6 +33,213 @@ namespace Mongo {
 
 typedef tuple<Path, CellValue, Date> Cell;
 
+typedef bsoncxx::stdx::optional<bsoncxx::document::value> MongoFilter;
+
+/// Name of a field in MongoDB's dot notation, or empty if the column
+/// can't be queried by MongoDB
+static string toMongoField(const SqlExpression & expr)
+{
+    auto column = dynamic_cast<const ReadColumnExpression *>(&expr);
+    if (!column || column->columnName.empty())
+        return "";
+
+    string result;
+    for (auto & el: column->columnName) {
+        string name = el.toUtf8String().rawString();
+        if (name.empty() || name[0] == '$' || name.find('.') != string::npos)
+            return "";
+        result += (result.empty() ? "" : ".") + name;
+    }
+
+    // The _id is an ObjectId in MongoDB, but a string in MLDB
+    if (result == "_id")
+        return "";
+    return result;
+}
+
+/// Append the value of a constant, if it is a number or a string
+static bool appendMongoValue(bsoncxx::builder::core & builder,
+                             const SqlExpression & expr)
+{
+    auto constant = dynamic_cast<const ConstantExpression *>(&expr);
+    if (!constant || !constant->constant.isAtom())
+        return false;
+    CellValue value = constant->constant.getAtom();
+    switch (value.cellType()) {
+    case CellValue::INTEGER:
+        if (!value.isInt64())
+            return false;
+        builder.append((int64_t)value.toInt());
+        return true;
+    case CellValue::FLOAT:
+        builder.append(value.toDouble());
+        return true;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        builder.append(value.toUtf8String().rawString());
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// Filter {field: {op: value}}
+static MongoFilter
+makeMongoComparison(const string & field, const string & op,
+                    const SqlExpression & value)
+{
+    bsoncxx::builder::core builder(false);
+    builder.key_owned(field);
+    builder.open_document();
+    builder.key_owned(op);
+    if (!appendMongoValue(builder, value))
+        return {};
+    builder.close_document();
+    return builder.extract_document();
+}
+
+/** Translate a WHERE expression into a MongoDB filter that matches at
+    least the documents that it's true for, so that only those are
+    transferred; the expression is still evaluated on them.  Comparisons,
+    BETWEEN, IN and IS [NOT] NULL between columns and numbers or strings,
+    combined with AND and OR, are supported.  As in MongoDB, comparisons
+    between values of different types never match.  Returns no filter if
+    the expression can't be translated.
+*/
+static MongoFilter toMongoFilter(const SqlExpression & expr)
+{
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&expr)) {
+        // Put the column on the left
+        static const map<string, pair<string, string> > ops = {
+            { "=", { "$eq", "$eq" } }, { "==", { "$eq", "$eq" } },
+            { "!=", { "$ne", "$ne" } }, { "<>", { "$ne", "$ne" } },
+            { "<", { "$lt", "$gt" } }, { "<=", { "$lte", "$gte" } },
+            { ">", { "$gt", "$lt" } }, { ">=", { "$gte", "$lte" } } };
+        auto op = ops.find(comparison->op);
+        if (op == ops.end())
+            return {};
+        string field = toMongoField(*comparison->lhs);
+        const SqlExpression * value = comparison->rhs.get();
+        string mongoOp = op->second.first;
+        if (field.empty()) {
+            field = toMongoField(*comparison->rhs);
+            value = comparison->lhs.get();
+            mongoOp = op->second.second;
+        }
+        if (field.empty())
+            return {};
+
+        if (mongoOp != "$ne")
+            return makeMongoComparison(field, mongoOp, *value);
+
+        // $ne also matches missing fields, which are NULL in MLDB
+        bsoncxx::builder::core builder(false);
+        builder.key_owned(field);
+        builder.open_document();
+        builder.key_owned("$nin");
+        builder.open_array();
+        if (!appendMongoValue(builder, *value))
+            return {};
+        builder.append(bsoncxx::types::b_null{});
+        builder.close_array();
+        builder.close_document();
+        return builder.extract_document();
+    }
+    if (auto boolean = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+        if ((boolean->op != "AND" && boolean->op != "OR") || !boolean->lhs)
+            return {};
+        MongoFilter lhs = toMongoFilter(*boolean->lhs);
+        MongoFilter rhs = toMongoFilter(*boolean->rhs);
+
+        // Either side of an AND is enough to narrow it down
+        if (boolean->op == "AND" && (!lhs || !rhs))
+            return lhs ? std::move(lhs) : std::move(rhs);
+        if (!lhs || !rhs)
+            return {};
+
+        bsoncxx::builder::core builder(false);
+        builder.key_owned(boolean->op == "AND" ? "$and" : "$or");
+        builder.open_array();
+        builder.append(bsoncxx::types::b_document{lhs->view()});
+        builder.append(bsoncxx::types::b_document{rhs->view()});
+        builder.close_array();
+        return builder.extract_document();
+    }
+    if (auto isType = dynamic_cast<const IsTypeExpression *>(&expr)) {
+        string field = toMongoField(*isType->expr);
+        if (isType->type != "null" || field.empty())
+            return {};
+        bsoncxx::builder::core builder(false);
+        builder.key_owned(field);
+        if (isType->notType) {
+            builder.open_document();
+            builder.key_owned("$ne");
+            builder.append(bsoncxx::types::b_null{});
+            builder.close_document();
+        }
+        else builder.append(bsoncxx::types::b_null{});
+        return builder.extract_document();
+    }
+    if (auto between = dynamic_cast<const BetweenExpression *>(&expr)) {
+        string field = toMongoField(*between->expr);
+        if (between->notBetween || field.empty())
+            return {};
+        bsoncxx::builder::core builder(false);
+        builder.key_owned(field);
+        builder.open_document();
+        builder.key_owned("$gte");
+        if (!appendMongoValue(builder, *between->lower))
+            return {};
+        builder.key_owned("$lte");
+        if (!appendMongoValue(builder, *between->upper))
+            return {};
+        builder.close_document();
+        return builder.extract_document();
+    }
+    if (auto in = dynamic_cast<const InExpression *>(&expr)) {
+        string field = toMongoField(*in->expr);
+        if (in->isNegative || in->kind != InExpression::TUPLE || field.empty())
+            return {};
+        bsoncxx::builder::core builder(false);
+        builder.key_owned(field);
+        builder.open_document();
+        builder.key_owned("$in");
+        builder.open_array();
+        for (auto & c: in->tuple->clauses) {
+            if (!appendMongoValue(builder, *c))
+                return {};
+        }
+        builder.close_array();
+        builder.close_document();
+        return builder.extract_document();
+    }
+    return {};
+}
+
+/** Projection that only returns the _id and the top level fields that the
+    given columns are in, or none if a field can't be named in one.
+*/
+static MongoFilter
+makeMongoProjection(const vector<ColumnPath> & columns)
+{
+    bsoncxx::builder::core builder(false);
+    builder.key_owned("_id");
+    builder.append((int32_t)1);
+    set<string> fields;
+    for (auto & c: columns) {
+        if (c.empty())
+            return {};
+        string field = c[0].toUtf8String().rawString();
+        if (field.empty() || field[0] == '$' || field.find('.') != string::npos)
+            return {};
+        if (field != "_id" && fields.insert(field).second) {
+            builder.key_owned(field);
+            builder.append((int32_t)1);
+        }
+    }
+    return builder.extract_document();
+}
+
 struct MongoMatrixView : MatrixView {
 
     vector<Path> getRowPaths(ssize_t start = 0,
@@ -196,8 +408,27 @@ struct MongoDataset: Dataset {
         MongoScope mongoScope(server);
         const auto whereBound = where.bind(mongoScope);
 
+        // Only transfer the documents that may match, and only the fields
+        // that the WHERE clause reads
+        MongoFilter filter;
+        mongocxx::options::find opts;
+        if (useWhere)
+            filter = toMongoFilter(where);
+        UnboundEntities unbound = where.getUnbound();
+        if (unbound.wildcards.empty() && unbound.tables.empty()
+            && !unbound.hasRowFunctions()) {
+            vector<ColumnPath> columns;
+            for (auto & v: unbound.vars)
+                columns.push_back(v.first);
+            if (MongoFilter projection = makeMongoProjection(columns))
+                opts.projection(std::move(*projection));
+        }
+
         using mongocxx::cursor;
-        shared_ptr<cursor> res(new cursor(connFindAll.db[collection].find({})));
+        shared_ptr<cursor> res(new cursor(
+            filter
+            ? connFindAll.db[collection].find(filter->view(), opts)
+            : connFindAll.db[collection].find(bsoncxx::document::view(), opts)));
         shared_ptr<cursor::iterator> it(new cursor::iterator(res->begin()));
 
         return {[=] (ssize_t numToGenerate, Any token,
@@ -234,6 +465,23 @@ struct MongoDataset: Dataset {
     }
 
     ExpressionValue getRowExpr(const Path & rowName) const override
+    {
+        return getRow(rowName, mongocxx::options::find());
+    }
+
+    /** Only transfer the fields that the query reads. */
+    ExpressionValue
+    getProjectedRowExpr(const Path & rowName,
+                        const vector<ColumnPath> & columns) const override
+    {
+        mongocxx::options::find opts;
+        if (MongoFilter projection = makeMongoProjection(columns))
+            opts.projection(std::move(*projection));
+        return getRow(rowName, opts);
+    }
+
+    ExpressionValue getRow(const Path & rowName,
+                           const mongocxx::options::find & opts) const
     {
         // This function is called by multiple threads. Connections are
         // allergic to threads so we must lock.
@@ -243,7 +491,7 @@ struct MongoDataset: Dataset {
         document queryDoc;
         queryDoc << "_id" << bsoncxx::oid(rowName.toUtf8String().rawString());
         {
-            auto cursor = connFindRow.db[collection].find(queryDoc.view());
+            auto cursor = connFindRow.db[collection].find(queryDoc.view(), opts);
             for (auto&& doc : cursor) {
                 auto oid = doc["_id"].get_oid();
                 Path rowName(oid.value.to_string());
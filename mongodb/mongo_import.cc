@@ -4,8 +4,14 @@
  * Mich, 2016-08-02
  * This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
  **/
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
 #include "bsoncxx/builder/stream/document.hpp"
+#include "bsoncxx/builder/core.hpp"
 #include "mongocxx/client.hpp"
+#include "mongocxx/options/find.hpp"
 #include "mongocxx/uri.hpp"
 
 #include "mldb/core/procedure.h"
@@ -14,6 +20,8 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 
 #include "mongo_common.h"
 
@@ -34,6 +42,7 @@ struct MongoImportConfig: ProcedureConfig {
 
     int64_t limit;
     int64_t offset;
+    int numPartitions;
     bool ignoreParsingErrors;
     SelectExpression select;
     std::shared_ptr<SqlExpression> where;
@@ -43,6 +52,7 @@ struct MongoImportConfig: ProcedureConfig {
         uriConnectionScheme(""),
         limit(-1),
         offset(0),
+        numPartitions(0),
         ignoreParsingErrors(false),
         select(SelectExpression::STAR),
         where(SqlExpression::TRUE),
@@ -72,6 +82,11 @@ MongoImportConfigDescription()
              "Maximum number of lines to process");
     addField("offset", &MongoImportConfig::offset,
              "Skip the first n lines.", int64_t(0));
+    addField("numPartitions", &MongoImportConfig::numPartitions,
+             "Number of ranges of `_id` that the collection is split into to "
+             "be read in parallel, each over its own connection.  The "
+             "default of 0 uses one per CPU.  The collection is read in a "
+             "single range when an offset or a limit is given.", 0);
     addField("ignoreParsingErrors", &MongoImportConfig::ignoreParsingErrors,
              "If true, any record causing an error will be skipped. Any "
              "record with BSON regex or BSON internal data type will cause an "
@@ -130,7 +145,6 @@ struct MongoImportProcedure: public Procedure {
                                     nullptr, true /*overwrite*/);
 
         MongoScope mongoScope(server);
-        ExpressionValue storage;
         const auto whereBound  = runConfig.where->bind(mongoScope);
         const auto selectBound = runConfig.select.bind(mongoScope);
         const auto namedBound  = runConfig.named->bind(mongoScope);
@@ -141,7 +155,7 @@ struct MongoImportProcedure: public Procedure {
         // using incorrect default value to ease check
         bool useNamed = config.named != SqlExpression::TRUE;
 
-        auto processor = [&](Dataset & output,
+        auto processor = [&](Recorder & recorder,
                              const bsoncxx::document::view & doc)
         {
             if (doc["_id"].type() != bsoncxx::type::k_oid) {
@@ -157,6 +171,7 @@ struct MongoImportProcedure: public Procedure {
             ExpressionValue expr(extract(ts, doc));
 
             if (useWhere || useSelect || useNamed) {
+                ExpressionValue storage;
                 MongoRowScope row(expr, oid.value.to_string());
                 if (useWhere && !whereBound(row, storage, GET_ALL).isTrue()) {
                     return;
@@ -172,15 +187,79 @@ struct MongoImportProcedure: public Procedure {
                 }
             }
 
-            output.recordRowExpr(rowName, expr);
+            recorder.recordRowExprDestructive(std::move(rowName), std::move(expr));
         };
 
-        auto offset = runConfig.offset;
-        auto limit = runConfig.limit;
-        int errors = 0;
-        size_t rowsInserted = 0;
+        // An offset or a limit needs a single ordered cursor
+        int numPartitions = runConfig.numPartitions > 0
+            ? runConfig.numPartitions : numCpus();
+        if (runConfig.offset > 0 || runConfig.limit >= 0)
+            numPartitions = 1;
+
+        // Split the collection into ranges of _id with the same number of
+        // documents, by finding the _id at each boundary in the index
+        std::vector<bsoncxx::oid> boundaries;
+        if (numPartitions > 1) {
+            using bsoncxx::builder::stream::document;
+            using bsoncxx::builder::stream::finalize;
+
+            int64_t count = db[runConfig.collection].count(bsoncxx::document::view());
+            for (int p = 1;  p < numPartitions && count > 0;  ++p) {
+                mongocxx::options::find opts;
+                opts.sort(document{} << "_id" << 1 << finalize);
+                opts.projection(document{} << "_id" << 1 << finalize);
+                opts.skip((int32_t)std::min<int64_t>(count * p / numPartitions,
+                                                     std::numeric_limits<int32_t>::max()));
+                opts.limit(1);
+                auto cursor = db[runConfig.collection].find(bsoncxx::document::view(), opts);
+                for (auto&& doc : cursor) {
+                    if (doc["_id"].type() != bsoncxx::type::k_oid) {
+                        throw HttpReturnException(
+                            500,
+                            "monbodb.import: unimplemented support for "
+                            "MongoDB records with key \"_id\" that are not "
+                            "ObjectIDs.");
+                    }
+                    auto oid = doc["_id"].get_oid().value;
+                    if (boundaries.empty() || oid != boundaries.back())
+                        boundaries.push_back(oid);
+                }
+            }
+        }
+
+        DEBUG_MSG(logger) << "Reading " << boundaries.size() + 1 << " ranges";
+
+        Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
+
+        std::atomic<int> errors(0);
+        std::atomic<size_t> rowsInserted(0);
+
+        auto doRange = [&] (size_t p)
         {
-            auto cursor = db[runConfig.collection].find({});
+            // Connections can't be shared between threads
+            mongocxx::client rangeConn(mongoUri);
+            auto rangeDb = rangeConn[mongoUri.database()];
+
+            bsoncxx::builder::core filter(false);
+            if (!boundaries.empty()) {
+                filter.key_owned("_id");
+                filter.open_document();
+                if (p > 0) {
+                    filter.key_owned("$gte");
+                    filter.append(bsoncxx::types::b_oid{boundaries[p - 1]});
+                }
+                if (p < boundaries.size()) {
+                    filter.key_owned("$lt");
+                    filter.append(bsoncxx::types::b_oid{boundaries[p]});
+                }
+                filter.close_document();
+            }
+
+            std::unique_ptr<Recorder> chunkRecorder = recorder.newChunk(p);
+
+            auto offset = runConfig.offset;
+            auto limit = runConfig.limit;
+            auto cursor = rangeDb[runConfig.collection].find(filter.view_document());
             for (auto&& doc : cursor) {
                 if (offset > 0) {
                     --offset;
@@ -198,29 +277,35 @@ struct MongoImportProcedure: public Procedure {
                 }
                 if (runConfig.ignoreParsingErrors) {
                     try {
-                        processor(*output.get(), doc);
+                        processor(*chunkRecorder, doc);
                     }
                     catch (const MLDB::Exception & exc) {
-                        ++ errors;
-                        if (errors <= 100) {
+                        int numErrors = ++errors;
+                        if (numErrors <= 100) {
                             logger->error() << exc.what();
                         }
-                        if (errors == 100) {
+                        if (numErrors == 100) {
                             logger->error() <<
                                 "100 errors logged, not logging them anymore.";
                         }
                     }
                 }
                 else {
-                    processor(*output.get(), doc);
+                    processor(*chunkRecorder, doc);
                 }
             }
-            DEBUG_MSG(logger) << "Fetched " << rowsInserted << " documents";
-        }
-        output->commit();
+
+            chunkRecorder->finishedChunk();
+        };
+
+        parallelMap(0, boundaries.size() + 1, doRange);
+
+        DEBUG_MSG(logger) << "Fetched " << rowsInserted << " documents";
+
+        recorder.commit();
         Json::Value res = jsonEncode(output->getStatus());
-        res["numParsingErrors"] = errors;
-        res["numInsertedRows"] = rowsInserted;
+        res["numParsingErrors"] = errors.load();
+        res["numInsertedRows"] = rowsInserted.load();
         return RunOutput(res);
     }
 };
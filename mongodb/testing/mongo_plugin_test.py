@@ -168,6 +168,32 @@ class MongodbPluginTest(MldbUnitTest):  # noqa
             }
         ])
 
+    @unittest.skipIf(not got_mongod, "mongod not available")
+    def test_import_partitioned(self):
+        # The collection is read in ranges of _id, in parallel
+        coll = self.pymongo_db.partitioned_coll
+        coll.insert_many([{'x' : i} for i in range(1000)])
+
+        for num_partitions in [1, 3, 16]:
+            res = mldb.post('/v1/procedures', {
+                'type' : 'mongodb.import',
+                'params' : {
+                    'uriConnectionScheme' : self.connection_scheme,
+                    'collection' : 'partitioned_coll',
+                    'numPartitions' : num_partitions,
+                    'outputDataset' : {
+                        'id' : 'partitioned_imported',
+                        'type' : 'sparse.mutable'
+                    }
+                }
+            }).json()
+            self.assertEqual(
+                res['status']['firstRun']['status']['numInsertedRows'], 1000)
+
+            res = mldb.query('SELECT count(*), sum(x), max(x) '
+                             'FROM partitioned_imported')
+            self.assertEqual(res[1][1:], [1000, 499500, 999])
+
     @unittest.skipIf(not got_mongod, "mongod not available")
     def test_import_oid(self):
         """
@@ -463,6 +489,47 @@ class MongodbPluginTest(MldbUnitTest):  # noqa
         res = mldb.query("SELECT username FROM ds WHERE type != 'simple'")
         self.assertEqual(len(res), 3)
 
+    @unittest.skipIf(not got_mongod, "mongod not available")
+    def test_dataset_pushdown(self):
+        # The WHERE clause and the columns that are read are sent to MongoDB;
+        # the results must be the same as when MLDB filters the rows.
+        coll = self.pymongo_db.pushdown_coll
+        for i in range(10):
+            coll.insert_one({'x' : i, 'name' : 'n%d' % i,
+                             'obj' : {'parity' : i % 2}})
+        coll.insert_one({'y' : 1})
+
+        mldb.put('/v1/datasets/pushdown_ds', {
+            'type' : 'mongodb.dataset',
+            'params' : {
+                'uriConnectionScheme' : self.connection_scheme,
+                'collection' : 'pushdown_coll',
+            }
+        })
+
+        def xs(where):
+            res = mldb.query(
+                'SELECT x FROM pushdown_ds WHERE {} ORDER BY x'.format(where))
+            return [r[1] for r in res[1:]]
+
+        self.assertEqual(xs('x > 6'), [7, 8, 9])
+        self.assertEqual(xs('3 >= x'), [0, 1, 2, 3])
+        self.assertEqual(xs('x > 2 AND x < 5'), [3, 4])
+        self.assertEqual(xs('x < 1 OR name = \'n9\''), [0, 9])
+        self.assertEqual(xs('x BETWEEN 4 AND 6'), [4, 5, 6])
+        self.assertEqual(xs('x IN (1, 3, 20)'), [1, 3])
+        self.assertEqual(xs('x != 5 AND x > 7'), [8, 9])
+        self.assertEqual(xs('x IS NULL'), [None])
+        self.assertEqual(xs('y IS NOT NULL'), [None])
+        self.assertEqual(xs('obj.parity = 1 AND x < 5'), [1, 3])
+
+        # Only part of the expression can be sent, the rest is done by MLDB
+        self.assertEqual(xs('x > 5 AND x % 2 = 0'), [6, 8])
+        self.assertEqual(xs('NOT (x > 1)'), [0, 1])
+
+        res = mldb.query('SELECT name FROM pushdown_ds WHERE x = 2')
+        self.assertEqual(res[1][1], 'n2')
+
     def test_dataset_missing_param(self):
         msg = 'uriConnectionScheme is a required property'
         with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
@@ -87,6 +87,14 @@ AccuracyConfigDescription()
               "test set is very large and aggregate statistics for each unique score is "
               "sufficient, for instance to generate a ROC curve. This has no effect "
               "for other values of `mode`.", false);
+    addField("scoreSignificantBits", &AccuracyConfig::scoreSignificantBits,
+              "If `mode` is `boolean` and `outputDataset` is not set, round "
+              "the scores to this many significant bits (from 1 to 24) before "
+              "calculating the statistics.  This merges thresholds that are "
+              "very close together, which keeps the memory used small when "
+              "the test set is very large and nearly all scores are "
+              "different, and changes the AUC by a very small amount.  The "
+              "default of 0 uses the exact scores.", 0);
     addField("recallOverN", &AccuracyConfig::accuracyOverN,
               "Calculate a recall score over the top scoring labels."
               "Does not apply to boolean or regression modes.");
@@ -131,44 +139,94 @@ runBoolean(AccuracyConfig & runAccuracyConf,
            std::shared_ptr<Dataset> output)
 {
 
-    PerThreadAccumulator<ScoredStats> accum;
     auto logger = MLDB::getMldbLog<AccuracyProcedure>();
 
-    auto processor = [&] (NamedRowValue & row,
-                          const std::vector<ExpressionValue> & scoreLabelWeight)
-        {
-            double score = scoreLabelWeight[0].toDouble();
-            bool label = scoreLabelWeight[1].asBool();
-            double weight = scoreLabelWeight[2].toDouble();
+    ScoredStats stats;
+    bool gotStuff = false;
 
-            TRACE_MSG(logger) << "score=" << score << "; label=" << label << "; weight=" << weight;
+    if (output) {
+        // Each example is written to the output, so we need to keep and
+        // sort all of them along with their row names.
+        PerThreadAccumulator<ScoredStats> accum;
 
-            accum.get().update(label, score, weight, row.rowName);
+        auto processor = [&] (NamedRowValue & row,
+                              const std::vector<ExpressionValue> & scoreLabelWeight)
+            {
+                double score = scoreLabelWeight[0].toDouble();
+                bool label = scoreLabelWeight[1].asBool();
+                double weight = scoreLabelWeight[2].toDouble();
 
-            return true;
-        };
+                TRACE_MSG(logger) << "score=" << score << "; label=" << label << "; weight=" << weight;
 
-    selectQuery.execute({processor,true/*processInParallel*/}, runAccuracyConf.testingData.stm->offset,
-             runAccuracyConf.testingData.stm->limit,
-             nullptr /* progress */);
+                accum.get().update(label, score, weight, row.rowName);
 
-    // Now merge out stats together
-    ScoredStats stats;
-    bool gotStuff = false;
+                return true;
+            };
+
+        selectQuery.execute({processor,true/*processInParallel*/}, runAccuracyConf.testingData.stm->offset,
+                 runAccuracyConf.testingData.stm->limit,
+                 nullptr /* progress */);
+
+        // Now merge out stats together
+        accum.forEach([&] (ScoredStats * thrStats)
+                      {
+                          gotStuff = true;
+                          thrStats->sort();
+                          stats.add(*thrStats);
+                      });
+
+        if (!gotStuff) {
+            throw MLDB::Exception(NO_DATA_ERR_MSG);
+        }
 
-    accum.forEach([&] (ScoredStats * thrStats)
-                  {
-                      gotStuff = true;
-                      thrStats->sort();
-                      stats.add(*thrStats);
-                  });
+        //stats.sort();
+        stats.calculate();
+    }
+    else {
+        // Only the aggregate stats are needed, so each thread simply
+        // counts the examples of each score, and nothing is sorted but
+        // the distinct scores.
+        int significantBits = runAccuracyConf.scoreSignificantBits;
+        if (significantBits < 0 || significantBits > 24)
+            throw HttpReturnException
+                (400, "scoreSignificantBits must be between 0 and 24",
+                 "scoreSignificantBits", significantBits);
+        PerThreadAccumulator<ScoreHistogram> accum
+            ([=] () { return new ScoreHistogram(significantBits); });
+
+        auto processor = [&] (NamedRowValue & row,
+                              const std::vector<ExpressionValue> & scoreLabelWeight)
+            {
+                double score = scoreLabelWeight[0].toDouble();
+                bool label = scoreLabelWeight[1].asBool();
+                double weight = scoreLabelWeight[2].toDouble();
 
-    if (!gotStuff) {
-        throw MLDB::Exception(NO_DATA_ERR_MSG);
+                TRACE_MSG(logger) << "score=" << score << "; label=" << label << "; weight=" << weight;
+
+                accum.get().update(label, score, weight);
+
+                return true;
+            };
+
+        selectQuery.execute({processor,true/*processInParallel*/}, runAccuracyConf.testingData.stm->offset,
+                 runAccuracyConf.testingData.stm->limit,
+                 nullptr /* progress */);
+
+        ScoreHistogram histogram(significantBits);
+
+        accum.forEach([&] (ScoreHistogram * thrHistogram)
+                      {
+                          gotStuff = true;
+                          histogram.add(*thrHistogram);
+                      });
+
+        if (!gotStuff) {
+            throw MLDB::Exception(NO_DATA_ERR_MSG);
+        }
+
+        stats = histogram.toScoredStats();
     }
 
-    //stats.sort();
-    stats.calculate();
     if(output) {
         const Date recordDate = Date::now();
 
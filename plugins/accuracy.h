@@ -35,6 +35,9 @@ struct AccuracyConfig : public ProcedureConfig {
 
     bool uniqueScoresOnly = false;
 
+    /// Significant bits of the scores to keep in boolean mode; 0 is exact
+    int scoreSignificantBits = 0;
+
     //check if label is among the 'N' top scores
     std::vector<size_t> accuracyOverN;
 
@@ -0,0 +1,191 @@
+/** arrow_export_procedure.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Procedure that exports the output of a query in the Apache Arrow format.
+*/
+
+#include "arrow_export_procedure.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/bound_queries.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/server/arrow_writer.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/plugins/sql_config_validator.h"
+#include "mldb/http/http_exception.h"
+
+using namespace std;
+
+
+namespace MLDB {
+
+DEFINE_STRUCTURE_DESCRIPTION(ArrowExportProcedureConfig);
+
+ArrowExportProcedureConfigDescription::
+ArrowExportProcedureConfigDescription()
+{
+    addField("exportData", &ArrowExportProcedureConfig::exportData,
+             "An SQL query to select the data to be exported.  This could "
+             "be any query on an existing dataset.");
+    addField("dataFileUrl", &ArrowExportProcedureConfig::dataFileUrl,
+             "URL where the Arrow file should be written to. If a file "
+             "already exists, it will be overwritten.");
+    addField("format", &ArrowExportProcedureConfig::format,
+             "Arrow format to write: `file` for the IPC file format (also "
+             "known as Feather version 2), which can be memory mapped "
+             "and read at random, or `stream` for the IPC streaming format, "
+             "which can be read in a single pass.", string("file"));
+    addField("rowsPerBatch", &ArrowExportProcedureConfig::rowsPerBatch,
+             "Maximum number of rows in each record batch of the output.  "
+             "The type of each column is chosen from the values in the "
+             "first batch.", (uint64_t)65536);
+    addField("skipDuplicateCells",
+             &ArrowExportProcedureConfig::skipDuplicateCells,
+             "The Arrow format cannot represent many values per cell the "
+             "way MLDB datasets can by using the time dimension. When this "
+             "parameter is set to `false`, an exception will be thrown "
+             "when the export procedure detects many values for the same "
+             "row/column pair.  When it's set to `true`, the last one is "
+             "kept.  Applying a temporal aggregator, like "
+             "`temporal_latest()`, to the values is another way to deal "
+             "with them.", false);
+
+    addParent<ProcedureConfig>();
+
+    onPostValidate = [&] (ArrowExportProcedureConfig * cfg,
+                          JsonParsingContext & context)
+    {
+        if (cfg->format != "file" && cfg->format != "stream") {
+            throw MLDB::Exception("format must be 'file' or 'stream'");
+        }
+        if (cfg->rowsPerBatch == 0) {
+            throw MLDB::Exception("rowsPerBatch must be greater than zero");
+        }
+        MustContainFrom()(cfg->exportData, ArrowExportProcedureConfig::name);
+    };
+}
+
+ArrowExportProcedure::
+ArrowExportProcedure(MldbServer * owner,
+                     PolyConfig config,
+                     const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    procedureConfig = config.params.convert<ArrowExportProcedureConfig>();
+}
+
+void
+exportQueryToArrow(MldbServer * server,
+                   const InputQuery & query,
+                   std::ostream & out,
+                   ArrowFormat format,
+                   size_t rowsPerBatch,
+                   bool skipDuplicateCells,
+                   const std::function<bool (const Json::Value &)> & onProgress)
+{
+    SqlExpressionMldbScope context(server);
+
+    ConvertProgressToJson convertProgressToJson(onProgress);
+    auto boundDataset = query.stm->from->bind(context, convertProgressToJson);
+
+    vector<shared_ptr<SqlExpression> > calc;
+    BoundSelectQuery bsq(query.stm->select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         query.stm->when,
+                         *query.stm->where,
+                         query.stm->orderBy,
+                         calc);
+
+    vector<ColumnPath> columnNames
+        = bsq.getSelectOutputInfo()->allAtomNames();
+
+    Lightweight_Hash<ColumnHash, int> columnIndex;
+    for (size_t i = 0;  i < columnNames.size();  ++i)
+        columnIndex[columnNames[i]] = i;
+
+    ArrowWriter writer(out, columnNames, format, rowsPerBatch);
+
+    auto outputRow = [&] (NamedRowValue & row_,
+                          const vector<ExpressionValue> & calc)
+    {
+        MatrixNamedRow row = row_.flattenDestructive();
+        vector<CellValue> values(columnNames.size());
+
+        for (auto & col: row.columns) {
+            const ColumnPath & columnName = std::get<0>(col);
+            auto it = columnIndex.find(columnName);
+            if (it == columnIndex.end()) {
+                throw HttpReturnException
+                    (400, "Column '" + columnName.toUtf8String()
+                     + "' of row '" + row.rowName.toUtf8String()
+                     + "' was not known when the export started.  Arrow "
+                     "export needs the columns of the query to be known "
+                     "in advance.",
+                     "column", columnName);
+            }
+
+            CellValue & value = values[it->second];
+            if (!value.empty() && !skipDuplicateCells) {
+                throw HttpReturnException
+                    (400, "Arrow export does not work over cells having "
+                     "multiple values, at row '" + row.rowName.toUtf8String()
+                     + "' for column '" + columnName.toUtf8String()
+                     + "'.  Set skipDuplicateCells to true or use a "
+                     "temporal aggregator.",
+                     "rowName", row.rowName,
+                     "column", columnName);
+            }
+            value = std::move(std::get<1>(col));
+        }
+
+        writer.addRow(values.data(), values.size());
+        return true;
+    };
+
+    bsq.execute({outputRow, false/*processInParallel*/},
+                query.stm->offset,
+                query.stm->limit,
+                convertProgressToJson);
+
+    writer.finish();
+}
+
+RunOutput
+ArrowExportProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
+
+    filter_ostream out(runProcConf.dataFileUrl);
+    exportQueryToArrow(server, runProcConf.exportData, out,
+                       runProcConf.format == "stream"
+                       ? ARROW_STREAM : ARROW_FILE,
+                       runProcConf.rowsPerBatch,
+                       runProcConf.skipDuplicateCells,
+                       onProgress);
+    out.close();
+
+    RunOutput output;
+    return output;
+}
+
+Any
+ArrowExportProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+static RegisterProcedureType<ArrowExportProcedure, ArrowExportProcedureConfig>
+regArrowExportProcedure(
+    builtinPackage(),
+    "Exports the output of a query to a target location as an Apache Arrow "
+    "or Feather file",
+    "procedures/ArrowExportProcedure.md.html");
+
+} // namespace MLDB
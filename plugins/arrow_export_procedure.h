@@ -0,0 +1,63 @@
+/** arrow_export_procedure.h                                       -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Procedure that exports the output of a query in the Apache Arrow format.
+*/
+
+#pragma once
+
+#include "mldb/core/procedure.h"
+#include "mldb/core/function.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/server/arrow_writer.h"
+
+
+namespace MLDB {
+
+struct ArrowExportProcedureConfig : ProcedureConfig {
+    ArrowExportProcedureConfig()
+        : format("file"), rowsPerBatch(65536), skipDuplicateCells(false)
+    {
+    }
+
+    static constexpr const char * name = "export.arrow";
+
+    InputQuery exportData;
+    Url dataFileUrl;
+    std::string format;
+    uint64_t rowsPerBatch;
+    bool skipDuplicateCells;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ArrowExportProcedureConfig);
+
+/** Run the query and write its output to the stream, in the given Arrow
+    format.  The other parameters are as in ArrowExportProcedureConfig.
+*/
+void exportQueryToArrow(MldbServer * server,
+                        const InputQuery & query,
+                        std::ostream & out,
+                        ArrowFormat format,
+                        size_t rowsPerBatch,
+                        bool skipDuplicateCells,
+                        const std::function<bool (const Json::Value &)> & onProgress);
+
+
+struct ArrowExportProcedure: public Procedure {
+
+    ArrowExportProcedure(
+        MldbServer * owner,
+        PolyConfig config,
+        const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(
+        const ProcedureRunConfig & run,
+        const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    ArrowExportProcedureConfig procedureConfig;
+};
+
+} // namespace MLDB
@@ -0,0 +1,234 @@
+/** background_compactor.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Background compaction of the recent writes to mutable datasets.
+*/
+
+#include "background_compactor.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/structure_description.h"
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COMPACTION CONFIG                                                         */
+/*****************************************************************************/
+
+CompactionConfig::
+CompactionConfig()
+    : enabled(true), maxPending(100000), maxAgeSeconds(30.0)
+{
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(CompactionConfig);
+
+CompactionConfigDescription::
+CompactionConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("enabled", &CompactionConfig::enabled,
+             "If true, recently recorded data is compacted in the background "
+             "into a form that is faster to read and to commit, without "
+             "blocking reads or writes.", true);
+    addField("maxPending", &CompactionConfig::maxPending,
+             "Compact once this many records have been written since the "
+             "last compaction.", (uint64_t)100000);
+    addField("maxAgeSeconds", &CompactionConfig::maxAgeSeconds,
+             "Compact once the oldest record that hasn't been compacted was "
+             "written this many seconds ago.  Zero means that compaction "
+             "only depends on `maxPending`.", 30.0);
+}
+
+
+/*****************************************************************************/
+/* COMPACTION STATS                                                          */
+/*****************************************************************************/
+
+CompactionStats::
+CompactionStats()
+    : numCompactions(0), numErrors(0), recordsCompacted(0),
+      pendingRecords(0), lastDurationSeconds(0), totalDurationSeconds(0)
+{
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(CompactionStats);
+
+CompactionStatsDescription::
+CompactionStatsDescription()
+{
+    addField("numCompactions", &CompactionStats::numCompactions,
+             "Number of background compactions that have finished");
+    addField("numErrors", &CompactionStats::numErrors,
+             "Number of background compactions that have failed");
+    addField("recordsCompacted", &CompactionStats::recordsCompacted,
+             "Number of records folded in by background compactions");
+    addField("pendingRecords", &CompactionStats::pendingRecords,
+             "Number of records written since the last compaction");
+    addField("lastDurationSeconds", &CompactionStats::lastDurationSeconds,
+             "Time taken by the last compaction");
+    addField("totalDurationSeconds", &CompactionStats::totalDurationSeconds,
+             "Time taken by all compactions");
+    addField("lastCompaction", &CompactionStats::lastCompaction,
+             "When the last compaction finished");
+    addField("lastError", &CompactionStats::lastError,
+             "Error message from the last compaction that failed");
+}
+
+
+/*****************************************************************************/
+/* BACKGROUND COMPACTOR                                                      */
+/*****************************************************************************/
+
+BackgroundCompactor::
+BackgroundCompactor(CompactionConfig config,
+                    std::function<void ()> compact)
+    : config(std::move(config)), compact(std::move(compact)),
+      pending(0), firstPending(0), shutdown(false)
+{
+}
+
+BackgroundCompactor::
+~BackgroundCompactor()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        shutdown = true;
+    }
+    wakeup.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void
+BackgroundCompactor::
+recorded(uint64_t numRecords)
+{
+    if (!config.enabled || numRecords == 0)
+        return;
+
+    uint64_t before = pending.fetch_add(numRecords);
+    if (before != 0 && before + numRecords < config.maxPending)
+        return;
+
+    // Either the first pending records (which starts the age clock) or
+    // we've just crossed the threshold
+    std::unique_lock<std::mutex> guard(mutex);
+    if (before == 0)
+        firstPending = Date::now().secondsSinceEpoch();
+    if (shutdown)
+        return;
+    if (!thread.joinable())
+        thread = std::thread(&BackgroundCompactor::run, this);
+    else if (before + numRecords >= config.maxPending)
+        wakeup.notify_one();
+}
+
+std::unique_lock<std::mutex>
+BackgroundCompactor::
+pause()
+{
+    std::unique_lock<std::mutex> result(compactionMutex);
+    firstPending = 0;
+    pending = 0;
+    return result;
+}
+
+CompactionStats
+BackgroundCompactor::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    CompactionStats result = stats;
+    result.pendingRecords = pending;
+    return result;
+}
+
+bool
+BackgroundCompactor::
+isDue(double now) const
+{
+    uint64_t numPending = pending;
+    if (numPending == 0)
+        return false;
+    if (numPending >= config.maxPending)
+        return true;
+    // firstPending is zero for the short time before recorded() sets it
+    double first = firstPending;
+    return config.maxAgeSeconds > 0 && first != 0
+        && now - first >= config.maxAgeSeconds;
+}
+
+void
+BackgroundCompactor::
+run()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    while (!shutdown) {
+        double now = Date::now().secondsSinceEpoch();
+        if (!isDue(now)) {
+            // Wake up in time for the age trigger, or now and again in
+            // case we missed a notification
+            double toWait = 1.0;
+            double first = firstPending;
+            if (pending && first != 0 && config.maxAgeSeconds > 0)
+                toWait = std::max(0.001,
+                                  std::min(toWait, first
+                                           + config.maxAgeSeconds - now));
+            wakeup.wait_for(guard, std::chrono::microseconds
+                            ((int64_t)(toWait * 1000000)));
+            continue;
+        }
+
+        guard.unlock();
+        runCompaction();
+        guard.lock();
+    }
+}
+
+void
+BackgroundCompactor::
+runCompaction()
+{
+    std::unique_lock<std::mutex> compactionGuard(compactionMutex);
+
+    firstPending = 0;
+    uint64_t numRecords = pending.exchange(0);
+    if (numRecords == 0)
+        return;  // a pause() dealt with them
+
+    Date start = Date::now();
+    std::string error;
+    try {
+        compact();
+    } catch (const std::exception & exc) {
+        error = exc.what();
+    } catch (...) {
+        error = "unknown exception";
+    }
+    Date end = Date::now();
+
+    std::unique_lock<std::mutex> guard(mutex);
+    double elapsed = end.secondsSince(start);
+    stats.lastDurationSeconds = elapsed;
+    stats.totalDurationSeconds += elapsed;
+    if (error.empty()) {
+        stats.numCompactions += 1;
+        stats.recordsCompacted += numRecords;
+        stats.lastCompaction = end;
+    }
+    else {
+        stats.numErrors += 1;
+        stats.lastError = std::move(error);
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,113 @@
+/** background_compactor.h                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Background compaction of the recent writes to mutable datasets.
+*/
+
+#pragma once
+
+#include "mldb/types/value_description_fwd.h"
+#include "mldb/types/date.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COMPACTION CONFIG                                                         */
+/*****************************************************************************/
+
+struct CompactionConfig {
+    CompactionConfig();
+
+    bool enabled;            ///< Compact in the background at all?
+    uint64_t maxPending;     ///< Compact after this many records
+    double maxAgeSeconds;    ///< Compact when the oldest is this old
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(CompactionConfig);
+
+
+/*****************************************************************************/
+/* COMPACTION STATS                                                          */
+/*****************************************************************************/
+
+struct CompactionStats {
+    CompactionStats();
+
+    uint64_t numCompactions;       ///< Number of compactions that finished
+    uint64_t numErrors;            ///< Number of compactions that failed
+    uint64_t recordsCompacted;     ///< Records folded in by those compactions
+    uint64_t pendingRecords;       ///< Records written since the last one
+    double lastDurationSeconds;    ///< Time taken by the last compaction
+    double totalDurationSeconds;   ///< Time taken by all compactions
+    Date lastCompaction;           ///< When the last compaction finished
+    std::string lastError;         ///< Error from the last failed compaction
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(CompactionStats);
+
+
+/*****************************************************************************/
+/* BACKGROUND COMPACTOR                                                      */
+/*****************************************************************************/
+
+/** Runs a compaction function on a background thread once enough records
+    have been written, or the oldest record that hasn't been compacted is
+    old enough, so that a dataset can fold its recent writes into a form
+    that's faster to read (and quicker to commit) without making writers or
+    readers wait for it.
+
+    The compaction function must be safe to run concurrently with reads
+    and writes.  Only one compaction runs at a time.  The thread is only
+    started once the first record has been written.
+*/
+
+struct BackgroundCompactor {
+    BackgroundCompactor(CompactionConfig config,
+                        std::function<void ()> compact);
+
+    /** Stops the thread, waiting for a running compaction to finish. */
+    ~BackgroundCompactor();
+
+    /** Tell the compactor that the given number of records were just
+        written.  This is cheap enough to call on every write.
+    */
+    void recorded(uint64_t numRecords);
+
+    /** Returns a lock that stops any compaction from running while it is
+        held, for operations that can't run concurrently with one.  The
+        pending records are forgotten, as the operation (for example a
+        commit) is expected to deal with them.
+    */
+    std::unique_lock<std::mutex> pause();
+
+    /** Return the statistics of the compactions run so far. */
+    CompactionStats getStats() const;
+
+private:
+    void run();
+    void runCompaction();
+    bool isDue(double now) const;
+
+    CompactionConfig config;
+    std::function<void ()> compact;
+
+    std::atomic<uint64_t> pending;       ///< Records since the last compaction
+    std::atomic<double> firstPending;    ///< Time at which pending became > 0
+
+    std::mutex compactionMutex;          ///< Held while a compaction runs
+
+    mutable std::mutex mutex;            ///< Protects everything below
+    std::condition_variable wakeup;
+    bool shutdown;
+    std::thread thread;
+    CompactionStats stats;
+};
+
+} // namespace MLDB
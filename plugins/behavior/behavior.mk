@@ -5,8 +5,11 @@
 LIBBEHAVIOR_SOURCES := \
 	behavior_domain.cc \
 	mapped_behavior_domain.cc \
+	posting_list.cc \
+	subject_set.cc \
 	mutable_behavior_domain.cc \
 	merged_behavior_domain.cc \
+	sharded_behavior_domain.cc \
 	mapped_value.cc \
 	behavior_svd.cc \
 	behavior_manager.cc \
@@ -1117,8 +1117,6 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
         t.restart();
     }
 
-    int numSubjectBits = ML::highest_bit(index.size() - 1, -1) + 1;
-
     struct BehaviorEntryToWrite {
         BehaviorEntryToWrite(uint32_t * subjectsBuf = 0,
                               size_t subjectsWords = 0,
@@ -1139,16 +1137,12 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
 
     auto serializeBehaviorSubjects = [&] (const vector<uint32_t> & indexes)
         {
-            uint64_t numBits = indexes.size() * numSubjectBits;
-            uint64_t numWords = (numBits + 31) / 32;
-            uint64_t numBytes = numWords * 4;
+            vector<uint32_t> encoded
+                = encodePostingList(indexes.data(), indexes.size());
+            size_t numWords = encoded.size();
 
             uint32_t * buf = new uint32_t[numWords];
-            memset(buf, 0, numBytes);
-
-            Bit_Writer<uint32_t> writer(buf);
-            for (unsigned j = 0;  j < indexes.size();  ++j)
-                writer.write(indexes[j], numSubjectBits);
+            std::copy(encoded.begin(), encoded.end(), buf);
 
             return make_pair(buf, numWords);
         };
@@ -1405,7 +1399,7 @@ serialize(DB::Store_Writer & store, ssize_t maxSubjectBehaviors)
     MappedBehaviorDomain::Metadata metadata;
     memset(&metadata, 0, sizeof(metadata));
     metadata.magic = magicStr("BehsHour");
-    metadata.version = 5;
+    metadata.version = 6;
     metadata.subjectDataOffset = subjectDataOffset;
     metadata.subjectIndexOffset = subjectIndexOffset;
     metadata.behaviorIndexOffset = behaviorIndexOffset;
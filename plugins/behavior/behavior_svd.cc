@@ -10,6 +10,7 @@
 #include "behavior_svd.h"
 #include "mldb/ext/svdlibc/svdlib.h"
 #include "mldb/base/parallel.h"
+#include "mldb/arch/simd_vector.h"
 #include "mldb/jml/utils/vector_utils.h"
 #include <boost/thread/thread.hpp>
 #include "mldb/jml/db/persistent.h"
@@ -50,7 +51,8 @@ BehaviorSvd(SH maxSubject, int numDenseBehaviors,
       numDenseBehaviors(numDenseBehaviors),
       numSingularValues(numSingularValues),
       biasedBehaviors(biasedBehaviors.begin(), biasedBehaviors.end()),
-      space(space), calcLongTail(calcLongTail)
+      space(space), calcLongTail(calcLongTail),
+      solver(SVD_LANCZOS), oversampling(10), numPowerIterations(2)
 {
 }
 
@@ -175,12 +177,17 @@ train(const BehaviorDomain & behs,
     if (!finishedPhase("updateBehaviorCache"))
         return;
 
-    calcDenseCointersections(behs, cache);
+    if (solver == SVD_RANDOMIZED) {
+        calcDenseSvdRandomized(cache);
+    }
+    else {
+        calcDenseCointersections(behs, cache);
 
-    if (!finishedPhase("denseCointersections"))
-        return;
+        if (!finishedPhase("denseCointersections"))
+            return;
 
-    calcDenseSvd();
+        calcDenseSvd();
+    }
 
     if (!finishedPhase("denseSvd"))
         return;
@@ -668,6 +675,174 @@ calcDenseSvd()
     ExcAssertEqual(denseBehaviors.size(), numDenseBehaviors);
 }
 
+void
+BehaviorSvd::
+calcDenseSvdRandomized(const BehaviorCache & cache)
+{
+    int n = numDenseBehaviors;
+
+    // A is subjects by dense behaviors, with A'A being the cointersections.
+    // The buckets of the entries split the subjects by hash, and each
+    // bucket's subjects are split again into ranges of MAX_SHARD_ROWS.
+    // Each of those is a shard of the rows of A that's multiplied on its
+    // own, with its subjects numbered densely and its columns held as
+    // compressed sparse columns.
+    static constexpr int MAX_SHARD_ROWS = 1 << 14;
+
+    struct Shard {
+        int numRows = 0;
+        std::vector<int> columnStart;   ///< n + 1 entries into rows
+        std::vector<int> rows;
+        std::vector<float> weights;     ///< Empty in Hamming space
+    };
+
+    std::vector<const SvdColumnEntry *> columns(n, nullptr);
+    for (unsigned j = 0;  j < n;  ++j) {
+        BH beh = denseBehaviors[j];
+        // Biased behaviors don't contribute
+        if (biasedBehaviors.count(beh))
+            continue;
+        auto it = cache.behToIndex.find(beh);
+        if (it == cache.behToIndex.end())
+            throw MLDB::Exception("no behavior found");
+        columns[j] = &cache.subjects[it->second];
+    }
+
+    static constexpr int NUM_BUCKETS = 64;  // buckets of an SvdColumnEntry
+    std::vector<std::vector<Shard> > bucketShards(NUM_BUCKETS);
+
+    auto makeShards = [&] (int b)
+        {
+            std::vector<uint32_t> subjects;
+            for (auto c: columns) {
+                if (c)
+                    subjects.insert(subjects.end(),
+                                    c->buckets[b].rows.begin(),
+                                    c->buckets[b].rows.end());
+            }
+            std::sort(subjects.begin(), subjects.end());
+            subjects.erase(std::unique(subjects.begin(), subjects.end()),
+                           subjects.end());
+
+            std::vector<Shard> & shards = bucketShards[b];
+            shards.resize((subjects.size() + MAX_SHARD_ROWS - 1)
+                          / MAX_SHARD_ROWS);
+            for (unsigned i = 0;  i < shards.size();  ++i) {
+                shards[i].numRows
+                    = std::min<size_t>(MAX_SHARD_ROWS,
+                                       subjects.size() - i * MAX_SHARD_ROWS);
+                shards[i].columnStart.push_back(0);
+            }
+
+            for (auto c: columns) {
+                if (c) {
+                    const auto & bucket = c->buckets[b];
+                    for (unsigned i = 0;  i < bucket.rows.size();  ++i) {
+                        int row = std::lower_bound(subjects.begin(),
+                                                   subjects.end(),
+                                                   bucket.rows[i])
+                            - subjects.begin();
+                        Shard & shard = shards[row / MAX_SHARD_ROWS];
+                        shard.rows.push_back(row % MAX_SHARD_ROWS);
+                        if (space != HAMMING)
+                            shard.weights.push_back(bucket.counts.at(i));
+                    }
+                }
+                for (auto & shard: shards)
+                    shard.columnStart.push_back(shard.rows.size());
+            }
+        };
+
+    parallelMap(0, NUM_BUCKETS, makeShards);
+
+    std::vector<Shard> shards;
+    for (auto & s: bucketShards)
+        for (auto & shard: s)
+            shards.emplace_back(std::move(shard));
+    bucketShards.clear();
+
+    // out = A'A in, as z = A in then A'z over each shard
+    auto multiply = [&] (const double * in, double * out, int l)
+        {
+            // Row major, so that the row of each behavior is contiguous
+            std::vector<double> inRows(n * l);
+            for (unsigned j = 0;  j < n;  ++j)
+                for (unsigned c = 0;  c < l;  ++c)
+                    inRows[j * l + c] = in[c * n + j];
+
+            auto accum = [&] (std::vector<double> & partial, size_t b)
+                {
+                    const Shard & shard = shards[b];
+                    if (partial.empty())
+                        partial.resize(n * l);
+
+                    std::vector<double> z(shard.numRows * l);
+                    for (unsigned j = 0;  j < n;  ++j) {
+                        for (int p = shard.columnStart[j];
+                             p < shard.columnStart[j + 1];  ++p) {
+                            double w = shard.weights.empty()
+                                ? 1.0 : shard.weights[p];
+                            double * zr = &z[shard.rows[p] * l];
+                            SIMD::vec_add(zr, w, &inRows[j * l], zr, l);
+                        }
+                    }
+
+                    for (unsigned j = 0;  j < n;  ++j) {
+                        double * outr = &partial[j * l];
+                        for (int p = shard.columnStart[j];
+                             p < shard.columnStart[j + 1];  ++p) {
+                            double w = shard.weights.empty()
+                                ? 1.0 : shard.weights[p];
+                            SIMD::vec_add(outr, w, &z[shard.rows[p] * l],
+                                          outr, l);
+                        }
+                    }
+                };
+
+            auto combine = [&] (std::vector<double> & into,
+                                std::vector<double> & from)
+                {
+                    if (from.empty())
+                        return;
+                    if (into.empty())
+                        into.swap(from);
+                    else SIMD::vec_add(&into[0], &from[0], &into[0],
+                                       into.size());
+                };
+
+            std::vector<double> total
+                = parallelReduce(0, shards.size(), std::vector<double>(),
+                                 accum, combine);
+
+            for (unsigned j = 0;  j < n;  ++j)
+                for (unsigned c = 0;  c < l;  ++c)
+                    out[c * n + j] = total.empty() ? 0.0 : total[j * l + c];
+        };
+
+    std::vector<double> svalues;
+    std::vector<std::vector<double> > vt;
+    std::tie(svalues, vt)
+        = randomizedSvd(n, numSingularValues, oversampling,
+                        numPowerIterations, multiply);
+
+    singularValues.clear();
+    singularValues.resize(numSingularValues);
+    std::copy(svalues.begin(), svalues.end(), singularValues.begin());
+
+    cerr << "svalues = " << singularValues << endl;
+
+    // Extract the singular vectors for the dense behaviors
+    denseVectors.clear();
+    for (unsigned i = 0;  i < numDenseBehaviors;  ++i) {
+        distribution<float> & d = singularVectors[i];
+        d.clear();
+        d.resize(numSingularValues);
+        for (unsigned j = 0;  j < vt.size();  ++j)
+            d[j] = vt[j][i];
+        denseVectors.push_back(d);
+    }
+}
+
 distribution<float>
 BehaviorSvd::
 calculateBehaviorVectorCached(BH beh, const BehaviorDomain & behs,
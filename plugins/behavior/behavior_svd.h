@@ -28,7 +28,8 @@ namespace MLDB {
 struct BehaviorSvd {
 
     BehaviorSvd()
-        : space(HAMMING), calcLongTail(true)
+        : space(HAMMING), calcLongTail(true),
+          solver(SVD_LANCZOS), oversampling(10), numPowerIterations(2)
     {
     }
 
@@ -52,6 +53,14 @@ struct BehaviorSvd {
     SvdSpace space;
     bool calcLongTail;
 
+    /** Solver for the dense singular vectors.  The randomized one doesn't
+        calculate the cointersections of the dense behaviors; instead its
+        products with them are a few passes over their subjects.
+    */
+    SvdSolver solver;
+    int oversampling;        ///< Extra random vectors over the singular values
+    int numPowerIterations;  ///< Power iterations of the randomized solver
+
     /** Singular values */
     distribution<float> singularValues;
 
@@ -174,6 +183,14 @@ struct BehaviorSvd {
     void calcDenseCointersections(const BehaviorDomain & behs,
                                   const BehaviorCache & cache);
 
+    /** Run the randomized SVD over the dense behaviors, and extract the
+        singular vectors from them.  Each product with the cointersection
+        matrix is done as two passes over the subjects of the cached dense
+        behaviors, in parallel over the 64 subject hash buckets of their
+        entries, so denseOverlaps is never filled in.
+    */
+    void calcDenseSvdRandomized(const BehaviorCache & cache);
+
     float calcOverlapCached(BH bi,
                             BH bj,
                             const SvdColumnEntry & ei,
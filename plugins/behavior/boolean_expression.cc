@@ -7,6 +7,7 @@
 */
 
 #include "boolean_expression.h"
+#include "mapped_behavior_domain.h"
 #include "mldb/arch/exception.h"
 #include "mldb/arch/format.h"
 #include <sstream>
@@ -96,6 +97,84 @@ BehaviorWrapper(const BehaviorDomain & behs)
 
             return segmentsMatching;
         };
+
+    const BehaviorDomain * domain = &behs;
+
+    subjectIndexCount = [=] () -> uint32_t
+        {
+            return domain->subjectCount();
+        };
+
+    // Mapped domains store the subjects of each behavior as a list of
+    // their indexes, so the sets come straight from them
+    auto mapped = dynamic_cast<const MappedBehaviorDomain *>(domain);
+    if (mapped) {
+        getSubjectSet = [=] (BH beh)
+            {
+                return mapped->getSubjectSet(beh);
+            };
+
+        getSubjectSetForHashes = [=] (const std::vector<SH> & subjects)
+            {
+                SubjectSet result;
+                for (SH subject: subjects)
+                    if (mapped->knownSubject(subject))
+                        result.append(mapped->getSubjectIndex(subject).index());
+                return result;
+            };
+
+        getSubjectHash = [=] (uint32_t index)
+            {
+                return mapped->getSubjectHash(SI(index));
+            };
+
+        return;
+    }
+
+    // Other domains get an index of their subjects the first time that
+    // it's needed
+    struct SubjectIndex {
+        std::once_flag once;
+        std::vector<SH> subjects;
+    };
+
+    auto index = std::make_shared<SubjectIndex>();
+    auto getSubjects = [=] () -> const std::vector<SH> &
+        {
+            std::call_once(index->once, [&] ()
+                           {
+                               index->subjects
+                                   = domain->allSubjectHashes(SH::max(),
+                                                              true /* sorted */);
+                           });
+            return index->subjects;
+        };
+
+    getSubjectSetForHashes = [=] (const std::vector<SH> & subjects)
+        {
+            const std::vector<SH> & all = getSubjects();
+            SubjectSet result;
+            auto it = all.begin();
+            for (SH subject: subjects) {
+                it = std::lower_bound(it, all.end(), subject);
+                if (it == all.end())
+                    break;
+                if (*it == subject)
+                    result.append(it - all.begin());
+            }
+            return result;
+        };
+
+    getSubjectSet = [=] (BH beh)
+        {
+            return getSubjectSetForHashes
+                (domain->getSubjectHashes(beh, SH::max(), true /* sorted */));
+        };
+
+    getSubjectHash = [=] (uint32_t index)
+        {
+            return getSubjects().at(index);
+        };
 }
 
 BehaviorWrapper::
@@ -142,6 +221,19 @@ generateUnique(const BehaviorWrapper & behs,
     return result;
 }
 
+SubjectSet
+BooleanExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    std::vector<SH> subjects;
+    for (auto & s: generate(behs, SH::max()))
+        subjects.push_back(s.first);
+    std::sort(subjects.begin(), subjects.end());
+    subjects.erase(std::unique(subjects.begin(), subjects.end()),
+                   subjects.end());
+    return behs.getSubjectSetForHashes(subjects);
+}
+
 struct CompareSubjects {
     bool operator () (const std::pair<SH, Date> & p1,
                       const std::pair<SH, Date> & p2) const
@@ -345,6 +437,13 @@ generateAllTimestamps(const BehaviorWrapper & behs,
     return behs.getSubjectHashesAndAllTimestamps(seg, maxSubject);
 }
 
+SubjectSet
+SegExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    return behs.getSubjectSet(seg);
+}
+
 
 /*****************************************************************************/
 /* CONTAINS EXPRESSION                                                       */
@@ -412,6 +511,15 @@ generateAllTimestamps(const BehaviorWrapper & behs,
     throw MLDB::Exception("SegNameExpression can't be executed without binding");
 }
 
+SubjectSet
+SegNameContainsExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    cerr << "warning: SegNameContainsExpression should be bound, "
+         << "not run directly" << endl;
+    return bind(behs)->generateSet(behs);
+}
+
 
 /*****************************************************************************/
 /* REGEX EXPRESSION                                                          */
@@ -478,6 +586,14 @@ generateAllTimestamps(const BehaviorWrapper & behs,
     throw MLDB::Exception("RegexExpression can't be executed without binding");
 }
 
+SubjectSet
+RegexExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    cerr << "warning: RegexExpression should be bound, not run directly" << endl;
+    return bind(behs)->generateSet(behs);
+}
+
 
 /******************************************************************************/
 /* TIMES FUNCTION EXPRESSION                                                  */
@@ -628,6 +744,14 @@ generateAllTimestamps(const BehaviorWrapper & behs, SH maxSubject) const
     return generate(behs, maxSubject);
 }
 
+SubjectSet
+NotExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    return SubjectSet::all(behs.subjectIndexCount())
+        .andNot(base->generateSet(behs));
+}
+
 BoolExprPtr 
 NotExpression::
 bind(const BehaviorWrapper & behs,
@@ -698,6 +822,34 @@ generateAllTimestamps(const BehaviorWrapper & behs, SH maxSubject) const
                         "not done");
 }
 
+SubjectSet
+AndExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    // Negated terms are subtracted instead of being complemented and
+    // intersected, which would need a set of all the other subjects
+    std::vector<BoolExprPtr> positive, negative;
+    for (auto & e: exprs) {
+        auto ne = std::dynamic_pointer_cast<NotExpression>(e);
+        if (ne)
+            negative.push_back(ne->base);
+        else positive.push_back(e);
+    }
+
+    SubjectSet result;
+    if (positive.empty())
+        result = SubjectSet::all(behs.subjectIndexCount());
+    else result = positive[0]->generateSet(behs);
+
+    for (unsigned i = 1;  i < positive.size() && !result.empty();  ++i)
+        result = result & positive[i]->generateSet(behs);
+
+    for (unsigned i = 0;  i < negative.size() && !result.empty();  ++i)
+        result = result.andNot(negative[i]->generateSet(behs));
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* OR EXPRESSION                                                             */
@@ -750,6 +902,26 @@ generateAllTimestamps(const BehaviorWrapper & behs, SH maxSubject) const
     return result;
 }
 
+SubjectSet
+OrExpression::
+generateSet(const BehaviorWrapper & behs) const
+{
+    SubjectSet result;
+    mutex m;
+
+    auto mainWork = [&] (size_t it)
+        {
+            SubjectSet tmpResult = exprs[it]->generateSet(behs);
+            if (!tmpResult.empty()) {
+                unique_lock<mutex> lock(m);
+                result = result | tmpResult;
+            }
+        };
+    parallelMap(0, exprs.size(), mainWork);
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* THEN EXPRESSION                                                           */
@@ -14,6 +14,7 @@
 #include <limits>
 #include "mldb/plugins/behavior/id.h"
 #include "behavior_domain.h"
+#include "subject_set.h"
 #include <boost/any.hpp>
 
 namespace MLDB {
@@ -48,6 +49,22 @@ struct BehaviorWrapper {
     std::function<std::vector<Id>(const std::string & regex)>
     getBehaviorsContainingString;
 
+    /** Number of subjects.  Subject sets identify each subject by its
+        index in order of subject hash, from zero up to this number.
+    */
+    std::function<uint32_t ()> subjectIndexCount;
+
+    /** Set of the subjects that have the given behavior. */
+    std::function<SubjectSet (BH beh)> getSubjectSet;
+
+    /** Set of the given subjects, which are sorted.  Unknown subjects are
+        ignored. */
+    std::function<SubjectSet (const std::vector<SH> & subjects)>
+    getSubjectSetForHashes;
+
+    /** Hash of the subject with the given index in a subject set. */
+    std::function<SH (uint32_t index)> getSubjectHash;
+
 private:
     const BehaviorDomain * behs;
 };
@@ -137,6 +154,14 @@ struct BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const = 0;
 
+    /** Return the set of matching subjects, ignoring the timestamps.  This
+        is much cheaper than generate() for expressions that combine the
+        subjects of many behaviors, as the intermediate results are
+        compressed sets instead of vectors of subjects and timestamps.
+        Default implementation calls generate() and converts its result.
+    */
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
+
     /** Filter a given list, leaving only the values that remain.  Default
         implementation calls generate() and then removes those values
         from the list passed in.
@@ -191,6 +216,8 @@ struct SegExpression : public BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
+
     Id seg;
 };
 
@@ -225,6 +252,8 @@ struct SegNameContainsExpression : public BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
+
     std::string mustContain;
 };
 
@@ -258,6 +287,8 @@ struct RegexExpression : public BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
+
     std::string regex;
 };
 
@@ -350,6 +381,8 @@ struct NotExpression : public BooleanExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
+
     BoolExprPtr base;
 
     virtual BoolExprPtr bind(const BehaviorWrapper & behs,
@@ -424,6 +457,8 @@ struct AndExpression : public CompoundExpression {
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
 
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
+
     virtual BoolExprPtr makeCopy() const
     {
         return std::make_shared<AndExpression>(copyExprs());
@@ -458,6 +493,8 @@ struct OrExpression : public CompoundExpression {
     virtual std::vector<std::pair<SH, Date> >
     generateAllTimestamps(const BehaviorWrapper & behs,
                           SH maxSubject) const;
+
+    virtual SubjectSet generateSet(const BehaviorWrapper & behs) const;
 };
 
 /*****************************************************************************/
@@ -586,7 +586,7 @@ init(const File_Read_Buffer & file, uint64_t md_offset)
     if (md->magic != magicStr("BehsHour"))
         throw MLDB::Exception("invalid behavior magic");
 
-    if (md->version > 5)
+    if (md->version > 6)
         throw MLDB::Exception("invalid behavior version");
     if (md->idSpaceDeprecated != 0)
         throw MLDB::Exception("id space must be equal to 0");
@@ -692,6 +692,8 @@ init(const File_Read_Buffer & file, uint64_t md_offset)
 
     // Version 5 has split behavior tables
 
+    // Version 6 has compressed behavior to subject lists; see posting_list.h
+
     const Metadata & md2 = *md;
 
     vector<pair<string, uint64_t> > offsets = {
@@ -1378,19 +1380,9 @@ getBehaviorSubjectCount(BI beh, SH maxSubject, Precision p) const
     if (maxSubject.isMax())
         return behaviorStats[beh].subjectCount;
 
-    const uint32_t * data = behaviorToSubjects + behaviorToSubjectsIndex[beh];
-
-    int len = behaviorStats[beh].subjectCount;
-    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
-
-    typedef ML::BitArrayIterator<uint32_t> BitArrayIterator;
-
-    BitArrayIterator
-        start(data, numSubjectBits, 0),
-        end(data, numSubjectBits, len),
-        it = std::upper_bound(start, end, maxSubject);
-
-    return it.index;
+    PostingListCursor cursor = getSubjectCursor(beh);
+    cursor.advanceTo(subjectIndexUpperBound(maxSubject));
+    return cursor.index();
 }
 
 size_t
@@ -1406,23 +1398,14 @@ std::vector<SH>
 MappedBehaviorDomain::
 getSubjectHashes(BI beh, SH maxSubject, bool sorted) const
 {
-    const uint32_t * data = behaviorToSubjects + behaviorToSubjectsIndex[beh];
-
-    int len = getBehaviorSubjectCount(beh);
-    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
-
-    ML::Bit_Extractor<uint32_t> extractor(data);
-
     vector<SH> result;
 
     // These are always sorted by default
 
-    for (unsigned i = 0;  i < len;  ++i) {
-        uint32_t sub;
-        extractor.extract(sub, numSubjectBits);
-        SH hash = getSubjectHash(SI(sub));
+    for (PostingListCursor cursor = getSubjectCursor(beh);  !cursor.done();
+         cursor.next()) {
+        SH hash = getSubjectHash(SI(cursor.value()));
         if (hash > maxSubject) break;
-        //cerr << "sub " << i << " = " << sub << endl;
         result.push_back(hash);
     }
 
@@ -1441,6 +1424,55 @@ getSubjectHashes(BH beh, SH maxSubject, bool sorted) const
     return getSubjectHashes(BI(index), maxSubject, sorted);
 }
 
+SubjectSet
+MappedBehaviorDomain::
+getSubjectSet(BH beh) const
+{
+    SubjectSet result;
+    int index = behaviorIndex.get(beh, -1);
+    if (index == -1)
+        return result;
+
+    for (PostingListCursor cursor = getSubjectCursor(BI(index));
+         !cursor.done();  cursor.next())
+        result.append(cursor.value());
+
+    return result;
+}
+
+PostingListCursor
+MappedBehaviorDomain::
+getSubjectCursor(BI beh) const
+{
+    const uint32_t * data = behaviorToSubjects + behaviorToSubjectsIndex[beh];
+    size_t len = behaviorStats[beh].subjectCount;
+
+    // Version 6 compresses the lists
+    if (md->version >= 6)
+        return PostingListCursor(data, len);
+
+    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
+    return PostingListCursor(data, len, numSubjectBits);
+}
+
+uint32_t
+MappedBehaviorDomain::
+subjectIndexUpperBound(SH maxSubject) const
+{
+    if (maxSubject.isMax())
+        return md->numSubjects;
+
+    // The subject index is sorted by hash
+    uint32_t lo = 0, hi = md->numSubjects;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (getSubjectHash(SI(mid)) > maxSubject)
+            hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
 std::vector<std::pair<SH, Date> >
 MappedBehaviorDomain::
 getSubjectHashesAndTimestamps(BH beh, SH maxSubject, bool sorted) const
@@ -1459,9 +1491,6 @@ getSubjectHashesAndTimestamps(BI index, SH maxSubject, bool sorted) const
 
     auto stats = getBehaviorStats(index, BS_EARLIEST | BS_SUBJECT_COUNT);
 
-    const uint32_t * subjectData
-        = behaviorToSubjects + behaviorToSubjectsIndex[index];
-
     bool hasTimestamps = behaviorToSubjectTimestamps != 0;
 
     uint32_t offset = 0;
@@ -1488,18 +1517,12 @@ getSubjectHashesAndTimestamps(BI index, SH maxSubject, bool sorted) const
         //cerr << "numTimestampBits = " << numTimestampBits << endl;
     }
 
-    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
-
-    ML::Bit_Extractor<uint32_t> extractor(subjectData);
-
-    for (unsigned i = 0;  i < stats.subjectCount;  ++i) {
-        uint32_t sub;
-        extractor.extract(sub, numSubjectBits);
-        SH subject = getSubjectHash(SI(sub));
+    for (PostingListCursor cursor = getSubjectCursor(index);  !cursor.done();
+         cursor.next()) {
+        SH subject = getSubjectHash(SI(cursor.value()));
         if (subject > maxSubject)
             break;
 
-        //cerr << "sub " << i << " = " << sub << endl;
         Date ts;
         if (hasTimestamps) {
             uint32_t ofs;
@@ -1535,9 +1558,6 @@ forEachBehaviorSubject(BH beh,
 
     auto stats = getBehaviorStats(BI(index), BS_EARLIEST | BS_SUBJECT_COUNT);
 
-    const uint32_t * subjectData
-        = behaviorToSubjects + behaviorToSubjectsIndex[index];
-
     bool hasTimestamps = behaviorToSubjectTimestamps != 0;
     if (withTimestamps && !hasTimestamps)
         throw MLDB::Exception("asked for timestamps with none present");
@@ -1566,18 +1586,12 @@ forEachBehaviorSubject(BH beh,
         //cerr << "numTimestampBits = " << numTimestampBits << endl;
     }
 
-    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
-
-    ML::Bit_Extractor<uint32_t> extractor(subjectData);
-
-    for (unsigned i = 0;  i < stats.subjectCount;  ++i) {
-        uint32_t sub;
-        extractor.extract(sub, numSubjectBits);
-        SH subject = getSubjectHash(SI(sub));
+    for (PostingListCursor cursor = getSubjectCursor(BI(index));  !cursor.done();
+         cursor.next()) {
+        SH subject = getSubjectHash(SI(cursor.value()));
         if (subject > maxSubject)
             break;
 
-        //cerr << "sub " << i << " = " << sub << endl;
         Date ts;
         if (hasTimestamps) {
             uint32_t ofs;
@@ -1801,86 +1815,28 @@ coIterateBehaviorsScan(BI behi1, BI behi2,
                         SH maxSubject,
                         const OnBehaviors & onBehaviors) const
 {
-    //cerr << "mapped coiterate scan" << endl;
-
-    //cerr << "beh1 = " << beh1 << " beh2 = " << beh2 << endl;
-    
-    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
-
-    auto getExtractor = [&] (BI beh)
-        {
-            const uint32_t * data
-            = behaviorToSubjects
-            + behaviorToSubjectsIndex[beh];
-
-            return ML::Bit_Extractor<uint32_t>(data);
-        };
-
-    ML::Bit_Extractor<uint32_t> extractor1 = getExtractor(behi1);
-    ML::Bit_Extractor<uint32_t> extractor2 = getExtractor(behi2);
-
-    int idx1 = 0, len1 = e1.subjectCount;
-    uint32_t sub1, sub2;
-    int idx2 = 0, len2 = e2.subjectCount;
-    extractor1.extract(sub1, numSubjectBits);
-    extractor2.extract(sub2, numSubjectBits);
-
-    size_t result = 0;
-
-    int unmatched = 0;
+    // Merge the two lists.  Subject indexes are in the order of the
+    // subject hashes, so maxSubject is a bound on the index.
+    PostingListCursor cursor1 = getSubjectCursor(behi1);
+    PostingListCursor cursor2 = getSubjectCursor(behi2);
+    uint32_t end = subjectIndexUpperBound(maxSubject);
 
-    //cerr << "len1 = " << len1 << " len2 = " << len2 << endl;
+    int result = 0;
 
-    while (idx1 < len1 && idx2 < len2) {
-        uint32_t cur1 = sub1, cur2 = sub2;
-
-#if 0
-        cerr << "c1 = " << cur1 << " c2 = " << cur2
-             << " i1 = " << idx1 << " l1 = " << len1
-             << " i2 = " << idx2 << " l2 = " << len2
-             << " h1 = " << getSubjectHash(SI(cur1))
-             << " h2 = " << getSubjectHash(SI(cur2))
-             << " max = " << maxSubject << endl;
-#endif
+    while (!cursor1.done() && !cursor2.done()) {
+        uint32_t sub1 = cursor1.value(), sub2 = cursor2.value();
+        if (sub1 >= end || sub2 >= end)
+            break;
 
-        if (cur1 == cur2) {
-            if (maxSubject.isMax() && !onBehaviors) {
-                ++result;
-            }
-            else {
-                SH sh = getSubjectHash(SI(cur1));
-                if (sh > maxSubject) break;
-                //cerr << "   *** got subject " << sh << endl;
-                if (onBehaviors)
-                    onBehaviors(sh);
-                ++result;
-                unmatched = 0;
-            }
-        }
-        else {
-            if (!maxSubject.isMax()) {
-                if (unmatched > 10) {
-                    SH sh = getSubjectHash(SI(std::min(cur1, cur2)));
-                    if (sh > maxSubject) {
-                        //cerr << " --> bailing for SH " << sh << " too high"
-                        //     << endl;
-                        break;
-                    }
-                    unmatched = 0;
-                }
-                else ++unmatched;
-            }
-        }
-        if (cur1 <= cur2) {
-            ++idx1;
-            if (idx1 == len1) break;
-            extractor1.extract(sub1, numSubjectBits);
-        }
-        if (cur2 <= cur1) {
-            ++idx2;
-            if (idx2 == len2) break;
-            extractor2.extract(sub2, numSubjectBits);
+        if (sub1 == sub2) {
+            if (onBehaviors)
+                onBehaviors(getSubjectHash(SI(sub1)));
+            ++result;
         }
+        if (sub1 <= sub2)
+            cursor1.next();
+        if (sub2 <= sub1)
+            cursor2.next();
     }
 
     return result;
@@ -1894,80 +1850,31 @@ coIterateBehaviorsLookup(BI behi1, BI behi2,
                           SH maxSubject,
                           const OnBehaviors & onBehaviors) const
 {
-    int numSubjectBits = ML::highest_bit(md->numSubjects - 1, -1) + 1;
-
-    auto getExtractor = [&] (BI beh)
-        {
-            const uint32_t * data
-            = behaviorToSubjects
-            + behaviorToSubjectsIndex[beh];
-
-            return ML::Bit_Extractor<uint32_t>(data);
-        };
-
-    ML::Bit_Extractor<uint32_t> extractor2 = getExtractor(behi2);
-    int len2 = e2.subjectCount;
-
-    typedef ML::BitArrayIterator<uint32_t> BitArrayIterator;
-
-    int len1 = e1.subjectCount;
-    const uint32_t * data1
-        = behaviorToSubjects
-        + behaviorToSubjectsIndex[behi1];
-
-    BitArrayIterator
-        start(data1, numSubjectBits, 0),
-        end(data1, numSubjectBits, len1);
-
-    struct CompareSubj {
-        CompareSubj(const MappedBehaviorDomain * dom)
-            : dom(dom)
-        {
-        }
-
-        const MappedBehaviorDomain * dom;
-        bool operator () (uint32_t s1, SH s2) const
-        {
-            return dom->getSubjectHash(SI(s1)) < s2;
-        }
-
-        bool operator () (SH s1, uint32_t s2) const
-        {
-            return s1 < dom->getSubjectHash(SI(s2));
-        }
-    };
-    
-    if (!maxSubject.isMax())
-        end = std::upper_bound(start, end, maxSubject, CompareSubj(this));
-    
-    size_t result = 0;
-    
-    for (unsigned i = 0;  i < len2;  ++i) {
-        uint32_t sub = extractor2.extract<uint32_t>(numSubjectBits);
-        SH sh = getSubjectHash(SI(sub));
-        if (sh > maxSubject) break;
-        
- #if 0
-        cerr << "scanning " << sh << " sub " << sub << " at "
-             << i << " of " << len2 << " between "
-             << start.index << " (" << *start << ")  and " << end.index
-             << " (" << *end << ")" << endl;
-#endif
-
-        // Perform a binary search
-        BitArrayIterator it = std::lower_bound(start, end, sub);
-
-        //cerr << "  found " << it.index << " (" << *it << ")" << endl;
+    // Leapfrog between the two lists, so that the runs of the longer one
+    // that can't match are skipped over.  With compressed lists, that
+    // skips whole blocks without decoding them.
+    PostingListCursor cursor1 = getSubjectCursor(behi1);
+    PostingListCursor cursor2 = getSubjectCursor(behi2);
+    uint32_t end = subjectIndexUpperBound(maxSubject);
+
+    int result = 0;
+
+    while (!cursor1.done() && !cursor2.done()) {
+        uint32_t sub1 = cursor1.value(), sub2 = cursor2.value();
+        if (sub1 >= end || sub2 >= end)
+            break;
 
-        if (it != end && *it == sub) {
+        if (sub1 < sub2)
+            cursor1.advanceTo(sub2);
+        else if (sub2 < sub1)
+            cursor2.advanceTo(sub1);
+        else {
             if (onBehaviors)
-                onBehaviors(sh);
-            //cerr << "   *** got one" << endl;
+                onBehaviors(getSubjectHash(SI(sub1)));
             ++result;
+            cursor1.next();
+            cursor2.next();
         }
-
-        // Don't start from any earlier than before
-        start = it;
     }
     
     return result;
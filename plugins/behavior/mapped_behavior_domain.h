@@ -9,6 +9,8 @@
 
 #include "behavior_domain.h"
 #include "mapped_value.h"
+#include "posting_list.h"
+#include "subject_set.h"
 #include "mldb/arch/bit_range_ops.h"
 
 
@@ -345,6 +347,11 @@ struct MappedBehaviorDomain: public BehaviorDomain {
     getSubjectHashesAndAllTimestamps(BH beh, SH maxSubject = SH(-1),
                                      bool sorted = false) const;
 
+    /** Return the set of the indexes of the subjects that have the given
+        behavior, straight from its list of subjects.
+    */
+    SubjectSet getSubjectSet(BH beh) const;
+
     virtual bool
     forEachBehaviorSubject(BH beh,
                             const OnBehaviorSubject & onSubject,
@@ -396,8 +403,9 @@ struct MappedBehaviorDomain: public BehaviorDomain {
 
     int64_t getSubjectIndexImpl(SH subjectHash) const;
 
-    /** Implement behavior co-iteration via a lookup when behi1 contains
-        a lot more entries than behi2.
+    /** Implement behavior co-iteration when one of the behaviors
+        contains a lot more entries than the other, by skipping over the
+        parts of the longer list that can't match.
     */
     int coIterateBehaviorsLookup(BI behi1, BI behi2, 
                                   const BehaviorStatsFormat & e1,
@@ -523,6 +531,16 @@ struct MappedBehaviorDomain: public BehaviorDomain {
     int64_t
     getSubjectIndexImplTmpl(SH subjectHash, const SubjectIndex & subjectIndex) const;
 
+    /** Return a cursor over the indexes of the subjects that have the
+        given behavior, whatever the version of the file.
+    */
+    PostingListCursor getSubjectCursor(BI beh) const;
+
+    /** Return the number of subjects whose hash is at most maxSubject,
+        which is the first subject index past it.
+    */
+    uint32_t subjectIndexUpperBound(SH maxSubject) const;
+
 };
 
 static_assert(sizeof(MappedBehaviorDomain::SubjectIndexEntry2) == 24,
@@ -17,6 +17,7 @@
 #include "mldb/ext/cityhash/src/city.h"
 #include "mldb/server/parallel_merge_sort.h"
 #include <thread>
+#include <queue>
 
 
 using namespace std;
@@ -84,7 +85,8 @@ MergedBehaviorDomain(const MergedBehaviorDomain & other)
       latest_(other.latest_),
       nominalStart_(other.nominalStart_),
       nominalEnd_(other.nominalEnd_),
-      nonOverlappingInTime(other.nonOverlappingInTime)
+      nonOverlappingInTime(other.nonOverlappingInTime),
+      fileMetadata_(other.fileMetadata_)
 {
     hasSubjectIds = other.hasSubjectIds;
     minSubjects = other.minSubjects;
@@ -1420,4 +1422,265 @@ getAllFileMetadata() const
 }
 
 
+
+std::vector<std::shared_ptr<BehaviorDomain> >
+MergedBehaviorDomain::
+leafDomains() const
+{
+    std::vector<std::shared_ptr<BehaviorDomain> > result;
+    for (auto & b: behs) {
+        auto merged = dynamic_cast<const MergedBehaviorDomain *>(b.get());
+        if (merged) {
+            auto nested = merged->leafDomains();
+            result.insert(result.end(), nested.begin(), nested.end());
+        }
+        else result.push_back(b);
+    }
+    return result;
+}
+
+namespace {
+
+/** Merged domain that is used to compact a merge into a single file.  It
+    knows, for each subject, which of the (flattened) merged domains
+    contain it, and overrides the methods that serialization of the
+    subjects and behaviors calls to use that and only consult those
+    domains.
+*/
+struct CompactingBehaviorDomain : public MergedBehaviorDomain {
+
+    CompactingBehaviorDomain(const MergedBehaviorDomain & merged)
+        : MergedBehaviorDomain(merged),
+          leaves(merged.leafDomains())
+    {
+        if (leaves.size() > 65536)
+            throw MLDB::Exception("can't compact more than 65536 behavior "
+                                  "files at once");
+        indexSubjects();
+    }
+
+    std::vector<std::shared_ptr<BehaviorDomain> > leaves;
+
+    /// All subjects, sorted.  The leaves that contain subjects[i] are
+    /// sources[sourcesStart[i]] up to sources[sourcesStart[i + 1]].
+    std::vector<SH> subjects;
+    std::vector<uint64_t> sourcesStart;
+    std::vector<uint16_t> sources;
+
+    void indexSubjects()
+    {
+        std::vector<std::vector<SH> > leafSubjects(leaves.size());
+        auto getLeafSubjects = [&] (int i)
+            {
+                leafSubjects[i] = leaves[i]->allSubjectHashes(SH::max(), true);
+            };
+        parallelMap(0, leaves.size(), getLeafSubjects);
+
+        // Subject hashes are uniformly distributed, so equal ranges of
+        // the hash space have about the same number of subjects
+        static constexpr int NUM_RANGES = 256;
+
+        struct Range {
+            std::vector<SH> subjects;
+            std::vector<uint32_t> numSources;
+            std::vector<uint16_t> sources;
+        };
+
+        std::vector<Range> ranges(NUM_RANGES);
+
+        auto mergeRange = [&] (int r)
+            {
+                SH first((uint64_t)r << 56);
+                typedef std::vector<SH>::const_iterator It;
+                std::vector<std::pair<It, It> > cursors(leaves.size());
+
+                typedef std::pair<SH, int> Entry;
+                std::priority_queue<Entry, std::vector<Entry>,
+                                    std::greater<Entry> > heap;
+
+                for (unsigned i = 0;  i < leaves.size();  ++i) {
+                    const std::vector<SH> & s = leafSubjects[i];
+                    It it = std::lower_bound(s.begin(), s.end(), first);
+                    It end = r == NUM_RANGES - 1 ? s.end()
+                        : std::lower_bound(it, s.end(),
+                                           SH((uint64_t)(r + 1) << 56));
+                    cursors[i] = { it, end };
+                    if (it != end)
+                        heap.emplace(*it, i);
+                }
+
+                Range & range = ranges[r];
+                while (!heap.empty()) {
+                    SH subject;
+                    int leaf;
+                    std::tie(subject, leaf) = heap.top();
+                    heap.pop();
+
+                    if (range.subjects.empty()
+                        || range.subjects.back() != subject) {
+                        range.subjects.push_back(subject);
+                        range.numSources.push_back(0);
+                    }
+                    range.numSources.back() += 1;
+                    range.sources.push_back(leaf);
+
+                    auto & cursor = cursors[leaf];
+                    if (++cursor.first != cursor.second)
+                        heap.emplace(*cursor.first, leaf);
+                }
+            };
+
+        parallelMap(0, NUM_RANGES, mergeRange);
+
+        leafSubjects.clear();
+
+        size_t numSubjects = 0, numSources = 0;
+        for (auto & range: ranges) {
+            numSubjects += range.subjects.size();
+            numSources += range.sources.size();
+        }
+
+        subjects.reserve(numSubjects);
+        sourcesStart.reserve(numSubjects + 1);
+        sources.reserve(numSources);
+        sourcesStart.push_back(0);
+
+        for (auto & range: ranges) {
+            subjects.insert(subjects.end(),
+                            range.subjects.begin(), range.subjects.end());
+            for (uint32_t n: range.numSources)
+                sourcesStart.push_back(sourcesStart.back() + n);
+            sources.insert(sources.end(),
+                           range.sources.begin(), range.sources.end());
+            range = Range();
+        }
+    }
+
+    /** Return the range of sources of the subject, which is empty if it
+        is unknown. */
+    std::pair<const uint16_t *, const uint16_t *>
+    getSources(SH subject) const
+    {
+        auto it = std::lower_bound(subjects.begin(), subjects.end(), subject);
+        if (it == subjects.end() || *it != subject)
+            return { nullptr, nullptr };
+        size_t i = it - subjects.begin();
+        return { sources.data() + sourcesStart[i],
+                 sources.data() + sourcesStart[i + 1] };
+    }
+
+    virtual std::vector<SH>
+    allSubjectHashes(SH maxSubject, bool sorted) const
+    {
+        return std::vector<SH>(subjects.begin(),
+                               std::upper_bound(subjects.begin(),
+                                                subjects.end(),
+                                                maxSubject));
+    }
+
+    virtual bool knownSubject(SH subject) const
+    {
+        return getSources(subject).first != nullptr;
+    }
+
+    virtual Id getSubjectId(SH subject) const
+    {
+        auto s = getSources(subject);
+        if (!s.first)
+            throw MLDB::Exception("attempt to get Subject ID for unknown "
+                                  "subject");
+        return leaves[*s.first]->getSubjectId(subject);
+    }
+
+    virtual std::pair<Date, Date>
+    getSubjectTimestampRange(SH subject) const
+    {
+        Date earliest = Date::positiveInfinity();
+        Date latest = Date::negativeInfinity();
+
+        for (auto s = getSources(subject);  s.first != s.second;  ++s.first) {
+            auto range = leaves[*s.first]->getSubjectTimestampRange(subject);
+            earliest.setMin(range.first);
+            latest.setMax(range.second);
+        }
+
+        return make_pair(earliest, latest);
+    }
+
+    virtual bool
+    forEachSubjectBehaviorHash(SH subject,
+                               const OnSubjectBehaviorHash & onBeh,
+                               SubjectBehaviorFilter filter,
+                               Order order) const
+    {
+        if (order == INORDER)
+            return MergedBehaviorDomain
+                ::forEachSubjectBehaviorHash(subject, onBeh, filter, order);
+
+        for (auto s = getSources(subject);  s.first != s.second;  ++s.first) {
+            if (!leaves[*s.first]->forEachSubjectBehaviorHash
+                (subject, onBeh, filter, ANYORDER))
+                return false;
+        }
+        return true;
+    }
+
+    virtual std::vector<std::pair<SH, Date> >
+    getSubjectHashesAndTimestamps(BH beh, SH maxSubject, bool sorted) const
+    {
+        std::vector<TsVector> lists;
+        for (auto & leaf: leaves) {
+            if (leaf->knownBehavior(beh))
+                lists.emplace_back(leaf->getSubjectHashesAndTimestamps
+                                   (beh, maxSubject, true /* sorted */));
+        }
+
+        if (lists.empty())
+            return TsVector();
+
+        // Merge them pairwise, so each entry is merged log(n) times
+        while (lists.size() > 1) {
+            std::vector<TsVector> merged;
+            for (unsigned i = 0;  i + 1 < lists.size();  i += 2)
+                merged.emplace_back(mergeSubjects(lists[i], lists[i + 1]));
+            if (lists.size() % 2)
+                merged.emplace_back(std::move(lists.back()));
+            lists.swap(merged);
+        }
+
+        return std::move(lists[0]);
+    }
+
+    virtual bool
+    forEachBehaviorSubject(BH beh,
+                           const OnBehaviorSubject & onSubject,
+                           bool withTimestamps,
+                           Order order,
+                           SH maxSubject) const
+    {
+        // The merged list is in order, which is also good for ANYORDER
+        for (auto & s: getSubjectHashesAndTimestamps(beh, maxSubject, true))
+            if (!onSubject(s.first, withTimestamps ? s.second : Date()))
+                return false;
+        return true;
+    }
+
+    virtual size_t
+    getBehaviorSubjectCount(BH beh, SH maxSubject, Precision p) const
+    {
+        return getSubjectHashesAndTimestamps(beh, maxSubject, false).size();
+    }
+};
+
+} // file scope
+
+void
+MergedBehaviorDomain::
+compact(const std::string & filename, ssize_t maxSubjectBehaviors) const
+{
+    CompactingBehaviorDomain compacting(*this);
+    compacting.save(filename, maxSubjectBehaviors);
+}
+
+
 } // namespace MLDB
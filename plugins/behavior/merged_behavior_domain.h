@@ -50,6 +50,26 @@ struct MergedBehaviorDomain : public BehaviorDomain {
     void init(std::vector<std::shared_ptr<BehaviorDomain> > toMerge,
               bool preIndex);
 
+    /** Write the merged behaviors to a single behavior file, which can be
+        loaded with a MappedBehaviorDomain instead of merging the files
+        again each time.
+
+        The nested merges are flattened, and the subjects of all of the
+        files are merged (a k-way merge of their sorted subject hashes, in
+        parallel over ranges of the hash space) into an index of the files
+        that contain each subject.  The file is then streamed to disk by
+        the usual serialization, which only needs to consult the files
+        containing each subject, and never builds a MutableBehaviorDomain
+        in memory.
+    */
+    void compact(const std::string & filename,
+                 ssize_t maxSubjectBehaviors = -1) const;
+
+    /** Return the domains that are merged, with any nested merges replaced
+        by the domains that they merge.
+    */
+    std::vector<std::shared_ptr<BehaviorDomain> > leafDomains() const;
+
     /** Make a copy of the data structure.  */
     virtual MergedBehaviorDomain * makeShallowCopy() const;
 
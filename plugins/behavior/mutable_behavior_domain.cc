@@ -2544,6 +2544,34 @@ makeImmutable()
     immutable_ = true;
 }
 
+void
+MutableBehaviorDomain::
+compact()
+{
+    if (immutable_)
+        return;
+
+    for (unsigned r = 0;  r < NUM_SUBJECT_ROOTS;  ++r) {
+        auto subs = subjectRoots[r]->subjectEntryPtr();
+
+        auto doSubjectEntry = [&] (int i)
+            {
+                subs->entries[i].load()->sort(false, this);
+            };
+
+        parallelMap(0, subs->size.load(), doSubjectEntry);
+    }
+
+    auto behs = behaviorRoot();
+
+    auto doBehaviorEntry = [&] (int i)
+        {
+            behs->entries[i].load()->sort(rootLock, false);
+        };
+
+    parallelMap(0, behs->size.load(), doBehaviorEntry);
+}
+
 uint64_t
 MutableBehaviorDomain::
 getApproximateFileSize() const
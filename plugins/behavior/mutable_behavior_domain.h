@@ -278,6 +278,14 @@ struct MutableBehaviorDomain : public BehaviorDomain {
     */
     virtual void makeImmutable();
 
+    /** Sort the behaviors recorded so far for each subject and the subjects
+        recorded so far for each behavior, while leaving the domain mutable.
+        This can run concurrently with reads and writes; the old sorted
+        ranges are freed via the root GcLock once no reader can see them.
+        It makes reads faster and leaves less to do in makeImmutable().
+    */
+    void compact();
+
     /** Return an approximation to the size of the data in the file. */
     uint64_t getApproximateFileSize() const;
 
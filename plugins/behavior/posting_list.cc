@@ -0,0 +1,306 @@
+/* posting_list.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Compressed lists of the subjects that have a behavior.
+*/
+
+#include "posting_list.h"
+#include "mldb/arch/bitops.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+inline uint32_t lowBits(int bits)
+{
+    return bits == 32 ? uint32_t(-1) : (uint32_t(1) << bits) - 1;
+}
+
+inline int bitWidth(uint32_t value)
+{
+    return ML::highest_bit(value, -1) + 1;
+}
+
+/** Pack the low bits bits of each of the n values together into out,
+    which must be zeroed. */
+void pack(const uint32_t * values, size_t n, int bits, uint32_t * out)
+{
+    if (bits == 0)
+        return;
+    uint64_t bitPos = 0;
+    for (size_t i = 0;  i < n;  ++i, bitPos += bits) {
+        uint32_t v = values[i] & lowBits(bits);
+        size_t word = bitPos >> 5;
+        int shift = bitPos & 31;
+        out[word] |= v << shift;
+        if (shift + bits > 32)
+            out[word + 1] |= v >> (32 - shift);
+    }
+}
+
+/** Inverse of pack(). */
+void unpack(const uint32_t * in, size_t n, int bits, uint32_t * values)
+{
+    if (bits == 0) {
+        std::fill(values, values + n, 0);
+        return;
+    }
+    uint32_t mask = lowBits(bits);
+    uint64_t bitPos = 0;
+    for (size_t i = 0;  i < n;  ++i, bitPos += bits) {
+        size_t word = bitPos >> 5;
+        int shift = bitPos & 31;
+        uint64_t w = in[word];
+        if (shift + bits > 32)
+            w |= (uint64_t)in[word + 1] << 32;
+        values[i] = (w >> shift) & mask;
+    }
+}
+
+/** Position of the first of values[i] to values[n - 1], which are sorted,
+    that is not less than target, or n if there is none. */
+size_t firstNotLess(const uint32_t * values, size_t i, size_t n,
+                    uint32_t target)
+{
+#if defined(__SSE2__)
+    // Compare four at once.  SSE2 only has signed comparisons, so the sign
+    // bits are flipped to compare as unsigned.
+    const __m128i bias = _mm_set1_epi32(0x80000000);
+    const __m128i t = _mm_xor_si128(_mm_set1_epi32(target), bias);
+    for (;  i + 4 <= n;  i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+        v = _mm_xor_si128(v, bias);
+        int less = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, t)));
+        if (less != 0xf)
+            return i + __builtin_ctz(~less);
+    }
+#endif
+    while (i < n && values[i] < target)
+        ++i;
+    return i;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* POSTING LIST                                                              */
+/*****************************************************************************/
+
+std::vector<uint32_t>
+encodePostingList(const uint32_t * values, size_t n)
+{
+    std::vector<uint32_t> result;
+    if (n == 0)
+        return result;
+
+    size_t numBlocks = (n + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    if (numBlocks > 1)
+        result.resize(numBlocks * 2);
+
+    uint32_t gaps[POSTING_BLOCK_SIZE];
+    uint8_t positions[POSTING_BLOCK_SIZE];
+
+    for (size_t b = 0;  b < numBlocks;  ++b) {
+        size_t start = b * POSTING_BLOCK_SIZE;
+        size_t count = std::min<size_t>(POSTING_BLOCK_SIZE, n - start);
+
+        if (numBlocks > 1) {
+            result[b * 2] = values[start];
+            result[b * 2 + 1] = result.size();
+        }
+        else result.push_back(values[start]);
+
+        if (count == 1)
+            continue;
+
+        size_t numGaps = count - 1;
+        int widthCounts[33] = { 0 };
+        for (size_t i = 0;  i < numGaps;  ++i) {
+            uint32_t prev = values[start + i], v = values[start + i + 1];
+            ExcAssertGreater(v, prev);
+            gaps[i] = v - prev - 1;
+            ++widthCounts[bitWidth(gaps[i])];
+        }
+
+        // Pick the width that gives the smallest block, counting each
+        // exception as a word for its high bits and a byte for its position
+        int bits = 32;
+        uint64_t bestCost = numGaps * 32;
+        size_t numExceptions = numGaps;
+        for (int w = 0;  w < 32;  ++w) {
+            numExceptions -= widthCounts[w];
+            uint64_t cost = numGaps * w + numExceptions * 40;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bits = w;
+            }
+        }
+
+        numExceptions = 0;
+        for (size_t i = 0;  i < numGaps;  ++i) {
+            if (bitWidth(gaps[i]) > bits)
+                positions[numExceptions++] = i;
+        }
+
+        result.push_back(bits | (numExceptions << 8));
+
+        size_t packedStart = result.size();
+        result.resize(packedStart + (numGaps * bits + 31) / 32, 0);
+        pack(gaps, numGaps, bits, result.data() + packedStart);
+
+        for (size_t e = 0;  e < numExceptions;  ++e)
+            result.push_back(gaps[positions[e]] >> bits);
+
+        size_t positionsStart = result.size();
+        result.resize(positionsStart + (numExceptions + 3) / 4, 0);
+        memcpy(result.data() + positionsStart, positions, numExceptions);
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* POSTING LIST CURSOR                                                       */
+/*****************************************************************************/
+
+PostingListCursor::
+PostingListCursor(const uint32_t * data, size_t length)
+    : data_(data), length_(length), legacyBits_(-1), pos_(0), current_(0),
+      numBlocks_((length + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE),
+      blockNum_(0), blockStart_(0), blockLength_(0)
+{
+    if (length_ > 0)
+        loadBlock(0);
+}
+
+PostingListCursor::
+PostingListCursor(const uint32_t * data, size_t length, int bits)
+    : data_(data), length_(length), legacyBits_(bits), pos_(0), current_(0),
+      numBlocks_(0), blockNum_(0), blockStart_(0), blockLength_(0)
+{
+    ExcAssertGreaterEqual(bits, 0);
+    ExcAssertLessEqual(bits, 32);
+    if (length_ > 0)
+        current_ = legacyAt(0);
+}
+
+void
+PostingListCursor::
+loadBlock(size_t blockNum)
+{
+    blockNum_ = blockNum;
+    blockStart_ = blockNum * POSTING_BLOCK_SIZE;
+    blockLength_ = std::min<size_t>(POSTING_BLOCK_SIZE, length_ - blockStart_);
+    pos_ = blockStart_;
+
+    block_[0] = blockFirstValue(blockNum);
+
+    if (blockLength_ > 1) {
+        const uint32_t * body
+            = numBlocks_ == 1 ? data_ + 1 : data_ + data_[blockNum * 2 + 1];
+        int bits = body[0] & 0xff;
+        size_t numExceptions = body[0] >> 8;
+        size_t numGaps = blockLength_ - 1;
+
+        const uint32_t * packed = body + 1;
+        unpack(packed, numGaps, bits, block_ + 1);
+
+        const uint32_t * highBits = packed + (numGaps * bits + 31) / 32;
+        const uint8_t * positions
+            = (const uint8_t *)(highBits + numExceptions);
+        for (size_t e = 0;  e < numExceptions;  ++e)
+            block_[1 + positions[e]] |= highBits[e] << bits;
+
+        for (size_t i = 1;  i < blockLength_;  ++i)
+            block_[i] += block_[i - 1] + 1;
+    }
+
+    current_ = block_[0];
+}
+
+uint32_t
+PostingListCursor::
+legacyAt(size_t index) const
+{
+    if (legacyBits_ == 0)
+        return 0;
+    uint64_t bitPos = (uint64_t)index * legacyBits_;
+    size_t word = bitPos >> 5;
+    int shift = bitPos & 31;
+    uint64_t w = data_[word];
+    if (shift + legacyBits_ > 32)
+        w |= (uint64_t)data_[word + 1] << 32;
+    return (w >> shift) & lowBits(legacyBits_);
+}
+
+void
+PostingListCursor::
+advanceTo(uint32_t target)
+{
+    if (pos_ == length_ || current_ >= target)
+        return;
+
+    if (legacyBits_ >= 0) {
+        // Gallop forward to bracket the target, then binary search.  The
+        // value at lo is always less than the target, and the value at hi
+        // is not (or hi is the end).
+        size_t lo = pos_, step = 1, hi = pos_ + 1;
+        while (hi < length_ && legacyAt(hi) < target) {
+            lo = hi;
+            step *= 2;
+            hi = lo + step;
+        }
+        hi = std::min(hi, length_);
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (legacyAt(mid) < target)
+                lo = mid;
+            else hi = mid;
+        }
+        pos_ = hi;
+        if (pos_ < length_)
+            current_ = legacyAt(pos_);
+        return;
+    }
+
+    // Skip to the last block that starts at or before the target, using
+    // the directory, without decoding the blocks in between
+    if (blockNum_ + 1 < numBlocks_ && blockFirstValue(blockNum_ + 1) <= target) {
+        size_t lo = blockNum_ + 1, hi = numBlocks_;
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (blockFirstValue(mid) <= target)
+                lo = mid;
+            else hi = mid;
+        }
+        loadBlock(lo);
+        if (current_ >= target)
+            return;
+    }
+
+    size_t i = firstNotLess(block_, pos_ - blockStart_, blockLength_, target);
+    if (i < blockLength_) {
+        pos_ = blockStart_ + i;
+        current_ = block_[i];
+    }
+    else if (blockNum_ + 1 < numBlocks_) {
+        // The next block starts after the target, or we would have
+        // skipped to it
+        loadBlock(blockNum_ + 1);
+    }
+    else pos_ = length_;
+}
+
+} // namespace MLDB
@@ -0,0 +1,130 @@
+/* posting_list.h                                                  -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Compressed lists of the subjects that have a behavior.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* POSTING LIST                                                              */
+/*****************************************************************************/
+
+/** Posting lists are sorted lists of distinct 32 bit integers (the indexes
+    of the subjects that have a behavior).  From version 6 of the mapped
+    behavior file format they are stored with patched frame of reference
+    delta coding (PForDelta; Zukowski et al. 2006, with the exceptions
+    stored as in NewPFD, Yan et al. 2009):
+
+    - The values are split into blocks of POSTING_BLOCK_SIZE.
+    - If there is more than one block, the list starts with a directory
+      of two words per block: its first value, and the word offset of the
+      rest of the block from the start of the list.  This allows blocks to
+      be skipped without being decoded.  A list of a single block instead
+      starts with its first value, followed by the rest of the block.
+    - The rest of a block of more than one value is a header word (the bit
+      width b in the low 8 bits, and the number of exceptions above), then
+      for each following value the low b bits of its gap minus one, packed
+      together, then the higher bits of the gaps that don't fit in b bits
+      (one word each), then the position of each of those exceptions (one
+      byte each, padded to a word).
+
+    b is chosen for each block to minimize its size, so that a few large
+    gaps don't make the whole block wide.  For the behaviors of very many
+    subjects, the gaps are small and the list takes a few bits per subject
+    instead of the log2(numSubjects) bits of the legacy format.
+*/
+
+static constexpr int POSTING_BLOCK_SIZE = 128;
+
+/** Encode the n sorted and distinct values into a posting list. */
+std::vector<uint32_t> encodePostingList(const uint32_t * values, size_t n);
+
+
+/*****************************************************************************/
+/* POSTING LIST CURSOR                                                       */
+/*****************************************************************************/
+
+/** Sequential access to a posting list, with the ability to skip forward
+    to a value, which is what is needed to intersect them.  It can read
+    both the compressed lists and the fixed width lists of legacy files.
+*/
+
+struct PostingListCursor {
+
+    /** Cursor over an encoded posting list of the given length. */
+    PostingListCursor(const uint32_t * data, size_t length);
+
+    /** Cursor over a legacy list of the given length, which is the values
+        packed together in bits bits each. */
+    PostingListCursor(const uint32_t * data, size_t length, int bits);
+
+    /** Are we past the last value? */
+    bool done() const
+    {
+        return pos_ == length_;
+    }
+
+    /** Current value.  Only valid if !done(). */
+    uint32_t value() const
+    {
+        return current_;
+    }
+
+    /** Position of the current value in the list. */
+    size_t index() const
+    {
+        return pos_;
+    }
+
+    /** Move to the next value. */
+    void next()
+    {
+        if (++pos_ == length_)
+            return;
+        if (legacyBits_ >= 0)
+            current_ = legacyAt(pos_);
+        else if (pos_ - blockStart_ < blockLength_)
+            current_ = block_[pos_ - blockStart_];
+        else loadBlock(blockNum_ + 1);
+    }
+
+    /** Move forward to the first value that is greater than or equal to
+        target, or to the end if there is none.  A cursor that is already
+        there doesn't move.
+    */
+    void advanceTo(uint32_t target);
+
+private:
+    const uint32_t * data_;
+    size_t length_;
+    int legacyBits_;         ///< Width of legacy values, or -1 if encoded
+    size_t pos_;
+    uint32_t current_;
+
+    size_t numBlocks_;
+    size_t blockNum_;        ///< Block that is decoded in block_
+    size_t blockStart_;      ///< Position of the first value of block_
+    size_t blockLength_;     ///< Number of values in block_
+    uint32_t block_[POSTING_BLOCK_SIZE];
+
+    /** Decode the given block, and move to its first value. */
+    void loadBlock(size_t blockNum);
+
+    uint32_t blockFirstValue(size_t blockNum) const
+    {
+        return numBlocks_ == 1 ? data_[0] : data_[blockNum * 2];
+    }
+
+    uint32_t legacyAt(size_t index) const;
+};
+
+} // namespace MLDB
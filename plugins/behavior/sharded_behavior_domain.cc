@@ -0,0 +1,688 @@
+/* sharded_behavior_domain.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Behavior domain that is partitioned by subject into independent mutable
+   behavior domains.
+*/
+
+#include "sharded_behavior_domain.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/server/parallel_merge_sort.h"
+#include <algorithm>
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SHARDED MUTABLE BEHAVIOR DOMAIN                                           */
+/*****************************************************************************/
+
+ShardedMutableBehaviorDomain::
+ShardedMutableBehaviorDomain(int numShards, double timeQuantum,
+                             int minSubjects)
+    : BehaviorDomain(minSubjects, timeQuantum),
+      nominalStart_(Date::positiveInfinity()),
+      nominalEnd_(Date::negativeInfinity())
+{
+    if (numShards <= 0)
+        numShards = numCpus();
+
+    shards.resize(numShards);
+    for (auto & shard: shards) {
+        shard = std::make_shared<MutableBehaviorDomain>(minSubjects);
+        shard->timeQuantum = timeQuantum;
+    }
+}
+
+ShardedMutableBehaviorDomain::
+ShardedMutableBehaviorDomain(const ShardedMutableBehaviorDomain & other,
+                             bool deep)
+    : BehaviorDomain(other),
+      shards(other.shards.size()),
+      nominalStart_(other.nominalStart_),
+      nominalEnd_(other.nominalEnd_),
+      fileMetadata_(other.getAllFileMetadata())
+{
+    for (unsigned i = 0;  i < shards.size();  ++i) {
+        shards[i].reset(deep
+                        ? other.shards[i]->makeDeepCopy()
+                        : other.shards[i]->makeShallowCopy());
+    }
+}
+
+ShardedMutableBehaviorDomain::
+~ShardedMutableBehaviorDomain()
+{
+}
+
+ShardedMutableBehaviorDomain *
+ShardedMutableBehaviorDomain::
+makeShallowCopy() const
+{
+    return new ShardedMutableBehaviorDomain(*this, false /* deep */);
+}
+
+ShardedMutableBehaviorDomain *
+ShardedMutableBehaviorDomain::
+makeDeepCopy() const
+{
+    return new ShardedMutableBehaviorDomain(*this, true /* deep */);
+}
+
+void
+ShardedMutableBehaviorDomain::
+record(const Id & subject, const Id & behavior, Date ts,
+       uint32_t count, const Id & verb)
+{
+    shardOf(SH(subject)).record(subject, behavior, ts, count, verb);
+}
+
+void
+ShardedMutableBehaviorDomain::
+recordOnce(const Id & subject,
+           const Id & behavior, Date ts, const Id & verb)
+{
+    shardOf(SH(subject)).recordOnce(subject, behavior, ts, verb);
+}
+
+void
+ShardedMutableBehaviorDomain::
+recordMany(const Id & subject,
+           const ManyEntryInt * first,
+           size_t n)
+{
+    shardOf(SH(subject)).recordMany(subject, first, n);
+}
+
+void
+ShardedMutableBehaviorDomain::
+recordMany(const Id & subject,
+           const ManyEntryId * first,
+           size_t n)
+{
+    shardOf(SH(subject)).recordMany(subject, first, n);
+}
+
+void
+ShardedMutableBehaviorDomain::
+recordMany(const Id * behIds,
+           size_t numBehIds,
+           const Id * subjectIds,
+           size_t numSubjectIds,
+           const ManyEntryIndex * first,
+           size_t n)
+{
+    // Split the events up by the shard of their subject.  Each shard gets
+    // its own subject and behavior lists, renumbered, so that it only
+    // creates the entries that it records into.
+    struct ShardEvents {
+        std::vector<Id> behIds, subjectIds;
+        std::vector<int> behIndex;
+        std::vector<ManyEntryIndex> entries;
+    };
+
+    std::vector<int> subjectShard(numSubjectIds), subjectIndex(numSubjectIds);
+    std::vector<ShardEvents> events(shards.size());
+
+    for (unsigned i = 0;  i < numSubjectIds;  ++i) {
+        int s = shardFor(SH(subjectIds[i]));
+        subjectShard[i] = s;
+        subjectIndex[i] = events[s].subjectIds.size();
+        events[s].subjectIds.push_back(subjectIds[i]);
+    }
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        ManyEntryIndex entry = first[i];
+        ShardEvents & shardEvents = events[subjectShard.at(entry.subjIndex)];
+
+        if (shardEvents.behIndex.empty())
+            shardEvents.behIndex.resize(numBehIds, -1);
+        int & behIndex = shardEvents.behIndex.at(entry.behIndex);
+        if (behIndex == -1) {
+            behIndex = shardEvents.behIds.size();
+            shardEvents.behIds.push_back(behIds[entry.behIndex]);
+        }
+
+        entry.behIndex = behIndex;
+        entry.subjIndex = subjectIndex[entry.subjIndex];
+        shardEvents.entries.push_back(entry);
+    }
+
+    for (unsigned s = 0;  s < shards.size();  ++s) {
+        const ShardEvents & shardEvents = events[s];
+        if (shardEvents.entries.empty())
+            continue;
+        shards[s]->recordMany(shardEvents.behIds.data(),
+                              shardEvents.behIds.size(),
+                              shardEvents.subjectIds.data(),
+                              shardEvents.subjectIds.size(),
+                              shardEvents.entries.data(),
+                              shardEvents.entries.size());
+    }
+}
+
+void
+ShardedMutableBehaviorDomain::
+recordManySubjects(const Id & beh,
+                   const ManySubjectId * first,
+                   size_t n)
+{
+    std::vector<std::vector<ManySubjectId> > events(shards.size());
+    for (unsigned i = 0;  i < n;  ++i)
+        events[shardFor(SH(first[i].subject))].push_back(first[i]);
+
+    for (unsigned s = 0;  s < shards.size();  ++s) {
+        if (events[s].empty())
+            continue;
+        shards[s]->recordManySubjects(beh, events[s].data(), events[s].size());
+    }
+}
+
+void
+ShardedMutableBehaviorDomain::
+finish()
+{
+    parallelMap(0, shards.size(),
+                [&] (int s) { shards[s]->finish(); });
+}
+
+void
+ShardedMutableBehaviorDomain::
+makeImmutable()
+{
+    parallelMap(0, shards.size(),
+                [&] (int s) { shards[s]->makeImmutable(); });
+}
+
+void
+ShardedMutableBehaviorDomain::
+compact()
+{
+    parallelMap(0, shards.size(),
+                [&] (int s) { shards[s]->compact(); });
+}
+
+size_t
+ShardedMutableBehaviorDomain::
+subjectCount() const
+{
+    size_t result = 0;
+    for (auto & shard: shards)
+        result += shard->subjectCount();
+    return result;
+}
+
+size_t
+ShardedMutableBehaviorDomain::
+behaviorCount() const
+{
+    if (shards.size() == 1)
+        return shards[0]->behaviorCount();
+    return allBehaviorHashes().size();
+}
+
+std::vector<BH>
+ShardedMutableBehaviorDomain::
+allBehaviorHashes(bool sorted) const
+{
+    if (shards.size() == 1)
+        return shards[0]->allBehaviorHashes(sorted);
+
+    // The same behavior can be in many shards; sorting is the easiest way
+    // to remove the duplicates, so the result is always sorted
+    std::vector<BH> result;
+    for (auto & shard: shards) {
+        auto behs = shard->allBehaviorHashes();
+        result.insert(result.end(), behs.begin(), behs.end());
+    }
+
+    MLDB::parallelQuickSortRecursive<BH>(result);
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
+std::vector<SH>
+ShardedMutableBehaviorDomain::
+allSubjectHashes(SH maxSubject, bool sorted) const
+{
+    std::vector<SH> result;
+    for (auto & shard: shards) {
+        auto subjects = shard->allSubjectHashes(maxSubject);
+        result.insert(result.end(), subjects.begin(), subjects.end());
+    }
+
+    if (sorted)
+        MLDB::parallelQuickSortRecursive<SH>(result);
+
+    return result;
+}
+
+namespace {
+
+/** Stream of the behaviors of a sharded domain, in order of hash. */
+struct ShardedBehaviorDomainBehaviorStream
+    : public BehaviorDomain::BehaviorStream
+{
+    ShardedBehaviorDomainBehaviorStream
+        (const ShardedMutableBehaviorDomain * source, size_t start)
+        : behs(source->allBehaviorHashes(true)), index(start), source(source)
+    {
+    }
+
+    virtual Id next()
+    {
+        Id result = current();
+        advance();
+        return result;
+    }
+
+    virtual Id current() const
+    {
+        if (index >= behs.size())
+            return Id();
+        return source->getBehaviorId(behs[index]);
+    }
+
+    virtual void advance()
+    {
+        ++index;
+    }
+
+    virtual void advanceBy(size_t n)
+    {
+        index += n;
+    }
+
+    std::vector<BH> behs;
+    size_t index;
+    const ShardedMutableBehaviorDomain * source;
+};
+
+/** Stream of the subjects of a sharded domain, one shard after another. */
+struct ShardedBehaviorDomainSubjectStream
+    : public BehaviorDomain::SubjectStream
+{
+    ShardedBehaviorDomainSubjectStream
+        (const ShardedMutableBehaviorDomain * source, size_t start)
+        : s(0), remaining(0), source(source)
+    {
+        // Skip the shards that are entirely before the start
+        for (;  s < source->numShards();  ++s) {
+            size_t count = source->shard(s)->subjectCount();
+            if (start < count) {
+                stream = source->shard(s)->getSubjectStream(start);
+                remaining = count - start;
+                break;
+            }
+            start -= count;
+        }
+    }
+
+    virtual Id next()
+    {
+        Id result = current();
+        advance();
+        return result;
+    }
+
+    virtual Id current() const
+    {
+        ExcAssert(stream);
+        return stream->current();
+    }
+
+    virtual void advance()
+    {
+        ExcAssert(stream);
+
+        if (--remaining > 0) {
+            stream->advance();
+            return;
+        }
+
+        // Move on to the next shard with any subjects
+        stream.reset();
+        for (++s;  s < source->numShards();  ++s) {
+            remaining = source->shard(s)->subjectCount();
+            if (remaining > 0) {
+                stream = source->shard(s)->getSubjectStream(0);
+                return;
+            }
+        }
+    }
+
+    virtual void advanceBy(size_t n)
+    {
+        while (n--)
+            advance();
+    }
+
+    size_t s;           ///< Shard number
+    size_t remaining;   ///< Number of subjects left in the shard
+    std::unique_ptr<BehaviorDomain::SubjectStream> stream;  ///< Shard's stream
+    const ShardedMutableBehaviorDomain * source;
+};
+
+} // file scope
+
+std::unique_ptr<BehaviorDomain::BehaviorStream>
+ShardedMutableBehaviorDomain::
+getBehaviorStream(size_t start) const
+{
+    std::unique_ptr<BehaviorDomain::BehaviorStream> result
+        (new ShardedBehaviorDomainBehaviorStream(this, start));
+    return result;
+}
+
+std::unique_ptr<BehaviorDomain::SubjectStream>
+ShardedMutableBehaviorDomain::
+getSubjectStream(size_t start) const
+{
+    std::unique_ptr<BehaviorDomain::SubjectStream> result
+        (new ShardedBehaviorDomainSubjectStream(this, start));
+    return result;
+}
+
+bool
+ShardedMutableBehaviorDomain::
+forEachSubject(const OnSubject & onSubject,
+               const SubjectFilter & filter) const
+{
+    for (auto & shard: shards)
+        if (!shard->forEachSubject(onSubject, filter))
+            return false;
+    return true;
+}
+
+bool
+ShardedMutableBehaviorDomain::
+knownSubject(SH subjectHash) const
+{
+    return shardOf(subjectHash).knownSubject(subjectHash);
+}
+
+bool
+ShardedMutableBehaviorDomain::
+knownBehavior(BH behHash) const
+{
+    for (auto & shard: shards)
+        if (shard->knownBehavior(behHash))
+            return true;
+    return false;
+}
+
+BehaviorDomain::SubjectStats
+ShardedMutableBehaviorDomain::
+getSubjectStats(SH subjectHash,
+                bool needDistinctBehaviors,
+                bool needDistinctTimestamps) const
+{
+    return shardOf(subjectHash)
+        .getSubjectStats(subjectHash, needDistinctBehaviors,
+                         needDistinctTimestamps);
+}
+
+std::pair<Date, Date>
+ShardedMutableBehaviorDomain::
+getSubjectTimestampRange(SH subjectHash) const
+{
+    return shardOf(subjectHash).getSubjectTimestampRange(subjectHash);
+}
+
+int
+ShardedMutableBehaviorDomain::
+numDistinctTimestamps(SH subjectHash, uint32_t maxValue) const
+{
+    return shardOf(subjectHash).numDistinctTimestamps(subjectHash, maxValue);
+}
+
+std::vector<SH>
+ShardedMutableBehaviorDomain::
+getSubjectHashes(BH beh, SH maxSubject, bool sorted) const
+{
+    std::vector<SH> result;
+    for (auto & shard: shards) {
+        auto subjects = shard->getSubjectHashes(beh, maxSubject);
+        result.insert(result.end(), subjects.begin(), subjects.end());
+    }
+
+    if (sorted)
+        std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+std::vector<std::pair<SH, Date> >
+ShardedMutableBehaviorDomain::
+getSubjectHashesAndTimestamps(BH beh, SH maxSubject, bool sorted) const
+{
+    std::vector<std::pair<SH, Date> > result;
+    for (auto & shard: shards) {
+        auto subjects = shard->getSubjectHashesAndTimestamps(beh, maxSubject);
+        result.insert(result.end(), subjects.begin(), subjects.end());
+    }
+
+    if (sorted)
+        std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+std::vector<std::pair<SH, Date> >
+ShardedMutableBehaviorDomain::
+getSubjectHashesAndAllTimestamps(BH beh, SH maxSubject, bool sorted) const
+{
+    std::vector<std::pair<SH, Date> > result;
+    for (auto & shard: shards) {
+        auto subjects
+            = shard->getSubjectHashesAndAllTimestamps(beh, maxSubject);
+        result.insert(result.end(), subjects.begin(), subjects.end());
+    }
+
+    if (sorted)
+        std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+bool
+ShardedMutableBehaviorDomain::
+forEachBehaviorSubject(BH beh,
+                        const OnBehaviorSubject & onSubject,
+                        bool withTimestamps,
+                        Order order,
+                        SH maxSubject) const
+{
+    if (order == INORDER) {
+        for (auto & s_ts: getSubjectHashesAndTimestamps(beh, maxSubject, true))
+            if (!onSubject(s_ts.first, s_ts.second))
+                return false;
+        return true;
+    }
+
+    for (auto & shard: shards)
+        if (!shard->forEachBehaviorSubject(beh, onSubject, withTimestamps,
+                                           order, maxSubject))
+            return false;
+    return true;
+}
+
+size_t
+ShardedMutableBehaviorDomain::
+getBehaviorSubjectCount(BH beh, SH maxSubject, Precision p) const
+{
+    // The shards have no subjects in common, so the counts add up
+    size_t result = 0;
+    for (auto & shard: shards)
+        result += shard->getBehaviorSubjectCount(beh, maxSubject, p);
+    return result;
+}
+
+int
+ShardedMutableBehaviorDomain::
+coIterateBehaviors(BH beh1, BH beh2,
+                   SH maxSubject,
+                   const OnBehaviors & onBehaviors) const
+{
+    // A subject has both behaviors in its own shard or not at all
+    int result = 0;
+    for (auto & shard: shards)
+        result += shard->coIterateBehaviors(beh1, beh2, maxSubject,
+                                            onBehaviors);
+    return result;
+}
+
+bool
+ShardedMutableBehaviorDomain::
+subjectHasNDistinctBehaviors(SH subject, int N) const
+{
+    return shardOf(subject).subjectHasNDistinctBehaviors(subject, N);
+}
+
+Id
+ShardedMutableBehaviorDomain::
+getSubjectId(SH subjectHash) const
+{
+    return shardOf(subjectHash).getSubjectId(subjectHash);
+}
+
+Id
+ShardedMutableBehaviorDomain::
+getBehaviorId(BH beh) const
+{
+    for (auto & shard: shards)
+        if (shard->knownBehavior(beh))
+            return shard->getBehaviorId(beh);
+
+    // Let the shard deal with an unknown behavior
+    return shards[0]->getBehaviorId(beh);
+}
+
+BehaviorDomain::BehaviorStats
+ShardedMutableBehaviorDomain::
+getBehaviorStats(BH beh, int fields) const
+{
+    BehaviorStats result;
+    for (auto & shard: shards) {
+        if (!shard->knownBehavior(beh))
+            continue;
+        BehaviorStats stats = shard->getBehaviorStats(beh, fields);
+        result.id = stats.id;
+        result.subjectCount += stats.subjectCount;
+        result.earliest.setMin(stats.earliest);
+        result.latest.setMax(stats.latest);
+    }
+
+    return result;
+}
+
+std::vector<std::pair<BH, uint32_t> >
+ShardedMutableBehaviorDomain::
+getSubjectBehaviorCounts(SH subjectHash, Order order) const
+{
+    return shardOf(subjectHash).getSubjectBehaviorCounts(subjectHash, order);
+}
+
+bool
+ShardedMutableBehaviorDomain::
+forEachSubjectBehaviorHash(SH subject,
+                           const OnSubjectBehaviorHash & onBeh,
+                           SubjectBehaviorFilter filter,
+                           Order order) const
+{
+    return shardOf(subject)
+        .forEachSubjectBehaviorHash(subject, onBeh, filter, order);
+}
+
+Date
+ShardedMutableBehaviorDomain::
+earliestTime() const
+{
+    Date result = shards[0]->earliestTime();
+    for (auto & shard: shards)
+        result.setMin(shard->earliestTime());
+    return result;
+}
+
+Date
+ShardedMutableBehaviorDomain::
+latestTime() const
+{
+    Date result = shards[0]->latestTime();
+    for (auto & shard: shards)
+        result.setMax(shard->latestTime());
+    return result;
+}
+
+void
+ShardedMutableBehaviorDomain::
+setNominalTimeRange(Date start, Date end)
+{
+    ExcAssertGreater(end, start);
+
+    nominalStart_ = start;
+    nominalEnd_ = end;
+
+    for (auto & shard: shards)
+        shard->setNominalTimeRange(start, end);
+}
+
+bool
+ShardedMutableBehaviorDomain::
+fileMetadataExists(const std::string & key) const
+{
+    std::unique_lock<std::mutex> guard(fileMetadataLock);
+    return fileMetadata_.isMember(key);
+}
+
+Json::Value
+ShardedMutableBehaviorDomain::
+getFileMetadata(const std::string & key) const
+{
+    std::unique_lock<std::mutex> guard(fileMetadataLock);
+    return fileMetadata_[key];
+}
+
+void
+ShardedMutableBehaviorDomain::
+setFileMetadata(const std::string & key,
+                Json::Value && value)
+{
+    std::unique_lock<std::mutex> guard(fileMetadataLock);
+    fileMetadata_[key] = std::move(value);
+}
+
+Json::Value
+ShardedMutableBehaviorDomain::
+getAllFileMetadata() const
+{
+    std::unique_lock<std::mutex> guard(fileMetadataLock);
+    return fileMetadata_;
+}
+
+int64_t
+ShardedMutableBehaviorDomain::
+totalEventsRecorded() const
+{
+    int64_t result = 0;
+    for (auto & shard: shards)
+        result += shard->totalEventsRecorded();
+    return result;
+}
+
+int64_t
+ShardedMutableBehaviorDomain::
+approximateMemoryUsage() const
+{
+    int64_t result = 0;
+    for (auto & shard: shards)
+        result += shard->approximateMemoryUsage();
+    return result;
+}
+
+} // namespace MLDB
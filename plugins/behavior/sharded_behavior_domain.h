@@ -0,0 +1,254 @@
+/* sharded_behavior_domain.h                                       -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Behavior domain that is partitioned by subject into independent mutable
+   behavior domains, so that recording scales with the number of writers.
+*/
+
+#pragma once
+
+#include "mutable_behavior_domain.h"
+#include <mutex>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SHARDED MUTABLE BEHAVIOR DOMAIN                                           */
+/*****************************************************************************/
+
+/** A mutable behavior domain that is split into a number of independent
+    MutableBehaviorDomain shards, by the hash of the subject.
+
+    Within a single MutableBehaviorDomain, the subjects are spread over
+    several roots, but the behaviors (with their locks and index), the
+    time range and the event counter are shared between all writers.  Here
+    nothing is shared between shards, and so writers recording different
+    subjects only contend when they fall in the same shard.
+
+    Each subject lives in exactly one shard.  Queries about a subject go
+    to its shard only; queries about a behavior go to all of the shards
+    and their results are combined, which is simple as the subject sets of
+    the shards are disjoint.  finish(), compact() and makeImmutable() run
+    on the shards in parallel.
+
+    This is thread safe in the same way as MutableBehaviorDomain.
+*/
+
+struct ShardedMutableBehaviorDomain : public BehaviorDomain {
+
+    typedef MutableBehaviorDomain::ManyEntryInt ManyEntryInt;
+    typedef MutableBehaviorDomain::ManyEntryId ManyEntryId;
+    typedef MutableBehaviorDomain::ManyEntryIndex ManyEntryIndex;
+    typedef MutableBehaviorDomain::ManySubjectId ManySubjectId;
+
+    /** Create with the given number of shards.  Zero or less means one
+        per hardware thread.
+    */
+    ShardedMutableBehaviorDomain(int numShards = 0,
+                                 double timeQuantum = 1.0,
+                                 int minSubjects = 1);
+
+    ~ShardedMutableBehaviorDomain();
+
+    /** Make a copy of the data structure, shard by shard.  */
+    virtual ShardedMutableBehaviorDomain * makeShallowCopy() const;
+
+    /** Make a deep copy of the data structure, shard by shard. */
+    virtual ShardedMutableBehaviorDomain * makeDeepCopy() const;
+
+    /** Number of shards. */
+    size_t numShards() const
+    {
+        return shards.size();
+    }
+
+    /** Shard that records the given subject. */
+    int shardFor(SH subject) const
+    {
+        return subject.hash() % shards.size();
+    }
+
+    /** Return the given shard. */
+    const std::shared_ptr<MutableBehaviorDomain> & shard(int i) const
+    {
+        return shards.at(i);
+    }
+
+    virtual void
+    record(const Id & subject, const Id & behavior, Date ts,
+           uint32_t count = 1, const Id & verb = Id());
+
+    virtual void
+    recordOnce(const Id & subject,
+               const Id & behavior, Date ts, const Id & verb = Id());
+
+    void recordMany(const Id & subject,
+                    const ManyEntryInt * first,
+                    size_t n);
+
+    void recordMany(const Id & subject,
+                    const ManyEntryId * first,
+                    size_t n);
+
+    /** Record events for many subjects at once.  The events are split up
+        by the shard of their subject, and each shard only sees the
+        subjects and behaviors of its own events.
+    */
+    void recordMany(const Id * behIds,
+                    size_t numBehIds,
+                    const Id * subjectIds,
+                    size_t numSubjectIds,
+                    const ManyEntryIndex * first,
+                    size_t n);
+
+    void recordManySubjects(const Id & beh,
+                            const ManySubjectId * first,
+                            size_t n);
+
+    virtual void finish();
+
+    virtual size_t subjectCount() const;
+
+    virtual size_t behaviorCount() const;
+
+    virtual std::vector<BH> allBehaviorHashes(bool sorted = false) const;
+
+    virtual std::vector<SH>
+    allSubjectHashes(SH maxSubject = SH(-1), bool sorted = false) const;
+
+    virtual std::unique_ptr<BehaviorStream>
+    getBehaviorStream(size_t start) const;
+
+    virtual std::unique_ptr<SubjectStream>
+    getSubjectStream(size_t start) const;
+
+    virtual bool
+    forEachSubject(const OnSubject & onSubject,
+                   const SubjectFilter & filter = SubjectFilter()) const;
+
+    virtual bool knownSubject(SH subjectHash) const;
+
+    virtual bool knownBehavior(BH behHash) const;
+
+    virtual SubjectStats
+    getSubjectStats(SH subjectHash,
+                    bool needDistinctBehaviors = true,
+                    bool needDistinctTimestamps = false) const;
+
+    virtual std::pair<Date, Date>
+    getSubjectTimestampRange(SH subjectHash) const;
+
+    virtual int
+    numDistinctTimestamps(SH subjectHash, uint32_t maxValue = -1) const;
+
+    virtual std::vector<SH>
+    getSubjectHashes(BH beh, SH maxSubject = SH(-1), bool sorted = false)
+        const;
+
+    virtual std::vector<std::pair<SH, Date> >
+    getSubjectHashesAndTimestamps(BH beh, SH maxSubject = SH(-1),
+                                  bool sorted = false) const;
+
+    virtual std::vector<std::pair<SH, Date> >
+    getSubjectHashesAndAllTimestamps(BH beh, SH maxSubject = SH(-1),
+                                     bool sorted = false) const;
+
+    virtual bool
+    forEachBehaviorSubject(BH beh,
+                            const OnBehaviorSubject & onSubject,
+                            bool withTimestamps = false,
+                            Order order = INORDER,
+                            SH maxSubject = SH::max()) const;
+
+    virtual size_t
+    getBehaviorSubjectCount(BH beh, SH maxSubject = SH::max(),
+                             Precision p = EXACT) const;
+
+    virtual int coIterateBehaviors(BH beh1, BH beh2,
+                                    SH maxSubject = SH::max(),
+                                    const OnBehaviors & onBehaviors
+                                        = OnBehaviors()) const;
+
+    virtual bool subjectHasNDistinctBehaviors(SH subject, int N) const;
+
+    virtual Id getSubjectId(SH subjectHash) const;
+
+    virtual Id getBehaviorId(BH beh) const;
+
+    virtual BehaviorStats
+    getBehaviorStats(BH behavior, int fields) const;
+
+    virtual std::vector<std::pair<BH, uint32_t> >
+    getSubjectBehaviorCounts(SH subjectHash, Order order = INORDER) const;
+
+    virtual bool forEachSubjectBehaviorHash
+        (SH subject,
+         const OnSubjectBehaviorHash & onBeh,
+         SubjectBehaviorFilter filter = SubjectBehaviorFilter(),
+         Order order = INORDER) const;
+
+    using BehaviorDomain::getSubjectBehaviorCounts;
+
+    virtual Date earliestTime() const;
+
+    virtual Date latestTime() const;
+
+    virtual Date nominalStart() const
+    {
+        return nominalStart_;
+    }
+
+    virtual Date nominalEnd() const
+    {
+        return nominalEnd_;
+    }
+
+    virtual void setNominalTimeRange(Date start, Date end);
+
+    virtual bool fileMetadataExists(const std::string & key) const;
+
+    virtual Json::Value getFileMetadata(const std::string & key) const;
+
+    virtual void setFileMetadata(const std::string & key,
+                                 Json::Value && value);
+
+    virtual Json::Value getAllFileMetadata() const;
+
+    virtual int64_t totalEventsRecorded() const;
+
+    virtual int64_t approximateMemoryUsage() const;
+
+    /** Make all of the shards immutable, in parallel. */
+    virtual void makeImmutable();
+
+    /** Compact all of the shards, in parallel.  See
+        MutableBehaviorDomain::compact().
+    */
+    void compact();
+
+private:
+    /** Copy the other domain, with shallow or deep copies of its shards. */
+    ShardedMutableBehaviorDomain(const ShardedMutableBehaviorDomain & other,
+                                 bool deep);
+
+    const MutableBehaviorDomain & shardOf(SH subject) const
+    {
+        return *shards[shardFor(subject)];
+    }
+
+    MutableBehaviorDomain & shardOf(SH subject)
+    {
+        return *shards[shardFor(subject)];
+    }
+
+    std::vector<std::shared_ptr<MutableBehaviorDomain> > shards;
+
+    Date nominalStart_, nominalEnd_;
+
+    mutable std::mutex fileMetadataLock;
+    Json::Value fileMetadata_;
+};
+
+} // namespace MLDB
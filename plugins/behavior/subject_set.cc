@@ -0,0 +1,410 @@
+/* subject_set.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Compressed sets of subjects, used to evaluate boolean expressions.
+*/
+
+#include "subject_set.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Maximum number of values in an array chunk
+static constexpr size_t ARRAY_MAX = 4096;
+
+/// Number of words in a bitmap chunk
+static constexpr size_t BITMAP_WORDS = 65536 / 64;
+
+inline bool testBit(const uint64_t * bits, uint16_t low)
+{
+    return bits[low >> 6] & (uint64_t(1) << (low & 63));
+}
+
+inline void setBit(uint64_t * bits, uint16_t low)
+{
+    bits[low >> 6] |= uint64_t(1) << (low & 63);
+}
+
+inline void clearBit(uint64_t * bits, uint16_t low)
+{
+    bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SUBJECT SET                                                               */
+/*****************************************************************************/
+
+SubjectSet::
+SubjectSet()
+    : count_(0)
+{
+}
+
+SubjectSet::
+SubjectSet(const uint32_t * values, size_t n)
+    : count_(0)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        append(values[i]);
+}
+
+SubjectSet
+SubjectSet::
+all(uint32_t n)
+{
+    SubjectSet result;
+    for (uint64_t start = 0;  start < n;  start += 65536) {
+        size_t num = std::min<uint64_t>(65536, n - start);
+        Chunk chunk(start >> 16);
+        if (num <= ARRAY_MAX) {
+            chunk.array.resize(num);
+            for (size_t i = 0;  i < num;  ++i)
+                chunk.array[i] = i;
+        }
+        else {
+            chunk.bits.resize(BITMAP_WORDS, 0);
+            std::fill(chunk.bits.begin(), chunk.bits.begin() + num / 64,
+                      uint64_t(-1));
+            if (num % 64)
+                chunk.bits[num / 64] = (uint64_t(1) << (num % 64)) - 1;
+        }
+        chunk.cardinality = num;
+        result.chunks.emplace_back(std::move(chunk));
+    }
+    result.count_ = n;
+    return result;
+}
+
+void
+SubjectSet::
+append(uint32_t value)
+{
+    uint16_t key = value >> 16, low = value;
+    if (chunks.empty() || chunks.back().key != key) {
+        ExcAssert(chunks.empty() || chunks.back().key < key);
+        chunks.emplace_back(key);
+    }
+
+    Chunk & chunk = chunks.back();
+    if (chunk.isBitmap()) {
+        setBit(chunk.bits.data(), low);
+    }
+    else {
+        ExcAssert(chunk.array.empty() || chunk.array.back() < low);
+        chunk.array.push_back(low);
+        if (chunk.array.size() > ARRAY_MAX)
+            chunk.toBitmap();
+    }
+
+    // As values are appended in order, the value is always new
+    if (chunk.cardinality != -1)
+        ++chunk.cardinality;
+    if (count_ != -1)
+        ++count_;
+}
+
+size_t
+SubjectSet::
+count() const
+{
+    if (count_ == -1) {
+        count_ = 0;
+        for (auto & chunk: chunks)
+            count_ += chunk.count();
+    }
+    return count_;
+}
+
+bool
+SubjectSet::
+contains(uint32_t value) const
+{
+    uint16_t key = value >> 16;
+    auto it = std::lower_bound(chunks.begin(), chunks.end(), key,
+                               [] (const Chunk & chunk, uint16_t key)
+                               { return chunk.key < key; });
+    return it != chunks.end() && it->key == key && it->contains(value);
+}
+
+SubjectSet
+SubjectSet::
+operator & (const SubjectSet & other) const
+{
+    SubjectSet result;
+    result.count_ = -1;
+
+    auto it1 = chunks.begin(), end1 = chunks.end();
+    auto it2 = other.chunks.begin(), end2 = other.chunks.end();
+
+    while (it1 != end1 && it2 != end2) {
+        if (it1->key < it2->key)
+            ++it1;
+        else if (it2->key < it1->key)
+            ++it2;
+        else {
+            Chunk chunk = doAnd(*it1++, *it2++);
+            if (chunk.isBitmap() || !chunk.array.empty())
+                result.chunks.emplace_back(std::move(chunk));
+        }
+    }
+
+    return result;
+}
+
+SubjectSet
+SubjectSet::
+operator | (const SubjectSet & other) const
+{
+    SubjectSet result;
+    result.count_ = -1;
+    result.chunks.reserve(std::max(chunks.size(), other.chunks.size()));
+
+    auto it1 = chunks.begin(), end1 = chunks.end();
+    auto it2 = other.chunks.begin(), end2 = other.chunks.end();
+
+    while (it1 != end1 && it2 != end2) {
+        if (it1->key < it2->key)
+            result.chunks.push_back(*it1++);
+        else if (it2->key < it1->key)
+            result.chunks.push_back(*it2++);
+        else result.chunks.emplace_back(doOr(*it1++, *it2++));
+    }
+
+    result.chunks.insert(result.chunks.end(), it1, end1);
+    result.chunks.insert(result.chunks.end(), it2, end2);
+
+    return result;
+}
+
+SubjectSet
+SubjectSet::
+andNot(const SubjectSet & other) const
+{
+    SubjectSet result;
+    result.count_ = -1;
+    result.chunks.reserve(chunks.size());
+
+    auto it1 = chunks.begin(), end1 = chunks.end();
+    auto it2 = other.chunks.begin(), end2 = other.chunks.end();
+
+    while (it1 != end1) {
+        while (it2 != end2 && it2->key < it1->key)
+            ++it2;
+        if (it2 == end2 || it2->key != it1->key) {
+            result.chunks.push_back(*it1++);
+            continue;
+        }
+        Chunk chunk = doAndNot(*it1++, *it2++);
+        if (chunk.isBitmap() || !chunk.array.empty())
+            result.chunks.emplace_back(std::move(chunk));
+    }
+
+    return result;
+}
+
+bool
+SubjectSet::
+forEach(const std::function<bool (uint32_t)> & onValue) const
+{
+    for (auto & chunk: chunks) {
+        uint32_t high = uint32_t(chunk.key) << 16;
+        if (chunk.isBitmap()) {
+            for (size_t w = 0;  w < BITMAP_WORDS;  ++w) {
+                for (uint64_t word = chunk.bits[w];  word;  word &= word - 1) {
+                    if (!onValue(high | (w * 64 + __builtin_ctzll(word))))
+                        return false;
+                }
+            }
+        }
+        else {
+            for (uint16_t low: chunk.array)
+                if (!onValue(high | low))
+                    return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint32_t>
+SubjectSet::
+toVector() const
+{
+    std::vector<uint32_t> result;
+    result.reserve(count());
+    forEach([&] (uint32_t value) { result.push_back(value);  return true; });
+    return result;
+}
+
+size_t
+SubjectSet::
+memusage() const
+{
+    size_t result = sizeof(*this) + chunks.capacity() * sizeof(Chunk);
+    for (auto & chunk: chunks)
+        result += chunk.array.capacity() * sizeof(uint16_t)
+            + chunk.bits.capacity() * sizeof(uint64_t);
+    return result;
+}
+
+bool
+SubjectSet::
+operator == (const SubjectSet & other) const
+{
+    // A chunk can be stored either way, depending upon how it was made, so
+    // compare the values
+    if (count() != other.count())
+        return false;
+    return toVector() == other.toVector();
+}
+
+size_t
+SubjectSet::Chunk::
+count() const
+{
+    if (cardinality == -1) {
+        cardinality = 0;
+        for (uint64_t word: bits)
+            cardinality += __builtin_popcountll(word);
+    }
+    return cardinality;
+}
+
+bool
+SubjectSet::Chunk::
+contains(uint16_t low) const
+{
+    if (isBitmap())
+        return testBit(bits.data(), low);
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void
+SubjectSet::Chunk::
+toBitmap()
+{
+    bits.resize(BITMAP_WORDS, 0);
+    for (uint16_t low: array)
+        setBit(bits.data(), low);
+    cardinality = array.size();
+    array = std::vector<uint16_t>();
+}
+
+SubjectSet::Chunk
+SubjectSet::
+doAnd(const Chunk & c1, const Chunk & c2)
+{
+    Chunk result(c1.key);
+
+    if (c1.isBitmap() && c2.isBitmap()) {
+        result.bits.resize(BITMAP_WORDS);
+        uint64_t any = 0;
+        for (size_t i = 0;  i < BITMAP_WORDS;  ++i)
+            any |= result.bits[i] = c1.bits[i] & c2.bits[i];
+        result.cardinality = -1;
+        if (!any)
+            result.bits.clear();
+        return result;
+    }
+
+    if (c1.isBitmap() || c2.isBitmap()) {
+        const Chunk & array = c1.isBitmap() ? c2 : c1;
+        const Chunk & bitmap = c1.isBitmap() ? c1 : c2;
+        for (uint16_t low: array.array)
+            if (testBit(bitmap.bits.data(), low))
+                result.array.push_back(low);
+    }
+    else {
+        std::set_intersection(c1.array.begin(), c1.array.end(),
+                              c2.array.begin(), c2.array.end(),
+                              back_inserter(result.array));
+    }
+
+    result.cardinality = result.array.size();
+    return result;
+}
+
+SubjectSet::Chunk
+SubjectSet::
+doOr(const Chunk & c1, const Chunk & c2)
+{
+    Chunk result(c1.key);
+
+    if (c1.isBitmap() && c2.isBitmap()) {
+        result.bits.resize(BITMAP_WORDS);
+        for (size_t i = 0;  i < BITMAP_WORDS;  ++i)
+            result.bits[i] = c1.bits[i] | c2.bits[i];
+        result.cardinality = -1;
+        return result;
+    }
+
+    if (c1.isBitmap() || c2.isBitmap()) {
+        const Chunk & array = c1.isBitmap() ? c2 : c1;
+        result = c1.isBitmap() ? c1 : c2;
+        for (uint16_t low: array.array)
+            setBit(result.bits.data(), low);
+        result.cardinality = -1;
+        return result;
+    }
+
+    result.array.reserve(c1.array.size() + c2.array.size());
+    std::set_union(c1.array.begin(), c1.array.end(),
+                   c2.array.begin(), c2.array.end(),
+                   back_inserter(result.array));
+    result.cardinality = result.array.size();
+    if (result.array.size() > ARRAY_MAX)
+        result.toBitmap();
+    return result;
+}
+
+SubjectSet::Chunk
+SubjectSet::
+doAndNot(const Chunk & c1, const Chunk & c2)
+{
+    Chunk result(c1.key);
+
+    if (c1.isBitmap()) {
+        result.bits = c1.bits;
+        if (c2.isBitmap()) {
+            for (size_t i = 0;  i < BITMAP_WORDS;  ++i)
+                result.bits[i] &= ~c2.bits[i];
+        }
+        else {
+            for (uint16_t low: c2.array)
+                clearBit(result.bits.data(), low);
+        }
+
+        uint64_t any = 0;
+        for (uint64_t word: result.bits)
+            any |= word;
+        result.cardinality = -1;
+        if (!any)
+            result.bits.clear();
+        return result;
+    }
+
+    if (c2.isBitmap()) {
+        for (uint16_t low: c1.array)
+            if (!testBit(c2.bits.data(), low))
+                result.array.push_back(low);
+    }
+    else {
+        std::set_difference(c1.array.begin(), c1.array.end(),
+                            c2.array.begin(), c2.array.end(),
+                            back_inserter(result.array));
+    }
+
+    result.cardinality = result.array.size();
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,128 @@
+/* subject_set.h                                                   -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Compressed sets of subjects, used to evaluate boolean expressions.
+*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SUBJECT SET                                                               */
+/*****************************************************************************/
+
+/** A set of subjects, identified by their 32 bit index in a behavior domain
+    (the position of the subject in order of its hash).
+
+    It is stored like a Roaring bitmap (Chambi et al. 2016): the values are
+    split into chunks of 65536 by their high 16 bits, and each non-empty
+    chunk is stored as either a sorted array of the low 16 bits if there
+    are up to 4096 values in the chunk, or as a bitmap of 1024 64 bit words
+    if there are more.  A set therefore takes at most 16 bits per value,
+    and at most one bit per possible value, however dense or sparse it is.
+
+    The intersection, union and difference of sets are calculated a chunk
+    at a time; those of two bitmaps a word at a time.  The number of values
+    in a bitmap chunk is only counted (and remembered) when it's needed, so
+    that a chain of operations doesn't need to count the intermediate
+    results.
+*/
+
+struct SubjectSet {
+
+    /** Empty set. */
+    SubjectSet();
+
+    /** Set of the n sorted and distinct values. */
+    SubjectSet(const uint32_t * values, size_t n);
+
+    /** Set of all of the values from 0 up to n - 1. */
+    static SubjectSet all(uint32_t n);
+
+    /** Add the value to the set.  It must be greater than all of the values
+        that are already in the set.
+    */
+    void append(uint32_t value);
+
+    /** Is the set empty? */
+    bool empty() const
+    {
+        return chunks.empty();
+    }
+
+    /** Number of values in the set. */
+    size_t count() const;
+
+    /** Is the value in the set? */
+    bool contains(uint32_t value) const;
+
+    /** Intersection of the two sets. */
+    SubjectSet operator & (const SubjectSet & other) const;
+
+    /** Union of the two sets. */
+    SubjectSet operator | (const SubjectSet & other) const;
+
+    /** Values of this set that aren't in other. */
+    SubjectSet andNot(const SubjectSet & other) const;
+
+    /** Call onValue for each value in the set, in order, until it returns
+        false.  Returns false if it was stopped, or true otherwise.
+    */
+    bool forEach(const std::function<bool (uint32_t)> & onValue) const;
+
+    /** Return all of the values of the set, in order. */
+    std::vector<uint32_t> toVector() const;
+
+    /** Number of bytes of memory used to store the set. */
+    size_t memusage() const;
+
+    bool operator == (const SubjectSet & other) const;
+
+    bool operator != (const SubjectSet & other) const
+    {
+        return !operator == (other);
+    }
+
+private:
+    struct Chunk {
+        Chunk(uint16_t key = 0)
+            : key(key), cardinality(0)
+        {
+        }
+
+        uint16_t key;                 ///< High 16 bits of the values
+        std::vector<uint16_t> array;  ///< Sorted low bits, unless a bitmap
+        std::vector<uint64_t> bits;   ///< Bitmap, or empty for an array
+        mutable ssize_t cardinality;  ///< Number of values, or -1 if unknown
+
+        bool isBitmap() const
+        {
+            return !bits.empty();
+        }
+
+        size_t count() const;
+
+        bool contains(uint16_t low) const;
+
+        /** Convert an array chunk into a bitmap chunk. */
+        void toBitmap();
+    };
+
+    static Chunk doAnd(const Chunk & c1, const Chunk & c2);
+    static Chunk doOr(const Chunk & c1, const Chunk & c2);
+    static Chunk doAndNot(const Chunk & c1, const Chunk & c2);
+
+    std::vector<Chunk> chunks;        ///< Non-empty chunks, in order of key
+    mutable ssize_t count_;           ///< Number of values, or -1 if unknown
+};
+
+} // namespace MLDB
@@ -382,6 +382,55 @@ BOOST_AUTO_TEST_CASE(test_merge_with_empty_behaviors_serialized)
 }
 #endif
 
+#if 1
+BOOST_AUTO_TEST_CASE(test_compact_merged)
+{
+    // Split the behaviors over more files than fit directly into a merge,
+    // so that some of them are in nested merges.  Each file gets the
+    // events of some of the seconds, like daily files do, so that each
+    // subject is in many files.
+    int numFiles = 40;
+
+    auto all = std::make_shared<MutableBehaviorDomain>();
+    all->hasSubjectIds = true;
+    vector<std::shared_ptr<MutableBehaviorDomain> > parts;
+    for (unsigned i = 0;  i < numFiles;  ++i) {
+        parts.push_back(std::make_shared<MutableBehaviorDomain>());
+        parts.back()->hasSubjectIds = true;
+    }
+
+    Date start(2012, 01, 01, 00, 00, 00);
+
+    for (unsigned i = 0;  i < nToRecord;  ++i) {
+        Id subject(random() % nSubjects + 1);
+        Id behavior(random() % nBehaviors + 1);
+        uint32_t count(random() % 10 + 1);
+        int second = random() % 3600;
+        Date timestamp = start.plusSeconds(second);
+
+        all->record(subject, behavior, timestamp, count);
+        parts[second % numFiles]->record(subject, behavior, timestamp, count);
+    }
+
+    vector<std::shared_ptr<BehaviorDomain> > toMerge;
+    for (unsigned i = 0;  i < numFiles;  ++i) {
+        string filename = "tmp/compactPart" + to_string(i) + ".beh";
+        parts[i]->save(filename);
+        toMerge.push_back(std::make_shared<MappedBehaviorDomain>(filename));
+    }
+
+    MergedBehaviorDomain merged(toMerge, true);
+    BOOST_CHECK_EQUAL(merged.leafDomains().size(), numFiles);
+
+    merged.compact("tmp/compacted.beh");
+
+    MappedBehaviorDomain compacted("tmp/compacted.beh");
+
+    testIntegrity(compacted);
+    testEquivalent(compacted, *all);
+}
+#endif
+
 #if 1
 BOOST_AUTO_TEST_CASE(test_streams)
 {
@@ -10,6 +10,8 @@ $(eval $(call set_compile_option,$(notdir $(wildcard pro/behavior/testing/*.cc))
 $(eval $(call test,behavior_domain_test,behavior test_utils,boost timed))
 $(eval $(call test,mutable_behavior_domain_test,behavior test_utils,boost timed))
 $(eval $(call test,mapped_behavior_domain_test,behavior test_utils,boost timed))
+$(eval $(call test,posting_list_test,behavior,boost))
+$(eval $(call test,subject_set_test,behavior,boost))
 $(eval $(call test,behavior_domain_valgrind_test,behavior,boost valgrind manual))
 $(eval $(call test,boolean_expression_test,behavior,boost timed))
 #$(eval $(call test,bridged_behavior_domain_test,behavior,boost timed)) # about to be removed
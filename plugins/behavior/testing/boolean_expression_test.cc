@@ -97,6 +97,20 @@ BOOST_AUTO_TEST_CASE( test_matching )
                 res.push_back(behs.getSubjectId(m.first).val1);
             std::sort(res.begin(), res.end());
             BOOST_CHECK_EQUAL(res, expected);
+
+            // The set of subjects must be the same
+            BehaviorWrapper wrapper(behs);
+            SubjectSet set = parsed->generateSet(wrapper);
+            BOOST_CHECK_EQUAL(set.count(), expected.size());
+            vector<int> setRes;
+            set.forEach([&] (uint32_t index)
+                        {
+                            SH subject = wrapper.getSubjectHash(index);
+                            setRes.push_back(behs.getSubjectId(subject).val1);
+                            return true;
+                        });
+            std::sort(setRes.begin(), setRes.end());
+            BOOST_CHECK_EQUAL(setRes, expected);
         };
     
     testMatch("123", { 1, 2, 3 });
@@ -10,7 +10,9 @@
 #define BOOST_TEST_DYN_LINK
 
 #include <boost/test/unit_test.hpp>
+#include <set>
 #include "mldb/plugins/behavior/mutable_behavior_domain.h"
+#include "mldb/plugins/behavior/sharded_behavior_domain.h"
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/ml/jml/thread_context.h"
 #include "mldb/vfs/filter_streams.h"
@@ -380,3 +382,103 @@ BOOST_AUTO_TEST_CASE( test_numDistinctTimestamps )
     dom.recordId(subjectId, behId2, ts.plusSeconds(5));
     BOOST_CHECK_EQUAL(dom.numDistinctTimestamps(sh), 2);
 }
+
+/* Record the same events from several threads into a sharded domain and
+ * from one thread into a single mutable domain, and make sure that they
+ * end up with the same contents.
+ */
+BOOST_AUTO_TEST_CASE( test_sharded_recording )
+{
+    ShardedMutableBehaviorDomain sharded(8);
+    MutableBehaviorDomain single;
+
+    BOOST_CHECK_EQUAL(sharded.numShards(), 8);
+
+    int numThreads = 8;
+    int numIterations = 200;
+    Date tsBase = Date(2014, 1, 1);
+
+    typedef MutableBehaviorDomain::ManyEntryIndex ManyEntryIndex;
+
+    // Batches of events over many subjects, like recordRows() records
+    auto generate = [&] (int threadNum, int iter,
+                         std::vector<Id> & behIds,
+                         std::vector<Id> & subjectIds,
+                         std::vector<ManyEntryIndex> & entries)
+        {
+            ML::Thread_Context context;
+            context.seed(threadNum * 1000 + iter + 1);
+
+            for (unsigned i = 0;  i < 10;  ++i)
+                behIds.emplace_back(context.random() % 200 + 1);
+            for (unsigned i = 0;  i < 20;  ++i)
+                subjectIds.emplace_back(context.random() % 1000 + 1);
+
+            for (unsigned i = 0;  i < 50;  ++i) {
+                ManyEntryIndex entry;
+                entry.behIndex = context.random() % behIds.size();
+                entry.subjIndex = context.random() % subjectIds.size();
+                entry.timestamp = tsBase.plusSeconds(context.random() % 86400);
+                entries.push_back(entry);
+            }
+        };
+
+    auto testThread = [&] (int threadNum)
+        {
+            for (unsigned iter = 0;  iter < numIterations;  ++iter) {
+                std::vector<Id> behIds, subjectIds;
+                std::vector<ManyEntryIndex> entries;
+                generate(threadNum, iter, behIds, subjectIds, entries);
+
+                sharded.recordMany(behIds.data(), behIds.size(),
+                                   subjectIds.data(), subjectIds.size(),
+                                   entries.data(), entries.size());
+                sharded.record(Id(threadNum * 100000 + iter), behIds[0],
+                               tsBase);
+            }
+        };
+
+    std::vector<std::unique_ptr<std::thread> > threads;
+    for (unsigned i = 0;  i < numThreads;  ++i)
+        threads.emplace_back(new std::thread([=] () { testThread(i); }));
+    for (unsigned i = 0;  i < numThreads;  ++i)
+        threads[i]->join();
+
+    for (unsigned t = 0;  t < numThreads;  ++t) {
+        for (unsigned iter = 0;  iter < numIterations;  ++iter) {
+            std::vector<Id> behIds, subjectIds;
+            std::vector<ManyEntryIndex> entries;
+            generate(t, iter, behIds, subjectIds, entries);
+
+            single.recordMany(behIds.data(), behIds.size(),
+                              subjectIds.data(), subjectIds.size(),
+                              entries.data(), entries.size());
+            single.record(Id(t * 100000 + iter), behIds[0], tsBase);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(sharded.totalEventsRecorded(),
+                      single.totalEventsRecorded());
+
+    sharded.makeImmutable();
+    single.makeImmutable();
+
+    BOOST_CHECK_EQUAL(sharded.subjectCount(), single.subjectCount());
+    BOOST_CHECK_EQUAL(sharded.behaviorCount(), single.behaviorCount());
+
+    // Each subject is in exactly one shard
+    size_t shardSubjects = 0;
+    for (unsigned s = 0;  s < sharded.numShards();  ++s)
+        shardSubjects += sharded.shard(s)->subjectCount();
+    BOOST_CHECK_EQUAL(shardSubjects, single.subjectCount());
+
+    // The subject stream goes over all of the shards
+    std::set<Id> streamed;
+    auto stream = sharded.getSubjectStream(0);
+    for (unsigned i = 0;  i < sharded.subjectCount();  ++i)
+        streamed.insert(stream->next());
+    BOOST_CHECK_EQUAL(streamed.size(), single.subjectCount());
+
+    testIntegrity(sharded);
+    testEquivalent(sharded, single);
+}
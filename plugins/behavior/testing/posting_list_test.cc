@@ -0,0 +1,108 @@
+/* posting_list_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the compressed posting lists of the behavior files.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <random>
+#include <set>
+#include "mldb/plugins/behavior/posting_list.h"
+
+using namespace std;
+using namespace MLDB;
+
+
+static vector<uint32_t> randomList(size_t n, uint32_t maxValue, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> dist(0, maxValue);
+    std::set<uint32_t> values;
+    while (values.size() < n)
+        values.insert(dist(rng));
+    return vector<uint32_t>(values.begin(), values.end());
+}
+
+static vector<uint32_t> decode(const vector<uint32_t> & encoded, size_t n)
+{
+    vector<uint32_t> result;
+    for (PostingListCursor cursor(encoded.data(), n);  !cursor.done();
+         cursor.next()) {
+        BOOST_CHECK_EQUAL(cursor.index(), result.size());
+        result.push_back(cursor.value());
+    }
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_posting_list_round_trip )
+{
+    for (size_t n: { 0, 1, 2, 127, 128, 129, 1000, 10000 }) {
+        for (uint32_t maxValue: { 20000u, 1000000u, 4000000000u }) {
+            vector<uint32_t> values = randomList(n, maxValue, n + maxValue);
+            vector<uint32_t> encoded
+                = encodePostingList(values.data(), values.size());
+            vector<uint32_t> decoded = decode(encoded, n);
+            BOOST_CHECK_EQUAL_COLLECTIONS(values.begin(), values.end(),
+                                          decoded.begin(), decoded.end());
+        }
+    }
+
+    // Extreme values and gaps, which need exceptions
+    vector<uint32_t> values = { 0, 1, 2, 3, 1000000, 1000001, 4294967295u };
+    vector<uint32_t> encoded = encodePostingList(values.data(), values.size());
+    vector<uint32_t> decoded = decode(encoded, values.size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(values.begin(), values.end(),
+                                  decoded.begin(), decoded.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_posting_list_size )
+{
+    // A dense list (average gap of 4) takes a few bits per value, instead
+    // of the 22 bits that a fixed width list of values up to 4M needs
+    vector<uint32_t> values = randomList(1000000, 4000000, 1);
+    vector<uint32_t> encoded = encodePostingList(values.data(), values.size());
+    cerr << "encoded " << values.size() << " values in "
+         << encoded.size() * 32.0 / values.size() << " bits each" << endl;
+    BOOST_CHECK_LT(encoded.size() * 32, values.size() * 6);
+}
+
+BOOST_AUTO_TEST_CASE( test_posting_list_advance )
+{
+    vector<uint32_t> values = randomList(5000, 100000, 2);
+    vector<uint32_t> encoded = encodePostingList(values.data(), values.size());
+
+    // The same values in the legacy fixed width format
+    int bits = 17;
+    vector<uint32_t> legacy((values.size() * bits + 31) / 32 + 1, 0);
+    for (size_t i = 0;  i < values.size();  ++i) {
+        for (int b = 0;  b < bits;  ++b) {
+            size_t bit = i * bits + b;
+            legacy[bit / 32] |= ((values[i] >> b) & 1) << (bit % 32);
+        }
+    }
+
+    std::mt19937 rng(3);
+    for (int trial = 0;  trial < 100;  ++trial) {
+        PostingListCursor cursor(encoded.data(), values.size());
+        PostingListCursor legacyCursor(legacy.data(), values.size(), bits);
+        uint32_t target = 0;
+        while (!cursor.done()) {
+            target += rng() % (trial < 50 ? 100 : 10000);
+            cursor.advanceTo(target);
+            legacyCursor.advanceTo(target);
+
+            auto it = std::lower_bound(values.begin(), values.end(), target);
+            BOOST_REQUIRE_EQUAL(cursor.index(), it - values.begin());
+            BOOST_REQUIRE_EQUAL(legacyCursor.index(), it - values.begin());
+            if (it != values.end()) {
+                BOOST_REQUIRE_EQUAL(cursor.value(), *it);
+                BOOST_REQUIRE_EQUAL(legacyCursor.value(), *it);
+            }
+            else BOOST_REQUIRE(legacyCursor.done());
+        }
+    }
+}
@@ -0,0 +1,99 @@
+/* subject_set_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the compressed subject sets.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <random>
+#include <set>
+#include <algorithm>
+#include <iterator>
+#include "mldb/plugins/behavior/subject_set.h"
+
+using namespace std;
+using namespace MLDB;
+
+
+static vector<uint32_t> randomSet(size_t n, uint32_t maxValue, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> dist(0, maxValue);
+    std::set<uint32_t> values;
+    while (values.size() < n)
+        values.insert(dist(rng));
+    return vector<uint32_t>(values.begin(), values.end());
+}
+
+BOOST_AUTO_TEST_CASE( test_subject_set_round_trip )
+{
+    // Sparse sets are stored as arrays, and dense ones as bitmaps
+    for (size_t n: { 0, 1, 100, 10000, 100000 }) {
+        for (uint32_t maxValue: { 200000u, 4000000000u }) {
+            vector<uint32_t> values = randomSet(n, maxValue, n + maxValue);
+            SubjectSet set(values.data(), values.size());
+            BOOST_CHECK_EQUAL(set.count(), n);
+            BOOST_CHECK_EQUAL(set.empty(), n == 0);
+            vector<uint32_t> decoded = set.toVector();
+            BOOST_CHECK_EQUAL_COLLECTIONS(values.begin(), values.end(),
+                                          decoded.begin(), decoded.end());
+            for (unsigned i = 0;  i < values.size();  i += 7) {
+                BOOST_CHECK(set.contains(values[i]));
+                BOOST_CHECK_EQUAL(set.contains(values[i] + 1),
+                                  std::binary_search(values.begin(),
+                                                     values.end(),
+                                                     values[i] + 1));
+            }
+        }
+    }
+
+    SubjectSet all = SubjectSet::all(200000);
+    BOOST_CHECK_EQUAL(all.count(), 200000);
+    BOOST_CHECK(all.contains(199999));
+    BOOST_CHECK(!all.contains(200000));
+
+    // A dense set takes about a bit per possible value
+    SubjectSet all2 = SubjectSet::all(4 * 65536);
+    BOOST_CHECK_EQUAL(all2.count(), 4 * 65536);
+    BOOST_CHECK_LT(all2.memusage(), 4 * 65536 / 8 + 1024);
+}
+
+BOOST_AUTO_TEST_CASE( test_subject_set_operations )
+{
+    // Mix sparse and dense chunks, so that all kinds of chunks are
+    // combined with each other
+    for (int trial = 0;  trial < 4;  ++trial) {
+        vector<uint32_t> v1 = randomSet(trial % 2 ? 100000 : 1000, 300000,
+                                        trial);
+        vector<uint32_t> v2 = randomSet(trial / 2 ? 100000 : 1000, 300000,
+                                        trial + 100);
+
+        SubjectSet s1(v1.data(), v1.size()), s2(v2.data(), v2.size());
+
+        vector<uint32_t> expectedAnd, expectedOr, expectedAndNot;
+        std::set_intersection(v1.begin(), v1.end(), v2.begin(), v2.end(),
+                              back_inserter(expectedAnd));
+        std::set_union(v1.begin(), v1.end(), v2.begin(), v2.end(),
+                       back_inserter(expectedOr));
+        std::set_difference(v1.begin(), v1.end(), v2.begin(), v2.end(),
+                            back_inserter(expectedAndNot));
+
+        SubjectSet sAnd = s1 & s2, sOr = s1 | s2, sAndNot = s1.andNot(s2);
+
+        BOOST_CHECK_EQUAL(sAnd.count(), expectedAnd.size());
+        BOOST_CHECK_EQUAL(sOr.count(), expectedOr.size());
+        BOOST_CHECK_EQUAL(sAndNot.count(), expectedAndNot.size());
+
+        BOOST_CHECK(sAnd.toVector() == expectedAnd);
+        BOOST_CHECK(sOr.toVector() == expectedOr);
+        BOOST_CHECK(sAndNot.toVector() == expectedAndNot);
+
+        BOOST_CHECK(sOr.andNot(s1).andNot(s2).empty());
+        BOOST_CHECK(s1.andNot(s1).empty());
+        BOOST_CHECK(((s1 & s2) | s1.andNot(s2)) == s1);
+    }
+}
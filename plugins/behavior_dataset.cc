@@ -22,11 +22,20 @@
 #include "mldb/types/compact_vector_description.h"
 #include "mldb/vfs/fs_utils.h"
 #include "behavior/behavior_manager.h"
-#include "behavior/mutable_behavior_domain.h"
+#include "behavior/sharded_behavior_domain.h"
 #include "mldb/types/map_description.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "behavior/behavior_utils.h"
+#include "mldb/types/pair_description.h"
+#include "mldb/types/tuple_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/base/scope.h"
+#include "mldb/http/http_exception.h"
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include <future>
+#include <limits>
+#include <set>
 
 using namespace std;
 
@@ -366,7 +375,7 @@ struct BehaviorKeyValueIndex {
         return;
     }
 
-    std::pair<ColumnPath, CellValue> extractColumn(BH beh) const
+    const std::pair<ColumnPath, CellValue> & extractColumn(BH beh) const
     {
         auto it = behIndex.find(beh);
         if (it == behIndex.end()) {
@@ -613,6 +622,27 @@ struct BehaviorMatrixView: public MatrixView {
         return result;
     }
 
+    /** Return the columns of the row that the projection needs, without
+        copying the others.
+    */
+    RowValue getProjectedRow(const RowPath & rowName,
+                             const ColumnProjection & projection) const
+    {
+        RowValue result;
+
+        auto onBeh = [&] (BH beh, Date ts, int)
+            {
+                auto & kv = kvIndex->extractColumn(beh);
+                if (projection.isNeeded(kv.first))
+                    result.emplace_back(kv.first, kv.second, ts);
+                return true;
+            };
+
+        behs->forEachSubjectBehavior(rowName, onBeh);
+
+        return result;
+    }
+
     virtual RowPath getRowPath(const RowHash & rowHash) const
     {
         return toPathElement(behs->getSubjectId(rowHash));
@@ -810,6 +840,103 @@ getRowStream() const
     return make_shared<BehaviorDatasetRowStream>(this->behs);
 }
 
+ExpressionValue
+BehaviorDataset::
+getProjectedRowExpr(const RowPath & row,
+                    const std::vector<ColumnPath> & columns) const
+{
+    ColumnProjection projection(columns);
+    if (projection.all)
+        return getRowExpr(row);
+    return matrix->getProjectedRow(row, projection);
+}
+
+
+/*****************************************************************************/
+/* BEHAVIOR CHECKPOINT CONFIG                                                */
+/*****************************************************************************/
+
+BehaviorCheckpointConfig::
+BehaviorCheckpointConfig()
+    : intervalSeconds(300.0), writeAheadLog(false)
+{
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(BehaviorCheckpointConfig);
+
+BehaviorCheckpointConfigDescription::
+BehaviorCheckpointConfigDescription()
+{
+    nullAccepted = true;
+
+    addField("url", &BehaviorCheckpointConfig::url,
+             "URL of the directory to write checkpoints to.  If it already "
+             "holds a checkpoint, the dataset starts with what it contains.  "
+             "Empty (the default) means no checkpoints.");
+    addField("intervalSeconds", &BehaviorCheckpointConfig::intervalSeconds,
+             "Write a checkpoint once the oldest write that isn't in one was "
+             "made this many seconds ago.  Only the shards that changed are "
+             "written.", 300.0);
+    addField("writeAheadLog", &BehaviorCheckpointConfig::writeAheadLog,
+             "If true, each row is also appended to a log as it's recorded, "
+             "and the log is replayed on recovery, so that rows recorded "
+             "since the last checkpoint aren't lost.  Only `file://` URLs "
+             "are supported.", false);
+}
+
+
+/*****************************************************************************/
+/* BEHAVIOR CHECKPOINT MANIFEST                                              */
+/*****************************************************************************/
+
+/// Files that hold the checkpoint of one shard, relative to its directory
+struct BehaviorCheckpointShard {
+    std::string snapshot;           ///< Behavior file with its contents
+    std::vector<std::string> logs;  ///< Logs of the rows recorded since
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BehaviorCheckpointShard);
+DEFINE_STRUCTURE_DESCRIPTION(BehaviorCheckpointShard);
+
+BehaviorCheckpointShardDescription::
+BehaviorCheckpointShardDescription()
+{
+    addField("snapshot", &BehaviorCheckpointShard::snapshot,
+             "Behavior file with the contents of the shard");
+    addField("logs", &BehaviorCheckpointShard::logs,
+             "Logs of the rows recorded since the snapshot, in order");
+}
+
+/** Describes a whole checkpoint.  Each one is written as
+    checkpoint-<sequence>.json once all of its files are written, and the
+    previous one is only erased after that, so there is always a complete
+    one to recover from.
+*/
+struct BehaviorCheckpointManifest {
+    BehaviorCheckpointManifest()
+        : sequence(0)
+    {
+    }
+
+    uint64_t sequence;
+    Date date;
+    std::vector<BehaviorCheckpointShard> shards;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BehaviorCheckpointManifest);
+DEFINE_STRUCTURE_DESCRIPTION(BehaviorCheckpointManifest);
+
+BehaviorCheckpointManifestDescription::
+BehaviorCheckpointManifestDescription()
+{
+    addField("sequence", &BehaviorCheckpointManifest::sequence,
+             "Sequence number of the checkpoint");
+    addField("date", &BehaviorCheckpointManifest::date,
+             "Date at which the checkpoint was written");
+    addField("shards", &BehaviorCheckpointManifest::shards,
+             "Files of each shard");
+}
+
 
 /*****************************************************************************/
 /* MUTABLE BEHAVIOR DATASET CONFIG                                          */
@@ -817,7 +944,7 @@ getRowStream() const
 
 MutableBehaviorDatasetConfig::
 MutableBehaviorDatasetConfig() 
-    : timeQuantumSeconds(1.0)
+    : timeQuantumSeconds(1.0), numShards(1)
 {
 }
 
@@ -832,8 +959,373 @@ MutableBehaviorDatasetConfigDescription()
              "a number that controls the resolution of timestamps stored in the dataset, "
              "in seconds. 1 means one second, 0.001 means one millisecond, 60 means one minute. "
              "Higher resolution requires more memory to store timestamps.", 1.0);
+    addField("numShards", &MutableBehaviorDatasetConfig::numShards,
+             "Number of independent partitions that the rows are split "
+             "into, by the hash of the row name.  Rows in different "
+             "partitions can be recorded in parallel without contending "
+             "with each other.  Zero means one per CPU.", 1);
+    addField("compaction", &MutableBehaviorDatasetConfig::compaction,
+             "Controls the background sorting of recently recorded "
+             "values, which makes them faster to read and leaves less "
+             "to do on `commit()`, without blocking reads or writes.");
+    addField("checkpoint", &MutableBehaviorDatasetConfig::checkpoint,
+             "Controls the periodic checkpoints of the dataset, from which "
+             "it's recovered when it's created again, for example after a "
+             "crash.");
 }
 
+
+/*****************************************************************************/
+/* MUTABLE BEHAVIOR DATASET CHECKPOINTER                                     */
+/*****************************************************************************/
+
+/** Writes checkpoints of the shards of a mutable behavior dataset, and
+    recovers the dataset from them.
+
+    Each shard is written to its own behavior file, and only when it has
+    changed since the last checkpoint.  While a shard is written, its
+    writers wait (on its lock) so that what is written is consistent;
+    writers to the other shards and readers carry on.  When the write ahead
+    log is on, the same lock switches the shard to a new log, which holds
+    exactly the rows recorded after its snapshot.
+*/
+
+struct MutableBehaviorDataset::Checkpointer {
+
+    typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Values;
+    typedef std::pair<RowPath, Values> LoggedRow;
+
+    Checkpointer(BehaviorCheckpointConfig config_,
+                 MutableBehaviorDataset * dataset)
+        : config(std::move(config_)),
+          dir(config.url.toString()),
+          dataset(dataset),
+          nextSequence(0)
+    {
+        if (config.writeAheadLog && getUriScheme(dir) != "file")
+            throw HttpReturnException
+                (400, "The write ahead log of a beh.mutable dataset needs a "
+                 "file:// checkpoint URL",
+                 "url", dir);
+        if (!dir.empty() && dir[dir.size() - 1] == '/')
+            dir.resize(dir.size() - 1);
+
+        for (unsigned i = 0;  i < dataset->behs->numShards();  ++i)
+            shards.emplace_back(new Shard());
+    }
+
+    ~Checkpointer()
+    {
+        for (auto & s: shards) {
+            if (s->log)
+                s->log->close();
+        }
+    }
+
+    struct Shard {
+        Shard()
+            : generation(0), savedGeneration(0)
+        {
+        }
+
+        /// Shared by writers, held exclusively while it's checkpointed
+        boost::shared_mutex lock;
+
+        /// Incremented on each write, to tell if it changed
+        std::atomic<uint64_t> generation;
+
+        // Below here is protected by checkpointMutex
+        uint64_t savedGeneration;    ///< Generation in the last checkpoint
+        BehaviorCheckpointShard files;
+
+        std::mutex logMutex;         ///< Protects the log
+        std::unique_ptr<filter_ostream> log;
+    };
+
+    BehaviorCheckpointConfig config;
+    std::string dir;
+    MutableBehaviorDataset * dataset;
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    std::mutex checkpointMutex;      ///< Only one checkpoint at a time
+    uint64_t nextSequence;           ///< For the names of files
+    std::string lastManifest;        ///< File of the last checkpoint
+    std::vector<std::string> lastFiles;  ///< Files that it refers to
+
+    std::string path(const std::string & file) const
+    {
+        return dir + "/" + file;
+    }
+
+    std::string manifestName(uint64_t sequence) const
+    {
+        return "checkpoint-" + std::to_string(sequence) + ".json";
+    }
+
+    /// Shard that the given row is recorded in
+    int shardFor(const RowPath & rowName) const
+    {
+        return dataset->behs->shardFor(SH(toId(rowName)));
+    }
+
+    /** Log a row before it's recorded.  The caller holds the shared lock
+        of its shard.
+    */
+    void log(int shard, const RowPath & rowName, const Values & vals)
+    {
+        Shard & s = *shards[shard];
+        s.generation += 1;
+        if (!config.writeAheadLog)
+            return;
+
+        std::string line = jsonEncodeStr(LoggedRow(rowName, vals));
+        std::unique_lock<std::mutex> guard(s.logMutex);
+        *s.log << line << "\n";
+        // Get it to the operating system, so that it survives a crash of
+        // the process
+        s.log->flush();
+    }
+
+    /// Open a new log for the shard, and return its name
+    std::string openLog(Shard & s, int shardNum, uint64_t sequence)
+    {
+        std::string name = "shard-" + std::to_string(shardNum) + "-"
+            + std::to_string(sequence) + ".wal";
+        std::unique_ptr<filter_ostream> log(new filter_ostream(path(name)));
+        std::unique_lock<std::mutex> guard(s.logMutex);
+        if (s.log)
+            s.log->close();
+        s.log = std::move(log);
+        return name;
+    }
+
+    /** Load the latest checkpoint, if there is one, and replay what was
+        logged since.  Called before anything is recorded.
+    */
+    void recover()
+    {
+        makeUriDirectory(dir + "/");
+
+        // Find the checkpoints, latest first
+        std::vector<std::pair<uint64_t, std::string> > manifests;
+        auto onObject = [&] (const std::string & uri,
+                             const FsObjectInfo & info,
+                             const OpenUriObject & open,
+                             int depth)
+            {
+                std::string name = baseName(uri);
+                unsigned long long sequence;
+                char dummy;
+                if (sscanf(name.c_str(), "checkpoint-%llu.jso%c",
+                           &sequence, &dummy) == 2)
+                    manifests.emplace_back(sequence, name);
+                return true;
+            };
+        auto onSubdir = [] (const std::string &, int) { return false; };
+        forEachUriObject(dir + "/", onObject, onSubdir);
+        std::sort(manifests.rbegin(), manifests.rend());
+
+        BehaviorCheckpointManifest manifest;
+        bool found = false;
+        for (auto & m: manifests) {
+            nextSequence = std::max(nextSequence, m.first + 1);
+            if (found)
+                continue;
+            // One that was being written when we crashed won't parse
+            try {
+                filter_istream stream(path(m.second));
+                manifest = jsonDecodeStream<BehaviorCheckpointManifest>(stream);
+                lastManifest = m.second;
+                found = true;
+            } catch (const std::exception & exc) {
+                cerr << "ignoring incomplete checkpoint " << path(m.second)
+                     << ": " << exc.what() << endl;
+            }
+        }
+
+        if (found) {
+            cerr << "recovering beh.mutable dataset from checkpoint "
+                 << path(lastManifest) << endl;
+
+            // Each shard of the checkpoint is loaded in parallel.  The rows
+            // go to whichever shard they belong to now, so the number of
+            // shards may have changed.
+            auto loadShard = [&] (size_t i)
+                {
+                    const BehaviorCheckpointShard & files = manifest.shards[i];
+                    if (!files.snapshot.empty())
+                        loadSnapshot(path(files.snapshot));
+                    for (auto & l: files.logs)
+                        replayLog(path(l));
+                };
+            parallelMap(0, manifest.shards.size(), loadShard);
+
+            for (auto & files: manifest.shards) {
+                if (!files.snapshot.empty())
+                    lastFiles.push_back(files.snapshot);
+                lastFiles.insert(lastFiles.end(),
+                                 files.logs.begin(), files.logs.end());
+            }
+        }
+
+        if (found && manifest.shards.size() != shards.size()) {
+            // The rows are now in different shards, so they all need to
+            // be written again
+            for (auto & s: shards)
+                s->generation = 1;
+            write();
+            return;
+        }
+
+        // Carry on from where it was; the shards are only written again
+        // once they change
+        if (found) {
+            for (unsigned i = 0;  i < shards.size();  ++i)
+                shards[i]->files = manifest.shards[i];
+        }
+
+        if (config.writeAheadLog) {
+            uint64_t sequence = nextSequence++;
+            for (unsigned i = 0;  i < shards.size();  ++i)
+                shards[i]->files.logs.push_back
+                    (openLog(*shards[i], i, sequence));
+            writeManifest(sequence);
+        }
+    }
+
+    void loadSnapshot(const std::string & uri)
+    {
+        auto snapshot = behManager.get(uri, BehaviorManager::CACHE_NEVER,
+                                       nullptr /* onProgress */);
+
+        std::vector<ShardedMutableBehaviorDomain::ManyEntryId> toRecord;
+        for (SH subject: snapshot->allSubjectHashes()) {
+            toRecord.clear();
+            auto onBeh = [&] (BH beh, Date ts, uint32_t count)
+                {
+                    ShardedMutableBehaviorDomain::ManyEntryId entry;
+                    entry.behavior = snapshot->getBehaviorId(beh);
+                    entry.timestamp = ts;
+                    entry.count = count;
+                    toRecord.emplace_back(std::move(entry));
+                    return true;
+                };
+            snapshot->forEachSubjectBehaviorHash(subject, onBeh);
+            if (!toRecord.empty())
+                dataset->behs->recordMany(snapshot->getSubjectId(subject),
+                                          toRecord.data(), toRecord.size());
+        }
+    }
+
+    void replayLog(const std::string & uri)
+    {
+        if (!tryGetUriObjectInfo(uri))
+            return;
+        filter_istream stream(uri);
+        std::string line;
+        size_t numRows = 0;
+        while (getline(stream, line)) {
+            LoggedRow row;
+            try {
+                row = jsonDecodeStr<LoggedRow>(line);
+            } catch (const std::exception & exc) {
+                // The last line may have been cut off by the crash
+                cerr << "stopping replay of " << uri << " at row " << numRows
+                     << ": " << exc.what() << endl;
+                break;
+            }
+            dataset->recordRowUnlogged(row.first, row.second);
+            ++numRows;
+        }
+    }
+
+    /** Write a checkpoint of the shards that changed since the last one. */
+    void write()
+    {
+        std::unique_lock<std::mutex> guard(checkpointMutex);
+        uint64_t sequence = nextSequence++;
+        bool changed = false;
+
+        for (unsigned i = 0;  i < shards.size();  ++i) {
+            Shard & s = *shards[i];
+            if (s.generation == s.savedGeneration)
+                continue;
+            changed = true;
+
+            std::string snapshot = "shard-" + std::to_string(i) + "-"
+                + std::to_string(sequence) + ".beh";
+
+            boost::unique_lock<boost::shared_mutex> shardGuard(s.lock);
+            uint64_t generation = s.generation;
+            const auto & domain = dataset->behs->shard(i);
+            if (domain->subjectCount() == 0) {
+                // Nothing to load it from
+                snapshot.clear();
+            }
+            else {
+                bool good = false;
+                auto onExit = ScopeExit([&] () noexcept
+                    {
+                        if (!good)
+                            tryEraseUriObject(path(snapshot));
+                    });
+                filter_ostream stream(path(snapshot));
+                domain->saveToStream(stream);
+                stream.close();
+                good = true;
+            }
+
+            s.files.snapshot = snapshot;
+            s.files.logs.clear();
+            if (config.writeAheadLog)
+                s.files.logs.push_back(openLog(s, i, sequence));
+            shardGuard.unlock();
+
+            s.savedGeneration = generation;
+        }
+
+        if (changed)
+            writeManifest(sequence);
+    }
+
+    /** Write the manifest for the current files of each shard, then erase
+        the previous one and what only it used.  Called with
+        checkpointMutex held (or before any writes).
+    */
+    void writeManifest(uint64_t sequence)
+    {
+        BehaviorCheckpointManifest manifest;
+        manifest.sequence = sequence;
+        manifest.date = Date::now();
+        std::vector<std::string> files;
+        for (auto & s: shards) {
+            manifest.shards.push_back(s->files);
+            if (!s->files.snapshot.empty())
+                files.push_back(s->files.snapshot);
+            files.insert(files.end(),
+                         s->files.logs.begin(), s->files.logs.end());
+        }
+
+        std::string name = manifestName(sequence);
+        {
+            filter_ostream stream(path(name));
+            stream << jsonEncodeStr(manifest);
+            stream.close();
+        }
+
+        if (!lastManifest.empty())
+            tryEraseUriObject(path(lastManifest));
+        std::set<std::string> inUse(files.begin(), files.end());
+        for (auto & f: lastFiles) {
+            if (!inUse.count(f))
+                tryEraseUriObject(path(f));
+        }
+
+        lastManifest = name;
+        lastFiles = std::move(files);
+    }
+};
+
 /*****************************************************************************/
 /* MUTABLE BEHAVIOR DATASET                                                 */
 /*****************************************************************************/
@@ -846,14 +1338,44 @@ MutableBehaviorDataset(MldbServer * owner,
 {
     ExcAssert(!config.id.empty());
     auto params = config.params.convert<MutableBehaviorDatasetConfig>();
-    behs.reset(new MutableBehaviorDomain());
-    behs->timeQuantum = params.timeQuantumSeconds;
+    behs.reset(new ShardedMutableBehaviorDomain(params.numShards,
+                                                params.timeQuantumSeconds));
     this->address = params.dataFileUrl.toString();
+    compactor.reset(new BackgroundCompactor
+                    (params.compaction,
+                     std::bind(&ShardedMutableBehaviorDomain::compact, behs.get())));
+
+    if (!params.checkpoint.url.empty()) {
+        checkpointer.reset(new Checkpointer(params.checkpoint, this));
+        checkpointer->recover();
+
+        // The compactor's triggers do what we need: checkpoint once the
+        // oldest write that isn't in one is old enough
+        CompactionConfig checkpointTrigger;
+        checkpointTrigger.maxPending = std::numeric_limits<uint64_t>::max();
+        checkpointTrigger.maxAgeSeconds = params.checkpoint.intervalSeconds;
+        checkpointRunner.reset(new BackgroundCompactor
+                               (checkpointTrigger,
+                                std::bind(&Checkpointer::write,
+                                          checkpointer.get())));
+    }
 }
 
 MutableBehaviorDataset::
 ~MutableBehaviorDataset()
 {
+    checkpointRunner.reset();
+    compactor.reset();
+}
+
+void
+MutableBehaviorDataset::
+checkpoint()
+{
+    if (!checkpointer)
+        return;
+    auto pause = checkpointRunner->pause();
+    checkpointer->write();
 }
 
 Any
@@ -865,6 +1387,9 @@ getStatus() const
     result["valueCount"] = behs->behaviorCount();
     result["eventsRecorded"] = behs->totalEventsRecorded();
     result["memUsageMb"] = behs->approximateMemoryUsage() / 1000000.0;
+    result["compaction"] = jsonEncode(compactor->getStats());
+    if (checkpointRunner)
+        result["checkpoints"] = jsonEncode(checkpointRunner->getStats());
     return result;
 }
 
@@ -907,19 +1432,50 @@ getRowStream() const
     return make_shared<BehaviorDatasetRowStream>(this->behs);
 }
 
+ExpressionValue
+MutableBehaviorDataset::
+getProjectedRowExpr(const RowPath & row,
+                    const std::vector<ColumnPath> & columns) const
+{
+    ColumnProjection projection(columns);
+    if (projection.all)
+        return getRowExpr(row);
+    auto view = matrix;
+    if (!view)
+        throw MLDB::Exception("No matrix view for an uncommitted mutable dataset");
+    return view->getProjectedRow(row, projection);
+}
+
 void
 MutableBehaviorDataset::
 recordRowItl(const RowPath & rowName,
              const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
 {
+    if (checkpointer) {
+        int shard = checkpointer->shardFor(rowName);
+        boost::shared_lock<boost::shared_mutex>
+            guard(checkpointer->shards[shard]->lock);
+        checkpointer->log(shard, rowName, vals);
+        recordRowUnlogged(rowName, vals);
+        checkpointRunner->recorded(1);
+    }
+    else recordRowUnlogged(rowName, vals);
 
-    vector<MutableBehaviorDomain::ManyEntryId> toRecord;
+    compactor->recorded(1);
+}
+
+void
+MutableBehaviorDataset::
+recordRowUnlogged(const RowPath & rowName,
+                  const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+{
+    vector<ShardedMutableBehaviorDomain::ManyEntryId> toRecord;
     toRecord.reserve(vals.size());
     for (auto & b: vals) {
         const ColumnPath& name = std::get<0>(b);
         const CellValue& value = std::get<1>(b);
 
-        MutableBehaviorDomain::ManyEntryId entry;
+        ShardedMutableBehaviorDomain::ManyEntryId entry;
         entry.behavior = behaviors::encodeColumn(name, value);
         entry.timestamp = std::get<2>(b);
         entry.count = 1;
@@ -962,7 +1518,7 @@ recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPat
             return index;
         };
     
-    std::vector<MutableBehaviorDomain::ManyEntryIndex> toRecord;
+    std::vector<ShardedMutableBehaviorDomain::ManyEntryIndex> toRecord;
     for (auto & row: rows) {
         ExcAssertNotEqual(row.first, RowPath());
         validateNames(row.first, row.second);
@@ -975,7 +1531,7 @@ recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPat
             Date ts = std::get<2>(b);
 
             int64_t colIndex = getColumnIndex(name, value);
-            MutableBehaviorDomain::ManyEntryIndex entry;
+            ShardedMutableBehaviorDomain::ManyEntryIndex entry;
             entry.behIndex = colIndex;
             entry.subjIndex = rowIndex;
             entry.timestamp = ts;
@@ -984,26 +1540,49 @@ recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPat
         }
     }
 
+    // The rows may go to any of the shards, so none of them can be
+    // checkpointed while they're recorded
+    std::vector<boost::shared_lock<boost::shared_mutex> > checkpointGuards;
+    if (checkpointer) {
+        for (auto & s: checkpointer->shards)
+            checkpointGuards.emplace_back(s->lock);
+        for (auto & row: rows)
+            checkpointer->log(checkpointer->shardFor(row.first),
+                              row.first, row.second);
+    }
+
     behs->recordMany(&columnNames[0],
                      columnNames.size(),
                      &rowNames[0],
                      rowNames.size(),
                      &toRecord[0],
                      toRecord.size());
+    
+    if (checkpointer)
+        checkpointRunner->recorded(rows.size());
+    compactor->recorded(rows.size());
 }
 
 void
 MutableBehaviorDataset::
 commit()
 {
+    // So that it can be recovered with everything recorded
+    checkpoint();
+
     behs->setFileMetadata("mldbEncoding", "beh");
-    behs->makeImmutable();
+    {
+        // Nothing left to compact once it's immutable
+        auto pause = compactor->pause();
+        behs->makeImmutable();
+    }
     if (!address.empty()) {
         MLDB::makeUriDirectory(this->address);
         behs->save(this->address);
     }
     columns = std::make_shared<BehaviorColumnIndex>(behs);
     matrix = std::make_shared<BehaviorMatrixView>(behs, columns->index);
+    Dataset::commit();
 }
 
 namespace {
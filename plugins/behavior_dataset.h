@@ -6,13 +6,14 @@
 */
 
 #include "mldb/core/dataset.h"
+#include "background_compactor.h"
 
 #pragma once
 
 namespace MLDB {
 
 struct BehaviorDomain;
-struct MutableBehaviorDomain;
+struct ShardedMutableBehaviorDomain;
 struct BehaviorManager;
 class BehaviorColumnIndex;
 class BehaviorMatrixView;
@@ -63,6 +64,13 @@ struct BehaviorDataset: public Dataset {
 
     virtual std::shared_ptr<RowStream> getRowStream() const;
 
+    /** Only extracts the columns that the query needs from the row's
+        behaviors.
+    */
+    virtual ExpressionValue
+    getProjectedRowExpr(const RowPath & row,
+                        const std::vector<ColumnPath> & columns) const;
+
     virtual std::pair<Date, Date> getTimestampRange() const;
     virtual Date quantizeTimestamp(Date timestamp) const;
 
@@ -76,10 +84,34 @@ private:
 /* MUTABLE BEHAVIOR DATASET CONFIG                                          */
 /*****************************************************************************/
 
+/** Periodic checkpoints of a mutable behavior dataset, so that it can be
+    recovered after a crash without recording everything again.
+*/
+
+struct BehaviorCheckpointConfig
+{
+    BehaviorCheckpointConfig();
+
+    Url url;                  ///< Directory to write checkpoints to
+    double intervalSeconds;   ///< Checkpoint when the oldest write is this old
+    bool writeAheadLog;       ///< Log writes made since the last checkpoint
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BehaviorCheckpointConfig);
+
 struct MutableBehaviorDatasetConfig : BehaviorDatasetConfig
 {
     MutableBehaviorDatasetConfig();
     double timeQuantumSeconds; 
+
+    /// Number of independent partitions of the rows, to record in parallel
+    int numShards;
+
+    /// When to sort recent writes in the background
+    CompactionConfig compaction;
+
+    /// Where and when to checkpoint the dataset
+    BehaviorCheckpointConfig checkpoint;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(MutableBehaviorDatasetConfig);
@@ -111,17 +143,40 @@ struct MutableBehaviorDataset: public Dataset {
 
     virtual std::shared_ptr<RowStream> getRowStream() const;
 
+    /** Only extracts the columns that the query needs from the row's
+        behaviors.
+    */
+    virtual ExpressionValue
+    getProjectedRowExpr(const RowPath & row,
+                        const std::vector<ColumnPath> & columns) const;
+
     virtual std::pair<Date, Date> getTimestampRange() const;
     virtual Date quantizeTimestamp(Date timestamp) const;
+
+    /** Write a checkpoint now of what was recorded since the last one.
+        Does nothing if checkpoints aren't configured.
+    */
+    void checkpoint();
     
 private:
 
     friend struct MutableBehaviorDatasetRowStream;
 
+    /// Record a row, without logging it for the checkpoint
+    void recordRowUnlogged(const RowPath & rowName,
+                           const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals);
+
     std::string address;
-    std::shared_ptr<MutableBehaviorDomain> behs;
+    std::shared_ptr<ShardedMutableBehaviorDomain> behs;
     std::shared_ptr<BehaviorColumnIndex> columns;
     std::shared_ptr<BehaviorMatrixView> matrix;
+
+    struct Checkpointer;
+    std::unique_ptr<Checkpointer> checkpointer;
+
+    // Last, so that they stop before behs and checkpointer go away
+    std::unique_ptr<BackgroundCompactor> compactor;
+    std::unique_ptr<BackgroundCompactor> checkpointRunner;
 };
 
 
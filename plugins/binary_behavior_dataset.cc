@@ -658,6 +658,7 @@ commit()
         MLDB::makeUriDirectory(address);
         itl->mutableBehs->save(address);
     }
+    Dataset::commit();
 }
 
 namespace {
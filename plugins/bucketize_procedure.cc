@@ -23,7 +23,10 @@
 #include "mldb/utils/log.h"
 #include "mldb/rest/cancellation_exception.h"
 #include "mldb/utils/progress.h"
+#include "mldb/sql/sketches.h"
 #include <memory>
+#include <unordered_map>
+#include <cmath>
 
 using namespace std;
 
@@ -57,6 +60,14 @@ BucketizeProcedureConfigDescription()
              "\"a\" with rows where 0% < rank/count <= 50% "
              "and \"b\" with rows where 50% < rank/count <= 100% "
              "where rank is based on the orderBy parameter.");
+    addField("columns", &BucketizeProcedureConfig::columns,
+             "If set, each of the columns selected by this expression is "
+             "bucketized on its own values instead of ranking the rows with "
+             "the order by expression of `inputData`.  The output then has "
+             "one column per input column holding the bucket of its value.  "
+             "The rows don't need to be sorted, but the percentiles are "
+             "approximate.  Values that are not numbers are not bucketized.",
+             SelectExpression());
     addParent<ProcedureConfig>();
 
     onPostValidate = [&] (BucketizeProcedureConfig * cfg,
@@ -98,6 +109,16 @@ BucketizeProcedureConfigDescription()
             last = range;
         }
         MustContainFrom()(cfg->inputData, BucketizeProcedureConfig::name);
+
+        if (!cfg->columns.clauses.empty()) {
+            const auto & stm = *cfg->inputData.stm;
+            if (!stm.orderBy.clauses.empty() || stm.offset != 0
+                || stm.limit != -1) {
+                throw MLDB::Exception(
+                    "The inputData of the bucketize procedure can't have "
+                    "ORDER BY, OFFSET or LIMIT clauses when columns is set");
+            }
+        }
     };
 }
 
@@ -110,6 +131,169 @@ BucketizeProcedure(MldbServer * owner,
     procedureConfig = config.params.convert<BucketizeProcedureConfig>();
 }
 
+typedef tuple<ColumnPath, CellValue, Date> Cell;
+
+/** Bucketize each output column of config.columns on its own values.  A
+    first parallel pass over the rows builds a t-digest of the values of
+    each column, from which the values at the bucket boundaries are
+    estimated; a second parallel pass assigns each value to its bucket.
+    Unlike ranking the rows, nothing needs to be sorted.
+
+    Returns false if it was cancelled.
+*/
+static bool
+bucketizeColumns(const BucketizeProcedureConfig & config,
+                 BoundTableExpression & boundDataset,
+                 Dataset & output,
+                 Progress & bucketizeProgress,
+                 std::shared_ptr<Step> iterationStep,
+                 const std::function<bool (const Json::Value &)> & onProgress)
+{
+    const auto & stm = *config.inputData.stm;
+    OrderByExpression noOrderBy;
+    BoundSelectQuery bsq(config.columns,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         stm.when,
+                         *stm.where,
+                         noOrderBy,
+                         {} /* calc */);
+
+    std::vector<ColumnPath> columnNames
+        = bsq.getSelectOutputInfo()->allColumnNames();
+    std::unordered_map<ColumnPath, size_t> columnIndexes;
+    for (size_t i = 0;  i < columnNames.size();  ++i)
+        columnIndexes.emplace(columnNames[i], i);
+
+    // Call onValue with the index of the column for each numeric value
+    // of the row
+    auto forEachValue = [&] (const ExpressionValue & row,
+                             const std::function<void (size_t, double, Date)>
+                             & onValue)
+        {
+            ExpressionValue storage;
+            const ExpressionValue & latest = row.getFiltered(GET_LATEST,
+                                                             storage);
+            auto onAtom = [&] (const Path & columnName,
+                               const Path & prefix,
+                               const CellValue & val,
+                               Date ts)
+                {
+                    if (!val.isNumber())
+                        return true;
+                    auto it = columnIndexes.find(prefix + columnName);
+                    if (it != columnIndexes.end())
+                        onValue(it->second, val.toDouble(), ts);
+                    return true;
+                };
+            latest.forEachAtom(onAtom);
+        };
+
+    mutex progressMutex;
+    std::shared_ptr<Step> step = iterationStep;
+    auto onPassProgress = [&] (const ProgressState & percent) {
+        lock_guard<mutex> lock(progressMutex);
+        if (percent.total)
+            step->value = (float) percent.count / *percent.total;
+        return onProgress(jsonEncode(bucketizeProgress));
+    };
+
+    PerThreadAccumulator<std::vector<TDigest> > digests;
+
+    auto addValues = [&] (RowPath & rowName,
+                          ExpressionValue & row,
+                          std::vector<ExpressionValue> & calc)
+        {
+            auto & threadDigests = digests.get();
+            if (MLDB_UNLIKELY(threadDigests.empty()))
+                threadDigests.resize(columnNames.size());
+            forEachValue(row, [&] (size_t i, double val, Date ts)
+                         {
+                             threadDigests[i].add(val);
+                         });
+            return true;
+        };
+
+    if (!bsq.executeExpr({addValues, true /*processInParallel*/},
+                         0, -1, onPassProgress))
+        return false;
+
+    std::vector<TDigest> merged(columnNames.size());
+    digests.forEach([&] (std::vector<TDigest> * threadDigests)
+                    {
+                        for (size_t i = 0;  i < threadDigests->size();  ++i)
+                            merged[i].merge((*threadDigests)[i]);
+                    });
+
+    // A value is in a bucket if lower < value <= upper.  The bounds at
+    // 0 and 100 are open, so that the extreme values can't fall outside
+    // due to the approximation.
+    struct Bucket {
+        CellValue name;
+        double lower;
+        double upper;
+    };
+
+    std::vector<std::vector<Bucket> > buckets(columnNames.size());
+    for (size_t i = 0;  i < columnNames.size();  ++i) {
+        for (const auto & mappedRange: config.percentileBuckets) {
+            auto range = mappedRange.second;
+            double lower = range.first == 0
+                ? -INFINITY : merged[i].quantile(range.first / 100);
+            double upper = range.second == 100
+                ? INFINITY : merged[i].quantile(range.second / 100);
+            buckets[i].push_back({mappedRange.first, lower, upper});
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(progressMutex);
+        step = iterationStep->nextStep(1);
+    }
+
+    PerThreadAccumulator<vector<pair<RowPath, vector<Cell>>>> accum;
+
+    auto recordBuckets = [&] (RowPath & rowName,
+                              ExpressionValue & row,
+                              std::vector<ExpressionValue> & calc)
+        {
+            vector<Cell> cells;
+            forEachValue(row, [&] (size_t i, double val, Date ts)
+                         {
+                             for (auto & b: buckets[i]) {
+                                 if (val > b.lower && val <= b.upper) {
+                                     cells.emplace_back(columnNames[i],
+                                                        b.name, ts);
+                                     break;
+                                 }
+                             }
+                         });
+            if (cells.empty())
+                return true;
+
+            auto & rows = accum.get();
+            rows.reserve(1024);
+            rows.emplace_back(rowName, std::move(cells));
+            if (rows.size() >= 1024) {
+                output.recordRows(rows);
+                rows.clear();
+            }
+            return true;
+        };
+
+    if (!bsq.executeExpr({recordBuckets, true /*processInParallel*/},
+                         0, -1, onPassProgress))
+        return false;
+
+    // record remainder
+    accum.forEach([&] (vector<pair<RowPath, vector<Cell>>> * rows)
+    {
+        output.recordRows(*rows);
+    });
+
+    return true;
+}
+
 RunOutput
 BucketizeProcedure::
 run(const ProcedureRunConfig & run,
@@ -127,6 +311,18 @@ run(const ProcedureRunConfig & run,
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.inputData.stm->from->bind(context, convertProgressToJson);
 
+    if (!runProcConf.columns.clauses.empty()) {
+        auto output = createDataset(server, runProcConf.outputDataset,
+                                    nullptr, true /*overwrite*/);
+        if (!bucketizeColumns(runProcConf, boundDataset, *output,
+                              bucketizeProgress, iterationStep, onProgress)) {
+            throw CancellationException(std::string(BucketizeProcedureConfig::name) +
+                                        " procedure was cancelled");
+        }
+        output->commit();
+        return output->getStatus();
+    }
+
     SelectExpression select(SelectExpression::parse("1"));
     vector<shared_ptr<SqlExpression> > calc;
 
@@ -185,7 +381,6 @@ run(const ProcedureRunConfig & run,
     auto output = createDataset(server, runProcConf.outputDataset,
                                 nullptr, true /*overwrite*/);
 
-    typedef tuple<ColumnPath, CellValue, Date> Cell;
     PerThreadAccumulator<vector<pair<RowPath, vector<Cell>>>> accum;
 
     auto bucketizeStep = iterationStep->nextStep(1);
@@ -23,6 +23,10 @@ struct BucketizeProcedureConfig : ProcedureConfig {
     InputQuery inputData;
     PolyConfigT<Dataset> outputDataset;
     std::map<std::string, std::pair<float, float>> percentileBuckets;
+
+    /// Columns to bucketize on their own values, rather than ranking the
+    /// rows by the ORDER BY clause of inputData
+    SelectExpression columns;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BucketizeProcedureConfig);
@@ -34,6 +34,7 @@
 #include "mldb/ml/jml/classifier_generator.h"
 #include "mldb/ml/jml/registry.h"
 #include "mldb/ml/jml/onevsall_generator.h"
+#include "mldb/ml/jml/compiled_tree_ensemble.h"
 #include "mldb/jml/utils/map_reduce.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/server/analytics.h"
@@ -44,6 +45,10 @@
 #include "mldb/rest/in_process_rest_connection.h"
 #include "mldb/server/static_content_macro.h"
 #include "mldb/utils/log.h"
+#include "mldb/arch/rcu_protected.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/rest/rest_request_binding.h"
+#include <mutex>
 
 
 using namespace std;
@@ -140,6 +145,15 @@ ClassifierConfigDescription()
              "If specified, an instance of the ![](%%doclink classifier function) of this name will be created using "
              "the trained model. Note that to use this parameter, the `modelFileUrl` must "
              "also be provided.");
+    addField("trainingCacheUrl", &ClassifierConfig::trainingCacheUrl,
+             "URL of a file where the training data extracted by the "
+             "`trainingData` query is saved.  A later run whose `trainingData`, "
+             "`mode` and `multilabelStrategy` are the same, over input data "
+             "that hasn't changed, will read the training data from this file "
+             "rather than running the query again, which is useful when "
+             "trying different algorithms or configurations.  If the file is "
+             "for different training data, it's replaced.  By default nothing "
+             "is saved.");
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&ClassifierConfig::trainingData,
@@ -150,6 +164,111 @@ ClassifierConfigDescription()
                            validateFunction<ClassifierConfig>());
 }
 
+/*****************************************************************************/
+/* CLASSIFIER TRAINING CACHE                                                 */
+/*****************************************************************************/
+
+/** Training data that was extracted by the trainingData query of the
+    classifier.train procedure, which is saved to the trainingCacheUrl so
+    that later runs over the same data can skip the extraction.  The file
+    starts with a key describing the query and the state of the input
+    dataset, and is only used by a run with the same key.
+*/
+
+struct ClassifierTrainingCache {
+    std::shared_ptr<DatasetFeatureSpace> featureSpace;
+    std::map<std::string, int> labelMapping;
+    std::vector<std::vector<int> > multiLabelList;
+    std::vector<ML::Mutable_Feature_Set> featureSets;
+
+    /** Return the key for a run with the given configuration over the
+        given dataset.
+    */
+    static std::string getKey(const ClassifierConfig & config,
+                              const Dataset & dataset)
+    {
+        Json::Value key;
+        key["trainingData"] = jsonEncode(config.trainingData);
+        key["mode"] = jsonEncode(config.mode);
+        key["multilabelStrategy"] = jsonEncode(config.multilabelStrategy);
+        if (dataset.config_)
+            key["dataset"] = dataset.config_->id;
+        key["generation"] = dataset.getGeneration();
+        key["rowCount"] = dataset.getMatrixView()->getRowCount();
+        key["timestampRange"] = jsonEncode(dataset.getTimestampRange());
+        return key.toStringNoNewLine();
+    }
+
+    /** Load the cache from the given URL, returning false if there is no
+        file there or if it's for a different key.
+    */
+    bool load(const Url & url, const std::string & key)
+    {
+        if (!tryGetUriObjectInfo(url.toDecodedString()).exists)
+            return false;
+
+        filter_istream stream(url);
+        ML::DB::Store_Reader store(stream);
+
+        std::string magic, fileKey;
+        char version;
+        store >> magic >> version;
+        if (magic != "MLDB classifier training cache" || version != 1)
+            return false;
+        store >> fileKey;
+        if (fileKey != key)
+            return false;
+
+        featureSpace = std::make_shared<DatasetFeatureSpace>();
+        featureSpace->reconstitute(store);
+        store >> labelMapping >> multiLabelList;
+
+        ML::DB::compact_size_t numExamples(store);
+        featureSets.clear();
+        featureSets.reserve(numExamples);
+        for (size_t i = 0;  i < numExamples;  ++i) {
+            ML::DB::compact_size_t numFeatures(store);
+            ML::Mutable_Feature_Set::features_type features(numFeatures);
+            for (auto & f: features) {
+                featureSpace->ML::Feature_Space::reconstitute(store, f.first);
+                store >> f.second;
+            }
+            // Already sorted when it was saved
+            featureSets.emplace_back(std::move(features), true /* sorted */);
+        }
+
+        return true;
+    }
+
+    /** Save the cache to the given URL under the given key.  The examples
+        are passed separately, as getExample(i) for each one.
+    */
+    void save(const Url & url, const std::string & key,
+              size_t numExamples,
+              const std::function<const ML::Mutable_Feature_Set & (size_t)>
+                  & getExample) const
+    {
+        filter_ostream stream(url);
+        ML::DB::Store_Writer store(stream);
+
+        store << std::string("MLDB classifier training cache") << (char)1
+              << key;
+        featureSpace->serialize(store);
+        store << labelMapping << multiLabelList;
+
+        store << ML::DB::compact_size_t(numExamples);
+        for (size_t i = 0;  i < numExamples;  ++i) {
+            const ML::Mutable_Feature_Set & features = getExample(i);
+            store << ML::DB::compact_size_t(features.features.size());
+            for (auto & f: features) {
+                featureSpace->ML::Feature_Space::serialize(store, f.first);
+                store << f.second;
+            }
+        }
+    }
+};
+
+
 /*****************************************************************************/
 /* CLASSIFIER PROCEDURE                                                       */
 /*****************************************************************************/
@@ -340,12 +459,34 @@ run(const ProcedureRunConfig & run,
 
     Timer timer;
 
+    // If the training data for this query and input was already extracted
+    // and saved, there is no need to do it again
+    ClassifierTrainingCache cache;
+    std::string cacheKey;
+    bool cached = false;
+    if (!runProcConf.trainingCacheUrl.empty()) {
+        cacheKey = ClassifierTrainingCache::getKey(runProcConf,
+                                                   *boundDataset.dataset);
+        cached = cache.load(runProcConf.trainingCacheUrl, cacheKey);
+        if (cached)
+            INFO_MSG(logger) << "loaded " << cache.featureSets.size()
+                             << " training examples from "
+                             << runProcConf.trainingCacheUrl << " in "
+                             << timer.elapsed();
+    }
+
     // TODO: it's not the feature space itself, but indeed the output of
     // the select expression that's important...
-    auto featureSpace = std::make_shared<DatasetFeatureSpace>
-        (boundDataset.dataset, labelInfo, knownInputColumns);
+    std::shared_ptr<DatasetFeatureSpace> featureSpace;
+    if (cached) {
+        featureSpace = cache.featureSpace;
+    }
+    else {
+        featureSpace = std::make_shared<DatasetFeatureSpace>
+            (boundDataset.dataset, labelInfo, knownInputColumns);
 
-    INFO_MSG(logger) << "initialized feature space in " << timer.elapsed();
+        INFO_MSG(logger) << "initialized feature space in " << timer.elapsed();
+    }
 
     // We want to calculate the label and weight of each row as well
     // as the select expression
@@ -670,16 +811,18 @@ run(const ProcedureRunConfig & run,
 
     timer.restart();
 
-    BoundSelectQuery(select, *boundDataset.dataset,
-                     boundDataset.asName, runProcConf.trainingData.stm->when,
-                     *runProcConf.trainingData.stm->where,
-                     runProcConf.trainingData.stm->orderBy, extra)
-        .execute({processor,true/*processInParallel*/},
-                 runProcConf.trainingData.stm->offset,
-                 runProcConf.trainingData.stm->limit,
-                 nullptr /* progress */);
-
-    INFO_MSG(logger) << "extracted feature vectors in " << timer.elapsed();
+    if (!cached) {
+        BoundSelectQuery(select, *boundDataset.dataset,
+                         boundDataset.asName, runProcConf.trainingData.stm->when,
+                         *runProcConf.trainingData.stm->where,
+                         runProcConf.trainingData.stm->orderBy, extra)
+            .execute({processor,true/*processInParallel*/},
+                     runProcConf.trainingData.stm->offset,
+                     runProcConf.trainingData.stm->limit,
+                     nullptr /* progress */);
+
+        INFO_MSG(logger) << "extracted feature vectors in " << timer.elapsed();
+    }
 
     // If we're categorical, we need to sort out the labels over all
     // of the threads.
@@ -689,8 +832,9 @@ run(const ProcedureRunConfig & run,
     std::map<std::vector<int>, int> multiLabelMap;
     std::vector<std::vector<int>> uniqueMultiLabelList;
 
-    if (runProcConf.mode == CM_CATEGORICAL || 
-        runProcConf.mode == CM_MULTILABEL) {
+    if (!cached &&
+        (runProcConf.mode == CM_CATEGORICAL ||
+         runProcConf.mode == CM_MULTILABEL)) {
 
         std::set<std::string> allLabels;
         std::vector<std::vector<int>> multiLabelList;
@@ -761,25 +905,40 @@ run(const ProcedureRunConfig & run,
 
     timer.restart();
 
-    parallelMergeSortRecursive(accum.threads, 0, accum.threads.size(),
-                               [] (const std::shared_ptr<ThreadAccum> & t)
-                               {
-                                   t->sort();
-                               },
-                               [] (const std::shared_ptr<ThreadAccum> & t1,
-                                   const std::shared_ptr<ThreadAccum> & t2)
-                               {
-                                   ThreadAccum::merge(*t1, *t2);
-                               },
-                               [] (const std::shared_ptr<ThreadAccum> & t)
-                               {
-                                   return t->fvs.size();
-                               },
-                               10000 /* thread threshold */);
-
-    INFO_MSG(logger) << "merged feature vectors in " << timer.elapsed();
-
-    if (!accum.threads.empty()) {
+    if (cached) {
+        // The labels were already mapped and the examples sorted
+        labelMapping = std::move(cache.labelMapping);
+        uniqueMultiLabelList = std::move(cache.multiLabelList);
+        if (multilabelGenerator) {
+            multilabelGenerator->setMultilabelMapping(uniqueMultiLabelList,
+                                                      labelMapping.size());
+        }
+        fvs.reserve(cache.featureSets.size());
+        for (auto & featureSet: cache.featureSets)
+            fvs.emplace_back(RowPath(), std::move(featureSet));
+        numRows = fvs.size();
+    }
+    else {
+        parallelMergeSortRecursive(accum.threads, 0, accum.threads.size(),
+                                   [] (const std::shared_ptr<ThreadAccum> & t)
+                                   {
+                                       t->sort();
+                                   },
+                                   [] (const std::shared_ptr<ThreadAccum> & t1,
+                                       const std::shared_ptr<ThreadAccum> & t2)
+                                   {
+                                       ThreadAccum::merge(*t1, *t2);
+                                   },
+                                   [] (const std::shared_ptr<ThreadAccum> & t)
+                                   {
+                                       return t->fvs.size();
+                                   },
+                                   10000 /* thread threshold */);
+
+        INFO_MSG(logger) << "merged feature vectors in " << timer.elapsed();
+    }
+
+    if (!cached && !accum.threads.empty()) {
         fvs = std::move(accum.threads[0]->fvs);
     }
 
@@ -809,6 +968,23 @@ run(const ProcedureRunConfig & run,
                                   "limitClause", runProcConf.trainingData.stm->limit);
     }
 
+    if (!cached && !runProcConf.trainingCacheUrl.empty()) {
+        timer.restart();
+
+        cache.featureSpace = featureSpace;
+        cache.labelMapping = labelMapping;
+        cache.multiLabelList = uniqueMultiLabelList;
+        cache.save(runProcConf.trainingCacheUrl, cacheKey, fvs.size(),
+                   [&] (size_t i) -> const ML::Mutable_Feature_Set &
+                   {
+                       return fvs[i].featureSet;
+                   });
+
+        INFO_MSG(logger) << "saved training data to "
+                         << runProcConf.trainingCacheUrl << " in "
+                         << timer.elapsed();
+    }
+
     timer.restart();
 
     ML::Training_Data trainingSet(featureSpace);
@@ -1006,10 +1182,56 @@ ClassifyFunctionConfigDescription()
 }
 
 struct ClassifyFunction::Itl {
+    Url modelFileUrl;
     ML::Classifier classifier;
     std::shared_ptr<const DatasetFeatureSpace> featureSpace;
     ML::Feature_Info labelInfo;
     ClassifierMode mode;
+    bool isRegression;
+
+    /// Optimized form of the classifier for dense features, and the
+    /// flattened form if it's a tree ensemble.  These are made when the
+    /// model is loaded rather than each time that it's bound.
+    ML::Optimization_Info optInfo;
+    std::shared_ptr<const ML::Compiled_Tree_Ensemble> compiled;
+
+    static std::shared_ptr<const Itl> load(const Url & modelFileUrl)
+    {
+        auto result = std::make_shared<Itl>();
+        result->modelFileUrl = modelFileUrl;
+        result->classifier.load(modelFileUrl.toDecodedString());
+        result->featureSpace
+            = result->classifier.feature_space<DatasetFeatureSpace>();
+        result->labelInfo = result->featureSpace->info(labelFeature);
+        result->isRegression = result->classifier.label_count() == 1;
+
+        // Assume there is one of each features
+        vector<ML::Feature> features(result->featureSpace->columnInfo.size());
+        for (auto & col: result->featureSpace->columnInfo)
+            features[col.second.index]
+                = result->featureSpace->getFeature(col.first);
+
+        result->optInfo = result->classifier.impl->optimize(features);
+        result->compiled
+            = ML::Compiled_Tree_Ensemble::compile(*result->classifier.impl,
+                                                  features);
+        return result;
+    }
+};
+
+struct ClassifyFunction::Current {
+    Current(std::shared_ptr<const Itl> model)
+        : model(gcLock, std::move(model))
+    {
+    }
+
+    GcLock gcLock;
+    RcuProtected<std::shared_ptr<const Itl> > model;
+
+    /// Serializes reloads
+    std::mutex reloadMutex;
+
+    RestRequestRouter router;
 };
 
 ClassifyFunction::
@@ -1020,31 +1242,66 @@ ClassifyFunction(MldbServer * owner,
 {
     functionConfig = config.params.convert<ClassifyFunctionConfig>();
 
-    itl.reset(new Itl());
+    current.reset(new Current(Itl::load(functionConfig.modelFileUrl)));
+
+    addRouteSyncJsonReturn(current->router, "/reload", {"POST"},
+                           "Load the given model file (or the current one "
+                           "again), and swap it in once it's ready",
+                           "Status of the function with the new model",
+                           &ClassifyFunction::reloadModel,
+                           this,
+                           JsonParamDefault<Url>("modelFileUrl",
+                                                 "URL of the model file to "
+                                                 "load; the current one is "
+                                                 "reloaded if not given"));
+}
+
+ClassifyFunction::
+~ClassifyFunction()
+{
+}
 
-    itl->classifier.load(functionConfig.modelFileUrl.toDecodedString());
+std::shared_ptr<const ClassifyFunction::Itl>
+ClassifyFunction::
+getModel() const
+{
+    auto locked = current->model();
+    return *locked;
+}
 
-    itl->featureSpace = itl->classifier.feature_space<DatasetFeatureSpace>();
+Any
+ClassifyFunction::
+reloadModel(const Url & modelFileUrl)
+{
+    std::unique_lock<std::mutex> guard(current->reloadMutex);
 
-    ML::Feature_Info labelInfo = itl->featureSpace->info(labelFeature);
+    // The old model keeps on scoring while this loads
+    auto model = Itl::load(modelFileUrl.empty()
+                           ? getModel()->modelFileUrl : modelFileUrl);
 
-    itl->labelInfo = labelInfo;
+    current->model.replace(new std::shared_ptr<const Itl>(std::move(model)));
 
-    isRegression = itl->classifier.label_count() == 1;
+    return getStatus();
 }
 
+RestRequestMatchResult
 ClassifyFunction::
-~ClassifyFunction()
+handleRequest(RestConnection & connection,
+              const RestRequest & request,
+              RestRequestParsingContext & context) const
 {
+    return current->router.processRequest(connection, request, context);
 }
 
 Any
 ClassifyFunction::
 getStatus() const
 {
+    auto itl = getModel();
     Json::Value result;
     result["summary"] = itl->classifier.impl->summary();
     result["mode"] = jsonEncode(itl->mode);
+    result["modelFileUrl"] = itl->modelFileUrl.toUtf8String();
     return result;
 }
 
@@ -1052,53 +1309,67 @@ Any
 ClassifyFunction::
 getDetails() const
 {
+    auto itl = getModel();
     Json::Value result;
     result["model"] = jsonEncode(itl->classifier.impl);
     return result;
 }
 
-std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
+bool
 ClassifyFunction::
-getFeatureSet(const ExpressionValue & context, bool attemptDense) const
+getDenseFeatures(const Itl & model,
+                 const ExpressionValue & row, float * output,
+                 Date & ts) const
 {
-    auto row = context.getColumn(PathElement("features"));
-
-    Date ts = Date::negativeInfinity();
+    std::fill(output, output + model.featureSpace->columnInfo.size(),
+              std::numeric_limits<float>::quiet_NaN());
 
     bool multiValue = false;
-    if (attemptDense) {
-        std::vector<float> denseFeatures(itl->featureSpace->columnInfo.size(),
-                                         std::numeric_limits<float>::quiet_NaN());
 
-        auto onAtom = [&] (const Path & suffix,
-                           const Path & prefix,
-                           const CellValue & value,
-                           Date tsIn)
-            {
-                ColumnPath columnName(prefix + suffix);
-                ColumnHash columnHash(columnName);
+    auto onAtom = [&] (const Path & suffix,
+                       const Path & prefix,
+                       const CellValue & value,
+                       Date tsIn)
+        {
+            ColumnPath columnName(prefix + suffix);
+            ColumnHash columnHash(columnName);
                 
-                auto it = itl->featureSpace->columnInfo.find(columnHash);
-                if (it == itl->featureSpace->columnInfo.end())
-                    return true;
+            auto it = model.featureSpace->columnInfo.find(columnHash);
+            if (it == model.featureSpace->columnInfo.end())
+                return true;
 
-                ts.setMax(tsIn);
+            ts.setMax(tsIn);
 
-                if (!isnanf(denseFeatures[it->second.index])) {
-                    multiValue = true;
-                    return false;
-                }
+            if (!isnanf(output[it->second.index])) {
+                multiValue = true;
+                return false;
+            }
                 
-                denseFeatures[it->second.index]
-                    = itl->featureSpace->encodeFeatureValue(columnHash, value);
+            output[it->second.index]
+                = model.featureSpace->encodeFeatureValue(columnHash, value);
 
-                return true;
-            };
+            return true;
+        };
+
+    row.forEachAtom(onAtom);
+
+    return !multiValue;
+}
+
+std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
+ClassifyFunction::
+getFeatureSet(const Itl & model,
+              const ExpressionValue & context, bool attemptDense) const
+{
+    auto row = context.getColumn(PathElement("features"));
 
-        row.forEachAtom(onAtom);
+    Date ts = Date::negativeInfinity();
 
-        if (!multiValue)
+    if (attemptDense) {
+        std::vector<float> denseFeatures(model.featureSpace->columnInfo.size());
+        if (getDenseFeatures(model, row, denseFeatures.data(), ts))
             return std::make_tuple( std::move(denseFeatures), nullptr, ts );
+        ts = Date::negativeInfinity();
     }
 
 
@@ -1112,13 +1383,13 @@ getFeatureSet(const ExpressionValue & context, bool attemptDense) const
             ColumnPath columnName(prefix + suffix);
             ColumnHash columnHash(columnName);
 
-            auto it = itl->featureSpace->columnInfo.find(columnHash);
-            if (it == itl->featureSpace->columnInfo.end())
+            auto it = model.featureSpace->columnInfo.find(columnHash);
+            if (it == model.featureSpace->columnInfo.end())
                 return true;
 
             ts.setMax(tsIn);
 
-            itl->featureSpace->encodeFeature(columnHash, value, features);
+            model.featureSpace->encodeFeature(columnHash, value, features);
 
             return true;
         };
@@ -1135,13 +1406,16 @@ getFeatureSet(const ExpressionValue & context, bool attemptDense) const
 }
 
 struct ClassifyFunctionApplier: public FunctionApplier {
-    ClassifyFunctionApplier(const Function * owner)
-        : FunctionApplier(owner)
+    ClassifyFunctionApplier(const ClassifyFunction * owner,
+                            std::shared_ptr<const ClassifyFunction::Itl> model)
+        : FunctionApplier(owner), model(std::move(model))
     {
-        info = owner->getFunctionInfo();
+        info = owner->getModelInfo(*this->model);
     }
 
-    ML::Optimization_Info optInfo;
+    /// Model that was current when we were bound, which we keep using
+    /// even if the function's model is swapped
+    std::shared_ptr<const ClassifyFunction::Itl> model;
 };
 
 std::unique_ptr<FunctionApplier>
@@ -1149,17 +1423,9 @@ ClassifyFunction::
 bind(SqlBindingScope & outerContext,
      const std::vector<std::shared_ptr<ExpressionValueInfo> > & input) const
 {
-    // Assume there is one of each features
-    vector<ML::Feature> features(itl->featureSpace->columnInfo.size());
-
-    for (auto & col: itl->featureSpace->columnInfo)
-        features[col.second.index] = itl->featureSpace->getFeature(col.first);
-
-    std::unique_ptr<ClassifyFunctionApplier> result
-        (new ClassifyFunctionApplier(this));
-    result->optInfo = itl->classifier.impl->optimize(features);
-
-    return std::move(result);
+    // The model was optimized when it was loaded
+    return std::unique_ptr<FunctionApplier>
+        (new ClassifyFunctionApplier(this, getModel()));
 }
 
 ExpressionValue
@@ -1168,28 +1434,35 @@ apply(const FunctionApplier & applier_,
       const ExpressionValue & context) const
 {
     auto & applier = (ClassifyFunctionApplier &)applier_;
+    const Itl & model = *applier.model;
 
-    int labelCount = itl->classifier.label_count();
+    int labelCount = model.classifier.label_count();
 
     std::vector<float> dense;
     std::shared_ptr<ML::Mutable_Feature_Set> fset;
     Date ts;
 
     std::tie(dense, fset, ts)
-        = getFeatureSet(context, applier.optInfo /* try to optimize */);
+        = getFeatureSet(model, context, model.optInfo || model.compiled
+                        /* try to optimize */);
 
     StructValue result;
     result.reserve(1);
 
-    auto cat = itl->labelInfo.categorical();
-    if (!dense.empty() && applier.optInfo) {
+    auto cat = model.labelInfo.categorical();
+    if (!dense.empty() && model.compiled) {
+        ML::Label_Dist scores = model.compiled->predict(dense.data());
+        ExcAssertEqual(scores.size(), labelCount);
+        return getOutput(model, &scores[0], ts);
+    }
+    else if (!dense.empty() && model.optInfo) {
         if (cat) {
 
             ML::Label_Dist scores
-                = itl->classifier.impl->predict(dense, applier.optInfo);
+                = model.classifier.impl->predict(dense, model.optInfo);
             ExcAssertEqual(scores.size(), labelCount);
 
-            vector<tuple<PathElement, ExpressionValue> > row;
+            StructValue row;
             for (unsigned i = 0;  i < labelCount;  ++i) {
                 row.emplace_back(PathElement(cat->print(i)),
                                  ExpressionValue(scores[i], ts));
@@ -1197,16 +1470,16 @@ apply(const FunctionApplier & applier_,
 
             result.emplace_back("scores", std::move(row));
         }
-        else if (itl->labelInfo.type() == ML::REAL) {
+        else if (model.labelInfo.type() == ML::REAL) {
             ExcAssertEqual(labelCount, 1);
             float score
-                = itl->classifier.impl->predict(0, dense, applier.optInfo);
+                = model.classifier.impl->predict(0, dense, model.optInfo);
             result.emplace_back("score", ExpressionValue(score, ts));
         }
         else {
             ExcAssertEqual(labelCount, 2);
             float score
-                = itl->classifier.impl->predict(1, dense, applier.optInfo);
+                = model.classifier.impl->predict(1, dense, model.optInfo);
             result.emplace_back("score", ExpressionValue(score, ts));
         }
     }
@@ -1217,10 +1490,10 @@ apply(const FunctionApplier & applier_,
         }
         
         if (cat) {
-            auto scores = itl->classifier.predict(*fset);
+            auto scores = model.classifier.predict(*fset);
             ExcAssertEqual(scores.size(), labelCount);
 
-            vector<tuple<PathElement, ExpressionValue> > row;
+            StructValue row;
 
             for (unsigned i = 0;  i < labelCount;  ++i) {
                 row.emplace_back(PathElement(cat->print(i)),
@@ -1228,14 +1501,14 @@ apply(const FunctionApplier & applier_,
             }
             result.emplace_back("scores", std::move(row));
         }
-        else if (itl->labelInfo.type() == ML::REAL) {
+        else if (model.labelInfo.type() == ML::REAL) {
             ExcAssertEqual(labelCount, 1);
-            float score = itl->classifier.predict(0, *fset);
+            float score = model.classifier.predict(0, *fset);
             result.emplace_back("score", ExpressionValue(score, ts));
         }
         else {
             ExcAssertEqual(labelCount, 2);
-            float score = itl->classifier.predict(1, *fset);
+            float score = model.classifier.predict(1, *fset);
             result.emplace_back("score", ExpressionValue(score, ts));
         }
     }
@@ -1243,16 +1516,111 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+ExpressionValue
+ClassifyFunction::
+getOutput(const Itl & model, const float * scores, Date ts) const
+{
+    StructValue result;
+    result.reserve(1);
+
+    auto cat = model.labelInfo.categorical();
+    if (cat) {
+        int labelCount = model.classifier.label_count();
+        StructValue row;
+        row.reserve(labelCount);
+        for (unsigned i = 0;  i < labelCount;  ++i) {
+            row.emplace_back(PathElement(cat->print(i)),
+                             ExpressionValue(scores[i], ts));
+        }
+
+        result.emplace_back("scores", std::move(row));
+    }
+    else {
+        float score = scores[model.labelInfo.type() == ML::REAL ? 0 : 1];
+        result.emplace_back("score", ExpressionValue(score, ts));
+    }
+
+    return std::move(result);
+}
+
+void
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           const ExpressionValue * inputs,
+           ExpressionValue * outputs,
+           size_t n) const
+{
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+    const Itl & model = *applier.model;
+
+    if (!model.compiled && !model.optInfo) {
+        Function::applyBatch(applier, inputs, outputs, n);
+        return;
+    }
+
+    static constexpr size_t BATCH_SIZE = 64;
+
+    size_t nf = model.featureSpace->columnInfo.size();
+    int labelCount = model.classifier.label_count();
+
+    // Buffers for a batch of dense rows and their scores, which are
+    // reused from call to call on each thread so that scoring doesn't
+    // allocate any memory per row.
+    static thread_local std::vector<float> dense, scores;
+    static thread_local std::vector<std::pair<size_t, Date> > denseRows;
+    dense.resize(nf * BATCH_SIZE);
+    scores.resize(labelCount * BATCH_SIZE);
+
+    for (size_t first = 0;  first < n;  first += BATCH_SIZE) {
+        size_t last = std::min(n, first + BATCH_SIZE);
+
+        denseRows.clear();
+        for (size_t i = first;  i < last;  ++i) {
+            Date ts = Date::negativeInfinity();
+            auto row = inputs[i].getColumn(PathElement("features"));
+            if (getDenseFeatures(model, row,
+                                 dense.data() + denseRows.size() * nf,
+                                 ts)) {
+                denseRows.emplace_back(i, ts);
+            }
+            else {
+                // Multiple values for a feature; needs the sparse path
+                outputs[i] = apply(applier, inputs[i]);
+            }
+        }
+
+        if (model.compiled)
+            model.compiled->predict(dense.data(), denseRows.size(), nf,
+                                      scores.data());
+        else model.classifier.impl->predict_batch
+                 (dense.data(), denseRows.size(), nf, model.optInfo,
+                  scores.data());
+
+        for (size_t j = 0;  j < denseRows.size();  ++j) {
+            outputs[denseRows[j].first]
+                = getOutput(model, scores.data() + j * labelCount,
+                            denseRows[j].second);
+        }
+    }
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
+{
+    return getModelInfo(*getModel());
+}
+
+FunctionInfo
+ClassifyFunction::
+getModelInfo(const Itl & model) const
 {
     FunctionInfo result;
 
     std::vector<KnownColumn> featureColumns;
 
     // Input is cell values
-    for (auto & col: itl->featureSpace->columnInfo) {
+    for (auto & col: model.featureSpace->columnInfo) {
 
         ColumnSparsity sparsity = col.second.info.optional()
             ? COLUMN_IS_SPARSE : COLUMN_IS_DENSE;
@@ -1308,10 +1676,10 @@ getFunctionInfo() const
     
     std::vector<KnownColumn> outputColumns;
 
-    auto cat = itl->labelInfo.categorical();
+    auto cat = model.labelInfo.categorical();
 
     if (cat) {
-        int labelCount = itl->classifier.label_count();
+        int labelCount = model.classifier.label_count();
 
         std::vector<KnownColumn> scoreColumns;
 
@@ -1364,16 +1732,29 @@ ExplainFunction::
 {
 }
 
+void
+ExplainFunction::
+applyBatch(const FunctionApplier & applier,
+           const ExpressionValue * inputs,
+           ExpressionValue * outputs,
+           size_t n) const
+{
+    Function::applyBatch(applier, inputs, outputs, n);
+}
+
 ExpressionValue
 ExplainFunction::
 apply(const FunctionApplier & applier,
       const ExpressionValue & context) const
 {
+    const Itl & model = *static_cast<const ClassifyFunctionApplier &>(applier).model;
+
     std::vector<float> dense;
     std::shared_ptr<ML::Mutable_Feature_Set> fset;
     Date ts;
 
-    std::tie(dense, fset, ts) = getFeatureSet(context, false /* attempt to optimize */);
+    std::tie(dense, fset, ts)
+        = getFeatureSet(model, context, false /* attempt to optimize */);
 
     if (fset->features.empty()) {
         throw MLDB::Exception("The specified features couldn't be found in the "
@@ -1384,8 +1765,9 @@ apply(const FunctionApplier & applier,
     CellValue label = context.getColumn("label").getAtom();
 
     ML::Explanation expl
-        = itl->classifier.impl
-        ->explain(*fset, itl->featureSpace->encodeLabel(label, isRegression));
+        = model.classifier.impl
+        ->explain(*fset, model.featureSpace->encodeLabel(label,
+                                                         model.isRegression));
 
     StructValue output;
     output.reserve(2);
@@ -1396,7 +1778,7 @@ apply(const FunctionApplier & applier,
     Date effectiveDate = ts;
 
     for(auto iter=expl.feature_weights.begin(); iter!=expl.feature_weights.end(); iter++) {
-        features.emplace_back(ColumnPath::parse(itl->featureSpace->print(iter->first)),
+        features.emplace_back(ColumnPath::parse(model.featureSpace->print(iter->first)),
                               iter->second,
                               effectiveDate);
     }
@@ -1408,7 +1790,7 @@ apply(const FunctionApplier & applier,
 
 FunctionInfo
 ExplainFunction::
-getFunctionInfo() const
+getModelInfo(const Itl & model) const
 {
     FunctionInfo result;
 
@@ -76,6 +76,10 @@ struct ClassifierConfig : public ProcedureConfig {
 
     // Function name
     Utf8String functionName;
+
+    /// File to save the extracted training data to, so that later runs
+    /// over the same query and data can reuse it.  Empty means don't.
+    Url trainingCacheUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ClassifierConfig);
@@ -135,9 +139,58 @@ struct ClassifyFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Apply to a batch of inputs.  The rows that can be densified are
+        scored together through the compiled or optimized classifier, using
+        per-thread buffers, and the rest one at a time through apply().
+    */
+    virtual void applyBatch(const FunctionApplier & applier,
+                            const ExpressionValue * inputs,
+                            ExpressionValue * outputs,
+                            size_t n) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
+    /// Loaded model, with everything needed to score with it
+    struct Itl;
+
+    /** Describe the input and output of the function with the given
+        model.  getFunctionInfo() calls this with the current model.
+    */
+    virtual FunctionInfo getModelInfo(const Itl & model) const;
+
+    /** Return the model currently in use.  Appliers keep the model that
+        was current when they were bound.
+    */
+    std::shared_ptr<const Itl> getModel() const;
+
+    /** Load and warm up the model at the given URL (or reload the current
+        one if it's empty), and then swap it in.  Calls continue to be
+        scored with the old model while the new one loads, and those that
+        were bound before the swap keep using it.  Returns the status of
+        the function with the new model.
+    */
+    Any reloadModel(const Url & modelFileUrl);
+
+    virtual RestRequestMatchResult
+    handleRequest(RestConnection & connection,
+                  const RestRequest & request,
+                  RestRequestParsingContext & context) const;
+
+    /** Write the dense (optimized) feature vector for the features column
+        of the input to output, which must have space for one float per
+        feature, and update ts with its latest timestamp.  Returns false if
+        a feature has more than one value, in which case the row can't be
+        densified.
+    */
+    bool getDenseFeatures(const Itl & model,
+                          const ExpressionValue & row, float * output,
+                          Date & ts) const;
+
+    /** Return the function's output for the given label scores. */
+    ExpressionValue getOutput(const Itl & model,
+                              const float * scores, Date ts) const;
+
     /** Return the feature set for the given function context.  If
         returnDense is true, then it will attempt to return an optimized
         (dense) feature vector.
@@ -149,15 +202,16 @@ struct ClassifyFunction: public Function {
         set as a whole.
     */
     std::tuple<std::vector<float>, std::shared_ptr<ML::Mutable_Feature_Set>, Date>
-    getFeatureSet(const ExpressionValue & context, bool returnDense) const;
+    getFeatureSet(const Itl & model,
+                  const ExpressionValue & context, bool returnDense) const;
 
     //Classifier classifier;
     ClassifyFunctionConfig functionConfig;
 
-    struct Itl;
-    std::shared_ptr<Itl> itl;
-
-    bool isRegression;
+private:
+    /// Current model, protected by RCU so that it can be swapped
+    struct Current;
+    std::unique_ptr<Current> current;
 };
 
 /*****************************************************************************/
@@ -174,8 +228,16 @@ struct ExplainFunction: public ClassifyFunction {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
-    /** Describe what the input and output is for this function. */
-    virtual FunctionInfo getFunctionInfo() const;
+    /** Explanations are done one at a time. */
+    virtual void applyBatch(const FunctionApplier & applier,
+                            const ExpressionValue * inputs,
+                            ExpressionValue * outputs,
+                            size_t n) const;
+
+    /** Describe what the input and output is for this function, which
+        doesn't depend upon the model.
+    */
+    virtual FunctionInfo getModelInfo(const Itl & model) const;
 };
 
 
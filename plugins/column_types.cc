@@ -9,6 +9,7 @@
 #include "mldb/sql/cell_value.h"
 #include "mldb/sql/expression_value.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/jml/db/persistent.h"
 
 
 
@@ -156,5 +157,30 @@ getExpressionValueInfo() const
     }
 }
 
+void
+ColumnTypes::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << (char)1 // version
+          << numNulls << numZeros << numIntegers
+          << minNegativeInteger << maxNegativeInteger
+          << minPositiveInteger << maxPositiveInteger
+          << numReals << numStrings << numBlobs << numTimestamps << numOther;
+}
+
+void
+ColumnTypes::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    char version;
+    store >> version;
+    if (version != 1)
+        throw MLDB::Exception("Unknown ColumnTypes serialization version");
+    store >> numNulls >> numZeros >> numIntegers
+          >> minNegativeInteger >> maxNegativeInteger
+          >> minPositiveInteger >> maxPositiveInteger
+          >> numReals >> numStrings >> numBlobs >> numTimestamps >> numOther;
+}
+
 } // namespace MLDB
 
@@ -10,6 +10,7 @@
 
 #include <memory>
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/jml/db/persistent_fwd.h"
 #include <limits>
 
 
@@ -38,6 +39,9 @@ struct ColumnTypes {
     std::shared_ptr<ExpressionValueInfo>
     getExpressionValueInfo() const;
 
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
     uint64_t numNulls = 0;
     uint64_t numZeros = 0;
     
@@ -94,6 +98,12 @@ struct ColumnTypes {
             && numStrings == 0 && numBlobs == 0 && numOther == 0;
     }
 
+    bool onlyStringsAndNulls() const
+    {
+        return numReals == 0 && numIntegers == 0 && numBlobs == 0
+            && numTimestamps == 0 && numOther == 0;
+    }
+
     uint64_t numReals = 0;
     uint64_t numStrings = 0;
     uint64_t numBlobs = 0;
@@ -22,6 +22,7 @@
 #include "mldb/server/mldb_server.h"
 #include "mldb/builtin/merged_dataset.h"
 #include "mldb/utils/log.h"
+#include <deque>
 
 
 using namespace std;
@@ -35,6 +36,12 @@ namespace MLDB {
 /* CONTINUOUS DATASET CONFIG                                                 */
 /*****************************************************************************/
 
+ContinuousDatasetConfig::
+ContinuousDatasetConfig()
+    : memorySegments(16)
+{
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(ContinuousDatasetConfig);
 
 ContinuousDatasetConfigDescription::
@@ -48,6 +55,16 @@ ContinuousDatasetConfigDescription()
              "Procedure that will save a storage dataset returning metadata");
     addField("commitInterval", &ContinuousDatasetConfig::commitInterval,
              "Interval between auto-commit operations");
+    addField("memorySegments", &ContinuousDatasetConfig::memorySegments,
+             "Number of the most recently saved datasets to keep in memory, "
+             "so that `continuous.window` datasets over recent data can use "
+             "them without loading the saved files.  Zero keeps none.",
+             16);
+    addField("memoryRetention", &ContinuousDatasetConfig::memoryRetention,
+             "Saved datasets whose latest timestamp is further than this "
+             "behind that of the latest saved dataset are no longer kept "
+             "in memory.  The default of zero keeps them until there are "
+             "more than `memorySegments` of them.");
 }
 
 
@@ -58,6 +75,8 @@ ContinuousDatasetConfigDescription()
 struct ContinuousDataset::Itl {
     Itl(MldbServer * server, const ContinuousDatasetConfig & config)
         : server(server),
+          memorySegments(config.memorySegments),
+          memoryRetention(config.memoryRetention.interval),
           current(gcLock),
           lastCommit(Date::now().secondsSinceEpoch()),
           logger(MLDB::getMldbLog<ContinuousWindowDataset>())
@@ -123,6 +142,61 @@ struct ContinuousDataset::Itl {
     std::shared_ptr<Procedure> createStorageDataset;
     std::shared_ptr<Procedure> saveStorageDataset;
 
+    /// A saved dataset that is still held in memory
+    struct Segment {
+        RowPath rowName;                   ///< Row in the metadata dataset
+        Date earliest;                     ///< Earliest timestamp in it
+        Date latest;                       ///< Latest timestamp in it
+        std::shared_ptr<Dataset> dataset;  ///< Dataset itself
+    };
+
+    int memorySegments;
+    double memoryRetention;
+
+    /// Ring of the most recently saved datasets, oldest first
+    std::deque<Segment> segments;
+    mutable std::mutex segmentsMutex;
+
+    /** Add a newly saved dataset to the ring, and expire the ones that are
+        too many or too old.
+    */
+    void addSegment(Segment segment)
+    {
+        std::unique_lock<std::mutex> guard(segmentsMutex);
+
+        if (memorySegments <= 0)
+            return;
+
+        segments.emplace_back(std::move(segment));
+        while (segments.size() > (size_t)memorySegments)
+            segments.pop_front();
+
+        if (memoryRetention > 0) {
+            Date newest = Date::negativeInfinity();
+            for (auto & s: segments)
+                newest = std::max(newest, s.latest);
+            Date expiry = newest.plusSeconds(-memoryRetention);
+            segments.erase(std::remove_if(segments.begin(), segments.end(),
+                                          [&] (const Segment & s)
+                                          {
+                                              return s.latest < expiry;
+                                          }),
+                           segments.end());
+        }
+    }
+
+    std::map<RowPath, std::shared_ptr<Dataset> >
+    getSegmentsInMemory(Date from, Date to) const
+    {
+        std::unique_lock<std::mutex> guard(segmentsMutex);
+        std::map<RowPath, std::shared_ptr<Dataset> > result;
+        for (auto & s: segments) {
+            if (s.earliest <= to && s.latest >= from)
+                result[s.rowName] = s.dataset;
+        }
+        return result;
+    }
+
     void initRoutes()
     {
 #if 0
@@ -279,6 +353,8 @@ struct ContinuousDataset::Itl {
 
         metadataDataset->recordRow(rowName, metadata);
 
+        addSegment({ rowName, earliest, latest, savedDataset });
+
         datasetWatches.trigger(savedDataset);
 
         // We now know that everything is committed up to lastCommit.
@@ -384,7 +460,8 @@ void
 ContinuousDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    Dataset::commit();
 }
     
 std::pair<Date, Date>
@@ -431,6 +508,13 @@ handleRequest(RestConnection & connection,
     return itl->handleRequest(connection, request, context);
 }
 
+std::map<RowPath, std::shared_ptr<Dataset> >
+ContinuousDataset::
+getSegmentsInMemory(Date from, Date to) const
+{
+    return itl->getSegmentsInMemory(from, to);
+}
+
 static RegisterDatasetType<ContinuousDataset, ContinuousDatasetConfig>
 regContinuous(builtinPackage(),
               "continuous",
@@ -465,6 +549,11 @@ ContinuousWindowDatasetConfigDescription()
     addField("datasetFilter", &ContinuousWindowDatasetConfig::datasetFilter,
              "Filter to apply to dataset metadata when choosing datasets",
              SqlExpression::parse("true"));
+    addField("continuousDataset",
+             &ContinuousWindowDatasetConfig::continuousDataset,
+             "The `continuous` dataset recording into the metadata dataset. "
+             "If given, the datasets that it still holds in memory are used "
+             "directly instead of being loaded from their saved files.");
 }
 
 
@@ -490,11 +579,11 @@ reconstituteConfig(MatrixNamedRow row)
     return jsonDecode<PolyConfigT<const Dataset> >(current);
 }
 
-PolyConfigT<const Dataset>
+std::vector<MatrixNamedRow>
 ContinuousWindowDataset::
-getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
-                 Date from,
-                 Date to)
+queryMetadata(std::shared_ptr<SqlExpression> datasetsWhere,
+              Date from,
+              Date to)
 {
     // Construct a query that gets us our datasets from from and to
     // This is earliest <= to and latest >= from
@@ -504,8 +593,7 @@ getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
         + "AND latest >= CAST ('" + CellValue(from).toString() + "' AS TIMESTAMP)";
     
     // Query our metadata dataset for the datasets to load up
-    auto datasets
-        = metadataDataset
+    return metadataDataset
         ->queryStructured(SelectExpression::STAR,
                           WhenExpression::TRUE /* when */,
                           *SqlExpression::parse(where) /* where */,
@@ -516,6 +604,15 @@ getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
                           0 /* offset */,
                           -1 /* limit */,
                           "" /* alias */);
+}
+
+PolyConfigT<const Dataset>
+ContinuousWindowDataset::
+getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
+                 Date from,
+                 Date to)
+{
+    auto datasets = queryMetadata(datasetsWhere, from, to);
 
     // TODO:
     // 1.  Use from and to
@@ -534,6 +631,33 @@ getDatasetConfig(std::shared_ptr<SqlExpression> datasetsWhere,
     return result;
 }
 
+std::vector<std::shared_ptr<Dataset> >
+ContinuousWindowDataset::
+getDatasets(std::shared_ptr<SqlExpression> datasetsWhere,
+            Date from,
+            Date to,
+            const ContinuousDataset & continuous)
+{
+    // The metadata still says which datasets are in the window, since
+    // other recorders or earlier runs may have saved datasets into it;
+    // only the loading is skipped for those in memory.
+    auto inMemory = continuous.getSegmentsInMemory(from, to);
+    auto rows = queryMetadata(datasetsWhere, from, to);
+
+    std::vector<std::shared_ptr<Dataset> > result;
+    result.reserve(rows.size());
+
+    for (auto & row: rows) {
+        auto it = inMemory.find(row.rowName);
+        if (it != inMemory.end())
+            result.emplace_back(it->second);
+        else result.emplace_back
+                 (obtainDataset(server, reconstituteConfig(std::move(row))));
+    }
+
+    return result;
+}
+
 ContinuousWindowDataset::
 ContinuousWindowDataset(MldbServer * owner,
                         PolyConfig config_,
@@ -552,6 +676,29 @@ ContinuousWindowDataset(MldbServer * owner,
                              "continuousDatasetConfig", config);
     }
 
+    if (!config.continuousDataset.id.empty()
+        || !config.continuousDataset.type.empty()) {
+        try {
+            // Merge the datasets directly, taking those in memory from the
+            // continuous dataset
+            auto recorder = std::dynamic_pointer_cast<const ContinuousDataset>
+                (obtainDataset(server, config.continuousDataset));
+            if (!recorder)
+                throw HttpReturnException
+                    (400, "continuousDataset must be a continuous dataset");
+
+            auto datasets = getDatasets(config.datasetFilter, config.from,
+                                        config.to, *recorder);
+            setUnderlying(std::make_shared<MergedDataset>(server, datasets));
+        } MLDB_CATCH_ALL {
+            rethrowHttpException(-1, "Error initializing continuous window "
+                                 "dataset from in-memory datasets: "
+                                 + getExceptionString(),
+                                 "continuousDatasetConfig", config);
+        }
+        return;
+    }
+
     PolyConfigT<const Dataset> toLoadConfig;
 
     try {
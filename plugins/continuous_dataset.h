@@ -26,10 +26,14 @@ namespace MLDB {
 /*****************************************************************************/
 
 struct ContinuousDatasetConfig {
+    ContinuousDatasetConfig();
+
     PolyConfigT<Dataset> metadataDataset;          ///< Dataset for metadata storage
     PolyConfigT<Procedure> createStorageDataset;   ///< Create a storage dataset
     PolyConfigT<Procedure> saveStorageDataset;     ///< Save a storage dataset
     TimePeriod commitInterval;                     ///< Frequency for auto-commit
+    int memorySegments;                            ///< Saved datasets kept in memory
+    TimePeriod memoryRetention;                    ///< How long they are kept
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ContinuousDatasetConfig);
@@ -73,6 +77,14 @@ struct ContinuousDataset: public Dataset {
                   const RestRequest & request,
                   RestRequestParsingContext & context) const;
 
+    /** Return the saved datasets that are still held in memory and have
+        data between from and to, indexed by the row name they have in the
+        metadata dataset.  Once saved they are never modified again, so
+        they can be used directly in place of loading the saved files.
+    */
+    std::map<RowPath, std::shared_ptr<Dataset> >
+    getSegmentsInMemory(Date from, Date to) const;
+
 private:
     ContinuousDatasetConfig datasetConfig;
     struct Itl;
@@ -91,6 +103,7 @@ struct ContinuousWindowDatasetConfig {
     Date from;                         ///< Earliest data point to use
     Date to;                           ///< Latest data point to use
     std::shared_ptr<SqlExpression> datasetFilter;  ///< Filter for datasets
+    PolyConfigT<const Dataset> continuousDataset;  ///< Recorder, if in memory
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ContinuousWindowDatasetConfig);
@@ -115,6 +128,22 @@ struct ContinuousWindowDataset: public ForwardedDataset {
     getDatasetConfig(std::shared_ptr<SqlExpression> datasetFilter,
                      Date earliest,
                      Date latest);
+
+    /** Return the datasets to merge for the window, taking the ones that
+        the continuous dataset still holds in memory from there instead of
+        loading them.
+    */
+    std::vector<std::shared_ptr<Dataset> >
+    getDatasets(std::shared_ptr<SqlExpression> datasetFilter,
+                Date earliest,
+                Date latest,
+                const ContinuousDataset & continuous);
+
+private:
+    std::vector<MatrixNamedRow>
+    queryMetadata(std::shared_ptr<SqlExpression> datasetFilter,
+                  Date earliest,
+                  Date latest);
 };
 
 
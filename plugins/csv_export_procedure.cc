@@ -23,7 +23,11 @@
 #include "mldb/vfs/filter_streams.h"
 #include "csv_writer.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/jml/utils/string_functions.h"
 #include <memory>
+#include <mutex>
+#include <sstream>
 
 using namespace std;
 
@@ -61,6 +65,19 @@ CsvExportProcedureConfigDescription()
              "    [Built-in Functions](../sql/ValueExpression.md.html) documentation for the\n"
              "    complete list of aggregators.\n\n",
              false);
+    addField("ordered", &CsvExportProcedureConfig::ordered,
+             "If true, the rows are written in the order that the query "
+             "produces them, which is given by its `ORDER BY` clause.  If "
+             "false, rows are written as soon as they're formatted, in no "
+             "particular order, which is faster and uses less memory.", true);
+    addField("numFiles", &CsvExportProcedureConfig::numFiles,
+             "Number of files to write the rows to, so that they can be "
+             "compressed and written in parallel.  If more than 1, the "
+             "`dataFileUrl` must contain `$part`, which is replaced by the "
+             "number of each file starting at 1 and padded to 5 digits, for "
+             "example `file://export/part-$part.csv.gz`.  Each file has its "
+             "own header line.  With `ordered` set, consecutive blocks of "
+             "rows go to each file in turn.", 1);
 
     addParent<ProcedureConfig>();
 
@@ -73,6 +90,14 @@ CsvExportProcedureConfigDescription()
         if (cfg->quoteChar.size() != 1) {
             throw MLDB::Exception("Quotechar must be 1 char long.");
         }
+        if (cfg->numFiles < 1) {
+            throw MLDB::Exception("numFiles must be at least 1.");
+        }
+        if (cfg->numFiles > 1
+            && cfg->dataFileUrl.toString().find("$part") == std::string::npos) {
+            throw MLDB::Exception("dataFileUrl must contain $part when "
+                                  "numFiles is more than 1.");
+        }
         MustContainFrom()(cfg->exportData, CsvExportProcedureConfig::name);
     };
 }
@@ -86,6 +111,120 @@ CsvExportProcedure(MldbServer * owner,
     procedureConfig = config.params.convert<CsvExportProcedureConfig>();
 }
 
+namespace {
+
+/** Write the cells of the row to the CSV writer in the order of the
+    columnNames, followed by the end of the line.  The lineBuffer keeps
+    the values that cannot be output yet due to the ordering difference
+    between columnNames and the order in which columns are in the row; it
+    is reused from one row to the next.
+*/
+void
+writeCsvRow(CsvWriter & csv,
+            MatrixNamedRow & row,
+            const std::vector<ColumnPath> & columnNames,
+            std::vector<std::string> & lineBuffer,
+            bool skipDuplicateCells)
+{
+    const auto lineSize = columnNames.size();
+    lineBuffer.resize(lineSize);
+    const auto columnNamesEnd = columnNames.end();
+    const auto columnNamesBegin = columnNames.begin();
+
+    size_t lineBufferIndex = 0; // position of the buffered value ready to
+                                // be outputed
+
+    auto outputLineBuffer = [&] () {
+        // inline function to make sure the index is set to "" after each
+        // use
+        csv << lineBuffer[lineBufferIndex];
+        lineBuffer[lineBufferIndex] = "";
+    };
+
+    for (const auto & col: row.columns) {
+        const auto & seekColumn = std::get<0>(col); // the column to seek in
+                                                  // the csv ordering
+        auto columnNamesIt = columnNames.begin() + lineBufferIndex;
+        size_t columnIndex;
+
+        auto updatePointers = [&] () {
+            // Linear performance will hurt if there are many columns
+            for (; columnNamesIt == columnNamesEnd
+                     || *columnNamesIt != seekColumn; ++ columnNamesIt) {
+                // column must always be found, otherwise me should be in a
+                // context where cells have multiple values.
+                if (columnNamesIt == columnNamesEnd) {
+                    if(skipDuplicateCells)
+                        return false;
+
+                    throw MLDB::Exception(Utf8String("CSV export does not work over "
+                            "cells having multiple values, at row '" + row.rowName.toUtf8String() +
+                            "' for column '" + seekColumn.toUtf8String() + "'").utf8String());
+                }
+            }
+            columnIndex = columnNamesIt - columnNamesBegin;
+            return true;
+        };
+        if(!updatePointers())
+            continue;
+
+        if (columnIndex == lineBufferIndex) {
+            // immediate output
+            csv << std::get<1>(col).toUtf8String().rawString();
+            ++ lineBufferIndex;
+
+            // check if the buffer is filled on the next position and
+            // output it as long as it is
+            for (; lineBufferIndex < lineSize
+                   && lineBuffer[lineBufferIndex] != "";
+                 ++ lineBufferIndex)
+            {
+                outputLineBuffer();
+            }
+        }
+        else {
+            // store for later
+
+            if (lineBuffer[columnIndex] != "") {
+                // collision - Happens when a column is found both in an
+                // explicit statement and a star clause. Since they don't
+                // mingle, having a collision means we can output until the
+                // current columnIndex
+                for (; lineBufferIndex <= columnIndex
+                    && lineBuffer[lineBufferIndex] != "";
+                    ++ lineBufferIndex)
+                {
+                    outputLineBuffer();
+                }
+                // find the next index where to store, collision are not
+                // possible
+                ++ columnNamesIt;
+                if(!updatePointers())
+                    continue;
+            }
+            ExcAssert(lineBuffer[columnIndex] == "");
+            lineBuffer[columnIndex] =
+                std::get<1>(col).toUtf8String().rawString();
+        }
+    }
+
+    // output until the end of the buffer
+    for (; lineBufferIndex < lineSize; ++ lineBufferIndex) {
+        outputLineBuffer();
+    }
+    csv.endl();
+}
+
+/// Number of rows formatted together into a single buffer when the output
+/// is ordered.  Each of these blocks goes to a single file.
+constexpr size_t MORSEL_ROWS = 1024;
+
+/// Size at which the buffer of a thread is written out, when the output is
+/// not ordered
+constexpr size_t UNORDERED_FLUSH_BYTES = 1024 * 1024;
+
+} // file scope
+
 RunOutput
 CsvExportProcedure::
 run(const ProcedureRunConfig & run,
@@ -93,9 +232,25 @@ run(const ProcedureRunConfig & run,
 {
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
     SqlExpressionMldbScope context(server);
-    filter_ostream out(runProcConf.dataFileUrl);
-    CsvWriter csv(out, runProcConf.delimiter.at(0),
-                  runProcConf.quoteChar.at(0));
+
+    const char delimiter = runProcConf.delimiter.at(0);
+    const char quoteChar = runProcConf.quoteChar.at(0);
+    const size_t numFiles = runProcConf.numFiles;
+
+    // One stream per file; each is only written to by one thread at a
+    // time, which means that compression happens in parallel over files
+    std::vector<std::unique_ptr<filter_ostream> > outputs;
+    if (numFiles == 1) {
+        outputs.emplace_back(new filter_ostream(runProcConf.dataFileUrl));
+    }
+    else {
+        for (size_t i = 0;  i < numFiles;  ++i) {
+            string url = runProcConf.dataFileUrl.toString();
+            ML::replace_all(url, "$part", MLDB::format("%05zd", i + 1));
+            outputs.emplace_back(new filter_ostream(Url(url)));
+        }
+    }
+    std::vector<std::mutex> outputMutexes(numFiles);
 
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.exportData.stm->from->bind(context, convertProgressToJson);
@@ -111,114 +266,129 @@ run(const ProcedureRunConfig & run,
 
     const auto columnNames = bsq.getSelectOutputInfo()->allAtomNames();
 
-    vector<string> lineBuffer; // keeps the data that cannot be outputed
-                               // yet to the csv due to the ordering difference
-                               // between columnNames and the order in which
-                               // columns are in the bound select query execute
-    const auto lineSize = columnNames.size();
-    lineBuffer.resize(columnNames.size());
-    const auto columnNamesEnd = columnNames.end();
-    const auto columnNamesBegin = columnNames.begin();
-    auto outputCsvLine = [&] (NamedRowValue & row_,
-                              const vector<ExpressionValue> & calc)
-    {
-        MatrixNamedRow row = row_.flattenDestructive();
-        ExcAssert(lineBuffer.size() == columnNames.size());
-        size_t lineBufferIndex = 0; // position of the buffered value ready to
-                                    // be outputed
-
-        auto outputLineBuffer = [&] () {
-            // inline function to make sure the index is set to "" after each
-            // use
-            csv << lineBuffer[lineBufferIndex];
-            lineBuffer[lineBufferIndex] = "";
-        };
+    if (runProcConf.headers) {
+        for (auto & out: outputs) {
+            CsvWriter csv(*out, delimiter, quoteChar);
+            for (const auto & name: columnNames) {
+                csv << name.toUtf8String();
+            }
+            csv.endl();
+        }
+    }
 
-        for (const auto & col: row.columns) {
-            const auto & seekColumn = std::get<0>(col); // the column to seek in
-                                                      // the csv ordering
-            auto columnNamesIt = columnNames.begin() + lineBufferIndex;
-            size_t columnIndex;
-
-            auto updatePointers = [&] () {
-                // Linear performance will hurt if there are many columns
-                for (; *columnNamesIt != seekColumn; ++ columnNamesIt) {
-                    // column must always be found, otherwise me should be in a
-                    // context where cells have multiple values.
-                    if (columnNamesIt == columnNamesEnd) {
-                        if(runProcConf.skipDuplicateCells)
-                            return false;
-
-                        throw MLDB::Exception(Utf8String("CSV export does not work over "
-                                "cells having multiple values, at row '" + row.rowName.toUtf8String() +
-                                "' for column '" + seekColumn.toUtf8String() + "'").utf8String());
-                    }
-                }
-                columnIndex = columnNamesIt - columnNamesBegin;
+    if (runProcConf.ordered) {
+        // The query is evaluated in parallel and gives us the rows in
+        // order.  We buffer enough of them to keep every thread busy
+        // formatting blocks of rows, then write the blocks in order, with
+        // each file being written by its own thread.
+        const size_t roundRows = MORSEL_ROWS * 4 * std::max<size_t>(numCpus(), numFiles);
+        std::vector<MatrixNamedRow> pending;
+        pending.reserve(roundRows);
+        size_t morselsDone = 0;
+
+        auto flush = [&] ()
+            {
+                size_t numMorsels = (pending.size() + MORSEL_ROWS - 1) / MORSEL_ROWS;
+                std::vector<std::string> text(numMorsels);
+
+                auto formatMorsel = [&] (size_t m)
+                    {
+                        std::ostringstream stream;
+                        CsvWriter csv(stream, delimiter, quoteChar);
+                        std::vector<std::string> lineBuffer;
+                        size_t end = std::min(pending.size(), (m + 1) * MORSEL_ROWS);
+                        for (size_t i = m * MORSEL_ROWS;  i < end;  ++i) {
+                            writeCsvRow(csv, pending[i], columnNames, lineBuffer,
+                                        runProcConf.skipDuplicateCells);
+                        }
+                        text[m] = stream.str();
+                    };
+
+                parallelMap(0, numMorsels, formatMorsel);
+                pending.clear();
+
+                auto writeFile = [&] (size_t f)
+                    {
+                        for (size_t m = 0;  m < numMorsels;  ++m) {
+                            if ((morselsDone + m) % numFiles == f)
+                                *outputs[f] << text[m];
+                        }
+                    };
+
+                if (numFiles == 1)
+                    writeFile(0);
+                else parallelMap(0, numFiles, writeFile);
+
+                morselsDone += numMorsels;
+            };
+
+        auto onRow = [&] (NamedRowValue & row_,
+                          const vector<ExpressionValue> & calc)
+            {
+                pending.emplace_back(row_.flattenDestructive());
+                if (pending.size() == roundRows)
+                    flush();
                 return true;
             };
-            if(!updatePointers())
-                continue;
-
-            if (columnIndex == lineBufferIndex) {
-                // immediate output
-                csv << std::get<1>(col).toUtf8String().rawString();
-                ++ lineBufferIndex;
-
-                // check if the buffer is filled on the next position and
-                // output it as long as it is
-                for (; lineBufferIndex < lineSize
-                       && lineBuffer[lineBufferIndex] != "";
-                     ++ lineBufferIndex)
-                {
-                    outputLineBuffer();
-                }
-            }
-            else {
-                // store for later
-
-                if (lineBuffer[columnIndex] != "") {
-                    // collision - Happens when a column is found both in an
-                    // explicit statement and a star clause. Since they don't
-                    // mingle, having a collision means we can output until the
-                    // current columnIndex
-                    for (; lineBufferIndex <= columnIndex
-                        && lineBuffer[lineBufferIndex] != "";
-                        ++ lineBufferIndex)
-                    {
-                        outputLineBuffer();
-                    }
-                    // find the next index where to store, collision are not
-                    // possible
-                    ++ columnNamesIt;
-                    if(!updatePointers())
-                        continue;
-                }
-                ExcAssert(lineBuffer[columnIndex] == "");
-                lineBuffer[columnIndex] =
-                    std::get<1>(col).toUtf8String().rawString();
+
+        bsq.execute({onRow, false/*processInParallel*/},
+                    runProcConf.exportData.stm->offset,
+                    runProcConf.exportData.stm->limit,
+                    convertProgressToJson);
+        flush();
+    }
+    else {
+        // Each thread formats rows into its own buffer, which is written
+        // to the next file when it gets big enough
+        struct ThreadOutput {
+            ThreadOutput(char delimiter, char quoteChar)
+                : csv(stream, delimiter, quoteChar)
+            {
             }
-        }
 
-        // output until the end of the buffer
-        for (; lineBufferIndex < lineSize; ++ lineBufferIndex) {
-            outputLineBuffer();
-        }
-        csv.endl();
-        return true;
-    };
+            std::ostringstream stream;
+            CsvWriter csv;
+            std::vector<std::string> lineBuffer;
+        };
 
-    if (runProcConf.headers) {
-        for (const auto & name: bsq.getSelectOutputInfo()->allAtomNames()) {
-            csv << name.toUtf8String();
-        }
-        csv.endl();
+        PerThreadAccumulator<ThreadOutput> threadOutputs
+            ([&] () { return new ThreadOutput(delimiter, quoteChar); });
+        std::atomic<size_t> numFlushes(0);
+
+        auto writeOut = [&] (ThreadOutput & thr)
+            {
+                std::string text = thr.stream.str();
+                thr.stream.str("");
+                if (text.empty())
+                    return;
+                size_t f = numFlushes++ % numFiles;
+                std::unique_lock<std::mutex> guard(outputMutexes[f]);
+                *outputs[f] << text;
+            };
+
+        auto onRow = [&] (NamedRowValue & row_,
+                          const vector<ExpressionValue> & calc)
+            {
+                MatrixNamedRow row = row_.flattenDestructive();
+                ThreadOutput & thr = threadOutputs.get();
+                writeCsvRow(thr.csv, row, columnNames, thr.lineBuffer,
+                            runProcConf.skipDuplicateCells);
+                if (thr.stream.tellp() >= (std::streamoff)UNORDERED_FLUSH_BYTES)
+                    writeOut(thr);
+                return true;
+            };
+
+        bsq.execute({onRow, true/*processInParallel*/},
+                    runProcConf.exportData.stm->offset,
+                    runProcConf.exportData.stm->limit,
+                    convertProgressToJson);
+
+        threadOutputs.forEach([&] (ThreadOutput * thr) { writeOut(*thr); });
     }
 
-    bsq.execute({outputCsvLine, false/*processInParallel*/},
-                runProcConf.exportData.stm->offset,
-                runProcConf.exportData.stm->limit,
-                convertProgressToJson);
+    for (auto & out: outputs)
+        out->close();
+
     RunOutput output;
     return output;
 }
@@ -16,7 +16,7 @@ namespace MLDB {
 struct CsvExportProcedureConfig : ProcedureConfig {
     CsvExportProcedureConfig()
         : headers(true), skipDuplicateCells(false),
-          delimiter(","), quoteChar("\"")
+          delimiter(","), quoteChar("\""), ordered(true), numFiles(1)
     {
     }
 
@@ -28,6 +28,14 @@ struct CsvExportProcedureConfig : ProcedureConfig {
     bool skipDuplicateCells;
     std::string delimiter;
     std::string quoteChar;
+
+    /// Write the rows in the order of the query.  If false, rows are
+    /// written in whatever order they're formatted in.
+    bool ordered;
+
+    /// Number of files to write the rows to.  If more than one, each
+    /// $part in the dataFileUrl is replaced by the number of the file.
+    int numFiles;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(CsvExportProcedureConfig);
@@ -55,12 +55,23 @@ DatasetFeatureSpace(std::shared_ptr<Dataset> dataset,
         filteredColumns.push_back(columnName);
     }
 
+    // The training columns are all bucketized in one go, so that the
+    // dataset can share the work between them.
+    std::vector<std::tuple<BucketList, BucketDescriptions> > allBuckets;
+    if (bucketize) {
+        allBuckets = dataset->getColumnIndex()
+            ->getColumnsBuckets(filteredColumns, 255 /* num buckets */);
+    }
+
     auto onColumn = [&] (int i)
         {
             const ColumnPath & columnName = filteredColumns[i];
             ColumnHash ch = columnName;
             int oldIndex = columnInfo[ch].index;
-            columnInfo[ch] = getColumnInfo(dataset, columnName, bucketize);
+            if (bucketize)
+                columnInfo[ch] = getBucketedColumnInfo
+                    (columnName, std::move(allBuckets[i]));
+            else columnInfo[ch] = getColumnInfo(dataset, columnName, false);
             columnInfo[ch].index = oldIndex;
             return true;
         };
@@ -123,56 +134,69 @@ getColumnInfo(std::shared_ptr<Dataset> dataset,
         }
     }
     else {
-        auto bucketsAndDescriptions
-            = dataset->getColumnIndex()
-            ->getColumnBuckets(columnName, 255 /* num buckets */);
+        result = getBucketedColumnInfo
+            (columnName,
+             dataset->getColumnIndex()
+             ->getColumnBuckets(columnName, 255 /* num buckets */));
+    }
 
-        BucketList & buckets = std::get<0>(bucketsAndDescriptions);
-        BucketDescriptions & descriptions = std::get<1>(bucketsAndDescriptions);
+    return result;
+}
 
-        if (descriptions.numeric.active) {
-            result.info = ML::REAL;
-            // TODO: if we have both numbers and strings, we probably do need
-            // to support it in the long term.
-            if (!descriptions.strings.buckets.empty()) {
-                std::vector<Utf8String> stringValues;
-                if (descriptions.strings.buckets.size() > 100) {
-                    stringValues.insert(stringValues.end(),
-                                        descriptions.strings.buckets.begin(),
-                                        descriptions.strings.buckets.begin() + 100);
-                }
-                else stringValues = std::move(descriptions.strings.buckets);
-
-                throw HttpReturnException
-                    (400, "This classifier can't train on column "
-                     + columnName.toUtf8String() + " which has both string "
-                     + " and numeric values.  Consider using \nCAST ("
-                     + columnName.toUtf8String() + " AS STRING)\nor splitting "
-                     + "into two columns, one numeric-or-null and one "
-                     + "string-or-null, eg\nCASE WHEN " + columnName.toUtf8String() + " IS NUMBER THEN " + columnName.toUtf8String() + " ELSE NULL END AS "
-                     + columnName.toUtf8String() + "_numeric, CASE WHEN " + columnName.toUtf8String() + " IS STRING THEN " + columnName.toUtf8String() + " ELSE NULL END AS "
-                     + columnName.toUtf8String() + "_string",
-                     "stringValues", stringValues);
+//static
+DatasetFeatureSpace::ColumnInfo
+DatasetFeatureSpace::
+getBucketedColumnInfo(const ColumnPath & columnName,
+                      std::tuple<BucketList, BucketDescriptions>
+                          bucketsAndDescriptions)
+{
+    ColumnInfo result;
+    result.columnName = columnName;
+
+    BucketList & buckets = std::get<0>(bucketsAndDescriptions);
+    BucketDescriptions & descriptions = std::get<1>(bucketsAndDescriptions);
+
+    if (descriptions.numeric.active) {
+        result.info = ML::REAL;
+        // TODO: if we have both numbers and strings, we probably do need
+        // to support it in the long term.
+        if (!descriptions.strings.buckets.empty()) {
+            std::vector<Utf8String> stringValues;
+            if (descriptions.strings.buckets.size() > 100) {
+                stringValues.insert(stringValues.end(),
+                                    descriptions.strings.buckets.begin(),
+                                    descriptions.strings.buckets.begin() + 100);
             }
-            ExcAssert(descriptions.strings.buckets.empty());
+            else stringValues = std::move(descriptions.strings.buckets);
+
+            throw HttpReturnException
+                (400, "This classifier can't train on column "
+                 + columnName.toUtf8String() + " which has both string "
+                 + " and numeric values.  Consider using \nCAST ("
+                 + columnName.toUtf8String() + " AS STRING)\nor splitting "
+                 + "into two columns, one numeric-or-null and one "
+                 + "string-or-null, eg\nCASE WHEN " + columnName.toUtf8String() + " IS NUMBER THEN " + columnName.toUtf8String() + " ELSE NULL END AS "
+                 + columnName.toUtf8String() + "_numeric, CASE WHEN " + columnName.toUtf8String() + " IS STRING THEN " + columnName.toUtf8String() + " ELSE NULL END AS "
+                 + columnName.toUtf8String() + "_string",
+                 "stringValues", stringValues);
         }
-        else if (!descriptions.strings.buckets.empty()) {
-            std::vector<std::string> categories;
-            categories.reserve(descriptions.strings.buckets.size());
-            for (auto & s: descriptions.strings.buckets) {
-                categories.emplace_back(s.rawString());
-            }
-            auto categorical
-                = std::make_shared<ML::Fixed_Categorical_Info>(std::move(categories));
-            result.info = ML::Feature_Info(categorical);
+        ExcAssert(descriptions.strings.buckets.empty());
+    }
+    else if (!descriptions.strings.buckets.empty()) {
+        std::vector<std::string> categories;
+        categories.reserve(descriptions.strings.buckets.size());
+        for (auto & s: descriptions.strings.buckets) {
+            categories.emplace_back(s.rawString());
         }
-
-        result.distinctValues = descriptions.numBuckets();
-        result.buckets = std::move(buckets);
-        result.bucketDescriptions = std::move(descriptions);
-
+        auto categorical
+            = std::make_shared<ML::Fixed_Categorical_Info>(std::move(categories));
+        result.info = ML::Feature_Info(categorical);
     }
 
+    result.distinctValues = descriptions.numBuckets();
+    result.buckets = std::move(buckets);
+    result.bucketDescriptions = std::move(descriptions);
+
     return result;
 }
 
@@ -72,6 +72,11 @@ struct DatasetFeatureSpace: public ML::Feature_Space {
                                     const ColumnPath & columnName,
                                     bool bucketize);
 
+    /// Column info for a column from its buckets, as with bucketize
+    static ColumnInfo
+    getBucketedColumnInfo(const ColumnPath & columnName,
+                          std::tuple<BucketList, BucketDescriptions> buckets);
+
     std::unordered_map<ColumnHash, ColumnInfo> columnInfo;
 
     /// Mapping from the first two 32 bit values of a feature to
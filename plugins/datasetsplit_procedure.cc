@@ -19,6 +19,7 @@
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
 #include "mldb/server/bound_queries.h"
+#include "mldb/base/parallel.h"
 #include <random>
 
 using namespace std;
@@ -26,6 +27,25 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/** Hash of the row name mixed with the seed, which decides the order in
+    which the rows are distributed.  This uses the splitmix64 finalizer so
+    that different seeds give unrelated orders.
+*/
+uint64_t splitHash(const RowPath & rowPath, uint64_t seed)
+{
+    uint64_t h = rowPath.hash() ^ (seed * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+} // file scope
+
 /*****************************************************************************/
 /* DATASET SPLIT PROCEDURE CONFIG                                            */
 /*****************************************************************************/
@@ -49,6 +69,12 @@ SplitProcedureConfigDescription()
              "Importance of respecting the splits versus the distribution of the labels."
              "0 will optimize the distribution of the labels only, while 1.0 will weight them equally.",
              1.0f);    
+    addField("seed", &SplitProcedureConfig::seed,
+             "If set, the rows are distributed in the order of a hash of their "
+             "name and this seed, instead of an order that depends on the "
+             "order in which the rows were selected.  This makes the split "
+             "of a row depend only upon the rows that are present, so that "
+             "it can be reproduced from the same rows in any dataset.");
     addParent<ProcedureConfig>();
 }
 
@@ -136,9 +162,23 @@ run(const ProcedureRunConfig & run,
                  runProcConf.labels.stm->limit,
                  nullptr /* progress */);
 
-    //Shuffle to prevent any aliasing effect
-    std::minstd_rand rng;
-    std::shuffle(rowPaths.begin(), rowPaths.end(), rng);
+    if (runProcConf.seed) {
+        //Order by a hash of the row name and the seed, so that the split
+        //doesn't depend on the order in which the rows are selected
+        uint64_t seed = *runProcConf.seed;
+        std::vector<std::pair<uint64_t, RowPath> > hashed;
+        hashed.reserve(rowPaths.size());
+        for (auto & rowPath: rowPaths)
+            hashed.emplace_back(splitHash(rowPath, seed), std::move(rowPath));
+        std::sort(hashed.begin(), hashed.end());
+        for (size_t i = 0;  i < hashed.size();  ++i)
+            rowPaths[i] = std::move(hashed[i].second);
+    }
+    else {
+        //Shuffle to prevent any aliasing effect
+        std::minstd_rand rng;
+        std::shuffle(rowPaths.begin(), rowPaths.end(), rng);
+    }
 
     size_t numFolds = runProcConf.splits.size();
     std::vector<size_t> distributions(numFolds); //Rows per Fold
@@ -147,13 +187,35 @@ run(const ProcedureRunConfig & run,
     SqlExpressionDatasetScope datasetScope(boundDataset.dataset, boundDataset.asName);
     BoundSqlExpression boundSelect = runProcConf.labels.stm->select.bind(datasetScope);
 
-    //Distribute the rows using a greedy approach.
-    ExpressionValue storage;
+    //Read each row and find its labels in parallel.  The rows are kept
+    //so that they can be recorded once the fold is known.
+    std::vector<MatrixNamedRow> rows(rowPaths.size());
+    std::vector<std::vector<PathElement> > rowLabels(rowPaths.size());
+    auto matrix = boundDataset.dataset->getMatrixView();
+
+    auto getLabels = [&] (size_t i)
+        {
+            rows[i] = matrix->getRow(rowPaths[i]);
+            auto rowScope = datasetScope.getRowScope(rows[i]);
+            ExpressionValue storage;
+            const ExpressionValue & rowValue
+                = boundSelect(rowScope, storage, GET_ALL);
+            auto onColumn = [&] (const PathElement & columnName,
+                                 const ExpressionValue & val)
+                {
+                    rowLabels[i].push_back(columnName);
+                    return true;
+                };
+            rowValue.forEachColumn(onColumn);
+        };
+
+    parallelMap(0, rowPaths.size(), getLabels);
+
+    //Distribute the rows using a greedy approach.  This needs to see the
+    //rows one by one in order, but it only looks at the labels.
+    std::vector<size_t> rowFolds(rowPaths.size());
     size_t numRowsAdded = 0;
-    for (const auto& rowPath : rowPaths) {
-        MatrixNamedRow row = boundDataset.dataset->getMatrixView()->getRow(rowPath);
-        auto rowScope = datasetScope.getRowScope(row);
-        auto rowValue = boundSelect(rowScope, storage, GET_ALL);
+    for (size_t r = 0;  r < rowPaths.size();  ++r) {
         size_t bestFold = 0;
         float diff = 0.f;
         bool unknown = false;
@@ -170,8 +232,7 @@ run(const ProcedureRunConfig & run,
         }
 
         //check the best fold according to label distribution
-        auto onColumn = [&] (const PathElement & columnName,
-                             const ExpressionValue & val) {
+        auto onLabel = [&] (const PathElement & columnName) {
             auto it = sums.find(columnName);
             if (it == sums.end()) {
                 //first time we see this label, put the row in fold 0
@@ -191,7 +252,7 @@ run(const ProcedureRunConfig & run,
                         //This fold does not have the label, give it
                         bestFold = i;
                         unknown = true;
-                        return true;
+                        return;
                     }
                     else {
                         labelSum += v;
@@ -220,29 +281,59 @@ run(const ProcedureRunConfig & run,
                     bestFold = worstFold;
                 }
             }
-
-            return true;
         };
         //find the best fold
-        rowValue.forEachColumn(onColumn);
+        for (auto & label: rowLabels[r])
+            onLabel(label);
 
         //update distributions
-        auto updateDistribution = [&] (const PathElement & columnName,
-                             const ExpressionValue & val) {
-            auto it = sums.find(columnName);
+        for (auto & label: rowLabels[r]) {
+            auto it = sums.find(label);
             ExcAssert(it != sums.end());
             it->second[bestFold]++;
-            return true;
-        };
+        }
 
-        rowValue.forEachColumn(updateDistribution);
         distributions[bestFold]++;
-        datasets[bestFold]->recordRow(rowPath, row.columns);
+        rowFolds[r] = bestFold;
         numRowsAdded++;
     }
 
-    for (auto& outputDataset : datasets)
-        outputDataset->commit();
+    rowLabels.clear();
+
+    //Record the rows of each fold in parallel, one chunk per block of rows
+    typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+    static constexpr size_t CHUNK_ROWS = 1024;
+
+    for (size_t f = 0;  f < numFolds;  ++f) {
+        std::vector<size_t> foldRows;
+        foldRows.reserve(distributions[f]);
+        for (size_t r = 0;  r < rowFolds.size();  ++r) {
+            if (rowFolds[r] == f)
+                foldRows.push_back(r);
+        }
+
+        Dataset::MultiChunkRecorder recorder = datasets[f]->getChunkRecorder();
+
+        auto recordChunk = [&] (size_t chunk)
+            {
+                size_t first = chunk * CHUNK_ROWS;
+                size_t last = std::min(first + CHUNK_ROWS, foldRows.size());
+                Rows toRecord;
+                toRecord.reserve(last - first);
+                for (size_t i = first;  i < last;  ++i) {
+                    size_t r = foldRows[i];
+                    toRecord.emplace_back(std::move(rowPaths[r]),
+                                          std::move(rows[r].columns));
+                }
+                auto chunkRecorder = recorder.newChunk(chunk);
+                chunkRecorder->recordRowsDestructive(std::move(toRecord));
+                chunkRecorder->finishedChunk();
+            };
+
+        parallelMap(0, (foldRows.size() + CHUNK_ROWS - 1) / CHUNK_ROWS,
+                    recordChunk);
+        recorder.commit();
+    }
 
     Json::Value results;
     std::vector<Utf8String> incompleteLabels;
@@ -9,6 +9,7 @@
 #include "server/mldb_server.h"
 #include "mldb/core/procedure.h"
 #include "sql/sql_expression.h"
+#include "mldb/types/optional.h"
 
 
 namespace MLDB {
@@ -31,6 +32,7 @@ struct SplitProcedureConfig : public ProcedureConfig {
     std::vector<PolyConfigT<Dataset>> outputDatasets;
     std::vector<float> splits;
     float foldImportance = 1.0f;
+    Optional<unsigned> seed;
 
 };
 
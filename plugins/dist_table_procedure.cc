@@ -29,6 +29,7 @@
 #include "mldb/plugins/sql_config_validator.h"
 #include "mldb/base/parallel.h"
 #include "mldb/utils/log.h"
+#include "rolling_tables.h"
 
 
 using namespace std;
@@ -376,6 +377,103 @@ run(const ProcedureRunConfig & run,
 
     const int nbOutcomes = runProcConf.outcomes.size();
 
+    // Tables by index, and the names of the output columns of each for
+    // the fixed columns mode
+    vector<DistTable *> tables;
+    vector<vector<ColumnPath> > tableColNames;
+    std::unordered_map<ColumnPath, size_t> tableIndexes;
+    for (auto & dt: distTablesMap) {
+        tableIndexes[dt.first] = tables.size();
+        tables.push_back(&dt.second);
+
+        vector<ColumnPath> names;
+        for (int i=0; i < nbOutcomes; ++i) {
+            for (DISTTABLE_STATISTICS sid : activeStats) {
+                names.emplace_back(PathElement(outcome_names[i]) + dt.first
+                                   + dtStatsNames[sid]);
+            }
+        }
+        tableColNames.emplace_back(std::move(names));
+    }
+
+    // The stats are updated in blocks of rows, with one thread per hash
+    // partition of the feature values
+    RollingTables<vector<DistTableStats> >
+        rollingTables(tables.size(), vector<DistTableStats>(nbOutcomes));
+
+    struct BlockCell {
+        size_t table;
+        size_t entry;   ///< Index of the occurrence in the block
+        Date ts;
+    };
+
+    struct BlockRow {
+        RowPath rowName;
+        vector<double> targets;
+        vector<BlockCell> cells;
+    };
+
+    static constexpr size_t ROWS_PER_BLOCK = 4096;
+    vector<BlockRow> blockRows;
+    vector<size_t> entryRows;      // row in the block of each occurrence
+    vector<Utf8String> entryKeys;  // bag of words mode: the word
+
+    auto processBlock = [&] ()
+        {
+            // Stats for each occurrence, before it is added
+            vector<vector<DistTableStats> > before;
+            if (output)
+                before.resize(entryRows.size());
+
+            rollingTables.processBlock
+                ([&] (size_t entry, vector<DistTableStats> & stats)
+                 {
+                     if (output)
+                         before[entry] = stats;
+                     const auto & targets = blockRows[entryRows[entry]].targets;
+                     for (int i=0; i < nbOutcomes; ++i)
+                         stats[i].increment(targets[i]);
+                 });
+
+            if (output) {
+                typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Columns;
+                vector<pair<RowPath, Columns> > outputRows(blockRows.size());
+
+                auto doRow = [&] (size_t r)
+                    {
+                        BlockRow & row = blockRows[r];
+                        Columns & output_cols = outputRows[r].second;
+                        outputRows[r].first = std::move(row.rowName);
+                        for (auto & cell: row.cells) {
+                            const auto & stats = before[cell.entry];
+                            size_t n = 0;
+                            for (int i=0; i < nbOutcomes; ++i) {
+                                for (DISTTABLE_STATISTICS sid : activeStats) {
+                                    ColumnPath colName
+                                        = runProcConf.mode == DT_MODE_BAG_OF_WORDS
+                                        ? PathElement(outcome_names[i])
+                                          + entryKeys[cell.entry]
+                                          + dtStatsNames[sid]
+                                        : tableColNames[cell.table][n];
+                                    output_cols.emplace_back(
+                                        std::move(colName),
+                                        CellValue(stats[i].getStat(sid)),
+                                        cell.ts);
+                                    ++n;
+                                }
+                            }
+                        }
+                    };
+
+                parallelMap(0, blockRows.size(), doRow);
+                output->recordRows(outputRows);
+            }
+
+            blockRows.clear();
+            entryRows.clear();
+            entryKeys.clear();
+        };
+
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
@@ -390,19 +488,19 @@ run(const ProcedureRunConfig & run,
                 INFO_MSG(logger) << message;
             }
 
+            blockRows.emplace_back();
+            BlockRow & blockRow = blockRows.back();
+            blockRow.rowName = row.rowName;
+
             // we parse in advance the value for each outcome
-            vector<double> targets(nbOutcomes);
+            blockRow.targets.resize(nbOutcomes);
             for (int i=0; i < nbOutcomes; i++) {
                 const CellValue & outcome = extraVals.at(i).getAtom();
-                targets[i] = outcome.toDouble();
+                blockRow.targets[i] = outcome.toDouble();
             }
 
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > output_cols;
-
             if (runProcConf.mode == DT_MODE_BAG_OF_WORDS) {
                 // there is only a single table
-                DistTable & distTable = distTablesMap.begin()->second;
-
                 for (const std::tuple<ColumnPath, CellValue, Date> & col :
                         row.columns) {
 
@@ -414,82 +512,41 @@ run(const ProcedureRunConfig & run,
                         continue;
 
                     // the feature value is in the column name
-                    const Utf8String & colName = get<0>(col).toUtf8String();
-                    const Date & ts = get<2>(col);
-
-                    if (output) {
-                        const auto & stats = distTable.getStats(colName);
-                        for (int i=0; i < nbOutcomes; ++i) {
-                            for (DISTTABLE_STATISTICS sid : activeStats) {
-                                output_cols.emplace_back(
-                                    PathElement(outcome_names[i])
-                                        + colName
-                                        + dtStatsNames[sid],
-                                    CellValue(stats[i].getStat(sid)),
-                                    ts);
-                            }
-                        }
-                    }
-
-                    distTable.increment(colName, targets);
+                    Utf8String colName = get<0>(col).toUtf8String();
+                    if (output)
+                        entryKeys.push_back(colName);
+                    size_t entry = rollingTables.add(0, std::move(colName));
+                    entryRows.push_back(blockRows.size() - 1);
+                    blockRow.cells.push_back({0, entry, get<2>(col)});
                 }
             }
             else if(runProcConf.mode == DT_MODE_FIXED_COLUMNS) {
 
-                map<ColumnPath, size_t> column_idx;
-                for (int i=0; i<row.columns.size(); i++) {
-                    column_idx.insert(make_pair(get<0>(row.columns[i]), i));
-                }
-
-                // for each of our feature column (or distribution table)
-                for (auto it = distTablesMap.begin(); it != distTablesMap.end(); it++) {
-                    const ColumnPath & featureColumnName = it->first;
-                    DistTable & distTable = it->second;
-
-                    // It seems that all the columns from the select will always
-                    // be here, even if NULL. If that is not the case, we will need
-                    // to treat this case separately and return (0,nan, nan, nan,
-                    // nan, nan) as statistics.
-                    auto col_ptr = column_idx.find(featureColumnName);
-                    if (col_ptr == column_idx.end()) {
-                        ExcAssert(false);
-                    }
-
-                    const tuple<ColumnPath, CellValue, Date> & col =
-                        row.columns[col_ptr->second];
-
-                    const Utf8String & featureValue = get<1>(col).toUtf8String();
-                    const Date & ts = get<2>(col);
-
-                    if(output) {
-                        // note current dist tables for output dataset
-                        // TODO we compute the column names everytime, maybe we should
-                        // cache them
-                        const auto & stats = distTable.getStats(featureValue);
-
-                        for (int i=0; i < nbOutcomes; ++i) {
-                            for(DISTTABLE_STATISTICS sid : activeStats) {
-                                output_cols.emplace_back(
-                                    PathElement(outcome_names[i]) + featureColumnName
-                                        + dtStatsNames[sid],
-                                    CellValue(stats[i].getStat(sid)),
-                                    ts);
-                            }
-                        }
-                    }
+                // It seems that all the columns from the select will always
+                // be here, even if NULL. If that is not the case, we will need
+                // to treat this case separately and return (0,nan, nan, nan,
+                // nan, nan) as statistics.
+                vector<bool> found(tables.size(), false);
+                for (auto & col: row.columns) {
+                    auto it = tableIndexes.find(get<0>(col));
+                    if (it == tableIndexes.end() || found[it->second])
+                        continue;
+                    size_t table = it->second;
+                    found[table] = true;
 
-                    // increment stats tables with current row
-                    distTable.increment(featureValue, targets);
+                    size_t entry = rollingTables.add(table, get<1>(col).toUtf8String());
+                    entryRows.push_back(blockRows.size() - 1);
+                    entryKeys.emplace_back();
+                    blockRow.cells.push_back({table, entry, get<2>(col)});
                 }
-
+                ExcAssertEqual(blockRow.cells.size(), tables.size());
             }
             else {
                 throw MLDB::Exception("Unknown distTable mode");
             }
 
-            if (output) {
-                output->recordRow(ColumnPath(row.rowName), std::move(output_cols));
-            }
+            if (blockRows.size() >= ROWS_PER_BLOCK)
+                processBlock();
 
             return true;
         };
@@ -511,6 +568,14 @@ run(const ProcedureRunConfig & run,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit);
 
+    processBlock();
+
+    rollingTables.finish([&] (size_t table,
+                              std::unordered_map<Utf8String, vector<DistTableStats> > && stats)
+                         {
+                             tables[table]->stats = std::move(stats);
+                         });
+
     if(output) {
         output->commit();
     }
@@ -95,6 +95,11 @@ EMConfigDescription()
              "Maximum number of iterations to perform.  If no convergance is "
              "reached within this number of iterations, the current clustering "
              "will be returned.", 100);
+    addField("diagonalCovariance", &EMConfig::diagonalCovariance,
+             "If true, each cluster only has a variance per dimension rather "
+             "than a full covariance matrix.  This is much faster to train "
+             "and needs fewer points in high dimensions, but the clusters "
+             "are then aligned with the axes.", false);
     addField("functionName", &EMConfig::functionName,
              "If specified, a function of this name will be created using "
              "the training result.");
@@ -173,7 +178,8 @@ run(const ProcedureRunConfig & run,
     int numIterations = emConfig.maxIterations;
 
     DEBUG_MSG(logger) << "EM training start";
-    em.train(vecs, inCluster, numClusters, numIterations, 0);
+    em.train(vecs, inCluster, numClusters, numIterations, 0,
+             runProcConf.diagonalCovariance);
     DEBUG_MSG(logger) << "EM training end";
 
     // Let the model know about its column names
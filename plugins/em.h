@@ -31,7 +31,8 @@ struct EMConfig : public ProcedureConfig  {
     EMConfig()
         : numInputDimensions(-1),
           numClusters(10),
-          maxIterations(100)
+          maxIterations(100),
+          diagonalCovariance(false)
     {
         centroids.withType("embedding");
     }
@@ -44,6 +45,7 @@ struct EMConfig : public ProcedureConfig  {
     int numInputDimensions;
     int numClusters;
     int maxIterations;
+    bool diagonalCovariance;
     Url modelFileUrl;
 
     Utf8String functionName;
@@ -8,11 +8,14 @@
 */
 
 #include "embedding.h"
+#include "hnsw_index.h"
+#include "ivf_index.h"
 #include "mldb/ml/tsne/vantage_point_tree.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/storage_allocator.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/tuple_description.h"
@@ -23,6 +26,7 @@
 #include "mldb/types/jml_serialization.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
 #include "mldb/arch/timers.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/server/bucket.h"
@@ -55,6 +59,49 @@ operator >> (ML::DB::Store_Reader & store, Path & coords);
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+EmbeddingIndexTypeDescription::
+EmbeddingIndexTypeDescription()
+{
+    addValue("vptree", EMBEDDING_INDEX_VPTREE,
+             "Vantage point tree.  This gives exact results, and is rebuilt "
+             "from scratch on each commit.  It works well for low "
+             "dimensional embeddings, but degrades to a brute force scan "
+             "for high dimensional ones.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Hierarchical Navigable Small World graph.  This gives "
+             "approximate results, but is much faster for large, high "
+             "dimensional embeddings.  Rows are added to the index as "
+             "they are recorded.");
+    addValue("ivf", EMBEDDING_INDEX_IVF,
+             "Inverted file index.  This gives approximate results.  The "
+             "rows are split into lists around centres chosen from the rows, "
+             "and a query only looks at the rows in the lists with the "
+             "closest centres.  It is rebuilt from scratch on each commit, "
+             "which compares each row with each centre, and is fast and "
+             "compact for very large embeddings.");
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingStorageType);
+
+EmbeddingStorageTypeDescription::
+EmbeddingStorageTypeDescription()
+{
+    addValue("float32", EMBEDDING_STORAGE_FLOAT32,
+             "Single precision floating point.  Coordinates are kept "
+             "exactly as they were recorded, using 4 bytes each.");
+    addValue("float16", EMBEDDING_STORAGE_FLOAT16,
+             "Half precision floating point, using 2 bytes per coordinate.  "
+             "Coordinates keep about 3 significant digits, and must be "
+             "no larger than 65504 in magnitude.");
+    addValue("int8", EMBEDDING_STORAGE_INT8,
+             "8 bit integers, using 1 byte per coordinate plus a scale "
+             "factor for each row.  Each coordinate is rounded to one of "
+             "255 evenly spaced values between minus and plus the largest "
+             "magnitude in its row.  Coordinates must be finite.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -68,6 +115,64 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index structure used to answer nearest neighbors queries.",
+             EMBEDDING_INDEX_VPTREE);
+    addField("storage", &EmbeddingDatasetConfig::storage,
+             "How the coordinates are stored in memory and in the data "
+             "file.  The 'float16' and 'int8' types use 2 and 4 times less "
+             "memory than 'float32' and are faster to search, at the "
+             "expense of precision.  Values returned by queries and "
+             "distances are calculated from the stored values.  When a "
+             "data file is loaded, the type it was saved with is used.",
+             EMBEDDING_STORAGE_FLOAT32);
+    addField("M", &EmbeddingDatasetConfig::M,
+             "For the 'hnsw' index, the number of links that each row has "
+             "to its neighbors on each layer of the graph.  Higher values "
+             "give better recall for high dimensional data at the expense "
+             "of memory and insertion time.", 16);
+    addField("efConstruction", &EmbeddingDatasetConfig::efConstruction,
+             "For the 'hnsw' index, the number of candidates considered "
+             "when choosing the neighbors of a new row.  Higher values "
+             "give a better quality index but slower insertion.", 200);
+    addField("efSearch", &EmbeddingDatasetConfig::efSearch,
+             "For the 'hnsw' index, the number of candidates considered "
+             "when answering a nearest neighbors query.  Higher values "
+             "give better recall but slower queries.  It is always at "
+             "least the number of neighbors asked for.", 64);
+    addField("ivfLists", &EmbeddingDatasetConfig::ivfLists,
+             "For the 'ivf' index, the number of lists that the rows are "
+             "split into.  The default of 0 uses the square root of the "
+             "number of rows.", 0);
+    addField("ivfProbes", &EmbeddingDatasetConfig::ivfProbes,
+             "For the 'ivf' index, the number of lists searched when "
+             "answering a nearest neighbors query.  Higher values give "
+             "better recall but slower queries.", 8);
+    addField("dataFileUrl", &EmbeddingDatasetConfig::dataFileUrl,
+             "URL of a file in which the dataset, including its index, is "
+             "persisted.  If the file exists when the dataset is created, "
+             "the dataset is loaded from it, and more rows may be recorded "
+             "and committed.  The file is rewritten on each commit.");
+    onPostValidate = [] (EmbeddingDatasetConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->M < 2)
+                throw HttpReturnException
+                    (400, "Embedding dataset parameter M must be at least 2",
+                     "M", config->M);
+            if (config->efConstruction < 1 || config->efSearch < 1)
+                throw HttpReturnException
+                    (400, "Embedding dataset parameters efConstruction and "
+                     "efSearch must be positive",
+                     "efConstruction", config->efConstruction,
+                     "efSearch", config->efSearch);
+            if (config->ivfLists < 0 || config->ivfProbes < 1)
+                throw HttpReturnException
+                    (400, "Embedding dataset parameter ivfLists must not be "
+                     "negative and ivfProbes must be positive",
+                     "ivfLists", config->ivfLists,
+                     "ivfProbes", config->ivfProbes);
+        };
 }
 
 
@@ -76,31 +181,54 @@ EmbeddingDatasetConfigDescription()
 /*****************************************************************************/
 
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new ML::VantagePointTreeT<int>()),
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
+        : metric(config.metric),
+          storage(config.storage),
+          vpTree(new ML::VantagePointTreeT<int>()),
           distance(DistanceMetric::create(metric))
     {
+        if (config.index == EMBEDDING_INDEX_HNSW)
+            hnsw.reset(new HnswIndex(config.M, config.efConstruction));
+        else if (config.index == EMBEDDING_INDEX_IVF)
+            ivf.reset(new IvfIndex(config.ivfLists));
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnPath> columnNames,
-                         MetricSpace metric)
-        : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
-          vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+                         const EmbeddingDatasetConfig & config)
+        : EmbeddingDatasetRepr(config)
     {
+        this->columnNames = std::move(columnNames);
+        columns.resize(this->columnNames.size());
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
         }
     }
 
     EmbeddingDatasetRepr(const EmbeddingDatasetRepr & other)
-        : columnNames(other.columnNames),
+        : metric(other.metric),
+          storage(other.storage),
+          columnNames(other.columnNames),
           columns(other.columns),
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          halfCoords(other.halfCoords,
+                     HalfCoords::allocator_type(storageAccount)),
+          int8Coords(other.int8Coords,
+                     Int8Coords::allocator_type(storageAccount)),
+          int8Scales(other.int8Scales),
+          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          distance(DistanceMetric::create(metric))
     {
+        // The distance metric caches information about each row, which
+        // needs to be recalculated.
+        distribution<float> buffer;
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            distance->addRow(i, getCoords(i, buffer));
+        if (other.hnsw)
+            hnsw.reset(new HnswIndex(*other.hnsw));
+        if (other.ivf)
+            ivf.reset(new IvfIndex(*other.ivf));
     }
 
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
@@ -146,8 +274,149 @@ struct EmbeddingDatasetRepr {
         {
             store << rowName.toUtf8String() << coords << timestamp;
         }
+
+        static Row reconstitute(ML::DB::Store_Reader & store)
+        {
+            Utf8String rowName;
+            distribution<float> coords;
+            Date timestamp;
+            store >> rowName >> coords >> timestamp;
+            return Row(RowPath::parse(rowName), std::move(coords), timestamp);
+        }
     };
 
+    /** Store the coordinates of a new row at the end, and tell the
+        distance metric about it.  With quantized storage, the row's
+        coords are left empty and the coordinates go in the arrays below.
+    */
+    void addRow(RowPath rowName, distribution<float> coords, Date timestamp)
+    {
+        size_t n = columnNames.size();
+        if (coords.size() != n)
+            throw HttpReturnException
+                (400, "Row '" + rowName.toUtf8String() + "' has the wrong "
+                 "number of coordinates for the embedding",
+                 "numCoords", coords.size(), "numColumns", n);
+        size_t rowNum = rows.size();
+
+        if (storage == EMBEDDING_STORAGE_FLOAT16) {
+            for (float c: coords) {
+                if (std::isfinite(c) && std::abs(c) > 65504.0f)
+                    throw HttpReturnException
+                        (400, "Coordinate of row '" + rowName.toUtf8String()
+                         + "' is too large for float16 embedding storage",
+                         "value", c);
+            }
+            halfCoords.resize((rowNum + 1) * n);
+            SIMD::vec_float_to_half(coords.data(),
+                                    halfCoords.data() + rowNum * n, n);
+            coords.clear();
+        }
+        else if (storage == EMBEDDING_STORAGE_INT8) {
+            float maxAbs = 0.0f;
+            for (float c: coords) {
+                if (!std::isfinite(c))
+                    throw HttpReturnException
+                        (400, "Coordinates of row '" + rowName.toUtf8String()
+                         + "' must be finite for int8 embedding storage",
+                         "value", c);
+                maxAbs = std::max(maxAbs, std::abs(c));
+            }
+            float scale = maxAbs / 127.0f;
+            float factor = maxAbs == 0.0f ? 0.0f : 127.0f / maxAbs;
+            int8Coords.resize((rowNum + 1) * n);
+            int8_t * q = int8Coords.data() + rowNum * n;
+            for (size_t i = 0;  i < n;  ++i)
+                q[i] = boost::algorithm::clamp(lrintf(coords[i] * factor),
+                                               -127L, 127L);
+            int8Scales.push_back(scale);
+            coords.clear();
+        }
+
+        rows.emplace_back(std::move(rowName), std::move(coords), timestamp);
+
+        distribution<float> buffer;
+        distance->addRow(rowNum, getCoords(rowNum, buffer));
+    }
+
+    /** Undo the last addRow(), to keep things consistent when the row
+        can't be indexed.
+    */
+    void popRow()
+    {
+        rows.pop_back();
+        size_t n = columnNames.size();
+        if (storage == EMBEDDING_STORAGE_FLOAT16)
+            halfCoords.resize(rows.size() * n);
+        else if (storage == EMBEDDING_STORAGE_INT8) {
+            int8Coords.resize(rows.size() * n);
+            int8Scales.resize(rows.size());
+        }
+    }
+
+    /** Write the coordinates of the given row, widened to floats, into
+        output, which has space for one per column.
+    */
+    void getCoords(unsigned rowNum, float * output) const
+    {
+        size_t n = columnNames.size();
+        switch (storage) {
+        case EMBEDDING_STORAGE_FLOAT32:
+            std::copy(rows[rowNum].coords.begin(), rows[rowNum].coords.end(),
+                      output);
+            return;
+        case EMBEDDING_STORAGE_FLOAT16:
+            SIMD::vec_half_to_float(halfCoords.data() + rowNum * n,
+                                    output, n);
+            return;
+        case EMBEDDING_STORAGE_INT8:
+            SIMD::vec_scale(int8Coords.data() + rowNum * n,
+                            int8Scales[rowNum], output, n);
+            return;
+        }
+        throw HttpReturnException(500, "Unknown embedding storage type");
+    }
+
+    /** Return the coordinates of the given row.  For float32 storage
+        these are the row's own; otherwise they are decoded into buffer.
+    */
+    const distribution<float> &
+    getCoords(unsigned rowNum, distribution<float> & buffer) const
+    {
+        if (storage == EMBEDDING_STORAGE_FLOAT32)
+            return rows[rowNum].coords;
+        buffer.resize(columnNames.size());
+        getCoords(rowNum, buffer.data());
+        return buffer;
+    }
+
+    /** Return the values of the given column for each row.  For float32
+        storage these come from the column index built on commit;
+        otherwise they are decoded into buffer.
+    */
+    const std::vector<float> &
+    columnValues(unsigned columnNum, std::vector<float> & buffer) const
+    {
+        if (storage == EMBEDDING_STORAGE_FLOAT32)
+            return columns.at(columnNum);
+
+        ExcAssertLess(columnNum, columnNames.size());
+        size_t n = columnNames.size();
+        buffer.resize(rows.size());
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            if (storage == EMBEDDING_STORAGE_FLOAT16)
+                SIMD::vec_half_to_float(&halfCoords[i * n + columnNum],
+                                        &buffer[i], 1);
+            else SIMD::vec_scale(&int8Coords[i * n + columnNum],
+                                 int8Scales[i], &buffer[i], 1);
+        }
+        return buffer;
+    }
+
+    // Distances with quantized storage are calculated by decoding the
+    // rows involved into these buffers, one set per thread, so that the
+    // results are exactly those of the metric on the stored values.
+
     float dist(unsigned row1, unsigned row2) const
     {
         ExcAssertLess(row1, rows.size());
@@ -155,22 +424,52 @@ struct EmbeddingDatasetRepr {
 
         if (row1 == row2)
             return 0.0f;
+
+        static thread_local distribution<float> buffer1, buffer2;
         
         float result = distance->dist(row1, row2,
-                                      rows[row1].coords,
-                                      rows[row2].coords);
+                                      getCoords(row1, buffer1),
+                                      getCoords(row2, buffer2));
         
         ExcAssert(isfinite(result));
         return result;
     }
 
+    /** Distance from row1 to each of the n given rows. */
+    void dist(unsigned row1, const int * rowNums, size_t n,
+              float * output) const
+    {
+        ExcAssertLess(row1, rows.size());
+
+        static thread_local distribution<float> buffer1;
+        static thread_local std::vector<distribution<float> > buffers;
+        if (storage != EMBEDDING_STORAGE_FLOAT32 && buffers.size() < n)
+            buffers.resize(n);
+
+        std::vector<const distribution<float> *> coords(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            ExcAssertLess(rowNums[i], rows.size());
+            coords[i] = storage == EMBEDDING_STORAGE_FLOAT32
+                ? &rows[rowNums[i]].coords
+                : &getCoords(rowNums[i], buffers[i]);
+        }
+
+        distance->distBatch(row1, getCoords(row1, buffer1), rowNums,
+                            coords.data(), n, output);
+
+        for (size_t i = 0;  i < n;  ++i)
+            ExcAssert(isfinite(output[i]));
+    }
+
     float dist(unsigned row1, const distribution<float> & row2) const
     {
         ExcAssertLess(row1, rows.size());
         ExcAssertEqual(row2.size(), columns.size());
+
+        static thread_local distribution<float> buffer1;
         
         float result = distance->dist(row1, -1,
-                                      rows[row1].coords,
+                                      getCoords(row1, buffer1),
                                       row2);
         ExcAssert(isfinite(result));
         return result;
@@ -197,19 +496,65 @@ struct EmbeddingDatasetRepr {
         return { earliest, latest };
     }
     
+    /** Add the given (already recorded) row to the HNSW index, if there
+        is one.
+    */
+    void indexRow(unsigned rowNum)
+    {
+        if (!hnsw)
+            return;
+        auto rowDist = [&] (int row1, int row2) -> float
+            {
+                return dist(row1, row2);
+            };
+        hnsw->insert(rowNum, rowDist);
+    }
+
+    /** Find the nearest neighbours using whichever index we have. */
+    std::vector<std::pair<float, int> >
+    search(const std::function<float (int)> & dist, int numNeighbors,
+           double maxDistance, int efSearch, int ivfProbes) const
+    {
+        if (hnsw)
+            return hnsw->search(dist, numNeighbors, maxDistance, efSearch);
+        if (ivf)
+            return ivf->search(dist, numNeighbors, maxDistance, ivfProbes);
+        return vpTree->search(dist, numNeighbors, maxDistance);
+    }
+
+    MetricSpace metric;
+    EmbeddingStorageType storage;
     std::vector<ColumnPath> columnNames;
+    /// Values of each column, built on commit; empty for quantized storage
     std::vector<std::vector<float> > columns;
     Lightweight_Hash<ColumnHash, int> columnIndex;
 
     std::vector<Row> rows;
     Lightweight_Hash<uint64_t, int> rowIndex;
+
+    /// Storage of the quantized coordinates below
+    std::shared_ptr<StorageAccount> storageAccount
+        = std::make_shared<StorageAccount>();
+
+    typedef std::vector<uint16_t, StorageAllocator<uint16_t> > HalfCoords;
+    typedef std::vector<int8_t, StorageAllocator<int8_t> > Int8Coords;
+
+    /// Coordinates for float16 storage, one row after the other
+    HalfCoords halfCoords { HalfCoords::allocator_type(storageAccount) };
+    /// Coordinates for int8 storage, one row after the other
+    Int8Coords int8Coords { Int8Coords::allocator_type(storageAccount) };
+    /// For int8 storage, what each row's coordinates are multiplied by
+    std::vector<float> int8Scales;
     
     std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;
+    std::unique_ptr<HnswIndex> hnsw;   ///< Only when the index is hnsw
+    std::unique_ptr<IvfIndex> ivf;     ///< Only when the index is ivf
     std::unique_ptr<DistanceMetric> distance;
 
-    void save(const std::string & filename)
+    void save(const Url & dataFileUrl)
     {
-        filter_ostream stream(filename);
+        makeUriDirectory(dataFileUrl.toDecodedString());
+        filter_ostream stream(dataFileUrl);
         ML::DB::Store_Writer store(stream);
         
         serialize(store);
@@ -217,7 +562,17 @@ struct EmbeddingDatasetRepr {
         // Make sure that we saved properly
         stream.close();
     }
+
+    void load(const Url & dataFileUrl)
+    {
+        filter_istream stream(dataFileUrl);
+        ML::DB::Store_Reader store(stream);
+
+        reconstitute(store);
+    }
+
     void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
 const RowHash EmbeddingDatasetRepr::nullHashIn(RowPath("null"));
@@ -234,22 +589,124 @@ EmbeddingDatasetRepr::
 serialize(ML::DB::Store_Writer & store) const
 {
     store << string("EMBEDDING_DATASET")
-          << ML::DB::compact_size_t(1);  // version
-    store << columnNames << columns << rows;
-    vpTree->serialize(store);
+          << ML::DB::compact_size_t(4);  // version
+    store << columnNames << ML::DB::compact_size_t(storage)
+          << columns << rows;
+    if (storage == EMBEDDING_STORAGE_FLOAT16)
+        store << halfCoords;
+    else if (storage == EMBEDDING_STORAGE_INT8)
+        store << int8Coords << int8Scales;
+    EmbeddingIndexType index
+        = hnsw ? EMBEDDING_INDEX_HNSW
+        : ivf ? EMBEDDING_INDEX_IVF
+        : EMBEDDING_INDEX_VPTREE;
+    store << ML::DB::compact_size_t(index);
+    if (hnsw)
+        hnsw->serialize(store);
+    else if (ivf)
+        ivf->serialize(store);
+    else vpTree->serialize(store);
 }
 
-struct EmbeddingDataset::Itl
-    : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr),
-          logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
-    {
+void
+EmbeddingDatasetRepr::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    string magic;
+    ML::DB::compact_size_t version;
+    store >> magic >> version;
+    if (magic != "EMBEDDING_DATASET")
+        throw HttpReturnException(400, "File is not an embedding dataset file");
+    if (version < 2 || version > 4)
+        throw HttpReturnException(400, "Unknown embedding dataset file version",
+                                  "version", (size_t)version);
+
+    store >> columnNames;
+
+    // Version 2 files are always float32; otherwise the storage type of
+    // the file is used, whatever the configuration says.
+    storage = EMBEDDING_STORAGE_FLOAT32;
+    if (version >= 3) {
+        ML::DB::compact_size_t storageType(store);
+        if (storageType > EMBEDDING_STORAGE_INT8)
+            throw HttpReturnException
+                (400, "Unknown embedding dataset storage type",
+                 "storage", (size_t)storageType);
+        storage = (EmbeddingStorageType)(size_t)storageType;
+    }
+
+    store >> columns;
+
+    ML::DB::compact_size_t numRows(store);
+    rows.clear();
+    rows.reserve(numRows);
+    for (size_t i = 0;  i < numRows;  ++i)
+        rows.emplace_back(Row::reconstitute(store));
+
+    halfCoords.clear();
+    int8Coords.clear();
+    int8Scales.clear();
+    if (storage == EMBEDDING_STORAGE_FLOAT16)
+        store >> halfCoords;
+    else if (storage == EMBEDDING_STORAGE_INT8)
+        store >> int8Coords >> int8Scales;
+
+    size_t numStored = rows.size() * columnNames.size();
+    if ((storage == EMBEDDING_STORAGE_FLOAT16
+         && halfCoords.size() != numStored)
+        || (storage == EMBEDDING_STORAGE_INT8
+            && (int8Coords.size() != numStored
+                || int8Scales.size() != rows.size())))
+        throw HttpReturnException(400, "Embedding dataset file is corrupt");
+
+    // Before version 4, there was only a flag saying if it was HNSW
+    size_t index;
+    if (version >= 4) {
+        ML::DB::compact_size_t indexType(store);
+        index = indexType;
+    }
+    else {
+        bool hasHnsw;
+        store >> hasHnsw;
+        index = hasHnsw ? EMBEDDING_INDEX_HNSW : EMBEDDING_INDEX_VPTREE;
+    }
+
+    hnsw.reset();
+    ivf.reset();
+    if (index == EMBEDDING_INDEX_HNSW) {
+        hnsw.reset(new HnswIndex());
+        hnsw->reconstitute(store);
     }
+    else if (index == EMBEDDING_INDEX_IVF) {
+        ivf.reset(new IvfIndex());
+        ivf->reconstitute(store);
+        if (ivf->size() != rows.size())
+            throw HttpReturnException(400, "Embedding dataset file is corrupt");
+    }
+    else if (index == EMBEDDING_INDEX_VPTREE) {
+        vpTree.reset(new ML::VantagePointTreeT<int>());
+        vpTree->reconstitute(store);
+    }
+    else throw HttpReturnException(400, "Unknown embedding dataset index type",
+                                   "index", index);
+
+    // Rebuild the in-memory indexes
+    columnIndex.clear();
+    for (unsigned i = 0;  i < columnNames.size();  ++i)
+        columnIndex[columnNames[i]] = i;
+
+    distribution<float> buffer;
+    rowIndex.clear();
+    for (unsigned i = 0;  i < rows.size();  ++i) {
+        rowIndex[getRowHashForIndex(rows[i].rowName)] = i;
+        distance->addRow(i, getCoords(i, buffer));
+    }
+}
 
-    // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address),
+struct EmbeddingDataset::Itl
+    : public MatrixView, public ColumnIndex {
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
@@ -259,7 +716,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -268,7 +725,6 @@ struct EmbeddingDataset::Itl
     typedef std::mutex Mutex;
     Mutex mutex;
     std::atomic<EmbeddingDatasetRepr *> uncommitted;
-    std::string address;
 
     RestRequestRouter router;
 
@@ -384,10 +840,13 @@ struct EmbeddingDataset::Itl
 
         MatrixNamedRow result;
         result.rowHash = result.rowName = rowName;
-        result.columns.reserve(row.coords.size());
+        distribution<float> buffer;
+        const distribution<float> & coords
+            = repr->getCoords(it->second, buffer);
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -408,10 +867,13 @@ struct EmbeddingDataset::Itl
         MatrixRow result;
         result.rowHash = rowHash;
         result.rowName = row.rowName;
-        result.columns.reserve(row.coords.size());
+        distribution<float> buffer;
+        const distribution<float> & coords
+            = repr->getCoords(it->second, buffer);
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -494,7 +956,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> buffer;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, buffer);
 
         toStoreResult.isNumeric_ = true;
         toStoreResult.atMostOne_ = true;
@@ -519,7 +983,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> buffer;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, buffer);
 
         MatrixColumn result;
 
@@ -543,7 +1009,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> buffer;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, buffer);
 
         std::vector<CellValue> result(columnVals.begin(), columnVals.end());
 
@@ -562,7 +1030,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> buffer;
+        const vector<float> & columnVals
+            = repr->columnValues(it->second, buffer);
         auto sortedVals = columnVals;
         std::sort(sortedVals.begin(), sortedVals.end());
         sortedVals.erase(std::unique(sortedVals.begin(), sortedVals.end()),
@@ -584,6 +1054,19 @@ struct EmbeddingDataset::Itl
         return std::make_tuple(std::move(buckets), std::move(descriptions));
     }
 
+    virtual std::vector<std::vector<CellValue> >
+    getColumnsDense(const std::vector<ColumnPath> & columns) const override
+    {
+        return getEachColumnDense(columns);
+    }
+
+    virtual std::vector<std::tuple<BucketList, BucketDescriptions> >
+    getColumnsBuckets(const std::vector<ColumnPath> & columns,
+                      int maxNumBuckets) const override
+    {
+        return getEachColumnBuckets(columns, maxNumBuckets);
+    }
+
     /** Return a RowValueInfo that describes all rows that could be returned
         from the dataset.
     */
@@ -666,7 +1149,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -719,15 +1202,13 @@ struct EmbeddingDataset::Itl
         
             try {
                 // Update the row
-                (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
-                                                 ts);
-                (*uncommitted).distance->addRow(numRowsBefore,
-                                                (*uncommitted).rows.back().coords);
+                (*uncommitted).addRow(rowName, std::move(embedding), ts);
+                (*uncommitted).indexRow(numRowsBefore);
             } catch (const std::exception & exc) {
                 // If there is an exception, keep the data structure consistent
                 (*uncommitted).rowIndex[rowHash] = -1;
                 if ((*uncommitted).rows.size() > numRowsBefore)
-                    (*uncommitted).rows.pop_back();
+                    (*uncommitted).popRow();
                 throw;
             }        
         }
@@ -785,7 +1266,7 @@ struct EmbeddingDataset::Itl
                 
                 //DEBUG_MSG(logger) << "columnNames = " << columnNames;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -848,15 +1329,13 @@ struct EmbeddingDataset::Itl
         
         try {
             // Update the row
-            (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
-                                             latestDate);
-            (*uncommitted).distance->addRow(numRowsBefore,
-                                            (*uncommitted).rows.back().coords);
+            (*uncommitted).addRow(rowName, std::move(embedding), latestDate);
+            (*uncommitted).indexRow(numRowsBefore);
         } catch (const std::exception & exc) {
             // If there is an exception, keep the data structure consistent
             (*uncommitted).rowIndex[rowHash] = -1;
             if ((*uncommitted).rows.size() > numRowsBefore)
-                (*uncommitted).rows.pop_back();
+                (*uncommitted).popRow();
             throw;
         }        
     }
@@ -870,18 +1349,53 @@ struct EmbeddingDataset::Itl
         if (!uncommitted)
             return;
 
-        for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-            (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+        // Create the column index; this is a standard matrix inversion.
+        // Quantized storage decodes the columns when asked instead, as
+        // a copy of them would use more memory than the embedding.
+        if ((*uncommitted).storage == EMBEDDING_STORAGE_FLOAT32) {
+            for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                (*uncommitted).columns[j].resize((*uncommitted).rows.size());
 
-        // Create the column index; this is a standard matrix inversion
-        auto indexRow = [&] (size_t i)
-            {
-                for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-                    (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
-            };
+            auto indexRow = [&] (size_t i)
+                {
+                    for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                        (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
+                };
+
+            parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        }
+
+        // The HNSW index is built incrementally as rows are recorded
+        if ((*uncommitted).ivf)
+            buildIvf();
+        else if (!(*uncommitted).hnsw)
+            buildVpTree();
+
+        committed.replace(uncommitted);
+        uncommitted = nullptr;
+
+        if (!config.dataFileUrl.empty()) {
+            INFO_MSG(logger) << "saving embedding to " << config.dataFileUrl;
+            committed()->save(config.dataFileUrl);
+        }
+    }
+
+    /** Load the dataset from a file written on commit. */
+    void load(const Url & dataFileUrl)
+    {
+        std::unique_ptr<EmbeddingDatasetRepr> repr
+            (new EmbeddingDatasetRepr(config));
+        repr->load(dataFileUrl);
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        std::unique_lock<Mutex> guard(mutex);
+        committed.replace(repr.release());
+    }
 
+    /** Build the vantage point tree for the uncommitted rows.  Must be
+        called with the mutex held.
+    */
+    void buildVpTree()
+    {
         // Create the vantage point tree
         INFO_MSG(logger) << "creating vantage point tree";
         Timer timer;
@@ -900,27 +1414,31 @@ struct EmbeddingDataset::Itl
 
                 distribution<float> result(items.size());
 
-                auto doItem = [&] (int n)
-                {
-                    int i = items[n];
+                // Items are compared in blocks, so that the batched
+                // distance kernels can be used.
+                static constexpr size_t BLOCK_SIZE = 1024;
 
-                    result[n] = (*uncommitted).dist(item, i);
+                auto doBlock = [&] (size_t block)
+                {
+                    size_t start = block * BLOCK_SIZE;
+                    size_t end = std::min(start + BLOCK_SIZE, items.size());
 
-                    if (item == i)
-                        ExcAssertEqual(result[n], 0.0);
+                    (*uncommitted).dist(item, items.data() + start,
+                                        end - start, result.data() + start);
 
-                    if (!isfinite(result[n])) {
-                        INFO_MSG(logger) << "dist between " << i << " and " << item << " is "
-                             << result.back();
+                    for (size_t n = start;  n < end;  ++n) {
+                        if (items[n] == item)
+                            ExcAssertEqual(result[n], 0.0);
                     }
-                    ExcAssert(isfinite(result[n]));
                 };
 
+                size_t numBlocks = (items.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
                 if (items.size() < 10000 || depth > 2) {
-                    for (unsigned n = 0;  n < items.size();  ++n)
-                        doItem(n);
+                    for (size_t b = 0;  b < numBlocks;  ++b)
+                        doBlock(b);
                 }
-                else parallelMap(0, items.size(), doItem);
+                else parallelMap(0, numBlocks, doBlock);
                 
                 return result;
             };
@@ -929,14 +1447,26 @@ struct EmbeddingDataset::Itl
         (*uncommitted).vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
 
         INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
-        
-        committed.replace(uncommitted);
-        uncommitted = nullptr;
+    }
 
-        if (!address.empty()) {
-            INFO_MSG(logger) << "saving embedding";
-            committed()->save(address);
-        }
+    /** Build the IVF index for the uncommitted rows.  Must be called
+        with the mutex held.
+    */
+    void buildIvf()
+    {
+        INFO_MSG(logger) << "creating IVF index";
+        Timer timer;
+
+        auto dist = [&] (int item, const int * items, size_t n,
+                         float * output)
+            {
+                (*uncommitted).dist(item, items, n, output);
+            };
+
+        (*uncommitted).ivf->build((*uncommitted).rows.size(), dist);
+
+        INFO_MSG(logger) << "IVF index of " << (*uncommitted).ivf->centers.size()
+                         << " lists done in " << timer.elapsed();
     }
 
     vector<tuple<RowPath, RowHash, float> >
@@ -957,7 +1487,8 @@ struct EmbeddingDataset::Itl
 
         //Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, numNeighbors, maxDistance,
+                                      config.efSearch, config.ivfProbes);
 
         //DEBUG_MSG(logger) << "neighbors took " << timer.elapsed();
 
@@ -973,6 +1504,44 @@ struct EmbeddingDataset::Itl
         return result;
     }
 
+    ssize_t poolRows(const std::vector<RowPath> & rows,
+                     size_t numColumns,
+                     double * sum, float * min, float * max,
+                     Date & latest) const
+    {
+        auto repr = committed();
+        if (!repr->initialized())
+            return 0;
+        if (repr->columnNames.size() != numColumns)
+            return -1;
+
+        distribution<float> buffer;
+        size_t found = 0;
+        for (auto & r: rows) {
+            auto it = repr->rowIndex.find
+                (EmbeddingDatasetRepr::getRowHashForIndex(r));
+            if (it == repr->rowIndex.end() || it->second == -1)
+                continue;
+
+            const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
+            if (row.rowName != r)
+                continue;
+
+            const float * coords = repr->getCoords(it->second, buffer).data();
+            if (sum)
+                SIMD::vec_add(sum, coords, sum, numColumns);
+            if (min)
+                SIMD::vec_min(min, coords, min, numColumns);
+            if (max)
+                SIMD::vec_max(max, coords, max, numColumns);
+
+            latest.setMax(row.timestamp);
+            ++found;
+        }
+
+        return found;
+    }
+
     vector<tuple<RowPath, RowHash, float> >
     getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance)
     {
@@ -997,7 +1566,8 @@ struct EmbeddingDataset::Itl
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, numNeighbors, maxDistance,
+                                      config.efSearch, config.ivfProbes);
 
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -1031,17 +1601,15 @@ EmbeddingDataset(MldbServer * owner,
     : Dataset(owner)
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
-#if 1
-    itl.reset(new Itl(datasetConfig.metric));
-#else // once persistence is done
-
-    if (!config.address.empty()) {
-        itl.reset(new Itl(config.address));
-    }
-    else {
-        itl.reset(new Itl());
+    itl.reset(new Itl(datasetConfig));
+
+    // If the file already exists, we load it up and are immediately
+    // committed.  Otherwise, it will be written on commit.
+    if (!datasetConfig.dataFileUrl.empty()
+        && tryGetUriObjectInfo(datasetConfig.dataFileUrl.toDecodedString())
+           .exists) {
+        itl->load(datasetConfig.dataFileUrl);
     }
-#endif
 }
     
 EmbeddingDataset::
@@ -1053,7 +1621,13 @@ Any
 EmbeddingDataset::
 getStatus() const
 {
-    return Any();
+    auto repr = itl->committed();
+    StorageAccountStats storage = repr->storageAccount->getStats();
+    Json::Value status;
+    status["rowCount"] = repr->rows.size();
+    status["storageBytes"] = storage.bytes;
+    status["hugePageBytes"] = storage.hugePageBytes;
+    return status;
 }
 
 void
@@ -1076,7 +1650,8 @@ void
 EmbeddingDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    Dataset::commit();
 }
     
 std::pair<Date, Date>
@@ -1137,6 +1712,14 @@ getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance) const
     return itl->getRowNeighbors(row, numNeighbors, maxDistance);
 }
 
+ssize_t
+EmbeddingDataset::
+poolRows(const std::vector<RowPath> & rows, size_t numColumns,
+         double * sum, float * min, float * max, Date & latest) const
+{
+    return itl->poolRows(rows, numColumns, sum, min, max, latest);
+}
+
 KnownColumn
 EmbeddingDataset::
 getKnownColumnInfo(const ColumnPath & columnName) const
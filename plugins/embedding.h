@@ -22,13 +22,42 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+/** Index structure used to answer nearest neighbour queries. */
+enum EmbeddingIndexType {
+    EMBEDDING_INDEX_VPTREE,  ///< Exact; vantage point tree
+    EMBEDDING_INDEX_HNSW,    ///< Approximate; HNSW graph
+    EMBEDDING_INDEX_IVF      ///< Approximate; inverted file of lists
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+/** How the coordinates of each row are held in memory. */
+enum EmbeddingStorageType {
+    EMBEDDING_STORAGE_FLOAT32,  ///< Full single precision floats
+    EMBEDDING_STORAGE_FLOAT16,  ///< IEEE half precision floats
+    EMBEDDING_STORAGE_INT8      ///< 8 bit integers with a scale per row
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingStorageType);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN), index(EMBEDDING_INDEX_VPTREE),
+          storage(EMBEDDING_STORAGE_FLOAT32),
+          M(16), efConstruction(200), efSearch(64),
+          ivfLists(0), ivfProbes(8)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndexType index;
+    EmbeddingStorageType storage;
+    int M;
+    int efConstruction;
+    int efSearch;
+    int ivfLists;
+    int ivfProbes;
+    Url dataFileUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
@@ -84,6 +113,19 @@ struct EmbeddingDataset: public Dataset {
     getRowNeighbors(const RowPath & row, int numNeighbors,
                     double maxDistance) const;
 
+    /** Accumulate the coordinates of the given rows straight from the
+        committed embedding, without going through a query.  Rows that
+        aren't in the embedding are skipped.  Each of sum, min and max
+        (which may be null) has numColumns entries, and is updated in place.
+        latest is updated with the latest timestamp of the rows found.
+
+        Returns the number of rows found, or -1 if the embedding doesn't
+        have numColumns columns.
+    */
+    ssize_t poolRows(const std::vector<RowPath> & rows, size_t numColumns,
+                     double * sum, float * min, float * max,
+                     Date & latest) const;
+
 private:
     EmbeddingDatasetConfig datasetConfig;
     struct Itl;
@@ -22,6 +22,8 @@
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/parallel.h"
+#include <mutex>
 
 using namespace std;
 
@@ -192,6 +194,13 @@ ExperimentProcedureConfigDescription()
               "test set is very large and aggregate statistics for each unique score is "
               "sufficient, for instance to generate a ROC curve. This has no effect "
               "for other values of `mode`.", false);
+    addField("maxParallelFolds", &ExperimentProcedureConfig::maxParallelFolds,
+             "Maximum number of folds that are trained and tested at the same "
+             "time.  All of the folds share the same pool of threads, so the "
+             "number of CPUs used is never more than the machine has, but each "
+             "fold being run holds its training data in memory.  The default "
+             "of 0 runs as many folds at the same time as there are threads "
+             "to run them; 1 runs the folds one after the other.", 0);
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&ExperimentProcedureConfig::inputData,
@@ -309,17 +318,6 @@ run(const ProcedureRunConfig & run,
 
     auto runProcConf = applyRunConfOverProcConf(procConfig, run);
 
-    std::atomic<int> progress(0);
-
-
-    auto onProgress2 = [&] (const Json::Value & details)
-        {
-            Json::Value value;
-            value["foldNumber"] = (int)progress;
-            value["details"] = details;
-            return onProgress(value);
-        };
-
     vector<string> resourcesToDelete;
 
     std::shared_ptr<Procedure> clsProcedure;
@@ -376,195 +374,256 @@ run(const ProcedureRunConfig & run,
 
     ExcAssertGreater(runProcConf.datasetFolds.size(), 0);
 
-    for(auto & datasetFold : runProcConf.datasetFolds) {
-        /***
-         * TRAIN
-         * **/
-        ClassifierConfig clsProcConf;
-        clsProcConf.trainingData = runProcConf.inputData;
-        clsProcConf.trainingData.stm->where = datasetFold.trainingWhere;
-        clsProcConf.trainingData.stm->limit = datasetFold.trainingLimit;
-        clsProcConf.trainingData.stm->offset = datasetFold.trainingOffset;
-        clsProcConf.trainingData.stm->orderBy = datasetFold.trainingOrderBy;
-
-        string baseUrl = runProcConf.modelFileUrlPattern.toString();
-        ML::replace_all(baseUrl, "$runid",
-                        MLDB::format("%s-%d", runProcConf.experimentName, (int)progress));
-        clsProcConf.modelFileUrl = Url(baseUrl);
-        clsProcConf.configuration = runProcConf.configuration;
-        clsProcConf.configurationFile = runProcConf.configurationFile;
-        clsProcConf.algorithm = runProcConf.algorithm;
-        clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
-        clsProcConf.mode = runProcConf.mode;
-        clsProcConf.multilabelStrategy = runProcConf.multilabelStrategy;        
-
-        clsProcConf.functionName = MLDB::format("%s_scorer_%d", runProcConf.experimentName, (int)progress);
-
-        if(progress == 0) {
-            PolyConfig clsProcPC;
-            clsProcPC.id = runProcConf.experimentName + "_trainer";
-            clsProcPC.type = "classifier.train";
-            clsProcPC.params = jsonEncode(clsProcConf);
-
-            INFO_MSG(logger) << " >>>>> Creating training procedure";
-            clsProcedure = createProcedure(server, clsProcPC, onProgress2, true);
-            resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
-        }
-
-        if(!clsProcedure) {
-            throw MLDB::Exception("Was unable to create classifier.train procedure");
-        }
+    if(runProcConf.maxParallelFolds < 0) {
+        throw MLDB::Exception("The maxParallelFolds parameter must be >= 0.");
+    }
 
-        // create run configuration
-        ProcedureRunConfig clsProcRunConf;
-        clsProcRunConf.id = "run_"+to_string(progress);
-        clsProcRunConf.params = jsonEncode(clsProcConf);
-        Date trainStart = Date::now();
-        RunOutput output = clsProcedure->run(clsProcRunConf, onProgress2);
-        Date trainFinish = Date::now();
+    size_t numFolds = runProcConf.datasetFolds.size();
 
+    // Folds report their progress from several threads at once
+    std::mutex progressMutex;
+    auto getOnProgress = [&] (int foldNum)
+        {
+            return [&,foldNum] (const Json::Value & details)
+                {
+                    Json::Value value;
+                    value["foldNumber"] = foldNum;
+                    value["details"] = details;
+                    std::unique_lock<std::mutex> guard(progressMutex);
+                    return onProgress(value);
+                };
+        };
 
-        /***
-         * scoring function
-         * created during the training so only add it to the cleanup list
-         * **/
+    // Each fold has its own copy of the query, since the shared statement
+    // is modified to select the fold's rows
+    auto foldQuery = [] (const InputQuery & query,
+                         const std::shared_ptr<SqlExpression> & where,
+                         ssize_t limit, ssize_t offset,
+                         const OrderByExpression & orderBy)
+        {
+            InputQuery result;
+            result.stm = std::make_shared<SelectStatement>(*query.stm);
+            result.stm->where = where;
+            result.stm->limit = limit;
+            result.stm->offset = offset;
+            result.stm->orderBy = orderBy;
+            return result;
+        };
 
-        resourcesToDelete.push_back("/v1/functions/" + clsProcConf.functionName.utf8String());
+    auto getClassifierConfig = [&] (int foldNum)
+        {
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNum];
+
+            ClassifierConfig clsProcConf;
+            clsProcConf.trainingData
+                = foldQuery(runProcConf.inputData,
+                            datasetFold.trainingWhere,
+                            datasetFold.trainingLimit,
+                            datasetFold.trainingOffset,
+                            datasetFold.trainingOrderBy);
+
+            string baseUrl = runProcConf.modelFileUrlPattern.toString();
+            ML::replace_all(baseUrl, "$runid",
+                            MLDB::format("%s-%d", runProcConf.experimentName, foldNum));
+            clsProcConf.modelFileUrl = Url(baseUrl);
+            clsProcConf.configuration = runProcConf.configuration;
+            clsProcConf.configurationFile = runProcConf.configurationFile;
+            clsProcConf.algorithm = runProcConf.algorithm;
+            clsProcConf.equalizationFactor = runProcConf.equalizationFactor;
+            clsProcConf.mode = runProcConf.mode;
+            clsProcConf.multilabelStrategy = runProcConf.multilabelStrategy;
+
+            clsProcConf.functionName = MLDB::format("%s_scorer_%d", runProcConf.experimentName, foldNum);
+            return clsProcConf;
+        };
 
-        /***
-         * accuracy
-         * **/
-        auto createAccuracyProcedure = [&] (AccuracyConfig & accuracyConf)
+    auto getAccuracyConfig = [&] (int foldNum, bool onTestSet)
         {
-            PolyConfig accuracyProcPC;
-            accuracyProcPC.id = runProcConf.experimentName + "_scorer";
-            accuracyProcPC.type = "classifier.test";
-            accuracyProcPC.params = accuracyConf;
+            const DatasetFoldConfig & datasetFold
+                = runProcConf.datasetFolds[foldNum];
+
+            // create config for the accuracy procedure
+            AccuracyConfig accuracyConfig;
+            accuracyConfig.mode = runProcConf.mode;
+            accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
+            accuracyConfig.accuracyOverN = runProcConf.accuracyOverN;
+
+            if(runProcConf.outputAccuracyDataset && onTestSet) {
+                PolyConfigT<Dataset> outputPC;
+                outputPC.id = MLDB::format("%s_results_%d", runProcConf.experimentName,
+                                           foldNum);
+                outputPC.type = "tabular";
+                accuracyConfig.outputDataset.emplace(outputPC);
+            }
 
-            INFO_MSG(logger) << " >>>>> Creating testing procedure";
-            accuracyProc = createProcedure(server, accuracyProcPC, onProgress2, true);
+            if(onTestSet) {
+                accuracyConfig.testingData
+                    = foldQuery(runProcConf.testingDataOverride
+                                ? *runProcConf.testingDataOverride
+                                : runProcConf.inputData,
+                                datasetFold.testingWhere,
+                                datasetFold.testingLimit,
+                                datasetFold.testingOffset,
+                                datasetFold.testingOrderBy);
+            }
+            else {
+                accuracyConfig.testingData
+                    = foldQuery(runProcConf.inputData,
+                                datasetFold.trainingWhere,
+                                datasetFold.trainingLimit,
+                                datasetFold.trainingOffset,
+                                datasetFold.trainingOrderBy);
+            }
 
-            resourcesToDelete.push_back("/v1/procedures/"+accuracyProcPC.id.utf8String());
+            return accuracyConfig;
         };
 
+    /***
+     * procedures
+     * These are created once, and each fold runs them with its own
+     * configuration, so that the folds can run at the same time.
+     * **/
+    {
+        PolyConfig clsProcPC;
+        clsProcPC.id = runProcConf.experimentName + "_trainer";
+        clsProcPC.type = "classifier.train";
+        clsProcPC.params = jsonEncode(getClassifierConfig(0));
+
+        INFO_MSG(logger) << " >>>>> Creating training procedure";
+        clsProcedure = createProcedure(server, clsProcPC, getOnProgress(0), true);
+        resourcesToDelete.push_back("/v1/procedures/"+clsProcPC.id.utf8String());
+    }
 
-        // setup score expression
-        string scoreExpr;
-        if     (runProcConf.mode == CM_BOOLEAN ||
-                runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
-        else if(runProcConf.mode == CM_CATEGORICAL ||
-                runProcConf.mode == CM_MULTILABEL) scoreExpr = "\"%s\"({%s})[scores] as score";
-        else throw MLDB::Exception("Classifier mode %d not implemented", runProcConf.mode);
-
+    if(!clsProcedure) {
+        throw MLDB::Exception("Was unable to create classifier.train procedure");
+    }
 
-        // this lambda actually runs the accuracy procedure for the given config
-        auto runAccuracyFor = [&] (AccuracyConfig & accuracyConf)
+    auto createAccuracyProcedure = [&] (const Utf8String & id,
+                                        const AccuracyConfig & accuracyConf)
         {
-            auto features = extractNamedSubSelect("features", accuracyConf.testingData.stm->select);
-            auto label = extractNamedSubSelect("label", accuracyConf.testingData.stm->select);
-            shared_ptr<SqlRowExpression> weight = extractNamedSubSelect("weight", accuracyConf.testingData.stm->select);
-            if (!weight)
-                weight = SqlRowExpression::parse("1.0 as weight");
-
-            auto score = SqlRowExpression::parse(MLDB::format(scoreExpr.c_str(),
-                                                            clsProcConf.functionName.utf8String(),
-                                                            features->surface.utf8String()));
+            PolyConfig accuracyProcPC;
+            accuracyProcPC.id = id;
+            accuracyProcPC.type = "classifier.test";
+            accuracyProcPC.params = accuracyConf;
 
-            accuracyConf.testingData.stm->select = SelectExpression({features, label, weight, score});
+            INFO_MSG(logger) << " >>>>> Creating testing procedure";
+            auto result = createProcedure(server, accuracyProcPC, getOnProgress(0), true);
+            if(!result)
+                throw MLDB::Exception("Was unable to create accuracy procedure");
 
-            Timer timer;
+            resourcesToDelete.push_back("/v1/procedures/"+accuracyProcPC.id.utf8String());
+            return result;
+        };
 
-            if(!accuracyProc)
-                throw MLDB::Exception("Was unable to create accuracy procedure");
+    // create empty testing procedures.  The one for the training set is
+    // separate, as it has no output dataset.
+    accuracyProc = createAccuracyProcedure(runProcConf.experimentName + "_scorer",
+                                           getAccuracyConfig(0, true));
+    std::shared_ptr<Procedure> accuracyProcTrain;
+    if(runProcConf.evalTrain) {
+        accuracyProcTrain
+            = createAccuracyProcedure(runProcConf.experimentName + "_train_scorer",
+                                      getAccuracyConfig(0, false));
+    }
 
-            ProcedureRunConfig accuracyProcRunConf;
-            accuracyProcRunConf.id = "run_"+to_string(progress);
-            accuracyProcRunConf.params = jsonEncode(accuracyConf);
-            Date testStart = Date::now();
-            RunOutput accuracyOutput = accuracyProc->run(accuracyProcRunConf, onProgress2);
-            Date testFinish = Date::now();
+    // setup score expression
+    string scoreExpr;
+    if     (runProcConf.mode == CM_BOOLEAN ||
+            runProcConf.mode == CM_REGRESSION)  scoreExpr = "\"%s\"({%s})[score] as score";
+    else if(runProcConf.mode == CM_CATEGORICAL ||
+            runProcConf.mode == CM_MULTILABEL) scoreExpr = "\"%s\"({%s})[scores] as score";
+    else throw MLDB::Exception("Classifier mode %d not implemented", runProcConf.mode);
+
+    // this lambda actually runs the accuracy procedure for the given config
+    auto runAccuracyFor = [&] (const Procedure & proc,
+                               AccuracyConfig & accuracyConf,
+                               const ClassifierConfig & clsProcConf,
+                               int foldNum)
+    {
+        auto features = extractNamedSubSelect("features", accuracyConf.testingData.stm->select);
+        auto label = extractNamedSubSelect("label", accuracyConf.testingData.stm->select);
+        shared_ptr<SqlRowExpression> weight = extractNamedSubSelect("weight", accuracyConf.testingData.stm->select);
+        if (!weight)
+            weight = SqlRowExpression::parse("1.0 as weight");
+
+        auto score = SqlRowExpression::parse(MLDB::format(scoreExpr.c_str(),
+                                                        clsProcConf.functionName.utf8String(),
+                                                        features->surface.utf8String()));
+
+        accuracyConf.testingData.stm->select = SelectExpression({features, label, weight, score});
+
+        Timer timer;
+
+        ProcedureRunConfig accuracyProcRunConf;
+        accuracyProcRunConf.id = "run_"+to_string(foldNum);
+        accuracyProcRunConf.params = jsonEncode(accuracyConf);
+        Date testStart = Date::now();
+        RunOutput accuracyOutput = proc.run(accuracyProcRunConf, getOnProgress(foldNum));
+        Date testFinish = Date::now();
+
+        INFO_MSG(logger) << "accuracy took " << timer.elapsed();
+
+        return make_tuple(accuracyOutput,
+                          testFinish.secondsSinceEpoch() - testStart.secondsSinceEpoch());
+    };
+
+    std::vector<Json::Value> foldResults(numFolds);
+
+    auto runFold = [&] (size_t foldNum)
+    {
+        /***
+         * TRAIN
+         * **/
+        ClassifierConfig clsProcConf = getClassifierConfig(foldNum);
 
-            INFO_MSG(logger) << "accuracy took " << timer.elapsed();
+        // create run configuration
+        ProcedureRunConfig clsProcRunConf;
+        clsProcRunConf.id = "run_"+to_string(foldNum);
+        clsProcRunConf.params = jsonEncode(clsProcConf);
+        Date trainStart = Date::now();
+        RunOutput output = clsProcedure->run(clsProcRunConf, getOnProgress(foldNum));
+        Date trainFinish = Date::now();
 
-            return make_tuple(accuracyOutput,
-                              testFinish.secondsSinceEpoch() - testStart.secondsSinceEpoch());
-        };
+        /***
+         * accuracy
+         * **/
+        auto accuracyConfig = getAccuracyConfig(foldNum, true);
 
+        if(accuracyConfig.outputDataset) {
+            InProcessRestConnection connection;
+            Utf8String id = accuracyConfig.outputDataset->id;
+            RestRequest request("DELETE", "/v1/datasets/"+id.utf8String(),
+                                RestParams(), "{}");
+            server->handleRequest(connection, request);
 
-        auto getAccuracyConfig = [&] (bool onTestSet)
-            {
-                // create config for the accuracy procedure
-                AccuracyConfig accuracyConfig;
-                accuracyConfig.mode = runProcConf.mode;
-                accuracyConfig.uniqueScoresOnly = runProcConf.uniqueScoresOnly;
-                accuracyConfig.accuracyOverN = runProcConf.accuracyOverN;
-
-                if(runProcConf.outputAccuracyDataset && onTestSet) {
-                    PolyConfigT<Dataset> outputPC;
-                    outputPC.id = MLDB::format("%s_results_%d", runProcConf.experimentName, 
-                                                              (int)progress);
-                    outputPC.type = "tabular";
-
-                    {
-                        InProcessRestConnection connection;
-                        RestRequest request("DELETE", "/v1/datasets/"+outputPC.id.utf8String(),
-                                            RestParams(), "{}");
-                        server->handleRequest(connection, request);
-
-                        if(connection.responseCode != 204) {
-                            throw MLDB::Exception("HTTP error "+std::to_string(connection.responseCode)+
-                                " when trying to DELETE dataset '"+outputPC.id.utf8String()+"'");
-                        }
-                    }
-                    accuracyConfig.outputDataset.emplace(outputPC);
-                }
-
-                if(onTestSet) {
-                    accuracyConfig.testingData =
-                        runProcConf.testingDataOverride ? *runProcConf.testingDataOverride
-                                                        : runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.testingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.testingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.testingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.testingOrderBy;
-                }
-                else {
-                    accuracyConfig.testingData = runProcConf.inputData;
-                    accuracyConfig.testingData.stm->where = datasetFold.trainingWhere;
-                    accuracyConfig.testingData.stm->limit = datasetFold.trainingLimit;
-                    accuracyConfig.testingData.stm->offset = datasetFold.trainingOffset;
-                    accuracyConfig.testingData.stm->orderBy = datasetFold.trainingOrderBy;
-                }
-
-                return accuracyConfig;
-            };
-
-        auto accuracyConfig = getAccuracyConfig(true);
-
-        // create empty testing procedure
-        if(progress == 0)
-            createAccuracyProcedure(accuracyConfig);
+            if(connection.responseCode != 204) {
+                throw MLDB::Exception("HTTP error "+std::to_string(connection.responseCode)+
+                    " when trying to DELETE dataset '"+id.utf8String()+"'");
+            }
+        }
 
         // run evaluation on testing
-        auto accuracyOutput = runAccuracyFor(accuracyConfig);
+        auto accuracyOutput = runAccuracyFor(*accuracyProc, accuracyConfig,
+                                             clsProcConf, foldNum);
 
         // run evaluation on training
         std::tuple<RunOutput, double> accuracyOutputTrain;
         if(runProcConf.evalTrain) {
-            auto accuracyTrainingConf = getAccuracyConfig(false);
-            createAccuracyProcedure(accuracyTrainingConf);
-            accuracyOutputTrain = runAccuracyFor(accuracyTrainingConf);
+            auto accuracyTrainingConf = getAccuracyConfig(foldNum, false);
+            accuracyOutputTrain = runAccuracyFor(*accuracyProcTrain,
+                                                 accuracyTrainingConf,
+                                                 clsProcConf, foldNum);
         }
 
         Json::Value duration;
         duration["train"] = trainFinish.secondsSinceEpoch() - trainStart.secondsSinceEpoch();
         duration["test"] = get<1>(accuracyOutput) + (runProcConf.evalTrain ? get<1>(accuracyOutputTrain)
                                                                            : 0);
-        durationStatsGen.accumStats(duration, "");
 
         // Add results
         Json::Value foldRez;
-        foldRez["fold"] = jsonEncode(datasetFold);
+        foldRez["fold"] = jsonEncode(runProcConf.datasetFolds[foldNum]);
         foldRez["modelFileUrl"] = clsProcConf.modelFileUrl.toUtf8String();
         foldRez["functionName"] = clsProcConf.functionName;
 
@@ -573,16 +632,33 @@ run(const ProcedureRunConfig & run,
 
         foldRez["resultsTest"] = jsonEncode(get<0>(accuracyOutput).results);
         foldRez["durationSecs"] = duration;
-        statsGen.accumStats(foldRez["resultsTest"], "");
 
         if(runProcConf.evalTrain) {
             foldRez["resultsTrain"] = jsonEncode(get<0>(accuracyOutputTrain).results);
-            statsGenTrain.accumStats(foldRez["resultsTrain"], "");
         }
 
-        test_eval_results.append(foldRez);
+        foldResults[foldNum] = std::move(foldRez);
+    };
 
-        progress ++;
+    parallelMap(0, numFolds, runFold,
+                runProcConf.maxParallelFolds > 0
+                ? runProcConf.maxParallelFolds : -1);
+
+    // Collect the results in fold order, so that they don't depend on
+    // which folds finished first
+    for(auto & foldRez : foldResults) {
+        /***
+         * scoring function
+         * created during the training so only add it to the cleanup list
+         * **/
+        resourcesToDelete.push_back("/v1/functions/" + foldRez["functionName"].asString());
+
+        durationStatsGen.accumStats(foldRez["durationSecs"], "");
+        statsGen.accumStats(foldRez["resultsTest"], "");
+        if(runProcConf.evalTrain)
+            statsGenTrain.accumStats(foldRez["resultsTrain"], "");
+
+        test_eval_results.append(foldRez);
     }
 
     /***
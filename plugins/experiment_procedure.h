@@ -101,6 +101,10 @@ struct ExperimentProcedureConfig : public ProcedureConfig {
     bool outputAccuracyDataset = true;
     bool uniqueScoresOnly = false;
     bool evalTrain = false;
+
+    /// Maximum number of folds trained and tested at the same time.  0
+    /// means no limit other than the thread pool, which all folds share.
+    int maxParallelFolds = 0;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ExperimentProcedureConfig);
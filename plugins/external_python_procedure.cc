@@ -16,6 +16,17 @@
 #include "mldb/utils/runner.h"
 #include <boost/filesystem.hpp>
 #include "mldb/types/any_impl.h"
+#include "mldb/types/optional_description.h"
+#include "mldb/server/arrow_reader.h"
+#include "mldb/plugins/arrow_export_procedure.h"
+#include "mldb/plugins/sql_config_validator.h"
+#include "mldb/http/http_exception.h"
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#include <unistd.h>
 
 
 using namespace std;
@@ -35,9 +46,148 @@ ExternalPythonProcedureConfigDescription()
             "Script resource configuration");
     addField("stdInData", &ExternalPythonProcedureConfig::stdInData,
             "What to send on the stdin of the python process");
+    addField("inputData", &ExternalPythonProcedureConfig::inputData,
+             "Query whose output is given to the script, as an Apache Arrow "
+             "stream in shared memory.  The script finds the path of the "
+             "stream in the `MLDB_INPUT_ARROW` environment variable.");
+    addField("outputDataset", &ExternalPythonProcedureConfig::outputDataset,
+             "Dataset in which to record the Arrow stream that the script "
+             "writes to the path in the `MLDB_OUTPUT_ARROW` environment "
+             "variable.  If it's not given, the script has no output "
+             "stream.");
+
+    onPostValidate = [&] (ExternalPythonProcedureConfig * cfg,
+                          JsonParsingContext & context)
+    {
+        if (cfg->inputData.stm)
+            MustContainFrom()(cfg->inputData,
+                              ExternalPythonProcedureConfig::name);
+    };
 }
 
 
+namespace {
+
+/** File in memory, created with memfd_create, through which Arrow data is
+    exchanged with the script.  The script opens it by its path under /proc
+    and can map it, so the data isn't copied on its way through.
+*/
+struct MemFile {
+    MemFile(const char * name)
+    {
+        fd = syscall(SYS_memfd_create, name, MFD_CLOEXEC);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "memfd_create");
+    }
+
+    ~MemFile()
+    {
+        if (data)
+            ::munmap(data, length);
+        ::close(fd);
+    }
+
+    MemFile(const MemFile &) = delete;
+    void operator = (const MemFile &) = delete;
+
+    /// Path by which another process can open the file
+    std::string path() const
+    {
+        return "/proc/" + std::to_string(::getpid())
+            + "/fd/" + std::to_string(fd);
+    }
+
+    /// Map what has been written to the file, returning its length
+    size_t map()
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == -1)
+            throw MLDB::Exception(errno, "fstat");
+        length = st.st_size;
+        if (length == 0)
+            return 0;
+        data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            data = nullptr;
+            throw MLDB::Exception(errno, "mmap");
+        }
+        return length;
+    }
+
+    const char * bytes() const
+    {
+        return (const char *)data;
+    }
+
+    int fd = -1;
+    void * data = nullptr;
+    size_t length = 0;
+};
+
+/** Record the Arrow stream in the file into the dataset, one chunk per
+    record batch.  A column called `_rowName` gives the names of the rows;
+    without one, they are numbered from 0.  Returns the number of rows.
+*/
+uint64_t recordArrowOutput(MemFile & file, Dataset & dataset)
+{
+    if (file.map() == 0)
+        throw HttpReturnException
+            (400, "The script didn't write an Arrow stream to the path in "
+             "MLDB_OUTPUT_ARROW");
+
+    ArrowStreamReader reader(file.bytes(), file.length);
+
+    int rowNameColumn = -1;
+    vector<ColumnPath> columnNames;
+    for (auto & name: reader.columnNames()) {
+        if (name == "_rowName") {
+            rowNameColumn = columnNames.size();
+            continue;
+        }
+        // Names written by MLDB are paths; others are taken as they are
+        auto parsed = ColumnPath::tryParse(name);
+        columnNames.emplace_back(parsed.second && !parsed.first.empty()
+                                 ? std::move(parsed.first)
+                                 : ColumnPath(PathElement(name)));
+    }
+
+    Dataset::MultiChunkRecorder recorder = dataset.getChunkRecorder();
+    Date ts = Date::now();
+    uint64_t numRows = 0;
+    vector<vector<CellValue> > batch;
+    vector<CellValue> values(columnNames.size());
+
+    for (size_t chunk = 0;  reader.readBatch(batch);  ++chunk) {
+        std::unique_ptr<Recorder> chunkRecorder = recorder.newChunk(chunk);
+        auto recordRow = chunkRecorder->specializeRecordTabular(columnNames);
+        size_t batchRows = batch.empty() ? 0 : batch[0].size();
+
+        for (size_t i = 0;  i < batchRows;  ++i, ++numRows) {
+            RowPath rowName;
+            size_t n = 0;
+            for (size_t c = 0;  c < batch.size();  ++c) {
+                if ((int)c == rowNameColumn) {
+                    if (!batch[c][i].empty())
+                        rowName = batch[c][i].coerceToPath();
+                }
+                else values[n++] = std::move(batch[c][i]);
+            }
+            if (rowName.empty())
+                rowName = RowPath(PathElement(numRows));
+            recordRow(std::move(rowName), ts, values.data(), values.size(),
+                      {});
+        }
+
+        chunkRecorder->finishedChunk();
+    }
+
+    recorder.commit();
+    return numRows;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* EXTERNAL PYTHON PROCEDURE                                                 */
 /*****************************************************************************/
@@ -98,8 +248,36 @@ run(const ProcedureRunConfig & run,
         python_executable = "./virtualenv/bin/python";
     }
 
+    // The data exchanged with the script goes through files in memory,
+    // whose paths are passed in its environment
+    vector<string> command;
+    std::unique_ptr<MemFile> inputFile, outputFile;
+
+    if (newProcConf.inputData.stm) {
+        inputFile.reset(new MemFile("mldb-external-input"));
+        std::ofstream stream(inputFile->path(), std::ios::binary);
+        exportQueryToArrow(server, newProcConf.inputData, stream,
+                           ARROW_STREAM, ArrowWriter::DEFAULT_ROWS_PER_BATCH,
+                           false /* skipDuplicateCells */, onProgress);
+        stream.close();
+        if (!stream)
+            throw MLDB::Exception("Error writing the input of the script");
+        command.push_back("MLDB_INPUT_ARROW=" + inputFile->path());
+    }
+
+    if (newProcConf.outputDataset) {
+        outputFile.reset(new MemFile("mldb-external-output"));
+        command.push_back("MLDB_OUTPUT_ARROW=" + outputFile->path());
+    }
+
+    if (!command.empty())
+        command.insert(command.begin(), "/usr/bin/env");
+
     string cmd = python_executable + " " + pluginRes->getElementLocation(MAIN);
-    RunResult runRes = execute(ML::split(cmd, ' '), stdout_sink,
+    for (auto & arg: ML::split(cmd, ' '))
+        command.push_back(arg);
+
+    RunResult runRes = execute(command, stdout_sink,
                                 stderr_sink, newProcConf.stdInData);
 
     cout << runRes.state << endl;
@@ -139,6 +317,17 @@ run(const ProcedureRunConfig & run,
     jsRes["stderr"] = output_stderr->str();
     jsRes["runResult"] = jsonEncode(runRes);
 
+    // Only the output of a script that succeeded is recorded
+    if (outputFile && runRes.state == RunResult::RETURNED
+        && runRes.returnCode == 0) {
+        PolyConfigT<Dataset> outputConfig = *newProcConf.outputDataset;
+        if (outputConfig.type.empty())
+            outputConfig.type = "tabular";
+        auto output = createDataset(server, outputConfig, nullptr,
+                                    true /* overwrite */);
+        jsRes["rowCount"] = recordArrowOutput(*outputFile, *output);
+    }
+
 
     return RunOutput(jsRes);
 }
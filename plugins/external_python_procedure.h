@@ -10,6 +10,8 @@
 #pragma once
 
 #include "mldb/core/procedure.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/server/plugin_resource.h"
 
@@ -25,6 +27,8 @@ struct ExternalPythonProcedureConfig: public ProcedureConfig {
 
     std::string stdInData;
     ScriptResource scriptConfig;
+    InputQuery inputData;
+    Optional<PolyConfigT<Dataset> > outputDataset;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ExternalPythonProcedureConfig);
@@ -14,6 +14,7 @@
 #include <chrono>
 #include <thread>
 #include <cstring>
+#include <sys/mman.h>
 #include "mldb/jml/utils/ring_buffer.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/thread_pool.h"
@@ -247,6 +248,20 @@ forEachLineStr(const std::string & filename,
 /* FOR EACH LINE BLOCK                                                       */
 /*****************************************************************************/
 
+/** Tell the kernel that the given mapping will be read once from start to
+    end, so that it reads ahead aggressively, and that it may use huge pages
+    for it.  These are only hints, so failures are ignored.
+*/
+static void adviseSequential(const char * mapped, size_t mappedSize)
+{
+    // The mapping starts on a page boundary
+    void * addr = const_cast<char *>(mapped);
+    ::madvise(addr, mappedSize, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    ::madvise(addr, mappedSize, MADV_HUGEPAGE);
+#endif
+}
+
 void forEachLineBlock(std::istream & stream,
                       std::function<bool (const char * line,
                                           size_t lineLength,
@@ -281,6 +296,20 @@ void forEachLineBlock(std::istream & stream,
         std::tie(mapped, mappedSize) = fistream->mapped();
     }
 
+    // Where the next block starts in the mapping
+    int64_t mappedOffset = 0;
+
+    if (mapped && (!stream || stream.eof())) {
+        // Nothing left to read; let the stream code deal with it
+        mapped = nullptr;
+    }
+    else if (mapped) {
+        mappedOffset = stream.tellg();
+        if (mappedOffset < 0 || (size_t)mappedOffset > mappedSize)
+            mapped = nullptr;
+        else adviseSequential(mapped, mappedSize);
+    }
+
     std::atomic<int> hasExc(false);
     std::exception_ptr exc;
 
@@ -295,34 +324,33 @@ void forEachLineBlock(std::istream & stream,
             size_t myChunkNumber = 0;
             
             try {
-                //MLDB-1426
-                if (mapped && false) {
-                    const char * start = mapped + stream.tellg();
+                if (mapped) {
+                    // Zero copy: the lines are handed out directly from
+                    // the mapping
+                    const char * start = mapped + mappedOffset;
                     const char * current = start;
                     const char * end = mapped + mappedSize;
 
-                    while (current && current < end && (current - start) < BLOCK_SIZE
-                           && (maxLines == -1 || doneLines < maxLines)) { //stop processing new line when we have enough)
-                        current = (const char *)memchr(current, '\n', end - current);
-                        if (current && current < end) {
-                            ExcAssertEqual(*current, '\n');
-                            lineOffsets.push_back(current - start);
+                    while (current < end && (current - start) < BLOCK_SIZE
+                           && (maxLines == -1 || doneLines < maxLines)) { //stop processing new line when we have enough
+                        const char * eol
+                            = (const char *)memchr(current, '\n', end - current);
+                        if (!eol) {
+                            // Last line has no newline
+                            lineOffsets.push_back(end - start);
                             ++doneLines;
-                            ++current;
+                            current = end;
+                            break;
                         }
-                    }
-                
-                    if (current)
-                        stream.seekg(current - start, ios::cur);
-                    else {
-                        // Last line has no newline
-                        lineOffsets.push_back(end - start);
+                        lineOffsets.push_back(eol - start);
                         ++doneLines;
+                        current = eol + 1;
                     }
-                    
+
+                    mappedOffset = current - mapped;
                     myChunkNumber = chunkNumber++;
 
-                    if (current && current < end &&
+                    if (current < end &&
                         (maxLines == -1 || doneLines < maxLines)) // don't schedule a new block if we have enough lines
                         {
                             // Ready for another chunk
@@ -473,6 +501,10 @@ void forEachLineBlock(std::istream & stream,
     if (hasExc) {
         std::rethrow_exception(exc);
     }
+
+    // Leave the stream where we stopped reading the mapping
+    if (mapped)
+        stream.seekg(mappedOffset, ios::beg);
 }
 
 /*****************************************************************************/
@@ -100,7 +100,9 @@ forEachLineStr(const std::string & filename,
 
     If a filter_istream is passed, the code is optimized as it allows
     for the file to be memory mapped.  It should in that case be opened
-    with the "mapped" option.
+    with the "mapped" option; the lines are then passed directly from the
+    mapping without being copied, and the stream is left positioned after
+    the last line read.
 
     The startBlock and endBlock functions are called, in the context of
     the processing thread, at the beginning and end of the block
@@ -9,11 +9,16 @@
 #include "tabular_dataset_column.h"
 #include "mldb/arch/bitops.h"
 #include "mldb/arch/bit_range_ops.h"
+#include "mldb/base/storage_allocator.h"
 #include "mldb/utils/compact_vector.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
 #include "mldb/types/value_description.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/sql/path.h"
 #include <mutex>
 
 using namespace std;
@@ -22,13 +27,285 @@ using namespace std;
 namespace MLDB {
 
 
+/*****************************************************************************/
+/* CELL VALUE SERIALIZATION                                                  */
+/*****************************************************************************/
+
+namespace {
+
+/** Binary serialization of a CellValue, used for the value tables of frozen
+    columns.  Unlike JSON it round-trips all types exactly and requires no
+    parsing of the values on reload.
+*/
+void serializeCell(ML::DB::Store_Writer & store, const CellValue & val)
+{
+    CellValue::CellType type = val.cellType();
+    store << (unsigned char)type;
+    switch (type) {
+    case CellValue::EMPTY:
+        return;
+    case CellValue::INTEGER:
+        if (val.isPositiveNumber()) {
+            store << (unsigned char)1 << (unsigned long long)val.toUInt();
+        }
+        else {
+            store << (unsigned char)0 << (long long)val.toInt();
+        }
+        return;
+    case CellValue::FLOAT:
+        store << val.toDouble();
+        return;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        store << std::string(val.stringChars(), val.toStringLength());
+        return;
+    case CellValue::TIMESTAMP:
+        store << val.toTimestamp();
+        return;
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = val.toMonthDaySecond();
+        store << (long long)months << (long long)days << seconds;
+        return;
+    }
+    case CellValue::BLOB:
+        store << std::string((const char *)val.blobData(), val.blobLength());
+        return;
+    case CellValue::PATH:
+        store << val.coerceToPath().toUtf8String();
+        return;
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw HttpReturnException(500, "Unknown cell type serializing frozen column");
+}
+
+CellValue reconstituteCell(ML::DB::Store_Reader & store)
+{
+    unsigned char type;
+    store >> type;
+    switch (type) {
+    case CellValue::EMPTY:
+        return CellValue();
+    case CellValue::INTEGER: {
+        unsigned char isPositive;
+        store >> isPositive;
+        if (isPositive) {
+            unsigned long long val;
+            store >> val;
+            return val;
+        }
+        long long val;
+        store >> val;
+        return val;
+    }
+    case CellValue::FLOAT: {
+        double val;
+        store >> val;
+        return val;
+    }
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING: {
+        std::string str;
+        store >> str;
+        return CellValue(str.data(), str.length(),
+                         type == CellValue::ASCII_STRING
+                         ? STRING_IS_VALID_ASCII
+                         : STRING_IS_VALID_UTF8_NOT_ASCII);
+    }
+    case CellValue::TIMESTAMP: {
+        Date ts;
+        store >> ts;
+        return ts;
+    }
+    case CellValue::TIMEINTERVAL: {
+        long long months, days;
+        double seconds;
+        store >> months >> days >> seconds;
+        return CellValue::fromMonthDaySecond(months, days, seconds);
+    }
+    case CellValue::BLOB: {
+        std::string str;
+        store >> str;
+        return CellValue::blob(std::move(str));
+    }
+    case CellValue::PATH: {
+        Utf8String str;
+        store >> str;
+        return CellValue(Path::parse(str));
+    }
+    default:
+        break;
+    }
+    
+    throw HttpReturnException(500, "Unknown cell type reconstituting frozen column",
+                              "cellType", (int)type);
+}
+
+template<typename Table>
+void serializeTable(ML::DB::Store_Writer & store, const Table & table)
+{
+    store << ML::DB::compact_size_t(table.size());
+    for (auto & v: table)
+        serializeCell(store, v);
+}
+
+template<typename Table>
+void reconstituteTable(ML::DB::Store_Reader & store, Table & table)
+{
+    ML::DB::compact_size_t size(store);
+    table.resize(size);
+    for (auto & v: table)
+        v = reconstituteCell(store);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* MAPPED COLUMN SOURCE                                                      */
+/*****************************************************************************/
+
+static constexpr size_t MAPPED_ARRAY_ALIGNMENT = 8;
+
+const char *
+MappedColumnSource::
+mapBytes(size_t numBytes)
+{
+    ML::DB::compact_size_t storedBytes(store);
+    if (storedBytes != numBytes) {
+        throw HttpReturnException
+            (500, "Wrong array length reconstituting mapped frozen column",
+             "expected", numBytes,
+             "stored", (size_t)storedBytes);
+    }
+    size_t padding = (MAPPED_ARRAY_ALIGNMENT - store.offset() % MAPPED_ARRAY_ALIGNMENT)
+        % MAPPED_ARRAY_ALIGNMENT;
+    store.skip(padding);
+    store.must_have(numBytes);
+    const char * result = store.pos();
+    store.skip(numBytes);
+    return result;
+}
+
+
+/*****************************************************************************/
+/* MAPPED COLUMN SINK                                                        */
+/*****************************************************************************/
+
+void
+MappedColumnSink::
+writeBytes(const char * data, size_t numBytes)
+{
+    store << ML::DB::compact_size_t(numBytes);
+    static const char zeros[MAPPED_ARRAY_ALIGNMENT] = { 0 };
+    size_t padding = (MAPPED_ARRAY_ALIGNMENT - store.offset() % MAPPED_ARRAY_ALIGNMENT)
+        % MAPPED_ARRAY_ALIGNMENT;
+    store.save_binary(zeros, padding);
+    store.save_binary(data, numBytes);
+}
+
+
+/*****************************************************************************/
+/* COLUMN DICTIONARY                                                         */
+/*****************************************************************************/
+
+constexpr uint32_t ColumnDictionary::NOT_FOUND;
+
+uint32_t
+ColumnDictionary::
+intern(const CellValue & val)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = codes.find(val);
+    if (it != codes.end())
+        return it->second;
+    if (values.size() >= NOT_FOUND) {
+        throw HttpReturnException
+            (500, "Too many distinct values for tabular column dictionary");
+    }
+    uint32_t code = values.size();
+    values.push_back(val);
+    codes.emplace(val, code);
+    return code;
+}
+
+uint32_t
+ColumnDictionary::
+find(const CellValue & val) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = codes.find(val);
+    if (it == codes.end())
+        return NOT_FOUND;
+    return it->second;
+}
+
+size_t
+ColumnDictionary::
+size() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return values.size();
+}
+
+size_t
+ColumnDictionary::
+memusage() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    size_t result = sizeof(*this);
+    // Each value is stored once in values, and its key in codes shares
+    // the string with it
+    for (auto & v: values)
+        result += v.memusage() + sizeof(CellValue) + 2 * sizeof(void *);
+    return result;
+}
+
+void
+ColumnDictionary::
+serialize(ML::DB::Store_Writer & store) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    serializeTable(store, values);
+}
+
+std::shared_ptr<ColumnDictionary>
+ColumnDictionary::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    auto result = std::make_shared<ColumnDictionary>();
+    reconstituteTable(store, result->values);
+    result->codes.reserve(result->values.size());
+    for (size_t i = 0;  i < result->values.size();  ++i) {
+        if (!result->codes.emplace(result->values[i], i).second) {
+            throw HttpReturnException
+                (500, "Duplicate value reconstituting tabular column dictionary",
+                 "value", result->values[i]);
+        }
+    }
+    return result;
+}
+
+
 /*****************************************************************************/
 /* TABLE FROZEN COLUMN                                                       */
 /*****************************************************************************/
 
 /// Frozen column that finds each value in a lookup table
 struct TableFrozenColumn: public FrozenColumn {
-    TableFrozenColumn(TabularDatasetColumn & column)
+    TableFrozenColumn(MappedColumnSource & source)
+    {
+        source.store >> indexBits >> numEntries >> firstEntry >> hasNulls;
+        columnTypes.reconstitute(source.store);
+        reconstituteTable(source.store, table);
+        storage = source.mapArray<uint32_t>((indexBits * numEntries + 31) / 32);
+    }
+
+    TableFrozenColumn(TabularDatasetColumn & column,
+                      std::shared_ptr<StorageAccount> account)
         : table(std::move(column.indexedVals)),
           columnTypes(column.columnTypes)
     {
@@ -37,8 +314,10 @@ struct TableFrozenColumn: public FrozenColumn {
         hasNulls = column.sparseIndexes.size() < numEntries;
         indexBits = ML::highest_bit(table.size() + hasNulls) + 1;
         size_t numWords = (indexBits * numEntries + 31) / 32;
-        uint32_t * data = new uint32_t[numWords];
-        storage = std::shared_ptr<uint32_t>(data, [] (uint32_t * p) { delete[] p; });
+        auto writableStorage
+            = allocateStorageArray<uint32_t>(numWords, account);
+        uint32_t * data = writableStorage.get();
+        storage = writableStorage;
 
         if (!hasNulls) {
             // Contiguous rows
@@ -163,6 +442,19 @@ struct TableFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    virtual std::string format() const
+    {
+        return "Table";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << indexBits << numEntries << firstEntry << hasNulls;
+        columnTypes.serialize(sink.store);
+        serializeTable(sink.store, table);
+        sink.writeArray(storage.get(), (indexBits * numEntries + 31) / 32);
+    }
+
     static size_t bytesRequired(const TabularDatasetColumn & column)
     {
         size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
@@ -210,7 +502,13 @@ struct TableFrozenColumnFormat: public FrozenColumnFormat {
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const override
     {
-        return new TableFrozenColumn(column);
+        return new TableFrozenColumn(column, params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new TableFrozenColumn(source);
     }
 };
 
@@ -218,139 +516,159 @@ RegisterFrozenColumnFormatT<TableFrozenColumnFormat> regTable;
 
 
 /*****************************************************************************/
-/* SPARSE FROZEN COLUMN                                                      */
+/* DICTIONARY FROZEN COLUMN                                                  */
 /*****************************************************************************/
 
-/// Sparse frozen column that finds each value in a lookup table
-struct SparseTableFrozenColumn: public FrozenColumn {
-    SparseTableFrozenColumn(TabularDatasetColumn & column)
-        : table(column.indexedVals.size()), columnTypes(column.columnTypes)
-    {
-        firstEntry = column.minRowNumber;
-        lastEntry = column.maxRowNumber;
-        std::move(std::make_move_iterator(column.indexedVals.begin()),
-                  std::make_move_iterator(column.indexedVals.end()),
-                  table.begin());
-        indexBits = ML::highest_bit(table.size()) + 1;
-        rowNumBits = ML::highest_bit(column.maxRowNumber - column.minRowNumber) + 1;
-        numEntries = column.sparseIndexes.size();
-        size_t numWords = ((indexBits + rowNumBits) * numEntries + 31) / 32;
-        uint32_t * data = new uint32_t[numWords];
-        storage = std::shared_ptr<uint32_t>(data, [] (uint32_t * p) { delete[] p; });
-            
-        ML::Bit_Writer<uint32_t> writer(data);
-        for (auto & i: column.sparseIndexes) {
-            writer.write(i.first, rowNumBits);
-            ExcAssertLess(i.second, table.size());
-            writer.write(i.second, indexBits);
+/// Frozen column of strings whose values are in the dictionary that the
+/// dataset keeps for the column.  Like the table column, each row has a
+/// bit-packed index into a table, but the table holds the codes of the
+/// chunk's values in the dictionary rather than the values themselves, so
+/// that each string is stored once for the whole dataset and can be
+/// matched by its code.
+struct DictionaryFrozenColumn: public FrozenColumn {
+    DictionaryFrozenColumn(MappedColumnSource & source)
+        : dictionary(source.dictionary)
+    {
+        if (!dictionary) {
+            throw HttpReturnException
+                (500, "Dictionary frozen column must be reconstituted as a "
+                 "fixed column of a tabular dataset");
         }
-
-        if (logger->should_log(spdlog::level::debug)) {
-            size_t mem = memusage();
-            if (mem > 30000) {
-                using namespace std;
-                logger->debug() << "table with " << column.sparseIndexes.size()
-                                << " entries from "
-                                << column.minRowNumber << " to " << column.maxRowNumber
-                                << " and " << table.size()
-                                << " uniques takes " << mem << " memory";
-                
-                for (unsigned i = 0;  i < 5 && i < table.size();  ++i) {
-                    logger->debug() << "  " << table[i];
-                }
+        source.store >> indexBits >> numEntries >> firstEntry >> hasNulls
+                     >> numCodes;
+        columnTypes.reconstitute(source.store);
+        codes = source.mapArray<uint32_t>(numCodes);
+        storage = source.mapArray<uint32_t>((indexBits * numEntries + 31) / 32);
+
+        size_t dictionarySize = dictionary->size();
+        for (size_t i = 0;  i < numCodes;  ++i) {
+            if (codes.get()[i] >= dictionarySize) {
+                throw HttpReturnException
+                    (500, "Code out of range reconstituting dictionary "
+                     "frozen column",
+                     "code", codes.get()[i],
+                     "dictionarySize", dictionarySize);
             }
         }
     }
 
-    virtual bool forEach(const ForEachRowFn & onRow) const
+    DictionaryFrozenColumn(TabularDatasetColumn & column,
+                           std::shared_ptr<ColumnDictionary> dictionary,
+                           std::shared_ptr<StorageAccount> account)
+        : dictionary(dictionary),
+          columnTypes(column.columnTypes)
     {
-        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        firstEntry = column.minRowNumber;
+        numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        hasNulls = column.sparseIndexes.size() < numEntries;
+        numCodes = column.indexedVals.size();
+        indexBits = ML::highest_bit(numCodes + hasNulls) + 1;
 
-        for (size_t i = 0;  i < numEntries;  ++i) {
-            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
-            uint32_t index = bits.extract<uint32_t>(indexBits);
-            if (!onRow(rowNum + firstEntry, table[index]))
-                return false;
+        auto writableCodes = allocateStorageArray<uint32_t>(numCodes, account);
+        uint32_t * codeData = writableCodes.get();
+        codes = writableCodes;
+        for (size_t i = 0;  i < numCodes;  ++i)
+            codeData[i] = dictionary->intern(column.indexedVals[i]);
+
+        size_t numWords = (indexBits * numEntries + 31) / 32;
+        auto writableStorage
+            = allocateStorageArray<uint32_t>(numWords, account);
+        uint32_t * data = writableStorage.get();
+        storage = writableStorage;
+
+        if (!hasNulls) {
+            // Contiguous rows
+            ML::Bit_Writer<uint32_t> writer(data);
+            for (size_t i = 0;  i < column.sparseIndexes.size();  ++i) {
+                ExcAssertEqual(column.sparseIndexes[i].first, i);
+                writer.write(column.sparseIndexes[i].second, indexBits);
+            }
+        }
+        else {
+            // Non-contiguous; leave gaps with a zero (null) value
+            std::fill(data, data + numWords, 0);
+            for (auto & r_i: column.sparseIndexes) {
+                ML::Bit_Writer<uint32_t> writer(data);
+                writer.skip(r_i.first * indexBits);
+                writer.write(r_i.second + 1, indexBits);
+            }
         }
-        
-        return true;
     }
 
-    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    /** Call onIndex with the row number and the index into codes of each
+        row, or -1 for nulls if keepNulls is set.
+    */
+    template<typename Fn>
+    bool forEachIndex(Fn && onIndex, bool keepNulls) const
     {
         ML::Bit_Extractor<uint32_t> bits(storage.get());
 
-        size_t lastRowNum = 0;
         for (size_t i = 0;  i < numEntries;  ++i) {
-            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
-            uint32_t index = bits.extract<uint32_t>(indexBits);
-
-            while (lastRowNum < rowNum) {
-                if (!onRow(firstEntry + lastRowNum, CellValue()))
-                    return false;
-                ++lastRowNum;
+            int index = bits.extract<uint32_t>(indexBits);
+            if (hasNulls) {
+                if (index == 0 && !keepNulls)
+                    continue;  // skip nulls
+                index -= 1;
             }
 
-            if (!onRow(firstEntry + rowNum, table[index]))
+            if (!onIndex(i + firstEntry, index))
                 return false;
         }
 
-        while (firstEntry + lastRowNum <= lastEntry) {
-            if (!onRow(firstEntry + lastRowNum, CellValue()))
-                return false;
-            ++lastRowNum;
-        }
-        
         return true;
     }
 
-    virtual CellValue get(uint32_t rowIndex) const
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
     {
-        CellValue result;
-        if (rowIndex < firstEntry)
-            return result;
-        rowIndex -= firstEntry;
-
-        auto getAtIndex = [&] (uint32_t n)
+        // The values are passed straight from the dictionary, without
+        // being copied
+        CellValue null;
+        auto onIndex = [&] (size_t rowNum, int index)
             {
-                ML::Bit_Extractor<uint32_t> bits(storage.get());
-                bits.advance(n * (indexBits + rowNumBits));
-                uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
-                uint32_t index = bits.extract<uint32_t>(indexBits);
-                return std::make_pair(rowNum, index);
+                return onRow(rowNum,
+                             index < 0 ? null : (*dictionary)[codes.get()[index]]);
             };
 
-        uint32_t first = 0;
-        uint32_t last  = numEntries;
-
-        while (first != last) {
-            uint32_t middle = (first + last) / 2;
-            uint32_t rowNum, index;
-            std::tie(rowNum, index) = getAtIndex(middle);
+        return forEachIndex(onIndex, keepNulls);
+    }
 
-            TRACE_MSG(logger) << "first = " << first << " middle = " << middle
-                              << " last = " << last << " rowNum = " << rowNum
-                              << " looking for " << rowIndex;
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
 
-            if (rowNum == rowIndex) {
-                ExcAssertLess(index, table.size());
-                return result = table[index];
-            }
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
 
-            // Break out if the element isn't there
-            if (first + 1 == last)
-                break;
+    virtual bool forEachCode(const ForEachCodeFn & onRow) const
+    {
+        auto onIndex = [&] (size_t rowNum, int index)
+            {
+                return onRow(rowNum, codes.get()[index]);
+            };
 
-            if (rowNum < rowIndex) {
-                first = middle;
-            }
-            else {
-                last = middle;
-            }
+        return forEachIndex(onIndex, false /* keep nulls */);
+    }
 
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance(rowIndex * indexBits);
+        int index = bits.extract<uint32_t>(indexBits);
+        if (hasNulls) {
+            if (index == 0)
+                return result;
+            index -= 1;
         }
-        
-        return result;
+        return result = (*dictionary)[codes.get()[index]];
     }
 
     virtual size_t size() const
@@ -360,32 +678,333 @@ struct SparseTableFrozenColumn: public FrozenColumn {
 
     virtual size_t memusage() const
     {
-        size_t result
-            = sizeof(*this)
-            + ((indexBits + rowNumBits) * numEntries + 31) / 8;
-
-        for (auto & v: table)
-            result += v.memusage();
-
-        return result;
+        // The values belong to the dictionary, which is shared with the
+        // other chunks
+        return sizeof(*this)
+            + (indexBits * numEntries + 31) / 8
+            + numCodes * sizeof(uint32_t);
     }
 
     virtual bool
     forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
     {
-        if (!fn(CellValue()))
-            return false;
-        for (auto & v: table) {
-            if (!fn(v))
+        if (hasNulls) {
+            if (!fn(CellValue()))
                 return false;
         }
-        
+        for (size_t i = 0;  i < numCodes;  ++i) {
+            if (!fn((*dictionary)[codes.get()[i]]))
+                return false;
+        }
+
         return true;
     }
 
-    virtual ColumnTypes getColumnTypes() const
+    virtual bool
+    forEachDistinctCode(const std::function<bool (uint32_t code)> & fn) const
     {
-        return columnTypes;
+        if (hasNulls) {
+            if (!fn(ColumnDictionary::NOT_FOUND))
+                return false;
+        }
+        for (size_t i = 0;  i < numCodes;  ++i) {
+            if (!fn(codes.get()[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual const ColumnDictionary * getDictionary() const
+    {
+        return dictionary.get();
+    }
+
+    std::shared_ptr<const ColumnDictionary> dictionary;
+    std::shared_ptr<const uint32_t> codes;
+    std::shared_ptr<const uint32_t> storage;
+    uint32_t numCodes;
+    uint32_t indexBits;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    
+    bool hasNulls;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual std::string format() const
+    {
+        return "Dictionary";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << indexBits << numEntries << firstEntry << hasNulls
+                   << numCodes;
+        columnTypes.serialize(sink.store);
+        sink.writeArray(codes.get(), numCodes);
+        sink.writeArray(storage.get(), (indexBits * numEntries + 31) / 32);
+    }
+
+    static size_t bytesRequired(const TabularDatasetColumn & column)
+    {
+        size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        size_t hasNulls = column.sparseIndexes.size() < numEntries;
+        int indexBits = ML::highest_bit(column.indexedVals.size() + hasNulls) + 1;
+        return sizeof(DictionaryFrozenColumn)
+            + (indexBits * numEntries + 31) / 8
+            + column.indexedVals.size() * sizeof(uint32_t);
+    }
+};
+
+struct DictionaryFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~DictionaryFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "Dictionary";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return params.dictionary
+            && column.columnTypes.numStrings > 0
+            && column.columnTypes.onlyStringsAndNulls();
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        return DictionaryFrozenColumn::bytesRequired(column);
+    }
+    
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        return new DictionaryFrozenColumn(column, params.dictionary,
+                                          params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new DictionaryFrozenColumn(source);
+    }
+};
+
+RegisterFrozenColumnFormatT<DictionaryFrozenColumnFormat> regDictionary;
+
+
+/*****************************************************************************/
+/* SPARSE FROZEN COLUMN                                                      */
+/*****************************************************************************/
+
+/// Sparse frozen column that finds each value in a lookup table
+struct SparseTableFrozenColumn: public FrozenColumn {
+    SparseTableFrozenColumn(MappedColumnSource & source)
+    {
+        source.store >> rowNumBits >> indexBits >> numEntries
+                     >> firstEntry >> lastEntry;
+        columnTypes.reconstitute(source.store);
+        reconstituteTable(source.store, table);
+        storage = source.mapArray<uint32_t>
+            (((indexBits + rowNumBits) * numEntries + 31) / 32);
+    }
+
+    SparseTableFrozenColumn(TabularDatasetColumn & column,
+                            std::shared_ptr<StorageAccount> account)
+        : table(column.indexedVals.size()), columnTypes(column.columnTypes)
+    {
+        firstEntry = column.minRowNumber;
+        lastEntry = column.maxRowNumber;
+        std::move(std::make_move_iterator(column.indexedVals.begin()),
+                  std::make_move_iterator(column.indexedVals.end()),
+                  table.begin());
+        indexBits = ML::highest_bit(table.size()) + 1;
+        rowNumBits = ML::highest_bit(column.maxRowNumber - column.minRowNumber) + 1;
+        numEntries = column.sparseIndexes.size();
+        size_t numWords = ((indexBits + rowNumBits) * numEntries + 31) / 32;
+        auto writableStorage
+            = allocateStorageArray<uint32_t>(numWords, account);
+        uint32_t * data = writableStorage.get();
+        storage = writableStorage;
+            
+        ML::Bit_Writer<uint32_t> writer(data);
+        for (auto & i: column.sparseIndexes) {
+            writer.write(i.first, rowNumBits);
+            ExcAssertLess(i.second, table.size());
+            writer.write(i.second, indexBits);
+        }
+
+        if (logger->should_log(spdlog::level::debug)) {
+            size_t mem = memusage();
+            if (mem > 30000) {
+                using namespace std;
+                logger->debug() << "table with " << column.sparseIndexes.size()
+                                << " entries from "
+                                << column.minRowNumber << " to " << column.maxRowNumber
+                                << " and " << table.size()
+                                << " uniques takes " << mem << " memory";
+                
+                for (unsigned i = 0;  i < 5 && i < table.size();  ++i) {
+                    logger->debug() << "  " << table[i];
+                }
+            }
+        }
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+            if (!onRow(rowNum + firstEntry, table[index]))
+                return false;
+        }
+        
+        return true;
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+
+        size_t lastRowNum = 0;
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+
+            while (lastRowNum < rowNum) {
+                if (!onRow(firstEntry + lastRowNum, CellValue()))
+                    return false;
+                ++lastRowNum;
+            }
+
+            if (!onRow(firstEntry + rowNum, table[index]))
+                return false;
+        }
+
+        while (firstEntry + lastRowNum <= lastEntry) {
+            if (!onRow(firstEntry + lastRowNum, CellValue()))
+                return false;
+            ++lastRowNum;
+        }
+        
+        return true;
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+
+        auto getAtIndex = [&] (uint32_t n)
+            {
+                ML::Bit_Extractor<uint32_t> bits(storage.get());
+                bits.advance(n * (indexBits + rowNumBits));
+                uint32_t rowNum = bits.extract<uint32_t>(rowNumBits);
+                uint32_t index = bits.extract<uint32_t>(indexBits);
+                return std::make_pair(rowNum, index);
+            };
+
+        uint32_t first = 0;
+        uint32_t last  = numEntries;
+
+        while (first != last) {
+            uint32_t middle = (first + last) / 2;
+            uint32_t rowNum, index;
+            std::tie(rowNum, index) = getAtIndex(middle);
+
+            TRACE_MSG(logger) << "first = " << first << " middle = " << middle
+                              << " last = " << last << " rowNum = " << rowNum
+                              << " looking for " << rowIndex;
+
+            if (rowNum == rowIndex) {
+                ExcAssertLess(index, table.size());
+                return result = table[index];
+            }
+
+            // Break out if the element isn't there
+            if (first + 1 == last)
+                break;
+
+            if (rowNum < rowIndex) {
+                first = middle;
+            }
+            else {
+                last = middle;
+            }
+
+        }
+        
+        return result;
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        size_t result
+            = sizeof(*this)
+            + ((indexBits + rowNumBits) * numEntries + 31) / 8;
+
+        for (auto & v: table)
+            result += v.memusage();
+
+        return result;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (!fn(CellValue()))
+            return false;
+        for (auto & v: table) {
+            if (!fn(v))
+                return false;
+        }
+        
+        return true;
+    }
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual std::string format() const
+    {
+        return "SparseTable";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << rowNumBits << indexBits << numEntries
+                   << firstEntry << lastEntry;
+        columnTypes.serialize(sink.store);
+        serializeTable(sink.store, table);
+        sink.writeArray(storage.get(),
+                        ((indexBits + rowNumBits) * numEntries + 31) / 32);
     }
 
     static size_t bytesRequired(const TabularDatasetColumn & column)
@@ -445,7 +1064,13 @@ struct SparseTableFrozenColumnFormat: public FrozenColumnFormat {
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const override
     {
-        return new SparseTableFrozenColumn(column);
+        return new SparseTableFrozenColumn(column, params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new SparseTableFrozenColumn(source);
     }
 };
 
@@ -489,51 +1114,656 @@ struct IntegerFrozenColumn: public FrozenColumn {
                 return;
             }
 
-            numEntries = column.maxRowNumber - column.minRowNumber + 1;
-            hasNulls = column.sparseIndexes.size() < numEntries;
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+
+            // If we have too much range to represent nulls then we can't
+            // use this kind of column.
+            if (range == -1 && hasNulls)
+                return;
+                
+#if 0 // later on... we should look for a common multiple to reduce bits used
+   
+            // Check for common multiple
+            std::vector<int64_t> offsets;
+            offsets.reserve(column.indexedVals.size());
+            for (auto & v: column.indexedVals) {
+                if (!v.empty())
+                    offsets.emplace_back(v.toInt());
+            }
+
+            std::sort(offsets.begin(), offsets.end());
+        
+            // Find the multiple
+            for (size_t i = 0;  i < offsets.size() - 1;  ++i) {
+                offsets[i] = offsets[i + 1] - offsets[i];
+            }
+            if (!offsets.empty())
+                offsets.pop_back();
+
+            // Uniquify
+            std::sort(offsets.begin(), offsets.end());
+            offsets.erase(std::unique(offsets.begin(), offsets.end()),
+                          offsets.end());
+        
+            static std::mutex mutex;
+            std::unique_lock<std::mutex> guard(mutex);
+
+            TRACE_MSG(logger) << "got " << offsets.size() << " unique offsets starting at "
+                              << offsets.front();
+
+            for (size_t i = 0;  i < 100 && i < offsets.size() - 1;  ++i) {
+                TRACE_MSG(logger) << "  " << offsets[i];
+            }
+#endif
+            entryBits = ML::highest_bit(range + hasNulls) + 1;
+            numWords = (entryBits * numEntries + 63) / 64;
+            bytesRequired = sizeof(IntegerFrozenColumn) + numWords * 8;
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        uint64_t range;
+        int64_t offset;
+        size_t numEntries;
+        bool hasNulls;
+        size_t numWords;
+        int entryBits;
+    };
+    
+    IntegerFrozenColumn(MappedColumnSource & source)
+    {
+        source.store >> entryBits >> numEntries >> firstEntry >> offset
+                     >> hasNulls;
+        columnTypes.reconstitute(source.store);
+        storage = source.mapArray<uint64_t>((entryBits * numEntries + 63) / 64);
+    }
+
+    IntegerFrozenColumn(TabularDatasetColumn & column,
+                        std::shared_ptr<StorageAccount> account)
+        : columnTypes(column.columnTypes)
+    {
+        SizingInfo info(column);
+        ExcAssertNotEqual(info.bytesRequired, -1);
+
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+
+        // Check it's really feasible
+        ExcAssert(column.columnTypes.onlyIntegersAndNulls());
+        ExcAssertLessEqual(column.columnTypes.maxPositiveInteger,
+                           (uint64_t)std::numeric_limits<int64_t>::max());
+
+        hasNulls = info.hasNulls;
+        entryBits = info.entryBits;
+        offset = info.offset;
+        auto writableStorage
+            = allocateStorageArray<uint64_t>(info.numWords, account);
+        uint64_t * data = writableStorage.get();
+        storage = writableStorage;
+
+        if (!hasNulls) {
+            // Contiguous rows
+            DEBUG_MSG(logger) << "fill with contiguous";
+            ML::Bit_Writer<uint64_t> writer(data);
+            for (size_t i = 0;  i < column.sparseIndexes.size();  ++i) {
+                ExcAssertEqual(column.sparseIndexes[i].first, i);
+                int64_t val
+                    = column.indexedVals[column.sparseIndexes[i].second].toInt();
+                DEBUG_MSG(logger) << "writing " << val << " - " << offset << " = "
+                                  << val - offset << " at " << i;
+                writer.write(val - offset, entryBits);
+            }
+        }
+        else {
+            // Non-contiguous; leave gaps with a zero (null) value
+            std::fill(data, data + info.numWords, 0);
+            for (auto & r_i: column.sparseIndexes) {
+                int64_t val
+                    = column.indexedVals[r_i.second].toInt();
+                ML::Bit_Writer<uint64_t> writer(data);
+                writer.skip(r_i.first * entryBits);
+                writer.write(val - offset + 1, entryBits);
+            }
+        }
+
+#if 0
+        // Check that we got the right thing
+        for (auto & i: column.sparseIndexes) {
+            DEBUG_MSG(logger) << "getting " << i.first << " with value "
+                              << column.indexedVals.at(i.second);
+            ExcAssertEqual(get(i.first + firstEntry),
+                           column.indexedVals.at(i.second));
+        }
+#endif
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            int64_t val = bits.extract<uint64_t>(entryBits);
+            if (hasNulls) {
+                if (val == 0) {
+                    if (keepNulls && (!onRow(i + firstEntry, CellValue())))
+                        return false;
+                }
+                else {
+                    if (!onRow(i + firstEntry, val + offset - 1))
+                        return false;
+                }
+            }
+            else {
+                if (!onRow(i + firstEntry, val + offset))
+                    return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        ExcAssertLess(rowIndex, numEntries);
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bits.advance(rowIndex * entryBits);
+        int64_t val = bits.extract<uint64_t>(entryBits);
+        if (hasNulls) {
+            if (val == 0)
+                return result;
+            else return result = val + offset - 1;
+        }
+        else {
+            return result = val + offset;
+        }
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        size_t result
+            = sizeof(*this)
+            + (entryBits * numEntries + 63) / 8;
+
+        return result;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        // Handle nulls first so we don't have to do them later
+        if (hasNulls && !fn(CellValue()))
+            return false;
+
+        std::vector<int64_t> allVals;
+        allVals.reserve(numEntries);
+
+        ML::Bit_Extractor<uint64_t> bits(storage.get());
+        
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            int64_t val = bits.extract<uint64_t>(entryBits);
+            if (val == 0 && hasNulls)
+                continue;
+            allVals.push_back(val);
+        }
+
+        std::sort(allVals.begin(), allVals.end());
+        auto endIt = std::unique(allVals.begin(), allVals.end());
+
+        for (auto it = allVals.begin();  it != endIt;  ++it) {
+            if (!fn(*it + offset - hasNulls))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const uint64_t> storage;
+    uint32_t entryBits;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    int64_t offset;
+
+    bool hasNulls;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual std::string format() const
+    {
+        return "Integer";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << entryBits << numEntries << firstEntry << offset
+                   << hasNulls;
+        columnTypes.serialize(sink.store);
+        sink.writeArray(storage.get(), (entryBits * numEntries + 63) / 64);
+    }
+
+    static ssize_t bytesRequired(const TabularDatasetColumn & column)
+    {
+        return SizingInfo(column);
+    }
+};
+
+struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
+    
+    virtual ~IntegerFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "Integer";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return column.columnTypes.onlyIntegersAndNulls()
+            && column.columnTypes.maxPositiveInteger
+            <= (uint64_t)std::numeric_limits<int64_t>::max();
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        return IntegerFrozenColumn::bytesRequired(column);
+    }
+    
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        return new IntegerFrozenColumn(column, params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new IntegerFrozenColumn(source);
+    }
+};
+
+RegisterFrozenColumnFormatT<IntegerFrozenColumnFormat> regInteger;
+
+
+/*****************************************************************************/
+/* RUN LENGTH FROZEN COLUMN                                                  */
+/*****************************************************************************/
+
+/** Frozen column that stores runs of identical values, each of which is an
+    index into a lookup table.  This is very compact for sorted or
+    clustered columns, where the number of runs is much smaller than the
+    number of rows.
+*/
+struct RunLengthFrozenColumn: public FrozenColumn {
+
+    /** Call onRun(startRow, index) for each run in the column, where the
+        start row is relative to minRowNumber and the index is into the
+        table, offset by one if there are nulls (with zero meaning null).
+    */
+    template<typename Fn>
+    static void forEachRun(const TabularDatasetColumn & column,
+                           size_t numEntries, bool hasNulls, Fn && onRun)
+    {
+        int64_t current = -1;  // no run yet
+        uint32_t nextRow = 0;
+
+        for (auto & r_i: column.sparseIndexes) {
+            if (r_i.first > nextRow && current != 0) {
+                // gap of nulls
+                onRun(nextRow, 0);
+                current = 0;
+            }
+            uint32_t index = r_i.second + hasNulls;
+            if (index != current) {
+                onRun(r_i.first, index);
+                current = index;
+            }
+            nextRow = r_i.first + 1;
+        }
+
+        if (nextRow < numEntries && current != 0)
+            onRun(nextRow, 0);
+    }
+
+    static size_t countRuns(const TabularDatasetColumn & column,
+                            size_t numEntries, bool hasNulls)
+    {
+        size_t result = 0;
+        forEachRun(column, numEntries, hasNulls,
+                   [&] (uint32_t, uint32_t) { ++result; });
+        return result;
+    }
+
+    RunLengthFrozenColumn(MappedColumnSource & source)
+    {
+        source.store >> indexBits >> numEntries >> numRuns >> firstEntry
+                     >> hasNulls;
+        columnTypes.reconstitute(source.store);
+        reconstituteTable(source.store, table);
+        runStarts = source.mapArray<uint32_t>(numRuns);
+        runValues = source.mapArray<uint32_t>(numValueWords());
+    }
+
+    RunLengthFrozenColumn(TabularDatasetColumn & column,
+                          std::shared_ptr<StorageAccount> account)
+        : table(std::move(column.indexedVals)),
+          columnTypes(column.columnTypes)
+    {
+        firstEntry = column.minRowNumber;
+        numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        hasNulls = column.sparseIndexes.size() < numEntries;
+        indexBits = ML::highest_bit(table.size() + hasNulls) + 1;
+        numRuns = countRuns(column, numEntries, hasNulls);
+
+        auto writableStarts = allocateStorageArray<uint32_t>(numRuns, account);
+        uint32_t * starts = writableStarts.get();
+        runStarts = writableStarts;
+        size_t numWords = numValueWords();
+        auto writableValues = allocateStorageArray<uint32_t>(numWords, account);
+        uint32_t * values = writableValues.get();
+        runValues = writableValues;
+
+        ML::Bit_Writer<uint32_t> writer(values);
+        size_t n = 0;
+        auto onRun = [&] (uint32_t start, uint32_t index)
+            {
+                starts[n++] = start;
+                writer.write(index, indexBits);
+            };
+
+        forEachRun(column, numEntries, hasNulls, onRun);
+        ExcAssertEqual(n, numRuns);
+    }
+
+    size_t numValueWords() const
+    {
+        // Always at least one word, so the bit extractor has something
+        // to read
+        return std::max<size_t>(1, (indexBits * numRuns + 31) / 32);
+    }
+
+    /// Return the end row (relative to firstEntry) of the given run
+    uint32_t runEnd(size_t run) const
+    {
+        return run + 1 < numRuns ? runStarts.get()[run + 1] : numEntries;
+    }
+
+    CellValue getValue(uint32_t index) const
+    {
+        if (hasNulls) {
+            if (index == 0)
+                return CellValue();
+            return table[index - 1];
+        }
+        return table[index];
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(runValues.get());
+
+        for (size_t i = 0;  i < numRuns;  ++i) {
+            uint32_t index = bits.extract<uint32_t>(indexBits);
+            if (hasNulls && index == 0 && !keepNulls)
+                continue;  // skip the whole run of nulls
+            CellValue val = getValue(index);
+            for (uint32_t j = runStarts.get()[i], e = runEnd(i);  j < e;  ++j) {
+                if (!onRow(j + firstEntry, val))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+
+        // Find the last run that starts at or before the row
+        const uint32_t * starts = runStarts.get();
+        size_t run = std::upper_bound(starts, starts + numRuns, rowIndex)
+            - starts - 1;
+        ExcAssertLess(run, numRuns);
+
+        ML::Bit_Extractor<uint32_t> bits(runValues.get());
+        bits.advance(run * indexBits);
+        return result = getValue(bits.extract<uint32_t>(indexBits));
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        size_t result
+            = sizeof(*this)
+            + numRuns * sizeof(uint32_t)
+            + numValueWords() * sizeof(uint32_t);
+
+        for (auto & v: table)
+            result += v.memusage();
+
+        return result;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls) {
+            if (!fn(CellValue()))
+                return false;
+        }
+        for (auto & v: table) {
+            if (!fn(v))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const uint32_t> runStarts;
+    std::shared_ptr<const uint32_t> runValues;
+    uint32_t indexBits;
+    uint32_t numEntries;
+    uint32_t numRuns;
+    uint64_t firstEntry;
+
+    bool hasNulls;
+    std::vector<CellValue> table;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+
+    virtual std::string format() const
+    {
+        return "RunLength";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << indexBits << numEntries << numRuns << firstEntry
+                   << hasNulls;
+        columnTypes.serialize(sink.store);
+        serializeTable(sink.store, table);
+        sink.writeArray(runStarts.get(), numRuns);
+        sink.writeArray(runValues.get(), numValueWords());
+    }
+
+    static size_t bytesRequired(const TabularDatasetColumn & column)
+    {
+        size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
+        bool hasNulls = column.sparseIndexes.size() < numEntries;
+        int indexBits = ML::highest_bit(column.indexedVals.size() + hasNulls) + 1;
+        size_t numRuns = countRuns(column, numEntries, hasNulls);
+
+        size_t result
+            = sizeof(RunLengthFrozenColumn)
+            + numRuns * sizeof(uint32_t)
+            + std::max<size_t>(1, (indexBits * numRuns + 31) / 32) * 4;
+
+        for (auto & v: column.indexedVals)
+            result += v.memusage();
+
+        return result;
+    }
+};
+
+struct RunLengthFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~RunLengthFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "RunLength";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return true;
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        return RunLengthFrozenColumn::bytesRequired(column);
+    }
+    
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        return new RunLengthFrozenColumn(column, params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new RunLengthFrozenColumn(source);
+    }
+};
+
+RegisterFrozenColumnFormatT<RunLengthFrozenColumnFormat> regRunLength;
 
-            // If we have too much range to represent nulls then we can't
-            // use this kind of column.
-            if (range == -1 && hasNulls)
-                return;
-                
-#if 0 // later on... we should look for a common multiple to reduce bits used
-   
-            // Check for common multiple
-            std::vector<int64_t> offsets;
-            offsets.reserve(column.indexedVals.size());
-            for (auto & v: column.indexedVals) {
-                if (!v.empty())
-                    offsets.emplace_back(v.toInt());
-            }
 
-            std::sort(offsets.begin(), offsets.end());
-        
-            // Find the multiple
-            for (size_t i = 0;  i < offsets.size() - 1;  ++i) {
-                offsets[i] = offsets[i + 1] - offsets[i];
-            }
-            if (!offsets.empty())
-                offsets.pop_back();
+/*****************************************************************************/
+/* DELTA INTEGER FROZEN COLUMN                                               */
+/*****************************************************************************/
 
-            // Uniquify
-            std::sort(offsets.begin(), offsets.end());
-            offsets.erase(std::unique(offsets.begin(), offsets.end()),
-                          offsets.end());
-        
-            static std::mutex mutex;
-            std::unique_lock<std::mutex> guard(mutex);
+/** Frozen column for dense integer columns that stores the difference
+    between each value and the previous one, frame-of-reference encoded
+    against the minimum difference and bit-packed.  For sorted columns like
+    timestamps or sequence numbers, the differences need far fewer bits
+    than the values themselves.
 
-            TRACE_MSG(logger) << "got " << offsets.size() << " unique offsets starting at "
-                              << offsets.front();
+    The absolute value is stored every BLOCK_SIZE rows so that random
+    access only needs to sum up the differences within one block.
+*/
+struct DeltaIntegerFrozenColumn: public FrozenColumn {
 
-            for (size_t i = 0;  i < 100 && i < offsets.size() - 1;  ++i) {
-                TRACE_MSG(logger) << "  " << offsets[i];
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            if (!column.columnTypes.onlyIntegers())
+                return;  // nulls or non-integers; can't use this column type
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            if (column.sparseIndexes.size() != numEntries)
+                return;  // sparse
+
+            // Make sure that we can't overflow when taking differences
+            static constexpr int64_t LIMIT = int64_t(1) << 61;
+            if (column.columnTypes.maxPositiveInteger > (uint64_t)LIMIT)
+                return;
+            if (column.columnTypes.hasNegativeIntegers()
+                && column.columnTypes.minNegativeInteger < -LIMIT)
+                return;
+            if (numEntries < 2)
+                return;  // nothing to gain
+
+            int64_t last = column.indexedVals[column.sparseIndexes[0].second].toInt();
+            minDelta = std::numeric_limits<int64_t>::max();
+            int64_t maxDelta = std::numeric_limits<int64_t>::min();
+            for (size_t i = 1;  i < numEntries;  ++i) {
+                int64_t val = column.indexedVals[column.sparseIndexes[i].second].toInt();
+                int64_t delta = val - last;
+                minDelta = std::min(minDelta, delta);
+                maxDelta = std::max(maxDelta, delta);
+                last = val;
             }
-#endif
-            entryBits = ML::highest_bit(range + hasNulls) + 1;
-            numWords = (entryBits * numEntries + 63) / 64;
-            bytesRequired = sizeof(IntegerFrozenColumn) + numWords * 8;
+
+            entryBits = ML::highest_bit(maxDelta - minDelta) + 1;
+            numBlocks = (numEntries + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            numWords = std::max<size_t>(1, (entryBits * numEntries + 63) / 64);
+            bytesRequired = sizeof(DeltaIntegerFrozenColumn)
+                + numBlocks * 8 + numWords * 8;
         }
 
         operator ssize_t () const
@@ -542,15 +1772,23 @@ struct IntegerFrozenColumn: public FrozenColumn {
         }
 
         ssize_t bytesRequired = -1;
-        uint64_t range;
-        int64_t offset;
+        int64_t minDelta;
         size_t numEntries;
-        bool hasNulls;
+        size_t numBlocks;
         size_t numWords;
         int entryBits;
     };
-    
-    IntegerFrozenColumn(TabularDatasetColumn & column)
+
+    DeltaIntegerFrozenColumn(MappedColumnSource & source)
+    {
+        source.store >> entryBits >> numEntries >> firstEntry >> minDelta;
+        columnTypes.reconstitute(source.store);
+        checkpoints = source.mapArray<int64_t>(numBlocks());
+        storage = source.mapArray<uint64_t>(numWords());
+    }
+
+    DeltaIntegerFrozenColumn(TabularDatasetColumn & column,
+                             std::shared_ptr<StorageAccount> account)
         : columnTypes(column.columnTypes)
     {
         SizingInfo info(column);
@@ -558,88 +1796,92 @@ struct IntegerFrozenColumn: public FrozenColumn {
 
         firstEntry = column.minRowNumber;
         numEntries = info.numEntries;
-
-        // Check it's really feasible
-        ExcAssert(column.columnTypes.onlyIntegersAndNulls());
-        ExcAssertLessEqual(column.columnTypes.maxPositiveInteger,
-                           (uint64_t)std::numeric_limits<int64_t>::max());
-
-        hasNulls = info.hasNulls;
         entryBits = info.entryBits;
-        offset = info.offset;
-        uint64_t * data = new uint64_t[info.numWords];
-        storage = std::shared_ptr<uint64_t>(data, [] (uint64_t * p) { delete[] p; });
-
-        if (!hasNulls) {
-            // Contiguous rows
-            DEBUG_MSG(logger) << "fill with contiguous";
-            ML::Bit_Writer<uint64_t> writer(data);
-            for (size_t i = 0;  i < column.sparseIndexes.size();  ++i) {
-                ExcAssertEqual(column.sparseIndexes[i].first, i);
-                int64_t val
-                    = column.indexedVals[column.sparseIndexes[i].second].toInt();
-                DEBUG_MSG(logger) << "writing " << val << " - " << offset << " = "
-                                  << val - offset << " at " << i;
-                writer.write(val - offset, entryBits);
+        minDelta = info.minDelta;
+
+        auto writableCheckpoints
+            = allocateStorageArray<int64_t>(info.numBlocks, account);
+        int64_t * blocks = writableCheckpoints.get();
+        checkpoints = writableCheckpoints;
+        auto writableStorage
+            = allocateStorageArray<uint64_t>(info.numWords, account);
+        uint64_t * data = writableStorage.get();
+        storage = writableStorage;
+
+        // The first entry of each block has its absolute value stored in
+        // the checkpoints, and a zero delta.
+        ML::Bit_Writer<uint64_t> writer(data);
+        int64_t last = 0;
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            ExcAssertEqual(column.sparseIndexes[i].first, i);
+            int64_t val = column.indexedVals[column.sparseIndexes[i].second].toInt();
+            if (i % BLOCK_SIZE == 0) {
+                blocks[i / BLOCK_SIZE] = val;
+                writer.write(0, entryBits);
             }
-        }
-        else {
-            // Non-contiguous; leave gaps with a zero (null) value
-            std::fill(data, data + info.numWords, 0);
-            for (auto & r_i: column.sparseIndexes) {
-                int64_t val
-                    = column.indexedVals[r_i.second].toInt();
-                ML::Bit_Writer<uint64_t> writer(data);
-                writer.skip(r_i.first * entryBits);
-                writer.write(val - offset + 1, entryBits);
+            else {
+                writer.write(val - last - minDelta, entryBits);
             }
+            last = val;
         }
+    }
 
-#if 0
-        // Check that we got the right thing
-        for (auto & i: column.sparseIndexes) {
-            DEBUG_MSG(logger) << "getting " << i.first << " with value "
-                              << column.indexedVals.at(i.second);
-            ExcAssertEqual(get(i.first + firstEntry),
-                           column.indexedVals.at(i.second));
-        }
-#endif
+    size_t numBlocks() const
+    {
+        return (numEntries + BLOCK_SIZE - 1) / BLOCK_SIZE;
     }
 
-    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    size_t numWords() const
+    {
+        return std::max<size_t>(1, (entryBits * numEntries + 63) / 64);
+    }
+
+    /** Decode an entire block into the given buffer, returning the number
+        of values decoded.  Decoding a block at a time keeps the inner loop
+        free of any calls so that it runs as fast as possible.
+    */
+    size_t decodeBlock(size_t block, int64_t * output) const
     {
+        size_t start = block * BLOCK_SIZE;
+        size_t n = std::min<size_t>(BLOCK_SIZE, numEntries - start);
+
         ML::Bit_Extractor<uint64_t> bits(storage.get());
+        bits.advance((start + 1) * entryBits);
 
-        for (size_t i = 0;  i < numEntries;  ++i) {
-            int64_t val = bits.extract<uint64_t>(entryBits);
-            if (hasNulls) {
-                if (val == 0) {
-                    if (keepNulls && (!onRow(i + firstEntry, CellValue())))
-                        return false;
-                }
-                else {
-                    if (!onRow(i + firstEntry, val + offset - 1))
-                        return false;
-                }
-            }
-            else {
-                if (!onRow(i + firstEntry, val + offset))
+        int64_t val = checkpoints.get()[block];
+        output[0] = val;
+        for (size_t i = 1;  i < n;  ++i) {
+            val += (int64_t)bits.extract<uint64_t>(entryBits) + minDelta;
+            output[i] = val;
+        }
+
+        return n;
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow) const
+    {
+        int64_t values[BLOCK_SIZE];
+
+        for (size_t b = 0;  b < numBlocks();  ++b) {
+            size_t n = decodeBlock(b, values);
+            for (size_t i = 0;  i < n;  ++i) {
+                if (!onRow(b * BLOCK_SIZE + i + firstEntry, values[i]))
                     return false;
             }
         }
 
         return true;
-
     }
 
     virtual bool forEach(const ForEachRowFn & onRow) const
     {
-        return forEachImpl(onRow, false /* keep nulls */);
+        return forEachImpl(onRow);
     }
 
     virtual bool forEachDense(const ForEachRowFn & onRow) const
     {
-        return forEachImpl(onRow, true /* keep nulls */);
+        // There are never any nulls
+        return forEachImpl(onRow);
     }
 
     virtual CellValue get(uint32_t rowIndex) const
@@ -650,18 +1892,18 @@ struct IntegerFrozenColumn: public FrozenColumn {
         rowIndex -= firstEntry;
         if (rowIndex >= numEntries)
             return result;
-        ExcAssertLess(rowIndex, numEntries);
+
+        size_t block = rowIndex / BLOCK_SIZE;
+        size_t start = block * BLOCK_SIZE;
+        int64_t val = checkpoints.get()[block];
+
         ML::Bit_Extractor<uint64_t> bits(storage.get());
-        bits.advance(rowIndex * entryBits);
-        int64_t val = bits.extract<uint64_t>(entryBits);
-        if (hasNulls) {
-            if (val == 0)
-                return result;
-            else return result = val + offset - 1;
-        }
-        else {
-            return result = val + offset;
+        bits.advance((start + 1) * entryBits);
+        for (size_t i = start + 1;  i <= rowIndex;  ++i) {
+            val += (int64_t)bits.extract<uint64_t>(entryBits) + minDelta;
         }
+
+        return result = val;
     }
 
     virtual size_t size() const
@@ -671,50 +1913,39 @@ struct IntegerFrozenColumn: public FrozenColumn {
 
     virtual size_t memusage() const
     {
-        size_t result
-            = sizeof(*this)
-            + (entryBits * numEntries + 63) / 8;
-
-        return result;
+        return sizeof(*this) + numBlocks() * 8 + numWords() * 8;
     }
 
     virtual bool
     forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
     {
-        // Handle nulls first so we don't have to do them later
-        if (hasNulls && !fn(CellValue()))
-            return false;
-
         std::vector<int64_t> allVals;
         allVals.reserve(numEntries);
 
-        ML::Bit_Extractor<uint64_t> bits(storage.get());
-        
-        for (size_t i = 0;  i < numEntries;  ++i) {
-            int64_t val = bits.extract<uint64_t>(entryBits);
-            if (val == 0 && hasNulls)
-                continue;
-            allVals.push_back(val);
+        int64_t values[BLOCK_SIZE];
+        for (size_t b = 0;  b < numBlocks();  ++b) {
+            size_t n = decodeBlock(b, values);
+            allVals.insert(allVals.end(), values, values + n);
         }
 
         std::sort(allVals.begin(), allVals.end());
         auto endIt = std::unique(allVals.begin(), allVals.end());
 
         for (auto it = allVals.begin();  it != endIt;  ++it) {
-            if (!fn(*it + offset - hasNulls))
+            if (!fn(*it))
                 return false;
         }
 
         return true;
     }
 
+    std::shared_ptr<const int64_t> checkpoints;
     std::shared_ptr<const uint64_t> storage;
     uint32_t entryBits;
     uint32_t numEntries;
     uint64_t firstEntry;
-    int64_t offset;
+    int64_t minDelta;
 
-    bool hasNulls;
     ColumnTypes columnTypes;
 
     virtual ColumnTypes getColumnTypes() const
@@ -722,30 +1953,43 @@ struct IntegerFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    virtual std::string format() const
+    {
+        return "DeltaInteger";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << entryBits << numEntries << firstEntry << minDelta;
+        columnTypes.serialize(sink.store);
+        sink.writeArray(checkpoints.get(), numBlocks());
+        sink.writeArray(storage.get(), numWords());
+    }
+
     static ssize_t bytesRequired(const TabularDatasetColumn & column)
     {
         return SizingInfo(column);
     }
 };
 
-struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
+struct DeltaIntegerFrozenColumnFormat: public FrozenColumnFormat {
     
-    virtual ~IntegerFrozenColumnFormat()
+    virtual ~DeltaIntegerFrozenColumnFormat()
     {
     }
 
     virtual std::string format() const override
     {
-        return "Integer";
+        return "DeltaInteger";
     }
 
     virtual bool isFeasible(const TabularDatasetColumn & column,
                             const ColumnFreezeParameters & params,
                             std::shared_ptr<void> & cachedInfo) const override
     {
-        return column.columnTypes.onlyIntegersAndNulls()
-            && column.columnTypes.maxPositiveInteger
-            <= (uint64_t)std::numeric_limits<int64_t>::max();
+        return column.columnTypes.onlyIntegers()
+            && column.sparseIndexes.size()
+               == column.maxRowNumber - column.minRowNumber + 1;
     }
 
     virtual ssize_t columnSize(const TabularDatasetColumn & column,
@@ -753,7 +1997,7 @@ struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
                                ssize_t previousBest,
                                std::shared_ptr<void> & cachedInfo) const override
     {
-        return IntegerFrozenColumn::bytesRequired(column);
+        return DeltaIntegerFrozenColumn::bytesRequired(column);
     }
     
     virtual FrozenColumn *
@@ -761,11 +2005,17 @@ struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const override
     {
-        return new IntegerFrozenColumn(column);
+        return new DeltaIntegerFrozenColumn(column, params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new DeltaIntegerFrozenColumn(source);
     }
 };
 
-RegisterFrozenColumnFormatT<IntegerFrozenColumnFormat> regInteger;
+RegisterFrozenColumnFormatT<DeltaIntegerFrozenColumnFormat> regDeltaInteger;
 
 
 /*****************************************************************************/
@@ -840,7 +2090,15 @@ struct DoubleFrozenColumn: public FrozenColumn {
         }
     };
 
-    DoubleFrozenColumn(TabularDatasetColumn & column)
+    DoubleFrozenColumn(MappedColumnSource & source)
+    {
+        source.store >> numEntries >> firstEntry;
+        columnTypes.reconstitute(source.store);
+        storage = source.mapArray<Entry>(numEntries);
+    }
+
+    DoubleFrozenColumn(TabularDatasetColumn & column,
+                       std::shared_ptr<StorageAccount> account)
         : columnTypes(column.columnTypes)
     {
         SizingInfo info(column);
@@ -851,8 +2109,11 @@ struct DoubleFrozenColumn: public FrozenColumn {
 
         // Check it's really feasible
         ExcAssert(column.columnTypes.onlyDoublesAndNulls());
-        Entry * data = new Entry[info.numEntries];
-        storage = std::shared_ptr<Entry>(data, [] (Entry * p) { delete[] p; });
+        auto writableStorage
+            = allocateStorageArray<Entry>(info.numEntries, account);
+        Entry * data = writableStorage.get();
+        std::fill(data, data + info.numEntries, Entry());
+        storage = writableStorage;
 
         for (auto & r_i: column.sparseIndexes) {
             const CellValue & v = column.indexedVals[r_i.second];
@@ -967,6 +2228,18 @@ struct DoubleFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    virtual std::string format() const
+    {
+        return "Double";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        sink.store << numEntries << firstEntry;
+        columnTypes.serialize(sink.store);
+        sink.writeArray(storage.get(), numEntries);
+    }
+
     static ssize_t bytesRequired(const TabularDatasetColumn & column)
     {
         return SizingInfo(column);
@@ -1004,7 +2277,13 @@ struct DoubleFrozenColumnFormat: public FrozenColumnFormat {
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const override
     {
-        return new DoubleFrozenColumn(column);
+        return new DoubleFrozenColumn(column, params.storage);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new DoubleFrozenColumn(source);
     }
 };
 
@@ -1021,6 +2300,12 @@ struct TimestampFrozenColumn: public FrozenColumn {
     // This stores the underlying doubles or CellValues 
     std::shared_ptr<const FrozenColumn> unwrapped;
 
+    TimestampFrozenColumn(MappedColumnSource & source)
+    {
+        columnTypes.reconstitute(source.store);
+        unwrapped = FrozenColumn::reconstitute(source);
+    }
+
     TimestampFrozenColumn(TabularDatasetColumn & column,
                           const ColumnFreezeParameters & params)
         : columnTypes(column.columnTypes)
@@ -1100,6 +2385,17 @@ struct TimestampFrozenColumn: public FrozenColumn {
     {
         return columnTypes;
     }
+
+    virtual std::string format() const
+    {
+        return "Timestamp";
+    }
+
+    virtual void serialize(MappedColumnSink & sink) const
+    {
+        columnTypes.serialize(sink.store);
+        serializeColumn(*unwrapped, sink);
+    }
 };
 
 struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
@@ -1137,6 +2433,12 @@ struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new TimestampFrozenColumn(column, params);
     }
+
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const override
+    {
+        return new TimestampFrozenColumn(source);
+    }
 };
 
 RegisterFrozenColumnFormatT<TimestampFrozenColumnFormat> regTimestamp;
@@ -1165,6 +2467,15 @@ FrozenColumnFormat::
 {
 }
 
+FrozenColumn *
+FrozenColumnFormat::
+reconstitute(MappedColumnSource & source) const
+{
+    throw HttpReturnException
+        (500, "Frozen column format " + format()
+         + " does not support reconstitution");
+}
+
 std::shared_ptr<void>
 FrozenColumnFormat::
 registerFormat(std::shared_ptr<FrozenColumnFormat> format)
@@ -1203,6 +2514,28 @@ registerFormat(std::shared_ptr<FrozenColumnFormat> format)
     }
 }
 
+std::shared_ptr<const FrozenColumnFormat>
+FrozenColumnFormat::
+find(const std::string & name)
+{
+    auto formats = getFormats().load();
+    auto it = formats->find(name);
+    if (it == formats->end())
+        return nullptr;
+    return it->second;
+}
+
+std::vector<std::string>
+FrozenColumnFormat::
+formatNames()
+{
+    auto formats = getFormats().load();
+    std::vector<std::string> result;
+    for (auto & f: *formats)
+        result.push_back(f.first);
+    return result;
+}
+
 
 /*****************************************************************************/
 /* FROZEN COLUMN                                                             */
@@ -1265,6 +2598,69 @@ freeze(TabularDatasetColumn & column,
     return res.second(column);
 }
 
+const ColumnDictionary *
+FrozenColumn::
+getDictionary() const
+{
+    return nullptr;
+}
+
+bool
+FrozenColumn::
+forEachCode(const ForEachCodeFn & onRow) const
+{
+    throw HttpReturnException
+        (500, "Frozen column format " + format()
+         + " does not store dictionary codes");
+}
+
+bool
+FrozenColumn::
+forEachDistinctCode(const std::function<bool (uint32_t code)> & fn) const
+{
+    throw HttpReturnException
+        (500, "Frozen column format " + format()
+         + " does not store dictionary codes");
+}
+
+void
+FrozenColumn::
+serialize(MappedColumnSink & sink) const
+{
+    throw HttpReturnException
+        (500, "Frozen column format " + format()
+         + " does not support serialization");
+}
+
+void
+FrozenColumn::
+serializeColumn(const FrozenColumn & column,
+                MappedColumnSink & sink)
+{
+    sink.store << column.format();
+    column.serialize(sink);
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+reconstitute(MappedColumnSource & source)
+{
+    std::string format;
+    source.store >> format;
+
+    auto formats = getFormats().load();
+    auto it = formats->find(format);
+    if (it == formats->end()) {
+        throw HttpReturnException
+            (500, "Unknown frozen column format '" + format
+             + "' reconstituting column; is the plugin that provides it "
+             "loaded?",
+             "format", format);
+    }
+
+    return std::shared_ptr<FrozenColumn>(it->second->reconstitute(source));
+}
+
 
 } // namespace MLDB
 
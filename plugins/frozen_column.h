@@ -10,13 +10,141 @@
 
 #include "column_types.h"
 #include "mldb/utils/log.h"
+#include "mldb/sql/cell_value.h"
 #include "mldb/plugins/tabular_dataset.h"
+#include "mldb/jml/db/persistent_fwd.h"
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 
 namespace MLDB {
 
 struct TabularDatasetColumn;
+struct ColumnDictionary;
+struct StorageAccount;
+
+
+/*****************************************************************************/
+/* MAPPED COLUMN SOURCE                                                      */
+/*****************************************************************************/
+
+/** Source from which frozen columns are reconstituted.  This wraps a
+    store reader that points into memory that was usually obtained by
+    memory mapping a file.  Bulk data (bit-packed values, etc) is not copied
+    out of the mapping; instead the columns hold onto pointers that alias
+    the mapped memory and keep it alive via the owner.
+*/
+
+struct MappedColumnSource {
+    MappedColumnSource(ML::DB::Store_Reader & store,
+                       std::shared_ptr<const void> owner)
+        : store(store), owner(std::move(owner))
+    {
+    }
+
+    ML::DB::Store_Reader & store;
+    std::shared_ptr<const void> owner;
+
+    /// Dictionary that the column being reconstituted has its values in,
+    /// if it's one of the dataset's fixed columns
+    std::shared_ptr<const ColumnDictionary> dictionary;
+
+    /** Return a pointer to an array of numElements elements of type T at
+        the current position of the store, and skip over it.  The array
+        must have been written with MappedColumnSink::writeArray().
+    */
+    template<typename T>
+    std::shared_ptr<const T> mapArray(size_t numElements)
+    {
+        return std::shared_ptr<const T>
+            (owner, reinterpret_cast<const T *>(mapBytes(numElements * sizeof(T))));
+    }
+
+    const char * mapBytes(size_t numBytes);
+};
+
+
+/*****************************************************************************/
+/* MAPPED COLUMN SINK                                                        */
+/*****************************************************************************/
+
+/** Sink to which frozen columns are serialized.  Arrays are written aligned
+    to an 8 byte boundary so that they can be used directly once the file
+    is memory mapped back in.
+*/
+
+struct MappedColumnSink {
+    MappedColumnSink(ML::DB::Store_Writer & store)
+        : store(store)
+    {
+    }
+
+    ML::DB::Store_Writer & store;
+
+    template<typename T>
+    void writeArray(const T * data, size_t numElements)
+    {
+        writeBytes(reinterpret_cast<const char *>(data),
+                   numElements * sizeof(T));
+    }
+
+    void writeBytes(const char * data, size_t numBytes);
+};
+
+
+/*****************************************************************************/
+/* COLUMN DICTIONARY                                                         */
+/*****************************************************************************/
+
+/** Dictionary of the string values of one column, shared by all of the
+    chunks of a dataset so that each distinct string is stored once and
+    has the same code in every chunk.  It is append only: values are added
+    as chunks are frozen, and a code never changes once it's been given.
+
+    intern() and find() may be called from any thread.  The values
+    themselves are read without a lock, so the dictionary must not be
+    added to while the columns that use it are being read, which holds for
+    the tabular dataset as its chunks are only read once it's committed.
+*/
+
+struct ColumnDictionary {
+
+    /// Code returned by find() for a value that isn't in the dictionary,
+    /// and passed for nulls to FrozenColumn::forEachDistinctCode()
+    static constexpr uint32_t NOT_FOUND = -1;
+
+    /** Return the code of the given value, adding it if it's not already
+        in the dictionary.
+    */
+    uint32_t intern(const CellValue & val);
+
+    /** Return the code of the given value, or NOT_FOUND if no chunk has
+        added it.
+    */
+    uint32_t find(const CellValue & val) const;
+
+    /** Return the value with the given code. */
+    const CellValue & operator [] (uint32_t code) const
+    {
+        return values[code];
+    }
+
+    size_t size() const;
+
+    size_t memusage() const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+
+    static std::shared_ptr<ColumnDictionary>
+    reconstitute(ML::DB::Store_Reader & store);
+
+private:
+    mutable std::mutex mutex;
+    std::vector<CellValue> values;
+    std::unordered_map<CellValue, uint32_t> codes;
+};
 
 
 /*****************************************************************************/
@@ -25,6 +153,21 @@ struct TabularDatasetColumn;
 
 /** Parameters used to control the freeze operation. */
 struct ColumnFreezeParameters {
+    /** Dictionaries of the dataset that the chunk belongs to, one for each
+        of its fixed columns.  If empty, each chunk stores its own values.
+    */
+    std::vector<std::shared_ptr<ColumnDictionary> > dictionaries;
+
+    /** Dictionary for the column being frozen, which is set from
+        dictionaries by the chunk for each of its fixed columns.  String
+        columns are stored as codes into it.
+    */
+    std::shared_ptr<ColumnDictionary> dictionary;
+
+    /** Account that the storage of the frozen columns is counted in,
+        usually the one of the dataset.  May be null.
+    */
+    std::shared_ptr<StorageAccount> storage;
 };
 
 
@@ -57,11 +200,54 @@ struct FrozenColumn {
 
     virtual ColumnTypes getColumnTypes() const = 0;
 
+    /** Return the dictionary that the column stores its values as codes
+        into, or null (the default) if it stores its own values.
+    */
+    virtual const ColumnDictionary * getDictionary() const;
+
+    typedef std::function<bool (size_t rowNum, uint32_t code)> ForEachCodeFn;
+
+    /** Call onRow with the dictionary code of each non-null row.  Only
+        columns with a dictionary support this; the default throws.
+    */
+    virtual bool forEachCode(const ForEachCodeFn & onRow) const;
+
+    /** Call fn with the dictionary code of each distinct value, and with
+        ColumnDictionary::NOT_FOUND if there are nulls, in the same way as
+        forEachDistinctValue().  Only columns with a dictionary support
+        this; the default throws.
+    */
+    virtual bool
+    forEachDistinctCode(const std::function<bool (uint32_t code)> & fn) const;
+
+    /** Return the name of the format of this column, which must match the
+        format() of the FrozenColumnFormat that reconstitutes it.
+    */
+    virtual std::string format() const = 0;
+
+    /** Serialize the column's data (not including the format name) to
+        the given sink.  The default throws that the column format can't
+        be serialized.
+    */
+    virtual void serialize(MappedColumnSink & sink) const;
+
     /** Freeze the given column into the best fitting frozen column type. */
     static std::shared_ptr<FrozenColumn>
     freeze(TabularDatasetColumn & column,
            const ColumnFreezeParameters & params);
 
+    /** Serialize the given column, along with its format name, so that it
+        can be reconstituted using reconstitute().
+    */
+    static void serializeColumn(const FrozenColumn & column,
+                                MappedColumnSink & sink);
+
+    /** Reconstitute a column serialized with serializeColumn(), by looking
+        up the registered format and asking it to do the work.
+    */
+    static std::shared_ptr<FrozenColumn>
+    reconstitute(MappedColumnSource & source);
+
     std::shared_ptr<spdlog::logger> logger;
 };
 
@@ -122,12 +308,29 @@ struct FrozenColumnFormat {
     freeze(TabularDatasetColumn & column,
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const = 0;
+
+    /** Reconstitute a column of this format from the given source, which
+        is positioned just after the format name.  The default throws that
+        the format doesn't support reconstitution.
+    */
+    virtual FrozenColumn *
+    reconstitute(MappedColumnSource & source) const;
     
     /** Register a new column format.  Returns a handle that, once released,
         will de-register the column format.
     */
     static std::shared_ptr<void>
     registerFormat(std::shared_ptr<FrozenColumnFormat> format);
+
+    /** Return the registered column format with the given name, or null
+        if there is none.  This allows a particular format to be used, for
+        example to test or benchmark it.
+    */
+    static std::shared_ptr<const FrozenColumnFormat>
+    find(const std::string & name);
+
+    /** Return the names of all registered column formats. */
+    static std::vector<std::string> formatNames();
 };
 
 
@@ -0,0 +1,280 @@
+/** hnsw_index.cc
+    Hierarchical Navigable Small World graph index.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "hnsw_index.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+#include <unordered_set>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+HnswIndex::
+HnswIndex(int M, int efConstruction)
+    : M(M), maxM0(2 * M), efConstruction(efConstruction),
+      entryPoint(-1), maxLevel(-1)
+{
+    if (M < 2)
+        throw HttpReturnException(400, "HNSW index requires M >= 2",
+                                  "M", M);
+    if (efConstruction < 1)
+        throw HttpReturnException(400, "HNSW index requires efConstruction >= 1",
+                                  "efConstruction", efConstruction);
+}
+
+int
+HnswIndex::
+randomLevel(int item) const
+{
+    // Hash the item number to a uniform number in (0, 1], so that the
+    // structure of the graph depends only upon the order of insertion.
+    uint64_t h = item + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    double u = ((h >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+    // Levels are geometrically distributed with ratio 1/M
+    return (int)std::floor(-std::log(u) / std::log((double)M));
+}
+
+std::vector<HnswIndex::Candidate>
+HnswIndex::
+searchLayer(const QueryDistance & dist,
+            const std::vector<Candidate> & entryPoints,
+            int ef, int level) const
+{
+    std::unordered_set<int> visited;
+
+    // Closest first; the frontier of the search
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        std::greater<Candidate> > toExplore;
+
+    // Furthest first; the current best ef items
+    std::priority_queue<Candidate> best;
+
+    for (auto & ep: entryPoints) {
+        if (!visited.insert(ep.second).second)
+            continue;
+        toExplore.push(ep);
+        best.push(ep);
+        if (best.size() > ef)
+            best.pop();
+    }
+
+    while (!toExplore.empty()) {
+        Candidate current = toExplore.top();
+        if (best.size() >= ef && current.first > best.top().first)
+            break;
+        toExplore.pop();
+
+        for (int neighbor: links[current.second][level]) {
+            if (!visited.insert(neighbor).second)
+                continue;
+            float d = dist(neighbor);
+            if (best.size() < ef || d < best.top().first) {
+                toExplore.emplace(d, neighbor);
+                best.emplace(d, neighbor);
+                if (best.size() > ef)
+                    best.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> result(best.size());
+    for (ssize_t i = result.size() - 1;  i >= 0;  --i) {
+        result[i] = best.top();
+        best.pop();
+    }
+
+    return result;
+}
+
+std::vector<int>
+HnswIndex::
+selectNeighbors(const std::vector<Candidate> & candidates, int m,
+                const PairwiseDistance & dist) const
+{
+    std::vector<int> result;
+    std::vector<int> pruned;
+
+    for (auto & c: candidates) {
+        if (result.size() >= m)
+            break;
+        bool diverse = true;
+        for (int r: result) {
+            if (dist(c.second, r) < c.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse)
+            result.push_back(c.second);
+        else pruned.push_back(c.second);
+    }
+
+    // Keep the graph well connected by filling up with the closest of the
+    // pruned candidates
+    for (size_t i = 0;  i < pruned.size() && result.size() < m;  ++i)
+        result.push_back(pruned[i]);
+
+    return result;
+}
+
+void
+HnswIndex::
+insert(int item, const PairwiseDistance & dist)
+{
+    ExcAssertEqual(item, links.size());
+
+    int level = randomLevel(item);
+
+    if (entryPoint == -1) {
+        links.emplace_back(level + 1);
+        entryPoint = item;
+        maxLevel = level;
+        return;
+    }
+
+    auto distToItem = [&] (int other) { return dist(item, other); };
+
+    // Calculate this first, so that if the distance function throws the
+    // index is left unmodified.
+    std::vector<Candidate> entryPoints
+        = { { distToItem(entryPoint), entryPoint } };
+
+    links.emplace_back(level + 1);
+
+    // Greedily descend the layers above those of the new item
+    for (int l = maxLevel;  l > level;  --l)
+        entryPoints = searchLayer(distToItem, entryPoints, 1, l);
+
+    // Link the item into each of its layers
+    for (int l = std::min(level, maxLevel);  l >= 0;  --l) {
+        std::vector<Candidate> found
+            = searchLayer(distToItem, entryPoints, efConstruction, l);
+
+        std::vector<int> neighbors = selectNeighbors(found, M, dist);
+        links[item][l] = neighbors;
+
+        int maxLinks = l == 0 ? maxM0 : M;
+
+        for (int n: neighbors) {
+            std::vector<int> & nlinks = links[n][l];
+            nlinks.push_back(item);
+            if (nlinks.size() <= maxLinks)
+                continue;
+
+            // Too many links; keep only the best ones
+            std::vector<Candidate> existing;
+            existing.reserve(nlinks.size());
+            for (int e: nlinks)
+                existing.emplace_back(dist(n, e), e);
+            std::sort(existing.begin(), existing.end());
+            nlinks = selectNeighbors(existing, maxLinks, dist);
+        }
+
+        entryPoints = std::move(found);
+    }
+
+    if (level > maxLevel) {
+        maxLevel = level;
+        entryPoint = item;
+    }
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+search(const QueryDistance & dist, int n, float maximumDist,
+       int efSearch) const
+{
+    if (entryPoint == -1 || n <= 0)
+        return {};
+
+    std::vector<Candidate> entryPoints = { { dist(entryPoint), entryPoint } };
+
+    for (int l = maxLevel;  l > 0;  --l)
+        entryPoints = searchLayer(dist, entryPoints, 1, l);
+
+    std::vector<Candidate> found
+        = searchLayer(dist, entryPoints, std::max(efSearch, n), 0);
+
+    std::vector<std::pair<float, int> > result;
+    for (auto & c: found) {
+        if (result.size() >= n || c.first > maximumDist)
+            break;
+        result.push_back(c);
+    }
+
+    return result;
+}
+
+void
+HnswIndex::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << string("HNSW") << ML::DB::compact_size_t(1);  // version
+    store << M << efConstruction << entryPoint << maxLevel;
+    store << ML::DB::compact_size_t(links.size());
+    for (auto & itemLinks: links) {
+        store << ML::DB::compact_size_t(itemLinks.size());
+        for (auto & layer: itemLinks) {
+            store << ML::DB::compact_size_t(layer.size());
+            for (int l: layer)
+                store << ML::DB::compact_size_t(l);
+        }
+    }
+}
+
+void
+HnswIndex::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    string magic;
+    ML::DB::compact_size_t version;
+    store >> magic >> version;
+    if (magic != "HNSW")
+        throw HttpReturnException(400, "Expected an HNSW index",
+                                  "magic", magic);
+    if (version != 1)
+        throw HttpReturnException(400, "Unknown HNSW index version",
+                                  "version", (size_t)version);
+
+    store >> M >> efConstruction >> entryPoint >> maxLevel;
+    maxM0 = 2 * M;
+
+    ML::DB::compact_size_t numItems(store);
+    links.clear();
+    links.resize(numItems);
+    for (auto & itemLinks: links) {
+        ML::DB::compact_size_t numLayers(store);
+        itemLinks.resize(numLayers);
+        for (auto & layer: itemLinks) {
+            ML::DB::compact_size_t numLinks(store);
+            layer.resize(numLinks);
+            for (int & l: layer) {
+                ML::DB::compact_size_t val(store);
+                l = val;
+            }
+        }
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,103 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    Hierarchical Navigable Small World graph index.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Approximate nearest neighbour search over items identified by a dense
+    integer index, for which the caller provides the distance function.
+    See Malkov and Yashunin, "Efficient and robust approximate nearest
+    neighbor search using Hierarchical Navigable Small World graphs".
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <vector>
+#include <functional>
+#include <utility>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Multi-layer proximity graph used to find approximate nearest neighbours.
+    Unlike the vantage point tree, the index is built incrementally, one
+    item at a time, and the search cost grows logarithmically with the
+    number of items even in a high dimensional space.
+
+    Items must be inserted in order of their index (0, 1, 2, ...).  The
+    structure isn't thread safe for insertion; searches may run in parallel
+    with each other.
+*/
+struct HnswIndex {
+
+    /** Create an index.  M is the number of links per item on each layer
+        (twice that on the bottom layer), and efConstruction is the size of
+        the candidate list used when inserting.
+    */
+    HnswIndex(int M = 16, int efConstruction = 200);
+
+    /// Distance between two items in the index
+    typedef std::function<float (int item1, int item2)> PairwiseDistance;
+
+    /// Distance between the query and an item in the index
+    typedef std::function<float (int item)> QueryDistance;
+
+    /** Insert the given item, which must be equal to size(). */
+    void insert(int item, const PairwiseDistance & dist);
+
+    /** Return the (approximate) n closest items with a distance no more
+        than maximumDist, sorted by increasing distance.  efSearch is the
+        size of the candidate list; higher values improve the recall at
+        the expense of speed.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & dist, int n, float maximumDist,
+           int efSearch) const;
+
+    /** Number of items in the index. */
+    size_t size() const
+    {
+        return links.size();
+    }
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+    int M;               ///< Maximum links per item on upper layers
+    int maxM0;           ///< Maximum links per item on the bottom layer
+    int efConstruction;  ///< Candidate list size for insertion
+    int entryPoint;      ///< Item on the top layer where searches start
+    int maxLevel;        ///< Highest layer in the graph
+
+    /// For each item, for each of its layers, the list of linked items
+    std::vector<std::vector<std::vector<int> > > links;
+
+private:
+    typedef std::pair<float, int> Candidate;
+
+    /// Choose the top layer of an item; deterministic in the item number
+    int randomLevel(int item) const;
+
+    /** Greedy beam search of a single layer, returning up to ef of the
+        closest items found, sorted by increasing distance.
+    */
+    std::vector<Candidate>
+    searchLayer(const QueryDistance & dist,
+                const std::vector<Candidate> & entryPoints,
+                int ef, int level) const;
+
+    /** Choose up to m neighbours from the (sorted) candidates, preferring
+        those that aren't closer to an already chosen neighbour than to the
+        item itself, so that links go in diverse directions.
+    */
+    std::vector<int>
+    selectNeighbors(const std::vector<Candidate> & candidates, int m,
+                    const PairwiseDistance & dist) const;
+};
+
+} // namespace MLDB
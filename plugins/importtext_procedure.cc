@@ -25,6 +25,10 @@
 #include "mldb/utils/log.h"
 #include "mldb/ext/re2/re2/re2.h"
 #include "mldb/utils/possibly_dynamic_buffer.h"
+#include "mldb/arch/arch.h"
+#if MLDB_INTEL_ISA
+# include <emmintrin.h>
+#endif
 
 
 using namespace std;
@@ -37,7 +41,15 @@ DEFINE_STRUCTURE_DESCRIPTION(ImportTextConfig);
 ImportTextConfigDescription::ImportTextConfigDescription()
 {
     addField("dataFileUrl", &ImportTextConfig::dataFileUrl,
-             "URL of the text data to import");
+             "URL of the text data to import.  It may contain the wildcards "
+             "`*`, `?` and `[...]` in its path components, in which case all "
+             "of the matching files are imported, for example "
+             "`s3://bucket/logs/2026/*/*.csv.gz`.");
+    addField("dataFileUrls", &ImportTextConfig::dataFileUrls,
+             "URLs of more text files to import along with `dataFileUrl`, "
+             "which may also contain wildcards.  All of the files must have "
+             "the same header, and are imported together into the output "
+             "dataset.");
     addField("outputDataset", &ImportTextConfig::outputDataset,
              "Dataset to record the data into.",
              PolyConfigT<Dataset>().withType("tabular"));
@@ -139,6 +151,10 @@ ImportTextConfigDescription::ImportTextConfigDescription()
             throw MLDB::Exception("autoGenerateHeaders cannot be true if "
                                 "headers is defined.");
         }
+        if (config->dataFileUrl.empty() && config->dataFileUrls.empty()) {
+            throw MLDB::Exception("dataFileUrl or dataFileUrls must be "
+                                  "specified.");
+        }
     };
 }
 
@@ -155,8 +171,9 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
 
     struct RowScope: public SqlRowScope {
         RowScope(const CellValue * row, Date ts, int64_t lineNumber,
-                 int64_t lineOffset)
-            : row(row), ts(ts), lineNumber(lineNumber), lineOffset(lineOffset)
+                 int64_t lineOffset, const Utf8String * dataFileUrl)
+            : row(row), ts(ts), lineNumber(lineNumber), lineOffset(lineOffset),
+              dataFileUrl(dataFileUrl)
         {
         }
 
@@ -164,6 +181,7 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
         Date ts;
         int64_t lineNumber;
         int64_t lineOffset;
+        const Utf8String * dataFileUrl;  ///< null if only one file
         const RowPath * rowName;
     };
 
@@ -316,7 +334,8 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
             return {[=] (const std::vector<ExpressionValue> & args,
                          const SqlRowScope & scope)
                     {
-                        return ExpressionValue(fileTimestamp, fileTimestamp);
+                        auto & row = scope.as<RowScope>();
+                        return ExpressionValue(row.ts, row.ts);
                     },
                     std::make_shared<TimestampValueInfo>()
                 };
@@ -325,6 +344,9 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
             return {[=] (const std::vector<ExpressionValue> & args,
                          const SqlRowScope & scope)
                     {
+                        auto & row = scope.as<RowScope>();
+                        if (row.dataFileUrl)
+                            return ExpressionValue(*row.dataFileUrl, row.ts);
                         return ExpressionValue(dataFileUrl, fileTimestamp);
                     },
                     std::make_shared<Utf8StringValueInfo>()
@@ -345,9 +367,10 @@ struct SqlCsvScope: public SqlExpressionMldbScope {
     }
 
     static RowScope bindRow(const CellValue * row, Date ts,
-                            int64_t lineNumber, int64_t lineOffset)
+                            int64_t lineNumber, int64_t lineOffset,
+                            const Utf8String * dataFileUrl = nullptr)
     {
-        return RowScope(row, ts, lineNumber, lineOffset);
+        return RowScope(row, ts, lineNumber, lineOffset, dataFileUrl);
     }
 };
 
@@ -415,6 +438,79 @@ MLDB_ALWAYS_INLINE bool isascii(int c)
     return (c & (~127)) == 0;
 }
 
+/** Return a pointer to the first character in [p, end) that is equal to
+    c1 or c2, or end if there is none.  eightBit is set if there is a
+    non-ASCII character before that point.
+
+    This is the inner loop of CSV field splitting.  It classifies 32
+    characters at a time with SSE2 (which is always available on x86_64)
+    and never reads past end.
+*/
+MLDB_ALWAYS_INLINE const char *
+findCsvSpecial(const char * p, const char * end, char c1, char c2,
+               bool & eightBit)
+{
+#if MLDB_INTEL_ISA
+    const __m128i cc1 = _mm_set1_epi8(c1), cc2 = _mm_set1_epi8(c2);
+    uint32_t highBits = 0;
+
+    for (; p + 32 <= end;  p += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+        uint32_t special
+            = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(a, cc1),
+                                                       _mm_cmpeq_epi8(a, cc2)))
+            | ((uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(b, cc1),
+                                                        _mm_cmpeq_epi8(b, cc2)))
+               << 16);
+        uint32_t high = (uint32_t)_mm_movemask_epi8(a)
+            | ((uint32_t)_mm_movemask_epi8(b) << 16);
+
+        if (special) {
+            // Only the characters before the special one count
+            int n = __builtin_ctz(special);
+            highBits |= high & ((1U << n) - 1);
+            eightBit = eightBit || highBits;
+            return p + n;
+        }
+        highBits |= high;
+    }
+
+    eightBit = eightBit || highBits;
+#endif
+
+    for (; p < end;  ++p) {
+        const char c = *p;
+        if (c == c1 || c == c2)
+            return p;
+        if (!isascii(c))
+            eightBit = true;
+    }
+
+    return end;
+}
+
+/** Return true if there is a non-ASCII character in [p, end). */
+MLDB_ALWAYS_INLINE bool
+hasNonAscii(const char * p, const char * end)
+{
+#if MLDB_INTEL_ISA
+    for (; p + 32 <= end;  p += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)))
+            return true;
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        if (!isascii(*p))
+            return true;
+    }
+
+    return false;
+}
+
 /** Parse a single row of CSV into an array of CellValues.
 
     Carefully designed to not perform any memory allocations in the
@@ -557,23 +653,32 @@ parseFixedWidthCsvRow(const char * & line,
             bool eightBit = false;
             bool ok = false;
 
-            auto pushChar = [&] (char c)
+            // Append [p, p + n) to the string; eightBit has already been
+            // taken care of by the caller.
+            auto pushChars = [&] (const char * p, size_t n)
                 {
-                    if (len == buflen) {
-                        std::unique_ptr<char[]> newBuf(new char[buflen * 2]);
+                    if (len + n > buflen) {
+                        while (len + n > buflen)
+                            buflen *= 2;
+                        std::unique_ptr<char[]> newBuf(new char[buflen]);
                         std::copy(s, s + len, newBuf.get());
                         sdynamic.swap(newBuf);
                         s = sdynamic.get();
-                        buflen *= 2;
                     }
 
-
-                    ExcAssertLess(len, buflen);
-                    eightBit = eightBit || !isascii(c);
-                    s[len++] = c;
+                    std::copy(p, p + n, s + len);
+                    len += n;
                 };
 
             for (; line < lineEnd;  ++line) {
+                // Copy everything up to the next quote in one go
+                const char * next
+                    = findCsvSpecial(line, lineEnd, quote, quote, eightBit);
+                pushChars(line, next - line);
+                line = next;
+                if (line == lineEnd)
+                    break;
+
                 const char c = *line;
                 if (c == quote) {
                     ++line;
@@ -588,7 +693,7 @@ parseFixedWidthCsvRow(const char * & line,
                     }
                     else if (*line == quote) {
                         // doubled quote; take a literal value
-                        pushChar(quote);
+                        pushChars(line, 1);
                     }
                     else {
                         // Error
@@ -596,9 +701,6 @@ parseFixedWidthCsvRow(const char * & line,
                         break;
                     }
                 }
-                else {
-                    pushChar(c);
-                }
             }
 
             if (!ok)
@@ -654,16 +756,19 @@ parseFixedWidthCsvRow(const char * & line,
             // likely a non-quoted string
 
             bool eightBit = !isascii(c);
-            size_t len = 1;
+            size_t len;
 
-            for (; line < lineEnd;  ++line, ++len) {
-                const char c = *line;
-                if (c == separator && !isTextLine) {
-                    ++line;
-                    break;
-                }
-                if (!isascii(c))
-                    eightBit = true;
+            if (isTextLine) {
+                eightBit = eightBit || hasNonAscii(line, lineEnd);
+                len = lineEnd - start;
+                line = lineEnd;
+            }
+            else {
+                const char * next
+                    = findCsvSpecial(line, lineEnd, separator, separator,
+                                     eightBit);
+                len = next - start;
+                line = next == lineEnd ? lineEnd : next + 1;
             }
 
             values[colNum++] = finishString(start, len, eightBit);
@@ -732,22 +837,113 @@ struct ImportTextProcedureWorkInstance
     size_t rowCount;
     uint64_t numLineErrors;
 
+    /// Fields of the header line of the first file, when it has one
+    vector<string> headerFields;
+
+    /// One of the files being imported
+    struct InputFile {
+        Utf8String url;
+        Date ts;             ///< Last modification time of the file
+        int64_t lineOffset;  ///< Line number of the first line to import
+    };
+
+    /*    Return the files to import, with the wildcards expanded  */
+    static vector<string> getDataFileNames(const ImportTextConfig & config)
+    {
+        vector<string> result;
+
+        auto addFiles = [&] (const Url & url)
+            {
+                string pattern = url.toDecodedString();
+                string scheme = getUriScheme(pattern);
+
+                // A '?' in an http URL is the start of the query string
+                if (scheme == "http" || scheme == "https"
+                    || pattern.find_first_of("*?[") == string::npos) {
+                    result.push_back(pattern);
+                    return;
+                }
+
+                vector<string> matching;
+                auto onObject = [&] (const std::string & uri,
+                                     const FsObjectInfo & info,
+                                     const OpenUriObject & open,
+                                     int depth)
+                    {
+                        matching.push_back(uri);
+                        return true;
+                    };
+                forEachUriObjectMatching(pattern, onObject);
+
+                if (matching.empty())
+                    throw HttpReturnException
+                        (400, "No file matches the pattern '" + pattern + "'",
+                         "dataFileUrl", pattern);
+
+                std::sort(matching.begin(), matching.end());
+                result.insert(result.end(), matching.begin(), matching.end());
+            };
+
+        if (!config.dataFileUrl.empty())
+            addFiles(config.dataFileUrl);
+        for (auto & url: config.dataFileUrls)
+            addFiles(url);
+
+        return result;
+    }
+
+    /*    Read the fields of the header line at the start of the stream  */
+    vector<string> readHeader(std::istream & stream,
+                              const ImportTextConfig & config,
+                              const string & filename,
+                              const RE2 & skipLineRegex)
+    {
+        string header;
+        string prevHeader;
+        while(true) {
+            std::getline(stream, header);
+
+            if (prevHeader.empty()
+                && config.skipLineRegex.initialized()
+                && RE2::FullMatch(header, skipLineRegex))
+                continue;
+
+            if(!prevHeader.empty()) {
+                prevHeader += ' ' + header;
+                header.assign(std::move(prevHeader));
+            }
+
+            try {
+                ParseContext pcontext(filename,
+                                       header.c_str(), header.length(), 1, 0);
+                return expect_csv_row(pcontext, -1, separator);
+            }
+            catch (FileFinishInsideQuote & exp) {
+                if(config.allowMultiLines) {
+                    prevHeader.assign(std::move(header));
+                    continue;
+                }
+
+                throw exp;
+            }
+        }
+    }
+
     /*    Load a text file and filter according to the configuration  */
     void loadText(const ImportTextConfig& config,
                   std::shared_ptr<Dataset> dataset,
                   MldbServer * server,
                   const std::function<bool (const Json::Value &)> & onProgress)
     {
-        string filename = config.dataFileUrl.toDecodedString();
+        vector<string> filenames = getDataFileNames(config);
+        const string & filename = filenames.at(0);
 
         // Ask for a memory mappable stream if possible
-        filter_istream stream(config.dataFileUrl, { { "mapped", "true" } });
+        filter_istream stream(filename, { { "mapped", "true" } });
 
         // Get the file timestamp out
         ts = stream.info().lastModified;
 
-        string header;
-
         if (config.delimiter.length() == 1) {
             separator = config.delimiter[0];
         }
@@ -814,42 +1010,13 @@ struct ImportTextProcedureWorkInstance
 
             if (config.headers.empty()) {
 
-                vector<string> fields;
-
                 // Read header line
-                string prevHeader;
-                while(true) {
-                    std::getline(stream, header);
-
-                    if (prevHeader.empty()
-                        && config.skipLineRegex.initialized()
-                        && RE2::FullMatch(header, skipLineRegex))
-                        continue;
-
-                    if(!prevHeader.empty()) {
-                        prevHeader += ' ' + header;
-                        header.assign(std::move(prevHeader));
-                    }
-
-                    try {
-                        ParseContext pcontext(filename,
-                                               header.c_str(), header.length(), 1, 0);
-                        fields = expect_csv_row(pcontext, -1, separator);
-                        break;
-                    }
-                    catch (FileFinishInsideQuote & exp) {
-                        if(config.allowMultiLines) {
-                            prevHeader.assign(std::move(header));
-                            continue;
-                        }
-
-                        throw exp;
-                    }
-                }
+                vector<string> fields
+                    = readHeader(stream, config, filename, skipLineRegex);
 
                 if (config.autoGenerateHeaders) {
                     // Re-open stream
-                    stream.open(config.dataFileUrl, { { "mapped", "true" } });
+                    stream.open(filename, { { "mapped", "true" } });
                     auto nfields = fields.size();
                     for (ssize_t i = 0; i < nfields; ++i) {
                         inputColumnNames.emplace_back(i);
@@ -857,6 +1024,7 @@ struct ImportTextProcedureWorkInstance
                 }
                 else {
                     lineOffset += 1;
+                    headerFields = fields;
                     switch (encoding) {
                     case ASCII:
                         for (const auto & f: fields)
@@ -897,8 +1065,7 @@ struct ImportTextProcedureWorkInstance
 
         // Now we know the columns, we can bind our SQL expressions for the
         // select, where, named and timestamp parts of the expression.
-        SqlCsvScope scope(server, inputColumnNames, ts,
-                          Utf8String(config.dataFileUrl.toDecodedString()));
+        SqlCsvScope scope(server, inputColumnNames, ts, Utf8String(filename));
 
         selectBound = config.select.bind(scope);
         whereBound = config.where->bind(scope);
@@ -955,15 +1122,21 @@ struct ImportTextProcedureWorkInstance
             getline(stream, line);
         }
 
-        loadTextData(dataset, stream, config, scope, onProgress);
+        loadTextData(dataset, stream, filenames, config, scope,
+                     skipLineRegex, onProgress);
     }
 
-    /*    Load, filter and format all lines and process them  */
+    /*    Load, filter and format all lines of all files and process them.
+          The stream is the first file, positioned at its first line to
+          import.
+    */
     void
     loadTextData(std::shared_ptr<Dataset> dataset,
                  std::istream& stream,
+                 const vector<string> & filenames,
                  const ImportTextConfig& config,
                  SqlCsvScope& scope,
+                 const RE2 & skipLineRegex,
                  const std::function<bool (const Json::Value &)> & onProgress)
     {
         Progress progress;
@@ -980,7 +1153,6 @@ struct ImportTextProcedureWorkInstance
         bool isNamedLineNumber = config.named->surface == "lineNumber()";
 
         std::atomic<uint64_t> numSkipped(0);
-        std::atomic<uint64_t> totalLinesProcessed(0);
 
         Timer timer;
 
@@ -1044,33 +1216,23 @@ struct ImportTextProcedureWorkInstance
                 return true;
             };
 
-        atomic<ssize_t> lineCount(0);
-        atomic<ssize_t> byteCount(0);
-        auto onLine = [&] (const char * line,
+        // Counted by the threads parsing lines, and read by the sampler
+        // below that reports the progress
+        ProgressCounter lineCount;
+        ProgressCounter byteCount;
+        // With several files, the rows are named after the file as well
+        // as the line, as line numbers restart in each file
+        bool multipleFiles = filenames.size() > 1;
+
+        auto onLine = [&] (const InputFile & file,
+                           const char * line,
                            size_t length,
                            int chunkNum,
                            int64_t lineNum)
         {
-            byteCount += length + 1;
-            if (++lineCount % PROGRESS_RATE == 0) {
-                iterationStep->value = lineCount;
-                onProgress(jsonEncode(iterationStep));
-            }
-            int64_t actualLineNum = lineNum + lineOffset;
-#if 1
-            uint64_t linesDone = totalLinesProcessed.fetch_add(1);
-
-            if (linesDone && linesDone % 100000 == 0) {
-
-                double wall = timer.elapsed_wall();
-                INFO_MSG(this->logger)
-                    << "done " << linesDone << " in " << wall
-                    << "s at " << linesDone / wall * 0.000001
-                    << "M lines/second on "
-                    << timer.elapsed_cpu() / timer.elapsed_wall()
-                    << " CPUs";
-            }
-#endif
+            byteCount.add(length + 1);
+            lineCount.add();
+            int64_t actualLineNum = lineNum + file.lineOffset;
 
             auto & threadAccum = accum.get();
 
@@ -1126,13 +1288,17 @@ struct ImportTextProcedureWorkInstance
                                            string(line, length));
                 }
 
-            auto row = scope.bindRow(values.data(), ts, actualLineNum,
-                                     0 /* todo: chunk ofs */);
+            auto row = scope.bindRow(values.data(), file.ts, actualLineNum,
+                                     0 /* todo: chunk ofs */,
+                                     multipleFiles ? &file.url : nullptr);
 
             ExpressionValue nameStorage;
             RowPath rowName;
 
-            if (isNamedLineNumber) {
+            if (isNamedLineNumber && multipleFiles) {
+                rowName = Path(file.url + ":" + std::to_string(actualLineNum));
+            }
+            else if (isNamedLineNumber) {
                 rowName = Path(actualLineNum);
             }
             else {
@@ -1148,7 +1314,7 @@ struct ImportTextProcedureWorkInstance
             }
 
             // Get the timestamp for the row
-            Date rowTs = ts;
+            Date rowTs = file.ts;
             ExpressionValue tsStorage;
             rowTs = timestampBound(row, tsStorage, GET_ALL)
                     .coerceToTimestamp().toTimestamp();
@@ -1189,18 +1355,37 @@ struct ImportTextProcedureWorkInstance
         };
 
 
-        if(!config.allowMultiLines) {
-            forEachLineBlock(stream, onLine, config.limit,
-                             numCpus() /* parallelism */,
-                             startChunk, doneChunk);
-        }
-        else {
+        // Import one file, into chunks numbered after the file so that the
+        // chunks of different files don't clash
+        auto importFile = [&] (size_t fileNum, std::istream & stream,
+                               const InputFile & file)
+        {
+            int64_t firstChunk = int64_t(fileNum) << 32;
+
+            auto onFileLine = [&] (const char * line, size_t length,
+                                   int chunkNum, int64_t lineNum)
+                {
+                    return onLine(file, line, length, chunkNum, lineNum);
+                };
+
+            auto startFileChunk = [&] (int64_t chunkNumber, size_t lineNumber)
+                {
+                    return startChunk(firstChunk + chunkNumber, lineNumber);
+                };
+
+            if(!config.allowMultiLines) {
+                forEachLineBlock(stream, onFileLine, config.limit,
+                                 numCpus() /* parallelism */,
+                                 startFileChunk, doneChunk);
+                return;
+            }
+
             // very simplistic and not efficient way of doing multi-line. we send
             // lines one by one to the 'onLine' function, and if
             // we get an error that probably is caused by a multi-
             // line string, we concat the current line with the next
             // one and try again. 
-            startChunk(0, 0);
+            startFileChunk(0, 0);
 
             string line;
             string t_line;
@@ -1214,8 +1399,8 @@ struct ImportTextProcedureWorkInstance
                     line += ' ' + t_line;
                 }
 
-                if(!onLine(line.c_str(), line.size(),
-                           0 /* chunkNum */, lineNum)) {
+                if(!onFileLine(line.c_str(), line.size(),
+                               0 /* chunkNum */, lineNum)) {
                     prevLine.assign(std::move(line));
                 } else {
                     prevLine.erase();
@@ -1227,7 +1412,86 @@ struct ImportTextProcedureWorkInstance
             }
 
             doneChunk(0, lineNum);
+        };
+
+        // The other files have the same header line as the first, which
+        // isn't imported; the offset and limit apply to each file
+        bool skipHeader = !headerFields.empty();
+
+        auto importOtherFile = [&] (size_t fileNum)
+        {
+            const string & filename = filenames[fileNum];
+            filter_istream stream(filename, { { "mapped", "true" } });
+
+            InputFile file{ Utf8String(filename), stream.info().lastModified, 1 };
+
+            if (skipHeader) {
+                auto fields = readHeader(stream, config, filename,
+                                         skipLineRegex);
+                if (fields != headerFields)
+                    throw HttpReturnException
+                        (400, "File '" + filename + "' doesn't have the same "
+                         "header as '" + filenames[0] + "'",
+                         "header", fields,
+                         "expectedHeader", headerFields);
+                file.lineOffset += 1;
+            }
+
+            std::string line;
+            for (size_t i = 0;  stream && i < config.offset;  ++i, ++file.lineOffset) {
+                getline(stream, line);
+            }
+
+            importFile(fileNum, stream, file);
+        };
+
+        InputFile firstFile{ Utf8String(filenames[0]), ts, lineOffset };
+
+        // Progress is reported from the sampler's thread, so that the
+        // threads parsing lines never serialize it or take the lock of
+        // the procedure run's status
+        uint64_t lastLogged = 0;
+        auto onSample = [&] ()
+            {
+                uint64_t linesDone = lineCount.total();
+                if (linesDone / 100000 != lastLogged / 100000) {
+                    double wall = timer.elapsed_wall();
+                    INFO_MSG(this->logger)
+                        << "done " << linesDone << " in " << wall
+                        << "s at " << linesDone / wall * 0.000001
+                        << "M lines/second on "
+                        << timer.elapsed_cpu() / timer.elapsed_wall()
+                        << " CPUs";
+                    lastLogged = linesDone;
+                }
+
+                iterationStep->value = linesDone;
+                return onProgress(jsonEncode(iterationStep));
+            };
+
+        ProgressSampler sampler(onSample);
+
+        if (!multipleFiles) {
+            importFile(0, stream, firstFile);
         }
+        else {
+            // Each file is split into blocks by forEachLineBlock(), so
+            // that small files are done whole by one thread while large
+            // ones are spread over several
+            auto doFile = [&] (size_t fileNum)
+                {
+                    if (fileNum == 0)
+                        importFile(0, stream, firstFile);
+                    else importOtherFile(fileNum);
+                };
+
+            parallelMap(0, filenames.size(), doFile);
+        }
+
+        sampler.stop();
+
+        uint64_t totalLinesProcessed = lineCount.total();
+        uint64_t totalBytes = byteCount.total();
 
         double wall = timer.elapsed_wall();
         INFO_MSG(logger)
@@ -1236,14 +1500,14 @@ struct ImportTextProcedureWorkInstance
             << "M lines/second on "
             << timer.elapsed_cpu() / timer.elapsed_wall() << " CPUs";
         INFO_MSG(logger)
-            << "done " << byteCount * 0.000001 << " megabytes at "
-            << byteCount / timer.elapsed_wall() * 0.000001 << " megabytes/sec";
+            << "done " << totalBytes * 0.000001 << " megabytes at "
+            << totalBytes / timer.elapsed_wall() * 0.000001 << " megabytes/sec";
         INFO_MSG(logger) << "processed " << totalLinesProcessed << " lines";
         
         recorder.commit();
 
         numLineErrors = numSkipped;
-        rowCount = lineCount;
+        rowCount = totalLinesProcessed;
     }
 };
 
@@ -43,6 +43,7 @@ struct ImportTextConfig : public ProcedureConfig  {
     }
 
     Url dataFileUrl;
+    std::vector<Url> dataFileUrls;
     PolyConfigT<Dataset> outputDataset;
     std::vector<Utf8String> headers;
     std::string delimiter;
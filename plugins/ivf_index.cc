@@ -0,0 +1,190 @@
+/** ivf_index.cc
+    Inverted file index.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "ivf_index.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include <queue>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* IVF INDEX                                                                 */
+/*****************************************************************************/
+
+IvfIndex::
+IvfIndex(int numLists)
+    : numLists(numLists), listStart(1, 0)
+{
+    if (numLists < 0)
+        throw HttpReturnException(400, "IVF index requires numLists >= 0",
+                                  "numLists", numLists);
+}
+
+void
+IvfIndex::
+build(int numItems, const BatchDistance & dist)
+{
+    centers.clear();
+    items.clear();
+    listStart.assign(1, 0);
+
+    if (numItems <= 0)
+        return;
+
+    int numCenters = numLists > 0
+        ? numLists
+        : (int)std::ceil(std::sqrt((double)numItems));
+    numCenters = std::min(numCenters, numItems);
+
+    for (int i = 0;  i < numCenters;  ++i)
+        centers.push_back((int64_t)i * numItems / numCenters);
+
+    // Find the closest centre to each item.  The items are done in
+    // blocks, so that each job compares its items with all of the centres
+    // using the batched distance.
+    std::vector<int> assignment(numItems);
+    static constexpr int BLOCK_SIZE = 256;
+    size_t numBlocks = (numItems + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    auto doBlock = [&] (size_t block)
+        {
+            std::vector<float> dists(numCenters);
+            int start = block * BLOCK_SIZE;
+            int end = std::min(start + BLOCK_SIZE, numItems);
+            for (int item = start;  item < end;  ++item) {
+                dist(item, centers.data(), numCenters, dists.data());
+                assignment[item]
+                    = std::min_element(dists.begin(), dists.end())
+                    - dists.begin();
+            }
+        };
+
+    parallelMap(0, numBlocks, doBlock);
+
+    // Lay out the lists one after the other, with their items in order
+    listStart.assign(numCenters + 1, 0);
+    for (int a: assignment)
+        ++listStart[a + 1];
+    for (int i = 0;  i < numCenters;  ++i)
+        listStart[i + 1] += listStart[i];
+
+    items.resize(numItems);
+    std::vector<int> pos(listStart.begin(), listStart.end() - 1);
+    for (int item = 0;  item < numItems;  ++item)
+        items[pos[assignment[item]]++] = item;
+}
+
+std::vector<std::pair<float, int> >
+IvfIndex::
+search(const QueryDistance & dist, int n, float maximumDist,
+       int numProbes) const
+{
+    if (centers.empty() || n <= 0)
+        return {};
+
+    typedef std::pair<float, int> Candidate;
+
+    std::vector<Candidate> centerDists(centers.size());
+    for (size_t i = 0;  i < centers.size();  ++i)
+        centerDists[i] = { dist(centers[i]), i };
+
+    int probes = std::max(1, std::min<int>(numProbes, centers.size()));
+    std::partial_sort(centerDists.begin(), centerDists.begin() + probes,
+                      centerDists.end());
+
+    // Furthest first; the current best n items
+    std::priority_queue<Candidate> best;
+
+    for (int p = 0;  p < probes;  ++p) {
+        int list = centerDists[p].second;
+        for (int i = listStart[list];  i < listStart[list + 1];  ++i) {
+            int item = items[i];
+            float d = item == centers[list] ? centerDists[p].first : dist(item);
+            if (d > maximumDist)
+                continue;
+            if (best.size() < n || Candidate(d, item) < best.top()) {
+                best.emplace(d, item);
+                if (best.size() > n)
+                    best.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> result(best.size());
+    for (ssize_t i = result.size() - 1;  i >= 0;  --i) {
+        result[i] = best.top();
+        best.pop();
+    }
+
+    return result;
+}
+
+void
+IvfIndex::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << string("IVF") << ML::DB::compact_size_t(1);  // version
+    store << numLists;
+    store << ML::DB::compact_size_t(centers.size());
+    for (int c: centers)
+        store << ML::DB::compact_size_t(c);
+    for (int s: listStart)
+        store << ML::DB::compact_size_t(s);
+    for (int i: items)
+        store << ML::DB::compact_size_t(i);
+}
+
+void
+IvfIndex::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    string magic;
+    ML::DB::compact_size_t version;
+    store >> magic >> version;
+    if (magic != "IVF")
+        throw HttpReturnException(400, "Expected an IVF index",
+                                  "magic", magic);
+    if (version != 1)
+        throw HttpReturnException(400, "Unknown IVF index version",
+                                  "version", (size_t)version);
+
+    store >> numLists;
+
+    ML::DB::compact_size_t numCenters(store);
+    centers.resize(numCenters);
+    for (int & c: centers) {
+        ML::DB::compact_size_t val(store);
+        c = val;
+    }
+    listStart.resize(numCenters + 1);
+    for (int & s: listStart) {
+        ML::DB::compact_size_t val(store);
+        s = val;
+    }
+    if (listStart[0] != 0
+        || !std::is_sorted(listStart.begin(), listStart.end()))
+        throw HttpReturnException(400, "IVF index is corrupt");
+
+    items.resize(listStart.back());
+    for (int & i: items) {
+        ML::DB::compact_size_t val(store);
+        i = val;
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,85 @@
+/** ivf_index.h                                                    -*- C++ -*-
+    Inverted file index.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Approximate nearest neighbour search over items identified by a dense
+    integer index, for which the caller provides the distance function.
+    The items are split into lists around a set of centres, and only the
+    lists whose centres are closest to the query are searched.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <vector>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* IVF INDEX                                                                 */
+/*****************************************************************************/
+
+/** Coarse quantizer used to find approximate nearest neighbours.  The
+    centres are items of the index, evenly spaced through it, and each
+    item goes in the list of the centre that it's closest to.  A search
+    looks at all of the centres, and then at each item of the numProbes
+    lists with the closest ones, so it looks at about
+    numLists + numProbes * numItems / numLists items.
+
+    Unlike the HNSW index, the index is built all at once, with each item
+    compared with all of the centres, and the lists are laid out one after
+    the other in memory so that they're scanned sequentially.
+
+    Searches may run in parallel with each other.
+*/
+struct IvfIndex {
+
+    /** Create an index with the given number of lists.  Zero means the
+        square root of the number of items, which keeps building and
+        searching balanced.
+    */
+    IvfIndex(int numLists = 0);
+
+    /// Distance from item1 to each of the n given items
+    typedef std::function<void (int item1, const int * items, size_t n,
+                                float * output)> BatchDistance;
+
+    /// Distance between the query and an item in the index
+    typedef std::function<float (int item)> QueryDistance;
+
+    /** Build the index over items 0 to numItems - 1, replacing what was
+        there.  The items are assigned to their lists in parallel.
+    */
+    void build(int numItems, const BatchDistance & dist);
+
+    /** Return the (approximate) n closest items with a distance no more
+        than maximumDist, sorted by increasing distance.  numProbes is the
+        number of lists that are searched; higher values improve the
+        recall at the expense of speed.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & dist, int n, float maximumDist,
+           int numProbes) const;
+
+    /** Number of items in the index. */
+    size_t size() const
+    {
+        return items.size();
+    }
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+    int numLists;               ///< Number of lists asked for; 0 is automatic
+    std::vector<int> centers;   ///< Centre item of each list
+    std::vector<int> items;     ///< Items of all of the lists, in list order
+    std::vector<int> listStart; ///< Where each list starts in items, plus end
+};
+
+} // namespace MLDB
@@ -11,6 +11,7 @@
 #include "mldb/core/dataset.h"
 #include "mldb/types/value_description.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/types/json_tape_parsing.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/plugins/for_each_line.h"
@@ -20,6 +21,7 @@
 #include "mldb/sql/builtin_functions.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parse_context.h"
 #include "mldb/rest/cancellation_exception.h"
@@ -250,7 +252,9 @@ struct JSONImporter: public Procedure {
         Date zeroTs;
 
         std::atomic<int64_t> errors(0);
-        std::atomic<int64_t> recordedLines(0);
+
+        // Counted by the threads parsing lines, and read by the sampler
+        ProgressCounter recordedLines;
         int64_t lineOffset = 1;
         std::string line;
         std::string filename = runProcConf.dataFileUrl.toDecodedString();
@@ -288,6 +292,9 @@ struct JSONImporter: public Procedure {
             /// Recorder object for this thread that the dataset gives us
             /// to record into the dataset.
             std::unique_ptr<Recorder> threadRecorder;
+
+            /// Tape for parsing lines, reused from one line to the next
+            JsonTape tape;
         };
 
         PerThreadAccumulator<ThreadAccum> accum;
@@ -318,9 +325,16 @@ struct JSONImporter: public Procedure {
         const auto whereBound = config.where->bind(jsonScope);
         const auto selectBound = config.select.bind(jsonScope);
         const auto namedBound = config.named->bind(jsonScope);
-        bool keepGoing = true;
-        mutex progressMutex;
 
+        // Progress is reported from the sampler's thread, so that the
+        // threads parsing lines don't queue up behind each other to do it
+        auto onSample = [&] ()
+            {
+                iterationStep->value = recordedLines.total();
+                return onProgress(jsonEncode(progress));
+            };
+
+        ProgressSampler sampler(onSample);
         auto onLine = [&] (const char * line,
                            size_t lineLength,
                            int64_t blockNumber,
@@ -334,25 +348,41 @@ struct JSONImporter: public Procedure {
             if(lineLength == 0)
                 return handleError("empty line", actualLineNum, "");
 
-            StreamingJsonParsingContext parser(filename, line, lineLength,
-                                               actualLineNum);
+            ExpressionValue expr;
 
-            skipJsonWhitespace(*parser.context);
-            if (parser.context->eof()) {
-                return handleError("empty line", actualLineNum, "");
+            // Lines that can be indexed are parsed from the tape.  The
+            // others (blank, malformed or using NaN and friends) go
+            // through the streaming parser, which also reports the errors.
+            if (threadAccum.tape.index(line, lineLength)) {
+                TapeJsonParsingContext parser(filename, threadAccum.tape,
+                                              actualLineNum);
+                try {
+                    expr = ExpressionValue::parseJson(parser, timestamp,
+                                                      config.arrays);
+                } catch (const std::exception & exc) {
+                    return handleError(exc.what(), actualLineNum, string(line, lineLength));
+                }
             }
+            else {
+                StreamingJsonParsingContext parser(filename, line, lineLength,
+                                                   actualLineNum);
 
-            ExpressionValue expr;
-            try {
-                expr = ExpressionValue::parseJson(parser, timestamp,
-                                                  config.arrays);
-            } catch (const std::exception & exc) {
-                return handleError(exc.what(), actualLineNum, string(line, lineLength));
-            }
+                skipJsonWhitespace(*parser.context);
+                if (parser.context->eof()) {
+                    return handleError("empty line", actualLineNum, "");
+                }
 
-            skipJsonWhitespace(*parser.context);
-            if (!parser.context->eof()) {
-                return handleError("extra characters at end of line", actualLineNum, "");
+                try {
+                    expr = ExpressionValue::parseJson(parser, timestamp,
+                                                      config.arrays);
+                } catch (const std::exception & exc) {
+                    return handleError(exc.what(), actualLineNum, string(line, lineLength));
+                }
+
+                skipJsonWhitespace(*parser.context);
+                if (!parser.context->eof()) {
+                    return handleError("extra characters at end of line", actualLineNum, "");
+                }
             }
 
             RowPath rowName(actualLineNum);
@@ -377,24 +407,19 @@ struct JSONImporter: public Procedure {
 
             }
 
-            int numLines = recordedLines.fetch_add(1);
-            if (numLines % PROGRESS_RATE_LOW == 0) {
-                lock_guard<mutex> l(progressMutex);
-                if (numLines > iterationStep->value) {
-                    iterationStep->value = numLines;
-                }
-                keepGoing = onProgress(jsonEncode(progress));
-            }
-
             threadAccum.threadRecorder->recordRowExprDestructive(
                 std::move(rowName), std::move(expr));
+            recordedLines.add();
 
-            return keepGoing;
+            return !sampler.cancelled();
         };
 
-        forEachLineBlock(stream, onLine, runProcConf.limit, 32,
+        forEachLineBlock(stream, onLine, runProcConf.limit,
+                         numCpus() /* parallelism */,
                          startChunk, doneChunk);
-        if (!keepGoing) {
+        sampler.stop();
+
+        if (sampler.cancelled()) {
             throw MLDB::CancellationException("Procedure import.json cancelled");
         }
 
@@ -410,7 +435,7 @@ struct JSONImporter: public Procedure {
         DEBUG_MSG(logger) << "done";
 
         Json::Value result;
-        result["rowCount"] = (int64_t)recordedLines;
+        result["rowCount"] = (int64_t)recordedLines.total();
         result["numLineErrors"] = (int64_t)errors;
         return RunOutput(result);
     }
@@ -34,6 +34,53 @@ using namespace std;
 
 
 
+namespace ML {
+
+DEFINE_ENUM_DESCRIPTION_NAMED(KMeansAlgorithmDescription,
+                              ML::KMeansAlgorithm);
+
+KMeansAlgorithmDescription::
+KMeansAlgorithmDescription()
+{
+    addValue("lloyd", ML::KMEANS_LLOYD,
+             "Lloyd's algorithm, which calculates the distance from every "
+             "point to every centroid on each iteration.");
+    addValue("hamerly", ML::KMEANS_HAMERLY,
+             "Lloyd's algorithm, with bounds on the distances that allow "
+             "most of the distance calculations to be skipped once the "
+             "clusters start to settle.  It gives the same clusters as "
+             "`lloyd`, much faster for large numbers of clusters.  It "
+             "requires the `euclidean` metric; with other metrics `lloyd` "
+             "is used.");
+    addValue("minibatch", ML::KMEANS_MINIBATCH,
+             "Mini-batch k-means, which moves the centroids towards "
+             "`batchSize` randomly sampled points on each iteration, and "
+             "only goes over all of the points once at the end to assign "
+             "them to clusters.  It is much faster on large datasets, with "
+             "slightly worse clusters.  All `maxIterations` iterations are "
+             "performed.");
+}
+
+DEFINE_ENUM_DESCRIPTION_NAMED(KMeansInitializationDescription,
+                              ML::KMeansInitialization);
+
+KMeansInitializationDescription::
+KMeansInitializationDescription()
+{
+    addValue("farthest", ML::KMEANS_INIT_FARTHEST,
+             "Choose the centroids one at a time, each as the point farthest "
+             "from the centroids already chosen out of a random sample of "
+             "points.");
+    addValue("kmeans||", ML::KMEANS_INIT_PARALLEL,
+             "Scalable k-means++ initialization, which samples candidate "
+             "centroids in a few passes over the points in proportion to "
+             "their distance from the candidates found so far, then chooses "
+             "the centroids amongst the candidates.  It gives better initial "
+             "centroids, and scales to large numbers of clusters.");
+}
+
+} // namespace ML
+
 namespace MLDB {
 
 DEFINE_STRUCTURE_DESCRIPTION(KmeansConfig);
@@ -80,6 +127,15 @@ KmeansConfigDescription()
              "Normally this will be Cosine for an orthonormal basis, and "
              "Euclidian for another basis",
              METRIC_COSINE);
+    addField("algorithm", &KmeansConfig::algorithm,
+             "Algorithm used to find the clusters.",
+             ML::KMEANS_LLOYD);
+    addField("initialization", &KmeansConfig::initialization,
+             "How the initial centroids are chosen.",
+             ML::KMEANS_INIT_FARTHEST);
+    addField("batchSize", &KmeansConfig::batchSize,
+             "Number of points sampled on each iteration of the `minibatch` "
+             "algorithm.  Ignored by the other algorithms.", 1000);
     addField("modelFileUrl", &KmeansConfig::modelFileUrl,
              "URL where the model file (with extension '.kms') should be saved. "
              "This file can be loaded by the ![](%%doclink kmeans function). "
@@ -193,6 +249,9 @@ run(const ProcedureRunConfig & run,
 
     ML::KMeans kmeans;
     kmeans.metric.reset(makeMetric(runProcConf.metric));
+    kmeans.algorithm = runProcConf.algorithm;
+    kmeans.initialization = runProcConf.initialization;
+    kmeans.batchSize = runProcConf.batchSize;
 
     vector<int> inCluster;
 
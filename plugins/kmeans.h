@@ -17,8 +17,18 @@
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/types/optional.h"
 #include "metric_space.h"
+#include "mldb/ml/kmeans.h"
 
 
+namespace ML {
+
+DECLARE_ENUM_DESCRIPTION_NAMED(KMeansAlgorithmDescription,
+                               ML::KMeansAlgorithm);
+DECLARE_ENUM_DESCRIPTION_NAMED(KMeansInitializationDescription,
+                               ML::KMeansInitialization);
+
+} // namespace ML
+
 namespace MLDB {
 
 
@@ -33,7 +43,10 @@ struct KmeansConfig : public ProcedureConfig {
         : numInputDimensions(-1),
           numClusters(10),
           maxIterations(100),
-          metric(METRIC_COSINE)
+          metric(METRIC_COSINE),
+          algorithm(ML::KMEANS_LLOYD),
+          initialization(ML::KMEANS_INIT_FARTHEST),
+          batchSize(1000)
     {
     }
 
@@ -47,6 +60,9 @@ struct KmeansConfig : public ProcedureConfig {
     int numClusters;
     int maxIterations;
     MetricSpace metric;
+    ML::KMeansAlgorithm algorithm;
+    ML::KMeansInitialization initialization;
+    int batchSize;
 
     Utf8String functionName;
 };
@@ -14,6 +14,7 @@
 #include "mldb/sql/sql_expression.h"
 
 #include <boost/algorithm/string.hpp>
+#include <mutex>
 
 using namespace std;
 
@@ -53,6 +54,13 @@ struct JsFunctionData {
     std::string filenameForErrorMessages;
     std::vector<std::string> params;
     std::shared_ptr<JsPluginContext> context;
+
+    /// Protects codeCache
+    mutable std::mutex codeCacheMutex;
+
+    /// V8 code cache of the compiled script, produced by the first thread
+    /// to compile it and used by the isolates of the others.
+    mutable std::string codeCache;
 };
 
 void
@@ -91,7 +99,17 @@ initialize(const JsFunctionData & data)
         ->Set(String::NewFromUtf8(this->isolate->isolate,
                                  "mldb"), mldb);
     
-    Utf8String jsFunctionSource = data.scriptSource;
+    // This is equivalent to fntocall = new Function('arg1', ..., 'script'),
+    // but compiled as a script so that the code cache can be used.  The
+    // script source starts on the first line, so that line numbers in
+    // error messages are unchanged.
+    Utf8String jsFunctionSource = "(function(";
+    for (unsigned i = 0;  i != data.params.size();  ++i) {
+        if (i != 0)
+            jsFunctionSource += ",";
+        jsFunctionSource += data.params[i];
+    }
+    jsFunctionSource += ") {" + data.scriptSource + "\n})";
 
     // Create a string containing the JavaScript source code.
     Handle<String> source
@@ -101,22 +119,46 @@ initialize(const JsFunctionData & data)
     TryCatch trycatch;
     //trycatch.SetVerbose(true);
 
-    // This is equivalent to fntocall = new Function('arg1', ..., 'script');
-    auto function
-        = this->context.Get(this->isolate->isolate)
-        ->Global()
-        ->Get(v8::String::NewFromUtf8(this->isolate->isolate, "Function"))
-        .As<v8::Object>();
-    
-    std::vector<v8::Handle<v8::Value> > argv;
-    for (unsigned i = 0;  i != data.params.size();  ++i)
-        argv.push_back(v8::String::NewFromUtf8(this->isolate->isolate,
-                                               data.params[i].c_str()));
-    argv.push_back(source);
+    ScriptOrigin origin
+        (String::NewFromUtf8(this->isolate->isolate,
+                             data.filenameForErrorMessages.c_str()));
+
+    // Compiling the same source in each thread's isolate is expensive, so
+    // the first thread to compile it produces a code cache that the others
+    // consume.  The cache is just a copy; if V8 rejects it, we compile
+    // from the source as usual.
+    std::unique_lock<std::mutex> guard(data.codeCacheMutex);
+
+    ScriptCompiler::CachedData * cached = nullptr;
+    ScriptCompiler::CompileOptions options = ScriptCompiler::kProduceCodeCache;
+    if (!data.codeCache.empty()) {
+        cached = new ScriptCompiler::CachedData
+            ((const uint8_t *)data.codeCache.data(), data.codeCache.size());
+        options = ScriptCompiler::kConsumeCodeCache;
+        guard.unlock();
+    }
 
-    v8::Local<v8::Function> compiled 
-        = function->CallAsConstructor(argv.size(), &argv[0])
-        .As<v8::Function>();
+    // The source takes ownership of cached
+    ScriptCompiler::Source compileSource(source, origin, cached);
+    Local<Script> script
+        = ScriptCompiler::Compile(this->isolate->isolate, &compileSource,
+                                  options);
+
+    if (options == ScriptCompiler::kProduceCodeCache) {
+        const ScriptCompiler::CachedData * produced
+            = compileSource.GetCachedData();
+        if (!script.IsEmpty() && produced && produced->length > 0)
+            data.codeCache.assign((const char *)produced->data,
+                                  produced->length);
+        guard.unlock();
+    }
+
+    v8::Local<v8::Function> compiled;
+    if (!script.IsEmpty()) {
+        auto result = script->Run();
+        if (!result.IsEmpty() && result->IsFunction())
+            compiled = result.As<v8::Function>();
+    }
 
     if (compiled.IsEmpty()) {  
         auto rep = convertException(trycatch, "Compiling jseval script");
@@ -191,7 +233,7 @@ run(const std::vector<ExpressionValue> & args,
     else if (result->IsObject()) {
         std::map<Utf8String, CellValue> cols = JS::fromJS(result);
 
-        std::vector<std::tuple<PathElement, ExpressionValue> > row;
+        StructValue row;
         row.reserve(cols.size());
         for (auto & c: cols) {
             row.emplace_back(c.first, ExpressionValue(std::move(c.second),
@@ -240,6 +282,11 @@ BoundFunction bindJsEval(const Utf8String & name,
     string params = args[1].constantValue().toString();
     boost::split(runner->params, params,
                  boost::is_any_of(","));
+
+    // Compile the script in this thread, so that errors are reported when
+    // the query is bound and the code cache is ready for the threads that
+    // run it.
+    runner->threadInfo.get()->initialize(*runner);
     
     // 3.  We don't know what it returns; TODO: allow it to be specified
     auto info = std::make_shared<AnyValueInfo>();
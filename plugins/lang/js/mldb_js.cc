@@ -731,6 +731,7 @@ struct MldbJS::Methods {
                             payload.isNull() ? "" : payload.toStringNoNewLine());
 
         InProcessRestConnection connection;
+        connection.structuredResponse = true;
 
         server->handleRequest(connection, request);
 
@@ -744,7 +745,14 @@ struct MldbJS::Methods {
         if (!connection.headers.empty())
             result->Set(v8::String::NewFromUtf8(isolate, "headers"),
                         JS::toJS(connection.headers));
-        if (!connection.response.empty()) {
+        if (connection.hasJsonResponse) {
+            // Converted straight from the value, without parsing
+            result->Set(v8::String::NewFromUtf8(isolate, "response"),
+                        JS::toJS(connection.getResponseText()));
+            result->Set(v8::String::NewFromUtf8(isolate, "json"),
+                        JS::toJS(connection.jsonResponse));
+        }
+        else if (!connection.response.empty()) {
             result->Set(v8::String::NewFromUtf8(isolate, "response"),
                         JS::toJS(connection.response));
             if (connection.contentType == "application/json") {
@@ -261,6 +261,9 @@ construct_recur(PyObject * pyObj)
     else if(pyObj == Py_None) {
         // nothing to do. leave Json::Value empty 
     }
+    else if(PyObject_CheckBuffer(pyObj)) {
+        val = construct_buffer(pyObj);
+    }
     else {
         // try to create a string reprensetation of object for a better error msg
         PyObject* str_obj = PyObject_Str(pyObj);
@@ -278,6 +281,94 @@ construct_recur(PyObject * pyObj)
     return val;
 }
 
+namespace {
+
+/** Read a single element of the given struct module format from the
+    buffer.  Returns false if the format is not supported.
+*/
+bool
+readBufferElement(char format, const char * data, Json::Value & val)
+{
+    switch (format) {
+    case '?': val = *(const bool *)data;  return true;
+    case 'b': val = *(const signed char *)data;  return true;
+    case 'B': val = *(const unsigned char *)data;  return true;
+    case 'h': val = *(const short *)data;  return true;
+    case 'H': val = *(const unsigned short *)data;  return true;
+    case 'i': val = *(const int *)data;  return true;
+    case 'I': val = *(const unsigned int *)data;  return true;
+    case 'l': val = (Json::Value::Int)*(const long *)data;  return true;
+    case 'L': val = (Json::Value::UInt)*(const unsigned long *)data;  return true;
+    case 'q': val = (Json::Value::Int)*(const long long *)data;  return true;
+    case 'Q': val = (Json::Value::UInt)*(const unsigned long long *)data;  return true;
+    case 'f': val = *(const float *)data;  return true;
+    case 'd': val = *(const double *)data;  return true;
+    default:  return false;
+    }
+}
+
+/** Convert dimension dim of the buffer, starting at data, into nested
+    arrays.
+*/
+Json::Value
+constructBufferDim(const Py_buffer & view, char format,
+                   const char * data, int dim)
+{
+    Json::Value result(Json::ValueType::arrayValue);
+    Py_ssize_t n = view.ndim == 0 ? 1 : view.shape[dim];
+    Py_ssize_t stride = view.ndim == 0 ? view.itemsize : view.strides[dim];
+    result.resize(n);
+    for (Py_ssize_t i = 0;  i < n;  ++i) {
+        const char * element = data + i * stride;
+        if (dim + 1 < view.ndim)
+            result[(int)i] = constructBufferDim(view, format, element, dim + 1);
+        else readBufferElement(format, element, result[(int)i]);
+    }
+    return result;
+}
+
+} // file scope
+
+Json::Value
+JsonValueConverter::
+construct_buffer(PyObject * pyObj)
+{
+    Py_buffer view;
+    if (PyObject_GetBuffer(pyObj, &view, PyBUF_STRIDES | PyBUF_FORMAT) != 0) {
+        PyErr_Clear();
+        throw MLDB::Exception("Unable to get buffer of object in PyDict to "
+                              "JsVal converter");
+    }
+
+    std::shared_ptr<Py_buffer> guard(&view, PyBuffer_Release);
+
+    // Native byte order and alignment only
+    const char * format = view.format ? view.format : "B";
+    if (*format == '@' || *format == '=')
+        ++format;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (*format == '<')
+        ++format;
+#endif
+
+    Json::Value dummy;
+    if (format[0] == 0 || format[1] != 0
+        || !readBufferElement(format[0], (const char *)view.buf, dummy)
+        || view.ndim > 0 && !view.strides) {
+        throw MLDB::Exception("Unsupported buffer format '"
+                              + std::string(view.format ? view.format : "")
+                              + "' in PyDict to JsVal converter");
+    }
+
+    if (view.ndim == 0) {
+        Json::Value result;
+        readBufferElement(format[0], (const char *)view.buf, result);
+        return result;
+    }
+
+    return constructBufferDim(view, format[0], (const char *)view.buf, 0);
+}
+
 void
 JsonValueConverter::
 construct(PyObject* obj, void* storage)
@@ -286,41 +377,58 @@ construct(PyObject* obj, void* storage)
     (*js) = construct_recur(obj);
 }
 
-bp::object*
+PyObject*
 JsonValueConverter::
 convert_recur(const Json::Value & js)
 {
+    // This uses the C API directly, as it's called for each element of
+    // arrays such as embeddings and going through boost::python objects
+    // costs more than the conversion itself.
     if(js.isIntegral()) {
-        //TODO this is pretty ugly. find the right way to do this
-        int i = js.asInt();
-        auto int_as_str = boost::lexical_cast<std::string>(i);
-        PyObject* pyobj = PyInt_FromString(const_cast<char*>(int_as_str.c_str()), NULL, 10);
-
-        // When you want a bp::object to manage a pointer to PyObject* pyobj one does: 
-        // bp::object o(bp::handle<>(pyobj));
-        //  In this case, the o object, manages the pyobj, it won’t increase the reference count on construction. 
-        return new bp::object(bp::handle<>(pyobj));
-
-        // using the code below will always return a long 
-        //             return new bp::int(js.asInt());
+        return PyInt_FromLong(js.asInt());
     }
     else if(js.isDouble()) {
-        return new bp::object(js.asDouble());
+        return PyFloat_FromDouble(js.asDouble());
     }
     else if(js.isString()) {
-        return new bp::str(js.asString());
+        std::string str = js.asString();
+        return PyString_FromStringAndSize(str.c_str(), str.size());
     }
     else if(js.isArray()) {
-        bp::list* lst = new bp::list();
+        PyObject * lst = PyList_New(js.size());
+        if (!lst)
+            bp::throw_error_already_set();
         for(int i=0; i<js.size(); i++) {
-            lst->append(js[i]);
+            PyObject * elem = nullptr;
+            try {
+                elem = convert_recur(js[i]);
+            } catch (...) {
+                Py_DECREF(lst);
+                throw;
+            }
+            // steals the reference to elem
+            PyList_SET_ITEM(lst, i, elem);
         }
         return lst;
     }
     else if(js.isObject()) {
-        PyDict * dict = new PyDict();
+        PyObject * dict = PyDict_New();
+        if (!dict)
+            bp::throw_error_already_set();
         for (const std::string & id : js.getMemberNames()) {
-            (*dict)[id.c_str()] = js[id];
+            PyObject * elem = nullptr;
+            try {
+                elem = convert_recur(js[id]);
+            } catch (...) {
+                Py_DECREF(dict);
+                throw;
+            }
+            int res = PyDict_SetItemString(dict, id.c_str(), elem);
+            Py_DECREF(elem);
+            if (res != 0) {
+                Py_DECREF(dict);
+                bp::throw_error_already_set();
+            }
         }
         return dict;
     }
@@ -333,7 +441,7 @@ PyObject*
 JsonValueConverter::
 convert(const Json::Value & js)
 {
-    return bp::incref(convert_recur(js)->ptr());
+    return convert_recur(js);
 }
 
 static struct AtInit {
@@ -390,10 +390,16 @@ struct JsonValueConverter
 
     static Json::Value construct_recur(PyObject * pyObj);
 
+    /** Object supporting the buffer protocol, such as a numpy array, ->
+        Json::Value.  The elements are read directly from the buffer.
+    */
+    static Json::Value construct_buffer(PyObject * pyObj);
+
     /** PyDict -> Json::Value */
     static void construct(PyObject* obj, void* storage);
 
-    static boost::python::object* convert_recur(const Json::Value & js);
+    /** Json::Value -> Python object.  Returns a new reference. */
+    static PyObject* convert_recur(const Json::Value & js);
 
     /** Json::Value -> PyDict */
     static PyObject* convert(const Json::Value & js);
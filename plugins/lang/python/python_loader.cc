@@ -679,7 +679,6 @@ class mldb_wrapper(object):
             self.headers     = {k: v for k, v in
                                 raw_response.get('headers', {})}
             self.status_code = raw_response['statusCode']
-            self.text        = raw_response.get('response', '')
             self.raw         = raw_response
 
             self.apparent_encoding = 'unimplemented'
@@ -696,7 +695,15 @@ class mldb_wrapper(object):
             self.reason            = 'unimplemented'
             self.request           = 'unimplemented'
 
+        @property
+        def text(self):
+            if 'json' in self.raw:
+                return mldb_wrapper.jsonlib.dumps(self.raw['json'])
+            return self.raw.get('response', '')
+
         def json(self):
+            if 'json' in self.raw:
+                return self.raw['json']
             return mldb_wrapper.jsonlib.loads(self.text)
 
         def __str__(self):
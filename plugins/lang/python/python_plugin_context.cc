@@ -366,6 +366,7 @@ perform(MldbPythonContext * mldbCon,
 
     RestRequest request(header, payload.toString());
     InProcessRestConnection connection;
+    connection.structuredResponse = true;
 
     // add magic token to notify the receiver that this is a child call
     if(resource.find("/plugins/") != std::string::npos) {
@@ -410,7 +411,11 @@ perform(MldbPythonContext * mldbCon,
         }
         result["headers"] = headers;
     }
-    if (!connection.response.empty())
+    // A JSON response is passed as a value, and it's turned into Python
+    // objects without going through text
+    if (connection.hasJsonResponse)
+        result["json"] = std::move(connection.jsonResponse);
+    else if (!connection.response.empty())
         result["response"] = connection.response;
 
     return result;
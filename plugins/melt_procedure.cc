@@ -20,6 +20,9 @@
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/plugins/sparse_matrix_dataset.h"
 #include "mldb/server/bound_queries.h"
+#include "mldb/server/per_thread_accumulator.h"
+#include "mldb/base/parallel.h"
+#include "mldb/core/recorder.h"
 
 using namespace std;
 
@@ -138,7 +141,41 @@ run(const ProcedureRunConfig & run,
     ColumnPath keyColumnName(runProcConf.keyColumnName);
     ColumnPath valueColumnName(runProcConf.valueColumnName);
 
-    std::mutex recordMutex;
+    // Each thread records the rows it melts into its own chunk, which
+    // is handed over to the dataset once it has enough rows.  The rows
+    // are passed to the chunk in batches, so neither the batch nor the
+    // chunk grow without bound for wide input rows.
+    static constexpr size_t BATCH_ROWS = 1024;
+    static constexpr size_t CHUNK_ROWS = 65536;
+
+    typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+
+    struct ThreadAccum {
+        std::unique_ptr<Recorder> threadRecorder;
+        Rows batch;
+        size_t rowsInChunk = 0;
+    };
+
+    Dataset::MultiChunkRecorder recorder = outputDataset->getChunkRecorder();
+    PerThreadAccumulator<ThreadAccum> accum;
+    std::atomic<size_t> chunkNumber(0);
+
+    auto flushBatch = [&] (ThreadAccum & thr)
+        {
+            if (thr.batch.empty())
+                return;
+            if (!thr.threadRecorder)
+                thr.threadRecorder = recorder.newChunk(chunkNumber.fetch_add(1));
+            thr.rowsInChunk += thr.batch.size();
+            thr.threadRecorder->recordRowsDestructive(std::move(thr.batch));
+            thr.batch.clear();
+            if (thr.rowsInChunk >= CHUNK_ROWS) {
+                thr.threadRecorder->finishedChunk();
+                thr.threadRecorder.reset();
+                thr.rowsInChunk = 0;
+            }
+        };
+
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
@@ -166,18 +203,23 @@ run(const ProcedureRunConfig & run,
                 expr.forEachAtom(onAtom, ColumnPath());
             }
 
+            ThreadAccum & thr = accum.get();
+
             // Melted
             for(auto & col : row.columns) {
-                // TODO. should I call recordRow twice instead of doing a vector copy here?
-                RowValue currOutputRow(fixedOutputRows);
+                RowValue currOutputRow;
+                currOutputRow.reserve(fixedOutputRows.size() + 2);
+                currOutputRow.insert(currOutputRow.end(),
+                                     fixedOutputRows.begin(),
+                                     fixedOutputRows.end());
 
                 currOutputRow.emplace_back(keyColumnName, get<0>(col).toUtf8String(), rowTs);
-                currOutputRow.emplace_back(valueColumnName, get<1>(col), rowTs);
-
-                RowPath rowName = row.rowName + std::get<0>(col);
+                currOutputRow.emplace_back(valueColumnName, std::move(get<1>(col)), rowTs);
 
-                std::unique_lock<std::mutex> guard(recordMutex);
-                outputDataset->recordRow(rowName, currOutputRow);
+                thr.batch.emplace_back(row.rowName + std::get<0>(col),
+                                       std::move(currOutputRow));
+                if (thr.batch.size() >= BATCH_ROWS)
+                    flushBatch(thr);
             }
             return true;
         };
@@ -194,7 +236,17 @@ run(const ProcedureRunConfig & run,
                  runProcConf.inputData.stm->limit,
                  nullptr /* progress */);
 
-    outputDataset->commit();
+    // Finish off the last bits of each thread
+    parallelMap(0, accum.threads.size(),
+                [&] (size_t n)
+                {
+                    auto & thr = *accum.threads[n];
+                    flushBatch(thr);
+                    if (thr.threadRecorder)
+                        thr.threadRecorder->finishedChunk();
+                });
+
+    recorder.commit();
 
     return RunOutput();
 }
@@ -57,6 +57,17 @@ create(MetricSpace space)
     }
 }
 
+void
+DistanceMetric::
+distBatch(int rowNum, const distribution<float> & coords,
+          const int * rowNums,
+          const distribution<float> * const * rows,
+          size_t n, float * output) const
+{
+    for (size_t i = 0;  i < n;  ++i)
+        output[i] = dist(rowNum, rowNums[i], coords, *rows[i]);
+}
+
 
 /*****************************************************************************/
 /* EUCLIDEAN DISTANCE METRIC                                                 */
@@ -113,12 +124,21 @@ dist(int rowNum1, int rowNum2,
     */
         
     // Use the optimized version, since we know the sum
-    float dpResult = -2.0 * ML::SIMD::vec_dotprod_dp(&coords1[0],
-                                                     &coords2[0],
-                                                     coords1.size());
-    ExcAssert(isfinite(dpResult));
+    return distFromDotProduct(rowNum1, rowNum2,
+                              ML::SIMD::vec_dotprod_dp(&coords1[0],
+                                                       &coords2[0],
+                                                       coords1.size()));
+}
 
+float
+EuclideanDistanceMetric::
+distFromDotProduct(int rowNum1, int rowNum2, double dotprod) const
+{
+    // The order of the additions matters for dist(x,y) === dist(y,x)
+    ExcAssertLess(rowNum1, rowNum2);
 
+    float dpResult = -2.0 * dotprod;
+    ExcAssert(isfinite(dpResult));
 
     float distSquared = dpResult + sum_dist.at(rowNum1) + sum_dist.at(rowNum2);
     ExcAssert(isfinite(distSquared));
@@ -130,6 +150,44 @@ dist(int rowNum1, int rowNum2,
     return sqrtf(distSquared);
 }
 
+void
+EuclideanDistanceMetric::
+distBatch(int rowNum, const distribution<float> & coords,
+          const int * rowNums,
+          const distribution<float> * const * rows,
+          size_t n, float * output) const
+{
+    std::vector<const float *> ptrs(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        ExcAssertEqual(rows[i]->size(), coords.size());
+        ptrs[i] = rows[i]->data();
+    }
+
+    std::vector<double> results(n);
+
+    if (rowNum == -1) {
+        // Same as calc()
+        ML::SIMD::vec_euclid_batch(coords.data(), ptrs.data(), n,
+                                   coords.size(), results.data());
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = sqrt(results[i]);
+        return;
+    }
+
+    ML::SIMD::vec_dotprod_dp_batch(coords.data(), ptrs.data(), n,
+                                   coords.size(), results.data());
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (rowNums[i] == -1)
+            output[i] = calc(coords, *rows[i]);
+        else if (rowNums[i] == rowNum)
+            output[i] = 0.0;
+        else output[i] = distFromDotProduct(std::min(rowNum, rowNums[i]),
+                                            std::max(rowNum, rowNums[i]),
+                                            results[i]);
+    }
+}
+
 
 /*****************************************************************************/
 /* COSINE DISTANCE METRIC                                                    */
@@ -218,6 +276,16 @@ dist(int rowNum1, int rowNum2,
     if (rowNum1 == rowNum2)
         return 0.0;
 
+    return distFromDotProduct(rowNum1, rowNum2, coords1.dotprod(coords2));
+}
+
+float
+CosineDistanceMetric::
+distFromDotProduct(int rowNum1, int rowNum2, double dotprod) const
+{
+    // The order of the multiplications matters for dist(x,y) === dist(y,x)
+    ExcAssertLess(rowNum1, rowNum2);
+
     if (!isfinite(two_norm_recip.at(rowNum1))
         && !isfinite(two_norm_recip.at(rowNum2))) {
         return 0.0;
@@ -227,7 +295,7 @@ dist(int rowNum1, int rowNum2,
         return 1.0;
     }
 
-    float result = 1.0 - coords1.dotprod(coords2) * two_norm_recip.at(rowNum1) * two_norm_recip.at(rowNum2);
+    float result = 1.0 - dotprod * two_norm_recip.at(rowNum1) * two_norm_recip.at(rowNum2);
     if (result < 0.0) {
         result = 0.0;
     }
@@ -238,6 +306,41 @@ dist(int rowNum1, int rowNum2,
     return result;
 }
 
+void
+CosineDistanceMetric::
+distBatch(int rowNum, const distribution<float> & coords,
+          const int * rowNums,
+          const distribution<float> * const * rows,
+          size_t n, float * output) const
+{
+    // Queries for unknown rows go through calc(), which needs the norms
+    // of both vectors anyway; only the known rows are batched.
+    if (rowNum == -1) {
+        DistanceMetric::distBatch(rowNum, coords, rowNums, rows, n, output);
+        return;
+    }
+
+    std::vector<const float *> ptrs(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        ExcAssertEqual(rows[i]->size(), coords.size());
+        ptrs[i] = rows[i]->data();
+    }
+
+    std::vector<double> results(n);
+    ML::SIMD::vec_dotprod_dp_batch(coords.data(), ptrs.data(), n,
+                                   coords.size(), results.data());
+
+    for (size_t i = 0;  i < n;  ++i) {
+        if (rowNums[i] == -1)
+            output[i] = calc(coords, *rows[i]);
+        else if (rowNums[i] == rowNum)
+            output[i] = 0.0;
+        else output[i] = distFromDotProduct(std::min(rowNum, rowNums[i]),
+                                            std::max(rowNum, rowNums[i]),
+                                            results[i]);
+    }
+}
+
 
 
 } // namespace MLDB
@@ -44,6 +44,18 @@ struct DistanceMetric {
                        const distribution<float> & coords1,
                        const distribution<float> & coords2) const = 0;
 
+    /** Calculate the distance between one row and each of n others,
+        putting the results in output.  The row numbers have the same
+        meaning as for dist(), and each result is exactly the same as
+        dist() would return.  This allows the one against many comparisons
+        of nearest neighbour searches to be done with the batched SIMD
+        kernels; the default implementation simply calls dist().
+    */
+    virtual void distBatch(int rowNum, const distribution<float> & coords,
+                           const int * rowNums,
+                           const distribution<float> * const * rows,
+                           size_t n, float * output) const;
+
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
 };
@@ -61,10 +73,18 @@ struct EuclideanDistanceMetric: public DistanceMetric {
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
+    void distBatch(int rowNum, const distribution<float> & coords,
+                   const int * rowNums,
+                   const distribution<float> * const * rows,
+                   size_t n, float * output) const;
+
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
     std::vector<double> sum_dist;
 
+    /// Distance between two known rows given their dot product
+    float distFromDotProduct(int rowNum1, int rowNum2, double dotprod) const;
+
     /// Static method to perform the calculation, with no caching
     static float calc(const distribution<float> & coords1,
                       const distribution<float> & coords2);
@@ -83,9 +103,17 @@ struct CosineDistanceMetric: public DistanceMetric {
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
+    void distBatch(int rowNum, const distribution<float> & coords,
+                   const int * rowNums,
+                   const distribution<float> * const * rows,
+                   size_t n, float * output) const;
+
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
     std::vector<double> two_norm_recip;
+
+    /// Distance between two known rows given their dot product
+    float distFromDotProduct(int rowNum1, int rowNum2, double dotprod) const;
     
     /// Static method to perform the calculation, with no caching
     static float calc(const distribution<float> & coords1,
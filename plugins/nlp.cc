@@ -11,7 +11,8 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/sql/tokenize.h"
-#include "mldb/base/parse_context.h"
+#include "mldb/ext/cityhash/src/city.h"
+#include <cstring>
 
 using namespace std;
 
@@ -49,6 +50,165 @@ ApplyStopWordsFunctionConfigDescription()
 {
 }
 
+
+/*****************************************************************************/
+/* STOP WORDS                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/** Stop words of each language. */
+const std::map<std::string, std::vector<const char *> > &
+getStopWordLists()
+{
+    static const std::map<std::string, std::vector<const char *> > result = {
+        {"english", {
+            "a's","able","about","above","according","accordingly","across",
+            "actually","after","afterwards","again","against","ain't","all",
+            "allow","allows","almost","alone","along","already","also",
+            "although","always","am","among","amongst","an","and","another",
+            "any","anybody","anyhow","anyone","anything","anyway","anyways",
+            "anywhere","apart","appear","appreciate","appropriate","are",
+            "aren't","around","as","aside","ask","asking","associated","at",
+            "available","away","awfully","be","became","because","become",
+            "becomes","becoming","been","before","beforehand","behind","being",
+            "believe","below","beside","besides","best","better","between",
+            "beyond","both","brief","but","by","c'mon","c's","came","can",
+            "can't","cannot","cant","cause","causes","certain","certainly",
+            "changes","clearly","co","com","come","comes","concerning",
+            "consequently","consider","considering","contain","containing",
+            "contains","corresponding","could","couldn't","course","currently",
+            "definitely","described","despite","did","didn't","different","do",
+            "does","doesn't","doing","don't","done","down","downwards",
+            "during","each","edu","eg","eight","either","else","elsewhere",
+            "enough","entirely","especially","et","etc","even","ever","every",
+            "everybody","everyone","everything","everywhere","ex","exactly",
+            "example","except","far","few","fifth","first","five","followed",
+            "following","follows","for","former","formerly","forth","four",
+            "from","further","furthermore","get","gets","getting","given",
+            "gives","go","goes","going","gone","got","gotten","greetings",
+            "had","hadn't","happens","hardly","has","hasn't","have","haven't",
+            "having","he","he's","hello","help","hence","her","here","here's",
+            "hereafter","hereby","herein","hereupon","hers","herself","hi",
+            "him","himself","his","hither","hopefully","how","howbeit",
+            "however","i'd","i'll","i'm","i've","ie","if","ignored",
+            "immediate","in","inasmuch","inc","indeed","indicate","indicated",
+            "indicates","inner","insofar","instead","into","inward","is",
+            "isn't","it","it'd","it'll","it's","its","itself","just","keep",
+            "keeps","kept","know","known","knows","last","lately","later",
+            "latter","latterly","least","less","lest","let","let's","like",
+            "liked","likely","little","look","looking","looks","ltd","mainly",
+            "many","may","maybe","me","mean","meanwhile","merely","might",
+            "more","moreover","most","mostly","much","must","my","myself",
+            "name","namely","nd","near","nearly","necessary","need","needs",
+            "neither","never","nevertheless","new","next","nine","no","nobody",
+            "non","none","noone","nor","normally","not","nothing","novel",
+            "now","nowhere","obviously","of","off","often","oh","ok","okay",
+            "old","on","once","one","ones","only","onto","or","other","others",
+            "otherwise","ought","our","ours","ourselves","out","outside",
+            "over","overall","own","particular","particularly","per","perhaps",
+            "placed","please","plus","possible","presumably","probably",
+            "provides","que","quite","qv","rather","rd","re","really",
+            "reasonably","regarding","regardless","regards","relatively",
+            "respectively","right","said","same","saw","say","saying","says",
+            "second","secondly","see","seeing","seem","seemed","seeming",
+            "seems","seen","self","selves","sensible","sent","serious",
+            "seriously","seven","several","shall","she","should","shouldn't",
+            "since","six","so","some","somebody","somehow","someone",
+            "something","sometime","sometimes","somewhat","somewhere","soon",
+            "sorry","specified","specify","specifying","still","sub","such",
+            "sup","sure","t's","take","taken","tell","tends","th","than",
+            "thank","thanks","thanx","that","that's","thats","the","their",
+            "theirs","them","themselves","then","thence","there","there's",
+            "thereafter","thereby","therefore","therein","theres","thereupon",
+            "these","they","they'd","they'll","they're","they've","think",
+            "third","this","thorough","thoroughly","those","though","three",
+            "through","throughout","thru","thus","to","together","too","took",
+            "toward","towards","tried","tries","truly","try","trying","twice",
+            "two","un","under","unfortunately","unless","unlikely","until",
+            "unto","up","upon","us","use","used","useful","uses","using",
+            "usually","value","various","very","via","viz","vs","want","wants",
+            "was","wasn't","way","we","we'd","we'll","we're","we've","welcome",
+            "well","went","were","weren't","what","what's","whatever","when",
+            "whence","whenever","where","where's","whereafter","whereas",
+            "whereby","wherein","whereupon","wherever","whether","which",
+            "while","whither","who","who's","whoever","whole","whom","whose",
+            "why","will","willing","wish","with","within","without","won't",
+            "wonder","would","wouldn't","yes","yet","you","you'd","you'll",
+            "you're","you've","your","yours","yourself","yourselves","zero"
+        }}
+    };
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPILED STOP WORDS                                                       */
+/*****************************************************************************/
+
+CompiledStopWords::
+CompiledStopWords(const std::vector<const char *> & words)
+{
+    size_t numSlots = 16;
+    while (numSlots < words.size() * 2)
+        numSlots *= 2;
+    mask = numSlots - 1;
+    slots.resize(numSlots, -1);
+
+    for (const char * w: words) {
+        size_t len = strlen(w);
+        if (contains(w, len))
+            continue;
+        int index = offsets.size();
+        offsets.push_back(chars.size());
+        chars.append(w, len);
+        offsets.push_back(chars.size());
+
+        size_t slot = CityHash64(w, len) & mask;
+        while (slots[slot] != -1)
+            slot = (slot + 1) & mask;
+        slots[slot] = index;
+    }
+}
+
+bool
+CompiledStopWords::
+contains(const char * str, size_t len) const
+{
+    size_t slot = CityHash64(str, len) & mask;
+    for (;;) {
+        int index = slots[slot];
+        if (index == -1)
+            return false;
+        uint32_t begin = offsets[index], end = offsets[index + 1];
+        if (end - begin == len && memcmp(chars.data() + begin, str, len) == 0)
+            return true;
+        slot = (slot + 1) & mask;
+    }
+}
+
+const CompiledStopWords *
+CompiledStopWords::
+get(const std::string & language)
+{
+    // Compiled once, when first needed, and shared by all functions
+    static const std::map<std::string, CompiledStopWords> compiled = [] ()
+        {
+            std::map<std::string, CompiledStopWords> result;
+            for (auto & l: getStopWordLists())
+                result.emplace(l.first, CompiledStopWords(l.second));
+            return result;
+        } ();
+
+    auto it = compiled.find(language);
+    if (it == compiled.end())
+        return nullptr;
+    return &it->second;
+}
+
+
 /*****************************************************************************/
 /* APPLY STOP WORDS FUNCTION                                                 */
 /*****************************************************************************/
@@ -60,14 +220,9 @@ ApplyStopWordsFunction(MldbServer * owner,
     : BaseT(owner, config)
 {
     //functionConfig = config.params.convert<ApplyStopWordsFunctionConfig>();
-
-    stopwords = {{"english", {"a's","able","about","above","according","accordingly","across","actually","after","afterwards","again","against","ain't","all","allow","allows","almost","alone","along","already","also","although","always","am","among","amongst","an","and","another","any","anybody","anyhow","anyone","anything","anyway","anyways","anywhere","apart","appear","appreciate","appropriate","are","aren't","around","as","aside","ask","asking","associated","at","available","away","awfully","be","became","because","become","becomes","becoming","been","before","beforehand","behind","being","believe","below","beside","besides","best","better","between","beyond","both","brief","but","by","c'mon","c's","came","can","can't","cannot","cant","cause","causes","certain","certainly","changes","clearly","co","com","come","comes","concerning","consequently","consider","considering","contain","containing","contains","corresponding","could","couldn't","course","currently","definitely","described","despite","did","didn't","different","do","does","doesn't","doing","don't","done","down","downwards","during","each","edu","eg","eight","either","else","elsewhere","enough","entirely","especially","et","etc","even","ever","every","everybody","everyone","everything","everywhere","ex","exactly","example","except","far","few","fifth","first","five","followed","following","follows","for","former","formerly","forth","four","from","further","furthermore","get","gets","getting","given","gives","go","goes","going","gone","got","gotten","greetings","had","hadn't","happens","hardly","has","hasn't","have","haven't","having","he","he's","hello","help","hence","her","here","here's","hereafter","hereby","herein","hereupon","hers","herself","hi","him","himself","his","hither","hopefully","how","howbeit","however","i'd","i'll","i'm","i've","ie","if","ignored","immediate","in","inasmuch","inc","indeed","indicate","indicated","indicates","inner","insofar","instead","into","inward","is","isn't","it","it'd","it'll","it's","its","itself","just","keep","keeps","kept","know","known","knows","last","lately","later","latter","latterly","least","less","lest","let","let's","like","liked","likely","little","look","looking","looks","ltd","mainly","many","may","maybe","me","mean","meanwhile","merely","might","more","moreover","most","mostly","much","must","my","myself","name","namely","nd","near","nearly","necessary","need","needs","neither","never","nevertheless","new","next","nine","no","nobody","non","none","noone","nor","normally","not","nothing","novel","now","nowhere","obviously","of","off","often","oh","ok","okay","old","on","once","one","ones","only","onto","or","other","others","otherwise","ought","our","ours","ourselves","out","outside","over","overall","own","particular","particularly","per","perhaps","placed","please","plus","possible","presumably","probably","provides","que","quite","qv","rather","rd","re","really","reasonably","regarding","regardless","regards","relatively","respectively","right","said","same","saw","say","saying","says","second","secondly","see","seeing","seem","seemed","seeming","seems","seen","self","selves","sensible","sent","serious","seriously","seven","several","shall","she","should","shouldn't","since","six","so","some","somebody","somehow","someone","something","sometime","sometimes","somewhat","somewhere","soon","sorry","specified","specify","specifying","still","sub","such","sup","sure","t's","take","taken","tell","tends","th","than","thank","thanks","thanx","that","that's","thats","the","their","theirs","them","themselves","then","thence","there","there's","thereafter","thereby","therefore","therein","theres","thereupon","these","they","they'd","they'll","they're","they've","think","third","this","thorough","thoroughly","those","though","three","through","throughout","thru","thus","to","together","too","took","toward","towards","tried","tries","truly","try","trying","twice","two","un","under","unfortunately","unless","unlikely","until","unto","up","upon","us","use","used","useful","uses","using","usually","value","various","very","via","viz","vs","want","wants","was","wasn't","way","we","we'd","we'll","we're","we've","welcome","well","went","were","weren't","what","what's","whatever","when","whence","whenever","where","where's","whereafter","whereas","whereby","wherein","whereupon","wherever","whether","which","while","whither","who","who's","whoever","whole","whom","whose","why","will","willing","wish","with","within","without","won't","wonder","would","wouldn't","yes","yet","you","you'd","you'll","you're","you've","your","yours","yourself","yourselves","zero"}}};
-
-    auto it = stopwords.find(functionConfig.language);
-    if(it == stopwords.end())
+    stopwords = CompiledStopWords::get(functionConfig.language);
+    if (!stopwords)
         throw MLDB::Exception("Unsupported language: " + functionConfig.language);
-
-    selected_stopwords = &(it->second);
 }
 
 Words
@@ -80,9 +235,12 @@ call(Words input) const
                        const CellValue & val,
                        Date ts)
         {
-            const string colStr = columnName.toSimpleName().stealRawString();
+            if (columnName.size() != 1)
+                columnName.toSimpleName();  // throws the usual error
 
-            if(!selected_stopwords->count(colStr)) {
+            // Look up the bytes of the name directly, without a copy
+            auto name = columnName.getStringView(0);
+            if (!stopwords->contains(name.first, name.second)) {
                 rtnRow.push_back(make_tuple(columnName, val, ts));
             }
 
@@ -106,6 +264,60 @@ regAppylStopWordsFunction(builtinPackage(),
 
 
 
+/*****************************************************************************/
+/* STEMMERS                                                                  */
+/*****************************************************************************/
+
+namespace {
+
+struct StemmerDeleter {
+    void operator () (sb_stemmer * stemmer) const
+    {
+        sb_stemmer_delete(stemmer);
+    }
+};
+
+typedef std::unique_ptr<sb_stemmer, StemmerDeleter> StemmerPtr;
+
+StemmerPtr createStemmer(const std::string & language)
+{
+    StemmerPtr result(sb_stemmer_new(language.c_str(), "UTF_8"));
+    if (!result) {
+        throw MLDB::Exception(MLDB::format("language `%s' not available for stemming in "
+                "encoding `%s'", language, "utf8"));
+    }
+    return result;
+}
+
+/** Return the stemmer for the language for this thread.  The sb_stemmer
+    objects aren't thread safe, but they can be reused for as many words
+    as we like, and the stemmed word is returned in their own buffer.
+*/
+sb_stemmer * getThreadStemmer(const std::string & language)
+{
+    static thread_local std::map<std::string, StemmerPtr> stemmers;
+    auto it = stemmers.find(language);
+    if (it == stemmers.end())
+        it = stemmers.emplace(language, createStemmer(language)).first;
+    return it->second.get();
+}
+
+/** Stem the word, returning a pointer to the stem (which lives until the
+    next call with this stemmer) and its length.
+*/
+std::pair<const char *, size_t>
+stem(sb_stemmer * stemmer, const char * word, size_t len)
+{
+    const sb_symbol * stemmed
+        = sb_stemmer_stem(stemmer, (const sb_symbol *)word, len);
+    if (stemmed == nullptr)
+        throw MLDB::Exception("Out of memory when stemming");
+    return { (const char *)stemmed, (size_t)sb_stemmer_length(stemmer) };
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* STEMMER FUNCTION CONFIG                                                   */
 /*****************************************************************************/
@@ -132,22 +344,14 @@ StemmerFunction(MldbServer * owner,
     functionConfig = config.params.convert<StemmerFunctionConfig>();
 
     //this is just to verify the language at creation time
-    std::unique_ptr<sb_stemmer> stemmer(sb_stemmer_new(functionConfig.language.c_str(), "UTF_8"));
-
-    if (!stemmer) {
-        throw MLDB::Exception(MLDB::format("language `%s' not available for stemming in "
-                "encoding `%s'", functionConfig.language, "utf8"));
-    }
+    createStemmer(functionConfig.language);
 }
 
 Words
 StemmerFunction::
 call(Words input) const
 {
-    // the sb_stemmer object is not thread safe
-    // but this allocation is not very expensive as profiled
-    // compared to actually doing the stemming
-    std::unique_ptr<sb_stemmer> stemmer(sb_stemmer_new(functionConfig.language.c_str(), "UTF_8"));
+    sb_stemmer * stemmer = getThreadStemmer(functionConfig.language);
 
     map<PathElement, pair<double, Date> > accum;
 
@@ -156,14 +360,11 @@ call(Words input) const
                        const CellValue & val,
                        Date ts)
         {
-            string str = columnName.toSimpleName().stealRawString();
+            if (columnName.size() != 1)
+                columnName.toSimpleName();  // throws the usual error
 
-            const sb_symbol * stemmed = sb_stemmer_stem(stemmer.get(),
-                    (const unsigned char*)str.c_str(), str.size());
-
-            if (stemmed == nullptr) {
-                throw MLDB::Exception("Out of memory when stemming");
-            }
+            auto word = columnName.getStringView(0);
+            auto stemmed = stem(stemmer, word.first, word.second);
 
             // Cast the cell value as a double before we accumulate them
             double val_as_double;
@@ -172,11 +373,11 @@ call(Words input) const
             else
                 val_as_double = val.toDouble();
 
-            PathElement col(string((const char*)stemmed));
+            PathElement col(stemmed.first, stemmed.second);
 
             auto it = accum.find(col);
             if(it == accum.end()) {
-                accum.emplace(col, make_pair(val_as_double, ts));
+                accum.emplace(std::move(col), make_pair(val_as_double, ts));
             }
             else {
                 it->second.first += val_as_double;
@@ -221,53 +422,44 @@ StemmerOnDocumentFunction(MldbServer * owner,
     functionConfig = config.params.convert<StemmerFunctionConfig>();
 
     //this is just to verify the language at creation time
-    std::unique_ptr<sb_stemmer> stemmer(sb_stemmer_new(functionConfig.language.c_str(), "UTF_8"));
-
-    if (!stemmer) {
-        throw MLDB::Exception(MLDB::format("language `%s' not available for stemming in "
-                "encoding `%s'", functionConfig.language, "utf8"));
-    }
+    createStemmer(functionConfig.language);
 }
 
 Document
 StemmerOnDocumentFunction::
 call(Document doc) const
 {
-    // the sb_stemmer object is not thread safe
-    // but this allocation is not very expensive as profiled
-    // compared to actually doing the stemming
-    std::unique_ptr<sb_stemmer> stemmer(sb_stemmer_new(functionConfig.language.c_str(), "UTF_8"));
-
-    Utf8String accum;
-
-    auto onGram = [&](Utf8String& word) -> bool
-    {
-        const string& str = word.rawString(); 
-
-        const sb_symbol * stemmed = sb_stemmer_stem(stemmer.get(),
-                    (const unsigned char*)str.c_str(), str.size());
-
-        if (stemmed == NULL) {
-            throw MLDB::Exception("Out of memory when stemming");
-        }
-
-        Utf8String out((const char*)stemmed);
-
-        if (accum.empty())
-          accum = out;
-        else
-          accum += " " + out;
-       
-        return true;
-    };
+    sb_stemmer * stemmer = getThreadStemmer(functionConfig.language);
 
     Utf8String text = doc.document.toUtf8String();
-    ParseContext pcontext(text.rawData(), text.rawData(), text.rawLength());
-
-    tokenize_exec(onGram, pcontext, " ", "", 0);
+    const char * p = text.rawData();
+    const char * end = p + text.rawLength();
+
+    // Single pass over the text, stemming each space separated word
+    // straight from the text into the output.  This gives the same words,
+    // including empty ones from repeated spaces, as tokenizing on spaces.
+    std::string accum;
+    accum.reserve(text.rawLength());
+
+    if (p != end) {
+        for (;;) {
+            const char * wordEnd = (const char *)memchr(p, ' ', end - p);
+            if (!wordEnd)
+                wordEnd = end;
+
+            auto stemmed = stem(stemmer, p, wordEnd - p);
+            if (!accum.empty())
+                accum += ' ';
+            accum.append(stemmed.first, stemmed.second);
+
+            if (wordEnd == end)
+                break;
+            p = wordEnd + 1;
+        }
+    }
 
     Document result;
-    result.document = ExpressionValue(std::move(accum),
+    result.document = ExpressionValue(Utf8String(std::move(accum), false),
                                       doc.document.getEffectiveTimestamp());
     return result;
 }
@@ -42,6 +42,32 @@ struct Document {
 DECLARE_STRUCTURE_DESCRIPTION(Document);
 
 
+/*****************************************************************************/
+/* COMPILED STOP WORDS                                                       */
+/*****************************************************************************/
+
+/** Set of stop words, compiled into an open addressed hash table over a
+    single block of characters, so that a word can be looked up from its
+    bytes without allocating.
+*/
+struct CompiledStopWords {
+    CompiledStopWords(const std::vector<const char *> & words);
+
+    bool contains(const char * str, size_t len) const;
+
+    /** Return the stop words for the given language, or null if there are
+        none.  These are compiled once and shared.
+    */
+    static const CompiledStopWords * get(const std::string & language);
+
+private:
+    std::string chars;               ///< All words, one after the other
+    std::vector<uint32_t> offsets;   ///< Begin and end of each word in chars
+    std::vector<int> slots;          ///< Index of word in each slot, or -1
+    size_t mask;
+};
+
+
 /*****************************************************************************/
 /* APPLY STOP WORDS FUNCTION                                                 */
 /*****************************************************************************/
@@ -53,8 +79,7 @@ struct ApplyStopWordsFunction: public ValueFunctionT<Words, Words> {
     
     virtual Words call(Words input) const override;
 
-    std::map<std::string, std::set<std::string> > stopwords;
-    std::set<std::string> * selected_stopwords;
+    const CompiledStopWords * stopwords;
 
     ApplyStopWordsFunctionConfig functionConfig;
 };
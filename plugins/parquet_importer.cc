@@ -0,0 +1,599 @@
+/* parquet_importer.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Importer for Apache Parquet files.
+*/
+
+#include "mldb/plugins/parquet_reader.h"
+#include "mldb/utils/progress.h"
+#include "mldb/core/procedure.h"
+#include "mldb/core/dataset.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/sql/builtin_functions.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/timers.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/utils/log.h"
+#include <cmath>
+
+using namespace std;
+
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARQUET IMPORTER                                                          */
+/*****************************************************************************/
+
+struct ParquetImporterConfig : ProcedureConfig {
+
+    static constexpr const char * name = "import.parquet";
+
+    ParquetImporterConfig() :
+          limit(-1),
+          offset(0),
+          select(SelectExpression::STAR),
+          where(SqlExpression::TRUE),
+          named(SqlExpression::parse("rowNumber()")),
+          timestamp(SqlExpression::parse("fileTimestamp()"))
+    {
+        outputDataset.withType("tabular");
+    }
+
+    Url dataFileUrl;
+    PolyConfigT<Dataset> outputDataset;
+
+    int64_t limit;
+    int64_t offset;
+    SelectExpression select;
+    std::shared_ptr<SqlExpression> where;
+    std::shared_ptr<SqlExpression> named;
+    std::shared_ptr<SqlExpression> timestamp;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(ParquetImporterConfig);
+
+DEFINE_STRUCTURE_DESCRIPTION(ParquetImporterConfig);
+
+ParquetImporterConfigDescription::
+ParquetImporterConfigDescription()
+{
+    addField("dataFileUrl", &ParquetImporterConfig::dataFileUrl,
+             "URL to load Parquet file from");
+    addField("outputDataset", &ParquetImporterConfig::outputDataset,
+             "Configuration for output dataset",
+             PolyConfigT<Dataset>().withType("tabular"));
+    addField("limit", &ParquetImporterConfig::limit,
+             "Maximum number of rows to process");
+    addField("offset", &ParquetImporterConfig::offset,
+             "Skip the first n rows.", int64_t(0));
+    addField("select", &ParquetImporterConfig::select,
+             "Which columns to use.  Only the columns used here and in the "
+             "other expressions are read from the file.",
+             SelectExpression::STAR);
+    addField("where", &ParquetImporterConfig::where,
+             "Which rows to use.",
+             SqlExpression::TRUE);
+    addField("named", &ParquetImporterConfig::named,
+             "Row name expression for output dataset. Note that each row "
+             "must have a unique name.",
+             SqlExpression::parse("rowNumber()"));
+    addField("timestamp", &ParquetImporterConfig::timestamp,
+             "Expression for row timestamp.",
+             SqlExpression::parse("fileTimestamp()"));
+
+    addParent<ProcedureConfig>();
+
+    onPostValidate = [] (ParquetImporterConfig * config,
+                         JsonParsingContext & context)
+    {
+        if (config->dataFileUrl.empty()) {
+            throw HttpReturnException(
+                400,
+                "dataFileUrl is a required property and must not be empty");
+        }
+    };
+}
+
+
+/*****************************************************************************/
+/* SQL PARQUET SCOPE                                                         */
+/*****************************************************************************/
+
+/** This allows an SQL expression to be bound to a row of a Parquet file,
+    and records which columns are used so that only those are decoded.
+*/
+
+struct SqlParquetScope: public SqlExpressionMldbScope {
+
+    struct RowScope: public SqlRowScope {
+        RowScope(const CellValue * row, Date ts, int64_t rowNumber)
+            : row(row), ts(ts), rowNumber(rowNumber)
+        {
+        }
+
+        const CellValue * row;
+        Date ts;
+        int64_t rowNumber;
+    };
+
+    SqlParquetScope(MldbServer * server,
+                    const std::vector<ColumnPath> & columnNames,
+                    Date fileTimestamp, Utf8String dataFileUrl)
+        : SqlExpressionMldbScope(server), columnNames(columnNames),
+          fileTimestamp(fileTimestamp),
+          dataFileUrl(std::move(dataFileUrl))
+    {
+        columnsUsed.resize(columnNames.size(), false);
+    }
+
+    /// Column names passed in to the scope
+    const std::vector<ColumnPath> & columnNames;
+
+    /// Which columns are accessed by the bound expressions?
+    std::vector<int> columnsUsed;
+
+    /// What is the timestamp for the actual file itself?  This is used as a
+    /// default timestamp on values returned.
+    Date fileTimestamp;
+
+    /// What is the URI for this file?
+    Utf8String dataFileUrl;
+
+    virtual ColumnGetter doGetColumn(const Utf8String & tableName,
+                                     const ColumnPath & columnName)
+    {
+        if (!tableName.empty()) {
+            throw HttpReturnException(400, "Unknown table name in import.parquet procedure",
+                                      "tableName", tableName);
+        }
+
+        int index = std::find(columnNames.begin(), columnNames.end(), columnName)
+            - columnNames.begin();
+        if (index == columnNames.size())
+            throw HttpReturnException(400, "Unknown column name in import.parquet procedure",
+                                      "columnName", columnName,
+                                      "knownColumnNames", columnNames);
+
+        columnsUsed[index] = true;
+
+        return {[=] (const SqlRowScope & scope,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    auto & row = scope.as<RowScope>();
+                    return storage = ExpressionValue(row.row[index],
+                                                     row.ts);
+                },
+                std::make_shared<AtomValueInfo>()};
+    }
+
+    GetAllColumnsOutput
+    doGetAllColumns(const Utf8String & tableName,
+                    const ColumnFilter& keep)
+    {
+        vector<ColumnPath> toKeep;
+        std::vector<KnownColumn> columnsWithInfo;
+        size_t numToKeep = 0;
+
+        for (unsigned i = 0;  i < columnNames.size();  ++i) {
+            const ColumnPath & columnName = columnNames[i];
+            ColumnPath outputName(keep(columnName));
+
+            bool keep = !outputName.empty();
+            toKeep.emplace_back(outputName);
+            if (keep) {
+                columnsUsed[i] = true;
+                columnsWithInfo.emplace_back(outputName,
+                                             std::make_shared<AtomValueInfo>(),
+                                             COLUMN_IS_SPARSE);
+                ++numToKeep;
+            }
+        }
+
+        for (size_t i = 0;  i < columnsWithInfo.size();  ++i) {
+            columnsWithInfo[i].offset = i;
+        }
+
+        auto exec = [=] (const SqlRowScope & scope, const VariableFilter & filter)
+            {
+                auto & row = scope.as<RowScope>();
+
+                RowValue result;
+                result.reserve(numToKeep);
+
+                for (unsigned i = 0;  i < columnNames.size();  ++i) {
+                    if (!toKeep[i].empty() && !row.row[i].empty())
+                        result.emplace_back(toKeep[i], row.row[i], row.ts);
+                }
+
+                return result;
+            };
+
+        GetAllColumnsOutput result;
+        result.exec = exec;
+        result.info = std::make_shared<RowValueInfo>(std::move(columnsWithInfo),
+                                                     SCHEMA_CLOSED);
+        return result;
+    }
+
+    virtual BoundFunction
+    doGetFunction(const Utf8String & tableName,
+                  const Utf8String & functionName,
+                  const std::vector<BoundSqlExpression> & args,
+                  SqlBindingScope & argScope)
+    {
+        if (functionName == "rowNumber") {
+            return {[=] (const std::vector<ExpressionValue> & args,
+                         const SqlRowScope & scope)
+                    {
+                        auto & row = scope.as<RowScope>();
+                        return ExpressionValue(row.rowNumber, fileTimestamp);
+                    },
+                    std::make_shared<IntegerValueInfo>()
+                };
+        }
+        else if (functionName == "fileTimestamp") {
+            return {[=] (const std::vector<ExpressionValue> & args,
+                         const SqlRowScope & scope)
+                    {
+                        return ExpressionValue(fileTimestamp, fileTimestamp);
+                    },
+                    std::make_shared<TimestampValueInfo>()
+                };
+        }
+        else if (functionName == "dataFileUrl") {
+            return {[=] (const std::vector<ExpressionValue> & args,
+                         const SqlRowScope & scope)
+                    {
+                        return ExpressionValue(dataFileUrl, fileTimestamp);
+                    },
+                    std::make_shared<Utf8StringValueInfo>()
+                };
+        }
+        return SqlBindingScope::doGetFunction(tableName, functionName, args,
+                                              argScope);
+    }
+};
+
+
+/*****************************************************************************/
+/* UTILITY FUNCTIONS                                                         */
+/*****************************************************************************/
+
+namespace {
+
+/** Value of a decimal stored as a big endian two's complement integer. */
+double decodeDecimalBytes(const char * p, size_t len)
+{
+    if (len == 0)
+        return 0;
+    double result = (signed char)p[0];
+    for (size_t i = 1;  i < len;  ++i)
+        result = result * 256 + (unsigned char)p[i];
+    return result;
+}
+
+/** Turn the i-th decoded value of a column into a cell. */
+CellValue getCell(const ParquetColumn & column,
+                  const ParquetColumnValues & values,
+                  size_t i)
+{
+    if (values.isNull(i))
+        return CellValue();
+
+    switch (column.kind) {
+    case PARQUET_KIND_NUMBER:
+        if (column.type == PARQUET_FLOAT || column.type == PARQUET_DOUBLE)
+            return values.doubles[i];
+        return (int64_t)values.ints[i];
+    case PARQUET_KIND_UNSIGNED:
+        if (column.type == PARQUET_INT32)
+            return (uint32_t)values.ints[i];
+        return (uint64_t)values.ints[i];
+    case PARQUET_KIND_STRING:
+        return CellValue(values.bytesData(i), values.bytesLength(i),
+                         STRING_UNKNOWN);
+    case PARQUET_KIND_BLOB:
+        return CellValue::blob(values.bytesData(i), values.bytesLength(i));
+    case PARQUET_KIND_DECIMAL: {
+        double unscaled
+            = (column.type == PARQUET_INT32 || column.type == PARQUET_INT64)
+            ? values.ints[i]
+            : decodeDecimalBytes(values.bytesData(i), values.bytesLength(i));
+        return unscaled / std::pow(10.0, column.scale);
+    }
+    case PARQUET_KIND_DATE:
+        return Date::fromSecondsSinceEpoch(values.ints[i] * 86400.0);
+    case PARQUET_KIND_TIMESTAMP:
+        return Date::fromSecondsSinceEpoch
+            ((double)values.ints[i] / column.timestampUnitsPerSecond);
+    }
+
+    throw MLDB::Exception("Unknown Parquet value kind");
+}
+
+} // file scope
+
+
+struct ParquetImporter: public Procedure {
+
+    ParquetImporter(MldbServer * owner,
+                    PolyConfig config_,
+                    const std::function<bool (const Json::Value &)> & onProgress)
+        : Procedure(owner)
+    {
+        config = config_.params.convert<ParquetImporterConfig>();
+    }
+
+    ParquetImporterConfig config;
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const
+    {
+        auto runProcConf = applyRunConfOverProcConf(config, run);
+        Progress progress;
+
+        std::shared_ptr<Step> iterationStep = progress.steps({
+            make_pair("iterating", "rows")
+        });
+
+        // Create the output dataset
+        if (runProcConf.outputDataset.type == "tabular") {
+            if (runProcConf.outputDataset.params == nullptr) {
+                 Json::Value params;
+                 params["unknownColumns"] = "add";
+                 runProcConf.outputDataset.params = params;
+            }
+            else {
+                auto params =
+                    runProcConf.outputDataset.params.as<Json::Value>();
+                if (!params.isMember("unknownColumns")) {
+                    params["unknownColumns"] = "add";
+                    runProcConf.outputDataset.params = params;
+                }
+            }
+        }
+        std::shared_ptr<Dataset> outputDataset
+            = createDataset(server, runProcConf.outputDataset,
+                            onProgress, true);
+
+        if(!outputDataset) {
+            throw MLDB::Exception("Unable to obtain output dataset");
+        }
+
+        std::string filename = runProcConf.dataFileUrl.toDecodedString();
+
+        // Ask for a memory mappable stream if possible, as the file is
+        // accessed randomly
+        filter_istream stream(runProcConf.dataFileUrl, { { "mapped", "true" } });
+        Date ts = stream.info().lastModified;
+
+        std::string contents;
+        std::pair<const char *, size_t> data = stream.mapped();
+        if (!data.first) {
+            contents = stream.readAll();
+            data = { contents.data(), contents.size() };
+        }
+
+        Timer timer;
+
+        std::unique_ptr<ParquetFile> file;
+        try {
+            file.reset(new ParquetFile(data.first, data.second));
+        } catch (const std::exception & exc) {
+            throw HttpReturnException(400, "Error reading Parquet file: "
+                                      + string(exc.what()),
+                                      "dataFileUrl", filename);
+        }
+
+        const std::vector<ParquetColumn> & columns = file->columns;
+
+        std::vector<ColumnPath> columnNames;
+        Lightweight_Hash<ColumnHash, int> columnIndex;
+        for (auto & column: columns) {
+            std::vector<PathElement> elements(column.path.begin(),
+                                              column.path.end());
+            columnNames.emplace_back(elements.begin(), elements.end());
+            ColumnHash ch(columnNames.back());
+            if (!columnIndex.insert(make_pair(ch, columnNames.size())).second)
+                throw HttpReturnException(400, "Duplicate column name in Parquet file",
+                                          "columnName", columnNames.back());
+        }
+
+        DEBUG_MSG(logger)
+            << "file has " << file->numRows << " rows in "
+            << file->numRowGroups() << " row groups and "
+            << columns.size() << " columns";
+
+        // Bind our SQL expressions.  This tells us which columns need to
+        // be read.
+        SqlParquetScope scope(server, columnNames, ts, Utf8String(filename));
+
+        auto selectBound = runProcConf.select.bind(scope);
+        auto whereBound = runProcConf.where->bind(scope);
+        auto namedBound = runProcConf.named->bind(scope);
+        auto timestampBound = runProcConf.timestamp->bind(scope);
+
+        // Do we have a "select *"?  In that case, we can record the
+        // values directly without calling into the SQL layer
+        SqlExpressionDatasetScope noContext(*outputDataset, "");
+        bool isIdentitySelect = runProcConf.select.isIdentitySelect(noContext);
+        bool isWhereTrue = runProcConf.where->isConstantTrue();
+        bool isNamedRowNumber = runProcConf.named->surface == "rowNumber()";
+
+        std::vector<size_t> columnsToRead;
+        for (size_t i = 0;  i < columns.size();  ++i) {
+            if (isIdentitySelect || scope.columnsUsed[i])
+                columnsToRead.push_back(i);
+        }
+
+        DEBUG_MSG(logger)
+            << "reading " << columnsToRead.size() << " of "
+            << columns.size() << " columns";
+
+        // Work out which rows of each row group we need
+        int64_t begin = std::max<int64_t>(runProcConf.offset, 0);
+        int64_t end = file->numRows;
+        if (runProcConf.limit >= 0)
+            end = std::min(end, begin + runProcConf.limit);
+
+        std::vector<int64_t> rowGroupStart(1, 0);
+        for (size_t i = 0;  i < file->numRowGroups();  ++i) {
+            rowGroupStart.push_back(rowGroupStart.back()
+                                    + file->rowGroupRows(i));
+        }
+
+        Dataset::MultiChunkRecorder recorder
+            = outputDataset->getChunkRecorder();
+
+        std::atomic<int64_t> recordedRows(0);
+        std::atomic<bool> keepGoing(true);
+        mutex progressMutex;
+
+        auto doRowGroup = [&] (size_t rowGroup)
+        {
+            int64_t groupBegin = std::max(begin, rowGroupStart[rowGroup]);
+            int64_t groupEnd = std::min(end, rowGroupStart[rowGroup + 1]);
+            if (groupBegin >= groupEnd)
+                return true;  // nothing to read in this one
+
+            // Decode only the columns that are needed
+            std::vector<ParquetColumnValues> values(columns.size());
+            for (size_t i: columnsToRead) {
+                try {
+                    values[i] = file->readColumn(rowGroup, i);
+                } catch (const std::exception & exc) {
+                    throw HttpReturnException(400, "Error reading Parquet file: "
+                                              + string(exc.what()),
+                                              "dataFileUrl", filename,
+                                              "rowGroup", rowGroup,
+                                              "columnName", columnNames[i]);
+                }
+            }
+
+            std::unique_ptr<Recorder> threadRecorder
+                = recorder.newChunk(rowGroup);
+
+            std::function<void (RowPath rowName,
+                                Date timestamp,
+                                CellValue * vals,
+                                size_t numVals,
+                                std::vector<std::pair<ColumnPath, CellValue> > extra)>
+                specializedRecorder;
+            if (isIdentitySelect)
+                specializedRecorder
+                    = threadRecorder->specializeRecordTabular(columnNames);
+
+            std::vector<CellValue> row(columns.size());
+
+            for (int64_t rowNum = groupBegin;  rowNum < groupEnd;  ++rowNum) {
+                size_t index = rowNum - rowGroupStart[rowGroup];
+                for (size_t i: columnsToRead)
+                    row[i] = getCell(columns[i], values[i], index);
+
+                int64_t rowNumber = rowNum + 1;
+                SqlParquetScope::RowScope rowScope(row.data(), ts, rowNumber);
+
+                // If it doesn't match the where, don't add it
+                if (!isWhereTrue) {
+                    ExpressionValue storage;
+                    if (!whereBound(rowScope, storage, GET_ALL).isTrue())
+                        continue;
+                }
+
+                RowPath rowName;
+                if (isNamedRowNumber) {
+                    rowName = RowPath(rowNumber);
+                }
+                else {
+                    ExpressionValue nameStorage;
+                    rowName = namedBound(rowScope, nameStorage, GET_ALL)
+                        .coerceToPath();
+                }
+
+                ExpressionValue tsStorage;
+                Date rowTs = timestampBound(rowScope, tsStorage, GET_ALL)
+                    .coerceToTimestamp().toTimestamp();
+
+                if (isIdentitySelect) {
+                    specializedRecorder(std::move(rowName), rowTs,
+                                        row.data(), row.size(), {});
+                }
+                else {
+                    ExpressionValue selectStorage;
+                    const ExpressionValue & selectOutput
+                        = selectBound(rowScope, selectStorage, GET_ALL);
+
+                    if (&selectOutput == &selectStorage) {
+                        threadRecorder
+                            ->recordRowExprDestructive(std::move(rowName),
+                                                       std::move(selectStorage));
+                    }
+                    else {
+                        threadRecorder->recordRowExpr(std::move(rowName),
+                                                      selectOutput);
+                    }
+                }
+
+                int64_t numRows = recordedRows.fetch_add(1);
+                if (numRows % PROGRESS_RATE_LOW == 0) {
+                    lock_guard<mutex> l(progressMutex);
+                    if (numRows > iterationStep->value) {
+                        iterationStep->value = numRows;
+                    }
+                    if (!onProgress(jsonEncode(progress)))
+                        keepGoing = false;
+                }
+                if (!keepGoing)
+                    return false;
+            }
+
+            threadRecorder->finishedChunk();
+            return true;
+        };
+
+        // Row groups are independent; decode and record them in parallel
+        parallelMapHaltable(0, file->numRowGroups(), doRowGroup);
+
+        if (!keepGoing) {
+            throw MLDB::CancellationException("Procedure import.parquet cancelled");
+        }
+
+        DEBUG_MSG(logger) << timer.elapsed();
+        timer.restart();
+
+        DEBUG_MSG(logger) << "committing dataset";
+
+        recorder.commit();
+
+        DEBUG_MSG(logger) << timer.elapsed();
+
+        Json::Value result;
+        result["rowCount"] = (int64_t)recordedRows;
+        return RunOutput(result);
+    }
+
+    virtual Any getStatus() const
+    {
+        return Any();
+    }
+};
+
+static RegisterProcedureType<ParquetImporter, ParquetImporterConfig>
+regParquet(builtinPackage(),
+           "Import an Apache Parquet file into MLDB",
+           "procedures/ParquetImporter.md.html");
+
+
+} // namespace MLDB
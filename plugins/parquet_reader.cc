@@ -0,0 +1,1360 @@
+/** parquet_reader.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Reader for the Apache Parquet columnar file format.  The metadata is
+    encoded with the Thrift compact protocol, which is decoded here directly
+    rather than through generated code.
+*/
+
+#include "parquet_reader.h"
+#include "mldb/arch/exception.h"
+#include "mldb/ext/zstd/lib/zstd.h"
+#include "mldb/ext/lz4/lz4.h"
+#include <zlib.h>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/*****************************************************************************/
+/* THRIFT COMPACT PROTOCOL                                                   */
+/*****************************************************************************/
+
+enum CompactType {
+    CT_STOP = 0,
+    CT_BOOLEAN_TRUE = 1,
+    CT_BOOLEAN_FALSE = 2,
+    CT_BYTE = 3,
+    CT_I16 = 4,
+    CT_I32 = 5,
+    CT_I64 = 6,
+    CT_DOUBLE = 7,
+    CT_BINARY = 8,
+    CT_LIST = 9,
+    CT_SET = 10,
+    CT_MAP = 11,
+    CT_STRUCT = 12
+};
+
+/** Sequential reader of values encoded with the Thrift compact protocol. */
+struct CompactReader {
+    CompactReader(const uint8_t * p, const uint8_t * end)
+        : p(p), end(end)
+    {
+    }
+
+    const uint8_t * p;
+    const uint8_t * end;
+    int depth = 0;
+
+    uint8_t byte()
+    {
+        if (p >= end)
+            throw MLDB::Exception("Parquet metadata is truncated");
+        return *p++;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t result = 0;
+        for (int shift = 0;  shift < 64;  shift += 7) {
+            uint8_t b = byte();
+            result |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return result;
+        }
+        throw MLDB::Exception("Invalid varint in Parquet metadata");
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t v = varint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    int64_t integer(int type)
+    {
+        if (type == CT_BYTE)
+            return (int8_t)byte();
+        if (type != CT_I16 && type != CT_I32 && type != CT_I64)
+            throw MLDB::Exception("Expected an integer in Parquet metadata");
+        return zigzag();
+    }
+
+    bool boolean(int type)
+    {
+        // Booleans are in the type for struct fields, in a byte for lists
+        if (type == CT_BOOLEAN_TRUE)
+            return true;
+        if (type == CT_BOOLEAN_FALSE)
+            return false;
+        return byte() == 1;
+    }
+
+    std::string binary()
+    {
+        uint64_t len = varint();
+        if (len > (uint64_t)(end - p))
+            throw MLDB::Exception("Parquet metadata is truncated");
+        std::string result((const char *)p, len);
+        p += len;
+        return result;
+    }
+
+    /** Read a list header, returning its size and setting the type of its
+        elements.
+    */
+    uint64_t list(int & elementType)
+    {
+        uint8_t header = byte();
+        elementType = header & 0x0f;
+        uint64_t size = header >> 4;
+        if (size == 15)
+            size = varint();
+        return size;
+    }
+
+    /** Read a structure, calling onField with the id and type of each of
+        its fields.  It returns false if it didn't read the value, which is
+        then skipped.
+    */
+    void readStruct(const std::function<bool (int id, int type)> & onField)
+    {
+        if (++depth > 64)
+            throw MLDB::Exception("Parquet metadata is nested too deeply");
+        int lastId = 0;
+        for (;;) {
+            uint8_t header = byte();
+            int type = header & 0x0f;
+            if (type == CT_STOP)
+                break;
+            int delta = header >> 4;
+            int id = delta ? lastId + delta : (int16_t)zigzag();
+            lastId = id;
+            if (!onField(id, type))
+                skip(type);
+        }
+        --depth;
+    }
+
+    /** Read a list of structures, calling onElement for each. */
+    void readStructList(int type, const std::function<void ()> & onElement)
+    {
+        if (type != CT_LIST && type != CT_SET)
+            throw MLDB::Exception("Expected a list in Parquet metadata");
+        int elementType;
+        uint64_t size = list(elementType);
+        for (uint64_t i = 0;  i < size;  ++i) {
+            if (elementType != CT_STRUCT)
+                skip(elementType);
+            else onElement();
+        }
+    }
+
+    void skip(int type)
+    {
+        switch (type) {
+        case CT_BOOLEAN_TRUE:
+        case CT_BOOLEAN_FALSE:
+            return;
+        case CT_BYTE:
+            byte();
+            return;
+        case CT_I16:
+        case CT_I32:
+        case CT_I64:
+            varint();
+            return;
+        case CT_DOUBLE:
+            if (end - p < 8)
+                throw MLDB::Exception("Parquet metadata is truncated");
+            p += 8;
+            return;
+        case CT_BINARY:
+            binary();
+            return;
+        case CT_LIST:
+        case CT_SET: {
+            int elementType;
+            uint64_t size = list(elementType);
+            for (uint64_t i = 0;  i < size;  ++i) {
+                // Booleans in lists take a byte each
+                if (elementType == CT_BOOLEAN_TRUE
+                    || elementType == CT_BOOLEAN_FALSE)
+                    byte();
+                else skip(elementType);
+            }
+            return;
+        }
+        case CT_MAP: {
+            uint64_t size = varint();
+            if (size == 0)
+                return;
+            uint8_t types = byte();
+            for (uint64_t i = 0;  i < size;  ++i) {
+                skip(types >> 4);
+                skip(types & 0x0f);
+            }
+            return;
+        }
+        case CT_STRUCT:
+            readStruct([] (int, int) { return false; });
+            return;
+        default:
+            throw MLDB::Exception("Unknown type %d in Parquet metadata", type);
+        }
+    }
+};
+
+
+/*****************************************************************************/
+/* METADATA                                                                  */
+/*****************************************************************************/
+
+/// https://github.com/apache/parquet-format/blob/master/src/main/thrift/parquet.thrift
+enum ConvertedType {
+    CONVERTED_NONE = -1,
+    CONVERTED_UTF8 = 0,
+    CONVERTED_ENUM = 4,
+    CONVERTED_DECIMAL = 5,
+    CONVERTED_DATE = 6,
+    CONVERTED_TIMESTAMP_MILLIS = 9,
+    CONVERTED_TIMESTAMP_MICROS = 10,
+    CONVERTED_UINT_8 = 11,
+    CONVERTED_UINT_64 = 14,
+    CONVERTED_JSON = 19
+};
+
+enum Repetition {
+    REQUIRED = 0,
+    OPTIONAL = 1,
+    REPEATED = 2
+};
+
+enum Encoding {
+    ENC_PLAIN = 0,
+    ENC_PLAIN_DICTIONARY = 2,
+    ENC_RLE = 3,
+    ENC_BIT_PACKED = 4,
+    ENC_DELTA_BINARY_PACKED = 5,
+    ENC_DELTA_LENGTH_BYTE_ARRAY = 6,
+    ENC_DELTA_BYTE_ARRAY = 7,
+    ENC_RLE_DICTIONARY = 8,
+    ENC_BYTE_STREAM_SPLIT = 9
+};
+
+enum Codec {
+    CODEC_UNCOMPRESSED = 0,
+    CODEC_SNAPPY = 1,
+    CODEC_GZIP = 2,
+    CODEC_LZ4 = 5,
+    CODEC_ZSTD = 6,
+    CODEC_LZ4_RAW = 7
+};
+
+enum PageType {
+    DATA_PAGE = 0,
+    INDEX_PAGE = 1,
+    DICTIONARY_PAGE = 2,
+    DATA_PAGE_V2 = 3
+};
+
+struct SchemaElement {
+    int type = -1;
+    int typeLength = 0;
+    int repetition = REQUIRED;
+    std::string name;
+    int numChildren = 0;
+    int convertedType = CONVERTED_NONE;
+    int scale = 0;
+
+    // From the logical type, which supersedes the converted type
+    int logicalType = 0;          ///< Field id in the LogicalType union
+    int timestampUnit = 0;        ///< 1 = millis, 2 = micros, 3 = nanos
+    bool integerSigned = true;
+};
+
+SchemaElement readSchemaElement(CompactReader & reader)
+{
+    SchemaElement result;
+    reader.readStruct([&] (int id, int type)
+        {
+            switch (id) {
+            case 1: result.type = reader.integer(type);  return true;
+            case 2: result.typeLength = reader.integer(type);  return true;
+            case 3: result.repetition = reader.integer(type);  return true;
+            case 4: result.name = reader.binary();  return true;
+            case 5: result.numChildren = reader.integer(type);  return true;
+            case 6: result.convertedType = reader.integer(type);  return true;
+            case 7: result.scale = reader.integer(type);  return true;
+            case 10:
+                if (type != CT_STRUCT)
+                    return false;
+                // Union; the field id tells which logical type it is
+                reader.readStruct([&] (int id, int type)
+                    {
+                        result.logicalType = id;
+                        if (type != CT_STRUCT)
+                            return false;
+                        reader.readStruct([&] (int subId, int subType)
+                            {
+                                if (id == 5 && subId == 1) {
+                                    // DecimalType.scale
+                                    result.scale = reader.integer(subType);
+                                    return true;
+                                }
+                                if (id == 8 && subId == 2
+                                    && subType == CT_STRUCT) {
+                                    // TimestampType.unit
+                                    reader.readStruct([&] (int unit, int)
+                                        {
+                                            result.timestampUnit = unit;
+                                            return false;
+                                        });
+                                    return true;
+                                }
+                                if (id == 10 && subId == 2) {
+                                    // IntType.isSigned
+                                    result.integerSigned
+                                        = reader.boolean(subType);
+                                    return true;
+                                }
+                                return false;
+                            });
+                        return true;
+                    });
+                return true;
+            default:
+                return false;
+            }
+        });
+    return result;
+}
+
+/** Work out how the values of a column are to be interpreted. */
+void setColumnKind(ParquetColumn & column, const SchemaElement & element)
+{
+    column.scale = element.scale;
+
+    bool isString = element.logicalType == 1 || element.logicalType == 4
+        || element.logicalType == 12
+        || element.convertedType == CONVERTED_UTF8
+        || element.convertedType == CONVERTED_ENUM
+        || element.convertedType == CONVERTED_JSON;
+    bool isDecimal = element.logicalType == 5
+        || element.convertedType == CONVERTED_DECIMAL;
+    bool isDate = element.logicalType == 6
+        || element.convertedType == CONVERTED_DATE;
+    bool isUnsigned = (element.logicalType == 10 && !element.integerSigned)
+        || (element.convertedType >= CONVERTED_UINT_8
+            && element.convertedType <= CONVERTED_UINT_64);
+
+    int timestampUnit = 0;
+    if (element.logicalType == 8)
+        timestampUnit = element.timestampUnit;
+    else if (element.convertedType == CONVERTED_TIMESTAMP_MILLIS)
+        timestampUnit = 1;
+    else if (element.convertedType == CONVERTED_TIMESTAMP_MICROS)
+        timestampUnit = 2;
+
+    switch (column.type) {
+    case PARQUET_BYTE_ARRAY:
+    case PARQUET_FIXED_LEN_BYTE_ARRAY:
+        if (isString && column.type == PARQUET_BYTE_ARRAY)
+            column.kind = PARQUET_KIND_STRING;
+        else if (isDecimal)
+            column.kind = PARQUET_KIND_DECIMAL;
+        else column.kind = PARQUET_KIND_BLOB;
+        break;
+    case PARQUET_INT96:
+        column.kind = PARQUET_KIND_TIMESTAMP;
+        column.timestampUnitsPerSecond = 1000000000;
+        break;
+    case PARQUET_INT32:
+    case PARQUET_INT64:
+        if (isDecimal)
+            column.kind = PARQUET_KIND_DECIMAL;
+        else if (isDate)
+            column.kind = PARQUET_KIND_DATE;
+        else if (timestampUnit) {
+            column.kind = PARQUET_KIND_TIMESTAMP;
+            column.timestampUnitsPerSecond
+                = timestampUnit == 1 ? 1000
+                : timestampUnit == 2 ? 1000000 : 1000000000;
+        }
+        else if (isUnsigned)
+            column.kind = PARQUET_KIND_UNSIGNED;
+        break;
+    default:
+        break;
+    }
+}
+
+struct PageHeader {
+    int type = -1;
+    int uncompressedSize = 0;
+    int compressedSize = 0;
+    int numValues = 0;
+    int encoding = ENC_PLAIN;
+    int definitionLevelEncoding = ENC_RLE;
+
+    // Data page v2 only
+    int definitionLevelsLength = 0;
+    int repetitionLevelsLength = 0;
+    bool isCompressed = true;
+};
+
+PageHeader readPageHeader(CompactReader & reader)
+{
+    PageHeader result;
+    reader.readStruct([&] (int id, int type)
+        {
+            switch (id) {
+            case 1: result.type = reader.integer(type);  return true;
+            case 2: result.uncompressedSize = reader.integer(type);  return true;
+            case 3: result.compressedSize = reader.integer(type);  return true;
+            case 5:  // DataPageHeader
+            case 7:  // DictionaryPageHeader
+                if (type != CT_STRUCT)
+                    return false;
+                reader.readStruct([&] (int subId, int subType)
+                    {
+                        switch (subId) {
+                        case 1: result.numValues = reader.integer(subType);  return true;
+                        case 2: result.encoding = reader.integer(subType);  return true;
+                        case 3:
+                            if (id != 5)
+                                return false;
+                            result.definitionLevelEncoding
+                                = reader.integer(subType);
+                            return true;
+                        default: return false;
+                        }
+                    });
+                return true;
+            case 8:  // DataPageHeaderV2
+                if (type != CT_STRUCT)
+                    return false;
+                reader.readStruct([&] (int subId, int subType)
+                    {
+                        switch (subId) {
+                        case 1: result.numValues = reader.integer(subType);  return true;
+                        case 4: result.encoding = reader.integer(subType);  return true;
+                        case 5: result.definitionLevelsLength = reader.integer(subType);  return true;
+                        case 6: result.repetitionLevelsLength = reader.integer(subType);  return true;
+                        case 7: result.isCompressed = reader.boolean(subType);  return true;
+                        default: return false;
+                        }
+                    });
+                return true;
+            default:
+                return false;
+            }
+        });
+
+    if (result.compressedSize < 0 || result.uncompressedSize < 0
+        || result.numValues < 0 || result.definitionLevelsLength < 0
+        || result.repetitionLevelsLength < 0)
+        throw MLDB::Exception("Invalid Parquet page header");
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* DECOMPRESSION                                                             */
+/*****************************************************************************/
+
+/** Decompress a raw snappy block, as used by Parquet (without the framing
+    of the snappy stream format).
+*/
+std::string snappyDecompress(const uint8_t * p, const uint8_t * end,
+                             size_t uncompressedSize)
+{
+    CompactReader reader(p, end);
+    uint64_t length = reader.varint();
+    p = reader.p;
+    if (length != uncompressedSize)
+        throw MLDB::Exception("Wrong size for snappy Parquet page");
+
+    std::string result;
+    result.reserve(length);
+
+    while (p < end) {
+        uint8_t tag = *p++;
+        size_t len, offset;
+        switch (tag & 3) {
+        case 0: {
+            // Literal
+            len = tag >> 2;
+            if (len >= 60) {
+                int numBytes = len - 59;
+                if (end - p < numBytes)
+                    throw MLDB::Exception("Invalid snappy data");
+                len = 0;
+                for (int i = 0;  i < numBytes;  ++i)
+                    len |= size_t(p[i]) << (8 * i);
+                p += numBytes;
+            }
+            len += 1;
+            if ((size_t)(end - p) < len)
+                throw MLDB::Exception("Invalid snappy data");
+            result.append((const char *)p, len);
+            p += len;
+            continue;
+        }
+        case 1:
+            if (end - p < 1)
+                throw MLDB::Exception("Invalid snappy data");
+            len = ((tag >> 2) & 7) + 4;
+            offset = (size_t(tag >> 5) << 8) | p[0];
+            p += 1;
+            break;
+        case 2:
+            if (end - p < 2)
+                throw MLDB::Exception("Invalid snappy data");
+            len = (tag >> 2) + 1;
+            offset = p[0] | (size_t(p[1]) << 8);
+            p += 2;
+            break;
+        default:
+            if (end - p < 4)
+                throw MLDB::Exception("Invalid snappy data");
+            len = (tag >> 2) + 1;
+            offset = p[0] | (size_t(p[1]) << 8) | (size_t(p[2]) << 16)
+                | (size_t(p[3]) << 24);
+            p += 4;
+            break;
+        }
+
+        // Copy, which may overlap with what it produces
+        if (offset == 0 || offset > result.size())
+            throw MLDB::Exception("Invalid snappy data");
+        size_t start = result.size() - offset;
+        for (size_t i = 0;  i < len;  ++i)
+            result.push_back(result[start + i]);
+    }
+
+    if (result.size() != length)
+        throw MLDB::Exception("Invalid snappy data");
+
+    return result;
+}
+
+std::string gzipDecompress(const uint8_t * p, size_t len,
+                           size_t uncompressedSize)
+{
+    std::string result(uncompressedSize, '\0');
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // Detect both gzip and zlib headers
+    if (inflateInit2(&stream, 32 + MAX_WBITS) != Z_OK)
+        throw MLDB::Exception("Error initializing gzip decompressor");
+    stream.next_in = (Bytef *)p;
+    stream.avail_in = len;
+    char dummy;
+    stream.next_out = (Bytef *)(result.empty() ? &dummy : &result[0]);
+    stream.avail_out = result.size();
+    int res = inflate(&stream, Z_FINISH);
+    size_t totalOut = stream.total_out;
+    inflateEnd(&stream);
+
+    if (res != Z_STREAM_END || totalOut != uncompressedSize)
+        throw MLDB::Exception("Error decompressing gzip Parquet page");
+    return result;
+}
+
+std::string lz4Decompress(const uint8_t * p, size_t len,
+                          size_t uncompressedSize, bool hadoopFraming)
+{
+    std::string result(uncompressedSize, '\0');
+
+    if (hadoopFraming && len >= 8) {
+        // Hadoop's framing: big endian decompressed and compressed sizes
+        // before each block
+        auto readBE = [] (const uint8_t * p)
+            {
+                return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16)
+                    | (uint32_t(p[2]) << 8) | p[3];
+            };
+        const uint8_t * q = p, * end = p + len;
+        size_t done = 0;
+        bool ok = true;
+        while (ok && end - q >= 8) {
+            uint32_t blockDecompressed = readBE(q);
+            uint32_t blockCompressed = readBE(q + 4);
+            q += 8;
+            if (blockCompressed > (size_t)(end - q)
+                || blockDecompressed > uncompressedSize - done) {
+                ok = false;
+                break;
+            }
+            int res = LZ4_decompress_safe((const char *)q, &result[done],
+                                          blockCompressed, blockDecompressed);
+            if (res != (int)blockDecompressed) {
+                ok = false;
+                break;
+            }
+            q += blockCompressed;
+            done += blockDecompressed;
+        }
+        if (ok && q == end && done == uncompressedSize)
+            return result;
+        // Otherwise, it's not framed; fall through to a raw block
+    }
+
+    int res = LZ4_decompress_safe((const char *)p, &result[0], len,
+                                  uncompressedSize);
+    if (res < 0 || (size_t)res != uncompressedSize)
+        throw MLDB::Exception("Error decompressing lz4 Parquet page");
+    return result;
+}
+
+std::string decompress(int codec, const uint8_t * p, size_t len,
+                       size_t uncompressedSize)
+{
+    switch (codec) {
+    case CODEC_UNCOMPRESSED:
+        return std::string((const char *)p, len);
+    case CODEC_SNAPPY:
+        return snappyDecompress(p, p + len, uncompressedSize);
+    case CODEC_GZIP:
+        return gzipDecompress(p, len, uncompressedSize);
+    case CODEC_ZSTD: {
+        std::string result(uncompressedSize, '\0');
+        size_t res = ZSTD_decompress(&result[0], result.size(), p, len);
+        if (ZSTD_isError(res) || res != uncompressedSize)
+            throw MLDB::Exception("Error decompressing zstd Parquet page");
+        return result;
+    }
+    case CODEC_LZ4:
+        return lz4Decompress(p, len, uncompressedSize, true /* hadoop */);
+    case CODEC_LZ4_RAW:
+        return lz4Decompress(p, len, uncompressedSize, false);
+    default:
+        throw MLDB::Exception("Unsupported Parquet compression codec %d",
+                              codec);
+    }
+}
+
+
+/*****************************************************************************/
+/* VALUE DECODING                                                            */
+/*****************************************************************************/
+
+template<typename T>
+T readLE(const uint8_t * p)
+{
+    T result;
+    std::memcpy(&result, p, sizeof(T));
+    return result;
+}
+
+/** Reads values of a fixed number of bits, packed from the least
+    significant bit of each byte.
+*/
+struct BitReader {
+    BitReader(const uint8_t * p, const uint8_t * end)
+        : p(p), end(end)
+    {
+    }
+
+    const uint8_t * p;
+    const uint8_t * end;
+    size_t bitPos = 0;
+
+    uint64_t read(int width)
+    {
+        uint64_t result = 0;
+        int done = 0;
+        while (done < width) {
+            const uint8_t * bytePos = p + (bitPos >> 3);
+            if (bytePos >= end)
+                throw MLDB::Exception("Parquet bit packed data is truncated");
+            int offset = bitPos & 7;
+            int todo = std::min(8 - offset, width - done);
+            uint64_t bits = (*bytePos >> offset) & ((1u << todo) - 1);
+            result |= bits << done;
+            done += todo;
+            bitPos += todo;
+        }
+        return result;
+    }
+};
+
+/** Decode count values of the RLE / bit packing hybrid encoding, starting
+    at p.  Returns a pointer to the end of the data read.
+*/
+const uint8_t *
+decodeRle(const uint8_t * p, const uint8_t * end, int bitWidth,
+          size_t count, std::vector<uint32_t> & output)
+{
+    if (bitWidth < 0 || bitWidth > 32)
+        throw MLDB::Exception("Invalid Parquet bit width %d", bitWidth);
+
+    output.clear();
+    output.reserve(count);
+
+    while (output.size() < count) {
+        CompactReader reader(p, end);
+        uint64_t header = reader.varint();
+        p = reader.p;
+
+        if (header & 1) {
+            // Bit packed groups of 8 values
+            size_t numValues = (header >> 1) * 8;
+            size_t numBytes = (header >> 1) * bitWidth;
+            if (numBytes > (size_t)(end - p))
+                throw MLDB::Exception("Parquet RLE data is truncated");
+            BitReader bits(p, p + numBytes);
+            for (size_t i = 0;  i < numValues && output.size() < count;  ++i)
+                output.push_back(bits.read(bitWidth));
+            p += numBytes;
+        }
+        else {
+            // Run of the same value
+            size_t runLength = header >> 1;
+            int numBytes = (bitWidth + 7) / 8;
+            if (numBytes > end - p)
+                throw MLDB::Exception("Parquet RLE data is truncated");
+            uint32_t value = 0;
+            for (int i = 0;  i < numBytes;  ++i)
+                value |= uint32_t(p[i]) << (8 * i);
+            p += numBytes;
+            if (runLength == 0)
+                throw MLDB::Exception("Invalid Parquet RLE data");
+            runLength = std::min(runLength, count - output.size());
+            output.insert(output.end(), runLength, value);
+        }
+    }
+
+    return p;
+}
+
+/** Decode values of the DELTA_BINARY_PACKED encoding.  Returns a pointer
+    to the end of the data read.
+*/
+const uint8_t *
+decodeDeltaBinaryPacked(const uint8_t * p, const uint8_t * end,
+                        std::vector<int64_t> & output)
+{
+    CompactReader reader(p, end);
+    uint64_t blockSize = reader.varint();
+    uint64_t numMiniBlocks = reader.varint();
+    uint64_t totalCount = reader.varint();
+    uint64_t value = reader.zigzag();
+
+    if (numMiniBlocks == 0 || blockSize % numMiniBlocks != 0
+        || (blockSize / numMiniBlocks) % 8 != 0
+        || totalCount > (uint64_t)(end - p) * 8 + 1)
+        throw MLDB::Exception("Invalid Parquet delta encoding header");
+    uint64_t valuesPerMiniBlock = blockSize / numMiniBlocks;
+
+    output.clear();
+    output.reserve(totalCount);
+    if (totalCount > 0)
+        output.push_back(value);
+
+    while (output.size() < totalCount) {
+        uint64_t minDelta = reader.zigzag();
+        std::vector<int> bitWidths(numMiniBlocks);
+        for (auto & w: bitWidths) {
+            w = reader.byte();
+            if (w > 64)
+                throw MLDB::Exception("Invalid Parquet delta bit width");
+        }
+
+        for (uint64_t i = 0;  i < numMiniBlocks && output.size() < totalCount;
+             ++i) {
+            size_t numBytes = valuesPerMiniBlock * bitWidths[i] / 8;
+            if (numBytes > (size_t)(reader.end - reader.p))
+                throw MLDB::Exception("Parquet delta data is truncated");
+            BitReader bits(reader.p, reader.p + numBytes);
+            for (uint64_t j = 0;
+                 j < valuesPerMiniBlock && output.size() < totalCount;  ++j) {
+                // Wrapping arithmetic, as the format requires
+                value += minDelta + bits.read(bitWidths[i]);
+                output.push_back(value);
+            }
+            reader.p += numBytes;
+        }
+    }
+
+    return reader.p;
+}
+
+/** Size in bytes of one value with PLAIN encoding, or 0 if variable. */
+size_t plainSize(const ParquetColumn & column)
+{
+    switch (column.type) {
+    case PARQUET_INT32:
+    case PARQUET_FLOAT:
+        return 4;
+    case PARQUET_INT64:
+    case PARQUET_DOUBLE:
+        return 8;
+    case PARQUET_INT96:
+        return 12;
+    case PARQUET_FIXED_LEN_BYTE_ARRAY:
+        return column.typeLength;
+    default:
+        return 0;
+    }
+}
+
+/** Nanoseconds since the epoch of a (legacy) 96 bit timestamp, which has
+    the nanoseconds of the day followed by the Julian day.
+*/
+int64_t int96ToNanos(const uint8_t * p)
+{
+    static constexpr int64_t JULIAN_EPOCH_DAY = 2440588;
+    static constexpr int64_t NANOS_PER_DAY = 86400LL * 1000000000LL;
+    int64_t nanosOfDay = readLE<int64_t>(p);
+    int32_t julianDay = readLE<int32_t>(p + 8);
+    return (julianDay - JULIAN_EPOCH_DAY) * NANOS_PER_DAY + nanosOfDay;
+}
+
+void appendBytes(ParquetColumnValues & values, const char * p, size_t len)
+{
+    values.bytes.append(p, len);
+    values.offsets.push_back(values.bytes.size());
+    ++values.numValues;
+}
+
+/** Decode count values with the PLAIN encoding, appending them. */
+void decodePlain(const ParquetColumn & column,
+                 const uint8_t * p, const uint8_t * end,
+                 size_t count, ParquetColumnValues & values)
+{
+    if (column.type == PARQUET_BOOLEAN) {
+        BitReader bits(p, end);
+        for (size_t i = 0;  i < count;  ++i)
+            values.ints.push_back(bits.read(1));
+        values.numValues += count;
+        return;
+    }
+
+    if (column.type == PARQUET_BYTE_ARRAY) {
+        for (size_t i = 0;  i < count;  ++i) {
+            if (end - p < 4)
+                throw MLDB::Exception("Parquet page is truncated");
+            uint32_t len = readLE<uint32_t>(p);
+            p += 4;
+            if (len > (size_t)(end - p))
+                throw MLDB::Exception("Parquet page is truncated");
+            appendBytes(values, (const char *)p, len);
+            p += len;
+        }
+        return;
+    }
+
+    size_t size = plainSize(column);
+    if (size == 0 || count > (size_t)(end - p) / size)
+        throw MLDB::Exception("Parquet page is truncated");
+
+    for (size_t i = 0;  i < count;  ++i, p += size) {
+        switch (column.type) {
+        case PARQUET_INT32:
+            values.ints.push_back(readLE<int32_t>(p));
+            break;
+        case PARQUET_INT64:
+            values.ints.push_back(readLE<int64_t>(p));
+            break;
+        case PARQUET_INT96:
+            values.ints.push_back(int96ToNanos(p));
+            break;
+        case PARQUET_FLOAT:
+            values.doubles.push_back(readLE<float>(p));
+            break;
+        case PARQUET_DOUBLE:
+            values.doubles.push_back(readLE<double>(p));
+            break;
+        case PARQUET_FIXED_LEN_BYTE_ARRAY:
+            appendBytes(values, (const char *)p, size);
+            continue;
+        default:
+            throw MLDB::Exception("Unknown Parquet type");
+        }
+        ++values.numValues;
+    }
+}
+
+/** Decode count values with the given encoding, appending them. */
+void decodeValues(const ParquetColumn & column, int encoding,
+                  const uint8_t * p, const uint8_t * end, size_t count,
+                  const ParquetColumnValues * dictionary,
+                  ParquetColumnValues & values);
+
+void appendValue(ParquetColumnValues & values,
+                 const ParquetColumnValues & from, size_t i)
+{
+    if (from.type == PARQUET_BYTE_ARRAY
+        || from.type == PARQUET_FIXED_LEN_BYTE_ARRAY)
+        appendBytes(values, from.bytesData(i), from.bytesLength(i));
+    else {
+        if (from.type == PARQUET_FLOAT || from.type == PARQUET_DOUBLE)
+            values.doubles.push_back(from.doubles[i]);
+        else values.ints.push_back(from.ints[i]);
+        ++values.numValues;
+    }
+}
+
+void appendNull(ParquetColumnValues & values)
+{
+    if (values.type == PARQUET_BYTE_ARRAY
+        || values.type == PARQUET_FIXED_LEN_BYTE_ARRAY)
+        appendBytes(values, nullptr, 0);
+    else {
+        if (values.type == PARQUET_FLOAT || values.type == PARQUET_DOUBLE)
+            values.doubles.push_back(0);
+        else values.ints.push_back(0);
+        ++values.numValues;
+    }
+}
+
+ParquetColumnValues emptyValues(const ParquetColumn & column)
+{
+    ParquetColumnValues result;
+    result.type = column.type;
+    result.offsets.push_back(0);
+    return result;
+}
+
+void decodeValues(const ParquetColumn & column, int encoding,
+                  const uint8_t * p, const uint8_t * end, size_t count,
+                  const ParquetColumnValues * dictionary,
+                  ParquetColumnValues & values)
+{
+    switch (encoding) {
+    case ENC_PLAIN:
+        decodePlain(column, p, end, count, values);
+        return;
+
+    case ENC_PLAIN_DICTIONARY:
+    case ENC_RLE_DICTIONARY: {
+        if (!dictionary)
+            throw MLDB::Exception("Parquet dictionary page is missing");
+        if (count == 0)
+            return;
+        if (p >= end)
+            throw MLDB::Exception("Parquet page is truncated");
+        int bitWidth = *p++;
+        std::vector<uint32_t> indexes;
+        decodeRle(p, end, bitWidth, count, indexes);
+        for (uint32_t index: indexes) {
+            if (index >= dictionary->size())
+                throw MLDB::Exception("Invalid Parquet dictionary index");
+            appendValue(values, *dictionary, index);
+        }
+        return;
+    }
+
+    case ENC_RLE: {
+        if (column.type != PARQUET_BOOLEAN)
+            throw MLDB::Exception("RLE Parquet encoding only for booleans");
+        if (end - p < 4)
+            throw MLDB::Exception("Parquet page is truncated");
+        uint32_t len = readLE<uint32_t>(p);
+        p += 4;
+        if (len > (size_t)(end - p))
+            throw MLDB::Exception("Parquet page is truncated");
+        std::vector<uint32_t> bits;
+        decodeRle(p, p + len, 1, count, bits);
+        values.ints.insert(values.ints.end(), bits.begin(), bits.end());
+        values.numValues += count;
+        return;
+    }
+
+    case ENC_DELTA_BINARY_PACKED: {
+        if (column.type != PARQUET_INT32 && column.type != PARQUET_INT64)
+            throw MLDB::Exception("Invalid Parquet delta encoding for type");
+        std::vector<int64_t> ints;
+        decodeDeltaBinaryPacked(p, end, ints);
+        if (ints.size() < count)
+            throw MLDB::Exception("Parquet page is truncated");
+        for (size_t i = 0;  i < count;  ++i) {
+            values.ints.push_back(column.type == PARQUET_INT32
+                                  ? (int32_t)ints[i] : ints[i]);
+        }
+        values.numValues += count;
+        return;
+    }
+
+    case ENC_DELTA_LENGTH_BYTE_ARRAY:
+    case ENC_DELTA_BYTE_ARRAY: {
+        if (column.type != PARQUET_BYTE_ARRAY
+            && column.type != PARQUET_FIXED_LEN_BYTE_ARRAY)
+            throw MLDB::Exception("Invalid Parquet delta encoding for type");
+
+        std::vector<int64_t> prefixLengths;
+        if (encoding == ENC_DELTA_BYTE_ARRAY)
+            p = decodeDeltaBinaryPacked(p, end, prefixLengths);
+        std::vector<int64_t> lengths;
+        p = decodeDeltaBinaryPacked(p, end, lengths);
+        if (lengths.size() < count
+            || (encoding == ENC_DELTA_BYTE_ARRAY
+                && prefixLengths.size() < count))
+            throw MLDB::Exception("Parquet page is truncated");
+
+        std::string last;
+        for (size_t i = 0;  i < count;  ++i) {
+            uint64_t len = lengths[i];
+            if (len > (uint64_t)(end - p))
+                throw MLDB::Exception("Parquet page is truncated");
+            if (encoding == ENC_DELTA_BYTE_ARRAY) {
+                uint64_t prefix = prefixLengths[i];
+                if (prefix > last.size())
+                    throw MLDB::Exception("Invalid Parquet delta prefix");
+                last.resize(prefix);
+                last.append((const char *)p, len);
+                appendBytes(values, last.data(), last.size());
+            }
+            else appendBytes(values, (const char *)p, len);
+            p += len;
+        }
+        return;
+    }
+
+    case ENC_BYTE_STREAM_SPLIT: {
+        // Byte k of each value is in stream k; put them back together
+        size_t size = plainSize(column);
+        if (size == 0 || count > (size_t)(end - p) / size)
+            throw MLDB::Exception("Parquet page is truncated");
+        std::string joined(count * size, '\0');
+        for (size_t i = 0;  i < count;  ++i)
+            for (size_t k = 0;  k < size;  ++k)
+                joined[i * size + k] = p[k * count + i];
+        const uint8_t * q = (const uint8_t *)joined.data();
+        decodePlain(column, q, q + joined.size(), count, values);
+        return;
+    }
+
+    default:
+        throw MLDB::Exception("Unsupported Parquet encoding %d for column %s",
+                              encoding, column.name.c_str());
+    }
+}
+
+/// Number of bits needed to store values up to maxValue
+int bitWidth(int maxValue)
+{
+    int result = 0;
+    while (maxValue >> result)
+        ++result;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PARQUET FILE                                                              */
+/*****************************************************************************/
+
+ParquetFile::
+ParquetFile(const char * data, size_t length)
+    : data(data), length(length)
+{
+    static constexpr size_t FOOTER_SIZE = 8;
+
+    if (length < 4 + FOOTER_SIZE || std::memcmp(data, "PAR1", 4) != 0) {
+        if (length >= 4 && std::memcmp(data, "PARE", 4) == 0)
+            throw MLDB::Exception("Encrypted Parquet files are not supported");
+        throw MLDB::Exception("Not a Parquet file");
+    }
+    if (std::memcmp(data + length - 4, "PAR1", 4) != 0)
+        throw MLDB::Exception("Parquet file is truncated");
+
+    uint32_t metadataLength
+        = readLE<uint32_t>((const uint8_t *)data + length - FOOTER_SIZE);
+    if (metadataLength > length - 4 - FOOTER_SIZE)
+        throw MLDB::Exception("Invalid Parquet metadata length");
+
+    const uint8_t * metadata
+        = (const uint8_t *)data + length - FOOTER_SIZE - metadataLength;
+    CompactReader reader(metadata, metadata + metadataLength);
+
+    std::vector<SchemaElement> schema;
+
+    reader.readStruct([&] (int id, int type)
+        {
+            switch (id) {
+            case 2:  // schema
+                reader.readStructList(type, [&] ()
+                    {
+                        schema.emplace_back(readSchemaElement(reader));
+                    });
+                return true;
+            case 3:  // num_rows
+                numRows = reader.integer(type);
+                return true;
+            case 4:  // row_groups
+                reader.readStructList(type, [&] ()
+                    {
+                        RowGroup group;
+                        reader.readStruct([&] (int id, int type)
+                            {
+                                if (id == 3) {
+                                    group.numRows = reader.integer(type);
+                                    return true;
+                                }
+                                if (id != 1)
+                                    return false;
+                                reader.readStructList(type, [&] ()
+                                    {
+                                        group.chunks.emplace_back();
+                                        auto & chunk = group.chunks.back();
+                                        reader.readStruct([&] (int id, int type)
+                                            {
+                                                if (id == 1)
+                                                    throw MLDB::Exception
+                                                        ("Parquet files with "
+                                                         "columns in other files "
+                                                         "are not supported");
+                                                if (id != 3 || type != CT_STRUCT)
+                                                    return false;
+                                                reader.readStruct([&] (int id, int type)
+                                                    {
+                                                        switch (id) {
+                                                        case 4: chunk.codec = reader.integer(type);  return true;
+                                                        case 5: chunk.numValues = reader.integer(type);  return true;
+                                                        case 7: chunk.totalCompressedSize = reader.integer(type);  return true;
+                                                        case 9: chunk.dataPageOffset = reader.integer(type);  return true;
+                                                        case 11: chunk.dictionaryPageOffset = reader.integer(type);  return true;
+                                                        default: return false;
+                                                        }
+                                                    });
+                                                return true;
+                                            });
+                                    });
+                                return true;
+                            });
+                        rowGroups.emplace_back(std::move(group));
+                    });
+                return true;
+            default:
+                return false;
+            }
+        });
+
+    if (schema.empty())
+        throw MLDB::Exception("Parquet file has no schema");
+
+    // The schema is a tree flattened depth first, whose root is the first
+    // element.  Walk it to find the leaf columns.
+    size_t pos = 1;
+    int leafIndex = 0;
+
+    std::vector<std::string> path;
+
+    std::function<void (int, int, bool)> walk
+        = [&] (int numChildren, int maxDefinitionLevel, bool repeated)
+        {
+            for (int i = 0;  i < numChildren;  ++i) {
+                if (pos >= schema.size())
+                    throw MLDB::Exception("Invalid Parquet schema");
+                const SchemaElement & element = schema[pos++];
+                int defLevel = maxDefinitionLevel
+                    + (element.repetition != REQUIRED);
+                bool isRepeated = repeated || element.repetition == REPEATED;
+
+                path.push_back(element.name);
+                if (element.numChildren > 0) {
+                    walk(element.numChildren, defLevel, isRepeated);
+                    path.pop_back();
+                    continue;
+                }
+
+                std::string name = path[0];
+                for (size_t j = 1;  j < path.size();  ++j)
+                    name += "." + path[j];
+                std::vector<std::string> columnPath = path;
+                path.pop_back();
+
+                int index = leafIndex++;
+                if (isRepeated || defLevel > 1)
+                    continue;  // nested values aren't supported
+
+                if (element.type < PARQUET_BOOLEAN
+                    || element.type > PARQUET_FIXED_LEN_BYTE_ARRAY)
+                    throw MLDB::Exception("Invalid Parquet type for column "
+                                          + name);
+
+                ParquetColumn column;
+                column.name = name;
+                column.path = std::move(columnPath);
+                column.index = index;
+                column.type = (ParquetType)element.type;
+                column.typeLength = element.typeLength;
+                column.optional = defLevel > 0;
+                setColumnKind(column, element);
+                if (column.type == PARQUET_FIXED_LEN_BYTE_ARRAY
+                    && column.typeLength <= 0)
+                    throw MLDB::Exception("Invalid length for Parquet column "
+                                          + name);
+                columns.emplace_back(std::move(column));
+            }
+        };
+
+    walk(schema[0].numChildren, 0, false);
+
+    for (auto & group: rowGroups) {
+        if (group.chunks.size() != (size_t)leafIndex)
+            throw MLDB::Exception("Parquet row group has wrong number of "
+                                  "columns");
+    }
+}
+
+int64_t
+ParquetFile::
+rowGroupRows(size_t rowGroup) const
+{
+    return rowGroups.at(rowGroup).numRows;
+}
+
+ParquetColumnValues
+ParquetFile::
+readColumn(size_t rowGroup, size_t columnNumber) const
+{
+    const ParquetColumn & column = columns.at(columnNumber);
+    const RowGroup & group = rowGroups.at(rowGroup);
+    const ColumnChunk & chunk = group.chunks.at(column.index);
+
+    // For flat columns there is exactly one value per row
+    if (chunk.numValues != group.numRows)
+        throw MLDB::Exception("Parquet column chunk for %s has %lld values "
+                              "for %lld rows", column.name.c_str(),
+                              (long long)chunk.numValues,
+                              (long long)group.numRows);
+
+    ParquetColumnValues result = emptyValues(column);
+
+    // The dictionary page, if any, comes first
+    int64_t start = chunk.dataPageOffset;
+    if (chunk.dictionaryPageOffset > 0
+        && chunk.dictionaryPageOffset < chunk.dataPageOffset)
+        start = chunk.dictionaryPageOffset;
+    if (start < 4 || start >= (int64_t)length)
+        throw MLDB::Exception("Invalid Parquet column chunk offset");
+
+    const uint8_t * p = (const uint8_t *)data + start;
+    const uint8_t * end = (const uint8_t *)data + length;
+
+    std::unique_ptr<ParquetColumnValues> dictionary;
+    std::vector<uint32_t> definitionLevels;
+
+    while ((int64_t)result.size() < chunk.numValues) {
+        CompactReader reader(p, end);
+        PageHeader header = readPageHeader(reader);
+        p = reader.p;
+        if (header.compressedSize > end - p)
+            throw MLDB::Exception("Parquet page is truncated");
+        const uint8_t * pageStart = p;
+        p += header.compressedSize;
+
+        if (header.type != DICTIONARY_PAGE
+            && header.numValues > chunk.numValues - (int64_t)result.size())
+            throw MLDB::Exception("Parquet page has too many values");
+
+        if (header.type == DICTIONARY_PAGE) {
+            std::string page = decompress(chunk.codec, pageStart,
+                                          header.compressedSize,
+                                          header.uncompressedSize);
+            const uint8_t * q = (const uint8_t *)page.data();
+            dictionary.reset(new ParquetColumnValues(emptyValues(column)));
+            decodePlain(column, q, q + page.size(), header.numValues,
+                        *dictionary);
+            continue;
+        }
+
+        if (header.type != DATA_PAGE && header.type != DATA_PAGE_V2)
+            continue;  // index pages, etc
+
+        std::string page;
+        const uint8_t * q;
+        const uint8_t * qend;
+        size_t numValues = header.numValues;
+        definitionLevels.clear();
+
+        if (header.type == DATA_PAGE) {
+            page = decompress(chunk.codec, pageStart, header.compressedSize,
+                              header.uncompressedSize);
+            q = (const uint8_t *)page.data();
+            qend = q + page.size();
+
+            if (column.optional) {
+                if (header.definitionLevelEncoding != ENC_RLE)
+                    throw MLDB::Exception("Unsupported Parquet definition "
+                                          "level encoding");
+                if (qend - q < 4)
+                    throw MLDB::Exception("Parquet page is truncated");
+                uint32_t len = readLE<uint32_t>(q);
+                q += 4;
+                if (len > (size_t)(qend - q))
+                    throw MLDB::Exception("Parquet page is truncated");
+                decodeRle(q, q + len, bitWidth(1), numValues,
+                          definitionLevels);
+                q += len;
+            }
+        }
+        else {
+            // Levels are never compressed in v2 pages
+            size_t levelsLength = header.definitionLevelsLength
+                + header.repetitionLevelsLength;
+            if (levelsLength > (size_t)header.compressedSize)
+                throw MLDB::Exception("Invalid Parquet page header");
+            const uint8_t * levels
+                = pageStart + header.repetitionLevelsLength;
+            if (column.optional) {
+                decodeRle(levels, levels + header.definitionLevelsLength,
+                          bitWidth(1), numValues, definitionLevels);
+            }
+            const uint8_t * valuesStart = pageStart + levelsLength;
+            size_t valuesLength = header.compressedSize - levelsLength;
+            if (header.isCompressed) {
+                page = decompress(chunk.codec, valuesStart, valuesLength,
+                                  header.uncompressedSize - levelsLength);
+            }
+            else page.assign((const char *)valuesStart, valuesLength);
+            q = (const uint8_t *)page.data();
+            qend = q + page.size();
+        }
+
+        if (!column.optional) {
+            decodeValues(column, header.encoding, q, qend, numValues,
+                         dictionary.get(), result);
+            continue;
+        }
+
+        // Decode the non-null values, then spread them out over the rows
+        size_t numPresent = std::count(definitionLevels.begin(),
+                                       definitionLevels.end(), 1u);
+        ParquetColumnValues present = emptyValues(column);
+        decodeValues(column, header.encoding, q, qend, numPresent,
+                     dictionary.get(), present);
+
+        if (result.present.empty())
+            result.present.resize(result.size(), 1);
+
+        size_t n = 0;
+        for (uint32_t level: definitionLevels) {
+            if (level == 1)
+                appendValue(result, present, n++);
+            else appendNull(result);
+            result.present.push_back(level == 1);
+        }
+    }
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,152 @@
+/** parquet_reader.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Reader for the Apache Parquet columnar file format.
+
+    This only depends on the file being in memory, and decodes column chunks
+    into typed arrays, so that only the columns needed are ever decoded and
+    the row groups can be decoded in parallel.
+
+    Supported are the flat (non-nested, non-repeated) columns of a file,
+    with all of the encodings of the format and the uncompressed, snappy,
+    gzip, zstd and lz4 codecs.  Nested and repeated columns are skipped.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARQUET COLUMN                                                            */
+/*****************************************************************************/
+
+/** Physical types of values in a Parquet file. */
+enum ParquetType {
+    PARQUET_BOOLEAN = 0,
+    PARQUET_INT32 = 1,
+    PARQUET_INT64 = 2,
+    PARQUET_INT96 = 3,
+    PARQUET_FLOAT = 4,
+    PARQUET_DOUBLE = 5,
+    PARQUET_BYTE_ARRAY = 6,
+    PARQUET_FIXED_LEN_BYTE_ARRAY = 7
+};
+
+/** How the values of a column are to be interpreted, from the converted
+    and logical types of the schema.
+*/
+enum ParquetValueKind {
+    PARQUET_KIND_NUMBER,     ///< Integer, boolean or floating point
+    PARQUET_KIND_UNSIGNED,   ///< Unsigned integer stored in a signed one
+    PARQUET_KIND_STRING,     ///< UTF-8 string
+    PARQUET_KIND_BLOB,       ///< Binary data
+    PARQUET_KIND_DECIMAL,    ///< Scaled integer
+    PARQUET_KIND_DATE,       ///< Days since the epoch
+    PARQUET_KIND_TIMESTAMP   ///< Since the epoch, in timestampUnitsPerSecond
+};
+
+/** Description of a (leaf) column of a Parquet file. */
+struct ParquetColumn {
+    std::string name;         ///< Dotted path of the column in the schema
+    std::vector<std::string> path;  ///< Elements of the path in the schema
+    int index = -1;           ///< Index of the column chunk in a row group
+    ParquetType type = PARQUET_INT32;
+    int typeLength = 0;       ///< For fixed length byte arrays
+    bool optional = false;    ///< Can it contain nulls?
+    ParquetValueKind kind = PARQUET_KIND_NUMBER;
+    int scale = 0;            ///< For decimals
+    int64_t timestampUnitsPerSecond = 1000;  ///< For timestamps
+};
+
+
+/*****************************************************************************/
+/* PARQUET COLUMN VALUES                                                     */
+/*****************************************************************************/
+
+/** The decoded values of a column for a row group.  There is one entry per
+    row, whether it's null or not.  Depending upon the physical type, they
+    are stored in ints (booleans, 32 and 64 bit integers, and 96 bit
+    timestamps converted to nanoseconds since the epoch), doubles, or as
+    byte strings in bytes.
+*/
+struct ParquetColumnValues {
+    ParquetType type = PARQUET_INT32;
+    size_t numValues = 0;
+    std::vector<uint8_t> present;   ///< Empty if the column has no nulls
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::string bytes;
+    std::vector<uint64_t> offsets;  ///< numValues + 1 offsets into bytes
+
+    size_t size() const { return numValues; }
+
+    bool isNull(size_t i) const { return !present.empty() && !present[i]; }
+
+    const char * bytesData(size_t i) const
+    {
+        return bytes.data() + offsets[i];
+    }
+
+    size_t bytesLength(size_t i) const
+    {
+        return offsets[i + 1] - offsets[i];
+    }
+};
+
+
+/*****************************************************************************/
+/* PARQUET FILE                                                              */
+/*****************************************************************************/
+
+/** A Parquet file held in memory.  The memory must stay valid for the
+    lifetime of the object.  Reading column values is thread safe.
+
+    Errors in the file throw an MLDB::Exception.
+*/
+struct ParquetFile {
+    ParquetFile(const char * data, size_t length);
+
+    /// Flat columns of the file, in schema order
+    std::vector<ParquetColumn> columns;
+
+    /// Total number of rows in the file
+    int64_t numRows = 0;
+
+    /// Number of row groups in the file
+    size_t numRowGroups() const { return rowGroups.size(); }
+
+    /// Number of rows in the given row group
+    int64_t rowGroupRows(size_t rowGroup) const;
+
+    /** Decode the values of the given column (as an index into columns)
+        for the given row group.
+    */
+    ParquetColumnValues readColumn(size_t rowGroup, size_t column) const;
+
+    struct ColumnChunk {
+        int codec = 0;
+        int64_t numValues = 0;
+        int64_t dataPageOffset = -1;
+        int64_t dictionaryPageOffset = -1;
+        int64_t totalCompressedSize = 0;
+    };
+
+    struct RowGroup {
+        int64_t numRows = 0;
+        std::vector<ColumnChunk> chunks;
+    };
+
+private:
+    const char * data;
+    size_t length;
+    std::vector<RowGroup> rowGroups;
+};
+
+} // namespace MLDB
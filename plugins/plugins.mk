@@ -11,6 +11,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	metric_space.cc \
 	sqlite_dataset.cc \
 	sparse_matrix_dataset.cc \
+	background_compactor.cc \
 	script_procedure.cc \
 	permuter_procedure.cc \
 	external_python_procedure.cc \
@@ -23,8 +24,11 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	bucketize_procedure.cc \
 	git.cc \
 	csv_export_procedure.cc \
+	arrow_export_procedure.cc \
 	xlsx_importer.cc \
 	json_importer.cc \
+	parquet_reader.cc \
+	parquet_importer.cc \
 	melt_procedure.cc \
 	ranking_procedure.cc \
 	fetcher.cc \
@@ -38,6 +42,8 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	classifier.cc \
 	sql_functions.cc \
 	embedding.cc \
+	hnsw_index.cc \
+	ivf_index.cc \
 	svd.cc \
 	kmeans.cc \
 	probabilizer.cc \
@@ -63,7 +69,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 $(eval $(call set_compile_option,python_plugin_loader.cc,-I$(PYTHON_INCLUDE_PATH)))
 $(eval $(call set_compile_option,importtext_procedure.cc,-I$(RE2_INCLUDE_PATH)))
 
-$(eval $(call library,mldb_builtin_plugins,$(LIBMLDB_BUILTIN_PLUGIN_SOURCES),datacratic_sqlite ml mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins tsne svm libstemmer edlib algebra svdlibc uap re2 behavior))
+$(eval $(call library,mldb_builtin_plugins,$(LIBMLDB_BUILTIN_PLUGIN_SOURCES),datacratic_sqlite ml mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins tsne svm libstemmer edlib algebra svdlibc uap re2 behavior lz4 zstd z))
 $(eval $(call library_forward_dependency,mldb_builtin_plugins,mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins))
 
 $(eval $(call include_sub_make,lang))
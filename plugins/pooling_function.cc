@@ -5,6 +5,7 @@
 */
 
 #include "pooling_function.h"
+#include "embedding.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
@@ -101,6 +102,72 @@ PoolingFunction(MldbServer * owner,
     boundEmbeddingDataset = functionConfig.embeddingDataset->bind(context, convertProgressToJson);
     
     columnNames = boundEmbeddingDataset.dataset->getRowInfo()->allColumnNames();
+
+    embedding = dynamic_cast<const EmbeddingDataset *>
+        (boundEmbeddingDataset.dataset.get());
+}
+
+bool
+PoolingFunction::
+poolEmbedding(const ExpressionValue & words,
+              std::vector<double> & outputEmbedding,
+              Date & outputTs) const
+{
+    if (!embedding)
+        return false;
+
+    std::vector<RowPath> rows;
+    auto onKey = [&] (const PathElement & key, const ExpressionValue & val)
+        {
+            rows.emplace_back(key);
+            return true;
+        };
+    if (words.isRow())
+        words.forEachColumn(onKey);
+
+    size_t n = columnNames.size();
+
+    bool doSum = false, doMin = false, doMax = false;
+    for (auto & agg: functionConfig.aggregators) {
+        doSum = doSum || agg == "avg" || agg == "sum";
+        doMin = doMin || agg == "min";
+        doMax = doMax || agg == "max";
+    }
+
+    std::vector<double> sum(doSum ? n : 0, 0.0);
+    std::vector<float> min(doMin ? n : 0, INFINITY);
+    std::vector<float> max(doMax ? n : 0, -INFINITY);
+
+    Date latest = Date::negativeInfinity();
+    ssize_t found = embedding->poolRows(rows, n,
+                                        doSum ? sum.data() : nullptr,
+                                        doMin ? min.data() : nullptr,
+                                        doMax ? max.data() : nullptr,
+                                        latest);
+    if (found == -1)
+        return false;
+
+    outputEmbedding.reserve(n * functionConfig.aggregators.size());
+
+    if (found == 0) {
+        outputEmbedding.resize(n * functionConfig.aggregators.size(), 0.0);
+        return true;
+    }
+
+    for (auto & agg: functionConfig.aggregators) {
+        if (agg == "avg") {
+            for (auto & v: sum)
+                outputEmbedding.push_back(v / found);
+        }
+        else if (agg == "sum")
+            outputEmbedding.insert(outputEmbedding.end(), sum.begin(), sum.end());
+        else if (agg == "min")
+            outputEmbedding.insert(outputEmbedding.end(), min.begin(), min.end());
+        else outputEmbedding.insert(outputEmbedding.end(), max.begin(), max.end());
+    }
+
+    outputTs.setMax(latest);
+    return true;
 }
 
 struct PoolingFunctionApplier: public FunctionApplierT<PoolingInput, PoolingOutput> {
@@ -126,6 +193,12 @@ applyT(const ApplierT & applier_, PoolingInput input) const
     size_t num_embed_cols = columnNames.size() * functionConfig.aggregators.size();
 
     Date outputTs = input.words.getEffectiveTimestamp();
+
+    // Embedding datasets are read directly, rather than through the query
+    std::vector<double> pooled;
+    if (poolEmbedding(input.words, pooled, outputTs))
+        return {ExpressionValue(std::move(pooled), outputTs)};
+
     StructValue inputRow;
     inputRow.emplace_back("words", std::move(input.words));
 
@@ -16,6 +16,7 @@
 
 namespace MLDB {
 
+struct EmbeddingDataset;
 
 /*****************************************************************************/
 /* POOLING FUNCTION CONFIG                                                   */
@@ -63,6 +64,14 @@ struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
           const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
         const override;
    
+    /** Pool the embeddings of the words directly from the embedding
+        dataset.  Returns false if the dataset isn't an embedding dataset
+        with the expected columns, in which case the query is used.
+    */
+    bool poolEmbedding(const ExpressionValue & words,
+                       std::vector<double> & outputEmbedding,
+                       Date & outputTs) const;
+
     std::shared_ptr<SqlQueryFunction> queryFunction;
 
     BoundTableExpression boundEmbeddingDataset;
@@ -70,6 +79,9 @@ struct PoolingFunction: public ValueFunctionT<PoolingInput, PoolingOutput> {
     PoolingFunctionConfig functionConfig;
     std::vector<ColumnPath> columnNames;
 
+    /// Embedding dataset, if that's what embeddingDataset is; else null
+    const EmbeddingDataset * embedding = nullptr;
+
     SelectExpression select;
 };
 
@@ -20,7 +20,10 @@
 #include "mldb/types/date.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/base/thread_pool.h"
+#include <algorithm>
 #include <memory>
+#include <mutex>
 
 using namespace std;
 
@@ -77,6 +80,28 @@ RankingProcedure(MldbServer * owner,
     procedureConfig = config.params.convert<RankingProcedureConfig>();
 }
 
+namespace {
+
+/// A row to be ranked, with what's needed to sort it
+struct RankedRow {
+    std::string key;                    ///< Normalized key of the fields
+    std::vector<ExpressionValue> fields;  ///< Values of the order by clauses
+    int rowNum;                         ///< Position in the dataset's rows
+    RowPath rowName;
+    Date timestamp;                     ///< Latest timestamp of the fields
+};
+
+/// Number of samples taken per bucket to choose the splitters
+static constexpr size_t SAMPLES_PER_BUCKET = 16;
+
+/// Smallest number of rows it's worth making a bucket for
+static constexpr size_t MIN_BUCKET_ROWS = 1024;
+
+/// Rows recorded together in a chunk
+static constexpr size_t CHUNK_ROWS = 1024;
+
+} // file scope
+
 RunOutput
 RankingProcedure::
 run(const ProcedureRunConfig & run,
@@ -88,104 +113,239 @@ run(const ProcedureRunConfig & run,
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.inputData.stm->from->bind(context, convertProgressToJson);
 
+    const OrderByExpression & inputOrderBy = runProcConf.inputData.stm->orderBy;
+
+    // Sort the way an ordered query would: constant clauses are skipped
+    // and rowHash() breaks the ties, then the position of the row in the
+    // dataset.
+    OrderByExpression orderBy;
+    for (auto & c: inputOrderBy.clauses) {
+        if (c.first->getType() != "constant")
+            orderBy.clauses.push_back(c);
+    }
+    bool orderByRowHash
+        = orderBy.clauses.size() == 1
+        && orderBy.clauses[0].second == ASC
+        && orderBy.clauses[0].first->getType() == "function"
+        && orderBy.clauses[0].first->getOperation() == "rowHash";
+    if (!orderByRowHash && !orderBy.clauses.empty())
+        orderBy.clauses.emplace_back(SqlExpression::parse("rowHash()"), ASC);
+
+    // Rather than having the query sort the rows, which is done globally
+    // on one thread, we calculate the order by fields for each row, then
+    // the timestamp of each of the order by clauses, and do a sample sort
+    // here.
     SelectExpression select(SelectExpression::parse("1"));
     vector<shared_ptr<SqlExpression> > calc;
-
-    // We calculate an expression with the timestamp of the order by
-    // clause.  First, we need to calculate each of the order by clauses
-    for (auto & c: runProcConf.inputData.stm->orderBy.clauses) {
+    for (auto & c: orderBy.clauses)
+        calc.emplace_back(c.first);
+    for (auto & c: inputOrderBy.clauses) {
         auto whenClause = std::make_shared<FunctionCallExpression>
             ("" /* tableName */, "latest_timestamp",
              vector<shared_ptr<SqlExpression> >(1, c.first));
         calc.emplace_back(whenClause);
     }
 
-    vector<RowPath> orderedRowNames;
-    Date globalMaxOrderByTimestamp = Date::negativeInfinity();
-    auto getSize = [&] (NamedRowValue & row,
-                        const vector<ExpressionValue> & calc)
+    size_t numFields = orderBy.clauses.size();
+
+    OrderByExpression noOrderBy;
+    BoundSelectQuery query(select,
+                           *boundDataset.dataset,
+                           boundDataset.asName,
+                           runProcConf.inputData.stm->when,
+                           *runProcConf.inputData.stm->where,
+                           noOrderBy,
+                           calc);
+
+    BoundOrderByExpression boundOrderBy = orderBy.bindAll(*query.context);
+
+    PerThreadAccumulator<vector<RankedRow> > accum;
+
+    auto getRow = [&] (NamedRowValue & row,
+                       vector<ExpressionValue> & calcd,
+                       int rowNum)
     {
-        for (auto & c: calc) {
-            auto ts = c.getAtom().toTimestamp();
-            if (ts.isADate()) {
-                globalMaxOrderByTimestamp.setMax(c.getAtom().toTimestamp());
-            }
+        RankedRow ranked;
+        ranked.fields.reserve(numFields);
+        for (size_t i = 0;  i < numFields;  ++i)
+            ranked.fields.emplace_back(std::move(calcd[i]));
+        ranked.key = boundOrderBy.encodeKey(ranked.fields);
+        ranked.rowNum = rowNum;
+        ranked.rowName = std::move(row.rowName);
+        ranked.timestamp = Date::negativeInfinity();
+        for (size_t i = numFields;  i < calcd.size();  ++i) {
+            auto ts = calcd[i].getAtom().toTimestamp();
+            if (ts.isADate())
+                ranked.timestamp.setMax(ts);
         }
 
-        orderedRowNames.emplace_back(row.rowName);
+        accum.get().emplace_back(std::move(ranked));
         return true;
     };
 
-    BoundSelectQuery(select,
-                     *boundDataset.dataset,
-                     boundDataset.asName,
-                     runProcConf.inputData.stm->when,
-                     *runProcConf.inputData.stm->where,
-                     runProcConf.inputData.stm->orderBy,
-                     calc)
-        .execute({getSize,false/*processInParallel*/},
-                 runProcConf.inputData.stm->offset,
-                 runProcConf.inputData.stm->limit,
-                 convertProgressToJson);
+    query.execute(getRow, true /* processInParallel */, 0 /* offset */,
+                  -1 /* limit */, convertProgressToJson);
 
-    int64_t rowCount = orderedRowNames.size();
+    vector<vector<RankedRow> *> threadRows;
+    accum.forEach([&] (vector<RankedRow> * rows)
+                  {
+                      threadRows.push_back(rows);
+                  });
 
-    auto output = createDataset(server, runProcConf.outputDataset,
-                                nullptr, true /*overwrite*/);
+    size_t numRows = 0;
+    for (auto * rows: threadRows)
+        numRows += rows->size();
 
-    typedef tuple<ColumnPath, CellValue, Date> Cell;
-    PerThreadAccumulator<vector<pair<RowPath, vector<Cell> > > > accum;
-    const ColumnPath columnName(runProcConf.rankingColumnName);
-    function<void(int64_t)> applyFct;
-    float countD100 = (rowCount) / 100.0;
-    if (false) {
-    //if (runProcConf.rankingType == RankingType::PERCENTILE) {
-        // Improper implementation, see
-        // https://en.wikipedia.org/wiki/Percentile_rank
-        applyFct = [&](int64_t idx)
+    // Total order over the rows, which is what makes the ranks not
+    // depend on how the rows were spread over the threads
+    auto rowLess = [&] (const RankedRow & row1, const RankedRow & row2)
         {
-            vector<Cell> rowValue;
-            rowValue.emplace_back(columnName,
-                                  (idx + 1) / countD100,
-                                  globalMaxOrderByTimestamp);
+            int cmp = boundOrderBy.compareKeys(row1.key, row1.fields,
+                                               row2.key, row2.fields);
+            if (cmp != 0)
+                return cmp < 0;
+            return row1.rowNum < row2.rowNum;
+        };
+
+    // Choose the splitters between the buckets from evenly spaced samples
+    // of the rows of each thread.  Samples are pointers, since the rows
+    // stay where they are until they are bucketed.
+    size_t numBuckets
+        = std::max<size_t>(1, std::min<size_t>(numCpus() * 4,
+                                               numRows / MIN_BUCKET_ROWS));
+
+    vector<const RankedRow *> samples;
+    for (auto * rows: threadRows) {
+        size_t numSamples
+            = (rows->size() * numBuckets * SAMPLES_PER_BUCKET
+               + numRows - 1) / std::max<size_t>(numRows, 1);
+        for (size_t i = 0;  i < numSamples;  ++i)
+            samples.push_back(&(*rows)[i * rows->size() / numSamples]);
+    }
+
+    std::sort(samples.begin(), samples.end(),
+              [&] (const RankedRow * row1, const RankedRow * row2)
+              {
+                  return rowLess(*row1, *row2);
+              });
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
+    vector<RankedRow> splitters;
+    for (size_t i = 1;  i < numBuckets && !samples.empty();  ++i)
+        splitters.push_back(*samples[i * samples.size() / numBuckets]);
+    numBuckets = splitters.size() + 1;
 
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
+    // Each thread's rows are split into the buckets independently...
+    vector<vector<vector<RankedRow> > > threadBuckets(threadRows.size());
+    auto bucketThread = [&] (size_t t)
+        {
+            auto & buckets = threadBuckets[t];
+            buckets.resize(numBuckets);
+            for (auto & row: *threadRows[t]) {
+                size_t b = std::upper_bound(splitters.begin(), splitters.end(),
+                                            row, rowLess)
+                    - splitters.begin();
+                buckets[b].emplace_back(std::move(row));
             }
+            vector<RankedRow>().swap(*threadRows[t]);
         };
-    }
-    else {
-        ExcAssert(runProcConf.rankingType == RankingType::INDEX);
-        applyFct = [&](int64_t idx)
-        {
-            vector<Cell> rowValue;
-            rowValue.emplace_back(columnName,
-                                  idx,
-                                  globalMaxOrderByTimestamp);
 
-            auto & rows = accum.get();
-            rows.emplace_back(orderedRowNames[idx], rowValue);
+    parallelMap(0, threadRows.size(), bucketThread);
+
+    // ... and then each bucket is gathered and sorted on its own
+    vector<vector<RankedRow> > buckets(numBuckets);
+    auto sortBucket = [&] (size_t b)
+        {
+            auto & bucket = buckets[b];
+            size_t size = 0;
+            for (auto & tb: threadBuckets)
+                size += tb[b].size();
+            bucket.reserve(size);
+            for (auto & tb: threadBuckets) {
+                for (auto & row: tb[b])
+                    bucket.emplace_back(std::move(row));
+                vector<RankedRow>().swap(tb[b]);
+            }
+            std::sort(bucket.begin(), bucket.end(), rowLess);
+        };
 
-            if (rows.size() >= 1024) {
-                output->recordRows(rows);
-                rows.clear();
+    parallelMap(0, numBuckets, sortBucket);
+    threadBuckets.clear();
+
+    // The rank of the first row of each bucket is the number of rows in
+    // the buckets before it
+    vector<size_t> bucketOffsets(numBuckets + 1, 0);
+    for (size_t b = 0;  b < numBuckets;  ++b)
+        bucketOffsets[b + 1] = bucketOffsets[b] + buckets[b].size();
+
+    // Only the rows within the offset and limit of the query are ranked,
+    // starting at zero.
+    size_t first = std::min<size_t>(std::max<ssize_t>(runProcConf.inputData.stm->offset, 0),
+                                    numRows);
+    size_t last = numRows;
+    if (runProcConf.inputData.stm->limit != -1)
+        last = std::min<size_t>(last, first + runProcConf.inputData.stm->limit);
+
+    // All rank cells take the latest timestamp of the order by fields of
+    // the ranked rows
+    std::mutex timestampMutex;
+    Date globalMaxOrderByTimestamp = Date::negativeInfinity();
+    auto getTimestamp = [&] (size_t b)
+        {
+            Date maxTimestamp = Date::negativeInfinity();
+            for (size_t r = std::max(first, bucketOffsets[b]),
+                     end = std::min(last, bucketOffsets[b + 1]);
+                 r < end;  ++r) {
+                maxTimestamp.setMax(buckets[b][r - bucketOffsets[b]].timestamp);
             }
+            std::unique_lock<std::mutex> guard(timestampMutex);
+            globalMaxOrderByTimestamp.setMax(maxTimestamp);
         };
+
+    parallelMap(0, numBuckets, getTimestamp);
+
+    auto output = createDataset(server, runProcConf.outputDataset,
+                                nullptr, true /*overwrite*/);
+
+    // Record in chunks that don't cross a bucket, so each is written by
+    // one thread from a bucket it has to itself
+    vector<std::tuple<size_t, size_t, size_t> > chunks;  // bucket, begin, end
+    for (size_t b = 0;  b < numBuckets;  ++b) {
+        size_t begin = std::max(first, bucketOffsets[b]);
+        size_t end = std::min(last, bucketOffsets[b + 1]);
+        for (size_t r = begin;  r < end;  r += CHUNK_ROWS)
+            chunks.emplace_back(b, r, std::min(end, r + CHUNK_ROWS));
     }
 
+    typedef tuple<ColumnPath, CellValue, Date> Cell;
+    const ColumnPath columnName(runProcConf.rankingColumnName);
+    ExcAssert(runProcConf.rankingType == RankingType::INDEX);
 
-    parallelMap(0, rowCount, applyFct);
+    Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
 
-    // record remainder
-    accum.forEach([&] (vector<pair<RowPath, vector<Cell> > > * rows)
-    {
-        output->recordRows(*rows);
-    });
-    output->commit();
+    auto recordChunk = [&] (size_t chunk)
+        {
+            size_t b, begin, end;
+            std::tie(b, begin, end) = chunks[chunk];
+
+            vector<pair<RowPath, vector<Cell> > > rows;
+            rows.reserve(end - begin);
+            for (size_t r = begin;  r < end;  ++r) {
+                vector<Cell> rowValue;
+                rowValue.emplace_back(columnName,
+                                      (int64_t)(r - first),
+                                      globalMaxOrderByTimestamp);
+                rows.emplace_back(std::move(buckets[b][r - bucketOffsets[b]].rowName),
+                                  std::move(rowValue));
+            }
+
+            auto chunkRecorder = recorder.newChunk(chunk);
+            chunkRecorder->recordRowsDestructive(std::move(rows));
+            chunkRecorder->finishedChunk();
+        };
+
+    parallelMap(0, chunks.size(), recordChunk);
+
+    recorder.commit();
     return output->getStatus();
 }
 
@@ -0,0 +1,144 @@
+/** rolling_tables.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Parallel training of tables of per-key statistics, for the statsTable
+    and distTable procedures.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include <unordered_map>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ROLLING TABLES                                                            */
+/*****************************************************************************/
+
+/** Statistics for each key of a number of tables, which are updated from a
+    stream of occurrences of keys in which the order matters: each
+    occurrence sees the statistics of the earlier occurrences of the same
+    key, like the rolling counts that the statsTable.train procedure
+    records.
+
+    The keys are hash partitioned, and each partition has its own maps
+    which are only ever touched by one thread at a time.  A block of
+    occurrences is processed by one thread per partition with no locking,
+    and each key still sees its occurrences in order.  When training is
+    finished, the partitions of each table are merged together.
+*/
+
+template<typename Stats>
+struct RollingTables {
+    typedef std::unordered_map<Utf8String, Stats> Map;
+
+    RollingTables(size_t numTables, Stats initial,
+                  size_t numPartitions = 4 * numCpus())
+        : numTables(numTables),
+          initial(std::move(initial)),
+          partitionEntries(numPartitions),
+          partitions(numPartitions, std::vector<Map>(numTables))
+    {
+    }
+
+    /** Add an occurrence of the key in the given table to the current
+        block.  Returns the index of the occurrence within the block.
+    */
+    size_t add(size_t table, Utf8String key)
+    {
+        size_t index = block.size();
+        size_t partition
+            = std::hash<Utf8String>()(key) % partitionEntries.size();
+        block.push_back({table, std::move(key)});
+        partitionEntries[partition].push_back(index);
+        return index;
+    }
+
+    /** Number of occurrences in the current block. */
+    size_t blockSize() const
+    {
+        return block.size();
+    }
+
+    /** Update the statistics with each occurrence of the current block,
+        which is then cleared.  onEntry(index, stats) is called with the
+        index of the occurrence in the block and the statistics of its key
+        from the earlier occurrences, which it should update.  Calls for
+        different keys may be made at the same time from different
+        threads; those for the same key are made in order.
+    */
+    template<typename Fn>
+    void processBlock(const Fn & onEntry)
+    {
+        auto doPartition = [&] (size_t p)
+            {
+                std::vector<Map> & maps = partitions[p];
+                for (size_t index: partitionEntries[p]) {
+                    const Entry & entry = block[index];
+                    Map & map = maps[entry.table];
+                    auto it = map.find(entry.key);
+                    if (it == map.end())
+                        it = map.emplace(entry.key, initial).first;
+                    onEntry(index, it->second);
+                }
+                partitionEntries[p].clear();
+            };
+
+        parallelMap(0, partitions.size(), doPartition);
+        block.clear();
+    }
+
+    /** Merge the partitions of each table, and pass the result to
+        onTable(table, map).  Tables are merged in parallel, so onTable
+        may be called from several threads at once.
+    */
+    template<typename Fn>
+    void finish(const Fn & onTable)
+    {
+        auto doTable = [&] (size_t table)
+            {
+                size_t size = 0;
+                for (auto & maps: partitions)
+                    size += maps[table].size();
+
+                Map result;
+                result.reserve(size);
+                for (auto & maps: partitions) {
+                    // Partitions have distinct keys, so nothing is lost
+                    for (auto & entry: maps[table])
+                        result.emplace(entry.first, std::move(entry.second));
+                    Map().swap(maps[table]);
+                }
+
+                onTable(table, std::move(result));
+            };
+
+        parallelMap(0, numTables, doTable);
+    }
+
+private:
+    struct Entry {
+        size_t table;
+        Utf8String key;
+    };
+
+    size_t numTables;
+    Stats initial;
+
+    /// Occurrences in the current block
+    std::vector<Entry> block;
+
+    /// For each partition, the indexes in the block of its occurrences
+    std::vector<std::vector<uint32_t> > partitionEntries;
+
+    /// For each partition, the statistics of each table
+    std::vector<std::vector<Map> > partitions;
+};
+
+} // namespace MLDB
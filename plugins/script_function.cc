@@ -34,6 +34,13 @@ ScriptFunctionConfigDescription()
             "Script language (python or javascript)");
     addField("scriptConfig", &ScriptFunctionConfig::scriptConfig, 
             "Script resource configuration");
+    addField("batch", &ScriptFunctionConfig::batch,
+             "If true, the script is called with a list of the args of "
+             "several calls of the function at once, and must return a "
+             "list with the return value of each.  This amortizes the cost "
+             "of running the script over the calls, for example when the "
+             "function is applied to many inputs through the batch "
+             "application route.", false);
 }
 
 
@@ -72,21 +79,46 @@ getStatus() const
     return Any();
 }
 
+namespace {
+
+/** Convert the return value of the script for one call into the output
+    of the function.
+*/
 ExpressionValue
+convertReturn(const Json::Value & result)
+{
+    StructValue vals;
+    if(!result.isArray()) {
+        throw MLDB::Exception("Function should return array of arrays.");
+    }
+
+    for(const Json::Value & elem : result) {
+        if(!elem.isArray() || elem.size() != 3)
+            throw MLDB::Exception("elem should be array of size 3");
+
+        vals.push_back(make_tuple(PathElement(elem[0].asString()),
+                                  ExpressionValue(elem[1],
+                                                  Date::parseIso8601DateTime(elem[2].asString()))));
+    }
+
+    StructValue sresult;
+    sresult.emplace_back("return", std::move(vals));
+
+    return std::move(sresult);
+}
+
+} // file scope
+
+Json::Value
 ScriptFunction::
-apply(const FunctionApplier & applier,
-      const ExpressionValue & context) const
+runScript(Json::Value args) const
 {
     string resource = "/v1/types/plugins/" + runner + "/routes/run";
 
     // make it so that if the params parameter contains an args key, we move
     // its contents to the args parameter of the script
     ScriptResource copiedSR(cachedResource);
-
-    ExpressionValue args = context.getColumn(PathElement("args"));
-    //Json::Value val = { args.extractJson(), jsonEncode(args.getEffectiveTimestamp()) };
-    Json::Value val = jsonEncode(args);
-    copiedSR.args = val;
+    copiedSR.args = std::move(args);
 
     DEBUG_MSG(logger) << "script args = " << jsonEncode(copiedSR.args);
 
@@ -107,26 +139,54 @@ apply(const FunctionApplier & applier,
                                   Json::parse(connection.response));
     }
 
-    Json::Value result = Json::parse(connection.response)["result"];
-    
-    vector<tuple<PathElement, ExpressionValue>> vals;
-    if(!result.isArray()) {
-        throw MLDB::Exception("Function should return array of arrays.");
-    }
+    return Json::parse(connection.response)["result"];
+}
 
-    for(const Json::Value & elem : result) {
-        if(!elem.isArray() || elem.size() != 3)
-            throw MLDB::Exception("elem should be array of size 3");
+ExpressionValue
+ScriptFunction::
+apply(const FunctionApplier & applier,
+      const ExpressionValue & context) const
+{
+    ExpressionValue output;
+    applyBatch(applier, &context, &output, 1);
+    return output;
+}
 
-        vals.push_back(make_tuple(PathElement(elem[0].asString()),
-                                  ExpressionValue(elem[1],
-                                                  Date::parseIso8601DateTime(elem[2].asString()))));
+void
+ScriptFunction::
+applyBatch(const FunctionApplier & applier,
+           const ExpressionValue * inputs,
+           ExpressionValue * outputs,
+           size_t n) const
+{
+    auto getArgs = [&] (size_t i)
+        {
+            ExpressionValue args = inputs[i].getColumn(PathElement("args"));
+            //Json::Value val = { args.extractJson(), jsonEncode(args.getEffectiveTimestamp()) };
+            return jsonEncode(args);
+        };
+
+    if (!functionConfig.batch) {
+        for (size_t i = 0;  i < n;  ++i)
+            outputs[i] = convertReturn(runScript(getArgs(i)));
+        return;
     }
 
-    StructValue sresult;
-    sresult.emplace_back("return", std::move(vals));
+    Json::Value allArgs(Json::arrayValue);
+    for (size_t i = 0;  i < n;  ++i)
+        allArgs.append(getArgs(i));
+
+    Json::Value results = runScript(std::move(allArgs));
+    if (!results.isArray() || results.size() != n) {
+        throw HttpReturnException
+            (400, "Batch script function should return a list with one "
+             "element per call",
+             "numCalls", n,
+             "returned", results);
+    }
 
-    return std::move(sresult);
+    for (size_t i = 0;  i < n;  ++i)
+        outputs[i] = convertReturn(results[(int)i]);
 }
 
 FunctionInfo
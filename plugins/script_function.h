@@ -23,6 +23,9 @@ namespace MLDB {
 struct ScriptFunctionConfig {
     std::string language;
     ScriptResource scriptConfig;
+
+    /// Script is called with a list of the args of many calls at once
+    bool batch = false;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ScriptFunctionConfig);
@@ -43,8 +46,19 @@ struct ScriptFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** If the function is configured with batch, this runs the script
+        once for all of the inputs.  Otherwise it runs it for each one.
+    */
+    virtual void applyBatch(const FunctionApplier & applier,
+                            const ExpressionValue * inputs,
+                            ExpressionValue * outputs,
+                            size_t n) const;
+
     virtual FunctionInfo getFunctionInfo() const;
 
+    /** Run the script with the given args, and return what it returned. */
+    Json::Value runScript(Json::Value args) const;
+
     ScriptFunctionConfig functionConfig;
 
     std::string runner;
@@ -22,6 +22,7 @@
 #include "mldb/server/parallel_merge_sort.h"
 #include "mldb/utils/log.h"
 #include <mutex>
+#include <thread>
 
 using namespace std;
 
@@ -202,6 +203,23 @@ struct SparseMatrixDataset::Itl
 
     shared_ptr<spdlog::logger> logger;
 
+    /** Cache of values that are stored out of line in the values matrix
+        (long strings, paths and some intervals), keyed by their hash.
+        Those rows are immutable once written, so entries never go stale,
+        and since CellValue shares the storage of long strings between
+        copies, returning a cached value copies none of its contents.
+        It's split into shards to avoid contention between the threads
+        of a parallel scan.
+    */
+    struct ValueCacheShard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::pair<uint32_t, CellValue> > values;
+    };
+
+    static constexpr size_t NUM_VALUE_CACHE_SHARDS = 16;
+    static constexpr size_t MAX_CACHED_VALUES_PER_SHARD = 16384;
+    mutable ValueCacheShard valueCache[NUM_VALUE_CACHE_SHARDS];
+
     /// Obtain a new read transaction at the current state
     std::shared_ptr<ReadTransaction>
     getReadTransaction() const
@@ -279,7 +297,7 @@ struct SparseMatrixDataset::Itl
         setDefaultTransaction(std::move(result));
     }
 
-    void optimize()
+    virtual void optimize()
     {
         DEBUG_MSG(logger) << "optimize() on MutableSparseMatrixDataset";
         //Timer timer;
@@ -350,20 +368,8 @@ struct SparseMatrixDataset::Itl
             repr.u = val;
             return CellValue::fromMonthDaySecond(repr.mths, repr.days, repr.seconds);
         }
-        case 26: { // time interval, seconds can't be done with a float
-            CellValue result;
-
-            auto onRow = [&] (const BaseEntry & entry)
-                {
-                    result = jsonDecodeStr<CellValue>(entry.metadata.at(0));
-                    return false;
-                };
-            
-            if (trans.values->iterateRow(val, onRow))
-                throw HttpReturnException(400, "Can't find unknown value hash",
-                                          "hash", val);
-            return result;
-        }            
+        case 26: // time interval, seconds can't be done with a float
+            return decodeStoredVal(val, tag, trans);
 
         // Strings
         case 16:
@@ -379,26 +385,11 @@ struct SparseMatrixDataset::Itl
                 val >>= 8;
             }
 
-            return CellValue(Utf8String(string(c, c + len)));
+            return CellValue(c, len);
         }
         case 24:
-        case 30: {
-            CellValue result;
-
-            auto onRow = [&] (const BaseEntry & entry)
-                {
-                    if (tag == 30) // PATH
-                        result = CellValue(Path::parse(entry.metadata.at(0)));
-                    else // UTF8 strings and long ASCII
-                        result = CellValue(Utf8String(entry.metadata.at(0)));
-                    return false;
-                };
-            
-            if (trans.values->iterateRow(val, onRow))
-                throw HttpReturnException(400, "Can't find unknown value hash",
-                                          "hash", val);
-            return result;
-        }
+        case 30:
+            return decodeStoredVal(val, tag, trans);
         case 31:
             return CellValue(Path(PathElement(val)));
         default:
@@ -406,6 +397,47 @@ struct SparseMatrixDataset::Itl
         }            
     }
     
+    /** Decode a value that's stored out of line in the values matrix
+        under the given hash, going through the value cache.
+    */
+    CellValue decodeStoredVal(uint64_t val, uint32_t tag,
+                              ReadTransaction & trans) const
+    {
+        ValueCacheShard & shard
+            = valueCache[(val >> 32) % NUM_VALUE_CACHE_SHARDS];
+        {
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            auto it = shard.values.find(val);
+            if (it != shard.values.end() && it->second.first == tag)
+                return it->second.second;
+        }
+
+        CellValue result;
+
+        auto onRow = [&] (const BaseEntry & entry)
+            {
+                const std::string & stored = entry.metadata.at(0);
+                if (tag == 26) // TIME INTERVAL
+                    result = jsonDecodeStr<CellValue>(stored);
+                else if (tag == 30) // PATH
+                    result = CellValue(Path::parse(stored));
+                else // UTF8 strings and long ASCII
+                    result = CellValue(stored.data(), stored.length());
+                return false;
+            };
+
+        if (trans.values->iterateRow(val, onRow))
+            throw HttpReturnException(400, "Can't find unknown value hash",
+                                      "hash", val);
+
+        std::unique_lock<std::mutex> guard(shard.mutex);
+        if (shard.values.size() >= MAX_CACHED_VALUES_PER_SHARD)
+            shard.values.clear();
+        shard.values.emplace(val, std::make_pair(tag, result));
+
+        return result;
+    }
+
     static uint64_t encodeTs(Date val, double timeQuantumSeconds)
     {
         if (val == Date::negativeInfinity())
@@ -631,7 +663,12 @@ struct SparseMatrixDataset::Itl
     virtual MatrixNamedRow getRow(const RowPath & rowName) const override
     {
         auto trans = getReadTransaction();
+        return getRowTrans(rowName, *trans);
+    }
 
+    MatrixNamedRow getRowTrans(const RowPath & rowName,
+                               ReadTransaction & trans) const
+    {
         MatrixNamedRow result;
         result.columns.reserve(16);
         result.rowHash = result.rowName = rowName;
@@ -640,16 +677,39 @@ struct SparseMatrixDataset::Itl
             {
                 Date ts = decodeTs(entry.timestamp);
                 ColumnHash col(entry.rowcol);
-                CellValue v = decodeVal(entry.val, entry.tag, *trans);
-                result.columns.emplace_back(getColumnPathTrans(col, *trans), v, ts);
+                CellValue v = decodeVal(entry.val, entry.tag, trans);
+                result.columns.emplace_back(getColumnPathTrans(col, trans), v, ts);
                 return true;
             };
 
-        trans->matrix->iterateRow(result.rowHash.hash(), onEntry);
+        trans.matrix->iterateRow(result.rowHash.hash(), onEntry);
         
         return result;
     }
 
+    // The bulk lookups share a single read transaction
+    virtual std::vector<bool>
+    knownRows(const std::vector<RowPath> & rows) const override
+    {
+        auto trans = getReadTransaction();
+        std::vector<bool> result(rows.size());
+        for (size_t i = 0;  i < rows.size();  ++i)
+            result[i] = trans->matrix->knownRow(RowHash(rows[i]).hash());
+        return result;
+    }
+
+    virtual std::vector<MatrixNamedRow>
+    getRows(const std::vector<RowPath> & rows) const override
+    {
+        auto trans = getReadTransaction();
+        std::vector<MatrixNamedRow> result(rows.size());
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            if (trans->matrix->knownRow(RowHash(rows[i]).hash()))
+                result[i] = getRowTrans(rows[i], *trans);
+        }
+        return result;
+    }
+
     virtual ExpressionValue getRowExpr(const RowPath & rowName) const
     {
         auto trans = getReadTransaction();
@@ -672,6 +732,47 @@ struct SparseMatrixDataset::Itl
         return std::move(result);
     }
 
+    ExpressionValue
+    getProjectedRowExpr(const RowPath & rowName,
+                        const std::vector<ColumnPath> & columns) const
+    {
+        ColumnProjection projection(columns);
+        if (projection.all)
+            return getRowExpr(rowName);
+
+        // Columns that are read by name are recognized by their hash,
+        // without needing to look up their name
+        std::vector<ColumnHash> hashes;
+        for (auto & c: columns)
+            hashes.emplace_back(c);
+
+        auto trans = getReadTransaction();
+
+        RowValue result;
+
+        auto onEntry = [&] (const BaseEntry & entry)
+            {
+                ColumnHash col(entry.rowcol);
+                ColumnPath columnName;
+                auto it = std::find(hashes.begin(), hashes.end(), col);
+                if (it != hashes.end())
+                    columnName = columns[it - hashes.begin()];
+                else {
+                    columnName = getColumnPathTrans(col, *trans);
+                    if (!projection.isNeeded(columnName))
+                        return true;
+                }
+                Date ts = decodeTs(entry.timestamp);
+                CellValue v = decodeVal(entry.val, entry.tag, *trans);
+                result.emplace_back(std::move(columnName), std::move(v), ts);
+                return true;
+            };
+
+        trans->matrix->iterateRow(RowHash(rowName).hash(), onEntry);
+
+        return std::move(result);
+    }
+
     RowPath getRowPathTrans(const RowHash & rowHash,
                             ReadTransaction & trans) const
     {
@@ -1044,7 +1145,8 @@ commit()
     // We call commit() when we're done with writing data.  We take advantage
     // of it to optimize the storage of the data that's been recorded to
     // date.
-    return itl->optimize();
+    itl->optimize();
+    Dataset::commit();
 }
     
 Date
@@ -1091,6 +1193,14 @@ getRowExpr(const RowPath & rowName) const
     return itl->getRowExpr(rowName);
 }
 
+ExpressionValue
+SparseMatrixDataset::
+getProjectedRowExpr(const RowPath & rowName,
+                    const std::vector<ColumnPath> & columns) const
+{
+    return itl->getProjectedRowExpr(rowName, columns);
+}
+
 enum CommitMode {
     READ_ON_COMMIT,
     READ_FAST,
@@ -1360,12 +1470,162 @@ struct MutableBaseData {
     std::vector<std::shared_ptr<RowsEntry> > nonReadableWrites;
     shared_ptr<spdlog::logger> logger;
 
-    /** Commit and optimize everything that's been written up to here. */
+    /** Commit and optimize everything that's been written up to here.
+
+        Except in the READ_FAST mode, where insertBalanced() may rearrange
+        the entries at any time, the merge is done without holding the
+        mutex so that writers don't have to wait for it.  It works on a
+        snapshot; anything that was made readable in the meantime can only
+        have been appended, and is added back afterwards.
+    */
     void optimize()
     {
+        std::unique_lock<std::mutex> compactionGuard(compactionMutex);
+
+        if (commitMode == READ_FAST) {
+            std::unique_lock<std::mutex> guard(mutex);
+            auto newRows = repr.load()->rows.optimize(nonReadableWrites);
+            auto newRepr = std::make_shared<Repr>(std::move(newRows));
+            repr.store(std::move(newRepr));
+            return;
+        }
+
+        std::shared_ptr<Repr> r;
+        std::vector<std::shared_ptr<RowsEntry> > toMerge;
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            r = repr.load();
+            toMerge.swap(nonReadableWrites);
+        }
+
+        auto newRows = r->rows.optimize(toMerge);
+
+        std::unique_lock<std::mutex> guard(mutex);
+        installMerged(*r, r->rows.entries.size(), std::move(newRows),
+                      false /* keepRowCount */);
+    }
+
+    /** Fold recent writes together in the background, without stopping
+        reads or writes.  In the READ_ON_COMMIT mode, the writes waiting for
+        a commit are merged into one (still unreadable) entry so that the
+        commit has less to do.  In the WRITE_FAST mode, the small recent
+        entries are merged together, like insertBalanced() would have done
+        on the write path, so that reads have fewer entries to look at.
+    */
+    void compact()
+    {
+        std::unique_lock<std::mutex> compactionGuard(compactionMutex);
+
+        switch (commitMode) {
+        case READ_ON_COMMIT:
+            compactNonReadable();
+            return;
+        case WRITE_FAST:
+            compactReadable();
+            return;
+        case READ_FAST:
+            // Already balanced on every write
+            return;
+        }
+    }
+
+    void compactNonReadable()
+    {
+        std::vector<std::shared_ptr<RowsEntry> > toMerge;
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            toMerge.swap(nonReadableWrites);
+        }
+
+        if (toMerge.size() > 1) {
+            auto merged = std::make_shared<RowsEntry>(std::move(*toMerge[0]));
+            for (unsigned i = 1;  i < toMerge.size();  ++i) {
+                for (auto & v: *toMerge[i]) {
+                    auto & vec = (*merged)[v.first];
+                    vec.insert(vec.end(),
+                               std::make_move_iterator(v.second.begin()),
+                               std::make_move_iterator(v.second.end()));
+                }
+            }
+            toMerge.clear();
+            toMerge.emplace_back(std::move(merged));
+        }
+
+        // Put them back in front of anything that was written since
+        std::unique_lock<std::mutex> guard(mutex);
+        nonReadableWrites.insert(nonReadableWrites.begin(),
+                                 std::make_move_iterator(toMerge.begin()),
+                                 std::make_move_iterator(toMerge.end()));
+    }
+
+    void compactReadable()
+    {
+        std::shared_ptr<Repr> r;
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            r = repr.load();
+        }
+
+        const auto & entries = r->rows.entries;
+
+        // Merge from the newest backwards while we're at least half the
+        // size of the next entry, which keeps the sizes decreasing
+        std::shared_ptr<RowsEntry> current;
+        int first = entries.size();
+        for (int i = entries.size() - 1;  i >= 0;  --i) {
+            if (current && current->size() * 2 < entries[i]->size())
+                break;
+
+            // Readers may be looking at the entries, so we copy them
+            auto merged = std::make_shared<RowsEntry>(*entries[i]);
+            if (current) {
+                for (auto & v: *current) {
+                    auto & vec = (*merged)[v.first];
+                    vec.insert(vec.end(),
+                               std::make_move_iterator(v.second.begin()),
+                               std::make_move_iterator(v.second.end()));
+                }
+            }
+            current = std::move(merged);
+            first = i;
+        }
+
+        if (first >= (int)entries.size() - 1)
+            return;  // nothing to merge
+
+        Rows newRows;
+        newRows.entries.insert(newRows.entries.end(),
+                               entries.begin(), entries.begin() + first);
+        newRows.entries.emplace_back(std::move(current));
+
         std::unique_lock<std::mutex> guard(mutex);
-        auto newRows = repr.load()->rows.optimize(nonReadableWrites);
-        auto newRepr = std::make_shared<Repr>(std::move(newRows));
+        installMerged(*r, entries.size(), std::move(newRows),
+                      true /* keepRowCount */);
+    }
+
+    /** Replace the first numEntries entries of the given snapshot, which
+        must be a prefix of the current entries, with the given merged rows.
+        If keepRowCount is true, the merged rows contain exactly the same
+        rows as the ones they replace.  Must be called with the mutex held.
+    */
+    void installMerged(const Repr & snapshot, size_t numEntries, Rows newRows,
+                       bool keepRowCount)
+    {
+        auto current = repr.load();
+        const auto & currentEntries = current->rows.entries;
+
+        ExcAssertGreaterEqual(currentEntries.size(), numEntries);
+        for (size_t i = 0;  i < numEntries;  ++i)
+            ExcAssert(currentEntries[i] == snapshot.rows.entries[i]);
+
+        int64_t rowCount = keepRowCount
+            ? current->rows.cachedRowCount.load() : -1;
+
+        for (size_t i = numEntries;  i < currentEntries.size();  ++i)
+            newRows.entries.push_back(currentEntries[i]);
+
+        auto newRepr = std::make_shared<Repr>(std::move(newRows.entries),
+                                              rowCount);
         repr.store(std::move(newRepr));
     }
 
@@ -1493,6 +1753,9 @@ struct MutableBaseData {
     }
 
     mutable std::mutex mutex;
+
+    /// Only one of optimize() or compact() runs at a time
+    std::mutex compactionMutex;
 };
 
 struct MutableReadTransaction;
@@ -1698,6 +1961,11 @@ struct MutableBaseMatrix: public BaseMatrix {
     {
         data->optimize();
     }
+
+    void compact()
+    {
+        data->compact();
+    }
 };
 
 /******************************************************************************/
@@ -1767,6 +2035,11 @@ MutableSparseMatrixDatasetConfigDescription()
              "Whether to favor reads or writes.  Only has effect for when "
              "`consistencyLevel` is set to `consistentAfterWrite`.",
              TF_FAVOR_READS);
+    addField("compaction", &MutableSparseMatrixDatasetConfig::compaction,
+             "Controls the background compaction of recently written "
+             "values, which makes them faster to read (with "
+             "`consistentAfterWrite`) or to commit (with "
+             "`consistentAfterCommit`) without blocking reads or writes.");
 }
 
 /*****************************************************************************/
@@ -1778,7 +2051,9 @@ struct MutableSparseMatrixDataset::Itl
 
     Itl(double timeQuantumSeconds,
         WriteTransactionLevel consistencyLevel,
-        TransactionFavor favor) 
+        TransactionFavor favor,
+        CompactionConfig compaction)
+        : compactor(std::move(compaction), std::bind(&Itl::compact, this))
     {
         CommitMode mode;
         if (consistencyLevel == WT_READ_AFTER_COMMIT)
@@ -1792,6 +2067,206 @@ struct MutableSparseMatrixDataset::Itl
              std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode));
+
+        // Nothing needs to be readable before a commit, so writers don't
+        // need to wait for each other
+        if (mode == READ_ON_COMMIT) {
+            numWriteShards = 2 * numCpus();
+            writeShards.reset(new WriteShard[numWriteShards]);
+        }
+    }
+
+    /** When written values only need to be readable after a commit,
+        concurrent writers don't need to go through commitWrites() (and its
+        root lock) one at a time.  Instead, each record call writes into one
+        of a set of write shards, each of which has its own write
+        transaction, and the shards are committed into the matrices when
+        commit() is called.
+    */
+    struct WriteShard {
+        std::mutex mutex;
+        std::shared_ptr<WriteTransaction> trans;
+    };
+
+    std::unique_ptr<WriteShard[]> writeShards;
+    size_t numWriteShards = 0;
+
+    /** Lock and return a write shard for the current thread.  We start at
+        one that depends on the thread and take the first that's free, so
+        that writers only wait for each other when every shard is busy.
+    */
+    WriteShard & lockWriteShard()
+    {
+        size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (size_t i = 0;  i < numWriteShards;  ++i) {
+            WriteShard & shard = writeShards[(start + i) % numWriteShards];
+            if (shard.mutex.try_lock())
+                return shard;
+        }
+
+        WriteShard & shard = writeShards[start % numWriteShards];
+        shard.mutex.lock();
+        return shard;
+    }
+
+    template<typename Rows, typename RecordFn>
+    void recordSharded(const Rows & rows, const RecordFn & record)
+    {
+        // Check up-front so that an error doesn't leave half of the rows
+        // in the shard to be committed later
+        for (auto & r: rows) {
+            if (r.first.empty())
+                throw HttpReturnException(400, "Datasets don't accept empty row names");
+        }
+
+        WriteShard & shard = lockWriteShard();
+        std::unique_lock<std::mutex> guard(shard.mutex, std::adopt_lock);
+
+        if (!shard.trans)
+            shard.trans = getWriteTransaction(*getReadTransaction());
+
+        for (auto & r: rows)
+            record(r, *shard.trans);
+
+        guard.unlock();
+        compactor.recorded(rows.size());
+    }
+
+    /** Commit everything that's waiting in the write shards. */
+    void commitWriteShards()
+    {
+        for (size_t i = 0;  i < numWriteShards;  ++i) {
+            WriteShard & shard = writeShards[i];
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            if (!shard.trans)
+                continue;
+            commitWrites(*shard.trans);
+            shard.trans.reset();
+        }
+    }
+
+    virtual void
+    recordRow(const RowPath & rowName,
+              const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+        override
+    {
+        if (!writeShards) {
+            SparseMatrixDataset::Itl::recordRow(rowName, vals);
+            compactor.recorded(1);
+            return;
+        }
+
+        std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > >
+            row(rowName, vals);
+        recordRows({ std::move(row) });
+    }
+
+    virtual void
+    recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows) override
+    {
+        if (!writeShards) {
+            SparseMatrixDataset::Itl::recordRows(rows);
+            compactor.recorded(rows.size());
+            return;
+        }
+
+        auto record = [&] (const std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > & r,
+                           WriteTransaction & trans)
+            {
+                recordRowTrans(r.first, r.second, trans, timeQuantumSeconds,
+                               logger);
+            };
+
+        recordSharded(rows, record);
+    }
+
+    virtual void
+    recordRowExpr(const RowPath & rowName,
+                  const ExpressionValue & vals) override
+    {
+        if (!writeShards) {
+            SparseMatrixDataset::Itl::recordRowExpr(rowName, vals);
+            compactor.recorded(1);
+            return;
+        }
+
+        recordRowsExpr({ { rowName, vals } });
+    }
+
+    virtual void
+    recordRowsExpr(const std::vector<std::pair<RowPath, ExpressionValue> > & rows) override
+    {
+        if (!writeShards) {
+            SparseMatrixDataset::Itl::recordRowsExpr(rows);
+            compactor.recorded(rows.size());
+            return;
+        }
+
+        auto record = [&] (const std::pair<RowPath, ExpressionValue> & r,
+                           WriteTransaction & trans)
+            {
+                recordRowExprTrans(r.first, r.second, trans,
+                                   timeQuantumSeconds);
+            };
+
+        recordSharded(rows, record);
+    }
+
+    /** The matrices deal with concurrent writes while they optimize (see
+        MutableBaseData::optimize()), so unlike the base class we don't hold
+        the root lock while doing it, and writers can carry on.
+    */
+    virtual void optimize() override
+    {
+        DEBUG_MSG(logger) << "optimize() on MutableSparseMatrixDataset";
+
+        // Anything pending is about to be dealt with
+        auto pause = compactor.pause();
+
+        commitWriteShards();
+
+        ThreadPool tp;
+        tp.add(std::bind(&BaseMatrix::optimize, matrix.get()));
+        tp.add(std::bind(&BaseMatrix::optimize, inverse.get()));
+        tp.add(std::bind(&BaseMatrix::optimize, values.get()));
+        tp.waitForAll();
+
+        refreshDefaultTransaction();
+    }
+
+    /** Called by the compactor in the background to fold recent writes
+        together.  Nothing becomes readable that wasn't before.
+    */
+    void compact()
+    {
+        commitWriteShards();
+
+        for (auto & m: { matrix, inverse, values })
+            static_cast<MutableBaseMatrix &>(*m).compact();
+
+        refreshDefaultTransaction();
+    }
+
+    /** Make new readers see the current state of the matrices.  We don't
+        increment the epoch since logically it's exactly the same.
+    */
+    void refreshDefaultTransaction()
+    {
+        std::unique_lock<RootLock> guard(rootLock);
+        auto result = std::make_shared<ReadTransaction>();
+        result->matrix = matrix->startReadTransaction();
+        result->inverse = inverse->startReadTransaction();
+        result->values = values->startReadTransaction();
+        result->epoch = epoch;
+        setDefaultTransaction(std::move(result));
+    }
+
+    virtual Any getStatus() const override
+    {
+        Json::Value result
+            = SparseMatrixDataset::Itl::getStatus().convert<Json::Value>();
+        result["compaction"] = jsonEncode(compactor.getStats());
+        return result;
     }
 
     /** This is a recorder that is designed to have each thread record
@@ -1876,6 +2351,9 @@ struct MutableSparseMatrixDataset::Itl
             itl->commitWrites(trans);
         }
     };
+
+    // Last, so that the compactor has stopped before anything else goes
+    BackgroundCompactor compactor;
 };
 
 /** Live recordable and queryable sparse matrix dataset. */
@@ -1887,7 +2365,12 @@ MutableSparseMatrixDataset(MldbServer * owner,
     : SparseMatrixDataset(owner)
 {
     auto params = config.params.convert<MutableSparseMatrixDatasetConfig>();
-    itl.reset(new Itl(params.timeQuantumSeconds, params.consistencyLevel, params.favor));
+    itl.reset(new Itl(params.timeQuantumSeconds, params.consistencyLevel,
+                      params.favor, params.compaction));
+
+    // Nothing that's written can be read until it's committed
+    if (params.consistencyLevel == WT_READ_AFTER_COMMIT)
+        enableStatisticsCache();
 }
 
 Dataset::MultiChunkRecorder
@@ -11,6 +11,7 @@
 
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/core/dataset.h"
+#include "background_compactor.h"
 
 
 
@@ -68,6 +69,11 @@ struct SparseMatrixDataset: public Dataset {
 
     virtual ExpressionValue getRowExpr(const RowPath & rowName) const override;
 
+    /** Only decodes the values of the columns that the query needs. */
+    virtual ExpressionValue
+    getProjectedRowExpr(const RowPath & rowName,
+                        const std::vector<ColumnPath> & columns) const override;
+
 protected:
     struct Itl;
     std::shared_ptr<Itl> itl;
@@ -105,6 +111,9 @@ struct MutableSparseMatrixDatasetConfig
 
     /// Transaction favor.  When reads and writes are mixed, which do we favor?
     TransactionFavor favor;
+
+    /// When to fold recent writes together in the background
+    CompactionConfig compaction;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(MutableSparseMatrixDatasetConfig);
@@ -12,8 +12,11 @@
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/server/bound_queries.h"
 #include "mldb/sql/table_expression_operations.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/binding_contexts.h"
 #include "mldb/sql/join_utils.h"
 #include "mldb/sql/execution_pipeline.h"
 #include "mldb/arch/backtrace.h"
@@ -145,6 +148,8 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
                                                            SCHEMA_CLOSED));
         
 
+        initFastPath(*config.query.stm);
+
         switch (function->functionConfig.output) {
         case FIRST_ROW:
             // What type does the pipeline return?
@@ -167,6 +172,103 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
     {
     }
 
+    /** Look for a query of the form
+
+            SELECT ... FROM dataset WHERE rowName() = <expr>
+
+        where <expr> depends only upon the parameters, returning the first
+        row.  Such a query is a lookup of a single row, which we do
+        directly with the dataset's matrix view and the bound SELECT
+        expression instead of starting the pipeline for each call.
+    */
+    void initFastPath(const SelectStatement & stm)
+    {
+        if (function->functionConfig.output != FIRST_ROW)
+            return;
+        if (!stm.from || !stm.where || !stm.groupBy.empty()
+            || (stm.having && !stm.having->isConstantTrue())
+            || (stm.when.when && !stm.when.when->isConstantTrue())
+            || stm.offset != 0 || stm.limit == 0)
+            return;
+        // Aggregators make it a query over all of the matching rows
+        if (!stm.select.findAggregators(false /* withGroupBy */).empty())
+            return;
+        if (!dynamic_cast<const DatasetExpression *>(stm.from.get()))
+            return;
+
+        auto comparison
+            = dynamic_cast<const ComparisonExpression *>(stm.where.get());
+        if (!comparison || comparison->op != "=")
+            return;
+
+        auto getRowNameFunction = [&] (const SqlExpression & expr)
+            -> const FunctionCallExpression *
+            {
+                auto fn = dynamic_cast<const FunctionCallExpression *>(&expr);
+                if (!fn || !fn->args.empty()
+                    || (fn->functionName != "rowName"
+                        && fn->functionName != "rowPath")
+                    || (!fn->tableName.empty()
+                        && fn->tableName != stm.from->getAs()))
+                    return nullptr;
+                return fn;
+            };
+
+        const FunctionCallExpression * rowFunction
+            = getRowNameFunction(*comparison->lhs);
+        std::shared_ptr<SqlExpression> keyExpr = comparison->rhs;
+        if (!rowFunction) {
+            rowFunction = getRowNameFunction(*comparison->rhs);
+            keyExpr = comparison->lhs;
+        }
+        if (!rowFunction)
+            return;
+
+        auto unbound = keyExpr->getUnbound();
+        if (!unbound.vars.empty() || !unbound.tables.empty()
+            || !unbound.wildcards.empty())
+            return;
+
+        mldbScope.reset(new SqlExpressionMldbScope(function->server));
+        auto boundFrom = stm.from->bind(*mldbScope, nullptr /* onProgress */);
+        if (!boundFrom.dataset)
+            return;
+
+        paramScope.reset(new SqlExpressionParamScope(*mldbScope));
+        datasetScope.reset(new SqlExpressionDatasetScope(boundFrom));
+
+        fastFrom = boundFrom.dataset;
+        fastKeyIsRowName = rowFunction->functionName == "rowName";
+        fastKey = keyExpr->bind(*paramScope);
+        fastSelect = stm.select.bind(*datasetScope);
+    }
+
+    /** Apply a query that was recognized by initFastPath(). */
+    ExpressionValue applyFast(const BoundParameters & params) const
+    {
+        SqlExpressionParamScope::RowScope keyScope(params);
+        ExpressionValue key = fastKey(keyScope, GET_LATEST);
+        if (key.empty())
+            return ExpressionValue();
+
+        // Match the conversions done by Dataset::generateRowsWhere()
+        RowPath rowName;
+        if (fastKeyIsRowName)
+            rowName = RowPath::tryParse(key.toUtf8String()).first;
+        else rowName = key.coerceToPath();
+
+        if (!fastFrom->getMatrixView()->knownRow(rowName))
+            return ExpressionValue();
+
+        ExpressionValue row = fastFrom->getRowExpr(rowName);
+        auto rowScope = datasetScope->getRowScope(rowName, row, &params);
+        ExpressionValue storage;
+        const ExpressionValue & result = fastSelect(rowScope, storage, GET_ALL);
+        if (&result == &storage)
+            return std::move(storage);
+        return result;
+    }
+
     ExpressionValue apply(const ExpressionValue & context) const
     {
         // 1.  Run our generator, finding all rows
@@ -176,6 +278,9 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
                 return context.getColumn(name);
             };
 
+        if (fastFrom)
+            return applyFast(params);
+
         auto executor = boundPipeline->start(params);
 
         switch (function->functionConfig.output) {
@@ -195,7 +300,7 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
             return result;
         }
         case NAMED_COLUMNS:
-            std::vector<std::tuple<PathElement, ExpressionValue> > row;
+            StructValue row;
 
             ssize_t limit = function->functionConfig.query.stm->limit;
             ssize_t offset = function->functionConfig.query.stm->offset;
@@ -281,6 +386,16 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
     std::shared_ptr<Dataset> from;
     std::shared_ptr<PipelineElement> pipeline;
     std::shared_ptr<BoundPipelineElement> boundPipeline;
+
+    /// Single row lookups, set up by initFastPath().  fastFrom is null if the
+    /// query isn't a lookup.
+    std::unique_ptr<SqlExpressionMldbScope> mldbScope;
+    std::unique_ptr<SqlExpressionParamScope> paramScope;
+    std::unique_ptr<SqlExpressionDatasetScope> datasetScope;
+    std::shared_ptr<Dataset> fastFrom;
+    bool fastKeyIsRowName = false;
+    BoundSqlExpression fastKey;
+    BoundSqlExpression fastSelect;
 };
 
 std::unique_ptr<FunctionApplier>
@@ -430,7 +545,7 @@ getAutoInputName(SqlExpressionExtractScope & innerScope) const
 
 BoundSqlExpression
 SqlExpressionFunction::
-doBind(SqlExpressionExtractScope & innerScope) const
+doBind(SqlBindingScope & innerScope) const
 {
     if (functionConfig.raw) {
         // 1.  Grab the single SqlExpression that we need from the select
@@ -572,6 +687,220 @@ apply(const FunctionApplier & applier,
            .apply(context);
 }
 
+/** Scope used to bind the expression of an sql.expression function inline
+    into the expression that calls it.  Variables read the expressions of
+    the call's argument, which are bound in the calling scope, and rows are
+    evaluated in the caller's own row scope, so nothing needs to be packed
+    or unpacked per row.  Anything that can't be handled like that marks
+    the binding as failed, and the call is made through the applier.
+*/
+struct SqlExpressionInlineScope: public SqlBindingScope {
+
+    SqlExpressionInlineScope(SqlBindingScope & outer)
+        : outer(outer), autoInput(nullptr), failed(false)
+    {
+        this->functionStackDepth = outer.functionStackDepth + 1;
+    }
+
+    struct Input {
+        BoundSqlExpression bound;
+        bool duplicable;   ///< Cheap and safe to evaluate more than once
+        int numReads;      ///< Number of variables bound to read it
+    };
+
+    /// Scope of the calling expression
+    SqlBindingScope & outer;
+
+    /// Expressions of the argument, by their names
+    std::map<PathElement, Input> inputs;
+
+    /// With autoInput, the argument that the (only) variable reads
+    const Input * autoInput;
+
+    /// Set when something was bound that we can't inline
+    bool failed;
+
+    static Input getInput(const SqlExpression & expr,
+                          BoundSqlExpression bound)
+    {
+        bool duplicable = bound.info->isConst()
+            || expr.getType() == "variable"
+            || expr.getType() == "constant";
+        return { std::move(bound), duplicable, 0 };
+    }
+
+    ColumnGetter fail()
+    {
+        failed = true;
+        return {[=] (const SqlRowScope & scope,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    return storage = ExpressionValue();
+                },
+                std::make_shared<AnyValueInfo>()};
+    }
+
+    virtual ColumnGetter doGetColumn(const Utf8String & tableName,
+                                     const ColumnPath & columnName)
+    {
+        if (!tableName.empty() || columnName.empty())
+            return fail();
+
+        auto it = inputs.find(columnName[0]);
+        if (it == inputs.end() && autoInput && inputs.empty())
+            it = inputs.emplace(columnName[0], *autoInput).first;
+        if (it == inputs.end())
+            return fail();
+
+        ++it->second.numReads;
+        BoundSqlExpression bound = it->second.bound;
+
+        if (columnName.size() == 1) {
+            return {[=] (const SqlRowScope & scope,
+                         ExpressionValue & storage,
+                         const VariableFilter & filter)
+                    -> const ExpressionValue &
+                    {
+                        return bound(scope, storage, filter);
+                    },
+                    bound.info};
+        }
+
+        ColumnPath nested = columnName.removePrefix();
+        return {[=] (const SqlRowScope & scope,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    ExpressionValue valStorage;
+                    const ExpressionValue & val
+                        = bound(scope, valStorage, filter);
+                    return storage = val.getNestedColumn(nested, filter);
+                },
+                std::make_shared<AnyValueInfo>()};
+    }
+
+    virtual GetAllColumnsOutput
+    doGetAllColumns(const Utf8String & tableName,
+                    const ColumnFilter& keep)
+    {
+        failed = true;
+        GetAllColumnsOutput result;
+        result.exec = [] (const SqlRowScope & scope,
+                          const VariableFilter & filter)
+            {
+                return ExpressionValue();
+            };
+        result.info = std::make_shared<UnknownRowValueInfo>();
+        return result;
+    }
+
+    virtual BoundFunction
+    doGetFunction(const Utf8String & tableName,
+                  const Utf8String & functionName,
+                  const std::vector<BoundSqlExpression> & args,
+                  SqlBindingScope & argScope)
+    {
+        // Like the extract scope, functions come from the outer scope
+        return outer.doGetFunction(tableName, functionName, args, argScope);
+    }
+
+    virtual ColumnPath
+    doResolveTableName(const ColumnPath & fullVariableName,
+                       Utf8String & tableName) const
+    {
+        return outer.doResolveTableName(fullVariableName, tableName);
+    }
+
+    virtual MldbServer * getMldbServer() const
+    {
+        return outer.getMldbServer();
+    }
+};
+
+BoundSqlExpression
+SqlExpressionFunction::
+bindInline(SqlBindingScope & scope,
+           const std::shared_ptr<SqlExpression> & arg,
+           const BoundSqlExpression & boundArg) const
+{
+    // Inlining changes when and how often the expression is evaluated, so
+    // functions with hidden state or cached results are applied as normal
+    auto config = getConfigPtr();
+    if (!config || !config->deterministic || config->resultCacheBytes > 0)
+        return BoundSqlExpression();
+
+    // Aggregators in the argument can't be bound a second time
+    bool hasAggregator = false;
+    arg->traverse([&] (const SqlExpression & expr,
+                       const std::string & type,
+                       const Utf8String & operation,
+                       const std::vector<std::shared_ptr<SqlExpression> > &)
+                  {
+                      hasAggregator = hasAggregator || expr.isAggregator();
+                      return !hasAggregator;
+                  });
+    if (hasAggregator)
+        return BoundSqlExpression();
+
+    SqlExpressionInlineScope inlineScope(scope);
+    SqlExpressionInlineScope::Input autoInput;
+
+    if (functionConfig.autoInput) {
+        autoInput = SqlExpressionInlineScope::getInput(*arg, boundArg);
+        inlineScope.autoInput = &autoInput;
+    }
+    else {
+        // We need a literal row like { a: x, b: y } to know the expression
+        // behind each of the input's columns
+        auto within = std::dynamic_pointer_cast<SelectWithinExpression>(arg);
+        if (!within)
+            return BoundSqlExpression();
+
+        std::vector<std::shared_ptr<SqlRowExpression> > clauses;
+        auto select = std::dynamic_pointer_cast<SelectExpression>(within->select);
+        if (select)
+            clauses = select->clauses;
+        else clauses.push_back(within->select);
+
+        for (auto & c: clauses) {
+            auto named = std::dynamic_pointer_cast<NamedColumnExpression>(c);
+            if (!named || named->alias.size() != 1)
+                return BoundSqlExpression();
+            auto input = SqlExpressionInlineScope::getInput
+                (*named->expression, named->expression->bind(scope));
+            if (!inlineScope.inputs.emplace(named->alias[0],
+                                            std::move(input)).second)
+                return BoundSqlExpression();
+        }
+    }
+
+    BoundSqlExpression bound = doBind(inlineScope);
+    if (inlineScope.failed)
+        return BoundSqlExpression();
+
+    // Only expressions that are cheap and always give the same value may be
+    // evaluated more than once per call
+    for (auto & i: inlineScope.inputs) {
+        if (i.second.numReads > 1 && !i.second.duplicable)
+            return BoundSqlExpression();
+    }
+
+    // As when it's applied, the expression sees the latest values only
+    auto exec = bound.exec;
+    return {[=] (const SqlRowScope & row,
+                 ExpressionValue & storage,
+                 const VariableFilter & filter)
+            -> const ExpressionValue &
+            {
+                return exec(row, storage, GET_LATEST);
+            },
+            bound.expr.get(),
+            bound.info};
+}
+
 FunctionInfo
 SqlExpressionFunction::
 getFunctionInfo() const
@@ -623,7 +952,7 @@ regSqlExpressionFunction(builtinPackage(),
 
 TransformDatasetConfig::
 TransformDatasetConfig()
-    : skipEmptyRows(false)
+    : skipEmptyRows(false), maxRowsInFlight(-1)
 {
     outputDataset.withType("sparse.mutable");
 }
@@ -645,6 +974,17 @@ TransformDatasetConfigDescription()
     addField("skipEmptyRows", &TransformDatasetConfig::skipEmptyRows,
              "Skip rows from the input dataset where no values are selected",
              false);
+    addField("maxRowsInFlight", &TransformDatasetConfig::maxRowsInFlight,
+             "Maximum number of transformed rows that are held before "
+             "being passed to the output dataset.  Each thread records its "
+             "rows into its own chunk of the output dataset, and hands it "
+             "over to the dataset once it holds its share of this number "
+             "of rows.  When the query has no ORDER BY, OFFSET or LIMIT, "
+             "the input rows are also streamed rather than listed up front. "
+             "The default of -1 keeps a single chunk per thread until the "
+             "end of the transform.  Ignored for queries with GROUP BY or "
+             "aggregators.",
+             (ssize_t)-1);
     addParent<ProcedureConfig>();
 }
 
@@ -757,11 +1097,22 @@ run(const ProcedureRunConfig & run,
         Dataset::MultiChunkRecorder recorder
             = output->getChunkRecorder();
 
+        // Each thread hands over its chunk once it has this many rows, to
+        // bound the memory used by the rows not yet in the dataset
+        ssize_t maxRowsPerChunk = -1;
+        if (runProcConf.maxRowsInFlight > 0) {
+            maxRowsPerChunk
+                = std::max<ssize_t>(1, runProcConf.maxRowsInFlight / numCpus());
+        }
+
         struct ThreadAccum {
             /// Recorder object for this thread that the dataset gives us
             /// to record into the dataset.
             std::unique_ptr<Recorder> threadRecorder;
 
+            /// Number of rows recorded in threadRecorder
+            ssize_t rowsInChunk = 0;
+
             /// Special function to allow rapid insertion of fixed set of
             /// atom valued columns.  Only for isIdentitySelect.
             //std::function<void (RowPath rowName,
@@ -810,9 +1161,24 @@ run(const ProcedureRunConfig & run,
                 // and copying the existing rowPath in that case
                 threadAccum.threadRecorder->recordRowExprDestructive
                     (calc[0].coerceToPath(), std::move(row));
+
+                if (maxRowsPerChunk != -1
+                    && ++threadAccum.rowsInChunk >= maxRowsPerChunk) {
+                    threadAccum.threadRecorder->finishedChunk();
+                    threadAccum.threadRecorder.reset();
+                    threadAccum.rowsInChunk = 0;
+                }
                 return true;
             };
 
+        // Without an order or a range of rows, the rows can be streamed
+        // from the input in buckets rather than listed up front
+        const auto & stm = *runProcConf.inputData.stm;
+        int numBuckets = -1;
+        if (maxRowsPerChunk != -1 && stm.orderBy.clauses.empty()
+            && stm.offset == 0 && stm.limit == -1)
+            numBuckets = numCpus();
+
         DEBUG_MSG(logger) << "performing dataset transform";
    
         ConvertProgressToJson convertProgressToJson(onProgress);
@@ -822,7 +1188,8 @@ run(const ProcedureRunConfig & run,
                               runProcConf.inputData.stm->when,
                               *runProcConf.inputData.stm->where,
                               runProcConf.inputData.stm->orderBy,
-                              { runProcConf.inputData.stm->rowName })
+                              { runProcConf.inputData.stm->rowName },
+                              numBuckets)
             .executeExpr({recordRowInOutputDataset, true /*processInParallel*/},
                          runProcConf.inputData.stm->offset,
                          runProcConf.inputData.stm->limit,
@@ -838,9 +1205,10 @@ run(const ProcedureRunConfig & run,
         parallelMap(0, accum.threads.size(),
                     [&] (size_t n)
                     {
+                        // May have been handed over after the last row
                         auto & threadAccum = *accum.threads[n];
-                        ExcAssert(threadAccum.threadRecorder.get());
-                        threadAccum.threadRecorder->finishedChunk();
+                        if (threadAccum.threadRecorder)
+                            threadAccum.threadRecorder->finishedChunk();
                     });
     }
     else {
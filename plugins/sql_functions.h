@@ -99,6 +99,15 @@ struct SqlExpressionFunction: public Function {
 
     virtual FunctionInfo getFunctionInfo() const;
 
+    /** Calls made with a literal row argument, or with any argument when
+        autoInput is set, are bound directly into the calling expression
+        with each variable reading the argument's expression.
+    */
+    virtual BoundSqlExpression
+    bindInline(SqlBindingScope & scope,
+               const std::shared_ptr<SqlExpression> & arg,
+               const BoundSqlExpression & boundArg) const;
+
     SqlExpressionFunctionConfig functionConfig;
 
     std::unique_ptr<SqlExpressionMldbScope> outerScope;
@@ -107,7 +116,7 @@ struct SqlExpressionFunction: public Function {
     PathElement preparedAutoInputName;
     BoundSqlExpression bound;
 
-    BoundSqlExpression doBind(SqlExpressionExtractScope & innerScope) const;
+    BoundSqlExpression doBind(SqlBindingScope & innerScope) const;
 
     std::tuple<PathElement, std::vector<std::shared_ptr<ExpressionValueInfo> > >
     getAutoInputName(SqlExpressionExtractScope & innerScope) const;
@@ -135,6 +144,10 @@ struct TransformDatasetConfig : ProcedureConfig {
 
     /// Skip rows with no columns
     bool skipEmptyRows;
+
+    /// Maximum number of output rows held by the chunk recorders before
+    /// being passed to the output dataset.  -1 means no limit.
+    ssize_t maxRowsInFlight;
 };
 
 
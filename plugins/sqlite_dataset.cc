@@ -19,6 +19,7 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/utils/log.h"
+#include <map>
 
 using namespace std;
 
@@ -105,6 +106,20 @@ SqliteSparseDatasetConfigDescription()
 {
     addField("dataFileUrl", &SqliteSparseDatasetConfig::dataFileUrl,
              "URI (must be file://) under which the database data lives");
+    addField("mmapSize", &SqliteSparseDatasetConfig::mmapSize,
+             "Number of bytes of the database file that are read through "
+             "memory mapped I/O rather than read calls.  Zero turns off "
+             "memory mapping.",
+             (uint64_t)10000000000);
+    addField("rowsPerTransaction",
+             &SqliteSparseDatasetConfig::rowsPerTransaction,
+             "Number of rows recorded in one write transaction before it is "
+             "committed.  With the default of 1, each record call is "
+             "committed and visible immediately.  Larger values record "
+             "much faster, but rows are only visible to readers once "
+             "their transaction is committed, which also happens when "
+             "the dataset is committed.",
+             (uint64_t)1);
 }
 
 
@@ -120,6 +135,38 @@ struct SqliteSparseDataset::Itl
             : sqlite3pp::database(filename.empty() ? ("file::" + id + "?mode=memory&cache=shared").rawData() : filename.c_str())
         {
         }
+
+        /** Return the prepared query for the given SQL, reset so that it's
+            ready to be bound and run again.  Statements are kept for the
+            life of the connection, which is only used by one thread at a
+            time.
+        */
+        sqlite3pp::query & cachedQuery(const std::string & sql)
+        {
+            auto it = queries.find(sql);
+            if (it == queries.end()) {
+                it = queries.emplace(sql, nullptr).first;
+                it->second.reset(new sqlite3pp::query(*this, it->first.c_str()));
+            }
+            else it->second->reset();
+            return *it->second;
+        }
+
+        /// Same as cachedQuery(), for statements that return no rows
+        sqlite3pp::command & cachedCommand(const std::string & sql)
+        {
+            auto it = commands.find(sql);
+            if (it == commands.end()) {
+                it = commands.emplace(sql, nullptr).first;
+                it->second.reset(new sqlite3pp::command(*this, it->first.c_str()));
+            }
+            else it->second->reset();
+            return *it->second;
+        }
+
+        // These are destroyed before the database is closed
+        std::map<std::string, std::unique_ptr<sqlite3pp::query> > queries;
+        std::map<std::string, std::unique_ptr<sqlite3pp::command> > commands;
     };
 
     struct Connection: public std::unique_ptr<Database> {
@@ -139,11 +186,17 @@ struct SqliteSparseDataset::Itl
 
     };
 
-    Itl(const Url & url, const Utf8String & id,
-        shared_ptr<spdlog::logger> logger) : logger(logger)
+    Itl(const SqliteSparseDatasetConfig & config, const Utf8String & id,
+        shared_ptr<spdlog::logger> logger)
+        : logger(logger),
+          mmapSize(config.mmapSize),
+          rowsPerTransaction(std::max<uint64_t>(config.rowsPerTransaction, 1)),
+          rowsInTransaction(0)
     {
         initRoutes();
 
+        const Url & url = config.dataFileUrl;
+
         if (url.scheme() != "file" && !url.empty())
             throw HttpReturnException(400, "SQLite database requires file:// "
                                       "URI, passed '" + url.toUtf8String() + "'");
@@ -156,11 +209,19 @@ struct SqliteSparseDataset::Itl
 
     ~Itl()
     {
+        try {
+            commit();
+        } catch (const std::exception & exc) {
+            ERROR_MSG(logger) << "error committing sqlite dataset " << id
+                              << " on destruction: " << exc.what();
+        }
     }
 
     std::string filename;
     Utf8String id;
     shared_ptr<spdlog::logger> logger;
+    uint64_t mmapSize;
+    uint64_t rowsPerTransaction;
 
     RestRequestRouter router;
 
@@ -182,7 +243,9 @@ struct SqliteSparseDataset::Itl
 
     static void bindArg(sqlite3pp::statement & statement, int index, const RowPath & arg)
     {
-        int res = statement.bind(index, arg.toUtf8String().rawData());
+        // The name is a temporary, so sqlite needs to take a copy
+        int res = statement.bind(index, arg.toUtf8String().rawData(),
+                                 false /* static */);
         ExcAssertEqual(res, SQLITE_OK);
     }
 
@@ -287,7 +350,7 @@ struct SqliteSparseDataset::Itl
             INFO_MSG(logger) << explainQuery << "\n" << explanation;
         }
 
-        sqlite3pp::query query(*db, queryStr.c_str());
+        sqlite3pp::query & query = db->cachedQuery(queryStr);
 
         bindArgs(query, 1, std::forward<Args>(args)...);
 
@@ -442,54 +505,39 @@ struct SqliteSparseDataset::Itl
         return result;
     }
 
-    virtual int getRowNum(sqlite3pp::database & db, const RowPath & rowName)
+    int getRowNum(Database & db, const RowPath & rowName)
     {
         RowHash rowHash(rowName);
+        auto it = rowNumCache.find(rowHash);
+        if (it != rowNumCache.end())
+            return it->second;
+
         std::string rowNameStr = rowName.toUtf8String().rawString();
 
         {
-            sqlite3pp::command command(db,"INSERT OR IGNORE INTO rows VALUES (NULL, ?, ?)");
+            sqlite3pp::command & command
+                = db.cachedCommand("INSERT OR IGNORE INTO rows VALUES (NULL, ?, ?)");
             bindArg(command, 1, rowHash);
             bindArg(command, 2, rowNameStr.c_str());
             command.execute();
         }
 
-        //dumpQuery(db, "SELECT * FROM rows");
-
-
-        if (false) {
-            string explainQuery = "EXPLAIN QUERY PLAN SELECT rowNum FROM rows WHERE rowHash = ? LIMIT 1";
-
-            sqlite3pp::query query(db, explainQuery.c_str());
-            bindArgs(query, 1, rowHash);
-            
-            Json::Value explanation;
-
-            for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
-                Json::Value record;
-                for (int j = 0; j < query.column_count(); ++j) {
-                    const char * v = (*i).get<char const*>(j);
-                    record[query.column_name(j)] = v ? Json::Value(v) : Json::Value();
-                }
-                
-                explanation.append(record);
-            }
-
-            INFO_MSG(logger) << explainQuery << "\n" << explanation;
-        }
-
-
-
-        sqlite3pp::query query(db, "SELECT rowNum FROM rows WHERE rowHash = ? LIMIT 1");
+        int result = -1;
+        sqlite3pp::query & query
+            = db.cachedQuery("SELECT rowNum FROM rows WHERE rowHash = ? LIMIT 1");
         bindArg(query, 1, rowHash);
         for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
-            return (*i).get<int>(0);
+            result = (*i).get<int>(0);
         }
 
-        throw HttpReturnException(400, "Couldn't get a row number");
+        if (result == -1)
+            throw HttpReturnException(400, "Couldn't get a row number");
+
+        rowNumCache[rowHash] = result;
+        return result;
     }
 
-    virtual int getColNum(sqlite3pp::database & db, const ColumnPath & colName)
+    int getColNum(Database & db, const ColumnPath & colName)
     {
         ColumnHash colHash(colName);
         auto it = colNumCache.find(colHash);
@@ -499,23 +547,26 @@ struct SqliteSparseDataset::Itl
         std::string colNameStr = colName.toUtf8String().rawString();
         
         {
-            sqlite3pp::command command(db,"INSERT OR IGNORE INTO cols VALUES (NULL, ?, ?)");
+            sqlite3pp::command & command
+                = db.cachedCommand("INSERT OR IGNORE INTO cols VALUES (NULL, ?, ?)");
             bindArg(command, 1, colHash);
             bindArg(command, 2, colNameStr.c_str());
             command.execute();
         }
 
-        //dumpQuery(db, "SELECT * FROM cols");
-
-        sqlite3pp::query query(db, "SELECT colNum FROM cols WHERE colHash = ? AND colName = ? LIMIT 1");
+        int result = -1;
+        sqlite3pp::query & query
+            = db.cachedQuery("SELECT colNum FROM cols WHERE colHash = ? AND colName = ? LIMIT 1");
         bindArgs(query, 1, colHash, colNameStr.c_str());
         for (sqlite3pp::query::iterator i = query.begin(); i != query.end(); ++i) {
-            int result = (*i).get<int>(0);
-            colNumCache[colHash] = result;
-            return result;
+            result = (*i).get<int>(0);
         }
 
-        throw HttpReturnException(400, "Couldn't get a col number");
+        if (result == -1)
+            throw HttpReturnException(400, "Couldn't get a col number");
+
+        colNumCache[colHash] = result;
+        return result;
     }
     
     virtual void
@@ -525,42 +576,112 @@ struct SqliteSparseDataset::Itl
         recordRows({{rowName, vals}});
     }
     
-    virtual void recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows)
+    /// Number of values written by each multi-row insert into vals
+    static constexpr size_t VALS_PER_INSERT = 200;
+
+    /// Return the statement that inserts the given number of values
+    static std::string valsInsertSql(size_t numVals)
     {
-        std::unique_lock<std::mutex> guard(writeLock);
+        std::string result = "INSERT OR IGNORE INTO vals VALUES (?, ?, ?, ?)";
+        for (size_t i = 1;  i < numVals;  ++i)
+            result += ", (?, ?, ?, ?)";
+        return result;
+    }
 
-        auto db = getConnection();
+    /// A value waiting to be inserted into the vals table
+    struct PendingVal {
+        int rowNum;
+        int colNum;
+        sqlite_int64 ts;
+        std::string val;
+    };
 
-        sqlite3pp::transaction trans(*db);
+    /// Insert the given values, VALS_PER_INSERT at a time
+    void insertVals(Database & db, const std::vector<PendingVal> & vals)
+    {
+        static const std::string fullInsert = valsInsertSql(VALS_PER_INSERT);
+        static const std::string singleInsert = valsInsertSql(1);
 
-        sqlite3pp::command command(*db, "INSERT OR IGNORE INTO vals VALUES (?, ?, ?, ?)");
+        size_t done = 0;
+        while (done < vals.size()) {
+            size_t n = vals.size() - done >= VALS_PER_INSERT
+                ? VALS_PER_INSERT : 1;
 
-        for (auto & r: rows) {
+            sqlite3pp::command & command
+                = db.cachedCommand(n == 1 ? singleInsert : fullInsert);
+            auto binder = command.binder();
+            for (size_t i = done;  i < done + n;  ++i) {
+                binder << vals[i].rowNum << vals[i].colNum << vals[i].ts
+                       << vals[i].val.c_str();
+            }
 
-            const RowPath & rowName = r.first;
-            const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals = r.second;
-            
-            Dataset::validateNames(rowName, vals);
+            int res = command.execute();
+            if (res != SQLITE_OK)
+                throw HttpReturnException(500, "Error recording to sqlite dataset: "
+                                          + string(db.error_msg()));
+            done += n;
+        }
+    }
 
-            int rowNum = getRowNum(*db, rowName);
-            
-            for (auto & r: vals) {
-                int colNum = getColNum(*db, std::get<0>(r));
-                command.reset();
-            
-                std::string valStr = jsonEncodeUtf8(std::get<1>(r)).rawString();
+    /// Run a statement on the writer.  Must be called with the write lock held.
+    void writerCommand(const char * command)
+    {
+        int res = writer->execute(command);
+        if (res != SQLITE_OK)
+            throw HttpReturnException(500, "Error executing " + string(command)
+                                      + " on sqlite dataset: "
+                                      + writer->error_msg());
+    }
 
-                command.binder()
-                    << rowNum
-                    << colNum
-                    << sqlite_int64(encodeTs(std::get<2>(r)))
-                    << valStr.c_str();
+    virtual void recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows)
+    {
+        for (auto & r: rows)
+            Dataset::validateNames(r.first, r.second);
+
+        std::unique_lock<std::mutex> guard(writeLock);
+
+        if (rowsInTransaction == 0)
+            writerCommand("BEGIN IMMEDIATE");
 
-                command.execute();
+        try {
+            std::vector<PendingVal> vals;
+
+            for (auto & r: rows) {
+                int rowNum = getRowNum(*writer, r.first);
+            
+                for (auto & v: r.second) {
+                    int colNum = getColNum(*writer, std::get<0>(v));
+                    vals.push_back({ rowNum, colNum,
+                                     sqlite_int64(encodeTs(std::get<2>(v))),
+                                     jsonEncodeUtf8(std::get<1>(v)).rawString() });
+                }
             }
+
+            insertVals(*writer, vals);
+        } catch (...) {
+            // This also drops anything else recorded in the open
+            // transaction, along with the row and column numbers that it
+            // allocated
+            writer->execute("ROLLBACK");
+            rowsInTransaction = 0;
+            rowNumCache.clear();
+            colNumCache.clear();
+            throw;
         }
 
-        trans.commit();
+        rowsInTransaction += std::max<size_t>(rows.size(), 1);
+        if (rowsInTransaction >= rowsPerTransaction)
+            commitTransaction();
+    }
+
+    /// Commit the open write transaction, if any.  Must be called with the
+    /// write lock held.
+    void commitTransaction()
+    {
+        if (rowsInTransaction == 0)
+            return;
+        rowsInTransaction = 0;
+        writerCommand("COMMIT");
     }
 
     static int64_t encodeTs(Date ts)
@@ -575,7 +696,11 @@ struct SqliteSparseDataset::Itl
 
     virtual void commit()
     {
-        // Commits happen straight away; no need to do anything special here
+        // Rows are committed as their transaction fills up; here we commit
+        // whatever is left over
+        std::unique_lock<std::mutex> guard(writeLock);
+        if (writer)
+            commitTransaction();
     }
 
     virtual RestRequestMatchResult
@@ -603,7 +728,12 @@ struct SqliteSparseDataset::Itl
     {
         std::unique_lock<std::mutex> guard(writeLock);
 
-        auto db = getConnection();
+        // Writes all go through one connection, as sqlite only allows one
+        // writer at a time anyway.  This lets it keep a transaction open
+        // across calls and keep its row and column numbers cached.
+        writer.reset(new Database(filename, id));
+        initConnection(*writer);
+        Database * db = writer.get();
 
         auto doCommand = [&] (const std::string & command)
             {
@@ -646,6 +776,8 @@ struct SqliteSparseDataset::Itl
     // Protected by the write lock
     Lightweight_Hash<RowHash, int> rowNumCache;
     Lightweight_Hash<ColumnHash, int> colNumCache;
+    std::unique_ptr<Database> writer;
+    uint64_t rowsInTransaction;  ///< Rows recorded in the open transaction
 
     // Unfortunately...
     mutable std::mutex writeLock;
@@ -680,7 +812,12 @@ struct SqliteSparseDataset::Itl
         doCommand("PRAGMA synchronous=NORMAL");
         doCommand("PRAGMA locking_mode=NORMAL");
         doCommand("PRAGMA foreign_keys=ON");
-        doCommand("PRAGMA mmap_size=10000000000");
+        doCommand("PRAGMA mmap_size=" + std::to_string(mmapSize));
+
+        // In-memory databases share a cache rather than using the WAL, and
+        // readers would otherwise fail on the tables locked by the writer
+        if (filename.empty())
+            doCommand("PRAGMA read_uncommitted=1");
     }
 
     Connection getConnection() const
@@ -712,7 +849,7 @@ SqliteSparseDataset(MldbServer * owner,
 {
     if (!config.params.empty())
         datasetConfig = config.params.convert<SqliteSparseDatasetConfig>();
-    itl.reset(new Itl(datasetConfig.dataFileUrl, config.id,
+    itl.reset(new Itl(datasetConfig, config.id,
                       MLDB::getMldbLog<SqliteSparseDataset>()));
 }
     
@@ -747,7 +884,8 @@ void
 SqliteSparseDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    Dataset::commit();
 }
     
 std::pair<Date, Date>
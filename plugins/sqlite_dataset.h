@@ -23,10 +23,13 @@ namespace MLDB {
 
 struct SqliteSparseDatasetConfig {
     SqliteSparseDatasetConfig()
+        : mmapSize(10000000000), rowsPerTransaction(1)
     {
     }
 
     Url dataFileUrl;  /// must be file://
+    uint64_t mmapSize;  ///< Bytes of the file read through mmap
+    uint64_t rowsPerTransaction;  ///< Rows recorded before committing
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(SqliteSparseDatasetConfig);
@@ -29,6 +29,10 @@
 #include "mldb/base/parallel.h"
 #include "mldb/types/optional_description.h"
 #include "mldb/utils/log.h"
+#include "rolling_tables.h"
+#include "mldb/server/per_thread_accumulator.h"
+#include "mldb/base/thread_pool.h"
+#include <atomic>
 
 
 using namespace std;
@@ -246,8 +250,87 @@ run(const ProcedureRunConfig & run,
     int num_req = 0;
     Date start = Date::now();
 
-    // columns cache
-    map<ColumnPath, vector<ColumnPath>> colCache;
+    // Tables by index, and the names of the output columns of each
+    vector<StatsTable *> tables;
+    vector<vector<ColumnPath> > tableColNames;
+    std::unordered_map<ColumnPath, size_t> tableIndexes;
+    for (auto & st: statsTables) {
+        tableIndexes[st.first] = tables.size();
+        tables.push_back(&st.second);
+
+        vector<ColumnPath> names;
+        names.emplace_back(PathElement("trial") + st.first);
+        for (auto & outcomeName: outcome_names)
+            names.emplace_back(PathElement(outcomeName) + st.first);
+        tableColNames.emplace_back(std::move(names));
+    }
+
+    // The counts are updated in blocks of rows, with one thread per hash
+    // partition of the keys
+    RollingTables<StatsTable::BucketCounts>
+        rollingTables(tables.size(),
+                      make_pair(0, vector<int64_t>(outcome_names.size())));
+
+    struct BlockCell {
+        size_t table;
+        size_t entry;   ///< Index of the occurrence in the block
+        Date ts;
+    };
+
+    struct BlockRow {
+        RowPath rowName;
+        vector<uint> encodedLabels;
+        vector<BlockCell> cells;
+    };
+
+    static constexpr size_t ROWS_PER_BLOCK = 4096;
+    vector<BlockRow> blockRows;
+    vector<size_t> entryRows;  // row in the block of each occurrence
+    vector<int64_t> rowSeen(tables.size(), -1);
+
+    auto processBlock = [&] ()
+        {
+            // Counts for each occurrence, before it is counted
+            vector<StatsTable::BucketCounts> before(entryRows.size());
+
+            rollingTables.processBlock
+                ([&] (size_t entry, StatsTable::BucketCounts & counts)
+                 {
+                     before[entry] = counts;
+                     const auto & labels
+                         = blockRows[entryRows[entry]].encodedLabels;
+                     counts.first += 1;
+                     for (size_t i = 0;  i < labels.size();  ++i)
+                         counts.second[i] += labels[i];
+                 });
+
+            typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > Columns;
+            vector<pair<RowPath, Columns> > outputRows(blockRows.size());
+
+            auto doRow = [&] (size_t i)
+                {
+                    BlockRow & row = blockRows[i];
+                    Columns & output_cols = outputRows[i].second;
+                    outputRows[i].first = std::move(row.rowName);
+                    for (auto & cell: row.cells) {
+                        const auto & counts = before[cell.entry];
+                        const auto & colNames = tableColNames[cell.table];
+                        output_cols.emplace_back(colNames[0], counts.first,
+                                                 cell.ts);
+                        for (size_t j = 0;  j < counts.second.size();  ++j) {
+                            output_cols.emplace_back(colNames[j + 1],
+                                                     counts.second[j],
+                                                     cell.ts);
+                        }
+                    }
+                };
+
+            parallelMap(0, blockRows.size(), doRow);
+            output->recordRows(outputRows);
+
+            blockRows.clear();
+            entryRows.clear();
+        };
 
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
@@ -262,65 +345,35 @@ run(const ProcedureRunConfig & run,
                 INFO_MSG(logger) << message;
             }
 
-            vector<uint> encodedLabels;
+            int64_t rowIndex = num_req;
+            blockRows.emplace_back();
+            BlockRow & blockRow = blockRows.back();
+            blockRow.rowName = row.rowName;
+
             for(int lbl_idx=0; lbl_idx<runProcConf.outcomes.size(); lbl_idx++) {
                 CellValue outcome = extraVals.at(lbl_idx).getAtom();
-                encodedLabels.push_back( !outcome.empty() && outcome.isTrue() );
+                blockRow.encodedLabels.push_back( !outcome.empty() && outcome.isTrue() );
             }
 
-            map<ColumnPath, size_t> column_idx;
-            for(int i=0; i<row.columns.size(); i++) {
-                column_idx.insert(make_pair(get<0>(row.columns[i]), i));
-            }
-
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > output_cols;
-            for(auto it = statsTables.begin(); it != statsTables.end(); it++) {
-                // is this col present for row?
-                auto col_ptr = column_idx.find(it->first);
-                if(col_ptr == column_idx.end()) {
-                    // TODO handle unknowns
-                    //output_cols.emplace_back(get<0>(col), count, get<2>(col));
-                }
-                else {
-                    const tuple<ColumnPath, CellValue, Date> & col = row.columns[col_ptr->second];
-                    const StatsTable::BucketCounts & counts = it->second.increment(get<1>(col), encodedLabels);
-
-                    // *******
-                    // column name caching
-                    auto colIt = colCache.find(get<0>(col));
-                    vector<ColumnPath> * colNames;
-                    if(colIt != colCache.end()) {
-                        colNames = &(colIt->second);
-                    }
-                    else {
-                        // if we didn't compute the column names yet, do that now
-                        const Path & key = std::get<0>(col);
-
-                        vector<ColumnPath> names;
-                        names.emplace_back(PathElement("trial") + key);
-                        for(int lbl_idx=0; lbl_idx<encodedLabels.size(); lbl_idx++) {
-                            names.emplace_back(PathElement(outcome_names[lbl_idx]) + key);
-                        }
-
-                        auto inserted = colCache.emplace(get<0>(col), names);
-                        colNames = &((*(inserted.first)).second);
-                    }
-
-
-                    output_cols.emplace_back(colNames->at(0),
-                                             counts.first - 1,
-                                             get<2>(col));
-
-                    // add all outcomes
-                    for(int lbl_idx=0; lbl_idx<encodedLabels.size(); lbl_idx++) {
-                        output_cols.emplace_back(colNames->at(lbl_idx+1),
-                                                 counts.second[lbl_idx] - encodedLabels[lbl_idx],
-                                                 get<2>(col));
-                    }
-                }
+            for (auto & col: row.columns) {
+                auto it = tableIndexes.find(get<0>(col));
+                // TODO handle unknowns
+                if (it == tableIndexes.end())
+                    continue;
+
+                // Only the first value of a column in the row is counted
+                size_t table = it->second;
+                if (rowSeen[table] == rowIndex)
+                    continue;
+                rowSeen[table] = rowIndex;
+
+                size_t entry = rollingTables.add(table, get<1>(col).toUtf8String());
+                entryRows.push_back(blockRows.size() - 1);
+                blockRow.cells.push_back({table, entry, get<2>(col)});
             }
 
-            output->recordRow(ColumnPath(row.rowName), output_cols);
+            if (blockRows.size() >= ROWS_PER_BLOCK)
+                processBlock();
 
             return true;
         };
@@ -342,6 +395,14 @@ run(const ProcedureRunConfig & run,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit);
 
+    processBlock();
+
+    rollingTables.finish([&] (size_t table,
+                              std::unordered_map<Utf8String, StatsTable::BucketCounts> && counts)
+                         {
+                             tables[table]->counts = std::move(counts);
+                         });
+
     output->commit();
 
     // save if required
@@ -686,16 +747,30 @@ run(const ProcedureRunConfig & run,
             return onProgress(value);
         };
 
-    int num_req = 0;
+    std::atomic<int> num_req(0);
     Date start = Date::now();
 
+    // Only the final counts are needed, so the rows are processed in
+    // parallel.  Each thread counts into its own maps, one per hash
+    // partition of the words, and partition i of every thread is merged
+    // together at the end.
+    typedef std::unordered_map<Utf8String, StatsTable::BucketCounts> Counts;
+    const size_t numPartitions = 4 * numCpus();
+    auto hashPartition = [&] (const Utf8String & word)
+        {
+            return std::hash<Utf8String>()(word) % numPartitions;
+        };
+
+    PerThreadAccumulator<vector<Counts> > threadCounts;
+
     auto processor = [&] (NamedRowValue & row_,
                            const std::vector<ExpressionValue> & extraVals)
         {
             MatrixNamedRow row = row_.flattenDestructive();
-            if(num_req++ % PROGRESS_RATE_LOW == 0) {
+            int req = num_req++;
+            if(req % PROGRESS_RATE_LOW == 0) {
                 double secs = Date::now().secondsSinceEpoch() - start.secondsSinceEpoch();
-                string message = MLDB::format("done %d. %0.4f/sec", num_req, num_req / secs);
+                string message = MLDB::format("done %d. %0.4f/sec", req, req / secs);
                 Json::Value progress;
                 progress["message"] = message;
                 onProgress2(progress);
@@ -708,8 +783,23 @@ run(const ProcedureRunConfig & run,
                 encodedLabels.push_back( !outcome.empty() && outcome.isTrue() );
             }
 
+            vector<Counts> & partitions = threadCounts.get();
+            if (partitions.empty())
+                partitions.resize(numPartitions);
+
             for(const std::tuple<ColumnPath, CellValue, Date> & col : row.columns) {
-                statsTable.increment(CellValue(get<0>(col).toUtf8String()), encodedLabels);
+                Utf8String word = get<0>(col).toUtf8String();
+                Counts & counts = partitions[hashPartition(word)];
+                auto it = counts.find(word);
+                if (it == counts.end()) {
+                    counts.emplace(std::move(word),
+                                   make_pair(1, vector<int64_t>(encodedLabels.begin(),
+                                                                encodedLabels.end())));
+                    continue;
+                }
+                it->second.first += 1;
+                for (size_t i = 0;  i < encodedLabels.size();  ++i)
+                    it->second.second[i] += encodedLabels[i];
             }
 
             return true;
@@ -726,11 +816,48 @@ run(const ProcedureRunConfig & run,
                    runProcConf.trainingData.stm->when,
                    *runProcConf.trainingData.stm->where,
                    extra,
-                   {processor,false/*processInParallel*/},
+                   {processor,true/*processInParallel*/},
                    runProcConf.trainingData.stm->orderBy,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit);
 
+    // Merge each partition over all of the threads
+    vector<vector<Counts> *> allThreads;
+    threadCounts.forEach([&] (vector<Counts> * partitions)
+                         {
+                             allThreads.push_back(partitions);
+                         });
+
+    vector<Counts> merged(numPartitions);
+    auto mergePartition = [&] (size_t p)
+        {
+            Counts & result = merged[p];
+            for (auto * partitions: allThreads) {
+                for (auto & entry: (*partitions)[p]) {
+                    auto it = result.find(entry.first);
+                    if (it == result.end()) {
+                        result.emplace(entry.first, std::move(entry.second));
+                        continue;
+                    }
+                    it->second.first += entry.second.first;
+                    for (size_t i = 0;  i < it->second.second.size();  ++i)
+                        it->second.second[i] += entry.second.second[i];
+                }
+                Counts().swap((*partitions)[p]);
+            }
+        };
+    parallelMap(0, numPartitions, mergePartition);
+
+    size_t numWords = 0;
+    for (auto & counts: merged)
+        numWords += counts.size();
+    statsTable.counts.reserve(numWords);
+    for (auto & counts: merged) {
+        for (auto & entry: counts)
+            statsTable.counts.emplace(entry.first, std::move(entry.second));
+        Counts().swap(counts);
+    }
+
     // Optionally save counts to a dataset
     if (runProcConf.outputDataset) {
         Date date0;
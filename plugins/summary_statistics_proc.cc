@@ -18,11 +18,13 @@
 #include "mldb/types/any_impl.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/types/date.h"
-#include "mldb/sql/sql_expression.h"
+#include "mldb/sql/sketches.h"
 #include "mldb/plugins/sql_config_validator.h"
 #include "mldb/utils/log.h"
 #include "mldb/utils/progress.h"
 #include <memory>
+#include <unordered_map>
+#include <cmath>
 
 
 using namespace std;
@@ -140,286 +142,251 @@ struct MostFrequents {
     }
 };
 
-// Simple handlers to enhance the lisibility of the run function.
-struct NumericRowHandler {
-    NumericRowHandler() = delete;
-    NumericRowHandler(BoundTableExpression & boundDataset,
-                      SummaryStatisticsProcedureConfig & config,
-                      shared_ptr<Dataset> output,
-                      Date now,
-                      const std::function<bool (const Json::Value &)> & onProgress)
-        : first(true), boundDataset(boundDataset), config(config),
-          output(output), now(now), onProgress(onProgress) {}
-
-    const int AVG_IDX = 0;
-    const int MAX_IDX = 1;
-    const int MIN_IDX = 2;
-    const int NUM_NOT_NULL_IDX = 3;
-    const int NUM_NULL_IDX = 4;
-    const int NUM_UNIQUE_IDX = 5;
-    const int STDDEV_IDX = 6;
-
-    bool first;
-    BoundTableExpression & boundDataset;
-    SummaryStatisticsProcedureConfig & config;
-    shared_ptr<Dataset> output;
-    Date now;
-    std::function<bool (const Json::Value &)> onProgress;
-
-    // Returns false if the column failed to be treated as numeric
-    bool recordStatsForColumn(const Utf8String & name, const Path & rowName) {
-
-        int64_t numNotNull = 0;
-        bool isNumeric = false;
-        ColumnPath value("value");
-        auto onRow = [&] (NamedRowValue & row) {
-
-            // If the data is categorical, we don't even reach this point
-
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                // Checks on the first row if the expected order is correct
-                ExcAssert(std::get<0>(cols[AVG_IDX]).toUtf8String() == "avg");
-                ExcAssert(std::get<0>(cols[MAX_IDX]).toUtf8String() == "max");
-                ExcAssert(std::get<0>(cols[MIN_IDX]).toUtf8String() == "min");
-                ExcAssert(std::get<0>(cols[NUM_NOT_NULL_IDX]).toUtf8String() == "num_not_null");
-                ExcAssert(std::get<0>(cols[NUM_NULL_IDX]).toUtf8String() == "num_null");
-                ExcAssert(std::get<0>(cols[NUM_UNIQUE_IDX]).toUtf8String() == "num_unique");
-                ExcAssert(std::get<0>(cols[STDDEV_IDX]).toUtf8String() == "stddev");
+/** Statistics of a single column, accumulated over the rows seen by one
+    thread and then merged together, so that every column is done in the
+    same pass over the input.
+
+    The value counts are kept exactly until there are more than MAX_EXACT
+    distinct values; the statistics are then the same as those evaluated
+    by SQL.  After that the counts are replaced by sketches: a HyperLogLog
+    for the number of unique values, a t-digest for the quartiles and a
+    Misra-Gries summary with NUM_COUNTERS counters for the most frequent
+    items.  The moments are always exact.
+*/
+struct ColumnSummary {
+    static constexpr size_t MAX_EXACT = 10000;
+    static constexpr size_t NUM_COUNTERS = 1000;
+
+    int64_t numNotNull = 0;
+    bool numeric = true;         ///< All non-null values are numbers
+
+    // Moments of the values, for numeric columns
+    double sum = 0;
+    double mean = 0;
+    double m2 = 0;               ///< Sum of squared differences from mean
+    double min = INFINITY;
+    double max = -INFINITY;
+
+    /// Exact counts, or the Misra-Gries counters once we have sketches
+    std::unordered_map<CellValue, int64_t> counts;
+    bool exact = true;
+    HyperLogLog distinct;
+    TDigest digest;
+
+    void add(const CellValue & val)
+    {
+        ++numNotNull;
+        if (val.isNumber()) {
+            double d = val.toDouble();
+            sum += d;
+            double delta = d - mean;
+            mean += delta / numNotNull;
+            m2 += delta * (d - mean);
+            min = std::min(min, d);
+            max = std::max(max, d);
+        }
+        else numeric = false;
 
-            }
+        if (exact) {
+            ++counts[val];
+            if (counts.size() > MAX_EXACT)
+                toSketches();
+        }
+        else addToSketches(val, 1);
+    }
 
-            vector<Cell> toRecord;
-            if (!std::get<1>(cols[MAX_IDX]).isNumber()) {
-                // If the column is empty, we reach this point (max is null)
-                auto theThing = std::get<1>(cols[MAX_IDX]);
-                return false;
-            }
-            isNumeric = true;
-            toRecord.emplace_back(value + "avg", std::get<1>(cols[AVG_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "max", std::get<1>(cols[MAX_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "min", std::get<1>(cols[MIN_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "num_null", std::get<1>(cols[NUM_NULL_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "num_unique", std::get<1>(cols[NUM_UNIQUE_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "stddev", std::get<1>(cols[STDDEV_IDX]).toDouble(), now);
-            toRecord.emplace_back(value + "data_type", "number", now);
-            output->recordRow(rowName, toRecord);
-            numNotNull = std::get<1>(cols[NUM_NOT_NULL_IDX]).toInt();
+    void merge(ColumnSummary & other)
+    {
+        if (other.numNotNull == 0)
+            return;
 
-            return true;
-        };
+        int64_t n = numNotNull + other.numNotNull;
+        double delta = other.mean - mean;
+        m2 += other.m2 + delta * delta * numNotNull * other.numNotNull / n;
+        mean += delta * other.numNotNull / n;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        numNotNull = n;
+        numeric = numeric && other.numeric;
+
+        if (exact && other.exact) {
+            for (auto & c: other.counts)
+                counts[c.first] += c.second;
+            if (counts.size() > MAX_EXACT)
+                toSketches();
+            return;
+        }
 
-        auto select = SelectExpression::parse(
-            "count_distinct(" + name + ") AS num_unique, "
-            "min(" + name + ") AS min, "
-            "max(" + name + ") AS max, "
-            "avg(" + name + ") AS avg, "
-            "sum(" + name + " IS NULL) AS num_null, "
-            "sum(" + name + " IS NOT NULL) AS num_not_null, "
-            "stddev(" + name + ") AS stddev"
-        );
-        vector<shared_ptr<SqlExpression>> aggregators =
-            select.findAggregators(!config.inputData.stm->groupBy.clauses.empty());
-
-        try {
-            // The first query is used to determine whether it's numeric or
-            // not, hence the special try/catch/failedProcessingQuery handling.
-            ConvertProgressToJson convertProgressToJson(onProgress);
-            BoundGroupByQuery(select,
-                              *boundDataset.dataset,
-                              boundDataset.asName,
-                              config.inputData.stm->when,
-                              *config.inputData.stm->where,
-                              config.inputData.stm->groupBy,
-                              aggregators,
-                              *config.inputData.stm->having,
-                              *config.inputData.stm->rowName,
-                              config.inputData.stm->orderBy)
-                .execute({onRow, false /*processInParallel*/},
-                         0, // offset
-                         -1, // limit
-                         convertProgressToJson);
+        if (exact)
+            toSketches();
+
+        if (other.exact) {
+            for (auto & c: other.counts)
+                addToSketches(c.first, c.second);
+            return;
         }
-        catch (const MLDB::Exception & exc) {
-            if (!isNumeric) {
-                // Categorical, the query doesn't work
-                return false;
-            }
-            throw;
+
+        distinct.merge(other.distinct);
+        digest.merge(other.digest);
+        for (auto & c: other.counts)
+            counts[c.first] += c.second;
+        pruneCounters();
+    }
+
+    void toSketches()
+    {
+        for (auto & c: counts) {
+            distinct.add(c.first.hash());
+            if (c.first.isNumber())
+                digest.add(c.first.toDouble(), c.second);
         }
-        if (!isNumeric) {
-            // empty col
-            return false;
+        exact = false;
+        pruneCounters();
+    }
+
+    void addToSketches(const CellValue & val, int64_t count)
+    {
+        distinct.add(val.hash());
+        if (val.isNumber())
+            digest.add(val.toDouble(), count);
+        counts[val] += count;
+        if (counts.size() > 2 * NUM_COUNTERS)
+            pruneCounters();
+    }
+
+    /** Keep only the NUM_COUNTERS largest counters, subtracting the next
+        largest count from each of them.  This is the merge step of a
+        Misra-Gries summary, and keeps each count within numNotNull /
+        NUM_COUNTERS of its real value.
+    */
+    void pruneCounters()
+    {
+        if (counts.size() <= NUM_COUNTERS)
+            return;
+
+        std::vector<int64_t> sorted;
+        sorted.reserve(counts.size());
+        for (auto & c: counts)
+            sorted.push_back(c.second);
+        std::nth_element(sorted.begin(), sorted.begin() + NUM_COUNTERS,
+                         sorted.end(), std::greater<int64_t>());
+        int64_t cutoff = sorted[NUM_COUNTERS];
+
+        for (auto it = counts.begin();  it != counts.end();) {
+            it->second -= cutoff;
+            if (it->second <= 0)
+                it = counts.erase(it);
+            else ++it;
         }
+    }
 
-        select = SelectExpression::parse("count(" + name + ") AS _0, "
-                                         + name + " AS _1");
-        auto groupBy = TupleExpression::parse(name);
-        auto orderBy = OrderByExpression::parse(name);
-        auto where = SqlExpression::parse(name + " IS NOT NULL");
-        const int NUM_QUARTILES = 3;
-        double quartiles[NUM_QUARTILES];
-        double quartilesThreshold[NUM_QUARTILES] = {numNotNull * 0.25,
-                                                    numNotNull * 0.5,
-                                                    numNotNull * 0.75};
+    int64_t numUnique()
+    {
+        return exact ? counts.size() : distinct.estimate();
+    }
+
+    /** Fill in the quartiles.  In exact mode, each is the first value at
+        which the running count goes over the quartile's share of the
+        values.
+    */
+    void getQuartiles(double quartiles[3])
+    {
+        if (!exact) {
+            quartiles[0] = digest.quantile(0.25);
+            quartiles[1] = digest.quantile(0.5);
+            quartiles[2] = digest.quantile(0.75);
+            return;
+        }
+
+        std::vector<std::pair<double, int64_t> > sorted;
+        sorted.reserve(counts.size());
+        for (auto & c: counts)
+            sorted.emplace_back(c.first.toDouble(), c.second);
+        std::sort(sorted.begin(), sorted.end());
+
+        double thresholds[3] = { numNotNull * 0.25,
+                                 numNotNull * 0.5,
+                                 numNotNull * 0.75 };
         int idx = 0;
         int64_t count = 0;
-        MostFrequents<double, 10> mostFrequents; // Keep top 10
-        auto onRow2 = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                ExcAssert(std::get<0>(cols[0]).toUtf8String() == "_0");
-                ExcAssert(std::get<0>(cols[1]).toUtf8String() == "_1");
-                first = false;
-            }
-            int64_t currentCount = std::get<1>(cols[0]).toInt();
-            mostFrequents.addItem(make_pair(currentCount,
-                                            std::get<1>(cols[1]).toDouble()));
-            count += currentCount;
-            while (idx < NUM_QUARTILES && quartilesThreshold[idx] < count) {
-                quartiles[idx] = std::get<1>(cols[1]).toDouble();
-                ++idx;
-            }
-            return true;
-        };
-        ConvertProgressToJson convertProgressToJson(onProgress);
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *where,
-                        groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        orderBy)
-            .execute({onRow2, false /*processInParallel*/},
-                     0, // offset
-                     -1, // limit
-                     convertProgressToJson);
-        ExcAssert(count == numNotNull);
-        ExcAssert(idx == NUM_QUARTILES);
-        vector<Cell> toRecord;
-        toRecord.emplace_back(value + "1st_quartile", quartiles[0], now);
-        toRecord.emplace_back(value + "median", quartiles[1], now);
-        toRecord.emplace_back(value + "3rd_quartile", quartiles[2], now);
-        for (int i = 0; i < mostFrequents.currSize; ++ i) {
-            toRecord.emplace_back(
-                // CellValue::to_string returns "1" instead of "1.00000"
-                value + "most_frequent_items" + to_string(CellValue(mostFrequents.top[i].second)),
-                mostFrequents.top[i].first, now);
+        for (auto & s: sorted) {
+            count += s.second;
+            while (idx < 3 && thresholds[idx] < count)
+                quartiles[idx++] = s.first;
         }
-        output->recordRow(rowName, toRecord);
-        return true;
+        ExcAssert(idx == 3);
     }
-
 };
 
-struct CategoricalRowHandler {
-    CategoricalRowHandler() = delete;
-    CategoricalRowHandler(BoundTableExpression & boundDataset,
-                          SummaryStatisticsProcedureConfig & config,
-                          shared_ptr<Dataset> output,
-                          Date now,
-                          const std::function<bool (const Json::Value &)> & onProgress)
-        : first(true), boundDataset(boundDataset), config(config),
-          output(output), now(now), onProgress(onProgress) {}
-
-    const int NUM_NULL_IDX = 0;
-    const int NUM_UNIQUE_IDX = 1;
-
-    bool first;
-    BoundTableExpression & boundDataset;
-    SummaryStatisticsProcedureConfig & config;
-    shared_ptr<Dataset> output;
-    Date now;
-    std::function<bool (const Json::Value &)> onProgress;
-
-    void recordStatsForColumn(const Utf8String & name, const Path & rowName) {
-        ColumnPath value("value");
-        auto onRow = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                // Checks on the first row if the expected order is correct
-                ExcAssert(std::get<0>(cols[NUM_NULL_IDX]).toUtf8String() == "num_null");
-                ExcAssert(std::get<0>(cols[NUM_UNIQUE_IDX]).toUtf8String() == "num_unique");
-            }
-            vector<Cell> toRecord;
-            toRecord.emplace_back(value + "data_type", "categorical", now);
-            toRecord.emplace_back(value + "num_null", std::get<1>(cols[NUM_NULL_IDX]).toInt(), now);
-            toRecord.emplace_back(value + "num_unique", std::get<1>(cols[NUM_UNIQUE_IDX]).toInt(), now);
-            output->recordRow(rowName, toRecord);
-            return true;
-        };
+constexpr size_t ColumnSummary::MAX_EXACT;
+constexpr size_t ColumnSummary::NUM_COUNTERS;
 
-        auto select = SelectExpression::parse(
-            "count_distinct(" + name + ") AS num_unique, "
-            "sum(" + name + " IS NULL) AS num_null"
-        );
-        vector<shared_ptr<SqlExpression>> aggregators =
-            select.findAggregators(!config.inputData.stm->groupBy.clauses.empty());
-
-        ConvertProgressToJson convertProgressToJson(onProgress);
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *config.inputData.stm->where,
-                        config.inputData.stm->groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        config.inputData.stm->orderBy)
-            .execute({onRow, false /*processInParallel*/},
-                     0, // offset
-                     -1, // limit
-                    convertProgressToJson);
+/// Statistics of all of the columns over the rows seen by one thread
+struct ThreadStats {
+    int64_t numRows = 0;
+    std::vector<ColumnSummary> columns;
+};
 
-        select = SelectExpression::parse("count(" + name + ") AS _0, "
-                                         + name + " AS _1");
-        auto groupBy = TupleExpression::parse(name);
-        auto orderBy = OrderByExpression::parse("_0 DESC");
+static void
+recordColumnStats(Dataset & output,
+                  const Path & rowName,
+                  ColumnSummary & stats,
+                  int64_t numRows,
+                  Date now)
+{
+    ColumnPath value("value");
+    vector<Cell> toRecord;
+    int64_t numNull = numRows - stats.numNotNull;
+
+    // Empty columns are considered categorical
+    if (stats.numNotNull == 0 || !stats.numeric) {
+        toRecord.emplace_back(value + "data_type", "categorical", now);
+        toRecord.emplace_back(value + "num_null", numNull, now);
+        toRecord.emplace_back(value + "num_unique", stats.numUnique(), now);
 
         MostFrequents<Utf8String, 10> mostFrequents; // Keep top 10
-        auto onRow2 = [&] (NamedRowValue & row) {
-            const auto & cols = row.columns;
-            if (MLDB_UNLIKELY(first)) {
-                ExcAssert(std::get<0>(cols[0]).toUtf8String() == "_0");
-                ExcAssert(std::get<0>(cols[1]).toUtf8String() == "_1");
-            }
-            if (MLDB_UNLIKELY(std::get<1>(cols[1]).empty())) {
-                // skipp null
-                return true;
-            }
-            mostFrequents.addItem(make_pair(std::get<1>(cols[0]).toInt(),
-                                            std::get<1>(cols[1]).toUtf8String()));
-            return true;
-        };
-        BoundGroupByQuery(select,
-                        *boundDataset.dataset,
-                        boundDataset.asName,
-                        config.inputData.stm->when,
-                        *config.inputData.stm->where,
-                        groupBy,
-                        aggregators,
-                        *config.inputData.stm->having,
-                        *config.inputData.stm->rowName,
-                        orderBy)
-            .execute({onRow2, false /*processInParallel*/},
-                    0, // offset
-                    -1, // limit
-                    convertProgressToJson);
-        vector<Cell> toRecord;
+        for (auto & c: stats.counts) {
+            mostFrequents.addItem(make_pair(c.second,
+                                            c.first.toUtf8String()));
+        }
         for (int i = 0; i < mostFrequents.currSize; ++ i) {
             toRecord.emplace_back(
                 value + "most_frequent_items" + mostFrequents.top[i].second,
                 mostFrequents.top[i].first,
                 now);
         }
-        output->recordRow(rowName, toRecord);
-        first = false;
+        output.recordRow(rowName, toRecord);
+        return;
     }
-};
+
+    double quartiles[3];
+    stats.getQuartiles(quartiles);
+
+    toRecord.emplace_back(value + "avg", stats.sum / stats.numNotNull, now);
+    toRecord.emplace_back(value + "max", stats.max, now);
+    toRecord.emplace_back(value + "min", stats.min, now);
+    toRecord.emplace_back(value + "num_null", numNull, now);
+    toRecord.emplace_back(value + "num_unique", stats.numUnique(), now);
+    // Sample standard deviation, which is NaN for a single value
+    toRecord.emplace_back(value + "stddev",
+                          sqrt(stats.m2 / (stats.numNotNull - 1)), now);
+    toRecord.emplace_back(value + "data_type", "number", now);
+    toRecord.emplace_back(value + "1st_quartile", quartiles[0], now);
+    toRecord.emplace_back(value + "median", quartiles[1], now);
+    toRecord.emplace_back(value + "3rd_quartile", quartiles[2], now);
+
+    MostFrequents<double, 10> mostFrequents; // Keep top 10
+    for (auto & c: stats.counts)
+        mostFrequents.addItem(make_pair(c.second, c.first.toDouble()));
+    for (int i = 0; i < mostFrequents.currSize; ++ i) {
+        toRecord.emplace_back(
+            // CellValue::to_string returns "1" instead of "1.00000"
+            value + "most_frequent_items" + to_string(CellValue(mostFrequents.top[i].second)),
+            mostFrequents.top[i].first, now);
+    }
+    output.recordRow(rowName, toRecord);
+}
 
 RunOutput
 SummaryStatisticsProcedure::
@@ -427,79 +394,85 @@ run(const ProcedureRunConfig & run,
     const std::function<bool (const Json::Value &)> & onProgress) const
 {
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
-    Progress bucketizeProgress;
-    std::shared_ptr<Step> iterationStep = bucketizeProgress.steps({
-        make_pair("iterating", "percentile"),
-    });
 
     SqlExpressionMldbScope context(server);
 
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.inputData.stm->from->bind(context, convertProgressToJson);
 
-    vector<shared_ptr<SqlExpression> > calc;
+    // The order of the rows doesn't matter for the statistics, so we don't
+    // pass the ORDER BY clause, which allows the rows to be processed in
+    // parallel.
+    OrderByExpression noOrderBy;
+    BoundSelectQuery bsq(runProcConf.inputData.stm->select,
+                         *boundDataset.dataset,
+                         boundDataset.asName,
+                         runProcConf.inputData.stm->when,
+                         *runProcConf.inputData.stm->where,
+                         noOrderBy,
+                         {} /* calc */);
+
+    // Each output column of the query becomes a row of the output, even
+    // if it has no values
+    std::vector<ColumnPath> columnNames
+        = bsq.getSelectOutputInfo()->allColumnNames();
+    std::unordered_map<ColumnPath, size_t> columnIndexes;
+    for (size_t i = 0;  i < columnNames.size();  ++i)
+        columnIndexes.emplace(columnNames[i], i);
+
+    PerThreadAccumulator<ThreadStats> accum;
+
+    auto onRow = [&] (RowPath & rowName,
+                      ExpressionValue & val,
+                      std::vector<ExpressionValue> & calcd)
+        {
+            ThreadStats & stats = accum.get();
+            if (MLDB_UNLIKELY(stats.columns.empty()))
+                stats.columns.resize(columnNames.size());
+            ++stats.numRows;
+
+            ExpressionValue storage;
+            const ExpressionValue & latest = val.getFiltered(GET_LATEST,
+                                                             storage);
+
+            auto onAtom = [&] (const Path & columnName,
+                               const Path & prefix,
+                               const CellValue & val,
+                               Date ts)
+                {
+                    if (val.empty())
+                        return true;
+                    auto it = columnIndexes.find(prefix + columnName);
+                    if (it != columnIndexes.end())
+                        stats.columns[it->second].add(val);
+                    return true;
+                };
+
+            latest.forEachAtom(onAtom);
+            return true;
+        };
 
-    for (auto & c: runProcConf.inputData.stm->orderBy.clauses) {
-        auto whenClause = std::make_shared<FunctionCallExpression>
-            ("" /* tableName */, "latest_timestamp",
-             vector<shared_ptr<SqlExpression> >(1, c.first));
-        calc.emplace_back(whenClause);
-    }
+    bsq.executeExpr({onRow, true /*processInParallel*/},
+                    0, // offset
+                    -1, // limit
+                    convertProgressToJson);
 
-    int num = 0;
-    float denum = 0;
-    {
-        BoundSelectQuery bsq(runProcConf.inputData.stm->select,
-                             *boundDataset.dataset,
-                             boundDataset.asName,
-                             runProcConf.inputData.stm->when,
-                             *runProcConf.inputData.stm->where,
-                             runProcConf.inputData.stm->orderBy,
-                             calc);
-        denum = bsq.getSelectOutputInfo()->allColumnNames().size();
-    }
-    auto onProgress2 = [&](const Json::Value & progress) {
-        Json::Value v;
-        v["percent"] = num / denum;
-        return onProgress(progress);
-    };
+    ThreadStats total;
+    total.columns.resize(columnNames.size());
+    accum.forEach([&] (ThreadStats * stats)
+                  {
+                      total.numRows += stats->numRows;
+                      for (size_t i = 0;  i < stats->columns.size();  ++i)
+                          total.columns[i].merge(stats->columns[i]);
+                  });
 
     Date now = Date::now();
     auto output = createDataset(server, runProcConf.outputDataset,
                                 nullptr, true /*overwrite*/);
 
-
-    NumericRowHandler nrh(boundDataset, runProcConf, output, now, onProgress2);
-    CategoricalRowHandler crh(boundDataset, runProcConf, output, now,
-                                onProgress);
-    auto record = [&] (const Utf8String & expr, const Path & alias) {
-        const Utf8String name = "\"" + expr + "\"";
-        if (!nrh.recordStatsForColumn(name, alias)) {
-            crh.recordStatsForColumn(name, alias);
-        }
-    };
-
-    for (const auto & clause: procedureConfig.inputData.stm->select.clauses) {
-        Utf8String surface;
-        Utf8String alias;
-        if (clause->isWildcard()) {
-            BoundSelectQuery bsq(SelectExpression::parse("*"),
-                                *boundDataset.dataset,
-                                boundDataset.asName,
-                                runProcConf.inputData.stm->when,
-                                *runProcConf.inputData.stm->where,
-                                runProcConf.inputData.stm->orderBy,
-                                calc);
-            for (const auto & colName: bsq.getSelectOutputInfo()->allColumnNames()) {
-                ++ num;
-                record(colName.toSimpleName(), colName);
-            }
-            continue;
-        }
-        ++ num;
-        // static_cast -> validated already from onPostValidate
-        auto expr = static_cast<NamedColumnExpression *>(clause.get());
-        record(expr->getChildren()[0]->surface, expr->alias);
+    for (size_t i = 0;  i < columnNames.size();  ++i) {
+        recordColumnStats(*output, columnNames[i], total.columns[i],
+                          total.numRows, now);
     }
 
     output->commit();
@@ -3,8 +3,8 @@
  * Mich, 2016-06-30
  * Copyright (c) 2016 mldb.ai inc. All rights reserved.
  *
- * Generates column statistics based on an input query. The statistics are
- * computed from a sequence of mldb sql queries.
+ * Generates column statistics based on an input query. The statistics of
+ * every column are computed in a single parallel pass over the query.
  **/
 
 #pragma once
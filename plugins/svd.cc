@@ -89,6 +89,17 @@ SvdConfigDescription()
              "The runtime goes up with the square of this parameter, "
              "in other words 10 times as many is 100 times as long to run.",
              2000);
+    addField("solver", &SvdConfig::solver,
+             "Solver used to calculate the singular vectors of the dense "
+             "basis.", SVD_LANCZOS);
+    addField("oversampling", &SvdConfig::oversampling,
+             "Number of random vectors beyond `numSingularValues` used by "
+             "the `randomized` solver.  More improves the accuracy of the "
+             "smaller singular values.", 10);
+    addField("numPowerIterations", &SvdConfig::numPowerIterations,
+             "Number of power iterations done by the `randomized` solver.  "
+             "Each one is a pass over the dense basis, and makes the result "
+             "more accurate when the singular values decay slowly.", 2);
     addField("outputColumn", &SvdConfig::outputColumn,
              "Base name of the column that will be written by the SVD.  "
              "It will be an embedding with numSingularValues elements.",
@@ -391,6 +402,7 @@ SvdBasisDescription()
 struct SvdTrainer {
     static SvdBasis calcSvdBasis(const ColumnCorrelations & correlations,
                                  int numSingularValues,
+                                 const SvdConfig & config,
                                  shared_ptr<spdlog::logger> logger);
 
     static SvdBasis calcRightSingular(const ClassifiedColumns & columns,
@@ -403,6 +415,7 @@ SvdBasis
 SvdTrainer::
 calcSvdBasis(const ColumnCorrelations & correlations,
              int numSingularValues,
+             const SvdConfig & config,
              shared_ptr<spdlog::logger> logger)
 {
 #if 0
@@ -432,32 +445,68 @@ calcSvdBasis(const ColumnCorrelations & correlations,
         }
     }
 
-    /**************************************************************
-     * multiplication of matrix B by vector x, where B = A'A,     *
-     * and A is nrow by ncol (nrow >> ncol). Hence, B is of order *
-     * n = ncol (y stores product vector).		              *
-     **************************************************************/
+    // Singular values, and the right singular vector for each
+    std::vector<double> svalues;
+    std::vector<std::vector<double> > vt;
 
-    auto opb_fn = [&] (const double * x, double * y)
-    {
-        for (unsigned i = 0; i != ndims; i++) {
-            y[i] = ML::SIMD::vec_dotprod_dp(&correlations.correlations[i][0], x, ndims);
-        }
-    };
+    if (config.solver == SVD_RANDOMIZED) {
+        // out = B * in, parallel over the rows of B
+        auto multiply = [&] (const double * in, double * out, int l)
+            {
+                auto doRow = [&] (size_t i)
+                    {
+                        const float * row = &correlations.correlations[i][0];
+                        for (unsigned j = 0;  j < l;  ++j)
+                            out[j * ndims + i] = ML::SIMD::vec_dotprod_dp
+                                (row, in + j * ndims, ndims);
+                    };
+                parallelMap(0, ndims, doRow);
+            };
+
+        std::tie(svalues, vt)
+            = randomizedSvd(ndims, numSingularValues,
+                            config.oversampling,
+                            config.numPowerIterations,
+                            multiply);
+        INFO_MSG(logger) << "done randomized SVD " << timer.elapsed();
+    }
+    else {
+        /**************************************************************
+         * multiplication of matrix B by vector x, where B = A'A,     *
+         * and A is nrow by ncol (nrow >> ncol). Hence, B is of order *
+         * n = ncol (y stores product vector).		              *
+         **************************************************************/
+
+        auto opb_fn = [&] (const double * x, double * y)
+        {
+            for (unsigned i = 0; i != ndims; i++) {
+                y[i] = ML::SIMD::vec_dotprod_dp(&correlations.correlations[i][0], x, ndims);
+            }
+        };
+
+        SVDParams params;
+        params.opb = opb_fn;
+        params.ierr = 0;
+        params.nrows = ndims;
+        params.ncols = ndims;
+        params.nvals = 0;
+        params.doU = false;
+        params.calcPrecision(params.ncols);
+
+        svdrec * svdResult = svdLAS2A(numSingularValues, params);
+        ML::Call_Guard cleanUp( [&](){ svdFreeSVDRec(svdResult); });
 
-    SVDParams params;
-    params.opb = opb_fn;
-    params.ierr = 0;
-    params.nrows = ndims;
-    params.ncols = ndims;
-    params.nvals = 0;
-    params.doU = false;
-    params.calcPrecision(params.ncols);
+        INFO_MSG(logger) << "done SVD " << timer.elapsed();
 
-    svdrec * svdResult = svdLAS2A(numSingularValues, params);
-    ML::Call_Guard cleanUp( [&](){ svdFreeSVDRec(svdResult); });
+        TRACE_MSG(logger) << "Vt rows " << svdResult->Vt->rows;
+        TRACE_MSG(logger) << "Vt cols " << svdResult->Vt->cols;
 
-    INFO_MSG(logger) << "done SVD " << timer.elapsed();
+        for (unsigned j = 0;  j < svdResult->d;  ++j) {
+            svalues.push_back(svdResult->S[j]);
+            vt.emplace_back(svdResult->Vt->value[j],
+                            svdResult->Vt->value[j] + ndims);
+        }
+    }
 
     // It doesn't clean up the ones that didn't converge properly... do it ourselves
     // We go until we get a NaN or one with too small a ratio.
@@ -465,27 +514,23 @@ calcSvdBasis(const ColumnCorrelations & correlations,
     // svalues = { 3.06081 2.01797 1.91045 1.39165 1.20556 1.0859 1.01295 0.973041 0.96686 0.795663 0.787847 0.753074 0.663018 0.58732 0.566861 0.53674 0.507972 0.481893 0.476135 0.451054 0.434212 0.428739 0.406749 0.396502 0.388368 0.383147 0.381553 0.34724 0.322744 0.311273 0.297784 0.285271 0.275972 0.272025 0.271609 0.265779 0.254749 0.244108 0.234286 0.229235 0.21586 0.208849 0.207129 0.194427 0.186311 0.184302 0.18284 0.170876 0.1612 0.153722 0.145908 0.145039 0.139881 0.136478 0.134853 0.131319 0.124427 0.112027 0.0839514 0.0766772 0.0687135 0.0484199 0.0354719 0.034498 9.62614e-05 7.98612e-05 7.48308e-05 6.6479e-05 5.5881e-05 5.00391e-05 4.59796e-05 4.33525e-05 3.0214e-05 2.67698e-05 2.66379e-05 1.749e-05 1.64916e-05 1.20429e-05 5.02268e-08 -nan -nan -nan -nan 2.46486e-09 -nan -nan -nan -nan -nan -nan -nan -nan -nan -nan -nan 1.61711e-08 }
 
     unsigned realD = 0;
-    while (realD < svdResult->d
-           && isfinite(svdResult->S[realD])
-           && svdResult->S[realD] / svdResult->S[0] > 1e-9)
+    while (realD < svalues.size()
+           && isfinite(svalues[realD])
+           && svalues[realD] / svalues[0] > 1e-9)
         ++realD;
 
-    INFO_MSG(logger) << "skipped " << svdResult->d - realD << " bad singular values";
-    ExcAssertLessEqual(realD, svdResult->d);
+    INFO_MSG(logger) << "skipped " << svalues.size() - realD << " bad singular values";
+    ExcAssertLessEqual(realD, svalues.size());
     ExcAssertLessEqual(realD, numSingularValues);
-    svdResult->d = realD;
 
-    INFO_MSG(logger) << "got " << svdResult->d << " singular values";
+    INFO_MSG(logger) << "got " << realD << " singular values";
 
-    numSingularValues = svdResult->d;
-
-    TRACE_MSG(logger) << "Vt rows " << svdResult->Vt->rows;
-    TRACE_MSG(logger) << "Vt cols " << svdResult->Vt->cols;
+    numSingularValues = realD;
 
     SvdBasis result;
     result.modelTs = correlations.modelTs;
     result.singularValues.resize(numSingularValues);
-    std::copy(svdResult->S, svdResult->S + numSingularValues,
+    std::copy(svalues.begin(), svalues.begin() + numSingularValues,
               result.singularValues.begin());
 
     INFO_MSG(logger) << "svalues = " << result.singularValues;
@@ -494,27 +539,20 @@ calcSvdBasis(const ColumnCorrelations & correlations,
     std::copy(correlations.columns.begin(), correlations.columns.end(),
               result.columns.begin());
 
-#if 1
     // Extract the singular vectors for the dense behaviours
     for (unsigned i = 0;  i < ndims;  ++i) {
 
         distribution<float> & d = result.columns[i].singularVector;
         d.resize(numSingularValues);
         for (unsigned j = 0;  j < numSingularValues;  ++j)
-            d[j] = svdResult->Vt->value[j][i];
+            d[j] = vt[j][i];
 
         ColumnPath columnName = result.columns[i].columnName;
         CellValue cellValue = result.columns[i].cellValue;
 
         result.columnIndex[columnName].values[cellValue] = i;
         result.columnIndex[columnName].columnName = columnName;
-
-
-        //std::copy(svdResult->Vt->value[i],
-        //          svdResult->Vt->value[i] + numSingularValues,
-        //          d.begin());
     }
-#endif
 
     TRACE_MSG(logger) << "result.columnIndex.size() = " << result.columnIndex.size();
     TRACE_MSG(logger) << "ndims = " << ndims;
@@ -752,6 +790,7 @@ run(const ProcedureRunConfig & run,
     ColumnCorrelations correlations = calculateCorrelations(columnIndex, numBasisVectors, logger);
     SvdBasis svd = SvdTrainer::calcSvdBasis(correlations,
                                             runProcConf.numSingularValues,
+                                            runProcConf,
                                             logger);
 
     auto outputSvdColumns = [](const SvdBasis & basis) {
@@ -16,6 +16,7 @@
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/types/optional.h"
 #include "mldb/utils/log_fwd.h"
+#include "mldb/ml/svd_utils.h"
 
 
 namespace MLDB {
@@ -30,7 +31,10 @@ struct SvdConfig : ProcedureConfig {
     SvdConfig()
         : outputColumn("embedding"),
           numSingularValues(100),
-          numDenseBasisVectors(1000)
+          numDenseBasisVectors(1000),
+          solver(SVD_LANCZOS),
+          oversampling(10),
+          numPowerIterations(2)
     {
     }
 
@@ -43,6 +47,9 @@ struct SvdConfig : ProcedureConfig {
     PathElement outputColumn;
     int numSingularValues;
     int numDenseBasisVectors;
+    SvdSolver solver;
+    int oversampling;
+    int numPowerIterations;
     Utf8String functionName;
 };
 
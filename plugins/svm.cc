@@ -22,6 +22,8 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/scope.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/simd_vector.h"
 
 #include "mldb/ext/svm/svm.h"
 
@@ -179,6 +181,18 @@ SVMConfigDescription()
     addField("svmType", &SVMConfig::svmType,
              "If specified, a SVM function of this name will be created using "
              "the trained SVM.", SVM_CLASSIFICATION);
+    addField("CValues", &SVMConfig::CValues,
+             "Values of the C parameter to try in a grid search.  If this or "
+             "`gammaValues` is set, a model is trained and cross-validated "
+             "for each combination of values in parallel, and the final "
+             "model is trained with the best one.  If empty, the value in "
+             "`configuration` is used.");
+    addField("gammaValues", &SVMConfig::gammaValues,
+             "Values of the gamma parameter to try in a grid search, as for "
+             "`CValues`.  If empty, the value in `configuration` is used.");
+    addField("numFolds", &SVMConfig::numFolds,
+             "Number of folds of cross-validation used to compare the "
+             "models of a grid search.", 3);
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&SVMConfig::trainingData,
@@ -211,6 +225,137 @@ struct MLDBSVM_Problem : svm_problem
     svm_node* x_space;
 };
 
+namespace {
+
+/** Train and cross-validate a model for each combination of the C and
+    gamma values in the configuration, and return the best combination
+    along with the score of each one.  All of the folds of all of the
+    combinations are trained in parallel.  The folds are the rows with
+    the same index modulo numFolds, rather than the random ones of
+    svm_cross_validation(), so that the result doesn't depend on the
+    order in which the threads run.
+*/
+Json::Value
+gridSearch(const svm_problem & prob, const svm_parameter & param,
+           const SVMConfig & config)
+{
+    if (config.svmType == SVM_ONE_CLASS) {
+        throw HttpReturnException
+            (400, "Grid search is not supported for one class SVMs");
+    }
+
+    int numFolds = config.numFolds;
+    if (numFolds < 2 || numFolds > prob.l) {
+        throw HttpReturnException
+            (400, "The number of folds for an SVM grid search must be "
+             "between 2 and the number of rows",
+             "numFolds", numFolds,
+             "numRows", prob.l);
+    }
+
+    std::vector<double> CValues = config.CValues;
+    if (CValues.empty())
+        CValues.push_back(param.C);
+    std::vector<double> gammaValues = config.gammaValues;
+    if (gammaValues.empty())
+        gammaValues.push_back(param.gamma);
+
+    size_t numCombinations = CValues.size() * gammaValues.size();
+
+    bool isRegression = config.svmType == SVM_REGRESSION_EPSILON
+        || config.svmType == SVM_REGRESSION_NU;
+
+    // predictions[c][i] is the prediction of combination c for row i, made
+    // by the model of the fold that doesn't contain it
+    std::vector<std::vector<double> >
+        predictions(numCombinations, std::vector<double>(prob.l));
+
+    auto trainFold = [&] (size_t n)
+        {
+            size_t combination = n / numFolds;
+            int fold = n % numFolds;
+
+            svm_parameter foldParam = param;
+            foldParam.C = CValues[combination / gammaValues.size()];
+            foldParam.gamma = gammaValues[combination % gammaValues.size()];
+
+            // The training rows point into the full problem
+            std::vector<double> y;
+            std::vector<svm_node *> x;
+            for (int i = 0;  i < prob.l;  ++i) {
+                if (i % numFolds == fold)
+                    continue;
+                y.push_back(prob.y[i]);
+                x.push_back(prob.x[i]);
+            }
+
+            svm_problem subProb;
+            subProb.l = y.size();
+            subProb.y = y.data();
+            subProb.x = x.data();
+
+            const char * error = svm_check_parameter(&subProb, &foldParam);
+            if (error) {
+                throw HttpReturnException
+                    (400, "Invalid SVM parameters for grid search: "
+                     + std::string(error),
+                     "C", foldParam.C,
+                     "gamma", foldParam.gamma);
+            }
+
+            svm_model * model = svm_train(&subProb, &foldParam);
+            if (!model) {
+                throw HttpReturnException
+                    (500, "Could not train support vector machine");
+            }
+            Scope_Exit(svm_free_and_destroy_model(&model));
+
+            for (int i = fold;  i < prob.l;  i += numFolds)
+                predictions[combination][i] = svm_predict(model, prob.x[i]);
+        };
+
+    parallelMap(0, numCombinations * numFolds, trainFold);
+
+    Json::Value result;
+    Json::Value & scores = result["gridSearch"];
+    scores = Json::Value(Json::arrayValue);
+
+    double bestScore = -INFINITY;
+    for (size_t c = 0;  c < numCombinations;  ++c) {
+        double C = CValues[c / gammaValues.size()];
+        double gamma = gammaValues[c % gammaValues.size()];
+
+        // Accuracy for classification, and the negative mean squared error
+        // for regression, so that higher is always better
+        double total = 0;
+        for (int i = 0;  i < prob.l;  ++i) {
+            double prediction = predictions[c][i];
+            if (isRegression)
+                total -= (prediction - prob.y[i]) * (prediction - prob.y[i]);
+            else total += prediction == prob.y[i];
+        }
+        double score = total / prob.l;
+
+        Json::Value entry;
+        entry["C"] = C;
+        entry["gamma"] = gamma;
+        entry[isRegression ? "meanSquaredError" : "accuracy"]
+            = isRegression ? -score : score;
+        scores.append(entry);
+
+        if (score > bestScore) {
+            bestScore = score;
+            result["C"] = C;
+            result["gamma"] = gamma;
+        }
+    }
+
+    return result;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* SVM PROCEDURE                                                             */
 /*****************************************************************************/
@@ -314,6 +459,15 @@ run(const ProcedureRunConfig & run,
     rows.resize(0);
     vars.resize(0);
 
+    RunOutput result;
+
+    if (!runProcConf.CValues.empty() || !runProcConf.gammaValues.empty()) {
+        Json::Value search = gridSearch(prob, paramWrapper.param, runProcConf);
+        paramWrapper.param.C = search["C"].asDouble();
+        paramWrapper.param.gamma = search["gamma"].asDouble();
+        result = RunOutput(search);
+    }
+
     svm_model * model = svm_train(&prob,&paramWrapper.param);
     if(!model) {
         throw HttpReturnException(500, "Could not train support vector machine");
@@ -343,7 +497,7 @@ run(const ProcedureRunConfig & run,
         rethrowHttpException(500, "Could not save support vector machine model file", runProcConf.modelFileUrl.toString());
     }
 
-    return RunOutput();
+    return result;
 }
 
 /*****************************************************************************/
@@ -379,9 +533,261 @@ SVMExpressionValueDescription()
              "Output of the SVM for either classification or regression");
 }
 
+namespace {
+
+/// Integer power, calculated in the same way as libsvm for the poly kernel
+double powi(double base, int times)
+{
+    double tmp = base, ret = 1.0;
+
+    for (int t = times;  t > 0;  t /= 2) {
+        if (t % 2 == 1)
+            ret *= tmp;
+        tmp = tmp * tmp;
+    }
+    return ret;
+}
+
+} // file scope
+
+/** Scores dense rows with an SVM model, giving the same output as
+    svm_predict() without going through its sparse nodes for each row.
+
+    Linear kernels are folded into one weight vector for each decision
+    function, so a row is scored with one dot product per decision
+    function (which is just one for two classes or regression) however
+    many support vectors there are.  For the other kernels, the support
+    vectors are stored as a dense matrix, and the kernel of a block of
+    rows is calculated against a block of support vectors at a time, so
+    that the support vectors are read from cache rather than memory for
+    all but the first row of the block.
+*/
+
+struct DenseSVMScorer {
+
+    /** Extract the support vectors from a model.  Returns false if the
+        model can't be scored densely, in which case svm_predict() must be
+        used.
+    */
+    bool init(const svm_model * model, size_t numFeatures)
+    {
+        this->model = model;
+        this->numFeatures = numFeatures;
+
+        const svm_parameter & param = model->param;
+        if (param.kernel_type != LINEAR && param.kernel_type != POLY
+            && param.kernel_type != RBF && param.kernel_type != SIGMOID)
+            return false;
+
+        isMultiClass = param.svm_type == C_SVC || param.svm_type == NU_SVC;
+        numDecisions = isMultiClass
+            ? model->nr_class * (model->nr_class - 1) / 2
+            : 1;
+
+        // Dense support vectors and their squared norms
+        supportVectors.clear();
+        supportVectors.resize(model->l * numFeatures, 0.0);
+        for (int i = 0;  i < model->l;  ++i) {
+            for (const svm_node * x = model->SV[i];  x->index != -1;  ++x) {
+                if (x->index < 0 || x->index >= numFeatures)
+                    return false;
+                supportVectors[i * numFeatures + x->index] = x->value;
+            }
+        }
+
+        if (isMultiClass) {
+            start.resize(model->nr_class);
+            start[0] = 0;
+            for (int i = 1;  i < model->nr_class;  ++i)
+                start[i] = start[i - 1] + model->nSV[i - 1];
+        }
+
+        if (param.kernel_type == LINEAR) {
+            // One weight vector per decision function
+            weights.clear();
+            weights.resize(numDecisions * numFeatures, 0.0);
+
+            auto addSupportVectors = [&] (double * w, const double * coef,
+                                          int first, int count)
+                {
+                    for (int k = first;  k < first + count;  ++k) {
+                        ML::SIMD::vec_add(w, coef[k],
+                                          &supportVectors[k * numFeatures],
+                                          w, numFeatures);
+                    }
+                };
+
+            if (isMultiClass) {
+                int p = 0;
+                for (int i = 0;  i < model->nr_class;  ++i) {
+                    for (int j = i + 1;  j < model->nr_class;  ++j, ++p) {
+                        double * w = &weights[p * numFeatures];
+                        addSupportVectors(w, model->sv_coef[j - 1],
+                                          start[i], model->nSV[i]);
+                        addSupportVectors(w, model->sv_coef[i],
+                                          start[j], model->nSV[j]);
+                    }
+                }
+            }
+            else addSupportVectors(&weights[0], model->sv_coef[0],
+                                   0, model->l);
+
+            // The support vectors aren't needed any more
+            supportVectors.clear();
+            supportVectors.shrink_to_fit();
+        }
+
+        return true;
+    }
+
+    /// Number of rows scored together
+    static constexpr size_t ROW_BLOCK = 16;
+
+    /// Number of support vectors whose kernels are calculated together
+    static constexpr size_t SV_BLOCK = 64;
+
+    /** Score n dense rows of numFeatures values each, writing the output
+        of the model for each one into output.
+    */
+    void score(const double * rows, size_t n, double * output) const
+    {
+        const svm_parameter & param = model->param;
+        static thread_local std::vector<double> decisions, kernels, diff;
+        decisions.resize(numDecisions);
+
+        if (param.kernel_type == LINEAR) {
+            for (size_t r = 0;  r < n;  ++r) {
+                const double * x = rows + r * numFeatures;
+                for (int p = 0;  p < numDecisions;  ++p) {
+                    decisions[p]
+                        = ML::SIMD::vec_dotprod(&weights[p * numFeatures],
+                                                x, numFeatures)
+                        - model->rho[p];
+                }
+                output[r] = getOutput(decisions.data());
+            }
+            return;
+        }
+
+        size_t numSV = model->l;
+        kernels.resize(ROW_BLOCK * numSV);
+        diff.resize(numFeatures);
+
+        for (size_t r0 = 0;  r0 < n;  r0 += ROW_BLOCK) {
+            size_t nr = std::min(ROW_BLOCK, n - r0);
+
+            for (size_t s0 = 0;  s0 < numSV;  s0 += SV_BLOCK) {
+                size_t ns = std::min(SV_BLOCK, numSV - s0);
+                for (size_t r = 0;  r < nr;  ++r) {
+                    const double * x = rows + (r0 + r) * numFeatures;
+                    for (size_t s = s0;  s < s0 + ns;  ++s) {
+                        kernels[r * numSV + s]
+                            = kernel(x, &supportVectors[s * numFeatures],
+                                     diff.data());
+                    }
+                }
+            }
+
+            for (size_t r = 0;  r < nr;  ++r) {
+                const double * k = &kernels[r * numSV];
+                if (isMultiClass) {
+                    int p = 0;
+                    for (int i = 0;  i < model->nr_class;  ++i) {
+                        for (int j = i + 1;  j < model->nr_class;  ++j, ++p) {
+                            int si = start[i], sj = start[j];
+                            decisions[p]
+                                = ML::SIMD::vec_dotprod
+                                    (model->sv_coef[j - 1] + si, k + si,
+                                     model->nSV[i])
+                                + ML::SIMD::vec_dotprod
+                                    (model->sv_coef[i] + sj, k + sj,
+                                     model->nSV[j])
+                                - model->rho[p];
+                        }
+                    }
+                }
+                else {
+                    decisions[0]
+                        = ML::SIMD::vec_dotprod(model->sv_coef[0], k, numSV)
+                        - model->rho[0];
+                }
+                output[r0 + r] = getOutput(decisions.data());
+            }
+        }
+    }
+
+private:
+    double kernel(const double * x, const double * y, double * diff) const
+    {
+        const svm_parameter & param = model->param;
+        switch (param.kernel_type) {
+        case POLY:
+            return powi(param.gamma * ML::SIMD::vec_dotprod(x, y, numFeatures)
+                        + param.coef0,
+                        param.degree);
+        case RBF:
+            ML::SIMD::vec_minus(x, y, diff, numFeatures);
+            return exp(-param.gamma
+                       * ML::SIMD::vec_dotprod(diff, diff, numFeatures));
+        case SIGMOID:
+            return tanh(param.gamma * ML::SIMD::vec_dotprod(x, y, numFeatures)
+                        + param.coef0);
+        default:
+            return ML::SIMD::vec_dotprod(x, y, numFeatures);
+        }
+    }
+
+    /// Turn the decision values into the output, as svm_predict() does
+    double getOutput(const double * decisions) const
+    {
+        if (!isMultiClass) {
+            if (model->param.svm_type == ONE_CLASS)
+                return decisions[0] > 0 ? 1 : -1;
+            return decisions[0];
+        }
+
+        int nr_class = model->nr_class;
+        static thread_local std::vector<int> votes;
+        votes.assign(nr_class, 0);
+
+        int p = 0;
+        for (int i = 0;  i < nr_class;  ++i) {
+            for (int j = i + 1;  j < nr_class;  ++j, ++p) {
+                if (decisions[p] > 0)
+                    ++votes[i];
+                else ++votes[j];
+            }
+        }
+
+        int best = 0;
+        for (int i = 1;  i < nr_class;  ++i)
+            if (votes[i] > votes[best])
+                best = i;
+        return model->label[best];
+    }
+
+    const svm_model * model = nullptr;
+    size_t numFeatures = 0;
+    bool isMultiClass = false;
+    int numDecisions = 0;
+
+    /// Support vectors, one row of numFeatures for each
+    std::vector<double> supportVectors;
+
+    /// For linear kernels, the weights of each decision function
+    std::vector<double> weights;
+
+    /// Index of the first support vector of each class
+    std::vector<int> start;
+};
+
 struct SVMFunction::Itl {
     svm_model * model;
     std::vector<ColumnPath> columnNames;
+
+    /// Set if the model can be scored with the dense scorer
+    bool isDense = false;
+    DenseSVMScorer dense;
 };
 
 SVMFunction::
@@ -418,6 +824,8 @@ SVMFunction(MldbServer * owner,
 
         if (!itl->model)
           throw;
+
+        itl->isDense = itl->dense.init(itl->model, itl->columnNames.size());
     }
     catch (const std::exception & exc) {
         throw HttpReturnException(500, "Could not load support vector machine model file", functionConfig.modelFileUrl.toString());
@@ -438,6 +846,12 @@ call(SVMFunctionArgs input) const
                                                   itl->columnNames.size());
     Date ts = input.embedding.getEffectiveTimestamp();
 
+    if (itl->isDense) {
+        double output;
+        itl->dense.score(embedding.data(), 1, &output);
+        return {ExpressionValue(output, ts)};
+    }
+
     svm_node * x = new svm_node[embedding.size()+1];
     Scope_Exit(delete[] x);
 
@@ -457,6 +871,49 @@ call(SVMFunctionArgs input) const
     return {ExpressionValue(predict_label, ts)};    
 }
 
+void
+SVMFunction::
+applyBatch(const FunctionApplier & applier,
+           const ExpressionValue * inputs,
+           ExpressionValue * outputs,
+           size_t n) const
+{
+    if (!itl->isDense) {
+        Function::applyBatch(applier, inputs, outputs, n);
+        return;
+    }
+
+    static constexpr size_t BATCH_SIZE = 256;
+
+    size_t nf = itl->columnNames.size();
+
+    static thread_local std::vector<double> rows, scores;
+    static thread_local std::vector<Date> timestamps;
+    rows.resize(nf * BATCH_SIZE);
+    scores.resize(BATCH_SIZE);
+    timestamps.resize(BATCH_SIZE);
+
+    for (size_t first = 0;  first < n;  first += BATCH_SIZE) {
+        size_t num = std::min(n - first, BATCH_SIZE);
+
+        for (size_t i = 0;  i < num;  ++i) {
+            ExpressionValue embedding
+                = inputs[first + i].getColumn(PathElement("embedding"));
+            auto values = embedding.getEmbedding(itl->columnNames.data(), nf);
+            std::copy(values.begin(), values.end(), &rows[i * nf]);
+            timestamps[i] = embedding.getEffectiveTimestamp();
+        }
+
+        itl->dense.score(rows.data(), num, scores.data());
+
+        for (size_t i = 0;  i < num;  ++i) {
+            SVMExpressionValue output{ExpressionValue(scores[i],
+                                                      timestamps[i])};
+            outputs[first + i] = toOutput(&output);
+        }
+    }
+}
+
 namespace {
 
 RegisterProcedureType<SVMProcedure, SVMConfig>
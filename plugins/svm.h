@@ -51,6 +51,13 @@ struct SVMConfig : public ProcedureConfig {
 
     //SVM-Specific parameters
     SVMType svmType;
+
+    /// Values of C and gamma to choose from by cross-validation
+    std::vector<double> CValues;
+    std::vector<double> gammaValues;
+
+    /// Number of cross-validation folds for the grid search
+    int numFolds = 3;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(SVMConfig);
@@ -110,6 +117,15 @@ struct SVMFunction: public ValueFunctionT<SVMFunctionArgs, SVMExpressionValue>
 
     virtual SVMExpressionValue call(SVMFunctionArgs input) const override; 
 
+    /** Apply to a batch of inputs.  Unless the model has a kernel that
+        isn't supported, the rows are scored together by a dense scorer
+        rather than one at a time through libsvm.
+    */
+    virtual void applyBatch(const FunctionApplier & applier,
+                            const ExpressionValue * inputs,
+                            ExpressionValue * outputs,
+                            size_t n) const override;
+
     SVMFunctionConfig functionConfig;
 
     struct Itl;
@@ -15,17 +15,28 @@
 #include "mldb/ml/jml/training_index_entry.h"
 #include "mldb/jml/utils/smart_ptr_utils.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/storage_allocator.h"
+#include "mldb/arch/cpu_info.h"
 #include "mldb/base/thread_pool.h"
 #include "mldb/base/scope.h"
 #include "mldb/server/bucket.h"
 #include "mldb/server/parallel_merge_sort.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_utils.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/utils/flat_hash_map.h"
 #include "mldb/jml/utils/floating_point.h"
 #include "mldb/utils/log.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
 #include <mutex>
+#include <numeric>
 
 using namespace std;
 
@@ -34,6 +45,10 @@ namespace MLDB {
 
 static constexpr size_t NUM_PARALLEL_CHUNKS=8;
 
+/// Magic string at the start of a persisted tabular dataset file
+static const std::string TABULAR_FILE_MAGIC = "MLDB Tabular Dataset";
+static constexpr int TABULAR_FILE_VERSION = 3;
+
 
 /*****************************************************************************/
 /* TABULAR DATA STORE                                                        */
@@ -45,20 +60,24 @@ static constexpr size_t NUM_PARALLEL_CHUNKS=8;
 
 struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
-    // Find the optimal chunk size.  For narrow datasets, we want
-    // big chunks because it means less overhead.  However, for
-    // wide datasets we want a lot less as otherwise there is far too
-    // much memory allocated and the TLB can't hold all of the entries
-    // for all of the columns.
-    static size_t chunkSizeForNumColumns(size_t numColumns)
+    // Chunks are rotated once the rows recorded into them take up about
+    // this much memory, rather than after a fixed number of rows.  Frozen
+    // chunks are what scans and freezes are split over, so this keeps
+    // them of a similar size whatever the width of the dataset or the
+    // size of its values: narrow datasets get many rows per chunk, and
+    // wide or sparse ones few enough that the memory allocated for all of
+    // their columns still fits in the TLB.
+    static constexpr size_t TARGET_CHUNK_BYTES = 32 << 20;
+
+    // Limit on the rows in a chunk, which is only reached by datasets with
+    // very few, small columns.
+    static constexpr size_t MAX_CHUNK_ROWS = 131072;
+
+    static std::shared_ptr<MutableTabularDatasetChunk>
+    newMutableChunk(size_t numColumns, size_t maxRows = MAX_CHUNK_ROWS)
     {
-        if (numColumns == 0)
-            numColumns = 1;
-        size_t rowsPerChunk
-            = std::min<size_t>(131072, 131072*numCpus()/numColumns);
-        if (rowsPerChunk < 16)
-            rowsPerChunk = 16;
-        return rowsPerChunk;
+        return std::make_shared<MutableTabularDatasetChunk>
+            (numColumns, maxRows, TARGET_CHUNK_BYTES);
     }
 
     TabularDataStore(TabularDatasetConfig config,
@@ -137,6 +156,32 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             return streams;
         }
 
+        /// Morsels never cross a chunk, so that chunks of different
+        /// sizes (or densities) don't cause threads to wait on each other
+        virtual std::vector<size_t>
+        getMorselOffsets(int64_t rowStreamTotalRows,
+                         ssize_t maxRowsPerMorsel) const override
+        {
+            if (maxRowsPerMorsel == AUTO)
+                maxRowsPerMorsel = defaultRowsPerMorsel(rowStreamTotalRows);
+            ExcAssertGreater(maxRowsPerMorsel, 0);
+
+            std::vector<size_t> result;
+            size_t startAt = 0;
+            for (auto & chunk: store->chunks) {
+                size_t n = chunk.rowCount();
+                size_t numMorsels = (n + maxRowsPerMorsel - 1) / maxRowsPerMorsel;
+                for (size_t i = 0;  i < numMorsels;  ++i)
+                    result.push_back(startAt + n * i / numMorsels);
+                startAt += n;
+            }
+            result.push_back(startAt);
+
+            ExcAssertEqual(startAt, rowStreamTotalRows);
+
+            return result;
+        }
+
         virtual bool supportsExtendedInterface() const override
         {
             return true;
@@ -265,6 +310,57 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     /// we are forced to lookup on ColumnHash.
     Lightweight_Hash<ColumnHash, int> columnHashIndex;
 
+    /** Range of the non-null values of a column within a single chunk.
+        This allows a predicate on the column to skip the entire chunk
+        without decoding it when no value in the range could match.
+    */
+    struct ZoneMap {
+        ZoneMap()
+            : hasValues(false)
+        {
+        }
+
+        bool hasValues;
+        CellValue minValue;
+        CellValue maxValue;
+
+        void add(const CellValue & val)
+        {
+            if (val.empty())
+                return;
+            if (!hasValues) {
+                minValue = maxValue = val;
+                hasValues = true;
+            }
+            else if (val < minValue)
+                minValue = val;
+            else if (maxValue < val)
+                maxValue = val;
+        }
+
+        /** Can any value within the range satisfy (value op constant)?  If
+            this returns false then the chunk can be skipped.
+        */
+        bool mayMatch(const std::string & op, const CellValue & constant) const
+        {
+            if (!hasValues)
+                return false;
+            if (op == "=" || op == "==")
+                return !(constant < minValue) && !(maxValue < constant);
+            else if (op == "!=")
+                return !(minValue == constant && maxValue == constant);
+            else if (op == "<")
+                return minValue < constant;
+            else if (op == "<=")
+                return !(constant < minValue);
+            else if (op == ">")
+                return constant < maxValue;
+            else if (op == ">=")
+                return !(maxValue < constant);
+            return true;
+        }
+    };
+
     struct ColumnEntry {
         ColumnEntry()
             : rowCount(0)
@@ -279,10 +375,50 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         /// The set of chunks that contain the column.  This may not be all
         /// chunks for sparse columns.
         std::vector<std::pair<uint32_t, std::shared_ptr<const FrozenColumn> > > chunks;
+
+        /// Range of values for each entry in chunks, in the same order
+        std::vector<ZoneMap> zoneMaps;
     };
 
     /// List of all columns in the dataset
     std::vector<ColumnEntry> columns;
+
+    /** Position of a value within a column: the entry in the column's
+        ColumnEntry::chunks, and the row number within that chunk.
+    */
+    struct IndexEntry {
+        uint32_t chunk;
+        uint32_t row;
+
+        bool operator < (const IndexEntry & other) const
+        {
+            return chunk < other.chunk
+                || (chunk == other.chunk && row < other.row);
+        }
+    };
+
+    /** Secondary index over the non-null values of a column, which finds
+        the rows with a given value (or range of values, for a sorted
+        index) without scanning the column.
+    */
+    struct SecondaryIndex {
+        TabularIndexType type;
+        ColumnPath columnName;
+        int column;  ///< Index of the indexed column in columns
+
+        /// Position of each non-null value of the column, ordered by the
+        /// hash of the value for a hash index, or by value for a sorted one
+        std::vector<IndexEntry> entries;
+
+        /// Sorted index only: the value of each entry
+        std::vector<CellValue> values;
+
+        /// Hash index only: range of entries for each hash of a value
+        FlatHashMap<uint64_t, std::pair<size_t, size_t> > ranges;
+    };
+
+    /// Secondary indexes from the config, built on commit
+    std::vector<SecondaryIndex> secondaryIndexes;
     
     /// List of the names of the fixed columns in the dataset
     std::vector<ColumnPath> fixedColumns;
@@ -290,6 +426,26 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     /// Index of just the fixed columns
     Lightweight_Hash<uint64_t, int> fixedColumnIndex;
 
+    /// Indexes in fixedColumns of the columns with each first element, to
+    /// find the columns that a projection needs without looking at them all
+    std::map<PathElement, std::vector<int> > fixedColumnsByHead;
+
+    /// Dictionary of the string values of each fixed column, which the
+    /// chunks share so that each string is only stored once
+    std::vector<std::shared_ptr<ColumnDictionary> > dictionaries;
+
+    /// Storage of the frozen columns of the chunks
+    std::shared_ptr<StorageAccount> storageAccount
+        = std::make_shared<StorageAccount>();
+
+    /// Schema used to return rows as flat expression values, which is
+    /// only possible if every fixed column has a simple name.  Null if
+    /// that's not the case.
+    std::shared_ptr<const FlatRowSchema> flatSchema;
+
+    /// Index in fixedColumns of each of the columns of flatSchema
+    std::vector<int> flatColumnOrder;
+
     /// List of all chunks in the dataset
     std::vector<TabularDatasetChunk> chunks;
 
@@ -363,8 +519,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     /// Index from rowHash to (chunk, indexInChunk) when line number not used for rowName
     static constexpr size_t ROW_INDEX_SHARDS=32;
-    Lightweight_Hash<RowHash, std::pair<int, int> > rowIndex
-        [ROW_INDEX_SHARDS];
+    FlatHashMap<RowHash, std::pair<int, int> > rowIndex[ROW_INDEX_SHARDS];
     std::string filename;
     Date earliestTs, latestTs;
 
@@ -514,6 +669,19 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return std::make_tuple(std::move(buckets), std::move(desc));
     }
 
+    virtual std::vector<std::vector<CellValue> >
+    getColumnsDense(const std::vector<ColumnPath> & columns) const override
+    {
+        return getEachColumnDense(columns);
+    }
+
+    virtual std::vector<std::tuple<BucketList, BucketDescriptions> >
+    getColumnsBuckets(const std::vector<ColumnPath> & columns,
+                      int maxNumBuckets) const override
+    {
+        return getEachColumnBuckets(columns, maxNumBuckets);
+    }
+
     virtual uint64_t getColumnRowCount(const ColumnPath & column) const override
     {
         return rowCount;
@@ -673,8 +841,45 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                  "rowName", rowName);
         }
 
-        return chunks.at(it->second.first)
-            .getRowExpr(it->second.second, fixedColumns);
+        const TabularDatasetChunk & chunk = chunks.at(it->second.first);
+        if (flatSchema && chunk.sparseColumns.empty())
+            return chunk.getFlatRowExpr(it->second.second,
+                                        flatSchema, flatColumnOrder);
+        return chunk.getRowExpr(it->second.second, fixedColumns);
+    }
+
+    ExpressionValue
+    getProjectedRowExpr(const RowPath & rowName,
+                        const std::vector<ColumnPath> & columns) const
+    {
+        ColumnProjection projection(columns);
+        if (projection.all)
+            return getRowExpr(rowName);
+
+        RowHash rowHash(rowName);
+        int shard = getRowShard(rowHash);
+        auto it = rowIndex[shard].find(rowHash);
+        if (it == rowIndex[shard].end()) {
+            throw HttpReturnException
+                (400, "Row not found in tabular dataset: "
+                 + rowName.toUtf8String(),
+                 "rowName", rowName);
+        }
+
+        // Keep the columns in the same order as getRowExpr()
+        std::vector<int> fixedColumnIndexes;
+        for (auto & head: projection.heads) {
+            auto jt = fixedColumnsByHead.find(head);
+            if (jt == fixedColumnsByHead.end())
+                continue;
+            fixedColumnIndexes.insert(fixedColumnIndexes.end(),
+                                      jt->second.begin(), jt->second.end());
+        }
+        std::sort(fixedColumnIndexes.begin(), fixedColumnIndexes.end());
+
+        const TabularDatasetChunk & chunk = chunks.at(it->second.first);
+        return chunk.getProjectedRowExpr(it->second.second, fixedColumns,
+                                         fixedColumnIndexes, projection);
     }
 
     virtual RowPath getRowPath(const RowHash & rowHash) const override
@@ -716,6 +921,11 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         bool isNumeric = true;
 
+        // Chunks that share a dictionary are counted by code, so that each
+        // distinct value is only looked up once
+        const ColumnDictionary * dictionary = nullptr;
+        std::vector<uint64_t> codeCounts;
+
         for (auto & c: columns.at(it->second).chunks) {
 
             auto onValue = [&] (const CellValue & value)
@@ -725,8 +935,33 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     stats.values[value].rowCount_ += 1;
                     return true;
                 };
-                                
-            c.second->forEachDistinctValue(onValue);
+
+            auto onCode = [&] (uint32_t code)
+                {
+                    if (code == ColumnDictionary::NOT_FOUND)
+                        return onValue(CellValue());
+                    if (code >= codeCounts.size())
+                        codeCounts.resize(dictionary->size());
+                    codeCounts[code] += 1;
+                    return true;
+                };
+
+            const ColumnDictionary * chunkDictionary
+                = c.second->getDictionary();
+            if (chunkDictionary && !dictionary)
+                dictionary = chunkDictionary;
+
+            if (chunkDictionary && chunkDictionary == dictionary)
+                c.second->forEachDistinctCode(onCode);
+            else c.second->forEachDistinctValue(onValue);
+        }
+
+        for (size_t i = 0;  i < codeCounts.size();  ++i) {
+            if (codeCounts[i] == 0)
+                continue;
+            // Dictionaries only hold strings
+            isNumeric = false;
+            stats.values[(*dictionary)[i]].rowCount_ += codeCounts[i];
         }
 
         stats.isNumeric_ = isNumeric && !chunks.empty();
@@ -749,18 +984,538 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return { earliestTs, latestTs };
     }
 
+    /// Return the secondary index of the given type on the column, or
+    /// null if there is none
+    const SecondaryIndex * findIndex(int column, TabularIndexType type) const
+    {
+        for (auto & index: secondaryIndexes) {
+            if (index.column == column && index.type == type)
+                return &index;
+        }
+        return nullptr;
+    }
+
+    /** Return the entries of the index whose value satisfies
+        (value op constant), where op is a comparison that the index can
+        answer.
+    */
+    std::vector<IndexEntry>
+    lookupIndex(const SecondaryIndex & index,
+                const std::string & op,
+                const CellValue & constant) const
+    {
+        std::vector<IndexEntry> result;
+
+        if (index.type == TI_HASH) {
+            ExcAssert(op == "=" || op == "==");
+            auto it = index.ranges.find(constant.hash().hash());
+            if (it == index.ranges.end())
+                return result;
+
+            // Values with the same hash may still be different
+            const ColumnEntry & entry = columns[index.column];
+            for (size_t i = it->second.first;  i < it->second.second;  ++i) {
+                const IndexEntry & e = index.entries[i];
+                if (entry.chunks[e.chunk].second->get(e.row) == constant)
+                    result.push_back(e);
+            }
+            return result;
+        }
+
+        auto begin = index.values.begin(), end = index.values.end();
+        auto first = begin, last = end;
+        if (op == "=" || op == "==") {
+            // Values that sort equally aren't always equal (for example
+            // 1 and 1.0), so check each one
+            std::tie(first, last) = std::equal_range(begin, end, constant);
+            for (auto vit = first;  vit != last;  ++vit) {
+                if (*vit == constant)
+                    result.push_back(index.entries[vit - begin]);
+            }
+            return result;
+        }
+        else if (op == "<")
+            last = std::lower_bound(begin, end, constant);
+        else if (op == "<=")
+            last = std::upper_bound(begin, end, constant);
+        else if (op == ">")
+            first = std::upper_bound(begin, end, constant);
+        else if (op == ">=")
+            first = std::lower_bound(begin, end, constant);
+        else throw HttpReturnException
+                 (500, "Sorted index can't look up operator " + op);
+
+        result.insert(result.end(),
+                      index.entries.begin() + (first - begin),
+                      index.entries.begin() + (last - begin));
+        return result;
+    }
+
+    /** Generate the rows matching a WHERE clause from the secondary
+        indexes, for "column op constant" with an operator the index can
+        answer and "column IN (constant, ...)".  The rows are returned in
+        the same order as a scan would return them.  Returns an empty
+        function if no index can be used.
+    */
+    GenerateRowsWhereFunction
+    generateRowsWhereIndexed(const Utf8String & alias,
+                             const SqlExpression & where,
+                             ssize_t offset,
+                             ssize_t limit) const
+    {
+        GenerateRowsWhereFunction result;
+        if (secondaryIndexes.empty())
+            return result;
+
+        const ReadColumnExpression * variable = nullptr;
+        std::string op = "=";
+        std::vector<CellValue> constants;
+
+        auto getAtom = [&] (const SqlExpression & expression)
+            {
+                auto constant
+                    = dynamic_cast<const ConstantExpression *>(&expression);
+                if (!constant || !constant->constant.isAtom())
+                    return false;
+                constants.push_back(constant->constant.getAtom());
+                return true;
+            };
+
+        if (auto in = dynamic_cast<const InExpression *>(&where)) {
+            if (in->kind != InExpression::TUPLE || in->isNegative)
+                return result;
+            variable = dynamic_cast<const ReadColumnExpression *>
+                (in->expr.get());
+            for (auto & c: in->tuple->clauses) {
+                if (!getAtom(*c))
+                    return result;
+            }
+        }
+        else if (auto comparison
+                 = dynamic_cast<const ComparisonExpression *>(&where)) {
+            op = comparison->op;
+            variable = dynamic_cast<const ReadColumnExpression *>
+                (comparison->lhs.get());
+            if (variable) {
+                if (!getAtom(*comparison->rhs))
+                    return result;
+            }
+            else {
+                // constant op variable; flip the comparison around
+                variable = dynamic_cast<const ReadColumnExpression *>
+                    (comparison->rhs.get());
+                if (!getAtom(*comparison->lhs))
+                    return result;
+                if (op == "<")
+                    op = ">";
+                else if (op == "<=")
+                    op = ">=";
+                else if (op == ">")
+                    op = "<";
+                else if (op == ">=")
+                    op = "<=";
+            }
+        }
+
+        if (!variable)
+            return result;
+
+        ColumnPath columnName(removeTableName(alias, variable->columnName));
+        auto it = columnIndex.find(columnName.oldHash());
+        if (it == columnIndex.end())
+            return result;
+
+        // Equality prefers the hash index; ranges need the sorted one
+        const SecondaryIndex * index = nullptr;
+        if (op == "=" || op == "==") {
+            index = findIndex(it->second, TI_HASH);
+            if (!index)
+                index = findIndex(it->second, TI_SORTED);
+        }
+        else if (op == "<" || op == "<=" || op == ">" || op == ">=") {
+            index = findIndex(it->second, TI_SORTED);
+        }
+
+        if (!index)
+            return result;
+
+        auto exec = [=] (ssize_t numToGenerate, Any token,
+                         const BoundParameters & params,
+                         const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                std::vector<IndexEntry> found;
+                for (auto & c: constants) {
+                    auto entries = lookupIndex(*index, op, c);
+                    found.insert(found.end(), entries.begin(), entries.end());
+                }
+
+                std::sort(found.begin(), found.end());
+                found.erase(std::unique(found.begin(), found.end(),
+                                        [] (const IndexEntry & e1,
+                                            const IndexEntry & e2)
+                                        {
+                                            return !(e1 < e2) && !(e2 < e1);
+                                        }),
+                            found.end());
+
+                const ColumnEntry & entry = columns[index->column];
+                std::vector<RowPath> rows;
+                for (size_t i = std::max<ssize_t>(offset, 0);
+                     i < found.size()
+                         && (limit == -1 || (ssize_t)rows.size() < limit);
+                     ++i) {
+                    const TabularDatasetChunk & chunk
+                        = chunks[entry.chunks[found[i].chunk].first];
+                    rows.emplace_back(chunk.getRowPath(found[i].row));
+                }
+
+                return { std::move(rows), Any() };
+            };
+
+        return { exec,
+                 Utf8String(index->type == TI_HASH ? "tabular hash index"
+                            : "tabular sorted index")
+                 + " lookup for " + where.print(),
+                 GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+    }
+
+    /** Generate the rows matching a WHERE clause of the form
+        "column op constant" or "constant op column".  If the column has a
+        secondary index that can answer the comparison it is used.
+        Otherwise, chunks whose zone map shows that no value can match are
+        skipped entirely, and the others are scanned on the single column
+        only.  Returns an empty function for anything else, to fall back
+        to the generic implementation.
+    */
     GenerateRowsWhereFunction
     generateRowsWhere(const SqlBindingScope & context,
+                      const Utf8String & alias,
                       const SqlExpression & where,
                       ssize_t offset,
                       ssize_t limit) const
     {
-        GenerateRowsWhereFunction result;
-        return result;
+        GenerateRowsWhereFunction result
+            = generateRowsWhereIndexed(alias, where, offset, limit);
+        if (result)
+            return result;
+
+        auto comparison = dynamic_cast<const ComparisonExpression *>(&where);
+        if (!comparison)
+            return result;
+
+        auto getConstant = [] (const SqlExpression & expression)
+            {
+                return dynamic_cast<const ConstantExpression *>(&expression);
+            };
+
+        auto getVariable = [] (const SqlExpression & expression)
+            {
+                return dynamic_cast<const ReadColumnExpression *>(&expression);
+            };
+
+        std::string op = comparison->op;
+        auto variable = getVariable(*comparison->lhs);
+        auto constant = getConstant(*comparison->rhs);
+
+        if (!variable || !constant) {
+            // constant op variable; flip the comparison around
+            variable = getVariable(*comparison->rhs);
+            constant = getConstant(*comparison->lhs);
+            if (op == "<")
+                op = ">";
+            else if (op == "<=")
+                op = ">=";
+            else if (op == ">")
+                op = "<";
+            else if (op == ">=")
+                op = "<=";
+        }
+
+        if (!variable || !constant || !constant->constant.isAtom())
+            return result;
+
+        if (op != "=" && op != "==" && op != "!=" && op != "<" && op != "<="
+            && op != ">" && op != ">=")
+            return result;
+
+        ColumnPath columnName(removeTableName(alias, variable->columnName));
+        auto it = columnIndex.find(columnName.oldHash());
+        if (it == columnIndex.end())
+            return result;
+
+        const ColumnEntry * entry = &columns[it->second];
+        CellValue value = constant->constant.getAtom();
+
+        auto exec = [=] (ssize_t numToGenerate, Any token,
+                         const BoundParameters & params,
+                         const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                std::function<bool (const CellValue &)> matches;
+                if (op == "=" || op == "==")
+                    matches = [&] (const CellValue & v) { return v == value; };
+                else if (op == "!=")
+                    matches = [&] (const CellValue & v) { return v != value; };
+                else if (op == "<")
+                    matches = [&] (const CellValue & v) { return v < value; };
+                else if (op == "<=")
+                    matches = [&] (const CellValue & v) { return !(value < v); };
+                else if (op == ">")
+                    matches = [&] (const CellValue & v) { return value < v; };
+                else matches = [&] (const CellValue & v) { return !(v < value); };
+
+                std::vector<std::vector<RowPath> > chunkRows(entry->chunks.size());
+
+                auto onChunk = [&] (size_t i)
+                    {
+                        if (!entry->zoneMaps[i].mayMatch(op, value))
+                            return;
+
+                        const TabularDatasetChunk & chunk
+                            = chunks[entry->chunks[i].first];
+                        const FrozenColumn & column = *entry->chunks[i].second;
+
+                        // Equality on a column with a dictionary compares
+                        // the codes, without looking at the strings
+                        const ColumnDictionary * dictionary
+                            = column.getDictionary();
+                        if (dictionary && op != "<" && op != "<="
+                            && op != ">" && op != ">=") {
+                            bool equal = op != "!=";
+                            uint32_t code = dictionary->find(value);
+                            if (code == ColumnDictionary::NOT_FOUND && equal)
+                                return;
+
+                            auto onCode = [&] (size_t rowNum, uint32_t rowCode)
+                                {
+                                    if ((rowCode == code) == equal)
+                                        chunkRows[i].emplace_back
+                                            (chunk.getRowPath(rowNum));
+                                    return true;
+                                };
+
+                            column.forEachCode(onCode);
+                            return;
+                        }
+
+                        auto onRow = [&] (size_t rowNum, const CellValue & val)
+                            {
+                                if (!val.empty() && matches(val))
+                                    chunkRows[i].emplace_back
+                                        (chunk.getRowPath(rowNum));
+                                return true;
+                            };
+
+                        column.forEach(onRow);
+                    };
+
+                // Scan each chunk from the NUMA node that holds it
+                auto chunkNode = [&] (size_t i)
+                    {
+                        return numaNodeOfAddress(entry->chunks[i].second.get());
+                    };
+
+                parallelMapNuma(0, entry->chunks.size(), chunkNode, onChunk);
+
+                std::vector<RowPath> rows;
+                for (auto & r: chunkRows) {
+                    rows.insert(rows.end(),
+                                std::make_move_iterator(r.begin()),
+                                std::make_move_iterator(r.end()));
+                }
+
+                return { std::move(rows), Any() };
+            };
+
+        return { exec,
+                 "tabular zone map scan for " + where.print(),
+                 GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+    }
+
+    /** Calculate the values (sorted index) or the ranges of entries
+        for each hash (hash index) from the entries of the index, which
+        must already be in order.
+    */
+    void finishIndex(SecondaryIndex & index) const
+    {
+        const ColumnEntry & entry = columns[index.column];
+        size_t n = index.entries.size();
+        std::vector<CellValue> values(n);
+
+        static constexpr size_t ENTRIES_PER_BLOCK = 65536;
+        auto doBlock = [&] (size_t block)
+            {
+                size_t end = std::min(n, (block + 1) * ENTRIES_PER_BLOCK);
+                for (size_t i = block * ENTRIES_PER_BLOCK;  i < end;  ++i) {
+                    const IndexEntry & e = index.entries[i];
+                    values[i] = entry.chunks.at(e.chunk).second->get(e.row);
+                }
+            };
+
+        parallelMap(0, (n + ENTRIES_PER_BLOCK - 1) / ENTRIES_PER_BLOCK,
+                    doBlock);
+
+        if (index.type == TI_SORTED) {
+            index.values = std::move(values);
+            return;
+        }
+
+        index.ranges.clear();
+        for (size_t i = 0;  i < n;) {
+            uint64_t hash = values[i].hash().hash();
+            size_t j = i + 1;
+            while (j < n && values[j].hash().hash() == hash)
+                ++j;
+            index.ranges[hash] = { i, j };
+            i = j;
+        }
+    }
+
+    /** Build an index from the values of the column. */
+    void buildIndex(SecondaryIndex & index) const
+    {
+        const ColumnEntry & entry = columns[index.column];
+
+        // Entries of each chunk, with the hash of their value so that a
+        // hash index can be sorted without looking up the value again
+        typedef std::pair<uint64_t, IndexEntry> HashEntry;
+        std::vector<std::vector<HashEntry> > chunkEntries(entry.chunks.size());
+
+        auto onChunk = [&] (size_t i)
+            {
+                auto onRow = [&] (size_t rowNum, const CellValue & val)
+                    {
+                        if (!val.empty())
+                            chunkEntries[i].emplace_back
+                                (val.hash().hash(),
+                                 IndexEntry{ (uint32_t)i, (uint32_t)rowNum });
+                        return true;
+                    };
+                entry.chunks[i].second->forEach(onRow);
+            };
+
+        parallelMap(0, entry.chunks.size(), onChunk);
+
+        std::vector<HashEntry> entries;
+        for (auto & c: chunkEntries) {
+            entries.insert(entries.end(), c.begin(), c.end());
+            c = std::vector<HashEntry>();
+        }
+
+        if (index.type == TI_HASH) {
+            auto less = [] (const HashEntry & e1, const HashEntry & e2)
+                {
+                    return e1.first < e2.first
+                        || (e1.first == e2.first && e1.second < e2.second);
+                };
+            parallelQuickSortRecursive<HashEntry, decltype(less)>
+                (entries.begin(), entries.end(), less);
+
+            index.entries.reserve(entries.size());
+            for (auto & e: entries)
+                index.entries.push_back(e.second);
+        }
+        else {
+            typedef std::pair<CellValue, IndexEntry> ValueEntry;
+            std::vector<ValueEntry> valueEntries;
+            valueEntries.reserve(entries.size());
+            for (auto & e: entries) {
+                const IndexEntry & ie = e.second;
+                valueEntries.emplace_back
+                    (entry.chunks[ie.chunk].second->get(ie.row), ie);
+            }
+            entries = std::vector<HashEntry>();
+
+            auto less = [] (const ValueEntry & e1, const ValueEntry & e2)
+                {
+                    return e1.first < e2.first
+                        || (!(e2.first < e1.first) && e1.second < e2.second);
+                };
+            parallelQuickSortRecursive<ValueEntry, decltype(less)>
+                (valueEntries.begin(), valueEntries.end(), less);
+
+            index.entries.reserve(valueEntries.size());
+            index.values.reserve(valueEntries.size());
+            for (auto & e: valueEntries) {
+                index.entries.push_back(e.second);
+                index.values.emplace_back(std::move(e.first));
+            }
+            return;
+        }
+
+        finishIndex(index);
+    }
+
+    /** Set up the secondary indexes of the config, in parallel.  Those
+        that were loaded along with the dataset are kept rather than being
+        rebuilt.
+
+        NOTE: must be called with the lock held, from finalize().
+    */
+    void buildIndexes(std::vector<SecondaryIndex> loaded)
+    {
+        std::vector<bool> isLoaded(loaded.size(), true);
+
+        for (auto & c: config.indexes) {
+            bool found = false;
+            for (auto & index: loaded) {
+                if (index.columnName == c.column && index.type == c.type)
+                    found = true;
+            }
+            if (found)
+                continue;
+
+            auto it = columnIndex.find(c.column.oldHash());
+            if (it == columnIndex.end()) {
+                // An empty dataset has no columns, and needs no index
+                if (rowCount == 0)
+                    continue;
+                throw HttpReturnException
+                    (400, "Can't create an index on a column that isn't in "
+                     "the tabular dataset",
+                     "columnName", c.column);
+            }
+
+            SecondaryIndex index;
+            index.type = c.type;
+            index.columnName = c.column;
+            index.column = it->second;
+            loaded.emplace_back(std::move(index));
+            isLoaded.push_back(false);
+        }
+
+        for (auto & index: loaded) {
+            auto it = columnIndex.find(index.columnName.oldHash());
+            if (it == columnIndex.end())
+                throw HttpReturnException
+                    (400, "Index in tabular dataset file is on an unknown "
+                     "column", "columnName", index.columnName);
+            index.column = it->second;
+        }
+
+        Timer indexTimer;
+
+        auto doIndex = [&] (size_t i)
+            {
+                if (isLoaded[i])
+                    finishIndex(loaded[i]);
+                else buildIndex(loaded[i]);
+            };
+
+        parallelMap(0, loaded.size(), doIndex);
+
+        secondaryIndexes = std::move(loaded);
+
+        if (!secondaryIndexes.empty())
+            INFO_MSG(logger) << "secondary indexes took "
+                             << indexTimer.elapsed();
     }
 
     void finalize(std::vector<TabularDatasetChunk> & inputChunks,
-                  uint64_t totalRows)
+                  uint64_t totalRows,
+                  std::vector<SecondaryIndex> loadedIndexes
+                      = std::vector<SecondaryIndex>())
     {
         // NOTE: must be called with the lock held
 
@@ -807,6 +1562,25 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         ExcAssertEqual(columns.size(), columnIndex.size());
         ExcAssertEqual(columns.size(), columnHashIndex.size());
 
+        // Calculate the zone maps, which are used to skip chunks when
+        // filtering on a column
+        auto zoneMapColumn = [&] (size_t i)
+            {
+                ColumnEntry & entry = columns[i];
+                entry.zoneMaps.resize(entry.chunks.size());
+                for (size_t j = 0;  j < entry.chunks.size();  ++j) {
+                    ZoneMap & zoneMap = entry.zoneMaps[j];
+                    auto onValue = [&] (const CellValue & val)
+                        {
+                            zoneMap.add(val);
+                            return true;
+                        };
+                    entry.chunks[j].second->forEachDistinctValue(onValue);
+                }
+            };
+
+        parallelMap(0, columns.size(), zoneMapColumn);
+
         // We create the row index in multiple chunks
 
         std::mutex rowIndexLock[ROW_INDEX_SHARDS];
@@ -866,6 +1640,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 #endif
         INFO_MSG(logger) << "row index took " << rowIndexTimer.elapsed();
 
+        buildIndexes(std::move(loadedIndexes));
     }
 
     void initialize(vector<ColumnPath> columnNames)
@@ -873,6 +1648,16 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         ExcAssert(this->fixedColumns.empty());
         this->fixedColumns = std::move(columnNames);
 
+        dictionaries.clear();
+        for (size_t i = 0;  i < fixedColumns.size();  ++i)
+            dictionaries.emplace_back(std::make_shared<ColumnDictionary>());
+
+        fixedColumnsByHead.clear();
+        for (size_t i = 0;  i < fixedColumns.size();  ++i) {
+            if (!fixedColumns[i].empty())
+                fixedColumnsByHead[fixedColumns[i][0]].push_back(i);
+        }
+
         for (size_t i = 0;  i < fixedColumns.size();  ++i) {
             if (!fixedColumnIndex.insert(make_pair(fixedColumns[i].oldHash(), i))
                 .second)
@@ -880,6 +1665,29 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                                           "Duplicate column name in tabular dataset",
                                           "columnName", fixedColumns[i]);
         }
+
+        bool allSimple = true;
+        for (auto & c: fixedColumns) {
+            if (c.size() != 1) {
+                allSimple = false;
+                break;
+            }
+        }
+
+        if (allSimple && !fixedColumns.empty()) {
+            flatColumnOrder.resize(fixedColumns.size());
+            std::iota(flatColumnOrder.begin(), flatColumnOrder.end(), 0);
+            std::sort(flatColumnOrder.begin(), flatColumnOrder.end(),
+                      [&] (int i1, int i2)
+                      {
+                          return fixedColumns[i1][0] < fixedColumns[i2][0];
+                      });
+            std::vector<PathElement> names;
+            names.reserve(fixedColumns.size());
+            for (int i: flatColumnOrder)
+                names.push_back(fixedColumns[i][0]);
+            flatSchema = std::make_shared<FlatRowSchema>(std::move(names));
+        }
     }
 
     /** This is a recorder that allows parallel records from multiple
@@ -1045,10 +1853,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 ExcAssertEqual(written,
                                MutableTabularDatasetChunk::ADD_PERFORM_ROTATION);
                 finishedChunk();
-                chunk.reset
-                    (new MutableTabularDatasetChunk
-                     (orderedVals.size(),
-                      chunkSizeForNumColumns(orderedVals.size())));
+                chunk = newMutableChunk(orderedVals.size());
             }
         }
 
@@ -1086,9 +1891,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         {
             if (!chunk || chunk->rowCount() == 0)
                 return;
-            ColumnFreezeParameters params;
-            auto frozen = chunk->freeze(params);
-            store->addFrozenChunk(std::move(frozen));
+            // The chunk is frozen while this thread goes on recording into
+            // a new one; commit() waits for it
+            store->freezeChunkInBackground(std::move(chunk));
+            chunk.reset();
         }
 
         virtual
@@ -1137,10 +1943,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                         ExcAssertEqual(written,
                                        MutableTabularDatasetChunk::ADD_PERFORM_ROTATION);
                         finishedChunk();
-                        chunk.reset
-                            (new MutableTabularDatasetChunk
-                             (columnNames.size(),
-                              chunkSizeForNumColumns(columnNames.size())));
+                        chunk = newMutableChunk(columnNames.size());
                     }
                 };
         }
@@ -1212,6 +2015,171 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
              << 1.0 * mem / rowCount << " bytes/row";
         INFO_MSG(logger) << "column memory is " << columnMem;
 
+        size_t dictionaryMem = 0;
+        for (auto & d: dictionaries)
+            dictionaryMem += d->memusage();
+        INFO_MSG(logger) << "column dictionary memory is " << dictionaryMem;
+
+        if (!config.dataFileUrl.empty())
+            save(config.dataFileUrl);
+    }
+
+    /** Save the committed contents of the dataset to the given URL in a
+        format that can be memory mapped back in with load().
+
+        NOTE: must be called with the lock held, after finalize().
+    */
+    void save(const Url & dataFileUrl) const
+    {
+        Timer saveTimer;
+
+        makeUriDirectory(dataFileUrl.toDecodedString());
+        filter_ostream stream(dataFileUrl);
+        ML::DB::Store_Writer store(stream);
+        MappedColumnSink sink(store);
+
+        store << TABULAR_FILE_MAGIC << TABULAR_FILE_VERSION;
+        store << ML::DB::compact_size_t(fixedColumns.size());
+        for (auto & c: fixedColumns)
+            store << c.toUtf8String();
+        // The chunks refer to the dictionaries by code, so they come first
+        for (auto & d: dictionaries)
+            d->serialize(store);
+        store << earliestTs << latestTs;
+
+        store << ML::DB::compact_size_t(chunks.size());
+        for (auto & c: chunks)
+            c.serialize(sink);
+
+        // The order of the entries of each index is saved, which is all
+        // that's needed to set it up again on load
+        store << ML::DB::compact_size_t(secondaryIndexes.size());
+        for (auto & index: secondaryIndexes) {
+            store << index.columnName.toUtf8String() << (int)index.type;
+            store << ML::DB::compact_size_t(index.entries.size());
+            for (auto & e: index.entries) {
+                store << ML::DB::compact_size_t(e.chunk)
+                      << ML::DB::compact_size_t(e.row);
+            }
+        }
+
+        stream.close();
+
+        INFO_MSG(logger) << "saved " << chunks.size() << " chunks with "
+                         << rowCount << " rows to " << dataFileUrl
+                         << " in " << saveTimer.elapsed();
+    }
+
+    /** Load the dataset from a file written by save().  If the file can
+        be memory mapped, the bulk of the column data is used in place
+        without being copied; otherwise it is read into memory first.
+    */
+    void load(const Url & dataFileUrl)
+    {
+        Timer loadTimer;
+
+        filter_istream stream(dataFileUrl, { { "mapped", "true" } });
+
+        const char * mappedAddr;
+        size_t mappedSize;
+        std::tie(mappedAddr, mappedSize) = stream.mapped();
+
+        // Something that keeps the memory alive for as long as the
+        // columns refer to it
+        std::shared_ptr<const void> owner;
+
+        if (mappedAddr) {
+            owner = std::make_shared<filter_istream>(std::move(stream));
+        }
+        else {
+            auto contents = std::make_shared<std::string>(stream.readAll());
+            mappedAddr = contents->data();
+            mappedSize = contents->size();
+            owner = std::move(contents);
+        }
+
+        ML::DB::Store_Reader store(mappedAddr, mappedSize);
+        MappedColumnSource source(store, owner);
+        
+        std::string magic;
+        int version;
+        store >> magic >> version;
+        if (magic != TABULAR_FILE_MAGIC) {
+            throw HttpReturnException
+                (400, "File is not a tabular dataset file",
+                 "dataFileUrl", dataFileUrl);
+        }
+        if (version < 1 || version > TABULAR_FILE_VERSION) {
+            throw HttpReturnException
+                (400, "Unknown tabular dataset file version",
+                 "dataFileUrl", dataFileUrl,
+                 "version", version,
+                 "knownVersion", TABULAR_FILE_VERSION);
+        }
+
+        ML::DB::compact_size_t numFixedColumns(store);
+        std::vector<ColumnPath> columnNames;
+        columnNames.reserve(numFixedColumns);
+        for (size_t i = 0;  i < numFixedColumns;  ++i) {
+            Utf8String name;
+            store >> name;
+            columnNames.emplace_back(ColumnPath::parse(name));
+        }
+
+        // Version 2 and earlier files have no dictionaries
+        std::vector<std::shared_ptr<ColumnDictionary> > loadedDictionaries;
+        if (version >= 3) {
+            for (size_t i = 0;  i < numFixedColumns;  ++i) {
+                loadedDictionaries.emplace_back
+                    (ColumnDictionary::reconstitute(store));
+            }
+        }
+
+        Date earliest, latest;
+        store >> earliest >> latest;
+
+        ML::DB::compact_size_t numChunks(store);
+        std::vector<TabularDatasetChunk> loadedChunks;
+        loadedChunks.reserve(numChunks);
+        uint64_t totalRows = 0;
+        for (size_t i = 0;  i < numChunks;  ++i) {
+            loadedChunks.emplace_back
+                (TabularDatasetChunk::reconstitute(source, loadedDictionaries));
+            totalRows += loadedChunks.back().rowCount();
+        }
+
+        // Version 1 files have no secondary indexes
+        std::vector<SecondaryIndex> loadedIndexes;
+        if (version >= 2) {
+            ML::DB::compact_size_t numIndexes(store);
+            for (size_t i = 0;  i < numIndexes;  ++i) {
+                SecondaryIndex index;
+                Utf8String name;
+                int type;
+                store >> name >> type;
+                index.columnName = ColumnPath::parse(name);
+                index.type = (TabularIndexType)type;
+                ML::DB::compact_size_t numEntries(store);
+                index.entries.reserve(numEntries);
+                for (size_t j = 0;  j < numEntries;  ++j) {
+                    ML::DB::compact_size_t chunk(store), row(store);
+                    index.entries.push_back({ (uint32_t)chunk, (uint32_t)row });
+                }
+                loadedIndexes.emplace_back(std::move(index));
+            }
+        }
+
+        std::unique_lock<std::mutex> guard(datasetMutex);
+        initialize(std::move(columnNames));
+        if (!loadedDictionaries.empty())
+            dictionaries = std::move(loadedDictionaries);
+        earliestTs = earliest;
+        latestTs = latest;
+        finalize(loadedChunks, totalRows, std::move(loadedIndexes));
+
+        INFO_MSG(logger) << "loaded " << numChunks << " chunks with "
+                         << totalRows << " rows from " << dataFileUrl
+                         << " in " << loadTimer.elapsed();
     }
 
     /// The number of background jobs that we're currently waiting for
@@ -1227,6 +2195,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             return;
 
         ColumnFreezeParameters params;
+        params.dictionaries = dictionaries;
+        params.storage = storageAccount;
         auto job = [=] ()
             {
                 Scope_Exit(--this->backgroundJobsActive);
@@ -1258,11 +2228,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         if (!mc)
             return nullptr;
 
-        return std::make_shared<MutableTabularDatasetChunk>
-            (fixedColumns.size(),
-             expectedSize == -1
-             ? chunkSizeForNumColumns(fixedColumns.size())
-             : expectedSize);
+        return newMutableChunk(fixedColumns.size(),
+                               expectedSize == -1
+                               ? MAX_CHUNK_ROWS : expectedSize);
     }
 
     /** Analyze the first row to know what the columns are. */
@@ -1289,8 +2257,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
 
             for (auto & c: *newChunks) {
-                auto newChunk = std::make_shared<MutableTabularDatasetChunk>
-                    (fixedColumns.size(), chunkSizeForNumColumns(fixedColumns.size()));
+                auto newChunk = newMutableChunk(fixedColumns.size());
                 c.store(std::move(newChunk));
             }
             
@@ -1386,8 +2353,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             else if (written
                      == MutableTabularDatasetChunk::ADD_PERFORM_ROTATION) {
                 // We need a rotation, and we've been selected to do it
-                auto newChunk = std::make_shared<MutableTabularDatasetChunk>
-                    (fixedColumns.size(), chunkSizeForNumColumns(fixedColumns.size()));
+                auto newChunk = newMutableChunk(fixedColumns.size());
                 if (mc->chunks[chunkNum]
                     .compare_exchange_strong(chunkPtr, newChunk)) {
                     // Successful rotation.  First we background freeze
@@ -1401,15 +2367,30 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     }
 };
 
+constexpr size_t TabularDataset::TabularDataStore::TARGET_CHUNK_BYTES;
+constexpr size_t TabularDataset::TabularDataStore::MAX_CHUNK_ROWS;
+
 TabularDataset::
 TabularDataset(MldbServer * owner,
                PolyConfig config,
                const ProgressFunc & onProgress)
     : Dataset(owner)
 {
+    auto params = config.params.convert<TabularDatasetConfig>();
     itl = make_shared<TabularDataStore>(
-            config.params.convert<TabularDatasetConfig>(),
+            params,
             MLDB::getMldbLog<TabularDataset>());
+
+    // If we've been pointed to an existing file, then we load it up and
+    // are immediately committed.  Otherwise, the file will be written on
+    // commit.
+    if (!params.dataFileUrl.empty()
+        && tryGetUriObjectInfo(params.dataFileUrl.toDecodedString()).exists) {
+        itl->load(params.dataFileUrl);
+    }
+
+    // Rows are only queryable once they are committed
+    enableStatisticsCache();
 }
 
 TabularDataset::
@@ -1424,6 +2405,9 @@ getStatus() const
     Json::Value status;
     status["rowCount"] = itl->rowCount;
     status["columnCount"] = itl->columns.size();
+    StorageAccountStats storage = itl->storageAccount->getStats();
+    status["storageBytes"] = storage.bytes;
+    status["hugePageBytes"] = storage.hugePageBytes;
     return status;
 }
 
@@ -1463,6 +2447,14 @@ getRowExpr(const RowPath & row) const
     return itl->getRowExpr(row);
 }
 
+ExpressionValue
+TabularDataset::
+getProjectedRowExpr(const RowPath & row,
+                    const std::vector<ColumnPath> & columns) const
+{
+    return itl->getProjectedRowExpr(row, columns);
+}
+
 GenerateRowsWhereFunction
 TabularDataset::
 generateRowsWhere(const SqlBindingScope & context,
@@ -1472,7 +2464,7 @@ generateRowsWhere(const SqlBindingScope & context,
                   ssize_t limit) const
 {
     GenerateRowsWhereFunction fn
-        = itl->generateRowsWhere(context, where, offset, limit);
+        = itl->generateRowsWhere(context, alias, where, offset, limit);
     if (!fn)
         fn = Dataset::generateRowsWhere(context, alias, where, offset, limit);
     return fn;
@@ -1489,7 +2481,8 @@ void
 TabularDataset::
 commit()
 {
-    return itl->commit();
+    itl->commit();
+    Dataset::commit();
 }
 
 Dataset::MultiChunkRecorder
@@ -1544,6 +2537,34 @@ UnknownColumnActionDescription()
     addValue("add", UC_ADD, "Unknown columns will be added as a sparse column");
 };
 
+DEFINE_ENUM_DESCRIPTION(TabularIndexType);
+
+TabularIndexTypeDescription::
+TabularIndexTypeDescription()
+{
+    addValue("hash", TI_HASH, "Hash index, which speeds up equality "
+             "comparisons and IN with constants");
+    addValue("sorted", TI_SORTED, "Sorted index, which speeds up equality, "
+             "range comparisons and IN with constants");
+}
+
+TabularIndexConfig::
+TabularIndexConfig()
+    : type(TI_HASH)
+{
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(TabularIndexConfig);
+
+TabularIndexConfigDescription::
+TabularIndexConfigDescription()
+{
+    addField("column", &TabularIndexConfig::column,
+             "Column to index");
+    addField("type", &TabularIndexConfig::type,
+             "Type of the index", TI_HASH);
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
 
 TabularDatasetConfigDescription::
@@ -1556,6 +2577,18 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of a file in which the dataset is persisted.  If the file "
+             "exists when the dataset is created, the dataset is loaded from "
+             "it (memory mapping it where possible) and is immediately "
+             "available for querying; no more rows may be recorded.  "
+             "Otherwise, the dataset is written to the file when it is "
+             "committed.");
+    addField("indexes", &TabularDatasetConfig::indexes,
+             "Secondary indexes on columns, which are built when the "
+             "dataset is committed and are saved with it in `dataFileUrl`.  "
+             "They are used to find the rows matching a `WHERE` clause "
+             "that compares an indexed column with constants.");
 }
 
 namespace {
@@ -29,10 +29,31 @@ enum UnknownColumnAction {
 
 DECLARE_ENUM_DESCRIPTION(UnknownColumnAction);
 
+enum TabularIndexType {
+    TI_HASH,     ///< Hash index, for equality lookups
+    TI_SORTED    ///< Sorted index, for equality and range lookups
+};
+
+DECLARE_ENUM_DESCRIPTION(TabularIndexType);
+
+/** Secondary index on the values of a column, which is built when the
+    dataset is committed.
+*/
+struct TabularIndexConfig {
+    TabularIndexConfig();
+
+    ColumnPath column;
+    TabularIndexType type;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(TabularIndexConfig);
+
 struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+    Url dataFileUrl;
+    std::vector<TabularIndexConfig> indexes;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -54,6 +75,13 @@ struct TabularDataset : public Dataset {
     virtual std::shared_ptr<RowStream> getRowStream() const;
 
     virtual ExpressionValue getRowExpr(const RowPath & row) const;
+
+    /** Only reads the fixed and sparse columns that the query needs from
+        the chunk that holds the row.
+    */
+    virtual ExpressionValue
+    getProjectedRowExpr(const RowPath & row,
+                        const std::vector<ColumnPath> & columns) const;
     
     virtual std::pair<Date, Date> getTimestampRange() const;
 
@@ -7,6 +7,12 @@
 
 #include "tabular_dataset_chunk.h"
 #include "mldb/sql/expression_value.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/base/parallel.h"
 
 namespace MLDB {
 
@@ -155,6 +161,54 @@ getRowExpr(size_t index, const std::vector<ColumnPath> & fixedColumnNames) const
     return std::move(result);
 }
 
+ExpressionValue
+TabularDatasetChunk::
+getProjectedRowExpr(size_t index,
+                    const std::vector<ColumnPath> & fixedColumnNames,
+                    const std::vector<int> & fixedColumnIndexes,
+                    const ColumnProjection & projection) const
+{
+    ExcAssertLess(index, rowCount());
+    std::vector<std::tuple<ColumnPath, CellValue, Date> > result;
+    result.reserve(fixedColumnIndexes.size());
+    Date ts = timestamps->get(index).mustCoerceToTimestamp();
+    for (int i: fixedColumnIndexes) {
+        CellValue val = columns[i]->get(index);
+        if (val.empty())
+            continue;
+        result.emplace_back(fixedColumnNames[i], std::move(val), ts);
+    }
+
+    for (auto & c: sparseColumns) {
+        if (!projection.isNeeded(c.first))
+            continue;
+        CellValue val = c.second->get(index);
+        if (val.empty())
+            continue;
+        result.emplace_back(c.first, std::move(val), ts);
+    }
+    return std::move(result);
+}
+
+ExpressionValue
+TabularDatasetChunk::
+getFlatRowExpr(size_t index,
+               const std::shared_ptr<const FlatRowSchema> & schema,
+               const std::vector<int> & columnOrder) const
+{
+    ExcAssertLess(index, rowCount());
+    ExcAssert(sparseColumns.empty());
+    ExcAssertEqual(columnOrder.size(), columns.size());
+
+    std::vector<CellValue> values;
+    values.reserve(columnOrder.size());
+    for (int c: columnOrder)
+        values.emplace_back(columns[c]->get(index));
+
+    Date ts = timestamps->get(index).mustCoerceToTimestamp();
+    return ExpressionValue(std::move(values), schema, ts);
+}
+
 void
 TabularDatasetChunk::
 addToColumn(int columnIndex,
@@ -190,47 +244,161 @@ addToColumn(int columnIndex,
     }
 }
 
+void
+TabularDatasetChunk::
+serialize(MappedColumnSink & sink) const
+{
+    ML::DB::Store_Writer & store = sink.store;
+    store << (char)1; // version
+
+    store << ML::DB::compact_size_t(columns.size());
+    for (auto & c: columns)
+        FrozenColumn::serializeColumn(*c, sink);
+
+    store << ML::DB::compact_size_t(sparseColumns.size());
+    for (auto & c: sparseColumns) {
+        store << c.first.toUtf8String();
+        FrozenColumn::serializeColumn(*c.second, sink);
+    }
+
+    // Integer row names are stored as a mapped array; others need to be
+    // parsed back in.
+    store << rowNames.empty();
+    if (rowNames.empty()) {
+        store << ML::DB::compact_size_t(integerRowNames.size());
+        sink.writeArray(integerRowNames.data(), integerRowNames.size());
+    }
+    else {
+        store << ML::DB::compact_size_t(rowNames.size());
+        for (auto & r: rowNames)
+            store << r.toUtf8String();
+    }
+
+    FrozenColumn::serializeColumn(*timestamps, sink);
+}
+
+TabularDatasetChunk
+TabularDatasetChunk::
+reconstitute(MappedColumnSource & source,
+             const std::vector<std::shared_ptr<ColumnDictionary> > & dictionaries)
+{
+    ML::DB::Store_Reader & store = source.store;
+    char version;
+    store >> version;
+    if (version != 1) {
+        throw HttpReturnException
+            (500, "Unknown tabular dataset chunk version",
+             "version", (int)version);
+    }
+
+    ML::DB::compact_size_t numColumns(store);
+    TabularDatasetChunk result(numColumns);
+    for (size_t i = 0;  i < result.columns.size();  ++i) {
+        source.dictionary
+            = i < dictionaries.size() ? dictionaries[i] : nullptr;
+        result.columns[i] = FrozenColumn::reconstitute(source);
+    }
+    source.dictionary = nullptr;
+
+    ML::DB::compact_size_t numSparseColumns(store);
+    result.sparseColumns.reserve(numSparseColumns);
+    for (size_t i = 0;  i < numSparseColumns;  ++i) {
+        Utf8String name;
+        store >> name;
+        auto column = FrozenColumn::reconstitute(source);
+        result.sparseColumns.emplace(Path::parse(name), std::move(column));
+    }
+
+    bool integerRowNames;
+    store >> integerRowNames;
+    ML::DB::compact_size_t numRows(store);
+    if (integerRowNames) {
+        auto mapped = source.mapArray<uint64_t>(numRows);
+        result.integerRowNames.assign(mapped.get(), mapped.get() + numRows);
+    }
+    else {
+        result.rowNames.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            Utf8String name;
+            store >> name;
+            result.rowNames.emplace_back(Path::parse(name));
+        }
+    }
+
+    result.timestamps = FrozenColumn::reconstitute(source);
+
+    return result;
+}
+
 
 /*****************************************************************************/
 /* MUTABLE TABULAR DATASET CHUNK                                             */
 /*****************************************************************************/
 
 MutableTabularDatasetChunk::
-MutableTabularDatasetChunk(size_t numColumns, size_t maxSize)
-    : maxSize(maxSize), rowCount_(0),
+MutableTabularDatasetChunk(size_t numColumns, size_t maxSize,
+                           size_t maxBytes)
+    : maxSize(maxSize), maxBytes(maxBytes), bytesUsed(0), rowCount_(0),
       columns(numColumns), isFrozen(false),
       addFailureNotified(false)
 {
-    timestamps.reserve(maxSize);
-    integerRowNames.reserve(maxSize);
+    // Reserve for as many rows as fit in maxBytes if the values are
+    // small; bigger ones will fill it before then
+    size_t expectedRows
+        = std::min(maxSize, maxBytes / ((numColumns + 2) * sizeof(CellValue)));
+    expectedRows = std::max<size_t>(std::min<size_t>(maxSize, 16),
+                                    expectedRows);
+
+    timestamps.reserve(expectedRows);
+    integerRowNames.reserve(expectedRows);
     for (unsigned i = 0;  i < numColumns;  ++i)
-        columns[i].reserve(maxSize);
+        columns[i].reserve(expectedRows);
 }
 
 TabularDatasetChunk
 MutableTabularDatasetChunk::
 freeze(const ColumnFreezeParameters & params)
 {
-    std::unique_lock<std::mutex> guard(mutex);
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        ExcAssert(!isFrozen);
+        isFrozen = true;
+    }
 
-    ExcAssert(!isFrozen);
+    // From here on add() doesn't touch the chunk, so the lock isn't
+    // needed.  It mustn't be held while the columns are frozen, as this
+    // thread may run a job that records into the chunk while it waits.
 
     TabularDatasetChunk result;
     result.columns.resize(columns.size());
     result.sparseColumns.reserve(sparseColumns.size());
 
-    for (unsigned i = 0;  i < columns.size();  ++i)
-        result.columns[i] = columns[i].freeze(params);
+    // The columns are independent, so they're frozen in parallel.  This
+    // matters most for the last chunks, which are frozen while commit()
+    // waits.
+    auto freezeColumn = [&] (size_t i)
+        {
+            ColumnFreezeParameters columnParams = params;
+            columnParams.dictionary
+                = i < params.dictionaries.size()
+                ? params.dictionaries[i] : nullptr;
+            result.columns[i] = columns[i].freeze(columnParams);
+        };
+
+    parallelMap(0, columns.size(), freezeColumn);
+
+    // Sparse columns come and go between chunks, so they keep their own
+    // values
+    ColumnFreezeParameters columnParams = params;
+    columnParams.dictionary = nullptr;
     for (auto & c: sparseColumns)
-        result.sparseColumns.emplace(c.first, c.second.freeze(params));
+        result.sparseColumns.emplace(c.first, c.second.freeze(columnParams));
 
-    result.timestamps = timestamps.freeze(params);
+    result.timestamps = timestamps.freeze(columnParams);
 
     result.rowNames = std::move(rowNames);
     result.integerRowNames = std::move(integerRowNames);
 
-    isFrozen = true;
-
     return result;
 }
 
@@ -247,7 +415,7 @@ add(RowPath & rowName,
         return ADD_AWAIT_ROTATION;
     size_t numRows = rowCount_;
 
-    if (numRows == maxSize) {
+    if (numRows == maxSize || (numRows > 0 && bytesUsed >= maxBytes)) {
         if (addFailureNotified)
             return ADD_AWAIT_ROTATION;
         else {
@@ -258,12 +426,20 @@ add(RowPath & rowName,
 
     ExcAssertEqual(columns.size(), numVals);
 
+    size_t rowBytes = sizeof(uint64_t) + sizeof(double);
+    for (size_t i = 0;  i < numVals;  ++i)
+        rowBytes += vals[i].memusage();
+    for (auto & e: extra)
+        rowBytes += e.second.memusage() + sizeof(std::pair<uint32_t, uint32_t>);
+
     uint64_t intRowName;
 
     if (!rowNames.empty() || (intRowName = rowName.toIndex()) == -1) {
+        rowBytes += rowName.memusage();
+
         // Non-integer row name
         if (rowNames.empty()) {
-            rowNames.reserve(maxSize);
+            rowNames.reserve(integerRowNames.capacity());
             for (auto & n: integerRowNames)
                 rowNames.emplace_back(n);
             integerRowNames.clear();
@@ -286,6 +462,7 @@ add(RowPath & rowName,
     }
 
     ++rowCount_;
+    bytesUsed += rowBytes;
 
     return ADD_SUCCEEDED;
 }
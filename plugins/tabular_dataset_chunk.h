@@ -96,11 +96,44 @@ public:
     ExpressionValue
     getRowExpr(size_t index, const std::vector<Path> & fixedColumnNames) const;
 
+    /** Get the row with the given index, with only the fixed columns at
+        the given indexes (in that order) and the sparse columns that the
+        projection needs.
+    */
+    ExpressionValue
+    getProjectedRowExpr(size_t index,
+                        const std::vector<Path> & fixedColumnNames,
+                        const std::vector<int> & fixedColumnIndexes,
+                        const ColumnProjection & projection) const;
+
+    /** Get the row with the given index as a flat row with the given
+        schema.  The schema's columns are the fixed columns, in the order
+        given by columnOrder (which holds an index into columns for each
+        of them).  The chunk must not have any sparse columns.
+    */
+    ExpressionValue
+    getFlatRowExpr(size_t index,
+                   const std::shared_ptr<const FlatRowSchema> & schema,
+                   const std::vector<int> & columnOrder) const;
+
     /// Add the given column to the column with the given index
     void addToColumn(int columnIndex,
                      const Path & colName,
                      std::vector<std::tuple<Path, CellValue, Date> > & rows,
                      bool dense) const;
+
+    /// Serialize the chunk, so that it can be memory mapped back in
+    void serialize(MappedColumnSink & sink) const;
+
+    /** Reconstitute a chunk serialized with serialize().  The dictionaries
+        are those of the dataset's fixed columns, which must be the same
+        as the chunk was frozen with.
+    */
+    static TabularDatasetChunk
+    reconstitute(MappedColumnSource & source,
+                 const std::vector<std::shared_ptr<ColumnDictionary> > & dictionaries
+                     = std::vector<std::shared_ptr<ColumnDictionary> >());
+
     friend class MutableTabularDatasetChunk;
 };
 
@@ -111,11 +144,18 @@ public:
 
 struct MutableTabularDatasetChunk {
 
-    MutableTabularDatasetChunk(size_t numColumns, size_t maxSize);
+    /** Create a chunk that holds up to maxSize rows, or fewer if they
+        take up more than about maxBytes of memory between them.
+    */
+    MutableTabularDatasetChunk(size_t numColumns, size_t maxSize,
+                               size_t maxBytes = -1);
 
     MutableTabularDatasetChunk(MutableTabularDatasetChunk && other) noexcept = delete;
     MutableTabularDatasetChunk & operator = (MutableTabularDatasetChunk && other) noexcept = delete;
 
+    /** Freeze the chunk.  Each fixed column is frozen with the dictionary
+        at its index in params.dictionaries, if there is one.
+    */
     TabularDatasetChunk freeze(const ColumnFreezeParameters & params);
 
     /// Protect access in a multithreaded context
@@ -124,6 +164,12 @@ struct MutableTabularDatasetChunk {
     /// Maximum size
     size_t maxSize;
 
+    /// Memory that the rows may use before the chunk needs rotating
+    size_t maxBytes;
+
+    /// Approximate memory used by the rows added so far
+    size_t bytesUsed;
+
     /// Number of rows added so far
     size_t rowCount_;
 
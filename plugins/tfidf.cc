@@ -25,6 +25,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/server/per_thread_accumulator.h"
 #include "mldb/utils/log.h"
 
 using namespace std;
@@ -198,12 +199,14 @@ run(const ProcedureRunConfig & run,
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.trainingData.stm->from->bind(context, convertProgressToJson);
 
-    //This will cummulate the number of documents each word is in
-    std::unordered_map<Utf8String, uint64_t> dfs;
+    //This will cummulate the number of documents each word is in.  Each
+    //thread counts into its own map, which are merged at the end.
+    PerThreadAccumulator<std::unordered_map<Utf8String, uint64_t> > threadDfs;
     std::atomic<uint64_t> corpusSize(0);
 
     auto processor = [&] (NamedRowValue & row_)
         {
+            auto & dfs = threadDfs.get();
             MatrixNamedRow row = row_.flattenDestructive();
             for (auto& col : row.columns) {
                 Utf8String word = get<0>(col).toUtf8String();
@@ -217,12 +220,23 @@ run(const ProcedureRunConfig & run,
     iterateDataset(runProcConf.trainingData.stm->select, *boundDataset.dataset, boundDataset.asName,
                    runProcConf.trainingData.stm->when,
                    *runProcConf.trainingData.stm->where,
-                   {processor,false/*processInParallel*/},
+                   {processor,true/*processInParallel*/},
                    runProcConf.trainingData.stm->orderBy,
                    runProcConf.trainingData.stm->offset,
                    runProcConf.trainingData.stm->limit,
                    convertProgressToJson);
 
+    std::unordered_map<Utf8String, uint64_t> dfs;
+    threadDfs.forEach([&] (std::unordered_map<Utf8String, uint64_t> * thr)
+        {
+            if (dfs.empty()) {
+                dfs = std::move(*thr);
+                return;
+            }
+            for (auto & df: *thr)
+                dfs[df.first] += df.second;
+        });
+
     bool saved = false;
     if (!runProcConf.modelFileUrl.empty()) {
         try {
@@ -303,6 +317,77 @@ TfidfFunctionConfigDescription()
 }
 
 
+/*****************************************************************************/
+/* TFIDF VOCABULARY                                                          */
+/*****************************************************************************/
+
+double
+calcIdf(IDFType idfType, uint64_t corpusSize, uint64_t maxNt,
+        double numberOfRelevantDoc)
+{
+    switch (idfType) {
+    case IDF_inverse:
+        return std::log(corpusSize / (1 + numberOfRelevantDoc));
+    case IDF_inverseSmooth:
+        return std::log(1 + (corpusSize / (1 + numberOfRelevantDoc)));
+    case IDF_inverseMax:
+        return std::log(1 + (maxNt) / (1 + numberOfRelevantDoc));
+    case IDF_probabilistic_inverse:
+        return std::log((corpusSize - numberOfRelevantDoc)
+                        / (1 + numberOfRelevantDoc));
+    case IDF_unary:
+    default:
+        return 1.0f;
+    }
+}
+
+TfidfVocabulary::
+TfidfVocabulary()
+    : mask(0)
+{
+}
+
+void
+TfidfVocabulary::
+init(const std::unordered_map<Utf8String, uint64_t> & dfsIn,
+     uint64_t corpusSize, IDFType idfType)
+{
+    terms.clear();
+    dfs.clear();
+    idfs.clear();
+    slots.clear();
+    mask = 0;
+
+    if (dfsIn.empty())
+        return;
+
+    terms.reserve(dfsIn.size());
+    dfs.reserve(dfsIn.size());
+    idfs.reserve(dfsIn.size());
+
+    // Keep the table at most half full, so that probe sequences are short
+    size_t numSlots = 1;
+    while (numSlots < 2 * dfsIn.size())
+        numSlots *= 2;
+    slots.resize(numSlots, 0);
+    mask = numSlots - 1;
+
+    for (auto & df: dfsIn) {
+        PathElement term(df.first);
+        uint64_t slot = term.newHash() & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+
+        terms.emplace_back(std::move(term));
+        dfs.push_back(df.second);
+        // inverseMax depends on the document, so is calculated on apply
+        idfs.push_back(idfType == IDF_inverseMax
+                       ? 0.0 : calcIdf(idfType, corpusSize, 0, df.second));
+        slots[slot] = terms.size();
+    }
+}
+
+
 /*****************************************************************************/
 /* TFIDF FUNCTION                                                            */
 /*****************************************************************************/
@@ -314,7 +399,9 @@ TfidfFunction(MldbServer * owner,
     : Function(owner, config)
 {
     functionConfig = config.params.convert<TfidfFunctionConfig>();
+    std::unordered_map<Utf8String, uint64_t> dfs;
     load(functionConfig.modelFileUrl.toString(), corpusSize, dfs);
+    vocabulary.init(dfs, corpusSize, functionConfig.idf_type);
 }
 
 Any
@@ -339,99 +426,54 @@ apply(const FunctionApplier & applier,
     auto onColumn = [&] (const PathElement & name,
                          const ExpressionValue & val)
         {
-            Utf8String term = name.toUtf8String();
             uint64_t value = val.getAtom().toUInt();
             maxFrequency = std::max(value, maxFrequency);
-            const auto termFrequency = dfs.find(term);
-            if (termFrequency != dfs.end())
-                maxNt = std::max(maxNt, termFrequency->second); 
+            ssize_t index = vocabulary.find(name);
+            if (index != -1)
+                maxNt = std::max(maxNt, vocabulary.dfs[index]);
             return true;
         };
 
     inputVal.forEachColumn(onColumn);
 
-    // the different possible TF scores
-    auto tf_raw = [=] (double frequency) {
-        return frequency;
-    };
-    auto tf_log = [=] (double frequency) {
-        return (std::log(1.0f + frequency));
-    };
-    auto tf_augmented = [=] (double frequency) {
-        return 0.5f + (0.5f * frequency) / maxFrequency;
-    };
-
-    std::function<double(double)> tf_fct = tf_raw;
-
-    switch (functionConfig.tf_type)
-    {
-        case TF_log:
-            tf_fct = tf_log;
-        break;
-        case TF_augmented:
-            tf_fct = tf_augmented;
-        break;
-        default:
-        break;
-    }
-
-    // the different possible IDF scores
-    auto idf_unary = [=] (double numberOfRelevantDoc) {
-        return 1.0f;
-    };
-
-    auto idf_inverse = [=] (double numberOfRelevantDoc) {
-        return std::log(corpusSize / (1 + numberOfRelevantDoc));
-    };
-    auto idf_inverseSmooth = [=] (double numberOfRelevantDoc) {
-        return std::log(1 + (corpusSize / (1 + numberOfRelevantDoc)));
-    };
-    auto idf_inverseMax = [=] (double numberOfRelevantDoc) {
-        return std::log(1 + (maxNt) / (1 + numberOfRelevantDoc));
-    };
-    auto idf_probabilistic_inverse = [=] (double numberOfRelevantDoc) {
-        return std::log((corpusSize - numberOfRelevantDoc) / (1 + numberOfRelevantDoc));
-    };
-
-    std::function<double(double)> idf_fct = idf_unary;
-
-    switch (functionConfig.idf_type)
-    {
-        case IDF_inverse:
-            idf_fct = idf_inverse;
-        break;
-        case IDF_inverseSmooth:
-            idf_fct = idf_inverseSmooth;
-        break;
-        case IDF_inverseMax:
-            idf_fct = idf_inverseMax;
-        break;
-        case IDF_probabilistic_inverse:
-            idf_fct = idf_probabilistic_inverse;
-        break;
-        default:
-        break;
-    }
-
     RowValue values;
     Date ts = inputVal.getEffectiveTimestamp();
 
     // Compute the score for every word in the input
     DEBUG_MSG(logger) << "corpus size: " << corpusSize;
 
+    IDFType idfType = functionConfig.idf_type;
+
     auto onColumn2 = [&] (const PathElement & name,
                           const ExpressionValue & val)
         {
-            Utf8String term = name.toUtf8String();
             double frequency = val.getAtom().toDouble();
 
-            double tf = tf_fct(frequency);
-            const auto docFrequency = dfs.find(term);
-            uint64_t docFrequencyInt = docFrequency != dfs.end() ? docFrequency->second : 0;
-            double idf = idf_fct(docFrequencyInt);
+            double tf;
+            switch (functionConfig.tf_type) {
+            case TF_log:
+                tf = std::log(1.0f + frequency);
+                break;
+            case TF_augmented:
+                tf = 0.5f + (0.5f * frequency) / maxFrequency;
+                break;
+            default:
+                tf = frequency;
+                break;
+            }
+
+            ssize_t index = vocabulary.find(name);
+            uint64_t docFrequencyInt = index != -1 ? vocabulary.dfs[index] : 0;
+
+            // The IDF of known terms was calculated when we loaded, apart
+            // from inverseMax which depends upon the document
+            double idf;
+            if (index != -1 && idfType != IDF_inverseMax)
+                idf = vocabulary.idfs[index];
+            else idf = calcIdf(idfType, corpusSize, maxNt, docFrequencyInt);
 
             DEBUG_MSG(logger)
-                << "term: '" << term << "', df: "
+                << "term: '" << name << "', df: "
                 << docFrequencyInt << ", tf: " << tf << ", idf: " << idf;
 
             values.emplace_back(name, tf*idf, ts);
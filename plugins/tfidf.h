@@ -89,6 +89,51 @@ struct TfidfFunctionConfig {
 
 DECLARE_STRUCTURE_DESCRIPTION(TfidfFunctionConfig);
 
+/** Document frequencies of the terms of a trained tf-idf model, frozen
+    into contiguous arrays when the function is loaded.  The terms are
+    found through an open addressed hash table of indexes into those
+    arrays, so that looking up a term of a document doesn't allocate.
+*/
+
+struct TfidfVocabulary {
+    TfidfVocabulary();
+
+    /** Build the table from the document frequencies.  The IDF of each term
+        is calculated once here, except for IDF_inverseMax which depends
+        upon the document.
+    */
+    void init(const std::unordered_map<Utf8String, uint64_t> & dfs,
+              uint64_t corpusSize, IDFType idfType);
+
+    /** Return the index of the term in the arrays, or -1 if it's not in
+        the vocabulary.
+    */
+    ssize_t find(const PathElement & term) const
+    {
+        if (slots.empty())
+            return -1;
+        for (uint64_t slot = term.newHash() & mask;  ; slot = (slot + 1) & mask) {
+            uint32_t index = slots[slot];
+            if (index == 0)
+                return -1;
+            if (terms[index - 1] == term)
+                return index - 1;
+        }
+    }
+
+    std::vector<PathElement> terms;  ///< Term for each index
+    std::vector<uint64_t> dfs;       ///< Document frequency for each index
+    std::vector<double> idfs;        ///< IDF for each index
+
+private:
+    std::vector<uint32_t> slots;     ///< 1 + index, or 0 if empty
+    uint64_t mask;
+};
+
+/** Calculate the IDF of a term from its document frequency. */
+double calcIdf(IDFType idfType, uint64_t corpusSize, uint64_t maxNt,
+               double numberOfRelevantDoc);
+
 struct TfidfFunction: public Function {
     TfidfFunction(MldbServer * owner,
                 PolyConfig config,
@@ -104,7 +149,7 @@ struct TfidfFunction: public Function {
 
     TfidfFunctionConfig functionConfig;
     // document frequencies for terms
-    std::unordered_map<Utf8String, uint64_t> dfs;
+    TfidfVocabulary vocabulary;
     uint64_t corpusSize;
 };
 
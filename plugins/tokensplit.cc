@@ -110,6 +110,14 @@ TokenSplit(MldbServer * owner,
     
     // sorting is important here - it is used to optimize the tokenization
     std::sort(dictionary.begin(), dictionary.end());
+
+    asciiSplitChars.fill(false);
+    for (uint32_t c: functionConfig.splitchars) {
+        if (c < asciiSplitChars.size())
+            asciiSplitChars[c] = true;
+        else otherSplitChars.push_back(c);
+    }
+    std::sort(otherSplitChars.begin(), otherSplitChars.end());
 }
 
 Any
@@ -143,20 +151,19 @@ apply(const FunctionApplier & applier,
             Utf8String subString(startIt, it);
             bool found = false;
             bool startFound = false;
-            for (auto& token : dictionary) {
 
-                if (token == subString) {
-                    //found an exact token, but there could be a longer one
-                    found = true;
-                }
-                else if (token.startsWith(subString)) {
-                    //found a token that starts with the sub string
-                    startFound = true;
-                }
-                else if (found || startFound) {
-                    //because its sorted, we can stop here
-                    break;
-                }
+            //because its sorted, the tokens that start with the sub string
+            //come right after it
+            auto tokenIt = std::lower_bound(dictionary.begin(), dictionary.end(),
+                                            subString);
+            while (tokenIt != dictionary.end() && *tokenIt == subString) {
+                //found an exact token, but there could be a longer one
+                found = true;
+                ++tokenIt;
+            }
+            if (tokenIt != dictionary.end() && tokenIt->startsWith(subString)) {
+                //found a token that starts with the sub string
+                startFound = true;
             }
 
             if (found) {
@@ -203,8 +210,6 @@ apply(const FunctionApplier & applier,
 
     //check if there is already a separator
 
-    auto& splitchars = functionConfig.splitchars;
-
     std::vector<int> insertionNeeded;
     auto it = textstring.begin();
     int pos = 0;
@@ -219,19 +224,9 @@ apply(const FunctionApplier & applier,
         if (it == textstring.end())
             break;
 
-        //Check if that character is one of several possible separators
-        auto splitCharIt = splitchars.begin();
-        bool found = false;
-        while (splitCharIt != splitchars.end()) {
-            if (*it == *splitCharIt) {
-                found = true;
-                break;
-            }
-            ++splitCharIt;
-        }
-
-        //if not, mark for insertion
-        if (!found)
+        //Check if that character is one of several possible separators,
+        //and if not, mark for insertion
+        if (!isSplitChar(*it))
             insertionNeeded.push_back(insert.second);
     }
 
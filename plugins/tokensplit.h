@@ -13,6 +13,8 @@
 #include "mldb/core/function.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/types/optional.h"
+#include <algorithm>
+#include <array>
 
 
 namespace MLDB {
@@ -51,7 +53,25 @@ struct TokenSplit: public Function {
    
     TokenSplitConfig functionConfig;
 
+    /// Tokens to split, sorted so that those that start with the same
+    /// string are next to each other
     std::vector<Utf8String> dictionary;
+
+private:
+    /// Is the character one of the splitChars?
+    bool isSplitChar(uint32_t c) const
+    {
+        if (c < asciiSplitChars.size())
+            return asciiSplitChars[c];
+        return std::binary_search(otherSplitChars.begin(),
+                                  otherSplitChars.end(), c);
+    }
+
+    /// Lookup table for the splitChars that are ASCII
+    std::array<bool, 128> asciiSplitChars;
+
+    /// The other splitChars, in sorted order
+    std::vector<uint32_t> otherSplitChars;
 };
 
 
@@ -35,6 +35,26 @@
 using namespace std;
 
 
+namespace ML {
+
+DEFINE_ENUM_DESCRIPTION_NAMED(TSNE_RepulsionDescription, ML::TSNE_Repulsion);
+
+TSNE_RepulsionDescription::
+TSNE_RepulsionDescription()
+{
+    addValue("barnesHut", ML::TSNE_BARNES_HUT,
+             "Barnes-Hut approximation, which groups far away points into "
+             "the cells of a quadtree.  Works for any number of output "
+             "dimensions.");
+    addValue("interpolation", ML::TSNE_INTERPOLATION,
+             "Interpolation of the points onto a grid, with the forces "
+             "between grid points calculated using FFTs (FIt-SNE).  It "
+             "scales linearly with the number of points, and is much faster "
+             "than Barnes-Hut for large datasets.  Only available for two "
+             "output dimensions; Barnes-Hut is used for others.");
+}
+
+} // namespace ML
 
 namespace MLDB {
 
@@ -80,6 +100,10 @@ TsneConfigDescription()
              "may jump over the best optimal point. In general, the learning rate "
              "should be between 100 and 1000.",
              500.0);
+    addField("repulsion", &TsneConfig::repulsion,
+             "Method used to approximate the repulsive forces between all "
+             "of the points at each iteration.",
+             ML::TSNE_BARNES_HUT);
     addField("modelFileUrl", &TsneConfig::modelFileUrl,
              "URL where the model file (with extension '.tsn') should be saved. "
              "This file can be loaded by the ![](%%doclink tsne.embedRow function). "
@@ -241,6 +265,7 @@ run(const ProcedureRunConfig & run,
     itl->params.perplexity = runProcConf.perplexity;
     itl->params.tolerance = runProcConf.tolerance;
     itl->params.eta = runProcConf.learningRate;
+    itl->params.repulsion = runProcConf.repulsion;
 
     DEBUG_MSG(logger) << "perplexity = " << itl->params.perplexity;
     DEBUG_MSG(logger) << "tolerance = " << itl->params.tolerance;
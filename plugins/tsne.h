@@ -14,8 +14,15 @@
 #include "mldb/core/value_function.h"
 #include "matrix.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/ml/tsne/tsne.h"
 
 
+namespace ML {
+
+DECLARE_ENUM_DESCRIPTION_NAMED(TSNE_RepulsionDescription, ML::TSNE_Repulsion);
+
+} // namespace ML
+
 namespace MLDB {
 
 struct TsneItl;
@@ -28,7 +35,8 @@ struct TsneConfig : public ProcedureConfig {
           numOutputDimensions(2),
           tolerance(1e-5),
           perplexity(30.0),
-          learningRate(500.0)
+          learningRate(500.0),
+          repulsion(ML::TSNE_BARNES_HUT)
     {
         output.withType("embedding");
     }
@@ -43,6 +51,7 @@ struct TsneConfig : public ProcedureConfig {
     double tolerance;
     double perplexity;
     double learningRate;
+    ML::TSNE_Repulsion repulsion;
 
     Utf8String functionName;
 };
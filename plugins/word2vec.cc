@@ -17,6 +17,17 @@
 #include "mldb/utils/log.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/server/analytics.h"
+#include "mldb/base/parallel.h"
+#include "mldb/utils/progress.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/plugins/sql_config_validator.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <cmath>
 
 using namespace std;
 
@@ -251,5 +262,531 @@ regScript(builtinPackage(),
           "procedures/Word2VecImporter.md.html");
 
 
+/*****************************************************************************/
+/* WORD2VEC TRAINER                                                          */
+/*****************************************************************************/
+
+enum Word2VecModel {
+    W2V_SKIP_GRAM,
+    W2V_CBOW
+};
+
+DECLARE_ENUM_DESCRIPTION(Word2VecModel);
+DEFINE_ENUM_DESCRIPTION(Word2VecModel);
+
+Word2VecModelDescription::
+Word2VecModelDescription()
+{
+    addValue("skipGram", W2V_SKIP_GRAM,
+             "Predict each of the words around a word from the word itself.  "
+             "This is slower but gives better embeddings for rare words.");
+    addValue("cbow", W2V_CBOW,
+             "Continuous bag of words: predict each word from the average "
+             "of the words around it.  This is several times faster than "
+             "skip-gram.");
+}
+
+struct Word2VecTrainerConfig : ProcedureConfig {
+    static constexpr const char * name = "word2vec.train";
+
+    Word2VecTrainerConfig()
+        : model(W2V_SKIP_GRAM), dimensions(100), windowSize(5),
+          negativeSamples(5), minCount(5), sample(1e-3),
+          numIterations(5), learningRate(0.025), seed(1)
+    {
+        output.withType("embedding");
+    }
+
+    InputQuery trainingData;
+    PolyConfigT<Dataset> output;
+    Word2VecModel model;
+    int dimensions;
+    int windowSize;
+    int negativeSamples;
+    int minCount;
+    double sample;
+    int numIterations;
+    double learningRate;
+    int seed;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(Word2VecTrainerConfig);
+
+DEFINE_STRUCTURE_DESCRIPTION(Word2VecTrainerConfig);
+
+Word2VecTrainerConfigDescription::
+Word2VecTrainerConfigDescription()
+{
+    addField("trainingData", &Word2VecTrainerConfig::trainingData,
+             "An SQL query to provide the text to train on.  Each string "
+             "value of each row is taken as a piece of text, which is split "
+             "into words on whitespace.  Words are not normalized in any "
+             "way, so the text should be lowercased and have its "
+             "punctuation removed beforehand if needed.");
+    addField("outputDataset", &Word2VecTrainerConfig::output,
+             "Output dataset for the embedding.  There is one row per word "
+             "of the vocabulary, named after the word, with one column per "
+             "dimension.",
+             PolyConfigT<Dataset>().withType("embedding"));
+    addField("model", &Word2VecTrainerConfig::model,
+             "Model to train", W2V_SKIP_GRAM);
+    addField("dimensions", &Word2VecTrainerConfig::dimensions,
+             "Number of dimensions of the embedding", 100);
+    addField("windowSize", &Word2VecTrainerConfig::windowSize,
+             "Maximum number of words either side of a word that are "
+             "taken to be its context.  The window used for each word is "
+             "picked at random up to this size, which weighs closer words "
+             "more.", 5);
+    addField("negativeSamples", &Word2VecTrainerConfig::negativeSamples,
+             "Number of words drawn at random, from the unigram "
+             "distribution raised to the 3/4 power, to contrast with each "
+             "word that is predicted", 5);
+    addField("minCount", &Word2VecTrainerConfig::minCount,
+             "Words that occur fewer times than this in the training data "
+             "are removed before training, and have no embedding.", 5);
+    addField("sample", &Word2VecTrainerConfig::sample,
+             "Threshold for the subsampling of frequent words.  Words with "
+             "a frequency above this are randomly skipped, more often the "
+             "more frequent they are.  Set to 0 to disable subsampling.",
+             1e-3);
+    addField("numIterations", &Word2VecTrainerConfig::numIterations,
+             "Number of passes over the training data", 5);
+    addField("learningRate", &Word2VecTrainerConfig::learningRate,
+             "Learning rate at the start of training.  It decreases "
+             "linearly to nearly zero by the end.  "
+             "A value of 0.05 usually works better for the `cbow` model.",
+             0.025);
+    addField("seed", &Word2VecTrainerConfig::seed,
+             "Seed for the random number generator.  Since the threads "
+             "update the same weights as they go, training is not "
+             "repeatable even with the same seed.", 1);
+    addParent<ProcedureConfig>();
+
+    onPostValidate = [] (Word2VecTrainerConfig * cfg,
+                         JsonParsingContext & context)
+        {
+            MustContainFrom()(cfg->trainingData, Word2VecTrainerConfig::name);
+            if (cfg->dimensions <= 0 || cfg->windowSize <= 0
+                || cfg->negativeSamples <= 0 || cfg->numIterations <= 0
+                || cfg->learningRate <= 0.0 || cfg->sample < 0.0) {
+                throw MLDB::Exception(std::string(Word2VecTrainerConfig::name)
+                                      + ": dimensions, windowSize, "
+                                      "negativeSamples, numIterations and "
+                                      "learningRate must be positive, and "
+                                      "sample must not be negative");
+            }
+        };
+}
+
+namespace {
+
+/** Skip-gram and CBOW with negative sampling (Mikolov et al., 2013).
+
+    As with the original word2vec tool, the weights are updated by all of
+    the threads at once without any locking (Hogwild; Niu et al., 2011).
+    Each update only touches the rows of a few words, so that collisions
+    are rare and don't hurt convergence, and training scales with the
+    number of cores.
+*/
+struct Word2VecTraining {
+
+    Word2VecTraining(const Word2VecTrainerConfig & config,
+                     const std::vector<uint64_t> & counts,
+                     const std::vector<int> & corpus,
+                     const std::vector<size_t> & sentenceStarts)
+        : config(config), dims(config.dimensions),
+          corpus(corpus), sentenceStarts(sentenceStarts), wordsDone(0)
+    {
+        size_t numWords = counts.size();
+
+        // Input vectors start small and random, output vectors at zero
+        embedding.resize(numWords * dims);
+        uint64_t rng = config.seed;
+        for (float & v: embedding) {
+            rng = rng * 25214903917ULL + 11;
+            v = (((rng & 0xFFFF) / 65536.0) - 0.5) / dims;
+        }
+        output.resize(numWords * dims, 0.0);
+
+        // Table to draw the negative samples in constant time
+        double total = 0.0;
+        for (auto c: counts)
+            total += pow(c, 0.75);
+        size_t tableSize = std::min<size_t>(10000000, numWords * 1000);
+        unigrams.reserve(tableSize);
+        double cumulative = 0.0;
+        for (size_t w = 0;  w < numWords;  ++w) {
+            cumulative += pow(counts[w], 0.75) / total;
+            while (unigrams.size() < tableSize
+                   && unigrams.size() < cumulative * tableSize)
+                unigrams.push_back(w);
+        }
+        while (unigrams.size() < tableSize)
+            unigrams.push_back(numWords - 1);
+
+        // Probability of keeping each word, for subsampling
+        double corpusWords = corpus.size();
+        keep.resize(numWords, 1.0);
+        if (config.sample > 0.0) {
+            double threshold = config.sample * corpusWords;
+            for (size_t w = 0;  w < numWords;  ++w) {
+                keep[w] = (sqrt(counts[w] / threshold) + 1.0)
+                    * threshold / counts[w];
+            }
+        }
+
+        totalWords = corpusWords * config.numIterations;
+    }
+
+    const Word2VecTrainerConfig & config;
+    int dims;
+    const std::vector<int> & corpus;
+    const std::vector<size_t> & sentenceStarts;
+
+    std::vector<float> embedding;  ///< The input vectors, which we output
+    std::vector<float> output;     ///< Output vectors for negative sampling
+    std::vector<int> unigrams;
+    std::vector<float> keep;
+    double totalWords;
+    std::atomic<uint64_t> wordsDone;
+
+    /** Learn to tell the word from negative samples given the hidden layer
+        h, adding the gradient for h into grad.
+    */
+    void learn(const float * h, int word, float alpha, float * grad,
+               uint64_t & rng)
+    {
+        for (int d = 0;  d <= config.negativeSamples;  ++d) {
+            int target;
+            float label;
+            if (d == 0) {
+                target = word;
+                label = 1.0;
+            }
+            else {
+                rng = rng * 25214903917ULL + 11;
+                target = unigrams[(rng >> 16) % unigrams.size()];
+                if (target == word)
+                    continue;
+                label = 0.0;
+            }
+
+            float * out = &output[(size_t)target * dims];
+            float f = 0.0;
+            for (int i = 0;  i < dims;  ++i)
+                f += h[i] * out[i];
+
+            float g;
+            if (f > 6.0)
+                g = (label - 1.0) * alpha;
+            else if (f < -6.0)
+                g = label * alpha;
+            else g = (label - 1.0 / (1.0 + exp(-f))) * alpha;
+
+            for (int i = 0;  i < dims;  ++i)
+                grad[i] += g * out[i];
+            for (int i = 0;  i < dims;  ++i)
+                out[i] += g * h[i];
+        }
+    }
+
+    /** Train over the given range of sentences in the given pass. */
+    void train(size_t first, size_t last, int iter)
+    {
+        uint64_t rng = config.seed + first
+            + (uint64_t)iter * sentenceStarts.size();
+        std::vector<float> hidden(dims), grad(dims);
+        std::vector<int> sentence;
+        double lr = config.learningRate;
+        int window = config.windowSize;
+
+        for (size_t s = first;  s < last;  ++s) {
+            size_t sentenceWords = sentenceStarts[s + 1] - sentenceStarts[s];
+            float alpha = std::max(lr * (1.0 - wordsDone / totalWords),
+                                   lr * 0.0001);
+            wordsDone += sentenceWords;
+
+            sentence.clear();
+            for (size_t i = sentenceStarts[s];  i < sentenceStarts[s + 1];
+                 ++i) {
+                int w = corpus[i];
+                if (keep[w] < 1.0) {
+                    rng = rng * 25214903917ULL + 11;
+                    if (keep[w] < (rng & 0xFFFF) / 65536.0)
+                        continue;
+                }
+                sentence.push_back(w);
+            }
+
+            int len = sentence.size();
+            for (int pos = 0;  pos < len;  ++pos) {
+                rng = rng * 25214903917ULL + 11;
+                int b = rng % window;
+                int start = std::max(0, pos - window + b);
+                int end = std::min(len, pos + window - b + 1);
+
+                if (config.model == W2V_CBOW) {
+                    std::fill(hidden.begin(), hidden.end(), 0.0);
+                    std::fill(grad.begin(), grad.end(), 0.0);
+                    int n = 0;
+                    for (int c = start;  c < end;  ++c) {
+                        if (c == pos)
+                            continue;
+                        const float * in
+                            = &embedding[(size_t)sentence[c] * dims];
+                        for (int i = 0;  i < dims;  ++i)
+                            hidden[i] += in[i];
+                        ++n;
+                    }
+                    if (n == 0)
+                        continue;
+                    for (int i = 0;  i < dims;  ++i)
+                        hidden[i] /= n;
+
+                    learn(hidden.data(), sentence[pos], alpha, grad.data(),
+                          rng);
+
+                    for (int c = start;  c < end;  ++c) {
+                        if (c == pos)
+                            continue;
+                        float * in = &embedding[(size_t)sentence[c] * dims];
+                        for (int i = 0;  i < dims;  ++i)
+                            in[i] += grad[i];
+                    }
+                }
+                else {
+                    for (int c = start;  c < end;  ++c) {
+                        if (c == pos)
+                            continue;
+                        float * in = &embedding[(size_t)sentence[c] * dims];
+                        std::fill(grad.begin(), grad.end(), 0.0);
+                        learn(in, sentence[pos], alpha, grad.data(), rng);
+                        for (int i = 0;  i < dims;  ++i)
+                            in[i] += grad[i];
+                    }
+                }
+            }
+        }
+    }
+};
+
+} // file scope
+
+struct Word2VecTrainer: public Procedure {
+
+    Word2VecTrainer(MldbServer * owner,
+                    PolyConfig config_,
+                    const std::function<bool (const Json::Value &)> & onProgress)
+        : Procedure(owner)
+    {
+        config = config_.params.convert<Word2VecTrainerConfig>();
+    }
+
+    Word2VecTrainerConfig config;
+
+    /// Sentences longer than this are split, to balance the work
+    static constexpr size_t MAX_SENTENCE_LENGTH = 1000;
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const
+    {
+        auto runProcConf = applyRunConfOverProcConf(config, run);
+
+        Progress trainingProgress;
+        std::shared_ptr<Step> iterationStep = trainingProgress.steps({
+                make_pair("iterating", "percentile"),
+                make_pair("training", "percentile")
+            });
+
+        std::mutex progressMutex;
+        auto onIterationProgress = [&] (const ProgressState & percent)
+            {
+                lock_guard<mutex> lock(progressMutex);
+                if (percent.total)
+                    iterationStep->updateValue((float)percent.count
+                                               / *percent.total);
+                return onProgress(jsonEncode(trainingProgress));
+            };
+
+        SqlExpressionMldbScope context(server);
+        ConvertProgressToJson convertProgressToJson(onProgress);
+        auto boundDataset = runProcConf.trainingData.stm->from
+            ->bind(context, convertProgressToJson);
+
+        // Split the text of each row into words
+        std::mutex textsMutex;
+        vector<vector<string> > texts;
+
+        auto processor = [&] (NamedRowValue & row_)
+            {
+                MatrixNamedRow row = row_.flattenDestructive();
+                for (auto & col: row.columns) {
+                    const CellValue & val = std::get<1>(col);
+                    if (!val.isString())
+                        continue;
+                    vector<string> words;
+                    string text = val.toUtf8String().rawString();
+                    boost::split(words, text, boost::is_any_of(" \t\r\n"),
+                                 boost::token_compress_on);
+                    words.erase(std::remove(words.begin(), words.end(), ""),
+                                words.end());
+                    if (words.empty())
+                        continue;
+                    lock_guard<mutex> lock(textsMutex);
+                    texts.emplace_back(std::move(words));
+                }
+                return true;
+            };
+
+        if (!iterateDataset(runProcConf.trainingData.stm->select,
+                            *boundDataset.dataset, boundDataset.asName,
+                            runProcConf.trainingData.stm->when,
+                            *runProcConf.trainingData.stm->where,
+                            {processor, true /*processInParallel*/},
+                            runProcConf.trainingData.stm->orderBy,
+                            runProcConf.trainingData.stm->offset,
+                            runProcConf.trainingData.stm->limit,
+                            onIterationProgress).first) {
+            throw CancellationException(std::string(Word2VecTrainerConfig::name)
+                                        + " procedure was cancelled");
+        }
+
+        // Vocabulary, from the most to the least frequent word
+        std::unordered_map<string, uint64_t> wordCounts;
+        for (auto & words: texts)
+            for (auto & w: words)
+                wordCounts[w] += 1;
+
+        vector<pair<string, uint64_t> > vocab;
+        for (auto & wc: wordCounts) {
+            if (wc.second >= runProcConf.minCount)
+                vocab.emplace_back(wc.first, wc.second);
+        }
+        wordCounts.clear();
+
+        if (vocab.empty()) {
+            throw HttpReturnException(400, "No word occurs at least minCount "
+                                      "times in the training data for the "
+                                      + string(Word2VecTrainerConfig::name)
+                                      + " procedure",
+                                      "minCount", runProcConf.minCount);
+        }
+
+        std::sort(vocab.begin(), vocab.end(),
+                  [] (const pair<string, uint64_t> & p1,
+                      const pair<string, uint64_t> & p2)
+                  {
+                      return p1.second > p2.second
+                          || (p1.second == p2.second && p1.first < p2.first);
+                  });
+
+        std::unordered_map<string, int> wordIndexes;
+        vector<uint64_t> counts;
+        for (auto & wc: vocab) {
+            wordIndexes[wc.first] = counts.size();
+            counts.push_back(wc.second);
+        }
+
+        // The corpus, as a sequence of word indexes
+        vector<int> corpus;
+        vector<size_t> sentenceStarts(1, 0);
+        for (auto & words: texts) {
+            size_t sentenceStart = corpus.size();
+            for (auto & w: words) {
+                auto it = wordIndexes.find(w);
+                if (it == wordIndexes.end())
+                    continue;
+                corpus.push_back(it->second);
+                if (corpus.size() - sentenceStart == MAX_SENTENCE_LENGTH) {
+                    sentenceStarts.push_back(corpus.size());
+                    sentenceStart = corpus.size();
+                }
+            }
+            if (corpus.size() != sentenceStart)
+                sentenceStarts.push_back(corpus.size());
+            vector<string>().swap(words);
+        }
+        texts.clear();
+
+        INFO_MSG(logger) << "training " << runProcConf.dimensions
+                         << " dimensions over " << vocab.size()
+                         << " words, with " << corpus.size()
+                         << " words of training data";
+
+        Word2VecTraining training(runProcConf, counts, corpus,
+                                  sentenceStarts);
+
+        auto trainingStep = iterationStep->nextStep(1);
+        size_t numSentences = sentenceStarts.size() - 1;
+        std::atomic<bool> cancelled(false);
+
+        for (int iter = 0;  iter < runProcConf.numIterations;  ++iter) {
+            auto onChunk = [&] (size_t first, size_t last)
+                {
+                    if (cancelled)
+                        return;
+                    training.train(first, last, iter);
+
+                    lock_guard<mutex> lock(progressMutex);
+                    trainingStep->updateValue(training.wordsDone
+                                              / training.totalWords);
+                    if (!onProgress(jsonEncode(trainingProgress)))
+                        cancelled = true;
+                };
+
+            parallelMapChunked(0, numSentences,
+                               parallelGrainSize(numSentences, 16),
+                               onChunk);
+
+            if (cancelled) {
+                throw CancellationException(std::string(Word2VecTrainerConfig::name)
+                                            + " procedure was cancelled");
+            }
+        }
+
+        auto output = createDataset(server, runProcConf.output, nullptr,
+                                    true /*overwrite*/);
+
+        int dims = runProcConf.dimensions;
+        vector<ColumnPath> columnNames;
+        for (unsigned i = 0;  i < dims;  ++i) {
+            columnNames.emplace_back(PathElement(i));
+        }
+
+        Date applyDate = Date::now();
+        vector<tuple<RowPath, vector<float>, Date> > rows;
+
+        for (size_t w = 0;  w < vocab.size();  ++w) {
+            const float * vec = &training.embedding[w * dims];
+            rows.emplace_back(RowPath(PathElement(Utf8String(vocab[w].first))),
+                              vector<float>(vec, vec + dims),
+                              applyDate);
+            if (rows.size() == 10000) {
+                output->recordEmbedding(columnNames, rows);
+                rows.clear();
+            }
+        }
+
+        output->recordEmbedding(columnNames, rows);
+        output->commit();
+
+        Json::Value result;
+        result["vocabularySize"] = (int64_t)vocab.size();
+        result["trainingWords"] = (int64_t)corpus.size();
+        return RunOutput(result);
+    }
+
+    virtual Any getStatus() const
+    {
+        return Any();
+    }
+};
+
+RegisterProcedureType<Word2VecTrainer, Word2VecTrainerConfig>
+regTrainer(builtinPackage(),
+           "Train a word2vec embedding over text",
+           "procedures/Word2VecTrainer.md.html");
+
+
 } // namespace MLDB
 
@@ -10,9 +10,20 @@
 #include "mldb/soa/credentials/credentials.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 
 #include <postgresql/libpq-fe.h>
 
+#include <endian.h>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 using namespace std;
@@ -80,6 +91,460 @@ pg_conn* startPostgresqlConnection(const string& databaseName, const string& hos
     return conn;
 }
 
+/// Connection that is closed when it goes out of scope
+typedef std::unique_ptr<pg_conn, void (*) (pg_conn *)> PostgresqlConnection;
+
+PostgresqlConnection
+openPostgresqlConnection(const string& databaseName, const string& host, int port)
+{
+    return PostgresqlConnection(startPostgresqlConnection(databaseName, host, port),
+                                PQfinish);
+}
+
+/// Quote an identifier such as a column or table name for use in a query
+string quotePostgresIdentifier(pg_conn* conn, const string & identifier)
+{
+    char * quoted = PQescapeIdentifier(conn, identifier.c_str(), identifier.size());
+    if (!quoted)
+        throw HttpReturnException(400, "Could not quote PostgreSQL identifier: ",
+                                  string(PQerrorMessage(conn)));
+    string result(quoted);
+    PQfreemem(quoted);
+    return result;
+}
+
+/// Quote a string as a literal for use in a query
+string quotePostgresLiteral(pg_conn* conn, const string & value)
+{
+    char * quoted = PQescapeLiteral(conn, value.c_str(), value.size());
+    if (!quoted)
+        throw HttpReturnException(400, "Could not quote PostgreSQL literal: ",
+                                  string(PQerrorMessage(conn)));
+    string result(quoted);
+    PQfreemem(quoted);
+    return result;
+}
+
+/// Translate an operand of a condition, which must be a column or a constant
+bool toPostgresOperand(pg_conn* conn, const SqlExpression & expr, string & out)
+{
+    if (auto column = dynamic_cast<const ReadColumnExpression *>(&expr)) {
+        // Columns of the table have a single element
+        if (column->columnName.size() != 1)
+            return false;
+        out = quotePostgresIdentifier(conn, column->columnName[0].toUtf8String().rawString());
+        return true;
+    }
+    if (auto constant = dynamic_cast<const ConstantExpression *>(&expr)) {
+        if (!constant->constant.isAtom())
+            return false;
+        CellValue value = constant->constant.getAtom();
+        switch (value.cellType()) {
+        case CellValue::INTEGER:
+        case CellValue::FLOAT:
+            if (!std::isfinite(value.toDouble()))
+                return false;
+            out = value.toString();
+            return true;
+        case CellValue::ASCII_STRING:
+        case CellValue::UTF8_STRING:
+            out = quotePostgresLiteral(conn, value.toUtf8String().rawString());
+            return true;
+        case CellValue::TIMESTAMP:
+            out = quotePostgresLiteral(conn, value.toTimestamp().printIso8601(6))
+                + "::timestamptz";
+            return true;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+/** Translate a WHERE expression into a PostgreSQL condition.  Comparisons,
+    BETWEEN, IN and IS [NOT] NULL between columns and constants, combined
+    with AND, OR and NOT, are supported; both use the same three-valued
+    logic for NULL.  Returns false if anything else is used.
+*/
+bool toPostgresCondition(pg_conn* conn, const SqlExpression & expr, string & out)
+{
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&expr)) {
+        static const std::map<string, string> ops = {
+            { "=", "=" }, { "==", "=" }, { "!=", "<>" }, { "<>", "<>" },
+            { "<", "<" }, { "<=", "<=" }, { ">", ">" }, { ">=", ">=" } };
+        auto op = ops.find(comparison->op);
+        string lhs, rhs;
+        if (op == ops.end()
+            || !toPostgresOperand(conn, *comparison->lhs, lhs)
+            || !toPostgresOperand(conn, *comparison->rhs, rhs))
+            return false;
+        out = "(" + lhs + " " + op->second + " " + rhs + ")";
+        return true;
+    }
+    if (auto boolean = dynamic_cast<const BooleanOperatorExpression *>(&expr)) {
+        string lhs, rhs;
+        if (boolean->op == "NOT" && !boolean->lhs) {
+            if (!toPostgresCondition(conn, *boolean->rhs, rhs))
+                return false;
+            out = "(NOT " + rhs + ")";
+            return true;
+        }
+        if ((boolean->op != "AND" && boolean->op != "OR") || !boolean->lhs
+            || !toPostgresCondition(conn, *boolean->lhs, lhs)
+            || !toPostgresCondition(conn, *boolean->rhs, rhs))
+            return false;
+        out = "(" + lhs + " " + boolean->op + " " + rhs + ")";
+        return true;
+    }
+    if (auto isType = dynamic_cast<const IsTypeExpression *>(&expr)) {
+        string operand;
+        if (isType->type != "null" || !toPostgresOperand(conn, *isType->expr, operand))
+            return false;
+        out = "(" + operand + (isType->notType ? " IS NOT NULL)" : " IS NULL)");
+        return true;
+    }
+    if (auto between = dynamic_cast<const BetweenExpression *>(&expr)) {
+        string operand, lower, upper;
+        if (!toPostgresOperand(conn, *between->expr, operand)
+            || !toPostgresOperand(conn, *between->lower, lower)
+            || !toPostgresOperand(conn, *between->upper, upper))
+            return false;
+        out = "(" + operand + (between->notBetween ? " NOT BETWEEN " : " BETWEEN ")
+            + lower + " AND " + upper + ")";
+        return true;
+    }
+    if (auto in = dynamic_cast<const InExpression *>(&expr)) {
+        string operand;
+        if (in->kind != InExpression::TUPLE || in->tuple->clauses.empty()
+            || !toPostgresOperand(conn, *in->expr, operand))
+            return false;
+        string values;
+        for (auto & c: in->tuple->clauses) {
+            string value;
+            if (!dynamic_cast<const ConstantExpression *>(c.get())
+                || !toPostgresOperand(conn, *c, value))
+                return false;
+            values += (values.empty() ? "" : ", ") + value;
+        }
+        out = "(" + operand + (in->isNegative ? " NOT IN (" : " IN (") + values + "))";
+        return true;
+    }
+    return false;
+}
+
+/// Run a query that returns rows, throwing on an error
+std::shared_ptr<PGresult>
+queryPostgresql(pg_conn* conn, const string & query)
+{
+    POSTGRESQL_VERBOSE(cerr << query << endl;)
+    std::shared_ptr<PGresult> res(PQexec(conn, query.c_str()), PQclear);
+    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK)
+        throw HttpReturnException(400, "Could not query PostgreSQL database: ",
+                                  string(PQresultErrorMessage(res.get())));
+    return res;
+}
+
+// Type oids from the pg_type catalog, which are fixed for builtin types
+enum {
+    PG_BOOL = 16, PG_BYTEA = 17, PG_CHAR = 18, PG_NAME = 19, PG_INT8 = 20,
+    PG_INT2 = 21, PG_INT4 = 23, PG_TEXT = 25, PG_OID = 26, PG_JSON = 114,
+    PG_XML = 142, PG_FLOAT4 = 700, PG_FLOAT8 = 701, PG_BPCHAR = 1042,
+    PG_VARCHAR = 1043, PG_DATE = 1082, PG_TIMESTAMP = 1114,
+    PG_TIMESTAMPTZ = 1184, PG_NUMERIC = 1700, PG_UUID = 2950, PG_JSONB = 3802
+};
+
+/// Can values of this type be decoded from the binary COPY format?  Other
+/// types are cast to text by the query.
+bool isBinaryDecodable(Oid type)
+{
+    switch (type) {
+    case PG_BOOL: case PG_BYTEA: case PG_CHAR: case PG_NAME: case PG_INT8:
+    case PG_INT2: case PG_INT4: case PG_TEXT: case PG_OID: case PG_JSON:
+    case PG_XML: case PG_FLOAT4: case PG_FLOAT8: case PG_BPCHAR:
+    case PG_VARCHAR: case PG_DATE: case PG_TIMESTAMP: case PG_TIMESTAMPTZ:
+    case PG_NUMERIC: case PG_UUID: case PG_JSONB:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Values in the binary format are in network byte order
+uint16_t readUInt16(const char * p)
+{
+    uint16_t result;
+    memcpy(&result, p, 2);
+    return be16toh(result);
+}
+
+uint32_t readUInt32(const char * p)
+{
+    uint32_t result;
+    memcpy(&result, p, 4);
+    return be32toh(result);
+}
+
+uint64_t readUInt64(const char * p)
+{
+    uint64_t result;
+    memcpy(&result, p, 8);
+    return be64toh(result);
+}
+
+/// PostgreSQL dates and timestamps count from 2000-01-01 UTC
+const int64_t postgresEpochSeconds = 946684800;
+
+CellValue decodeBinaryNumeric(const char * p, int len)
+{
+    if (len < 8)
+        throw HttpReturnException(500, "Invalid PostgreSQL numeric value");
+    int ndigits = (int16_t)readUInt16(p);
+    int weight = (int16_t)readUInt16(p + 2);
+    uint16_t sign = readUInt16(p + 4);
+    int dscale = readUInt16(p + 6);
+    if (sign == 0xC000)
+        return CellValue(std::numeric_limits<double>::quiet_NaN());
+    if (len < 8 + 2 * ndigits)
+        throw HttpReturnException(500, "Invalid PostgreSQL numeric value");
+
+    // Each digit is in base 10000, the first one has the given weight
+    double value = 0;
+    for (int i = 0;  i < ndigits;  ++i)
+        value += readUInt16(p + 8 + 2 * i) * std::pow(10000.0, weight - i);
+    if (sign == 0x4000)
+        value = -value;
+
+    if (dscale == 0 && std::abs(value) < 9007199254740992.0)
+        return CellValue((int64_t)value);
+    return CellValue(value);
+}
+
+/// Decode a non-null field of a binary COPY into a cell
+CellValue decodeBinaryValue(Oid type, const char * p, int len)
+{
+    switch (type) {
+    case PG_BOOL:
+        return CellValue(p[0] != 0 ? 1 : 0);
+    case PG_INT2:
+        return CellValue((int16_t)readUInt16(p));
+    case PG_INT4:
+        return CellValue((int32_t)readUInt32(p));
+    case PG_OID:
+        return CellValue(readUInt32(p));
+    case PG_INT8:
+        return CellValue((int64_t)readUInt64(p));
+    case PG_FLOAT4: {
+        uint32_t bits = readUInt32(p);
+        float value;
+        memcpy(&value, &bits, 4);
+        return CellValue(value);
+    }
+    case PG_FLOAT8: {
+        uint64_t bits = readUInt64(p);
+        double value;
+        memcpy(&value, &bits, 8);
+        return CellValue(value);
+    }
+    case PG_NUMERIC:
+        return decodeBinaryNumeric(p, len);
+    case PG_DATE: {
+        int32_t days = readUInt32(p);
+        if (days == std::numeric_limits<int32_t>::max())
+            return CellValue(Date::positiveInfinity());
+        if (days == std::numeric_limits<int32_t>::min())
+            return CellValue(Date::negativeInfinity());
+        return CellValue(Date::fromSecondsSinceEpoch
+                         (postgresEpochSeconds + days * 86400.0));
+    }
+    case PG_TIMESTAMP:
+    case PG_TIMESTAMPTZ: {
+        int64_t micros = readUInt64(p);
+        if (micros == std::numeric_limits<int64_t>::max())
+            return CellValue(Date::positiveInfinity());
+        if (micros == std::numeric_limits<int64_t>::min())
+            return CellValue(Date::negativeInfinity());
+        return CellValue(Date::fromSecondsSinceEpoch
+                         (postgresEpochSeconds + micros / 1000000.0));
+    }
+    case PG_UUID: {
+        static const char * hex = "0123456789abcdef";
+        string result;
+        for (int i = 0;  i < 16 && i < len;  ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10)
+                result += '-';
+            result += hex[(unsigned char)p[i] >> 4];
+            result += hex[(unsigned char)p[i] & 15];
+        }
+        return CellValue(result);
+    }
+    case PG_BYTEA:
+        return CellValue::blob(string(p, len));
+    case PG_JSONB:
+        // Prefixed by a version number
+        return CellValue(Utf8String(string(p + 1, len - 1)));
+    default:
+        // Everything else is text, since it's either a text type or was
+        // cast to text by the query
+        return CellValue(Utf8String(string(p, len)));
+    }
+}
+
+/** Incremental decoder of the output of COPY ... TO STDOUT (FORMAT binary).
+    It is given the chunks of data returned by PQgetCopyData, which don't
+    need to contain whole rows, and calls onRow with the non-null values of
+    each complete row, as (field number, value) pairs.
+*/
+struct BinaryCopyDecoder {
+    typedef std::function<void (std::vector<std::pair<int, CellValue> > & values)> OnRow;
+
+    BinaryCopyDecoder(std::vector<Oid> types, OnRow onRow)
+        : types(std::move(types)), onRow(std::move(onRow))
+    {
+    }
+
+    void feed(const char * data, size_t len)
+    {
+        buffer.append(data, len);
+
+        if (!headerDone) {
+            // Signature, flags and the length of the header extension
+            static const char signature[] = "PGCOPY\n\377\r\n";
+            if (buffer.size() < 19)
+                return;
+            if (buffer.compare(0, 11, signature, 11) != 0)
+                throw HttpReturnException(500, "Invalid PostgreSQL binary COPY header");
+            size_t headerLength = 19 + readUInt32(buffer.data() + 15);
+            if (buffer.size() < headerLength)
+                return;
+            pos = headerLength;
+            headerDone = true;
+        }
+
+        while (!finished && decodeRow()) {
+        }
+
+        // Drop what was consumed, so that the buffer stays small
+        buffer.erase(0, pos);
+        pos = 0;
+    }
+
+    bool finished = false;
+
+private:
+    /// Decode the row at pos, returning false if it's not complete yet
+    bool decodeRow()
+    {
+        const char * start = buffer.data() + pos;
+        size_t avail = buffer.size() - pos;
+        if (avail < 2)
+            return false;
+        int16_t nfields = readUInt16(start);
+        if (nfields == -1) {
+            finished = true;
+            pos += 2;
+            return false;
+        }
+        if (nfields != (int)types.size())
+            throw HttpReturnException(500, "Unexpected number of fields in PostgreSQL binary COPY");
+
+        // Check that the whole row is there before decoding any of it
+        size_t offset = 2;
+        for (int j = 0;  j < nfields;  ++j) {
+            if (avail < offset + 4)
+                return false;
+            int32_t len = readUInt32(start + offset);
+            offset += 4;
+            if (len > 0)
+                offset += len;
+        }
+        if (avail < offset)
+            return false;
+
+        values.clear();
+        offset = 2;
+        for (int j = 0;  j < nfields;  ++j) {
+            int32_t len = readUInt32(start + offset);
+            offset += 4;
+            if (len < 0)
+                continue;  // NULL
+            values.emplace_back(j, decodeBinaryValue(types[j], start + offset, len));
+            offset += len;
+        }
+        pos += offset;
+
+        onRow(values);
+        return true;
+    }
+
+    std::vector<Oid> types;
+    OnRow onRow;
+    string buffer;
+    size_t pos = 0;
+    bool headerDone = false;
+    std::vector<std::pair<int, CellValue> > values;
+};
+
+/** Run a COPY ... TO STDOUT (FORMAT binary) command, feeding its output
+    to the decoder as it arrives.
+*/
+void runBinaryCopyOut(pg_conn* conn, const string & copyCommand,
+                      BinaryCopyDecoder & decoder)
+{
+    POSTGRESQL_VERBOSE(cerr << copyCommand << endl;)
+    {
+        std::shared_ptr<PGresult> res(PQexec(conn, copyCommand.c_str()), PQclear);
+        if (PQresultStatus(res.get()) != PGRES_COPY_OUT)
+            throw HttpReturnException(400, "Could not copy from PostgreSQL database: ",
+                                      string(PQresultErrorMessage(res.get())));
+    }
+
+    for (;;) {
+        char * data = nullptr;
+        int len = PQgetCopyData(conn, &data, 0 /* not async */);
+        if (len == -1)
+            break;
+        if (len < 0)
+            throw HttpReturnException(400, "Could not copy from PostgreSQL database: ",
+                                      string(PQerrorMessage(conn)));
+        try {
+            decoder.feed(data, len);
+        } catch (...) {
+            PQfreemem(data);
+            throw;
+        }
+        PQfreemem(data);
+    }
+
+    std::shared_ptr<PGresult> res(PQgetResult(conn), PQclear);
+    if (PQresultStatus(res.get()) != PGRES_COMMAND_OK)
+        throw HttpReturnException(400, "Could not copy from PostgreSQL database: ",
+                                  string(PQresultErrorMessage(res.get())));
+    // Consume the end of the results
+    while (PGresult * next = PQgetResult(conn))
+        PQclear(next);
+}
+
+/// Append a value in the text format of COPY FROM STDIN
+void appendCopyText(string & out, const CellValue & cell)
+{
+    if (cell.empty()) {
+        out += "\\N";
+        return;
+    }
+
+    string text = cell.isString()
+        ? cell.toUtf8String().rawString() : cell.toString();
+    for (char c: text) {
+        switch (c) {
+        case '\\': out += "\\\\";  break;
+        case '\t': out += "\\t";  break;
+        case '\n': out += "\\n";  break;
+        case '\r': out += "\\r";  break;
+        default:   out += c;
+        }
+    }
+}
+
 }
 
 /*****************************************************************************/
@@ -191,22 +656,38 @@ struct PostgresqlDataset: public Dataset {
                       ssize_t limit) const override
     {
 
-        auto conn = startConnection();
+        auto conn = openPostgresqlConnection(config_.databaseName, config_.host, config_.port);
+
+        // Run the parts of the WHERE clause that we can translate on the
+        // database.  Anything else is passed as written, and so must be
+        // valid PostgreSQL.
+        string condition;
+        if (!where.isConstantTrue()
+            && !toPostgresCondition(conn.get(), where, condition))
+            condition = where.surface.rawString();
+
         string selectString = "SELECT ";
         selectString += config_.primaryKey + 
                         " FROM " + 
-                        config_.tableName +
-                        " WHERE " + 
-                        where.surface.rawString();
+                        config_.tableName;
+        if (!condition.empty())
+            selectString += " WHERE " + condition;
+
+        // Sort so that the order is deterministic, and so that the offset
+        // and limit can be applied by the database
+        selectString += " ORDER BY " + config_.primaryKey;
+        if (limit != -1)
+            selectString += " LIMIT " + std::to_string(limit);
+        if (offset > 0)
+            selectString += " OFFSET " + std::to_string(offset);
 
         POSTGRESQL_VERBOSE(cerr << "postgress where select: " << endl);
         POSTGRESQL_VERBOSE(cerr << selectString << endl);
 
-        auto res = PQexec(conn, selectString.c_str());
+        auto res = PQexec(conn.get(), selectString.c_str());
         if (PQresultStatus(res) != PGRES_TUPLES_OK) {
             string errorMsg(PQresultErrorMessage(res));
             PQclear(res);
-            PQfinish(conn);
             throw HttpReturnException(400, "Could not select from postgreSQL: ", errorMsg);
         }
         
@@ -226,7 +707,6 @@ struct PostgresqlDataset: public Dataset {
         }
 
         PQclear(res);
-        PQfinish(conn);
 
         return {[=] (ssize_t numToGenerate, Any token,
                      const BoundParameters & params,
@@ -248,7 +728,9 @@ struct PostgresqlDataset: public Dataset {
             return make_pair(std::move(rowsToKeep),
                              std::move(newToken));
         },
-        "PostgresqlDataset row generation"};
+        condition.empty() || condition == where.surface.rawString()
+            ? "PostgresqlDataset row generation"
+            : "PostgresqlDataset row generation with WHERE " + condition};
 
     }
 
@@ -257,14 +739,71 @@ struct PostgresqlDataset: public Dataset {
     */
     virtual ExpressionValue getRowExpr(const RowPath & row) const override
     {
-        auto conn = startConnection();
-        string selectString = "SELECT * FROM ";
+        return getRowColumns(row, "*");
+    }
+
+    /** Only select the columns of the table that the query reads. */
+    virtual ExpressionValue
+    getProjectedRowExpr(const RowPath & row,
+                        const std::vector<ColumnPath> & columns) const override
+    {
+        auto conn = openPostgresqlConnection(config_.databaseName, config_.host, config_.port);
+
+        string selectList;
+        for (auto & name: getTableColumns(conn.get())) {
+            bool needed = false;
+            for (auto & c: columns)
+                needed = needed || (!c.empty() && c[0].toUtf8String().rawString() == name);
+            if (!needed)
+                continue;
+            if (!selectList.empty())
+                selectList += ", ";
+            selectList += quotePostgresIdentifier(conn.get(), name);
+        }
+
+        if (selectList.empty())
+            return ExpressionValue(std::vector<std::tuple<ColumnPath, CellValue, Date> >());
+        return getRowColumns(conn.get(), row, selectList);
+    }
+
+    /** Return whether or not all columns names and info are known.
+    */
+    virtual bool hasColumnNames() const override { return false; }
+
+private:
+    /// Names of the columns of the table, which are read once
+    const std::vector<string> & getTableColumns(pg_conn* conn) const
+    {
+        std::unique_lock<std::mutex> guard(tableColumnsMutex);
+        if (!tableColumnsKnown) {
+            auto res = queryPostgresql(conn, "SELECT * FROM " + config_.tableName
+                                       + " LIMIT 0");
+            for (int j = 0;  j < PQnfields(res.get());  ++j)
+                tableColumns.emplace_back(PQfname(res.get(), j));
+            tableColumnsKnown = true;
+        }
+        return tableColumns;
+    }
+
+    mutable std::mutex tableColumnsMutex;
+    mutable std::vector<string> tableColumns;
+    mutable bool tableColumnsKnown = false;
+
+    ExpressionValue getRowColumns(const RowPath & row, const string & selectList) const
+    {
+        auto conn = openPostgresqlConnection(config_.databaseName, config_.host, config_.port);
+        return getRowColumns(conn.get(), row, selectList);
+    }
+
+    ExpressionValue getRowColumns(pg_conn* conn, const RowPath & row,
+                                  const string & selectList) const
+    {
+        string selectString = "SELECT " + selectList + " FROM ";
         selectString += config_.tableName +
                         " WHERE " + 
                         config_.primaryKey + 
-                        " = '" + 
-                        row.toUtf8String().rawString()
-                        + "'";
+                        " = " + 
+                        quotePostgresLiteral(conn, row.toUtf8String().rawString());
 
         POSTGRESQL_VERBOSE(cerr << "postgress row select: " << endl;)
         POSTGRESQL_VERBOSE(cerr << selectString << endl;)
@@ -273,7 +812,6 @@ struct PostgresqlDataset: public Dataset {
         if (PQresultStatus(res) != PGRES_TUPLES_OK) {
             string errorMsg(PQresultErrorMessage(res));
             PQclear(res);
-            PQfinish(conn);
             throw HttpReturnException(400, "Could not select from postgreSQL: ", errorMsg);
         }
 
@@ -286,7 +824,6 @@ struct PostgresqlDataset: public Dataset {
 
         std::vector<std::tuple<ColumnPath, CellValue, Date> > rowValues;
         if (ntuples > 0) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
             for(int j = 0; j < nfields; j++) {
                 rowValues.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, 0, j), Date::Date::notADate());
                 POSTGRESQL_VERBOSE(printf("[%d,%d] %s %s\n", 0, j, PQgetvalue(res, 0, j), PQfname(res, j));)
@@ -294,16 +831,9 @@ struct PostgresqlDataset: public Dataset {
         }
 
         PQclear(res);
-        PQfinish(conn);
 
         return ExpressionValue(rowValues);
-
     }
-
-    /** Return whether or not all columns names and info are known.
-    */
-    virtual bool hasColumnNames() const override { return false; }
-
 };
 
 /*****************************************************************************/
@@ -317,6 +847,7 @@ struct PostgresqlRecorderDatasetConfig {
     string tableName;
     bool createTable;
     bool dropTableIfExist;
+    size_t batchSize;
 
     PostgresqlRecorderDatasetConfig() {
         databaseName = "database";
@@ -325,6 +856,7 @@ struct PostgresqlRecorderDatasetConfig {
         tableName = "mytable";
         createTable = false;
         dropTableIfExist = false;
+        batchSize = 10000;
     }
 };
 
@@ -340,6 +872,10 @@ PostgresqlRecorderDatasetConfigDescription()
     addField("tableName", &PostgresqlRecorderDatasetConfig::tableName, "Name of the table to be recorded into");
     addField("createTable", &PostgresqlRecorderDatasetConfig::createTable, "Should we create the table when the dataset is created", false);
     addField("dropTableIfExist", &PostgresqlRecorderDatasetConfig::dropTableIfExist, "Should we drop an existing PostgreSQL table when creating it", false);
+    addField("batchSize", &PostgresqlRecorderDatasetConfig::batchSize,
+             "Number of rows that are buffered before they are written "
+             "together to PostgreSQL with a single COPY.  The rows that are "
+             "still buffered are written on commit.", (size_t)10000);
 }
 
 struct PostgresqlRecorderDataset: public Dataset {
@@ -347,6 +883,10 @@ struct PostgresqlRecorderDataset: public Dataset {
     PostgresqlRecorderDatasetConfig config_;
     std::unordered_set<ColumnPath> insertedColumns;
 
+    /// Rows recorded but not yet written, protected by pendingMutex
+    std::vector<std::vector<std::tuple<ColumnPath, CellValue, Date> > > pending;
+    std::mutex pendingMutex;
+
     pg_conn* startConnection() 
     {
         return startPostgresqlConnection(config_.databaseName, config_.host, config_.port);
@@ -398,6 +938,12 @@ struct PostgresqlRecorderDataset: public Dataset {
     
     virtual ~PostgresqlRecorderDataset()
     {
+        try {
+            commit();
+        } catch (const std::exception & exc) {
+            cerr << "could not write rows to PostgreSQL table "
+                 << config_.tableName << ": " << exc.what() << endl;
+        }
     }
 
     virtual Any getStatus() const override
@@ -448,7 +994,6 @@ struct PostgresqlRecorderDataset: public Dataset {
                 if (PQresultStatus(res) != PGRES_COMMAND_OK) {
                     string errorMsg(PQresultErrorMessage(res));
                     PQclear(res);
-                    PQfinish(conn);
                     throw HttpReturnException(400, "Could not alter PostgreSQL table:  ", errorMsg);
                 }
 
@@ -457,75 +1002,98 @@ struct PostgresqlRecorderDataset: public Dataset {
         }
     }
 
-    void insertRowPostgresql(pg_conn* conn, const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) 
+    /** Write the pending rows to the table with a single COPY FROM STDIN,
+        over the union of their columns.  Must be called with pendingMutex
+        held.
+    */
+    void flushPending()
     {
-        alterColumns(conn, vals);
-
-        string insertString = "INSERT INTO " + config_.tableName + " (";
-
-        bool first = true;
-        for (auto& p : vals) {                
-            if (!first) {
-                insertString += ",";                    
+        if (pending.empty())
+            return;
+
+        auto conn = openPostgresqlConnection(config_.databaseName, config_.host, config_.port);
+
+        std::vector<ColumnPath> columns;
+        std::unordered_map<ColumnPath, size_t> columnIndex;
+        for (auto & vals: pending) {
+            alterColumns(conn.get(), vals);
+            for (auto & p: vals) {
+                if (columnIndex.emplace(std::get<0>(p), columns.size()).second)
+                    columns.push_back(std::get<0>(p));
             }
-            first = false;
-            insertString += std::get<0>(p).toUtf8String().rawString();
         }
 
-        insertString += ") VALUES (";
-
-        first = true;
-        for (auto& p : vals) {                
-            if (!first) {
-                insertString += ",";                    
-            }
-            first = false;
-            auto& cell = std::get<1>(p);
-            if (cell.isString())
-                insertString += "'" + cell.toString() + "'";
-            else
-                insertString += cell.toString();
+        string copyString = "COPY " + config_.tableName + " (";
+        for (size_t i = 0;  i < columns.size();  ++i) {
+            if (i != 0)
+                copyString += ",";
+            copyString += columns[i].toUtf8String().rawString();
         }
+        copyString += ") FROM STDIN";
 
-        insertString += ")";
+        POSTGRESQL_VERBOSE(cerr << copyString << endl;)
 
-        POSTGRESQL_VERBOSE(cerr << insertString << endl;)
+        {
+            std::shared_ptr<PGresult> res(PQexec(conn.get(), copyString.c_str()), PQclear);
+            if (PQresultStatus(res.get()) != PGRES_COPY_IN)
+                throw HttpReturnException(400, "Could not insert data in PostgreSQL table:  ",
+                                          string(PQresultErrorMessage(res.get())));
+        }
 
-        auto res = PQexec(conn, insertString.c_str());
-        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-            string errorMsg(PQresultErrorMessage(res));
-            PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not insert data in PostgreSQL table:  ", errorMsg);
+        // One tab-separated line per row, with \N for missing values
+        string data;
+        std::vector<const CellValue *> rowValues(columns.size());
+        for (auto & vals: pending) {
+            std::fill(rowValues.begin(), rowValues.end(), nullptr);
+            for (auto & p: vals)
+                rowValues[columnIndex[std::get<0>(p)]] = &std::get<1>(p);
+            for (size_t i = 0;  i < columns.size();  ++i) {
+                if (i != 0)
+                    data += '\t';
+                if (rowValues[i])
+                    appendCopyText(data, *rowValues[i]);
+                else data += "\\N";
+            }
+            data += '\n';
         }
 
-        PQclear(res);
+        if (PQputCopyData(conn.get(), data.data(), data.size()) != 1
+            || PQputCopyEnd(conn.get(), nullptr) != 1)
+            throw HttpReturnException(400, "Could not insert data in PostgreSQL table:  ",
+                                      string(PQerrorMessage(conn.get())));
+
+        std::shared_ptr<PGresult> res(PQgetResult(conn.get()), PQclear);
+        if (PQresultStatus(res.get()) != PGRES_COMMAND_OK)
+            throw HttpReturnException(400, "Could not insert data in PostgreSQL table:  ",
+                                      string(PQresultErrorMessage(res.get())));
+
+        pending.clear();
     }
 
     virtual void recordRowItl(const RowPath & rowName,
                               const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
     {
-        auto conn = startConnection();
-
-        insertRowPostgresql(conn, vals);
-
-        PQfinish(conn);
+        std::unique_lock<std::mutex> guard(pendingMutex);
+        pending.push_back(vals);
+        if (pending.size() >= config_.batchSize)
+            flushPending();
     }
     
     virtual void recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows) override
     {
-        auto conn = startConnection();
-
+        std::unique_lock<std::mutex> guard(pendingMutex);
         for (auto& vals : rows) {
-            insertRowPostgresql(conn, vals.second);
-        }        
-
-        PQfinish(conn);
+            pending.push_back(vals.second);
+            if (pending.size() >= config_.batchSize)
+                flushPending();
+        }
     }
 
-    /** Commit changes to the database.  Default is a no-op. */
+    /** Write the rows that are still buffered to the table. */
     virtual void commit() override
     {
+        std::unique_lock<std::mutex> guard(pendingMutex);
+        flushPending();
     }
 
     virtual std::pair<Date, Date> getTimestampRange() const override
@@ -568,6 +1136,8 @@ struct PostgresqlImportConfig: public ProcedureConfig {
     int port;
     string host;
     string postgresqlQuery;
+    string partitionColumn;
+    int numPartitions;
 
     /// The output dataset.  Rows will be dumped into here via insertRows.
     PolyConfigT<Dataset> outputDataset;
@@ -577,6 +1147,7 @@ struct PostgresqlImportConfig: public ProcedureConfig {
         port = postgresqlDefaultPort;
         host = "localhost";
         postgresqlQuery = "";
+        numPartitions = 1;
 
         outputDataset.withType("sparse.mutable");
     }
@@ -593,6 +1164,13 @@ PostgresqlImportConfigDescription()
     addField("port", &PostgresqlImportConfig::port, "Port of the database to connect to.", postgresqlDefaultPort);
     addField("host", &PostgresqlImportConfig::host, "Address of the database to connect to ");
     addField("postgresqlQuery", &PostgresqlImportConfig::postgresqlQuery, "Query to run in postgresql to get rows");
+    addField("partitionColumn", &PostgresqlImportConfig::partitionColumn,
+             "Integer column of the query's result used to split the import "
+             "into ranges that are read in parallel.  Required when "
+             "numPartitions is more than one.");
+    addField("numPartitions", &PostgresqlImportConfig::numPartitions,
+             "Number of ranges of the partition column that are read in "
+             "parallel, each over its own connection.", 1);
 
     addField("outputDataset", &PostgresqlImportConfig::outputDataset,
              "Output dataset configuration.  This may refer either to an "
@@ -633,44 +1211,134 @@ struct PostgresqlImportProcedure: public Procedure {
 
         auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
 
-        // Connect to Postgresl database
-        auto conn = startConnection(runProcConf);
+        if (runProcConf.numPartitions < 1)
+            throw HttpReturnException(400, "numPartitions must be at least 1");
+        if (runProcConf.numPartitions > 1 && runProcConf.partitionColumn.empty())
+            throw HttpReturnException(400, "partitionColumn must be set to import "
+                                      "with more than one partition");
 
-        // Create the output
-        std::shared_ptr<Dataset> output =
-        createDataset(server, runProcConf.outputDataset, nullptr, true ); //overwrite
+        // The query is used as a subquery, so it can't be terminated
+        string query = runProcConf.postgresqlQuery;
+        while (!query.empty() && (isspace(query.back()) || query.back() == ';'))
+            query.pop_back();
+
+        // Connect to Postgresl database
+        auto conn = openPostgresqlConnection(runProcConf.databaseName,
+                                             runProcConf.host, runProcConf.port);
 
-        //query the rows
-        auto res = PQexec(conn, runProcConf.postgresqlQuery.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK)
+        // Find the columns and their types, without running the query
+        std::vector<ColumnPath> columnNames;
+        std::vector<Oid> types;
+        string selectList;
         {
-            string errorMsg = PQresultErrorMessage(res);
-            PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not query PostgreSQL database", errorMsg);
+            auto res = queryPostgresql(conn.get(), "SELECT * FROM (" + query
+                                       + ") AS mldb_import LIMIT 0");
+            for (int j = 0;  j < PQnfields(res.get());  ++j) {
+                string name = PQfname(res.get(), j);
+                Oid type = PQftype(res.get(), j);
+                columnNames.emplace_back(name);
+                if (!selectList.empty())
+                    selectList += ", ";
+                selectList += quotePostgresIdentifier(conn.get(), name);
+                if (!isBinaryDecodable(type)) {
+                    selectList += "::text";
+                    type = PG_TEXT;
+                }
+                types.push_back(type);
+            }
         }
 
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
-
-        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
-        for(int i = 0; i < ntuples; i++) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
-            for(int j = 0; j < nfields; j++) {
-                cols.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, i, j), Date::Date::notADate());
+        // Split the range of the partition column evenly between the
+        // partitions.  Rows where it's NULL go to the first one.
+        int numPartitions = runProcConf.numPartitions;
+        std::vector<string> conditions(numPartitions);
+        if (numPartitions > 1) {
+            string column = quotePostgresIdentifier(conn.get(), runProcConf.partitionColumn);
+            auto res = queryPostgresql(conn.get(), "SELECT min(" + column + ")::int8, max("
+                                       + column + ")::int8 FROM (" + query
+                                       + ") AS mldb_import");
+            if (PQgetisnull(res.get(), 0, 0)) {
+                numPartitions = 1;
+                conditions.resize(1);
+            }
+            else {
+                int64_t minValue = std::stoll(PQgetvalue(res.get(), 0, 0));
+                int64_t maxValue = std::stoll(PQgetvalue(res.get(), 0, 1));
+                int64_t span = (maxValue - minValue) / numPartitions + 1;
+                for (int p = 0;  p < numPartitions;  ++p) {
+                    int64_t low = minValue + p * span;
+                    conditions[p] = " WHERE " + column + " >= " + std::to_string(low)
+                        + " AND " + column + " < " + std::to_string(low + span);
+                    if (p == 0)
+                        conditions[p] += " OR " + column + " IS NULL";
+                }
             }
-            rows.emplace_back(Path(string("row_" + std::to_string(i))), std::move(cols));            
         }
+        conn.reset();
 
-        output->recordRows(rows);
+        // Create the output
+        std::shared_ptr<Dataset> output =
+        createDataset(server, runProcConf.outputDataset, nullptr, true ); //overwrite
+
+        // Stream each partition in, recording rows in batches as they are
+        // decoded
+        static const size_t batchSize = 10000;
+        std::atomic<size_t> rowsDone(0);
+        std::mutex progressMutex;
+
+        auto doPartition = [&] (size_t p)
+            {
+                auto partitionConn
+                    = openPostgresqlConnection(runProcConf.databaseName,
+                                               runProcConf.host, runProcConf.port);
+
+                std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+                size_t i = 0;
+
+                auto onRow = [&] (std::vector<std::pair<int, CellValue> > & values)
+                {
+                    std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
+                    cols.reserve(values.size());
+                    for (auto & v: values)
+                        cols.emplace_back(columnNames[v.first], std::move(v.second),
+                                          Date::notADate());
+
+                    string rowName = numPartitions == 1
+                        ? "row_" + std::to_string(i)
+                        : "row_" + std::to_string(p) + "_" + std::to_string(i);
+                    rows.emplace_back(Path(rowName), std::move(cols));
+                    ++i;
+
+                    if (rows.size() == batchSize) {
+                        output->recordRows(rows);
+                        rows.clear();
+                        size_t done = rowsDone += batchSize;
+                        Json::Value progress;
+                        progress["rowsImported"] = done;
+                        std::unique_lock<std::mutex> guard(progressMutex);
+                        if (!onProgress(progress))
+                            throw CancellationException("postgresql.import was cancelled");
+                    }
+                };
+
+                BinaryCopyDecoder decoder(types, onRow);
+                runBinaryCopyOut(partitionConn.get(),
+                                 "COPY (SELECT " + selectList + " FROM (" + query
+                                 + ") AS mldb_import" + conditions[p]
+                                 + ") TO STDOUT (FORMAT binary)",
+                                 decoder);
+
+                if (!rows.empty())
+                    output->recordRows(rows);
+            };
+
+        parallelMap(0, numPartitions, doPartition);
 
         // Save the dataset we created
         output->commit();
 
         result = output->getStatus();
 
-        PQclear(res);
-        PQfinish(conn);
         return result;
     }
 };
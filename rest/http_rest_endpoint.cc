@@ -10,31 +10,82 @@
 #include "mldb/base/exc_assert.h"
 #include "mldb/vfs/filter_streams.h"
 #include <boost/lexical_cast.hpp>
+#include "mldb/io/event_loop.h"
+#include "mldb/io/event_loop_impl.h"
 #include "mldb/io/tcp_acceptor.h"
 #include "http_rest_endpoint.h"
 #include "mldb/utils/log.h"
 #include <iomanip>
+#include <cstdio>
+#include <thread>
 
 using namespace std;
 
 namespace MLDB {
 
+/****************************************************************************/
+/* HTTP REST ENDPOINT :: ACCEPTOR SHARD                                     */
+/****************************************************************************/
+
+/** An extra acceptor, with an event loop that's run by a single thread of
+    its own.  Everything to do with the connections it accepts happens on
+    that thread.
+*/
+
+struct HttpRestEndpoint::AcceptorShard {
+    AcceptorShard(const TcpAcceptor::OnNewConnection & onNewConnection)
+        : work(new boost::asio::io_service::work(loop.impl().ioService())),
+          acceptor(new TcpAcceptor(loop, onNewConnection))
+    {
+    }
+
+    ~AcceptorShard()
+    {
+        shutdown();
+    }
+
+    void start()
+    {
+        auto & ioService = loop.impl().ioService();
+        thread = std::thread([&ioService] () { ioService.run(); });
+    }
+
+    void shutdown()
+    {
+        acceptor->shutdown();
+        work.reset();
+        // stop() is sticky, so it doesn't matter if the thread has not
+        // started running the loop yet
+        loop.impl().ioService().stop();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    EventLoop loop;
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::unique_ptr<TcpAcceptor> acceptor;
+    std::thread thread;
+};
+
+
 /****************************************************************************/
 /* HTTP REST ENDPOINT                                                       */
 /****************************************************************************/
 
 HttpRestEndpoint::
 HttpRestEndpoint(EventLoop & eventLoop, bool enableLogging)
+    : numAcceptors(1)
 {
-    auto makeHandler = [&, enableLogging] (TcpSocket && socket) {
+    makeHandler_ = [&, enableLogging] (TcpSocket && socket) {
         return make_shared<RestConnectionHandler>(this, std::move(socket), enableLogging);
     };
-    acceptor_.reset(new TcpAcceptor(eventLoop, makeHandler));
+    acceptor_.reset(new TcpAcceptor(eventLoop, makeHandler_));
 }
 
 HttpRestEndpoint::
 ~HttpRestEndpoint()
 {
+    shards_.clear();
 }
 
 void
@@ -55,6 +106,8 @@ HttpRestEndpoint::
 shutdown()
 {
     acceptor_->shutdown();
+    for (auto & shard: shards_)
+        shard->shutdown();
 }
 
 void
@@ -109,8 +162,20 @@ bindTcp(PortRange const & portRange, std::string host)
     if (host == "" || host == "*")
         host = "0.0.0.0";
 
-    acceptor_->listen(portRange, host);
+    ExcAssert(shards_.empty());
+    bool reusePort = numAcceptors > 1;
+    acceptor_->listen(portRange, host, 128, reusePort);
     int port = acceptor_->effectiveTCPv4Port();
+
+    // The other acceptors join the first one on the port it found
+    if (port == -1)
+        port = acceptor_->effectiveTCPv6Port();
+    for (int i = 1; i < numAcceptors; ++i) {
+        std::unique_ptr<AcceptorShard> shard(new AcceptorShard(makeHandler_));
+        shard->acceptor->listen(PortRange(port), host, 128, true /* reusePort */);
+        shard->start();
+        shards_.emplace_back(std::move(shard));
+    }
     const char * literate_doc_bind_file = getenv("LITERATE_DOC_BIND_FILENAME");
     if (literate_doc_bind_file) {
         Json::Value v;
@@ -222,11 +287,14 @@ sendResponse(int code,
 
 void
 HttpRestEndpoint::RestConnectionHandler::
-sendResponseHeader(int code, std::string contentType, RestParams headers)
+sendResponseHeader(int code, std::string contentType, RestParams headers,
+                   OnWriteFinished onWriteFinished)
 {
     auto onSendFinished = [=] {
-        // Do nothing once we've finished sending the response, so that
-        // the connection isn't closed
+        // Don't close the connection once we've finished sending the
+        // header, as the body is still to come
+        if (onWriteFinished)
+            onWriteFinished();
     };
     
     for (auto & h: endpoint->extraHeaders)
@@ -246,7 +314,19 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    // Each chunk is preceded by its length in hex and followed by a CRLF;
+    // the last one is empty, which gives "0\r\n\r\n".
+    char header[32];
+    int headerLength = snprintf(header, sizeof(header), "%zx\r\n",
+                                chunk.size());
+
+    std::string toSend;
+    toSend.reserve(headerLength + chunk.size() + 4);
+    toSend.append(header, headerLength);
+    toSend.append(chunk);
+    toSend.append("\r\n");
+
+    HttpLegacySocketHandler::send(std::move(toSend), next, onWriteFinished);
 }
 
 inline void
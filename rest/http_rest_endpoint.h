@@ -14,6 +14,7 @@
 #include <memory>
 #include <string>
 #include <time.h>
+#include <vector>
 
 namespace MLDB {
 
@@ -65,6 +66,16 @@ struct HttpRestEndpoint {
     */
     virtual std::string
     bindTcp(PortRange const & portRange, std::string host = "");
+
+    /** Number of acceptors to listen with.  When more than one, every
+        acceptor binds to the same port with SO_REUSEPORT, and all but the
+        first get their own event loop and thread.  Each owns the
+        connections it accepts, and handles their requests on that thread
+        without handing them over to the shared thread pool, so that the
+        accepting and dispatching of small requests is spread across
+        cores.  Must be set before binding.
+    */
+    int numAcceptors;
     
     /** Connection handler structure for the endpoint. */
     struct RestConnectionHandler: public HttpLegacySocketHandler {
@@ -92,12 +103,18 @@ struct HttpRestEndpoint {
                           std::string body, std::string contentType,
                           RestParams headers = RestParams());
 
+        /** Send the header of a response, whose body will be sent
+            separately.  The onWriteFinished callback is called once it's
+            been written.
+        */
         void sendResponseHeader(int code,
                                 std::string contentType,
-                                RestParams headers = RestParams());
+                                RestParams headers = RestParams(),
+                                OnWriteFinished onWriteFinished
+                                    = OnWriteFinished());
 
         /** Send an HTTP chunk with the appropriate headers back down the
-            wire. */
+            wire.  An empty chunk marks the end of the response. */
         void sendHttpChunk(std::string chunk,
                            NextAction next = NEXT_CONTINUE,
                            OnWriteFinished onWriteFinished = OnWriteFinished());
@@ -118,6 +135,12 @@ struct HttpRestEndpoint {
     std::vector<std::pair<std::string, std::string> > extraHeaders;
 
     std::unique_ptr<TcpAcceptor> acceptor_;
+
+private:
+    struct AcceptorShard;
+    std::vector<std::unique_ptr<AcceptorShard> > shards_;
+    std::function<std::shared_ptr<TcpSocketHandler> (TcpSocket &&)>
+        makeHandler_;
 };
 
 } // namespace MLDB
@@ -15,16 +15,175 @@
 #include "http_rest_endpoint.h"
 #include "http_rest_service.h"
 #include "mldb/utils/log.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include <boost/algorithm/string.hpp>
 
 using namespace std;
 
 
 namespace MLDB {
 
+/*****************************************************************************/
+/* CONTENT CODING                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/// Compression level for each of the codings that we send.  These favour
+/// speed, since the compression happens on the request thread.
+std::unique_ptr<Compressor> createResponseCompressor(const std::string & name)
+{
+    int level = name == "zstd" ? 3 : 5;
+    return std::unique_ptr<Compressor>(Compressor::create(name, level));
+}
+
+/// Return the name of the compressor for the given HTTP content coding,
+/// or the empty string if there is none
+std::string codingToCompressor(std::string coding)
+{
+    boost::algorithm::to_lower(coding);
+    if (coding == "gzip" || coding == "x-gzip")
+        return "gzip";
+    if (coding == "zstd")
+        return "zstd";
+    return std::string();
+}
+
+} // file scope
+
+std::string
+negotiateResponseCompression(const std::string & acceptEncoding)
+{
+    if (acceptEncoding.empty())
+        return std::string();
+
+    // In order of preference when the client gives them the same weight
+    static const std::vector<std::string> supported = { "zstd", "gzip" };
+    std::vector<double> weights(supported.size(), -1.0);
+    double wildcardWeight = -1.0;
+
+    std::vector<std::string> codings;
+    boost::algorithm::split(codings, acceptEncoding,
+                            boost::algorithm::is_any_of(","));
+    for (auto & c: codings) {
+        std::vector<std::string> params;
+        boost::algorithm::split(params, c, boost::algorithm::is_any_of(";"));
+        std::string coding = boost::algorithm::trim_copy(params[0]);
+        double weight = 1.0;
+        for (size_t i = 1;  i < params.size();  ++i) {
+            std::string param = boost::algorithm::trim_copy(params[i]);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q')
+                && param[1] == '=') {
+                weight = strtod(param.c_str() + 2, nullptr);
+            }
+        }
+
+        if (coding == "*") {
+            wildcardWeight = weight;
+            continue;
+        }
+        std::string compressor = codingToCompressor(coding);
+        for (size_t i = 0;  i < supported.size();  ++i) {
+            if (supported[i] == compressor)
+                weights[i] = weight;
+        }
+    }
+
+    std::string result;
+    double bestWeight = 0.0;
+    for (size_t i = 0;  i < supported.size();  ++i) {
+        double weight = weights[i] < 0.0 ? wildcardWeight : weights[i];
+        if (weight > bestWeight) {
+            result = supported[i];
+            bestWeight = weight;
+        }
+    }
+    return result;
+}
+
+std::string
+decodeRequestBody(const std::string & contentEncoding,
+                  const std::string & body)
+{
+    std::vector<std::string> codings;
+    boost::algorithm::split(codings, contentEncoding,
+                            boost::algorithm::is_any_of(","));
+
+    std::string result = body;
+
+    // The codings are listed in the order they were applied
+    for (auto it = codings.rbegin(), end = codings.rend();  it != end;  ++it) {
+        std::string coding = boost::algorithm::trim_copy(*it);
+        if (coding.empty() || boost::algorithm::iequals(coding, "identity"))
+            continue;
+
+        std::string name = codingToCompressor(coding);
+        std::unique_ptr<Decompressor> decompressor;
+        if (!name.empty())
+            decompressor.reset(Decompressor::create(name));
+        if (!decompressor) {
+            throw HttpReturnException(415, "Unsupported Content-Encoding '"
+                                      + coding + "' for request body; "
+                                      "accepted are 'gzip' and 'zstd'",
+                                      "contentEncoding", contentEncoding);
+        }
+
+        std::string decoded;
+        auto onData = [&] (const char * data, size_t len) -> size_t
+            {
+                decoded.append(data, len);
+                return len;
+            };
+        decompressor->decompress(result.data(), result.size(), onData);
+        decompressor->finish(onData);
+        result = std::move(decoded);
+    }
+
+    return result;
+}
+
 /*****************************************************************************/
 /* REST SERVICE ENDPOINT CONNECTION ID                                       */
 /*****************************************************************************/
 
+bool
+HttpRestConnection::
+compressBody(std::string & body, RestParams & headers) const
+{
+    if (compression.empty() || body.size() < MIN_COMPRESSED_SIZE)
+        return false;
+
+    // Already encoded by whoever made the response
+    for (auto & h: headers) {
+        if (h.first.rawString() == "Content-Encoding"
+            || h.first.rawString() == "content-encoding")
+            return false;
+    }
+
+    auto compressor = createResponseCompressor(compression);
+    if (!compressor)
+        return false;
+
+    std::string compressed;
+    auto onData = [&] (const char * data, size_t len) -> size_t
+        {
+            compressed.append(data, len);
+            return len;
+        };
+    compressor->compress(body.data(), body.size(), onData);
+    compressor->finish(onData);
+
+    if (compressed.size() >= body.size())
+        return false;
+
+    body = std::move(compressed);
+    headers.push_back({"Content-Encoding", compression});
+    headers.push_back({"Vary", "Accept-Encoding"});
+    return true;
+}
+
 void
 HttpRestConnection::
 sendResponse(int responseCode, std::string response, std::string contentType)
@@ -36,8 +195,12 @@ sendResponse(int responseCode, std::string response, std::string contentType)
         endpoint->logResponse(*this, responseCode, response,
                               contentType);
     
+    RestParams headers;
+    compressBody(response, headers);
+
     http->sendResponse(responseCode,
-                       std::move(response), std::move(contentType));
+                       std::move(response), std::move(contentType),
+                       std::move(headers));
     
     responseSent_ = true;
 }
@@ -52,6 +215,11 @@ sendResponse(int responseCode,
     //cerr << "sent response " << responseCode << " " << response
     //     << endl;
 
+    if (!compression.empty()) {
+        sendResponse(responseCode, response.toString(), std::move(contentType));
+        return;
+    }
+
     if (responseSent_)
         throw MLDB::Exception("response already sent");
 
@@ -133,6 +301,8 @@ sendHttpResponse(int responseCode,
         endpoint->logResponse(*this, responseCode, response,
                               contentType);
 
+    compressBody(response, headers);
+
     http->sendResponse(responseCode, std::move(response), std::move(contentType),
                        std::move(headers));
     responseSent_ = true;
@@ -154,6 +324,26 @@ sendHttpResponseHeader(int responseCode,
         endpoint->logResponse(*this, responseCode, "", contentType);
 
     RestParams headers = headers_;
+
+    // The compressed length isn't known until the end, so a compressed
+    // response is always chunked
+    if (!compression.empty() && responseCode != 204 && responseCode != 304) {
+        bool encoded = false;
+        for (auto & h: headers) {
+            if (h.first.rawString() == "Content-Encoding"
+                || h.first.rawString() == "content-encoding")
+                encoded = true;
+        }
+        if (!encoded)
+            streamCompressor = createResponseCompressor(compression);
+        if (streamCompressor) {
+            headers.push_back({"Content-Encoding", compression});
+            headers.push_back({"Vary", "Accept-Encoding"});
+            if (contentLength >= 0)
+                contentLength = CHUNKED_ENCODING;
+        }
+    }
+
     if (contentLength == CHUNKED_ENCODING) {
         chunkedEncoding = true;
         headers.push_back({"Transfer-Encoding", "chunked"});
@@ -165,8 +355,27 @@ sendHttpResponseHeader(int responseCode,
         keepAlive = false;
     }
 
+    auto onWritten = startWrite();
     http->sendResponseHeader(responseCode,
-                             std::move(contentType), std::move(headers));
+                             std::move(contentType), std::move(headers),
+                             std::move(onWritten));
+}
+
+std::function<void ()>
+HttpRestConnection::
+startWrite()
+{
+    auto state = writeState;
+    std::unique_lock<std::mutex> guard(state->mutex);
+    state->cond.wait(guard, [&] () { return !state->inProgress; });
+    state->inProgress = true;
+
+    return [state] ()
+        {
+            std::unique_lock<std::mutex> guard(state->mutex);
+            state->inProgress = false;
+            state->cond.notify_all();
+        };
 }
 
 bool
@@ -181,19 +390,79 @@ void
 HttpRestConnection::
 sendPayload(std::string payload)
 {
-    if (chunkedEncoding) {
-        if (payload.empty()) {
+    if (payload.empty()) {
+        if (chunkedEncoding)
             throw MLDB::Exception("Can't send empty chunk over a chunked connection");
+        return;
+    }
+
+    auto onWritten = startWrite();
+
+    // The client went away while we were waiting; there's no point going
+    // on producing the response
+    if (!http->isConnected()) {
+        onWritten();
+        throw MLDB::Exception("connection was closed while sending response");
+    }
+
+    // This is done once the previous write has finished, so that only one
+    // thread at a time uses the compressor
+    if (streamCompressor) {
+        std::string compressed;
+        auto onData = [&] (const char * data, size_t len) -> size_t
+            {
+                compressed.append(data, len);
+                return len;
+            };
+        try {
+            streamCompressor->compress(payload.data(), payload.size(), onData);
+            streamCompressor->flush(Compressor::FLUSH_AVAILABLE, onData);
+        } catch (...) {
+            onWritten();
+            throw;
+        }
+        if (compressed.empty()) {
+            onWritten();
+            return;
         }
-        http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE);
+        payload = std::move(compressed);
     }
-    else http->send(std::move(payload));
+
+    if (chunkedEncoding) {
+        http->sendHttpChunk(std::move(payload),
+                            HttpLegacySocketHandler::NEXT_CONTINUE,
+                            std::move(onWritten));
+    }
+    else http->send(std::move(payload),
+                    HttpLegacySocketHandler::NEXT_CONTINUE,
+                    std::move(onWritten));
 }
 
 void
 HttpRestConnection::
 finishResponse()
 {
+    // Make sure that the last payload has been written first
+    startWrite()();
+
+    if (streamCompressor) {
+        std::string tail;
+        auto onData = [&] (const char * data, size_t len) -> size_t
+            {
+                tail.append(data, len);
+                return len;
+            };
+        streamCompressor->finish(onData);
+        streamCompressor.reset();
+        if (!tail.empty()) {
+            if (chunkedEncoding)
+                http->sendHttpChunk(std::move(tail),
+                                    HttpLegacySocketHandler::NEXT_CONTINUE);
+            else http->send(std::move(tail),
+                            HttpLegacySocketHandler::NEXT_CONTINUE);
+        }
+    }
+
     if (chunkedEncoding) {
         http->sendHttpChunk("", HttpLegacySocketHandler::NEXT_CLOSE);
     }
@@ -273,8 +542,37 @@ init()
         {
             std::string requestId = this->getHttpRequestId();
             HttpRestConnection restConnection(connection, requestId, this);
+            restConnection.compression
+                = negotiateResponseCompression
+                    (header.tryGetHeader("accept-encoding"));
+
+            const std::string & contentEncoding
+                = header.tryGetHeader("content-encoding");
+            if (contentEncoding.empty()) {
+                this->doHandleRequest(restConnection,
+                                      RestRequest(header, payload));
+                return;
+            }
+
+            // The handlers see the request as if it had been sent without
+            // any encoding
+            std::string decoded;
+            try {
+                decoded = decodeRequestBody(contentEncoding, payload);
+            } catch (const std::exception & exc) {
+                auto httpExc = dynamic_cast<const HttpReturnException *>(&exc);
+                Json::Value error;
+                error["error"] = "Error decoding request body with "
+                    "Content-Encoding '" + contentEncoding + "': " + exc.what();
+                restConnection.sendErrorResponse
+                    (httpExc ? httpExc->httpCode : 400, error);
+                return;
+            }
+            HttpHeader decodedHeader = header;
+            decodedHeader.headers.erase("content-encoding");
+            decodedHeader.contentLength = decoded.size();
             this->doHandleRequest(restConnection,
-                                  RestRequest(header, payload));
+                                  RestRequest(decodedHeader, decoded));
         };
 }
 
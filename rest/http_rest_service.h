@@ -11,6 +11,8 @@
 
 #include <memory>
 #include <string>
+#include <mutex>
+#include <condition_variable>
 
 #include "mldb/io/asio_thread_pool.h"
 #include "mldb/rest/http_rest_endpoint.h"
@@ -28,6 +30,23 @@ namespace MLDB {
 struct EventLoop;
 struct HttpRestEndpoint;
 struct HttpRestService;
+struct Compressor;
+
+
+/** Choose the content coding for a response from the value of the
+    Accept-Encoding header of the request, honouring the q-values.
+    Returns the name of the Compressor to use ("zstd" or "gzip", which
+    are also the HTTP names of the codings), or the empty string if the
+    response should be sent uncompressed.
+*/
+std::string negotiateResponseCompression(const std::string & acceptEncoding);
+
+/** Decode a request body that was sent with the given Content-Encoding
+    header (a list of codings, applied in order).  Throws an
+    HttpReturnException with a 415 code for an unknown coding.
+*/
+std::string decodeRequestBody(const std::string & contentEncoding,
+                              const std::string & body);
 
 
 /*****************************************************************************/
@@ -38,6 +57,7 @@ struct HttpRestService;
 struct HttpRestConnection: public RestConnection {
     /// Don't initialize for now
     HttpRestConnection()
+        : writeState(std::make_shared<WriteState>())
     {
     }
         
@@ -51,7 +71,8 @@ struct HttpRestConnection: public RestConnection {
           responseSent_(false),
           startDate(Date::now()),
           chunkedEncoding(false),
-          keepAlive(true)
+          keepAlive(true),
+          writeState(std::make_shared<WriteState>())
     {
     }
 
@@ -63,6 +84,50 @@ struct HttpRestConnection: public RestConnection {
     bool chunkedEncoding;
     bool keepAlive;
 
+    /** Name of the Compressor for the content coding negotiated with the
+        client (see negotiateResponseCompression()), or empty to send the
+        response as-is.
+    */
+    std::string compression;
+
+    /// Responses with a body smaller than this aren't worth compressing
+    static constexpr size_t MIN_COMPRESSED_SIZE = 1024;
+
+    /** Compressor for a streamed response, created when its header is
+        sent.  Each payload is flushed through it so that the client can
+        decode it as soon as it's received.
+    */
+    std::shared_ptr<Compressor> streamCompressor;
+
+    /** Compress the body of a response that is sent in one piece, if a
+        coding was negotiated and it's worth it, adding the headers to
+        say so.  Returns true if the body was compressed.
+    */
+    bool compressBody(std::string & body, RestParams & headers) const;
+
+    /** Tracks whether part of a streamed response is still being written
+        to the socket.  Only one write is allowed to be outstanding at a
+        time, so sendPayload() waits for the previous part to have been
+        written before sending the next.  This gives backpressure to
+        whatever is producing the response, and stops the writes from
+        being interleaved on the socket.
+
+        It's shared so that it outlives the connection if a write is in
+        progress when the connection is destroyed.
+    */
+    struct WriteState {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool inProgress = false;
+    };
+
+    std::shared_ptr<WriteState> writeState;
+
+    /** Wait for the previous write to finish, and return the callback to
+        be called when the next one finishes.
+    */
+    std::function<void ()> startWrite();
+
     /** Data that is maintained with the connection.  This is where control
         data required for asynchronous or long-running connections can be
         put.
@@ -100,7 +165,9 @@ struct HttpRestConnection: public RestConnection {
                                         ssize_t contentLength,
                                         RestParams headers = RestParams());
     
-    /** Send a payload (or a chunk of a payload) for an HTTP connection. */
+    /** Send a payload (or a chunk of a payload) for an HTTP connection.
+        This blocks until the previous payload has been written.
+    */
     virtual void sendPayload(std::string payload);
 
     /** Finish the response, recycling or closing the connection. */
@@ -8,6 +8,8 @@
 */
 
 #include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/json_printing.h"
 
 
 using namespace std;
@@ -21,7 +23,9 @@ namespace MLDB {
 
 InProcessRestConnection::
 InProcessRestConnection()
-        : responseCode(-1)
+        : responseCode(-1),
+          structuredResponse(false),
+          hasJsonResponse(false)
 {
 }
 
@@ -45,8 +49,46 @@ sendResponse(int responseCode,
              const Json::Value & response, std::string contentType)
 {
     this->responseCode = responseCode;
-    this->response = response.toStringNoNewLine();
     this->contentType = std::move(contentType);
+    if (structuredResponse && responseCode >= 200 && responseCode < 300
+        && this->contentType == "application/json") {
+        this->jsonResponse = response;
+        this->hasJsonResponse = true;
+    }
+    else this->response = response.toStringNoNewLine();
+}
+
+void InProcessRestConnection::
+sendJsonResponse(int responseCode,
+                 const void * value,
+                 const ValueDescription & desc)
+{
+    if (!structuredResponse || responseCode < 200 || responseCode >= 300) {
+        HttpRestConnection::sendJsonResponse(responseCode, value, desc);
+        return;
+    }
+
+    this->responseCode = responseCode;
+    this->contentType = "application/json";
+    StructuredJsonPrintingContext context(this->jsonResponse);
+    desc.printJson(value, context);
+    this->hasJsonResponse = true;
+}
+
+Json::Value InProcessRestConnection::
+getJsonResponse() const
+{
+    if (hasJsonResponse)
+        return jsonResponse;
+    return Json::parse(response);
+}
+
+std::string InProcessRestConnection::
+getResponseText() const
+{
+    if (hasJsonResponse)
+        return jsonResponse.toStringNoNewLine();
+    return response;
 }
 
 void InProcessRestConnection::
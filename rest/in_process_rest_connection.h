@@ -34,6 +34,13 @@ struct InProcessRestConnection: public HttpRestConnection {
                  const Json::Value & response,
                  std::string contentType = "application/json");
 
+    /** Send a typed JSON response.  If structuredResponse is set, it's
+        put into jsonResponse without being printed.
+    */
+    virtual void sendJsonResponse(int responseCode,
+                                  const void * value,
+                                  const ValueDescription & desc);
+
     virtual void sendRedirect(int responseCode, std::string location);
 
     /** Send an HTTP-only response with the given headers.  If it's not
@@ -68,6 +75,28 @@ struct InProcessRestConnection: public HttpRestConnection {
     RestParams headers;
     std::string response;
 
+    /** If set by the caller before the request is handled, a successful
+        response that is sent as JSON is kept as a value in jsonResponse,
+        and response is left empty.  Callers in the same process (like
+        the language plugins) can then turn it straight into their own
+        objects, without printing and parsing JSON text.
+    */
+    bool structuredResponse;
+
+    /// True if the response was kept in jsonResponse
+    bool hasJsonResponse;
+    Json::Value jsonResponse;
+
+    /** Return the response as JSON, parsing the text if it wasn't kept
+        as a value.
+    */
+    Json::Value getJsonResponse() const;
+
+    /** Return the text of the response, printing jsonResponse if that's
+        where it was kept.
+    */
+    std::string getResponseText() const;
+
     virtual std::shared_ptr<RestConnection>
     capture(std::function<void ()> onDisconnect);
 
@@ -31,7 +31,9 @@ bool operator==(const PolyConfig & lhs, const PolyConfig & rhs)
         lhs.type == rhs.type &&
         lhs.persistent == rhs.persistent &&
         lhs.params == rhs.params &&
-        lhs.deterministic == rhs.deterministic;
+        lhs.deterministic == rhs.deterministic &&
+        lhs.resultCacheBytes == rhs.resultCacheBytes &&
+        lhs.resultCacheTtl == rhs.resultCacheTtl;
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(PolyConfig);
@@ -133,6 +133,16 @@ public:
                  std::shared_ptr<const ValueDescription> config = nullptr,
                  std::set<std::string> registryFlags = {});
 
+    /** Record that the given type isn't registered yet, but will be once
+        load() is called, for example by loading the plugin that provides
+        it.  It's called (possibly more than once, and from several threads
+        at once) the first time that the type is needed.  Until then the
+        type is listed with the registered ones.
+    */
+    static void
+    registerDeferredType(const Utf8String & name,
+                         std::function<void ()> load);
+
     template<typename T>
     static std::shared_ptr<EntityType<Entity> >
     registerType(const Package & package,
@@ -185,6 +185,9 @@ struct PolyCollection<Entity>::Registry {
     std::map<Utf8String, Entry> registry;
     WatchesT<Utf8String> watches;
 
+    /// Types that aren't registered yet, with what will register them
+    std::map<Utf8String, std::function<void ()> > deferred;
+
     void insert(const Utf8String & name,
                 const Utf8String & description,
                 const CreateEntity & createEntity,
@@ -197,17 +200,55 @@ struct PolyCollection<Entity>::Registry {
         if (!registry.insert(std::make_pair(name, Entry{ description, createEntity, docRoute, customRoute, config, registryFlags })).second) {
             throw HttpReturnException(400, "double-registering type " + name);
         }
-        watches.trigger(name);
+        // Deferred types were already announced to the watches
+        if (!deferred.erase(name))
+            watches.trigger(name);
     }
-    
-    const CreateEntity & lookup(const Utf8String & type)
+
+    void insertDeferred(const Utf8String & name,
+                        std::function<void ()> load)
+    {
+        std::unique_lock<std::recursive_mutex> guard(mutex);
+        if (registry.count(name))
+            return;
+        bool isNew = !deferred.count(name);
+        deferred[name] = std::move(load);
+        if (isNew)
+            watches.trigger(name);
+    }
+
+    /** Find the given type, first running whatever was deferred to
+        register it if it's not there yet.  The entries are never removed,
+        so the iterator stays valid once the lock is released.
+    */
+    typename std::map<Utf8String, Entry>::const_iterator
+    find(const Utf8String & type) const
     {
         std::unique_lock<std::recursive_mutex> guard(mutex);
         auto it = registry.find(type);
-        if (it == registry.end())
-            throw HttpReturnException(400, "couldn't find type '" + type
-                                      + "' in registry");
-        return it->second.create;
+        if (it != registry.end())
+            return it;
+
+        auto jt = deferred.find(type);
+        if (jt != deferred.end()) {
+            // Loading may take a while and register other types, so it's
+            // done without holding the lock
+            auto load = jt->second;
+            guard.unlock();
+            load();
+            guard.lock();
+            it = registry.find(type);
+            if (it != registry.end())
+                return it;
+        }
+
+        throw HttpReturnException(400, "couldn't find type '" + type
+                                  + "' in registry");
+    }
+    
+    const CreateEntity & lookup(const Utf8String & type)
+    {
+        return find(type)->second.create;
     }
 
     RestRequestMatchResult
@@ -217,16 +258,7 @@ struct PolyCollection<Entity>::Registry {
                      const RestRequest & req,
                      const RestRequestParsingContext & cxt)
     {
-        std::unique_lock<std::recursive_mutex> guard(mutex);
-
-        using namespace std;
-        //cerr << "cxt.resources = " << cxt.resources << endl;
-
-        auto it = registry.find(type);
-        if (it == registry.end())
-            throw HttpReturnException(400, "couldn't find type '"
-                                      + type + "' in registry");
-        guard.unlock();
+        auto it = find(type);
 
         if (!it->second.docRoute) {
             connection.sendErrorResponse(404, "type " + type + " has no documentation registered");
@@ -239,13 +271,7 @@ struct PolyCollection<Entity>::Registry {
                             const Utf8String & type) const
     {
         try {
-            std::unique_lock<std::recursive_mutex> guard(mutex);
-
-            auto it = registry.find(type);
-            if (it == registry.end())
-                throw HttpReturnException(400, "couldn't find type '" + type
-                                          + "' in registry");
-            guard.unlock();
+            auto it = find(type);
 
             Json::Value result;
         
@@ -292,16 +318,7 @@ struct PolyCollection<Entity>::Registry {
                         const RestRequest & req,
                         const RestRequestParsingContext & cxt)
     {
-        std::unique_lock<std::recursive_mutex> guard(mutex);
-        
-        using namespace std;
-        //cerr << "cxt.resources = " << cxt.resources << endl;
-        
-        auto it = registry.find(type);
-        if (it == registry.end())
-            throw HttpReturnException(400, "couldn't find type '" + type
-                                      + "' in registry");
-        guard.unlock();
+        auto it = find(type);
 
         if (!it->second.customRoute) {
             connection.sendErrorResponse(404, "type " + type + " has no custom route handler registered");
@@ -316,6 +333,8 @@ struct PolyCollection<Entity>::Registry {
         std::vector<Utf8String> result;
         for (auto & r: registry)
             result.push_back(r.first);
+        for (auto & d: deferred)
+            result.push_back(d.first);
         return result;
     }
 
@@ -356,6 +375,15 @@ registerType(const Package & package,
     return nullptr;
 }
 
+template<typename Entity>
+void
+PolyCollection<Entity>::
+registerDeferredType(const Utf8String & name,
+                     std::function<void ()> load)
+{
+    getRegistry().insertDeferred(name, std::move(load));
+}
+
 template<typename Entity>
 std::shared_ptr<Entity>
 PolyCollection<Entity>::
@@ -74,7 +74,9 @@ struct RestDirectory;
 struct PolyConfig {
     PolyConfig()
         : persistent(false),
-          deterministic(true)
+          deterministic(true),
+          resultCacheBytes(0),
+          resultCacheTtl(0)
     {
     }
 
@@ -82,6 +84,8 @@ struct PolyConfig {
     Utf8String type;      ///< Type of the entity.
     bool persistent;      ///< Save this object's configuration for loading
     bool deterministic;   ///< The entity has no hidden state
+    uint64_t resultCacheBytes;  ///< Functions: memory for cached results
+    double resultCacheTtl;      ///< Functions: seconds a result is cached
     Any params;           ///< Creation parameters, per type
 };
 
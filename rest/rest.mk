@@ -5,6 +5,7 @@
 # Copyright (c) 2015 mldb.ai inc.  All rights reserved.
 
 LIBREST_SOURCES := \
+	rest_connection.cc \
 	rest_request.cc \
 	rest_request_router.cc \
 	rest_request_binding.cc \
@@ -13,7 +14,6 @@ LIBREST_SOURCES := \
 	rest_service_endpoint.cc \
 	http_rest_endpoint.cc \
 	http_rest_service.cc \
-	cancellation_exception.cc \
 
 LIBLINK_SOURCES := \
 	call_me_back.cc \
@@ -40,7 +40,7 @@ LIBSERVICE_PEER_SOURCES := \
 	peer_info.cc \
 
 
-$(eval $(call library,rest,$(LIBREST_SOURCES),services log))
+$(eval $(call library,rest,$(LIBREST_SOURCES),services log base))
 $(eval $(call library,link,$(LIBLINK_SOURCES),watch))
 $(eval $(call library,rest_entity,$(LIBREST_ENTITY_SOURCES),services gc link any json_diff))
 $(eval $(call library,service_peer,$(LIBSERVICE_PEER_SOURCES),rest services gc link rest_entity))
@@ -17,6 +17,7 @@
 #include "mldb/types/structure_description.h"
 #include "mldb/types/enum_description.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/jml/utils/environment.h"
 
 
 using namespace std;
@@ -670,8 +671,20 @@ bool
 BackgroundTaskBase::
 cancel() noexcept
 {
+    {
+        // A task that never started now won't; this also frees what its
+        // start function holds on to, which includes the task itself
+        std::unique_lock<std::mutex> guard(mutex);
+        if (deferredStart) {
+            deferredStart = nullptr;
+            done = true;
+            doneCondition.notify_all();
+        }
+    }
+
     auto old_state = state.exchange(State::CANCELLED);
     if (old_state != State::CANCELLED && old_state != State::FINISHED) {
+        cancellation.cancel();
         try {
             cancelledWatches.trigger(true);
         }
@@ -766,6 +779,38 @@ setProgress(const Json::Value & _progress)
     }
 }
 
+bool
+BackgroundTaskBase::
+startDeferred()
+{
+    std::function<void ()> start;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (!deferredStart)
+            return false;
+        start = std::move(deferredStart);
+        deferredStart = nullptr;
+        running = true;
+    }
+    start();
+    return true;
+}
+
+bool
+BackgroundTaskBase::
+waitUntilDone()
+{
+    static EnvOption<double> MLDB_ENTITY_LOAD_WAIT("MLDB_ENTITY_LOAD_WAIT",
+                                                    600.0);
+
+    startDeferred();
+
+    std::unique_lock<std::mutex> guard(mutex);
+    return doneCondition.wait_for
+        (guard, std::chrono::duration<double>(MLDB_ENTITY_LOAD_WAIT.get()),
+         [&] () { return done; });
+}
+
 Utf8String
 BackgroundTaskBase::
 getState() const
@@ -13,9 +13,11 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/rest/rest_request_params.h"
 #include "mldb/watch/watch.h"
+#include "mldb/base/cancellation.h"
 #include "link.h"
 #include <map>
 #include <atomic>
+#include <condition_variable>
 
 
 namespace MLDB {
@@ -150,19 +152,44 @@ struct BackgroundTaskBase {
 
     Utf8String getState() const;
 
+    /** Start a task that was added without being started, as for an
+        entity loaded from the config store.  Returns false if it had
+        already been started.
+    */
+    bool startDeferred();
+
+    /** Start the task if needed, and wait for it to be done and its
+        entity (if any) to be added to the collection.  Gives up after
+        MLDB_ENTITY_LOAD_WAIT seconds, returning false.
+    */
+    bool waitUntilDone();
+
     typedef std::function<bool (const Json::Value &)> OnProgress;
 
     /** A task is running until it is CANCELLED, FINISHED or in ERROR state */
     std::atomic<bool>  running;
     std::atomic<State> state;
     WatchesT<bool> cancelledWatches;
-    
+
+    /// Current while the task runs, and cancelled along with it
+    CancellationToken cancellation;
+
+    /** Set for the construction of an entity loaded from the config
+        store.  getExistingEntry() waits for these instead of reporting
+        that the entity isn't ready, so that entities that use each other
+        can be loaded in any order.  Set before the task is added.
+    */
+    bool fromConfig = false;
+
     /// Everything below here is protected by this mutex
     mutable std::mutex mutex;
     std::exception_ptr exc;
     Json::Value progress;
     std::vector<OnProgress> onProgressFunctions;
     int64_t handle;  ///< Handle of the thread running task
+    std::function<void ()> deferredStart;  ///< Starts it, if not started
+    bool done = false;  ///< The collection has been updated with its result
+    std::condition_variable doneCondition;  ///< Notified once done
 };
 
 
@@ -328,7 +355,18 @@ struct RestCollection : public RestCollectionBase {
                                   const OnProgress & onProgress = nullptr,
                                   const OnDone & onDone = nullptr,
                                   bool mustBeNewEntry = false,
-                                  Any config = Any());
+                                  Any config = Any(),
+                                  bool fromConfig = false);
+
+    /** Start the construction of all of the entries that were loaded
+        from the config store without being started.
+    */
+    void startDeferredJobs();
+
+    /** Wait until all of the entries loaded from the config store have
+        been constructed, or have failed.
+    */
+    void waitForDeferredJobs();
 
     void finishedBackgroundJob(Key key,
                                std::shared_ptr<BackgroundTask> task,
@@ -491,6 +529,16 @@ struct RestConfigurableCollection: public RestCollection<Key, Value> {
     */
     virtual void loadConfig();
 
+    /** Add entries for the entities in the store configured via
+        attachConfig, without constructing them.  Each is constructed once
+        startDeferredJobs() is called or once it's needed by
+        getExistingEntry(), whichever comes first.  Until then, the entry
+        is reported as initializing.  Registering the entries of all
+        collections before starting any means that an entity can wait for
+        one it depends on, in this collection or another.
+    */
+    virtual void registerConfig();
+
     /** Return whether this object has required persistence.  Default
         implementation returns true.
     */
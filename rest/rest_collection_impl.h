@@ -519,7 +519,8 @@ addBackgroundJobInThread(Key key,
                          const OnProgress & onProgress,
                          const OnDone & onDone,
                          bool mustBeNewEntry,
-                         Any config)
+                         Any config,
+                         bool fromConfig)
 {
     using namespace std;
 
@@ -562,6 +563,7 @@ addBackgroundJobInThread(Key key,
         // Set up the task, without starting it yet
         auto task = std::make_shared<BackgroundTask>();
         task->config = config;
+        task->fromConfig = fromConfig;
 
         auto onProgressFn = [=] (const Json::Value & progress)
             {
@@ -579,6 +581,7 @@ addBackgroundJobInThread(Key key,
         auto toRun = [=] ()
             {
                 MLDB_TRACE_EXCEPTIONS(false);
+                CancellationScope cancellationScope(&task->cancellation);
                 try {
                     WatchT<bool> cancelled = std::move(*cancelledPtr);
                     task->value = fn(onProgressFn, std::move(cancelled));
@@ -611,19 +614,31 @@ addBackgroundJobInThread(Key key,
         if (onDone)
             task->onDoneFunctions.push_back(onDone);
 
-        std::atomic_thread_fence(std::memory_order_release);
+        auto start = [=] ()
+            {
+                std::thread thread(toRun);
 
-        if (impl->entries.cmp_xchg(oldEntries, newEntries, true)) {
-            // Now we can start the task, since the commit succeeded
-            task->running = true;
-            std::thread thread(toRun);
+                auto handle = thread.native_handle();
 
-            auto handle = thread.native_handle();
+                task->setHandle(handle);
 
-            task->setHandle(handle);
+                // The thread runs independently and cleans itself up
+                thread.detach();
+            };
 
-            // The thread runs independently and cleans itself up
-            thread.detach();
+        // Entries loaded from the config store are started later, once
+        // all of them are known; see registerConfig()
+        if (fromConfig)
+            task->deferredStart = start;
+
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (impl->entries.cmp_xchg(oldEntries, newEntries, true)) {
+            // Now we can start the task, since the commit succeeded
+            if (!fromConfig) {
+                task->running = true;
+                start();
+            }
             return;
         }
 
@@ -670,6 +685,48 @@ finishedBackgroundJob(Key key,
         for (auto & f: task->onDoneFunctions)
             f(task->value);
     }
+
+    task->done = true;
+    task->doneCondition.notify_all();
+}
+
+template<typename Key, class Value>
+void
+RestCollection<Key, Value>::
+startDeferredJobs()
+{
+    std::vector<std::shared_ptr<BackgroundTask> > tasks;
+    {
+        GcLock::SharedGuard guard(impl->entriesLock);
+        auto es = impl->entries.getImmutable();
+        for (auto & e: *es) {
+            if (e.second.underConstruction)
+                tasks.push_back(e.second.underConstruction);
+        }
+    }
+
+    for (auto & t: tasks)
+        t->startDeferred();
+}
+
+template<typename Key, class Value>
+void
+RestCollection<Key, Value>::
+waitForDeferredJobs()
+{
+    std::vector<std::shared_ptr<BackgroundTask> > tasks;
+    {
+        GcLock::SharedGuard guard(impl->entriesLock);
+        auto es = impl->entries.getImmutable();
+        for (auto & e: *es) {
+            if (e.second.underConstruction
+                && e.second.underConstruction->fromConfig)
+                tasks.push_back(e.second.underConstruction);
+        }
+    }
+
+    for (auto & t: tasks)
+        t->waitUntilDone();
 }
 
 template<typename Key, class Value>
@@ -913,19 +970,32 @@ std::shared_ptr<Value>
 RestCollection<Key, Value>::
 getExistingEntry(Key key) const
 {
-    // NOTE: Should not be necessary... investigation needed
-    GcLock::SharedGuard guard(impl->entriesLock);
+    std::shared_ptr<BackgroundTask> task;
+    {
+        // NOTE: Should not be necessary... investigation needed
+        GcLock::SharedGuard guard(impl->entriesLock);
 
-    auto es = impl->entries.getImmutable();
+        auto es = impl->entries.getImmutable();
 
-    auto it = es->find(key);
-    if (it != es->end() && it->second.value)
-        return it->second.value;
+        auto it = es->find(key);
+        if (it != es->end() && it->second.value)
+            return it->second.value;
 
-    if (it != es->end())
-        this->throwEntryNotReady(key);
-    else
-        this->throwEntryDoesntExist(key);
+        if (it == es->end())
+            this->throwEntryDoesntExist(key);
+
+        task = it->second.underConstruction;
+    }
+
+    // An entity still being loaded from the config store is waited for
+    // (and started, if it's loaded lazily), as the caller may be loading
+    // another one that depends on it.
+    if (task && task->fromConfig && task->waitUntilDone()
+        && task->state == BackgroundTaskBase::State::FINISHED
+        && task->value)
+        return task->value;
+
+    this->throwEntryNotReady(key);
 }
 
 template<typename Key, class Value>
@@ -1748,6 +1818,30 @@ loadConfig()
     }
 }
 
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::
+registerConfig()
+{
+    if (!configStore) return;
+
+    for (const auto & key_config: configStore->getAll()) {
+        Key key = restDecode(key_config.first, (Key *)0);
+        Config config = jsonDecode<Config>(key_config.second);
+        setKey(config, key);
+        auto savedConfig = jsonEncode(config);
+
+        auto fn = std::bind(
+                &RestConfigurableCollection::constructCancellable,
+                this, std::move(config), std::placeholders::_1,
+                std::placeholders::_2);
+        this->addBackgroundJobInThread(key, fn, nullptr, nullptr,
+                                       false /* must be new */, savedConfig,
+                                       true /* from config */);
+    }
+}
+
 template<typename Key, typename Value,
          typename Config, typename Status>
 bool
@@ -0,0 +1,33 @@
+/* rest_connection.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Connection object for REST connections.
+*/
+
+#include "mldb/rest/rest_connection.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/json_printing.h"
+#include <sstream>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* REST CONNECTION                                                           */
+/*****************************************************************************/
+
+void
+RestConnection::
+sendJsonResponse(int responseCode,
+                 const void * value,
+                 const ValueDescription & desc)
+{
+    std::ostringstream out;
+    StreamJsonPrintingContext context(out);
+    desc.printJson(value, context);
+    out << std::endl;
+    sendResponse(responseCode, out.str(), "application/json");
+}
+
+} // namespace MLDB
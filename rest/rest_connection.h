@@ -12,6 +12,7 @@
 #include <memory>
 #include "mldb/ext/jsoncpp/json.h"
 #include "mldb/http/http_header.h"
+#include "mldb/types/value_description_fwd.h"
 
 
 namespace MLDB {
@@ -52,6 +53,18 @@ struct RestConnection {
         return sendResponse(responseCode, "", "");
     }
 
+    /** Send a JSON response that is held as a typed value, with the
+        description used to print it.  The value only needs to live until
+        the call returns.
+
+        The default implementation prints it and sends it as text;
+        connections whose caller lives in the same process override it
+        to hand over the value without going through JSON text.
+    */
+    virtual void sendJsonResponse(int responseCode,
+                                  const void * value,
+                                  const ValueDescription & desc);
+
     virtual void sendRedirect(int responseCode, std::string location) = 0;
 
     /** Send an HTTP-only response with the given headers.  If it's not
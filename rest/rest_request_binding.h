@@ -1481,11 +1481,7 @@ addRouteSyncJsonReturn(RestRequestRouter & router,
                     const RestRequestParsingContext &)
         {
             static std::shared_ptr<ValueDescription> desc(getDefaultDescription((Return *)0));
-            std::ostringstream out;
-            StreamJsonPrintingContext context(out);
-            desc->printJson(&ret, context);
-            out << std::endl;
-            connection.sendResponse(200, out.str(), "application/json");
+            connection.sendJsonResponse(200, &ret, *desc);
             return RestRequestRouter::MR_YES;
         };
 
@@ -1537,11 +1533,7 @@ addRouteSyncJsonReturnContext(RestRequestRouter & router,
                     const RestRequestParsingContext &)
         {
             static std::shared_ptr<ValueDescription> desc(getDefaultDescription((Return *)0));
-            std::ostringstream out;
-            StreamJsonPrintingContext context(out);
-            desc->printJson(&ret, context);
-            out << std::endl;
-            connection.sendResponse(200, out.str(), "application/json");
+            connection.sendJsonResponse(200, &ret, *desc);
             return RestRequestRouter::MR_YES;
         };
 
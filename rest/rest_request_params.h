@@ -10,6 +10,7 @@
 #include <boost/lexical_cast.hpp>
 #include "json_codec.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/types/json_tape_parsing.h"
 
 namespace MLDB {
 
@@ -92,8 +93,7 @@ struct JsonStrCodec {
     {
         T result;
 
-        StreamingJsonParsingContext context(str, str.c_str(), str.length());
-        desc->parseJson(&result, context);
+        parseJsonDocument(*desc, &result, str, str.c_str(), str.length());
         return result;
     }
 
@@ -101,8 +101,8 @@ struct JsonStrCodec {
     {
         T result;
 
-        StreamingJsonParsingContext context(str.rawData(), str.rawData(), str.rawLength());
-        desc->parseJson(&result, context);
+        parseJsonDocument(*desc, &result, str.rawData(), str.rawData(),
+                          str.rawLength());
         return result;
     }
 
@@ -15,6 +15,9 @@
 #include "mldb/jml/utils/file_functions.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/base/less.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/cancellation.h"
+#include "mldb/base/memory_account.h"
 #include "mldb/types/value_description.h"
 
 
@@ -322,6 +325,17 @@ handleRequest(RestConnection & connection,
 {
     //MLDB_TRACE_EXCEPTIONS(false);
 
+    // Requests can choose the thread pool resource group that the work
+    // they start is accounted to
+    const std::string & groupName
+        = request.header.tryGetHeader("x-mldb-resource-group");
+    if (!groupName.empty() && !ThreadPool::getResourceGroup(groupName)) {
+        connection.sendErrorResponse(400, "Unknown resource group '"
+                                     + groupName + "'");
+        return;
+    }
+    ResourceGroupScope group(groupName);
+
     RestRequestParsingContext context(request);
     RestRequestMatchResult res = processRequest(connection, request, context);
     if (res == MR_NO) {
@@ -386,7 +400,12 @@ processRequest(RestConnection & connection,
         return rootHandler(connection, request, context);
     }
 
-    for (auto & sr: subRoutes) {
+    // Only the routes whose literal prefix matches need to be tried
+    std::vector<uint32_t> candidates;
+    routeIndex.findCandidates(context.remaining, candidates);
+
+    for (uint32_t i: candidates) {
+        const Route & sr = subRoutes[i];
         if (debug)
             cerr << "  trying subroute " << sr.router->description << endl;
         try {
@@ -424,10 +443,106 @@ options(std::set<std::string> & verbsAccepted,
     }
 }
 
+namespace {
+
+/** Return the characters that anything matched by the regex must start
+    with, stopping at the first one that isn't a plain (ASCII) literal.
+    Sets end to where the prefix ended in the regex.
+*/
+std::string regexLiteralPrefix(const Regex & rex, size_t & end)
+{
+    const std::string & surface = rex.surface().rawString();
+    end = 0;
+
+    // Alternatives and case insensitivity would need a lot more thought
+    if ((rex.flags() & std::regex_constants::icase)
+        || surface.find('|') != std::string::npos)
+        return std::string();
+
+    std::string result;
+    for (; end < surface.size();  ++end) {
+        unsigned char c = surface[end];
+        if (c >= 128 || strchr("\\.[](){}*+?^$", c))
+            break;
+        result += c;
+    }
+
+    // A quantifier may make the last character optional
+    if (end < surface.size() && !result.empty()
+        && strchr("*?{", surface[end])) {
+        result.resize(result.size() - 1);
+        --end;
+    }
+
+    return result;
+}
+
+} // file scope
+
+RestRequestRouter::Route::
+Route()
+    : matchKind(MATCH_REGEX), emptySegmentOk(false)
+{
+}
+
+void
+RestRequestRouter::Route::
+compile()
+{
+    literalPrefix.clear();
+    matchKind = MATCH_REGEX;
+    emptySegmentOk = false;
+
+    switch (path.type) {
+    case PathSpec::STRING:
+        matchKind = MATCH_LITERAL;
+        literalPrefix = path.path.rawString();
+        break;
+    case PathSpec::REGEX: {
+        size_t end;
+        literalPrefix = regexLiteralPrefix(path.rex, end);
+
+        // A single path segment as a parameter (for example the key of an
+        // entity in a collection) is common enough to do without the
+        // regex, which would be much slower
+        std::string rest = path.rex.surface().rawString().substr(end);
+        if (rest == "([^/]*)" || rest == "([^/]+)") {
+            matchKind = MATCH_SEGMENT;
+            emptySegmentOk = rest == "([^/]*)";
+        }
+        break;
+    }
+    case PathSpec::NONE:
+    default:
+        // Will throw when matched
+        break;
+    }
+}
+
 bool
 RestRequestRouter::Route::
 matchPath(RestRequestParsingContext & context) const
 {
+    if (matchKind == MATCH_SEGMENT) {
+        const std::string & remaining = context.remaining.rawString();
+        if (remaining.compare(0, literalPrefix.size(), literalPrefix) != 0)
+            return false;
+        size_t end = remaining.find('/', literalPrefix.size());
+        if (end == std::string::npos)
+            end = remaining.size();
+        if (end == literalPrefix.size() && !emptySegmentOk)
+            return false;
+
+        // Same as for the regex: the whole match, then the capture
+        Utf8String matched(remaining.data(), end, false /* check */);
+        Utf8String segment(remaining.data() + literalPrefix.size(),
+                           end - literalPrefix.size(), false /* check */);
+        context.resources.push_back(Url::decodeUri(matched));
+        context.resources.push_back(Url::decodeUri(segment));
+        context.remaining.removePrefix(matched);
+        return true;
+    }
+
     switch (path.type) {
     case PathSpec::STRING: {
         if (context.remaining.removePrefix(path.path)) {
@@ -492,12 +607,16 @@ process(const RestRequest & request,
             }
         }
         else if (f.location == RequestParamFilter::HEADER) {
+            // The content type is parsed out of the headers
+            const std::string & value
+                = f.param == "content-type"
+                ? request.header.contentType
+                : request.header.tryGetHeader(f.param);
             if (debug) {
                 cerr << "matching header " << f.param << " with value "
-                     << request.header.tryGetHeader(f.param)
-                     << " against " << f.value << endl;
+                     << value << " against " << f.value << endl;
             }
-            if (request.header.tryGetHeader(f.param) == f.value) {
+            if (value == f.value) {
                 matched = true;
             }
         }
@@ -545,6 +664,78 @@ options(std::set<std::string> & verbsAccepted,
     router->options(verbsAccepted, help, request, context);
 }
 
+void
+RestRequestRouter::
+insertRoute(Route route)
+{
+    route.compile();
+    routeIndex.insert(route.literalPrefix, subRoutes.size());
+    subRoutes.emplace_back(std::move(route));
+}
+
+RestRequestRouter::RouteIndex::
+RouteIndex()
+    : nodes(1)
+{
+}
+
+void
+RestRequestRouter::RouteIndex::
+insert(const std::string & prefix, uint32_t route)
+{
+    uint32_t node = 0;
+    for (char c: prefix) {
+        uint32_t child = 0;
+        for (auto & ch: nodes[node].children) {
+            if (ch.first == c) {
+                child = ch.second;
+                break;
+            }
+        }
+        if (child == 0) {
+            child = nodes.size();
+            nodes[node].children.emplace_back(c, child);
+            nodes.emplace_back();
+        }
+        node = child;
+    }
+    nodes[node].routes.push_back(route);
+}
+
+void
+RestRequestRouter::RouteIndex::
+findCandidates(const Utf8String & path, std::vector<uint32_t> & routes) const
+{
+    const std::string & chars = path.rawString();
+    size_t numNodesWithRoutes = 0;
+
+    uint32_t node = 0;
+    for (size_t i = 0;  ;  ++i) {
+        const Node & n = nodes[node];
+        if (!n.routes.empty()) {
+            routes.insert(routes.end(), n.routes.begin(), n.routes.end());
+            ++numNodesWithRoutes;
+        }
+        if (i == chars.size())
+            break;
+
+        uint32_t child = 0;
+        for (auto & ch: n.children) {
+            if (ch.first == chars[i]) {
+                child = ch.second;
+                break;
+            }
+        }
+        if (child == 0)
+            break;
+        node = child;
+    }
+
+    // Routes need to be tried in the order they were added
+    if (numNodesWithRoutes > 1)
+        std::sort(routes.begin(), routes.end());
+}
+
 void
 RestRequestRouter::
 addRoute(PathSpec path, RequestFilter filter,
@@ -624,7 +815,7 @@ addRoute(PathSpec path, RequestFilter filter,
 
         throw HttpReturnException(500, message.str());
     }
-    subRoutes.emplace_back(std::move(route));
+    insertRoute(std::move(route));
 }
 
 void
@@ -977,8 +1168,9 @@ addSubRouter(PathSpec path,
     route.router->notFoundHandler = notFoundHandler;
     route.extractObject = extractObject;
 
-    subRoutes.push_back(route);
-    return *route.router;
+    auto & result = *route.router;
+    insertRoute(std::move(route));
+    return result;
 }
 
 void
@@ -1010,6 +1202,10 @@ Json::Value extractException(const std::exception & exc, int defaultCode)
         = dynamic_cast<const HttpReturnException *>(&exc);
     const std::bad_alloc * balloc
         = dynamic_cast<const std::bad_alloc *>(&exc);
+    const DeadlineExceededException * deadline
+        = dynamic_cast<const DeadlineExceededException *>(&exc);
+    const MemoryBudgetExceededException * budget
+        = dynamic_cast<const MemoryBudgetExceededException *>(&exc);
 
     Json::Value val;
     val["error"] = exc.what();
@@ -1024,6 +1220,12 @@ Json::Value extractException(const std::exception & exc, int defaultCode)
             "or running on a machine with more memory.  "
             "(std::bad_alloc)";
     }
+    else if (deadline) {
+        val["httpCode"] = 504;
+    }
+    else if (budget) {
+        val["httpCode"] = 507;
+    }
     else {
         val["httpCode"] = defaultCode;
     }
@@ -491,11 +491,29 @@ struct RestRequestRouter {
     }
 
     struct Route {
+        Route();
+
         PathSpec path;
         RequestFilter filter;
         std::shared_ptr<RestRequestRouter> router;
         ExtractObject extractObject;
 
+        /// How the path is matched; filled in by compile()
+        enum MatchKind {
+            MATCH_LITERAL,  ///< String path; matches if it's a prefix
+            MATCH_SEGMENT,  ///< Literal then ([^/]*) or ([^/]+); no regex
+            MATCH_REGEX     ///< Anything else; goes through the regex
+        } matchKind;
+
+        /// Characters that any path matched by this route starts with
+        std::string literalPrefix;
+
+        /// For MATCH_SEGMENT, whether the segment may be empty
+        bool emptySegmentOk;
+
+        /// Work out how the path can be matched, from its spec
+        void compile();
+
         bool matchPath(RestRequestParsingContext & context) const;
 
         RestRequestMatchResult process(const RestRequest & request,
@@ -588,7 +606,7 @@ struct RestRequestRouter {
         route.router = res;
         route.router->description = description;
         route.extractObject = getExtractObject(res.get());
-        subRoutes.push_back(route);
+        insertRoute(std::move(route));
         return *res;
     }
 
@@ -601,6 +619,37 @@ struct RestRequestRouter {
     Utf8String description;
     bool terminal;
     Json::Value argHelp;
+
+private:
+    /** Index of the sub-routes by the literal prefix of their paths.  It's
+        a trie over the characters of the prefixes, with each route
+        attached to the node where its prefix ends.  Walking the
+        remaining path down the trie gives the only routes that can
+        match it, in time proportional to its length and no matter how
+        many routes there are.
+    */
+    struct RouteIndex {
+        RouteIndex();
+
+        struct Node {
+            std::vector<std::pair<char, uint32_t> > children;
+            std::vector<uint32_t> routes;
+        };
+
+        std::vector<Node> nodes;
+
+        void insert(const std::string & prefix, uint32_t route);
+
+        /// Put the indexes of the routes that could match the path into
+        /// routes, in the order they were inserted
+        void findCandidates(const Utf8String & path,
+                            std::vector<uint32_t> & routes) const;
+    };
+
+    RouteIndex routeIndex;
+
+    /// Add the route to subRoutes, and index it
+    void insertRoute(Route route);
 };
 
 /** Send an HTTP response in response to an exception. */
@@ -0,0 +1,84 @@
+/* http_rest_compression_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the negotiation and decoding of content codings for the REST
+   service.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/rest/http_rest_service.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/http/http_exception.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+std::string compress(const std::string & compression, const std::string & data)
+{
+    std::unique_ptr<Compressor> compressor(Compressor::create(compression, 5));
+    std::string result;
+    auto onData = [&] (const char * data, size_t len) -> size_t
+        {
+            result.append(data, len);
+            return len;
+        };
+    compressor->compress(data.data(), data.size(), onData);
+    compressor->finish(onData);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_negotiate_compression )
+{
+    BOOST_CHECK_EQUAL(negotiateResponseCompression(""), "");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("identity"), "");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("gzip"), "gzip");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("GZip"), "gzip");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("x-gzip"), "gzip");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("gzip, deflate, br"), "gzip");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("gzip, zstd"), "zstd");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("gzip;q=1.0, zstd;q=0.5"),
+                      "gzip");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("gzip;q=0"), "");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("*"), "zstd");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("*;q=0.1, zstd;q=0"), "gzip");
+    BOOST_CHECK_EQUAL(negotiateResponseCompression("deflate"), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_request_body )
+{
+    std::string body;
+    for (int i = 0;  i < 10000;  ++i)
+        body += "{\"x\":" + std::to_string(i) + "}\n";
+
+    BOOST_CHECK_EQUAL(decodeRequestBody("gzip", compress("gzip", body)), body);
+    BOOST_CHECK_EQUAL(decodeRequestBody("zstd", compress("zstd", body)), body);
+    BOOST_CHECK_EQUAL(decodeRequestBody("identity", body), body);
+
+    // Codings are undone in the reverse order to how they're listed
+    BOOST_CHECK_EQUAL(decodeRequestBody("gzip, zstd",
+                                        compress("zstd", compress("gzip", body))),
+                      body);
+
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        decodeRequestBody("br", body);
+        BOOST_ERROR("unknown coding should have thrown");
+    } catch (const HttpReturnException & exc) {
+        BOOST_CHECK_EQUAL(exc.httpCode, 415);
+    }
+
+    {
+        MLDB_TRACE_EXCEPTIONS(false);
+        BOOST_CHECK_THROW(decodeRequestBody("gzip", "not gzip data"),
+                          std::exception);
+    }
+}
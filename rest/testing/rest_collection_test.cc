@@ -643,3 +643,122 @@ BOOST_AUTO_TEST_CASE( stress_test_collection_cancellation )
          << endl;
     BOOST_CHECK_EQUAL(created + underConstruction, deletedAfterCreation + cancelledBeforeCreation);
 }
+
+/// Config store that keeps its entries in memory
+struct MemoryConfigStore: public CollectionConfigStore {
+    virtual std::vector<Utf8String> keys() const
+    {
+        std::vector<Utf8String> result;
+        for (auto & e: entries)
+            result.push_back(e.first);
+        return result;
+    }
+
+    virtual void set(Utf8String key, const Json::Value & config)
+    {
+        entries[key] = config;
+    }
+
+    virtual Json::Value get(Utf8String key) const
+    {
+        return entries.at(key);
+    }
+
+    virtual std::vector<std::pair<Utf8String, Json::Value> > getAll() const
+    {
+        return { entries.begin(), entries.end() };
+    }
+
+    virtual void clear()
+    {
+        entries.clear();
+    }
+
+    virtual void erase(Utf8String key)
+    {
+        entries.erase(key);
+    }
+
+    std::map<Utf8String, Json::Value> entries;
+};
+
+/** Collection whose objects need the object named in their dependsOn
+    parameter, as for example a function that reads from a dataset.
+*/
+struct DependentTestCollection: public TestCollection {
+
+    ~DependentTestCollection()
+    {
+        this->shutdown();
+    }
+
+    std::shared_ptr<TestObject>
+    construct(TestConfig config, const OnProgress & onProgress) const
+    {
+        ++numConstructed;
+        auto it = config.params.find("dependsOn");
+        if (it != config.params.end())
+            getExistingEntry(it->second);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        auto result = std::make_shared<TestObject>();
+        result->config.reset(new TestConfig(std::move(config)));
+        return result;
+    }
+
+    mutable std::atomic<int> numConstructed{0};
+};
+
+std::shared_ptr<MemoryConfigStore> makeDependentConfigs()
+{
+    // Added so that each depends on one that comes after it
+    auto store = std::make_shared<MemoryConfigStore>();
+    store->set("a", jsonEncode(TestConfig{"a", {{"dependsOn", "b"}}}));
+    store->set("b", jsonEncode(TestConfig{"b", {{"dependsOn", "c"}}}));
+    store->set("c", jsonEncode(TestConfig{"c", {}}));
+    store->set("d", jsonEncode(TestConfig{"d", {}}));
+    return store;
+}
+
+BOOST_AUTO_TEST_CASE( test_load_config_with_dependencies )
+{
+    DependentTestCollection collection;
+    collection.attachConfig(makeDependentConfigs());
+    collection.registerConfig();
+
+    // Nothing is started until asked for
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    BOOST_CHECK_EQUAL(collection.numConstructed, 0);
+    for (auto key: { "a", "b", "c", "d" }) {
+        auto entry = collection.getEntry(key);
+        BOOST_CHECK(!entry.first);
+        BOOST_REQUIRE(entry.second);
+        BOOST_CHECK_EQUAL(entry.second->getState(), "initializing");
+    }
+
+    collection.startDeferredJobs();
+    collection.waitForDeferredJobs();
+
+    BOOST_CHECK_EQUAL(collection.numConstructed, 4);
+    for (auto key: { "a", "b", "c", "d" })
+        BOOST_CHECK(collection.tryGetExistingEntry(key));
+}
+
+BOOST_AUTO_TEST_CASE( test_load_config_lazily )
+{
+    DependentTestCollection collection;
+    collection.attachConfig(makeDependentConfigs());
+    collection.registerConfig();
+
+    // Using it constructs it, along with what it depends on
+    auto a = collection.getExistingEntry("a");
+    BOOST_REQUIRE(a);
+    BOOST_CHECK_EQUAL(a->config->id, "a");
+    BOOST_CHECK_EQUAL(collection.numConstructed, 3);
+    BOOST_CHECK(collection.tryGetExistingEntry("c"));
+    BOOST_CHECK(!collection.tryGetExistingEntry("d"));
+
+    // Deleting one that was never started doesn't wait for it
+    collection.deleteEntry("d");
+    BOOST_CHECK_THROW(collection.getExistingEntry("d"), std::exception);
+    BOOST_CHECK_EQUAL(collection.numConstructed, 3);
+}
@@ -77,3 +77,59 @@ BOOST_AUTO_TEST_CASE( test_header_matching )
     }
 
 }
+
+BOOST_AUTO_TEST_CASE( test_structured_response )
+{
+    RestRequestRouter router;
+
+    struct TestObject {
+        std::vector<int> call(int n)
+        {
+            std::vector<int> result;
+            for (int i = 0;  i < n;  ++i)
+                result.push_back(i);
+            return result;
+        }
+    };
+
+    TestObject testObject;
+
+    addRouteSyncJsonReturn(router, "/test", { "GET" }, "Call test object",
+                           "numbers",
+                           &TestObject::call, &testObject,
+                           RestParam<int>("n", "number of elements"));
+
+    // Without asking for it, the response is text as before
+    {
+        InProcessRestConnection conn;
+        router.handleRequest(conn, RestRequest("GET", "/test", { { "n", "3" } }, ""));
+        BOOST_CHECK_EQUAL(conn.responseCode, 200);
+        BOOST_CHECK(!conn.hasJsonResponse);
+        BOOST_CHECK_EQUAL(conn.response, "[0,1,2]\n");
+        BOOST_CHECK_EQUAL(conn.getJsonResponse().size(), 3);
+    }
+
+    // Kept as a value
+    {
+        InProcessRestConnection conn;
+        conn.structuredResponse = true;
+        router.handleRequest(conn, RestRequest("GET", "/test", { { "n", "3" } }, ""));
+        BOOST_CHECK_EQUAL(conn.responseCode, 200);
+        BOOST_CHECK_EQUAL(conn.contentType, "application/json");
+        BOOST_REQUIRE(conn.hasJsonResponse);
+        BOOST_CHECK(conn.response.empty());
+        BOOST_REQUIRE_EQUAL(conn.jsonResponse.size(), 3);
+        BOOST_CHECK_EQUAL(conn.jsonResponse[2].asInt(), 2);
+        BOOST_CHECK_EQUAL(conn.getResponseText(), "[0,1,2]");
+    }
+
+    // Errors are always text
+    {
+        InProcessRestConnection conn;
+        conn.structuredResponse = true;
+        router.handleRequest(conn, RestRequest("GET", "/test", { { "m", "3" } }, ""));
+        BOOST_CHECK_EQUAL(conn.responseCode, 400);
+        BOOST_CHECK(!conn.hasJsonResponse);
+        BOOST_CHECK(!conn.response.empty());
+    }
+}
@@ -117,3 +117,58 @@ BOOST_AUTO_TEST_CASE( test_hidden_route )
                                        "Not matching regex", callback,
                     Json::Value());
 }
+
+BOOST_AUTO_TEST_CASE( test_route_index )
+{
+    RestRequestRouter router;
+
+    auto respond = [] (const std::string & what)
+        {
+            return [=] (RestConnection & connection,
+                        const RestRequest & request,
+                        RestRequestParsingContext & context)
+            {
+                std::string response = what;
+                for (unsigned i = 1;  i < context.resources.size();  ++i)
+                    response += ":" + context.resources[i].rawString();
+                connection.sendResponse(200, response, "text/plain");
+                return RestRequestRouter::MR_YES;
+            };
+        };
+
+    router.addRoute("/items", { "GET" },
+                    "List", respond("list"), Json::Value());
+    router.addRoute(Rx("/items/([^/]+)", "/items/<key>"), { "GET" },
+                    "Item", respond("item"), Json::Value());
+    router.addRoute(Rx("/items/([^/]*)/sub", "/items/<key>/sub"), { "GET" },
+                    "Sub", respond("sub"), Json::Value());
+    router.addRoute(Rx("/it(em)?s/x([0-9]+)", "/its/x<num>"), { "POST" },
+                    "Number", respond("num"), Json::Value());
+    router.addRoute(PathSpec(Regex("/ITEMS/(.*)", Regex::DEFAULT_FLAGS | std::regex::icase)),
+                    { "PUT" },
+                    "Any case", respond("icase"), Json::Value());
+
+    auto call = [&] (const std::string & verb, const std::string & resource)
+        {
+            RestRequest request;
+            request.verb = verb;
+            request.resource = resource;
+            InProcessRestConnection conn;
+            router.handleRequest(conn, request);
+            if (conn.responseCode != 200)
+                return std::to_string(conn.responseCode);
+            return conn.response;
+        };
+
+    BOOST_CHECK_EQUAL(call("GET", "/items"), "list");
+    BOOST_CHECK_EQUAL(call("GET", "/items/abc"), "item:abc");
+    BOOST_CHECK_EQUAL(call("GET", "/items/a%20b"), "item:a b");
+    BOOST_CHECK_EQUAL(call("GET", "/items/abc/sub"), "sub:abc");
+    BOOST_CHECK_EQUAL(call("GET", "/items//sub"), "sub:");
+    BOOST_CHECK_EQUAL(call("GET", "/items/"), "404");
+    BOOST_CHECK_EQUAL(call("GET", "/items/abc/other"), "404");
+    BOOST_CHECK_EQUAL(call("GET", "/other"), "404");
+    BOOST_CHECK_EQUAL(call("POST", "/its/x12"), "num::12");
+    BOOST_CHECK_EQUAL(call("POST", "/items/x12"), "num:em:12");
+    BOOST_CHECK_EQUAL(call("PUT", "/Items/x"), "icase:x");
+}
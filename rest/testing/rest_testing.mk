@@ -8,6 +8,7 @@
 ETCD_MANUAL:=$(if $(HAS_ETCD),,manual)
 
 $(eval $(call test,link_test,link,boost timed valgrind))
+$(eval $(call test,http_rest_compression_test,rest,boost))
 $(eval $(call test,rest_collection_test,service_peer,boost timed))
 $(eval $(call test,rest_collection_stress_test,service_peer,boost timed))
 $(eval $(call test,service_peer_test,service_peer,boost $(ETCD_MANUAL) timed))
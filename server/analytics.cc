@@ -411,6 +411,27 @@ queryFromStatementExpr(const SelectStatement & stm,
                        SqlBindingScope & scope,
                        BoundParameters params,
                        const ProgressFunc & onProgress)
+{
+    std::vector<NamedRowValue> rows;
+
+    auto onRow = [&] (NamedRowValue & row)
+        {
+            rows.emplace_back(std::move(row));
+            return true;
+        };
+
+    auto info = queryFromStatementStream(onRow, stm, scope, params, onProgress);
+
+    return std::make_tuple<std::vector<NamedRowValue>, 
+                           std::shared_ptr<ExpressionValueInfo> >(std::move(rows), std::move(info));
+}
+
+std::shared_ptr<ExpressionValueInfo>
+queryFromStatementStream(const std::function<bool (NamedRowValue &)> & onRow,
+                         const SelectStatement & stm,
+                         SqlBindingScope & scope,
+                         BoundParameters params,
+                         const ProgressFunc & onProgress)
 {
     /* The assumption is that both sides have the same number
        of items to process.  This is obviously not always the case
@@ -429,14 +450,15 @@ queryFromStatementExpr(const SelectStatement & stm,
     
     auto & iterateProgress = onProgress ? bind(joinedProgress, 1, _1) : onProgress;
     if (table.dataset) {
-        return table.dataset->queryStructuredExpr(stm.select, stm.when,
-                                                  *stm.where,
-                                                  stm.orderBy, stm.groupBy,
-                                                  stm.having,
-                                                  stm.rowName,
-                                                  stm.offset, stm.limit, 
-                                                  table.asName,
-                                                  iterateProgress);
+        return table.dataset->queryStructuredStream(onRow,
+                                                    stm.select, stm.when,
+                                                    *stm.where,
+                                                    stm.orderBy, stm.groupBy,
+                                                    stm.having,
+                                                    stm.rowName,
+                                                    stm.offset, stm.limit, 
+                                                    table.asName,
+                                                    iterateProgress);
     }
     else if (table.table.runQuery && stm.from) {
 
@@ -451,17 +473,20 @@ queryFromStatementExpr(const SelectStatement & stm,
                 throw HttpReturnException(500, "No query parameter " + param); 
             };
 
-        std::shared_ptr<PipelineElement> pipeline = PipelineElement::root(scope)->statement(stm, getParamInfo);
+        ssize_t limit = stm.limit;
+        ssize_t offset = stm.offset;
+
+        // We only ever take offset + limit rows, so the ORDER BY only
+        // needs to keep that many
+        std::shared_ptr<PipelineElement> pipeline
+            = PipelineElement::root(scope)
+            ->statement(stm, getParamInfo,
+                        limit == -1 ? -1 : offset + limit);
 
         auto boundPipeline = pipeline->bind();
 
-        auto executor = boundPipeline->start(params);
+        auto executor = boundPipeline->startProfiled(params);
         
-        std::vector<NamedRowValue> rows;
-
-        ssize_t limit = stm.limit;
-        ssize_t offset = stm.offset;
-
         auto output = executor->take();
 
         for (size_t n = 0;
@@ -483,15 +508,20 @@ queryFromStatementExpr(const SelectStatement & stm,
                 .coerceToPath(); 
             row.rowHash = row.rowName;
             output->values.back().mergeToRowDestructive(row.columns);
-            rows.emplace_back(std::move(row));
+            if (!onRow(row))
+                break;
         }
             
-        return std::make_tuple<std::vector<NamedRowValue>, 
-                              std::shared_ptr<ExpressionValueInfo> >(std::move(rows), std::make_shared<UnknownRowValueInfo>());
+        return std::make_shared<UnknownRowValueInfo>();
     }
     else {
         // No from at all
-        return queryWithoutDatasetExpr(stm, scope);
+        auto result = queryWithoutDatasetExpr(stm, scope);
+        for (auto & row: std::get<0>(result)) {
+            if (!onRow(row))
+                break;
+        }
+        return std::get<1>(result);
     }
 }
 
@@ -539,18 +569,22 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
                     throw HttpReturnException(500, "No query parameter " + param);
                 };
         
+        ssize_t limit = stm.limit;
+        ssize_t offset = stm.offset;
+
+        // We only ever take offset + limit rows, so the ORDER BY only
+        // needs to keep that many
         std::shared_ptr<PipelineElement> pipeline
-            = PipelineElement::root(scope)->statement(stm, getParamInfo);
+            = PipelineElement::root(scope)
+            ->statement(stm, getParamInfo,
+                        limit == -1 ? -1 : offset + limit);
 
         auto boundPipeline = pipeline->bind();
 
-        auto executor = boundPipeline->start(params);
+        auto executor = boundPipeline->startProfiled(params);
         
         std::vector<MatrixNamedRow> rows;
 
-        ssize_t limit = stm.limit;
-        ssize_t offset = stm.offset;
-
         auto output = executor->take();
 
         for (size_t n = 0;
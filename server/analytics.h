@@ -190,6 +190,20 @@ queryFromStatementExpr(const SelectStatement & stm,
                        BoundParameters params = nullptr,
                        const ProgressFunc & onProgress = nullptr);
 
+/** Same as queryFromStatementExpr, but each output row is passed to onRow as
+    it's produced rather than being accumulated.  The rows are passed in
+    order, and onRow is never called from more than one thread at once.
+    Stops early if onRow returns false.
+
+    Returns information about the structure of the output rows.
+*/
+std::shared_ptr<ExpressionValueInfo>
+queryFromStatementStream(const std::function<bool (NamedRowValue &)> & onRow,
+                         const SelectStatement & stm,
+                         SqlBindingScope & scope,
+                         BoundParameters params = nullptr,
+                         const ProgressFunc & onProgress = nullptr);
+
 /** Select from the given statement.  This will choose the most
     appropriate execution method based upon what is in the query.
 
@@ -0,0 +1,616 @@
+/** arrow_reader.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Reader for the Apache Arrow IPC streaming format.  As in the writer, the
+    flatbuffers of the metadata are decoded directly rather than with
+    generated code.
+*/
+
+#include "arrow_reader.h"
+#include "mldb/arch/exception.h"
+#include "mldb/types/date.h"
+#include <cmath>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/*****************************************************************************/
+/* FLATBUFFER TABLE                                                          */
+/*****************************************************************************/
+
+/** Table in a flatbuffer, whose fields are looked up through its vtable.
+    Everything that is read is checked against the length of the buffer,
+    since the buffer comes from another process.
+*/
+struct FlatBufferTable {
+    const char * buf = nullptr;
+    size_t len = 0;
+    size_t pos = 0;           ///< Position of the table in the buffer
+    size_t vtable = 0;
+    uint16_t vtableSize = 0;
+
+    FlatBufferTable(const char * buf, size_t len, size_t pos)
+        : buf(buf), len(len), pos(pos)
+    {
+        int64_t vt = (int64_t)pos - read<int32_t>(pos);
+        if (vt < 0 || (size_t)vt + 4 > len)
+            throw MLDB::Exception("Invalid Arrow metadata: bad vtable");
+        vtable = vt;
+        vtableSize = read<uint16_t>(vtable);
+    }
+
+    /// Root table of the given flatbuffer
+    static FlatBufferTable root(const char * buf, size_t len)
+    {
+        if (len < 4)
+            throw MLDB::Exception("Invalid Arrow metadata: truncated");
+        uint32_t rootPos;
+        std::memcpy(&rootPos, buf, 4);
+        return FlatBufferTable(buf, len, rootPos);
+    }
+
+    template<typename T>
+    T read(size_t offset) const
+    {
+        if (offset > len || len - offset < sizeof(T))
+            throw MLDB::Exception("Invalid Arrow metadata: truncated");
+        T result;
+        std::memcpy(&result, buf + offset, sizeof(T));
+        return result;
+    }
+
+    /// Position of the given field, or 0 if it's not there
+    size_t fieldPos(int slot) const
+    {
+        size_t entry = 4 + 2 * slot;
+        if (entry + 2 > vtableSize)
+            return 0;
+        uint16_t offset = read<uint16_t>(vtable + entry);
+        return offset ? pos + offset : 0;
+    }
+
+    bool has(int slot) const
+    {
+        return fieldPos(slot) != 0;
+    }
+
+    template<typename T>
+    T scalar(int slot, T defaultValue = T()) const
+    {
+        size_t p = fieldPos(slot);
+        return p ? read<T>(p) : defaultValue;
+    }
+
+    /// Position of what the given offset field refers to, or 0
+    size_t deref(int slot) const
+    {
+        size_t p = fieldPos(slot);
+        return p ? p + read<uint32_t>(p) : 0;
+    }
+
+    FlatBufferTable table(int slot) const
+    {
+        size_t p = deref(slot);
+        if (!p)
+            throw MLDB::Exception("Invalid Arrow metadata: missing table");
+        return FlatBufferTable(buf, len, p);
+    }
+
+    std::string string(int slot) const
+    {
+        size_t p = deref(slot);
+        if (!p)
+            return std::string();
+        uint32_t n = read<uint32_t>(p);
+        if (p + 4 + n > len)
+            throw MLDB::Exception("Invalid Arrow metadata: truncated string");
+        return std::string(buf + p + 4, n);
+    }
+
+    /** Number of elements of the given vector field, and position of the
+        first one.
+    */
+    std::pair<uint32_t, size_t> vector(int slot, size_t elementSize) const
+    {
+        size_t p = deref(slot);
+        if (!p)
+            return { 0, 0 };
+        uint32_t n = read<uint32_t>(p);
+        if (p + 4 + (uint64_t)n * elementSize > len)
+            throw MLDB::Exception("Invalid Arrow metadata: truncated vector");
+        return { n, p + 4 };
+    }
+
+    /// Table at the given index of a vector of tables
+    FlatBufferTable tableAt(size_t vectorStart, uint32_t index) const
+    {
+        size_t p = vectorStart + 4 * index;
+        return FlatBufferTable(buf, len, p + read<uint32_t>(p));
+    }
+};
+
+
+/*****************************************************************************/
+/* ARROW METADATA                                                            */
+/*****************************************************************************/
+
+/// https://github.com/apache/arrow/blob/master/format/Schema.fbs
+enum ArrowType {
+    ARROW_TYPE_NULL = 1,
+    ARROW_TYPE_INT = 2,
+    ARROW_TYPE_FLOATING_POINT = 3,
+    ARROW_TYPE_BINARY = 4,
+    ARROW_TYPE_UTF8 = 5,
+    ARROW_TYPE_BOOL = 6,
+    ARROW_TYPE_DATE = 8,
+    ARROW_TYPE_TIMESTAMP = 10,
+    ARROW_TYPE_LARGE_BINARY = 19,
+    ARROW_TYPE_LARGE_UTF8 = 20
+};
+
+enum ArrowMessageType {
+    ARROW_MESSAGE_SCHEMA = 1,
+    ARROW_MESSAGE_DICTIONARY_BATCH = 2,
+    ARROW_MESSAGE_RECORD_BATCH = 3
+};
+
+constexpr int16_t PRECISION_HALF = 0;
+constexpr int16_t PRECISION_SINGLE = 1;
+constexpr int16_t DATE_UNIT_DAY = 0;
+
+/// Continuation marker that starts each message
+constexpr uint32_t CONTINUATION = 0xffffffff;
+
+struct Column {
+    Utf8String name;
+    int type = 0;
+    int bitWidth = 64;
+    bool isSigned = true;
+    int16_t precision = 2;
+    int16_t unit = 0;      ///< For dates and timestamps
+};
+
+double halfToDouble(uint16_t h)
+{
+    int sign = h >> 15;
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    double result;
+    if (exponent == 0)
+        result = std::ldexp(mantissa, -24);
+    else if (exponent == 31)
+        result = mantissa ? NAN : INFINITY;
+    else result = std::ldexp(mantissa + 1024, exponent - 25);
+    return sign ? -result : result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ARROW STREAM READER                                                       */
+/*****************************************************************************/
+
+struct ArrowStreamReader::Itl {
+    Itl(const char * data, size_t length)
+        : data(data), length(length)
+    {
+        const char * metadata;
+        size_t metadataLength;
+        const char * body;
+        int64_t bodyLength;
+        if (!nextMessage(metadata, metadataLength, body, bodyLength))
+            throw MLDB::Exception("Arrow stream has no schema");
+
+        FlatBufferTable message
+            = FlatBufferTable::root(metadata, metadataLength);
+        if (message.scalar<uint8_t>(1) != ARROW_MESSAGE_SCHEMA)
+            throw MLDB::Exception("Arrow stream doesn't start with a schema");
+        readSchema(message.table(2));
+    }
+
+    const char * data;
+    size_t length;
+    size_t pos = 0;
+    bool done = false;
+
+    std::vector<Column> columns;
+    std::vector<Utf8String> columnNames;
+
+    /** Find the next message, returning false at the end of the stream.
+        Streams of old versions have no continuation marker.
+    */
+    bool nextMessage(const char * & metadata, size_t & metadataLength,
+                     const char * & body, int64_t & bodyLength)
+    {
+        if (done)
+            return false;
+
+        auto readInt = [&] () -> uint32_t
+            {
+                if (length - pos < 4)
+                    throw MLDB::Exception("Arrow stream is truncated");
+                uint32_t result;
+                std::memcpy(&result, data + pos, 4);
+                pos += 4;
+                return result;
+            };
+
+        // A stream that stops without the end marker is accepted
+        if (pos == length) {
+            done = true;
+            return false;
+        }
+
+        uint32_t len = readInt();
+        if (len == CONTINUATION)
+            len = readInt();
+        if (len == 0) {
+            done = true;
+            return false;
+        }
+        if (length - pos < len)
+            throw MLDB::Exception("Arrow stream is truncated");
+
+        metadata = data + pos;
+        metadataLength = len;
+        pos += len;
+
+        FlatBufferTable message = FlatBufferTable::root(metadata, len);
+        bodyLength = message.scalar<int64_t>(3);
+        if (bodyLength < 0 || length - pos < (uint64_t)bodyLength)
+            throw MLDB::Exception("Arrow stream is truncated");
+        body = data + pos;
+        pos += bodyLength;
+        return true;
+    }
+
+    void readSchema(const FlatBufferTable & schema)
+    {
+        if (schema.scalar<int16_t>(0) != 0)
+            throw MLDB::Exception("Big endian Arrow streams can't be read");
+
+        auto fields = schema.vector(1, 4);
+        for (uint32_t i = 0;  i < fields.first;  ++i) {
+            FlatBufferTable field = schema.tableAt(fields.second, i);
+            Column column;
+            column.name = Utf8String(field.string(0));
+            column.type = field.scalar<uint8_t>(2);
+
+            auto fail = [&] (const std::string & why)
+                {
+                    throw MLDB::Exception("Arrow column '"
+                                          + column.name.rawString()
+                                          + "' can't be read: " + why);
+                };
+
+            if (field.has(4))
+                fail("dictionary encoded columns are not supported");
+
+            switch (column.type) {
+            case ARROW_TYPE_NULL:
+            case ARROW_TYPE_BINARY:
+            case ARROW_TYPE_UTF8:
+            case ARROW_TYPE_BOOL:
+            case ARROW_TYPE_LARGE_BINARY:
+            case ARROW_TYPE_LARGE_UTF8:
+                break;
+            case ARROW_TYPE_INT: {
+                FlatBufferTable type = field.table(3);
+                column.bitWidth = type.scalar<int32_t>(0);
+                column.isSigned = type.scalar<uint8_t>(1);
+                if (column.bitWidth != 8 && column.bitWidth != 16
+                    && column.bitWidth != 32 && column.bitWidth != 64)
+                    fail("bad integer width");
+                break;
+            }
+            case ARROW_TYPE_FLOATING_POINT:
+                column.precision = field.table(3).scalar<int16_t>(0);
+                if (column.precision < 0 || column.precision > 2)
+                    fail("bad floating point precision");
+                break;
+            case ARROW_TYPE_DATE:
+                column.unit = field.table(3).scalar<int16_t>(0, 1);
+                break;
+            case ARROW_TYPE_TIMESTAMP:
+                column.unit = field.table(3).scalar<int16_t>(0);
+                if (column.unit < 0 || column.unit > 3)
+                    fail("bad timestamp unit");
+                break;
+            default:
+                fail("type " + std::to_string(column.type)
+                     + " is not supported; only flat columns of numbers, "
+                     "booleans, strings, blobs, dates and timestamps are");
+            }
+
+            columnNames.push_back(column.name);
+            columns.emplace_back(std::move(column));
+        }
+    }
+
+    bool readBatch(std::vector<std::vector<CellValue> > & output)
+    {
+        const char * metadata;
+        size_t metadataLength;
+        const char * body;
+        int64_t bodyLength;
+
+        for (;;) {
+            if (!nextMessage(metadata, metadataLength, body, bodyLength))
+                return false;
+            FlatBufferTable message
+                = FlatBufferTable::root(metadata, metadataLength);
+            int type = message.scalar<uint8_t>(1);
+            if (type == ARROW_MESSAGE_RECORD_BATCH) {
+                readRecordBatch(message.table(2), body, bodyLength, output);
+                return true;
+            }
+            if (type == ARROW_MESSAGE_DICTIONARY_BATCH)
+                throw MLDB::Exception("Arrow dictionary batches are not "
+                                      "supported");
+            // Anything else (a repeated schema, tensors) is skipped
+        }
+    }
+
+    void readRecordBatch(const FlatBufferTable & batch,
+                         const char * body, int64_t bodyLength,
+                         std::vector<std::vector<CellValue> > & output)
+    {
+        if (batch.has(3))
+            throw MLDB::Exception("Compressed Arrow batches are not "
+                                  "supported");
+
+        int64_t numRows = batch.scalar<int64_t>(0);
+        auto nodes = batch.vector(1, 16);
+        auto buffers = batch.vector(2, 16);
+        if (numRows < 0 || nodes.first != columns.size())
+            throw MLDB::Exception("Arrow record batch doesn't match its "
+                                  "schema");
+
+        uint32_t nextBuffer = 0;
+
+        // Returns the next buffer of the batch, checking that it's within
+        // the body
+        auto getBuffer = [&] (size_t & size) -> const char *
+            {
+                if (nextBuffer >= buffers.first)
+                    throw MLDB::Exception("Arrow record batch is missing "
+                                          "buffers");
+                size_t p = buffers.second + 16 * nextBuffer++;
+                int64_t offset = batch.read<int64_t>(p);
+                int64_t len = batch.read<int64_t>(p + 8);
+                if (offset < 0 || len < 0 || offset > bodyLength
+                    || bodyLength - offset < len)
+                    throw MLDB::Exception("Arrow buffer is outside of its "
+                                          "record batch");
+                size = len;
+                return body + offset;
+            };
+
+        output.resize(columns.size());
+
+        for (size_t c = 0;  c < columns.size();  ++c) {
+            const Column & column = columns[c];
+            vector<CellValue> & values = output[c];
+            values.clear();
+            values.reserve(numRows);
+
+            int64_t length = batch.read<int64_t>(nodes.second + 16 * c);
+            int64_t nullCount = batch.read<int64_t>(nodes.second + 16 * c + 8);
+            if (length != numRows)
+                throw MLDB::Exception("Arrow column '"
+                                      + column.name.rawString()
+                                      + "' has the wrong number of rows");
+
+            if (column.type == ARROW_TYPE_NULL) {
+                values.resize(numRows);
+                continue;
+            }
+
+            size_t validityLength;
+            const char * validity = getBuffer(validityLength);
+            if (nullCount == 0)
+                validity = nullptr;
+            else if (validityLength * 8 < (size_t)numRows)
+                throw MLDB::Exception("Arrow validity buffer is too short");
+
+            auto isValid = [&] (int64_t i)
+                {
+                    return !validity || ((validity[i / 8] >> (i % 8)) & 1);
+                };
+
+            size_t dataLength;
+            const char * data;
+
+            auto checkLength = [&] (size_t bytes)
+                {
+                    if (dataLength < bytes)
+                        throw MLDB::Exception("Arrow data buffer of column '"
+                                              + column.name.rawString()
+                                              + "' is too short");
+                };
+
+            switch (column.type) {
+            case ARROW_TYPE_BOOL:
+                data = getBuffer(dataLength);
+                checkLength((numRows + 7) / 8);
+                for (int64_t i = 0;  i < numRows;  ++i) {
+                    if (isValid(i))
+                        values.emplace_back((data[i / 8] >> (i % 8)) & 1);
+                    else values.emplace_back();
+                }
+                break;
+
+            case ARROW_TYPE_INT: {
+                data = getBuffer(dataLength);
+                int width = column.bitWidth / 8;
+                checkLength(numRows * width);
+                for (int64_t i = 0;  i < numRows;  ++i) {
+                    if (!isValid(i)) {
+                        values.emplace_back();
+                        continue;
+                    }
+                    const char * p = data + i * width;
+                    switch (width) {
+                    case 1:
+                        if (column.isSigned)
+                            values.emplace_back((int64_t)(int8_t)*p);
+                        else values.emplace_back((int64_t)(uint8_t)*p);
+                        break;
+                    case 2: {
+                        if (column.isSigned)
+                            values.emplace_back(readLE<int16_t>(p));
+                        else values.emplace_back(readLE<uint16_t>(p));
+                        break;
+                    }
+                    case 4:
+                        if (column.isSigned)
+                            values.emplace_back(readLE<int32_t>(p));
+                        else values.emplace_back(readLE<uint32_t>(p));
+                        break;
+                    default:
+                        if (column.isSigned)
+                            values.emplace_back(readLE<int64_t>(p));
+                        else values.emplace_back(readLE<uint64_t>(p));
+                    }
+                }
+                break;
+            }
+
+            case ARROW_TYPE_FLOATING_POINT: {
+                data = getBuffer(dataLength);
+                int width = column.precision == PRECISION_HALF
+                    ? 2 : column.precision == PRECISION_SINGLE ? 4 : 8;
+                checkLength(numRows * width);
+                for (int64_t i = 0;  i < numRows;  ++i) {
+                    const char * p = data + i * width;
+                    if (!isValid(i))
+                        values.emplace_back();
+                    else if (width == 2)
+                        values.emplace_back(halfToDouble(readLE<uint16_t>(p)));
+                    else if (width == 4)
+                        values.emplace_back(readLE<float>(p));
+                    else values.emplace_back(readLE<double>(p));
+                }
+                break;
+            }
+
+            case ARROW_TYPE_DATE:
+            case ARROW_TYPE_TIMESTAMP: {
+                data = getBuffer(dataLength);
+                bool days = column.type == ARROW_TYPE_DATE
+                    && column.unit == DATE_UNIT_DAY;
+                int width = days ? 4 : 8;
+                // Seconds per unit: dates are in days or milliseconds;
+                // timestamps in seconds, milli, micro or nanoseconds
+                double scale = days ? 86400.0
+                    : column.type == ARROW_TYPE_DATE ? 0.001
+                    : std::pow(10.0, -3 * column.unit);
+                checkLength(numRows * width);
+                for (int64_t i = 0;  i < numRows;  ++i) {
+                    const char * p = data + i * width;
+                    if (!isValid(i)) {
+                        values.emplace_back();
+                        continue;
+                    }
+                    int64_t v = days ? readLE<int32_t>(p) : readLE<int64_t>(p);
+                    values.emplace_back
+                        (Date::fromSecondsSinceEpoch(v * scale));
+                }
+                break;
+            }
+
+            case ARROW_TYPE_UTF8:
+            case ARROW_TYPE_BINARY:
+            case ARROW_TYPE_LARGE_UTF8:
+            case ARROW_TYPE_LARGE_BINARY: {
+                bool large = column.type == ARROW_TYPE_LARGE_UTF8
+                    || column.type == ARROW_TYPE_LARGE_BINARY;
+                bool binary = column.type == ARROW_TYPE_BINARY
+                    || column.type == ARROW_TYPE_LARGE_BINARY;
+                int width = large ? 8 : 4;
+
+                size_t offsetsLength;
+                const char * offsets = getBuffer(offsetsLength);
+                data = getBuffer(dataLength);
+                if (numRows > 0
+                    && offsetsLength < (size_t)(numRows + 1) * width)
+                    throw MLDB::Exception("Arrow offsets buffer of column '"
+                                          + column.name.rawString()
+                                          + "' is too short");
+
+                auto offsetAt = [&] (int64_t i) -> int64_t
+                    {
+                        return large
+                            ? readLE<int64_t>(offsets + i * 8)
+                            : readLE<int32_t>(offsets + i * 4);
+                    };
+
+                for (int64_t i = 0;  i < numRows;  ++i) {
+                    if (!isValid(i)) {
+                        values.emplace_back();
+                        continue;
+                    }
+                    int64_t start = offsetAt(i), end = offsetAt(i + 1);
+                    if (start < 0 || end < start
+                        || (uint64_t)end > dataLength)
+                        throw MLDB::Exception("Arrow string offsets of "
+                                              "column '"
+                                              + column.name.rawString()
+                                              + "' are invalid");
+                    if (binary)
+                        values.emplace_back
+                            (CellValue::blob(data + start, end - start));
+                    else values.emplace_back
+                             (Utf8String(data + start, (size_t)(end - start)));
+                }
+                break;
+            }
+
+            default:
+                throw MLDB::Exception("Unexpected Arrow column type");
+            }
+        }
+    }
+
+    template<typename T>
+    static T readLE(const char * p)
+    {
+        T result;
+        std::memcpy(&result, p, sizeof(T));
+        return result;
+    }
+};
+
+ArrowStreamReader::
+ArrowStreamReader(const char * data, size_t length)
+    : itl(new Itl(data, length))
+{
+}
+
+ArrowStreamReader::
+~ArrowStreamReader()
+{
+}
+
+const std::vector<Utf8String> &
+ArrowStreamReader::
+columnNames() const
+{
+    return itl->columnNames;
+}
+
+bool
+ArrowStreamReader::
+readBatch(std::vector<std::vector<CellValue> > & columns)
+{
+    return itl->readBatch(columns);
+}
+
+} // namespace MLDB
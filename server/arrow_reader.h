@@ -0,0 +1,51 @@
+/** arrow_reader.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Reader for the streaming form of the Apache Arrow IPC format, from a
+    buffer that is already in memory (typically a mapped file).
+
+    Only flat schemas can be read.  The column types that are understood
+    are null, bool, signed and unsigned integers, half, single and double
+    precision floating point, utf8 and binary (as well as their large
+    variants), date and timestamp.  Dictionary encoded columns, nested
+    types and compressed batches cause an exception to be thrown.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ARROW STREAM READER                                                       */
+/*****************************************************************************/
+
+struct ArrowStreamReader {
+
+    /** Create a reader over the given bytes, which must stay valid while
+        it's being used.  The schema is read straight away.
+    */
+    ArrowStreamReader(const char * data, size_t length);
+
+    ~ArrowStreamReader();
+
+    /// Names of the columns, as they are in the schema
+    const std::vector<Utf8String> & columnNames() const;
+
+    /** Read the next record batch, putting one vector of values per column
+        into columns, with empty values for nulls.  Returns false, with
+        columns untouched, once the end of the stream has been reached.
+    */
+    bool readBatch(std::vector<std::vector<CellValue> > & columns);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
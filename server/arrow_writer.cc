@@ -0,0 +1,663 @@
+/** arrow_writer.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Writer for the Apache Arrow IPC format.  The metadata of the format is
+    encoded as flatbuffers, which are built here directly rather than with
+    generated code.
+*/
+
+#include "arrow_writer.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/date.h"
+#include "mldb/types/any_impl.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const char * arrowMimeType(ArrowFormat format)
+{
+    return format == ARROW_FILE
+        ? "application/vnd.apache.arrow.file"
+        : "application/vnd.apache.arrow.stream";
+}
+
+namespace {
+
+/*****************************************************************************/
+/* FLATBUFFER BUILDER                                                        */
+/*****************************************************************************/
+
+/** Minimal builder of flatbuffers.  As in the reference implementation, the
+    buffer is built from the end backwards, so that objects can refer to
+    the ones that were built before them.  Offsets are the distance from the
+    end of the buffer; the bytes are kept in reverse order until finish().
+*/
+struct FlatBufferBuilder {
+    std::vector<uint8_t> buf;   ///< Contents, in reverse order
+    size_t minAlign = 1;
+
+    /// Fields of the table currently being built: (slot, offset)
+    std::vector<std::pair<int, uint32_t> > fields;
+    uint32_t tableStart = 0;
+
+    uint32_t size() const { return buf.size(); }
+
+    void pad(size_t n)
+    {
+        buf.insert(buf.end(), n, 0);
+    }
+
+    /// Align so that after writing additional bytes, we're aligned to n
+    void align(size_t n, size_t additional = 0)
+    {
+        minAlign = std::max(minAlign, n);
+        pad((n - ((buf.size() + additional) % n)) % n);
+    }
+
+    template<typename T>
+    void push(T value)
+    {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (int i = sizeof(T) - 1;  i >= 0;  --i)
+            buf.push_back(bytes[i]);
+    }
+
+    template<typename T>
+    uint32_t addScalar(T value)
+    {
+        align(sizeof(T));
+        push(value);
+        return size();
+    }
+
+    uint32_t addOffsetValue(uint32_t offset)
+    {
+        align(4);
+        push<uint32_t>(size() + 4 - offset);
+        return size();
+    }
+
+    uint32_t createString(const std::string & str)
+    {
+        align(4, str.size() + 1);
+        buf.push_back(0);
+        for (auto it = str.rbegin(); it != str.rend();  ++it)
+            buf.push_back(*it);
+        push<uint32_t>(str.size());
+        return size();
+    }
+
+    uint32_t createOffsetVector(const std::vector<uint32_t> & offsets)
+    {
+        align(4, offsets.size() * 4);
+        for (auto it = offsets.rbegin();  it != offsets.rend();  ++it)
+            addOffsetValue(*it);
+        push<uint32_t>(offsets.size());
+        return size();
+    }
+
+    /** Vector of structs, whose (little endian) bytes are already laid
+        out in forward order.
+    */
+    uint32_t createStructVector(const std::string & bytes, size_t numElements,
+                                size_t alignment)
+    {
+        align(4, bytes.size());
+        align(alignment, bytes.size());
+        for (auto it = bytes.rbegin();  it != bytes.rend();  ++it)
+            buf.push_back(*it);
+        push<uint32_t>(numElements);
+        return size();
+    }
+
+    void startTable()
+    {
+        ExcAssert(fields.empty());
+        tableStart = size();
+    }
+
+    template<typename T>
+    void addField(int slot, T value)
+    {
+        fields.emplace_back(slot, addScalar(value));
+    }
+
+    void addOffsetField(int slot, uint32_t offset)
+    {
+        fields.emplace_back(slot, addOffsetValue(offset));
+    }
+
+    uint32_t endTable()
+    {
+        // Placeholder for the offset to the vtable
+        addScalar<int32_t>(0);
+        uint32_t objectEnd = size();
+
+        int numSlots = 0;
+        for (auto & f: fields)
+            numSlots = std::max(numSlots, f.first + 1);
+        std::vector<uint16_t> slots(numSlots, 0);
+        for (auto & f: fields)
+            slots[f.first] = objectEnd - f.second;
+
+        // The vtable goes just before the table
+        for (int i = numSlots - 1;  i >= 0;  --i)
+            push<uint16_t>(slots[i]);
+        push<uint16_t>(objectEnd - tableStart);
+        push<uint16_t>(4 + 2 * numSlots);
+        uint32_t vtable = size();
+
+        int32_t vtableOffset = vtable - objectEnd;
+        for (int k = 0;  k < 4;  ++k)
+            buf[objectEnd - 1 - k] = (vtableOffset >> (8 * k)) & 0xff;
+
+        fields.clear();
+        return objectEnd;
+    }
+
+    /// Finish the buffer with the given root table, returning its bytes
+    std::string finish(uint32_t root)
+    {
+        align(minAlign, 4);
+        addOffsetValue(root);
+        return std::string(buf.rbegin(), buf.rend());
+    }
+};
+
+template<typename T>
+void appendLE(std::string & str, T value)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    str.append(bytes, sizeof(T));
+}
+
+size_t padTo8(size_t n)
+{
+    return (n + 7) & ~size_t(7);
+}
+
+
+/*****************************************************************************/
+/* ARROW METADATA                                                            */
+/*****************************************************************************/
+
+/// https://github.com/apache/arrow/blob/master/format/Schema.fbs
+enum ArrowType {
+    ARROW_TYPE_INT = 2,
+    ARROW_TYPE_FLOATING_POINT = 3,
+    ARROW_TYPE_BINARY = 4,
+    ARROW_TYPE_UTF8 = 5,
+    ARROW_TYPE_TIMESTAMP = 10
+};
+
+enum ArrowMessageType {
+    ARROW_MESSAGE_SCHEMA = 1,
+    ARROW_MESSAGE_RECORD_BATCH = 3
+};
+
+constexpr int16_t METADATA_VERSION_V5 = 4;
+constexpr int16_t PRECISION_DOUBLE = 2;
+constexpr int16_t TIME_UNIT_MICROSECOND = 2;
+
+/// Continuation marker that starts each message
+constexpr uint32_t CONTINUATION = 0xffffffff;
+
+const char FILE_MAGIC[] = "ARROW1";
+
+uint32_t buildSchema(FlatBufferBuilder & fbb,
+                     const std::vector<ColumnPath> & columns,
+                     const std::vector<ArrowType> & types)
+{
+    std::vector<uint32_t> fields;
+    for (size_t i = 0;  i < columns.size();  ++i) {
+        uint32_t name = fbb.createString(columns[i].toUtf8String().rawString());
+
+        uint32_t timezone = 0;
+        if (types[i] == ARROW_TYPE_TIMESTAMP)
+            timezone = fbb.createString("UTC");
+
+        fbb.startTable();
+        switch (types[i]) {
+        case ARROW_TYPE_INT:
+            fbb.addField<int32_t>(0, 64);  // bitWidth
+            fbb.addField<uint8_t>(1, 1);   // is_signed
+            break;
+        case ARROW_TYPE_FLOATING_POINT:
+            fbb.addField<int16_t>(0, PRECISION_DOUBLE);
+            break;
+        case ARROW_TYPE_TIMESTAMP:
+            fbb.addField<int16_t>(0, TIME_UNIT_MICROSECOND);
+            fbb.addOffsetField(1, timezone);
+            break;
+        default:
+            break;
+        }
+        uint32_t type = fbb.endTable();
+
+        // Readers require the children, even if there are none
+        uint32_t children = fbb.createOffsetVector({});
+
+        fbb.startTable();
+        fbb.addOffsetField(0, name);
+        fbb.addField<uint8_t>(1, 1);  // nullable
+        fbb.addField<uint8_t>(2, types[i]);
+        fbb.addOffsetField(3, type);
+        fbb.addOffsetField(5, children);
+        fields.push_back(fbb.endTable());
+    }
+
+    uint32_t fieldsVector = fbb.createOffsetVector(fields);
+
+    fbb.startTable();
+    fbb.addField<int16_t>(0, 0);  // little endian
+    fbb.addOffsetField(1, fieldsVector);
+    return fbb.endTable();
+}
+
+std::string buildMessage(FlatBufferBuilder & fbb,
+                         ArrowMessageType type, uint32_t header,
+                         int64_t bodyLength)
+{
+    fbb.startTable();
+    fbb.addField<int64_t>(3, bodyLength);
+    fbb.addOffsetField(2, header);
+    fbb.addField<int16_t>(0, METADATA_VERSION_V5);
+    fbb.addField<uint8_t>(1, type);
+    return fbb.finish(fbb.endTable());
+}
+
+/// Location of a message in a file, for the footer
+struct Block {
+    int64_t offset;
+    int32_t metadataLength;
+    int64_t bodyLength;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ARROW WRITER                                                              */
+/*****************************************************************************/
+
+struct ArrowWriter::Itl {
+    Itl(std::ostream & out, std::vector<ColumnPath> columns_,
+        ArrowFormat format, size_t rowsPerBatch)
+        : out(out), columns(std::move(columns_)), format(format),
+          rowsPerBatch(std::max<size_t>(rowsPerBatch, 1)),
+          values(columns.size())
+    {
+    }
+
+    /// Strings and blobs in a batch are limited by their 32 bit offsets
+    static constexpr size_t MAX_BATCH_BYTES = 1 << 30;
+
+    std::ostream & out;
+    std::vector<ColumnPath> columns;
+    ArrowFormat format;
+    size_t rowsPerBatch;
+
+    /// Types of the columns, chosen when the first batch is written
+    std::vector<ArrowType> types;
+
+    /// Values of the current batch, per column
+    std::vector<std::vector<CellValue> > values;
+    size_t numRows = 0;
+    size_t batchBytes = 0;
+
+    /// Number of bytes written so far
+    int64_t written = 0;
+    std::vector<Block> recordBatches;
+    bool finished = false;
+
+    void write(const std::string & data)
+    {
+        out.write(data.data(), data.size());
+        if (!out)
+            throw MLDB::Exception("Error writing Arrow output");
+        written += data.size();
+    }
+
+    /// Write an encapsulated message, returning its location
+    Block writeMessage(const std::string & metadata, const std::string & body)
+    {
+        Block result;
+        result.offset = written;
+
+        // The prefix and metadata are padded to a multiple of 8 bytes
+        std::string prefix;
+        appendLE<uint32_t>(prefix, CONTINUATION);
+        int32_t metadataLength = padTo8(8 + metadata.size()) - 8;
+        appendLE<int32_t>(prefix, metadataLength);
+        write(prefix);
+        write(metadata);
+        write(std::string(metadataLength - metadata.size(), '\0'));
+        write(body);
+
+        result.metadataLength = 8 + metadataLength;
+        result.bodyLength = body.size();
+        return result;
+    }
+
+    static ArrowType chooseType(const std::vector<CellValue> & values)
+    {
+        bool hasInteger = false, hasDouble = false, hasTimestamp = false;
+        bool hasBlob = false, hasOther = false;
+        for (auto & v: values) {
+            if (v.empty())
+                continue;
+            if (v.isInteger() && v.isInt64())
+                hasInteger = true;
+            else if (v.isNumber())
+                hasDouble = true;
+            else if (v.isTimestamp())
+                hasTimestamp = true;
+            else if (v.isBlob())
+                hasBlob = true;
+            else hasOther = true;
+        }
+
+        if (hasBlob)
+            return ARROW_TYPE_BINARY;
+        if (hasOther)
+            return ARROW_TYPE_UTF8;
+        if (hasTimestamp)
+            return hasInteger || hasDouble
+                ? ARROW_TYPE_UTF8 : ARROW_TYPE_TIMESTAMP;
+        if (hasDouble)
+            return ARROW_TYPE_FLOATING_POINT;
+        if (hasInteger)
+            return ARROW_TYPE_INT;
+        return ARROW_TYPE_UTF8;
+    }
+
+    static const char * typeName(ArrowType type)
+    {
+        switch (type) {
+        case ARROW_TYPE_INT: return "int64";
+        case ARROW_TYPE_FLOATING_POINT: return "float64";
+        case ARROW_TYPE_BINARY: return "binary";
+        case ARROW_TYPE_UTF8: return "utf8";
+        case ARROW_TYPE_TIMESTAMP: return "timestamp";
+        }
+        return "unknown";
+    }
+
+    void writeSchema()
+    {
+        types.clear();
+        for (auto & v: values)
+            types.push_back(chooseType(v));
+
+        if (format == ARROW_FILE) {
+            std::string magic(FILE_MAGIC, 6);
+            magic.resize(8, '\0');
+            write(magic);
+        }
+
+        FlatBufferBuilder fbb;
+        uint32_t schema = buildSchema(fbb, columns, types);
+        writeMessage(buildMessage(fbb, ARROW_MESSAGE_SCHEMA, schema, 0), "");
+    }
+
+    MLDB_NORETURN void throwMismatch(size_t column, const CellValue & value)
+    {
+        throw HttpReturnException
+            (400, "Value of column '" + columns[column].toUtf8String()
+             + "' can't be written to Arrow column of type "
+             + typeName(types[column])
+             + ", which was chosen from the preceding rows.  Use CAST in the "
+             "query to give the column a single type.",
+             "column", columns[column],
+             "value", value,
+             "columnType", std::string(typeName(types[column])));
+    }
+
+    void writeBatch()
+    {
+        if (types.empty())
+            writeSchema();
+
+        std::string body;
+        std::string buffers;   // Buffer structs: offset, length
+        std::string nodes;     // FieldNode structs: length, null count
+        int numBuffers = 0;
+
+        auto addBuffer = [&] (const std::string & data)
+            {
+                appendLE<int64_t>(buffers, body.size());
+                appendLE<int64_t>(buffers, data.size());
+                body += data;
+                body.resize(padTo8(body.size()), '\0');
+                ++numBuffers;
+            };
+
+        for (size_t c = 0;  c < columns.size();  ++c) {
+            const std::vector<CellValue> & vals = values[c];
+            ArrowType type = types[c];
+
+            std::string validity((numRows + 7) / 8, '\0');
+            int64_t nullCount = 0;
+            for (size_t i = 0;  i < numRows;  ++i) {
+                if (vals[i].empty())
+                    ++nullCount;
+                else validity[i / 8] |= 1 << (i % 8);
+            }
+
+            std::string data;
+            std::string offsets;
+
+            switch (type) {
+            case ARROW_TYPE_INT:
+                data.reserve(numRows * 8);
+                for (auto & v: vals) {
+                    int64_t value = 0;
+                    if (v.empty())
+                        ;
+                    else if (v.isInteger() && v.isInt64())
+                        value = v.toInt();
+                    else if (v.isNumber() && v.toDouble() == std::trunc(v.toDouble())
+                             && std::abs(v.toDouble()) < 9.2e18)
+                        value = v.toDouble();
+                    else throwMismatch(c, v);
+                    appendLE<int64_t>(data, value);
+                }
+                break;
+
+            case ARROW_TYPE_FLOATING_POINT:
+                data.reserve(numRows * 8);
+                for (auto & v: vals) {
+                    double value = 0;
+                    if (v.empty())
+                        ;
+                    else if (v.isNumber())
+                        value = v.toDouble();
+                    else throwMismatch(c, v);
+                    appendLE<double>(data, value);
+                }
+                break;
+
+            case ARROW_TYPE_TIMESTAMP:
+                data.reserve(numRows * 8);
+                for (auto & v: vals) {
+                    int64_t value = 0;
+                    if (v.empty())
+                        ;
+                    else if (v.isTimestamp())
+                        value = std::llround(v.toTimestamp().secondsSinceEpoch()
+                                             * 1000000.0);
+                    else throwMismatch(c, v);
+                    appendLE<int64_t>(data, value);
+                }
+                break;
+
+            case ARROW_TYPE_UTF8:
+            case ARROW_TYPE_BINARY:
+                offsets.reserve((numRows + 1) * 4);
+                appendLE<int32_t>(offsets, 0);
+                for (auto & v: vals) {
+                    if (v.empty())
+                        ;
+                    else if (v.isBlob()) {
+                        if (type != ARROW_TYPE_BINARY)
+                            throwMismatch(c, v);
+                        data.append((const char *)v.blobData(), v.blobLength());
+                    }
+                    else if (v.isString())
+                        data.append(v.stringChars(), v.toStringLength());
+                    else data += v.toUtf8String().rawString();
+                    if (data.size() > (size_t)std::numeric_limits<int32_t>::max())
+                        throw HttpReturnException
+                            (400, "Too much string data in an Arrow batch",
+                             "column", columns[c]);
+                    appendLE<int32_t>(offsets, data.size());
+                }
+                break;
+            }
+
+            appendLE<int64_t>(nodes, numRows);
+            appendLE<int64_t>(nodes, nullCount);
+
+            // The validity buffer can be omitted if there are no nulls
+            addBuffer(nullCount ? validity : std::string());
+            if (!offsets.empty())
+                addBuffer(offsets);
+            addBuffer(data);
+        }
+
+        FlatBufferBuilder fbb;
+        uint32_t buffersVector
+            = fbb.createStructVector(buffers, numBuffers, 8);
+        uint32_t nodesVector
+            = fbb.createStructVector(nodes, columns.size(), 8);
+        fbb.startTable();
+        fbb.addField<int64_t>(0, numRows);
+        fbb.addOffsetField(1, nodesVector);
+        fbb.addOffsetField(2, buffersVector);
+        uint32_t batch = fbb.endTable();
+
+        recordBatches.push_back
+            (writeMessage(buildMessage(fbb, ARROW_MESSAGE_RECORD_BATCH,
+                                       batch, body.size()),
+                          body));
+
+        for (auto & v: values)
+            v.clear();
+        numRows = 0;
+        batchBytes = 0;
+    }
+
+    void addRow(CellValue * row, size_t numValues)
+    {
+        ExcAssert(!finished);
+        if (numValues != columns.size())
+            throw MLDB::Exception("Arrow row has %zd values for %zd columns",
+                                  numValues, columns.size());
+
+        for (size_t i = 0;  i < numValues;  ++i) {
+            if (row[i].isString())
+                batchBytes += row[i].toStringLength();
+            else if (row[i].isBlob())
+                batchBytes += row[i].blobLength();
+            values[i].emplace_back(std::move(row[i]));
+        }
+        ++numRows;
+
+        if (numRows >= rowsPerBatch || batchBytes >= MAX_BATCH_BYTES)
+            writeBatch();
+    }
+
+    void finish()
+    {
+        if (finished)
+            return;
+        if (numRows > 0 || types.empty())
+            writeBatch();
+
+        // End of stream marker
+        std::string eos;
+        appendLE<uint32_t>(eos, CONTINUATION);
+        appendLE<int32_t>(eos, 0);
+        write(eos);
+
+        if (format == ARROW_FILE) {
+            FlatBufferBuilder fbb;
+            std::string blocks;
+            for (auto & b: recordBatches) {
+                appendLE<int64_t>(blocks, b.offset);
+                appendLE<int32_t>(blocks, b.metadataLength);
+                appendLE<int32_t>(blocks, 0);  // padding
+                appendLE<int64_t>(blocks, b.bodyLength);
+            }
+            uint32_t batchesVector
+                = fbb.createStructVector(blocks, recordBatches.size(), 8);
+            uint32_t dictionariesVector = fbb.createStructVector("", 0, 8);
+            uint32_t schema = buildSchema(fbb, columns, types);
+
+            fbb.startTable();
+            fbb.addField<int16_t>(0, METADATA_VERSION_V5);
+            fbb.addOffsetField(1, schema);
+            fbb.addOffsetField(2, dictionariesVector);
+            fbb.addOffsetField(3, batchesVector);
+            std::string footer = fbb.finish(fbb.endTable());
+
+            write(footer);
+            std::string trailer;
+            appendLE<int32_t>(trailer, footer.size());
+            trailer.append(FILE_MAGIC, 6);
+            write(trailer);
+        }
+
+        out.flush();
+        finished = true;
+    }
+};
+
+constexpr size_t ArrowWriter::Itl::MAX_BATCH_BYTES;
+constexpr size_t ArrowWriter::DEFAULT_ROWS_PER_BATCH;
+
+ArrowWriter::
+ArrowWriter(std::ostream & out,
+            std::vector<ColumnPath> columns,
+            ArrowFormat format,
+            size_t rowsPerBatch)
+    : itl(new Itl(out, std::move(columns), format, rowsPerBatch))
+{
+}
+
+ArrowWriter::
+~ArrowWriter()
+{
+}
+
+const std::vector<ColumnPath> &
+ArrowWriter::
+columns() const
+{
+    return itl->columns;
+}
+
+void
+ArrowWriter::
+addRow(CellValue * values, size_t numValues)
+{
+    itl->addRow(values, numValues);
+}
+
+void
+ArrowWriter::
+finish()
+{
+    itl->finish();
+}
+
+} // namespace MLDB
@@ -0,0 +1,79 @@
+/** arrow_writer.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Writer for the Apache Arrow IPC format, in either its streaming form or
+    its file form (which is also version 2 of the Feather format).
+
+    Rows are accumulated column by column and written as record batches.
+    The type of each column is chosen from the values in the first batch:
+
+    - integers give an int64 column, unless there are also floating point
+      values, in which case it's a float64 column;
+    - timestamps give a timestamp column, in microseconds and UTC;
+    - blobs give a binary column;
+    - anything else (strings, paths, intervals, mixed types or no values at
+      all) gives a utf8 column, with the values converted to strings.
+
+    A value in a later batch that can't be represented in the type of its
+    column causes an exception to be thrown.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+
+enum ArrowFormat {
+    ARROW_STREAM,   ///< Streaming format; can be read without seeking
+    ARROW_FILE      ///< File format, with a footer; also Feather v2
+};
+
+/// MIME type of the given Arrow format
+const char * arrowMimeType(ArrowFormat format);
+
+
+/*****************************************************************************/
+/* ARROW WRITER                                                              */
+/*****************************************************************************/
+
+struct ArrowWriter {
+
+    static constexpr size_t DEFAULT_ROWS_PER_BATCH = 65536;
+
+    /** Create a writer for the given columns, which outputs to the given
+        stream.  Nothing is written until the first batch is full or
+        finish() is called.
+    */
+    ArrowWriter(std::ostream & out,
+                std::vector<ColumnPath> columns,
+                ArrowFormat format = ARROW_STREAM,
+                size_t rowsPerBatch = DEFAULT_ROWS_PER_BATCH);
+
+    ~ArrowWriter();
+
+    /// Columns being written
+    const std::vector<ColumnPath> & columns() const;
+
+    /** Add a row.  It must contain one value per column, with empty
+        values for nulls.  The values are moved from.
+    */
+    void addRow(CellValue * values, size_t numValues);
+
+    /** Write what's remaining, and the end of the stream.  This must be
+        called for the output to be valid.
+    */
+    void finish();
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -10,17 +10,24 @@
 #include "mldb/core/dataset.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/memory_account.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/server/parallel_merge_sort.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/async_call_batch.h"
+#include "mldb/sql/query_profile.h"
+#include "mldb/base/metrics.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/log.h"
 #include "mldb/arch/demangle.h"
+#include "mldb/jml/utils/hash_specializations.h"
+#include "mldb/jml/utils/environment.h"
 
 #include <boost/algorithm/string.hpp>
+#include <set>
 
 #include "mldb/jml/utils/profile.h"
 
@@ -38,9 +45,43 @@ namespace MLDB {
 
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
+// number of hash partitions that GROUP BY keys are split into for merging
+const size_t GROUP_BY_PARTITIONS = 64;
+
+// Overlap the calls to I/O bound functions (like fetcher()) over blocks
+// of rows; see AsyncCallBatch
+static EnvOption<bool> ASYNC_FUNCTION_CALLS("MLDB_ASYNC_FUNCTION_CALLS", true);
 
 __thread int QueryThreadTracker::depth = 0;
 
+static MetricCounter & rowsScannedMetric()
+{
+    static MetricCounter & result
+        = Metrics::counter("mldb_query_rows_scanned_total",
+                           "Rows of datasets that matched the WHERE clause "
+                           "of a query and were processed");
+    return result;
+}
+
+
+// Estimate of the memory held by a row that is kept until the end of the
+// query, to charge to its memory account
+static size_t memusage(const NamedRowValue & row)
+{
+    size_t result = sizeof(row) + row.rowName.memusage();
+    for (auto & c: row.columns)
+        result += std::get<0>(c).memusage() + std::get<1>(c).memusage();
+    return result;
+}
+
+static size_t memusage(const std::vector<ExpressionValue> & values)
+{
+    size_t result = sizeof(values);
+    for (auto & v: values)
+        result += v.memusage();
+    return result;
+}
+
 
 /*****************************************************************************/
 /* BOUND SELECT QUERY                                                        */
@@ -91,8 +132,48 @@ struct BoundSelectQuery::Executor {
     }
 
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const = 0;
+
+    /// Columns that the query reads from each row, or null if it may read
+    /// any of them
+    std::shared_ptr<const std::vector<ColumnPath> > projection;
+
+    ExpressionValue getRow(const Dataset & dataset, const RowPath & row) const
+    {
+        if (projection)
+            return dataset.getProjectedRowExpr(row, *projection);
+        return dataset.getRowExpr(row);
+    }
 };
 
+/** Return the columns that are read from the rows of the dataset by the
+    given expressions, or null if they may read columns that can't be
+    known in advance, for example by selecting *.  The WHERE clause isn't
+    included, as it's taken care of by the row generator.
+*/
+static std::shared_ptr<const std::vector<ColumnPath> >
+getQueryProjection(const Utf8String & alias,
+                   const std::vector<UnboundEntities> & unbounds)
+{
+    std::set<ColumnPath> columns;
+    for (auto & unbound: unbounds) {
+        if (!unbound.wildcards.empty() || !unbound.tables.empty()
+            || unbound.hasRowFunctions())
+            return nullptr;
+        for (auto & v: unbound.vars) {
+            const ColumnPath & column = v.first;
+            if (column.empty())
+                return nullptr;
+            columns.insert(column);
+            // The alias may be a prefix of the name
+            if (!alias.empty() && column.size() > 1
+                && column[0] == PathElement(alias))
+                columns.insert(column.removePrefix());
+        }
+    }
+    return std::make_shared<std::vector<ColumnPath> >(columns.begin(),
+                                                      columns.end());
+}
+
 struct UnorderedExecutor: public BoundSelectQuery::Executor {
     const Dataset & dataset;
     GenerateRowsWhereFunction whereGenerator;
@@ -167,7 +248,14 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
 
          // Todo: report the progress of the whereGenerator without breaking
         // the reporting of the processRows. MLDBFB-745
-        auto rows = whereGenerator(-1, Any(), BoundParameters(), nullptr).first;
+        std::vector<RowPath> rows;
+        if (numBuckets <= 0 && limit > 0 && whereGenerator.execUntilMatched) {
+            // Only the first offset + limit matching rows are used, so
+            // the scan can stop once it has found them
+            rows = whereGenerator.execUntilMatched
+                (offset + limit, Any(), BoundParameters(), nullptr).first;
+        }
+        else rows = whereGenerator(-1, Any(), BoundParameters(), nullptr).first;
 
         //cerr << "ROWS MEMORY SIZE " << rows.size() * sizeof(RowName) << endl;
 
@@ -197,7 +285,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     }
                 }
 
-                ExpressionValue row = dataset.getRowExpr(rows[rowNum]);
+                ExpressionValue row = getRow(dataset, rows[rowNum]);
                 auto output = processRow(rows[rowNum], row, rowNum, numPerBucket,
                                          selectStar);
 
@@ -243,17 +331,51 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     return parallelMapHaltable(offset, upper, doRow);
                 }
                 else {
-                    // TODO: to reduce memory usage, we should fill blocks of
-                    // output on worker threads
-                    // in order as much as possible
-                    // while calling the aggregator on the caller thread.
+                    // Fill blocks of output in order on worker threads,
+                    // while calling the processor on the caller thread.
+                    // This keeps only one block in memory at a time, and
+                    // means that a processor that's slow to consume the
+                    // rows (for example, one that's streaming them to a
+                    // client) holds back the production of the next block.
                     ExcAssert(offset >= 0 && offset <= upper);
+                    static constexpr size_t ROWS_PER_BLOCK = 4096;
+
                     std::vector<std::tuple<Path, ExpressionValue, std::vector<ExpressionValue> > >
-                        output(upper-offset);
+                        output(std::min<size_t>(upper - offset,
+                                                ROWS_PER_BLOCK));
                 
                     ProgressState progress(upper-offset);
+                    size_t blockStart = offset;
+
+                    // Calls to I/O bound functions for the whole block are
+                    // started before any row is finished.  Whether there are
+                    // any is found out from the first row.
+                    bool asyncCalls = ASYNC_FUNCTION_CALLS;
+                    std::unique_ptr<AsyncCallBatch> batch;
+
+                    auto startRow = [&] (size_t rowNum)
+                        {
+                            AsyncCallBatch::RowScope scope
+                                (*batch, rowNum - blockStart,
+                                 AsyncCallBatch::START);
+                            try {
+                                auto row = getRow(dataset, rows[rowNum]);
+                                processRow(rows[rowNum], row, rowNum,
+                                           numPerBucket, selectStar);
+                            } MLDB_CATCH_ALL {
+                                // Errors are reported on the second pass
+                            }
+                        };
+
                     auto copyRow = [&] (int rowNum) -> bool
                         {
+                            std::unique_ptr<AsyncCallBatch::RowScope> asyncScope;
+                            if (batch) {
+                                asyncScope.reset(new AsyncCallBatch::RowScope
+                                                 (*batch, rowNum - blockStart,
+                                                  AsyncCallBatch::FINISH));
+                            }
+
                             if (rowNum % PROGRESS_RATE == 0) {
                                 if (onProgress) {
                                     progress = rowNum;
@@ -263,22 +385,39 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                                     }
                                 }
                             }
-                            auto row = dataset.getRowExpr(rows[rowNum]);
+                            auto row = getRow(dataset, rows[rowNum]);
                             auto outputRow = processRow(rows[rowNum], row, rowNum,
                                                         numPerBucket, selectStar);
-                            output[rowNum-offset] = std::move(outputRow);
+                            output[rowNum-blockStart] = std::move(outputRow);
                             return true;
                         };
 
                     DEBUG_MSG(logger) << "iterating rows sequentially";
-                    if (!parallelMapHaltable(offset, upper, copyRow))
-                        return false;
+                    for (; blockStart < upper;  blockStart += ROWS_PER_BLOCK) {
+                        size_t blockEnd
+                            = std::min(blockStart + ROWS_PER_BLOCK, upper);
+
+                        if (asyncCalls) {
+                            batch.reset(new AsyncCallBatch(blockEnd - blockStart));
+                            startRow(blockStart);
+                            if (batch->numStarted() == 0) {
+                                asyncCalls = false;
+                                batch.reset();
+                            }
+                            else if (blockEnd > blockStart + 1) {
+                                parallelMap(blockStart + 1, blockEnd, startRow);
+                            }
+                        }
 
-                    for (size_t i = offset; i < upper; ++i) {
-                        auto& outputRow = output[i-offset];
-                        if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
-                                       std::get<2>(outputRow), -1))
+                        if (!parallelMapHaltable(blockStart, blockEnd, copyRow))
                             return false;
+
+                        for (size_t i = blockStart; i < blockEnd; ++i) {
+                            auto& outputRow = output[i-blockStart];
+                            if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
+                                           std::get<2>(outputRow), -1))
+                                return false;
+                        }
                     }
                 }
             }
@@ -333,7 +472,7 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 stream->initAt(it);
                 for (;  it < stopIt; ++it) {
                     RowPath rowName = stream->next();
-                    auto row = dataset.getRowExpr(rowName);
+                    auto row = getRow(dataset, rowName);
 
                     auto output = processRow(rowName, row, it, numPerBucket, selectStar);
                     int bucketNumber
@@ -460,7 +599,11 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
    
         // For each one, generate the order by key
 
-        typedef std::tuple<std::vector<ExpressionValue>, NamedRowValue, std::vector<ExpressionValue> > SortedRow;
+        // Sort fields, output row, calculated values, the sort key
+        // encoded from the sort fields and the row number
+        typedef std::tuple<std::vector<ExpressionValue>, NamedRowValue,
+                           std::vector<ExpressionValue>, std::string,
+                           int> SortedRow;
         typedef std::vector<SortedRow> SortedRows;
         
         PerThreadAccumulator<SortedRows> accum;
@@ -468,11 +611,40 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         std::atomic<int64_t> rowsAdded(0);
         ProgressState progress(rows.size());
 
+        // Compare two rows according to the sort criteria.  Most rows
+        // are told apart by a memcmp() of their encoded sort keys; ties
+        // are broken by the row number so that the output doesn't depend
+        // on which thread saw which row.
+        auto compareRows = [&] (const SortedRow & row1,
+                                const SortedRow & row2) -> bool
+            {
+                int cmp = boundOrderBy.compareKeys(std::get<3>(row1),
+                                                   std::get<0>(row1),
+                                                   std::get<3>(row2),
+                                                   std::get<0>(row2));
+                if (cmp != 0)
+                    return cmp < 0;
+                return std::get<4>(row1) < std::get<4>(row2);
+            };
+
+        // If we have a limit, each thread only needs to keep the top
+        // offset + limit rows that it has seen, as no others can make it
+        // into the output.  They are kept in a heap with the worst row on
+        // top, so that we hold at most (offset + limit) * threads rows.
+        // DISTINCT ON needs to see the duplicates, so it can't do this.
+        ssize_t maxRowsPerThread = -1;
+        if (limit != -1 && numDistinctOnClauses_ == 0)
+            maxRowsPerThread = offset + limit;
+
+        // Rows kept for the sort are charged to the query; with a limit
+        // there are few enough that it's not worth it.
+        MemoryReservation reserved;
+
         auto doWhere = [&] (int rowNum) -> bool
             {
                 QueryThreadTracker childTracker = parentTracker.child();
 
-                auto row = dataset.getRowExpr(rows[rowNum]);
+                auto row = getRow(dataset, rows[rowNum]);
 
                 if (onProgress && rowsAdded % PROGRESS_RATE == 0) {
                     progress = rowsAdded;
@@ -513,11 +685,42 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
 
                 std::vector<ExpressionValue> sortFields
                     = boundOrderBy.apply(orderByRowScope);
+                std::string sortKey = boundOrderBy.encodeKey(sortFields);
 
                 SortedRows * sortedRows = &accum.get();
-                sortedRows->emplace_back(std::move(sortFields),
-                                         std::move(outputRow),
-                                         std::move(calcd));
+
+                if (maxRowsPerThread < 0) {
+                    reserved.add(memusage(outputRow) + memusage(calcd)
+                                 + memusage(sortFields) + sortKey.capacity());
+                    sortedRows->emplace_back(std::move(sortFields),
+                                             std::move(outputRow),
+                                             std::move(calcd),
+                                             std::move(sortKey),
+                                             rowNum);
+                }
+                else if (sortedRows->size() < maxRowsPerThread) {
+                    sortedRows->emplace_back(std::move(sortFields),
+                                             std::move(outputRow),
+                                             std::move(calcd),
+                                             std::move(sortKey),
+                                             rowNum);
+                    std::push_heap(sortedRows->begin(), sortedRows->end(),
+                                   compareRows);
+                }
+                else if (maxRowsPerThread > 0) {
+                    SortedRow sortedRow(std::move(sortFields),
+                                        std::move(outputRow),
+                                        std::move(calcd),
+                                        std::move(sortKey),
+                                        rowNum);
+                    if (compareRows(sortedRow, sortedRows->front())) {
+                        std::pop_heap(sortedRows->begin(), sortedRows->end(),
+                                      compareRows);
+                        sortedRows->back() = std::move(sortedRow);
+                        std::push_heap(sortedRows->begin(), sortedRows->end(),
+                                       compareRows);
+                    }
+                }
 
                 ++rowsAdded;
                 return true;
@@ -532,13 +735,6 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         //cerr << "map took " << timer.elapsed() << endl;
         timer.restart();
         
-        // Compare two rows according to the sort criteria
-        auto compareRows = [&] (const SortedRow & row1,
-                                const SortedRow & row2) -> bool
-            {
-                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
-            };
-            
         auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
 
         //cerr << "shuffle took " << timer.elapsed() << endl;
@@ -720,6 +916,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         // We will get them in a random order.  But once we have enough, we know
         // that we don't need to go past the point.
 
+        MemoryReservation reserved;
+
         std::atomic<size_t> maxRowNumNeeded(-1);
         std::atomic<ssize_t> minRowNum(-1);
         std::atomic<size_t> maxRowNum(0);
@@ -763,7 +961,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
                     //RowPath rowName = rows[rowNum];
 
-                    row = dataset.getRowExpr(rows[rowNum]);
+                    row = getRow(dataset, rows[rowNum]);
 
                     // Check it matches the where expression.  If not, we don't process
                     // it.
@@ -795,6 +993,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                         selectOutput.mergeToRowDestructive(outputRow.columns);
                     }
 
+                    reserved.add(memusage(outputRow) + memusage(calcd));
+
                     std::unique_lock<Spinlock> guard(mutex);
                     sorted.emplace_back(outputRow.rowHash,
                                         std::move(outputRow),
@@ -806,6 +1006,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                     }
 
                     return true;
+                } catch (const MemoryBudgetExceededException &) {
+                    throw;
                 } catch (...) {
                     rethrowHttpException(KEEP_HTTP_CODE,
                                          "Executing non-grouped query bound to row: " + getExceptionString(),
@@ -959,24 +1161,18 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         int numNeeded = offset + limit;
 
         int64_t upperBound = whereGenerator.rowStreamTotalRows;
-        int maxNumTask = numCpus() * TASK_PER_THREAD;
-        //try to have at least MIN_ROW_PER_TASK element per task
-        int numChunk = upperBound < maxNumTask*MIN_ROW_PER_TASK ? (upperBound / maxNumTask) : maxNumTask;
-        numChunk = std::max(numChunk, (int)1U);
-        int chunkSize = (int)std::floor((float)upperBound / numChunk);
 
-        auto doChunk = [&] (int bucketIndex)
+        // Small morsels pulled from a shared queue, so that the threads
+        // stay busy until the end even if some parts are slower to scan
+        auto doMorsel = [&] (RowStream & stream, size_t start, size_t end)
         {
-          int index = bucketIndex*chunkSize;
-          int stopIndex = bucketIndex == numChunk - 1 ? upperBound : index + chunkSize;
+          size_t index = start;
+          size_t stopIndex = end;
           AccumRows& rows = accum.get();
 
-          auto stream = whereGenerator.rowStream->clone();
-          stream->initAt(index);
-
           while (index < stopIndex)
           {
-              RowPath rowName = stream->next();
+              RowPath rowName = stream.next();
 
               if (rowName == RowPath())
                   break;
@@ -1007,9 +1203,10 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
               ++index;
           }
+          return true;
         };      
 
-        parallelMap(0, numChunk, doChunk);        
+        whereGenerator.rowStream->forEachMorsel(upperBound, doMorsel);
        
         // Compare two rows according to the sort criteria
         auto compareRows = [&] (const RowPath & row1,
@@ -1037,7 +1234,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         int count = 0;
         for (auto & r : rowsMerged) {
 
-            ExpressionValue row = dataset.getRowExpr(r);
+            ExpressionValue row = getRow(dataset, r);
             auto rowContext = context.getRowScope(r, row);
 
             whenBound.filterInPlace(row, rowContext);
@@ -1088,8 +1285,12 @@ BoundSelectQuery(const SelectExpression & select,
                  int numBuckets)
     : select(select), from(from), when(when), where(where), calc(calc),
       orderBy(orderBy), context(new SqlExpressionDatasetScope(from, std::move(alias))),
+      profile(nullptr),
       logger(getMldbLog<BoundSelectQuery>())
 {
+    if (QueryProfile * parent = QueryProfile::current())
+        profile = parent->addChild("BoundSelectQuery");
+
     try {
         SqlExpressionWhenScope whenScope(*context);
         auto whenBound = when.bind(whenScope);
@@ -1097,6 +1298,34 @@ BoundSelectQuery(const SelectExpression & select,
         // Get a generator for the rows that match 
         auto whereGenerator = context->doCreateRowsWhereGenerator(where, 0, -1);
 
+        // Record how the rows are found and how many of them there are
+        Utf8String strategy;
+        if (profile) {
+            strategy = whereGenerator.explain;
+            auto exec = std::move(whereGenerator.exec);
+            QueryProfile * profile = this->profile;
+            whereGenerator.exec
+                = [=] (ssize_t numToGenerate, Any token,
+                       const BoundParameters & params,
+                       const ProgressFunc & onProgress)
+                {
+                    auto result = exec(numToGenerate, std::move(token),
+                                       params, onProgress);
+                    profile->recordRowsIn(result.first.size());
+                    return result;
+                };
+        }
+
+        auto setStrategy = [&] (const char * kind)
+            {
+                if (!profile)
+                    return;
+                Utf8String description(kind);
+                if (!strategy.empty())
+                    description += "; " + strategy;
+                profile->setStrategy(std::move(description));
+            };
+
         auto boundSelect = select.bind(*context);
 
         selectInfo = boundSelect.info;
@@ -1141,6 +1370,7 @@ BoundSelectQuery(const SelectExpression & select,
         if (orderByRowHash) {
             ExcAssert(numBuckets < 0);
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(RowHashOrderedExecutor));
+            setStrategy("ordered by rowHash");
             executor.reset(new RowHashOrderedExecutor(from,
                                                       std::move(whereGenerator),
                                                       *context,
@@ -1154,6 +1384,7 @@ BoundSelectQuery(const SelectExpression & select,
         else if (!newOrderBy.clauses.empty()) {
             ExcAssert(numBuckets < 0);
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(OrderedExecutor));
+            setStrategy("ordered");
             executor.reset(new OrderedExecutor(from,
                                                std::move(whereGenerator),
                                                *context,
@@ -1164,6 +1395,7 @@ BoundSelectQuery(const SelectExpression & select,
                                                select.distinctExpr.size()));
         } else {
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(UnorderedExecutor));
+            setStrategy("unordered");
             executor.reset(new UnorderedExecutor(from,
                                                  std::move(whereGenerator),
                                                 *context,
@@ -1175,6 +1407,12 @@ BoundSelectQuery(const SelectExpression & select,
                                                  logger));
         }
 
+        std::vector<UnboundEntities> unbounds
+            = { select.getUnbound(), when.getUnbound(), orderBy.getUnbound() };
+        for (auto & c: calc)
+            unbounds.emplace_back(c->getUnbound());
+        executor->projection = getQueryProjection(alias, unbounds);
+
     } MLDB_CATCH_ALL {
         rethrowHttpException(KEEP_HTTP_CODE, "Binding error: "
                              + getExceptionString(),
@@ -1219,6 +1457,18 @@ execute(std::function<bool (NamedRowValue & output,
 
     ExcAssert(processor);
 
+    QueryProfile::Timer timer(profile);
+    auto inner = std::move(processor);
+    processor = [&] (NamedRowValue & output,
+                     std::vector<ExpressionValue> & calcd,
+                     int groupNum)
+        {
+            rowsScannedMetric().add();
+            if (profile)
+                profile->recordRowsOut(1);
+            return inner(output, calcd, groupNum);
+        };
+
     try {
         return executor->execute(processor, processInParallel, offset, limit, onProgress);
     } MLDB_CATCH_ALL {
@@ -1268,6 +1518,19 @@ executeExpr(std::function<bool (Path & rowName,
 
     ExcAssert(processor);
 
+    QueryProfile::Timer timer(profile);
+    auto inner = std::move(processor);
+    processor = [&] (Path & rowName,
+                     ExpressionValue & output,
+                     std::vector<ExpressionValue> & calcd,
+                     int groupNum)
+        {
+            rowsScannedMetric().add();
+            if (profile)
+                profile->recordRowsOut(1);
+            return inner(rowName, output, calcd, groupNum);
+        };
+
     try {
         return executor->executeExpr(processor, processInParallel,
                                      offset, limit, onProgress);
@@ -1643,8 +1906,12 @@ BoundGroupByQuery(const SelectExpression & select,
       having(having.shallowCopy()),
       orderBy(orderBy),
       numBuckets(1),
+      profile(nullptr),
       logger(getMldbLog<BoundGroupByQuery>())
 {
+    if (QueryProfile * parent = QueryProfile::current())
+        profile = parent->addChild("BoundGroupByQuery");
+
     for (auto & g: groupBy.clauses) {
         calc.push_back(g);
     }
@@ -1667,7 +1934,13 @@ BoundGroupByQuery(const SelectExpression & select,
 
     // bind the subselect
     //false means no implicit sort by rowhash, we want unsorted
-    subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets));
+    {
+        // the subselect is profiled as the input of the group by
+        std::unique_ptr<QueryProfile::Scope> scope;
+        if (profile)
+            scope.reset(new QueryProfile::Scope(profile));
+        subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets));
+    }
 
     std::vector<std::shared_ptr<ExpressionValueInfo> > groupInfo;
     for (size_t c = 0; c < groupBy.clauses.size(); ++c) {
@@ -1708,6 +1981,16 @@ execute(RowProcessor processor,
 {
     //STACK_PROFILE(BoundGroupByQuery);
 
+    QueryProfile::Timer timer(profile);
+    if (profile) {
+        auto inner = std::move(processor.processorfct);
+        processor.processorfct = [=] (NamedRowValue & output)
+            {
+                profile->recordRowsOut(1);
+                return inner(output);
+            };
+    }
+
     typedef std::tuple<std::vector<ExpressionValue>,
                        NamedRowValue,
                        std::vector<ExpressionValue> >
@@ -1718,7 +2001,12 @@ execute(RowProcessor processor,
 
     typedef std::vector<ExpressionValue> RowKey;
     typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
+
+    // Each bucket aggregates into its own set of partitions, chosen by the
+    // hash of the group key.  This means that each partition can then be
+    // merged over all buckets independently and in parallel.
+    std::vector<std::vector<GroupByMapType> >
+        accum(numBuckets, std::vector<GroupByMapType>(GROUP_BY_PARTITIONS));
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1743,18 +2031,28 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    // Groups are charged to the query as they are created
+    MemoryReservation reserved;
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
                       int groupNum)
     {
-       GroupByMapType & map = accum[groupNum];
        RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
 
+       size_t keyHash = 0;
+       for (auto & k: rowKey)
+           keyHash = ML::chain_hash(k.hash(), keyHash);
+
+       GroupByMapType & map = accum[groupNum][keyHash % GROUP_BY_PARTITIONS];
+
        auto pair = map.insert({rowKey, GroupMapValue()});
        auto & iter = pair.first;
        if (pair.second)
        {
+          reserved.add(memusage(rowKey) + sizeof(GroupByMapType::value_type));
+
           //initialize aggregator data
           groupContext->initializePerThreadAggregators(iter->second);
        }
@@ -1766,14 +2064,17 @@ execute(RowProcessor processor,
             
     subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
   
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
+    //merge each partition over the buckets in parallel.  Within a
+    //partition the buckets are merged in fixed order, so that the result
+    //is deterministic.
+    std::vector<GroupByMapType> destMaps(GROUP_BY_PARTITIONS);
+
+    auto mergePartition = [&] (size_t partition)
     {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
+        GroupByMapType & destMap = destMaps[partition];
+        for (auto & bucket : accum)
         {
+            GroupByMapType & srcMap = bucket[partition];
             for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
             {
                 auto pair = destMap.insert({it->first, GroupMapValue()});
@@ -1786,20 +2087,51 @@ execute(RowProcessor processor,
 
                 groupContext->mergeThreadMap(destiter->second, it->second);
             }
+
+            //free the bucket's memory as soon as we're done with it
+            GroupByMapType().swap(srcMap);
         }
-    }
+    };
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
+    parallelMap(0, GROUP_BY_PARTITIONS, mergePartition);
+
+    bool noGroups = std::all_of(destMaps.begin(), destMaps.end(),
+                                [] (const GroupByMapType & m) { return m.empty(); });
+
+    if (noGroups && groupContext->evaluateEmptyGroups
         && groupBy.clauses.empty())
     {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
+        auto pair = destMaps[0].emplace(RowKey(), GroupMapValue());
         groupContext->initializePerThreadAggregators(pair.first->second);
     }
 
-    //output rows
-    //each entry in the final map should be an output row for us   
-    for (auto it = destMap.begin(); it != destMap.end(); ++it)
+    //output rows in group key order, by merging the (sorted) partitions
+    //each entry in the final maps should be an output row for us
+    typedef std::pair<GroupByMapType::const_iterator,
+                      GroupByMapType::const_iterator> PartitionRange;
+
+    auto compareRanges = [] (const PartitionRange & r1,
+                             const PartitionRange & r2)
+        {
+            // reversed, so that the heap gives us the lowest key first
+            return r2.first->first < r1.first->first;
+        };
+
+    std::vector<PartitionRange> heap;
+    for (auto & m: destMaps) {
+        if (!m.empty())
+            heap.emplace_back(m.begin(), m.end());
+    }
+    std::make_heap(heap.begin(), heap.end(), compareRanges);
+
+    while (!heap.empty())
     {
+        std::pop_heap(heap.begin(), heap.end(), compareRanges);
+        auto it = heap.back().first++;
+        if (heap.back().first == heap.back().second)
+            heap.pop_back();
+        else std::push_heap(heap.begin(), heap.end(), compareRanges);
+
         RowKey rowKey = it->first;
         groupContext->aggData = it->second;
 
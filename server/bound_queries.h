@@ -10,6 +10,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/server/analytics.h"
 #include "mldb/utils/log_fwd.h"
+#include "mldb/arch/sampling_profiler.h"
 
 
 
@@ -17,18 +18,24 @@ namespace MLDB {
 
 struct GroupContext;
 struct SqlExpressionDatasetScope;
+struct QueryProfile;
 
 
 /** This object is designed to track whether a thread is executing a
     query as a child thread (in which case it shouldn't create any
     extra threads) or as a parent (in which case it could).
 
+    Child threads also take on the sampling profiler activity of the
+    parent (see SamplingProfiler::Activity), so that their samples are
+    attributed to the query that they're working on.
 */
 struct QueryThreadTracker {
 
     // Constructor for the parent thread
     QueryThreadTracker()
-        : inParent(true)
+        : inParent(true),
+          activity(SamplingProfiler::currentActivity()),
+          previousActivity(nullptr)
     {
     }
     
@@ -37,6 +44,9 @@ struct QueryThreadTracker {
     {
         QueryThreadTracker result;
         result.inParent = false;
+        result.activity = activity;
+        result.previousActivity
+            = SamplingProfiler::setCurrentActivity(activity);
         ++depth;
         return result;
     }
@@ -44,8 +54,10 @@ struct QueryThreadTracker {
     // Destructor, which undoes the increment from the desctructor
     ~QueryThreadTracker()
     {
-        if (!inParent)
+        if (!inParent) {
             --depth;
+            SamplingProfiler::setCurrentActivity(previousActivity);
+        }
     }
     
     static bool inChildThread() { return depth > 0; }
@@ -53,6 +65,11 @@ struct QueryThreadTracker {
     bool inParent;
     static __thread int depth;
 
+    /// Activity of the parent thread, and that of a child thread before
+    /// it took on the parent's
+    const char * activity;
+    const char * previousActivity;
+
     QueryThreadTracker(const QueryThreadTracker &) = delete;
     void operator = (const QueryThreadTracker &) = delete;
 
@@ -64,6 +81,8 @@ struct QueryThreadTracker {
     QueryThreadTracker & operator = (QueryThreadTracker && other)
     {
         inParent = other.inParent;
+        activity = other.activity;
+        previousActivity = other.previousActivity;
         other.inParent = true;  // to avoid depth being decremented
         return *this;
     }
@@ -134,6 +153,10 @@ struct BoundSelectQuery {
 
     std::shared_ptr<Executor> executor;
 
+    /// Node of the query profile that the query records into, or null if
+    /// it isn't being profiled.  See query_profile.h.
+    QueryProfile * profile;
+
     std::shared_ptr<ExpressionValueInfo> getSelectOutputInfo() const;
 };
 
@@ -191,6 +214,9 @@ struct BoundGroupByQuery {
 
     size_t numBuckets;
 
+    /// Node of the query profile that the query records into, or null
+    QueryProfile * profile;
+
     std::shared_ptr<spdlog::logger> logger;
 
 };
@@ -13,6 +13,7 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/ml/jml/buckets.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/storage_allocator.h"
 #include "mldb/types/string.h"
 
 #include <algorithm>
@@ -23,18 +24,6 @@
 
 namespace MLDB {
 
-namespace {
-
-template<typename T>
-static std::shared_ptr<T>
-makeSharedArray(size_t len)
-{
-    return std::shared_ptr<T>(new T[len],
-                              [] (T * p) { delete[] p; });
-}
-
-}
-
 /*****************************************************************************/
 /* BUCKET LIST                                                               */
 /*****************************************************************************/
@@ -63,7 +52,7 @@ init(size_t numElements, uint32_t numBuckets)
     //     << " buckets" << endl;
 
     size_t numWords = (entryBits * numElements + 63) / 64;
-    auto writableStorage = makeSharedArray<uint64_t>(numWords);
+    auto writableStorage = allocateStorageArray<uint64_t>(numWords);
     this->current = writableStorage.get();
     this->storage = writableStorage;
     this->bitsWritten = 0;
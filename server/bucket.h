@@ -38,6 +38,54 @@ struct BucketList {
         return result;
     }
 
+    /** Put the n bucket numbers starting at entry start into output.
+        This is much faster than calling operator [] for each of them, as
+        there is no shifting and masking for entries of 8 bits or more and
+        the loops can be vectorized.
+    */
+    void extract(size_t start, size_t n, uint32_t * output) const
+    {
+        //ExcAssertLessEqual(start + n, numEntries);
+        const uint8_t * bytes = (const uint8_t *)storage.get();
+        switch (entryBits) {
+        case 32:
+            copyEntries((const uint32_t *)bytes + start, n, output);
+            return;
+        case 16:
+            copyEntries((const uint16_t *)bytes + start, n, output);
+            return;
+        case 8:
+            copyEntries(bytes + start, n, output);
+            return;
+        default:
+            for (size_t i = 0;  i < n;  ++i)
+                output[i] = operator [] (start + i);
+        }
+    }
+
+    /** Put the bucket number of each of the n entries given by indexes
+        into output; the same as calling operator [] for each of them, but
+        faster.
+    */
+    void gather(const int * indexes, size_t n, uint32_t * output) const
+    {
+        const uint8_t * bytes = (const uint8_t *)storage.get();
+        switch (entryBits) {
+        case 32:
+            gatherEntries((const uint32_t *)bytes, indexes, n, output);
+            return;
+        case 16:
+            gatherEntries((const uint16_t *)bytes, indexes, n, output);
+            return;
+        case 8:
+            gatherEntries(bytes, indexes, n, output);
+            return;
+        default:
+            for (size_t i = 0;  i < n;  ++i)
+                output[i] = operator [] (indexes[i]);
+        }
+    }
+
     std::shared_ptr<const uint64_t> storage;
     int entryBits;
     int numBuckets;
@@ -47,6 +95,30 @@ struct BucketList {
     {
         return numEntries;
     }
+
+private:
+    // The entry widths are powers of two from 1 to 32 bits (see
+    // WritableBucketList::init()), so entries never straddle two words.
+    // On a little endian machine, entries of 8 bits or more are then at
+    // the same place as in an array of that size of integer.
+    template<typename Int>
+    static void copyEntries(const Int * entries, size_t n, uint32_t * output)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = entries[i];
+    }
+
+    template<typename Int>
+    static void gatherEntries(const Int * entries, const int * indexes,
+                              size_t n, uint32_t * output)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = entries[indexes[i]];
+    }
+
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+                  "BucketList::extract() and gather() need a little endian "
+                  "machine");
 };
 
 /** Writable version of the above.  OK to slice. */
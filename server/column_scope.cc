@@ -196,24 +196,15 @@ runIncrementalT(const std::vector<BoundSqlExpression> & exprs,
 
     if (optimizeRunIncremental(canTakeOptimizedPath)) {
         // No need to ever allocate a huge amount of memory
-        std::vector<size_t> chunkOffsets;
-        auto chunks = rowGen.rowStream->parallelize(numRows,
-                                                    RowStream::AUTO,
-                                                    &chunkOffsets);
-            
         static constexpr size_t ROWS_AT_ONCE = 1000;
 
-        auto onChunk = [&] (size_t chunkNum)
+        auto onMorsel = [&] (RowStream & stream,
+                             ssize_t startOffset, ssize_t endOffset)
             {
                 PossiblyDynamicBuffer<Val> valuesHolder(
                     requiredColumns.size() * ROWS_AT_ONCE);
                 Val * values = valuesHolder.data();
 
-                RowStream & stream = *chunks[chunkNum];
-
-                ssize_t startOffset = chunkOffsets[chunkNum];
-                ssize_t endOffset = chunkOffsets[chunkNum + 1];
-                    
                 size_t numRows = endOffset - startOffset;
 
                 PossiblyDynamicBuffer<Val> resultsHolder(exprs.size());
@@ -261,24 +252,17 @@ runIncrementalT(const std::vector<BoundSqlExpression> & exprs,
                 return true;
             };
 
-        return parallelMapHaltable(0, chunks.size(), onChunk);
+        return rowGen.rowStream->forEachMorsel(numRows, onMorsel);
     }
 
     // Fall back to version without a row stream
-    std::vector<std::vector<CellValue> > inputs(requiredColumns.size());
-
     auto rows = rowGen(-1, nullptr);
 
     //cerr << "got " << rows.first.size() << " rows in " << timer.elapsed()
     //     << " seconds" << endl;
 
-    auto doColumn = [&] (size_t index)
-        {
-            inputs[index] = dataset->getColumnIndex()
-                ->getColumnDense(requiredColumns[index]);
-        };
-
-    parallelMap(0, requiredColumns.size(), doColumn);
+    std::vector<std::vector<CellValue> > inputs
+        = dataset->getColumnIndex()->getColumnsDense(requiredColumns);
 
     using namespace std;
     cerr << "done columns" << endl;
@@ -10,6 +10,11 @@
 #include "mldb/server/dataset_collection.h"
 #include "mldb/rest/poly_collection_impl.h"
 #include "mldb/server/mldb_server.h"
+#include "mldb/server/arrow_writer.h"
+#include "mldb/server/query_json_writer.h"
+#include "mldb/server/msgpack_rows.h"
+#include "mldb/server/ingestion_queue.h"
+#include "mldb/jml/utils/environment.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/jml/utils/lightweight_hash.h"
@@ -18,6 +23,8 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/types/pointer_description.h"
 #include "mldb/types/tuple_description.h"
+#include <sstream>
+#include <cmath>
 
 using namespace std;
 
@@ -49,6 +56,15 @@ createDataset(MldbServer * server,
     return server->datasets->createEntitySync(config, onProgress, overwrite);
 }
 
+std::shared_ptr<Dataset>
+constructDataset(MldbServer * server,
+                 const PolyConfig & config,
+                 const std::function<bool (const Json::Value & progress)> & onProgress)
+{
+    return std::static_pointer_cast<Dataset>
+        (server->datasets->construct(config, onProgress));
+}
+
 std::shared_ptr<DatasetType>
 registerDatasetType(const Package & package,
                     const Utf8String & name,
@@ -82,35 +98,23 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         }
     }
 
-    if (format == "full" || format == "") {
-        connection.sendResponse(200, jsonEncodeStr(sparseOutput),
-                                "application/json");
-    }
-    else if (format == "sparse") {
-        std::vector<std::vector<std::pair<ColumnPath, CellValue> > > output;
-        output.reserve(sparseOutput.size());
-
-        for (auto & row: sparseOutput) {
-
-            std::vector<std::pair<ColumnPath, CellValue> > rowOut;
-            rowOut.reserve(row.columns.size() + rowNames + rowHashes);
-
-            if (rowNames)
-                rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
-            if (rowHashes)
-                rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
-
-            for (auto & c: row.columns) {
-                rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
-            }
-
-            std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
-
-            output.emplace_back(std::move(rowOut));
+    if (format == "full" || format == "" || format == "sparse"
+        || format == "aos") {
+        // Row by row formats; these are written straight to the output
+        std::string output = "[";
+        QueryJsonWriter writer(output);
+        for (size_t i = 0;  i < sparseOutput.size();  ++i) {
+            if (i != 0)
+                output += ',';
+            if (format == "sparse")
+                writer.writeSparseRow(sparseOutput[i], rowNames, rowHashes);
+            else if (format == "aos")
+                writer.writeAosRow(sparseOutput[i], rowNames, rowHashes);
+            else writer.writeFullRow(sparseOutput[i]);
         }
+        output += ']';
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        connection.sendResponse(200, std::move(output), "application/json");
     }
     else if (format == "soa") {
         // Structure of arrays; one array per column
@@ -136,29 +140,6 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(output),
                                 "application/json");
     }
-    else if (format == "aos") {
-        // Array of structures; one structure per row
-        std::vector<std::map<ColumnPath, CellValue> > output;
-        for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-
-            std::map<ColumnPath, CellValue> row;
-
-            if (rowNames)
-                row[ColumnPath("_rowName")] = sparseOutput[i].rowName.toUtf8String();
-            if (rowHashes)
-                row[ColumnPath("_rowHash")] = sparseOutput[i].rowHash.toString();
-
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnPath & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-                row[col] = val;
-            }
-
-            output.emplace_back(std::move(row));
-        }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
     else if (format == "table") {
         // TODO: the SQL knows what columns could be created... this could
         // be greatly optimized.
@@ -250,6 +231,58 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(output),
                                 "application/json");
     }
+    else if (format == "arrow" || format == "arrow-file") {
+        // Apache Arrow IPC; one column per output column, like the table
+        // format, but with the values in their native types
+        std::vector<ColumnPath> columns;
+        if (rowNames)
+            columns.emplace_back(ColumnPath("_rowName"));
+        if (rowHashes)
+            columns.emplace_back(ColumnPath("_rowHash"));
+
+        size_t numFixed = columns.size();
+        Lightweight_Hash<ColumnHash, int> columnIndex;
+        for (auto & o: sparseOutput) {
+            for (auto & c: o.columns) {
+                auto & columnName = std::get<0>(c);
+                if (columnIndex.insert({columnName, columns.size()}).second) {
+                    columns.push_back(columnName);
+                }
+            }
+        }
+
+        if (sortColumns) {
+            std::sort(columns.begin() + numFixed, columns.end());
+            for (size_t i = numFixed;  i < columns.size();  ++i) {
+                columnIndex[columns[i]] = i;
+            }
+        }
+
+        ArrowFormat arrowFormat
+            = format == "arrow" ? ARROW_STREAM : ARROW_FILE;
+
+        std::ostringstream stream;
+        ArrowWriter writer(stream, columns, arrowFormat);
+
+        for (auto & row: sparseOutput) {
+            std::vector<CellValue> rowOut(columns.size());
+            if (rowNames)
+                rowOut[0] = row.rowName.toUtf8String();
+            if (rowHashes)
+                rowOut[rowNames] = row.rowHash.toString();
+
+            for (auto & c: row.columns) {
+                rowOut[columnIndex[std::get<0>(c)]] = std::move(std::get<1>(c));
+            }
+
+            writer.addRow(rowOut.data(), rowOut.size());
+        }
+
+        writer.finish();
+
+        connection.sendResponse(200, stream.str(),
+                                arrowMimeType(arrowFormat));
+    }
     else if (format == "atom") {
         if (sparseOutput.size() > 1) {
             connection.sendErrorResponse(400, "Query with atom format returning multiple rows. Consider using limit.");
@@ -284,6 +317,104 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 }
 
 
+void runHttpQueryStreaming(std::function<void (const std::function<bool (NamedRowValue &)> &)> runQuery,
+                           RestConnection & connection,
+                           const std::string & format,
+                           bool createHeaders,
+                           bool rowNames,
+                           bool rowHashes,
+                           bool sortColumns)
+{
+    // Only the formats where the output for a row doesn't depend upon the
+    // other rows can be streamed
+    if (format != "full" && format != "" && format != "sparse"
+        && format != "aos") {
+        auto bufferQuery = [&] ()
+            {
+                std::vector<MatrixNamedRow> output;
+                auto onRow = [&] (NamedRowValue & row)
+                    {
+                        output.emplace_back(row.flattenDestructive());
+                        return true;
+                    };
+                runQuery(onRow);
+                return output;
+            };
+
+        runHttpQuery(bufferQuery, connection, format, createHeaders,
+                     rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    // Output is accumulated until there is this much, and then sent as a
+    // chunk.  Nothing is sent before the first chunk is full, so an error
+    // in a query with a small result still gets a proper error response.
+    static constexpr size_t CHUNK_SIZE = 65536;
+
+    std::string buffer = "[";
+    QueryJsonWriter writer(buffer);
+    bool headerSent = false;
+    size_t numRows = 0;
+
+    auto flush = [&] ()
+        {
+            if (!headerSent) {
+                connection.sendHttpResponseHeader
+                    (200, "application/json",
+                     RestConnection::CHUNKED_ENCODING);
+                headerSent = true;
+            }
+            connection.sendPayload(std::move(buffer));
+            buffer.clear();
+            buffer.reserve(CHUNK_SIZE + CHUNK_SIZE / 4);
+        };
+
+    auto onRow = [&] (NamedRowValue & row_)
+        {
+            MatrixNamedRow row = row_.flattenDestructive();
+            if (sortColumns)
+                std::sort(row.columns.begin(), row.columns.end());
+
+            if (numRows++ != 0)
+                buffer += ',';
+
+            if (format == "sparse")
+                writer.writeSparseRow(row, rowNames, rowHashes);
+            else if (format == "aos")
+                writer.writeAosRow(row, rowNames, rowHashes);
+            else writer.writeFullRow(row);
+
+            if (buffer.size() >= CHUNK_SIZE)
+                flush();
+
+            return true;
+        };
+
+    try {
+        runQuery(onRow);
+    } catch (...) {
+        if (!headerSent)
+            throw;
+
+        // We've already told the client that it worked, so the best we
+        // can do is to end the response early.  The output will be
+        // missing its closing bracket, and so won't parse.
+        connection.finishResponse();
+        return;
+    }
+
+    buffer += ']';
+
+    if (!headerSent) {
+        connection.sendResponse(200, std::move(buffer), "application/json");
+        return;
+    }
+
+    flush();
+    connection.finishResponse();
+}
+
+
 /*****************************************************************************/
 /* DATASET COLLECTION                                                         */
 /*****************************************************************************/
@@ -325,10 +456,29 @@ initRoutes(RouteManager & manager)
             return static_cast<Dataset *>(cxt.getSharedPtrAs<PolyEntity>(2).get());
         };
 
-    addRouteSync(*manager.valueNode, "/commit", { "POST" },
-                 "Commit dataset",
-                 &Dataset::commit,
-                 getDataset);
+    // Rows that were accepted for asynchronous ingestion before the commit
+    // are recorded before it happens
+    RestRequestRouter::OnProcessRequest commitDataset
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                auto collection = static_cast<DatasetCollection *>
+                    (manager.getCollection(cxt));
+                Dataset * dataset = getDataset(cxt);
+                collection->flushIngestion(dataset);
+                dataset->commit();
+                connection.sendResponse(200);
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    manager.valueNode->addRoute("/commit", { "POST" },
+                                "Commit dataset",
+                                commitDataset, Json::Value());
 
     addRouteSyncJsonReturn(*manager.valueNode, "/timestampRange", { "GET" },
                            "Return timestamp range for dataset",
@@ -392,6 +542,32 @@ initRoutes(RouteManager & manager)
                  JsonParam<std::vector<std::tuple<ColumnPath, CellValue, Date> > >
                  ("columns", "[ column name, value, date ] tuples to record"));
 
+    // Same as the next one, but with a MessagePack body so that there is no
+    // JSON to encode or decode.  It needs to come first, as it's only
+    // selected by the content type.
+    RestRequestRouter::OnProcessRequest recordMsgPackRows
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                auto dataset = getDataset(cxt);
+                dataset->recordRows(decodeMsgPackRows(req.payload.data(),
+                                                      req.payload.size()));
+                connection.sendResponse(200);
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    manager.valueNode->addRoute("/multirows",
+                                { "POST", "header:content-type="
+                                  + std::string(MSGPACK_MIME_TYPE) },
+                                "Record many rows into the dataset, encoded "
+                                "in MessagePack",
+                                recordMsgPackRows, Json::Value());
+
     addRouteSync(*manager.valueNode, "/multirows", { "POST" },
                  "Record many rows into the dataset",
                  &Dataset::recordRows,
@@ -399,6 +575,128 @@ initRoutes(RouteManager & manager)
                  JsonParam<std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > >
                  ("", "[ [ row name, [ [ column name, value, timestamp ], ... ] ], ...] tuples to record"));
 
+    /************************
+     *      /ingest
+     * ***************/
+
+    // Queue the rows to be recorded in the background, answering 202 once
+    // they're queued, or 429 with a hint of when to try again if the
+    // queue is full
+    auto ingestRows = [=] (RestConnection & connection,
+                           const RestRequestParsingContext & cxt,
+                           IngestionQueue::Rows rows)
+        {
+            auto collection = static_cast<DatasetCollection *>
+                (manager.getCollection(cxt));
+            auto queue = collection->getIngestionQueue
+                (std::static_pointer_cast<Dataset>
+                 (cxt.getSharedPtrAs<PolyEntity>(2)));
+
+            size_t numRows = rows.size();
+            if (!queue->enqueue(std::move(rows))) {
+                int retryAfter = std::ceil(std::min(60.0,
+                                                    queue->retryAfterSeconds()));
+                retryAfter = std::max(retryAfter, 1);
+                Json::Value error;
+                error["error"] = "The ingestion queue of the dataset is full; "
+                    "retry after " + std::to_string(retryAfter) + " seconds";
+                error["httpCode"] = 429;
+                error["details"]["retryAfterSeconds"] = retryAfter;
+                connection.sendHttpResponse(429, error.toStringNoNewLine(),
+                                            "application/json",
+                                            { { "Retry-After",
+                                                std::to_string(retryAfter) } });
+                return;
+            }
+
+            Json::Value result;
+            result["queuedRows"] = (uint64_t)numRows;
+            connection.sendResponse(202, result);
+        };
+
+    RestRequestRouter::OnProcessRequest ingestMsgPackRows
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                ingestRows(connection, cxt,
+                           decodeMsgPackRows(req.payload.data(),
+                                             req.payload.size()));
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    RestRequestRouter::OnProcessRequest ingestJsonRows
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                ingestRows(connection, cxt,
+                           jsonDecodeStr<IngestionQueue::Rows>(req.payload));
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    manager.valueNode->addRoute("/ingest",
+                                { "POST", "header:content-type="
+                                  + std::string(MSGPACK_MIME_TYPE) },
+                                "Queue many rows, encoded in MessagePack, "
+                                "to be recorded into the dataset",
+                                ingestMsgPackRows, Json::Value());
+
+    manager.valueNode->addRoute("/ingest", { "POST" },
+                                "Queue many rows to be recorded into the "
+                                "dataset, in the format of /multirows",
+                                ingestJsonRows, Json::Value());
+
+    RestRequestRouter::OnProcessRequest flushIngestion
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                auto collection = static_cast<DatasetCollection *>
+                    (manager.getCollection(cxt));
+                collection->flushIngestion(getDataset(cxt));
+                connection.sendResponse(200);
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    manager.valueNode->addRoute("/ingest/flush", { "POST" },
+                                "Wait for the queued rows to be recorded",
+                                flushIngestion, Json::Value());
+
+    RestRequestRouter::OnProcessRequest getIngestionStats
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                auto collection = static_cast<DatasetCollection *>
+                    (manager.getCollection(cxt));
+                auto queue = collection->getIngestionQueue
+                    (std::static_pointer_cast<Dataset>
+                     (cxt.getSharedPtrAs<PolyEntity>(2)));
+                connection.sendResponse(200, jsonEncode(queue->getStats()));
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+            return RestRequestRouter::MR_YES;
+        };
+
+    manager.valueNode->addRoute("/ingest", { "GET" },
+                                "Get the state of the ingestion queue",
+                                getIngestionStats, Json::Value());
+
     auto & row MLDB_UNUSED
         = rows.addSubRouter(Rx("/([0-9a-z]{16})", "/<rowHash>"),
                             "operations on an individual row");
@@ -466,14 +764,11 @@ initRoutes(RouteManager & manager)
                 auto dataset = std::static_pointer_cast<Dataset>
                     (cxt.getSharedPtrAs<PolyEntity>(2));
 
-                auto index = dataset->getColumnIndex();
-
-                ColumnStats columnStatsStorage;
-                auto stats = index->getColumnStats(ColumnPath(cxt.resources.at(6)),
-                                                   columnStatsStorage);
+                auto stats = dataset->getCachedColumnStats
+                    (ColumnPath(cxt.resources.at(6)));
 
                 vector<CellValue> result;
-                for (auto & v: stats.values)
+                for (auto & v: stats->values)
                     result.emplace_back(v.first);
 
                 connection.sendHttpResponse(200, jsonEncodeStr(result),
@@ -505,6 +800,13 @@ initRoutes(RouteManager & manager)
                                                      "Maximum number to return",
                                                      -1));
 
+    addRouteSyncJsonReturn(column, "/summary", { "GET" },
+                           "Get a summary of the values of a column",
+                           "Row count, distinct values and range of the column",
+                           &Dataset::getColumnSummary,
+                           getDataset,
+                           columnParam);
+
     // Make the plugin handle a route
     RestRequestRouter::OnProcessRequest handlePluginRoute
         = [=] (RestConnection & connection,
@@ -534,6 +836,66 @@ initRoutes(RouteManager & manager)
 
 }
 
+/// Rows that can be queued for a dataset before posts are refused
+static EnvOption<size_t> INGESTION_QUEUE_ROWS("MLDB_INGESTION_QUEUE_ROWS",
+                                              1000000);
+
+/// Largest batch recorded at once from an ingestion queue
+static EnvOption<size_t> INGESTION_BATCH_ROWS("MLDB_INGESTION_BATCH_ROWS",
+                                              65536);
+
+std::shared_ptr<IngestionQueue>
+DatasetCollection::
+getIngestionQueue(const std::shared_ptr<Dataset> & dataset)
+{
+    // Queues of datasets that have gone are destroyed outside of the lock,
+    // as that waits for their writer thread
+    std::vector<std::shared_ptr<IngestionQueue> > expired;
+    std::unique_lock<std::mutex> guard(ingestionMutex);
+
+    for (auto it = ingestionQueues.begin();  it != ingestionQueues.end();) {
+        if (it->second.dataset.expired()) {
+            expired.emplace_back(std::move(it->second.queue));
+            it = ingestionQueues.erase(it);
+        }
+        else ++it;
+    }
+
+    IngestionEntry & entry = ingestionQueues[dataset.get()];
+    if (!entry.queue) {
+        std::weak_ptr<Dataset> weak = dataset;
+        entry.dataset = weak;
+        entry.queue = std::make_shared<IngestionQueue>
+            ([weak] (const IngestionQueue::Rows & rows)
+             {
+                 auto dataset = weak.lock();
+                 if (!dataset)
+                     throw MLDB::Exception("Dataset was deleted before its "
+                                           "queued rows were recorded");
+                 dataset->recordRows(rows);
+             },
+             INGESTION_QUEUE_ROWS, INGESTION_BATCH_ROWS);
+    }
+    auto result = entry.queue;
+    guard.unlock();
+    return result;
+}
+
+void
+DatasetCollection::
+flushIngestion(const Dataset * dataset)
+{
+    std::shared_ptr<IngestionQueue> queue;
+    {
+        std::unique_lock<std::mutex> guard(ingestionMutex);
+        auto it = ingestionQueues.find(dataset);
+        if (it == ingestionQueues.end())
+            return;
+        queue = it->second.queue;
+    }
+    queue->flush();
+}
+
 std::vector<std::pair<CellValue, int64_t> >
 DatasetCollection::
 getColumnValueCounts(const Dataset * dataset,
@@ -541,13 +903,10 @@ getColumnValueCounts(const Dataset * dataset,
                      ssize_t offset,
                      ssize_t limit) const
 {
-    auto index = dataset->getColumnIndex();
-
-    ColumnStats columnStatsStorage;
-    auto stats = index->getColumnStats(columnName, columnStatsStorage);
+    auto stats = dataset->getCachedColumnStats(columnName);
 
     vector<pair<CellValue, int64_t> > result;
-    for (auto & v: stats.values)
+    for (auto & v: stats->values)
         result.emplace_back(v.first, v.second.rowCount());
 
     return result;
@@ -11,6 +11,8 @@
 
 #include "mldb/core/dataset.h"
 #include "mldb/rest/poly_collection.h"
+#include <map>
+#include <mutex>
 
 
 
@@ -18,6 +20,8 @@ struct RestConnection;
 
 namespace MLDB {
 
+struct IngestionQueue;
+
 
 /** Run a query (by calling the given function) and format and return the
     results in HTTP based upon the given flag.
@@ -34,6 +38,23 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool rowNames,
                   bool rowHashes,
                   bool sortColumns);
+
+/** Same as runHttpQuery, but the output is streamed back as the rows are
+    produced, using HTTP chunked transfer encoding.  The runQuery function
+    must call the function it's given with each output row, in order.
+    Sending blocks while the client is slow to read, which holds back the
+    query.
+
+    The full, sparse and aos formats are streamed.  The others need all of
+    the rows before any can be output, and so are buffered.
+*/
+void runHttpQueryStreaming(std::function<void (const std::function<bool (NamedRowValue &)> &)> runQuery,
+                           RestConnection & connection,
+                           const std::string & format,
+                           bool createHeaders,
+                           bool rowNames,
+                           bool rowHashes,
+                           bool sortColumns);
                       
 
 /*****************************************************************************/
@@ -71,6 +92,26 @@ struct DatasetCollection: public PolyCollection<Dataset> {
                     bool rowNames,
                     bool rowHashes,
                     bool sortColumns) const;
+
+    /** Return the queue through which rows are recorded asynchronously
+        into the dataset, creating it the first time.
+    */
+    std::shared_ptr<IngestionQueue>
+    getIngestionQueue(const std::shared_ptr<Dataset> & dataset);
+
+    /** Wait for the rows queued for the dataset to be recorded (see
+        IngestionQueue::flush()).  Does nothing if none ever were.
+    */
+    void flushIngestion(const Dataset * dataset);
+
+private:
+    struct IngestionEntry {
+        std::weak_ptr<Dataset> dataset;
+        std::shared_ptr<IngestionQueue> queue;
+    };
+
+    std::mutex ingestionMutex;
+    std::map<const Dataset *, IngestionEntry> ingestionQueues;
 };
 
 extern template class PolyCollection<Dataset>;
@@ -14,6 +14,7 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/sql_expression_operations.h"
 
 using namespace std;
 
@@ -78,7 +79,48 @@ doGetFunction(const Utf8String & tableName,
             bool isConst = constantArgs && applier->info.deterministic;
             auto outputInfo = applier->info.output->getConst(isConst);
 
-            return BoundFunction(exec, outputInfo);
+            BoundFunction result(exec, outputInfo);
+
+            if (args.empty())
+                return result;
+
+            // When called from a function call expression, give the function
+            // a chance to be bound inline into the calling expression.  The
+            // applier above has already checked the call, so errors are the
+            // same either way.
+            result.bindFunction
+                = [=] (SqlBindingScope & scope,
+                       std::vector<BoundSqlExpression> & boundArgs,
+                       const SqlExpression * expr)
+                -> BoundSqlExpression
+                {
+                    auto call
+                        = dynamic_cast<const FunctionCallExpression *>(expr);
+                    if (call && call->args.size() == 1
+                        && boundArgs.size() == 1) {
+                        BoundSqlExpression inlined
+                            = fn->bindInline(scope, call->args[0],
+                                             boundArgs[0]);
+                        if (inlined)
+                            return inlined;
+                    }
+
+                    return {[=] (const SqlRowScope & row,
+                                 ExpressionValue & storage,
+                                 const VariableFilter & filter)
+                            -> const ExpressionValue &
+                            {
+                                std::vector<ExpressionValue> evaluatedArgs;
+                                evaluatedArgs.reserve(boundArgs.size());
+                                for (auto & a: boundArgs)
+                                    evaluatedArgs.emplace_back(a(row, GET_LATEST));
+                                return storage = exec(evaluatedArgs, row);
+                            },
+                            expr,
+                            outputInfo};
+                };
+
+            return result;
         }
     }
 
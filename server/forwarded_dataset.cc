@@ -119,6 +119,7 @@ commit()
 {
     ExcAssert(underlying);
     underlying->commit();
+    Dataset::commit();
 }
 
 std::vector<MatrixNamedRow>
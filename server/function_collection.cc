@@ -15,6 +15,8 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/map_description.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/metrics.h"
 
 
 
@@ -75,6 +77,12 @@ ExpressionValue
 Function::
 call(const ExpressionValue & input) const
 {
+    static MetricHistogram & callTimes
+        = Metrics::histogram("mldb_function_call_seconds",
+                             "Time taken by calls to functions made outside "
+                             "of queries, including binding the function");
+    MetricTimer timer(callTimes);
+
     SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
     
     auto info = this->getFunctionInfo();
@@ -227,11 +235,13 @@ applyBatch(const Function * function,
     if (outputFormat != "json") {
         throw HttpReturnException
             (400, "batch apply only accepts 'json' output format currently; got '"
-             + inputFormat + "'");
+             + outputFormat + "'");
     }
 
-    Utf8String str;
-    Utf8StringJsonPrintingContext printingContext(str);
+    if (inputs.isNull()) {
+        connection.sendResponse(200, inputs, "application/json");
+        return;
+    }
 
     SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
     
@@ -240,8 +250,9 @@ applyBatch(const Function * function,
     
     Date ts = Date::now();
 
-    auto doInput = [&] (const Json::Value & val)
+    auto doInput = [&] (const Json::Value & val, Utf8String & out)
         {
+            Utf8StringJsonPrintingContext printingContext(out);
             StructuredJsonParsingContext context(val);
             ExpressionValue inputExpr
                 = ExpressionValue::parseJson(context, ts);
@@ -250,33 +261,104 @@ applyBatch(const Function * function,
             output.extractJson(printingContext);
         };
 
-    if (inputs.isNull()) {
-        connection.sendResponse(200, inputs, "application/json");
+    if (!inputs.isArray() && !inputs.isObject()) {
+        Utf8String str;
+        doInput(inputs, str);
+        connection.sendResponse(200, str.stealRawString(), "application/json");
         return;
     }
-    else if (inputs.isArray()) {
-        printingContext.startArray(inputs.size());
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
-            printingContext.newArrayElement();
-            doInput(*it);
-        }
-        printingContext.endArray();
+
+    // The applier is bound once, and then the inputs are applied across
+    // the thread pool, each one into its own output which are put
+    // together at the end.
+    std::vector<const Json::Value *> elements;
+    std::vector<Utf8String> outputs(inputs.size());
+    elements.reserve(inputs.size());
+    for (auto it = inputs.begin(), end = inputs.end();  it != end;  ++it) {
+        elements.push_back(&*it);
     }
-    else if (inputs.isObject()) {
-        printingContext.startObject();
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
-            printingContext.startMember(it.memberName());
-            doInput(*it);
+
+    // Each chunk is applied in one call, so that functions which score a
+    // batch faster than one row at a time can do so.  If that fails, the
+    // chunk is redone one at a time to find which element it was.
+    auto doChunk = [&] (size_t begin, size_t end)
+        {
+            std::vector<ExpressionValue> chunkInputs, chunkOutputs(end - begin);
+            chunkInputs.reserve(end - begin);
+
+            try {
+                for (size_t i = begin;  i < end;  ++i) {
+                    StructuredJsonParsingContext context(*elements[i]);
+                    chunkInputs.emplace_back
+                        (ExpressionValue::parseJson(context, ts));
+                }
+
+                function->applyBatch(*applier, chunkInputs.data(),
+                                     chunkOutputs.data(), end - begin);
+
+                for (size_t i = begin;  i < end;  ++i) {
+                    Utf8StringJsonPrintingContext printingContext(outputs[i]);
+                    chunkOutputs[i - begin].extractJson(printingContext);
+                }
+                return;
+            } MLDB_CATCH_ALL {
+                for (size_t i = begin;  i < end;  ++i)
+                    outputs[i] = Utf8String();
+            }
+
+            for (size_t i = begin;  i < end;  ++i) {
+                try {
+                    doInput(*elements[i], outputs[i]);
+                } MLDB_CATCH_ALL {
+                    rethrowHttpException(KEEP_HTTP_CODE,
+                                         "Error applying function '"
+                                         + function->config_->id
+                                         + "' to batch element "
+                                         + std::to_string(i) + ": "
+                                         + getExceptionString(),
+                                         "index", i);
+                }
+            }
+        };
+
+    parallelMapChunked(0, elements.size(),
+                       parallelGrainSize(elements.size(), 16),
+                       doChunk);
+
+    size_t totalLength = 2;
+    for (auto & o: outputs)
+        totalLength += o.rawLength() + 1;
+
+    std::string str;
+    if (inputs.isArray()) {
+        str.reserve(totalLength);
+        str += '[';
+        for (size_t i = 0;  i < outputs.size();  ++i) {
+            if (i != 0)
+                str += ',';
+            str += outputs[i].rawString();
         }
-        printingContext.endObject();
+        str += ']';
     }
     else {
-        doInput(inputs);
+        str.reserve(totalLength);
+        str += '{';
+        size_t i = 0;
+        for (auto it = inputs.begin(), end = inputs.end();
+             it != end;  ++it, ++i) {
+            if (i != 0)
+                str += ',';
+            Utf8String key;
+            Utf8StringJsonPrintingContext keyContext(key);
+            keyContext.writeStringUtf8(Utf8String(it.memberName()));
+            str += key.rawString();
+            str += ':';
+            str += outputs[i].rawString();
+        }
+        str += '}';
     }
 
-    connection.sendResponse(200, str.stealRawString(), "application/json");
+    connection.sendResponse(200, std::move(str), "application/json");
 }
 
 void
@@ -333,7 +415,7 @@ initRoutes(RouteManager & manager)
         "like dates into the call. This is the default and currently the only "
         "value accepted.";
     
-    addRouteAsync(*manager.valueNode, "/batch", { "GET" },
+    addRouteAsync(*manager.valueNode, "/batch", { "GET", "POST" },
                   "Apply a function to each element of a given set of input values and return the output",
                   //"Output of all values or those selected in the keepValues parameter",
                   &FunctionCollection::applyBatch,
@@ -392,7 +474,22 @@ Any
 FunctionCollection::
 getEntityStatus(const Function & function) const
 {
-    return function.getStatus();
+    Json::Value cacheStats = function.getResultCacheStats();
+    if (cacheStats.isNull())
+        return function.getStatus();
+
+    // Put the result cache statistics alongside the function's own status
+    Any functionStatus = function.getStatus();
+    Json::Value status;
+    if (!functionStatus.empty())
+        status = functionStatus.asJson();
+    if (!status.isNull() && !status.isObject()) {
+        Json::Value wrapped;
+        wrapped["status"] = std::move(status);
+        status = std::move(wrapped);
+    }
+    status["resultCache"] = std::move(cacheStats);
+    return status;
 }
 
 std::shared_ptr<PolyEntity>
@@ -0,0 +1,264 @@
+/** ingestion_queue.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Queue of rows posted to a dataset, recorded in batches.
+*/
+
+#include "ingestion_queue.h"
+#include "mldb/base/metrics.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/structure_description.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* INGESTION QUEUE STATS                                                     */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(IngestionQueueStats);
+
+IngestionQueueStatsDescription::
+IngestionQueueStatsDescription()
+{
+    addField("queuedRows", &IngestionQueueStats::queuedRows,
+             "Number of rows that were accepted but haven't been recorded "
+             "yet");
+    addField("queuedRequests", &IngestionQueueStats::queuedRequests,
+             "Number of requests that those rows came in");
+    addField("maxQueuedRows", &IngestionQueueStats::maxQueuedRows,
+             "Number of queued rows above which requests are refused");
+    addField("acceptedRows", &IngestionQueueStats::acceptedRows,
+             "Number of rows accepted so far");
+    addField("rejectedRequests", &IngestionQueueStats::rejectedRequests,
+             "Number of requests refused because the queue was full");
+    addField("recordedRows", &IngestionQueueStats::recordedRows,
+             "Number of rows recorded into the dataset so far");
+    addField("batches", &IngestionQueueStats::batches,
+             "Number of batches those rows were recorded in");
+    addField("errors", &IngestionQueueStats::errors,
+             "Number of batches that failed to be recorded");
+    addField("lastError", &IngestionQueueStats::lastError,
+             "Error message of the last batch that failed");
+}
+
+
+/*****************************************************************************/
+/* INGESTION QUEUE                                                           */
+/*****************************************************************************/
+
+namespace {
+
+/// Rows queued over all datasets, for the gauge
+std::atomic<int64_t> totalQueuedRows(0);
+
+MetricCounter & acceptedMetric
+    = Metrics::counter("mldb_ingestion_rows_total",
+                       "Rows accepted into ingestion queues");
+MetricCounter & rejectedMetric
+    = Metrics::counter("mldb_ingestion_rejected_total",
+                       "Requests refused because their ingestion queue "
+                       "was full");
+MetricCounter & batchesMetric
+    = Metrics::counter("mldb_ingestion_batches_total",
+                       "Batches recorded from ingestion queues");
+MetricCounter & errorsMetric
+    = Metrics::counter("mldb_ingestion_errors_total",
+                       "Batches from ingestion queues that failed to be "
+                       "recorded");
+MetricHistogram & latencyMetric
+    = Metrics::histogram("mldb_ingestion_latency_seconds",
+                         "Time from the acceptance of rows into an "
+                         "ingestion queue until they were recorded");
+MetricHistogram & batchTimeMetric
+    = Metrics::histogram("mldb_ingestion_batch_seconds",
+                         "Time taken to record a batch from an ingestion "
+                         "queue");
+std::shared_ptr<void> queuedRowsMetric
+    = Metrics::addCallback("mldb_ingestion_queued_rows",
+                           "Rows accepted into ingestion queues that have "
+                           "not been recorded yet",
+                           [] () -> double { return totalQueuedRows; });
+
+} // file scope
+
+IngestionQueue::
+IngestionQueue(std::function<void (const Rows &)> record,
+               size_t maxQueuedRows,
+               size_t maxBatchRows)
+    : record(std::move(record)),
+      maxQueuedRows(maxQueuedRows),
+      maxBatchRows(std::max<size_t>(maxBatchRows, 1))
+{
+    stats.maxQueuedRows = maxQueuedRows;
+}
+
+IngestionQueue::
+~IngestionQueue()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        shutdown = true;
+    }
+    wakeup.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+bool
+IngestionQueue::
+enqueue(Rows rows)
+{
+    size_t numRows = rows.size();
+    if (numRows == 0)
+        return true;
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (stats.queuedRows > 0
+            && stats.queuedRows + numRows > maxQueuedRows) {
+            ++stats.rejectedRequests;
+            rejectedMetric.add();
+            return false;
+        }
+
+        queue.push_back({ std::move(rows), Date::now() });
+        ++numQueued;
+        stats.queuedRows += numRows;
+        stats.acceptedRows += numRows;
+        if (!thread.joinable())
+            thread = std::thread(&IngestionQueue::run, this);
+    }
+
+    totalQueuedRows += numRows;
+    acceptedMetric.add(numRows);
+    wakeup.notify_one();
+    return true;
+}
+
+void
+IngestionQueue::
+flush()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    uint64_t target = numQueued;
+    recorded.wait(guard, [&] () { return numDone >= target; });
+
+    if (error) {
+        std::exception_ptr toThrow = error;
+        error = nullptr;
+        std::rethrow_exception(toThrow);
+    }
+}
+
+double
+IngestionQueue::
+retryAfterSeconds() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    // Until a batch has been recorded, there's nothing to go on
+    if (stats.recordedRows == 0 || recordSeconds <= 0)
+        return 1.0;
+
+    // Time to record enough of the queue to make room for a request of
+    // average size
+    double rowsPerSecond = stats.recordedRows / recordSeconds;
+    double requestRows = stats.acceptedRows / std::max<double>(numQueued, 1);
+    double excess = std::max<double>(0, stats.queuedRows + requestRows
+                                     - maxQueuedRows);
+    return excess / rowsPerSecond;
+}
+
+IngestionQueueStats
+IngestionQueue::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    IngestionQueueStats result = stats;
+    result.queuedRequests = numQueued - numDone;
+    return result;
+}
+
+void
+IngestionQueue::
+run()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    for (;;) {
+        wakeup.wait(guard, [&] () { return shutdown || !queue.empty(); });
+        if (queue.empty())
+            return;  // shut down, with nothing left to record
+
+        // Take what's queued, up to the batch size, keeping the order in
+        // which the requests were accepted
+        Rows batch;
+        std::vector<Date> accepted;
+        while (!queue.empty()
+               && (accepted.empty()
+                   || batch.size() + queue.front().rows.size()
+                      <= maxBatchRows)) {
+            Request & request = queue.front();
+            if (batch.empty())
+                batch = std::move(request.rows);
+            else batch.insert(batch.end(),
+                              std::make_move_iterator(request.rows.begin()),
+                              std::make_move_iterator(request.rows.end()));
+            accepted.push_back(request.accepted);
+            queue.pop_front();
+        }
+
+        guard.unlock();
+
+        Date before = Date::now();
+        std::exception_ptr batchError;
+        try {
+            record(batch);
+        } catch (...) {
+            batchError = std::current_exception();
+        }
+        Date after = Date::now();
+
+        double seconds = after.secondsSinceEpoch() - before.secondsSinceEpoch();
+        batchTimeMetric.record(seconds);
+        batchesMetric.add();
+        for (auto & a: accepted)
+            latencyMetric.record(after.secondsSinceEpoch()
+                                 - a.secondsSinceEpoch());
+        totalQueuedRows -= batch.size();
+
+        guard.lock();
+
+        stats.queuedRows -= batch.size();
+        ++stats.batches;
+        recordSeconds += seconds;
+        if (batchError) {
+            ++stats.errors;
+            errorsMetric.add();
+            try {
+                std::rethrow_exception(batchError);
+            } catch (const std::exception & exc) {
+                stats.lastError = exc.what();
+            } catch (...) {
+                stats.lastError = "unknown exception";
+            }
+            if (!error)
+                error = batchError;
+        }
+        else stats.recordedRows += batch.size();
+
+        numDone += accepted.size();
+        recorded.notify_all();
+    }
+}
+
+} // namespace MLDB
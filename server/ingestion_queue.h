@@ -0,0 +1,130 @@
+/** ingestion_queue.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Queue of rows that were posted to a dataset and accepted, but that have
+    not been recorded yet.  A writer thread takes everything that is queued
+    and records it with a single call, so that many small posts from many
+    connections are recorded as a few large batches (group commit).
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include "mldb/types/date.h"
+#include "mldb/types/value_description_fwd.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* INGESTION QUEUE STATS                                                     */
+/*****************************************************************************/
+
+struct IngestionQueueStats {
+    uint64_t queuedRows = 0;        ///< Rows accepted but not yet recorded
+    uint64_t queuedRequests = 0;    ///< Requests those rows came in
+    uint64_t maxQueuedRows = 0;     ///< Rows above which requests are refused
+    uint64_t acceptedRows = 0;      ///< Rows accepted so far
+    uint64_t rejectedRequests = 0;  ///< Requests refused as the queue was full
+    uint64_t recordedRows = 0;      ///< Rows recorded so far
+    uint64_t batches = 0;           ///< Batches they were recorded in
+    uint64_t errors = 0;            ///< Batches that failed to be recorded
+    std::string lastError;          ///< Error of the last batch that failed
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(IngestionQueueStats);
+
+
+/*****************************************************************************/
+/* INGESTION QUEUE                                                           */
+/*****************************************************************************/
+
+/** Rows accepted for a dataset, which a background thread records in
+    batches of up to maxBatchRows.  While a batch is being recorded, the
+    requests that come in accumulate, so the busier the dataset is the
+    bigger its batches get.
+
+    The number of rows that can be waiting is bounded by maxQueuedRows;
+    past that, requests are refused, so that clients that post faster than
+    the dataset can record are told to slow down instead of using up the
+    memory.
+
+    All methods are thread safe.
+*/
+
+struct IngestionQueue {
+
+    typedef std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > Rows;
+
+    /** Create a queue whose rows are recorded by calling record.  The
+        thread is only started once the first rows are queued.
+    */
+    IngestionQueue(std::function<void (const Rows &)> record,
+                   size_t maxQueuedRows,
+                   size_t maxBatchRows);
+
+    /** Records what's queued, then stops the thread. */
+    ~IngestionQueue();
+
+    IngestionQueue(const IngestionQueue &) = delete;
+    void operator = (const IngestionQueue &) = delete;
+
+    /** Queue the rows to be recorded.  Returns false, without queueing
+        them, if they would take the queue over maxQueuedRows.  A request
+        that is bigger than that on its own is accepted when the queue is
+        empty, so that it can get through.
+    */
+    bool enqueue(Rows rows);
+
+    /** Wait until the rows that were queued before the call have been
+        recorded.  If a batch has failed to be recorded since the last
+        call, its exception is thrown, since the client whose rows they
+        were has already been told that they were accepted.
+    */
+    void flush();
+
+    /** Estimate of the number of seconds until there is room in the
+        queue, from the rate at which rows have been recorded.  This is
+        sent along with refusals as a hint of when to try again.
+    */
+    double retryAfterSeconds() const;
+
+    IngestionQueueStats getStats() const;
+
+private:
+    void run();
+
+    struct Request {
+        Rows rows;
+        Date accepted;
+    };
+
+    std::function<void (const Rows &)> record;
+    size_t maxQueuedRows;
+    size_t maxBatchRows;
+
+    mutable std::mutex mutex;              ///< Protects everything below
+    std::condition_variable wakeup;        ///< Signals the writer thread
+    std::condition_variable recorded;      ///< Signals those in flush()
+    std::deque<Request> queue;
+    IngestionQueueStats stats;
+    uint64_t numQueued = 0;                ///< Requests queued so far
+    uint64_t numDone = 0;                  ///< Requests recorded (or failed)
+    size_t rowsInFlight = 0;               ///< Rows of the current batch
+    double recordSeconds = 0;              ///< Time spent recording so far
+    std::exception_ptr error;              ///< First error since flush()
+    bool shutdown = false;
+    std::thread thread;
+};
+
+} // namespace MLDB
@@ -13,6 +13,7 @@
 #include "mldb/http/http_rest_proxy.h"
 #include "mldb/server/credential_collection.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/uri_cache.h"
 #include "mldb/utils/config.h"
 #include "mldb/soa/credentials/credential_provider.h"
 #include "mldb/soa/credentials/credentials.h"
@@ -25,6 +26,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/exception/diagnostic_information.hpp> 
 #include <signal.h>
+#include <algorithm>
 
 
 using namespace std;
@@ -85,6 +87,7 @@ int main(int argc, char ** argv)
     options_description plugin_options("Plugin options");
 
     int numThreads(16);
+    int numHttpAcceptors(1);
     // Defaults for operational characteristics
     string httpListenPort = "11700-18000";
     string httpListenHost = "0.0.0.0";
@@ -92,6 +95,9 @@ int main(int argc, char ** argv)
     bool dontExitAfterScript = false;
 
     string cacheDir;
+    uint64_t uriCacheSizeMb = 0;
+    uint64_t queryCacheSizeMb = 0;
+    uint64_t queryMemoryBudgetMb = 0;
     string httpBaseUrl = "";
 
 #if 0
@@ -116,8 +122,13 @@ int main(int argc, char ** argv)
     string addCredentialsFromUrl;
     std::string credentialsPath;
 
+    // Where to persist the configuration of persistent entities
+    std::string entitiesPath;
+    bool lazyLoadEntities = false;
+
     // List of directories to scan for plugins
     vector<string> pluginDirectory;
+    bool eagerPlugins = false;
 
     bool muteFinalOutput = false;
 
@@ -129,6 +140,11 @@ int main(int argc, char ** argv)
          "Base path in etcd")
 #endif
         ("num-threads,t", value(&numThreads), "Number of HTTP worker threads")
+        ("http-acceptors",
+         value(&numHttpAcceptors)->default_value(numHttpAcceptors),
+         "Number of HTTP acceptors, each with its own event loop thread, "
+         "sharing the listening port with SO_REUSEPORT.  Requests are "
+         "handled on the thread of the acceptor of their connection.")
         ("http-listen-port,p",
          value(&httpListenPort)->default_value(httpListenPort),
          "Port to listen on for HTTP")
@@ -143,6 +159,18 @@ int main(int argc, char ** argv)
          "directory to serve documentation from")
         ("cache-dir", value(&cacheDir),
          "Cache directory to memory map large files and store downloads")
+        ("uri-cache-size", value(&uriCacheSizeMb),
+         "Maximum size in megabytes of the local copies of remote files "
+         "(s3, http, ...) kept under the cache directory.  The default of "
+         "0 disables the cache.")
+        ("query-cache-size", value(&queryCacheSizeMb),
+         "Maximum memory in megabytes used to cache the responses of "
+         "/v1/query, which are reused until a dataset changes.  The "
+         "default of 0 disables the cache.")
+        ("query-memory-budget", value(&queryMemoryBudgetMb),
+         "Maximum memory in megabytes that a call to /v1/query can hold "
+         "before it fails; the maxMemory parameter overrides it.  The "
+         "default of 0 means no limit.")
 
 #if 0
         ("peer-listen-port,l",
@@ -162,6 +190,13 @@ int main(int argc, char ** argv)
          value(&configPath),
          "Path to the mldb configuration.  This is optional. Configuration option "
          "in that file have acceptable default values.")
+        ("entities-path", value(&entitiesPath),
+         "Path in which to store the configuration of the datasets, "
+         "procedures, functions and plugins created with persistent: true, "
+         "which are recreated from it in the background on startup")
+        ("lazy-load-entities", bool_switch(&lazyLoadEntities),
+         "Only recreate each entity from --entities-path once it's first "
+         "used, instead of all of them on startup")
         ("credentials-path,c", value(&credentialsPath),
          "Path in which to store saved credentials and rules "
          "(file:// for filesystem or s3:// for S3 uri)")
@@ -194,7 +229,10 @@ int main(int argc, char ** argv)
     plugin_options.add_options()
         ("plugin-directory", value(&pluginDirectory),
          "URL of directory to scan for plugins (can be added multiple times). "
-         "Don't forget file://.");
+         "Don't forget file://.")
+        ("eager-plugins", bool_switch(&eagerPlugins),
+         "Load all plugins on startup, rather than waiting for the first use "
+         "of one of the types that their manifest says they provide");
 
     options_description all_opt;
     all_opt
@@ -240,6 +278,11 @@ int main(int argc, char ** argv)
         exit(1);
     }
 
+    if (uriCacheSizeMb > 0 && cacheDir.empty()) {
+        cerr << "'uri-cache-size' requires 'cache-dir' to be set" << endl;
+        exit(1);
+    }
+
     // Add these first so that if needed they can be used to load the credentials
     // file
     if (!addCredentials.empty()) {
@@ -316,6 +359,8 @@ int main(int argc, char ** argv)
     bool hideInternalEntities = vm.count("hide-internal-entities");
 
     MldbServer server("mldb", etcdUri, etcdPath, enableAccessLog, httpBaseUrl);
+    if (!entitiesPath.empty())
+        server.setEntityConfigStore(entitiesPath, lazyLoadEntities);
     bool initSuccess = server.init(credentialsPath, staticAssetsPath,
                                    staticDocPath, hideInternalEntities);
 
@@ -325,14 +370,24 @@ int main(int argc, char ** argv)
         // Set up the SSD cache, if configured
         if (!cacheDir.empty()) {
             server.setCacheDirectory(cacheDir);
+            if (uriCacheSizeMb > 0) {
+                setUriCache(cacheDir + "/uris", uriCacheSizeMb * 1000000);
+            }
+        }
+
+        if (queryCacheSizeMb > 0) {
+            server.setQueryCacheSize(queryCacheSizeMb * 1000000);
         }
 
+        server.setQueryMemoryBudget(queryMemoryBudgetMb * 1000000);
+
         // Scan each of our plugin directories
         for (auto & d: pluginDirectory) {
-            server.scanPlugins(d);
+            server.scanPlugins(d, !eagerPlugins /* lazy */);
         }
     }
 
+    server.httpEndpoint->numAcceptors = std::max(1, numHttpAcceptors);
     server.httpBoundAddress = server.bindTcp(httpListenPort, httpListenHost);
     server.router.addAutodocRoute("/autodoc", "/v1/help", "autodoc");
     server.threadPool->ensureThreads(numThreads);
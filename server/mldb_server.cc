@@ -22,6 +22,7 @@
 #include "mldb/server/plugin_resource.h"
 #include "mldb/sql/sql_expression.h"
 #include <signal.h>
+#include <mutex>
 
 #include "mldb/server/dataset_collection.h"
 #include "mldb/server/plugin_collection.h"
@@ -32,9 +33,23 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/server/analytics.h"
+#include "mldb/server/query_cache.h"
+#include "mldb/sql/query_profile.h"
+#include "mldb/arch/sampling_profiler.h"
+#include "mldb/base/trace_events.h"
+#include "mldb/base/metrics.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/arch/simd.h"
+#include "mldb/base/cancellation.h"
+#include "mldb/base/memory_account.h"
+#include "mldb/jml/utils/environment.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/rest/remote_peer.h"
+#include "mldb/types/vector_description.h"
+#include <future>
+#include <random>
+#include <algorithm>
 
 
 using namespace std;
@@ -50,6 +65,10 @@ bool supportsSystemRequirements() {
     return true;
 #endif
 }
+/// Number of parsed query statements kept so that they needn't be parsed
+/// again when the same query is repeated
+EnvOption<size_t> STATEMENT_CACHE_ENTRIES("MLDB_STATEMENT_CACHE_ENTRIES", 1024);
+
 } // file scope
 
 
@@ -87,6 +106,10 @@ MldbServer(const std::string & serviceName,
     : ServicePeer(serviceName, "MLDB", "global", enableAccessLog),
       EventRecorder(serviceName, std::make_shared<NullEventService>()),
       httpBaseUrl(httpBaseUrl), versionNode(nullptr),
+      statementCache(std::make_shared<StatementCache>
+                     (STATEMENT_CACHE_ENTRIES)),
+      queryMemoryBudget(0),
+      lazyEntityLoading(false),
       logger(getMldbLog<MldbServer>())
 {
     // Don't allow URIs without a scheme
@@ -155,6 +178,21 @@ initRoutes()
                     serviceInfoRoute,
                     Json::Value());
 
+    RestRequestRouter::OnProcessRequest metricsRoute
+        = [=] (RestConnection & connection,
+               const RestRequest & request,
+               const RestRequestParsingContext & context) {
+        connection.sendResponse(200, Metrics::prometheusText(),
+                                "text/plain; version=0.0.4");
+        return RestRequestRouter::MR_YES;
+    };
+
+    router.addRoute("/metrics", "GET",
+                    "Return the metrics of the server in the Prometheus "
+                    "text format",
+                    metricsRoute,
+                    Json::Value());
+
     // Push our this pointer in to make sure that it's available to sub
     // routes
     auto addObject = [=] (RestConnection & connection,
@@ -203,7 +241,9 @@ initRoutes()
             HybridParamDefault<Utf8String>("q", queryStringDef, ""),
             PassConnectionId(),
             HybridParamDefault<std::string>("format",
-                                            "Format of output",
+                                            "Format of output: full, sparse, "
+                                            "soa, aos, table, atom, arrow "
+                                            "or arrow-file",
                                             "full"),
             HybridParamDefault<bool>("headers",
                                      "Do we include headers on table format",
@@ -216,7 +256,74 @@ initRoutes()
                                      false),
             HybridParamDefault<bool>("sortColumns",
                                      "Do we sort the column names",
-                                     false));
+                                     false),
+            HybridParamDefault<bool>("cache",
+                                     "Can the response come from (and go "
+                                     "into) the query cache, if it's "
+                                     "enabled",
+                                     true),
+            HybridParamDefault<double>("timeout",
+                                       "Maximum number of seconds to spend "
+                                       "running the query, after which it "
+                                       "fails with a 504 error.  Zero means "
+                                       "no limit",
+                                       0.0),
+            HybridParamDefault<bool>("explain",
+                                     "Instead of returning the rows, run "
+                                     "the query and return the tree of "
+                                     "its elements with the rows that "
+                                     "went through each and the time "
+                                     "spent in each",
+                                     false),
+            HybridParamDefault<uint64_t>("maxMemory",
+                                         "Maximum number of bytes of "
+                                         "memory that the query can hold, "
+                                         "after which it fails with a 507 "
+                                         "error.  Zero means the default "
+                                         "of the server",
+                                         0));
+
+        addRouteSyncJsonReturn(versionNode, "/queryCache", { "GET" },
+                               "Get the statistics of the query cache",
+                               "Statistics of the query cache",
+                               &MldbServer::getQueryCacheStats,
+                               this);
+
+        addRouteSync(versionNode, "/queryCache", { "DELETE" },
+                     "Empty the query cache",
+                     &MldbServer::clearQueryCache,
+                     this);
+
+        addRouteSyncJsonReturn(versionNode, "/debug/queries", { "GET" },
+                               "List the queries and procedure runs in "
+                               "progress with the memory that they hold",
+                               "List of queries and procedure runs",
+                               &MldbServer::getRunningQueries,
+                               this);
+
+        addRouteAsync(
+            versionNode, "/debug/profile", { "GET" },
+            "Sample the stacks of the running threads and return them "
+            "as collapsed stacks for a flame graph",
+            &MldbServer::runSamplingProfile, this,
+            PassConnectionId(),
+            HybridParamDefault<double>("seconds",
+                                       "Number of seconds to sample for",
+                                       10.0),
+            HybridParamDefault<int>("frequency",
+                                    "Number of samples per second of CPU "
+                                    "time",
+                                    99));
+
+        addRouteAsync(
+            versionNode, "/debug/trace", { "GET" },
+            "Record what each thread does for a while and return it as "
+            "Chrome trace events, for chrome://tracing or Perfetto",
+            &MldbServer::runTrace, this,
+            PassConnectionId(),
+            HybridParamDefault<double>("seconds",
+                                       "Number of seconds to record for",
+                                       10.0));
 
         addRouteAsync(
             versionNode, "/redirect/get", {"POST"}, "Redirect POST as GET with body. "
@@ -258,19 +365,188 @@ runHttpQuery(const Utf8String& query,
              bool createHeaders,
              bool rowNames,
              bool rowHashes,
-             bool sortColumns) const
+             bool sortColumns,
+             bool useCache,
+             double timeout,
+             bool explain,
+             uint64_t maxMemory) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    auto stmPtr = statementCache->get(query);
+    const SelectStatement & stm = *stmPtr;
     SqlExpressionMldbScope mldbContext(this);
-
-    auto runQuery = [&] ()
+    SamplingProfiler::Activity activity("query " + query.rawString());
+
+    static MetricHistogram & queryTimes
+        = Metrics::histogram("mldb_query_duration_seconds",
+                             "Time taken to answer calls to the query API");
+    MetricTimer timer(queryTimes);
+
+    // Stop working on the query once it runs out of time or the client
+    // goes away
+    CancellationToken cancellation(currentCancellationToken());
+    if (timeout > 0)
+        cancellation.setTimeout(timeout);
+    cancellation.setPoll([&] () { return connection.isConnected(); });
+    CancellationScope cancellationScope(&cancellation);
+
+    // Account for the memory that it holds, so that it can be stopped
+    // before it takes the whole server down
+    MemoryAccount account("query " + query.rawString(),
+                          maxMemory ? maxMemory : queryMemoryBudget);
+    MemoryAccountScope accountScope(&account);
+
+    auto runQuery = [&] (const std::function<bool (NamedRowValue &)> & onRow)
         {
-            return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+            queryFromStatementStream(onRow, stm, mldbContext);
         };
 
-    MLDB::runHttpQuery(runQuery,
-                       connection, format, createHeaders,
-                       rowNames, rowHashes, sortColumns);
+    if (explain) {
+        QueryProfile profile("query");
+        {
+            QueryProfile::Scope scope(&profile);
+            QueryProfile::Timer timer(&profile);
+            auto onRow = [&] (NamedRowValue & row)
+                {
+                    profile.recordRowsOut(1);
+                    return true;
+                };
+            runQuery(onRow);
+        }
+        connection.sendResponse(200, profile.toJson());
+        return;
+    }
+
+    auto cache = queryCache;
+    if (!cache || !useCache) {
+        MLDB::runHttpQueryStreaming(runQuery,
+                                    connection, format, createHeaders,
+                                    rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    // The key is the normalized statement and everything that changes
+    // the way that the output is formatted.  The generation is taken
+    // before running the query, so that if it changes while the query is
+    // running the response isn't kept.
+    std::string key = stm.print().rawString() + "\n" + format
+        + "\n" + std::to_string(createHeaders) + std::to_string(rowNames)
+        + std::to_string(rowHashes) + std::to_string(sortColumns);
+    uint64_t generation = Dataset::getGlobalGeneration();
+
+    auto cached = cache->get(key, generation);
+    if (cached) {
+        connection.sendResponse(200, cached->body, cached->contentType);
+        return;
+    }
+
+    // Run the query into a buffer, so that the response can be kept
+    InProcessRestConnection buffer;
+    MLDB::runHttpQueryStreaming(runQuery,
+                                buffer, format, createHeaders,
+                                rowNames, rowHashes, sortColumns);
+
+    if (buffer.responseCode != 200) {
+        connection.sendResponse(buffer.responseCode, buffer.response,
+                                buffer.contentType);
+        return;
+    }
+
+    auto response = std::make_shared<QueryCache::Response>();
+    response->body = std::move(buffer.response);
+    response->contentType = std::move(buffer.contentType);
+    cache->put(key, generation, response);
+
+    connection.sendResponse(200, response->body, response->contentType);
+}
+
+void
+MldbServer::
+setQueryCacheSize(size_t maxBytes)
+{
+    if (maxBytes == 0)
+        queryCache.reset();
+    else queryCache = std::make_shared<QueryCache>(maxBytes);
+}
+
+QueryCacheStats
+MldbServer::
+getQueryCacheStats() const
+{
+    auto cache = queryCache;
+    if (!cache)
+        return QueryCacheStats();
+    return cache->getStats();
+}
+
+void
+MldbServer::
+clearQueryCache()
+{
+    auto cache = queryCache;
+    if (cache)
+        cache->clear();
+}
+
+void
+MldbServer::
+setEntityConfigStore(const std::string & path, bool lazy)
+{
+    entityConfigPath = path;
+    lazyEntityLoading = lazy;
+}
+
+void
+MldbServer::
+setQueryMemoryBudget(uint64_t maxBytes)
+{
+    queryMemoryBudget = maxBytes;
+}
+
+Json::Value
+MldbServer::
+getRunningQueries() const
+{
+    Json::Value result(Json::arrayValue);
+    for (auto & info: MemoryAccount::running()) {
+        Json::Value entry;
+        entry["description"] = info.description;
+        entry["bytesUsed"] = info.bytesUsed;
+        entry["peakBytes"] = info.peakBytes;
+        entry["budget"] = info.budget;
+        entry["secondsRunning"] = info.secondsRunning;
+        result.append(entry);
+    }
+    return result;
+}
+
+void
+MldbServer::
+runSamplingProfile(RestConnection & connection,
+                   double seconds,
+                   int frequency) const
+{
+    std::string stacks;
+    try {
+        stacks = SamplingProfiler::collapsedStacks(seconds, frequency);
+    } catch (const std::exception & exc) {
+        throw HttpReturnException(400, exc.what(),
+                                  "seconds", seconds,
+                                  "frequency", frequency);
+    }
+    connection.sendResponse(200, std::move(stacks), "text/plain");
+}
+
+void
+MldbServer::
+runTrace(RestConnection & connection, double seconds) const
+{
+    std::string trace;
+    try {
+        trace = TraceEvents::record(seconds);
+    } catch (const std::exception & exc) {
+        throw HttpReturnException(400, exc.what(), "seconds", seconds);
+    }
+    connection.sendResponse(200, std::move(trace), "application/json");
 }
 
 void
@@ -281,6 +557,7 @@ handleRedirectToGet(RestConnection & connection,
                     const Json::Value & body) const
 {
     InProcessRestConnection redirectConnection;
+    redirectConnection.structuredResponse = true;
     HttpHeader redirectHeader;
     redirectHeader.verb = "GET";
     redirectHeader.resource = uri;
@@ -291,7 +568,9 @@ handleRedirectToGet(RestConnection & connection,
                              
     Json::Value redirectResponse;
     Json::Reader reader;
-    if (!reader.parse(redirectConnection.response, redirectResponse, false))
+    if (redirectConnection.hasJsonResponse)
+        redirectResponse = std::move(redirectConnection.jsonResponse);
+    else if (!reader.parse(redirectConnection.response, redirectResponse, false))
         throw HttpReturnException(500, "failed to parse the redirect call");
   
     if (200 > redirectConnection.responseCode || redirectConnection.responseCode >= 300)
@@ -305,10 +584,210 @@ std::vector<MatrixNamedRow>
 MldbServer::
 query(const Utf8String& query) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    auto stm = statementCache->get(query);
     SqlExpressionMldbScope mldbContext(this);
 
-    return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+    return queryFromStatement(*stm, mldbContext, nullptr /*onProgress*/);
+}
+
+std::vector<NamedRowValue>
+MldbServer::
+queryPeer(const std::string & peer,
+          const Utf8String & query,
+          double timeout)
+{
+    if (peer.empty() || peer == getLocalPeerName()) {
+        auto stm = statementCache->get(query);
+        SqlExpressionMldbScope mldbContext(this);
+        return std::get<0>(queryFromStatementExpr(*stm, mldbContext));
+    }
+
+    // The response and the error can both be signalled for the same
+    // message, so only the first one is kept.
+    auto promise = std::make_shared<std::promise<std::vector<std::string> > >();
+    auto done = std::make_shared<std::atomic<bool> >(false);
+
+    auto onResponse = [=] (PeerMessage && msg,
+                           std::vector<std::string> && payload)
+        {
+            if (!done->exchange(true))
+                promise->set_value(std::move(payload));
+        };
+
+    auto onError = [=] (PeerMessage && msg)
+        {
+            if (done->exchange(true))
+                return;
+            promise->set_exception
+                (std::make_exception_ptr
+                 (HttpReturnException(500, "Error sending query to peer: "
+                                      + msg.error,
+                                      "peer", peer)));
+        };
+
+    auto future = promise->get_future();
+
+    sendPeerMessage(peer, PRI_NORMAL, Date::now().plusSeconds(timeout),
+                    PEER_MESSAGE_LAYER, PEER_QUERY,
+                    { query.rawString() }, onResponse, onError);
+
+    if (future.wait_for(std::chrono::duration<double>(timeout))
+        != std::future_status::ready) {
+        throw HttpReturnException(504, "Timeout waiting for query on peer",
+                                  "peer", peer,
+                                  "query", query,
+                                  "timeout", timeout);
+    }
+
+    std::vector<std::string> payload = future.get();
+    if (payload.size() != 2)
+        throw HttpReturnException(500, "Invalid response to query from peer",
+                                  "peer", peer);
+    if (payload[0] != "ok")
+        throw HttpReturnException(400, "Error running query on peer: "
+                                  + payload[1],
+                                  "peer", peer,
+                                  "query", query);
+
+    return jsonDecodeStr<std::vector<NamedRowValue> >(payload[1]);
+}
+
+std::vector<NamedRowValue>
+MldbServer::
+queryReplicas(const std::vector<std::string> & peers,
+              const Utf8String & query,
+              double timeout)
+{
+    if (peers.empty())
+        throw HttpReturnException(400, "No replicas to run query on",
+                                  "query", query);
+
+    std::exception_ptr lastError;
+
+    for (auto & peer: rankReplicas(peers)) {
+        {
+            std::unique_lock<std::mutex> guard(replicaLoadMutex);
+            ++replicaLoad[peer];
+        }
+
+        auto done = [&] ()
+            {
+                std::unique_lock<std::mutex> guard(replicaLoadMutex);
+                --replicaLoad[peer];
+            };
+
+        try {
+            auto rows = queryPeer(peer, query, timeout);
+            done();
+            return rows;
+        } catch (const HttpReturnException & exc) {
+            done();
+            // The other replicas would fail the same way
+            if (exc.httpCode < 500)
+                throw;
+            lastError = std::current_exception();
+        } catch (...) {
+            done();
+            throw;
+        }
+    }
+
+    std::rethrow_exception(lastError);
+}
+
+std::vector<std::string>
+MldbServer::
+rankReplicas(const std::vector<std::string> & peers) const
+{
+    std::map<std::string, PeerStatus> statuses;
+    for (auto & s: getPeerStatuses())
+        statuses[s.peerName] = s;
+
+    struct Candidate {
+        bool connected;
+        double cost;
+        std::string peer;
+    };
+
+    std::vector<Candidate> candidates;
+    {
+        std::unique_lock<std::mutex> guard(replicaLoadMutex);
+        for (auto & p: peers) {
+            bool connected = true;
+            double latencyMs = 0.0;
+            if (!p.empty() && p != getLocalPeerName()) {
+                auto it = statuses.find(p);
+                connected = it != statuses.end() && it->second.state == PS_OK;
+                if (connected)
+                    latencyMs = std::max(0.0,
+                                         it->second.stats.ping.latestTimeMs);
+            }
+
+            auto it = replicaLoad.find(p);
+            int load = it == replicaLoad.end() ? 0 : it->second;
+
+            // Running a query takes at least a millisecond, even here
+            double cost = (load + 1) * (latencyMs + 1.0);
+            candidates.push_back({ connected, cost, p });
+        }
+    }
+
+    // Replicas that cost the same are used in turn
+    static thread_local std::mt19937 rng(std::random_device{}());
+    std::shuffle(candidates.begin(), candidates.end(), rng);
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [] (const Candidate & c1, const Candidate & c2)
+                     {
+                         if (c1.connected != c2.connected)
+                             return c1.connected;
+                         return c1.cost < c2.cost;
+                     });
+
+    std::vector<std::string> result;
+    for (auto & c: candidates)
+        result.emplace_back(std::move(c.peer));
+    return result;
+}
+
+void
+MldbServer::
+handlePeerMessage(RemotePeer * peer, PeerMessage && msg)
+{
+    if (msg.layer != PEER_MESSAGE_LAYER || msg.type != PEER_QUERY) {
+        ServicePeer::handlePeerMessage(peer, std::move(msg));
+        return;
+    }
+
+    // Peers stay in the collection until the server is shut down, so the
+    // pointer is still valid once the query has run.
+    auto sharedMsg = std::make_shared<PeerMessage>(std::move(msg));
+
+    auto job = [=] () noexcept
+        {
+            std::vector<std::string> response;
+            try {
+                if (sharedMsg->payload.size() != 1)
+                    throw HttpReturnException
+                        (400, "Query message must have one payload element");
+                auto rows = queryPeer("", sharedMsg->payload[0]);
+                response = { "ok", jsonEncodeStr(rows) };
+            } catch (const std::exception & exc) {
+                response = { "error", exc.what() };
+            } catch (...) {
+                response = { "error", "unknown exception" };
+            }
+
+            try {
+                sharedMsg->payload = std::move(response);
+                peer->sendResponse(std::move(*sharedMsg));
+            } catch (...) {
+                logger->error() << "couldn't send query response to peer "
+                                << peer->remotePeerInfo.peerName;
+            }
+        };
+
+    ThreadPool::instance().add(job);
 }
 
 Json::Value
@@ -365,10 +844,36 @@ initCollections(std::string credentialsPath,
     credentials = createCredentialCollection(this, *routeManager, makeCredentialStore());
     types = createTypeClassCollection(this, *routeManager);
 
-    plugins->loadConfig();
-    datasets->loadConfig();
-    procedures->loadConfig();
-    functions->loadConfig();
+    if (!entityConfigPath.empty()) {
+        if (entityConfigPath.find("://") == string::npos)
+            entityConfigPath = "file://" + entityConfigPath;
+        plugins->attachConfig(std::make_shared<S3CollectionConfigStore>
+                              (entityConfigPath + "/plugins"));
+        datasets->attachConfig(std::make_shared<S3CollectionConfigStore>
+                               (entityConfigPath + "/datasets"));
+        procedures->attachConfig(std::make_shared<S3CollectionConfigStore>
+                                 (entityConfigPath + "/procedures"));
+        functions->attachConfig(std::make_shared<S3CollectionConfigStore>
+                                (entityConfigPath + "/functions"));
+    }
+
+    // Plugins come first, as they register the types of the others.  All
+    // of the other entities are registered before any is started, so that
+    // each can wait for those it depends on, and are then recreated in
+    // parallel in the background.
+    plugins->registerConfig();
+    plugins->startDeferredJobs();
+    plugins->waitForDeferredJobs();
+
+    datasets->registerConfig();
+    procedures->registerConfig();
+    functions->registerConfig();
+
+    if (!lazyEntityLoading) {
+        datasets->startDeferredJobs();
+        procedures->startDeferredJobs();
+        functions->startDeferredJobs();
+    }
 
     if (false) {
         logRequest = [&] (const HttpRestConnection & conn, const RestRequest & req)
@@ -438,7 +943,7 @@ static bool endsWith(const std::string & str,
 
 void
 MldbServer::
-scanPlugins(const std::string & dir_)
+scanPlugins(const std::string & dir_, bool lazy)
 {
     DEBUG_MSG(logger) << "scanning plugins in directory " << dir_;
 
@@ -456,22 +961,25 @@ scanPlugins(const std::string & dir_)
                     shlibConfig.allowInsecureLoading = true;
 
                     manifest.config.params = shlibConfig;
-
-                    auto plugin = plugins->obtainEntitySync(
-                        manifest.config, nullptr /* on progress */);
                 }
                 else if (manifest.config.type == "python" ||
                          manifest.config.type == "javascript") {
                     auto config = manifest.config.params.convert<PluginResource>();
                     config.address = dir;
                     manifest.config.params = config;
-                    auto plugin = plugins->obtainEntitySync(
-                        manifest.config, nullptr /* on progress */);
                 }
                 else {
                     throw HttpReturnException(
                         500, "unknown plugin type to autoload at " + dir);
                 }
+
+                if (lazy && !manifest.provides.empty()) {
+                    deferPlugin(manifest);
+                    return;
+                }
+
+                auto plugin = plugins->obtainEntitySync(
+                    manifest.config, nullptr /* on progress */);
             } catch (const HttpReturnException & exc) {
                 logger->error() << "loading plugin " << dir << ": " << exc.what();
                 logger->error() << "details:";
@@ -530,6 +1038,39 @@ scanPlugins(const std::string & dir_)
     }
 }
 
+void
+MldbServer::
+deferPlugin(const PluginManifest & manifest)
+{
+    DEBUG_MSG(logger) << "deferring loading of plugin " << manifest.config.id
+                      << " until first use";
+
+    // Several types may be needed at once from several threads; the first
+    // one loads the plugin and the others wait for it.  If loading fails,
+    // the next use tries again.
+    auto once = std::make_shared<std::once_flag>();
+    PolyConfig config = manifest.config;
+
+    auto load = [this, once, config] ()
+        {
+            std::call_once(*once, [&] ()
+                {
+                    INFO_MSG(logger) << "loading plugin " << config.id
+                                     << " on first use";
+                    plugins->obtainEntitySync(config, nullptr /* on progress */);
+                });
+        };
+
+    for (auto & type: manifest.provides.datasets)
+        PolyCollection<Dataset>::registerDeferredType(type, load);
+    for (auto & type: manifest.provides.procedures)
+        PolyCollection<Procedure>::registerDeferredType(type, load);
+    for (auto & type: manifest.provides.functions)
+        PolyCollection<Function>::registerDeferredType(type, load);
+    for (auto & name: manifest.provides.sqlFunctions)
+        registerDeferredFunctions(name, load);
+}
+
 Utf8String
 MldbServer::
 getPackageDocumentationPath(const Package & package) const
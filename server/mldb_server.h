@@ -14,6 +14,8 @@
 #include "mldb/types/string.h"
 #include "mldb/soa/service/event_service.h"
 #include "mldb/utils/log_fwd.h"
+#include <map>
+#include <mutex>
 
 
 namespace MLDB {
@@ -21,6 +23,7 @@ namespace MLDB {
 struct PolyConfig;
 struct Utf8String;
 struct Package;
+struct PluginManifest;
 
 
 struct PluginCollection;
@@ -37,6 +40,10 @@ struct Function;
 struct CredentialRule;
 
 struct MatrixNamedRow;
+struct NamedRowValue;
+struct QueryCache;
+struct QueryCacheStats;
+struct StatementCache;
 
 
 /*****************************************************************************/
@@ -73,8 +80,12 @@ struct MldbServer: public ServicePeer, public EventRecorder {
             subdirectory will be scanned recursively.
         2.  It has a mldb_plugin.json file, in which case the
             plugin will be loaded from that directory.
+
+        If lazy is true, plugins whose manifest lists the entity types
+        that they provide are not loaded now, but the first time that one
+        of those types is used.  Other plugins are always loaded now.
     */
-    void scanPlugins(const std::string & dir);
+    void scanPlugins(const std::string & dir, bool lazy = true);
 
     /** Set up the SSD cache directory, where files that need memory
         mapping can be cached.
@@ -110,8 +121,58 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     /** Parse and perform an SQL query. */
     std::vector<MatrixNamedRow> query(const Utf8String& query) const;
 
+    /** Layer and types of the peer to peer messages that MLDB servers
+        send each other.  Layers below 2 are used by ServicePeer itself.
+    */
+    static constexpr int PEER_MESSAGE_LAYER = 2;
+    enum PeerMessageType {
+        PEER_QUERY = 1   ///< Run the SQL query in the payload
+    };
+
+    /** Parse and perform an SQL query on the given peer, returning the
+        rows with their structure intact.  If the peer is empty or is this
+        server, the query is run locally.  Throws if the peer reports an
+        error or doesn't answer within timeout seconds.
+    */
+    std::vector<NamedRowValue>
+    queryPeer(const std::string & peer,
+              const Utf8String & query,
+              double timeout = 600.0);
+
+    /** Run the query on one of the given peers, which must all hold the
+        same data, and return the rows of the first one that answers.
+        Peers are tried in the order given by rankReplicas(); a peer that
+        can't be reached or times out is skipped for the next one, but an
+        error in the query itself is thrown straight away.
+    */
+    std::vector<NamedRowValue>
+    queryReplicas(const std::vector<std::string> & peers,
+                  const Utf8String & query,
+                  double timeout = 600.0);
+
+    /** Return the given peers in the order that queries should be sent
+        to them: connected peers first, then by their ping latency scaled
+        by the number of queries that this server is already running on
+        them, so that the load is spread over the replicas.  The empty
+        name and the name of this server are this server, which one is
+        always connected and has no latency.
+    */
+    std::vector<std::string>
+    rankReplicas(const std::vector<std::string> & peers) const;
+
+    /** Handle a message from another MLDB server.  Queries are run on the
+        thread pool, so that the peer connection isn't held up.
+    */
+    virtual void handlePeerMessage(RemotePeer * peer,
+                                   PeerMessage && msg) override;
+
     /** Parse and perform an SQL query, returning the results
-        on the given HTTP connection.
+        on the given HTTP connection.  The query is abandoned if it's still
+        running after timeout seconds (zero meaning never), or once the
+        connection is closed.  With explain, the rows are discarded and the
+        profile of the query (see query_profile.h) is returned instead.
+        The query fails with a 507 error once the memory it holds goes over
+        maxMemory bytes; zero means the default of the server.
     */
     void runHttpQuery(const Utf8String& query,
                       RestConnection & connection,
@@ -119,7 +180,61 @@ struct MldbServer: public ServicePeer, public EventRecorder {
                       bool createHeaders,
                       bool rowNames,
                       bool rowHashes,
-                      bool sortColumns) const;
+                      bool sortColumns,
+                      bool useCache,
+                      double timeout = 0.0,
+                      bool explain = false,
+                      uint64_t maxMemory = 0) const;
+
+    /** Enable the cache of query responses, with the given memory budget
+        in bytes.  A budget of zero disables it.  When it's enabled,
+        identical queries run through runHttpQuery() are answered from
+        the cache until a dataset is committed, created or destroyed.
+    */
+    void setQueryCacheSize(size_t maxBytes);
+
+    /** Return the statistics of the query cache.  They are all zero if
+        it's disabled.
+    */
+    QueryCacheStats getQueryCacheStats() const;
+
+    /** Empty the query cache. */
+    void clearQueryCache();
+
+    /** Persist the configuration of the datasets, procedures, functions
+        and plugins created with "persistent": true under the given
+        directory or URL, and recreate them from it on startup.  Must be
+        called before init().
+
+        Entities are recreated in the background, so that the server
+        answers requests straight away; an entity that's used before
+        it's ready, including by another entity being recreated, is waited
+        for.  With lazy, each is only recreated once it's first used.
+    */
+    void setEntityConfigStore(const std::string & path, bool lazy = false);
+
+    /** Set the default memory budget of queries run through
+        runHttpQuery(), in bytes.  Zero, the default, means no limit.
+    */
+    void setQueryMemoryBudget(uint64_t maxBytes);
+
+    /** Return the queries and procedure runs in progress, with the memory
+        that each holds.  See MemoryAccount.
+    */
+    Json::Value getRunningQueries() const;
+
+    /** Sample the stacks of the running threads for the given number of
+        seconds and return them as collapsed stacks for a flame graph.  See
+        SamplingProfiler.
+    */
+    void runSamplingProfile(RestConnection & connection,
+                            double seconds,
+                            int frequency) const;
+
+    /** Record the spans of all threads for the given number of seconds
+        and return them as Chrome trace event JSON.  See TraceEvents.
+    */
+    void runTrace(RestConnection & connection, double seconds) const;
 
     /** Redirect POST request as a GET with body.  
         This is for client that do not support GET with body.
@@ -179,8 +294,22 @@ private:
                          std::string staticFilesPath,
                          std::string staticDocPath,
                          bool hideInternalEntities);
+
+    /// Arrange for the plugin to be loaded when one of its types is used
+    void deferPlugin(const PluginManifest & manifest);
+
     RestRequestRouter * versionNode;
     std::string cacheDirectory_;
+    std::shared_ptr<QueryCache> queryCache;
+    std::shared_ptr<StatementCache> statementCache;
+    uint64_t queryMemoryBudget;
+
+    /// Number of queries running on each peer through queryReplicas()
+    mutable std::mutex replicaLoadMutex;
+    std::map<std::string, int> replicaLoad;
+
+    std::string entityConfigPath;
+    bool lazyEntityLoading;
     std::shared_ptr<spdlog::logger> logger;
 };
 
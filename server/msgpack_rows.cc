@@ -0,0 +1,438 @@
+/** msgpack_rows.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Decoding of rows to record that are encoded in MessagePack.
+*/
+
+#include "mldb/server/msgpack_rows.h"
+#include "mldb/sql/interval.h"
+#include "mldb/base/parse_context.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const char * const MSGPACK_MIME_TYPE = "application/msgpack";
+
+namespace {
+
+/** Reads the items of a MessagePack document one at a time.  Strings,
+    binary and extension payloads are returned as pointers into the
+    document; arrays and maps only return their size, and their elements
+    are read next.
+*/
+struct MsgPackReader {
+
+    enum Kind {
+        NIL, BOOL, UINT, INT, FLOAT, STR, BIN, ARRAY, MAP, EXT
+    };
+
+    struct Item {
+        Kind kind;
+        union {
+            bool b;
+            uint64_t u;
+            int64_t i;
+            double d;
+        };
+        const char * data;   ///< Payload for STR, BIN and EXT
+        uint32_t length;     ///< Payload length, or number of elements
+        int8_t extType;      ///< Type for EXT
+    };
+
+    MsgPackReader(const char * data, size_t length)
+        : start(data), p(data), end(data + length)
+    {
+    }
+
+    const char * start;
+    const char * p;
+    const char * end;
+
+    bool eof() const
+    {
+        return p == end;
+    }
+
+    /// Number of bytes left, which bounds the number of items left
+    size_t remaining() const
+    {
+        return end - p;
+    }
+
+    [[noreturn]] void error(const std::string & message,
+                            const char * where = nullptr) const
+    {
+        size_t offset = (where ? where : p) - start;
+        throw HttpReturnException(400, "Error decoding MessagePack rows at "
+                                  "offset " + std::to_string(offset)
+                                  + ": " + message,
+                                  "offset", offset);
+    }
+
+    const char * take(size_t n)
+    {
+        if (remaining() < n)
+            error("unexpected end of document");
+        const char * result = p;
+        p += n;
+        return result;
+    }
+
+    uint64_t readBigEndian(size_t n)
+    {
+        const unsigned char * q = (const unsigned char *)take(n);
+        uint64_t result = 0;
+        for (size_t i = 0;  i < n;  ++i)
+            result = (result << 8) | q[i];
+        return result;
+    }
+
+    void payload(Item & item, Kind kind, size_t length)
+    {
+        item.kind = kind;
+        item.length = length;
+        item.data = take(length);
+    }
+
+    void extension(Item & item, size_t length)
+    {
+        item.extType = (int8_t)readBigEndian(1);
+        payload(item, EXT, length);
+    }
+
+    Item next()
+    {
+        Item item;
+        item.u = 0;
+        item.data = nullptr;
+        item.length = 0;
+        item.extType = 0;
+
+        uint8_t c = readBigEndian(1);
+
+        if (c <= 0x7f) {
+            item.kind = UINT;
+            item.u = c;
+        }
+        else if (c >= 0xe0) {
+            item.kind = INT;
+            item.i = (int8_t)c;
+        }
+        else if (c >= 0x80 && c <= 0x8f) {
+            item.kind = MAP;
+            item.length = c & 0x0f;
+        }
+        else if (c >= 0x90 && c <= 0x9f) {
+            item.kind = ARRAY;
+            item.length = c & 0x0f;
+        }
+        else if (c >= 0xa0 && c <= 0xbf) {
+            payload(item, STR, c & 0x1f);
+        }
+        else switch (c) {
+        case 0xc0: item.kind = NIL;  break;
+        case 0xc2: item.kind = BOOL;  item.b = false;  break;
+        case 0xc3: item.kind = BOOL;  item.b = true;  break;
+        case 0xc4: payload(item, BIN, readBigEndian(1));  break;
+        case 0xc5: payload(item, BIN, readBigEndian(2));  break;
+        case 0xc6: payload(item, BIN, readBigEndian(4));  break;
+        case 0xc7: extension(item, readBigEndian(1));  break;
+        case 0xc8: extension(item, readBigEndian(2));  break;
+        case 0xc9: extension(item, readBigEndian(4));  break;
+        case 0xca: {
+            item.kind = FLOAT;
+            uint32_t bits = readBigEndian(4);
+            float f;
+            std::memcpy(&f, &bits, 4);
+            item.d = f;
+            break;
+        }
+        case 0xcb: {
+            item.kind = FLOAT;
+            uint64_t bits = readBigEndian(8);
+            std::memcpy(&item.d, &bits, 8);
+            break;
+        }
+        case 0xcc: item.kind = UINT;  item.u = readBigEndian(1);  break;
+        case 0xcd: item.kind = UINT;  item.u = readBigEndian(2);  break;
+        case 0xce: item.kind = UINT;  item.u = readBigEndian(4);  break;
+        case 0xcf: item.kind = UINT;  item.u = readBigEndian(8);  break;
+        case 0xd0: item.kind = INT;  item.i = (int8_t)readBigEndian(1);  break;
+        case 0xd1: item.kind = INT;  item.i = (int16_t)readBigEndian(2);  break;
+        case 0xd2: item.kind = INT;  item.i = (int32_t)readBigEndian(4);  break;
+        case 0xd3: item.kind = INT;  item.i = (int64_t)readBigEndian(8);  break;
+        case 0xd4: extension(item, 1);  break;
+        case 0xd5: extension(item, 2);  break;
+        case 0xd6: extension(item, 4);  break;
+        case 0xd7: extension(item, 8);  break;
+        case 0xd8: extension(item, 16);  break;
+        case 0xd9: payload(item, STR, readBigEndian(1));  break;
+        case 0xda: payload(item, STR, readBigEndian(2));  break;
+        case 0xdb: payload(item, STR, readBigEndian(4));  break;
+        case 0xdc: item.kind = ARRAY;  item.length = readBigEndian(2);  break;
+        case 0xdd: item.kind = ARRAY;  item.length = readBigEndian(4);  break;
+        case 0xde: item.kind = MAP;  item.length = readBigEndian(2);  break;
+        case 0xdf: item.kind = MAP;  item.length = readBigEndian(4);  break;
+        default:
+            error("invalid type byte " + std::to_string(c), p - 1);
+        }
+
+        return item;
+    }
+
+    /// Read an array header, and return its number of elements
+    size_t expectArray(const char * what)
+    {
+        const char * where = p;
+        Item item = next();
+        if (item.kind != ARRAY)
+            error(std::string("expected array for ") + what, where);
+        return item.length;
+    }
+};
+
+/// Timestamp extension type, from the MessagePack specification
+constexpr int8_t TIMESTAMP_EXT_TYPE = -1;
+
+Date decodeTimestamp(const MsgPackReader & reader,
+                     const MsgPackReader::Item & item,
+                     const char * where)
+{
+    const unsigned char * q = (const unsigned char *)item.data;
+    auto bigEndian = [&] (size_t offset, size_t n)
+        {
+            uint64_t result = 0;
+            for (size_t i = 0;  i < n;  ++i)
+                result = (result << 8) | q[offset + i];
+            return result;
+        };
+
+    int64_t seconds;
+    uint32_t nanoseconds;
+
+    switch (item.length) {
+    case 4:
+        seconds = bigEndian(0, 4);
+        nanoseconds = 0;
+        break;
+    case 8: {
+        uint64_t bits = bigEndian(0, 8);
+        nanoseconds = bits >> 34;
+        seconds = bits & ((1ULL << 34) - 1);
+        break;
+    }
+    case 12:
+        nanoseconds = bigEndian(0, 4);
+        seconds = (int64_t)bigEndian(4, 8);
+        break;
+    default:
+        reader.error("invalid timestamp length "
+                     + std::to_string(item.length), where);
+    }
+
+    if (nanoseconds >= 1000000000)
+        reader.error("invalid timestamp nanoseconds", where);
+
+    return Date::fromSecondsSinceEpoch(seconds + nanoseconds * 1e-9);
+}
+
+Date decodeDate(MsgPackReader & reader)
+{
+    const char * where = reader.p;
+    auto item = reader.next();
+
+    switch (item.kind) {
+    case MsgPackReader::UINT:
+        return Date::fromSecondsSinceEpoch(item.u);
+    case MsgPackReader::INT:
+        return Date::fromSecondsSinceEpoch(item.i);
+    case MsgPackReader::FLOAT:
+        return Date::fromSecondsSinceEpoch(item.d);
+    case MsgPackReader::STR: {
+        // Same as for the JSON form
+        std::string s(item.data, item.length);
+        if (s.length() >= 11
+            && s[4] == '-'
+            && s[7] == '-'
+            && (s[s.size() - 1] == 'Z'
+                || s[s.size() - 3] == ':')) {
+            Date date = Date::parseIso8601DateTime(s);
+            if (!date.isADate())
+                reader.error("expected date", where);
+            return date;
+        }
+        return Date::parseDefaultUtc(s);
+    }
+    case MsgPackReader::EXT:
+        if (item.extType == TIMESTAMP_EXT_TYPE)
+            return decodeTimestamp(reader, item, where);
+        // fall through
+    default:
+        reader.error("expected timestamp", where);
+    }
+}
+
+PathElement decodePathElement(MsgPackReader & reader)
+{
+    const char * where = reader.p;
+    auto item = reader.next();
+
+    switch (item.kind) {
+    case MsgPackReader::STR:
+        return PathElement(item.data, item.length);
+    case MsgPackReader::UINT:
+        return PathElement(item.u);
+    case MsgPackReader::INT:
+        if (item.i >= 0)
+            return PathElement(item.i);
+        // fall through
+    default:
+        reader.error("expected path element", where);
+    }
+}
+
+Path decodePath(MsgPackReader & reader)
+{
+    const char * where = reader.p;
+    auto item = reader.next();
+
+    switch (item.kind) {
+    case MsgPackReader::NIL:
+        return Path();
+    case MsgPackReader::STR:
+        return Path::parse(item.data, item.length);
+    case MsgPackReader::UINT:
+        return PathElement(item.u);
+    case MsgPackReader::INT:
+        if (item.i >= 0)
+            return PathElement(item.i);
+        break;
+    case MsgPackReader::ARRAY: {
+        std::vector<PathElement> elements;
+        elements.reserve(std::min<size_t>(item.length, reader.remaining()));
+        for (size_t i = 0;  i < item.length;  ++i)
+            elements.emplace_back(decodePathElement(reader));
+        return Path(elements.data(), elements.size());
+    }
+    default:
+        break;
+    }
+
+    reader.error("expected path", where);
+}
+
+CellValue decodeCell(MsgPackReader & reader)
+{
+    const char * where = reader.p;
+    auto item = reader.next();
+
+    switch (item.kind) {
+    case MsgPackReader::NIL:
+        return CellValue();
+    case MsgPackReader::BOOL:
+        return CellValue(item.b);
+    case MsgPackReader::UINT:
+        return CellValue((unsigned long long)item.u);
+    case MsgPackReader::INT:
+        return CellValue((long long)item.i);
+    case MsgPackReader::FLOAT:
+        return CellValue(item.d);
+    case MsgPackReader::STR:
+        return CellValue(item.data, item.length);
+    case MsgPackReader::BIN:
+        return CellValue::blob(item.data, item.length);
+    case MsgPackReader::EXT:
+        if (item.extType == TIMESTAMP_EXT_TYPE)
+            return CellValue(decodeTimestamp(reader, item, where));
+        break;
+    case MsgPackReader::MAP: {
+        // Same as the JSON form for types that have none in MessagePack
+        if (item.length != 1)
+            break;
+        auto key = reader.next();
+        if (key.kind != MsgPackReader::STR)
+            break;
+        std::string name(key.data, key.length);
+
+        if (name == "path") {
+            return CellValue(decodePath(reader));
+        }
+
+        const char * valueWhere = reader.p;
+        auto value = reader.next();
+        if (value.kind != MsgPackReader::STR)
+            reader.error("expected string for '" + name + "'", valueWhere);
+        std::string text(value.data, value.length);
+
+        if (name == "ts") {
+            return CellValue(Date::parseIso8601DateTime(text));
+        }
+        else if (name == "interval") {
+            ParseContext context(text, text.c_str(), text.length());
+            uint32_t months = 0;
+            uint32_t days = 0;
+            double seconds = 0.0;
+            expect_interval(context, months, days, seconds);
+            return CellValue::fromMonthDaySecond(months, days, seconds);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    reader.error("expected cell value", where);
+}
+
+} // file scope
+
+std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > >
+decodeMsgPackRows(const char * data, size_t length)
+{
+    MsgPackReader reader(data, length);
+
+    std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > result;
+
+    // Sizes aren't trusted to reserve more than the document could hold
+    size_t numRows = reader.expectArray("rows");
+    result.reserve(std::min(numRows, reader.remaining()));
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        const char * where = reader.p;
+        if (reader.expectArray("row") != 2)
+            reader.error("expected [ rowName, columns ] array", where);
+
+        RowPath rowName = decodePath(reader);
+
+        std::vector<std::tuple<ColumnPath, CellValue, Date> > columns;
+        size_t numColumns = reader.expectArray("columns");
+        columns.reserve(std::min(numColumns, reader.remaining()));
+
+        for (size_t j = 0;  j < numColumns;  ++j) {
+            const char * where = reader.p;
+            if (reader.expectArray("column") != 3)
+                reader.error("expected [ columnName, value, timestamp ] "
+                             "array", where);
+            ColumnPath columnName = decodePath(reader);
+            CellValue value = decodeCell(reader);
+            Date timestamp = decodeDate(reader);
+            columns.emplace_back(std::move(columnName), std::move(value),
+                                 timestamp);
+        }
+
+        result.emplace_back(std::move(rowName), std::move(columns));
+    }
+
+    if (!reader.eof())
+        reader.error("extra data after rows");
+
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,48 @@
+/** msgpack_rows.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Decoding of rows to record that are encoded in MessagePack.
+
+    The layout is the same as for the JSON form of a multirows request:
+
+        [ [ rowName, [ [ columnName, value, timestamp ], ... ] ], ... ]
+
+    with the following MessagePack types accepted:
+
+    - row and column names: a string, which is parsed as a path; a
+      non-negative integer; an array of strings and integers, one per
+      path element; or nil for the empty path;
+    - values: nil (empty), booleans (0 or 1), integers, floats, strings,
+      binary (a blob), the timestamp extension (type -1), or a map with a
+      single member, as in the JSON form: "ts" (an ISO 8601 string),
+      "interval" (a string) or "path" (an array of strings);
+    - timestamps: the timestamp extension, a number of seconds since the
+      epoch, or a string in the same formats as for JSON.
+
+    Cells are decoded straight into the structure that recordRows()
+    takes, without going through any intermediate representation.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include "mldb/types/date.h"
+#include <tuple>
+#include <vector>
+
+
+namespace MLDB {
+
+/// MIME type for a MessagePack request or response body
+extern const char * const MSGPACK_MIME_TYPE;
+
+/** Decode the given MessagePack document, which is in the format
+    described above, into rows to be recorded.  Throws an
+    HttpReturnException with a 400 code if the document is malformed;
+    the message contains the offset where the problem was found.
+*/
+std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > >
+decodeMsgPackRows(const char * data, size_t length);
+
+} // namespace MLDB
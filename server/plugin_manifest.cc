@@ -8,11 +8,29 @@
 
 #include "plugin_manifest.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/types/vector_description.h"
 
 
 namespace MLDB {
 
 
+DEFINE_STRUCTURE_DESCRIPTION(PluginProvides);
+
+PluginProvidesDescription::
+PluginProvidesDescription()
+{
+    addField("datasets", &PluginProvides::datasets,
+             "Dataset types registered by the plugin");
+    addField("procedures", &PluginProvides::procedures,
+             "Procedure types registered by the plugin");
+    addField("functions", &PluginProvides::functions,
+             "Function types registered by the plugin");
+    addField("sqlFunctions", &PluginProvides::sqlFunctions,
+             "SQL functions registered by the plugin.  A name ending in '*' "
+             "stands for all the functions starting with what comes "
+             "before it.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(PluginManifest);
 
 PluginManifestDescription::
@@ -20,6 +38,10 @@ PluginManifestDescription()
 {
     addField("config", &PluginManifest::config,
              "Configuration of plugin loading");
+    addField("provides", &PluginManifest::provides,
+             "Entity types registered by the plugin.  If any are given, "
+             "loading of the plugin is deferred until one of them is "
+             "first used.");
 }
 
 
@@ -20,8 +20,29 @@ namespace MLDB {
 /* PLUGIN MANIFEST                                                           */
 /*****************************************************************************/
 
+/** Entity types that a plugin registers once it's loaded.  When any are
+    given, the plugin is only loaded the first time that one of them is
+    needed.
+*/
+
+struct PluginProvides {
+    std::vector<Utf8String> datasets;
+    std::vector<Utf8String> procedures;
+    std::vector<Utf8String> functions;
+    std::vector<Utf8String> sqlFunctions;  ///< Names, or prefixes ending in '*'
+
+    bool empty() const
+    {
+        return datasets.empty() && procedures.empty() && functions.empty()
+            && sqlFunctions.empty();
+    }
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(PluginProvides);
+
 struct PluginManifest {
     PolyConfig config;
+    PluginProvides provides;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(PluginManifest);
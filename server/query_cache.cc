@@ -0,0 +1,263 @@
+/** query_cache.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Cache of the responses to queries, and of their parsed statements.
+*/
+
+#include "mldb/server/query_cache.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/base/metrics.h"
+#include "mldb/sql/sql_expression.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY CACHE STATS                                                         */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(QueryCacheStats);
+
+QueryCacheStatsDescription::
+QueryCacheStatsDescription()
+{
+    addField("hits", &QueryCacheStats::hits,
+             "Number of queries answered from the cache");
+    addField("misses", &QueryCacheStats::misses,
+             "Number of queries that had to be run");
+    addField("insertions", &QueryCacheStats::insertions,
+             "Number of responses added to the cache");
+    addField("evictions", &QueryCacheStats::evictions,
+             "Number of responses removed to stay within the memory budget");
+    addField("invalidations", &QueryCacheStats::invalidations,
+             "Number of times the cache was emptied because data changed");
+    addField("entries", &QueryCacheStats::entries,
+             "Number of responses currently in the cache");
+    addField("bytes", &QueryCacheStats::bytes,
+             "Memory used by the responses in the cache, in bytes");
+    addField("maxBytes", &QueryCacheStats::maxBytes,
+             "Memory budget of the cache, in bytes");
+}
+
+
+/*****************************************************************************/
+/* QUERY CACHE                                                               */
+/*****************************************************************************/
+
+size_t
+QueryCache::Response::
+memusage() const
+{
+    return sizeof(*this) + body.capacity() + contentType.capacity();
+}
+
+QueryCache::
+QueryCache(size_t maxBytes)
+    : maxBytes(maxBytes), generation(0)
+{
+    stats.maxBytes = maxBytes;
+}
+
+size_t
+QueryCache::
+entryBytes(const Entry & entry) const
+{
+    // Key is held twice: in the list, and in the index
+    return 2 * entry.first.capacity() + entry.second->memusage()
+        + 64 /* list and hash overhead */;
+}
+
+void
+QueryCache::
+clearLocked()
+{
+    entries.clear();
+    index.clear();
+    stats.entries = 0;
+    stats.bytes = 0;
+}
+
+void
+QueryCache::
+moveToGeneration(uint64_t newGeneration)
+{
+    if (newGeneration == generation)
+        return;
+    if (!entries.empty())
+        ++stats.invalidations;
+    clearLocked();
+    generation = newGeneration;
+}
+
+static MetricCounter & hitsMetric
+    = Metrics::counter("mldb_query_cache_hits_total",
+                       "Queries answered from the query cache");
+static MetricCounter & missesMetric
+    = Metrics::counter("mldb_query_cache_misses_total",
+                       "Queries looked up in the query cache and not found");
+
+std::shared_ptr<const QueryCache::Response>
+QueryCache::
+get(const std::string & key, uint64_t generation)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    // An old generation can't be answered from the cache, and doesn't
+    // invalidate the newer one
+    if (generation < this->generation) {
+        ++stats.misses;
+        missesMetric.add();
+        return nullptr;
+    }
+
+    moveToGeneration(generation);
+
+    auto it = index.find(key);
+    if (it == index.end()) {
+        ++stats.misses;
+        missesMetric.add();
+        return nullptr;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    ++stats.hits;
+    hitsMetric.add();
+    return it->second->second;
+}
+
+bool
+QueryCache::
+put(const std::string & key, uint64_t generation,
+    std::shared_ptr<const Response> response)
+{
+    Entry entry(key, std::move(response));
+    size_t bytes = entryBytes(entry);
+    if (bytes > maxBytes / 4)
+        return false;
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    if (generation < this->generation)
+        return false;
+
+    moveToGeneration(generation);
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        // Another thread ran the same query at the same time
+        return false;
+    }
+
+    while (stats.bytes + bytes > maxBytes && !entries.empty()) {
+        const Entry & last = entries.back();
+        stats.bytes -= entryBytes(last);
+        index.erase(last.first);
+        entries.pop_back();
+        --stats.entries;
+        ++stats.evictions;
+    }
+
+    entries.emplace_front(std::move(entry));
+    index[key] = entries.begin();
+    stats.bytes += bytes;
+    ++stats.entries;
+    ++stats.insertions;
+    return true;
+}
+
+void
+QueryCache::
+clear()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    clearLocked();
+}
+
+QueryCacheStats
+QueryCache::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return stats;
+}
+
+
+
+/*****************************************************************************/
+/* STATEMENT CACHE                                                           */
+/*****************************************************************************/
+
+StatementCache::
+StatementCache(size_t maxEntries)
+    : maxEntries(maxEntries)
+{
+}
+
+static MetricCounter & statementHitsMetric
+    = Metrics::counter("mldb_statement_cache_hits_total",
+                       "Queries whose parsed statement was in the cache");
+static MetricCounter & statementMissesMetric
+    = Metrics::counter("mldb_statement_cache_misses_total",
+                       "Queries that had to be parsed");
+
+std::shared_ptr<const SelectStatement>
+StatementCache::
+get(const Utf8String & query)
+{
+    const std::string & key = query.rawString();
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            statementHitsMetric.add();
+            return it->second->second;
+        }
+    }
+
+    statementMissesMetric.add();
+
+    // Parse without holding the lock, as it can take a while for a long
+    // query.  If another thread parses the same query at the same time,
+    // the first one to finish is kept.
+    auto statement
+        = std::make_shared<const SelectStatement>(SelectStatement::parse(key));
+
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = index.find(key);
+    if (it != index.end())
+        return it->second->second;
+
+    if (maxEntries == 0)
+        return statement;
+
+    while (entries.size() >= maxEntries) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+
+    entries.emplace_front(key, statement);
+    index[key] = entries.begin();
+    return statement;
+}
+
+size_t
+StatementCache::
+size() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return entries.size();
+}
+
+void
+StatementCache::
+clear()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    entries.clear();
+    index.clear();
+}
+
+} // namespace MLDB
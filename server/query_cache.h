@@ -0,0 +1,148 @@
+/** query_cache.h                                                  -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Cache of the responses to queries, for when the same queries are run
+    repeatedly over data that doesn't change, and of the parsed form of
+    their text, for when they are run over data that does.
+*/
+
+#pragma once
+
+#include "mldb/types/value_description_fwd.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+namespace MLDB {
+
+struct SelectStatement;
+struct Utf8String;
+
+
+/*****************************************************************************/
+/* QUERY CACHE STATS                                                         */
+/*****************************************************************************/
+
+struct QueryCacheStats {
+    uint64_t hits = 0;        ///< Lookups that found a response
+    uint64_t misses = 0;      ///< Lookups that didn't
+    uint64_t insertions = 0;  ///< Responses added
+    uint64_t evictions = 0;   ///< Responses removed to stay within budget
+    uint64_t invalidations = 0;  ///< Times the contents were dropped
+    uint64_t entries = 0;     ///< Responses currently held
+    uint64_t bytes = 0;       ///< Memory used by those responses
+    uint64_t maxBytes = 0;    ///< Memory budget
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(QueryCacheStats);
+
+
+/*****************************************************************************/
+/* QUERY CACHE                                                               */
+/*****************************************************************************/
+
+/** Least recently used cache of query responses, within a memory budget.
+
+    Each response is stored along with the generation of the data it was
+    computed from (see Dataset::getGlobalGeneration()).  A lookup at a
+    different generation finds the cache stale and empties it.
+
+    Responses bigger than a quarter of the budget aren't kept, so that a
+    single large result can't flush everything else.
+
+    All methods are thread safe.
+*/
+struct QueryCache {
+
+    struct Response {
+        std::string body;
+        std::string contentType;
+
+        size_t memusage() const;
+    };
+
+    QueryCache(size_t maxBytes);
+
+    /** Look up the response for the given key, made at the given
+        generation.  Returns a null pointer if there is none.
+    */
+    std::shared_ptr<const Response>
+    get(const std::string & key, uint64_t generation);
+
+    /** Record the response for the given key, which was computed from
+        the data at the given generation.  Returns false if it wasn't
+        kept, because it's too big or the generation is old.
+    */
+    bool put(const std::string & key, uint64_t generation,
+             std::shared_ptr<const Response> response);
+
+    /// Drop everything that's in the cache
+    void clear();
+
+    QueryCacheStats getStats() const;
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<const Response> > Entry;
+
+    void clearLocked();
+    void moveToGeneration(uint64_t generation);
+    size_t entryBytes(const Entry & entry) const;
+
+    mutable std::mutex mutex;
+    size_t maxBytes;
+    uint64_t generation;
+
+    /// Entries, most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+    QueryCacheStats stats;
+};
+
+
+
+/*****************************************************************************/
+/* STATEMENT CACHE                                                           */
+/*****************************************************************************/
+
+/** Least recently used cache of parsed SELECT statements, keyed by the
+    text of the query, so that a query that's sent over and over doesn't
+    need to be tokenized and parsed each time.  A statement doesn't depend
+    on any data, so unlike the responses above they never go stale.
+
+    Statements that fail to parse aren't kept, so their errors are
+    reported every time.
+
+    All methods are thread safe.
+*/
+struct StatementCache {
+
+    StatementCache(size_t maxEntries);
+
+    /** Return the parsed statement for the given query, parsing it if it's
+        not in the cache.  Throws if it can't be parsed.
+    */
+    std::shared_ptr<const SelectStatement> get(const Utf8String & query);
+
+    /// Number of statements in the cache
+    size_t size() const;
+
+    /// Drop everything that's in the cache
+    void clear();
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<const SelectStatement> >
+        Entry;
+
+    mutable std::mutex mutex;
+    size_t maxEntries;
+
+    /// Entries, most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+} // namespace MLDB
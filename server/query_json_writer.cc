@@ -0,0 +1,271 @@
+/** query_json_writer.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Writer for query results in the row by row JSON formats.
+*/
+
+#include "mldb/server/query_json_writer.h"
+#include "mldb/types/dtoa.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+void appendInteger(std::string & out, uint64_t val, bool negative)
+{
+    char buffer[24];
+    char * end = buffer + sizeof(buffer);
+    char * p = end;
+    do {
+        *--p = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    if (negative)
+        *--p = '-';
+    out.append(p, end);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* QUERY JSON WRITER                                                         */
+/*****************************************************************************/
+
+QueryJsonWriter::
+QueryJsonWriter(std::string & out)
+    : out(out), fallback(out)
+{
+}
+
+const QueryJsonWriter::PathCache::value_type *
+QueryJsonWriter::
+getCachedPath(const Path & path)
+{
+    auto it = cachedPaths.find(path);
+    if (it != cachedPaths.end())
+        return &*it;
+
+    if (cachedPaths.size() >= MAX_CACHED_PATHS)
+        return nullptr;
+
+    // Escape it exactly as the value description would
+    std::string escaped;
+    StringJsonPrintingContext context(escaped);
+    context.writeStringUtf8(path.toUtf8String());
+
+    return &*cachedPaths.emplace(path, std::move(escaped)).first;
+}
+
+void
+QueryJsonWriter::
+writePath(const Path & path)
+{
+    auto entry = getCachedPath(path);
+    if (entry)
+        out += entry->second;
+    else fallback.writeStringUtf8(path.toUtf8String());
+}
+
+void
+QueryJsonWriter::
+writeCell(const CellValue & cell)
+{
+    switch (cell.cellType()) {
+    case CellValue::EMPTY:
+        out += "null";
+        return;
+    case CellValue::INTEGER:
+        if (cell.isInt64()) {
+            int64_t val = cell.toInt();
+            appendInteger(out, val < 0 ? -(uint64_t)val : val, val < 0);
+        }
+        else appendInteger(out, cell.toUInt(), false);
+        return;
+    case CellValue::FLOAT: {
+        double val = cell.toDouble();
+        if (!std::isfinite(val))
+            break;
+        char buffer[DTOA_BUFFER_SIZE];
+        out.append(buffer, dtoa(val, buffer));
+        return;
+    }
+    default:
+        break;
+    }
+
+    // Strings are already escaped straight into the output; NaN, Inf and
+    // the structured types are rare enough not to need a fast path
+    cell.extractStructuredJson(fallback);
+}
+
+void
+QueryJsonWriter::
+writeDate(Date date)
+{
+    // The ISO 8601 form never needs to be escaped
+    out += '"';
+    out += date.printIso8601();
+    out += '"';
+}
+
+void
+QueryJsonWriter::
+writeFullRow(const MatrixNamedRow & row)
+{
+    out += '{';
+
+    // Empty fields are skipped, like the structure description does
+    if (!row.rowName.empty()) {
+        // Row names are rarely repeated, so they're not cached
+        out += "\"rowName\":";
+        fallback.writeStringUtf8(row.rowName.toUtf8String());
+    }
+
+    if (!row.columns.empty()) {
+        if (!row.rowName.empty())
+            out += ',';
+        out += "\"columns\":[";
+
+        if (previousColumns.size() < row.columns.size())
+            previousColumns.resize(row.columns.size());
+
+        for (size_t i = 0;  i < row.columns.size();  ++i) {
+            const ColumnPath & column = std::get<0>(row.columns[i]);
+
+            if (i != 0)
+                out += ',';
+            out += '[';
+
+            auto & entry = previousColumns[i];
+            if (!entry || entry->first != column)
+                entry = getCachedPath(column);
+            if (entry)
+                out += entry->second;
+            else fallback.writeStringUtf8(column.toUtf8String());
+
+            out += ',';
+            writeCell(std::get<1>(row.columns[i]));
+            out += ',';
+            writeDate(std::get<2>(row.columns[i]));
+            out += ']';
+        }
+
+        out += ']';
+    }
+
+    out += '}';
+}
+
+void
+QueryJsonWriter::
+writeSparseRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    static const ColumnPath rowNameColumn("_rowName");
+    static const ColumnPath rowHashColumn("_rowHash");
+
+    out += '[';
+
+    if (rowNames) {
+        out += '[';
+        writePath(rowNameColumn);
+        out += ',';
+        writeCell(CellValue(row.rowName.toUtf8String()));
+        out += ']';
+    }
+    if (rowHashes) {
+        if (rowNames)
+            out += ',';
+        out += '[';
+        writePath(rowHashColumn);
+        out += ',';
+        writeCell(CellValue(row.rowHash.toString()));
+        out += ']';
+    }
+
+    // Columns are sorted by name, and then by value
+    sorted.clear();
+    for (auto & c: row.columns)
+        sorted.emplace_back(&std::get<0>(c), &std::get<1>(c));
+
+    std::sort(sorted.begin(), sorted.end(),
+              [] (const std::pair<const Path *, const CellValue *> & p1,
+                  const std::pair<const Path *, const CellValue *> & p2)
+              {
+                  if (*p1.first < *p2.first)
+                      return true;
+                  if (*p2.first < *p1.first)
+                      return false;
+                  return *p1.second < *p2.second;
+              });
+
+    bool first = !rowNames && !rowHashes;
+    for (auto & c: sorted) {
+        if (!first)
+            out += ',';
+        first = false;
+        out += '[';
+        writePath(*c.first);
+        out += ',';
+        writeCell(*c.second);
+        out += ']';
+    }
+
+    out += ']';
+}
+
+void
+QueryJsonWriter::
+writeAosRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    static const ColumnPath rowNameColumn("_rowName");
+    static const ColumnPath rowHashColumn("_rowHash");
+
+    CellValue rowNameCell, rowHashCell;
+
+    sorted.clear();
+    if (rowNames) {
+        rowNameCell = row.rowName.toUtf8String();
+        sorted.emplace_back(&rowNameColumn, &rowNameCell);
+    }
+    if (rowHashes) {
+        rowHashCell = row.rowHash.toString();
+        sorted.emplace_back(&rowHashColumn, &rowHashCell);
+    }
+    for (auto & c: row.columns)
+        sorted.emplace_back(&std::get<0>(c), &std::get<1>(c));
+
+    // This is an object from column to value, with the keys in order.  If
+    // a column is there more than once, the last value wins.
+    auto compare = [] (const std::pair<const Path *, const CellValue *> & p1,
+                       const std::pair<const Path *, const CellValue *> & p2)
+        {
+            return *p1.first < *p2.first;
+        };
+
+    std::stable_sort(sorted.begin(), sorted.end(), compare);
+
+    out += '{';
+
+    bool first = true;
+    for (size_t i = 0;  i < sorted.size();  ++i) {
+        if (i + 1 < sorted.size() && !compare(sorted[i], sorted[i + 1]))
+            continue;
+        if (!first)
+            out += ',';
+        first = false;
+        writePath(*sorted[i].first);
+        out += ':';
+        writeCell(*sorted[i].second);
+    }
+
+    out += '}';
+}
+
+} // namespace MLDB
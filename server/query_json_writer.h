@@ -0,0 +1,95 @@
+/** query_json_writer.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Writer for query results in the JSON formats that are output row by
+    row (full, sparse and aos).
+
+    The output is exactly the same as calling jsonEncodeStr() on the row
+    (or on the intermediate structure that the sparse and aos formats are
+    defined by), but it's written straight onto the end of an output
+    buffer without going through the value descriptions.  Column names
+    are escaped only once per query and numbers are printed without any
+    allocation, so the cost per cell is mostly that of copying the
+    characters.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include "mldb/types/json_printing.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY JSON WRITER                                                         */
+/*****************************************************************************/
+
+struct QueryJsonWriter {
+
+    /** An upper bound on the number of different column names whose
+        escaped form is remembered.  Beyond that, they're escaped each
+        time they're written.
+    */
+    static constexpr size_t MAX_CACHED_PATHS = 65536;
+
+    /** Create a writer that appends to the given buffer.  The buffer can
+        be modified (for example, cleared once it's been sent) between
+        calls.
+    */
+    QueryJsonWriter(std::string & out);
+
+    /// Write the row as jsonEncodeStr(row) would
+    void writeFullRow(const MatrixNamedRow & row);
+
+    /// Write the row as an array of [ column, value ] pairs, sorted by
+    /// column, preceded by the row name and hash if asked for
+    void writeSparseRow(const MatrixNamedRow & row,
+                        bool rowNames, bool rowHashes);
+
+    /// Write the row as an object from column to value, including the row
+    /// name and hash if asked for
+    void writeAosRow(const MatrixNamedRow & row,
+                     bool rowNames, bool rowHashes);
+
+    /// Write the given path, as a string
+    void writePath(const Path & path);
+
+    /// Write the given value
+    void writeCell(const CellValue & cell);
+
+    /// Write the given timestamp
+    void writeDate(Date date);
+
+private:
+    std::string & out;
+
+    /// Used for everything that there is no fast path for
+    StringJsonPrintingContext fallback;
+
+    /// Escaped form of the column names that were already written
+    typedef std::unordered_map<Path, std::string, PathNewHasher> PathCache;
+    PathCache cachedPaths;
+
+    /// Entries in cachedPaths for the columns of the previous full row.
+    /// Rows often have the same columns in the same order, in which case
+    /// a comparison is enough to find them.
+    std::vector<const PathCache::value_type *> previousColumns;
+
+    /// Used to sort the columns of sparse and aos rows
+    std::vector<std::pair<const Path *, const CellValue *> > sorted;
+
+    /// Return the cached entry for the column, or null if it's not cached
+    /// because there are already too many
+    const PathCache::value_type * getCachedPath(const Path & path);
+
+    void writeRowNameAndHash(const MatrixNamedRow & row,
+                             bool rowNames, bool rowHashes,
+                             bool isObject, bool & first);
+};
+
+} // namespace MLDB
@@ -26,6 +26,12 @@ LIBMLDB_SOURCES:= \
 	forwarded_dataset.cc \
 	column_scope.cc \
 	bucket.cc \
+	arrow_writer.cc \
+	arrow_reader.cc \
+	query_json_writer.cc \
+	msgpack_rows.cc \
+	query_cache.cc \
+	ingestion_queue.cc \
 
 LIBMLDB_LINK:= \
 	service_peer mldb_builtin_plugins sql_expression runner credentials git2 hoedown mldb_builtin command_expression vfs_handlers mldb_core
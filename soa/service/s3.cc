@@ -581,7 +581,9 @@ S3Api::ObjectMetadata::
 ObjectMetadata()
     : redundancy(REDUNDANCY_DEFAULT),
       serverSideEncryption(SSE_NONE),
-      numRequests(8)
+      numRequests(8),
+      maxBufferedBytes(0),
+      numPartAttempts(3)
 {
 }
 
@@ -589,7 +591,9 @@ S3Api::ObjectMetadata::
 ObjectMetadata(Redundancy redundancy)
     : redundancy(redundancy),
       serverSideEncryption(SSE_NONE),
-      numRequests(8)
+      numRequests(8),
+      maxBufferedBytes(0),
+      numPartAttempts(3)
 {
 }
 
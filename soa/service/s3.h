@@ -177,6 +177,14 @@ struct S3Api : public AwsApi {
 
         /* maximum number of concurrent requests */
         unsigned int numRequests;
+
+        /* maximum number of bytes held by the parts being uploaded, or 0
+           to choose it from the system memory */
+        size_t maxBufferedBytes;
+
+        /* number of times the upload of a single part is attempted before
+           the whole upload is failed */
+        unsigned int numPartAttempts;
     };
 
     /** Signed request that can be executed. */
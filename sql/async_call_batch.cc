@@ -0,0 +1,92 @@
+/** async_call_batch.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Overlapping of calls to I/O bound functions across a block of rows.
+*/
+
+#include "async_call_batch.h"
+#include "mldb/base/exc_assert.h"
+
+
+namespace MLDB {
+
+namespace {
+
+struct ThreadState {
+    AsyncCallBatch * batch = nullptr;
+    size_t row = 0;
+    AsyncCallBatch::Pass pass = AsyncCallBatch::START;
+};
+
+thread_local ThreadState threadState;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ASYNC CALL BATCH                                                          */
+/*****************************************************************************/
+
+AsyncCallBatch::
+AsyncCallBatch(size_t numRows)
+    : rows(numRows), numStarted_(0)
+{
+}
+
+AsyncCallBatch::
+~AsyncCallBatch()
+{
+}
+
+AsyncCallBatch::RowScope::
+RowScope(AsyncCallBatch & batch, size_t row, Pass pass)
+    : oldBatch(threadState.batch), oldRow(threadState.row),
+      oldPass(threadState.pass)
+{
+    ExcAssertLess(row, batch.rows.size());
+    threadState.batch = &batch;
+    threadState.row = row;
+    threadState.pass = pass;
+}
+
+AsyncCallBatch::RowScope::
+~RowScope()
+{
+    threadState.batch = oldBatch;
+    threadState.row = oldRow;
+    threadState.pass = oldPass;
+}
+
+ExpressionValue
+AsyncCallBatch::
+call(const void * site,
+     const BoundFunction & fn,
+     std::vector<ExpressionValue> args,
+     const SqlRowScope & scope)
+{
+    ExcAssert(fn.asyncExec);
+
+    AsyncCallBatch * batch = threadState.batch;
+    if (!batch)
+        return fn(args, scope);
+
+    std::vector<Call> & calls = batch->rows[threadState.row];
+
+    if (threadState.pass == START) {
+        std::future<ExpressionValue> result = fn.asyncExec(args);
+        calls.push_back({ site, std::move(args), std::move(result), false });
+        ++batch->numStarted_;
+        return ExpressionValue();
+    }
+
+    for (auto & c: calls) {
+        if (c.taken || c.site != site || c.args != args)
+            continue;
+        c.taken = true;
+        return c.result.get();
+    }
+
+    return fn(args, scope);
+}
+
+} // namespace MLDB
@@ -0,0 +1,89 @@
+/** async_call_batch.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Overlapping of calls to I/O bound functions across a block of rows.
+*/
+
+#pragma once
+
+#include "sql_expression.h"
+#include <atomic>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ASYNC CALL BATCH                                                          */
+/*****************************************************************************/
+
+/** Lets an executor overlap the calls to functions that have an asyncExec
+    (see BoundFunction) over a block of rows, so that a query like
+    SELECT fetcher(url) FROM urls can have hundreds of requests
+    outstanding without a thread waiting on each of them.
+
+    Each row of the block is evaluated twice, with a RowScope telling which
+    pass it is.  In the first pass, asynchronous calls are started and
+    return null; the rest of the output is discarded, as are any
+    exceptions.  In the second pass, the evaluation is done for real, and
+    each asynchronous call waits on the result that was started in the
+    first pass for the same call and arguments.  A call that wasn't seen
+    in the first pass (for example, because it depends on the result of
+    another one) is simply made synchronously.
+
+    Different rows may be evaluated on different threads, but each row is
+    only ever evaluated by one thread at a time.
+*/
+
+struct AsyncCallBatch {
+    AsyncCallBatch(size_t numRows);
+
+    ~AsyncCallBatch();
+
+    enum Pass {
+        START,     ///< Start the calls, and return null
+        FINISH     ///< Wait for the results of the calls
+    };
+
+    /** Makes the given row of the batch the one that's being evaluated on
+        the current thread, in the given pass, while it exists.
+    */
+    struct RowScope {
+        RowScope(AsyncCallBatch & batch, size_t row, Pass pass);
+        ~RowScope();
+
+        RowScope(const RowScope &) = delete;
+        void operator = (const RowScope &) = delete;
+
+    private:
+        AsyncCallBatch * oldBatch;
+        size_t oldRow;
+        Pass oldPass;
+    };
+
+    /** Call the function (which must have an asyncExec) from the given call
+        site with the given arguments, for the row that's being evaluated on
+        the current thread.  Outside of a RowScope this simply calls exec.
+    */
+    static ExpressionValue call(const void * site,
+                                const BoundFunction & fn,
+                                std::vector<ExpressionValue> args,
+                                const SqlRowScope & scope);
+
+    /// Number of asynchronous calls started so far
+    size_t numStarted() const { return numStarted_; }
+
+private:
+    struct Call {
+        const void * site;
+        std::vector<ExpressionValue> args;
+        std::future<ExpressionValue> result;
+        bool taken;
+    };
+
+    std::vector<std::vector<Call> > rows;
+    std::atomic<size_t> numStarted_;
+};
+
+} // namespace MLDB
@@ -7,13 +7,15 @@
 
 #include "sql_expression.h"
 #include "builtin_functions.h"
+#include "sketches.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/jml/utils/csv.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/optimized_path.h"
+#include "mldb/utils/flat_hash_map.h"
 #include <array>
-#include <unordered_set>
+#include <cmath>
 
 using namespace std;
 
@@ -836,12 +838,145 @@ struct DistinctAccum {
         knownValues.insert(src->knownValues.begin(), src->knownValues.end());
     }
     
-    std::unordered_set<CellValue> knownValues;
+    FlatHashSet<CellValue> knownValues;
     Date ts;
 };
 
 static RegisterAggregatorT<DistinctAccum> registerDistinct("count_distinct");
 
+/** Approximate count of distinct values, using a HyperLogLog sketch.  See
+    sketches.h for the details.
+*/
+struct ApproxDistinctAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+
+    ApproxDistinctAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        sketch.add(val.getAtom().hash());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        return ExpressionValue(sketch.estimate(), ts);
+    }
+
+    void merge(ApproxDistinctAccum * src)
+    {
+        ts.setMax(src->ts);
+        sketch.merge(src->sketch);
+    }
+
+    HyperLogLog sketch;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxDistinctAccum>
+registerApproxDistinct("approx_count_distinct");
+
+/** Approximate quantile, using a merging t-digest.  See sketches.h for the
+    details.
+*/
+struct ApproxQuantileAccum {
+    static constexpr int nargs = 2;
+    static constexpr int maxArgs = nargs;
+
+    ApproxQuantileAccum()
+        : quantile(0.5),
+          ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<Float64ValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 2);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        setQuantile(args[1]);
+        digest.add(val.toDouble());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    void setQuantile(const ExpressionValue & q)
+    {
+        quantile = q.toDouble();
+        if (!(quantile >= 0.0 && quantile <= 1.0))
+            throw HttpReturnException
+                (400, "approx_quantile requires a quantile between 0 and 1",
+                 "quantile", q);
+    }
+
+    ExpressionValue extract()
+    {
+        if (digest.empty())
+            return ExpressionValue::null(ts);
+        return ExpressionValue(digest.quantile(quantile), ts);
+    }
+
+    void merge(ApproxQuantileAccum * src)
+    {
+        ts.setMax(src->ts);
+        if (!src->digest.empty())
+            quantile = src->quantile;
+        digest.merge(src->digest);
+    }
+
+    double quantile;
+    TDigest digest;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxQuantileAccum>
+registerApproxQuantile("approx_quantile");
+
+struct ApproxMedianAccum : public ApproxQuantileAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+
+    ApproxMedianAccum(): ApproxQuantileAccum()
+    {
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        digest.add(val.toDouble());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+};
+
+static RegisterAggregatorT<ApproxMedianAccum>
+registerApproxMedian("approx_median");
+
 struct LikelihoodRatioAccum {
     LikelihoodRatioAccum()
         : ts(Date::negativeInfinity())
@@ -14,6 +14,7 @@
 #include "mldb/jml/stats/distribution_simd.h"
 #include "mldb/jml/utils/csv.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/types/compact_vector_description.h"
 #include "mldb/ml/confidence_intervals.h"
 #include "mldb/jml/math/xdiv.h"
 #include "mldb/base/hash.h"
@@ -27,11 +28,13 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/http/curl_wrapper.h"
+#include "mldb/http/http_fetch.h"
 
 #include <iterator>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <future>
 #include <magic.h>
 
 using namespace std;
@@ -259,7 +262,8 @@ struct RegisterBuiltinUnaryScalar {
 
                 ExcAssert(false); // silence bad compiler escape analysis
             };
-        handles.push_back(registerFunction(Utf8String(name), fn));
+        handles.push_back(registerFunction(Utf8String(name), fn,
+                                           true /* deterministic */));
         doRegister(function, std::forward<Names>(names)...);
     }
 
@@ -702,7 +706,8 @@ struct RegisterBuiltinBinaryScalar {
                 ExcAssert(false); // silence bad compiler escape analysis
             };
 
-        handles.push_back(registerFunction(Utf8String(name), fn));
+        handles.push_back(registerFunction(Utf8String(name), fn,
+                                           true /* deterministic */));
         doRegister(function, std::forward<Names>(names)...);
     }
 
@@ -1998,6 +2003,15 @@ BoundFunction horizontal_count(const std::vector<BoundSqlExpression> & args)
                 size_t result = 0;
                 Date ts = Date::negativeInfinity();
 
+                // A flat row has its values in an array, and one timestamp
+                if (args.at(0).getFlatRowSchema()) {
+                    for (auto & val: args[0].getFlatRowValues())
+                        result += !val.empty();
+                    if (result)
+                        ts = args[0].getEffectiveTimestamp();
+                    return ExpressionValue(result, ts);
+                }
+
                 auto onAtom = [&] (const Path & columnName,
                                    const Path & prefix,
                                    const CellValue & val,
@@ -2018,6 +2032,30 @@ BoundFunction horizontal_count(const std::vector<BoundSqlExpression> & args)
 }
 static RegisterBuiltin registerHorizontal_Count(horizontal_count, "horizontal_count");
 
+/** Is the value an embedding of plain numbers, which can be read out as a
+    contiguous buffer?
+*/
+static bool isNumericEmbedding(const ExpressionValue & val)
+{
+    if (!val.isEmbedding())
+        return false;
+    switch (val.getEmbeddingType()) {
+    case ST_FLOAT32:
+    case ST_FLOAT64:
+    case ST_INT8:
+    case ST_UINT8:
+    case ST_INT16:
+    case ST_UINT16:
+    case ST_INT32:
+    case ST_UINT32:
+    case ST_INT64:
+    case ST_UINT64:
+        return true;
+    default:
+        return false;
+    }
+}
+
 BoundFunction horizontal_sum(const std::vector<BoundSqlExpression> & args)
 {
     checkArgsSize(args.size(), 1);
@@ -2025,8 +2063,31 @@ BoundFunction horizontal_sum(const std::vector<BoundSqlExpression> & args)
     return {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
+                // Numeric embeddings have no nulls and a single timestamp,
+                // so they can be summed as a buffer
+                if (isNumericEmbedding(args.at(0))
+                    && args[0].rowLength() > 0) {
+                    auto d = args[0].getEmbeddingDouble();
+                    return ExpressionValue(d.total(),
+                                           args[0].getEffectiveTimestamp());
+                }
+
                 double result = 0;
                 Date ts = Date::negativeInfinity();
+
+                if (args[0].getFlatRowSchema()) {
+                    bool any = false;
+                    for (auto & val: args[0].getFlatRowValues()) {
+                        if (!val.empty()) {
+                            result += val.toDouble();
+                            any = true;
+                        }
+                    }
+                    if (any)
+                        ts = args[0].getEffectiveTimestamp();
+                    return ExpressionValue(result, ts);
+                }
+
                 auto onAtom = [&] (const Path & columnName,
                                    const Path & prefix,
                                    const CellValue & val,
@@ -2311,6 +2372,22 @@ struct RegisterVectorOp {
                      const SqlRowScope & scope) -> ExpressionValue
                 {
                     checkArgsSize(args.size(), 2);
+
+                    // Two numeric embeddings of the same shape are worked
+                    // on directly as buffers, without naming each element
+                    if (isNumericEmbedding(args[0])
+                        && isNumericEmbedding(args[1])) {
+                        auto shape = args[0].getEmbeddingShape();
+                        if (shape == args[1].getEmbeddingShape()) {
+                            auto d1 = args[0].getEmbeddingDouble();
+                            auto d2 = args[1].getEmbeddingDouble();
+                            Date ts = std::min(args[0].getEffectiveTimestamp(),
+                                               args[1].getEffectiveTimestamp());
+                            return ExpressionValue(Op::apply(d1, d2), ts,
+                                                   std::move(shape));
+                        }
+                    }
+
                     distribution<double> embedding1, embedding2;
                     std::shared_ptr<const void> token;
                     Date ts;
@@ -3000,7 +3077,7 @@ BoundFunction clamp(const std::vector<BoundSqlExpression> & args)
                     return ExpressionValue(doAtom(args[0].getAtom()), std::max(args[0].getEffectiveTimestamp(), limitsTs));
                 }
                 else {
-                    std::vector<std::tuple<PathElement, ExpressionValue> > vals;
+                    StructValue vals;
                     auto exec = [&] (const PathElement & columnName,
                                      const ExpressionValue & val) {
 
@@ -3510,7 +3587,8 @@ BoundFunction fetcher(const std::vector<BoundSqlExpression> & args)
                              ColumnSparsity::COLUMN_IS_DENSE);
     auto outputInfo
         = std::make_shared<RowValueInfo>(columnsInfo);
-    return {[=] (const std::vector<ExpressionValue> & args,
+    BoundFunction result
+        {[=] (const std::vector<ExpressionValue> & args,
                  const SqlRowScope & scope) -> ExpressionValue
             {
 
@@ -3553,6 +3631,50 @@ BoundFunction fetcher(const std::vector<BoundSqlExpression> & args)
             },
             outputInfo
         };
+
+    // HTTP fetches are run on the event loop, so that many of them can be
+    // outstanding at once.  Other URLs are fetched when the result is
+    // waited on.
+    auto exec = result.exec;
+    result.asyncExec = [=] (const std::vector<ExpressionValue> & args)
+        -> std::future<ExpressionValue>
+        {
+            std::string url = args.at(0).toUtf8String().rawString();
+            if (!isAsyncHttpUrl(url)) {
+                return std::async(std::launch::deferred,
+                                  [=] () { return exec(args, SqlRowScope()); });
+            }
+
+            auto fetched = std::make_shared<std::future<HttpFetchResult> >
+                (asyncHttpGet(url));
+
+            auto convert = [=] () -> ExpressionValue
+                {
+                    HttpFetchResult fetch = fetched->get();
+
+                    StructValue result;
+                    if (fetch.error.empty()) {
+                        result.emplace_back
+                            ("content",
+                             ExpressionValue(CellValue::blob(std::move(fetch.body)),
+                                             fetch.lastModified));
+                        result.emplace_back
+                            ("error", ExpressionValue::null(Date::notADate()));
+                    }
+                    else {
+                        result.emplace_back
+                            ("content", ExpressionValue::null(Date::notADate()));
+                        result.emplace_back
+                            ("error", ExpressionValue(Utf8String(fetch.error),
+                                                      Date::now()));
+                    }
+                    return result;
+                };
+
+            return std::async(std::launch::deferred, convert);
+        };
+
+    return result;
 }
 static RegisterBuiltin registerFetcherFunction(fetcher, "fetcher");
 
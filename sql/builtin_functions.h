@@ -166,7 +166,8 @@ struct RegisterBuiltin {
                                          "functionArgs", args);
                 }
             };
-        handles.push_back(registerFunction(Utf8String(name), fn));
+        handles.push_back(registerFunction(Utf8String(name), fn,
+                                           determinism == DETERMINISTIC));
         doRegister(function, std::forward<Names>(names)...);
     }
 
@@ -13,6 +13,8 @@
 #include "mldb/utils/possibly_dynamic_buffer.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/arch/simd_vector.h"
+#include <mutex>
+#include <map>
 
 using namespace std;
 
@@ -21,6 +23,46 @@ using namespace std;
 namespace MLDB {
 namespace Builtins {
 
+namespace {
+
+/** Return the pffft setup for transforms of the given size and type.
+
+    Making a setup calculates the twiddle factors, which costs as much as
+    the transform itself for small sizes, and queries call fft() with the
+    same size for every row.  The setups are only read by the transform
+    (the work area is passed in separately) so they are kept and shared
+    between threads.  Returns null if pffft can't do that size.
+*/
+std::shared_ptr<PFFFT_Setup> getFftSetup(size_t n, pffft_transform_t type)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<size_t, int>, std::shared_ptr<PFFFT_Setup> >
+        setups;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    auto & entry = setups[{n, type}];
+    if (entry)
+        return entry;
+
+    PFFFT_Setup * setup = pffft_new_setup(n, type);
+    if (!setup) {
+        setups.erase({n, type});
+        return nullptr;
+    }
+
+    // Don't let lots of different sizes build up; the ones still in use
+    // are kept alive by their callers
+    if (setups.size() > 64) {
+        setups.clear();
+    }
+
+    std::shared_ptr<PFFFT_Setup> result(setup, pffft_destroy_setup);
+    setups[{n, type}] = result;
+    return result;
+}
+
+} // file scope
+
 ExpressionValue fft(const std::vector<ExpressionValue> & args,
                     const SqlRowScope & scope)
 {
@@ -94,13 +136,12 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
                 (400, "Complex input is required for inverse or complex fft");
         }
 
-        PFFFT_Setup * setup = pffft_new_setup(n, type);
+        auto setup = getFftSetup(n, type);
 
         if (!setup) {
             throw HttpReturnException(400, "Couldn't setup fft transform for size "
                                       + to_string(dimsVector[0]));
         }
-        Scope_Exit(pffft_destroy_setup(setup));
 
         // Pffft
         PossiblyDynamicBuffer<float> workspace(n + 3);
@@ -116,7 +157,7 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
     
         args[0].convertEmbedding(data.get(), n, ST_FLOAT32);
     
-        pffft_transform_ordered(setup, data.get(), data.get(), tmp,
+        pffft_transform_ordered(setup.get(), data.get(), data.get(), tmp,
                                 direction);
         
         // From pffft.h
@@ -139,13 +180,12 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
             n *= 2;   // fft of real n -> n/2 x 2, so ifft of n x 2 -> n*2
         }
 
-        PFFFT_Setup * setup = pffft_new_setup(n, type);
+        auto setup = getFftSetup(n, type);
 
         if (!setup) {
             throw HttpReturnException(400, "Couldn't setup complex fft transform for size "
                                       + to_string(n));
         }
-        Scope_Exit(pffft_destroy_setup(setup));
 
         PossiblyDynamicBuffer<float> workspace((n*2) + 3);
 
@@ -160,7 +200,7 @@ ExpressionValue fft(const std::vector<ExpressionValue> & args,
     
         args[0].convertEmbedding(data.get(), nel, ST_FLOAT32);
     
-        pffft_transform_ordered(setup, data.get(), data.get(), tmp,
+        pffft_transform_ordered(setup.get(), data.get(), data.get(), tmp,
                                 direction);
 
         DimsVector newShape;
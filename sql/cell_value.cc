@@ -16,6 +16,8 @@
 #include "mldb/types/itoa.h"
 #include "cell_value_impl.h"
 #include "mldb/base/parse_context.h"
+#include "mldb/base/fast_float_parsing.h"
+#include "mldb/base/fast_int_parsing.h"
 #include "mldb/compiler/compiler.h"
 #include "interval.h"
 #include "path.h"
@@ -51,14 +53,11 @@ CellValue(const Path & path)
             type = ST_SHORT_PATH;
         }
         else {
-            // NOTE: once the malloc has succeeded, the rest is
+            // NOTE: once the allocation has succeeded, the rest is
             // noexcept.
-            void * mem = malloc(sizeof(StringRepr) + strLength);
-            if (!mem)
-                throw std::bad_alloc();
-
-            longString = new (mem) StringRepr;  // placement new noexcept
+            longString = allocString(strLength);
             std::copy(p, p + strLength, longString->repr); // copy char noexcept
+            longString->repr[strLength] = 0;
             type = ST_LONG_PATH;
         }
 
@@ -82,9 +81,9 @@ CellValue(const Path & path)
         type = ST_SHORT_PATH;
     }
     else {
-        void * mem = malloc(sizeof(StringRepr) + strLength);
-        longString = new (mem) StringRepr;
+        longString = allocString(strLength);
         std::copy(u.rawData(), u.rawData() + strLength, longString->repr);
+        longString->repr[strLength] = 0;
         type = ST_LONG_PATH;
     }
 }
@@ -203,10 +202,9 @@ initString(const char * stringValue, size_t len, bool isUtf8, bool check)
         else {
             type = ST_ASCII_LONG_STRING;
         }
-        void * mem = malloc(sizeof(StringRepr) + strLength + 1);
-        longString = new (mem) StringRepr;
+        longString = allocString(strLength);
         std::copy(s, e, longString->repr);
-        longString->repr[strLength + 1] = 0;
+        longString->repr[strLength] = 0;
     }
 }
 
@@ -220,9 +218,9 @@ initBlob(const char * data, size_t len)
         type = ST_SHORT_BLOB;
     }
     else {
-        void * mem = malloc(sizeof(StringRepr) + len);
-        longString = new (mem) StringRepr;
+        longString = allocString(len);
         std::copy(data, data + len, longString->repr);
+        longString->repr[len] = 0;
         type = ST_LONG_BLOB;
     }
 }
@@ -235,11 +233,8 @@ CellValue(const CellValue & other)
         || other.type == ST_UTF8_LONG_STRING
         || other.type == ST_LONG_BLOB
         || other.type == ST_LONG_PATH) {
-        void * mem = malloc(sizeof(StringRepr) + other.strLength + 1);
-        longString = new (mem) StringRepr;
-        std::copy(other.longString->repr, other.longString->repr + strLength,
-                  longString->repr);
-        longString->repr[strLength] = 0;
+        // The representation is immutable, so we can share it
+        longString->ref.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
@@ -258,14 +253,11 @@ parse(const Utf8String & str)
 }
 
 /**
-   This implementation is slow but correct.  If this becomes the 
-   bottleneck of some scenarios (e.g. importing large csv file) consider
-   rewriting it without a copy of the buffer and by combining the three
-   independent parsing cases into one.  Note that any implementation
-   should be able to detect correctly overflow and underflow.  Also, it
-   should minimize rounding errors as it is done in strtod implementation.
-   See for example https://fossies.org/dox/glibc-2.24/strtod__l_8c_source.html
-   from the glic for an overview of the challenges.
+   The common cases, integers that fit in 64 bits and decimal numbers, are
+   parsed straight out of the string.  Anything else (leading whitespace,
+   hexadecimal, infinities and NaNs, integers too big for a signed 64 bit
+   value) goes through strtoll, strtoull and strtod on a null terminated
+   copy, which take care of overflow and underflow.
 */
 CellValue
 CellValue::
@@ -274,6 +266,29 @@ parse(const char * s_, size_t len, StringCharacteristics characteristics)
     if (len == 0)
         return CellValue();
 
+    const char * end = s_ + len;
+
+    // An integer of up to 18 digits can't overflow
+    {
+        const char * p = s_;
+        bool negative = *p == '-';
+        if (*p == '-' || *p == '+')
+            ++p;
+        uint64_t val = 0;
+        const char * e = parseDecimalDigits(p, end, val);
+        if (e == end && e != p && e - p <= 18)
+            return CellValue(negative ? -int64_t(val) : int64_t(val));
+    }
+
+    // A decimal number
+    {
+        double floatVal;
+        bool isInteger = false;
+        const char * e = parseDecimalDouble(s_, end, floatVal, &isInteger);
+        if (e == end && !isInteger)
+            return CellValue(floatVal);
+    }
+
     // this ensures that our buffer is null terminated as required below
     PossiblyDynamicBuffer<char, 256> sv(len + 1);
     memcpy(sv.data(), s_, len);
@@ -1207,14 +1222,112 @@ void
 CellValue::
 deleteString()
 {
-    if (longString) {
-        longString->~StringRepr();
-        free(longString);
-    }
+    if (longString)
+        releaseString(longString, strLength);
     type = ST_EMPTY;
     longString = nullptr;
 }
 
+namespace {
+
+/** Per-thread cache of freed long string blocks.  Blocks are rounded up
+    to a multiple of the size class granularity, so that any cached block
+    of a given class can hold any string of that class.  Long strings in
+    rows are overwhelmingly short (a few tens of bytes), so only small
+    blocks are cached, and a limited number of each, which bounds the
+    memory held by each thread.  A block may be freed on a different
+    thread to the one that allocated it, in which case it simply moves
+    to that thread's cache.
+*/
+struct StringBlockCache {
+    static constexpr size_t GRANULARITY = 32;
+    static constexpr size_t NUM_CLASSES = 8;
+    static constexpr size_t MAX_PER_CLASS = 256;
+
+    static size_t sizeClass(size_t bytes)
+    {
+        return (bytes - 1) / GRANULARITY;
+    }
+
+    void clear()
+    {
+        for (auto & c: classes) {
+            for (size_t i = 0;  i < c.count;  ++i)
+                free(c.blocks[i]);
+            c.count = 0;
+        }
+    }
+
+    struct Class {
+        size_t count;
+        void * blocks[MAX_PER_CLASS];
+    };
+
+    Class classes[NUM_CLASSES];
+};
+
+// Plain (trivially destructible) part of the cache, which remains usable
+// while other thread local objects holding CellValues are destroyed.
+thread_local StringBlockCache stringBlockCache;
+thread_local bool stringBlockCacheDisabled = false;
+
+// Frees the cached blocks on thread exit; anything released afterwards
+// goes straight back to malloc.
+struct StringBlockCacheCleanup {
+    ~StringBlockCacheCleanup()
+    {
+        stringBlockCache.clear();
+        stringBlockCacheDisabled = true;
+    }
+};
+
+thread_local StringBlockCacheCleanup stringBlockCacheCleanup;
+
+} // file scope
+
+CellValue::StringRepr *
+CellValue::
+allocString(size_t len)
+{
+    size_t bytes = sizeof(StringRepr) + len + 1;
+    size_t cls = StringBlockCache::sizeClass(bytes);
+
+    void * mem;
+    if (cls < StringBlockCache::NUM_CLASSES) {
+        // Make sure the cleanup runs on thread exit
+        (void)&stringBlockCacheCleanup;
+        auto & c = stringBlockCache.classes[cls];
+        if (c.count)
+            mem = c.blocks[--c.count];
+        else mem = malloc((cls + 1) * StringBlockCache::GRANULARITY);
+    }
+    else mem = malloc(bytes);
+
+    if (!mem)
+        throw std::bad_alloc();
+    return new (mem) StringRepr;  // placement new noexcept
+}
+
+void
+CellValue::
+releaseString(StringRepr * repr, size_t len) noexcept
+{
+    if (repr->ref.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    repr->~StringRepr();
+
+    size_t cls = StringBlockCache::sizeClass(sizeof(StringRepr) + len + 1);
+    if (cls < StringBlockCache::NUM_CLASSES && !stringBlockCacheDisabled) {
+        auto & c = stringBlockCache.classes[cls];
+        if (c.count < StringBlockCache::MAX_PER_CLASS) {
+            c.blocks[c.count++] = repr;
+            return;
+        }
+    }
+    free(repr);
+}
+
 Utf8String
 CellValue::
 trimmedExceptionString() const
@@ -150,7 +150,7 @@ struct CellValue {
     MLDB_ALWAYS_INLINE ~CellValue()
     {
         if (type == ST_ASCII_LONG_STRING || type == ST_UTF8_LONG_STRING
-            || type == ST_LONG_BLOB)
+            || type == ST_LONG_BLOB || type == ST_LONG_PATH)
             deleteString();
     }
 
@@ -430,6 +430,21 @@ private:
 
     void deleteString();
 
+    struct StringRepr;
+
+    /** Allocate the out of line storage for a long string, blob or path
+        of the given length (plus a null terminator).  Blocks are recycled
+        through a per-thread cache, so that the temporaries created and
+        destroyed for each row don't need to go back to malloc.  The
+        returned block has a reference count of one.
+    */
+    static StringRepr * allocString(size_t len);
+
+    /** Drop a reference to a block returned by allocString, returning
+        it to the per-thread cache when the last one goes away.
+    */
+    static void releaseString(StringRepr * repr, size_t len) noexcept;
+
     std::string printInterval() const;
 
     Utf8String trimmedExceptionString() const;
@@ -456,9 +471,13 @@ private:
         ST_LONG_PATH
     };
 
+    /** Out of line storage for long strings, blobs and paths.  It's
+        immutable once constructed, and so it's shared (with a reference
+        count) between copies of the same value rather than duplicated.
+    */
     struct StringRepr {
         StringRepr() noexcept
-            : hash(0), ref(0)
+            : hash(0), ref(1)
         {
         }
 
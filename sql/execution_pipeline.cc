@@ -10,6 +10,11 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/base/cancellation.h"
+#include "mldb/arch/demangle.h"
+#include "mldb/arch/timers.h"
+#include "query_profile.h"
+#include "mldb/base/trace_events.h"
 #include <algorithm>
 
 
@@ -386,13 +391,183 @@ bool
 ElementExecutor::
 takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
 {
-    std::shared_ptr<PipelineResults> res;
-    while ((res = take()))
-        if (!onResult(res))
-            return false;
+    PipelineResultsBatch batch;
+    batch.reserve(DEFAULT_BATCH_SIZE);
+    while (takeBatch(batch, DEFAULT_BATCH_SIZE)) {
+        checkCancelled();
+        for (auto & res: batch)
+            if (!onResult(res))
+                return false;
+        batch.clear();
+    }
     return true;
 }
 
+size_t
+ElementExecutor::
+takeBatch(PipelineResultsBatch & output, size_t maxRows)
+{
+    size_t numTaken = 0;
+    std::shared_ptr<PipelineResults> res;
+    checkCancelled();
+    while (numTaken < maxRows && (res = take())) {
+        output.emplace_back(std::move(res));
+        ++numTaken;
+    }
+    return numTaken;
+}
+
+/*****************************************************************************/
+/* BOUND PIPELINE ELEMENT                                                    */
+/*****************************************************************************/
+
+namespace {
+
+/** Executor that records what passes through another into a profile. */
+struct ProfiledExecutor: public ElementExecutor {
+    ProfiledExecutor(std::shared_ptr<ElementExecutor> inner,
+                     QueryProfile * profile)
+        : inner(std::move(inner)), profile(profile)
+    {
+    }
+
+    std::shared_ptr<ElementExecutor> inner;
+    QueryProfile * profile;
+
+    virtual std::shared_ptr<PipelineResults> take()
+    {
+        QueryProfile::Timer timer(profile);
+        auto result = inner->take();
+        if (result)
+            profile->recordRowsOut(1);
+        return result;
+    }
+
+    virtual size_t takeBatch(PipelineResultsBatch & output, size_t maxRows)
+    {
+        QueryProfile::Timer timer(profile);
+        size_t numTaken = inner->takeBatch(output, maxRows);
+        profile->recordRowsOut(numTaken);
+        return numTaken;
+    }
+
+    virtual bool
+    takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
+    {
+        // The callback belongs to the consumer, so its time is taken
+        // back out of ours.
+        std::mutex callbackMutex;
+        double callbackWall = 0, callbackCpu = 0;
+
+        auto onResult2 = [&] (std::shared_ptr<PipelineResults> & result)
+            {
+                profile->recordRowsOut(1);
+                double wall = wall_time(), cpu = QueryProfile::threadCpuTime();
+                bool keepGoing = onResult(result);
+                double cpuUsed = QueryProfile::threadCpuTime() - cpu;
+                double wallUsed = wall_time() - wall;
+                std::unique_lock<std::mutex> guard(callbackMutex);
+                callbackWall += wallUsed;
+                callbackCpu += cpuUsed;
+                return keepGoing;
+            };
+
+        double wall = wall_time(), cpu = QueryProfile::threadCpuTime();
+        bool result = inner->takeAll(onResult2);
+        profile->recordTime(wall_time() - wall - callbackWall,
+                            QueryProfile::threadCpuTime() - cpu - callbackCpu);
+        return result;
+    }
+
+    virtual void restart()
+    {
+        inner->restart();
+    }
+};
+
+/** Executor that records what another does as spans in the trace. */
+struct TracedExecutor: public ElementExecutor {
+    TracedExecutor(std::shared_ptr<ElementExecutor> inner,
+                   std::string name)
+        : inner(std::move(inner)), name(std::move(name))
+    {
+    }
+
+    std::shared_ptr<ElementExecutor> inner;
+    std::string name;
+
+    virtual std::shared_ptr<PipelineResults> take()
+    {
+        TraceSpan span("pipeline", "take", name);
+        return inner->take();
+    }
+
+    virtual size_t takeBatch(PipelineResultsBatch & output, size_t maxRows)
+    {
+        TraceSpan span("pipeline", "takeBatch", name);
+        return inner->takeBatch(output, maxRows);
+    }
+
+    virtual bool
+    takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
+    {
+        // The callbacks show up as spans of the consumer, nested in this
+        TraceSpan span("pipeline", "takeAll", name);
+        return inner->takeAll(std::move(onResult));
+    }
+
+    virtual void restart()
+    {
+        inner->restart();
+    }
+};
+
+/** Name of the element in a profile: JoinElement::Bound is JoinElement. */
+Utf8String elementName(const BoundPipelineElement & element)
+{
+    std::string name = type_name(element);
+    if (name.find("MLDB::") == 0)
+        name = name.substr(6);
+    static const std::string bound = "::Bound";
+    if (name.size() > bound.size()
+        && name.compare(name.size() - bound.size(), bound.size(), bound) == 0)
+        name.resize(name.size() - bound.size());
+    return Utf8String(name);
+}
+
+} // file scope
+
+std::shared_ptr<ElementExecutor>
+BoundPipelineElement::
+startProfiled(const BoundParameters & getParam) const
+{
+    // The root of a pipeline only outputs the empty row that starts it
+    if (!boundSource())
+        return start(getParam);
+
+    std::shared_ptr<ElementExecutor> executor;
+
+    QueryProfile * parent = QueryProfile::current();
+    if (parent) {
+        QueryProfile * profile = parent->addChild(elementName(*this));
+        {
+            QueryProfile::Scope scope(profile);
+            QueryProfile::Timer timer(profile);
+            executor = start(getParam);
+        }
+        executor = std::make_shared<ProfiledExecutor>(std::move(executor),
+                                                      profile);
+    }
+    else executor = start(getParam);
+
+    if (TraceEvents::enabled()) {
+        executor = std::make_shared<TracedExecutor>
+            (std::move(executor), elementName(*this).rawString());
+    }
+
+    return executor;
+}
+
 /*****************************************************************************/
 /* PIPELINE ELEMENT                                                          */
 /*****************************************************************************/
@@ -549,9 +724,10 @@ select(const TupleExpression & tup)
 
 std::shared_ptr<PipelineElement>
 PipelineElement::
-sort(OrderByExpression orderBy)
+sort(OrderByExpression orderBy, ssize_t maxRows)
 {
-    return std::make_shared<OrderByElement>(shared_from_this(), orderBy);
+    return std::make_shared<OrderByElement>(shared_from_this(), orderBy,
+                                            maxRows);
 }
 
 std::shared_ptr<PipelineElement>
@@ -563,7 +739,8 @@ partition(int numElements)
 
 std::shared_ptr<PipelineElement>
 PipelineElement::
-statement(const SelectStatement& stm, GetParamInfo getParamInfo)
+statement(const SelectStatement& stm, GetParamInfo getParamInfo,
+          ssize_t maxRows)
 {
     auto root = shared_from_this();
 
@@ -591,7 +768,7 @@ statement(const SelectStatement& stm, GetParamInfo getParamInfo)
             ->partition(groupBy.clauses.size())
             ->where(stm.having)
             ->select(stm.orderBy)
-            ->sort(stm.orderBy)
+            ->sort(stm.orderBy, maxRows)
             ->select(stm.rowName)  // second last element is rowname
             ->select(stm.select);
     }
@@ -604,7 +781,7 @@ statement(const SelectStatement& stm, GetParamInfo getParamInfo)
                    OrderByExpression(), getParamInfo)
             ->where(stm.where)
             ->select(stm.orderBy)
-            ->sort(stm.orderBy)
+            ->sort(stm.orderBy, maxRows)
             ->select(stm.rowName)  // second last element is rowname
             ->select(stm.select);
         }
@@ -217,15 +217,37 @@ private:
 /* ELEMENT EXECUTOR                                                          */
 /*****************************************************************************/
 
+/// A block of rows that is passed through the pipeline at once
+typedef std::vector<std::shared_ptr<PipelineResults> > PipelineResultsBatch;
+
 struct ElementExecutor {
 
     virtual ~ElementExecutor()
     {
     }
 
-    /** Take one element from the pipeline. */
+    /// Number of rows that is normally asked for in each call to takeBatch()
+    static constexpr size_t DEFAULT_BATCH_SIZE = 1024;
+
+    /** Take one element from the pipeline.  The elements that read rows
+        check the current thread's cancellation token (see
+        mldb/base/cancellation.h), and throw once the query is no longer
+        wanted.
+    */
     virtual std::shared_ptr<PipelineResults> take() = 0;
 
+    /** Take up to maxRows elements from the pipeline, appending them to
+        output.  Returns the number of elements that were added; zero
+        means that the pipeline is exhausted.
+
+        This amortizes the per-row virtual calls of take() over the whole
+        batch, and allows elements to process a block of rows in a tight
+        loop.  The default implementation simply calls take() repeatedly;
+        elements that can do better override it.
+    */
+    virtual size_t takeBatch(PipelineResultsBatch & output,
+                             size_t maxRows = DEFAULT_BATCH_SIZE);
+
     /** Take all elements from the pipeline.  inParallel describes whether
         the function can be called from multiple threads at once.
     */
@@ -250,6 +272,14 @@ struct BoundPipelineElement {
     virtual std::shared_ptr<ElementExecutor>
     start(const BoundParameters & getParam) const = 0;
 
+    /** Start running the query, recording the rows and time of the
+        element into a node under the current query profile if there is
+        one (see query_profile.h).  Elements start their sources with this
+        so that an explained query gets the whole tree.
+    */
+    std::shared_ptr<ElementExecutor>
+    startProfiled(const BoundParameters & getParam) const;
+
     /** Return the scope that describes the output of this element. */
     virtual std::shared_ptr<PipelineExpressionScope>
     outputScope() const = 0;
@@ -370,8 +400,12 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     std::shared_ptr<PipelineElement>
     select(const OrderByExpression & select);
 
+    /** Sort the rows.  If maxRows is non-negative, only the first maxRows
+        rows of the sorted output will be taken, which allows the sort to
+        keep just those rows instead of all of its input.
+    */
     std::shared_ptr<PipelineElement>
-    sort(OrderByExpression sortBy);
+    sort(OrderByExpression sortBy, ssize_t maxRows = -1);
 
     std::shared_ptr<PipelineElement>
     select(const TupleExpression & tup);
@@ -388,9 +422,14 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     std::shared_ptr<PipelineElement>
     select(std::shared_ptr<SqlExpression> select);
 
-    // return a pipeline that will execute the specified statement
+    /** Return a pipeline that will execute the specified statement.  If
+        maxRows is non-negative, the caller will take no more than that
+        many rows (usually the statement's offset plus its limit), which
+        allows the ORDER BY to keep only the top rows.
+    */
     std::shared_ptr<PipelineElement>
-    statement(const SelectStatement& statement, GetParamInfo getParamInfo);
+    statement(const SelectStatement& statement, GetParamInfo getParamInfo,
+              ssize_t maxRows = -1);
 };
 
 } // namespace MLDB
@@ -17,7 +17,17 @@
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/scope.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 #include "mldb/utils/log.h"
+#include "mldb/utils/flat_hash_map.h"
+#include "mldb/jml/utils/environment.h"
+#include "query_profile.h"
+#include "mldb/core/dataset.h"
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+#include <stdlib.h>
 
 using namespace std;
 
@@ -25,6 +35,24 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/// Implement equijoins with a HashJoinExecutor instead of sorting
+EnvOption<bool> MLDB_HASH_JOIN("MLDB_HASH_JOIN", false);
+
+/// Bytes of right side rows a hash join keeps in memory before spilling
+EnvOption<size_t> MLDB_HASH_JOIN_MEMORY_BUDGET
+    ("MLDB_HASH_JOIN_MEMORY_BUDGET", size_t(1) << 30);
+
+/// Number of partitions that a hash join splits its input into
+EnvOption<int> MLDB_HASH_JOIN_PARTITIONS("MLDB_HASH_JOIN_PARTITIONS", 64);
+
+/// Directory for the files of spilled hash join partitions
+EnvOption<std::string> MLDB_HASH_JOIN_SPILL_DIR
+    ("MLDB_HASH_JOIN_SPILL_DIR", "/tmp");
+
+} // file scope
+
 /*****************************************************************************/
 /* TABLE LEXICAL SCOPE                                                       */
 /*****************************************************************************/
@@ -268,6 +296,9 @@ std::shared_ptr<PipelineResults>
 GenerateRowsExecutor::
 take()
 {
+    // Stop reading rows as soon as nobody wants them anymore
+    checkCancelled();
+
     // Return the row itself as the value, and the row's name as
     // metadata.
     auto result = source->take();
@@ -289,6 +320,49 @@ take()
     return result;
 }
 
+size_t
+GenerateRowsExecutor::
+takeBatch(PipelineResultsBatch & output, size_t maxRows)
+{
+    size_t numTaken = 0;
+
+    while (numTaken < maxRows) {
+        // We need a source row as the scope to generate in, and then one
+        // source row per output row.
+        auto first = source->take();
+        if (!first)
+            break;
+
+        if (currentDone == current.size() && !generateMore(*first))
+            break;
+
+        size_t numToTake = std::min(maxRows - numTaken,
+                                    current.size() - currentDone);
+
+        size_t startAt = output.size();
+        output.emplace_back(std::move(first));
+        if (numToTake > 1)
+            source->takeBatch(output, numToTake - 1);
+
+        // Fill in the rows directly from the generated block
+        for (size_t i = startAt;  i < output.size();  ++i) {
+            PipelineResults & result = *output[i];
+            result.values.emplace_back(current[currentDone].rowName,
+                                       Date::notADate());
+            result.values.emplace_back
+                (std::move(current[currentDone].columns));
+            ++currentDone;
+        }
+
+        size_t numAdded = output.size() - startAt;
+        numTaken += numAdded;
+        if (numAdded < numToTake)
+            break;  // source is exhausted
+    }
+
+    return numTaken;
+}
+
 void
 GenerateRowsExecutor::
 restart()
@@ -347,7 +421,7 @@ GenerateRowsElement::Bound::
 start(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<GenerateRowsExecutor>();
-    result->source = source_->start(getParam);
+    result->source = source_->startProfiled(getParam);
 
     result->generator
         = parent->from.runQuery(*outputScope_,
@@ -357,6 +431,10 @@ start(const BoundParameters & getParam) const
                                 parent->orderBy,
                                 0 /* offset */, -1 /* limit */,
                                 nullptr /*onProgress*/);
+    if (QueryProfile * profile = QueryProfile::current()) {
+        if (!result->generator.explain.empty())
+            profile->setStrategy(result->generator.explain);
+    }
     result->params = getParam;
     ExcAssert(result->params);
     return result;
@@ -455,7 +533,7 @@ SubSelectExecutor::
 SubSelectExecutor(std::shared_ptr<BoundPipelineElement> boundSelect,
                   const BoundParameters & getParam)
 {
-    pipeline = boundSelect->start(getParam);
+    pipeline = boundSelect->startProfiled(getParam);
 }
 
 std::shared_ptr<PipelineResults>
@@ -803,6 +881,39 @@ outputAdded() const
 /* JOIN ELEMENT                                                              */
 /*****************************************************************************/
 
+namespace {
+
+/** Return what's known about one side of an equijoin without running it.
+    The number of rows is that of the dataset, even if the side has a
+    WHERE clause, and the distinct keys are only known when the key is the
+    row name.
+*/
+JoinSideStats
+getJoinSideStats(const BoundTableExpression & table,
+                 const AnnotatedJoinCondition::Side & side)
+{
+    JoinSideStats result;
+    if (!table.dataset)
+        return result;
+
+    try {
+        result.rows = table.dataset->getRowCount();
+    } catch (const std::exception & exc) {
+        return result;
+    }
+
+    auto & key = *side.selectExpression;
+    if (key.getType() == "function"
+        && (key.getOperation() == "rowName"
+            || key.getOperation() == "rowPath"
+            || key.getOperation() == "rowHash"))
+        result.distinctKeys = result.rows;
+
+    return result;
+}
+
+} // file scope
+
 JoinElement::
 JoinElement(std::shared_ptr<PipelineElement> root,
             std::shared_ptr<TableExpression> left,
@@ -817,11 +928,19 @@ JoinElement(std::shared_ptr<PipelineElement> root,
     : root(root),
       left(left), boundLeft(boundLeft), right(right), boundRight(boundRight),
       on(on), select(select), where(where), orderBy(orderBy),
-      condition(left, right, on, where, joinQualification), joinQualification(joinQualification)
+      condition(left, right, on, where, joinQualification), joinQualification(joinQualification),
+      hashJoin(false),
+      buildLeft(false)
 {
     switch (condition.style) {
     case AnnotatedJoinCondition::CROSS_JOIN:
+        break;
     case AnnotatedJoinCondition::EQUIJOIN:
+        plan = planEquiJoin(getJoinSideStats(boundLeft, condition.left),
+                            getJoinSideStats(boundRight, condition.right),
+                            false /* sortOutput */);
+        hashJoin = MLDB_HASH_JOIN || plan.strategy == JOIN_STRATEGY_HASH;
+        buildLeft = hashJoin && plan.buildLeft;
         break;
     default:
         throw HttpReturnException(400, "Join expression requires an equality operator; needs to be in the form f(left) = f(right)",
@@ -876,16 +995,17 @@ JoinElement(std::shared_ptr<PipelineElement> root,
     auto leftEmbedding = std::make_shared<EmbeddingLiteralExpression>(leftclauses.clauses);
     auto rightEmbedding = std::make_shared<EmbeddingLiteralExpression>(rightclauses.clauses);
 
+    // A hash join doesn't need its input sorted
     leftImpl= root
         ->where(constantWhere)
         ->from(left, boundLeft, when, selectAll, leftCondition,
-               condition.left.orderBy)
+               hashJoin ? OrderByExpression() : condition.left.orderBy)
         ->select(leftEmbedding);
 
     rightImpl = root
         ->where(constantWhere)
         ->from(right, boundRight, when, selectAll, rightCondition,
-               condition.right.orderBy)
+               hashJoin ? OrderByExpression() : condition.right.orderBy)
         ->select(rightEmbedding);
 }
 
@@ -897,7 +1017,9 @@ bind() const
                                    leftImpl->bind(),
                                    rightImpl->bind(),
                                    condition,
-                                   joinQualification);
+                                   joinQualification,
+                                   hashJoin,
+                                   buildLeft);
 }
 
 
@@ -1573,6 +1695,527 @@ restart()
 }
 
 
+/*****************************************************************************/
+/* HASH JOIN EXECUTOR                                                        */
+/*****************************************************************************/
+
+namespace {
+
+/// Rough estimate of the memory held by a row, to apply the budget
+size_t estimateMemory(const PipelineResults & row)
+{
+    size_t result = sizeof(PipelineResults);
+    for (auto & v: row.values)
+        result += v.memusage();
+    return result;
+}
+
+/** Extract the join key from the embedding that both sides put at the end
+    of their rows, returning false if the row can't match anything (the
+    key is null, or the row fails its side's condition).
+*/
+bool getJoinKey(const PipelineResults & row,
+                ExpressionValue & key, uint64_t & hash)
+{
+    const ExpressionValue & embedding = row.values.back();
+    key = embedding.getColumn(0, GET_ALL);
+    if (key.empty() || !embedding.getColumn(1, GET_ALL).isTrue())
+        return false;
+    hash = key.hash();
+    return true;
+}
+
+/** Temporary file holding the rows of a spilled partition, one JSON line
+    each.  The file is unlinked as soon as it's open, so it goes away with
+    the stream whatever happens to the query.
+*/
+struct SpillFile {
+    SpillFile()
+        : numRows(0)
+    {
+        std::string dir = MLDB_HASH_JOIN_SPILL_DIR.get();
+        std::string pattern = dir + "/mldb-hash-join-XXXXXX";
+        std::vector<char> filename(pattern.begin(), pattern.end());
+        filename.push_back(0);
+
+        int fd = mkstemp(filename.data());
+        if (fd == -1)
+            throw HttpReturnException
+                (500, "Couldn't create hash join spill file: "
+                 + string(strerror(errno)),
+                 "directory", dir);
+        stream.open(filename.data(),
+                    std::ios::in | std::ios::out | std::ios::binary);
+        ::close(fd);
+        ::unlink(filename.data());
+        if (!stream)
+            throw HttpReturnException
+                (500, "Couldn't open hash join spill file",
+                 "directory", dir);
+    }
+
+    void write(const PipelineResults & row)
+    {
+        stream << jsonEncodeStr(row.values) << '\n';
+        if (!stream)
+            throw HttpReturnException
+                (500, "Error writing to hash join spill file");
+        ++numRows;
+    }
+
+    void rewind()
+    {
+        stream.flush();
+        stream.seekg(0);
+    }
+
+    /// Read the next row, filling in the rest from the prototype
+    std::shared_ptr<PipelineResults>
+    read(const PipelineResults & prototype)
+    {
+        std::string line;
+        if (!std::getline(stream, line))
+            return nullptr;
+        auto result = std::make_shared<PipelineResults>(prototype);
+        result->values = jsonDecodeStr<std::vector<ExpressionValue> >(line);
+        return result;
+    }
+
+    std::fstream stream;
+    size_t numRows;
+};
+
+std::shared_ptr<PipelineResults>
+makePrototype(const PipelineResults & row)
+{
+    auto result = std::make_shared<PipelineResults>(row.inner);
+    result->getParam = row.getParam;
+    return result;
+}
+
+static constexpr uint32_t NO_MATCH = -1;
+
+} // file scope
+
+struct JoinElement::HashJoinExecutor::Partition {
+    Partition()
+        : memoryUsed(0)
+    {
+    }
+
+    struct Entry {
+        std::shared_ptr<PipelineResults> row;
+        ExpressionValue key;
+        uint64_t hash;
+        bool joinable;
+        bool matched;
+    };
+
+    std::vector<Entry> rows;
+    size_t memoryUsed;
+
+    /// Index from key hash to the first entry with it; next links the
+    /// rest of the entries with the same hash.
+    FlatHashMap<uint64_t, uint32_t> index;
+    std::vector<uint32_t> next;
+
+    /// If spilled, rows from each side that are waiting to be joined
+    std::unique_ptr<SpillFile> buildSpill, probeSpill;
+
+    void add(std::shared_ptr<PipelineResults> row)
+    {
+        Entry entry;
+        entry.joinable = getJoinKey(*row, entry.key, entry.hash);
+        entry.matched = false;
+        memoryUsed += estimateMemory(*row);
+        entry.row = std::move(row);
+        rows.emplace_back(std::move(entry));
+    }
+
+    /// Build the index.  It's built backwards so that each hash chain
+    /// goes through the rows in order.
+    void buildIndex()
+    {
+        index.clear();
+        index.reserve(rows.size());
+        next.assign(rows.size(), NO_MATCH);
+        for (size_t i = rows.size();  i > 0;  --i) {
+            const Entry & entry = rows[i - 1];
+            if (!entry.joinable)
+                continue;
+            auto res = index.insert({ entry.hash, uint32_t(i - 1) });
+            if (!res.second) {
+                next[i - 1] = res.first->second;
+                res.first->second = i - 1;
+            }
+        }
+    }
+
+    void spill()
+    {
+        ExcAssert(!buildSpill);
+        buildSpill.reset(new SpillFile());
+        for (auto & e: rows)
+            buildSpill->write(*e.row);
+        clear();
+    }
+
+    /// Load the rows of a spilled partition back in, ready to join
+    void unspill(const PipelineResults & prototype)
+    {
+        buildSpill->rewind();
+        while (auto row = buildSpill->read(prototype))
+            add(std::move(row));
+        buildSpill.reset();
+        buildIndex();
+        if (probeSpill)
+            probeSpill->rewind();
+    }
+
+    void clear()
+    {
+        std::vector<Entry>().swap(rows);
+        std::vector<uint32_t>().swap(next);
+        index.clear();
+        memoryUsed = 0;
+    }
+};
+
+JoinElement::HashJoinExecutor::
+HashJoinExecutor(const Bound * parent,
+                 std::shared_ptr<ElementExecutor> root,
+                 std::shared_ptr<ElementExecutor> left,
+                 std::shared_ptr<ElementExecutor> right,
+                 size_t leftAdded,
+                 size_t rightAdded)
+    : parent(parent),
+      root(std::move(root)),
+      left(std::move(left)),
+      right(std::move(right)),
+      leftAdded(leftAdded),
+      rightAdded(rightAdded),
+      buildLeft(parent->buildLeft_),
+      phase(BUILD),
+      memoryUsed(0),
+      numBuildRows(0),
+      currentPartition(0),
+      outerBuildIndex(0),
+      probeHash(0),
+      probePartition(nullptr),
+      nextMatch(NO_MATCH),
+      probeMatched(false),
+      logger(getMldbLog<HashJoinExecutor>())
+{
+    JoinQualification q = parent->joinQualification_;
+    bool outerLeft = q == JOIN_LEFT || q == JOIN_FULL;
+    bool outerRight = q == JOIN_RIGHT || q == JOIN_FULL;
+    outerBuild = buildLeft ? outerLeft : outerRight;
+    outerProbe = buildLeft ? outerRight : outerLeft;
+}
+
+JoinElement::HashJoinExecutor::
+~HashJoinExecutor()
+{
+}
+
+void
+JoinElement::HashJoinExecutor::
+build()
+{
+    int numPartitions = std::max<int>(1, MLDB_HASH_JOIN_PARTITIONS);
+    partitions.clear();
+    for (int i = 0;  i < numPartitions;  ++i)
+        partitions.emplace_back(new Partition());
+
+    auto & buildSide = buildLeft ? left : right;
+    while (auto row = buildSide->take())
+        addBuildRow(std::move(row));
+
+    size_t numSpilled = 0;
+    for (auto & p: partitions)
+        numSpilled += bool(p->buildSpill);
+
+    DEBUG_MSG(logger) << "hash join read " << numBuildRows
+                      << (buildLeft ? " left" : " right") << " rows; "
+                      << numSpilled << " of "
+                      << partitions.size() << " partitions spilled";
+
+    auto buildIndex = [&] (size_t i)
+        {
+            if (!partitions[i]->buildSpill)
+                partitions[i]->buildIndex();
+        };
+
+    parallelMap(0, partitions.size(), buildIndex);
+
+    phase = PROBE;
+}
+
+void
+JoinElement::HashJoinExecutor::
+addBuildRow(std::shared_ptr<PipelineResults> row)
+{
+    if (!buildPrototype)
+        buildPrototype = makePrototype(*row);
+
+    // Rows that can't match are spread around so that they don't all
+    // end up in the same partition.
+    ExpressionValue key;
+    uint64_t hash;
+    size_t partitionNum = getJoinKey(*row, key, hash)
+        ? hash % partitions.size()
+        : numBuildRows % partitions.size();
+    ++numBuildRows;
+
+    Partition & partition = *partitions[partitionNum];
+
+    if (partition.buildSpill) {
+        partition.buildSpill->write(*row);
+        return;
+    }
+
+    size_t before = partition.memoryUsed;
+    partition.add(std::move(row));
+    memoryUsed += partition.memoryUsed - before;
+
+    // Going over the budget of the query spills rather than failing it
+    bool withinBudget = reserved.tryResize(memoryUsed);
+    while ((memoryUsed > MLDB_HASH_JOIN_MEMORY_BUDGET.get() || !withinBudget)
+           && memoryUsed > 0) {
+        spillLargestPartition();
+        withinBudget = reserved.tryResize(memoryUsed);
+    }
+}
+
+void
+JoinElement::HashJoinExecutor::
+spillLargestPartition()
+{
+    Partition * largest = nullptr;
+    for (auto & p: partitions) {
+        if (!p->buildSpill
+            && (!largest || p->memoryUsed > largest->memoryUsed))
+            largest = p.get();
+    }
+
+    if (!largest || largest->memoryUsed == 0) {
+        memoryUsed = 0;
+        return;
+    }
+
+    DEBUG_MSG(logger) << "hash join spilling partition of "
+                      << largest->rows.size() << " rows and "
+                      << largest->memoryUsed << " bytes";
+
+    memoryUsed -= largest->memoryUsed;
+    largest->spill();
+}
+
+void
+JoinElement::HashJoinExecutor::
+startProbe(Partition & partition, std::shared_ptr<PipelineResults> row)
+{
+    probeRow = std::move(row);
+    probePartition = &partition;
+    probeMatched = false;
+    nextMatch = NO_MATCH;
+
+    if (!getJoinKey(*probeRow, probeKey, probeHash))
+        return;
+
+    auto it = partition.index.find(probeHash);
+    if (it != partition.index.end())
+        nextMatch = it->second;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+nextProbeMatch()
+{
+    Partition & partition = *probePartition;
+
+    while (nextMatch != NO_MATCH) {
+        Partition::Entry & entry = partition.rows[nextMatch];
+        nextMatch = partition.next[nextMatch];
+
+        if (entry.hash != probeHash || entry.key != probeKey)
+            continue;
+
+        auto result = buildLeft
+            ? joinRows(*entry.row, *probeRow)
+            : joinRows(*probeRow, *entry.row);
+
+        ExpressionValue storage;
+        if (!parent->crossWhere_(*result, storage, GET_LATEST).isTrue())
+            continue;
+
+        entry.matched = true;
+        probeMatched = true;
+        return result;
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+joinRows(const PipelineResults & leftRow,
+         const PipelineResults & rightRow) const
+{
+    auto result = std::make_shared<PipelineResults>(leftRow);
+    // Pop the selected join conditions from left
+    result->values.pop_back();
+    for (size_t i = 0;  i < rightAdded;  ++i)
+        result->values.push_back(rightRow.values[i]);
+    return result;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+outerRow(const PipelineResults & row, bool isLeft) const
+{
+    return isLeft ? leftOuterRow(row) : rightOuterRow(row);
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+leftOuterRow(const PipelineResults & row) const
+{
+    auto result = std::make_shared<PipelineResults>(row);
+    result->values.pop_back();
+    for (size_t i = 0;  i < rightAdded;  ++i)
+        result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+    return result;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+rightOuterRow(const PipelineResults & row) const
+{
+    auto result = std::make_shared<PipelineResults>(row);
+    result->values.clear();
+    for (size_t i = 0;  i < leftAdded;  ++i)
+        result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+    for (size_t i = 0;  i < rightAdded;  ++i)
+        result->values.push_back(row.values[i]);
+    return result;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+take()
+{
+    if (phase == BUILD)
+        build();
+
+    for (;;) {
+        // Finish matching the current probe row
+        if (probeRow) {
+            auto result = nextProbeMatch();
+            if (result)
+                return result;
+            auto row = std::move(probeRow);
+            probeRow.reset();
+            if (!probeMatched && outerProbe)
+                return outerRow(*row, !buildLeft);
+            continue;
+        }
+
+        if (phase == PROBE) {
+            auto row = (buildLeft ? right : left)->take();
+            if (!row) {
+                phase = FINISH;
+                currentPartition = 0;
+                outerBuildIndex = 0;
+                continue;
+            }
+
+            if (!probePrototype)
+                probePrototype = makePrototype(*row);
+
+            ExpressionValue key;
+            uint64_t hash;
+            if (!getJoinKey(*row, key, hash)) {
+                if (outerProbe)
+                    return outerRow(*row, !buildLeft);
+                continue;
+            }
+
+            Partition & partition = *partitions[hash % partitions.size()];
+            if (partition.buildSpill) {
+                // Its partition isn't in memory; join it later
+                if (!partition.probeSpill)
+                    partition.probeSpill.reset(new SpillFile());
+                partition.probeSpill->write(*row);
+                continue;
+            }
+
+            startProbe(partition, std::move(row));
+            continue;
+        }
+
+        if (phase == FINISH) {
+            if (currentPartition == partitions.size()) {
+                partitions.clear();
+                phase = DONE;
+                continue;
+            }
+
+            Partition & partition = *partitions[currentPartition];
+
+            if (partition.buildSpill) {
+                DEBUG_MSG(logger) << "hash join loading spilled partition "
+                                  << currentPartition;
+                partition.unspill(*buildPrototype);
+            }
+
+            if (partition.probeSpill) {
+                auto row = partition.probeSpill->read(*probePrototype);
+                if (row) {
+                    startProbe(partition, std::move(row));
+                    continue;
+                }
+                partition.probeSpill.reset();
+            }
+
+            if (outerBuild) {
+                while (outerBuildIndex < partition.rows.size()) {
+                    auto & entry = partition.rows[outerBuildIndex++];
+                    if (!entry.matched)
+                        return outerRow(*entry.row, buildLeft);
+                }
+            }
+
+            partition.clear();
+            ++currentPartition;
+            outerBuildIndex = 0;
+            continue;
+        }
+
+        // Nothing more found
+        return nullptr;
+    }
+}
+
+void
+JoinElement::HashJoinExecutor::
+restart()
+{
+    left->restart();
+    right->restart();
+    partitions.clear();
+    phase = BUILD;
+    memoryUsed = 0;
+    reserved.resize(0);
+    numBuildRows = 0;
+    currentPartition = 0;
+    outerBuildIndex = 0;
+    probeRow.reset();
+    probePartition = nullptr;
+    nextMatch = NO_MATCH;
+}
+
+
 /*****************************************************************************/
 /* BOUND JOIN EXECUTOR                                                       */
 /*****************************************************************************/
@@ -1582,14 +2225,18 @@ Bound(std::shared_ptr<BoundPipelineElement> root,
       std::shared_ptr<BoundPipelineElement> left,
       std::shared_ptr<BoundPipelineElement> right,
       AnnotatedJoinCondition condition,
-      JoinQualification joinQualification)
+      JoinQualification joinQualification,
+      bool hashJoin,
+      bool buildLeft)
     : root_(std::move(root)),
       left_(std::move(left)),
       right_(std::move(right)),
       outputScope_(createOutputScope()),
       crossWhere_(condition.crossWhere->bind(*outputScope_)),
       condition_(std::move(condition)),
-      joinQualification_(joinQualification)
+      joinQualification_(joinQualification),
+      hashJoin_(hashJoin),
+      buildLeft_(buildLeft)
 {
 }
 
@@ -1632,36 +2279,55 @@ start(const BoundParameters & getParam) const
     size_t leftAdded = left_->outputScope()->defaultScope()->outputAdded().size();
     size_t rightAdded = right_->outputScope()->defaultScope()->outputAdded().size();
 
+    auto setStrategy = [] (const char * strategy)
+        {
+            if (QueryProfile * profile = QueryProfile::current())
+                profile->setStrategy(strategy);
+        };
+
     switch (condition_.style) {
 
     case AnnotatedJoinCondition::CROSS_JOIN: 
     {
         if (joinQualification_ == JOIN_FULL) {
+            setStrategy("full cross join");
             return std::make_shared<FullCrossJoinExecutor>
             (this,
-             root_->start(getParam),
-             left_->start(getParam),
-             right_->start(getParam),
+             root_->startProfiled(getParam),
+             left_->startProfiled(getParam),
+             right_->startProfiled(getParam),
              leftAdded,
              rightAdded);
         }
         else {
+            setStrategy("cross join");
             return std::make_shared<CrossJoinExecutor>
             (this,
-             root_->start(getParam),
-             left_->start(getParam),
-             right_->start(getParam),
+             root_->startProfiled(getParam),
+             left_->startProfiled(getParam),
+             right_->startProfiled(getParam),
              leftAdded,
              rightAdded);
         }        
     }
 
     case AnnotatedJoinCondition::EQUIJOIN:
+        if (hashJoin_) {
+            setStrategy(buildLeft_ ? "hash join (build left)" : "hash join");
+            return std::make_shared<HashJoinExecutor>
+                (this,
+                 root_->startProfiled(getParam),
+                 left_->startProfiled(getParam),
+                 right_->startProfiled(getParam),
+                 leftAdded,
+                 rightAdded);
+        }
+        setStrategy("merge join");
         return std::make_shared<EquiJoinExecutor>
             (this,
-             root_->start(getParam),
-             left_->start(getParam),
-             right_->start(getParam),
+             root_->startProfiled(getParam),
+             left_->startProfiled(getParam),
+             right_->startProfiled(getParam),
              leftAdded,
              rightAdded);
 
@@ -1967,10 +2633,39 @@ take()
     }
 }
 
+size_t
+FilterWhereElement::Executor::
+takeBatch(PipelineResultsBatch & output, size_t maxRows)
+{
+    size_t numTaken = 0;
+
+    // Keep going until we've got something or the source is exhausted, as
+    // returning zero would signal the end of the pipeline.
+    while (numTaken == 0) {
+        input_.clear();
+        if (!source_->takeBatch(input_, maxRows))
+            break;
+
+        ExpressionValue storage;
+        for (auto & input: input_) {
+            const ExpressionValue & pass
+                = parent_->where_(*input, storage, GET_LATEST);
+            if (pass.isTrue()) {
+                output.emplace_back(std::move(input));
+                ++numTaken;
+            }
+        }
+    }
+
+    input_.clear();
+    return numTaken;
+}
+
 void
 FilterWhereElement::Executor::
 restart()
 {
+    input_.clear();
     source_->restart();
 }
 
@@ -1994,7 +2689,7 @@ start(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent_ = this;
-    result->source_ = source_->start(getParam);
+    result->source_ = source_->startProfiled(getParam);
     return result;
 }
 
@@ -2064,6 +2759,23 @@ take()
     }
 }
 
+size_t
+SelectElement::Executor::
+takeBatch(PipelineResultsBatch & output, size_t maxRows)
+{
+    size_t startAt = output.size();
+    size_t numTaken = source->takeBatch(output, maxRows);
+
+    // Run the select expression over the whole block in a tight loop
+    for (size_t i = startAt;  i < output.size();  ++i) {
+        PipelineResults & input = *output[i];
+        ExpressionValue selected = parent->select_(input, GET_ALL);
+        input.values.emplace_back(std::move(selected));
+    }
+
+    return numTaken;
+}
+
 void
 SelectElement::Executor::
 restart()
@@ -2092,7 +2804,7 @@ start(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent = this;
-    result->source = source_->start(getParam);
+    result->source = source_->startProfiled(getParam);
     return result;
 }
 
@@ -2117,8 +2829,9 @@ outputScope() const
 
 OrderByElement::
 OrderByElement(std::shared_ptr<PipelineElement> source,
-               OrderByExpression orderBy)
-    : source(source), orderBy(orderBy)
+               OrderByExpression orderBy,
+               ssize_t maxRows)
+    : source(source), orderBy(orderBy), maxRows(maxRows)
 {
 }
 
@@ -2126,7 +2839,7 @@ std::shared_ptr<BoundPipelineElement>
 OrderByElement::
 bind() const
 {
-    return std::make_shared<Bound>(source->bind(), orderBy);
+    return std::make_shared<Bound>(source->bind(), orderBy, maxRows);
 }
 
 
@@ -2152,13 +2865,6 @@ take()
     if (numDone == -1) {
         // Get and sort the input
 
-        while (true) {
-            std::shared_ptr<PipelineResults> input = source->take();
-            if (!input)
-                break;
-            sorted.emplace_back(std::move(input));
-        }
-
         // We assume that the fields to sort on are at the end of the
         // list of fields.
         int offset
@@ -2173,6 +2879,29 @@ take()
                                              offset);
             };
 
+        ssize_t maxRows = parent->maxRows_;
+
+        while (true) {
+            std::shared_ptr<PipelineResults> input = source->take();
+            if (!input)
+                break;
+
+            if (maxRows < 0) {
+                sorted.emplace_back(std::move(input));
+            }
+            else if (sorted.size() < maxRows) {
+                // Keep a heap with the worst of the top rows on top
+                sorted.emplace_back(std::move(input));
+                std::push_heap(sorted.begin(), sorted.end(), compare);
+            }
+            else if (maxRows > 0 && compare(input, sorted.front())) {
+                // Better than the worst of our top rows; replace it
+                std::pop_heap(sorted.begin(), sorted.end(), compare);
+                sorted.back() = std::move(input);
+                std::push_heap(sorted.begin(), sorted.end(), compare);
+            }
+        }
+
         std::sort(sorted.begin(), sorted.end(), compare);
                 
         numDone = 0;
@@ -2203,10 +2932,12 @@ restart()
 
 OrderByElement::Bound::
 Bound(std::shared_ptr<BoundPipelineElement> source,
-      const OrderByExpression & orderBy)
+      const OrderByExpression & orderBy,
+      ssize_t maxRows)
     : source_(std::move(source)),
       scope_(source_->outputScope()),
-      orderBy_(orderBy.bindAll(*scope_))
+      orderBy_(orderBy.bindAll(*scope_)),
+      maxRows_(maxRows)
 {
     ExcAssert(scope_->inLexicalScope());
 }
@@ -2216,7 +2947,7 @@ OrderByElement::Bound::
 start(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>(this,
-                                      source_->start(getParam));
+                                      source_->startProfiled(getParam));
 }
 
 std::shared_ptr<BoundPipelineElement>
@@ -2490,7 +3221,7 @@ PartitionElement::Bound::
 start(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>
-        (this, source_->start(getParam),
+        (this, source_->startProfiled(getParam),
          source_->numOutputFields() - numValues_,
          source_->numOutputFields());
 }
@@ -2575,7 +3306,7 @@ std::shared_ptr<ElementExecutor>
 ParamsElement::Bound::
 start(const BoundParameters & getParam) const
 {
-    return std::make_shared<Executor>(source_->start(getParam),
+    return std::make_shared<Executor>(source_->startProfiled(getParam),
                                       getParam);
 }
 
@@ -9,6 +9,7 @@
 
 #include "execution_pipeline.h"
 #include "join_utils.h"
+#include "mldb/base/memory_account.h"
 #include "mldb/utils/log_fwd.h"
 #include <list>
 
@@ -79,6 +80,8 @@ struct GenerateRowsExecutor: public ElementExecutor {
 
     virtual std::shared_ptr<PipelineResults> take();
 
+    virtual size_t takeBatch(PipelineResultsBatch & output, size_t maxRows);
+
     virtual void restart();
 };
 
@@ -299,6 +302,13 @@ struct JoinLexicalScope: public LexicalScope {
 /** An element that joins two tables together.  This is typically implemented
     by generating both sides sorted on the join key, and then iterating
     through matching rows.
+
+    Equijoins are instead implemented as a hash join, where neither side is
+    sorted and the smaller side is partitioned by the hash of the key, with
+    partitions spilling to disk when they don't fit in memory, when the
+    cost model of planEquiJoin() says that it's cheaper or when the
+    MLDB_HASH_JOIN environment variable is set.  The rows come out in a
+    different order.
 */
 
 struct JoinElement: public PipelineElement {
@@ -325,6 +335,9 @@ struct JoinElement: public PipelineElement {
     OrderByExpression orderBy;
     AnnotatedJoinCondition condition;
     JoinQualification joinQualification;
+    JoinPlan plan;  ///< How the cost model would run the equijoin
+    bool hashJoin;  ///< Use a HashJoinExecutor rather than sorting
+    bool buildLeft; ///< Build the hash join's index on the left side
 
     std::shared_ptr<PipelineElement> leftImpl;
     std::shared_ptr<PipelineElement> rightImpl;
@@ -424,6 +437,87 @@ struct JoinElement: public PipelineElement {
         virtual void restart();
     };
 
+    /** Grace hash join for equijoins.  The build side (the right side,
+        unless the plan says to build on the left) is read first and
+        distributed over a fixed number of partitions by the hash of its
+        join key, and an index on the key is then built for each partition.
+        The other, probe, side is streamed through, looking up each row in
+        the partition for its key.  Neither side needs to be sorted.
+
+        When the rows held from the build side go over the memory budget,
+        the biggest partition is written to a temporary file, along with
+        all of the rows from either side that belong to it.  Once the probe
+        side is exhausted, the spilled partitions are loaded and joined one
+        at a time.
+    */
+    struct HashJoinExecutor: public ElementExecutor {
+        HashJoinExecutor(const Bound * parent,
+                         std::shared_ptr<ElementExecutor> root,
+                         std::shared_ptr<ElementExecutor> left,
+                         std::shared_ptr<ElementExecutor> right,
+                         size_t leftAdded,
+                         size_t rightAdded);
+
+        ~HashJoinExecutor();
+
+        const Bound * parent;
+        std::shared_ptr<ElementExecutor> root, left, right;
+
+        const size_t leftAdded, rightAdded;
+        bool buildLeft;
+        bool outerBuild, outerProbe;
+
+        struct Partition;
+        std::vector<std::unique_ptr<Partition> > partitions;
+
+        enum Phase {
+            BUILD,    ///< Build side not read yet
+            PROBE,    ///< Streaming the probe side through
+            FINISH,   ///< Finishing partitions, including spilled ones
+            DONE
+        } phase;
+
+        size_t memoryUsed;          ///< Estimated bytes of in-memory rows
+        MemoryReservation reserved; ///< memoryUsed, charged to the query
+        size_t numBuildRows;        ///< Number of rows read to build
+        size_t currentPartition;    ///< Partition being finished
+        size_t outerBuildIndex;     ///< Next row to check for outer output
+
+        /// Probe row being matched, and where we are in its bucket
+        std::shared_ptr<PipelineResults> probeRow;
+        ExpressionValue probeKey;
+        uint64_t probeHash;
+        Partition * probePartition;
+        uint32_t nextMatch;
+        bool probeMatched;
+
+        /// Rows with everything but values, used to reload spilled rows
+        std::shared_ptr<PipelineResults> buildPrototype, probePrototype;
+
+        std::shared_ptr<spdlog::logger> logger;
+
+        virtual std::shared_ptr<PipelineResults> take();
+
+        virtual void restart();
+
+    private:
+        void build();
+        void addBuildRow(std::shared_ptr<PipelineResults> row);
+        void spillLargestPartition();
+        void startProbe(Partition & partition,
+                        std::shared_ptr<PipelineResults> row);
+        std::shared_ptr<PipelineResults> nextProbeMatch();
+        std::shared_ptr<PipelineResults>
+        joinRows(const PipelineResults & leftRow,
+                 const PipelineResults & rightRow) const;
+        std::shared_ptr<PipelineResults>
+        leftOuterRow(const PipelineResults & row) const;
+        std::shared_ptr<PipelineResults>
+        rightOuterRow(const PipelineResults & row) const;
+        std::shared_ptr<PipelineResults>
+        outerRow(const PipelineResults & row, bool isLeft) const;
+    };
+
     struct Bound: public BoundPipelineElement {
 
         /** Bind this in.  The main difficulty is with the output scope, which
@@ -434,7 +528,9 @@ struct JoinElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> left,
               std::shared_ptr<BoundPipelineElement> right,
               AnnotatedJoinCondition condition,
-              JoinQualification joinQualification);
+              JoinQualification joinQualification,
+              bool hashJoin,
+              bool buildLeft);
 
         std::shared_ptr<BoundPipelineElement> root_;
         std::shared_ptr<BoundPipelineElement> left_;
@@ -443,6 +539,8 @@ struct JoinElement: public PipelineElement {
         BoundSqlExpression crossWhere_;
         AnnotatedJoinCondition condition_;
         JoinQualification joinQualification_;
+        bool hashJoin_;
+        bool buildLeft_;
 
         /** Our output scope has:
             - The left and right tables
@@ -567,8 +665,14 @@ struct FilterWhereElement: public PipelineElement {
         std::shared_ptr<ElementExecutor> source_;
         PipelineExpressionScope * context_;
 
+        /// Input rows taken from the source but not yet filtered
+        PipelineResultsBatch input_;
+
         virtual std::shared_ptr<PipelineResults> take();
 
+        virtual size_t takeBatch(PipelineResultsBatch & output,
+                                 size_t maxRows);
+
         virtual void restart();
     };
 
@@ -623,6 +727,9 @@ struct SelectElement: public PipelineElement {
 
         virtual std::shared_ptr<PipelineResults> take();
 
+        virtual size_t takeBatch(PipelineResultsBatch & output,
+                                 size_t maxRows);
+
         virtual void restart();
     };
 
@@ -659,10 +766,12 @@ struct SelectElement: public PipelineElement {
 
 struct OrderByElement: public PipelineElement {
     OrderByElement(std::shared_ptr<PipelineElement> source,
-                   OrderByExpression orderBy);
+                   OrderByExpression orderBy,
+                   ssize_t maxRows = -1);
 
     std::shared_ptr<PipelineElement> source;
     OrderByExpression orderBy;
+    ssize_t maxRows;  ///< If non-negative, only keep the top maxRows rows
 
     struct Bound;
 
@@ -685,11 +794,13 @@ struct OrderByElement: public PipelineElement {
     struct Bound: public BoundPipelineElement {
 
         Bound(std::shared_ptr<BoundPipelineElement> source,
-              const OrderByExpression & orderBy);
+              const OrderByExpression & orderBy,
+              ssize_t maxRows);
 
         std::shared_ptr<BoundPipelineElement> source_;
         std::shared_ptr<PipelineExpressionScope> scope_;
         BoundOrderByExpression orderBy_;
+        ssize_t maxRows_;
         
         std::shared_ptr<ElementExecutor>
         start(const BoundParameters & getParam) const;
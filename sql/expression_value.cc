@@ -1145,6 +1145,47 @@ getScalarDescription() const
     return left + " or " + right;
 }
 
+/*****************************************************************************/
+/* FLAT ROW SCHEMA                                                           */
+/*****************************************************************************/
+
+struct FlatRowSchema::Index {
+    std::unordered_map<PathElement, int> columns;
+};
+
+FlatRowSchema::
+FlatRowSchema(std::vector<PathElement> columnNames)
+    : columnNames_(std::move(columnNames)), index_(new Index())
+{
+    index_->columns.reserve(columnNames_.size());
+    for (size_t i = 0;  i < columnNames_.size();  ++i) {
+        if (i > 0 && !(columnNames_[i - 1] < columnNames_[i])) {
+            throw HttpReturnException
+                (500, "Flat row schema column names must be sorted and "
+                 "distinct",
+                 "columnName", columnNames_[i],
+                 "previous", columnNames_[i - 1]);
+        }
+        index_->columns.emplace(columnNames_[i], i);
+    }
+}
+
+FlatRowSchema::
+~FlatRowSchema()
+{
+}
+
+int
+FlatRowSchema::
+find(const PathElement & columnName) const
+{
+    auto it = index_->columns.find(columnName);
+    if (it == index_->columns.end())
+        return -1;
+    return it->second;
+}
+
+
 /*****************************************************************************/
 /* EXPRESSION VALUE                                                          */
 /*****************************************************************************/
@@ -1153,7 +1194,7 @@ getScalarDescription() const
 /// element and an external set of column names.  There is only
 /// one timestamp for the whole thing.
 struct ExpressionValue::Flattened {
-    std::shared_ptr<const std::vector<ColumnPath> > columnNames;
+    std::shared_ptr<const FlatRowSchema> schema;
     std::vector<CellValue> values;
 
     size_t length() const
@@ -1166,17 +1207,18 @@ struct ExpressionValue::Flattened {
         return values.at(i);
     }
 
-    CellValue moveValue(int i)
+    const PathElement & columnName(int i) const
     {
-        return std::move(values.at(i));
+        return schema->columnName(i);
     }
 
-    ColumnPath columnName(int i) const
+    /// Number of columns actually present (non-empty values)
+    size_t numPresent() const
     {
-        if (columnNames)
-            return columnNames->at(i);
-        // TODO: static list of the first 1,000 column names to avoid allocs
-        else return ColumnPath(i);
+        size_t result = 0;
+        for (auto & v: values)
+            result += !v.empty();
+        return result;
     }
 };
 
@@ -1534,7 +1576,10 @@ struct ExpressionValue::Superposition {
 
 
 static_assert(sizeof(CellValue) <= 24, "CellValue is too big to fit");
-static_assert(sizeof(ExpressionValue::Structured) <= 24, "Structured is too big to fit");
+// Structured values are held by pointer, so they can be of any size
+static_assert(sizeof(std::shared_ptr<const ExpressionValue::Structured>)
+              <= 2 * sizeof(uint64_t),
+              "Structured pointer is too big to fit");
 
 ExpressionValue::
 ExpressionValue()
@@ -1841,6 +1886,7 @@ destroy()
     typedef std::shared_ptr<const Structured> StructuredRepr;
     typedef std::shared_ptr<const Embedding> EmbeddingRepr;
     typedef std::shared_ptr<const Superposition> SuperpositionRepr;
+    typedef std::shared_ptr<const Flattened> FlattenedRepr;
 
     auto type = type_;
     type_ = Type::NONE;
@@ -1851,6 +1897,7 @@ destroy()
     case Type::STRUCTURED:  structured_.~StructuredRepr();  return;
     case Type::EMBEDDING: embedding_.~EmbeddingRepr();  return;
     case Type::SUPERPOSITION: superposition_.~SuperpositionRepr();  return;
+    case Type::FLATTENED: flattened_.~FlattenedRepr();  return;
     }
 }
 
@@ -1874,6 +1921,12 @@ ExpressionValue(const ExpressionValue & other)
         type_ = Type::SUPERPOSITION;
         return;
     }
+    case Type::FLATTENED: {
+        ts_ = other.ts_;
+        new (storage_) std::shared_ptr<const Flattened>(other.flattened_);
+        type_ = Type::FLATTENED;
+        return;
+    }
     }
     throw HttpReturnException(400, "Unknown expression value type");
 }
@@ -1970,6 +2023,56 @@ ExpressionValue(std::vector<CellValue> values,
     v.swap(*this);
 }
 
+ExpressionValue::
+ExpressionValue(std::vector<CellValue> values,
+                std::shared_ptr<const FlatRowSchema> schema,
+                Date ts)
+    : type_(Type::NONE), ts_(ts)
+{
+    ExcAssert(schema);
+    ExcAssertEqual(values.size(), schema->size());
+
+    bool anyPresent = false;
+    for (auto & v: values) {
+        if (!v.empty()) {
+            anyPresent = true;
+            break;
+        }
+    }
+
+    // An empty row has no timestamp, so keep the normal representation
+    if (!anyPresent) {
+        initStructured(Structured());
+        return;
+    }
+
+    auto content = std::make_shared<Flattened>();
+    content->schema = std::move(schema);
+    content->values = std::move(values);
+
+    new (storage_) std::shared_ptr<const Flattened>(std::move(content));
+    type_ = Type::FLATTENED;
+}
+
+ExpressionValue
+ExpressionValue::
+unflatten() const
+{
+    assertType(Type::FLATTENED);
+    const Flattened & flat = *flattened_;
+
+    Structured result;
+    result.reserve(flat.length());
+    for (size_t i = 0;  i < flat.length();  ++i) {
+        if (flat.values[i].empty())
+            continue;
+        result.emplace_back(flat.columnName(i),
+                            ExpressionValue(flat.values[i], ts_));
+    }
+
+    return ExpressionValue(std::move(result), SORTED, NO_DUPLICATES);
+}
+
 ExpressionValue::
 ExpressionValue(const std::vector<double> & values,
                 std::shared_ptr<const std::vector<ColumnPath> > cols,
@@ -2187,6 +2290,8 @@ isTrue() const
         return embedding_->length();
     case Type::SUPERPOSITION:
         return superposition_->latest().isTrue();
+    case Type::FLATTENED:
+        return true;  // never empty
     }
 
     throw HttpReturnException(500, "Unknown expression value type");
@@ -2207,6 +2312,8 @@ isFalse() const
         return embedding_->length();
     case Type::SUPERPOSITION:
         return superposition_->latest().isFalse();
+    case Type::FLATTENED:
+        return false;  // never empty
     }
 
     throw HttpReturnException(500, "Unknown expression value type");
@@ -2299,7 +2406,7 @@ bool
 ExpressionValue::
 isArray() const
 {
-    return type_ == Type::STRUCTURED;
+    return type_ == Type::STRUCTURED || type_ == Type::FLATTENED;
 }
 
 bool
@@ -2313,7 +2420,8 @@ bool
 ExpressionValue::
 isRow() const
 {
-    return type_ == Type::STRUCTURED || type_ == Type::EMBEDDING;
+    return type_ == Type::STRUCTURED || type_ == Type::EMBEDDING
+        || type_ == Type::FLATTENED;
 }
 
 bool
@@ -2333,6 +2441,23 @@ isEmbedding() const
     return type_ == Type::EMBEDDING;
 }
 
+std::shared_ptr<const FlatRowSchema>
+ExpressionValue::
+getFlatRowSchema() const
+{
+    if (type_ == Type::FLATTENED)
+        return flattened_->schema;
+    return nullptr;
+}
+
+const std::vector<CellValue> &
+ExpressionValue::
+getFlatRowValues() const
+{
+    assertType(Type::FLATTENED, "flat row values");
+    return flattened_->values;
+}
+
 std::string
 ExpressionValue::
 toString() const
@@ -2368,7 +2493,9 @@ Date
 ExpressionValue::
 getMinTimestamp() const
 {
-    if (type_ == Type::NONE || type_ == Type::ATOM)
+    // Flattened rows have a single timestamp for all of their values
+    if (type_ == Type::NONE || type_ == Type::ATOM
+        || type_ == Type::FLATTENED)
         return ts_;
 
     Date result = Date::positiveInfinity();
@@ -2389,7 +2516,9 @@ Date
 ExpressionValue::
 getMaxTimestamp() const
 {
-    if (type_ == Type::NONE || type_ == Type::ATOM)
+    // Flattened rows have a single timestamp for all of their values
+    if (type_ == Type::NONE || type_ == Type::ATOM
+        || type_ == Type::FLATTENED)
         return ts_;
 
     Date result = Date::negativeInfinity();
@@ -2541,11 +2670,29 @@ struct FilterAccumulator {
     StructValue foundRows;
 };
 
+/// Number of columns from which a struct whose columns are in order is
+/// binary searched rather than scanned
+constexpr size_t SORTED_SEARCH_MIN_COLUMNS = 16;
+
 template<typename Fn, typename StructValueT>
 bool iterateStructured(StructValueT && vals,
+                       bool sorted,
                        const PathElement & toFind,
                        Fn && onValue)
 {
+    if (sorted && vals.size() >= SORTED_SEARCH_MIN_COLUMNS) {
+        // There is at most one column with the name
+        auto before = [] (const std::tuple<PathElement, ExpressionValue> & v,
+                          const PathElement & name)
+            {
+                return std::get<0>(v).compare(name) < 0;
+            };
+        auto it = std::lower_bound(vals.begin(), vals.end(), toFind, before);
+        if (it != vals.end() && std::get<0>(*it) == toFind)
+            return onValue(std::move(std::get<1>(*it)));
+        return true;
+    }
+
     for (auto && v: vals) {
         if (std::get<0>(v) == toFind) {
             if (!onValue(std::move(std::get<1>(v))))
@@ -2579,7 +2726,7 @@ tryGetColumn(const PathElement & columnName,
                 return true;
             };
         
-        if (iterateStructured(*structured_, columnName, onValue)) {
+        if (iterateStructured(*structured_, structuredSorted_, columnName, onValue)) {
             if (found)
                 return &storage;
             else return nullptr;
@@ -2588,7 +2735,7 @@ tryGetColumn(const PathElement & columnName,
         // More than one value, fall back
         // (shouldn't happen)
         FilterAccumulator accum(filter);
-        iterateStructured(*structured_, columnName, accum);
+        iterateStructured(*structured_, structuredSorted_, columnName, accum);
         return accum.extract(storage);
     }
     case Type::EMBEDDING: {
@@ -2597,6 +2744,15 @@ tryGetColumn(const PathElement & columnName,
     case Type::SUPERPOSITION: {
         return superposition_->tryGetNestedColumn(columnName, storage, ts_);
     }
+    case Type::FLATTENED: {
+        // There is only ever one value for each column, so the filter
+        // has nothing to choose between
+        int index = flattened_->schema->find(columnName);
+        if (index == -1 || flattened_->values[index].empty())
+            return nullptr;
+        storage = ExpressionValue(flattened_->values[index], ts_);
+        return &storage;
+    }
     case Type::NONE:
     case Type::ATOM:
         return nullptr;
@@ -2643,7 +2799,7 @@ tryGetNestedColumn(const ColumnPath & columnName,
                     return true;
                 };
         
-            if (iterateStructured(*structured_, columnName[0], onValue)) {
+            if (iterateStructured(*structured_, structuredSorted_, columnName[0], onValue)) {
                 if (found)
                     return &storage;
                 else return nullptr;
@@ -2675,7 +2831,7 @@ tryGetNestedColumn(const ColumnPath & columnName,
                 }
             };
         
-        iterateStructured(*structured_, columnName[0], onValue);
+        iterateStructured(*structured_, structuredSorted_, columnName[0], onValue);
 
         return accum.extract(storage);
     }
@@ -2685,6 +2841,14 @@ tryGetNestedColumn(const ColumnPath & columnName,
     case Type::SUPERPOSITION: {
         return superposition_->tryGetNestedColumn(columnName, storage, ts_);
     }
+    case Type::FLATTENED: {
+        if (columnName.empty())
+            return this;
+        // All values are atoms, so they have no nested columns
+        if (columnName.size() > 1)
+            return nullptr;
+        return tryGetColumn(columnName[0], storage, filter);
+    }
     case Type::NONE:
     case Type::ATOM:
         return nullptr;
@@ -2719,6 +2883,8 @@ coerceToEmbedding() const
 {
     if (type_ == Type::EMBEDDING)
         return *this;
+    else if (type_ == Type::FLATTENED)
+        return unflatten().coerceToEmbedding();
     else if (type_ != Type::STRUCTURED)
         throw HttpReturnException(500, "Cannot coerce value to embedding");
 
@@ -2790,6 +2956,7 @@ getEmbeddingShape() const
     case Type::ATOM:
         return {};
     case Type::STRUCTURED:
+    case Type::FLATTENED:
         return coerceToEmbedding().getEmbeddingShape();
     case Type::EMBEDDING:
         return embedding_->dims_;
@@ -2808,6 +2975,7 @@ reshape(DimsVector newShape) const
     case Type::NONE:
     case Type::ATOM:
     case Type::STRUCTURED:
+    case Type::FLATTENED:
         return coerceToEmbedding().reshape(newShape);
     case Type::SUPERPOSITION:
         return superposition_->latest().reshape(newShape);
@@ -2827,6 +2995,7 @@ reshape(DimsVector newShape,
     case Type::NONE:
     case Type::ATOM:
     case Type::STRUCTURED:
+    case Type::FLATTENED:
         return coerceToEmbedding().reshape(newShape, newValue);
     case Type::SUPERPOSITION:
         return superposition_->latest().reshape(newShape, newValue);
@@ -2837,11 +3006,44 @@ reshape(DimsVector newShape,
     throw HttpReturnException(500, "Unknown storage type for reshape()");
 }
 
+/** Is the embedding stored as plain numbers, which can be converted as a
+    contiguous buffer rather than atom by atom?
+*/
+static bool isNumericStorage(StorageType type)
+{
+    switch (type) {
+    case ST_FLOAT32:
+    case ST_FLOAT64:
+    case ST_INT8:
+    case ST_UINT8:
+    case ST_INT16:
+    case ST_UINT16:
+    case ST_INT32:
+    case ST_UINT32:
+    case ST_INT64:
+    case ST_UINT64:
+        return true;
+    default:
+        return false;
+    }
+}
+
 #if 1
 distribution<float, std::vector<float> >
 ExpressionValue::
 getEmbedding(ssize_t knownLength) const
 {
+    if (type_ == Type::EMBEDDING
+        && isNumericStorage(embedding_->storageType_)) {
+        size_t len = embedding_->length();
+        if (knownLength == -1 || knownLength == len) {
+            distribution<float> result(len);
+            convertEmbeddingImpl(result.data(), embedding_->data_.get(),
+                                 len, ST_FLOAT32, embedding_->storageType_);
+            return result;
+        }
+    }
+
     return getEmbeddingDouble(knownLength).cast<float>();
 }
 
@@ -3004,6 +3206,16 @@ getEmbedding(const ColumnPath * knownNames, size_t len) const
         }
         break;
 
+    case Type::FLATTENED: {
+        const Flattened & flat = *flattened_;
+        for (size_t i = 0;  i < flat.length();  ++i) {
+            if (flat.values[i].empty())
+                continue;
+            addCell(ColumnPath(flat.columnName(i)), flat.values[i]);
+        }
+        break;
+    }
+
     case Type::NONE:
     case Type::ATOM:
         throw HttpReturnException(400, "Cannot extract embedding from atom");
@@ -3018,6 +3230,19 @@ distribution<double, std::vector<double> >
 ExpressionValue::
 getEmbeddingDouble(ssize_t knownLength) const
 {
+    // Numeric embeddings are converted in one go, which is much quicker
+    // than going atom by atom and naming each one
+    if (type_ == Type::EMBEDDING
+        && isNumericStorage(embedding_->storageType_)) {
+        size_t len = embedding_->length();
+        if (knownLength == -1 || knownLength == len) {
+            distribution<double> result(len);
+            convertEmbeddingImpl(result.data(), embedding_->data_.get(),
+                                 len, ST_FLOAT64, embedding_->storageType_);
+            return result;
+        }
+    }
+
     // TODO: this is inefficient.  We should be able to have the
     // info function return us one that does it much more
     // efficiently.
@@ -3234,6 +3459,7 @@ appendToRowDestructive(ColumnPath & columnName, RowValue & row)
     case Type::STRUCTURED:
     case Type::EMBEDDING:
     case Type::SUPERPOSITION:
+    case Type::FLATTENED:
         if (row.capacity() == 0)
             row.reserve(rowLength());
         else if (row.capacity() < row.size() + rowLength())
@@ -3286,10 +3512,48 @@ rowLength() const
     else if (type_ == Type::SUPERPOSITION) {
         return superposition_->values.size();
     }
+    else if (type_ == Type::FLATTENED) {
+        return flattened_->numPresent();
+    }
     else throw HttpReturnException(500, "Attempt to access non-row as row",
                                    "value", *this);
 }
 
+size_t
+ExpressionValue::
+memusage() const
+{
+    size_t result = sizeof(*this);
+
+    switch (type_) {
+    case Type::NONE:
+        break;
+    case Type::ATOM:
+        result += cell_.memusage() - sizeof(cell_);
+        break;
+    case Type::STRUCTURED:
+        for (auto & c: *structured_) {
+            result += std::get<0>(c).memusage() + std::get<1>(c).memusage();
+        }
+        break;
+    case Type::EMBEDDING:
+        result += sizeof(Embedding)
+            + embedding_->length()
+            * sizeofStorageType(embedding_->storageType_);
+        break;
+    case Type::SUPERPOSITION:
+        for (auto & v: superposition_->values)
+            result += v.memusage();
+        break;
+    case Type::FLATTENED:
+        for (auto & v: flattened_->values)
+            result += v.memusage();
+        break;
+    }
+
+    return result;
+}
+
 size_t 
 ExpressionValue::
 getAtomCount() const
@@ -3307,6 +3571,9 @@ getAtomCount() const
     else if (type_ == Type::SUPERPOSITION) {
         return superposition_->length();
     }
+    else if (type_ == Type::FLATTENED) {
+        return flattened_->numPresent();
+    }
     else {
         return 1;
     }
@@ -3417,6 +3684,16 @@ forEachAtom(const std::function<bool (const Path & columnName,
         
         return superposition_->forEachAtom(onCol);
     }
+    case Type::FLATTENED: {
+        const Flattened & flat = *flattened_;
+        for (size_t i = 0;  i < flat.length();  ++i) {
+            if (flat.values[i].empty())
+                continue;
+            if (!onAtom(flat.columnName(i), prefix, flat.values[i], ts_))
+                return false;
+        }
+        return true;
+    }
     case Type::NONE: {
         return onAtom(Path(), prefix, CellValue(), ts_);
     }
@@ -3451,6 +3728,17 @@ forEachColumn(const std::function<bool (const PathElement & columnName,
     case Type::SUPERPOSITION: {
         return embedding_->forEachColumn(onColumn, ts_);
     }
+    case Type::FLATTENED: {
+        const Flattened & flat = *flattened_;
+        for (size_t i = 0;  i < flat.length();  ++i) {
+            if (flat.values[i].empty())
+                continue;
+            if (!onColumn(flat.columnName(i),
+                          ExpressionValue(flat.values[i], ts_)))
+                return false;
+        }
+        return true;
+    }
     case Type::NONE:
     case Type::ATOM:
         // A non-row doesn't have columns, so this call doesn't make sense
@@ -3520,6 +3808,18 @@ forEachColumnDestructiveT(Fn && onColumn) const
         
         return superposition_->forEachColumn(onCol, ts_);
     }
+    case Type::FLATTENED: {
+        const Flattened & flat = *flattened_;
+        for (size_t i = 0;  i < flat.length();  ++i) {
+            if (flat.values[i].empty())
+                continue;
+            PathElement name = flat.columnName(i);
+            ExpressionValue val(flat.values[i], ts_);
+            if (!onColumn(name, val))
+                return false;
+        }
+        return true;
+    }
     case Type::NONE:
     case Type::ATOM:
         throw HttpReturnException(500, "Expected row expression",
@@ -3619,6 +3919,18 @@ forEachAtomDestructiveT(Fn && onAtom)
         
         return superposition_->forEachAtom(onCol);
     }
+    case Type::FLATTENED: {
+        const Flattened & flat = *flattened_;
+        for (size_t i = 0;  i < flat.length();  ++i) {
+            if (flat.values[i].empty())
+                continue;
+            Path name(flat.columnName(i));
+            CellValue val = flat.values[i];
+            if (!onAtom(name, val, ts_))
+                return false;
+        }
+        return true;
+    }
     case Type::NONE: {
         Path name;
         CellValue val;
@@ -3671,6 +3983,7 @@ forEachSuperposedValue(const std::function<bool (const ExpressionValue & val)> &
     case Type::NONE:
         return true;
     case Type::EMBEDDING:
+    case Type::FLATTENED:
     case Type::ATOM:
         return onValue(*this);
     case Type::SUPERPOSITION:
@@ -3692,7 +4005,10 @@ ExpressionValue::
 getFiltered(const VariableFilter & filter,
             ExpressionValue & storage) const
 {
-    if (filter == GET_ALL || empty() || isAtom() || type_ == Type::EMBEDDING)
+    // Flattened rows have a single value per column and a single timestamp,
+    // so there is nothing to filter
+    if (filter == GET_ALL || empty() || isAtom() || type_ == Type::EMBEDDING
+        || type_ == Type::FLATTENED)
         return storage = *this;
 
     if (type_ == Type::SUPERPOSITION) {
@@ -3766,7 +4082,10 @@ ExpressionValue
 ExpressionValue::
 getFilteredDestructive(const VariableFilter & filter)
 {
-    if (filter == GET_ALL || empty() || isAtom() || type_ == Type::EMBEDDING)
+    // Flattened rows have a single value per column and a single timestamp,
+    // so there is nothing to filter
+    if (filter == GET_ALL || empty() || isAtom() || type_ == Type::EMBEDDING
+        || type_ == Type::FLATTENED)
         return std::move(*this);
 
     if (type_ == Type::SUPERPOSITION) {
@@ -3865,6 +4184,8 @@ getUniqueAtomCount() const
             }
             return result;
         }
+        case Type::FLATTENED:
+            return flattened_->numPresent();
         case Type::SUPERPOSITION:
             break;
         }
@@ -4039,6 +4360,12 @@ hasKey(const Utf8String & key) const
     case Type::NONE:
     case Type::ATOM:
         return { false, Date::negativeInfinity() };
+    case Type::FLATTENED: {
+        int index = flattened_->schema->find(PathElement(key));
+        if (index == -1 || flattened_->values[index].empty())
+            return { false, Date::negativeInfinity() };
+        return { true, ts_ };
+    }
     case Type::STRUCTURED: 
     case Type::SUPERPOSITION: 
     case Type::EMBEDDING: {
@@ -4094,7 +4421,8 @@ hasValue(const ExpressionValue & val) const
         return { false, Date::negativeInfinity() };
     case Type::STRUCTURED: 
     case Type::SUPERPOSITION: 
-    case Type::EMBEDDING: {
+    case Type::EMBEDDING:
+    case Type::FLATTENED: {
         // TODO: for embedding, we can do much, much better
         Date outputDate = Date::negativeInfinity();
         auto onExpr = [&] (const Path & columnName,
@@ -4130,7 +4458,8 @@ hash() const
         return cell_.hash();        // again, timestamp not counted
     case Type::STRUCTURED:
     case Type::EMBEDDING:
-    case Type::SUPERPOSITION: {
+    case Type::SUPERPOSITION:
+    case Type::FLATTENED: {
         std::vector<std::pair<PathElement, uint64_t> > vals;
         vals.reserve(rowLength());
         auto onValue = [&] (const PathElement & el,
@@ -4265,9 +4594,16 @@ initStructured(std::shared_ptr<const Structured> value) noexcept
 {
     assertType(Type::NONE);
 
+    // Only big structs are binary searched, so only they need to be checked
+    bool sorted = value->size() >= SORTED_SEARCH_MIN_COLUMNS;
+    const PathElement * last = nullptr;
+
     ts_ = Date::notADate();
     for (auto& r : *value) {
         ts_ = std::max(std::get<1>(r).getEffectiveTimestamp(), ts_);
+        if (sorted && last && last->compare(std::get<0>(r)) >= 0)
+            sorted = false;
+        last = &std::get<0>(r);
     }
 
     // In the case of a superposition, this isn't true
@@ -4276,6 +4612,7 @@ initStructured(std::shared_ptr<const Structured> value) noexcept
     //}
 
     new (storage_) std::shared_ptr<const Structured>(std::move(value));
+    structuredSorted_ = sorted;
     type_ = Type::STRUCTURED;
 }
 
@@ -4318,6 +4655,11 @@ coerceToAtom() const
         return embedding_->getValue(0);
     case Type::SUPERPOSITION:
         return superposition_->values[0].getAtom();
+    case Type::FLATTENED:
+        ExcAssertEqual(flattened_->numPresent(), 1);
+        for (auto & v: flattened_->values)
+            if (!v.empty())
+                return v;
     }
 
     throw HttpReturnException(500, "coerceToAtom: unknown expression type");
@@ -4445,6 +4787,12 @@ int
 ExpressionValue::
 compare(const ExpressionValue & other) const
 {
+    // Flattened rows compare like their structured equivalent
+    if (type_ == Type::FLATTENED)
+        return unflatten().compare(other);
+    if (other.type_ == Type::FLATTENED)
+        return compare(other.unflatten());
+
     if (type_ < other.type_)
         return -1;
     else if (type_ > other.type_)
@@ -4466,7 +4814,8 @@ compare(const ExpressionValue & other) const
     case Type::SUPERPOSITION:
     case Type::EMBEDDING: {
         return compare_t<vector<pair<ColumnPath, CellValue> >, ML::compare>(*this, other);
-    }
+    }    case Type::FLATTENED:
+        break;  // handled above
     }
     
     throw HttpReturnException(400, "unknown ExpressionValue type");
@@ -4476,6 +4825,16 @@ bool
 ExpressionValue::
 operator == (const ExpressionValue & other) const
 {
+    if (type_ == Type::FLATTENED) {
+        if (other.type_ == Type::FLATTENED
+            && flattened_->schema == other.flattened_->schema)
+            return ts_ == other.ts_
+                && flattened_->values == other.flattened_->values;
+        return unflatten() == other;
+    }
+    if (other.type_ == Type::FLATTENED)
+        return *this == other.unflatten();
+
     if (type_ != other.type_)
         return false;
     switch (type_) {
@@ -4489,7 +4848,8 @@ operator == (const ExpressionValue & other) const
     case Type::SUPERPOSITION:
     case Type::EMBEDDING: {
         return compare_t<vector<pair<ColumnPath, CellValue> >, equal_to>(*this, other);
-    }
+    }    case Type::FLATTENED:
+        break;  // handled above
     }
     throw HttpReturnException(400, "unknown ExpressionValue type " + to_string((int)type_));
 }
@@ -4498,6 +4858,11 @@ bool
 ExpressionValue::
 operator <  (const ExpressionValue & other) const
 {
+    if (type_ == Type::FLATTENED)
+        return unflatten() < other;
+    if (other.type_ == Type::FLATTENED)
+        return *this < other.unflatten();
+
     if (type_ < other.type_)
         return true;
     if (type_ > other.type_)
@@ -4514,7 +4879,8 @@ operator <  (const ExpressionValue & other) const
     case Type::SUPERPOSITION:
     case Type::EMBEDDING: {
         return compare_t<vector<pair<ColumnPath, CellValue> >, less>(*this, other);
-    }
+    }    case Type::FLATTENED:
+        break;  // handled above
     }
     throw HttpReturnException(400, "unknown ExpressionValue type");
 }
@@ -4556,6 +4922,7 @@ getSpecializedValueInfo(bool constant) const
         }
         throw HttpReturnException(500, "Can't specialize unknown cell type");
     case Type::STRUCTURED:
+    case Type::FLATTENED:
         // TODO: specialize for concrete value.  Currently we just say
         // "it's a row with some values we don't know about yet"
         return std::make_shared<RowValueInfo>(vector<KnownColumn>(), SCHEMA_OPEN, constant);
@@ -4579,6 +4946,10 @@ ExpressionValue::
 extractJson(JsonPrintingContext & context) const
 {
     switch (type_) {
+    case ExpressionValue::Type::FLATTENED:
+        unflatten().extractJson(context);
+        return;
+
     case ExpressionValue::Type::NONE:
         context.writeNull();
         return;
@@ -4860,6 +5231,11 @@ printJsonTyped(const ExpressionValue * val,
         val->embedding_->writeJson(context);
         return;
     }
+    case ExpressionValue::Type::FLATTENED: {
+        ExpressionValue structured = val->unflatten();
+        printJsonTyped(&structured, context);
+        return;
+    }
     }
     throw HttpReturnException(400, "unknown ExpressionValue type");
 }
@@ -4881,6 +5257,7 @@ print(Type t)
     case Type::STRUCTURED:       return "structured";
     case Type::EMBEDDING: return "embedding";
     case Type::SUPERPOSITION: return "superposition";
+    case Type::FLATTENED: return "flattened";
     default:
         throw HttpReturnException(400, "Unknown ExpressionValue type: "
                                   + std::to_string((int)t));
@@ -5072,7 +5449,7 @@ searchRow(const StructValue & columns,
           ExpressionValue & storage)
 {
     FilterAccumulator accum(filter);
-    iterateStructured(columns, columnName, accum);
+    iterateStructured(columns, false /* sorted */, columnName, accum);
     if (accum.empty())
         return nullptr;
     return accum.extract(storage);
@@ -5099,7 +5476,8 @@ searchRow(const StructValue & columns,
             }
         };
 
-    iterateStructured(columns, columnName.head(), onValue);
+    iterateStructured(columns, false /* sorted */, columnName.head(),
+                      onValue);
 
     if (accum.empty())
         return nullptr;
@@ -41,8 +41,11 @@ struct EmbeddingValueInfo;
 /** A row in an expression value is a set of (key, atom, timestamp) pairs. */
 typedef std::vector<std::tuple<Path, CellValue, Date> > RowValue;
 
-/** A struct in an expression value is a set of (key, value) pairs. */
-typedef std::vector<std::tuple<PathElement, ExpressionValue> > StructValue;
+/** A struct in an expression value is a set of (key, value) pairs.  Most
+    structs have only a few fields (function outputs in particular), so up
+    to four are stored inline without a separate allocation.
+*/
+typedef compact_vector<std::tuple<PathElement, ExpressionValue>, 4> StructValue;
 
 /** Return the ValueInfo that corresponds to the given
     ValueDescription.
@@ -575,6 +578,48 @@ struct EmbeddingMetadata {
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingMetadata);
 
 
+/*****************************************************************************/
+/* FLAT ROW SCHEMA                                                           */
+/*****************************************************************************/
+
+/** The column names of a flat row (see the ExpressionValue constructor that
+    takes one).  It's created once, for example per dataset or per chunk,
+    and shared between all of the rows that have those columns, which
+    then only need to store their values.
+
+    The names must be distinct and sorted, which is the order in which a
+    row's columns are otherwise stored; an exception is thrown if not.
+*/
+
+struct FlatRowSchema {
+    FlatRowSchema(std::vector<PathElement> columnNames);
+    ~FlatRowSchema();
+
+    const std::vector<PathElement> & columnNames() const
+    {
+        return columnNames_;
+    }
+
+    size_t size() const
+    {
+        return columnNames_.size();
+    }
+
+    const PathElement & columnName(size_t i) const
+    {
+        return columnNames_[i];
+    }
+
+    /// Return the index of the given column, or -1 if it's not there
+    int find(const PathElement & columnName) const;
+
+private:
+    std::vector<PathElement> columnNames_;
+    struct Index;
+    std::unique_ptr<Index> index_;
+};
+
+
 /*****************************************************************************/
 /* EXPRESSION VALUE                                                          */
 /*****************************************************************************/
@@ -634,7 +679,7 @@ DECLARE_STRUCTURE_DESCRIPTION(EmbeddingMetadata);
     translation of operations on the logical API to operate efficiently
     on the storage class.
 
-    The three ways of storing rows are:
+    The four ways of storing rows are:
 
     1.  As a structured representation, which is a sequence of (name, value)
         pairs where names are simple strings (ie, not paths: PathElement not Path)
@@ -648,6 +693,11 @@ DECLARE_STRUCTURE_DESCRIPTION(EmbeddingMetadata);
         atomic values and a shape to understand how the indexes apply, along
         with a single timestamp that is shared amongst all elements.  This
         is an efficient way to store numerical data like indexes or matrices.
+    4.  As a flat representation, which has a contiguous array of atomic
+        values, a single timestamp, and a FlatRowSchema holding the column
+        names that is shared with other rows.  This is how wide rows with
+        the same columns, typically from a dataset, are stored without
+        paying for the names of their columns on each row.
 
     Again, although it is possible to ask the ExpressionValue if its elements
     are an embedding or stored in a structured or flattened representation,
@@ -712,6 +762,16 @@ struct ExpressionValue {
                     std::shared_ptr<const std::vector<ColumnPath> > cols,
                     Date ts);
 
+    /** Construct a flat row, with one value per column of the schema and
+        all at the given timestamp.  The values are stored contiguously
+        and the names are shared with the schema, so this is much cheaper
+        to create, copy and scan than the same structured row.  Empty
+        values mean that the column is absent from the row.
+    */
+    ExpressionValue(std::vector<CellValue> values,
+                    std::shared_ptr<const FlatRowSchema> schema,
+                    Date ts);
+
     // Construct from an embedding of simple values with common names
     // This is more efficient than a row as only the values are kept
     ExpressionValue(const std::vector<double> & values,
@@ -841,6 +901,7 @@ struct ExpressionValue {
         // Dodgy as hell.  But none of them have self referential pointers, and so it
         // works and with no possibility of an exception.
         std::swap(type_,    other.type_);
+        std::swap(structuredSorted_, other.structuredSorted_);
         std::swap(storage_[0], other.storage_[0]);
         std::swap(storage_[1], other.storage_[1]);
         std::swap(ts_, other.ts_);
@@ -889,6 +950,19 @@ struct ExpressionValue {
 
     bool isEmbedding() const;
 
+    /** If this is a row stored flat, return the schema holding its column
+        names, so that work that depends only on the names can be done once
+        for all of the rows that share it.  Otherwise returns null.
+    */
+    std::shared_ptr<const FlatRowSchema> getFlatRowSchema() const;
+
+    /** Return the values of a row stored flat, in the order of the columns
+        of its schema.  Empty values are columns that the row doesn't have,
+        and all of the others have the row's timestamp.  Throws if the row
+        isn't stored flat.
+    */
+    const std::vector<CellValue> & getFlatRowValues() const;
+
     std::string toString() const;
 
     Utf8String toUtf8String() const;
@@ -1095,6 +1169,12 @@ struct ExpressionValue {
         ie the number of times forEachColumnDestructive will be called.
     */
     size_t rowLength() const;
+
+    /** Return an estimate of the number of bytes of memory used by this
+        value, including what it points to.  Data shared with other values
+        is counted in each of them.
+    */
+    size_t memusage() const;
     
     /** Write a flattened representation of the current value to the given
         dataset row or event, prepending the given column name.
@@ -1265,11 +1345,17 @@ private:
         ATOM,        ///< Expression is an atom (CellValue), including null
         STRUCTURED,  ///< Expression is a structured, ie a destructured complex type with independent timestamps
         EMBEDDING,    ///< Uniform typed n-dimensional array of atoms
-        SUPERPOSITION ///< Multiple values of the same thing
+        SUPERPOSITION, ///< Multiple values of the same thing
+        FLATTENED    ///< Row of atoms with a shared schema and timestamp
     };
 
     Type type_;
 
+    /// For a structured value, whether its columns are in order of their
+    /// names with no duplicates, so that they can be binary searched.  It
+    /// fits in the padding after type_.
+    bool structuredSorted_;
+
     static std::string print(Type t);
     void assertType(Type requested, const std::string & details="") const;
 
@@ -1277,6 +1363,10 @@ private:
     /// element and an external set of column names
     struct Flattened;
 
+    /// Return the structured equivalent of a flattened value, which is
+    /// used for the less common operations on them.
+    ExpressionValue unflatten() const;
+
     /// This is how we store a embedding, which is a dense array of a
     /// uniform data type.
     struct Embedding;
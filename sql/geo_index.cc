@@ -0,0 +1,96 @@
+/** geo_index.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Spatial index of points on the Earth.
+*/
+
+#include "geo_index.h"
+#include "mldb/ext/s2/s2.h"
+#include "mldb/ext/s2/s2cap.h"
+#include "mldb/ext/s2/s2cellid.h"
+#include "mldb/ext/s2/s2latlng.h"
+#include "mldb/ext/s2/s2regioncoverer.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+// https://en.wikipedia.org/w/index.php?title=Earth_radius&action=edit&section=16
+static constexpr double EARTH_MEAN_RADIUS_METERS = 6371008.8;
+
+// Maximum number of cells covering the circle of a query.  More cells fit
+// the circle more tightly, but each one is another lookup.
+static constexpr int MAX_COVERING_CELLS = 8;
+
+double geoDistanceMeters(double lat1, double lon1, double lat2, double lon2)
+{
+    S2LatLng point1 = S2LatLng::FromDegrees(lat1, lon1).Normalized();
+    S2LatLng point2 = S2LatLng::FromDegrees(lat2, lon2).Normalized();
+
+    return point1.GetDistance(point2).radians() * EARTH_MEAN_RADIUS_METERS;
+}
+
+
+/*****************************************************************************/
+/* GEO INDEX                                                                 */
+/*****************************************************************************/
+
+void
+GeoIndex::
+add(double lat, double lon, uint32_t id)
+{
+    S2LatLng point = S2LatLng::FromDegrees(lat, lon).Normalized();
+    points.push_back({ S2CellId::FromLatLng(point).id(), lat, lon, id });
+}
+
+void
+GeoIndex::
+finish()
+{
+    std::sort(points.begin(), points.end());
+}
+
+void
+GeoIndex::
+forEachWithin(double lat, double lon, double radiusMeters,
+              const std::function<void (uint32_t id)> & onPoint) const
+{
+    if (points.empty() || !(radiusMeters >= 0))
+        return;
+
+    S2Point center = S2LatLng::FromDegrees(lat, lon).Normalized().ToPoint();
+
+    // The cells only need to contain the circle; the distance to each point
+    // is checked exactly below.  The circle is made slightly bigger so
+    // that rounding can't lose points that are right on its edge.
+    double angle = std::min(radiusMeters / EARTH_MEAN_RADIUS_METERS, M_PI);
+    S2Cap cap = S2Cap::FromAxisAngle
+        (center, S1Angle::Radians(angle * (1.0 + 1e-9) + 1e-12));
+
+    S2RegionCoverer coverer;
+    coverer.set_max_cells(MAX_COVERING_CELLS);
+
+    vector<S2CellId> covering;
+    coverer.GetCovering(cap, &covering);
+
+    auto compareCell = [] (const Point & p, uint64_t cell)
+        {
+            return p.cell < cell;
+        };
+
+    for (const S2CellId & cell: covering) {
+        uint64_t first = cell.range_min().id(), last = cell.range_max().id();
+        auto it = std::lower_bound(points.begin(), points.end(), first,
+                                   compareCell);
+        for (;  it != points.end() && it->cell <= last;  ++it) {
+            if (geoDistanceMeters(lat, lon, it->lat, it->lon) <= radiusMeters)
+                onPoint(it->id);
+        }
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,79 @@
+/** geo_index.h                                                     -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Spatial index of points on the Earth, for finding the points within a
+    given distance of another without looking at all of them.
+*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/** Great circle distance in meters between two points given in degrees,
+    on a spherical Earth.  This is what the geo_distance() SQL function
+    returns.
+*/
+double geoDistanceMeters(double lat1, double lon1, double lat2, double lon2);
+
+
+/*****************************************************************************/
+/* GEO INDEX                                                                 */
+/*****************************************************************************/
+
+/** Index of points by the S2 leaf cell that they are in.  The cells are
+    numbered along a space filling curve, so the points in any S2 cell are
+    a contiguous range of the sorted index.  A query covers the circle
+    around its center with a handful of cells, looks up the range of
+    each one, and checks the exact distance of the points it finds there.
+
+    Points are added with add() and the index sorted with finish(); after
+    that it's read only and can be queried from several threads at once.
+*/
+
+struct GeoIndex {
+
+    /** Add a point, identified by the given number.  Latitudes and
+        longitudes are in degrees.
+    */
+    void add(double lat, double lon, uint32_t id);
+
+    /** Sort the points, which must be done after they have been added and
+        before the index is queried.
+    */
+    void finish();
+
+    /** Call onPoint with the id of each point within radiusMeters of
+        (lat, lon), in no particular order.
+    */
+    void forEachWithin(double lat, double lon, double radiusMeters,
+                       const std::function<void (uint32_t id)> & onPoint) const;
+
+    /** Number of points in the index. */
+    size_t size() const
+    {
+        return points.size();
+    }
+
+private:
+    struct Point {
+        uint64_t cell;   ///< S2 leaf cell containing the point
+        double lat, lon;
+        uint32_t id;
+
+        bool operator < (const Point & other) const
+        {
+            return cell < other.cell;
+        }
+    };
+
+    std::vector<Point> points;
+};
+
+} // namespace MLDB
@@ -12,6 +12,7 @@
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/http/http_exception.h"
 #include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -525,5 +526,96 @@ AnnotatedJoinConditionStyleDescription()
     addValue("UNKNOWN", AnnotatedJoinCondition::UNKNOWN, "Unknown join type");
 }
 
+
+/*****************************************************************************/
+/* JOIN PLANNING                                                             */
+/*****************************************************************************/
+
+DEFINE_ENUM_DESCRIPTION(JoinStrategy);
+
+JoinStrategyDescription::
+JoinStrategyDescription()
+{
+    addValue("merge", JOIN_STRATEGY_MERGE,
+             "Sort both sides on the key and merge them");
+    addValue("hash", JOIN_STRATEGY_HASH,
+             "Index one side on the key and look up the other side's rows");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(JoinPlan);
+
+JoinPlanDescription::
+JoinPlanDescription()
+{
+    addField("strategy", &JoinPlan::strategy,
+             "Way in which the join is run");
+    addField("buildLeft", &JoinPlan::buildLeft,
+             "For a hash join, is the index built on the left side?");
+    addField("estimatedRows", &JoinPlan::estimatedRows,
+             "Estimated number of joined rows");
+    addField("mergeCost", &JoinPlan::mergeCost,
+             "Estimated cost of a merge join");
+    addField("hashCost", &JoinPlan::hashCost,
+             "Estimated cost of a hash join");
+}
+
+namespace {
+
+double sortCost(double n)
+{
+    return n * std::log2(std::max(n, 2.0));
+}
+
+// Relative cost of inserting a row into the hash index, compared to
+// looking one up
+constexpr double HASH_BUILD_FACTOR = 2.0;
+
+// Fixed cost of a hash join, for setting up its partitions and indexes.
+// This keeps small joins, where it makes no difference, as merge joins.
+constexpr double HASH_SETUP_COST = 100000.0;
+
+} // file scope
+
+JoinPlan
+planEquiJoin(const JoinSideStats & left,
+             const JoinSideStats & right,
+             bool sortOutput)
+{
+    JoinPlan result;
+    if (!left.known() || !right.known())
+        return result;
+
+    double l = left.rows, r = right.rows;
+
+    auto distinct = [] (const JoinSideStats & side)
+        {
+            if (side.distinctKeys >= 0)
+                return std::min(side.distinctKeys, side.rows);
+            return -1.0;
+        };
+
+    double dl = distinct(left), dr = distinct(right);
+    double d;
+    if (dl < 0 && dr < 0)
+        d = std::min(l, r);
+    else d = std::max(dl, dr);
+    d = std::max(d, 1.0);
+
+    result.estimatedRows = l * r / d;
+    result.buildLeft = l < r;
+
+    double build = std::min(l, r), probe = std::max(l, r);
+    double output = result.estimatedRows;
+
+    result.mergeCost = sortCost(l) + sortCost(r) + l + r + output;
+    result.hashCost = HASH_SETUP_COST + HASH_BUILD_FACTOR * build + probe
+        + output + (sortOutput ? sortCost(output) : 0.0);
+
+    if (result.hashCost < result.mergeCost)
+        result.strategy = JOIN_STRATEGY_HASH;
+
+    return result;
+}
+
 } // namespace MLDB
 
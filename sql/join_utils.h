@@ -195,5 +195,60 @@ DECLARE_STRUCTURE_DESCRIPTION_NAMED(AnnotatedJoinConditionSideDescription,
 DECLARE_ENUM_DESCRIPTION_NAMED(AnnotatedJoinConditionStyleDescription,
                               AnnotatedJoinCondition::Style);
 
+
+/*****************************************************************************/
+/* JOIN PLANNING                                                             */
+/*****************************************************************************/
+
+/** What is known about one side of an equijoin when choosing how to run
+    it.  Negative values are unknown.
+*/
+struct JoinSideStats {
+    double rows = -1;          ///< Number of rows on the side
+    double distinctKeys = -1;  ///< Number of distinct values of the key
+
+    bool known() const { return rows >= 0; }
+
+    /// Is each value of the key in only one row?
+    bool uniqueKeys() const { return distinctKeys >= 0 && distinctKeys >= rows; }
+};
+
+/** Way in which an equijoin is run. */
+enum JoinStrategy {
+    JOIN_STRATEGY_MERGE,   ///< Sort both sides on the key and merge them
+    JOIN_STRATEGY_HASH     ///< Index one side on the key; look up the other
+};
+
+DECLARE_ENUM_DESCRIPTION(JoinStrategy);
+
+/** Plan for running an equijoin, along with the estimates it came from. */
+struct JoinPlan {
+    JoinStrategy strategy = JOIN_STRATEGY_MERGE;
+    bool buildLeft = false;        ///< For a hash join, index the left side
+    double estimatedRows = -1;     ///< Estimated number of joined rows
+    double mergeCost = -1;         ///< Estimated cost of a merge join
+    double hashCost = -1;          ///< Estimated cost of a hash join
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(JoinPlan);
+
+/** Choose how to run an equijoin with a simple cost model, which counts
+    the rows that are touched when sorting (n log n for each side), when
+    building and probing a hash index and when outputting the joined rows,
+    plus a fixed cost for setting up a hash join.
+    The number of output rows is estimated as left * right / max(distinct
+    keys); with unknown distinct keys, the key is assumed to be unique on
+    the smaller side.  The hash index is built on the smaller side.
+
+    If sortOutput is true, the caller needs the rows in the order that a
+    merge join would produce them, so a hash join has to sort its output
+    afterwards, which only pays off for selective joins.
+
+    If either side is unknown, a merge join is chosen.
+*/
+JoinPlan planEquiJoin(const JoinSideStats & left,
+                      const JoinSideStats & right,
+                      bool sortOutput);
+
 } // namespace MLDB
 
@@ -0,0 +1,271 @@
+/** path_interner.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Process-wide table of interned path elements.
+*/
+
+#include "path_interner.h"
+#include "mldb/ext/cityhash/src/city.h"
+#include "mldb/types/value_description.h"
+#include "mldb/http/http_exception.h"
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <iostream>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/** The table itself.
+
+    Entries live in a list of chunks, each twice the size of the one
+    before, which means that they never move once created and that the
+    chunk and offset of an ID are a couple of integer operations away.
+
+    The index from element to ID is an open addressing hash table of
+    slots, each holding the low bits of the ID plus one (zero for an
+    empty slot) and the top 32 bits of the hash.  When it gets too full,
+    a new index of twice the size is built and published; the old one is
+    kept (it's never freed) so that readers that are still using it can
+    finish.  A reader that misses in an old index falls back to the
+    locked path, which always looks in the current one.
+*/
+struct PathElementTable {
+
+    struct Entry {
+        PathElement element;
+        uint64_t hash;
+    };
+
+    static constexpr size_t FIRST_CHUNK_BITS = 10;
+    static constexpr size_t NUM_CHUNKS = 33 - FIRST_CHUNK_BITS;
+
+    struct Index {
+        Index(size_t numSlots)
+            : mask(numSlots - 1), slots(new std::atomic<uint64_t>[numSlots])
+        {
+            for (size_t i = 0;  i < numSlots;  ++i)
+                slots[i].store(0, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    };
+
+    PathElementTable()
+        : numEntries(0)
+    {
+        for (auto & c: chunks)
+            c.store(nullptr, std::memory_order_relaxed);
+        Index * idx = new Index(1024);
+        indexes.emplace_back(idx);
+        index.store(idx, std::memory_order_release);
+    }
+
+    static std::pair<size_t, size_t> chunkAndOffset(uint32_t id)
+    {
+        uint64_t v = ((uint64_t)id >> FIRST_CHUNK_BITS) + 1;
+        int chunk = 63 - __builtin_clzll(v);
+        uint64_t start = ((uint64_t(1) << chunk) - 1) << FIRST_CHUNK_BITS;
+        return { chunk, id - start };
+    }
+
+    static size_t chunkSize(size_t chunk)
+    {
+        return size_t(1) << (chunk + FIRST_CHUNK_BITS);
+    }
+
+    const Entry & getEntry(uint32_t id) const
+    {
+        if (id >= numEntries.load(std::memory_order_acquire))
+            throw HttpReturnException
+                (500, "Attempt to dereference unknown interned path element",
+                 "id", id);
+        size_t chunk, offset;
+        std::tie(chunk, offset) = chunkAndOffset(id);
+        return chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+
+    static uint64_t slotValue(uint32_t id, uint64_t hash)
+    {
+        return (hash & 0xffffffff00000000ULL) | (uint64_t(id) + 1);
+    }
+
+    /** Look for the element in the given index.  Returns the ID and true
+        if found.
+    */
+    std::pair<uint32_t, bool>
+    find(const Index & idx, const PathElement & element, uint64_t hash) const
+    {
+        for (size_t i = hash & idx.mask;  ;  i = (i + 1) & idx.mask) {
+            uint64_t val = idx.slots[i].load(std::memory_order_acquire);
+            if (val == 0)
+                return { 0, false };
+            if ((val >> 32) != (hash >> 32))
+                continue;
+            uint32_t id = (val & 0xffffffff) - 1;
+            const Entry & entry = getEntry(id);
+            if (entry.hash == hash && entry.element == element)
+                return { id, true };
+        }
+    }
+
+    static void insertSlot(Index & idx, uint32_t id, uint64_t hash)
+    {
+        for (size_t i = hash & idx.mask;  ;  i = (i + 1) & idx.mask) {
+            if (idx.slots[i].load(std::memory_order_relaxed) == 0) {
+                idx.slots[i].store(slotValue(id, hash),
+                                   std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    std::pair<uint32_t, bool> tryGet(const PathElement & element) const
+    {
+        uint64_t hash = element.hash();
+        return find(*index.load(std::memory_order_acquire), element, hash);
+    }
+
+    uint32_t intern(const PathElement & element)
+    {
+        uint64_t hash = element.hash();
+
+        // Lock-free fast path, for when it's already there
+        auto found = find(*index.load(std::memory_order_acquire),
+                          element, hash);
+        if (found.second)
+            return found.first;
+
+        std::unique_lock<std::mutex> guard(mutex);
+
+        // Look again in the current index, as it may have been added or
+        // the index replaced since.
+        Index * idx = index.load(std::memory_order_relaxed);
+        found = find(*idx, element, hash);
+        if (found.second)
+            return found.first;
+
+        uint32_t id = numEntries.load(std::memory_order_relaxed);
+        if (id == std::numeric_limits<uint32_t>::max())
+            throw HttpReturnException
+                (500, "Too many interned path elements");
+
+        size_t chunk, offset;
+        std::tie(chunk, offset) = chunkAndOffset(id);
+        Entry * entries = chunks[chunk].load(std::memory_order_relaxed);
+        if (!entries) {
+            entries = new Entry[chunkSize(chunk)];
+            chunks[chunk].store(entries, std::memory_order_release);
+        }
+        entries[offset].element = element;
+        entries[offset].hash = hash;
+        numEntries.store(id + 1, std::memory_order_release);
+
+        // Keep the index no more than half full
+        if ((id + 1) * 2 > idx->mask + 1) {
+            Index * newIdx = new Index((idx->mask + 1) * 2);
+            for (uint32_t i = 0;  i <= id;  ++i)
+                insertSlot(*newIdx, i, getEntry(i).hash);
+            indexes.emplace_back(newIdx);
+            index.store(newIdx, std::memory_order_release);
+        }
+        else insertSlot(*idx, id, hash);
+
+        return id;
+    }
+
+    std::atomic<Entry *> chunks[NUM_CHUNKS];
+    std::atomic<uint32_t> numEntries;
+    std::atomic<Index *> index;
+
+    /// Protects the insert path, and owns all indexes ever created
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Index> > indexes;
+};
+
+PathElementTable & getTable()
+{
+    // Never destroyed, since IDs and references may be used by other
+    // static objects that are destroyed after this one would be.
+    static PathElementTable * table = new PathElementTable();
+    return *table;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PATH ELEMENT INTERNING                                                    */
+/*****************************************************************************/
+
+InternedPathElementId
+internPathElement(const PathElement & element)
+{
+    return getTable().intern(element);
+}
+
+std::pair<InternedPathElementId, bool>
+tryGetInternedPathElement(const PathElement & element)
+{
+    return getTable().tryGet(element);
+}
+
+const PathElement &
+getInternedPathElement(InternedPathElementId id)
+{
+    return getTable().getEntry(id).element;
+}
+
+uint64_t
+getInternedPathElementHash(InternedPathElementId id)
+{
+    return getTable().getEntry(id).hash;
+}
+
+size_t
+numInternedPathElements()
+{
+    return getTable().numEntries.load(std::memory_order_acquire);
+}
+
+
+/*****************************************************************************/
+/* INTERNED PATH                                                             */
+/*****************************************************************************/
+
+InternedPath::
+InternedPath(const Path & path)
+    : hash_(0)
+{
+    ids_.reserve(path.size());
+    for (size_t i = 0;  i < path.size();  ++i) {
+        InternedPathElementId id = internPathElement(path.at(i));
+        uint64_t elHash = getInternedPathElementHash(id);
+        // Same combination as Path::oldHash()
+        hash_ = i == 0 ? elHash : Hash128to64({hash_, elHash});
+        ids_.push_back(id);
+    }
+}
+
+Path
+InternedPath::
+toPath() const
+{
+    PathBuilder builder;
+    for (auto & id: ids_)
+        builder.add(getInternedPathElement(id));
+    return builder.extract();
+}
+
+std::ostream & operator << (std::ostream & stream, const InternedPath & path)
+{
+    return stream << path.toPath();
+}
+
+} // namespace MLDB
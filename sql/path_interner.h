@@ -0,0 +1,123 @@
+/** path_interner.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Process-wide table of interned path elements.  Each distinct element
+    is stored once, and identified by a 32 bit ID that stays valid for the
+    lifetime of the process.
+
+    The table is append-only.  Looking up an element that is already
+    interned, or the element for an ID, never takes a lock; only adding
+    a new element does.  It's intended for column names, which come from a
+    small and slowly growing set even on very wide datasets, and not for
+    row names, which would grow it without bound.
+*/
+
+#pragma once
+
+#include "path.h"
+#include "mldb/utils/compact_vector.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PATH ELEMENT INTERNING                                                    */
+/*****************************************************************************/
+
+/// ID of an interned path element
+typedef uint32_t InternedPathElementId;
+
+/** Return the ID of the given element, adding it to the table if it's not
+    already there.  Equal elements always give the same ID.
+*/
+InternedPathElementId internPathElement(const PathElement & element);
+
+/** Return the ID of the given element if it's already interned, and
+    false in the second member otherwise.  Never modifies the table.
+*/
+std::pair<InternedPathElementId, bool>
+tryGetInternedPathElement(const PathElement & element);
+
+/** Return the element with the given ID.  The reference is valid for the
+    lifetime of the process.
+*/
+const PathElement & getInternedPathElement(InternedPathElementId id);
+
+/// Return the hash (PathElement::hash()) of the element with the given ID
+uint64_t getInternedPathElementHash(InternedPathElementId id);
+
+/// Return the number of elements in the table
+size_t numInternedPathElements();
+
+
+/*****************************************************************************/
+/* INTERNED PATH                                                             */
+/*****************************************************************************/
+
+/** A path represented as a list of interned element IDs.  Equality and
+    hashing are integer operations, and copying it never copies the
+    contents of its elements.  The hash is the same as that of the
+    equivalent Path, so the two can be used interchangeably as keys.
+*/
+
+struct InternedPath {
+    InternedPath()
+        : hash_(0)
+    {
+    }
+
+    /// Intern all of the elements of the path
+    explicit InternedPath(const Path & path);
+
+    /// Return the equivalent Path
+    Path toPath() const;
+
+    size_t size() const { return ids_.size(); }
+    bool empty() const { return ids_.empty(); }
+
+    InternedPathElementId id(size_t el) const { return ids_.at(el); }
+
+    const PathElement & at(size_t el) const
+    {
+        return getInternedPathElement(ids_.at(el));
+    }
+
+    const PathElement & operator [] (size_t el) const
+    {
+        return at(el);
+    }
+
+    /// Return the hash, which is the same as Path::hash()
+    uint64_t hash() const { return hash_; }
+
+    bool operator == (const InternedPath & other) const
+    {
+        return hash_ == other.hash_ && ids_ == other.ids_;
+    }
+
+    bool operator != (const InternedPath & other) const
+    {
+        return ! operator == (other);
+    }
+
+private:
+    compact_vector<InternedPathElementId, 4> ids_;
+    uint64_t hash_;
+};
+
+std::ostream & operator << (std::ostream & stream, const InternedPath & path);
+
+} // namespace MLDB
+
+namespace std {
+
+template<>
+struct hash<MLDB::InternedPath> {
+    size_t operator () (const MLDB::InternedPath & path) const
+    {
+        return path.hash();
+    }
+};
+
+} // namespace std
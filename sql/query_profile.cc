@@ -0,0 +1,173 @@
+/** query_profile.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Statistics of the elements of a query as it runs.
+*/
+
+#include "query_profile.h"
+#include "mldb/arch/timers.h"
+#include <algorithm>
+#include <time.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY PROFILE                                                             */
+/*****************************************************************************/
+
+static thread_local QueryProfile * currentProfile = nullptr;
+
+QueryProfile::
+QueryProfile(Utf8String element)
+    : element(std::move(element)),
+      rowsOut(0), rowsIn(0), hasRowsIn(false),
+      wallTime(0), cpuTime(0)
+{
+}
+
+QueryProfile *
+QueryProfile::
+addChild(Utf8String element)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    children.emplace_back(new QueryProfile(std::move(element)));
+    return children.back().get();
+}
+
+void
+QueryProfile::
+setStrategy(Utf8String strategy)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    this->strategy = std::move(strategy);
+}
+
+void
+QueryProfile::
+recordRowsOut(uint64_t numRows)
+{
+    if (numRows == 0)
+        return;
+    std::unique_lock<std::mutex> guard(mutex);
+    rowsOut += numRows;
+    rowsOutByThread[std::this_thread::get_id()] += numRows;
+}
+
+void
+QueryProfile::
+recordRowsIn(uint64_t numRows)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    rowsIn += numRows;
+    hasRowsIn = true;
+}
+
+void
+QueryProfile::
+recordTime(double wallSeconds, double cpuSeconds)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    wallTime += wallSeconds;
+    cpuTime += cpuSeconds;
+}
+
+Json::Value
+QueryProfile::
+toJson() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    Json::Value result;
+    result["element"] = element;
+    if (!strategy.empty())
+        result["strategy"] = strategy;
+
+    uint64_t childRowsOut = 0;
+    double childWallTime = 0;
+    Json::Value childrenJson(Json::arrayValue);
+    for (auto & c: children) {
+        childrenJson.append(c->toJson());
+        std::unique_lock<std::mutex> childGuard(c->mutex);
+        childRowsOut += c->rowsOut;
+        childWallTime += c->wallTime;
+    }
+
+    if (hasRowsIn)
+        result["rowsIn"] = rowsIn;
+    else if (!children.empty())
+        result["rowsIn"] = childRowsOut;
+    result["rowsOut"] = rowsOut;
+    result["wallTime"] = wallTime;
+    result["selfWallTime"] = std::max(0.0, wallTime - childWallTime);
+    result["cpuTime"] = cpuTime;
+
+    // Distribution of the output over threads, biggest first
+    std::vector<uint64_t> perThread;
+    for (auto & t: rowsOutByThread)
+        perThread.push_back(t.second);
+    std::sort(perThread.begin(), perThread.end(), std::greater<uint64_t>());
+    Json::Value threads(Json::arrayValue);
+    for (auto & n: perThread)
+        threads.append(n);
+    result["rowsOutPerThread"] = std::move(threads);
+
+    if (!children.empty())
+        result["children"] = std::move(childrenJson);
+
+    return result;
+}
+
+QueryProfile *
+QueryProfile::
+current()
+{
+    return currentProfile;
+}
+
+double
+QueryProfile::
+threadCpuTime()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0.0;
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+QueryProfile::Scope::
+Scope(QueryProfile * profile)
+    : previous(currentProfile)
+{
+    currentProfile = profile;
+}
+
+QueryProfile::Scope::
+~Scope()
+{
+    currentProfile = previous;
+}
+
+QueryProfile::Timer::
+Timer(QueryProfile * profile)
+    : profile(profile), wall(0), cpu(0)
+{
+    if (!profile)
+        return;
+    wall = wall_time();
+    cpu = threadCpuTime();
+}
+
+QueryProfile::Timer::
+~Timer()
+{
+    if (!profile)
+        return;
+    profile->recordTime(wall_time() - wall, threadCpuTime() - cpu);
+}
+
+} // namespace MLDB
@@ -0,0 +1,122 @@
+/** query_profile.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Statistics of the elements of a query as it runs, used to explain where
+    a query spends its time.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include "mldb/ext/jsoncpp/value.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY PROFILE                                                             */
+/*****************************************************************************/
+
+/** Node of the profile of a running query.  Each element of the query that
+    is profiled gets a node under the node of the element that started it,
+    so that the nodes form the tree of the query's plan.
+
+    Nothing is recorded unless a profile has been made current with a
+    Scope on the thread that binds and starts the query, so that queries
+    that aren't being explained only pay for a null pointer test when
+    each element is started.  Once started, an element may record into its
+    node from any thread.
+*/
+
+struct QueryProfile {
+    QueryProfile(Utf8String element);
+
+    /// Kind of element, for example "JoinElement"
+    Utf8String element;
+
+    /** Add a node for an element started from within this one.  The node
+        lives as long as this one does.
+    */
+    QueryProfile * addChild(Utf8String element);
+
+    /** Describe the strategy chosen by the element, for example the kind
+        of join or the way that rows are scanned.
+    */
+    void setStrategy(Utf8String strategy);
+
+    /** Record that the element output the given number of rows, from the
+        calling thread.
+    */
+    void recordRowsOut(uint64_t numRows);
+
+    /** Record that the element read the given number of rows.  This is
+        only needed for elements that read rows other than from the elements
+        under them, whose output is counted automatically.
+    */
+    void recordRowsIn(uint64_t numRows);
+
+    /** Record time spent in the element, including in the elements that it
+        called.
+    */
+    void recordTime(double wallSeconds, double cpuSeconds);
+
+    /** Return the tree rooted at this node as JSON.  The times are those
+        of the threads that called into the element, summed over threads,
+        so for elements that are called in parallel they may be greater
+        than the elapsed time.  Work that an element hands off to threads of
+        its own shows in its wall time but not in its CPU time.  rowsIn is
+        only present when it is known.
+    */
+    Json::Value toJson() const;
+
+    /** Return the node that elements started by this thread should go
+        under, or null if the query isn't being profiled.
+    */
+    static QueryProfile * current();
+
+    /** Return the CPU time used by the calling thread, in seconds. */
+    static double threadCpuTime();
+
+    /** Make the given node current on this thread for the lifetime of the
+        object.
+    */
+    struct Scope {
+        Scope(QueryProfile * profile);
+        ~Scope();
+
+    private:
+        QueryProfile * previous;
+    };
+
+    /** Record the wall and CPU time of the calling thread between
+        construction and destruction into the given node, if it isn't
+        null.
+    */
+    struct Timer {
+        Timer(QueryProfile * profile);
+        ~Timer();
+
+    private:
+        QueryProfile * profile;
+        double wall, cpu;
+    };
+
+private:
+    mutable std::mutex mutex;
+    Utf8String strategy;
+    std::vector<std::unique_ptr<QueryProfile> > children;
+    std::map<std::thread::id, uint64_t> rowsOutByThread;
+    uint64_t rowsOut;
+    uint64_t rowsIn;
+    bool hasRowsIn;
+    double wallTime;
+    double cpuTime;
+};
+
+} // namespace MLDB
@@ -8,11 +8,104 @@
 #include "mldb/http/http_exception.h"
 #include "mldb/sql/builtin_functions.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/jml/utils/environment.h"
+#include "re2/re2.h"
 
 using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+// Which engine do we use for matching?  "std" (the default) uses only the
+// standard library (ECMAScript syntax); "re2" uses RE2 when a pattern is
+// within its syntax, which runs in linear time but differs in some corner
+// cases (for example it has no backreferences or lookahead, which make
+// the pattern fall back to the standard engine).
+EnvOption<std::string> MLDB_REGEX_ENGINE("MLDB_REGEX_ENGINE", "std");
+
+std::shared_ptr<const re2::RE2> compileRe2(const Utf8String & pattern)
+{
+    re2::RE2::Options options;
+    options.set_encoding(re2::RE2::Options::EncodingUTF8);
+    options.set_log_errors(false);
+    auto result = std::make_shared<re2::RE2>
+        (re2::StringPiece(pattern.rawData(), pattern.rawLength()), options);
+    if (!result->ok())
+        return nullptr;
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPILED REGEX                                                            */
+/*****************************************************************************/
+
+bool
+CompiledRegex::
+match(const Utf8String & str) const
+{
+    if (re2)
+        return re2::RE2::FullMatch
+            (re2::StringPiece(str.rawData(), str.rawLength()), *re2);
+    return regex_match(str, regex);
+}
+
+bool
+CompiledRegex::
+search(const Utf8String & str) const
+{
+    if (re2)
+        return re2::RE2::PartialMatch
+            (re2::StringPiece(str.rawData(), str.rawLength()), *re2);
+    return regex_search(str, regex);
+}
+
+
+/*****************************************************************************/
+/* REGEX CACHE                                                               */
+/*****************************************************************************/
+
+RegexCache::
+RegexCache(size_t capacity)
+    : capacity(capacity)
+{
+}
+
+CompiledRegex
+RegexCache::
+get(const Utf8String & pattern,
+    const std::function<CompiledRegex ()> & compile)
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(pattern);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->second;
+        }
+    }
+
+    // Compile outside of the lock, as it may be slow
+    CompiledRegex result = compile();
+
+    std::unique_lock<std::mutex> guard(mutex);
+    if (index.count(pattern))
+        return result;  // someone else got there first
+
+    entries.emplace_front(pattern, result);
+    index[pattern] = entries.begin();
+    if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+
+    return result;
+}
+
+
 /*****************************************************************************/
 /* REGEX HELPER                                                              */
 /*****************************************************************************/
@@ -24,16 +117,30 @@ RegexHelper()
 
 void
 RegexHelper::
-init(BoundSqlExpression expr_, int argNumber)
+init(BoundSqlExpression expr_, int argNumber, bool allowRe2)
 {
     expr = std::move(expr_);
     this->argNumber = argNumber;
+    this->useRe2 = allowRe2 && MLDB_REGEX_ENGINE.get() == "re2";
 
     if (expr.info->isConst()) {
         isPrecompiled = true;
-        precompiled = compile(expr.constantValue());
+        precompiled = compileAll(expr.constantValue());
+    }
+    else {
+        isPrecompiled = false;
+        cache = std::make_shared<RegexCache>();
     }
-    else isPrecompiled = false;
+}
+
+CompiledRegex
+RegexHelper::
+compileAll(const ExpressionValue & val) const
+{
+    CompiledRegex result(compile(val));
+    if (useRe2 && result.initialized())
+        result.re2 = compileRe2(result.regex.surface());
+    return result;
 }
 
 Regex
@@ -73,9 +180,16 @@ operator () (const std::vector<ExpressionValue> & args,
     if (isPrecompiled) {
         return apply(args, scope, precompiled);
     }
-    else {
-        return apply(args, scope, compile(args.at(argNumber)));
+
+    const ExpressionValue & val = args.at(argNumber);
+    if (!val.isString()) {
+        // Not cacheable; compile() will deal with it
+        return apply(args, scope, compileAll(val));
     }
+
+    return apply(args, scope,
+                 cache->get(val.toUtf8String(),
+                            [&] () { return compileAll(val); }));
 }
 
 
@@ -86,14 +200,16 @@ operator () (const std::vector<ExpressionValue> & args,
 ApplyRegexReplace::
 ApplyRegexReplace(BoundSqlExpression e)
 {
-    init(std::move(e), 1 /* argNumber */);
+    // RE2 has a different replacement syntax, so we stick to the standard
+    // engine
+    init(std::move(e), 1 /* argNumber */, false /* allowRe2 */);
 }
 
 ExpressionValue
 ApplyRegexReplace::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     checkArgsSize(args.size(), 3);
 
@@ -101,7 +217,7 @@ apply(const std::vector<ExpressionValue> & args,
         return ExpressionValue::null(calcTs(args[0], args[1], args[2]));
 
     auto result = regex_replace(args[0].toUtf8String(),
-                                regex,
+                                regex.regex,
                                 args[2].toUtf8String());
     
     return ExpressionValue(std::move(result), calcTs(args[0], args[1], args[2]));
@@ -122,7 +238,7 @@ ExpressionValue
 ApplyRegexMatch::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     // TODO: should be able to pass utf-8 string directly in
 
@@ -131,7 +247,7 @@ apply(const std::vector<ExpressionValue> & args,
     if (args[0].empty() || args[1].empty())
         return ExpressionValue::null(calcTs(args[0], args[1]));
 
-    bool result = regex_match(args[0].toUtf8String(), regex);
+    bool result = regex.match(args[0].toUtf8String());
     return ExpressionValue(result, calcTs(args[0], args[1]));
 }
 
@@ -150,7 +266,7 @@ ExpressionValue
 ApplyRegexSearch::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     // TODO: should be able to pass utf-8 string directly in
 
@@ -159,7 +275,7 @@ apply(const std::vector<ExpressionValue> & args,
     if (args[0].empty() || args[1].empty())
         return ExpressionValue::null(calcTs(args[0], args[1]));
 
-    bool result = regex_search(args[0].toUtf8String(), regex);
+    bool result = regex.search(args[0].toUtf8String());
     return ExpressionValue(result, calcTs(args[0], args[1]));
 }
 
@@ -253,7 +369,7 @@ ExpressionValue
 ApplyLike::
 apply(const std::vector<ExpressionValue> & args,
       const SqlRowScope & scope,
-      const Regex & regex) const
+      const CompiledRegex & regex) const
 {
     checkArgsSize(args.size(), 2);
 
@@ -269,7 +385,7 @@ apply(const std::vector<ExpressionValue> & args,
             (400, "LIKE expression must have string on left side");
     }
     
-    bool result = regex_match(args[0].toUtf8String(), regex);
+    bool result = regex.match(args[0].toUtf8String());
 
     if (isNegative)
         result = !result;
@@ -5,13 +5,81 @@
     Helper classes for regex.
 */
 
+#pragma once
+
 #include "mldb/types/regex.h"
 #include "sql_expression.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 
+namespace re2 {
+class RE2;
+} // namespace re2
 
 namespace MLDB {
 
 
+/*****************************************************************************/
+/* COMPILED REGEX                                                            */
+/*****************************************************************************/
+
+/** A compiled regular expression.  It always has the standard version; if
+    the RE2 engine is enabled (MLDB_REGEX_ENGINE=re2) and the pattern is
+    within the syntax that RE2 supports, it also has an RE2 version, which
+    is used for matching as it runs in linear time.
+*/
+struct CompiledRegex {
+    CompiledRegex() = default;
+    CompiledRegex(Regex regex)
+        : regex(std::move(regex))
+    {
+    }
+
+    Regex regex;
+    std::shared_ptr<const re2::RE2> re2;
+
+    bool initialized() const { return regex.initialized(); }
+
+    /// Does the whole of the string match?
+    bool match(const Utf8String & str) const;
+
+    /// Does any part of the string match?
+    bool search(const Utf8String & str) const;
+};
+
+
+/*****************************************************************************/
+/* REGEX CACHE                                                               */
+/*****************************************************************************/
+
+/** Bounded LRU cache of compiled regexes, keyed by the pattern.  This is
+    used when the pattern isn't constant, to avoid recompiling it for each
+    row when it only takes a few values.  Thread safe.
+*/
+struct RegexCache {
+    static constexpr size_t DEFAULT_CAPACITY = 64;
+
+    RegexCache(size_t capacity = DEFAULT_CAPACITY);
+
+    /** Return the compiled version of the given pattern, calling compile
+        to create it if it's not in the cache.  Exceptions thrown by
+        compile are passed through, and nothing is cached.
+    */
+    CompiledRegex get(const Utf8String & pattern,
+                      const std::function<CompiledRegex ()> & compile);
+
+private:
+    typedef std::list<std::pair<Utf8String, CompiledRegex> > Entries;
+
+    size_t capacity;
+    std::mutex mutex;
+    Entries entries;  ///< Most recently used first
+    std::unordered_map<Utf8String, Entries::iterator> index;
+};
+
+
 /*****************************************************************************/
 /* REGEX HELPER                                                              */
 /*****************************************************************************/
@@ -26,18 +94,26 @@ struct RegexHelper {
     /// compilation, etc.  It can't be done in the real constructor as
     /// then the compile method would be bound to this one, not the one
     /// overriden in the sub-class.
+    ///
+    /// If allowRe2 is false, the RE2 engine is never used, for example
+    /// because the operation isn't one that it can do with the same
+    /// semantics.
     void init(BoundSqlExpression expr,
-              int argNumber);
+              int argNumber,
+              bool allowRe2 = true);
 
     /// Called to take an expression and turn it into a regex that will be
     /// applied.  Default simply compiles a standard regex.
     virtual Regex compile(const ExpressionValue & val) const;
 
+    /// Compile with compile(), and add the RE2 version if it's enabled
+    CompiledRegex compileAll(const ExpressionValue & val) const;
+
     /// The expression that the regex came from, to help with error messages
     BoundSqlExpression expr;
 
     /// The pre-compiled version of that expression, when it's constant
-    Regex precompiled;
+    CompiledRegex precompiled;
 
     /// Is it actually constant (and precompiled), or computed on the fly?
     bool isPrecompiled;
@@ -46,9 +122,16 @@ struct RegexHelper {
     /// constant?
     int argNumber;
 
+    /// Do we also compile with RE2?
+    bool useRe2;
+
+    /// Regexes that have been compiled on the fly.  Shared, as the helper
+    /// is copied into the bound function.
+    std::shared_ptr<RegexCache> cache;
+
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const = 0;
+                                  const CompiledRegex & regex) const = 0;
 
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & scope);
@@ -64,7 +147,7 @@ struct ApplyRegexReplace: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 };
 
 
@@ -77,7 +160,7 @@ struct ApplyRegexMatch: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 };
 
 
@@ -90,7 +173,7 @@ struct ApplyRegexSearch: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 };
 
 
@@ -109,7 +192,7 @@ struct ApplyLike: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const Regex & regex) const;
+                                  const CompiledRegex & regex) const;
 
     /// This inverts it, ie turns LIKE into NOT LIKE
     bool isNegative;
@@ -0,0 +1,258 @@
+/** sketches.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Mergeable summaries of streams of values.
+*/
+
+#include "sketches.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HYPER LOG LOG                                                             */
+/*****************************************************************************/
+
+constexpr int HyperLogLog::PRECISION;
+constexpr size_t HyperLogLog::NUM_REGISTERS;
+constexpr size_t HyperLogLog::MAX_SPARSE;
+
+void
+HyperLogLog::
+addMixed(uint64_t hash)
+{
+    if (!registers.empty()) {
+        addToRegisters(hash);
+        return;
+    }
+
+    pending.push_back(hash);
+    if (pending.size() >= MAX_SPARSE)
+        compactSparse();
+}
+
+void
+HyperLogLog::
+addToRegisters(uint64_t hash)
+{
+    uint32_t index = hash >> (64 - PRECISION);
+    uint64_t rest = hash << PRECISION;
+    // Position of the first set bit, counting from 1
+    uint8_t rank = rest == 0
+        ? 64 - PRECISION + 1
+        : std::min<int>(__builtin_clzll(rest) + 1, 64 - PRECISION + 1);
+    registers[index] = std::max(registers[index], rank);
+}
+
+void
+HyperLogLog::
+compactSparse()
+{
+    std::sort(pending.begin(), pending.end());
+    size_t before = sparse.size();
+    sparse.insert(sparse.end(), pending.begin(), pending.end());
+    std::inplace_merge(sparse.begin(), sparse.begin() + before,
+                       sparse.end());
+    sparse.erase(std::unique(sparse.begin(), sparse.end()), sparse.end());
+    pending.clear();
+
+    if (sparse.size() > MAX_SPARSE)
+        toDense();
+}
+
+void
+HyperLogLog::
+toDense()
+{
+    registers.resize(NUM_REGISTERS, 0);
+    for (auto & h: sparse)
+        addToRegisters(h);
+    for (auto & h: pending)
+        addToRegisters(h);
+    std::vector<uint64_t>().swap(sparse);
+    std::vector<uint64_t>().swap(pending);
+}
+
+uint64_t
+HyperLogLog::
+estimate()
+{
+    if (registers.empty()) {
+        compactSparse();
+        if (registers.empty())
+            return sparse.size();
+    }
+
+    static constexpr double m = NUM_REGISTERS;
+    static const double alpha = 0.7213 / (1.0 + 1.079 / m);
+
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (auto & r: registers) {
+        sum += std::ldexp(1.0, -r);
+        zeros += (r == 0);
+    }
+
+    double estimate = alpha * m * m / sum;
+
+    // Use linear counting for small cardinalities, where it is more
+    // accurate.  The threshold is the empirical one from HLL++ for
+    // this precision.
+    if (zeros != 0) {
+        double linear = m * std::log(m / zeros);
+        if (linear <= 11500)
+            estimate = linear;
+    }
+
+    return std::llround(estimate);
+}
+
+void
+HyperLogLog::
+merge(const HyperLogLog & other)
+{
+    if (!other.registers.empty()) {
+        if (registers.empty())
+            toDense();
+        for (size_t i = 0;  i < NUM_REGISTERS;  ++i)
+            registers[i] = std::max(registers[i], other.registers[i]);
+        return;
+    }
+
+    for (auto & h: other.sparse)
+        addMixed(h);
+    for (auto & h: other.pending)
+        addMixed(h);
+}
+
+
+/*****************************************************************************/
+/* T DIGEST                                                                  */
+/*****************************************************************************/
+
+constexpr double TDigest::COMPRESSION;
+constexpr size_t TDigest::BUFFER_SIZE;
+
+TDigest::
+TDigest()
+    : totalWeight(0), min(INFINITY), max(-INFINITY)
+{
+}
+
+void
+TDigest::
+add(double value, double weight)
+{
+    if (std::isnan(value))
+        return;
+    buffer.push_back({value, weight});
+    min = std::min(min, value);
+    max = std::max(max, value);
+    if (buffer.size() >= BUFFER_SIZE)
+        compress();
+}
+
+double
+TDigest::
+k(double q)
+{
+    return COMPRESSION / (2 * M_PI) * std::asin(2 * q - 1);
+}
+
+void
+TDigest::
+compress()
+{
+    if (buffer.empty())
+        return;
+
+    buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+    std::sort(buffer.begin(), buffer.end());
+    centroids.clear();
+
+    totalWeight = 0;
+    for (auto & c: buffer)
+        totalWeight += c.weight;
+
+    double weightSoFar = 0;
+    Centroid current = buffer[0];
+    double kLeft = k(0);
+
+    for (size_t i = 1;  i < buffer.size();  ++i) {
+        const Centroid & next = buffer[i];
+        double q = (weightSoFar + current.weight + next.weight)
+            / totalWeight;
+        if (k(q) - kLeft <= 1.0) {
+            // Merge into the current centroid
+            current.weight += next.weight;
+            current.mean += (next.mean - current.mean) * next.weight
+                / current.weight;
+        }
+        else {
+            weightSoFar += current.weight;
+            kLeft = k(weightSoFar / totalWeight);
+            centroids.push_back(current);
+            current = next;
+        }
+    }
+
+    centroids.push_back(current);
+    buffer.clear();
+}
+
+double
+TDigest::
+quantile(double q)
+{
+    compress();
+
+    if (centroids.empty())
+        return NAN;
+    if (centroids.size() == 1)
+        return centroids[0].mean;
+
+    double target = q * totalWeight;
+
+    // Each centroid is considered to be centered on its cumulative
+    // weight; we interpolate linearly between them, and to the
+    // minimum and maximum at the ends.
+    double cumulative = 0;
+    double lastMid = 0;
+    for (size_t i = 0;  i < centroids.size();  ++i) {
+        double mid = cumulative + centroids[i].weight / 2;
+        if (target < mid) {
+            if (i == 0) {
+                return min + (centroids[0].mean - min) * target / mid;
+            }
+            return centroids[i - 1].mean
+                + (centroids[i].mean - centroids[i - 1].mean)
+                * (target - lastMid) / (mid - lastMid);
+        }
+        cumulative += centroids[i].weight;
+        lastMid = mid;
+    }
+
+    double remaining = totalWeight - lastMid;
+    if (remaining <= 0)
+        return max;
+    return centroids.back().mean
+        + (max - centroids.back().mean) * (target - lastMid) / remaining;
+}
+
+void
+TDigest::
+merge(const TDigest & other)
+{
+    for (auto & c: other.centroids)
+        add(c.mean, c.weight);
+    for (auto & c: other.buffer)
+        add(c.mean, c.weight);
+}
+
+} // namespace MLDB
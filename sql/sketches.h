@@ -0,0 +1,149 @@
+/** sketches.h                                                      -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Small, mergeable summaries of a stream of values, used by the
+    approximate aggregators and by the summary statistics procedure.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HYPER LOG LOG                                                             */
+/*****************************************************************************/
+
+/** Approximate count of distinct values, using a HyperLogLog sketch.  While
+    the number of values is small, the (64 bit) hashes of the values are
+    kept in a sorted, unique list and the count is exact apart from hash
+    collisions; this sparse list is never more than a quarter of the size
+    of the dense registers that it's converted to as it grows.  This
+    means that the state is both small and bounded, no matter how many
+    distinct values there are.
+*/
+
+struct HyperLogLog {
+
+    /// Number of bits of the hash used to choose the register
+    static constexpr int PRECISION = 14;
+    static constexpr size_t NUM_REGISTERS = 1 << PRECISION;
+
+    /// Maximum number of hashes kept before we convert to registers
+    static constexpr size_t MAX_SPARSE = NUM_REGISTERS / sizeof(uint64_t) / 4;
+
+    /** Add the value with the given hash.  The hash doesn't need to be well
+        mixed, as that is done here.
+    */
+    void add(uint64_t hash)
+    {
+        addMixed(mix(hash));
+    }
+
+    /** Add all of the values in the other sketch.  */
+    void merge(const HyperLogLog & other);
+
+    /** Return the estimated number of distinct values.  This modifies the
+        internal representation, but not the value of the sketch.
+    */
+    uint64_t estimate();
+
+    /** Have any values been added? */
+    bool empty() const
+    {
+        return sparse.empty() && pending.empty() && registers.empty();
+    }
+
+    /// Ensure that the hash bits are well mixed (splitmix64 finalizer)
+    static uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+private:
+    void addMixed(uint64_t hash);
+    void addToRegisters(uint64_t hash);
+
+    /// Fold the pending hashes into the sparse list, and convert to dense
+    /// registers if it has got too big.
+    void compactSparse();
+
+    void toDense();
+
+    std::vector<uint64_t> sparse;    ///< Sorted unique hashes
+    std::vector<uint64_t> pending;   ///< Hashes not yet merged into sparse
+    std::vector<uint8_t> registers;  ///< Dense registers, once converted
+};
+
+
+/*****************************************************************************/
+/* T DIGEST                                                                  */
+/*****************************************************************************/
+
+/** Approximate quantiles, using a merging t-digest.  The values are
+    summarized by a bounded number of weighted centroids, which are small
+    near the extremes of the distribution and larger in the middle.  This
+    gives accurate extreme quantiles with a small, mergeable state.
+*/
+
+struct TDigest {
+
+    /// Compression parameter; there are at most about this many centroids
+    static constexpr double COMPRESSION = 100;
+
+    /// Number of unmerged values we buffer before compressing
+    static constexpr size_t BUFFER_SIZE = 500;
+
+    TDigest();
+
+    struct Centroid {
+        double mean;
+        double weight;
+
+        bool operator < (const Centroid & other) const
+        {
+            return mean < other.mean;
+        }
+    };
+
+    /** Add a value with the given weight.  NaN values are ignored. */
+    void add(double value, double weight = 1);
+
+    /** Add all of the values in the other digest. */
+    void merge(const TDigest & other);
+
+    /** Return the estimated value at quantile q, between 0 and 1, or NaN if
+        there are no values.
+    */
+    double quantile(double q);
+
+    /** Have any values been added? */
+    bool empty() const
+    {
+        return centroids.empty() && buffer.empty();
+    }
+
+private:
+    /// Scale function, which limits the size of the centroids depending
+    /// upon how close they are to the tails.
+    static double k(double q);
+
+    void compress();
+
+    std::vector<Centroid> centroids;  ///< Sorted, compressed centroids
+    std::vector<Centroid> buffer;     ///< Values not yet compressed
+    double totalWeight;               ///< Total weight of centroids
+    double min, max;
+};
+
+} // namespace MLDB
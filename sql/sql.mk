@@ -3,12 +3,13 @@
 SQL_TYPES_SOURCES := \
 	cell_value.cc \
 	path.cc \
+	path_interner.cc \
 	dataset_types.cc \
 	interval.cc \
 
 # make sure well optimized even for architectures with -Os normally
 $(eval $(call set_compile_option,path.cc cell_value.cc,-O3))
-$(eval $(call library,sql_types,$(SQL_TYPES_SOURCES),types utils value_description any json_diff highwayhash hash))
+$(eval $(call library,sql_types,$(SQL_TYPES_SOURCES),types utils value_description any json_diff highwayhash hash base))
 
 
 SQL_EXPRESSION_SOURCES := \
@@ -19,10 +20,13 @@ SQL_EXPRESSION_SOURCES := \
 	binding_contexts.cc \
 	builtin_functions.cc \
 	builtin_geo_functions.cc \
+	geo_index.cc \
 	builtin_image_functions.cc \
 	builtin_http_functions.cc \
 	builtin_dataset_functions.cc \
 	builtin_aggregators.cc \
+	sketches.cc \
+	query_profile.cc \
 	builtin_signal_functions.cc \
 	builtin_constants.cc \
 	interval.cc \
@@ -31,6 +35,7 @@ SQL_EXPRESSION_SOURCES := \
 	regex_helper.cc \
 	execution_pipeline.cc \
 	execution_pipeline_impl.cc \
+	async_call_batch.cc \
 	sql_utils.cc \
 	sql_expression_operations.cc \
 	eval_sql.cc \
@@ -39,10 +44,11 @@ SQL_EXPRESSION_SOURCES := \
 
 # Unfortunately the S2 library needs you to mess with the include path as its includes
 # aren't prefixed.
-$(eval $(call set_compile_option,cell_value.cc builtin_geo_functions.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
+$(eval $(call set_compile_option,cell_value.cc builtin_geo_functions.cc geo_index.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
+$(eval $(call set_compile_option,regex_helper.cc,-I$(RE2_INCLUDE_PATH)))
 
 # NOTE: the SQL library should NOT depend on MLDB.  See the comment in testing/testing.mk
-$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),sql_types utils value_description any ml json_diff highwayhash hash s2 edlib log pffft easyexif progress magic))
+$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),sql_types utils value_description any ml json_diff highwayhash hash s2 edlib log pffft easyexif progress magic re2 http))
 
 $(eval $(call include_sub_make,sql_testing,testing,sql_testing.mk))
 
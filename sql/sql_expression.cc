@@ -12,6 +12,7 @@
 #include "mldb/arch/demangle.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/types/compact_vector_description.h"
 #include "mldb/types/enum_description.h"
 #include "mldb/types/pair_description.h"
 #include "mldb/types/map_description.h"
@@ -30,6 +31,7 @@
 
 #include <mutex>
 #include <numeric>
+#include <unordered_set>
 
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
@@ -113,13 +115,14 @@ BoundSqlExpression(ExecFunction exec,
       info(std::move(info))
 {
     if (this->info->isConst()){
+        // Fold it.  The value lives as long as the closure, so it can be
+        // returned directly rather than copied into storage on each call.
         auto value = std::make_shared<ExpressionValue>(constantValue());
         this->exec = [=] (const SqlRowScope & rowScope,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
                 {
-                    storage = *value;
-                    return storage;
+                    return *value;
                 };
     }
 }
@@ -163,6 +166,19 @@ namespace {
 
 std::recursive_mutex externalFunctionsMutex;
 std::unordered_map<Utf8String, ExternalFunction> externalFunctions;
+std::unordered_set<Utf8String> deterministicFunctions;
+
+/// Functions that aren't registered yet, by name or prefix (ending in '*')
+std::vector<std::pair<Utf8String, std::function<void ()> > > deferredFunctions;
+
+bool matchesDeferred(const Utf8String & pattern, const Utf8String & name)
+{
+    if (!pattern.endsWith("*"))
+        return pattern == name;
+    std::string prefix = pattern.rawString();
+    prefix.resize(prefix.size() - 1);
+    return name.rawString().compare(0, prefix.size(), prefix) == 0;
+}
 
 std::recursive_mutex externalDatasetFunctionsMutex;
 std::unordered_map<Utf8String, ExternalDatasetFunction> externalDatasetFunctions;
@@ -170,19 +186,23 @@ std::unordered_map<Utf8String, ExternalDatasetFunction> externalDatasetFunctions
 
 } // file scope
 
-std::shared_ptr<void> registerFunction(Utf8String name, ExternalFunction function)
+std::shared_ptr<void> registerFunction(Utf8String name, ExternalFunction function,
+                                       bool deterministic)
 {
     auto unregister = [=] (void *)
         {
             //cerr << "unregistering external function " << name << endl;
             std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
             externalFunctions.erase(name);
+            deterministicFunctions.erase(name);
         };
 
     std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
     if (!externalFunctions.insert({name, std::move(function)}).second)
         throw HttpReturnException(400, "Attempt to double register function",
                                   "name", name);
+    if (deterministic)
+        deterministicFunctions.insert(name);
 
     //cerr << "registering external function " << name << endl;
     return std::shared_ptr<void>(nullptr, unregister);
@@ -197,15 +217,46 @@ ExternalFunction lookupFunction(const Utf8String & name)
     return res;
 }
 
+void registerDeferredFunctions(Utf8String name, std::function<void ()> load)
+{
+    std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
+    deferredFunctions.emplace_back(std::move(name), std::move(load));
+}
+
 ExternalFunction tryLookupFunction(const Utf8String & name)
 {
     std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
     auto it = externalFunctions.find(name);
+    if (it != externalFunctions.end())
+        return it->second;
+
+    std::function<void ()> load;
+    for (auto & d: deferredFunctions) {
+        if (matchesDeferred(d.first, name)) {
+            load = d.second;
+            break;
+        }
+    }
+    if (!load)
+        return nullptr;
+
+    // Loading may take a while, so it's done without holding the lock
+    guard.unlock();
+    load();
+    guard.lock();
+
+    it = externalFunctions.find(name);
     if (it == externalFunctions.end())
         return nullptr;
     return it->second;
 }
 
+bool isDeterministicFunction(const Utf8String & name)
+{
+    std::unique_lock<std::recursive_mutex> guard(externalFunctionsMutex);
+    return deterministicFunctions.count(name);
+}
+
 BoundFunction
 SqlBindingScope::
 doGetFunction(const Utf8String & tableName,
@@ -2568,6 +2619,132 @@ compare(const std::vector<ExpressionValue> & vec1,
     };
 }
 
+namespace {
+
+// Type tags for the sort key, in the same order as ExpressionValue::compare
+enum SortKeyTag: unsigned char {
+    SK_EMPTY = 1,
+    SK_NUMBER,
+    SK_STRING,
+    SK_TIMESTAMP,
+    SK_TIMEINTERVAL,
+    SK_BLOB,
+    SK_PATH,
+    SK_STRUCTURED,
+    SK_EMBEDDING
+};
+
+// Append a double such that memcmp gives the numeric order, NaN first,
+// with -0 and 0 equal as they are in CellValue::operator <
+void appendSortKeyDouble(std::string & key, double d)
+{
+    uint64_t bits = 0;
+    if (!std::isnan(d)) {
+        if (d == 0)
+            d = 0;
+        memcpy(&bits, &d, sizeof(bits));
+        bits = (bits & (1ULL << 63)) ? ~bits : bits | (1ULL << 63);
+        // All zeros are reserved for NaN, which no number maps to
+    }
+    for (int i = 7;  i >= 0;  --i)
+        key.push_back((char)(bits >> (i * 8)));
+}
+
+// Append an encoding of the value to the key, returning false if the
+// value could not be fully encoded (in which case only its type was).
+bool appendSortKey(std::string & key, const ExpressionValue & val)
+{
+    if (val.isAtom()) {
+        const CellValue & cell = val.getAtom();
+        switch (cell.cellType()) {
+        case CellValue::EMPTY:
+            // An uninitialized value sorts before a null, and we can't
+            // tell them apart from here
+            key.push_back(SK_EMPTY);
+            return false;
+        case CellValue::INTEGER: {
+            key.push_back(SK_NUMBER);
+            appendSortKeyDouble(key, cell.toDouble());
+            // Beyond 2^53 a double can't distinguish two integers
+            if (!cell.isInt64())
+                return false;
+            int64_t i = cell.toInt();
+            return i <= (1LL << 53) && i >= -(1LL << 53);
+        }
+        case CellValue::FLOAT:
+            key.push_back(SK_NUMBER);
+            appendSortKeyDouble(key, cell.toDouble());
+            return true;
+        case CellValue::ASCII_STRING:
+        case CellValue::UTF8_STRING: {
+            key.push_back(SK_STRING);
+            // Strings are compared as char, so bytes are compared signed
+            // on platforms where char is signed
+            const unsigned char flip
+                = std::numeric_limits<char>::is_signed ? 0x80 : 0;
+            const char * p = cell.stringChars();
+            const char * e = p + cell.toStringLength();
+            for (;  p != e;  ++p) {
+                unsigned char c = (unsigned char)*p ^ flip;
+                key.push_back(c);
+                if (c == 0)
+                    key.push_back((char)0xff);
+            }
+            // Terminator sorts before any character, including an escaped 0
+            key.push_back(0);
+            key.push_back(0);
+            return true;
+        }
+        case CellValue::TIMESTAMP: {
+            key.push_back(SK_TIMESTAMP);
+            double d = cell.toTimestamp().secondsSinceEpoch();
+            if (std::isnan(d))
+                return false;
+            appendSortKeyDouble(key, d);
+            return true;
+        }
+        case CellValue::TIMEINTERVAL:
+            key.push_back(SK_TIMEINTERVAL);
+            return false;
+        case CellValue::BLOB:
+            key.push_back(SK_BLOB);
+            return false;
+        case CellValue::PATH:
+            key.push_back(SK_PATH);
+            return false;
+        case CellValue::NUM_CELL_TYPES:
+            break;
+        }
+        return false;
+    }
+
+    // Rows (including superpositions) then embeddings
+    key.push_back(val.isEmbedding() ? SK_EMBEDDING : SK_STRUCTURED);
+    return false;
+}
+
+} // file scope
+
+std::string
+BoundOrderByExpression::
+encodeKey(const std::vector<ExpressionValue> & vec, int offset) const
+{
+    ExcAssertGreaterEqual(vec.size(), offset + clauses.size());
+
+    std::string result;
+    for (unsigned i = 0;  i < clauses.size();  ++i) {
+        size_t start = result.size();
+        bool complete = appendSortKey(result, vec[offset + i]);
+        if (clauses[i].dir == DESC) {
+            for (size_t j = start;  j < result.size();  ++j)
+                result[j] = ~result[j];
+        }
+        if (!complete)
+            break;
+    }
+    return result;
+}
+
 
 /*****************************************************************************/
 /* ORDER BY EXPRESSION                                                       */
@@ -3120,9 +3297,48 @@ static OptimizedPath optimizeSingleClauseSelect("mldb.sql.singleClauseSelect");
 // to help with unit testing.
 static OptimizedPath optimizeSelectMerging("mldb.sql.selectMerging");
 
+// Subexpressions that occur in several clauses are evaluated once per row
+static OptimizedPath
+optimizeCommonSubexpressions("mldb.sql.commonSubexpressions");
+
 BoundSqlExpression
 SelectExpression::
 bind(SqlBindingScope & context) const
+{
+    std::shared_ptr<SharedSubexpressionTable> table;
+    std::vector<std::shared_ptr<SqlRowExpression> > sharedClauses;
+    if (optimizeCommonSubexpressions.take(!clauses.empty()))
+        sharedClauses = shareCommonSubexpressions(clauses, table);
+
+    if (sharedClauses.empty())
+        return bindClauses(context, clauses);
+
+    BoundSqlExpression result = bindClauses(context, sharedClauses);
+    if (result.info->isConst())
+        return result;
+
+    auto exec = std::move(result.exec);
+    result.exec = [=] (const SqlRowScope & row,
+                       ExpressionValue & storage,
+                       const VariableFilter & filter)
+        -> const ExpressionValue &
+        {
+            // The rewritten clauses are referenced by the bound ones, so
+            // they need to be kept alive as long as we are
+            (void)sharedClauses;
+            SharedSubexpressionFrame frame(*table, row);
+            const ExpressionValue & val = exec(row, storage, filter);
+            if (frame.owns(&val))
+                return storage = val;
+            return val;
+        };
+    return result;
+}
+
+BoundSqlExpression
+SelectExpression::
+bindClauses(SqlBindingScope & context,
+            const std::vector<std::shared_ptr<SqlRowExpression> > & clauses) const
 {
     vector<BoundSqlExpression> boundClauses;
     for (auto & c: clauses)
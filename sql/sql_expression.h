@@ -17,6 +17,7 @@
 #include "mldb/utils/progress.h"
 #include <memory>
 #include <set>
+#include <future>
 
 // NOTE TO MLDB DEVELOPERS: This is an API header file.  No includes
 // should be added, especially value_description.h.  Only
@@ -321,6 +322,18 @@ struct BoundFunction {
     /// If defined, overrides the default bindFunction call.
     BindFunction bindFunction;
 
+    typedef std::function<std::future<ExpressionValue>
+                          (const std::vector<ExpressionValue> &)> AsyncExec;
+
+    /** Optional version of exec for functions that spend their time
+        waiting on I/O, such as fetching a URL.  It starts the work and
+        returns a future for the result without blocking.  Executors that
+        support it start the calls for a whole block of rows before they
+        wait on any of them (see AsyncCallBatch); exec is still used
+        everywhere else, and must be set too.
+    */
+    AsyncExec asyncExec;
+
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & context) const
     {
@@ -344,8 +357,27 @@ typedef std::function<BoundFunction(const Utf8String &,
 /** Register a new function into the SQL system under the given name.  The
     function will remain available until the returned value is destroyed,
     at which point it will be deregistered.
+
+    A deterministic function always returns the same value for the same
+    arguments and row; calls to it that occur several times in the same
+    SELECT may be evaluated only once per row.
 */
-std::shared_ptr<void> registerFunction(Utf8String name, ExternalFunction function);
+std::shared_ptr<void> registerFunction(Utf8String name, ExternalFunction function,
+                                       bool deterministic = false);
+
+/** Was the given function registered as deterministic?  False if it's not
+    registered.
+*/
+bool isDeterministicFunction(const Utf8String & name);
+
+/** Record that functions with the given name aren't registered yet, but
+    will be once load() is called, for example by loading the plugin that
+    provides them.  A name ending in '*' covers all functions that start
+    with what comes before it.  The first lookup of a matching function
+    that isn't registered calls load() (which may happen more than once,
+    and from several threads at once) and then looks again.
+*/
+void registerDeferredFunctions(Utf8String name, std::function<void ()> load);
 
 /** Look up the given function.  Throws if not found. */
 ExternalFunction lookupFunction(const Utf8String & name);
@@ -1263,6 +1295,12 @@ struct SelectExpression: public SqlRowExpression {
     this expression.
     */
     virtual std::vector<std::shared_ptr<SqlExpression> > findAggregators(bool withGroupBy) const;
+
+private:
+    /// Bind the given clauses, which are ours or a rewritten version
+    BoundSqlExpression
+    bindClauses(SqlBindingScope & context,
+                const std::vector<std::shared_ptr<SqlRowExpression> > & clauses) const;
 };
 
 PREDECLARE_VALUE_DESCRIPTION(SelectExpression);
@@ -1312,6 +1350,37 @@ struct BoundOrderByExpression {
         return compare(vec1, vec2, offset) == -1;
     }
 
+    /** Encode the sort fields into a normalized sort key, which is a byte
+        string such that if comparing the keys of two rows with memcmp()
+        over the length of the shorter key gives a difference, that
+        difference is the order that compare() would give.  Nulls,
+        numbers, strings and timestamps are encoded in full, as are the
+        directions of the clauses.  Other values (or numbers that can't be
+        held exactly in a double) only have their type encoded, and
+        nothing is encoded after them.
+
+        This allows a sort to compare most rows with a memcmp(), calling
+        compare() only for those that have equal (or truncated) keys; see
+        compareKeys().
+    */
+    std::string encodeKey(const std::vector<ExpressionValue> & vec,
+                          int offset = 0) const;
+
+    /** Compare two rows given their sort fields and the keys that
+        encodeKey() returned for them.  Gives the same result as compare().
+    */
+    int compareKeys(const std::string & key1,
+                    const std::vector<ExpressionValue> & vec1,
+                    const std::string & key2,
+                    const std::vector<ExpressionValue> & vec2,
+                    int offset = 0) const
+    {
+        size_t len = std::min(key1.size(), key2.size());
+        int res = memcmp(key1.data(), key2.data(), len);
+        if (res != 0)
+            return res < 0 ? -1 : 1;
+        return compare(vec1, vec2, offset);
+    }
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BoundOrderByExpression);
@@ -1474,6 +1543,15 @@ struct GenerateRowsWhereFunction {
 
     Exec exec;
 
+    /** Optional version of exec for when only the first few matching rows
+        are wanted, for a query without an ORDER BY.  Its numToGenerate is
+        the number of matching rows wanted, rather than the number of rows
+        to look at, and it can stop looking once it has found that many.
+        It returns at least that many rows unless fewer match, and no
+        token.  Null if the generator can't do better than exec.
+    */
+    Exec execUntilMatched;
+
     // BADSMELL the rowStream and upperBound are implementation details and
     // should be hidden inside the lambda
     std::shared_ptr<RowStream> rowStream;
@@ -16,6 +16,7 @@
 #include "mldb/server/dataset_context.h"
 #include "mldb/base/scope.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/async_call_batch.h"
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/base/optimized_path.h"
 
@@ -78,6 +79,138 @@ doComparison(const SqlExpression * expr,
             std::make_shared<BooleanValueInfo>(boundLhs.info->isConst() && boundRhs.info->isConst())};
 }
 
+namespace {
+
+// Comparison functors that work on both ExpressionValue and CellValue, so
+// that the same one can be used for the scalar and the generic paths.
+struct CompareEqual {
+    template<typename T>
+    bool operator () (const T & l, const T & r) const { return l == r; }
+};
+
+struct CompareNotEqual {
+    template<typename T>
+    bool operator () (const T & l, const T & r) const { return l != r; }
+};
+
+struct CompareLess {
+    template<typename T>
+    bool operator () (const T & l, const T & r) const { return l < r; }
+};
+
+struct CompareLessEqual {
+    template<typename T>
+    bool operator () (const T & l, const T & r) const { return l <= r; }
+};
+
+struct CompareGreater {
+    template<typename T>
+    bool operator () (const T & l, const T & r) const { return l > r; }
+};
+
+struct CompareGreaterEqual {
+    template<typename T>
+    bool operator () (const T & l, const T & r) const { return l >= r; }
+};
+
+template<typename Cmp>
+bool compareValues(const ExpressionValue & l, const ExpressionValue & r)
+{
+    // Atoms compare exactly as their cells do, so we can skip the type
+    // dispatch in ExpressionValue.  Anything else (which a scalar info
+    // shouldn't produce, but may) takes the generic path.
+    if (MLDB_LIKELY(l.isAtom() && r.isAtom()))
+        return Cmp()(l.getAtom(), r.getAtom());
+    return Cmp()(l, r);
+}
+
+/** Comparison where both sides are known at bind time to be scalars.  If
+    one of the two sides is constant, it's evaluated here once instead of
+    once per row; this is the common "column op constant" shape of a
+    WHERE clause.
+*/
+template<typename Cmp>
+BoundSqlExpression
+doScalarComparison(const SqlExpression * expr,
+                   const BoundSqlExpression & boundLhs,
+                   const BoundSqlExpression & boundRhs)
+{
+    auto info = std::make_shared<BooleanValueInfo>
+        (boundLhs.info->isConst() && boundRhs.info->isConst());
+
+    if (boundRhs.info->isConst() && !boundLhs.info->isConst()) {
+        ExpressionValue r = boundRhs.constantValue();
+        return {[=] (const SqlRowScope & row, ExpressionValue & storage,
+                     const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    ExpressionValue lstorage;
+                    const ExpressionValue & l
+                        = boundLhs(row, lstorage, GET_LATEST);
+                    Date ts = calcTs(l, r);
+                    if (l.empty() || r.empty())
+                        return storage = ExpressionValue::null(ts);
+                    return storage
+                        = ExpressionValue(compareValues<Cmp>(l, r), ts);
+                },
+                expr,
+                info};
+    }
+    else if (boundLhs.info->isConst() && !boundRhs.info->isConst()) {
+        ExpressionValue l = boundLhs.constantValue();
+        return {[=] (const SqlRowScope & row, ExpressionValue & storage,
+                     const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    ExpressionValue rstorage;
+                    const ExpressionValue & r
+                        = boundRhs(row, rstorage, GET_LATEST);
+                    Date ts = calcTs(l, r);
+                    if (l.empty() || r.empty())
+                        return storage = ExpressionValue::null(ts);
+                    return storage
+                        = ExpressionValue(compareValues<Cmp>(l, r), ts);
+                },
+                expr,
+                info};
+    }
+
+    return {[=] (const SqlRowScope & row, ExpressionValue & storage,
+                 const VariableFilter & filter)
+            -> const ExpressionValue &
+            {
+                ExpressionValue lstorage, rstorage;
+                const ExpressionValue & l = boundLhs(row, lstorage, GET_LATEST);
+                const ExpressionValue & r = boundRhs(row, rstorage, GET_LATEST);
+                Date ts = calcTs(l, r);
+                if (l.empty() || r.empty())
+                    return storage = ExpressionValue::null(ts);
+                return storage = ExpressionValue(compareValues<Cmp>(l, r), ts);
+            },
+            expr,
+            info};
+}
+
+// Is the info for a value that can only ever be an atom (or null)?
+bool isOnlyScalar(const ExpressionValueInfo & info)
+{
+    return info.isScalar() && !info.isEmbedding() && !info.isRow();
+}
+
+template<typename Cmp>
+BoundSqlExpression
+bindComparison(const SqlExpression * expr,
+               const BoundSqlExpression & boundLhs,
+               const BoundSqlExpression & boundRhs,
+               bool (ExpressionValue::* op)(const ExpressionValue &) const)
+{
+    if (isOnlyScalar(*boundLhs.info) && isOnlyScalar(*boundRhs.info))
+        return doScalarComparison<Cmp>(expr, boundLhs, boundRhs);
+    return doComparison(expr, boundLhs, boundRhs, op);
+}
+
+} // file scope
+
 BoundSqlExpression
 ComparisonExpression::
 bind(SqlBindingScope & scope) const
@@ -86,28 +219,28 @@ bind(SqlBindingScope & scope) const
     auto boundRhs = rhs->bind(scope);
 
     if (op == "=" || op == "==") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator ==);
+        return bindComparison<CompareEqual>
+            (this, boundLhs, boundRhs, &ExpressionValue::operator ==);
     }
     else if (op == "!=") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator !=);
+        return bindComparison<CompareNotEqual>
+            (this, boundLhs, boundRhs, &ExpressionValue::operator !=);
     }
     else if (op == ">") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator > );
+        return bindComparison<CompareGreater>
+            (this, boundLhs, boundRhs, &ExpressionValue::operator > );
     }
     else if (op == "<") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator < );
+        return bindComparison<CompareLess>
+            (this, boundLhs, boundRhs, &ExpressionValue::operator < );
     }
     else if (op == ">=") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator >=);
+        return bindComparison<CompareGreaterEqual>
+            (this, boundLhs, boundRhs, &ExpressionValue::operator >=);
     }
     else if (op == "<=") {
-        return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator <=);
+        return bindComparison<CompareLessEqual>
+            (this, boundLhs, boundRhs, &ExpressionValue::operator <=);
     }
     else throw HttpReturnException(400, "Unknown comparison op " + op);
 }
@@ -809,18 +942,20 @@ struct BinaryOpHelper {
             const SqlExpression * expr,
             bool isConstant)
     {
-        BoundSqlExpression result;
-        result.info = lhsContext.getInfoLhs(rhsContext);
-        result.exec = std::bind(apply<LhsContext, RhsContext>,
-                                lhsContext,
-                                rhsContext,
-                                std::placeholders::_1,
-                                std::placeholders::_2,
-                                GET_LATEST);
-        result.expr = expr->shared_from_this();
-        result.info = result.info->getConst(isConstant);
+        auto info = lhsContext.getInfoLhs(rhsContext)->getConst(isConstant);
+        // A lambda rather than std::bind, so that apply() and the
+        // contexts' operators can be inlined into the closure
+        auto exec = [=] (const SqlRowScope & row,
+                         ExpressionValue & storage,
+                         const VariableFilter & filter)
+            -> const ExpressionValue &
+            {
+                return apply(lhsContext, rhsContext, row, storage,
+                             GET_LATEST);
+            };
 
-        return result;
+        // Going through the constructor folds constant operations
+        return BoundSqlExpression(std::move(exec), expr, std::move(info));
     }
 
     template<class LhsContext>
@@ -854,11 +989,69 @@ struct BinaryOpHelper {
         }
     }
 
+    /** Scalar op constant or constant op scalar.  The constant side is
+        taken once here, and each row is applied directly without going
+        through the contexts.
+    */
+    static BoundSqlExpression
+    bindScalarConstant(const SqlExpression * expr,
+                       const BoundSqlExpression & boundLhs,
+                       const BoundSqlExpression & boundRhs)
+    {
+        BoundSqlExpression result;
+        result.info = Op::getInfo(boundLhs.info, boundRhs.info)
+            ->getConst(false);
+        result.expr = expr->shared_from_this();
+
+        if (boundRhs.info->isConst()) {
+            ExpressionValue rhs = boundRhs.constantValue();
+            BoundSqlExpression lhsBound = boundLhs;
+            result.exec = [=] (const SqlRowScope & row,
+                               ExpressionValue & storage,
+                               const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    ExpressionValue lstorage;
+                    const ExpressionValue & lhs
+                        = lhsBound(row, lstorage, GET_LATEST);
+                    return storage
+                        = ExpressionValue(Op::apply(lhs.getAtom(),
+                                                    rhs.getAtom()),
+                                          std::max(lhs.getEffectiveTimestamp(),
+                                                   rhs.getEffectiveTimestamp()));
+                };
+        }
+        else {
+            ExpressionValue lhs = boundLhs.constantValue();
+            BoundSqlExpression rhsBound = boundRhs;
+            result.exec = [=] (const SqlRowScope & row,
+                               ExpressionValue & storage,
+                               const VariableFilter & filter)
+                -> const ExpressionValue &
+                {
+                    ExpressionValue rstorage;
+                    const ExpressionValue & rhs
+                        = rhsBound(row, rstorage, GET_LATEST);
+                    return storage
+                        = ExpressionValue(Op::apply(lhs.getAtom(),
+                                                    rhs.getAtom()),
+                                          std::max(lhs.getEffectiveTimestamp(),
+                                                   rhs.getEffectiveTimestamp()));
+                };
+        }
+
+        return result;
+    }
+
     static BoundSqlExpression
     bind(const SqlExpression * expr,
          const BoundSqlExpression & boundLhs,
          const BoundSqlExpression & boundRhs)
     {
+        if (isOnlyScalar(*boundLhs.info) && isOnlyScalar(*boundRhs.info)
+            && boundLhs.info->isConst() != boundRhs.info->isConst())
+            return bindScalarConstant(expr, boundLhs, boundRhs);
+
         int scalar = boundLhs.info->isScalar();
         int embedding = boundLhs.info->isEmbedding();
         int row = boundLhs.info->isRow();
@@ -2329,6 +2522,23 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 this,
                 fn.resultInfo};
     }
+    else if (fn.asyncExec) {
+        // The call may be overlapped with those for other rows
+        return {[=] (const SqlRowScope & row,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    std::vector<ExpressionValue> evaluatedArgs;
+                    evaluatedArgs.reserve(boundArgs.size());
+                    for (auto & a: boundArgs)
+                        evaluatedArgs.emplace_back(a(row, fn.filter));
+
+                    return storage = AsyncCallBatch::call
+                        (this, fn, std::move(evaluatedArgs), row);
+                },
+                this,
+                fn.resultInfo};
+    }
     else {
         return {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
@@ -2867,6 +3077,80 @@ getChildren() const
 /* IN EXPRESSION                                                        */
 /*****************************************************************************/
 
+namespace {
+
+/** Frozen set of the values that an IN expression looks for, built once
+    when it's bound and then only read, so it can be shared between the
+    threads running the expression.  Lookups are O(1).
+
+    Atoms are keyed on their CellValue, or on their integer value if they
+    are all integers, which is the common case for whitelists of ids.
+    Anything else (rows) is kept as an ExpressionValue.  For each value,
+    the timestamp of the first one inserted is kept.
+*/
+struct InValueSet {
+
+    void insert(const ExpressionValue & val)
+    {
+        Date ts = val.getEffectiveTimestamp();
+        if (!val.isAtom()) {
+            rows.emplace(val, ts);
+            return;
+        }
+
+        const CellValue & atom = val.getAtom();
+        if (allIntegers && !atom.isInt64()) {
+            // Spill the integers over into the general case
+            for (auto & i: integers)
+                atoms.emplace(CellValue(i.first), i.second);
+            integers.clear();
+            allIntegers = false;
+        }
+
+        if (allIntegers)
+            integers.emplace(atom.toInt(), ts);
+        else atoms.emplace(atom, ts);
+    }
+
+    /** Is the value in the set?  Also returns the timestamp of the value
+        in the set.
+    */
+    std::pair<bool, Date> find(const ExpressionValue & val) const
+    {
+        static const std::pair<bool, Date>
+            NOT_FOUND(false, Date::negativeInfinity());
+
+        if (!val.isAtom()) {
+            auto it = rows.find(val);
+            if (it == rows.end())
+                return NOT_FOUND;
+            return { true, it->second };
+        }
+
+        const CellValue & atom = val.getAtom();
+        if (allIntegers) {
+            if (!atom.isInt64())
+                return NOT_FOUND;
+            auto it = integers.find(atom.toInt());
+            if (it == integers.end())
+                return NOT_FOUND;
+            return { true, it->second };
+        }
+
+        auto it = atoms.find(atom);
+        if (it == atoms.end())
+            return NOT_FOUND;
+        return { true, it->second };
+    }
+
+    bool allIntegers = true;
+    std::unordered_map<int64_t, Date> integers;
+    std::unordered_map<CellValue, Date> atoms;
+    std::unordered_map<ExpressionValue, Date> rows;
+};
+
+} // file scope
+
 InExpression::
 InExpression(std::shared_ptr<SqlExpression> expr,
              std::shared_ptr<TupleExpression> tuple,
@@ -2954,7 +3238,7 @@ bind(SqlBindingScope & scope) const
                                             nullptr /*onProgress*/);
             
             // This is a set of all values we can search for in our expression
-            auto valsPtr = std::make_shared<std::unordered_set<ExpressionValue> >();
+            auto valsPtr = std::make_shared<InValueSet>();
 
             // NOTE: this is where we REQUIRE that the subquery is non-
             // correlated.  We can only pass a naked SqlRowScope like this
@@ -2992,7 +3276,7 @@ bind(SqlBindingScope & scope) const
                         return storage = v;
           
                     // 3.  Lookup in our set of values
-                    bool found = valsPtr->count(v);
+                    bool found = valsPtr->find(v).first;
 
                     // 4.  Return our result
                     return storage = ExpressionValue(isNegative ? !found : found,
@@ -3008,9 +3292,45 @@ bind(SqlBindingScope & scope) const
         std::vector<BoundSqlExpression> tupleExpressions;
         tupleExpressions.reserve(tuple->clauses.size());
 
+        bool constantTuple = true;
         for (auto & tupleItem: tuple->clauses) {
             tupleExpressions.emplace_back(tupleItem->bind(scope));
             isConstant = isConstant && tupleExpressions.back().info->isConst();
+            constantTuple = constantTuple && tupleItem->isConstant();
+        }
+
+        if (constantTuple) {
+            // A literal list, which can be long.  Put it in a set once and
+            // for all rather than comparing each row against each item.
+            auto valsPtr = std::make_shared<InValueSet>();
+            for (auto & tupleItem: tuple->clauses) {
+                ExpressionValue itemValue = tupleItem->constantValue();
+                if (!itemValue.empty())
+                    valsPtr->insert(itemValue);
+            }
+
+            return {[=] (const SqlRowScope & rowScope,
+                         ExpressionValue & storage,
+                         const VariableFilter & filter) -> const ExpressionValue &
+            {
+                ExpressionValue vstorage;
+
+                const ExpressionValue & v = boundExpr(rowScope, vstorage, filter);
+
+                if (v.empty())
+                    return storage = v;
+
+                std::pair<bool, Date> found = valsPtr->find(v);
+                if (found.first) {
+                    return storage = ExpressionValue(!isNegative,
+                                                     std::max(v.getEffectiveTimestamp(),
+                                                              found.second));
+                }
+
+                return storage = ExpressionValue(isNegative, v.getEffectiveTimestamp());
+            },
+            this,
+            std::make_shared<BooleanValueInfo>(isConstant)};
         }
 
         return {[=] (const SqlRowScope & rowScope,
@@ -3083,6 +3403,57 @@ bind(SqlBindingScope & scope) const
 
         isConstant = isConstant && boundSet.info->isConst();
 
+        if (setExpr->isConstant()) {
+            // The values don't change from row to row, so we index them
+            // once and for all.  Nulls are left to hasValue(), which is the
+            // only place that they can match.
+            ExpressionValue s = setExpr->constantValue();
+
+            if (s.empty()) {
+                return {[=] (const SqlRowScope & rowScope,
+                             ExpressionValue & storage,
+                             const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    return storage = s;
+                },
+                this,
+                std::make_shared<BooleanValueInfo>(isConstant)};
+            }
+
+            auto valsPtr = std::make_shared<InValueSet>();
+            auto onValue = [&] (const PathElement & columnName,
+                                const ExpressionValue & value)
+                {
+                    if (!value.empty())
+                        valsPtr->insert(value);
+                    return true;
+                };
+            if (s.isRow())
+                s.forEachColumn(onValue);
+
+            return {[=] (const SqlRowScope & rowScope,
+                         ExpressionValue & storage,
+                         const VariableFilter & filter) -> const ExpressionValue &
+            {
+                ExpressionValue vstorage;
+
+                const ExpressionValue & v = boundExpr(rowScope, vstorage, filter);
+
+                std::pair<bool, Date> found
+                    = v.empty() ? s.hasValue(v) : valsPtr->find(v);
+            
+                if (found.first) {
+                    return storage = ExpressionValue(!isNegative,
+                                                     std::max(v.getEffectiveTimestamp(),
+                                                              found.second));
+                }
+
+                return storage = ExpressionValue(isNegative, v.getEffectiveTimestamp());
+            },
+            this,
+            std::make_shared<BooleanValueInfo>(isConstant)};
+        }
+
         return {[=] (const SqlRowScope & rowScope,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
@@ -3550,6 +3921,260 @@ getChildren() const
     return {};
 }
 
+/*****************************************************************************/
+/* SHARED SUBEXPRESSION                                                      */
+/*****************************************************************************/
+
+SharedSubexpression::
+SharedSubexpression(std::shared_ptr<SqlExpression> expression,
+                    std::shared_ptr<const SharedSubexpressionTable> table,
+                    int slot)
+    : expression(std::move(expression)),
+      table(std::move(table)),
+      slot(slot)
+{
+    this->surface = this->expression->surface;
+}
+
+BoundSqlExpression
+SharedSubexpression::
+bind(SqlBindingScope & scope) const
+{
+    BoundSqlExpression inner = expression->bind(scope);
+    if (inner.info->isConst())
+        return inner;
+
+    const SharedSubexpressionTable * table = this->table.get();
+    int slot = this->slot;
+
+    auto exec = [=] (const SqlRowScope & row,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter)
+        -> const ExpressionValue &
+        {
+            SharedSubexpressionFrame * frame
+                = SharedSubexpressionFrame::current();
+
+            // Only share within the row of the SELECT that we belong to
+            if (!frame || frame->table != table || frame->row != &row)
+                return inner(row, storage, filter);
+
+            SharedSubexpressionFrame::Slot & s = frame->slots[slot];
+            if (!s.value) {
+                s.value = &inner(row, s.storage, filter);
+                s.filter = filter;
+                return *s.value;
+            }
+            if (s.filter == filter)
+                return *s.value;
+            return inner(row, storage, filter);
+        };
+
+    return BoundSqlExpression(std::move(exec), this, inner.info);
+}
+
+Utf8String
+SharedSubexpression::
+print() const
+{
+    return expression->print();
+}
+
+std::shared_ptr<SqlExpression>
+SharedSubexpression::
+transform(const TransformArgs & transformArgs) const
+{
+    auto result = std::make_shared<SharedSubexpression>(*this);
+    result->expression = transformArgs({ expression }).at(0);
+    return result;
+}
+
+std::string
+SharedSubexpression::
+getType() const
+{
+    return "shared";
+}
+
+Utf8String
+SharedSubexpression::
+getOperation() const
+{
+    return Utf8String(std::to_string(slot));
+}
+
+std::vector<std::shared_ptr<SqlExpression> >
+SharedSubexpression::
+getChildren() const
+{
+    return { expression };
+}
+
+namespace {
+
+thread_local SharedSubexpressionFrame * currentSharedSubexpressionFrame
+    = nullptr;
+
+} // file scope
+
+SharedSubexpressionFrame::
+SharedSubexpressionFrame(const SharedSubexpressionTable & table,
+                         const SqlRowScope & row)
+    : table(&table), row(&row),
+      slots(new Slot[table.numSlots]),
+      previous(currentSharedSubexpressionFrame)
+{
+    currentSharedSubexpressionFrame = this;
+}
+
+SharedSubexpressionFrame::
+~SharedSubexpressionFrame()
+{
+    currentSharedSubexpressionFrame = previous;
+}
+
+bool
+SharedSubexpressionFrame::
+owns(const ExpressionValue * value) const
+{
+    for (int i = 0;  i < table->numSlots;  ++i)
+        if (value == &slots[i].storage)
+            return true;
+    return false;
+}
+
+SharedSubexpressionFrame *
+SharedSubexpressionFrame::
+current()
+{
+    return currentSharedSubexpressionFrame;
+}
+
+namespace {
+
+/** Can this expression be evaluated once per row and its value shared?
+    We only accept node types that are known to be deterministic, and
+    always evaluate their children in the same row scope as themselves.
+*/
+bool isShareable(const SqlExpression & expr)
+{
+    static const std::unordered_set<std::string> shareableTypes = {
+        "compare", "arith", "bitwise", "variable", "constant", "boolean",
+        "type", "nottype", "case", "between", "like", "cast", "embedding"
+    };
+
+    std::string type = expr.getType();
+    if (type == "function") {
+        auto & call = static_cast<const FunctionCallExpression &>(expr);
+        if (!call.tableName.empty()
+            || call.isAggregator()
+            || !isDeterministicFunction(call.functionName))
+            return false;
+    }
+    else if (!shareableTypes.count(type))
+        return false;
+
+    for (auto & c: expr.getChildren()) {
+        if (!isShareable(*c))
+            return false;
+    }
+    return true;
+}
+
+/** Is it worth sharing?  Reading a variable or a constant is as cheap as
+    looking up a shared value, and constants are folded anyway.
+*/
+bool isWorthSharing(const SqlExpression & expr)
+{
+    std::string type = expr.getType();
+    return type != "variable" && type != "constant" && !expr.isConstant();
+}
+
+// Count the occurrences of each shareable subexpression under expr.  We
+// only go down through shareable nodes, since others may evaluate their
+// children in a different scope (or not at all, for aggregators).
+void countSubexpressions(const SqlExpression & expr,
+                         std::unordered_map<Utf8String, int> & counts)
+{
+    if (!isShareable(expr))
+        return;
+    if (isWorthSharing(expr))
+        counts[expr.print()] += 1;
+
+    for (auto & c: expr.getChildren())
+        countSubexpressions(*c, counts);
+}
+
+} // file scope
+
+std::vector<std::shared_ptr<SqlRowExpression> >
+shareCommonSubexpressions(const std::vector<std::shared_ptr<SqlRowExpression> > & clauses,
+                          std::shared_ptr<SharedSubexpressionTable> & table)
+{
+    std::unordered_map<Utf8String, int> counts;
+    for (auto & c: clauses) {
+        if (c->getType() == "selectExpr")
+            countSubexpressions(*static_cast<NamedColumnExpression &>(*c)
+                                .expression,
+                                counts);
+    }
+
+    std::unordered_map<Utf8String, int> slots;
+    for (auto & c: counts) {
+        if (c.second > 1) {
+            int slot = slots.size();
+            slots[c.first] = slot;
+        }
+    }
+
+    if (slots.empty())
+        return {};
+
+    table = std::make_shared<SharedSubexpressionTable>();
+    table->numSlots = slots.size();
+
+    std::function<std::shared_ptr<SqlExpression>
+                  (const std::shared_ptr<SqlExpression> &)> rewrite;
+
+    auto rewriteArgs
+        = [&] (const std::vector<std::shared_ptr<SqlExpression> > & args)
+        {
+            std::vector<std::shared_ptr<SqlExpression> > result;
+            for (auto & a: args)
+                result.emplace_back(rewrite(a));
+            return result;
+        };
+
+    rewrite = [&] (const std::shared_ptr<SqlExpression> & expr)
+        -> std::shared_ptr<SqlExpression>
+        {
+            // Same traversal as countSubexpressions()
+            if (!isShareable(*expr))
+                return expr;
+            auto it = slots.find(expr->print());
+            if (it == slots.end())
+                return expr->transform(rewriteArgs);
+
+            return std::make_shared<SharedSubexpression>
+                (expr->transform(rewriteArgs), table, it->second);
+        };
+
+    std::vector<std::shared_ptr<SqlRowExpression> > result;
+    for (auto & c: clauses) {
+        if (c->getType() != "selectExpr") {
+            result.push_back(c);
+            continue;
+        }
+        auto named = std::make_shared<NamedColumnExpression>
+            (static_cast<NamedColumnExpression &>(*c));
+        named->expression = rewrite(named->expression);
+        result.push_back(named);
+    }
+
+    return result;
+}
+
+
 /*****************************************************************************/
 /* WILDCARD EXPRESSION                                                       */
 /*****************************************************************************/
@@ -3925,6 +4550,21 @@ bind(SqlBindingScope & scope) const
     /// List of all functions to run in our run() operator
     std::vector<std::function<void (const SqlRowScope &, StructValue &)> > functionsToRun;
 
+    // The WHERE and AS clauses normally only look at the name of the
+    // column, in which case what they give for each column is worked out
+    // once here for the known columns and once per schema for flat rows,
+    // rather than on every row.
+    bool whereReadsValue = where->getUnbound().funcs.count("value");
+    bool asReadsValue = as->getUnbound().funcs.count("value");
+
+    struct ColumnResult {
+        bool keep = false;
+        ColumnPath outputName;   ///< Only when keep and !asReadsValue
+    };
+
+    auto knownResults
+        = std::make_shared<std::unordered_map<ColumnPath, ColumnResult> >();
+
     std::vector<KnownColumn> knownColumns;
 
     knownColumns = allColumns.info->getKnownColumns(); 
@@ -3939,11 +4579,21 @@ bind(SqlBindingScope & scope) const
 
         bool keep = boundWhere(thisScope, GET_LATEST).isTrue();
 
-        if (!keep)
+        if (!keep) {
+            if (!whereReadsValue)
+                (*knownResults)[columnName].keep = false;
             continue;
+        }
 
         ColumnPath newColName = boundAs(thisScope, GET_LATEST).coerceToPath();
 
+        if (!whereReadsValue) {
+            auto & result = (*knownResults)[columnName];
+            result.keep = true;
+            if (!asReadsValue)
+                result.outputName = newColName;
+        }
+
         vector<ExpressionValue> orderBy;
         for (auto & c: boundOrderBy) {
             orderBy.emplace_back(c(thisScope, GET_LATEST));
@@ -4060,6 +4710,58 @@ bind(SqlBindingScope & scope) const
 
         BoundSqlExpression boundSelect = select->bind(colScope);
 
+        // Result of the WHERE and AS clauses for a column name, from the
+        // known columns or else by evaluating them
+        auto getColumnResult = [=] (const ColumnPath & columnName)
+            {
+                auto it = knownResults->find(columnName);
+                if (it != knownResults->end())
+                    return it->second;
+
+                ColumnResult result;
+                auto scope = ColumnExpressionBindingScope
+                    ::getColumnScope(columnName);
+                result.keep = boundWhere(scope, GET_LATEST).isTrue();
+                if (result.keep && !asReadsValue) {
+                    result.outputName
+                        = boundAs(scope, GET_LATEST).coerceToPath();
+                }
+                return result;
+            };
+
+        /// The columns of a flat row schema that are kept, with their
+        /// results.  Rows from the same dataset share their schema, so the
+        /// one for the last schema seen is kept.
+        struct FlatColumns {
+            std::shared_ptr<const FlatRowSchema> schema;
+            std::vector<std::tuple<int, ColumnPath, ColumnResult> > kept;
+        };
+
+        auto lastFlatColumns
+            = std::make_shared<std::shared_ptr<const FlatColumns> >();
+
+        auto getFlatColumns = [=] (std::shared_ptr<const FlatRowSchema> schema)
+            {
+                auto result = std::atomic_load(lastFlatColumns.get());
+                if (result && result->schema == schema)
+                    return result;
+
+                auto columns = std::make_shared<FlatColumns>();
+                for (size_t i = 0;  i < schema->size();  ++i) {
+                    ColumnPath columnName(schema->columnName(i));
+                    ColumnResult columnResult = getColumnResult(columnName);
+                    if (!columnResult.keep)
+                        continue;
+                    columns->kept.emplace_back(i, std::move(columnName),
+                                               std::move(columnResult));
+                }
+                columns->schema = std::move(schema);
+
+                result = std::move(columns);
+                std::atomic_store(lastFlatColumns.get(), result);
+                return result;
+            };
+
         auto exec = [=] (const SqlRowScope & scope,
                          ExpressionValue & storage,
                          const VariableFilter & filter)
@@ -4070,12 +4772,15 @@ bind(SqlBindingScope & scope) const
                 RowValue output;
                
                 auto onValue = [&] (const ColumnPath & columnName,
-                                   ExpressionValue in)
+                                    ExpressionValue in,
+                                    const ColumnResult * known)
                 {
                     auto scope = ColumnExpressionBindingScope
                         ::getColumnScope(columnName, in);
 
-                    bool keep = boundWhere(scope, GET_LATEST).isTrue();
+                    bool keep = known
+                        ? known->keep
+                        : boundWhere(scope, GET_LATEST).isTrue();
 
                     if (!keep)
                         return true;
@@ -4090,7 +4795,10 @@ bind(SqlBindingScope & scope) const
 
                     ColumnPath columnNameStorage;
                     const ColumnPath * columnNameOut = &columnName;
-                    if (!asColumnPath) {
+                    if (!asColumnPath && known && !asReadsValue) {
+                        columnNameOut = &known->outputName;
+                    }
+                    else if (!asColumnPath) {
                         ExpressionValue tmp;
                         columnNameStorage
                             = boundAs(scope, tmp, GET_ALL).coerceToPath();
@@ -4143,16 +4851,46 @@ bind(SqlBindingScope & scope) const
                     return true;
                 };
 
+                // A flat row only needs the names of its columns looked at
+                // once for all of the rows with the same schema
+                auto schema = input.getFlatRowSchema();
+                if (schema && !whereReadsValue) {
+                    auto columns = getFlatColumns(std::move(schema));
+                    const auto & values = input.getFlatRowValues();
+                    Date ts = input.getEffectiveTimestamp();
+                    for (auto & c: columns->kept) {
+                        const CellValue & val = values[std::get<0>(c)];
+                        if (val.empty())
+                            continue;
+                        onValue(std::get<1>(c), ExpressionValue(val, ts),
+                                &std::get<2>(c));
+                    }
+                    return storage = std::move(output);
+                }
+
                 auto onAtom = [&] (ColumnPath & columnName,
                                    CellValue & val,
                                    Date ts) -> bool
                 {
-                    return onValue(columnName,ExpressionValue(val, ts));
+                    if (whereReadsValue)
+                        return onValue(columnName, ExpressionValue(val, ts),
+                                       nullptr);
+                    ColumnResult known = getColumnResult(columnName);
+                    if (!known.keep)
+                        return true;
+                    return onValue(columnName, ExpressionValue(val, ts),
+                                   &known);
                 };
 
                 auto onColumn = [&] (PathElement & columnName, ExpressionValue & val) -> bool
                 {
-                    return onValue(ColumnPath(columnName), val);
+                    if (whereReadsValue)
+                        return onValue(ColumnPath(columnName), val, nullptr);
+                    ColumnPath columnPath(columnName);
+                    ColumnResult known = getColumnResult(columnPath);
+                    if (!known.keep)
+                        return true;
+                    return onValue(columnPath, val, &known);
                 };
                 
                 if (isStructured)
@@ -397,6 +397,89 @@ struct BoundParameterExpression: public SqlExpression {
 };
 
 
+/*****************************************************************************/
+/* SHARED SUBEXPRESSIONS                                                     */
+/*****************************************************************************/
+
+/** Identifies a set of subexpressions that are shared between the clauses
+    of one SELECT.  Each distinct subexpression has a slot, which holds its
+    value for the row currently being evaluated.
+*/
+struct SharedSubexpressionTable {
+    int numSlots = 0;
+};
+
+/** Wraps a subexpression that occurs several times within the clauses of a
+    SELECT, so that it's only evaluated once per row.  All of the
+    occurrences are structurally identical and deterministic, and share a
+    slot in the table.
+
+    The value is only shared when evaluated within a
+    SharedSubexpressionFrame for the same table and row; otherwise the
+    subexpression is simply evaluated.
+*/
+struct SharedSubexpression: public SqlExpression {
+    SharedSubexpression(std::shared_ptr<SqlExpression> expression,
+                        std::shared_ptr<const SharedSubexpressionTable> table,
+                        int slot);
+
+    virtual BoundSqlExpression
+    bind(SqlBindingScope & context) const;
+
+    virtual Utf8String print() const;
+
+    virtual std::shared_ptr<SqlExpression>
+    transform(const TransformArgs & transformArgs) const;
+
+    virtual std::string getType() const;
+    virtual Utf8String getOperation() const;
+    virtual std::vector<std::shared_ptr<SqlExpression> > getChildren() const;
+
+    std::shared_ptr<SqlExpression> expression;
+    std::shared_ptr<const SharedSubexpressionTable> table;
+    int slot;
+};
+
+/** Holds the values of shared subexpressions while a row is being
+    evaluated.  It's made current for the calling thread for its lifetime,
+    and frames nest (for example for subqueries).
+*/
+struct SharedSubexpressionFrame {
+    SharedSubexpressionFrame(const SharedSubexpressionTable & table,
+                             const SqlRowScope & row);
+    ~SharedSubexpressionFrame();
+
+    /// Is the given value held in one of our slots?
+    bool owns(const ExpressionValue * value) const;
+
+    /// Return the current frame of this thread, or null
+    static SharedSubexpressionFrame * current();
+
+    const SharedSubexpressionTable * table;
+    const SqlRowScope * row;
+
+    struct Slot {
+        const ExpressionValue * value = nullptr;
+        VariableFilter filter;
+        ExpressionValue storage;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+
+private:
+    SharedSubexpressionFrame * previous;
+};
+
+/** Look for structurally identical deterministic subexpressions that occur
+    more than once within the given SELECT clauses, and return the clauses
+    with each of them wrapped in a SharedSubexpression.  Returns an empty
+    list if there are none.
+*/
+std::vector<std::shared_ptr<SqlRowExpression> >
+shareCommonSubexpressions(const std::vector<std::shared_ptr<SqlRowExpression> > & clauses,
+                          std::shared_ptr<SharedSubexpressionTable> & table);
+
+
 /*****************************************************************************/
 /* SQL ROW EXPRESSIONS                                                       */
 /*****************************************************************************/
@@ -290,7 +290,7 @@ bind(SqlBindingScope & scope, const ProgressFunc & onProgress) const
                         return true;
                     };
 
-                    pipeline->start(params)->takeAll(gotElement);
+                    pipeline->startProfiled(params)->takeAll(gotElement);
                     
                     return result;
                 };
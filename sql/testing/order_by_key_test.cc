@@ -0,0 +1,139 @@
+/** order_by_key_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test that the encoded ORDER BY sort keys order like the sort fields.
+*/
+
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/vector_description.h"
+#include <cmath>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+using namespace MLDB;
+
+namespace {
+
+vector<ExpressionValue> testValues()
+{
+    Date ts = Date::fromSecondsSinceEpoch(1);
+
+    vector<CellValue> cells = {
+        CellValue(),
+        CellValue(0), CellValue(1), CellValue(-1), CellValue(1000000),
+        CellValue(-0.0), CellValue(0.5), CellValue(-0.5), CellValue(1e300),
+        CellValue(-INFINITY), CellValue(INFINITY), CellValue(NAN),
+        CellValue((long long)(1LL << 53)), CellValue((long long)(1LL << 53) + 1),
+        CellValue((long long)(1LL << 62)), CellValue((long long)(1LL << 62) + 1),
+        CellValue((unsigned long long)-1), CellValue((unsigned long long)-2),
+        CellValue(""), CellValue("a"), CellValue("ab"), CellValue("b"),
+        CellValue("aaaaaaaaaaaaaaaaaaaaaaaa"), CellValue("A"),
+        CellValue(Utf8String("\xc3\xa9t\xc3\xa9")), CellValue(Utf8String("\xc3\xa9")),
+        CellValue(Date::fromSecondsSinceEpoch(0)),
+        CellValue(Date::fromSecondsSinceEpoch(-1000.5)),
+        CellValue(Date::fromSecondsSinceEpoch(1.5e9)),
+        CellValue::blob("a"), CellValue::blob("b")
+    };
+
+    vector<ExpressionValue> result;
+    for (auto & c: cells)
+        result.emplace_back(c, ts);
+
+    result.emplace_back();
+
+    StructValue row;
+    row.emplace_back(PathElement("x"), ExpressionValue(1, ts));
+    result.emplace_back(std::move(row));
+
+    return result;
+}
+
+BoundOrderByExpression makeOrderBy(const vector<OrderByDirection> & dirs)
+{
+    BoundOrderByExpression result;
+    for (auto d: dirs) {
+        BoundOrderByClause clause;
+        clause.dir = d;
+        result.clauses.emplace_back(std::move(clause));
+    }
+    return result;
+}
+
+/* Check that wherever the keys decide the order, they agree with
+   compare(), and that compareKeys() always does. */
+void checkPair(const BoundOrderByExpression & orderBy,
+               const vector<ExpressionValue> & v1,
+               const vector<ExpressionValue> & v2)
+{
+    int cmp = orderBy.compare(v1, v2);
+    if (cmp != -orderBy.compare(v2, v1))
+        return;  // inconsistent comparison (eg, int vs float); no order
+
+    string k1 = orderBy.encodeKey(v1);
+    string k2 = orderBy.encodeKey(v2);
+    BOOST_CHECK_EQUAL(orderBy.compareKeys(k1, v1, k2, v2), cmp);
+
+    size_t len = std::min(k1.size(), k2.size());
+    int keyCmp = memcmp(k1.data(), k2.data(), len);
+    if (keyCmp != 0 && (keyCmp < 0) != (cmp < 0)) {
+        cerr << "v1 = " << jsonEncodeStr(v1) << endl;
+        cerr << "v2 = " << jsonEncodeStr(v2) << endl;
+        BOOST_CHECK_EQUAL(keyCmp < 0, cmp < 0);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_single_clause)
+{
+    auto vals = testValues();
+
+    for (auto dir: { ASC, DESC }) {
+        auto orderBy = makeOrderBy({ dir });
+        for (auto & v1: vals)
+            for (auto & v2: vals)
+                checkPair(orderBy, { v1 }, { v2 });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_two_clauses)
+{
+    auto vals = testValues();
+
+    for (auto dir1: { ASC, DESC }) {
+        for (auto dir2: { ASC, DESC }) {
+            auto orderBy = makeOrderBy({ dir1, dir2 });
+            for (unsigned i = 0;  i < vals.size();  i += 3)
+                for (unsigned j = 0;  j < vals.size();  j += 2)
+                    for (unsigned k = 1;  k < vals.size();  k += 3)
+                        for (unsigned l = 1;  l < vals.size();  l += 2)
+                            checkPair(orderBy,
+                                      { vals[i], vals[k] },
+                                      { vals[j], vals[l] });
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_string_prefixes)
+{
+    auto orderBy = makeOrderBy({ ASC, ASC });
+    Date ts;
+
+    // "a" then "z" must sort before "ab" then "a", which a naive
+    // concatenation of the strings would get wrong
+    vector<ExpressionValue> v1 = { ExpressionValue("a", ts),
+                                   ExpressionValue("z", ts) };
+    vector<ExpressionValue> v2 = { ExpressionValue("ab", ts),
+                                   ExpressionValue("a", ts) };
+
+    string k1 = orderBy.encodeKey(v1);
+    string k2 = orderBy.encodeKey(v2);
+    BOOST_CHECK_LT(memcmp(k1.data(), k2.data(), std::min(k1.size(), k2.size())),
+                   0);
+    BOOST_CHECK_EQUAL(orderBy.compareKeys(k1, v1, k2, v2), -1);
+}
@@ -0,0 +1,108 @@
+/** path_interner_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the path element intern table.
+*/
+
+#include "mldb/sql/path_interner.h"
+#include "mldb/arch/exception_handler.h"
+#include "mldb/types/value_description.h"
+#include "mldb/http/http_exception.h"
+#include <thread>
+#include <atomic>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_intern_element )
+{
+    PathElement el1("hello");
+    PathElement el2(string("hello"));
+    PathElement el3("a much longer element that isn't stored internally");
+
+    auto id1 = internPathElement(el1);
+    BOOST_CHECK_EQUAL(internPathElement(el2), id1);
+    auto id3 = internPathElement(el3);
+    BOOST_CHECK_NE(id1, id3);
+
+    BOOST_CHECK_EQUAL(getInternedPathElement(id1), el1);
+    BOOST_CHECK_EQUAL(getInternedPathElement(id3), el3);
+    BOOST_CHECK_EQUAL(getInternedPathElementHash(id3), el3.hash());
+
+    BOOST_CHECK(tryGetInternedPathElement(el3).second);
+    BOOST_CHECK_EQUAL(tryGetInternedPathElement(el3).first, id3);
+    BOOST_CHECK(!tryGetInternedPathElement(PathElement("not there")).second);
+
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(getInternedPathElement(numInternedPathElements()),
+                      HttpReturnException);
+}
+
+BOOST_AUTO_TEST_CASE( test_interned_path )
+{
+    Path p1 = PathElement("x") + PathElement("y") + PathElement(3);
+    InternedPath i1(p1);
+
+    BOOST_CHECK_EQUAL(i1.size(), 3);
+    BOOST_CHECK_EQUAL(i1.hash(), p1.hash());
+    BOOST_CHECK_EQUAL(i1.toPath(), p1);
+    BOOST_CHECK_EQUAL(i1[1], PathElement("y"));
+
+    InternedPath i2(p1);
+    BOOST_CHECK(i1 == i2);
+    BOOST_CHECK(i1 != InternedPath(Path(PathElement("x"))));
+
+    InternedPath empty((Path()));
+    BOOST_CHECK(empty.empty());
+    BOOST_CHECK_EQUAL(empty.hash(), Path().hash());
+    BOOST_CHECK_EQUAL(empty.toPath(), Path());
+}
+
+BOOST_AUTO_TEST_CASE( test_intern_many_threads )
+{
+    // Enough elements to grow the index and to need several chunks
+    constexpr int numElements = 20000;
+    constexpr int numThreads = 8;
+
+    size_t before = numInternedPathElements();
+
+    std::vector<std::vector<InternedPathElementId> > ids(numThreads);
+    std::atomic<int> errors(0);
+
+    auto run = [&] (int t)
+        {
+            for (int i = 0;  i < numElements;  ++i) {
+                int n = (i * (t + 1)) % numElements;
+                PathElement el("column " + to_string(n));
+                auto id = internPathElement(el);
+                if (getInternedPathElement(id) != el)
+                    ++errors;
+                ids[t].push_back(id);
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int t = 0;  t < numThreads;  ++t)
+        threads.emplace_back(run, t);
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK_EQUAL(numInternedPathElements(), before + numElements);
+
+    // Every thread must have seen the same ID for the same element
+    for (int t = 0;  t < numThreads;  ++t) {
+        for (int i = 0;  i < numElements;  ++i) {
+            int n = (i * (t + 1)) % numElements;
+            PathElement el("column " + to_string(n));
+            BOOST_REQUIRE_EQUAL(ids[t][i], internPathElement(el));
+        }
+    }
+}
@@ -5,3 +5,5 @@
 $(eval $(call test,path_test,sql_types,boost valgrind))
 $(eval $(call test,path_benchmark,sql_types,boost))
 $(eval $(call test,eval_sql_test,sql_expression,boost))
+$(eval $(call test,order_by_key_test,sql_expression,boost))
+$(eval $(call test,path_interner_test,sql_types,boost))
@@ -5,6 +5,8 @@
 */
 
 #include <thread>
+#include <deque>
+#include <chrono>
 
 #include "mldb/core/mldb_entity.h"
 #include "mldb/core/function.h"
@@ -510,6 +512,14 @@ struct TensorflowGraphBase: public Function {
     /// Timestamp at which the model was created
     Date modelTs = Date::notADate();
 
+    /// Maximum number of concurrent applications that are run together
+    /// in one batch.  1 means no batching.
+    unsigned maxBatchSize = 1;
+
+    /// Maximum time in seconds that an application waits for others to
+    /// fill its batch.
+    double maxBatchWait = 0;
+
     struct DeviceSession {
         DeviceSession(std::string device,
                       std::unique_ptr<tensorflow::Session> session,
@@ -727,6 +737,166 @@ struct TensorflowGraphBase: public Function {
         shared_ptr<spdlog::logger> logger;
         BoundSqlExpression boundInputs, boundOutputs;
 
+        /// An application waiting to be run as part of a batch
+        struct BatchEntry {
+            const std::vector<tensorflow::Tensor> * inputs = nullptr;
+            std::vector<tensorflow::Tensor> outputs;
+            std::exception_ptr exc;
+            bool leader = false;  ///< Collects and runs the next batch
+            bool done = false;
+        };
+
+        mutable std::mutex batchMutex;
+        mutable std::condition_variable batchCond;
+        mutable std::deque<BatchEntry *> batch;  ///< Waiting to be run
+
+        /** Run the graph over the given inputs, together with those of any
+            other applications made at the same time.
+
+            The first application to arrive becomes the leader: it waits
+            until there are maxBatchSize applications or maxBatchWait has
+            passed, concatenates their inputs along the first dimension,
+            runs the graph once, and splits the outputs back up.  Those
+            that arrive while it's running form the next batch.  No extra
+            threads are involved.
+        */
+        std::vector<tensorflow::Tensor>
+        callBatched(const std::vector<tensorflow::Tensor> & inputs,
+                    const std::vector<string> & inputLayers,
+                    const std::vector<string> & outputLayers) const
+        {
+            BatchEntry entry;
+            entry.inputs = &inputs;
+
+            std::unique_lock<std::mutex> guard(batchMutex);
+            batch.push_back(&entry);
+            if (batch.size() == 1)
+                entry.leader = true;
+            else if (batch.size() >= owner->maxBatchSize)
+                batchCond.notify_all();
+
+            batchCond.wait(guard, [&] () { return entry.done || entry.leader; });
+
+            if (!entry.done) {
+                auto deadline = std::chrono::steady_clock::now()
+                    + std::chrono::duration_cast<std::chrono::steady_clock::duration>
+                    (std::chrono::duration<double>(owner->maxBatchWait));
+                batchCond.wait_until(guard, deadline, [&] ()
+                                     { return batch.size() >= owner->maxBatchSize; });
+
+                size_t n = std::min<size_t>(batch.size(), owner->maxBatchSize);
+                std::vector<BatchEntry *> toRun(batch.begin(), batch.begin() + n);
+                batch.erase(batch.begin(), batch.begin() + n);
+                if (!batch.empty()) {
+                    batch.front()->leader = true;
+                    batchCond.notify_all();
+                }
+
+                guard.unlock();
+                try {
+                    runBatch(toRun, inputLayers, outputLayers);
+                } catch (...) {
+                    for (auto & e: toRun)
+                        e->exc = std::current_exception();
+                }
+                guard.lock();
+
+                for (auto & e: toRun)
+                    e->done = true;
+                batchCond.notify_all();
+            }
+
+            guard.unlock();
+
+            if (entry.exc)
+                std::rethrow_exception(entry.exc);
+            return std::move(entry.outputs);
+        }
+
+        /** Run the batch of applications, recording the outputs or the
+            exception in each entry.  If the inputs can't be concatenated
+            (for example, they have different shapes) or there is only one,
+            they are run one by one.
+        */
+        void runBatch(const std::vector<BatchEntry *> & entries,
+                      const std::vector<string> & inputLayers,
+                      const std::vector<string> & outputLayers) const
+        {
+            using namespace tensorflow;
+
+            auto runAlone = [&] (BatchEntry * entry)
+                {
+                    try {
+                        entry->outputs = owner->call(*entry->inputs, inputLayers,
+                                                     outputLayers, 0);
+                    } catch (...) {
+                        entry->exc = std::current_exception();
+                    }
+                };
+
+            std::vector<Tensor> inputs;
+            std::vector<int64> sizes;
+            int64 total = 0;
+            if (entries.size() > 1 && !inputLayers.empty()) {
+                for (auto & e: entries) {
+                    const Tensor & first = e->inputs->at(0);
+                    int64 size = first.dims() == 0 ? 0 : first.dim_size(0);
+                    sizes.push_back(size);
+                    total += size;
+                }
+                for (unsigned i = 0;  i < inputLayers.size();  ++i) {
+                    std::vector<const Tensor *> parts;
+                    for (auto & e: entries)
+                        parts.push_back(&e->inputs->at(i));
+                    Tensor concatenated;
+                    if (!concatRows(parts, sizes, concatenated))
+                        break;
+                    inputs.emplace_back(std::move(concatenated));
+                }
+            }
+
+            if (inputs.size() != inputLayers.size() || inputs.empty()) {
+                for (auto & e: entries)
+                    runAlone(e);
+                return;
+            }
+
+            try {
+                std::vector<Tensor> outputs
+                    = owner->call(inputs, inputLayers, outputLayers, 0);
+
+                for (auto & e: entries)
+                    e->outputs.resize(outputs.size());
+
+                for (unsigned i = 0;  i < outputs.size();  ++i) {
+                    const Tensor & output = outputs[i];
+                    if (output.dims() == 0 || output.dim_size(0) != total)
+                        throw HttpReturnException
+                            (400, "Output '" + outputLayers.at(i)
+                             + "' of batched Tensorflow graph doesn't have "
+                             "the batch as its first dimension; set "
+                             "maxBatchSize to 1 for this graph",
+                             "shape", output.shape().DebugString());
+                    int64 start = 0;
+                    for (unsigned j = 0;  j < entries.size();  ++j) {
+                        if (!copyRows(output, start, sizes[j],
+                                      entries[j]->outputs[i]))
+                            throw HttpReturnException
+                                (400, "Can't split output '" + outputLayers.at(i)
+                                 + "' of batched Tensorflow graph of type "
+                                 + DataTypeString(output.dtype()));
+                        start += sizes[j];
+                    }
+                }
+            } catch (...) {
+                auto exc = std::current_exception();
+                for (auto & e: entries) {
+                    e->outputs.clear();
+                    e->exc = exc;
+                }
+            }
+        }
+
         ExpressionValue apply(const ExpressionValue & inputData) const
         {
             ExpressionValue result;
@@ -772,8 +942,10 @@ struct TensorflowGraphBase: public Function {
 
             auto doRun = [&] (int i)
                 {
-                    auto output = owner->call(inputTensors, inputLayers,
-                                              outputLayers, i);
+                    auto output = owner->maxBatchSize > 1
+                        ? callBatched(inputTensors, inputLayers, outputLayers)
+                        : owner->call(inputTensors, inputLayers,
+                                      outputLayers, i);
 
                     if (i == 0)
                         outputs = std::move(output);
@@ -819,6 +991,95 @@ struct TensorflowGraphBase: public Function {
         return result;
     }
 
+    /** Concatenate the tensors along their first dimension, which has the
+        given sizes.  All other dimensions and the type must be the same.
+        Returns false if they're not, or the type can't be copied.
+    */
+    static bool
+    concatRows(const std::vector<const tensorflow::Tensor *> & parts,
+               const std::vector<tensorflow::int64> & sizes,
+               tensorflow::Tensor & result)
+    {
+        using namespace tensorflow;
+
+        const Tensor & first = *parts.at(0);
+        if (first.dims() == 0)
+            return false;
+
+        TensorShape shape = first.shape();
+        int64 total = 0;
+        for (unsigned i = 0;  i < parts.size();  ++i) {
+            const Tensor & part = *parts[i];
+            if (part.dtype() != first.dtype() || part.dims() != first.dims()
+                || part.dims() == 0 || part.dim_size(0) != sizes[i])
+                return false;
+            for (int d = 1;  d < part.dims();  ++d) {
+                if (part.dim_size(d) != first.dim_size(d))
+                    return false;
+            }
+            total += sizes[i];
+        }
+
+        shape.set_dim(0, total);
+        result = Tensor(first.dtype(), shape);
+
+        int64 offset = 0;
+        for (auto & p: parts) {
+            if (!copyRowsInto(*p, 0, p->dim_size(0), result, offset))
+                return false;
+            offset += p->dim_size(0);
+        }
+
+        return true;
+    }
+
+    /** Copy n rows, along the first dimension, of src starting at start
+        into a new tensor.  Returns false if the type can't be copied.
+    */
+    static bool
+    copyRows(const tensorflow::Tensor & src,
+             tensorflow::int64 start, tensorflow::int64 n,
+             tensorflow::Tensor & result)
+    {
+        using namespace tensorflow;
+        TensorShape shape = src.shape();
+        shape.set_dim(0, n);
+        result = Tensor(src.dtype(), shape);
+        return copyRowsInto(src, start, n, result, 0);
+    }
+
+    static bool
+    copyRowsInto(const tensorflow::Tensor & src,
+                 tensorflow::int64 start, tensorflow::int64 n,
+                 tensorflow::Tensor & dest,
+                 tensorflow::int64 destStart)
+    {
+        using namespace tensorflow;
+
+        int64 rowElements = src.dim_size(0) == 0
+            ? 0 : src.NumElements() / src.dim_size(0);
+
+        if (src.dtype() == DT_STRING) {
+            auto from = src.flat<string>();
+            auto to = dest.flat<string>();
+            for (int64 i = 0;  i < n * rowElements;  ++i)
+                to(destStart * rowElements + i) = from(start * rowElements + i);
+            return true;
+        }
+
+        if (!DataTypeCanUseMemcpy(src.dtype()))
+            return false;
+
+        size_t elementSize = DataTypeSize(src.dtype());
+        // Tensorflow's own utilities write through tensor_data() like this
+        const char * from = src.tensor_data().data();
+        char * to = const_cast<char *>(dest.tensor_data().data());
+        memcpy(to + destStart * rowElements * elementSize,
+               from + start * rowElements * elementSize,
+               n * rowElements * elementSize);
+        return true;
+    }
+
     static tensorflow::Tensor
     castToSizedAndTypedTensor(const ExpressionValue & val,
                               const tensorflow::TensorShape & shape,
@@ -1587,6 +1848,12 @@ struct TensorflowOp: public TensorflowGraphBase {
             node->add_input(input.name());
         }
         
+        if (functionConfig.maxBatchSize == 0)
+            throw HttpReturnException
+                (400, "maxBatchSize of tensorflow.graph must be at least 1");
+        maxBatchSize = functionConfig.maxBatchSize;
+        maxBatchWait = functionConfig.maxBatchWait;
+
         this->init(std::move(graph), functionConfig.inputs, functionConfig.outputs,
                    functionConfig.devices);
 
@@ -1634,6 +1901,8 @@ struct TensorflowGraphConfig {
     SelectExpression inputs;
     SelectExpression outputs;
     Regex devices = ".*";
+    unsigned maxBatchSize = 1;
+    double maxBatchWait = 0.002;
 };
 
 
@@ -1657,6 +1926,17 @@ TensorflowGraphConfigDescription()
             "graph is allowed to run.  For example, `.*` means all devices "
             "(CPU and GPU), `/cpu:.*` means CPU only, `/gpu:.*` means GPU "
             "only, `/gpu:[01]` means on the first two GPUs.");
+    addAuto("maxBatchSize", &TensorflowGraphConfig::maxBatchSize,
+            "Maximum number of applications of the function made at the "
+            "same time that are run together in one batch.  Their inputs "
+            "are concatenated along the first dimension, and the outputs "
+            "split along it, so this only works for graphs where the first "
+            "dimension of each input and output is the batch.  The default "
+            "of 1 runs each application on its own.");
+    addAuto("maxBatchWait", &TensorflowGraphConfig::maxBatchWait,
+            "Maximum time, in seconds, that an application waits for others "
+            "to fill its batch before it's run.  Only used when "
+            "`maxBatchSize` is more than 1.");
 }
 
 struct TensorflowGraph: public TensorflowGraphBase {
@@ -4,6 +4,7 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 #
 import unittest
+import math
 
 mldb = mldb_wrapper.wrap(mldb) # noqa
 
@@ -146,5 +147,42 @@ class TfIdfTest(MldbUnitTest):
         self.assertAlmostEqual(TfIdfTest.get_column(rez, 'output.jelly'), jelly_tfidf,
                         msg = "'jelly' tfidg is not equal to the one returned by scikit learn")
 
+    def test_many_documents(self):
+        # enough documents that they're counted by several threads
+        dataset = mldb.create_dataset({ "id": "many_docs",
+                                        "type": "sparse.mutable" })
+        for i in xrange(5000):
+            dataset.record_row("row%d" % i, [["w%d" % (i % 7), 1, 0],
+                                              ["all", 1, 0]])
+        dataset.commit()
+
+        mldb.put("/v1/procedures/tf_idf_many", {
+            "type": "tfidf.train",
+            "params": {
+                "trainingData": "select * from many_docs",
+                "modelFileUrl": "file://tmp/MLDB-1101-many.idf",
+                "outputDataset": "tf_idf_many",
+                "functionName": "tfidf_many",
+                "runOnCreation": True
+            }
+        })
+
+        expected = [["_rowName", "count"], ["all", 5000]]
+        for i in xrange(7):
+            expected.append(["w%d" % i, len(xrange(i, 5000, 7))])
+        self.assertTableResultEquals(
+            mldb.query("select * from tf_idf_many order by rowName()"),
+            expected)
+
+        # unknown terms have a document frequency of zero
+        rez = mldb.get("/v1/query",
+                       q="select tfidf_many({{all: 1, w0: 1, unknown: 1} "
+                       "as input}) as *")
+        self.assertAlmostEqual(TfIdfTest.get_column(rez, 'output.unknown'),
+                               math.log(1 + 5000.0), places=5)
+        self.assertAlmostEqual(TfIdfTest.get_column(rez, 'output.w0'),
+                               math.log(1 + 5000.0 / 716), places=5)
+        self.assertAlmostEqual(TfIdfTest.get_column(rez, 'output.all'),
+                               math.log(1 + 5000.0 / 5001), places=5)
 
 mldb.run_tests()
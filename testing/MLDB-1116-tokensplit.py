@@ -79,4 +79,25 @@ mldb.log(response)
 assert response[0]['columns'][0][1] == test_str, \
     'tokenized string does not match the expected value'
 
+# non-ASCII split chars, and tokens sharing a prefix
+config = {
+    'type': 'tokensplit',
+    'params': {
+        'tokens': "select 'ab', 'abc', 'b'",
+        'splitChars': u'\u00b7 ',
+        'splitCharToInsert': u'\u00b7'
+    }
+}
+
+result = mldb.put('/v1/functions/split_prefix', config)
+
+result = mldb.get(
+    '/v1/query',
+    q=u"select split_prefix({'abcxab\u00b7b' as text}) as query")
+
+response = result.json()
+mldb.log(response)
+assert response[0]['columns'][0][1] == u'abc\u00b7x\u00b7ab\u00b7b', \
+    'tokenized string does not match the expected value'
+
 mldb.script.set_return("success")
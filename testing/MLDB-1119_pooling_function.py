@@ -85,7 +85,43 @@ class Mldb1119(MldbUnitTest):
         # no match
         assert_val(js_res, "doc4", "word2vec.0", 0)
 
-    
+    def test_embedding_matches_query(self):
+        # Pooling from an embedding dataset reads it directly; it should
+        # give the same result as the query used for other datasets
+        mldb.put("/v1/procedures/copy_embedding", {
+            "type": "transform",
+            "params": {
+                "inputData": "select * from wordEmbedding",
+                "outputDataset": {"id": "wordSparse",
+                                  "type": "sparse.mutable"},
+                "runOnCreation": True
+            }
+        })
+
+        for name, dataset in [("pool_embedding", "wordEmbedding"),
+                              ("pool_sparse", "wordSparse")]:
+            mldb.put("/v1/functions/" + name, {
+                "type": "pooling",
+                "params": {
+                    "embeddingDataset": dataset,
+                    "aggregators": ["avg", "min", "max", "sum"]
+                }
+            })
+
+        def pool(name):
+            return mldb.query("""
+                select {name}({{words: {{*}}}})[embedding] as pooled
+                from bag_o_words order by rowName()
+            """.format(name=name))
+
+        from_embedding = pool("pool_embedding")
+        from_sparse = pool("pool_sparse")
+        self.assertEqual(len(from_embedding), len(from_sparse))
+        for row1, row2 in zip(from_embedding, from_sparse):
+            self.assertEqual(row1[0], row2[0])
+            for v1, v2 in zip(row1[1:], row2[1:]):
+                self.assertAlmostEqual(v1, v2, places=5)
+
     # MLDB-1733
     def test_returns_null_if_null_input(self):
         mldb.put("/v1/procedures/megatron", {
@@ -81,6 +81,16 @@ mldb.log(js_res)
 
 find_column(js_res, "output.document", "I like have lot")
 
+# Repeated and trailing spaces are kept, leading spaces dropped
+result = mldb.get(
+    '/v1/query',
+    q="SELECT stemmerdoc("
+      "{document: '  having  lots '}) as output")
+js_res = result.json()
+mldb.log(js_res)
+
+find_column(js_res, "output.document", "have  lot ")
+
 
 conf = {
     "type": "stemmerdoc",
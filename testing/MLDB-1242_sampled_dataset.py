@@ -118,6 +118,32 @@ class SampledDatasetTest(unittest.TestCase):
         rez2 = mldb.get("/v1/query", q="select * from sample(toy, {rows: 1})")
         self.assertNotEqual(rez.json()[0], rez2.json()[0])
 
+    def test_no_duplicates_without_replacement(self):
+        rez = mldb.query(
+            "select count(*) as cnt from sample(toy, {rows: 300, seed: 1}) "
+            "group by rowName()")
+        self.assertEqual(len(rez), 301)
+        self.assertEqual(set(r[1] for r in rez[1:]), set([1]))
+
+    def test_block_sampling(self):
+        ds = mldb.create_dataset({'id': 'toy_tabular', 'type': 'tabular'})
+        # Several chunks, so that blocks are taken from several of them
+        for chunk in xrange(5):
+            ds.record_rows([["r%d_%d" % (chunk, i), [["x", i, 0]]]
+                            for i in xrange(1000)])
+        ds.commit()
+
+        query = ("select x from sample(toy_tabular, "
+                 "{rows: 500, blockSampling: true, seed: %d})")
+        rez = mldb.query(query % 3)
+        self.assertEqual(len(rez), 501)
+        self.assertEqual(len(set(r[0] for r in rez[1:])), 500)
+        self.assertEqual(rez, mldb.query(query % 3))
+
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.query("select * from sample(toy_tabular, "
+                       "{rows: 5, blockSampling: true, withReplacement: true})")
+
     def test_default_options(self):
         rez = mldb.get(
             "/v1/query",
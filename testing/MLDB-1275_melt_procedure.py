@@ -143,6 +143,38 @@ class MeltProcedureTest(MldbUnitTest):  # noqa
             ['1.1', 1, '1', 3]
         ])
 
+    def test_wide_rows(self):
+        # enough output rows to fill many batches and chunks
+        ds = mldb.create_dataset({'id' : 'wide', 'type' : 'tabular'})
+        rows = []
+        for i in xrange(200):
+            rows.append([str(i), [['id', i, 0]]
+                         + [['c%d' % j, i * 1000 + j, 0] for j in xrange(600)]])
+        ds.record_rows(rows)
+        ds.commit()
+
+        mldb.post('/v1/procedures', {
+            'type': 'melt',
+            'params': {
+                'inputData': """
+                    SELECT {id} AS to_fix, {c*} AS to_melt FROM wide
+                    """,
+                'outputDataset': 'wide_melted',
+                'runOnCreation': True
+            }
+        })
+
+        res = mldb.query('select count(*), sum(value), min(id), max(id) '
+                         'from wide_melted')
+        self.assertEqual(res[1][1:], [
+            200 * 600,
+            sum(i * 1000 + j for i in xrange(200) for j in xrange(600)),
+            0, 199])
+
+        res = mldb.query("select id, key, value from wide_melted "
+                         "where rowName() = '17.c599'")
+        self.assertEqual(res[1][1:], [17, 'c599', 17599])
+
     def test_with_output_type(self):
         self.run_it(True)
 
@@ -88,4 +88,33 @@ result = mldb.query("select em_function({{* EXCLUDING(class)} as embedding}) fro
 for i in range(1, 151):
 	assert expected[i] == result[i]
 
+# with only a variance per dimension, setosa is still a cluster of its own
+
+mldb.put('/v1/procedures/em_train_iris_diag', {
+    'type' : 'gaussianclustering.train',
+    'params' : {
+        'trainingData' : 'select * EXCLUDING(class) from iris',
+        'outputDataset' : 'iris_clusters_diag',
+        'numClusters' : 3,
+        'diagonalCovariance' : True,
+        'modelFileUrl' : "file://tmp/MLDB-1353-diag.gs",
+        'functionName' : 'em_function_diag',
+        "runOnCreation": True
+    }
+})
+
+res = mldb.query("""
+    select cluster, count(*) as num
+    from merge(iris_clusters_diag, iris)
+    where class = 'Iris-setosa'
+    group by cluster
+""")
+assert len(res) == 2
+assert res[1][2] == 50
+
+expected = mldb.query("select * from iris_clusters_diag order by rowName()" )
+result = mldb.query("select em_function_diag({{* EXCLUDING(class)} as embedding}) from iris order by rowName()")
+for i in range(1, 151):
+	assert expected[i] == result[i]
+
 mldb.script.set_return("success")
@@ -63,6 +63,10 @@ void testMtInsert(MutableSparseMatrixDatasetConfig config)
     cerr << "did " << done << " commits in " << timer.elapsed()
          << " at " << done / timer.elapsed_wall() << " commits/second"
          << endl;
+    // Everything must be there once committed, whichever way it was
+    // written
+    dataset.commit();
+    BOOST_CHECK_EQUAL(dataset.getMatrixView()->getRowCount(), done.load());
 }
 
 BOOST_AUTO_TEST_CASE( test_multithreaded_insert_rr )
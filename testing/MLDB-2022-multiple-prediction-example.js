@@ -36,6 +36,25 @@ var expected = [ 6, 9, 6, 0 ];
 
 assertEqual(res.json, expected);
 
+// Large enough batch to be split over several threads, passed in the
+// body of a POST; the outputs must come back in the same order
+var bigInput = [];
+var bigExpected = [];
+for (var i = 0;  i < 1000;  ++i) {
+    bigInput.push([i, 1]);
+    bigExpected.push(i + 1);
+}
+
+var res = mldb.post('/v1/functions/score_one/batch', { input: bigInput });
+
+assertEqual(res.responseCode, 200);
+assertEqual(res.json, bigExpected);
+
+var res = mldb.post('/v1/functions/score_one/batch',
+                    { input: { "one": [1], "t\"wo": [2, 3] } });
+
+assertEqual(res.json, { "one": 1, "t\"wo": 5 });
+
 var functionConfig = {
     type: 'sql.query',
     params: {
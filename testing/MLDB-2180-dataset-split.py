@@ -248,6 +248,35 @@ class Mldb2180DatasetSplitTests(MldbUnitTest):  # noqa
         self.assertEquals(res2, [["_rowName", "sum({*}).x"],
                                  ["[]", 1 ]])
 
+    def test_seed(self):
+        # with a seed, the split only depends upon the rows, not the order
+        # in which they are selected
+        def split(order, seed):
+            mldb.put("/v1/procedures/split", {
+                "type": "split",
+                "params": {
+                    "labels": "SELECT * FROM ds4 ORDER BY rowName() " + order,
+                    "splits": [0.8, 0.2],
+                    "seed": seed,
+                    "outputDatasets": [{ "id": "ds_train",
+                                       "type": "sparse.mutable" },
+                                       { "id": "ds_test",
+                                       "type": "sparse.mutable" }],
+                }
+            })
+            return (mldb.query("SELECT * FROM ds_train ORDER BY rowName()"),
+                    mldb.query("SELECT * FROM ds_test ORDER BY rowName()"))
+
+        train1, test1 = split("ASC", 1)
+        train2, test2 = split("DESC", 1)
+        self.assertEquals(train1, train2)
+        self.assertEquals(test1, test2)
+        self.assertEqual(len(train1) + len(test1), 24 + 2)
+
+        # every label is still in every split
+        for res in split("ASC", 2):
+            self.assertEqual(sorted(res[0][1:]), ['x', 'y', 'z'])
+
     def test_errors(self):
 
         with self.assertRaisesRegexp(mldb_wrapper.ResponseException, 
@@ -0,0 +1,70 @@
+#
+# accuracy_score_histogram_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the boolean accuracy stats calculated from a histogram of the
+# scores are the same as those calculated by sorting all of the examples.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class AccuracyScoreHistogramTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        ds = mldb.create_dataset({'id' : 'scores', 'type' : 'sparse.mutable'})
+        for i in xrange(2000):
+            label = random.randint(0, 1)
+            # Half of the scores are repeated many times, half are unique
+            if i % 2:
+                score = random.randint(0, 20) / 20.0 + label * 0.2
+            else:
+                score = random.random() + label * 0.2
+            ds.record_row('r%d' % i, [['score', score, 0],
+                                      ['label', label, 0],
+                                      ['weight', random.randint(1, 3), 0]])
+        ds.commit()
+
+    num_runs = 0
+
+    def run_test(self, **params):
+        AccuracyScoreHistogramTest.num_runs += 1
+        params['testingData'] = \
+            'SELECT score, label, weight FROM scores'
+        params['mode'] = 'boolean'
+        params['runOnCreation'] = True
+        res = mldb.put('/v1/procedures/test%d' % self.num_runs, {
+            'type' : 'classifier.test',
+            'params' : params
+        }).json()
+        return res['status']['firstRun']['status']
+
+    def test_same_as_sorted(self):
+        # With an output dataset, all examples are kept and sorted
+        sorted_stats = self.run_test(
+            outputDataset={'id' : 'sorted_output', 'type' : 'sparse.mutable'})
+        stats = self.run_test()
+
+        self.assertAlmostEqual(stats['auc'], sorted_stats['auc'])
+        for point in ['bestF1Score', 'bestMcc']:
+            for k, v in sorted_stats[point].iteritems():
+                self.assertAlmostEqual(stats[point][k], v)
+
+    def test_significant_bits(self):
+        stats = self.run_test()
+        rounded = self.run_test(scoreSignificantBits=8)
+        self.assertAlmostEqual(rounded['auc'], stats['auc'], places=2)
+
+        # All of the bits is the same as exact
+        full = self.run_test(scoreSignificantBits=24)
+        self.assertAlmostEqual(full['auc'], stats['auc'])
+
+    def test_bad_significant_bits(self):
+        with self.assertMldbRaises(status_code=400):
+            self.run_test(scoreSignificantBits=25)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,84 @@
+#
+# approx_aggregators_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the approx_count_distinct, approx_quantile and approx_median
+# aggregators against their exact counterparts.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ApproxAggregatorsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in xrange(20000):
+            ds.record_row('row%d' % i, [
+                ['x', i, 0],
+                ['few', i % 10, 0],
+                ['many', 'value%d' % (i % 15000), 0],
+                ['grp', i % 2, 0]
+            ])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id': 'empty', 'type': 'sparse.mutable'})
+        ds.record_row('row', [['y', 1, 0]])
+        ds.commit()
+
+    def test_count_distinct_small_is_exact(self):
+        res = mldb.query("select approx_count_distinct(few) as c from ds")
+        self.assertEqual(res[1][1], 10)
+
+    def test_count_distinct_large(self):
+        res = mldb.query("""
+            select approx_count_distinct(many) as approx,
+                   count_distinct(many) as exact
+            from ds
+        """)
+        approx, exact = res[1][1], res[1][2]
+        self.assertEqual(exact, 15000)
+        self.assertLess(abs(approx - exact), exact * 0.03)
+
+    def test_count_distinct_group_by(self):
+        res = mldb.query("""
+            select approx_count_distinct(x) as c from ds
+            group by grp order by grp
+        """)
+        for row in res[1:]:
+            self.assertLess(abs(row[1] - 10000), 300)
+
+    def test_quantile(self):
+        res = mldb.query("""
+            select approx_quantile(x, 0.01) as q01,
+                   approx_quantile(x, 0.5) as q50,
+                   approx_quantile(x, 0.99) as q99,
+                   approx_median(x) as median
+            from ds
+        """)
+        q01, q50, q99, median = res[1][1:]
+        self.assertLess(abs(q01 - 200), 20)
+        self.assertLess(abs(q50 - 10000), 200)
+        self.assertLess(abs(q99 - 19800), 20)
+        self.assertEqual(q50, median)
+
+    def test_quantile_extremes(self):
+        res = mldb.query("""
+            select approx_quantile(x, 0) as lo, approx_quantile(x, 1) as hi
+            from ds
+        """)
+        self.assertEqual(res[1][1:], [0, 19999])
+
+    def test_null_when_no_values(self):
+        res = mldb.query("""
+            select approx_median(x) as m, approx_count_distinct(x) as c
+            from empty
+        """)
+        self.assertEqual(res[1][1:], [None, 0])
+
+    def test_bad_quantile(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("select approx_quantile(x, 2) from ds")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,80 @@
+#
+# archive_member_index_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of reading members of archive:// URIs through the member index.
+#
+
+import os
+import tarfile
+import tempfile
+import zipfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_MEMBERS = 50
+
+class ArchiveMemberIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp_dir = tempfile.mkdtemp(dir=os.getcwd() + '/build/x86_64/tmp')
+        members = []
+        for i in xrange(NUM_MEMBERS):
+            path = os.path.join(cls.tmp_dir, 'm%d.csv' % i)
+            with open(path, 'w') as f:
+                f.write('x,y\n')
+                for j in xrange(i + 1):
+                    f.write('%d,%d\n' % (i, j))
+            members.append(path)
+
+        cls.archives = {}
+        for ext, mode in [('tar', 'w'), ('tar.gz', 'w:gz')]:
+            name = os.path.join(cls.tmp_dir, 'members.' + ext)
+            with tarfile.open(name, mode) as tar:
+                for path in members:
+                    tar.add(path, arcname=os.path.basename(path))
+            cls.archives[ext] = name
+
+        name = os.path.join(cls.tmp_dir, 'members.zip')
+        with zipfile.ZipFile(name, 'w', zipfile.ZIP_DEFLATED) as z:
+            for path in members:
+                z.write(path, os.path.basename(path))
+        cls.archives['zip'] = name
+
+    def import_member(self, ext, i):
+        uri = 'archive+file://%s#m%d.csv' % (self.archives[ext], i)
+        mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : {
+                'dataFileUrl' : uri,
+                'outputDataset' : {'id' : 'imported', 'type' : 'tabular'},
+                'runOnCreation' : True
+            }
+        })
+        res = mldb.get('/v1/query',
+                       q='SELECT count(*), min(x), max(y) FROM imported',
+                       format='table', rowNames=False).json()
+        mldb.delete('/v1/datasets/imported')
+        return res[1]
+
+    def do_test_members(self, ext):
+        # Members out of order, each found without reading those before it
+        for i in [NUM_MEMBERS - 1, 0, 17, NUM_MEMBERS - 1]:
+            self.assertEqual(self.import_member(ext, i), [i + 1, i, i])
+
+    def test_tar(self):
+        self.do_test_members('tar')
+
+    def test_tar_gz(self):
+        self.do_test_members('tar.gz')
+
+    def test_zip(self):
+        self.do_test_members('zip')
+
+    def test_missing_member(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.import_member('tar', NUM_MEMBERS)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,84 @@
+#
+# arrow_export_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Tests for the export.arrow procedure.
+#
+
+import struct
+import tempfile
+
+if False:
+    mldb_wrapper = None
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+
+class ArrowExportTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(10):
+            ds.record_row('row{}'.format(i), [
+                ['num', i, 0],
+                ['str', 'value{}'.format(i), 0],
+                ['mixed', i if i < 5 else 'abc', 0]
+            ])
+        ds.commit()
+
+    def export(self, query, **kwargs):
+        tmp_file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp')
+        params = {
+            'exportData' : query,
+            'dataFileUrl' : 'file://' + tmp_file.name
+        }
+        params.update(kwargs)
+        mldb.post('/v1/procedures', {
+            'type' : 'export.arrow',
+            'params' : params
+        })
+        with open(tmp_file.name, 'rb') as f:
+            return f.read()
+
+    def test_file_format(self):
+        data = self.export('SELECT num, str FROM ds ORDER BY rowName()')
+        self.assertEqual(data[:6], b'ARROW1')
+        self.assertEqual(data[-6:], b'ARROW1')
+        footer_length = struct.unpack('<i', data[-10:-6])[0]
+        self.assertGreater(footer_length, 0)
+        self.assertLess(footer_length, len(data))
+        self.assertIn(b'value9', data)
+
+    def test_stream_format(self):
+        data = self.export('SELECT num, str FROM ds', format='stream')
+        self.assertEqual(data[:4], b'\xff\xff\xff\xff')
+        # ends with the end of stream marker
+        self.assertEqual(data[-8:], b'\xff\xff\xff\xff\x00\x00\x00\x00')
+
+    def test_mixed_types_in_one_batch(self):
+        # In a single batch, mixed types end up as strings
+        data = self.export('SELECT mixed FROM ds', format='stream')
+        self.assertIn(b'abc', data)
+
+    def test_mixed_types_over_batches(self):
+        msg = 'CAST'
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.export('SELECT mixed FROM ds ORDER BY num', rowsPerBatch=2)
+
+        # Casting gives the column a single type
+        data = self.export(
+            'SELECT CAST (mixed AS STRING) AS mixed FROM ds ORDER BY num',
+            rowsPerBatch=2)
+        self.assertIn(b'abc', data)
+
+    def test_bad_format(self):
+        msg = 'format must be'
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.export('SELECT * FROM ds', format='parquet')
+
+    def test_needs_from(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.export('SELECT 1')
+
+if __name__ == '__main__':
+    mldb.run_tests()
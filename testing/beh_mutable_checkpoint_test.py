@@ -0,0 +1,101 @@
+#
+# beh_mutable_checkpoint_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the checkpoints of beh.mutable datasets.
+#
+
+import os
+import shutil
+import tempfile
+import time
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class BehMutableCheckpointTest(MldbUnitTest):  # noqa
+
+    def setUp(self):
+        tmp_parent = os.getcwd() + '/build/x86_64/tmp'
+        self.dir = tempfile.mkdtemp(
+            dir=tmp_parent if os.path.isdir(tmp_parent) else None)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+    def create(self, id, **checkpoint):
+        checkpoint['url'] = 'file://' + self.dir
+        return mldb.create_dataset({
+            'id' : id,
+            'type' : 'beh.mutable',
+            'params' : {
+                'numShards' : 4,
+                'checkpoint' : checkpoint
+            }
+        })
+
+    def record(self, ds, first, last):
+        for i in xrange(first, last):
+            ds.record_row('r%d' % i, [['x', i, 0], ['y', 'v%d' % i, 0]])
+
+    def count(self, id):
+        return mldb.get('/v1/query', q='SELECT count(*) FROM ' + id,
+                        format='atom').json()
+
+    def test_recover_committed(self):
+        ds = self.create('committed')
+        self.record(ds, 0, 100)
+        ds.commit()
+        mldb.delete('/v1/datasets/committed')
+
+        ds = self.create('committed2')
+        ds.commit()
+        self.assertEqual(self.count('committed2'), 100)
+        res = mldb.query("SELECT x, y FROM committed2 WHERE rowName() = 'r7'")
+        self.assertEqual(res[1][1:], [7, 'v7'])
+
+    def test_recover_from_log(self):
+        ds = self.create('logged', writeAheadLog=True)
+        self.record(ds, 0, 50)
+        ds.commit()
+        mldb.delete('/v1/datasets/logged')
+
+        # Recovered from the checkpoint, then recorded into without one
+        ds = self.create('logged2', writeAheadLog=True)
+        self.record(ds, 50, 80)
+        mldb.delete('/v1/datasets/logged2')
+
+        ds = self.create('logged3', writeAheadLog=True)
+        ds.commit()
+        self.assertEqual(self.count('logged3'), 80)
+
+    def test_background_checkpoint(self):
+        ds = self.create('background', intervalSeconds=0.1)
+        self.record(ds, 0, 10)
+
+        for i in range(100):
+            status = mldb.get('/v1/datasets/background').json()['status']
+            if status['checkpoints']['numCompactions'] > 0:
+                break
+            time.sleep(0.1)
+        self.assertGreater(status['checkpoints']['numCompactions'], 0)
+        self.assertEqual(status['checkpoints']['numErrors'], 0)
+        mldb.delete('/v1/datasets/background')
+
+        ds = self.create('background2')
+        ds.commit()
+        self.assertEqual(self.count('background2'), 10)
+
+    def test_log_needs_file_url(self):
+        with self.assertMldbRaises(status_code=400):
+            mldb.put('/v1/datasets/s3log', {
+                'type' : 'beh.mutable',
+                'params' : {
+                    'checkpoint' : {
+                        'url' : 's3://bucket/checkpoint',
+                        'writeAheadLog' : True
+                    }
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
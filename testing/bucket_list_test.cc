@@ -0,0 +1,59 @@
+/** bucket_list_test.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test that the block accessors of BucketList agree with operator [].
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/server/bucket.h"
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_extract_and_gather )
+{
+    std::mt19937 rng(1);
+
+    for (uint32_t numBuckets: { 2, 3, 4, 15, 16, 17, 255, 256, 60000, 70000 }) {
+        size_t numEntries = 1000 + rng() % 100;
+
+        WritableBucketList list(numEntries, numBuckets);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            expected.push_back(rng() % numBuckets);
+            list.write(expected.back());
+        }
+
+        BucketList & readable = list;
+        for (size_t i = 0;  i < numEntries;  ++i)
+            BOOST_REQUIRE_EQUAL(readable[i], expected[i]);
+
+        // Blocks starting anywhere, including in the middle of a word
+        for (size_t start: { 0, 1, 7, 63, 64, 500 }) {
+            size_t n = std::min<size_t>(300, numEntries - start);
+            std::vector<uint32_t> extracted(n);
+            readable.extract(start, n, extracted.data());
+            BOOST_CHECK_EQUAL_COLLECTIONS(extracted.begin(), extracted.end(),
+                                          expected.begin() + start,
+                                          expected.begin() + start + n);
+        }
+
+        std::vector<int> indexes;
+        std::vector<uint32_t> expectedGathered;
+        for (size_t i = 0;  i < 200;  ++i) {
+            indexes.push_back(rng() % numEntries);
+            expectedGathered.push_back(expected[indexes.back()]);
+        }
+        std::vector<uint32_t> gathered(indexes.size());
+        readable.gather(indexes.data(), indexes.size(), gathered.data());
+        BOOST_CHECK_EQUAL_COLLECTIONS(gathered.begin(), gathered.end(),
+                                      expectedGathered.begin(),
+                                      expectedGathered.end());
+    }
+}
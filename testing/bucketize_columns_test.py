@@ -0,0 +1,79 @@
+#
+# bucketize_columns_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the bucketize procedure over many columns, without ordering.
+#
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class BucketizeColumnsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        rows = []
+        for i in xrange(1000):
+            rows.append(['r%d' % i, [['x', i, 0], ['y', 999 - i, 0]]])
+        rows.append(['txt', [['x', 'hello', 0]]])
+        ds.record_rows(rows)
+        ds.commit()
+
+    def run_bucketize(self, input_data, output_id):
+        mldb.post('/v1/procedures', {
+            'type' : 'bucketize',
+            'params' : {
+                'inputData' : input_data,
+                'columns' : 'x, y',
+                'outputDataset' : {
+                    'id' : output_id,
+                    'type' : 'sparse.mutable'
+                },
+                'percentileBuckets': {'low': [0, 50], 'high': [50, 100]},
+                'runOnCreation' : True
+            }
+        })
+
+    def test_columns(self):
+        self.run_bucketize('SELECT * FROM ds', 'output')
+
+        # The extremes are always in the outer buckets
+        res = mldb.query("SELECT x, y FROM output WHERE rowName() = 'r0'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'x', 'y'],
+            ['r0', 'low', 'high']
+        ])
+        res = mldb.query("SELECT x, y FROM output WHERE rowName() = 'r999'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'x', 'y'],
+            ['r999', 'high', 'low']
+        ])
+
+        # Every number is in a bucket; the cut point is approximate
+        res = mldb.query("""
+            SELECT count(*) AS n, sum(x = 'low') AS low
+            FROM output""")
+        self.assertEqual(res[1][1], 1000)
+        self.assertGreater(res[1][2], 450)
+        self.assertLess(res[1][2], 550)
+
+        # The low bucket always holds the smaller values
+        rows = mldb.get('/v1/query', q='SELECT x FROM output',
+                        format='aos', rowNames=True).json()
+        low = [int(r['_rowName'][1:]) for r in rows if r['x'] == 'low']
+        high = [int(r['_rowName'][1:]) for r in rows if r['x'] == 'high']
+        self.assertLess(max(low), min(high))
+
+        # Values that aren't numbers aren't bucketized
+        res = mldb.query("""
+            SELECT count(*) FROM output WHERE rowName() = 'txt'""")
+        self.assertEqual(res[1][1], 0)
+
+    def test_order_by_is_rejected(self):
+        msg = "can't have ORDER BY, OFFSET or LIMIT"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.run_bucketize('SELECT * FROM ds ORDER BY x', 'error')
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            self.run_bucketize('SELECT * FROM ds LIMIT 10', 'error')
+
+if __name__ == '__main__':
+    mldb.run_tests()
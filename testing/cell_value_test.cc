@@ -17,6 +17,8 @@
 
 #include <boost/test/unit_test.hpp>
 #include <climits>
+#include <thread>
+#include <atomic>
 
 
 using namespace std;
@@ -458,3 +460,66 @@ BOOST_AUTO_TEST_CASE (test_sorting_absolute_order)
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE( test_long_string_sharing )
+{
+    // Copies of long strings, blobs and paths share their storage
+    string s(100, 'x');
+    std::unique_ptr<CellValue> v1(new CellValue(s));
+    CellValue v2 = *v1;
+    BOOST_CHECK_EQUAL((const void *)v1->stringChars(),
+                      (const void *)v2.stringChars());
+
+    // ... and it outlives the original
+    v1.reset();
+    BOOST_CHECK_EQUAL(v2.toString(), s);
+
+    CellValue b1 = CellValue::blob(s);
+    CellValue b2 = b1;
+    BOOST_CHECK_EQUAL(b1.blobData(), b2.blobData());
+    b1 = CellValue();
+    BOOST_CHECK_EQUAL(b2, CellValue::blob(s));
+
+    Path path = PathElement(s);
+    CellValue p1(path);
+    CellValue p2 = p1;
+    BOOST_CHECK_EQUAL(p2, p1);
+    BOOST_CHECK(p2.isPath());
+    BOOST_CHECK_EQUAL(p2.coerceToPath(), path);
+}
+
+BOOST_AUTO_TEST_CASE( test_long_string_threads )
+{
+    // Values created on one thread and destroyed on another, of lengths
+    // covering the cached and uncached block sizes
+    std::vector<CellValue> vals;
+    for (size_t i = 0;  i < 1000;  ++i)
+        vals.emplace_back(string(13 + i, 'a' + i % 26));
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0;  t < 4;  ++t) {
+        threads.emplace_back([&, t] ()
+            {
+                std::vector<CellValue> mine;
+                for (size_t i = t;  i < vals.size();  i += 4)
+                    mine.push_back(vals[i]);
+                for (size_t i = 0;  i < mine.size();  ++i) {
+                    CellValue tmp(mine[i].toUtf8String());
+                    if (tmp != vals[t + i * 4])
+                        ++errors;
+                }
+            });
+    }
+
+    for (auto & t: threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+
+    vals.clear();
+    for (size_t i = 0;  i < 1000;  ++i) {
+        CellValue v(string(13 + i % 300, 'z'));
+        BOOST_CHECK_EQUAL(v.toString().length(), 13 + i % 300);
+    }
+}
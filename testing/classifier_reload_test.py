@@ -0,0 +1,81 @@
+#
+# classifier_reload_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of swapping the model of a classifier function with the reload route.
+#
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ClassifierReloadTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in xrange(200):
+            ds.record_row('r%d' % i, [['x', i % 17, 0],
+                                      ['y', (i * 7) % 13, 0],
+                                      ['label', (i % 17) % 3 == 0, 0]])
+        ds.commit()
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.train('first', 'x')
+        cls.train('second', 'y')
+
+    @classmethod
+    def train(cls, name, where):
+        mldb.put('/v1/procedures/' + name + '_proc', {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : 'SELECT {x, y} AS features, label FROM ds '
+                                 'WHERE %s > 3' % where,
+                'mode' : 'boolean',
+                'algorithm' : 'dt',
+                'configuration' : {
+                    'dt' : { 'type' : 'decision_tree', 'max_depth' : 4 }
+                },
+                'modelFileUrl' : cls.url(name),
+                'functionName' : name,
+                'runOnCreation' : True
+            }
+        })
+
+    @classmethod
+    def url(cls, name):
+        return 'file://' + os.path.join(cls.tmpdir, name + '.cls')
+
+    def scores(self, name):
+        return mldb.query(
+            "SELECT %s({features: {x, y}}) AS * FROM ds ORDER BY rowName()"
+            % name)
+
+    def test_reload(self):
+        mldb.put('/v1/functions/swapped', {
+            'type' : 'classifier',
+            'params' : { 'modelFileUrl' : self.url('first') }
+        })
+        self.assertEqual(self.scores('swapped'), self.scores('first'))
+
+        res = mldb.post('/v1/functions/swapped/routes/reload',
+                        { 'modelFileUrl' : self.url('second') }).json()
+        self.assertEqual(res['modelFileUrl'], self.url('second'))
+        self.assertEqual(self.scores('swapped'), self.scores('second'))
+
+        # reloading without a URL keeps the current model file
+        res = mldb.post('/v1/functions/swapped/routes/reload', {}).json()
+        self.assertEqual(res['modelFileUrl'], self.url('second'))
+        self.assertEqual(self.scores('swapped'), self.scores('second'))
+
+    def test_bad_model_keeps_old_one(self):
+        mldb.put('/v1/functions/kept', {
+            'type' : 'classifier',
+            'params' : { 'modelFileUrl' : self.url('first') }
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post('/v1/functions/kept/routes/reload',
+                      { 'modelFileUrl' : self.url('missing') })
+        self.assertEqual(self.scores('kept'), self.scores('first'))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,93 @@
+#
+# classifier_training_cache_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that classifier.train gives the same classifier when its training
+# data is read back from the trainingCacheUrl.
+#
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ClassifierTrainingCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in xrange(200):
+            ds.record_row('r%d' % i, [['x', i % 17, 0],
+                                      ['y', (i * 7) % 13, 0],
+                                      ['color', ['red', 'green', 'blue'][i % 3], 0],
+                                      ['label', ['a', 'b', 'c'][(i % 17) % 3], 0]])
+        ds.commit()
+        cls.tmpdir = tempfile.mkdtemp()
+
+    def train(self, name, cache_url=None, algorithm='dt'):
+        params = {
+            'trainingData' : 'SELECT {x, y, color} AS features, label FROM ds',
+            'mode' : 'categorical',
+            'algorithm' : algorithm,
+            'configuration' : {
+                'dt' : { 'type' : 'decision_tree', 'max_depth' : 8 },
+                'glz' : { 'type' : 'glz', 'verbosity' : 0 }
+            },
+            'modelFileUrl' : 'file://' + os.path.join(self.tmpdir, name + '.cls'),
+            'functionName' : name,
+            'runOnCreation' : True
+        }
+        if cache_url:
+            params['trainingCacheUrl'] = cache_url
+        mldb.put('/v1/procedures/' + name + '_proc', {
+            'type' : 'classifier.train',
+            'params' : params
+        })
+
+    def scores(self, name):
+        return mldb.query(
+            "SELECT %s({features: {x, y, color}}) AS * FROM ds ORDER BY rowName()"
+            % name)
+
+    def test_cache_gives_same_classifier(self):
+        cache_url = 'file://' + os.path.join(self.tmpdir, 'training.cache')
+        self.train('nocache')
+        self.train('first', cache_url)
+        self.assertTrue(os.path.exists(cache_url[len('file://'):]))
+        self.train('second', cache_url)
+
+        expected = self.scores('nocache')
+        self.assertEqual(self.scores('first'), expected)
+        self.assertEqual(self.scores('second'), expected)
+
+    def test_cache_with_other_algorithm(self):
+        cache_url = 'file://' + os.path.join(self.tmpdir, 'training2.cache')
+        self.train('dt_cached', cache_url)
+        self.train('glz_nocache', algorithm='glz')
+        self.train('glz_cached', cache_url, algorithm='glz')
+        self.assertEqual(self.scores('glz_cached'), self.scores('glz_nocache'))
+
+    def test_different_query_replaces_cache(self):
+        cache_url = 'file://' + os.path.join(self.tmpdir, 'training3.cache')
+        self.train('all_rows', cache_url)
+        mldb.put('/v1/procedures/some_rows_proc', {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : 'SELECT {x, y, color} AS features, label '
+                                 'FROM ds WHERE x < 10',
+                'mode' : 'categorical',
+                'algorithm' : 'dt',
+                'configuration' : {
+                    'dt' : { 'type' : 'decision_tree', 'max_depth' : 8 }
+                },
+                'modelFileUrl' : 'file://' + os.path.join(self.tmpdir, 'some_rows.cls'),
+                'functionName' : 'some_rows',
+                'trainingCacheUrl' : cache_url,
+                'runOnCreation' : True
+            }
+        })
+        self.train('all_rows_again', cache_url)
+        self.assertEqual(self.scores('all_rows_again'),
+                         self.scores('all_rows'))
+
+if __name__ == '__main__':
+    mldb.run_tests()
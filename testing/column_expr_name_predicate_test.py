@@ -0,0 +1,53 @@
+#
+# column_expr_name_predicate_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that COLUMN EXPR and the horizontal functions give the same answers
+# on wide tabular rows, whose column names are worked on once per schema,
+# as on sparse rows.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ColumnExprNamePredicateTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for id, type in [('wide_tab', 'tabular'),
+                         ('wide_sparse', 'sparse.mutable')]:
+            ds = mldb.create_dataset({'id': id, 'type': type})
+            for r in range(5):
+                cols = [['f_%d' % c, r * 100 + c, 0] for c in range(50)]
+                cols += [['g_%d' % c, 'x%d' % c, 0] for c in range(20)]
+                if r % 2 == 0:
+                    cols.append(['f_extra', r, 0])
+                ds.record_row('r%d' % r, cols)
+            ds.commit()
+
+    def check_same(self, query):
+        self.assertTableResultEquals(
+            mldb.query(query.format('wide_tab')),
+            mldb.query(query.format('wide_sparse')))
+
+    def test_where_name(self):
+        self.check_same("SELECT COLUMN EXPR (AS columnName() "
+                        "WHERE columnName() LIKE 'f_%') FROM {} "
+                        "ORDER BY rowName()")
+
+    def test_as_name(self):
+        self.check_same("SELECT COLUMN EXPR (AS 'out_' + columnName() "
+                        "WHERE columnName() LIKE 'g_1%') FROM {} "
+                        "ORDER BY rowName()")
+
+    def test_select_value(self):
+        self.check_same("SELECT COLUMN EXPR (SELECT value() * 2 "
+                        "WHERE columnName() LIKE 'f_1%') FROM {} "
+                        "ORDER BY rowName()")
+
+    def test_horizontal(self):
+        self.check_same("SELECT horizontal_count({{*}}) AS c, "
+                        "horizontal_sum({{f_*}}) AS s FROM {} "
+                        "ORDER BY rowName()")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,71 @@
+#
+# common_subexpression_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Subexpressions that occur several times in a SELECT are evaluated once
+# per row; check that the results are the same as evaluating each one.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class CommonSubexpressionTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        ds.record_row('r1', [['x', 1, 0], ['s', 'abc', 0]])
+        ds.record_row('r2', [['x', 3, 0], ['s', 'de', 0]])
+        ds.record_row('r3', [['s', 'f', 0]])
+        ds.commit()
+
+    def rows(self, select):
+        res = mldb.query("select " + select + " from ds order by rowName()")
+        return [r[1:] for r in res[1:]]
+
+    def test_repeated_in_clauses(self):
+        self.assertEqual(
+            self.rows("x + 1 as a, (x + 1) * 2 as b, x + 1 as c"),
+            [[2, 4, 2], [4, 8, 4], [None, None, None]])
+
+    def test_repeated_in_one_clause(self):
+        self.assertEqual(self.rows("pow(x, 2) + pow(x, 2) as a"),
+                         [[2], [18], [None]])
+
+    def test_nested(self):
+        self.assertEqual(
+            self.rows("sqrt(x * x * 4) as a, sqrt(x * x * 4) + x * x * 4 as b, "
+                      "x * x * 4 as c"),
+            [[2, 6, 4], [6, 42, 36], [None, None, None]])
+
+    def test_strings(self):
+        self.assertEqual(
+            self.rows("upper(s) as a, upper(s) + lower(upper(s)) as b"),
+            [['ABC', 'ABCabc'], ['DE', 'DEde'], ['F', 'Ff']])
+
+    def test_case_is_still_lazy(self):
+        # The shared subexpression must only be evaluated where the CASE
+        # would have evaluated it
+        self.assertEqual(
+            self.rows("case when x > 2 then 6 % (x - 2) else -1 end as a, "
+                      "case when x > 2 then 6 % (x - 2) else -2 end as b"),
+            [[-1, -2], [0, 0], [-1, -2]])
+
+    def test_aggregates(self):
+        res = mldb.query("select sum(x + 1) as a, sum(x + 1) * 2 as b, "
+                         "count(x + 1) as c from ds")
+        self.assertEqual(res[1][1:], [6, 12, 2])
+
+    def test_group_by(self):
+        res = mldb.query("select x + 1 as k, (x + 1) * 10 as k10, "
+                         "count(*) as n from ds group by x + 1 "
+                         "order by x + 1")
+        self.assertEqual([r[1:] for r in res[1:]],
+                         [[None, None, 1], [2, 20, 1], [4, 40, 1]])
+
+    def test_where_and_select(self):
+        res = mldb.query("select x + 1 as a, x + 1 > 3 as b from ds "
+                         "where x + 1 > 1 order by rowName()")
+        self.assertEqual([r[1:] for r in res[1:]], [[2, False], [4, True]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,119 @@
+#
+# continuous_window_in_memory_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that continuous.window uses the datasets that the continuous dataset
+# still holds in memory.
+#
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+create_storage_js = """
+var config = { type: "beh.binary.mutable" };
+var dataset = mldb.createDataset(config);
+var output = { config: dataset.config() };
+output;
+"""
+
+save_storage_js = """
+var uri = "file://%s/" + args.datasetId + ".beh";
+var addr = "/v1/datasets/" + args.datasetId;
+var res = mldb.post(addr + "/routes/saves", { dataFileUrl: uri });
+var output = { metadata: mldb.get(addr).json.status, config: res.json};
+output;
+"""
+
+class ContinuousWindowInMemoryTest(MldbUnitTest):  # noqa
+
+    num_windows = 0
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp_dir = tempfile.mkdtemp(dir=os.getcwd() + '/build/x86_64/tmp')
+        mldb.post('/v1/datasets', {
+            'id' : 'recorder',
+            'type' : 'continuous',
+            'params' : {
+                'commitInterval' : '0s',
+                'memorySegments' : 2,
+                'metadataDataset' : {
+                    'type' : 'sqliteSparse',
+                    'id' : 'metadataDb',
+                    'params' : {
+                        'dataFileUrl' : 'file://' + cls.tmp_dir
+                                        + '/metadata.sqlite'
+                    }
+                },
+                'createStorageDataset' : {
+                    'type' : 'script.run',
+                    'params' : {
+                        'language' : 'javascript',
+                        'scriptConfig' : { 'source' : create_storage_js }
+                    }
+                },
+                'saveStorageDataset' : {
+                    'type' : 'script.run',
+                    'params' : {
+                        'language' : 'javascript',
+                        'scriptConfig' : {
+                            'source' : save_storage_js % cls.tmp_dir
+                        }
+                    }
+                }
+            }
+        })
+
+        datasets = set(mldb.get('/v1/datasets').json())
+        for hour in range(3):
+            mldb.post('/v1/datasets/recorder/rows', {
+                'rowName' : 'row%d' % hour,
+                'columns' : [['hour', hour,
+                              '2017-01-01T%02d:30:00Z' % hour]]
+            })
+            mldb.post('/v1/datasets/recorder/commit')
+
+        # Unload the saved datasets, so that they can only be found through
+        # the continuous dataset or by loading their files
+        for ds in mldb.get('/v1/datasets').json():
+            if ds not in datasets:
+                mldb.delete('/v1/datasets/' + ds)
+
+    def window(self, start, end, **params):
+        params.update({
+            'metadataDataset' : { 'id' : 'metadataDb' },
+            'from' : '2017-01-01T%02d:00:00Z' % start,
+            'to' : '2017-01-01T%02d:00:00Z' % end
+        })
+        ContinuousWindowInMemoryTest.num_windows += 1
+        window = 'window%d' % self.num_windows
+        mldb.put('/v1/datasets/' + window, {
+            'type' : 'continuous.window',
+            'params' : params
+        })
+        return mldb.query('SELECT hour FROM %s ORDER BY hour' % window)[1:]
+
+    def test_window(self):
+        in_memory = { 'continuousDataset' : { 'id' : 'recorder' } }
+
+        # The last two are in memory
+        self.assertEqual(self.window(1, 3, **in_memory),
+                         [['row1', 1], ['row2', 2]])
+        self.assertEqual(self.window(2, 3, **in_memory), [['row2', 2]])
+
+        # The first one isn't any more, and is loaded from its file
+        self.assertEqual(self.window(0, 3, **in_memory),
+                         [['row0', 0], ['row1', 1], ['row2', 2]])
+
+        # Same as without going through the continuous dataset
+        self.assertEqual(self.window(0, 3),
+                         [['row0', 0], ['row1', 1], ['row2', 2]])
+
+    def test_not_continuous(self):
+        with self.assertMldbRaises(
+                expected_regexp='must be a continuous dataset'):
+            self.window(0, 3, continuousDataset={ 'id' : 'metadataDb' })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,76 @@
+#
+# csv_export_parallel_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that export.csv keeps the rows in order when they're formatted in
+# parallel, and that the unordered and multiple file outputs have all of
+# the rows.
+#
+import gzip
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 10000
+
+class CsvExportParallelTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        rows = []
+        for i in xrange(NUM_ROWS):
+            rows.append(['r%05d' % i, [['x', i, 0], ['y', 'v,%d' % i, 0]]])
+        ds.record_rows(rows)
+        ds.commit()
+        cls.tmpdir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+
+    def export(self, url, **params):
+        params['exportData'] = \
+            "SELECT x, y FROM ds ORDER BY rowName()"
+        params['dataFileUrl'] = url
+        params['runOnCreation'] = True
+        mldb.put('/v1/procedures/export', {
+            'type' : 'export.csv',
+            'params' : params
+        })
+
+    def expected_lines(self):
+        return ['%d,"v,%d"' % (i, i) for i in xrange(NUM_ROWS)]
+
+    def test_ordered(self):
+        path = os.path.join(self.tmpdir, 'ordered.csv')
+        self.export('file://' + path)
+        lines = open(path).read().splitlines()
+        self.assertEqual(lines[0], 'x,y')
+        self.assertEqual(lines[1:], self.expected_lines())
+
+    def test_unordered(self):
+        path = os.path.join(self.tmpdir, 'unordered.csv')
+        self.export('file://' + path, ordered=False)
+        lines = open(path).read().splitlines()
+        self.assertEqual(lines[0], 'x,y')
+        self.assertEqual(sorted(lines[1:]), sorted(self.expected_lines()))
+
+    def test_many_files(self):
+        pattern = os.path.join(self.tmpdir, 'part-$part.csv.gz')
+        self.export('file://' + pattern, numFiles=3)
+        lines = []
+        for part in ['00001', '00002', '00003']:
+            path = pattern.replace('$part', part)
+            part_lines = gzip.open(path).read().splitlines()
+            self.assertEqual(part_lines[0], 'x,y')
+            lines.extend(part_lines[1:])
+        # Blocks of rows go to each file in turn; each file is in order
+        self.assertEqual(sorted(lines), sorted(self.expected_lines()))
+        first = gzip.open(pattern.replace('$part', '00001')).read().splitlines()
+        self.assertEqual(first[1:1025], self.expected_lines()[:1024])
+
+    def test_many_files_needs_part(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.export('file://' + os.path.join(self.tmpdir, 'nopart.csv'),
+                        numFiles=2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
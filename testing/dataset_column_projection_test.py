@@ -0,0 +1,69 @@
+#
+# dataset_column_projection_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that queries that only read some of the columns of a row, which
+# fetch only those columns from the dataset, give the same results as
+# reading whole rows.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class DatasetColumnProjectionTest(MldbUnitTest):  # noqa
+
+    types = ['tabular', 'sparse.mutable', 'beh.mutable']
+
+    @classmethod
+    def setUpClass(cls):
+        for type in cls.types:
+            params = {'unknownColumns': 'add'} if type == 'tabular' else {}
+            ds = mldb.create_dataset({'id': type.replace('.', '_'),
+                                      'type': type, 'params': params})
+            for i in xrange(200):
+                row = [['a', i, 0], ['b', 'b%d' % (i % 7), 0],
+                       ['c', i % 3, 0],
+                       ['s.x', i * 2, 0], ['s.y', 'y%d' % i, 0]]
+                row += [['col%d' % j, i + j, 0] for j in xrange(50)]
+                if i % 5 == 0:
+                    row.append(['extra%d' % (i % 2), i, 0])
+                ds.record_row('row%d' % i, row)
+            ds.commit()
+
+    def check(self, query, expected_rows=None):
+        results = [mldb.query(query % type.replace('.', '_'))
+                   for type in self.types]
+        for res in results[1:]:
+            self.assertEqual(results[0], res)
+        if expected_rows is not None:
+            self.assertEqual(len(results[0]) - 1, expected_rows)
+        return results[0]
+
+    def test_selected_columns(self):
+        res = self.check(
+            "select a, b from %s where c > 0 order by rowName() limit 3",
+            3)
+        self.assertEqual(res, [["_rowName", "a", "b"],
+                               ["row1", 1, "b1"],
+                               ["row10", 10, "b3"],
+                               ["row100", 100, "b2"]])
+
+    def test_structured_column(self):
+        res = self.check(
+            "select s from %s where rowName() = 'row4'", 1)
+        self.assertEqual(res, [["_rowName", "s.x", "s.y"],
+                               ["row4", 8, "y4"]])
+
+    def test_expressions(self):
+        self.check("select a + col7 as x, extra0 from %s "
+                   "order by rowName()", 200)
+
+    def test_order_by_unselected(self):
+        self.check("select b from %s order by col3 desc, rowName() limit 10",
+                   10)
+
+    def test_wildcard_reads_whole_row(self):
+        res = self.check("select * from %s where rowName() = 'row5'", 1)
+        self.assertEqual(len(res[0]), 1 + 5 + 50 + 1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,65 @@
+#
+# dataset_ingest_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the asynchronous ingestion of rows through /ingest.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class DatasetIngestTest(MldbUnitTest):  # noqa
+
+    def test_ingest_then_commit(self):
+        mldb.create_dataset({'id': 'ingested', 'type': 'sparse.mutable'})
+        for i in xrange(20):
+            res = mldb.post('/v1/datasets/ingested/ingest', [
+                ['row%d_%d' % (i, j), [['x', i * 10 + j, 0]]]
+                for j in xrange(10)])
+            self.assertEqual(res.status_code, 202)
+            self.assertEqual(res.json(), {'queuedRows': 10})
+
+        # Committing records what was queued first
+        mldb.post('/v1/datasets/ingested/commit')
+        res = mldb.query("select count(*), sum(x) from ingested")
+        self.assertEqual(res[1][1:], [200, sum(xrange(200))])
+
+        stats = mldb.get('/v1/datasets/ingested/ingest').json()
+        self.assertEqual(stats['acceptedRows'], 200)
+        self.assertEqual(stats['recordedRows'], 200)
+        self.assertEqual(stats['queuedRows'], 0)
+        self.assertGreaterEqual(stats['batches'], 1)
+        self.assertLessEqual(stats['batches'], 20)
+
+    def test_flush(self):
+        mldb.create_dataset({'id': 'flushed', 'type': 'tabular'})
+        mldb.post('/v1/datasets/flushed/ingest',
+                  [['a', [['x', 1, 0]]], ['b', [['x', 2, 0]]]])
+        mldb.post('/v1/datasets/flushed/ingest/flush')
+        stats = mldb.get('/v1/datasets/flushed/ingest').json()
+        self.assertEqual(stats['recordedRows'], 2)
+
+    def test_malformed_rows_are_refused(self):
+        mldb.create_dataset({'id': 'malformed', 'type': 'sparse.mutable'})
+        with self.assertMldbRaises(status_code=400):
+            mldb.post('/v1/datasets/malformed/ingest', {'not': 'rows'})
+
+    def test_recording_errors_are_seen_by_commit(self):
+        # A row that the dataset refuses is only found when it's recorded
+        mldb.put('/v1/datasets/frozen', {
+            'type': 'tabular', 'params': {'unknownColumns': 'error'}})
+        mldb.post('/v1/datasets/frozen/rows',
+                  {'rowName': 'a', 'columns': [['x', 1, 0]]})
+
+        res = mldb.post('/v1/datasets/frozen/ingest',
+                        [['b', [['y', 1, 0]]]])
+        self.assertEqual(res.status_code, 202)
+        with self.assertMldbRaises(expected_regexp='unknownColumns'):
+            mldb.post('/v1/datasets/frozen/ingest/flush')
+
+        # It's only reported once
+        mldb.post('/v1/datasets/frozen/ingest/flush')
+        stats = mldb.get('/v1/datasets/frozen/ingest').json()
+        self.assertEqual(stats['errors'], 1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
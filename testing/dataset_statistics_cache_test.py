@@ -0,0 +1,86 @@
+#
+# dataset_statistics_cache_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the row count, column names and column summaries that datasets
+# keep between commits follow what's been committed.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class DatasetStatisticsCacheTest(MldbUnitTest):  # noqa
+
+    def get_summary(self, ds, column):
+        return mldb.get('/v1/datasets/{}/columns/{}/summary'
+                        .format(ds, column)).json()
+
+    def test_summary(self):
+        for id, type in [('summary_tab', 'tabular'),
+                         ('summary_sparse', 'sparse.mutable')]:
+            ds = mldb.create_dataset({'id': id, 'type': type})
+            for r in range(10):
+                cols = [['x', r % 4, 0]]
+                if r % 2 == 0:
+                    cols.append(['y', 'v%d' % r, 0])
+                ds.record_row('r%d' % r, cols)
+            ds.commit()
+
+            summary = self.get_summary(id, 'x')
+            self.assertEqual(summary['rowCount'], 10)
+            self.assertEqual(summary['distinctValues'], 4)
+            self.assertEqual(summary['minValue'], 0)
+            self.assertEqual(summary['maxValue'], 3)
+            self.assertEqual(summary['isNumeric'], True)
+
+            summary = self.get_summary(id, 'y')
+            self.assertEqual(summary['rowCount'], 5)
+            self.assertEqual(summary['distinctValues'], 5)
+            self.assertEqual(summary['minValue'], 'v0')
+            self.assertEqual(summary['maxValue'], 'v8')
+            self.assertEqual(summary['isNumeric'], False)
+
+    def test_commit_invalidates(self):
+        ds = mldb.create_dataset({'id': 'stats_sparse',
+                                  'type': 'sparse.mutable'})
+        ds.record_row('r0', [['x', 1, 0]])
+        ds.commit()
+
+        self.assertEqual(mldb.get('/v1/datasets/stats_sparse/columns').json(),
+                         ['x'])
+        self.assertEqual(self.get_summary('stats_sparse', 'x')['maxValue'], 1)
+        res = mldb.query('SELECT count(*) AS c FROM stats_sparse')
+        self.assertEqual(res[1][1], 1)
+
+        ds.record_row('r1', [['x', 5, 0], ['y', 2, 0]])
+        ds.commit()
+
+        self.assertEqual(
+            sorted(mldb.get('/v1/datasets/stats_sparse/columns').json()),
+            ['x', 'y'])
+        summary = self.get_summary('stats_sparse', 'x')
+        self.assertEqual(summary['rowCount'], 2)
+        self.assertEqual(summary['maxValue'], 5)
+        res = mldb.query('SELECT count(*) AS c FROM stats_sparse')
+        self.assertEqual(res[1][1], 2)
+
+    def test_readable_after_write(self):
+        # Values can be read before a commit, so nothing may be kept
+        mldb.put('/v1/datasets/stats_write', {
+            'type': 'sparse.mutable',
+            'params': {'consistencyLevel': 'consistentAfterWrite'}
+        })
+        mldb.post('/v1/datasets/stats_write/rows', {
+            'rowName': 'r0', 'columns': [['x', 1, 0]]
+        })
+        self.assertEqual(mldb.get('/v1/datasets/stats_write/columns').json(),
+                         ['x'])
+
+        mldb.post('/v1/datasets/stats_write/rows', {
+            'rowName': 'r1', 'columns': [['y', 1, 0]]
+        })
+        self.assertEqual(
+            sorted(mldb.get('/v1/datasets/stats_write/columns').json()),
+            ['x', 'y'])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,111 @@
+#
+# distributed_dataset_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the distributed dataset, with all of its shards on this server,
+# against a merged dataset of the same shards.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_SHARDS = 3
+
+class DistributedDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for s in range(NUM_SHARDS):
+            ds = mldb.create_dataset({'id': 'shard%d' % s,
+                                      'type': 'sparse.mutable'})
+            for r in range(20):
+                i = s * 20 + r
+                ds.record_row('r%d' % i, [['x', i % 7, 0], ['y', i, 0],
+                                          ['label', 'l%d' % (i % 3), 0]])
+            ds.commit()
+
+        mldb.put('/v1/datasets/dist', {
+            'type': 'distributed',
+            'params': {
+                'shards': [{'dataset': 'shard%d' % s}
+                           for s in range(NUM_SHARDS)]
+            }
+        })
+
+        mldb.put('/v1/datasets/merged', {
+            'type': 'merged',
+            'params': {
+                'datasets': [{'id': 'shard%d' % s} for s in range(NUM_SHARDS)]
+            }
+        })
+
+    def check_same(self, query):
+        self.assertTableResultEquals(
+            mldb.query(query.format('dist')),
+            mldb.query(query.format('merged')))
+
+    def test_all_rows(self):
+        self.check_same("SELECT * FROM {} ORDER BY rowName()")
+
+    def test_where(self):
+        self.check_same("SELECT y FROM {} WHERE x = 3 ORDER BY y")
+        self.check_same("SELECT y * 2 AS z FROM {} WHERE label = 'l1' "
+                        "AND y > 10 ORDER BY rowName()")
+
+    def test_top_k(self):
+        self.check_same("SELECT x, y FROM {} ORDER BY x DESC LIMIT 5")
+        self.check_same("SELECT x, y FROM {} ORDER BY x, y DESC "
+                        "OFFSET 3 LIMIT 4")
+        self.check_same("SELECT * FROM {} WHERE y % 2 = 0 "
+                        "ORDER BY y DESC LIMIT 7")
+
+    def test_order_by_output(self):
+        # The ORDER BY reads what the SELECT calculates, so the shards
+        # can't do the top-K
+        self.check_same("SELECT 100 - y AS x FROM {} ORDER BY x LIMIT 5")
+
+    def test_group_by(self):
+        self.check_same("SELECT label, count(*) AS cnt, sum(y) AS s, "
+                        "max(x) AS m FROM {} GROUP BY label ORDER BY label")
+        self.check_same("SELECT count(*) AS cnt, avg(y) AS a FROM {} "
+                        "WHERE x > 2")
+        self.check_same("SELECT x, count(*) AS cnt FROM {} GROUP BY x "
+                        "HAVING count(*) > 8 ORDER BY x")
+
+    def test_alias(self):
+        self.check_same("SELECT t.y FROM {} AS t WHERE t.x = 1 "
+                        "ORDER BY t.y LIMIT 3")
+
+    def test_params(self):
+        for id in ['dist', 'merged']:
+            mldb.put('/v1/functions/q_' + id, {
+                'type': 'sql.query',
+                'params': {
+                    'query': 'SELECT sum(y) AS s, count(*) AS cnt FROM %s '
+                             'WHERE x = $x' % id
+                }
+            })
+        self.check_same("SELECT q_{}({{x: 4}}) AS *")
+
+    def test_join(self):
+        # Joins use a copy of all of the shards
+        self.check_same("SELECT a.y, b.y FROM {0} AS a JOIN {0} AS b "
+                        "ON a.y = b.y + 50 ORDER BY a.y")
+
+    def test_no_shards(self):
+        with self.assertMldbRaises(status_code=400):
+            mldb.put('/v1/datasets/dist_empty', {
+                'type': 'distributed',
+                'params': {'shards': []}
+            })
+
+    def test_unknown_shard(self):
+        mldb.put('/v1/datasets/dist_missing', {
+            'type': 'distributed',
+            'params': {'shards': [{'dataset': 'shard0'},
+                                  {'dataset': 'does_not_exist'}]}
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):  # noqa
+            mldb.query("SELECT * FROM dist_missing")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,118 @@
+#
+# embedding_hnsw_index_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the HNSW nearest neighbors index of the embedding dataset,
+# including incremental inserts and persistence.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class EmbeddingHnswIndexTest(MldbUnitTest):  # noqa
+
+    dims = 20
+    url = 'file://tmp/embedding_hnsw_index_test.mldbds'
+
+    @classmethod
+    def record(cls, ds, start, end):
+        random.seed(start)
+        for i in xrange(start, end):
+            ds.record_row('row%d' % i,
+                          [['x%d' % j, random.gauss(0, 1), 0]
+                           for j in xrange(cls.dims)])
+
+    @classmethod
+    def setUpClass(cls):
+        for id, index in [('exact', 'vptree'), ('approx', 'hnsw')]:
+            ds = mldb.create_dataset({
+                'id': id,
+                'type': 'embedding',
+                'params': {
+                    'index': index,
+                    'efSearch': 100,
+                    'dataFileUrl': cls.url + '.' + id
+                }
+            })
+            cls.record(ds, 0, 1000)
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + id, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': id, 'defaultNumNeighbors': 10}
+            })
+
+    def neighbors(self, id, row):
+        res = mldb.query("select nn_%s({coords: '%s'})[neighbors] as *"
+                         % (id, row))
+        return set(res[1][1:])
+
+    def recall(self, rows):
+        found = 0
+        for row in rows:
+            found += len(self.neighbors('exact', row)
+                         & self.neighbors('approx', row))
+        return found / (10.0 * len(rows))
+
+    def test_recall(self):
+        self.assertGreater(self.recall(['row%d' % i for i in xrange(50)]),
+                           0.9)
+
+    def test_self_is_nearest(self):
+        res = mldb.query("select nn_approx({coords: 'row17'})[distances] as *")
+        self.assertEqual(res[0][1], 'row17')
+        self.assertEqual(res[1][1], 0)
+
+    def test_incremental_insert(self):
+        ds = mldb.create_dataset({
+            'id': 'incremental',
+            'type': 'embedding',
+            'params': {'index': 'hnsw'}
+        })
+        self.record(ds, 0, 500)
+        ds.commit()
+        self.record(ds, 500, 1000)
+        ds.commit()
+
+        mldb.put('/v1/functions/nn_incremental', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'incremental'}
+        })
+
+        res = mldb.query(
+            "select nn_incremental({coords: 'row900'})[distances] as *")
+        self.assertEqual(res[0][1], 'row900')
+        self.assertEqual(len(res[0]), 11)
+
+    def test_reload(self):
+        for id in ['exact', 'approx']:
+            mldb.put('/v1/datasets/reloaded_' + id, {
+                'type': 'embedding',
+                'params': {'dataFileUrl': self.url + '.' + id,
+                           'efSearch': 100}
+            })
+            mldb.put('/v1/functions/nn_reloaded_' + id, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': 'reloaded_' + id,
+                           'defaultNumNeighbors': 10}
+            })
+
+            self.assertEqual(
+                mldb.query("select * from reloaded_%s order by rowName()" % id),
+                mldb.query("select * from %s order by rowName()" % id))
+
+            for row in ['row3', 'row400']:
+                self.assertEqual(self.neighbors('reloaded_' + id, row),
+                                 self.neighbors(id, row))
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({
+                'id': 'bad',
+                'type': 'embedding',
+                'params': {'index': 'hnsw', 'M': 1}
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,83 @@
+#
+# embedding_ivf_index_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the IVF nearest neighbors index of the embedding dataset,
+# including persistence.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class EmbeddingIvfIndexTest(MldbUnitTest):  # noqa
+
+    dims = 20
+    url = 'file://tmp/embedding_ivf_index_test.mldbds'
+
+    @classmethod
+    def setUpClass(cls):
+        for id, params in [('exact', {'index': 'vptree'}),
+                           ('approx', {'index': 'ivf', 'ivfProbes': 8,
+                                       'dataFileUrl': cls.url})]:
+            ds = mldb.create_dataset({
+                'id': id, 'type': 'embedding', 'params': params
+            })
+            # Points around a few centres, as in a real embedding
+            random.seed(0)
+            centres = [[random.gauss(0, 10) for j in xrange(cls.dims)]
+                       for c in xrange(16)]
+            for i in xrange(2000):
+                centre = centres[i % 16]
+                ds.record_row('row%d' % i,
+                              [['x%d' % j, centre[j] + random.gauss(0, 1), 0]
+                               for j in xrange(cls.dims)])
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + id, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': id, 'defaultNumNeighbors': 10}
+            })
+
+    def neighbors(self, id, row):
+        res = mldb.query("select nn_%s({coords: '%s'})[neighbors] as *"
+                         % (id, row))
+        return set(res[1][1:])
+
+    def test_recall(self):
+        found = 0
+        rows = ['row%d' % i for i in xrange(0, 2000, 40)]
+        for row in rows:
+            found += len(self.neighbors('exact', row)
+                         & self.neighbors('approx', row))
+        self.assertGreater(found / (10.0 * len(rows)), 0.8)
+
+    def test_self_is_nearest(self):
+        res = mldb.query("select nn_approx({coords: 'row17'})[distances] as *")
+        self.assertEqual(res[0][1], 'row17')
+        self.assertEqual(res[1][1], 0)
+        self.assertEqual(len(res[0]), 11)
+
+    def test_reload(self):
+        mldb.put('/v1/datasets/reloaded', {
+            'type': 'embedding',
+            'params': {'dataFileUrl': self.url, 'ivfProbes': 8}
+        })
+        mldb.put('/v1/functions/nn_reloaded', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'reloaded', 'defaultNumNeighbors': 10}
+        })
+        for row in ['row3', 'row400']:
+            self.assertEqual(self.neighbors('reloaded', row),
+                             self.neighbors('approx', row))
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({
+                'id': 'bad',
+                'type': 'embedding',
+                'params': {'index': 'ivf', 'ivfProbes': 0}
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,103 @@
+#
+# embedding_quantized_storage_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the float16 and int8 storage of the embedding dataset.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class EmbeddingQuantizedStorageTest(MldbUnitTest):  # noqa
+
+    dims = 20
+    url = 'file://tmp/embedding_quantized_storage_test.mldbds'
+    storages = ['float32', 'float16', 'int8']
+
+    @classmethod
+    def setUpClass(cls):
+        for storage in cls.storages:
+            ds = mldb.create_dataset({
+                'id': storage,
+                'type': 'embedding',
+                'params': {
+                    'storage': storage,
+                    'dataFileUrl': cls.url + '.' + storage
+                }
+            })
+            random.seed(0)
+            for i in xrange(500):
+                ds.record_row('row%d' % i,
+                              [['x%d' % j, random.gauss(0, 1), 0]
+                               for j in xrange(cls.dims)])
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + storage, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': storage, 'defaultNumNeighbors': 10}
+            })
+
+    def neighbors(self, id, row):
+        res = mldb.query("select nn_%s({coords: '%s'})[neighbors] as *"
+                         % (id, row))
+        return set(res[1][1:])
+
+    def test_values(self):
+        exact = mldb.query("select * from float32 order by rowName()")
+        for storage, tolerance in [('float16', 0.002), ('int8', 0.02)]:
+            res = mldb.query("select * from %s order by rowName()" % storage)
+            self.assertEqual(res[0], exact[0])
+            self.assertEqual(len(res), len(exact))
+            for row, exact_row in zip(res[1:], exact[1:]):
+                self.assertEqual(row[0], exact_row[0])
+                scale = max(abs(v) for v in exact_row[1:])
+                for v, e in zip(row[1:], exact_row[1:]):
+                    self.assertLessEqual(abs(v - e), tolerance * scale)
+
+    def test_column(self):
+        # Column values are decoded in the same way as rows
+        res = mldb.get('/v1/datasets/int8/columns/x3/values').json()
+        rows = mldb.query("select x3 from int8")
+        self.assertEqual(set(res), set(v for name, v in rows[1:]))
+
+    def test_neighbors(self):
+        for storage in ['float16', 'int8']:
+            found = 0
+            for i in xrange(20):
+                row = 'row%d' % i
+                found += len(self.neighbors('float32', row)
+                             & self.neighbors(storage, row))
+            self.assertGreater(found / 200.0, 0.9)
+
+    def test_reload(self):
+        for storage in self.storages:
+            # The storage type is the one the file was saved with
+            mldb.put('/v1/datasets/reloaded_' + storage, {
+                'type': 'embedding',
+                'params': {'dataFileUrl': self.url + '.' + storage}
+            })
+            self.assertEqual(
+                mldb.query("select * from reloaded_%s order by rowName()"
+                           % storage),
+                mldb.query("select * from %s order by rowName()" % storage))
+
+    def test_bad_values(self):
+        ds = mldb.create_dataset({
+            'id': 'too_large',
+            'type': 'embedding',
+            'params': {'storage': 'float16'}
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            ds.record_row('row', [['x', 100000, 0]])
+
+        ds = mldb.create_dataset({
+            'id': 'not_finite',
+            'type': 'embedding',
+            'params': {'storage': 'int8'}
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            ds.record_row('row', [['x', float('inf'), 0]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
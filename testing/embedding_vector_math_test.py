@@ -0,0 +1,58 @@
+#
+# embedding_vector_math_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of vector math on numeric embeddings, which works on the buffers
+# directly, and of repeated calls to fft().
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+# normalize() returns a numeric embedding, rather than one of atoms like an
+# embedding literal
+A = "normalize([1, 2, 1, 4], 1)"   # [0.125, 0.25, 0.125, 0.5]
+B = "normalize([2, 2, 2, 2], 1)"   # [0.25, 0.25, 0.25, 0.25]
+
+class EmbeddingVectorMathTest(MldbUnitTest):  # noqa
+
+    def check_op(self, op, expected):
+        self.assertTableResultEquals(
+            mldb.query("SELECT {}({}, {}) AS r".format(op, A, B)),
+            [["_rowName", "r.0", "r.1", "r.2", "r.3"],
+             ["result"] + expected])
+
+    def test_vector_ops(self):
+        self.check_op('vector_sum', [0.375, 0.5, 0.375, 0.75])
+        self.check_op('vector_diff', [-0.125, 0, -0.125, 0.25])
+        self.check_op('vector_product', [0.03125, 0.0625, 0.03125, 0.125])
+        self.check_op('vector_quotient', [0.5, 1, 0.5, 2])
+
+    def test_mixed(self):
+        # An embedding of atoms goes the generic way
+        self.assertTableResultEquals(
+            mldb.query("SELECT vector_sum({}, [1, 1, 1, 1]) AS r".format(A)),
+            [["_rowName", "r.0", "r.1", "r.2", "r.3"],
+             ["result", 1.125, 1.25, 1.125, 1.5]])
+
+    def test_horizontal_sum(self):
+        self.assertTableResultEquals(
+            mldb.query("SELECT horizontal_sum({}) AS a, "
+                       "horizontal_sum([1, 2, 1, 4]) AS b".format(A)),
+            [["_rowName", "a", "b"],
+             ["result", 1, 8]])
+
+    def test_fft_repeated(self):
+        # The transform setup is shared between the rows
+        ds = mldb.create_dataset({'id': 'signals', 'type': 'sparse.mutable'})
+        for r in range(10):
+            ds.record_row('r%d' % r, [['k', r % 2, 0]])
+        ds.commit()
+
+        signal = "[" + ", ".join(str(i % 5) for i in range(32)) + "]"
+        res = mldb.query("SELECT fft({}) AS f FROM signals".format(signal))
+        self.assertEqual(len(res), 11)
+        for row in res[2:]:
+            self.assertEqual(row[1:], res[1][1:])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -11,6 +11,7 @@
 #include "mldb/types/tuple_description.h"
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/arch/exception_handler.h"
 
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
@@ -548,3 +549,122 @@ BOOST_AUTO_TEST_CASE( test_embedding_length )
     BOOST_CHECK_EQUAL(myValue.rowLength(), 2);
     BOOST_CHECK_EQUAL(myValue.getAtomCount(), 4);
 }
+
+BOOST_AUTO_TEST_CASE( test_flat_row )
+{
+    Date ts = Date::fromSecondsSinceEpoch(10);
+
+    auto schema = std::make_shared<FlatRowSchema>
+        (std::vector<PathElement>{ "a", "b", "c" });
+
+    ExpressionValue flat(std::vector<CellValue>{ 1, CellValue(), "hello" },
+                         schema, ts);
+
+    StructValue structured;
+    structured.emplace_back(PathElement("a"), ExpressionValue(1, ts));
+    structured.emplace_back(PathElement("c"), ExpressionValue("hello", ts));
+    ExpressionValue expected(std::move(structured));
+
+    BOOST_CHECK(flat.isRow());
+    BOOST_CHECK_EQUAL(flat.rowLength(), 2);
+    BOOST_CHECK_EQUAL(flat.getAtomCount(), 2);
+    BOOST_CHECK_EQUAL(flat.getEffectiveTimestamp(), ts);
+
+    // Same logical value as the structured equivalent
+    BOOST_CHECK(flat == expected);
+    BOOST_CHECK(expected == flat);
+    BOOST_CHECK_EQUAL(flat.compare(expected), 0);
+    BOOST_CHECK_EQUAL(flat.hash(), expected.hash());
+    BOOST_CHECK_EQUAL(jsonEncode(flat), jsonEncode(expected));
+
+    BOOST_CHECK_EQUAL(flat.getColumn("a").getAtom(), 1);
+    BOOST_CHECK(flat.getColumn("b").empty());
+    BOOST_CHECK_EQUAL(flat.getColumn("c").getAtom(), "hello");
+    BOOST_CHECK(flat.getColumn("d").empty());
+    BOOST_CHECK(flat.hasKey("a").first);
+    BOOST_CHECK(!flat.hasKey("b").first);
+
+    std::vector<PathElement> names;
+    auto onColumn = [&] (const PathElement & name, const ExpressionValue & val)
+        {
+            names.push_back(name);
+            BOOST_CHECK_EQUAL(val.getEffectiveTimestamp(), ts);
+            return true;
+        };
+    flat.forEachColumn(onColumn);
+    BOOST_CHECK(names == (std::vector<PathElement>{ "a", "c" }));
+
+    // Copies share the values
+    ExpressionValue copy = flat;
+    BOOST_CHECK(copy == flat);
+
+    // A row with no values is the empty row
+    ExpressionValue empty(std::vector<CellValue>(3), schema, ts);
+    BOOST_CHECK_EQUAL(empty.rowLength(), 0);
+    BOOST_CHECK(empty == ExpressionValue(StructValue()));
+
+    // Schema names must be sorted and distinct
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(FlatRowSchema({ "b", "a" }), HttpReturnException);
+    BOOST_CHECK_THROW(FlatRowSchema({ "a", "a" }), HttpReturnException);
+}
+
+BOOST_AUTO_TEST_CASE( test_small_struct_inline )
+{
+    Date ts = Date::fromSecondsSinceEpoch(10);
+
+    StructValue structured;
+    structured.emplace_back(PathElement("x"), ExpressionValue(1, ts));
+    structured.emplace_back(PathElement("y"), ExpressionValue(2, ts));
+    BOOST_CHECK_EQUAL(structured.capacity(), 4);
+
+    // Moving and copying keep the values, even though they're inline
+    StructValue moved = std::move(structured);
+    StructValue copied = moved;
+    BOOST_CHECK(copied == moved);
+
+    ExpressionValue val(std::move(moved));
+    BOOST_CHECK_EQUAL(val.getColumn("x").getAtom(), 1);
+    BOOST_CHECK_EQUAL(val.getColumn("y").getAtom(), 2);
+    BOOST_CHECK(val.getColumn("z").empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_wide_struct_lookup )
+{
+    Date ts = Date::fromSecondsSinceEpoch(10);
+    int n = 100;
+
+    // Recorded in reverse order, so it needs sorting
+    StructValue structured;
+    for (int i = n - 1;  i >= 0;  --i)
+        structured.emplace_back(PathElement("c" + std::to_string(i)),
+                                ExpressionValue(i, ts));
+    ExpressionValue val(structured);
+    ExpressionValue copy(val);
+
+    // Claiming that an unsorted struct is sorted doesn't stop its columns
+    // from being found
+    ExpressionValue unsorted(structured, ExpressionValue::SORTED,
+                             ExpressionValue::NO_DUPLICATES);
+
+    for (int i = 0;  i < n;  ++i) {
+        PathElement name("c" + std::to_string(i));
+        BOOST_CHECK_EQUAL(val.getColumn(name).getAtom(), i);
+        BOOST_CHECK_EQUAL(copy.getColumn(name).getAtom(), i);
+        BOOST_CHECK_EQUAL(unsorted.getColumn(name).getAtom(), i);
+        BOOST_CHECK_EQUAL(val.getNestedColumn(ColumnPath(name)).getAtom(), i);
+    }
+
+    BOOST_CHECK(val.getColumn("a").empty());
+    BOOST_CHECK(val.getColumn("c50a").empty());
+    BOOST_CHECK(val.getColumn("z").empty());
+
+    // Duplicated columns are superposed into one
+    structured.emplace_back(PathElement("c7"),
+                            ExpressionValue(1000, Date::fromSecondsSinceEpoch(20)));
+    ExpressionValue duplicated(structured);
+    BOOST_CHECK_EQUAL(duplicated.rowLength(), n);
+    BOOST_CHECK_EQUAL(duplicated.getColumn("c7", GET_LATEST).getAtom(), 1000);
+    BOOST_CHECK_EQUAL(duplicated.getColumn("c7", GET_EARLIEST).getAtom(), 7);
+    BOOST_CHECK_EQUAL(duplicated.getColumn("c8").getAtom(), 8);
+}
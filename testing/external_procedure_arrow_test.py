@@ -0,0 +1,80 @@
+#
+# external_procedure_arrow_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test the Arrow streams in shared memory through which the external python
+# procedure exchanges data with its script.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+# Copies its input to its output, so that what MLDB writes is read back
+COPY_SCRIPT = """
+import json
+import os
+
+data = open(os.environ['MLDB_INPUT_ARROW'], 'rb').read()
+with open(os.environ['MLDB_OUTPUT_ARROW'], 'wb') as f:
+    f.write(data)
+print json.dumps({"bytes": len(data)})
+"""
+
+
+class ExternalProcedureArrowTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in xrange(10):
+            row = [['x', i, 0], ['y', i / 4.0, 0], ['z', 'z%d' % i, 0]]
+            if i % 3 == 0:
+                row.append(['w', i, 0])
+            ds.record_row('row%d' % i, row)
+        ds.commit()
+
+    def run_script(self, source, params):
+        params['scriptConfig'] = {'source': source}
+        return mldb.post('/v1/procedures', {
+            'type': 'experimental.external.procedure',
+            'params': params
+        }).json()
+
+    def test_round_trip(self):
+        res = self.run_script(COPY_SCRIPT, {
+            'inputData': 'select rowName() as _rowName, x, y, z, w from ds',
+            'outputDataset': 'copy'
+        })
+        status = res['status']['firstRun']['status']
+        self.assertGreater(status['return']['bytes'], 0)
+        self.assertEqual(status['rowCount'], 10)
+
+        self.assertEqual(
+            mldb.query("select * from copy order by rowName()"),
+            mldb.query("select x, y, z, w from ds order by rowName()"))
+
+    def test_row_numbers(self):
+        self.run_script(COPY_SCRIPT, {
+            'inputData': 'select x from ds order by x',
+            'outputDataset': {'id': 'numbered', 'type': 'sparse.mutable'}
+        })
+        self.assertTableResultEquals(
+            mldb.query("select x from numbered where rowName() in ('0', '9') "
+                       "order by x"),
+            [["_rowName", "x"], ["0", 0], ["9", 9]])
+
+    def test_no_output(self):
+        with self.assertMldbRaises(expected_regexp='MLDB_OUTPUT_ARROW'):
+            self.run_script("print 1", {'outputDataset': 'nothing'})
+
+    def test_no_channel_without_config(self):
+        res = self.run_script("""
+import json
+import os
+print json.dumps([os.environ.get('MLDB_INPUT_ARROW'),
+                  os.environ.get('MLDB_OUTPUT_ARROW')])
+""", {})
+        self.assertEqual(res['status']['firstRun']['status']['return'],
+                         [None, None])
+
+if __name__ == '__main__':
+    mldb.run_tests()
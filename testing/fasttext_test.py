@@ -4,6 +4,7 @@
 # Mathieu Marquis Bolduc, March 2nd 2017
 # This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
 # ##
+import math
 import os
 import tempfile
 
@@ -66,33 +67,27 @@ class FastTextTest(MldbUnitTest):
                 }
             })
 
-            res = mldb.query("SELECT myclassify({features : {tokenize(lower(' hockey '), {splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}) as tokens} }) as * ")
-            self.assertTableResultEquals(res, [
-                [
+            # Each word votes for the label of the example it came from.
+            # The scores are log probabilities.
+            def scores(word):
+                res = mldb.query("SELECT myclassify({features : {tokenize(lower(' %s '), {splitChars:' ,.:;«»[]()%%!?', quoteChar:'', minTokenLength: 2}) as tokens} }) as * " % word)
+                self.assertEqual(sorted(res[0]), [
                     "_rowName",
                     "scores.\"\"\"Politique\"\"\"",
                     "scores.\"\"\"Sports\"\"\""
-                ],
-                [
-                    "result",
-                    -0.7370663285255432,
-                    -0.6548283100128174
-                ]
-            ]);
-
-            res = mldb.query("SELECT myclassify({features : {tokenize(lower(' hillary '), {splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}) as tokens} }) as * ")
-            self.assertTableResultEquals(res, [
-            [
-                "_rowName",
-                "scores.\"\"\"Politique\"\"\"",
-                "scores.\"\"\"Sports\"\"\""
-            ],
-            [
-                "result",
-                -0.6585947871208191,
-                -0.7329930067062378
-            ]
-        ]);
+                ])
+                return dict(zip(res[0], res[1]))
+
+            hockey = scores('hockey')
+            self.assertGreater(hockey['scores."""Sports"""'],
+                               hockey['scores."""Politique"""'])
+            self.assertAlmostEqual(
+                math.exp(hockey['scores."""Sports"""'])
+                + math.exp(hockey['scores."""Politique"""']), 1.0, places=4)
+
+            hillary = scores('hillary')
+            self.assertGreater(hillary['scores."""Politique"""'],
+                               hillary['scores."""Sports"""'])
 
 
         def test_fasttext_regression_error(self):
@@ -146,29 +141,12 @@ class FastTextTest(MldbUnitTest):
                 }
             })
 
-            res = mldb.query("SELECT myclassify({features : {tokenize(lower(' hockey '), {splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}) as tokens} }) as * ")
-            self.assertTableResultEquals(res, [
-                [
-                    "_rowName",
-                    "score"
-                ],
-                [
-                    "result",
-                    -0.6548283100128174
-                ]
-            ])
+            def score(word):
+                res = mldb.query("SELECT myclassify({features : {tokenize(lower(' %s '), {splitChars:' ,.:;«»[]()%%!?', quoteChar:'', minTokenLength: 2}) as tokens} }) as * " % word)
+                self.assertEqual(res[0], ["_rowName", "score"])
+                return res[1][1]
 
-            res = mldb.query("SELECT myclassify({features : {tokenize(lower(' hillary '), {splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}) as tokens} }) as * ")
-            self.assertTableResultEquals(res, [
-                [
-                    "_rowName",
-                    "score"
-                ],
-                [
-                    "result",
-                    -0.7329930067062378
-                ]
-            ])
+            self.assertGreater(score('hockey'), score('hillary'))
 
         def test_fasttext_explain(self):
 
@@ -209,22 +187,21 @@ class FastTextTest(MldbUnitTest):
                                                 label : 'Politique'}) as * 
                             """)
 
-            self.assertTableResultEquals(res, [
-                [
-                    "_rowName",
-                    "bias",
-                    "explanation.tokens.alabama",
-                    "explanation.tokens.futbol",
-                    "explanation.tokens.hockey"
-                ],
-                [
-                    "result",
-                    0,
-                    -0.006820799317210913,
-                    -0.07053825259208679,
-                    -0.08547607064247131
-                ]
-            ]);
+            self.assertEqual(sorted(res[0]), [
+                "_rowName",
+                "bias",
+                "explanation.tokens.alabama",
+                "explanation.tokens.futbol",
+                "explanation.tokens.hockey"
+            ])
+            explanation = dict(zip(res[0], res[1]))
+            self.assertEqual(explanation['bias'], 0)
+            # Alabama comes from the politics example, the others from the
+            # sports one
+            self.assertGreater(explanation['explanation.tokens.alabama'],
+                               explanation['explanation.tokens.futbol'])
+            self.assertGreater(explanation['explanation.tokens.alabama'],
+                               explanation['explanation.tokens.hockey'])
 
             with self.assertRaisesRegexp(mldb_wrapper.ResponseException, "label not in model"):
                 res = mldb.query("""SELECT explain({features : {tokenize(lower(' hockey Alabama Futbol'), {splitChars:' ,.:;«»[]()%!?', quoteChar:'', minTokenLength: 2}) as tokens},
@@ -11,6 +11,9 @@
 #define BOOST_TEST_DYN_LINK
 
 #include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -20,6 +23,8 @@
 #include "mldb/jml/utils/vector_utils.h"
 
 #include "mldb/plugins/for_each_line.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
 
 
 using namespace std;
@@ -92,3 +97,51 @@ BOOST_AUTO_TEST_CASE( test_forEachLine_throw )
     auto logger = getMldbLog("test");
     BOOST_CHECK_THROW(forEachLineStr(stream, processLine, logger), MLDB::Exception);
 }
+
+/* Lines of a mapped file are passed directly from the mapping; they must be
+   the same as those read through the stream. */
+BOOST_AUTO_TEST_CASE( test_forEachLineBlock_mapped )
+{
+    string filename = "tmp/for_each_line_test.txt";
+    makeUriDirectory(filename);
+    string data = "header\nline1\r\n\nline3";
+    for (int i = 0;  i < 10000;  ++i)
+        data += "\nline" + to_string(i);
+    {
+        ofstream out(filename);
+        out << data;
+    }
+
+    auto readLines = [&] (bool mapped, int64_t maxLines)
+        {
+            filter_istream stream(filename,
+                                  { { mapped ? "mapped" : "unmapped", "true" } });
+            BOOST_CHECK_EQUAL(stream.mapped().first != nullptr, mapped);
+            string header;
+            getline(stream, header);
+            BOOST_CHECK_EQUAL(header, "header");
+
+            std::mutex lock;
+            map<int64_t, string> lines;
+            auto onLine = [&] (const char * line, size_t length,
+                               int64_t blockNumber, int64_t lineNumber)
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    lines[lineNumber] = string(line, length);
+                    return true;
+                };
+            forEachLineBlock(stream, onLine, maxLines, 4);
+            return lines;
+        };
+
+    auto streamed = readLines(false, -1);
+    BOOST_CHECK_EQUAL(streamed.size(), 10003);
+    BOOST_CHECK_EQUAL(streamed[0], "line1");
+    BOOST_CHECK_EQUAL(streamed[1], "");
+    BOOST_CHECK_EQUAL(streamed[10002], "line9999");
+
+    BOOST_CHECK(readLines(true, -1) == streamed);
+    BOOST_CHECK_EQUAL(readLines(true, 100).size(), 100);
+
+    tryEraseUriObject(filename);
+}
@@ -0,0 +1,57 @@
+#
+# function_result_cache_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the cache of function results, turned on by resultCacheBytes.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class FunctionResultCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in xrange(1000):
+            ds.record_row('row%d' % i, [['x', i % 10, 0]])
+        ds.commit()
+
+    def create(self, name, **config):
+        config.update({
+            "type": "sql.expression",
+            "params": {
+                "expression": "x * 2 AS y"
+            }
+        })
+        mldb.put("/v1/functions/" + name, config)
+
+    def test_cached_results(self):
+        self.create("cached", resultCacheBytes=1000000)
+
+        res = mldb.query("SELECT sum(cached({x}).y) AS total FROM ds")
+        self.assertEqual(res[1][1], 2 * 100 * sum(range(10)))
+
+        stats = mldb.get("/v1/functions/cached").json()['status']['resultCache']
+        self.assertEqual(stats['hits'] + stats['misses'], 1000)
+        self.assertGreaterEqual(stats['misses'], 10)
+        self.assertLessEqual(stats['entries'], 10)
+        self.assertGreater(stats['hitRate'], 0.5)
+
+    def test_small_budget(self):
+        # a budget that can only hold a few entries still gives the right
+        # results, evicting as it goes
+        self.create("small", resultCacheBytes=4000)
+
+        res = mldb.query("SELECT sum(small({x}).y) AS total FROM ds")
+        self.assertEqual(res[1][1], 2 * 100 * sum(range(10)))
+
+        stats = mldb.get("/v1/functions/small").json()['status']['resultCache']
+        self.assertLessEqual(stats['bytes'], 4000)
+
+    def test_not_cached(self):
+        self.create("uncached")
+        status = mldb.get("/v1/functions/uncached").json().get('status')
+        self.assertTrue(status is None or 'resultCache' not in status)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,83 @@
+#
+# geo_within_join_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the geo_within() function and of joins on it, which are run with a
+# spatial index.  The join must give the same rows as the equivalent join on
+# geo_distance(), which compares every pair of rows.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class GeoWithinJoinTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1234)
+
+        events = mldb.create_dataset({'id': 'events', 'type': 'sparse.mutable'})
+        for i in range(300):
+            events.record_row('e%d' % i,
+                              [['lat', 45.5 + random.uniform(-0.1, 0.1), 0],
+                               ['lon', -73.6 + random.uniform(-0.1, 0.1), 0],
+                               ['kind', i % 3, 0]])
+        events.record_row('e_nowhere', [['kind', 0, 0]])
+        # Either side of the antimeridian
+        events.record_row('e_east', [['lat', 0.0, 0], ['lon', 179.9995, 0],
+                                     ['kind', 1, 0]])
+        events.commit()
+
+        stores = mldb.create_dataset({'id': 'stores', 'type': 'sparse.mutable'})
+        for i in range(40):
+            stores.record_row('s%d' % i,
+                              [['lat', 45.5 + random.uniform(-0.1, 0.1), 0],
+                               ['lon', -73.6 + random.uniform(-0.1, 0.1), 0]])
+        stores.record_row('s_west', [['lat', 0.0, 0], ['lon', -179.9995, 0]])
+        stores.commit()
+
+    def check_same(self, within_on, distance_on):
+        query = ("SELECT e.kind, s.lat FROM events AS e JOIN stores AS s "
+                 "ON {} ORDER BY rowName()")
+        within = mldb.query(query.format(within_on))
+        distance = mldb.query(query.format(distance_on))
+        self.assertTableResultEquals(within, distance)
+        return within
+
+    def test_function(self):
+        res = mldb.query("SELECT geo_within(45.5, -73.6, 45.5, -73.6, 0) AS a, "
+                         "geo_within(45.5, -73.6, 45.505, -73.6, 1000) AS b, "
+                         "geo_within(45.5, -73.6, 45.6, -73.6, 1000) AS c, "
+                         "geo_within(45.5, -73.6, 45.6, -73.6, NULL) AS d")
+        self.assertTableResultEquals(res, [['_rowName', 'a', 'b', 'c', 'd'],
+                                           ['result', True, True, False, None]])
+
+    def test_join(self):
+        res = self.check_same(
+            "geo_within(e.lat, e.lon, s.lat, s.lon, 1000)",
+            "geo_distance(e.lat, e.lon, s.lat, s.lon) <= 1000")
+        # With 1km around random points in a 20km square, some pairs match
+        # but far from all of them
+        self.assertGreater(len(res), 10)
+        self.assertLess(len(res), 300 * 40 / 4)
+
+    def test_join_sides_swapped(self):
+        self.check_same(
+            "geo_within(s.lat, s.lon, e.lat, e.lon, 2000)",
+            "geo_distance(e.lat, e.lon, s.lat, s.lon) <= 2000")
+
+    def test_join_side_conditions(self):
+        self.check_same(
+            "geo_within(e.lat, e.lon, s.lat, s.lon, 1000) AND e.kind = 1",
+            "geo_distance(e.lat, e.lon, s.lat, s.lon) <= 1000 AND e.kind = 1")
+
+    def test_join_antimeridian(self):
+        res = mldb.query("SELECT e.kind FROM events AS e JOIN stores AS s "
+                         "ON geo_within(e.lat, e.lon, s.lat, s.lon, 1000) "
+                         "WHERE s.rowName() = 's_west'")
+        self.assertTableResultEquals(res, [['_rowName', 'e.kind'],
+                                           ['[e_east]-[s_west]', 1]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,61 @@
+#
+# group_by_partitioned_merge_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that GROUP BY with many groups, which are aggregated into hash
+# partitions and merged in parallel, gives correct results in key order.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class GroupByPartitionedMergeTest(MldbUnitTest):  # noqa
+
+    num_rows = 20000
+    num_groups = 3000
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in xrange(cls.num_rows):
+            ds.record_row('row%d' % i, [['k', i % cls.num_groups, 0],
+                                        ['s', 'g%d' % (i % 7), 0],
+                                        ['x', i, 0]])
+        ds.commit()
+
+    def test_many_groups(self):
+        res = mldb.query("select k, count(*) as cnt, sum(x) as total "
+                         "from ds group by k")
+        self.assertEqual(len(res), self.num_groups + 1)
+
+        expected_sums = [0] * self.num_groups
+        expected_counts = [0] * self.num_groups
+        for i in xrange(self.num_rows):
+            expected_sums[i % self.num_groups] += i
+            expected_counts[i % self.num_groups] += 1
+
+        # No ORDER BY means the output is in group key order
+        keys = [r[1] for r in res[1:]]
+        self.assertEqual(keys, range(self.num_groups))
+        for r in res[1:]:
+            self.assertEqual(r[2], expected_counts[r[1]])
+            self.assertEqual(r[3], expected_sums[r[1]])
+
+    def test_compound_key_order(self):
+        res = mldb.query("select s, k % 3 as m, count(*) as cnt "
+                         "from ds group by s, k % 3")
+        keys = [(r[1], r[2]) for r in res[1:]]
+        self.assertEqual(keys, sorted(keys))
+        self.assertEqual(len(keys), 21)
+        self.assertEqual(sum(r[3] for r in res[1:]), self.num_rows)
+
+    def test_limit(self):
+        res = mldb.query("select k from ds group by k limit 10")
+        self.assertEqual([r[1] for r in res[1:]], range(10))
+
+    def test_empty_groups(self):
+        res = mldb.query("select count(*) as cnt from ds where x < 0")
+        self.assertTableResultEquals(res, [["_rowName", "cnt"],
+                                           ["[]", 0]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,108 @@
+#
+# import_parquet_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# The fixture has 100 rows in two row groups (snappy then gzip), with
+# dictionary, delta and v2 data pages and optional columns.
+#
+
+if False:
+    mldb_wrapper = None
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+FILE_URL = 'file://mldb/testing/dataset/import_parquet_test.parquet'
+
+
+class ImportParquetTest(MldbUnitTest):  # noqa
+
+    def run_import(self, ds, **params):
+        params['dataFileUrl'] = FILE_URL
+        params['outputDataset'] = ds
+        params['runOnCreation'] = True
+        return mldb.post('/v1/procedures', {
+            'type' : 'import.parquet',
+            'params' : params
+        }).json()['status']['firstRun']['status']
+
+    def test_import_all(self):
+        res = self.run_import('parquet_all')
+        self.assertEqual(res, { 'rowCount' : 100 })
+
+        res = mldb.query("""
+            SELECT id, name, score, flag, ts, day, price, count, float
+            FROM parquet_all WHERE rowName() IN ('1', '4', '61')
+            ORDER BY id
+        """)
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'id', 'name', 'score', 'flag', 'ts', 'day',
+             'price', 'count', 'float'],
+            ['1', 0, 'alice', 0, 1, {'ts' : '2017-07-14T02:40:00Z'},
+             {'ts' : '2016-07-18T00:00:00Z'}, -3, -40, 0],
+            ['4', 30, None, 1.5, 0, {'ts' : '2017-07-14T02:40:03Z'},
+             {'ts' : '2016-07-21T00:00:00Z'}, 0.75, -31, 0.75],
+            ['61', 600, 'alice', 30, 1, {'ts' : '2017-07-14T02:41:00Z'},
+             {'ts' : '2016-09-16T00:00:00Z'}, 72, -29, 15]
+        ])
+
+        res = mldb.query("""
+            SELECT count(name) AS names, count(score) AS scores,
+                   count(data) AS data, sum(id) AS ids
+            FROM parquet_all
+        """)
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'names', 'scores', 'data', 'ids'],
+            ['[]', 75, 80, 85, 49500]
+        ])
+
+    def test_select_where_named(self):
+        res = self.run_import('parquet_select',
+                              select='name, price * 100 AS cents',
+                              where='flag = 1 AND name IS NOT NULL',
+                              named="'row_' + CAST (id AS STRING)",
+                              limit=10)
+        self.assertEqual(res, { 'rowCount' : 5 })
+
+        res = mldb.query("SELECT * FROM parquet_select ORDER BY rowName()")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'cents', 'name'],
+            ['row_0', -300, 'alice'],
+            ['row_20', -50, 'carol'],
+            ['row_40', 200, 'bob'],
+            ['row_60', 450, 'alice'],
+            ['row_80', 700, 'carol']
+        ])
+
+    def test_offset_limit_across_row_groups(self):
+        res = self.run_import('parquet_offset', select='id',
+                              offset=55, limit=10)
+        self.assertEqual(res, { 'rowCount' : 10 })
+
+        res = mldb.query("""
+            SELECT min(id) AS lo, max(id) AS hi, min(rowName()) AS first
+            FROM parquet_offset
+        """)
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'lo', 'hi', 'first'],
+            ['[]', 550, 640, '56']
+        ])
+
+    def test_unknown_column(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            self.run_import('parquet_unknown', select='nothere')
+        self.assertIn('Unknown column name', re.exception.response.text)
+
+    def test_not_parquet(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.post('/v1/procedures', {
+                'type' : 'import.parquet',
+                'params' : {
+                    'dataFileUrl' :
+                        'file://mldb/testing/dataset/json_dataset.json',
+                    'outputDataset' : 'parquet_bad',
+                    'runOnCreation' : True
+                }
+            })
+        self.assertIn('Not a Parquet file', re.exception.response.text)
+
+if __name__ == '__main__':
+    mldb.run_tests()
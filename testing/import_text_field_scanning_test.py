@@ -0,0 +1,88 @@
+#
+# import_text_field_scanning_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the vectorized field splitting of import.text gives the same
+# fields as a reference CSV parser, for fields of every length and with
+# special characters at every position relative to the 32 byte blocks.
+#
+
+import csv
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ImportTextFieldScanningTest(MldbUnitTest):  # noqa
+
+    filename = 'tmp/import_text_field_scanning_test.csv'
+
+    @classmethod
+    def make_field(cls, rand):
+        length = rand.randint(1, 100)
+        chars = []
+        for i in xrange(length):
+            r = rand.randint(0, 30)
+            if r == 0:
+                chars.append(',')
+            elif r == 1:
+                chars.append('"')
+            elif r == 2:
+                chars.append(u'é'.encode('utf-8'))
+            else:
+                chars.append(chr(ord('a') + r % 26))
+        value = ''.join(chars)
+
+        # Don't start with something that looks like a number or has
+        # leading or trailing whitespace
+        return 'x' + value
+
+    @classmethod
+    def setUpClass(cls):
+        rand = random.Random(1234)
+        cls.rows = []
+        with open(cls.filename, 'wb') as f:
+            writer = csv.writer(f, quoting=csv.QUOTE_MINIMAL,
+                                lineterminator='\n')
+            writer.writerow(['a', 'b', 'c'])
+            for i in xrange(2000):
+                row = [cls.make_field(rand) for j in xrange(3)]
+                writer.writerow(row)
+                cls.rows.append(row)
+
+        mldb.post('/v1/procedures', {
+            'type': 'import.text',
+            'params': {
+                'dataFileUrl': 'file://' + cls.filename,
+                'outputDataset': 'scanned',
+                'runOnCreation': True,
+                'ignoreBadLines': False
+            }
+        })
+
+    def test_fields_match(self):
+        res = mldb.query("""
+            select a, b, c from scanned order by cast(rowName() as integer)
+        """)
+        self.assertEqual(len(res), len(self.rows) + 1)
+        for expected, row in zip(self.rows, res[1:]):
+            self.assertEqual([v.encode('utf-8') for v in row[1:]], expected)
+
+    def test_garbage_after_quote(self):
+        with open('tmp/import_text_field_scanning_bad.csv', 'wb') as f:
+            f.write('a,b\n')
+            f.write('"' + 'x' * 40 + '"y,z\n')
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post('/v1/procedures', {
+                'type': 'import.text',
+                'params': {
+                    'dataFileUrl':
+                        'file://tmp/import_text_field_scanning_bad.csv',
+                    'outputDataset': 'bad',
+                    'runOnCreation': True,
+                    'ignoreBadLines': False
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
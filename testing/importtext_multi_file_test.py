@@ -0,0 +1,104 @@
+#
+# importtext_multi_file_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of importing several files at once with import.text.
+#
+
+import os
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_FILES = 20
+
+class ImportTextMultiFileTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmp_dir = tempfile.mkdtemp(dir=os.getcwd() + '/build/x86_64/tmp')
+        for i in xrange(NUM_FILES):
+            day_dir = os.path.join(cls.tmp_dir, 'day%02d' % (i % 4))
+            if not os.path.exists(day_dir):
+                os.mkdir(day_dir)
+            with open(os.path.join(day_dir, 'part%02d.csv' % i), 'w') as f:
+                f.write('file,line\n')
+                for j in xrange(i + 1):
+                    f.write('%d,%d\n' % (i, j))
+
+        with open(os.path.join(cls.tmp_dir, 'other_header.csv'), 'w') as f:
+            f.write('a,b\n1,2\n')
+
+    def run_import(self, params):
+        params = dict(params)
+        params['outputDataset'] = {'id' : 'imported', 'type' : 'tabular'}
+        params['runOnCreation'] = True
+        return mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : params
+        }).json()
+
+    def test_glob(self):
+        res = self.run_import({
+            'dataFileUrl' : 'file://' + self.tmp_dir + '/day*/part*.csv'
+        })
+        self.assertEqual(res['status']['firstRun']['status']['rowCount'],
+                         NUM_FILES * (NUM_FILES + 1) / 2)
+
+        res = mldb.get('/v1/query',
+                       q='SELECT count(*) AS n, max(line) AS m FROM imported '
+                         'GROUP BY file ORDER BY file',
+                       format='table', rowNames=False).json()
+        self.assertEqual(len(res), NUM_FILES + 1)
+        for i in xrange(NUM_FILES):
+            self.assertEqual(res[i + 1], [i + 1, i])
+
+        # Rows are named after the file and the line, which are unique
+        res = mldb.get('/v1/query',
+                       q='SELECT count(distinct rowName()) FROM imported',
+                       format='atom').json()
+        self.assertEqual(res, NUM_FILES * (NUM_FILES + 1) / 2)
+
+    def test_list_and_functions(self):
+        files = ['file://%s/day00/part00.csv' % self.tmp_dir,
+                 'file://%s/day01/part05.csv' % self.tmp_dir]
+        self.run_import({
+            'dataFileUrls' : files,
+            'select' : 'file, dataFileUrl() AS url'
+        })
+
+        res = mldb.get('/v1/query',
+                       q='SELECT url, count(*) FROM imported GROUP BY url '
+                         'ORDER BY url',
+                       format='table', rowNames=False).json()
+        self.assertEqual(res[1:], [[files[0], 1], [files[1], 6]])
+
+    def test_offset_and_limit_per_file(self):
+        self.run_import({
+            'dataFileUrl' : 'file://' + self.tmp_dir + '/day00/part*.csv',
+            'offset' : 1,
+            'limit' : 2
+        })
+        # part00, part04, part08, part12 and part16 have 1, 5, 9, 13 and 17
+        # lines, of which the first is skipped and at most two are kept
+        res = mldb.get('/v1/query', q='SELECT count(*) FROM imported',
+                       format='atom').json()
+        self.assertEqual(res, 0 + 2 + 2 + 2 + 2)
+
+    def test_different_header(self):
+        with self.assertMldbRaises(expected_regexp='same header'):
+            self.run_import({
+                'dataFileUrls' : [
+                    'file://%s/day00/part00.csv' % self.tmp_dir,
+                    'file://%s/other_header.csv' % self.tmp_dir
+                ]
+            })
+
+    def test_no_match(self):
+        with self.assertMldbRaises(expected_regexp='No file matches'):
+            self.run_import({
+                'dataFileUrl' : 'file://' + self.tmp_dir + '/nothing*/*.csv'
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,58 @@
+#
+# in_expression_set_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of IN expressions on literal lists, subqueries and constant VALUES
+# OF, which are looked up in a set built when the expression is bound.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class InExpressionSetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ids', 'type': 'sparse.mutable'})
+        for i in range(100):
+            ds.record_row('r%d' % i, [['id', i, 0], ['name', 'n%d' % i, 0]])
+        ds.record_row('r_null', [['name', 'nothing', 0]])
+        ds.record_row('r_float', [['id', 2.5, 0]])
+        ds.commit()
+
+        wl = mldb.create_dataset({'id': 'whitelist', 'type': 'sparse.mutable'})
+        for i in range(0, 100, 7):
+            wl.record_row('w%d' % i, [['id', i, 0]])
+        wl.commit()
+
+    def count(self, where):
+        return mldb.query("SELECT count(*) FROM ids WHERE " + where)[1][1]
+
+    def test_long_literal_list(self):
+        vals = ', '.join(str(i) for i in range(0, 1000, 3))
+        self.assertEqual(self.count("id IN (%s)" % vals), 34)
+        self.assertEqual(self.count("id NOT IN (%s)" % vals), 67)
+
+    def test_mixed_types(self):
+        # Equal numbers match whatever their type; strings don't match
+        # numbers
+        self.assertEqual(self.count("id IN (1, 2.0, 2.5, '3', 'n4')"), 3)
+        self.assertEqual(self.count("name IN ('n1', 2, 'n3', 'nothing')"), 3)
+
+    def test_null(self):
+        self.assertEqual(mldb.get('/v1/query', q="SELECT NULL IN (1, 2) AS x",
+                                  format='table').json(),
+                         [['_rowName', 'x'], ['result', None]])
+        self.assertEqual(self.count("id IN (1, NULL)"), 1)
+
+    def test_subquery(self):
+        self.assertEqual(self.count("id IN (SELECT id FROM whitelist)"), 15)
+        self.assertEqual(self.count("id NOT IN (SELECT id FROM whitelist)"),
+                         86)
+
+    def test_values_of(self):
+        self.assertEqual(self.count("id IN (VALUES OF [1, 2, 3.5, 'x'])"), 2)
+        self.assertEqual(self.count("name IN (VALUES OF {a: 'n5', b: 'n6'})"),
+                         2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,180 @@
+/* ingestion_queue_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the queue that records posted rows in batches.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/server/ingestion_queue.h"
+#include "mldb/arch/exception.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+IngestionQueue::Rows makeRows(int first, int n)
+{
+    IngestionQueue::Rows result;
+    for (int i = first;  i < first + n;  ++i) {
+        std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
+        cols.emplace_back(ColumnPath("x"), i, Date());
+        result.emplace_back(RowPath(PathElement(i)), std::move(cols));
+    }
+    return result;
+}
+
+/// Record function that is held until it is released, to let requests
+/// accumulate behind the batch being recorded
+struct Gate {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool open = false;
+    int waiting = 0;
+
+    void pass()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        ++waiting;
+        cond.notify_all();
+        cond.wait(guard, [&] () { return open; });
+    }
+
+    void waitForWriter()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        cond.wait(guard, [&] () { return waiting > 0; });
+    }
+
+    void release()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        open = true;
+        cond.notify_all();
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_rows_are_recorded_in_order )
+{
+    std::vector<int> recorded;
+    IngestionQueue queue([&] (const IngestionQueue::Rows & rows)
+                         {
+                             for (auto & r: rows)
+                                 recorded.push_back(std::get<1>(r.second[0]).toInt());
+                         },
+                         1000, 100);
+
+    for (int i = 0;  i < 50;  ++i)
+        BOOST_CHECK(queue.enqueue(makeRows(i * 3, 3)));
+    queue.flush();
+
+    BOOST_REQUIRE_EQUAL(recorded.size(), 150);
+    for (int i = 0;  i < 150;  ++i)
+        BOOST_CHECK_EQUAL(recorded[i], i);
+
+    auto stats = queue.getStats();
+    BOOST_CHECK_EQUAL(stats.acceptedRows, 150);
+    BOOST_CHECK_EQUAL(stats.recordedRows, 150);
+    BOOST_CHECK_EQUAL(stats.queuedRows, 0);
+    BOOST_CHECK_EQUAL(stats.queuedRequests, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_requests_are_coalesced )
+{
+    Gate gate;
+    std::vector<size_t> batchSizes;
+    IngestionQueue queue([&] (const IngestionQueue::Rows & rows)
+                         {
+                             gate.pass();
+                             batchSizes.push_back(rows.size());
+                         },
+                         1000, 25);
+
+    // The first request is taken on its own; the others wait behind it
+    BOOST_CHECK(queue.enqueue(makeRows(0, 10)));
+    gate.waitForWriter();
+    for (int i = 1;  i <= 6;  ++i)
+        BOOST_CHECK(queue.enqueue(makeRows(i * 10, 10)));
+    gate.release();
+    queue.flush();
+
+    // Batches of at most 25 rows, made of whole requests
+    std::vector<size_t> expected = { 10, 20, 20, 20 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(batchSizes.begin(), batchSizes.end(),
+                                  expected.begin(), expected.end());
+    BOOST_CHECK_EQUAL(queue.getStats().batches, 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_full_queue_refuses )
+{
+    Gate gate;
+    IngestionQueue queue([&] (const IngestionQueue::Rows & rows)
+                         {
+                             gate.pass();
+                         },
+                         20, 100);
+
+    // A request bigger than the queue goes through when it's empty
+    BOOST_CHECK(queue.enqueue(makeRows(0, 30)));
+    gate.waitForWriter();
+    BOOST_CHECK(!queue.enqueue(makeRows(30, 1)));
+    BOOST_CHECK_GT(queue.retryAfterSeconds(), 0);
+
+    auto stats = queue.getStats();
+    BOOST_CHECK_EQUAL(stats.queuedRows, 30);
+    BOOST_CHECK_EQUAL(stats.rejectedRequests, 1);
+
+    gate.release();
+    queue.flush();
+    BOOST_CHECK(queue.enqueue(makeRows(30, 15)));
+    queue.flush();
+    BOOST_CHECK_EQUAL(queue.getStats().recordedRows, 45);
+}
+
+BOOST_AUTO_TEST_CASE( test_errors_are_seen_by_flush )
+{
+    std::atomic<int> calls(0);
+    IngestionQueue queue([&] (const IngestionQueue::Rows & rows)
+                         {
+                             if (calls++ == 0)
+                                 throw MLDB::Exception("bad rows");
+                         },
+                         1000, 100);
+
+    BOOST_CHECK(queue.enqueue(makeRows(0, 5)));
+    BOOST_CHECK_THROW(queue.flush(), MLDB::Exception);
+
+    // The error is only reported once
+    BOOST_CHECK(queue.enqueue(makeRows(5, 5)));
+    queue.flush();
+
+    auto stats = queue.getStats();
+    BOOST_CHECK_EQUAL(stats.errors, 1);
+    BOOST_CHECK_EQUAL(stats.lastError, "bad rows");
+    BOOST_CHECK_EQUAL(stats.recordedRows, 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_destructor_records_what_is_queued )
+{
+    std::atomic<size_t> recorded(0);
+    {
+        IngestionQueue queue([&] (const IngestionQueue::Rows & rows)
+                             {
+                                 recorded += rows.size();
+                             },
+                             1000, 7);
+        for (int i = 0;  i < 10;  ++i)
+            queue.enqueue(makeRows(i * 4, 4));
+    }
+    BOOST_CHECK_EQUAL(recorded, 40);
+}
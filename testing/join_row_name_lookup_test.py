@@ -0,0 +1,58 @@
+#
+# join_row_name_lookup_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of joins on the row name of the right side, which look up the right
+# rows by name rather than scanning them.  The results must be the same as
+# those of the merge join, which is forced by hiding the rowName() in an
+# expression.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class JoinRowNameLookupTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        facts = mldb.create_dataset({'id': 'facts', 'type': 'sparse.mutable'})
+        for i in range(50):
+            facts.record_row('f%d' % i, [['dim', 'd%d' % (i % 13), 0],
+                                         ['val', i, 0]])
+        facts.record_row('f_null', [['val', -1, 0]])
+        facts.record_row('f_num', [['dim', 3, 0], ['val', -2, 0]])
+        facts.record_row('f_quoted', [['dim', '"d3"', 0], ['val', -3, 0]])
+        facts.commit()
+
+        dims = mldb.create_dataset({'id': 'dims', 'type': 'sparse.mutable'})
+        for i in range(10):
+            dims.record_row('d%d' % i, [['name', 'dim %d' % i, 0]])
+        dims.record_row('3', [['name', 'three', 0]])
+        dims.commit()
+
+    def check_same(self, query):
+        self.assertTableResultEquals(
+            mldb.query(query.format("d.rowName()")),
+            mldb.query(query.format("d.rowName() + ''")))
+
+    def test_inner(self):
+        self.check_same("SELECT f.val, d.name FROM facts AS f "
+                        "JOIN dims AS d ON f.dim = {} "
+                        "ORDER BY f.val")
+
+    def test_left(self):
+        self.check_same("SELECT f.val, d.name FROM facts AS f "
+                        "LEFT JOIN dims AS d ON f.dim = {} "
+                        "ORDER BY f.val")
+
+    def test_left_where(self):
+        self.check_same("SELECT f.val, d.name FROM facts AS f "
+                        "LEFT JOIN dims AS d ON f.dim = {} AND f.val > 20 "
+                        "ORDER BY f.val")
+
+    def test_row_names(self):
+        # The joined rows come out in the same order, with the same names
+        self.check_same("SELECT rowName() AS n FROM facts AS f "
+                        "JOIN dims AS d ON f.dim = {}")
+
+if __name__ == '__main__':
+    mldb.run_tests()
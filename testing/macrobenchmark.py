@@ -0,0 +1,288 @@
+#
+# macrobenchmark.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# End to end benchmark of MLDB, loosely modelled on TPC-H.  It generates
+# synthetic orders and customers of a configurable size, loads them into
+# tabular, sparse and behavior datasets, runs a fixed mix of queries,
+# function calls and exports against each and reports their latency,
+# throughput and the peak memory of the process.
+#
+# The data is generated from a fixed seed, so that runs are comparable.
+# Arguments, passed as a JSON object with --script-args, all optional:
+#   scale:  number of orders in units of 100000, default 1; there are ten
+#           times fewer customers
+#   repeat: number of times each query is run, default 3
+#   types:  list of dataset types to load into, default all three
+#   output: file to write the JSON report to
+#
+# Run it at 1, 8 and all CPUs with "make macrobenchmark"; the number of
+# CPUs used is set by the NUM_CPUS environment variable.
+#
+
+import csv
+import json
+import os
+import random
+import shutil
+import tempfile
+import time
+
+if False:
+    mldb_wrapper = None
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+args = mldb.script.args if isinstance(mldb.script.args, dict) else {}
+scale = float(args.get('scale', 1))
+repeat = int(args.get('repeat', 3))
+dataset_types = args.get('types', ['tabular', 'sparse.mutable', 'beh.mutable'])
+
+num_orders = max(100, int(100000 * scale))
+num_customers = max(10, num_orders / 10)
+
+SEGMENTS = ['AUTOMOBILE', 'BUILDING', 'FURNITURE', 'HOUSEHOLD', 'MACHINERY']
+STATUSES = ['F', 'O', 'P']
+WORDS = ['carefully', 'final', 'deposits', 'quickly', 'regular', 'packages',
+         'blithely', 'ironic', 'accounts', 'furiously', 'pending', 'requests']
+
+
+def memory_kb(field):
+    """Return the given field of /proc/self/status, in kB, or None."""
+    try:
+        with open('/proc/self/status') as f:
+            for line in f:
+                if line.startswith(field + ':'):
+                    return int(line.split()[1])
+    except IOError:
+        pass
+    return None
+
+
+def reset_peak_rss():
+    """Reset the peak RSS of the process, so that it can be measured for
+    each dataset type.  This is only possible on Linux 4.0 and later;
+    otherwise the peak is that of the whole run so far."""
+    try:
+        with open('/proc/self/clear_refs', 'w') as f:
+            f.write('5')
+    except IOError:
+        pass
+
+
+def generate(tmp_dir):
+    """Write the orders and customers as CSV files, returning their paths.
+    """
+    rng = random.Random(42)
+
+    customers = os.path.join(tmp_dir, 'customers.csv')
+    with open(customers, 'wb') as f:
+        writer = csv.writer(f)
+        writer.writerow(['custkey', 'name', 'segment', 'nation', 'balance'])
+        for i in xrange(num_customers):
+            writer.writerow([i, 'Customer#%09d' % i, rng.choice(SEGMENTS),
+                             rng.randint(0, 24),
+                             round(rng.uniform(-999.99, 9999.99), 2)])
+
+    orders = os.path.join(tmp_dir, 'orders.csv')
+    with open(orders, 'wb') as f:
+        writer = csv.writer(f)
+        writer.writerow(['orderkey', 'custkey', 'status', 'quantity',
+                         'price', 'discount', 'orderdate', 'comment'])
+        for i in xrange(num_orders):
+            writer.writerow([i, rng.randrange(num_customers),
+                             rng.choice(STATUSES), rng.randint(1, 50),
+                             round(rng.uniform(900.0, 100000.0), 2),
+                             rng.randint(0, 10) / 100.0,
+                             '199%d-%02d-%02d' % (rng.randint(2, 8),
+                                                  rng.randint(1, 12),
+                                                  rng.randint(1, 28)),
+                             ' '.join(rng.sample(WORDS, 4))])
+
+    return orders, customers
+
+
+def timed(fn):
+    before = time.time()
+    fn()
+    return time.time() - before
+
+
+def dataset_id(name, dataset_type):
+    return 'bench_%s_%s' % (name, dataset_type.replace('.', '_'))
+
+
+def load(steps, orders_csv, customers_csv):
+    """Import the CSV files into tabular datasets, then copy them into each
+    of the other dataset types."""
+    ids = {}
+    for name, path in [('orders', orders_csv), ('customers', customers_csv)]:
+        ids[(name, 'tabular')] = dataset_id(name, 'tabular')
+        seconds = timed(lambda: mldb.post('/v1/procedures', {
+            'type': 'import.text',
+            'params': {
+                'dataFileUrl': 'file://' + path,
+                'outputDataset': {'id': ids[(name, 'tabular')],
+                                  'type': 'tabular'},
+                'runOnCreation': True
+            }
+        }))
+        steps.append({'name': 'import.' + name, 'datasetType': 'tabular',
+                      'seconds': seconds,
+                      'rowsPerSecond': (num_orders if name == 'orders'
+                                        else num_customers) / seconds})
+
+    for dataset_type in dataset_types:
+        if dataset_type == 'tabular':
+            continue
+        for name in ['orders', 'customers']:
+            ids[(name, dataset_type)] = dataset_id(name, dataset_type)
+            seconds = timed(lambda: mldb.post('/v1/procedures', {
+                'type': 'transform',
+                'params': {
+                    'inputData': 'SELECT * FROM ' + ids[(name, 'tabular')],
+                    'outputDataset': {'id': ids[(name, dataset_type)],
+                                      'type': dataset_type},
+                    'runOnCreation': True
+                }
+            }))
+            steps.append({'name': 'load.' + name,
+                          'datasetType': dataset_type,
+                          'seconds': seconds})
+    return ids
+
+
+# The query mix.  Each query reads the orders, so that its throughput is
+# given in orders per second; %(orders)s and %(customers)s are replaced by
+# the datasets of the type being benchmarked.
+QUERIES = [
+    ('scan', 'SELECT orderkey, price FROM %(orders)s'),
+    ('filter',
+     "SELECT orderkey FROM %(orders)s WHERE quantity > 45 AND status = 'F'"),
+    ('aggregate',
+     'SELECT count(*), sum(price), avg(quantity) FROM %(orders)s'),
+    ('groupBy',
+     'SELECT status, count(*), sum(quantity), sum(price * (1 - discount)), '
+     'avg(discount) FROM %(orders)s GROUP BY status'),
+    ('groupBy.highCardinality',
+     'SELECT custkey, sum(price) FROM %(orders)s GROUP BY custkey'),
+    ('join',
+     'SELECT c.segment, count(*), sum(o.price) FROM %(orders)s AS o '
+     'JOIN %(customers)s AS c ON o.custkey = c.custkey GROUP BY c.segment'),
+    ('topK',
+     'SELECT orderkey, price FROM %(orders)s ORDER BY price DESC LIMIT 10'),
+    ('functionCall',
+     'SELECT bench_revenue({price, discount}) AS * FROM %(orders)s'),
+    ('tokenize',
+     'SELECT tokenize(comment, {splitChars: \' \'}) AS * FROM %(orders)s '
+     'LIMIT 10000'),
+]
+
+
+def run_query(ids, dataset_type, name, query):
+    sql = query % {'orders': ids[('orders', dataset_type)],
+                   'customers': ids[('customers', dataset_type)]}
+    latencies = []
+    for i in range(repeat):
+        latencies.append(timed(lambda: mldb.get('/v1/query', q=sql,
+                                                format='table')))
+    latencies.sort()
+    median = latencies[len(latencies) / 2]
+    return {
+        'name': name,
+        'datasetType': dataset_type,
+        'query': sql,
+        'runs': len(latencies),
+        'minSeconds': latencies[0],
+        'medianSeconds': median,
+        'maxSeconds': latencies[-1],
+        'queriesPerSecond': 1.0 / median,
+        'rowsPerSecond': num_orders / median
+    }
+
+
+def run_function_calls():
+    """Latency of calling a function through the REST API, which doesn't
+    depend on the dataset type."""
+    num_calls = 1000
+    seconds = timed(lambda: [
+        mldb.get('/v1/functions/bench_revenue/application',
+                 input={'price': i, 'discount': 0.05})
+        for i in range(num_calls)])
+    return {
+        'name': 'functionApplication',
+        'runs': num_calls,
+        'medianSeconds': seconds / num_calls,
+        'queriesPerSecond': num_calls / seconds
+    }
+
+
+def run_export(ids, dataset_type, tmp_dir):
+    path = os.path.join(tmp_dir, 'export_%s.csv' % dataset_type)
+    seconds = timed(lambda: mldb.post('/v1/procedures', {
+        'type': 'export.csv',
+        'params': {
+            'exportData': 'SELECT * FROM ' + ids[('orders', dataset_type)],
+            'dataFileUrl': 'file://' + path,
+            'runOnCreation': True
+        }
+    }))
+    os.remove(path)
+    return {'name': 'export', 'datasetType': dataset_type,
+            'seconds': seconds, 'rowsPerSecond': num_orders / seconds}
+
+
+def main():
+    tmp_parent = 'build/x86_64/tmp'
+    tmp_dir = tempfile.mkdtemp(
+        dir=tmp_parent if os.path.isdir(tmp_parent) else None)
+    try:
+        report = {
+            'cpus': os.environ.get('NUM_CPUS', 'all'),
+            'scale': scale,
+            'orders': num_orders,
+            'customers': num_customers,
+            'repeat': repeat,
+            'steps': [],
+            'queries': [],
+            'peakRssKb': {}
+        }
+
+        before = time.time()
+        orders_csv, customers_csv = generate(tmp_dir)
+        report['steps'].append({'name': 'generate',
+                                'seconds': time.time() - before})
+
+        reset_peak_rss()
+        ids = load(report['steps'], orders_csv, customers_csv)
+        report['peakRssKb']['load'] = memory_kb('VmHWM')
+
+        mldb.put('/v1/functions/bench_revenue', {
+            'type': 'sql.expression',
+            'params': {
+                'expression': 'price * (1 - discount) AS revenue'
+            }
+        })
+
+        report['queries'].append(run_function_calls())
+
+        for dataset_type in dataset_types:
+            reset_peak_rss()
+            for name, query in QUERIES:
+                result = run_query(ids, dataset_type, name, query)
+                mldb.log('%s %s: %f s median' % (dataset_type, name,
+                                                 result['medianSeconds']))
+                report['queries'].append(result)
+            report['steps'].append(run_export(ids, dataset_type, tmp_dir))
+            report['peakRssKb'][dataset_type] = memory_kb('VmHWM')
+
+        report['rssKb'] = memory_kb('VmRSS')
+    finally:
+        shutil.rmtree(tmp_dir, ignore_errors=True)
+
+    mldb.log(report)
+    if 'output' in args:
+        with open(args['output'], 'w') as f:
+            json.dump(report, f, indent=4, sort_keys=True)
+
+main()
+mldb.script.set_return('success')
@@ -0,0 +1,105 @@
+#
+# materialized_dataset_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the materialized dataset and of its incremental refresh.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class MaterializedDatasetTest(MldbUnitTest):  # noqa
+
+    def make_source(self, name, start, end):
+        ds = mldb.create_dataset({'id': name, 'type': 'sparse.mutable'})
+        self.add_rows(ds, start, end)
+        return ds
+
+    def add_rows(self, ds, start, end):
+        for i in range(start, end):
+            ds.record_row('r%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def make_view(self, name, query, autoRefresh=True):
+        mldb.put('/v1/datasets/' + name, {
+            'type': 'materialized',
+            'params': {
+                'query': query,
+                'autoRefresh': autoRefresh
+            }
+        })
+
+    def status(self, name):
+        return mldb.get('/v1/datasets/' + name).json()['status']
+
+    def test_query(self):
+        self.make_source('src1', 0, 10)
+        self.make_view('view1', 'SELECT x, x * 2 AS y FROM src1 WHERE x % 2 = 0')
+
+        res = mldb.query('SELECT x, y FROM view1 ORDER BY x')
+        self.assertEqual(res, [['_rowName', 'x', 'y'],
+                               ['r0', 0, 0],
+                               ['r2', 2, 4],
+                               ['r4', 4, 8],
+                               ['r6', 6, 12],
+                               ['r8', 8, 16]])
+
+        res = mldb.query('SELECT count(*) FROM view1 WHERE y > 5')
+        self.assertEqual(res[1][1], 3)
+
+    def test_incremental_refresh(self):
+        ds = self.make_source('src2', 0, 10)
+        self.make_view('view2', 'SELECT x FROM src2 WHERE x >= 5')
+        self.assertEqual(self.status('view2')['rowsEvaluated'], 10)
+
+        self.add_rows(ds, 10, 15)
+        res = mldb.query('SELECT count(*) FROM view2')
+        self.assertEqual(res[1][1], 10)
+
+        # Only the new rows were evaluated
+        status = self.status('view2')
+        self.assertEqual(status['rowsEvaluated'], 15)
+        self.assertEqual(status['rowsEvaluatedLastRefresh'], 5)
+        self.assertEqual(status['parts'], 2)
+
+        # Nothing new, so no new part
+        res = mldb.query('SELECT count(*) FROM view2')
+        self.assertEqual(res[1][1], 10)
+        self.assertEqual(self.status('view2')['parts'], 2)
+
+    def test_manual_refresh(self):
+        ds = self.make_source('src3', 0, 4)
+        self.make_view('view3', 'SELECT x FROM src3', autoRefresh=False)
+        self.add_rows(ds, 4, 6)
+
+        res = mldb.query('SELECT count(*) FROM view3')
+        self.assertEqual(res[1][1], 4)
+
+        status = mldb.post('/v1/datasets/view3/routes/refresh').json()
+        self.assertEqual(status['rowCount'], 6)
+        self.assertEqual(status['rowsEvaluatedLastRefresh'], 2)
+
+        # Committing the view also refreshes it
+        self.add_rows(ds, 6, 7)
+        mldb.post('/v1/datasets/view3/commit')
+        res = mldb.query('SELECT count(*) FROM view3')
+        self.assertEqual(res[1][1], 7)
+
+    def test_when(self):
+        ds = mldb.create_dataset({'id': 'src4', 'type': 'sparse.mutable'})
+        ds.record_row('a', [['x', 1, '2017-01-01'], ['y', 2, '2017-06-01']])
+        ds.commit()
+        self.make_view('view4', "SELECT * FROM src4 "
+                       "WHEN value_timestamp() < TIMESTAMP '2017-03-01'")
+        res = mldb.query('SELECT * FROM view4')
+        self.assertEqual(res, [['_rowName', 'x'], ['a', 1]])
+
+    def test_not_row_by_row(self):
+        self.make_source('src5', 0, 4)
+        for query in ['SELECT count(*) FROM src5 GROUP BY x',
+                      'SELECT x FROM src5 ORDER BY x',
+                      'SELECT x FROM src5 LIMIT 2']:
+            with self.assertRaises(mldb_wrapper.ResponseException):
+                self.make_view('view5', query)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,64 @@
+#
+# merged_dataset_stream_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the rows of a merged dataset are streamed correctly when the
+# stream is split up into many pieces.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class MergedDatasetStreamTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # The rows overlap between the datasets, so that some rows of the
+        # merged dataset come from several of them
+        for d in range(3):
+            ds = mldb.create_dataset({'id': 'ds%d' % d,
+                                      'type': 'sparse.mutable'})
+            for r in range(d * 1000, d * 1000 + 3000):
+                ds.record_row('r%d' % r, [['c%d' % d, r, 0]])
+            ds.commit()
+
+        mldb.put('/v1/datasets/merged', {
+            'type': 'merged',
+            'params': {'datasets': [{'id': 'ds0'}, {'id': 'ds1'},
+                                    {'id': 'ds2'}]}
+        })
+
+    def test_all_rows(self):
+        # Each row is seen exactly once, with the columns of all of the
+        # datasets it comes from
+        res = mldb.query("""
+            select count(*) as cnt, sum(c0) as s0, sum(c1) as s1,
+                   sum(c2) as s2
+            from merged
+        """)
+        self.assertEqual(res[1][1:], [5000,
+                                      sum(range(0, 3000)),
+                                      sum(range(1000, 4000)),
+                                      sum(range(2000, 5000))])
+
+    def test_row_lookup(self):
+        res = mldb.query("select * from merged where rowName() = 'r2500'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'c0', 'c1', 'c2'],
+            ['r2500', 2500, 2500, 2500]
+        ])
+
+    def test_offset_limit(self):
+        names = [r[0] for r in mldb.query(
+            "select c0 from merged order by rowName()")[1:]]
+        self.assertEqual(len(names), 5000)
+        res = mldb.query(
+            "select c0 from merged order by rowName() offset 4000 limit 10")
+        self.assertEqual([r[0] for r in res[1:]], names[4000:4010])
+
+    def test_row_paths(self):
+        rows = mldb.get('/v1/datasets/merged/rows',
+                        start=100, limit=50).json()
+        self.assertEqual(len(rows), 50)
+
+if __name__ == '__main__':
+    mldb.run_tests()
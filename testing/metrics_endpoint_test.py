@@ -0,0 +1,49 @@
+#
+# metrics_endpoint_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the Prometheus /metrics route.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class MetricsEndpointTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in xrange(20):
+            ds.record_row('r%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def metrics(self):
+        result = {}
+        for line in mldb.get('/metrics').text.splitlines():
+            if line.startswith('#'):
+                continue
+            name, value = line.rsplit(' ', 1)
+            result[name] = float(value)
+        return result
+
+    def test_format(self):
+        text = mldb.get('/metrics').text
+        self.assertIn('# TYPE mldb_thread_pool_threads gauge', text)
+        self.assertIn('mldb_thread_pool_threads{pool="default"}', text)
+
+    def test_query_metrics(self):
+        mldb.get('/v1/query', q='SELECT x FROM ds')
+        before = self.metrics()
+        mldb.get('/v1/query', q='SELECT x FROM ds WHERE x < 10')
+        after = self.metrics()
+
+        count = 'mldb_query_duration_seconds_count'
+        self.assertEqual(after[count], before[count] + 1)
+        self.assertEqual(
+            after['mldb_query_duration_seconds_bucket{le="+Inf"}'],
+            after[count])
+
+        rows = 'mldb_query_rows_scanned_total'
+        self.assertEqual(after[rows], before[rows] + 10)
+
+if __name__ == '__main__':
+    mldb.run_tests()
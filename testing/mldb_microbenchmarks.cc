@@ -0,0 +1,579 @@
+/** mldb_microbenchmarks.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Microbenchmarks of the core data types and of the SQL engine, to track
+    performance from release to release.
+
+    Each test case is a group of benchmarks, which can be selected with
+    --run_test.  The timings are printed as a JSON object at the end, or
+    written to the file named by the MLDB_BENCHMARK_OUTPUT environment
+    variable.
+*/
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/plugins/frozen_column.h"
+#include "mldb/plugins/tabular_dataset_column.h"
+#include "mldb/base/parallel.h"
+#include "mldb/utils/testing/benchmarks.h"
+#include "mldb/vfs/filter_streams.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+Benchmarks benchmarks;
+
+/** Sink for the results of the benchmarked operations, so that the
+    compiler can't optimize them away.
+*/
+std::atomic<uint64_t> sink(0);
+
+void consume(uint64_t value)
+{
+    sink.fetch_add(value, std::memory_order_relaxed);
+}
+
+/** Run fn, which does numOps operations, once to warm up and then timed
+    under the given name.
+*/
+template<typename Fn>
+void bench(const std::string & name, uint64_t numOps, Fn && fn)
+{
+    fn();
+    Benchmark b(benchmarks, name, numOps);
+    fn();
+}
+
+struct DumpResults {
+    ~DumpResults()
+    {
+        const char * output = getenv("MLDB_BENCHMARK_OUTPUT");
+        if (output && *output) {
+            filter_ostream stream(output);
+            benchmarks.dumpJson(stream);
+        }
+        else benchmarks.dumpJson(cout);
+        cerr << "sink = " << sink.load() << endl;
+    }
+};
+
+BOOST_GLOBAL_FIXTURE(DumpResults);
+
+std::vector<std::string> makeStrings(size_t n, size_t length)
+{
+    std::mt19937 rng(1);
+    std::vector<std::string> result;
+    for (size_t i = 0;  i < n;  ++i) {
+        std::string s;
+        for (size_t j = 0;  j < length;  ++j)
+            s += 'a' + rng() % 26;
+        result.push_back(s);
+    }
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* CORE TYPES                                                                */
+/*****************************************************************************/
+
+BOOST_AUTO_TEST_CASE( bench_cell_value )
+{
+    constexpr size_t n = 1000000;
+
+    auto shortStrings = makeStrings(n, 6);
+    auto longStrings = makeStrings(n, 40);
+
+    bench("CellValue.construct.integer", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(CellValue(int64_t(i)).toInt());
+          });
+
+    bench("CellValue.construct.double", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(CellValue(i * 0.5).toDouble());
+          });
+
+    bench("CellValue.construct.shortString", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(CellValue(shortStrings[i]).toStringLength());
+          });
+
+    bench("CellValue.construct.longString", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(CellValue(longStrings[i]).toStringLength());
+          });
+
+    // A mix of all of the types, as found in a real column
+    std::vector<CellValue> mixed;
+    std::mt19937 rng(1);
+    for (size_t i = 0;  i < n;  ++i) {
+        switch (i % 4) {
+        case 0: mixed.emplace_back(int64_t(rng() % 1000));  break;
+        case 1: mixed.emplace_back((rng() % 1000) * 0.25);  break;
+        case 2: mixed.emplace_back(shortStrings[i]);  break;
+        case 3: mixed.emplace_back(longStrings[i]);  break;
+        }
+    }
+
+    bench("CellValue.hash", n, [&] ()
+          {
+              for (auto & v: mixed)
+                  consume(v.hash().hash());
+          });
+
+    bench("CellValue.compare", n - 1, [&] ()
+          {
+              for (size_t i = 1;  i < n;  ++i)
+                  consume(mixed[i - 1] < mixed[i]);
+          });
+
+    std::vector<CellValue> sorted;
+    bench("CellValue.sort", n, [&] ()
+          {
+              sorted = mixed;
+              std::sort(sorted.begin(), sorted.end());
+          });
+}
+
+BOOST_AUTO_TEST_CASE( bench_path_element )
+{
+    constexpr size_t n = 1000000;
+
+    auto shortStrings = makeStrings(n, 6);
+    auto longStrings = makeStrings(n, 40);
+
+    bench("PathElement.construct.short", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(PathElement(shortStrings[i]).dataLength());
+          });
+
+    bench("PathElement.construct.long", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(PathElement(longStrings[i]).dataLength());
+          });
+
+    bench("PathElement.construct.integer", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i)
+                  consume(PathElement(i).dataLength());
+          });
+
+    std::vector<PathElement> elements;
+    for (size_t i = 0;  i < n;  ++i)
+        elements.emplace_back(i % 2 ? shortStrings[i] : longStrings[i]);
+
+    bench("PathElement.hash", n, [&] ()
+          {
+              for (auto & e: elements)
+                  consume(e.hash());
+          });
+
+    bench("PathElement.compare", n - 1, [&] ()
+          {
+              for (size_t i = 1;  i < n;  ++i)
+                  consume(elements[i - 1] < elements[i]);
+          });
+
+    std::vector<Path> paths;
+    for (size_t i = 0;  i < n;  ++i)
+        paths.emplace_back(Path(elements[i]) + PathElement(i % 16));
+
+    bench("Path.hash", n, [&] ()
+          {
+              for (auto & p: paths)
+                  consume(p.hash());
+          });
+
+    bench("Path.compare", n - 1, [&] ()
+          {
+              for (size_t i = 1;  i < n;  ++i)
+                  consume(paths[i - 1] < paths[i]);
+          });
+
+    std::vector<Utf8String> printed;
+    for (auto & p: paths)
+        printed.push_back(p.toUtf8String());
+
+    bench("Path.parse", n, [&] ()
+          {
+              for (auto & s: printed)
+                  consume(Path::parse(s).size());
+          });
+}
+
+BOOST_AUTO_TEST_CASE( bench_expression_value_flatten )
+{
+    constexpr size_t n = 100000;
+    Date ts = Date::fromSecondsSinceEpoch(1);
+
+    // Rows of 20 columns, half of them in a nested object
+    StructValue inner;
+    for (int i = 0;  i < 10;  ++i)
+        inner.emplace_back(PathElement("inner" + to_string(i)),
+                           ExpressionValue(i * 1.5, ts));
+    StructValue outer;
+    for (int i = 0;  i < 10;  ++i)
+        outer.emplace_back(PathElement("outer" + to_string(i)),
+                           ExpressionValue("value" + to_string(i), ts));
+    outer.emplace_back(PathElement("nested"),
+                       ExpressionValue(std::move(inner)));
+    ExpressionValue row(std::move(outer));
+
+    bench("ExpressionValue.forEachAtom", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i) {
+                  row.forEachAtom([&] (const Path & columnName,
+                                       const Path & prefix,
+                                       const CellValue & val,
+                                       Date ts)
+                                  {
+                                      consume(val.isString());
+                                      return true;
+                                  });
+              }
+          });
+
+    bench("ExpressionValue.appendToRow", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i) {
+                  RowValue flattened;
+                  row.appendToRow(Path(), flattened);
+                  consume(flattened.size());
+              }
+          });
+
+    bench("ExpressionValue.appendToRowDestructive", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i) {
+                  ExpressionValue copy = row;
+                  RowValue flattened;
+                  Path columnName;
+                  copy.appendToRowDestructive(columnName, flattened);
+                  consume(flattened.size());
+              }
+          });
+
+    std::vector<double> embedding(100);
+    for (size_t i = 0;  i < embedding.size();  ++i)
+        embedding[i] = i;
+    ExpressionValue embeddingValue(embedding, ts);
+
+    bench("ExpressionValue.embedding.appendToRow", n, [&] ()
+          {
+              for (size_t i = 0;  i < n;  ++i) {
+                  RowValue flattened;
+                  embeddingValue.appendToRow(Path(), flattened);
+                  consume(flattened.size());
+              }
+          });
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMNS                                                            */
+/*****************************************************************************/
+
+BOOST_AUTO_TEST_CASE( bench_frozen_column_formats )
+{
+    constexpr size_t n = 1000000;
+    std::mt19937 rng(1);
+
+    // Columns that between them are storable by each of the formats
+    std::map<std::string, std::vector<CellValue> > columns;
+    auto & integers = columns["integers"];
+    auto & sortedIntegers = columns["sortedIntegers"];
+    auto & runs = columns["runs"];
+    auto & doubles = columns["doubles"];
+    auto & strings = columns["strings"];
+    auto & sparse = columns["sparse"];
+    auto & timestamps = columns["timestamps"];
+
+    auto words = makeStrings(1000, 8);
+    for (size_t i = 0;  i < n;  ++i) {
+        integers.emplace_back(int64_t(rng() % 100000));
+        sortedIntegers.emplace_back(int64_t(i * 3 + rng() % 3));
+        runs.emplace_back(int64_t(i / 1000));
+        doubles.emplace_back(rng() / 1000.0);
+        strings.emplace_back(words[rng() % words.size()]);
+        sparse.emplace_back(i % 10 == 0
+                            ? CellValue(words[rng() % words.size()])
+                            : CellValue());
+        timestamps.emplace_back(Date::fromSecondsSinceEpoch(i * 60));
+    }
+
+    ColumnFreezeParameters params;
+
+    for (auto & name: FrozenColumnFormat::formatNames()) {
+        auto format = FrozenColumnFormat::find(name);
+
+        for (auto & c: columns) {
+            TabularDatasetColumn column;
+            for (size_t i = 0;  i < c.second.size();  ++i) {
+                if (!c.second[i].empty())
+                    column.add(i, c.second[i]);
+            }
+
+            std::shared_ptr<void> cachedInfo;
+            if (!format->isFeasible(column, params, cachedInfo))
+                continue;
+            if (format->columnSize(column, params,
+                                   FrozenColumnFormat::NOT_BEST, cachedInfo)
+                < 0)
+                continue;
+
+            std::string tag = "FrozenColumn." + name + "." + c.first;
+
+            // Freezing may move from the column, so each freeze is of a copy
+            // made outside of the timed section
+            std::shared_ptr<FrozenColumn> frozen;
+            TabularDatasetColumn warmup = column;
+            frozen.reset(format->freeze(warmup, params, cachedInfo));
+            {
+                Benchmark b(benchmarks, tag + ".encode", n);
+                frozen.reset(format->freeze(column, params, cachedInfo));
+            }
+
+            cerr << tag << ": " << frozen->memusage() << " bytes" << endl;
+
+            bench(tag + ".decode.forEach", n, [&] ()
+                  {
+                      frozen->forEach([&] (size_t rowNum,
+                                           const CellValue & val)
+                                      {
+                                          consume(val.empty());
+                                          return true;
+                                      });
+                  });
+
+            size_t size = frozen->size();
+            std::vector<uint32_t> order(size);
+            for (size_t i = 0;  i < size;  ++i)
+                order[i] = rng() % size;
+
+            bench(tag + ".decode.get", size, [&] ()
+                  {
+                      for (auto i: order)
+                          consume(frozen->get(i).empty());
+                  });
+        }
+    }
+}
+
+
+/*****************************************************************************/
+/* PARALLELISM                                                               */
+/*****************************************************************************/
+
+BOOST_AUTO_TEST_CASE( bench_parallel_map )
+{
+    // With nearly empty jobs, this measures the overhead of parallelMap
+    // itself per job and per call
+    for (size_t n: { 1, 16, 1024, 65536 }) {
+        size_t numCalls = 1000000 / n + 10;
+        bench("parallelMap.overhead." + to_string(n) + "Jobs", numCalls * n,
+              [&] ()
+              {
+                  for (size_t c = 0;  c < numCalls;  ++c) {
+                      parallelMap(0, n, [&] (size_t i)
+                                  {
+                                      consume(i);
+                                  });
+                  }
+              });
+    }
+
+    bench("parallelMapChunked.overhead.65536Jobs", 65536 * 100, [&] ()
+          {
+              for (size_t c = 0;  c < 100;  ++c) {
+                  parallelMapChunked(0, 65536, 256, [&] (size_t b, size_t e)
+                                     {
+                                         consume(e - b);
+                                     });
+              }
+          });
+}
+
+
+/*****************************************************************************/
+/* SQL ENGINE                                                                */
+/*****************************************************************************/
+
+namespace {
+
+/** Server with synthetic tabular datasets to query:
+    - bench_facts has numRows rows with an integer primary key "id", a
+      grouping key "k" with 100 values, a double "x" and a string "s";
+    - bench_dims has numRows / 10 rows keyed by "id".
+*/
+struct SyntheticDatasets {
+    static constexpr size_t numRows = 200000;
+
+    SyntheticDatasets()
+    {
+        server.init();
+        server.bindTcp(PortRange(17000,18000), "127.0.0.1");
+        server.start();
+
+        auto words = makeStrings(1000, 8);
+        std::mt19937 rng(1);
+        Date ts = Date::fromSecondsSinceEpoch(1);
+
+        auto create = [&] (const std::string & id, size_t n, bool facts)
+            {
+                PolyConfig config;
+                config.id = id;
+                config.type = "tabular";
+                auto dataset = createDataset(&server, config);
+
+                std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+                for (size_t i = 0;  i < n;  ++i) {
+                    std::vector<std::tuple<ColumnPath, CellValue, Date> > row;
+                    row.emplace_back(PathElement("id"), int64_t(i), ts);
+                    if (facts) {
+                        row.emplace_back(PathElement("k"), int64_t(rng() % 100),
+                                         ts);
+                        row.emplace_back(PathElement("x"), rng() / 1000.0, ts);
+                    }
+                    row.emplace_back(PathElement("s"),
+                                     words[rng() % words.size()], ts);
+                    rows.emplace_back(RowPath(i), std::move(row));
+                    if (rows.size() == 10000) {
+                        dataset->recordRows(rows);
+                        rows.clear();
+                    }
+                }
+                dataset->recordRows(rows);
+                dataset->commit();
+                return dataset;
+            };
+
+        facts = create("bench_facts", numRows, true);
+        dims = create("bench_dims", numRows / 10, false);
+    }
+
+    /** Benchmark a query, whose number of operations is the number of rows
+        that it reads.
+    */
+    void query(const std::string & name, const Utf8String & query,
+               uint64_t rowsRead = numRows)
+    {
+        bench("query." + name, rowsRead, [&] ()
+              {
+                  consume(server.query(query).size());
+              });
+    }
+
+    MldbServer server;
+    std::shared_ptr<Dataset> facts;
+    std::shared_ptr<Dataset> dims;
+};
+
+SyntheticDatasets & synthetic()
+{
+    static SyntheticDatasets result;
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( bench_expression_evaluation )
+{
+    constexpr size_t n = 1000000;
+    auto & datasets = synthetic();
+
+    SqlExpressionDatasetScope scope(datasets.facts, "");
+
+    Date ts = Date::fromSecondsSinceEpoch(1);
+    StructValue columns;
+    columns.emplace_back(PathElement("k"), ExpressionValue(42, ts));
+    columns.emplace_back(PathElement("x"), ExpressionValue(1234.5, ts));
+    columns.emplace_back(PathElement("s"), ExpressionValue("hello", ts));
+    ExpressionValue row(std::move(columns));
+    RowPath rowName("row");
+
+    auto rowScope = scope.getRowScope(rowName, row);
+
+    std::vector<std::pair<std::string, std::string> > expressions = {
+        { "constant", "1 + 2 * 3" },
+        { "arithmetic", "x * 2 + k / 3 - 1" },
+        { "comparison", "x > 1000 AND k = 42" },
+        { "string", "s + '_' + s" },
+        { "like", "s LIKE 'h%o'" },
+        { "function", "sqrt(abs(x)) + ln(k + 1)" },
+        { "case", "CASE WHEN k < 10 THEN 'low' WHEN k < 50 THEN 'mid' "
+          "ELSE 'high' END" },
+        { "object", "{k, x, s AS label}" }
+    };
+
+    for (auto & e: expressions) {
+        auto bound = SqlExpression::parse(e.second)->bind(scope);
+        bench("expression." + e.first, n, [&] ()
+              {
+                  ExpressionValue storage;
+                  for (size_t i = 0;  i < n;  ++i) {
+                      const ExpressionValue & result
+                          = bound(rowScope, storage, GET_LATEST);
+                      consume(result.empty());
+                  }
+              });
+    }
+}
+
+BOOST_AUTO_TEST_CASE( bench_queries )
+{
+    auto & datasets = synthetic();
+    constexpr size_t numRows = SyntheticDatasets::numRows;
+
+    datasets.query("scan",
+                   "SELECT x FROM bench_facts");
+    datasets.query("where",
+                   "SELECT x FROM bench_facts WHERE k = 10");
+    datasets.query("orderBy",
+                   "SELECT x FROM bench_facts ORDER BY x LIMIT 100");
+    datasets.query("orderBy.string",
+                   "SELECT s FROM bench_facts ORDER BY s, rowName() LIMIT 100");
+    datasets.query("groupBy",
+                   "SELECT k, count(*), avg(x) FROM bench_facts GROUP BY k");
+    datasets.query("groupBy.string",
+                   "SELECT s, max(x) FROM bench_facts GROUP BY s");
+    datasets.query("groupBy.aggregate",
+                   "SELECT count(*), sum(x), min(s) FROM bench_facts");
+    datasets.query("join.hash",
+                   "SELECT count(*) FROM bench_facts AS f "
+                   "JOIN bench_dims AS d ON f.id = d.id",
+                   numRows + numRows / 10);
+    datasets.query("join.hashWithCondition",
+                   "SELECT count(*) FROM bench_facts AS f "
+                   "JOIN bench_dims AS d ON f.id = d.id AND f.x > d.id",
+                   numRows + numRows / 10);
+    datasets.query("join.left",
+                   "SELECT count(*) FROM bench_facts AS f "
+                   "LEFT JOIN bench_dims AS d ON f.id = d.id",
+                   numRows + numRows / 10);
+}
@@ -0,0 +1,228 @@
+/* msgpack_rows_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the decoding of MessagePack rows to record.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/server/msgpack_rows.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/pair_description.h"
+#include "mldb/types/tuple_description.h"
+#include <cstring>
+#include <limits>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/* Just enough of a MessagePack encoder to write the tests. */
+struct Encoder {
+    std::string out;
+
+    void bigEndian(uint64_t val, int n)
+    {
+        for (int i = n - 1;  i >= 0;  --i)
+            out += (char)(val >> (i * 8));
+    }
+
+    Encoder & array(uint32_t n)
+    {
+        if (n < 16)
+            out += (char)(0x90 | n);
+        else {
+            out += (char)0xdd;
+            bigEndian(n, 4);
+        }
+        return *this;
+    }
+
+    Encoder & map(uint32_t n)
+    {
+        out += (char)(0x80 | n);
+        return *this;
+    }
+
+    Encoder & str(const std::string & s)
+    {
+        if (s.size() < 32)
+            out += (char)(0xa0 | s.size());
+        else {
+            out += (char)0xdb;
+            bigEndian(s.size(), 4);
+        }
+        out += s;
+        return *this;
+    }
+
+    Encoder & bin(const std::string & s)
+    {
+        out += (char)0xc4;
+        bigEndian(s.size(), 1);
+        out += s;
+        return *this;
+    }
+
+    Encoder & nil()
+    {
+        out += (char)0xc0;
+        return *this;
+    }
+
+    Encoder & boolean(bool b)
+    {
+        out += (char)(b ? 0xc3 : 0xc2);
+        return *this;
+    }
+
+    Encoder & integer(int64_t i)
+    {
+        if (i >= 0 && i < 128)
+            out += (char)i;
+        else if (i < 0 && i >= -32)
+            out += (char)i;
+        else {
+            out += (char)0xd3;
+            bigEndian(i, 8);
+        }
+        return *this;
+    }
+
+    Encoder & uinteger(uint64_t i)
+    {
+        out += (char)0xcf;
+        bigEndian(i, 8);
+        return *this;
+    }
+
+    Encoder & float32(float f)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &f, 4);
+        out += (char)0xca;
+        bigEndian(bits, 4);
+        return *this;
+    }
+
+    Encoder & float64(double d)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &d, 8);
+        out += (char)0xcb;
+        bigEndian(bits, 8);
+        return *this;
+    }
+
+    Encoder & timestamp(uint32_t nanoseconds, uint64_t seconds)
+    {
+        out += (char)0xd7;
+        out += (char)-1;
+        bigEndian(((uint64_t)nanoseconds << 34) | seconds, 8);
+        return *this;
+    }
+};
+
+std::string decodeError(const std::string & doc)
+{
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        decodeMsgPackRows(doc.data(), doc.size());
+    } catch (const std::exception & exc) {
+        return exc.what();
+    }
+    return "";
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_decode_rows )
+{
+    Encoder e;
+    e.array(2);
+
+    e.array(2).str("row1").array(4);
+    e.array(3).str("x").integer(-3).float64(1500000000.5);
+    e.array(3).str("y").float32(2.5).timestamp(500000000, 1500000000);
+    e.array(3).str("z").str("hello").str("2017-07-14T02:40:00Z");
+    e.array(3).array(2).str("a.b").integer(1).boolean(true).integer(10);
+
+    e.array(2).array(2).str("row").integer(2).array(5);
+    e.array(3).str("n").nil().integer(0);
+    e.array(3).str("b").bin(std::string("\0\1", 2)).integer(0);
+    e.array(3).str("u").uinteger(std::numeric_limits<uint64_t>::max()).integer(0);
+    e.array(3).str("t").timestamp(0, 86400).integer(0);
+    e.array(3).str("i").map(1).str("interval").str("3D").integer(0);
+
+    auto rows = decodeMsgPackRows(e.out.data(), e.out.size());
+
+    BOOST_REQUIRE_EQUAL(rows.size(), 2);
+
+    BOOST_CHECK_EQUAL(rows[0].first, RowPath("row1"));
+    BOOST_REQUIRE_EQUAL(rows[0].second.size(), 4);
+    BOOST_CHECK_EQUAL(std::get<0>(rows[0].second[0]), ColumnPath("x"));
+    BOOST_CHECK_EQUAL(std::get<1>(rows[0].second[0]), -3);
+    BOOST_CHECK_EQUAL(std::get<2>(rows[0].second[0]),
+                      Date::fromSecondsSinceEpoch(1500000000.5));
+    BOOST_CHECK_EQUAL(std::get<1>(rows[0].second[1]), 2.5);
+    BOOST_CHECK_EQUAL(std::get<2>(rows[0].second[1]),
+                      Date::fromSecondsSinceEpoch(1500000000.5));
+    BOOST_CHECK_EQUAL(std::get<1>(rows[0].second[2]), "hello");
+    BOOST_CHECK_EQUAL(std::get<2>(rows[0].second[2]),
+                      Date::parseIso8601DateTime("2017-07-14T02:40:00Z"));
+    BOOST_CHECK_EQUAL(std::get<0>(rows[0].second[3]),
+                      Path({ PathElement("a.b"), PathElement(1) }));
+    BOOST_CHECK_EQUAL(std::get<1>(rows[0].second[3]), 1);
+
+    BOOST_CHECK_EQUAL(rows[1].first, Path({ PathElement("row"), PathElement(2) }));
+    BOOST_REQUIRE_EQUAL(rows[1].second.size(), 5);
+    BOOST_CHECK(std::get<1>(rows[1].second[0]).empty());
+    BOOST_CHECK(std::get<1>(rows[1].second[1]).isBlob());
+    BOOST_CHECK_EQUAL(std::get<1>(rows[1].second[1]).blobLength(), 2);
+    BOOST_CHECK_EQUAL(std::get<1>(rows[1].second[2]).toUInt(),
+                      std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK_EQUAL(std::get<1>(rows[1].second[3]),
+                      CellValue(Date::fromSecondsSinceEpoch(86400)));
+    BOOST_CHECK(std::get<1>(rows[1].second[4]).isTimeinterval());
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_errors )
+{
+    BOOST_CHECK_NE(decodeError(""), "");
+
+    // Not an array of rows
+    BOOST_CHECK_NE(decodeError(Encoder().str("x").out).find("offset 0"),
+                   string::npos);
+
+    // Row without its columns
+    BOOST_CHECK_NE(decodeError(Encoder().array(1).array(1).str("x").out)
+                   .find("offset 1"), string::npos);
+
+    // Truncated string
+    std::string truncated = Encoder().array(1).array(2).str("row").out;
+    truncated.resize(truncated.size() - 1);
+    BOOST_CHECK_NE(decodeError(truncated).find("unexpected end"),
+                   string::npos);
+
+    // Extra data at the end
+    BOOST_CHECK_NE(decodeError(Encoder().array(0).nil().out)
+                   .find("extra data"), string::npos);
+
+    // Unused type byte
+    BOOST_CHECK_NE(decodeError(Encoder().array(1).out + "\xc1")
+                   .find("invalid type byte"), string::npos);
+
+    // Huge array sizes don't cause huge allocations
+    BOOST_CHECK_NE(decodeError(Encoder().array(0xffffffff).out), "");
+
+    // Invalid UTF-8 in a string value
+    Encoder e;
+    e.array(1).array(2).str("row").array(1)
+        .array(3).str("x").str("\xff\xfe").integer(0);
+    BOOST_CHECK_NE(decodeError(e.out), "");
+}
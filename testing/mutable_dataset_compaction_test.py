@@ -0,0 +1,81 @@
+#
+# mutable_dataset_compaction_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Background compaction of the recent writes to sparse.mutable datasets.
+#
+
+import time
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class MutableDatasetCompactionTest(MldbUnitTest):  # noqa
+
+    def wait_for_compaction(self, ds_id):
+        for _ in range(100):
+            status = mldb.get('/v1/datasets/' + ds_id).json()['status']
+            if status['compaction']['numCompactions'] > 0:
+                return status['compaction']
+            time.sleep(0.1)
+        self.fail('no background compaction happened')
+
+    def record_rows(self, ds):
+        for i in range(200):
+            ds.record_row('row' + str(i), [['x', i, 1], ['y', i * 2, 1]])
+
+    def test_consistent_after_write(self):
+        ds = mldb.create_dataset({
+            'id' : 'after_write',
+            'type' : 'sparse.mutable',
+            'params' : {
+                'consistencyLevel' : 'consistentAfterWrite',
+                'favor' : 'favorWrites',
+                'compaction' : { 'maxPending' : 50 }
+            }
+        })
+        self.record_rows(ds)
+
+        stats = self.wait_for_compaction('after_write')
+        self.assertEqual(stats['numErrors'], 0)
+
+        # Everything is still readable and nothing is duplicated
+        res = mldb.query("SELECT count(*), sum(x), sum(y) FROM after_write")
+        self.assertEqual(res[1][1:], [200, 19900, 39800])
+
+        ds.commit()
+        res = mldb.query("SELECT count(*), sum(x), sum(y) FROM after_write")
+        self.assertEqual(res[1][1:], [200, 19900, 39800])
+
+    def test_consistent_after_commit(self):
+        ds = mldb.create_dataset({
+            'id' : 'after_commit',
+            'type' : 'sparse.mutable',
+            'params' : {
+                'compaction' : { 'maxPending' : 50 }
+            }
+        })
+        self.record_rows(ds)
+
+        stats = self.wait_for_compaction('after_commit')
+        self.assertEqual(stats['numErrors'], 0)
+
+        ds.commit()
+        res = mldb.query("SELECT count(*), sum(x), sum(y) FROM after_commit")
+        self.assertEqual(res[1][1:], [200, 19900, 39800])
+
+    def test_disabled(self):
+        ds = mldb.create_dataset({
+            'id' : 'disabled',
+            'type' : 'sparse.mutable',
+            'params' : {
+                'compaction' : { 'enabled' : False, 'maxPending' : 1 }
+            }
+        })
+        self.record_rows(ds)
+        ds.commit()
+
+        status = mldb.get('/v1/datasets/disabled').json()['status']
+        self.assertEqual(status['compaction']['numCompactions'], 0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,58 @@
+#
+# order_by_limit_top_k_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that ORDER BY ... LIMIT, which only keeps the top rows while
+# sorting, gives the same rows as sorting everything and then slicing.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class OrderByLimitTopKTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in xrange(5000):
+            # Lots of ties in the score, to check that tie-breaking is the
+            # same as for a full sort
+            ds.record_row('row%d' % i, [['score', (i * 7919) % 1000, 0],
+                                        ['x', i, 0]])
+        ds.commit()
+
+    def check(self, query, offset, limit):
+        everything = mldb.query(query)
+        res = mldb.query(query + " offset %d limit %d" % (offset, limit))
+        self.assertEqual(res, everything[:1] +
+                         everything[1 + offset:1 + offset + limit])
+
+    def test_query(self):
+        for offset, limit in [(0, 1), (0, 10), (5, 100), (4990, 20),
+                              (0, 10000)]:
+            self.check("select score, x from ds order by score desc",
+                       offset, limit)
+            self.check("select score, x from ds order by score, x desc",
+                       offset, limit)
+
+    def test_transform_with_limit(self):
+        mldb.post('/v1/procedures', {
+            'type': 'transform',
+            'params': {
+                'inputData': 'select score, x from ds order by score desc, '
+                             'x limit 10',
+                'outputDataset': 'top10',
+                'runOnCreation': True
+            }
+        })
+        res = mldb.query("select score, x from top10 order by score desc, x")
+        everything = mldb.query("select score, x from ds "
+                                "order by score desc, x")
+        self.assertEqual([r[1:] for r in res[1:]],
+                         [r[1:] for r in everything[1:11]])
+
+    def test_grouped(self):
+        self.check("select score, count(*) as cnt from ds group by score "
+                   "order by count(*) desc, score", 3, 17)
+
+if __name__ == '__main__':
+    mldb.run_tests()
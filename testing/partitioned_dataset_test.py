@@ -0,0 +1,99 @@
+#
+# partitioned_dataset_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the partitioned dataset and of its partition pruning.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class PartitionedDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # One partition per day, keyed by the day number
+        for day in range(1, 6):
+            ds = mldb.create_dataset({'id': 'day%d' % day,
+                                      'type': 'sparse.mutable'})
+            ts = '2017-01-0%d' % day
+            for r in range(10):
+                ds.record_row('d%d_r%d' % (day, r),
+                              [['day', day, ts], ['x', r, ts]])
+            ds.commit()
+
+        # This partition declares bounds that its rows don't respect, so
+        # that a query that skips it will not see its row
+        ds = mldb.create_dataset({'id': 'liar', 'type': 'sparse.mutable'})
+        ds.record_row('liar_r0', [['day', 3, '2017-01-03'],
+                                  ['x', 100, '2017-01-03']])
+        ds.commit()
+
+        mldb.put('/v1/datasets/parts', {
+            'type': 'partitioned',
+            'params': {
+                'keyColumn': 'day',
+                'partitions': [{'dataset': {'id': 'day%d' % day}}
+                               for day in range(1, 6)] + [
+                    {'dataset': {'id': 'liar'}, 'minKey': 100, 'maxKey': 200,
+                     'earliest': '2020-01-01', 'latest': '2020-12-31'}]
+            }
+        })
+
+    def count(self, where):
+        return mldb.query("select count(*) as cnt from parts where " + where
+                          )[1][1]
+
+    def test_all_rows(self):
+        res = mldb.query("select count(*) as cnt, sum(x) as s from parts")
+        self.assertEqual(res[1][1:], [51, 5 * 45 + 100])
+
+    def test_key_pruning(self):
+        # The liar partition is skipped, so its row isn't there
+        self.assertEqual(self.count("day = 3"), 10)
+        self.assertEqual(self.count("day <= 2"), 20)
+        self.assertEqual(self.count("day BETWEEN 2 AND 4"), 30)
+        self.assertEqual(self.count("day IN (1, 5)"), 20)
+        self.assertEqual(self.count("day = 1 OR day = 5"), 20)
+        self.assertEqual(self.count("day = 3 AND x < 5"), 5)
+        self.assertEqual(self.count("day > 10"), 0)
+
+        # Not a bound, so all partitions are used
+        self.assertEqual(self.count("x = 100"), 1)
+        self.assertEqual(self.count("NOT (day != 3)"), 11)
+
+    def test_timestamp_pruning(self):
+        self.assertEqual(
+            self.count("latest_timestamp({*}) >= TIMESTAMP '2017-01-04'"), 20)
+        self.assertEqual(
+            self.count("earliest_timestamp(x) < TIMESTAMP '2017-01-02'"), 10)
+
+    def test_values(self):
+        res = mldb.query("""
+            select x from parts where day = 4 and x = 7
+        """)
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'x'],
+            ['d4_r7', 7]
+        ])
+
+    def test_add_and_drop_partition(self):
+        ds = mldb.create_dataset({'id': 'day6', 'type': 'sparse.mutable'})
+        ds.record_row('d6_r0', [['day', 6, '2017-01-06'],
+                                ['x', 1000, '2017-01-06']])
+        ds.commit()
+
+        mldb.post('/v1/datasets/parts/routes/partitions',
+                  {'partition': {'dataset': {'id': 'day6'}}})
+        self.assertEqual(self.count("day = 6"), 1)
+        self.assertEqual(self.count("true"), 52)
+
+        mldb.delete('/v1/datasets/parts/routes/partitions', dataset='day6')
+        self.assertEqual(self.count("day = 6"), 0)
+        self.assertEqual(self.count("true"), 51)
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.delete('/v1/datasets/parts/routes/partitions',
+                        dataset='unknown')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,60 @@
+#
+# pipeline_batch_execution_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that joins, which run through the batch-at-a-time execution pipeline,
+# give the same results when the number of rows spans several batches.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class PipelineBatchExecutionTest(MldbUnitTest):  # noqa
+
+    num_rows = 2500
+
+    @classmethod
+    def setUpClass(cls):
+        for name in ['left', 'right']:
+            ds = mldb.create_dataset({'id': name, 'type': 'sparse.mutable'})
+            for i in xrange(cls.num_rows):
+                ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 7, 0]])
+            ds.commit()
+
+    def test_join_spanning_batches(self):
+        res = mldb.query("""
+            select count(*) as cnt
+            from left join right on left.x = right.x
+        """)
+        self.assertTableResultEquals(res, [
+            ["_rowName", "cnt"],
+            ["[]", self.num_rows]
+        ])
+
+    def test_join_with_filter_spanning_batches(self):
+        res = mldb.query("""
+            select count(*) as cnt
+            from left join right on left.x = right.x and right.y = 3
+        """)
+        expected = len([i for i in xrange(self.num_rows) if i % 7 == 3])
+        self.assertTableResultEquals(res, [
+            ["_rowName", "cnt"],
+            ["[]", expected]
+        ])
+
+    def test_joined_dataset_spanning_batches(self):
+        mldb.put('/v1/datasets/joined', {
+            'type': 'joined',
+            'params': {
+                'left': 'left',
+                'right': 'right',
+                'on': 'left.x = right.x'
+            }
+        })
+        res = mldb.query("select count(*) as cnt from joined")
+        self.assertTableResultEquals(res, [
+            ["_rowName", "cnt"],
+            ["[]", self.num_rows]
+        ])
+
+if __name__ == '__main__':
+    mldb.run_tests()
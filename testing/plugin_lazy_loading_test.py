@@ -0,0 +1,38 @@
+#
+# plugin_lazy_loading_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that plugins whose manifest lists what they provide are only loaded
+# the first time that it's used.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class PluginLazyLoadingTest(MldbUnitTest):  # noqa
+
+    def plugins(self):
+        return mldb.get('/v1/plugins').json()
+
+    def test_loaded_on_first_use(self):
+        # Its types are listed, but it isn't loaded yet
+        self.assertNotIn('tensorflow', self.plugins())
+        types = mldb.get('/v1/types/functions').json()
+        self.assertIn('tensorflow.graph', types)
+        self.assertIn('tensorflow.op', types)
+
+        # Unknown functions don't load it
+        with self.assertMldbRaises(status_code=400):
+            mldb.query('SELECT no_such_function(1)')
+        self.assertNotIn('tensorflow', self.plugins())
+
+        # Calling one of its SQL functions does
+        res = mldb.query(
+            "SELECT tf_Cos(0, {T: { type: 'DT_DOUBLE'}}) AS res")
+        self.assertEqual(res[1][1], 1)
+        self.assertIn('tensorflow', self.plugins())
+
+        # And its types can now be used
+        mldb.get('/v1/types/functions/tensorflow.graph/info')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -48,6 +48,19 @@ class PythonConverterTest(unittest.TestCase):
         print tester.getJsonVal(val)
         self.assertEqual(tester.getJsonVal(val), val)
 
+    def test_json_val_from_buffer(self):
+        try:
+            import numpy as np
+        except ImportError:
+            return
+
+        val = np.array([[1.5, 2.5], [3.5, 4.5]], dtype=np.float32)
+        self.assertEqual(tester.getJsonVal({"a": val}),
+                         {"a": [[1.5, 2.5], [3.5, 4.5]]})
+
+        val = np.arange(6, dtype=np.int64)[::2]
+        self.assertEqual(tester.getJsonVal([val]), [[0, 2, 4]])
+
 if __name__ == '__main__':
     unittest.main()
 
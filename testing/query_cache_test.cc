@@ -0,0 +1,123 @@
+/* query_cache_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the query response and statement caches.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/server/query_cache.h"
+#include "mldb/sql/sql_expression.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+std::shared_ptr<const QueryCache::Response>
+makeResponse(const std::string & body)
+{
+    auto result = std::make_shared<QueryCache::Response>();
+    result->body = body;
+    result->contentType = "application/json";
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_hit_and_miss )
+{
+    QueryCache cache(1 << 20);
+
+    BOOST_CHECK(!cache.get("q1", 1));
+    BOOST_CHECK(cache.put("q1", 1, makeResponse("[1]")));
+
+    auto res = cache.get("q1", 1);
+    BOOST_REQUIRE(res);
+    BOOST_CHECK_EQUAL(res->body, "[1]");
+    BOOST_CHECK(!cache.get("q2", 1));
+
+    auto stats = cache.getStats();
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+    BOOST_CHECK_EQUAL(stats.misses, 2);
+    BOOST_CHECK_EQUAL(stats.insertions, 1);
+    BOOST_CHECK_EQUAL(stats.entries, 1);
+    BOOST_CHECK_GT(stats.bytes, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_generation_invalidates )
+{
+    QueryCache cache(1 << 20);
+
+    BOOST_CHECK(cache.put("q1", 1, makeResponse("[1]")));
+    BOOST_CHECK(cache.get("q1", 1));
+
+    // The data has changed; the old response mustn't be returned
+    BOOST_CHECK(!cache.get("q1", 2));
+    BOOST_CHECK_EQUAL(cache.getStats().invalidations, 1);
+    BOOST_CHECK_EQUAL(cache.getStats().entries, 0);
+
+    // A response computed from old data isn't kept
+    BOOST_CHECK(!cache.put("q1", 1, makeResponse("[1]")));
+    BOOST_CHECK(!cache.get("q1", 2));
+
+    BOOST_CHECK(cache.put("q1", 2, makeResponse("[2]")));
+    BOOST_CHECK_EQUAL(cache.get("q1", 2)->body, "[2]");
+}
+
+BOOST_AUTO_TEST_CASE( test_lru_eviction )
+{
+    QueryCache cache(16384);
+
+    std::string body(1000, 'x');
+    for (unsigned i = 0;  i < 100;  ++i) {
+        BOOST_CHECK(cache.put("q" + to_string(i), 1, makeResponse(body)));
+        // Keep the first one in use
+        BOOST_CHECK(cache.get("q0", 1));
+    }
+
+    auto stats = cache.getStats();
+    BOOST_CHECK_LE(stats.bytes, stats.maxBytes);
+    BOOST_CHECK_GT(stats.evictions, 0);
+    BOOST_CHECK_EQUAL(stats.entries + stats.evictions, 100);
+
+    BOOST_CHECK(cache.get("q0", 1));
+    BOOST_CHECK(cache.get("q99", 1));
+    BOOST_CHECK(!cache.get("q1", 1));
+}
+
+BOOST_AUTO_TEST_CASE( test_too_big )
+{
+    QueryCache cache(16384);
+    BOOST_CHECK(!cache.put("q", 1, makeResponse(std::string(8192, 'x'))));
+    BOOST_CHECK(!cache.get("q", 1));
+    BOOST_CHECK_EQUAL(cache.getStats().insertions, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_statement_cache )
+{
+    StatementCache cache(2);
+
+    auto s1 = cache.get("select x from ds where y = 1");
+    BOOST_CHECK_EQUAL(s1->print(),
+                      SelectStatement::parse("select x from ds where y = 1")
+                      .print());
+    BOOST_CHECK_EQUAL(cache.get("select x from ds where y = 1"), s1);
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    // Errors aren't cached
+    BOOST_CHECK_THROW(cache.get("select 1 +"), std::exception);
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    // The least recently used one goes first
+    auto s2 = cache.get("select 2");
+    BOOST_CHECK_EQUAL(cache.get("select x from ds where y = 1"), s1);
+    cache.get("select 3");
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK_EQUAL(cache.get("select x from ds where y = 1"), s1);
+    BOOST_CHECK_NE(cache.get("select 2"), s2);
+}
@@ -0,0 +1,69 @@
+#
+# query_explain_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the explain parameter of the query API.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class QueryExplainTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds1', 'type' : 'sparse.mutable'})
+        for i in xrange(10):
+            ds.record_row('a%d' % i, [['x', i, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id' : 'ds2', 'type' : 'sparse.mutable'})
+        for i in xrange(10):
+            ds.record_row('b%d' % i, [['x', i % 5, 0]])
+        ds.commit()
+
+    def explain(self, query):
+        return mldb.get('/v1/query', q=query, explain='true').json()
+
+    def find(self, node, element):
+        if node['element'] == element:
+            return node
+        for c in node.get('children', []):
+            found = self.find(c, element)
+            if found:
+                return found
+        return None
+
+    def test_dataset_query(self):
+        res = self.explain('SELECT x FROM ds1 WHERE x > 4')
+        self.assertEqual(res['element'], 'query')
+        self.assertEqual(res['rowsOut'], 5)
+        self.assertGreaterEqual(res['wallTime'], res['selfWallTime'])
+
+        scan = self.find(res, 'BoundSelectQuery')
+        self.assertIsNotNone(scan)
+        self.assertEqual(scan['rowsOut'], 5)
+        self.assertEqual(sum(scan['rowsOutPerThread']), 5)
+        self.assertTrue(scan['strategy'].startswith('unordered'))
+
+    def test_group_by(self):
+        res = self.explain('SELECT count(*) FROM ds2 GROUP BY x')
+        self.assertEqual(res['rowsOut'], 5)
+        group = self.find(res, 'BoundGroupByQuery')
+        self.assertIsNotNone(group)
+        self.assertEqual(group['rowsOut'], 5)
+        self.assertEqual(group['rowsIn'], 10)
+        self.assertEqual(group['children'][0]['element'], 'BoundSelectQuery')
+
+    def test_join(self):
+        res = self.explain(
+            'SELECT * FROM ds1 JOIN ds2 ON ds1.x = ds2.x')
+        self.assertEqual(res['rowsOut'], 10)
+
+        join = self.find(res, 'JoinElement')
+        self.assertIsNotNone(join)
+        self.assertIn(join['strategy'], ['hash join', 'merge join'])
+        self.assertEqual(join['rowsOut'], 10)
+        self.assertEqual(len(join['children']), 2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
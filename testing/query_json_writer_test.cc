@@ -0,0 +1,174 @@
+/* query_json_writer_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the query JSON writer gives the same output as going through
+   the value descriptions.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/server/query_json_writer.h"
+#include "mldb/types/map_description.h"
+#include "mldb/types/pair_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/dtoa.h"
+#include <cmath>
+#include <limits>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+std::vector<MatrixNamedRow> makeRows()
+{
+    Date ts = Date::fromSecondsSinceEpoch(1500000000.25);
+    double inf = std::numeric_limits<double>::infinity();
+
+    std::vector<MatrixNamedRow> result;
+
+    MatrixNamedRow row;
+    row.rowName = RowPath("row1");
+    row.rowHash = row.rowName;
+    row.columns = {
+        { ColumnPath("x"), 1, ts },
+        { ColumnPath("y"), -12345678901234LL, ts },
+        { ColumnPath("z"), std::numeric_limits<uint64_t>::max(), ts },
+        { ColumnPath("a"), 0.1, ts },
+        { ColumnPath("b"), -1e-300, Date() },
+        { ColumnPath("c"), CellValue(), Date::positiveInfinity() },
+        { ColumnPath("d"), "he said \"hi\"\\\t\x01/", ts },
+        { ColumnPath("e"), Utf8String("café"), ts },
+        { ColumnPath("f"), std::nan(""), ts },
+        { ColumnPath("g"), -inf, ts },
+        { ColumnPath("h"), ts, ts },
+        { ColumnPath("i"), CellValue::blob(std::string("\x00\x01" "abc", 5)), ts },
+        { ColumnPath("j"), CellValue(Path({"p", "q.r"})), ts },
+        { Path({"with.dot", "and\"quote"}), 2.5, ts },
+        { ColumnPath("_rowName"), "overwritten in aos", ts },
+        { ColumnPath("x"), 2, ts }  // duplicate column
+    };
+    result.push_back(row);
+
+    // Same columns in the same order
+    row.rowName = RowPath(Utf8String("röw2"));
+    row.rowHash = row.rowName;
+    for (auto & c: row.columns)
+        std::get<1>(c) = 3;
+    result.push_back(row);
+
+    // Same columns in a different order, with one missing
+    std::reverse(row.columns.begin(), row.columns.end());
+    row.columns.pop_back();
+    result.push_back(row);
+
+    // No row name, and no columns
+    result.emplace_back();
+
+    return result;
+}
+
+std::vector<std::pair<ColumnPath, CellValue> >
+toSparseRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::vector<std::pair<ColumnPath, CellValue> > rowOut;
+    if (rowNames)
+        rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
+    if (rowHashes)
+        rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
+
+    for (auto & c: row.columns)
+        rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
+
+    std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
+
+    return rowOut;
+}
+
+std::map<ColumnPath, CellValue>
+toAosRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::map<ColumnPath, CellValue> rowOut;
+    if (rowNames)
+        rowOut[ColumnPath("_rowName")] = row.rowName.toUtf8String();
+    if (rowHashes)
+        rowOut[ColumnPath("_rowHash")] = row.rowHash.toString();
+
+    for (auto & c: row.columns)
+        rowOut[std::get<0>(c)] = std::get<1>(c);
+
+    return rowOut;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_dtoa_buffer )
+{
+    for (double d: { 0.0, -0.0, 1.0, -1.0, 0.1, 1e21, 1e22, 1e-5, 1e-6, 1e-7,
+                1.0 / 3, 123456789012345678.0, 5e-324, 1.7976931348623157e308,
+                std::numeric_limits<double>::infinity() }) {
+        char buffer[DTOA_BUFFER_SIZE];
+        size_t len = dtoa(d, buffer);
+        BOOST_CHECK_EQUAL(len, strlen(buffer));
+        BOOST_CHECK_EQUAL(std::string(buffer, len), dtoa(d));
+        if (std::isfinite(d))
+            BOOST_CHECK_EQUAL(strtod(buffer, nullptr), d);
+    }
+
+    char buffer[DTOA_BUFFER_SIZE];
+    BOOST_CHECK_EQUAL(std::string(buffer, dtoa(0.1, buffer)), "0.1");
+    BOOST_CHECK_EQUAL(std::string(buffer, dtoa(100.0, buffer)), "100.0");
+    BOOST_CHECK_EQUAL(std::string(buffer, dtoa(1e-7, buffer)), "1e-7");
+    BOOST_CHECK_EQUAL(std::string(buffer, dtoa(-2.5e22, buffer)), "-2.5e22");
+}
+
+BOOST_AUTO_TEST_CASE( test_full_rows )
+{
+    std::string output;
+    QueryJsonWriter writer(output);
+
+    for (auto & row: makeRows()) {
+        output.clear();
+        writer.writeFullRow(row);
+        BOOST_CHECK_EQUAL(output, jsonEncodeStr(row));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sparse_and_aos_rows )
+{
+    std::string output;
+    QueryJsonWriter writer(output);
+
+    for (bool rowNames: { false, true }) {
+        for (bool rowHashes: { false, true }) {
+            for (auto & row: makeRows()) {
+                output.clear();
+                writer.writeSparseRow(row, rowNames, rowHashes);
+                BOOST_CHECK_EQUAL(output, jsonEncodeStr(toSparseRow(row, rowNames, rowHashes)));
+
+                output.clear();
+                writer.writeAosRow(row, rowNames, rowHashes);
+                BOOST_CHECK_EQUAL(output, jsonEncodeStr(toAosRow(row, rowNames, rowHashes)));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_appends_to_buffer )
+{
+    auto rows = makeRows();
+
+    std::string output = "[";
+    QueryJsonWriter writer(output);
+    writer.writeFullRow(rows[0]);
+    output += ',';
+    writer.writeFullRow(rows[1]);
+    output += ']';
+
+    BOOST_CHECK_EQUAL(output, "[" + jsonEncodeStr(rows[0]) + ","
+                      + jsonEncodeStr(rows[1]) + "]");
+}
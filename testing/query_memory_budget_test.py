@@ -0,0 +1,75 @@
+#
+# query_memory_budget_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the memory budget of queries and procedure runs.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class QueryMemoryBudgetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in xrange(2000):
+            ds.record_row('r%d' % i, [['x', i, 0],
+                                      ['s', 'some text %d' % i * 10, 0]])
+        ds.commit()
+
+    def test_order_by_over_budget(self):
+        query = 'SELECT x, s FROM ds ORDER BY x'
+        with self.assertMldbRaises(status_code=507,
+                                   expected_regexp='Memory budget'):
+            mldb.get('/v1/query', q=query, maxMemory=10000)
+
+        # Without a budget, or with a large enough one, it runs
+        res = mldb.get('/v1/query', q=query, format='table').json()
+        self.assertEqual(len(res), 2001)
+        res = mldb.get('/v1/query', q=query, format='table',
+                       maxMemory=100000000).json()
+        self.assertEqual(len(res), 2001)
+
+    def test_order_by_limit(self):
+        # Only the top rows are kept, so they fit in the budget
+        res = mldb.get('/v1/query', q='SELECT x FROM ds ORDER BY x LIMIT 5',
+                       format='table', maxMemory=100000).json()
+        self.assertEqual(len(res), 6)
+
+    def test_group_by_over_budget(self):
+        query = 'SELECT count(*) FROM ds GROUP BY s'
+        with self.assertMldbRaises(status_code=507):
+            mldb.get('/v1/query', q=query, maxMemory=10000)
+
+        res = mldb.get('/v1/query', q='SELECT count(*) FROM ds GROUP BY x % 2',
+                       format='table', maxMemory=10000).json()
+        self.assertEqual(len(res), 3)
+
+    def test_procedure_over_budget(self):
+        mldb.put('/v1/procedures/sorter', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x, s FROM ds ORDER BY s',
+                'outputDataset' : {'id' : 'sorted', 'type' : 'tabular'},
+                'runOnCreation' : False
+            }
+        })
+
+        with self.assertMldbRaises(expected_regexp='Memory budget'):
+            mldb.post('/v1/procedures/sorter/runs', {'maxMemory' : 10000})
+
+        mldb.post('/v1/procedures/sorter/runs', {'maxMemory' : 100000000})
+        res = mldb.get('/v1/query', q='SELECT count(*) FROM sorted',
+                       format='atom').json()
+        self.assertEqual(res, 2000)
+
+    def test_debug_queries(self):
+        res = mldb.get('/v1/debug/queries').json()
+        self.assertEqual(type(res), list)
+        for entry in res:
+            for field in ['description', 'bytesUsed', 'peakBytes', 'budget',
+                          'secondsRunning']:
+                self.assertIn(field, entry)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,68 @@
+#
+# query_streaming_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Tests for the streamed output of the query API.
+#
+
+if False:
+    mldb_wrapper = None
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+
+class QueryStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        # Enough rows that the output spans many chunks
+        for i in range(5000):
+            ds.record_row('row{:05d}'.format(i), [
+                ['x', i, 0],
+                ['label', 'some text to make the output bigger', 0]
+            ])
+        ds.commit()
+
+    def test_full_format_spans_chunks(self):
+        res = mldb.get('/v1/query',
+                       q='SELECT x FROM ds ORDER BY rowName()').json()
+        self.assertEqual(len(res), 5000)
+        self.assertEqual(res[0]['rowName'], 'row00000')
+        self.assertEqual(res[4999]['rowName'], 'row04999')
+        self.assertEqual(res[4999]['columns'][0][1], 4999)
+
+    def test_aos_format_spans_chunks(self):
+        res = mldb.get('/v1/query', q='SELECT * FROM ds ORDER BY x',
+                       format='aos').json()
+        self.assertEqual(len(res), 5000)
+        self.assertEqual(res[1234], {
+            '_rowName' : 'row01234',
+            'x' : 1234,
+            'label' : 'some text to make the output bigger'
+        })
+
+    def test_sparse_format_sorts_columns(self):
+        res = mldb.get('/v1/query', q='SELECT x, label FROM ds LIMIT 2',
+                       format='sparse', rowNames=False).json()
+        self.assertEqual(len(res), 2)
+        self.assertEqual([c[0] for c in res[0]], ['label', 'x'])
+
+    def test_small_result_not_chunked(self):
+        res = mldb.get('/v1/query', q='SELECT 1 AS one')
+        self.assertEqual(res.json()[0]['columns'][0][:2], ['one', 1])
+
+    def test_error_before_output(self):
+        msg = 'Unable to find function'
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.get('/v1/query', q='SELECT no_such_function(x) FROM ds')
+
+    def test_buffered_formats_unchanged(self):
+        res = mldb.get('/v1/query', q='SELECT x FROM ds ORDER BY x LIMIT 3',
+                       format='table').json()
+        self.assertEqual(res, [['_rowName', 'x'],
+                               ['row00000', 0],
+                               ['row00001', 1],
+                               ['row00002', 2]])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,62 @@
+#
+# randomforest_sparse_columns_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of random forest training on a dataset without its own column
+# bucketing, which bucketizes all of the feature columns in one go.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_COLUMNS = 50
+
+class RandomForestSparseColumnsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        for id, type in [('sparse', 'sparse.mutable'), ('tabular', 'tabular')]:
+            ds = mldb.create_dataset({'id' : id, 'type' : type})
+            for i in xrange(500):
+                cols = [['x%d' % j, random.randint(0, 9), 0]
+                        for j in xrange(NUM_COLUMNS) if (i + j) % 7 != 0]
+                label = int(sum(c[1] for c in cols if c[0] in ('x1', 'x2')) > 9)
+                ds.record_row('r%d' % i, cols + [['label', label, 0]])
+            ds.commit()
+
+    def train_and_test(self, id):
+        mldb.put('/v1/procedures/rf_' + id, {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' : 'SELECT {* EXCLUDING(label)} AS features, '
+                                 'label FROM ' + id,
+                'modelFileUrl' : 'file://tmp/randomforest_sparse_columns_%s.cls'
+                                 % id,
+                'functionName' : 'rf_fn_' + id,
+                'featureVectorSamplings' : 5,
+                'featureSamplings' : 10,
+                'maxDepth' : 10,
+                'runOnCreation' : True
+            }
+        })
+        res = mldb.put('/v1/procedures/rf_test_' + id, {
+            'type' : 'classifier.test',
+            'params' : {
+                'testingData' : 'SELECT rf_fn_%s({{* EXCLUDING(label)} AS '
+                                'features})[score] AS score, label FROM %s'
+                                % (id, id),
+                'runOnCreation' : True
+            }
+        }).json()
+        return res['status']['firstRun']['status']['auc']
+
+    def test_sparse_dataset(self):
+        self.assertGreater(self.train_and_test('sparse'), 0.9)
+
+    def test_tabular_dataset(self):
+        self.assertGreater(self.train_and_test('tabular'), 0.9)
+
+if __name__ == '__main__':
+    mldb.run_tests()
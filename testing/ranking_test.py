@@ -60,5 +60,46 @@ class RankingTest(MldbUnitTest):  # noqa
         self.assertEqual(data[size][1], size - 1, str(data[size]))
         self.assertEqual(data[size][2], size - 1, str(data[size]))
 
+    def test_many_rows_with_ties(self):
+        # Enough rows to be sorted in several buckets
+        mldb.put('/v1/datasets/ties', {
+            'type' : 'sparse.mutable',
+        })
+
+        size = 5000
+        for i in xrange(size):
+            mldb.post('/v1/datasets/ties/rows', {
+                'rowName' : 'row{}'.format(i),
+                'columns' : [['score', i % 7, 1]]
+            })
+
+        mldb.post('/v1/datasets/ties/commit')
+
+        def check(where, offset, limit):
+            mldb.post('/v1/procedures', {
+                'type' : 'ranking',
+                'params' : {
+                    'inputData' : 'SELECT * FROM ties {} ORDER BY score DESC '
+                                  'OFFSET {} LIMIT {}'
+                                  .format(where, offset, limit),
+                    'outputDataset' : 'ties_out',
+                    'rankingType' : 'index',
+                    'runOnCreation' : True
+                }
+            })
+
+            # The ranks follow the order of the same query
+            expected = mldb.query(
+                'SELECT score FROM ties {} ORDER BY score DESC '
+                'OFFSET {} LIMIT {}'.format(where, offset, limit))
+            res = mldb.query('SELECT rank FROM ties_out ORDER BY rank')
+            self.assertEqual(len(res), len(expected))
+            for i in xrange(1, len(res)):
+                self.assertEqual(res[i][0], expected[i][0])
+                self.assertEqual(res[i][1], i - 1)
+
+        check('', 0, size)
+        check('WHERE score != 3', 100, 2500)
+
 if __name__ == '__main__':
     mldb.run_tests()
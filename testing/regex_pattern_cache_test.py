@@ -0,0 +1,59 @@
+#
+# regex_pattern_cache_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Regular expressions and LIKE patterns that come from a column are
+# compiled once per distinct pattern and cached; check that the results
+# are the same as with one compilation per row, including when there are
+# more patterns than fit in the cache.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class RegexPatternCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in xrange(300):
+            ds.record_row('r%03d' % i,
+                          [['s', 'value%d' % (i % 7), 0],
+                           ['re', 'value%d' % (i % 100), 0],
+                           ['like', 'val%%%d' % (i % 3), 0]])
+        ds.record_row('nulls', [['s', 'value1', 0]])
+        ds.commit()
+
+    def values(self, expr):
+        res = mldb.query("select %s as v from ds order by rowName()" % expr)
+        return [r[1] for r in res[1:]]
+
+    def expected(self, fn):
+        # The "nulls" row sorts first
+        return [None] + [fn(i) for i in xrange(300)]
+
+    def test_regex_match(self):
+        self.assertEqual(self.values("regex_match(s, re)"),
+                         self.expected(lambda i: i % 7 == i % 100))
+
+    def test_regex_search(self):
+        self.assertEqual(self.values("regex_search(re, s)"),
+                         self.expected(
+                             lambda i: ('value%d' % (i % 100)).startswith(
+                                 'value%d' % (i % 7))))
+
+    def test_regex_replace(self):
+        self.assertEqual(self.values("regex_replace(s, re, 'x')"),
+                         self.expected(
+                             lambda i: 'x' if i % 7 == i % 100
+                             else 'value%d' % (i % 7)))
+
+    def test_like(self):
+        self.assertEqual(self.values("s LIKE like"),
+                         self.expected(lambda i: (i % 7) % 10 == i % 3))
+
+    def test_bad_pattern(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("select regex_match(s, s + '(') from ds")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,68 @@
+#
+# replica_dataset_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the replica dataset and of shard replicas of the distributed
+# dataset, with all of the peers being this server.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ReplicaDatasetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'source', 'type': 'sparse.mutable'})
+        for i in range(20):
+            ds.record_row('r%d' % i, [['x', i, 0], ['y', 'v%d' % (i % 4), 0]])
+        ds.commit()
+
+        mldb.put('/v1/datasets/copy', {
+            'type': 'replica',
+            'params': {'peers': [''], 'dataset': 'source'}
+        })
+
+    def test_same_rows(self):
+        query = "SELECT * FROM {} ORDER BY rowName()"
+        self.assertTableResultEquals(mldb.query(query.format('copy')),
+                                     mldb.query(query.format('source')))
+
+    def test_refresh_on_commit(self):
+        ds = mldb.create_dataset({'id': 'source2', 'type': 'sparse.mutable'})
+        ds.record_row('a', [['x', 1, 0]])
+        ds.commit()
+
+        mldb.put('/v1/datasets/copy2', {
+            'type': 'replica',
+            'params': {'peers': ['', ''], 'dataset': 'source2'}
+        })
+
+        ds.record_row('b', [['x', 2, 0]])
+        ds.commit()
+
+        # The copy only changes when it's committed
+        query = "SELECT count(*) AS cnt FROM copy2"
+        self.assertEqual(mldb.query(query)[1][1], 1)
+        mldb.post('/v1/datasets/copy2/commit')
+        self.assertEqual(mldb.query(query)[1][1], 2)
+
+    def test_no_peers(self):
+        with self.assertMldbRaises(status_code=400):
+            mldb.put('/v1/datasets/copy_none', {
+                'type': 'replica',
+                'params': {'peers': [], 'dataset': 'source'}
+            })
+
+    def test_distributed_with_replicas(self):
+        mldb.put('/v1/datasets/dist', {
+            'type': 'distributed',
+            'params': {
+                'shards': [{'dataset': 'source', 'replicas': ['', '']}]
+            }
+        })
+        query = "SELECT x FROM {} WHERE y = 'v1' ORDER BY x DESC LIMIT 3"
+        self.assertTableResultEquals(mldb.query(query.format('dist')),
+                                     mldb.query(query.format('source')))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,77 @@
+#
+# rolling_tables_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the statsTable and distTable procedures keep the rolling
+# statistics in order when the rows span many blocks.
+#
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 10000
+NUM_KEYS = 7
+
+class RollingTablesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        rows = []
+        for i in xrange(NUM_ROWS):
+            rows.append(['r%05d' % i, [['key', 'k%d' % (i % NUM_KEYS), 0],
+                                       ['label', i % 2, 0],
+                                       ['target', i, 0]]])
+        ds.record_rows(rows)
+        ds.commit()
+
+    def check_rows(self, output_id, check):
+        for i in [0, 1, NUM_KEYS, 4095, 4096, 4097, 8191, NUM_ROWS - 1]:
+            res = mldb.get('/v1/query',
+                           q="SELECT * FROM %s WHERE rowName() = 'r%05d'"
+                           % (output_id, i), format='aos').json()
+            self.assertEqual(len(res), 1)
+            check(i, res[0])
+
+    def earlier(self, i):
+        return [j for j in xrange(i % NUM_KEYS, i, NUM_KEYS)]
+
+    def test_stats_table(self):
+        mldb.post('/v1/procedures', {
+            'type' : 'statsTable.train',
+            'params' : {
+                'trainingData' : 'SELECT key FROM ds ORDER BY rowName()',
+                'outcomes' : [['label', 'label = 1']],
+                'outputDataset' : 'stats_output',
+                'runOnCreation' : True
+            }
+        })
+
+        def check(i, row):
+            earlier = self.earlier(i)
+            self.assertEqual(row['trial.key'], len(earlier))
+            self.assertEqual(row['label.key'],
+                             len([j for j in earlier if j % 2 == 1]))
+
+        self.check_rows('stats_output', check)
+
+    def test_dist_table(self):
+        mldb.post('/v1/procedures', {
+            'type' : 'experimental.distTable.train',
+            'params' : {
+                'trainingData' : 'SELECT key FROM ds ORDER BY rowName()',
+                'outcomes' : [['target', 'target']],
+                'statistics' : ['count', 'max'],
+                'outputDataset' : 'dist_output',
+                'runOnCreation' : True
+            }
+        })
+
+        def check(i, row):
+            earlier = self.earlier(i)
+            self.assertEqual(row['target.key.count'], len(earlier))
+            if earlier:
+                self.assertEqual(row['target.key.max'], max(earlier))
+
+        self.check_rows('dist_output', check)
+
+if __name__ == '__main__':
+    mldb.run_tests()
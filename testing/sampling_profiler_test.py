@@ -0,0 +1,28 @@
+#
+# sampling_profiler_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the /v1/debug/profile route.
+#
+import re
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SamplingProfilerTest(MldbUnitTest):  # noqa
+
+    def test_collapsed_stacks(self):
+        res = mldb.get('/v1/debug/profile', seconds=0.5, frequency=500)
+        for line in res.text.splitlines():
+            self.assertIsNotNone(re.match(r'^.+ [0-9]+$', line), line)
+
+    def test_bad_parameters(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as exc:
+            mldb.get('/v1/debug/profile', seconds=-1)
+        self.assertEqual(exc.exception.response.status_code, 400)
+
+        with self.assertRaises(mldb_wrapper.ResponseException) as exc:
+            mldb.get('/v1/debug/profile', seconds=1, frequency=0)
+        self.assertEqual(exc.exception.response.status_code, 400)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,77 @@
+#
+# scalar_operator_bind_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Comparisons and arithmetic between scalars and constants are bound to
+# specialized closures; check that they give the same results as the
+# general case, including for nulls, mixed types and timestamps.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ScalarOperatorBindTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        ds.record_row('r1', [['x', 1, 1], ['y', 2.5, 2], ['s', 'abc', 3]])
+        ds.record_row('r2', [['x', 3, 1], ['s', 'abd', 1]])
+        ds.commit()
+
+    def query(self, expr):
+        return mldb.query("select %s as v from ds order by rowName()"
+                          % expr)
+
+    def values(self, expr):
+        return [r[1] for r in self.query(expr)[1:]]
+
+    def test_column_vs_constant(self):
+        self.assertEqual(self.values('x = 1'), [True, False])
+        self.assertEqual(self.values('1 = x'), [True, False])
+        self.assertEqual(self.values('x != 1'), [False, True])
+        self.assertEqual(self.values('x < 2'), [True, False])
+        self.assertEqual(self.values('2 > x'), [True, False])
+        self.assertEqual(self.values('x >= 3'), [False, True])
+        self.assertEqual(self.values('3 <= x'), [False, True])
+
+    def test_column_vs_column(self):
+        self.assertEqual(self.values('x < y'), [True, None])
+        self.assertEqual(self.values('y > x'), [True, None])
+
+    def test_nulls(self):
+        self.assertEqual(self.values('y = 2.5'), [True, None])
+        self.assertEqual(self.values('x = null'), [None, None])
+        self.assertEqual(self.values('null != x'), [None, None])
+        self.assertEqual(self.values('y + 1'), [3.5, None])
+
+    def test_strings(self):
+        self.assertEqual(self.values("s = 'abc'"), [True, False])
+        self.assertEqual(self.values("'abd' = s"), [False, True])
+        self.assertEqual(self.values("s < 'abd'"), [True, False])
+
+    def test_mixed_types(self):
+        # Numbers sort before strings
+        self.assertEqual(self.values("x < 'a'"), [True, True])
+        self.assertEqual(self.values("s > 1000"), [True, True])
+        self.assertEqual(self.values("x = '1'"), [False, False])
+
+    def test_arithmetic(self):
+        self.assertEqual(self.values('x + 1'), [2, 4])
+        self.assertEqual(self.values('10 - x'), [9, 7])
+        self.assertEqual(self.values('x * 2.5'), [2.5, 7.5])
+        self.assertEqual(self.values('3 / x'), [3, 1])
+        self.assertEqual(self.values('x % 2'), [1, 1])
+        self.assertEqual(self.values("s + 'z'"), ['abcz', 'abdz'])
+
+    def test_timestamps(self):
+        # The result takes the latest timestamp of its operands
+        res = mldb.get('/v1/query',
+                       q="select s = 'abc' as v, x + 1 as w from ds "
+                         "where rowName() = 'r1'",
+                       format='full').json()
+        cols = {c[0]: c for c in res[0]['columns']}
+        self.assertEqual(cols['v'][2], '1970-01-01T00:00:03Z')
+        self.assertEqual(cols['w'][2], '1970-01-01T00:00:01Z')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,67 @@
+#
+# script_function_batch_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of script.apply functions that are called with a batch of args.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class ScriptFunctionBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # Returns, for each call, the number of calls in the batch and the
+        # args that it was called with
+        source = """
+results = []
+for args in mldb.script.args:
+    results.append([["numCalls", len(mldb.script.args),
+                     "2017-01-01T00:00:00Z"],
+                    ["args", str(args), "2017-01-01T00:00:00Z"]])
+mldb.script.set_return(results)
+"""
+        mldb.put("/v1/functions/batched", {
+            "type": "script.apply",
+            "params": {
+                "language": "python",
+                "batch": True,
+                "scriptConfig": {
+                    "source": source
+                }
+            }
+        })
+
+    def test_single_call(self):
+        res = mldb.query("SELECT batched({args: {x: 12345}}) AS *")
+        self.assertEqual(res[0][1:], ["return.args", "return.numCalls"])
+        self.assertIn("12345", res[1][1])
+        self.assertEqual(res[1][2], 1)
+
+    def test_batch_route(self):
+        inputs = [{"args": {"x": 1000 + i}} for i in xrange(50)]
+        res = mldb.post("/v1/functions/batched/batch",
+                        {"input": inputs}).json()
+        self.assertEqual(len(res), 50)
+        for i, output in enumerate(res):
+            self.assertIn(str(1000 + i), output["return"]["args"])
+
+        # the script ran with more than one call at a time
+        self.assertGreater(max(o["return"]["numCalls"] for o in res), 1)
+
+    def test_wrong_number_returned(self):
+        mldb.put("/v1/functions/bad_batch", {
+            "type": "script.apply",
+            "params": {
+                "language": "python",
+                "batch": True,
+                "scriptConfig": {
+                    "source": "mldb.script.set_return([])"
+                }
+            }
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("SELECT bad_batch({args: {x: 1}}) AS *")
+
+if __name__ == '__main__':
+    mldb.run_tests()
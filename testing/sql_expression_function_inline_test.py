@@ -0,0 +1,83 @@
+#
+# sql_expression_function_inline_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that sql.expression functions bound inline into the calling query
+# give the same results as when they're applied.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SqlExpressionFunctionInlineTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in xrange(20):
+            ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 3, 0],
+                                        ['s', 'str%d' % i, 0]])
+        ds.record_row('nulls', [['s', 'none', 0]])
+        ds.commit()
+
+        for deterministic in [True, False]:
+            suffix = '' if deterministic else '_applied'
+            mldb.put('/v1/functions/poly' + suffix, {
+                'type': 'sql.expression',
+                'deterministic': deterministic,
+                'params': {
+                    'expression': 'a * a + b AS p, a IN (1, 2, b) AS isin, '
+                                  'c + \'!\' AS c'
+                }
+            })
+            mldb.put('/v1/functions/raw' + suffix, {
+                'type': 'sql.expression',
+                'deterministic': deterministic,
+                'params': {
+                    'expression': 'a - b',
+                    'raw': True
+                }
+            })
+            mldb.put('/v1/functions/auto' + suffix, {
+                'type': 'sql.expression',
+                'deterministic': deterministic,
+                'params': {
+                    'expression': 'val * 10 + val',
+                    'raw': True,
+                    'autoInput': True
+                }
+            })
+            mldb.put('/v1/functions/nested' + suffix, {
+                'type': 'sql.expression',
+                'deterministic': deterministic,
+                'params': {
+                    'expression': 'raw' + suffix + '({a: q, b: 1}) AS r'
+                }
+            })
+
+    def check(self, query):
+        # The same query calling the functions that aren't inlined gives
+        # the expected result
+        query += ' ORDER BY rowName()'
+        self.assertTableResultEquals(mldb.query(query.format(s='')),
+                                     mldb.query(query.format(s='_applied')))
+
+    def test_row_output(self):
+        self.check('SELECT poly{s}({{a: x, b: y, c: s}}) AS * FROM ds')
+
+    def test_raw(self):
+        self.check('SELECT raw{s}({{a: x, b: y * 2}}) AS r FROM ds')
+
+    def test_auto_input(self):
+        self.check('SELECT auto{s}(x + 1) AS v FROM ds')
+
+    def test_nested_call(self):
+        self.check('SELECT nested{s}({{q: x}}) AS * FROM ds')
+
+    def test_constants(self):
+        self.check('SELECT raw{s}({{a: 10, b: 3}}) AS r, x FROM ds')
+
+    def test_in_where(self):
+        self.check('SELECT x FROM ds WHERE raw{s}({{a: x, b: y}}) > 5')
+
+if __name__ == '__main__':
+    mldb.run_tests()
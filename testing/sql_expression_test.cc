@@ -78,7 +78,7 @@ struct TestBindingContext: public SqlBindingScope {
             {
                 const TestContext & testContext
                     = static_cast<const TestContext &>(context);
-                std::vector<std::tuple<PathElement, ExpressionValue> > result;
+                StructValue result;
 
                 for (auto & v: testContext.vars) {
                     ColumnPath name = keep(v.first);
@@ -253,7 +253,7 @@ BOOST_AUTO_TEST_CASE(test_simple_comparison)
         cerr << parsed->print() << endl;
         auto expr = parsed->bind(context);
         cerr << jsonEncode(expr) << endl;
-        vector<tuple<PathElement, ExpressionValue> > expected;
+        StructValue expected;
         expected.emplace_back(PathElement("x + 1"), ExpressionValue(11, Date()));
         BOOST_CHECK_EQUAL(expr(createRow({{"x", 10}, {"y", 3}, {"z", 2}}), GET_LATEST),
                           ExpressionValue(expected));
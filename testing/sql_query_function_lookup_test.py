@@ -0,0 +1,64 @@
+#
+# sql_query_function_lookup_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of sql.query functions that look up a single row by name, which
+# don't go through the query pipeline.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SqlQueryFunctionLookupTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'lookup', 'type' : 'sparse.mutable'})
+        for i in xrange(100):
+            ds.record_row('key%d' % i, [['value', i, 0], ['twice', i * 2, 0]])
+        ds.record_row('a.b', [['value', -1, 0]])
+        ds.commit()
+
+        def create(name, query):
+            mldb.put("/v1/functions/" + name, {
+                "type": "sql.query",
+                "params": {
+                    "query": query
+                }
+            })
+
+        # lookups
+        create("by_name", "SELECT * FROM lookup WHERE rowName() = $key")
+        create("by_name_rev", "SELECT value, $extra AS extra FROM lookup "
+               "WHERE $key = rowName()")
+        create("by_path", "SELECT value FROM lookup WHERE rowPath() = $key")
+
+        # the same, but not recognized as lookups
+        create("general", "SELECT * FROM lookup "
+               "WHERE rowName() = $key AND true")
+
+    def query(self, fn, args):
+        return mldb.query("SELECT %s(%s) AS *" % (fn, args))
+
+    def test_same_as_general(self):
+        for key in ["'key7'", "'key99'", "'nothere'", "'\"a.b\"'", "null"]:
+            self.assertEqual(self.query("by_name", "{key: %s}" % key),
+                             self.query("general", "{key: %s}" % key))
+
+    def test_values(self):
+        self.assertTableResultEquals(
+            self.query("by_name_rev", "{key: 'key3', extra: 'x'}"),
+            [["_rowName", "extra", "value"],
+             ["result", "x", 3]])
+
+        self.assertTableResultEquals(
+            self.query("by_path", "{key: 'key5'}"),
+            [["_rowName", "value"], ["result", 5]])
+
+    def test_in_query(self):
+        res = mldb.query("SELECT sum(by_name({key: 'key' + "
+                         "cast(value AS string)}).twice) AS total "
+                         "FROM lookup WHERE value >= 0")
+        self.assertEqual(res[1][1], 2 * sum(range(100)))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,45 @@
+#
+# sqlite_dataset_batch_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of batched writes to the sqliteSparse dataset.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SqliteDatasetBatchTest(MldbUnitTest):  # noqa
+
+    def count(self, dataset):
+        return mldb.get('/v1/query', q='SELECT count(*) FROM %s' % dataset,
+                        format='atom').json()
+
+    def test_record_rows(self):
+        ds = mldb.create_dataset({'id' : 'rows', 'type' : 'sqliteSparse'})
+        # More values than fit in one multi-row insert
+        ds.record_rows([['r%d' % i, [['x', i, 0], ['y', 'y%d' % i, 0]]]
+                        for i in xrange(500)])
+        ds.commit()
+        self.assertEqual(self.count('rows'), 500)
+
+        res = mldb.get('/v1/query', q="SELECT x, y FROM rows WHERE x = 321",
+                       format='table', rowNames=False).json()
+        self.assertEqual(res, [['x', 'y'], [321, 'y321']])
+
+    def test_rows_per_transaction(self):
+        ds = mldb.create_dataset({
+            'id' : 'batched',
+            'type' : 'sqliteSparse',
+            'params' : {'rowsPerTransaction' : 1000, 'mmapSize' : 0}
+        })
+        for i in xrange(1500):
+            ds.record_row('r%d' % i, [['x', i, 0]])
+        ds.commit()
+        self.assertEqual(self.count('batched'), 1500)
+
+        # Recording to an existing row and column reuses their numbers
+        ds.record_row('r0', [['x', 'again', 1]])
+        ds.commit()
+        self.assertEqual(self.count('batched'), 1500)
+
+if __name__ == '__main__':
+    mldb.run_tests()
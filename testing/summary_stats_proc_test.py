@@ -207,6 +207,55 @@ class SummaryStatsProcTest(MldbUnitTest):  # noqa
         ])
 
 
+    def test_many_unique_values(self):
+        # Over 10000 unique values, the statistics come from sketches
+        ds = mldb.create_dataset({
+            'id' : 'many_unique_source',
+            'type' : 'sparse.mutable'
+        })
+        rows = []
+        for i in xrange(30000):
+            rows.append([str(i), [['x', -1 if i % 3 == 0 else i, 0]]])
+        ds.record_rows(rows)
+        ds.commit()
+
+        mldb.post('/v1/procedures', {
+            'type' : 'summary.statistics',
+            'params' : {
+                'runOnCreation' : True,
+                'inputData' : "SELECT * FROM many_unique_source",
+                'outputDataset' : {
+                    'id' : 'many_unique_output',
+                    'type' : 'sparse.mutable'
+                }
+            }
+        })
+
+        res = mldb.get('/v1/query', q="""
+            SELECT * FROM many_unique_output""", format='aos').json()
+        self.assertEqual(len(res), 1)
+        stats = res[0]
+        self.assertEqual(stats['value.data_type'], 'number')
+        self.assertEqual(stats['value.num_null'], 0)
+
+        # Moments are always exact
+        self.assertEqual(stats['value.min'], -1)
+        self.assertEqual(stats['value.max'], 29999)
+
+        # 20000 values that aren't multiples of 3, plus -1
+        self.assertAlmostEqual(stats['value.num_unique'], 20001,
+                               delta=20001 * 0.05)
+
+        # The first 10000 values are -1, so the median is around the
+        # 5000th value that isn't a multiple of 3
+        self.assertGreater(stats['value.median'], 6000)
+        self.assertLess(stats['value.median'], 9000)
+
+        # -1 is the only frequent item, and must be found
+        self.assertLessEqual(stats['value.most_frequent_items.-1'], 10000)
+        self.assertGreaterEqual(stats['value.most_frequent_items.-1'],
+                                10000 - 30000 / 1000)
+
 
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,82 @@
+#
+# svm_grid_search_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the C/gamma grid search of svm.train, and that scoring a whole
+# dataset with the svm function gives the same output as one row at a time.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SvmGridSearchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        ds = mldb.create_dataset({'id' : 'points', 'type' : 'sparse.mutable'})
+        for i in xrange(300):
+            label = i % 3
+            ds.record_row('r%d' % i, [
+                ['x', random.gauss(label, 0.5), 0],
+                ['y', random.gauss(-label, 0.5), 0],
+                ['z', random.gauss(0, 1), 0],
+                ['label', label, 0]])
+        ds.commit()
+
+    def train(self, id, kernel, **params):
+        params['trainingData'] = 'SELECT * FROM points'
+        params['modelFileUrl'] = 'file://tmp/svm_grid_search_%s.svm' % id
+        params['configuration'] = {'kernel' : kernel}
+        params['runOnCreation'] = True
+        res = mldb.put('/v1/procedures/train_' + id, {
+            'type' : 'svm.train',
+            'params' : params
+        }).json()
+
+        mldb.put('/v1/functions/' + id, {
+            'type' : 'svm',
+            'params' : {'modelFileUrl' : params['modelFileUrl']}
+        })
+        return res['status']['firstRun']
+
+    def check_scores(self, id):
+        # Scored together in a query
+        rows = mldb.query('SELECT %s({embedding: {x, y, z}})[output] AS out '
+                          'FROM points ORDER BY rowName()' % id)
+
+        # Scored one at a time
+        for row in rows[1:20]:
+            x = mldb.query("SELECT x, y, z FROM points WHERE rowName() = '%s'"
+                           % row[0])[1]
+            res = mldb.get('/v1/functions/%s/application' % id,
+                           input={'embedding' : {'x' : x[1], 'y' : x[2],
+                                                 'z' : x[3]}}).json()
+            self.assertEqual(res['output']['output'], row[1])
+
+    def test_grid_search(self):
+        run = self.train('grid_rbf', 'rbf', CValues=[0.1, 1, 10],
+                         gammaValues=[0.1, 1])
+        search = run['status']['gridSearch']
+        self.assertEqual(len(search), 6)
+        best = max(search, key=lambda x: x['accuracy'])
+        self.assertGreater(best['accuracy'], 0.8)
+        self.assertEqual(run['status']['C'], best['C'])
+        self.assertEqual(run['status']['gamma'], best['gamma'])
+        self.check_scores('grid_rbf')
+
+    def test_linear(self):
+        self.train('linear', 'linear')
+        self.check_scores('linear')
+
+    def test_poly(self):
+        self.train('poly', 'poly')
+        self.check_scores('poly')
+
+    def test_bad_folds(self):
+        with self.assertMldbRaises(status_code=400):
+            self.train('bad_folds', 'rbf', CValues=[1], numFolds=1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
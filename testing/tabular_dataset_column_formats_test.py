@@ -0,0 +1,71 @@
+#
+# tabular_dataset_column_formats_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that columns that freeze into the run length and delta integer
+# formats give back exactly what was recorded, both in memory and after
+# being persisted and reloaded.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetColumnFormatsTest(MldbUnitTest):  # noqa
+
+    url = 'file://tmp/tabular_dataset_column_formats_test.mldbds'
+
+    @classmethod
+    def setUpClass(cls):
+        for name, config in [('tab', {'type': 'tabular',
+                                      'params': {'dataFileUrl': cls.url}}),
+                             ('ref', {'type': 'sparse.mutable'})]:
+            config['id'] = name
+            ds = mldb.create_dataset(config)
+            for i in xrange(5000):
+                row = [
+                    # sorted with a constant step; delta encoded
+                    ['seq', 1000000000 + i * 60, 0],
+                    # sorted with an irregular step, including negatives
+                    ['irregular', i * i - 100000, 0],
+                    # long runs of the same value; run length encoded
+                    ['status', ['ok', 'warn', 'error'][(i / 700) % 3], 0],
+                    # runs of values and runs of nulls
+                    ['runs', (i / 100) % 5 if (i / 300) % 2 else None, 0],
+                    # sorted timestamps with whole seconds
+                    ['ts', {'ts': '2017-01-01T00:%02d:%02dZ' %
+                            ((i / 60) % 60, i % 60)}, 0]
+                ]
+                ds.record_row('row%d' % i, row)
+            ds.commit()
+
+        mldb.put('/v1/datasets/reloaded', {
+            'type': 'tabular',
+            'params': {'dataFileUrl': cls.url}
+        })
+
+    def check(self, query):
+        expected = mldb.query(query % 'ref')
+        self.assertEqual(mldb.query(query % 'tab'), expected)
+        self.assertEqual(mldb.query(query % 'reloaded'), expected)
+
+    def test_select_all(self):
+        self.check("select * from %s order by rowName()")
+
+    def test_random_access(self):
+        self.check("select seq, irregular, status, runs, ts from %s "
+                   "where rowName() in ('row0', 'row63', 'row64', 'row65', "
+                   "'row299', 'row300', 'row4999') order by rowName()")
+
+    def test_filters(self):
+        self.check("select rowName() from %s where status = 'warn' "
+                   "order by rowName()")
+        self.check("select rowName() from %s where runs is null "
+                   "order by rowName()")
+        self.check("select rowName() from %s where seq > 1000100000 "
+                   "order by rowName()")
+
+    def test_aggregates(self):
+        self.check("select count(runs), sum(seq), min(irregular), "
+                   "max(irregular), max(ts) from %s")
+
+if __name__ == '__main__':
+    mldb.run_tests()
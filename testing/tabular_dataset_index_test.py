@@ -0,0 +1,81 @@
+#
+# tabular_dataset_index_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that WHERE clauses answered by the tabular dataset's secondary
+# indexes give the same rows as the generic evaluation, including after
+# the dataset is reloaded from its file.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetIndexTest(MldbUnitTest):  # noqa
+
+    url = 'file://tmp/tabular_dataset_index_test.mldbds'
+
+    indexes = [{'column': 'user', 'type': 'hash'},
+               {'column': 'x', 'type': 'sorted'},
+               {'column': 'mixed', 'type': 'hash'},
+               {'column': 'mixed', 'type': 'sorted'}]
+
+    @classmethod
+    def setUpClass(cls):
+        for name, type, params in [
+                ('tab', 'tabular', {'indexes': cls.indexes,
+                                    'dataFileUrl': cls.url}),
+                ('ref', 'sparse.mutable', {})]:
+            ds = mldb.create_dataset({'id': name, 'type': type,
+                                      'params': params})
+            for i in xrange(20000):
+                row = [['x', i % 5000, 0],
+                       ['user', 'user%d' % (i % 997), 0]]
+                if i % 3 == 0:
+                    row.append(['mixed', i, 0])
+                elif i % 3 == 1:
+                    row.append(['mixed', 'str%d' % i, 0])
+                ds.record_row('row%d' % i, row)
+            ds.commit()
+
+        mldb.put('/v1/datasets/reloaded', {
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': cls.url
+            }
+        })
+
+    def check(self, where):
+        query = "select * from %s where " + where + " order by rowName()"
+        expected = mldb.query(query % 'ref')
+        self.assertEqual(mldb.query(query % 'tab'), expected)
+        self.assertEqual(mldb.query(query % 'reloaded'), expected)
+
+    def test_hash_lookup(self):
+        self.check("user = 'user123'")
+        self.check("'user5' = user")
+        self.check("user = 'nobody'")
+        self.check("user IN ('user1', 'user2', 'user1', 'nobody')")
+
+    def test_sorted_lookup(self):
+        for op in ['=', '<', '<=', '>', '>=']:
+            self.check('x %s 1234' % op)
+            self.check('1234 %s x' % op)
+        self.check('x IN (1, 2, 4999, 6000)')
+        self.check('x > 100000')
+
+    def test_not_indexed(self):
+        self.check("x != 1234")
+        self.check("user > 'user990'")
+
+    def test_mixed_types_and_nulls(self):
+        self.check('mixed = 300')
+        self.check('mixed < 100')
+        self.check("mixed > 'str19990'")
+        self.check("mixed IN (3, 'str4')")
+
+    def test_limit(self):
+        res = mldb.query("select x from tab where user = 'user1' "
+                         "order by rowName() limit 3")
+        self.assertEqual(len(res), 4)
+
+if __name__ == '__main__':
+    mldb.run_tests()
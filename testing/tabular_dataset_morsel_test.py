@@ -0,0 +1,41 @@
+#
+# tabular_dataset_morsel_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that scans that split a tabular dataset into morsels see every row
+# exactly once, including with chunks of very different sizes.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetMorselTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for name, type in [('tab', 'tabular'), ('ref', 'sparse.mutable')]:
+            ds = mldb.create_dataset({'id': name, 'type': type})
+            # Each call to record_rows gives a chunk; make them skewed
+            n = 0
+            for size in [1, 50000, 3, 7000, 1, 20000, 2]:
+                rows = []
+                for i in xrange(size):
+                    rows.append(['row%d' % n, [['x', n, 0]]])
+                    n += 1
+                ds.record_rows(rows)
+            ds.commit()
+
+    def check(self, query):
+        self.assertEqual(mldb.query(query % 'tab'),
+                         mldb.query(query % 'ref'))
+
+    def test_limit_without_order_by(self):
+        # Implicitly ordered by row hash; scanned morsel by morsel
+        self.check("select x from %s limit 100")
+        self.check("select x from %s offset 1000 limit 500")
+        self.check("select x from %s offset 77000 limit 500")
+
+    def test_all_rows(self):
+        self.check("select count(*), sum(x), min(x), max(x) from %s")
+
+if __name__ == '__main__':
+    mldb.run_tests()
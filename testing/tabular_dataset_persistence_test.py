@@ -0,0 +1,116 @@
+#
+# tabular_dataset_persistence_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that a tabular dataset can be saved to a file on commit and memory
+# mapped back in.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetPersistenceTest(MldbUnitTest):  # noqa
+
+    url = 'file://tmp/tabular_dataset_persistence_test.mldbds'
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({
+            'id': 'original',
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': cls.url,
+                'unknownColumns': 'add'
+            }
+        })
+
+        for i in xrange(2000):
+            ds.record_row('row%d' % i, [
+                ['int', i, 0],
+                ['neg', -i * 1000000007, 0],
+                ['float', i * 0.5, 0],
+                ['str', 'value%d' % (i % 10), 0],
+                ['utf8', u'été %d' % (i % 3), 0],
+                ['ts', '2017-01-%02dT00:00:00Z' % (i % 28 + 1), 0],
+                ['sparse%d' % (i % 4), i, 0]
+            ])
+        ds.commit()
+
+        # Rows with integer names are stored differently
+        ds = mldb.create_dataset({
+            'id': 'intnames',
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': cls.url + '.int'
+            }
+        })
+
+        for i in xrange(100):
+            ds.record_row(str(i), [['x', i, 0], ['y', None, 0]])
+        ds.commit()
+
+    def reload(self, id, url):
+        mldb.put('/v1/datasets/' + id, {
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': url
+            }
+        })
+
+    def test_reload_is_identical(self):
+        self.reload('reloaded', self.url)
+
+        query = "select * from %s order by rowName()"
+        self.assertEqual(mldb.query(query % 'original'),
+                         mldb.query(query % 'reloaded'))
+
+        query = "select rowName(), timestamp(), * from %s where int % 7 = 0 order by rowName()"
+        self.assertEqual(mldb.query(query % 'original'),
+                         mldb.query(query % 'reloaded'))
+
+    def test_reload_integer_row_names(self):
+        self.reload('intreloaded', self.url + '.int')
+        query = "select * from %s order by rowName()"
+        self.assertEqual(mldb.query(query % 'intnames'),
+                         mldb.query(query % 'intreloaded'))
+
+    def test_reload_row_lookup(self):
+        self.reload('lookup', self.url)
+        self.assertTableResultEquals(
+            mldb.query("select int, str from lookup where rowName() = 'row123'"),
+            [
+                ["_rowName", "int", "str"],
+                ["row123", 123, "value3"]
+            ])
+
+    def test_reload_string_filters(self):
+        # String columns are stored as codes into a dictionary that's
+        # saved with the dataset
+        self.reload('strings', self.url)
+        for where in ["str = 'value3'", "str != 'value3'",
+                      "str = 'missing'", u"utf8 = 'été 1'"]:
+            query = ("select int from %s where " + where
+                     + " order by rowName()")
+            self.assertEqual(mldb.query(query % 'original'),
+                             mldb.query(query % 'strings'))
+
+        res = mldb.query("select count(*) from strings where str = 'value3'")
+        self.assertEqual(res[1][1], 200)
+
+        res = mldb.query("select count(*) from strings where str = 'missing'")
+        self.assertEqual(res[1][1], 0)
+
+    def test_reload_status(self):
+        self.reload('status', self.url)
+        status = mldb.get('/v1/datasets/status').json()['status']
+        self.assertEqual(status['rowCount'], 2000)
+
+    def test_bad_file(self):
+        url = 'file://tmp/tabular_dataset_persistence_test_bad.mldbds'
+        with open(url[len('file://'):], 'w') as f:
+            f.write('this is not a tabular dataset')
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.reload('bad', url)
+
+if __name__ == '__main__':
+    mldb.run_tests()
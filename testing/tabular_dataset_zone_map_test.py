@@ -0,0 +1,61 @@
+#
+# tabular_dataset_zone_map_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that WHERE clauses that are pushed down into the tabular dataset's
+# per-chunk zone maps give the same rows as the generic evaluation.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetZoneMapTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for name, type in [('tab', 'tabular'), ('ref', 'sparse.mutable')]:
+            ds = mldb.create_dataset({'id': name, 'type': type})
+            for i in xrange(20000):
+                row = [['x', i, 0],
+                       ['str', 'value%05d' % i, 0],
+                       ['ts', '2017-01-%02dT00:00:00Z' % (i * 28 / 20000 + 1),
+                        0]]
+                if i % 3 == 0:
+                    row.append(['mixed', i, 0])
+                elif i % 3 == 1:
+                    row.append(['mixed', 'str%d' % i, 0])
+                ds.record_row('row%d' % i, row)
+            ds.commit()
+
+    def check(self, where):
+        query = "select * from %s where " + where + " order by rowName()"
+        self.assertEqual(mldb.query(query % 'tab'),
+                         mldb.query(query % 'ref'))
+
+    def test_numeric_comparisons(self):
+        for op in ['=', '!=', '<', '<=', '>', '>=']:
+            self.check('x %s 12345' % op)
+            self.check('12345 %s x' % op)
+
+    def test_no_matching_chunk(self):
+        self.check('x > 1000000')
+        self.check('x < -1')
+        self.check("x = 'hello'")
+
+    def test_string_comparisons(self):
+        self.check("str = 'value01234'")
+        self.check("str >= 'value19990'")
+
+    def test_timestamp_range(self):
+        self.check("ts >= '2017-01-27T00:00:00Z'")
+
+    def test_mixed_types_and_nulls(self):
+        self.check('mixed = 300')
+        self.check('mixed < 100')
+        self.check("mixed > 'str19990'")
+
+    def test_conjunction(self):
+        self.check('x > 100 and x < 200')
+        self.check('x > 100 or x = 5')
+
+if __name__ == '__main__':
+    mldb.run_tests()
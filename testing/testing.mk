@@ -25,6 +25,10 @@ $(eval $(call test,mldb_plugin_test,mldb,boost))
 $(eval $(call test,mldb_python_plugin_test,mldb,boost))
 $(eval $(call test,MLDB-642_script_procedure_test,mldb,boost))
 $(eval $(call test,for_each_line_test,mldb,boost))
+$(eval $(call test,query_cache_test,mldb,boost))
+$(eval $(call test,ingestion_queue_test,mldb,boost))
+$(eval $(call test,query_json_writer_test,mldb,boost))
+$(eval $(call test,msgpack_rows_test,mldb,boost))
 $(eval $(call test,svd_utils_test,mldb,boost))
 
 $(eval $(call test,mldb_reddit_test,mldb,boost))
@@ -38,6 +42,7 @@ $(eval $(call test,expression_value_test,sql_expression,boost))
 $(eval $(call test,sql_expression_test,sql_expression,boost))
 $(eval $(call test,dataset_select_test,mldb,boost))
 $(eval $(call test,embedding_dataset_test,mldb,boost))
+$(eval $(call test,bucket_list_test,mldb,boost))
 $(eval $(call test,procedure_run_test,mldb,boost))
 $(eval $(call test,python_procedure_test,mldb,boost manual)) #manual -- unclear why
 $(eval $(call test,mldb_internal_plugin_doc_test,mldb,boost))
@@ -75,6 +80,7 @@ $(eval $(call test,MLDB-204-circular-references-initialization,mldb,boost))
 $(eval $(call test,MLDB-267-delete-while-loading,mldb,boost))
 $(eval $(call test,mldb_crash_multiple_py_routes,mldb,boost manual))  #manual - intermittent - MLDB-787
 $(eval $(call test,mldb_determinism_test,mldb,boost))
+$(eval $(call test,mldb_microbenchmarks,mldb test_utils,boost manual))  #manual - benchmark, writes timings as JSON
 $(eval $(call test,credentials_persistence_test,mldb vfs_handlers,boost))
 $(eval $(call test,MLDB-1025-output-dataset-serialization-test,mldb,boost))
 $(eval $(call test,MLDB-1559-transform-method,mldb,boost))
@@ -172,6 +178,7 @@ $(eval $(call mldb_unit_test,MLDB-684-remote-plugin.js,,virtualenv))
 $(eval $(call mldb_unit_test,MLDB-136-value-dataset.js))
 $(eval $(call mldb_unit_test,MLDB-499-text-dataset.js))
 $(eval $(call mldb_unit_test,MLDB-694_external_python_procedure.py))
+$(eval $(call mldb_unit_test,external_procedure_arrow_test.py))
 $(eval $(call mldb_unit_test,MLDB-704-jseval-row.js))
 $(eval $(call mldb_unit_test,MLDB-723-jseval-exceptions.js))
 $(eval $(call mldb_unit_test,MLDB-761-sub-queries.py))
@@ -418,6 +425,9 @@ $(eval $(call mldb_unit_test,MLDB-1736_operator_precedence.py))
 $(eval $(call mldb_unit_test,MLDB-1734_case_statement.py))
 $(eval $(call mldb_unit_test,sign_function_test.py))
 $(eval $(call mldb_unit_test,import_text_test.py))
+$(eval $(call mldb_unit_test,import_parquet_test.py))
+$(eval $(call mldb_unit_test,arrow_export_test.py))
+$(eval $(call mldb_unit_test,query_streaming_test.py))
 $(eval $(call mldb_unit_test,alias_resolving_test.py))
 $(eval $(call mldb_unit_test,MLDB-1753_useragent_function.py))
 $(eval $(call test,MLDB-1742-tabular-dataset-integer-columns,mldb,boost))
@@ -473,6 +483,7 @@ $(eval $(call mldb_unit_test,MLDB-1788_select_col_as_star_err.py))
 $(eval $(call mldb_unit_test,MLDB-1972-fft.js))
 $(eval $(call mldb_unit_test,MLDB-1984-constant-functions.js))
 $(eval $(call mldb_unit_test,union_dataset_test.py))
+$(eval $(call mldb_unit_test,mutable_dataset_compaction_test.py))
 $(eval $(call mldb_unit_test,deepteach_test.py,tensorflow,manual))
 $(eval $(call mldb_unit_test,MLDB-2025-st_contains.py))
 $(eval $(call mldb_unit_test,post_run_and_track_procedure_test.py))
@@ -511,3 +522,75 @@ $(eval $(call mldb_unit_test,MLDB-2181_null_feature_model_test.py))
 $(eval $(call mldb_unit_test,MLDB-2186-empty-array.py))
 $(eval $(call mldb_unit_test,MLDB-2170-csv-excel-formulas.js))
 $(eval $(call mldb_unit_test,MLDB-2168-csv-import-skip-lines.js))
+$(eval $(call mldb_unit_test,tabular_dataset_persistence_test.py))
+$(eval $(call mldb_unit_test,pipeline_batch_execution_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_zone_map_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_morsel_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_column_formats_test.py))
+$(eval $(call mldb_unit_test,group_by_partitioned_merge_test.py))
+$(eval $(call mldb_unit_test,order_by_limit_top_k_test.py))
+$(eval $(call mldb_unit_test,approx_aggregators_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_index_test.py))
+$(eval $(call mldb_unit_test,embedding_ivf_index_test.py))
+$(eval $(call mldb_unit_test,import_text_field_scanning_test.py))
+$(eval $(call mldb_unit_test,scalar_operator_bind_test.py))
+$(eval $(call mldb_unit_test,common_subexpression_test.py))
+$(eval $(call mldb_unit_test,regex_pattern_cache_test.py))
+$(eval $(call mldb_unit_test,word2vec_train_test.py))
+$(eval $(call mldb_unit_test,transposed_dataset_stream_test.py))
+$(eval $(call mldb_unit_test,merged_dataset_stream_test.py))
+$(eval $(call mldb_unit_test,partitioned_dataset_test.py))
+$(eval $(call mldb_unit_test,materialized_dataset_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_index_test.py))
+$(eval $(call mldb_unit_test,transform_max_rows_in_flight_test.py))
+$(eval $(call mldb_unit_test,bucketize_columns_test.py))
+$(eval $(call mldb_unit_test,rolling_tables_test.py))
+$(eval $(call mldb_unit_test,classifier_training_cache_test.py))
+$(eval $(call mldb_unit_test,dataset_column_projection_test.py))
+$(eval $(call mldb_unit_test,dataset_ingest_test.py))
+$(eval $(call mldb_unit_test,unordered_limit_test.py))
+$(eval $(call mldb_unit_test,csv_export_parallel_test.py))
+$(eval $(call mldb_unit_test,function_result_cache_test.py))
+$(eval $(call mldb_unit_test,sql_query_function_lookup_test.py))
+$(eval $(call mldb_unit_test,script_function_batch_test.py))
+$(eval $(call mldb_unit_test,sql_expression_function_inline_test.py))
+$(eval $(call mldb_unit_test,classifier_reload_test.py))
+$(eval $(call mldb_unit_test,query_explain_test.py))
+$(eval $(call mldb_unit_test,sampling_profiler_test.py))
+$(eval $(call mldb_unit_test,trace_events_endpoint_test.py))
+$(eval $(call mldb_unit_test,metrics_endpoint_test.py))
+$(eval $(call mldb_unit_test,query_memory_budget_test.py))
+$(eval $(call mldb_unit_test,plugin_lazy_loading_test.py,tensorflow))
+$(eval $(call mldb_unit_test,beh_mutable_checkpoint_test.py))
+$(eval $(call mldb_unit_test,sqlite_dataset_batch_test.py))
+$(eval $(call mldb_unit_test,archive_member_index_test.py))
+$(eval $(call mldb_unit_test,importtext_multi_file_test.py))
+$(eval $(call mldb_unit_test,continuous_window_in_memory_test.py))
+$(eval $(call mldb_unit_test,embedding_quantized_storage_test.py))
+$(eval $(call mldb_unit_test,randomforest_sparse_columns_test.py))
+$(eval $(call mldb_unit_test,accuracy_score_histogram_test.py))
+$(eval $(call mldb_unit_test,svm_grid_search_test.py))
+$(eval $(call mldb_unit_test,distributed_dataset_test.py))
+$(eval $(call mldb_unit_test,replica_dataset_test.py))
+$(eval $(call mldb_unit_test,join_row_name_lookup_test.py))
+$(eval $(call mldb_unit_test,in_expression_set_test.py))
+$(eval $(call mldb_unit_test,geo_within_join_test.py))
+$(eval $(call mldb_unit_test,embedding_vector_math_test.py))
+$(eval $(call mldb_unit_test,column_expr_name_predicate_test.py))
+$(eval $(call mldb_unit_test,dataset_statistics_cache_test.py))
+
+# End to end benchmark: run macrobenchmark.py at each number of CPUs in
+# MACROBENCHMARK_CPUS, writing a JSON report per run to
+# $(TESTS)/macrobenchmark-<cpus>.json.  MACROBENCHMARK_SCALE sets the size of
+# the generated datasets, in units of 100000 rows.
+MACROBENCHMARK_SCALE ?= 1
+MACROBENCHMARK_CPUS ?= 1 8 $(shell nproc)
+
+macrobenchmark: $(BIN)/mldb_runner $(CWD)/macrobenchmark.py
+	@for cpus in $$(echo $(MACROBENCHMARK_CPUS) | tr ' ' '\n' | sort -nu); do \
+		echo "macrobenchmark with $$cpus CPUs"; \
+		. $(shell readlink -f $(VIRTUALENV))/bin/activate; \
+		NUM_CPUS=$$cpus $(BIN)/mldb_runner -h localhost -p '11700-12700' --run-script $(CWD)/macrobenchmark.py --config-path mldb/container_files/mldb.conf $(MLDB_EXTRA_FLAGS) --script-args '{"scale": $(MACROBENCHMARK_SCALE), "output": "$(TESTS)/macrobenchmark-'$$cpus'.json"}' || exit 1; \
+	done
+
+.PHONY: macrobenchmark
@@ -0,0 +1,27 @@
+#
+# trace_events_endpoint_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the /v1/debug/trace route.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TraceEventsEndpointTest(MldbUnitTest):  # noqa
+
+    def test_trace_json(self):
+        res = mldb.get('/v1/debug/trace', seconds=0.2).json()
+        self.assertIn('traceEvents', res)
+        for event in res['traceEvents']:
+            self.assertIn(event['ph'], ['X', 'M'])
+            self.assertIn('tid', event)
+            if event['ph'] == 'X':
+                self.assertGreaterEqual(event['dur'], 0)
+
+    def test_bad_parameters(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as exc:
+            mldb.get('/v1/debug/trace', seconds=-1)
+        self.assertEqual(exc.exception.response.status_code, 400)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,61 @@
+#
+# transform_max_rows_in_flight_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that a transform that hands over its output chunks as it goes gives
+# the same output as one that records everything before committing.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TransformMaxRowsInFlightTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'input', 'type': 'sparse.mutable'})
+        for i in xrange(5000):
+            ds.record_row('row%d' % i, [['x', i, 0], ['y', i % 7, 0]])
+        ds.commit()
+
+    def transform(self, output, query, outputType, maxRowsInFlight):
+        mldb.post('/v1/procedures', {
+            'type': 'transform',
+            'params': {
+                'inputData': query,
+                'outputDataset': {'id': output, 'type': outputType},
+                'maxRowsInFlight': maxRowsInFlight,
+                'runOnCreation': True
+            }
+        })
+
+    def check(self, query, outputType):
+        self.transform('all_at_once', query, outputType, -1)
+        self.transform('in_flight', query, outputType, 100)
+
+        check = 'select * from %s order by rowName()'
+        self.assertEqual(mldb.query(check % 'in_flight'),
+                         mldb.query(check % 'all_at_once'))
+        return mldb.query('select count(*) from in_flight')[1][1]
+
+    def test_sparse_output(self):
+        self.assertEqual(
+            self.check('select x, y * 2 as z from input', 'sparse.mutable'),
+            5000)
+
+    def test_tabular_output(self):
+        self.assertEqual(
+            self.check('select x, y * 2 as z from input', 'tabular'), 5000)
+
+    def test_where(self):
+        self.assertEqual(
+            self.check('select x from input where y = 3', 'sparse.mutable'),
+            714)
+
+    def test_order_and_limit(self):
+        self.assertEqual(
+            self.check('select x from input order by x limit 250',
+                       'sparse.mutable'),
+            250)
+
+if __name__ == '__main__':
+    mldb.run_tests()
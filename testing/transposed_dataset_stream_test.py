@@ -0,0 +1,62 @@
+#
+# transposed_dataset_stream_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the rows of a transposed dataset are streamed correctly from
+# the columns of the underlying dataset.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TransposedDatasetStreamTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # 2000 columns, so the transposed dataset has enough rows for its
+        # stream to be split up
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for r in range(5):
+            ds.record_row('r%d' % r,
+                          [['c%d' % c, r * 10000 + c, 0]
+                           for c in xrange(2000) if (c + r) % 3 != 0])
+        ds.commit()
+
+        mldb.put('/v1/datasets/tr', {
+            'type': 'transposed',
+            'params': {'dataset': 'ds'}
+        })
+
+    def test_row_count(self):
+        self.assertTableResultEquals(
+            mldb.query("select count(*) as cnt from tr"),
+            [["_rowName", "cnt"],
+             ["[]", 2000]])
+
+    def test_values(self):
+        res = mldb.query("""
+            select r0, r1, r4 from tr where rowName() in ('c0', 'c1', 'c1999')
+            order by rowName()
+        """)
+        self.assertEqual(res, [
+            ["_rowName", "r0", "r1", "r4"],
+            ["c0", None, 10000, 40000],
+            ["c1", 1, None, 40001],
+            ["c1999", 1999, 11999, None]])
+
+    def test_all_rows(self):
+        # Each of the rows of the transposed dataset is seen exactly once
+        res = mldb.query("""
+            select count(*) as cnt, sum(r2) as s from tr
+        """)
+        expected = sum(20000 + c for c in xrange(2000) if (c + 2) % 3 != 0)
+        self.assertEqual(res[1][1:], [2000, expected])
+
+    def test_offset_limit(self):
+        names = [r[0] for r in mldb.query(
+            "select r0 from tr order by rowName()")[1:]]
+        res = mldb.query(
+            "select r0 from tr order by rowName() offset 1500 limit 10")
+        self.assertEqual([r[0] for r in res[1:]], names[1500:1510])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -214,6 +214,52 @@ class UnionDatasetTest(MldbUnitTest):  # noqa
         res = mldb.query("SELECT * FROM union_test_where WHERE colA='123'")
         self.assertEquals(len(res), 1)
 
+    def test_many_partitions(self):
+        # More datasets than there are bits in the column index, with a
+        # column only in the last ones and an empty partition, so that
+        # the rows are streamed in parallel across the partitions
+        datasets = []
+        expected = 0
+        for p in range(40):
+            ds = mldb.create_dataset({'id' : 'part%d' % p,
+                                      'type' : 'sparse.mutable'})
+            for r in range(0 if p == 7 else p * 10):
+                cols = [['x', p * 1000 + r, 1]]
+                if p >= 35:
+                    cols.append(['late', 1, 1])
+                ds.record_row('r%d' % r, cols)
+                expected += p * 1000 + r
+            ds.commit()
+            datasets.append({'id' : 'part%d' % p})
+
+        mldb.put('/v1/datasets/union_parts', {
+            'type' : 'union',
+            'params' : {'datasets' : datasets}
+        })
+
+        res = mldb.query(
+            "SELECT count(*) AS cnt, sum(x) AS s, sum(late) AS l "
+            "FROM union_parts")
+        self.assertEqual(res[1][1:],
+                         [sum(p * 10 for p in range(40) if p != 7),
+                          expected, sum(p * 10 for p in range(35, 40))])
+
+        res = mldb.query(
+            "SELECT x, late FROM union_parts WHERE rowName() = '38.r5'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'x', 'late'],
+            ['38.r5', 38005, 1]
+        ])
+
+        res = mldb.query("SELECT * FROM union_parts WHERE rowName() = '7.r0'")
+        self.assertEqual(len(res), 1)
+
+        cols = mldb.get('/v1/datasets/union_parts/columns').json()
+        self.assertEqual(sorted(cols), ['late', 'x'])
+
+        res = mldb.query("SELECT x FROM union_parts ORDER BY x LIMIT 3")
+        self.assertEqual([r[1] for r in res[1:]], [1000, 1001, 1002])
+
 
 if __name__ == '__main__':
     mldb.run_tests()
@@ -0,0 +1,47 @@
+#
+# unordered_limit_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that a LIMIT without an ORDER BY, which stops scanning once enough
+# rows match, still returns the right number of matching rows.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class UnorderedLimitTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in xrange(20000):
+            ds.record_row('row%d' % i, [['x', i, 0], ['rare', i % 97, 0]])
+        ds.commit()
+
+    def check(self, where, offset, limit, num_matching):
+        res = mldb.query("select x, rare from ds where %s offset %d limit %d"
+                         % (where, offset, limit))
+        expected = max(0, min(limit, num_matching - offset))
+        self.assertEqual(len(res) - 1, expected)
+        names = set(r[0] for r in res[1:])
+        self.assertEqual(len(names), expected)
+        return res
+
+    def test_rare_condition(self):
+        # 207 rows have rare = 3
+        for offset, limit in [(0, 1), (0, 10), (5, 100), (200, 20),
+                              (0, 1000), (300, 10)]:
+            res = self.check("rare = 3", offset, limit, 207)
+            for row in res[1:]:
+                self.assertEqual(row[2], 3)
+                self.assertEqual(row[1] % 97, 3)
+
+    def test_no_match(self):
+        self.check("rare = 100", 0, 10, 0)
+
+    def test_limit_covers_everything(self):
+        res = self.check("rare = 3", 0, 1000, 207)
+        everything = mldb.query("select x, rare from ds where rare = 3")
+        self.assertEqual(sorted(res[1:]), sorted(everything[1:]))
+
+if __name__ == '__main__':
+    mldb.run_tests()
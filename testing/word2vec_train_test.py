@@ -0,0 +1,75 @@
+#
+# word2vec_train_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the word2vec.train procedure on a corpus of a few unrelated
+# topics, whose words should end up close to each other.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class Word2VecTrainTest(MldbUnitTest):  # noqa
+
+    topics = [['%s%d' % (name, i) for i in xrange(20)]
+              for name in ['fruit', 'planet', 'river']]
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(0)
+        ds = mldb.create_dataset({'id': 'corpus', 'type': 'tabular'})
+        for i in xrange(3000):
+            topic = cls.topics[i % len(cls.topics)]
+            text = ' '.join(random.choice(topic) for _ in xrange(15))
+            ds.record_row('doc%d' % i, [['text', text, 0]])
+        ds.commit()
+
+    def train(self, model, rate):
+        output = 'w2v_' + model
+        res = mldb.post('/v1/procedures', {
+            'type': 'word2vec.train',
+            'params': {
+                'trainingData': 'SELECT text FROM corpus',
+                'outputDataset': output,
+                'model': model,
+                'learningRate': rate,
+                'dimensions': 16,
+                'runOnCreation': True
+            }
+        }).json()
+        self.assertEqual(res['status']['firstRun']['status'],
+                         {'vocabularySize': 60, 'trainingWords': 45000})
+
+        mldb.put('/v1/functions/nn_' + model, {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': output, 'defaultNumNeighbors': 10}
+        })
+
+        # The nearest neighbours of each word are from its own topic
+        for topic in self.topics:
+            res = mldb.query("SELECT nn_%s({coords: '%s'})[neighbors] as *"
+                             % (model, topic[0]))
+            self.assertEqual(set(res[1][1:]) - set(topic), set(), res)
+
+    def test_skip_gram(self):
+        self.train('skipGram', 0.025)
+
+    def test_cbow(self):
+        self.train('cbow', 0.05)
+
+    def test_min_count(self):
+        msg = 'No word occurs at least minCount times'
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.post('/v1/procedures', {
+                'type': 'word2vec.train',
+                'params': {
+                    'trainingData': 'SELECT text FROM corpus',
+                    'outputDataset': 'w2v_none',
+                    'minCount': 1000000,
+                    'runOnCreation': True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
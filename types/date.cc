@@ -13,6 +13,8 @@
 #include "mldb/arch/format.h"
 #include "mldb/ext/jsoncpp/json.h"
 #include "mldb/base/parse_context.h"
+#include "mldb/base/fast_float_parsing.h"
+#include "mldb/base/fast_int_parsing.h"
 #include <cmath>
 #include "mldb/arch/exception.h"
 #include "dtoa.h"
@@ -87,6 +89,180 @@ expectFixedWidthInt(ParseContext & context,
 const boost::posix_time::ptime
 epoch(boost::gregorian::date(1970, 1, 1));
 
+/// Day of the year (counting from 0 on the 1st of March) on which each
+/// month starts
+const int daysBeforeMonthFromMarch[12] = {
+    306, 337, 0, 31, 61, 92, 122, 153, 184, 214, 245, 275
+};
+
+/** Number of days from 1970-01-01 to the given date of the proleptic
+    Gregorian calendar.  Years are counted from March, so that the leap day
+    is at the end of the year and the day of the year only depends on the
+    month.  The year must not be negative.
+*/
+int64_t daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int era = year / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = daysBeforeMonthFromMarch[month - 1] + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100
+        + dayOfYear;
+    return int64_t(era) * 146097 + dayOfEra - 719468;
+}
+
+/** Inverse of daysFromCivil(), for any number of days. */
+void civilFromDays(int64_t days, int & year, int & month, int & day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int dayOfEra = int(days - era * 146097);
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524
+                     - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4
+                                - yearOfEra / 100);
+    int monthFromMarch = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * monthFromMarch + 2) / 5 + 1;
+    month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+    year = int(yearOfEra + era * 400 + (month <= 2));
+}
+
+int daysInMonth(int year, int month)
+{
+    static const int days[12] = {
+        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+    };
+    if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+        return 29;
+    return days[month - 1];
+}
+
+/** Do the eight characters loaded into word match the pattern, where a '0'
+    in the pattern (marked in digitMask) matches any digit and anything else
+    has to match exactly?  All eight are checked at once.
+*/
+inline bool matchesPattern(uint64_t word, uint64_t pattern, uint64_t digitMask)
+{
+    uint64_t x = word ^ pattern;
+    return (x & ~digitMask) == 0
+        && (x & 0xF0F0F0F0F0F0F0F0) == 0
+        && ((x + (0x0606060606060606 & digitMask)) & 0xF0F0F0F0F0F0F0F0) == 0;
+}
+
+inline int twoDigits(const char * p)
+{
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/** Parse the shapes of ISO 8601 date that are by far the most common,
+    YYYY-MM-DDTHH:MM:SS with optional fractional seconds and an optional
+    'Z' (a space instead of the 'T' is also accepted), without going
+    through a ParseContext.  Returns false for anything else, including
+    invalid dates, so that Iso8601Parser can deal with it; when it returns
+    true the result is exactly what Iso8601Parser would have given.
+*/
+bool parseCommonIso8601DateTime(const char * p, size_t len, Date & date)
+{
+    if (len < 19)
+        return false;
+
+    char dateAndTime[16];
+    memcpy(dateAndTime, p + 3, 16);
+    if (dateAndTime[7] == ' ')
+        dateAndTime[7] = 'T';
+
+    // "YYYY-MM-" at 0, "DDTHH:MM" at 8 and "HH:MM:SS" at 11
+    if (!matchesPattern(loadEightBytes(p),
+                        loadEightBytes("0000-00-"), 0x00FFFF00FFFFFFFF)
+        || !matchesPattern(loadEightBytes(dateAndTime + 5),
+                           loadEightBytes("00T00:00"), 0xFFFF00FFFF00FFFF)
+        || !matchesPattern(loadEightBytes(dateAndTime + 8),
+                           loadEightBytes("00:00:00"), 0xFFFF00FFFF00FFFF))
+        return false;
+
+    int year = twoDigits(p) * 100 + twoDigits(p + 2);
+    int month = twoDigits(p + 5);
+    int day = twoDigits(p + 8);
+    int hour = twoDigits(p + 11);
+    int minute = twoDigits(p + 14);
+    int second = twoDigits(p + 17);
+
+    // Same limits as Iso8601Parser; invalid days make it throw
+    if (year < 1400 || month < 1 || month > 12 || day < 1
+        || day > daysInMonth(year, month)
+        || hour > 23 || minute > 59 || second > 60)
+        return false;
+
+    int64_t seconds = daysFromCivil(year, month, day) * 86400
+        + hour * 3600 + minute * 60 + second;
+
+    const char * e = p + len;
+    p += 19;
+
+    double result = seconds;
+    if (p != e && *p == '.') {
+        // As for Iso8601Parser, the result is the nearest double to the
+        // whole number of seconds with the fractional digits after it,
+        // which is only what we want after the epoch
+        const char * digits = ++p;
+        while (p != e && *p >= '0' && *p <= '9')
+            ++p;
+        if (p == digits || seconds < 0)
+            return false;
+
+        DecimalNumber number;
+        char wholeDigits[24];
+        int numWholeDigits = snprintf(wholeDigits, sizeof(wholeDigits),
+                                      "%lld", (long long)seconds);
+        for (int i = 0;  i < numWholeDigits;  ++i)
+            number.addIntegerDigit(wholeDigits[i] - '0');
+        for (const char * d = digits;  d != p;  ++d)
+            number.addFractionDigit(*d - '0');
+        if (!decimalToDouble(number, result))
+            return false;
+    }
+
+    if (p != e && *p == 'Z')
+        ++p;
+    if (p != e)
+        return false;
+
+    date = Date::fromSecondsSinceEpoch(result);
+    return true;
+}
+
+/** Write the whole seconds since the epoch as YYYY-MM-DDTHH:MM:SS, as
+    strftime() does.  Only years 1000 to 9999 are written, since strftime()
+    doesn't pad the others to four digits; nullptr is returned for them.
+*/
+char * writeIso8601DateTime(char * p, int64_t seconds)
+{
+    int64_t days = (seconds >= 0 ? seconds : seconds - 86399) / 86400;
+    int secondOfDay = int(seconds - days * 86400);
+
+    int year, month, day;
+    civilFromDays(days, year, month, day);
+    if (year < 1000 || year > 9999)
+        return nullptr;
+
+    auto writeTwo = [&] (int val, char after)
+        {
+            *p++ = '0' + val / 10;
+            *p++ = '0' + val % 10;
+            if (after)
+                *p++ = after;
+        };
+
+    writeTwo(year / 100, 0);
+    writeTwo(year % 100, '-');
+    writeTwo(month, '-');
+    writeTwo(day, 'T');
+    writeTwo(secondOfDay / 3600, ':');
+    writeTwo(secondOfDay / 60 % 60, ':');
+    writeTwo(secondOfDay % 60, 0);
+    return p;
+}
+
 }
 
 namespace MLDB {
@@ -195,6 +371,9 @@ parseIso8601DateTime(const std::string & dateTimeStr)
         return negativeInfinity();
     else {
         Date date;
+        if (parseCommonIso8601DateTime(dateTimeStr.c_str(),
+                                       dateTimeStr.length(), date))
+            return date;
         Iso8601Parser parser(dateTimeStr);
         if (!parser.matchDateTime(date))
             return notADate();
@@ -316,6 +495,66 @@ static void addFractionalSeconds(std::string & result,
                              seconds_digits);
 }
 
+/** Same as addFractionalSeconds(), but writing into the buffer between p
+    and end.  Returns the end of what was written, or nullptr if it doesn't
+    fit.
+*/
+static char * writeFractionalSeconds(char * p, char * end,
+                                     double full_seconds,
+                                     int seconds_digits)
+{
+    if (seconds_digits == 0)
+        return p;
+
+    if (seconds_digits == -1) {
+        int decpt;
+        int sign;
+        char * digitsEnd;
+
+        char * digits = soa_dtoa(full_seconds, 1, -1 /* ndigits */,
+                                 &decpt, &sign, &digitsEnd);
+        int numDigits = digitsEnd - digits;
+
+        // A number less than one has zeros after the point
+        int numZeros = decpt < 0 ? -decpt : 0;
+        const char * fractional = digits + (decpt > 0 ? decpt : 0);
+
+        if (decpt >= numDigits || (numDigits == 1 && digits[0] == '0')) {
+            soa_freedtoa(digits);
+            return p;  // no extra digits
+        }
+
+        if (end - p < 1 + numZeros + (digitsEnd - fractional)) {
+            soa_freedtoa(digits);
+            return nullptr;
+        }
+
+        *p++ = '.';
+        p = std::fill_n(p, numZeros, '0');
+        p = std::copy(fractional, (const char *)digitsEnd, p);
+        soa_freedtoa(digits);
+        return p;
+    }
+    else if (seconds_digits > 0) {
+        double whole_seconds;
+        double partial_seconds = modf(full_seconds >= 0
+                                      ? full_seconds : -full_seconds,
+                                      &whole_seconds);
+
+        char fractional[64];
+        int len = snprintf(fractional, sizeof(fractional), "%.*f",
+                           seconds_digits, partial_seconds);
+        if (len >= sizeof(fractional) || end - p < len - 1)
+            return nullptr;
+        if (strcmp(fractional, "0.0") == 0)
+            return p;
+        // Remove the leading "0" and append
+        return std::copy(fractional + 1, fractional + len, p);
+    }
+    else throw MLDB::Exception("Unknown seconds_digits argument %d to Date::printIso8601()",
+                             seconds_digits);
+}
+
 std::string
 Date::
 print(int seconds_digits) const
@@ -359,10 +598,57 @@ printRfc2616() const
     return print("%a, %d %b %Y %H:%M:%S GMT");
 }
 
+size_t
+Date::
+printIso8601(char * buffer, int seconds_digits) const
+{
+    auto write = [&] (const char * str)
+        {
+            return std::copy(str, str + strlen(str) + 1, buffer) - buffer - 1;
+        };
+
+    if (!std::isfinite(secondsSinceEpoch_)) {
+        if (std::isnan(secondsSinceEpoch_)) {
+            return write("NaD");
+        }
+        else if (secondsSinceEpoch_ > 0) {
+            return write("Inf");
+        }
+        else return write("-Inf");
+    }
+
+    // Same limits as print()
+    if (secondsSinceEpoch_ >= 100000000000) {
+        return write("Inf");
+    }
+    if (secondsSinceEpoch_ <= -1000000000000) {
+        return write("-Inf");
+    }
+
+    // Truncated towards zero as the time_t in print()
+    char * p = writeIso8601DateTime(buffer, (int64_t)secondsSinceEpoch_);
+    if (!p)
+        return 0;
+
+    p = writeFractionalSeconds(p, buffer + ISO8601_BUFFER_SIZE - 2,
+                               secondsSinceEpoch_, seconds_digits);
+    if (!p)
+        return 0;
+
+    *p++ = 'Z';
+    *p = 0;
+    return p - buffer;
+}
+
 std::string
 Date::
 printIso8601(int seconds_digits) const
 {
+    char buffer[ISO8601_BUFFER_SIZE];
+    size_t len = printIso8601(buffer, seconds_digits);
+    if (len)
+        return std::string(buffer, buffer + len);
+
     if (!std::isfinite(secondsSinceEpoch_)) {
         if (std::isnan(secondsSinceEpoch_)) {
             return "NaD";
@@ -1965,7 +2251,11 @@ DateDescription::
 printJsonTyped(const Date * val,
                             JsonPrintingContext & context) const
 {
-    context.writeJson(val->printIso8601());//val->secondsSinceEpoch());
+    char buffer[Date::ISO8601_BUFFER_SIZE];
+    size_t len = val->printIso8601(buffer, -1);
+    if (len)
+        context.writeString(buffer, len);
+    else context.writeJson(val->printIso8601());
 }
 
 bool
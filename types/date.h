@@ -121,6 +121,18 @@ struct Date {
     std::string print(int seconds_digits = -1) const;
     std::string print(const std::string & format) const;
     std::string printIso8601(int seconds_digits = -1) const;
+
+    /// Size of the buffer needed by printIso8601(char *, int)
+    static constexpr size_t ISO8601_BUFFER_SIZE = 64;
+
+    /** Print the same as printIso8601(int) into the given buffer, which
+        must be at least ISO8601_BUFFER_SIZE characters long, without
+        allocating.  Returns the number of characters written, not
+        including the terminating nul, or zero for the rare dates that need
+        the other one (years before 1000, or too many fractional digits to
+        fit).
+    */
+    size_t printIso8601(char * buffer, int seconds_digits) const;
     std::string printRfc2616() const;
     std::string printClassic() const;
 
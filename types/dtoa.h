@@ -10,6 +10,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdio>
 #include <string>
 
 extern "C" {
@@ -63,48 +65,81 @@ soa_strtod(const char *s00, char **se);
 
 namespace MLDB {
 
-inline std::string dtoa(double floatVal)
+/** Size of the buffer needed for dtoa() below to print any double,
+    including the terminating nul character.
+*/
+constexpr size_t DTOA_BUFFER_SIZE = 32;
+
+/** Print the given number into the given buffer, which must be at least
+    DTOA_BUFFER_SIZE characters long, in the same format as dtoa(double).
+    Returns the number of characters written, not including the
+    terminating nul.  Nothing is allocated, so it can be used to print
+    large amounts of numbers.
+*/
+inline size_t dtoa(double floatVal, char * buffer)
 {
+    char * p = buffer;
+
     // if exactly 0 then return 0.0
-    if (floatVal == 0.0)
-        return "0.0";
+    if (floatVal == 0.0) {
+        *p++ = '0';  *p++ = '.';  *p++ = '0';
+        *p = 0;
+        return p - buffer;
+    }
 
     // Use dtoa to make sure we print a value that will be converted
     // back to the same on input, without printing more digits than
     // necessary.
     int decpt;
     int sign;
+    char * end;
+
+    char * digits = soa_dtoa(floatVal, 1, -1 /* ndigits */,
+                             &decpt, &sign, &end);
+    int numDigits = end - digits;
+
+    if (sign)
+        *p++ = '-';
 
-    char * result = soa_dtoa(floatVal, 1, -1 /* ndigits */,
-                             &decpt, &sign, nullptr);
-    std::string toReturn(result);
-    soa_freedtoa(result);
-
-    //cerr << "decpt = " << decpt << " sign = " << sign
-    //     << " result = " << toReturn << " val = " << floatVal
-    //     << endl;
-    if (decpt > 0 && decpt <= toReturn.size())
-        toReturn.insert(decpt, ".");
-    else if (decpt == 9999)
-        ;
+    if (decpt > 0 && decpt <= numDigits) {
+        p = std::copy(digits, digits + decpt, p);
+        *p++ = '.';
+        p = std::copy(digits + decpt, end, p);
+    }
+    else if (decpt == 9999) {
+        p = std::copy(digits, end, p);
+    }
     else if (decpt <= 0 && decpt > -6) {
-        toReturn.insert(0, "0.");
-        for (unsigned i = 0;  i < -decpt;  ++i)
-            toReturn.insert(2, "0");
+        *p++ = '0';  *p++ = '.';
+        p = std::fill_n(p, -decpt, '0');
+        p = std::copy(digits, end, p);
     }
     else {
-        if (toReturn.size() > 1)
-            toReturn.insert(1, ".");
-        toReturn += "e" + std::to_string(decpt - 1);
+        *p++ = digits[0];
+        if (numDigits > 1) {
+            *p++ = '.';
+            p = std::copy(digits + 1, end, p);
+        }
+        p += sprintf(p, "e%d", decpt - 1);
     }
-        
-    if (sign)
-        toReturn.insert(0, "-");
 
-    if (toReturn[toReturn.length() - 1] == '.')
-        toReturn += '0';
+    soa_freedtoa(digits);
 
-    return toReturn;
+    if (p[-1] == '.')
+        *p++ = '0';
+    *p = 0;
+
+    return p - buffer;
+}
+
+/** Print the given number as a string, with the precision necessary to
+    preserve its binary representation.
+*/
+inline std::string dtoa(double floatVal)
+{
+    char buffer[DTOA_BUFFER_SIZE];
+    size_t len = dtoa(floatVal, buffer);
+    return std::string(buffer, buffer + len);
 }
 
 
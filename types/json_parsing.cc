@@ -11,6 +11,7 @@
 #include "string.h"
 #include "value_description.h"
 #include "mldb/base/parse_context.h"
+#include "mldb/base/fast_float_parsing.h"
 #include "mldb/ext/jsoncpp/json.h"
 
 
@@ -629,10 +630,8 @@ JsonNumber expectJsonNumber(ParseContext & context)
 
     auto parseAsDouble = [&] ()
         {
-            char * endptr = 0;
-            errno = 0;
-            result.fp = strtod(number.c_str(), &endptr);
-            if ((errno && errno != ERANGE) || endptr != number.c_str() + number.length())
+            const char * end = number.c_str() + number.length();
+            if (parseDecimalDouble(number.c_str(), end, result.fp) != end)
                 context.exception(MLDB::format("failed to convert '%s' to double",
                                              number.c_str()));
             result.type = JsonNumber::FLOATING_POINT;
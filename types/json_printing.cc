@@ -770,8 +770,10 @@ void
 StringJsonPrintingContext::
 writeFloat(float f)
 {
-    if (std::isfinite(f))
-        str += MLDB::dtoa(f);
+    if (std::isfinite(f)) {
+        char buffer[DTOA_BUFFER_SIZE];
+        write(buffer, MLDB::dtoa(f, buffer));
+    }
     else {
         write('"');
         write(std::to_string(f));
@@ -783,8 +785,10 @@ void
 StringJsonPrintingContext::
 writeDouble(double d)
 {
-    if (std::isfinite(d))
-        str += MLDB::dtoa(d);
+    if (std::isfinite(d)) {
+        char buffer[DTOA_BUFFER_SIZE];
+        write(buffer, MLDB::dtoa(d, buffer));
+    }
     else {
         write('"');
         write(std::to_string(d));
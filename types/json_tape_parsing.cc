@@ -0,0 +1,1273 @@
+/** json_tape_parsing.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Two-stage parser for JSON documents that are held in memory.
+*/
+
+#include "json_tape_parsing.h"
+#include "json_parsing_impl.h"
+#include "string.h"
+#include "value_description.h"
+#include "mldb/base/parse_context.h"
+#include "mldb/base/fast_float_parsing.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <iterator>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Flags in JsonTape::ends telling what's in a string
+constexpr uint32_t STRING_HAS_ESCAPES = 1u << 31;
+constexpr uint32_t STRING_HAS_NON_ASCII = 1u << 30;
+constexpr uint32_t END_OFFSET_MASK = STRING_HAS_NON_ASCII - 1;
+
+constexpr uint64_t ONES = 0x0101010101010101ULL;
+constexpr uint64_t HIGHS = 0x8080808080808080ULL;
+
+/// Non-zero if any byte of v is zero.  The lowest set bit is always in
+/// the first zero byte; there may be spurious bits above it.
+inline uint64_t zeroBytes(uint64_t v)
+{
+    return (v - ONES) & ~v & HIGHS;
+}
+
+/// Non-zero if any of the eight bytes of v needs looking at inside of a
+/// string: a quote, a backslash or anything from DEL upwards.  As with
+/// zeroBytes(), the lowest set bit is in the first one of those.
+inline uint64_t specialStringBytes(uint64_t v)
+{
+    return zeroBytes(v ^ (ONES * '"'))
+        | zeroBytes(v ^ (ONES * '\\'))
+        | zeroBytes(v ^ (ONES * 0x7f))
+        | (v & HIGHS);
+}
+
+int hex4(const char * p, const char * e)
+{
+    if (e - p < 4)
+        return -1;
+    int result = 0;
+    for (unsigned i = 0;  i < 4;  ++i) {
+        int c = p[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else return -1;
+        result = (result << 4) | digit;
+    }
+    return result;
+}
+
+/** Length of the escape sequence starting with the backslash at p, or zero
+    if the streaming parser would reject it.  Surrogate pairs count as a
+    single escape.
+*/
+size_t escapeLength(const char * p, const char * e)
+{
+    if (e - p < 2)
+        return 0;
+    switch (p[1]) {
+    case '"': case '\\': case '/':
+    case 'b': case 'f': case 'n': case 'r': case 't':
+        return 2;
+    case 'u': {
+        int code = hex4(p + 2, e);
+        if (code < 0)
+            return 0;
+        if (code < 0xd800 || code > 0xdfff)
+            return 6;
+        if (e - p < 12 || p[6] != '\\' || p[7] != 'u')
+            return 0;
+        int low = hex4(p + 8, e);
+        if (low < 0xdc00 || low > 0xdfff)
+            return 0;
+        return 12;
+    }
+    default:
+        return 0;
+    }
+}
+
+/** Scan the body of a string, starting just after its opening quote.
+    Returns the offset of the closing quote, or -1 if the string isn't
+    terminated or has an invalid escape.  Flags gets STRING_HAS_ESCAPES and
+    STRING_HAS_NON_ASCII as needed.
+*/
+ssize_t scanString(const char * data, size_t pos, size_t length,
+                   uint32_t & flags)
+{
+    const char * e = data + length;
+
+    for (;;) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // Skip eight bytes at a time until one needs a closer look
+        while (pos + 8 <= length) {
+            uint64_t v;
+            memcpy(&v, data + pos, 8);
+            uint64_t special = specialStringBytes(v);
+            if (special) {
+                pos += __builtin_ctzll(special) / 8;
+                break;
+            }
+            pos += 8;
+        }
+#endif
+        if (pos >= length)
+            return -1;
+
+        unsigned char c = data[pos];
+        if (c == '"')
+            return pos;
+        if (c == '\\') {
+            flags |= STRING_HAS_ESCAPES;
+            size_t len = escapeLength(data + pos, e);
+            if (!len)
+                return -1;
+            pos += len;
+        }
+        else {
+            if (c >= 0x7f)
+                flags |= STRING_HAS_NON_ASCII;
+            ++pos;
+        }
+    }
+}
+
+inline bool isScalarEnd(char c)
+{
+    switch (c) {
+    case ' ': case '\t': case '\n': case '\r':
+    case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** Classify a scalar into one of the types on the tape.  Returns false
+    for anything that isn't a literal or a plain number (including numbers
+    too long for match_float()), which the streaming parser has to deal
+    with.
+*/
+bool classifyScalar(const char * p, const char * e, JsonTape::Type & type)
+{
+    size_t len = e - p;
+    if (len == 4 && memcmp(p, "true", 4) == 0) {
+        type = JsonTape::TRUE_VALUE;
+        return true;
+    }
+    if (len == 5 && memcmp(p, "false", 5) == 0) {
+        type = JsonTape::FALSE_VALUE;
+        return true;
+    }
+    if (len == 4 && memcmp(p, "null", 4) == 0) {
+        type = JsonTape::NULL_VALUE;
+        return true;
+    }
+    if (len >= 255)
+        return false;
+
+    auto digits = [&] () -> bool
+        {
+            const char * start = p;
+            while (p != e && *p >= '0' && *p <= '9')
+                ++p;
+            return p != start;
+        };
+
+    type = JsonTape::INTEGER;
+    if (p != e && *p == '-')
+        ++p;
+    if (!digits())
+        return false;
+    if (p != e && *p == '.') {
+        ++p;
+        if (!digits())
+            return false;
+        type = JsonTape::NUMBER;
+    }
+    if (p != e && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p != e && (*p == '+' || *p == '-'))
+            ++p;
+        if (!digits())
+            return false;
+        type = JsonTape::NUMBER;
+    }
+    return p == e;
+}
+
+/** Decode the body of a string with escapes the same way as
+    expectJsonStringUtf8(), or, if ascii is set, expectJsonStringAscii().
+    Returns false if the streaming parser needs to do it, either because
+    it would throw or because the string isn't valid UTF-8.
+*/
+bool decodeEscapedString(const char * p, const char * e, bool ascii,
+                         std::string & result)
+{
+    result.clear();
+    result.reserve(e - p);
+    bool nonAscii = false;
+
+    while (p != e) {
+        int c = (unsigned char)*p;
+        if (c != '\\') {
+            if (c >= 0x80) {
+                if (ascii)
+                    return false;
+                nonAscii = true;
+            }
+            else if (c == 0x7f && ascii)
+                return false;
+            result.push_back(*p++);
+            continue;
+        }
+
+        // Escapes have already been validated by the first stage
+        ++p;
+        c = *p++;
+        switch (c) {
+        case 't': c = '\t';  break;
+        case 'n': c = '\n';  break;
+        case 'r': c = '\r';  break;
+        case 'f': c = '\f';  break;
+        case 'b': c = '\b';  break;
+        case '/': c = '/';   break;
+        case '\\':c = '\\';  break;
+        case '"': c = '"';   break;
+        case 'u': {
+            int code = hex4(p, e);
+            p += 4;
+            if (ascii) {
+                if (code >= 127)
+                    return false;
+                c = code;
+                break;
+            }
+            if (code >= 0xd800 && code <= 0xdfff) {
+                // Combined the same way as getEscapedJsonCharacterPointUtf8()
+                int low = hex4(p + 2, e);
+                p += 6;
+                c = (code - 0xd800) << 10 | (low - 0xdc00);
+            }
+            else c = code;
+            break;
+        }
+        default:
+            return false;
+        }
+
+        if (c < ' ' || c >= 127)
+            utf8::append(c, std::back_inserter(result));
+        else result.push_back(c);
+    }
+
+    return !nonAscii || utf8::is_valid(result.begin(), result.end());
+}
+
+/// Keeps track of the character that closes the object or array that
+/// we're in
+struct Nesting {
+    Nesting(std::vector<char> & closers, char closer)
+        : closers(closers)
+    {
+        closers.push_back(closer);
+    }
+
+    ~Nesting()
+    {
+        closers.pop_back();
+    }
+
+    std::vector<char> & closers;
+};
+
+/* Same as the trim() in json_parsing.cc, for printCurrent(). */
+std::string trim(const std::string & other)
+{
+    size_t start = other.find_first_not_of(" \t");
+    if (start == std::string::npos)
+        return std::string();
+    size_t end = other.find_last_not_of(" \t");
+    return other.substr(start, end + 1 - start);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* JSON TAPE                                                                 */
+/*****************************************************************************/
+
+JsonTape::
+JsonTape()
+    : data(nullptr), length(0)
+{
+}
+
+bool
+JsonTape::
+index(const char * start, size_t length)
+{
+    this->data = start;
+    this->length = length;
+    entries.clear();
+
+    if (length >= END_OFFSET_MASK)
+        return false;
+
+    return findStructurals() && buildTape();
+}
+
+bool
+JsonTape::
+findStructurals()
+{
+    structurals.clear();
+    ends.clear();
+
+    size_t pos = 0;
+    while (pos < length) {
+        char c = data[pos];
+        switch (c) {
+        case ' ': case '\t': case '\n':
+            ++pos;
+            continue;
+
+        case '\r':
+            // skipJsonWhitespace() only knows about \r next to a \n
+            if ((pos + 1 < length && data[pos + 1] == '\n')
+                || (pos > 0 && data[pos - 1] == '\n')) {
+                ++pos;
+                continue;
+            }
+            return false;
+
+        case '{': case '}': case '[': case ']': case ':': case ',':
+            structurals.push_back(pos);
+            ++pos;
+            continue;
+
+        case '"': {
+            structurals.push_back(pos);
+            uint32_t flags = 0;
+            ssize_t close = scanString(data, pos + 1, length, flags);
+            if (close == -1)
+                return false;
+            pos = close + 1;
+            ends.push_back(pos | flags);
+            continue;
+        }
+
+        default: {
+            structurals.push_back(pos);
+            ++pos;
+            while (pos < length && !isScalarEnd(data[pos]))
+                ++pos;
+            ends.push_back(pos);
+        }
+        }
+    }
+
+    return true;
+}
+
+bool
+JsonTape::
+buildTape()
+{
+    open.clear();
+    entries.reserve(structurals.size());
+
+    enum State {
+        VALUE,
+        VALUE_OR_CLOSE,
+        KEY,
+        KEY_OR_CLOSE,
+        COLON,
+        COMMA_OR_CLOSE,
+        DONE
+    } state = VALUE;
+
+    size_t numEnds = 0;
+
+    auto afterValue = [&] ()
+        {
+            state = open.empty() ? DONE : COMMA_OR_CLOSE;
+        };
+
+    auto close = [&] (uint32_t ofs, Type type) -> bool
+        {
+            if (open.empty() || entries[open.back()].type != type)
+                return false;
+            Entry & entry = entries[open.back()];
+            entry.end = ofs + 1;
+            entry.next = entries.size();
+            open.pop_back();
+            afterValue();
+            return true;
+        };
+
+    for (uint32_t ofs: structurals) {
+        char c = data[ofs];
+        bool isKey = false;
+
+        switch (state) {
+        case DONE:
+            return false;
+        case COLON:
+            if (c != ':')
+                return false;
+            state = VALUE;
+            continue;
+        case COMMA_OR_CLOSE:
+            if (c == ',') {
+                state = entries[open.back()].type == OBJECT ? KEY : VALUE;
+                continue;
+            }
+            if (c == '}') {
+                if (!close(ofs, OBJECT))
+                    return false;
+                continue;
+            }
+            if (c == ']') {
+                if (!close(ofs, ARRAY))
+                    return false;
+                continue;
+            }
+            return false;
+        case KEY_OR_CLOSE:
+            if (c == '}') {
+                if (!close(ofs, OBJECT))
+                    return false;
+                continue;
+            }
+            // fall through
+        case KEY:
+            if (c != '"')
+                return false;
+            isKey = true;
+            break;
+        case VALUE_OR_CLOSE:
+            if (c == ']') {
+                if (!close(ofs, ARRAY))
+                    return false;
+                continue;
+            }
+            break;
+        case VALUE:
+            break;
+        }
+
+        // A value (or a key) starts here
+        Entry entry;
+        entry.start = ofs;
+        entry.next = entries.size() + 1;
+
+        switch (c) {
+        case '{':
+        case '[':
+            entry.end = 0;  // filled in when it's closed
+            entry.type = c == '{' ? OBJECT : ARRAY;
+            open.push_back(entries.size());
+            entries.push_back(entry);
+            state = c == '{' ? KEY_OR_CLOSE : VALUE_OR_CLOSE;
+            continue;
+
+        case '}': case ']': case ':': case ',':
+            return false;
+
+        case '"': {
+            uint32_t end = ends[numEnds++];
+            entry.end = end & END_OFFSET_MASK;
+            if (end & STRING_HAS_ESCAPES)
+                entry.type = STRING_ESCAPED;
+            else if (end & STRING_HAS_NON_ASCII)
+                entry.type = STRING_UTF8;
+            else entry.type = STRING;
+            break;
+        }
+
+        default:
+            entry.end = ends[numEnds++];
+            if (!classifyScalar(data + entry.start, data + entry.end,
+                                entry.type))
+                return false;
+        }
+
+        entries.push_back(entry);
+
+        if (isKey)
+            state = COLON;
+        else afterValue();
+    }
+
+    return state == DONE;
+}
+
+
+/*****************************************************************************/
+/* TAPE JSON PARSING CONTEXT                                                 */
+/*****************************************************************************/
+
+TapeJsonParsingContext::
+TapeJsonParsingContext(const std::string & filename,
+                       const JsonTape & tape,
+                       unsigned line, unsigned col)
+    : tape(tape), filename(filename), line(line), col(col),
+      current(0), depth(0)
+{
+}
+
+TapeJsonParsingContext::
+~TapeJsonParsingContext()
+{
+}
+
+JsonTape::Type
+TapeJsonParsingContext::
+currentType() const
+{
+    return tape.entries[current].type;
+}
+
+StreamingJsonParsingContext &
+TapeJsonParsingContext::
+slowPath() const
+{
+    size_t offset = current < tape.entries.size()
+        ? tape.entries[current].start : tape.length;
+
+    if (!slowContext || slowContext->get_offset() > offset) {
+        slowContext.reset(new ParseContext(filename, tape.data, tape.length,
+                                           line, col));
+        slowParser.reset(new StreamingJsonParsingContext(*slowContext));
+    }
+
+    while (slowContext->get_offset() < offset)
+        ++(*slowContext);
+
+    return *slowParser;
+}
+
+void
+TapeJsonParsingContext::
+finishSlowPath()
+{
+    if (current >= tape.entries.size())
+        return;
+
+    // Usually the streaming parser has either consumed the whole value,
+    // or nothing (a match that failed)
+    const JsonTape::Entry & entry = tape.entries[current];
+    size_t offset = slowContext->get_offset();
+    if (offset == entry.start)
+        return;
+    if (offset != entry.end && !closers.empty()) {
+        // The streaming parser would carry on from the middle of the
+        // value, and fail where the enclosing object or array expects a
+        // separator.  At the top level, it would leave the rest alone.
+        skipJsonWhitespace(*slowContext);
+        slowContext->expect_literal(closers.back());
+    }
+    current = entry.next;
+}
+
+bool
+TapeJsonParsingContext::
+decodeString(bool ascii, std::string & result) const
+{
+    if (current >= tape.entries.size())
+        return false;
+
+    const JsonTape::Entry & entry = tape.entries[current];
+    const char * p = tape.data + entry.start + 1;
+    const char * e = tape.data + entry.end - 1;
+
+    switch (entry.type) {
+    case JsonTape::STRING:
+        result.assign(p, e);
+        return true;
+    case JsonTape::STRING_UTF8:
+        if (ascii || !utf8::is_valid(p, e))
+            return false;
+        result.assign(p, e);
+        return true;
+    case JsonTape::STRING_ESCAPED:
+        return decodeEscapedString(p, e, ascii, result);
+    default:
+        return false;
+    }
+}
+
+void
+TapeJsonParsingContext::
+expectKey(std::string & key)
+{
+    if (decodeString(false, key)) {
+        ++current;
+        return;
+    }
+
+    // Same as StreamingJsonParsingContext::expectJsonObjectUtf8()
+    StreamingJsonParsingContext & slow = slowPath();
+    char keyBuffer[1024];
+    ssize_t done = slow.expectStringUtf8(keyBuffer, 1024);
+    if (done != -1)
+        key = keyBuffer;
+    else key = slow.expectStringUtf8().rawString();
+    finishSlowPath();
+}
+
+bool
+TapeJsonParsingContext::
+fastInteger(long long & val, long long min, long long max,
+            bool allowNegative)
+{
+    if (current >= tape.entries.size() || currentType() != JsonTape::INTEGER)
+        return false;
+
+    const JsonTape::Entry & entry = tape.entries[current];
+    const char * p = tape.data + entry.start;
+    const char * e = tape.data + entry.end;
+
+    bool negative = *p == '-';
+    if (negative) {
+        if (!allowNegative)
+            return false;
+        ++p;
+    }
+
+    // Anything that could overflow is left to the streaming parser
+    if (e - p > 18)
+        return false;
+
+    long long result = 0;
+    for (;  p != e;  ++p)
+        result = result * 10 + (*p - '0');
+    if (negative)
+        result = -result;
+
+    if (result < min || result > max)
+        return false;
+
+    val = result;
+    ++current;
+    return true;
+}
+
+bool
+TapeJsonParsingContext::
+fastDouble(double & val)
+{
+    if (current >= tape.entries.size())
+        return false;
+
+    const JsonTape::Entry & entry = tape.entries[current];
+    if (entry.type != JsonTape::INTEGER && entry.type != JsonTape::NUMBER)
+        return false;
+
+    // Scalars were checked to be valid numbers when the tape was built
+    parseDecimalDouble(tape.data + entry.start, tape.data + entry.end, val);
+    ++current;
+    return true;
+}
+
+void
+TapeJsonParsingContext::
+forEachMember(const std::function<void ()> & fn)
+{
+    if (current < tape.entries.size()
+        && currentType() == JsonTape::NULL_VALUE) {
+        ++current;
+        return;
+    }
+
+    if (current >= tape.entries.size() || currentType() != JsonTape::OBJECT) {
+        slowPath();
+        slowContext->expect_literal('{');
+        exception("expected object");
+    }
+
+    size_t end = tape.entries[current].next;
+    ++current;
+
+    if (depth == keys.size())
+        keys.emplace_back();
+    std::string & key = keys[depth];
+
+    Nesting nesting(closers, '}');
+
+    struct DepthGuard {
+        DepthGuard(size_t & depth)
+            : depth(depth)
+        {
+            ++depth;
+        }
+
+        ~DepthGuard()
+        {
+            --depth;
+        }
+
+        size_t & depth;
+    } depthGuard(depth);
+
+    // Takes care of pushing and popping our path entry, as in the
+    // StreamingJsonParsingContext
+    struct PathPusher {
+        PathPusher(const char * memberName,
+                   int memberNum,
+                   TapeJsonParsingContext * context)
+            : context(context)
+        {
+            context->pushPath(memberName, memberNum);
+        }
+
+        ~PathPusher()
+        {
+            context->popPath();
+        }
+
+        TapeJsonParsingContext * const context;
+    };
+
+    int memberNum = 0;
+    while (current < end) {
+        expectKey(key);
+        size_t next = tape.entries[current].next;
+        {
+            PathPusher pusher(key.c_str(), memberNum++, this);
+            fn();
+        }
+        current = next;
+    }
+}
+
+void
+TapeJsonParsingContext::
+forEachElement(const std::function<void ()> & fn)
+{
+    if (current < tape.entries.size()
+        && currentType() == JsonTape::NULL_VALUE) {
+        ++current;
+        return;
+    }
+
+    if (current >= tape.entries.size() || currentType() != JsonTape::ARRAY) {
+        slowPath();
+        slowContext->expect_literal('[');
+        exception("expected array");
+    }
+
+    size_t end = tape.entries[current].next;
+    ++current;
+
+    Nesting nesting(closers, ']');
+
+    int index = 0;
+    while (current < end) {
+        if (index == 0)
+            pushPath(index);
+        else replacePath(index);
+
+        size_t next = tape.entries[current].next;
+        fn();
+        current = next;
+        ++index;
+    }
+
+    if (index)
+        popPath();
+}
+
+void
+TapeJsonParsingContext::
+skip()
+{
+    if (current >= tape.entries.size())
+        slowPath().skip();
+    else current = tape.entries[current].next;
+}
+
+int
+TapeJsonParsingContext::
+expectInt()
+{
+    long long val;
+    if (fastInteger(val, -INT_MAX, INT_MAX, true))
+        return val;
+    int result = slowPath().expectInt();
+    finishSlowPath();
+    return result;
+}
+
+unsigned int
+TapeJsonParsingContext::
+expectUnsignedInt()
+{
+    // expect_unsigned() only goes up to INT_MAX
+    long long val;
+    if (fastInteger(val, 0, INT_MAX, false))
+        return val;
+    unsigned int result = slowPath().expectUnsignedInt();
+    finishSlowPath();
+    return result;
+}
+
+long
+TapeJsonParsingContext::
+expectLong()
+{
+    long long val;
+    if (fastInteger(val, -LONG_MAX, LONG_MAX, true))
+        return val;
+    long result = slowPath().expectLong();
+    finishSlowPath();
+    return result;
+}
+
+unsigned long
+TapeJsonParsingContext::
+expectUnsignedLong()
+{
+    long long val;
+    if (fastInteger(val, 0, LLONG_MAX, false))
+        return val;
+    unsigned long result = slowPath().expectUnsignedLong();
+    finishSlowPath();
+    return result;
+}
+
+long long
+TapeJsonParsingContext::
+expectLongLong()
+{
+    long long val;
+    if (fastInteger(val, -LLONG_MAX, LLONG_MAX, true))
+        return val;
+    long long result = slowPath().expectLongLong();
+    finishSlowPath();
+    return result;
+}
+
+unsigned long long
+TapeJsonParsingContext::
+expectUnsignedLongLong()
+{
+    long long val;
+    if (fastInteger(val, 0, LLONG_MAX, false))
+        return val;
+    unsigned long long result = slowPath().expectUnsignedLongLong();
+    finishSlowPath();
+    return result;
+}
+
+float
+TapeJsonParsingContext::
+expectFloat()
+{
+    double val;
+    if (fastDouble(val))
+        return val;
+    float result = slowPath().expectFloat();
+    finishSlowPath();
+    return result;
+}
+
+double
+TapeJsonParsingContext::
+expectDouble()
+{
+    double val;
+    if (fastDouble(val))
+        return val;
+    double result = slowPath().expectDouble();
+    finishSlowPath();
+    return result;
+}
+
+bool
+TapeJsonParsingContext::
+expectBool()
+{
+    if (current < tape.entries.size()) {
+        if (currentType() == JsonTape::TRUE_VALUE) {
+            ++current;
+            return true;
+        }
+        if (currentType() == JsonTape::FALSE_VALUE) {
+            ++current;
+            return false;
+        }
+    }
+    bool result = slowPath().expectBool();
+    finishSlowPath();
+    return result;
+}
+
+void
+TapeJsonParsingContext::
+expectNull()
+{
+    if (current < tape.entries.size()
+        && currentType() == JsonTape::NULL_VALUE) {
+        ++current;
+        return;
+    }
+    slowPath().expectNull();
+    finishSlowPath();
+}
+
+bool
+TapeJsonParsingContext::
+matchUnsignedLongLong(unsigned long long & val)
+{
+    long long v;
+    if (fastInteger(v, 0, LLONG_MAX, false)) {
+        val = v;
+        return true;
+    }
+    bool result = slowPath().matchUnsignedLongLong(val);
+    finishSlowPath();
+    return result;
+}
+
+bool
+TapeJsonParsingContext::
+matchLongLong(long long & val)
+{
+    if (fastInteger(val, LLONG_MIN, LLONG_MAX, true))
+        return true;
+    bool result = slowPath().matchLongLong(val);
+    finishSlowPath();
+    return result;
+}
+
+bool
+TapeJsonParsingContext::
+matchDouble(double & val)
+{
+    if (fastDouble(val))
+        return true;
+    bool result = slowPath().matchDouble(val);
+    finishSlowPath();
+    return result;
+}
+
+std::string
+TapeJsonParsingContext::
+expectStringAscii()
+{
+    std::string result;
+    if (decodeString(true, result)) {
+        ++current;
+        return result;
+    }
+    result = slowPath().expectStringAscii();
+    finishSlowPath();
+    return result;
+}
+
+ssize_t
+TapeJsonParsingContext::
+expectStringAscii(char * value, size_t maxLen)
+{
+    std::string result;
+    if (!decodeString(true, result)) {
+        ssize_t res = slowPath().expectStringAscii(value, maxLen);
+        if (res != -1)
+            finishSlowPath();
+        return res;
+    }
+
+    if (result.size() > maxLen - 1)
+        return -1;
+
+    memcpy(value, result.data(), result.size());
+    value[result.size()] = 0;
+    ++current;
+    return result.size();
+}
+
+Utf8String
+TapeJsonParsingContext::
+expectStringUtf8()
+{
+    std::string result;
+    if (decodeString(false, result)) {
+        ++current;
+        return Utf8String(std::move(result), false /* check */);
+    }
+    Utf8String str = slowPath().expectStringUtf8();
+    finishSlowPath();
+    return str;
+}
+
+ssize_t
+TapeJsonParsingContext::
+expectStringUtf8(char * value, size_t maxLen)
+{
+    std::string result;
+    if (!decodeString(false, result)) {
+        ssize_t res = slowPath().expectStringUtf8(value, maxLen);
+        if (res != -1)
+            finishSlowPath();
+        return res;
+    }
+
+    // The streaming parser gives up when a character starts within five
+    // bytes of the end of the buffer
+    if (!result.empty()) {
+        size_t lastChar = result.size() - 1;
+        while (lastChar > 0 && (result[lastChar] & 0xc0) == 0x80)
+            --lastChar;
+        if (lastChar >= maxLen - 5)
+            return -1;
+    }
+
+    memcpy(value, result.data(), result.size());
+    value[result.size()] = 0;
+    ++current;
+    return result.size();
+}
+
+bool
+TapeJsonParsingContext::
+isObject() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isObject();
+    return currentType() == JsonTape::OBJECT;
+}
+
+bool
+TapeJsonParsingContext::
+isString() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isString();
+    JsonTape::Type type = currentType();
+    return type == JsonTape::STRING || type == JsonTape::STRING_UTF8
+        || type == JsonTape::STRING_ESCAPED;
+}
+
+bool
+TapeJsonParsingContext::
+isArray() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isArray();
+    return currentType() == JsonTape::ARRAY;
+}
+
+bool
+TapeJsonParsingContext::
+isBool() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isBool();
+    JsonTape::Type type = currentType();
+    return type == JsonTape::TRUE_VALUE || type == JsonTape::FALSE_VALUE;
+}
+
+bool
+TapeJsonParsingContext::
+isInt() const
+{
+    // The streaming parser's isInt() never matches, as its first check
+    // looks at the ParseContext instead of the current character.  Give
+    // the same answer, so that both parsers produce the same values.
+    return false;
+}
+
+bool
+TapeJsonParsingContext::
+isUnsigned() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isUnsigned();
+    return currentType() == JsonTape::INTEGER
+        && tape.data[tape.entries[current].start] != '-';
+}
+
+bool
+TapeJsonParsingContext::
+isNumber() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isNumber();
+    JsonTape::Type type = currentType();
+    return type == JsonTape::INTEGER || type == JsonTape::NUMBER;
+}
+
+bool
+TapeJsonParsingContext::
+isNull() const
+{
+    if (current >= tape.entries.size())
+        return slowPath().isNull();
+    return currentType() == JsonTape::NULL_VALUE;
+}
+
+void
+TapeJsonParsingContext::
+exception(const std::string & message) const
+{
+    slowPath();
+    slowContext->exception("at " + printPath() + ": " + message);
+}
+
+std::string
+TapeJsonParsingContext::
+getContext() const
+{
+    slowPath();
+    return slowContext->where() + " at " + printPath();
+}
+
+Json::Value
+TapeJsonParsingContext::
+expectJson()
+{
+    if (current >= tape.entries.size())
+        return slowPath().expectJson();
+
+    const JsonTape::Entry & entry = tape.entries[current];
+
+    switch (entry.type) {
+    case JsonTape::OBJECT: {
+        Json::Value result(Json::objectValue);
+        size_t end = entry.next;
+        ++current;
+        while (current < end) {
+            std::string key = expectStringUtf8().rawString();
+            result[key] = expectJson();
+        }
+        return result;
+    }
+    case JsonTape::ARRAY: {
+        Json::Value result(Json::arrayValue);
+        size_t end = entry.next;
+        ++current;
+        for (int i = 0;  current < end;  ++i)
+            result[i] = expectJson();
+        return result;
+    }
+    case JsonTape::STRING:
+    case JsonTape::STRING_UTF8:
+    case JsonTape::STRING_ESCAPED:
+        return expectStringUtf8();
+    case JsonTape::TRUE_VALUE:
+        ++current;
+        return Json::Value(true);
+    case JsonTape::FALSE_VALUE:
+        ++current;
+        return Json::Value(false);
+    case JsonTape::NULL_VALUE:
+        ++current;
+        return Json::Value();
+    case JsonTape::INTEGER:
+    case JsonTape::NUMBER: {
+        // Same conversions as expectJsonNumber(), which also deals with
+        // integers that overflow
+        if (entry.type == JsonTape::NUMBER) {
+            double val = 0.0;
+            parseDecimalDouble(tape.data + entry.start,
+                               tape.data + entry.end, val);
+            ++current;
+            return val;
+        }
+
+        char buf[256];
+        size_t len = entry.end - entry.start;
+        memcpy(buf, tape.data + entry.start, len);
+        buf[len] = 0;
+
+        errno = 0;
+        if (buf[0] == '-') {
+            long long val = strtoll(buf, nullptr, 10);
+            if (errno != ERANGE) {
+                ++current;
+                return val;
+            }
+        }
+        else {
+            unsigned long long val = strtoull(buf, nullptr, 10);
+            if (errno != ERANGE) {
+                ++current;
+                return val;
+            }
+        }
+
+        Json::Value result = slowPath().expectJson();
+        finishSlowPath();
+        return result;
+    }
+    }
+
+    throw MLDB::Exception("logic error in expectJson");
+}
+
+std::string
+TapeJsonParsingContext::
+printCurrent()
+{
+    size_t saved = current;
+    try {
+        std::string result = trim(expectJson().toString());
+        current = saved;
+        return result;
+    } catch (const std::exception & exc) {
+        current = saved;
+        size_t start = current < tape.entries.size()
+            ? tape.entries[current].start : tape.length;
+        const char * p = tape.data + start;
+        const char * e = tape.data + tape.length;
+        return std::string(p, std::find(p, e, '\n'));
+    }
+}
+
+bool
+TapeJsonParsingContext::
+eof() const
+{
+    return current >= tape.entries.size();
+}
+
+
+/*****************************************************************************/
+/* IN-MEMORY DOCUMENT PARSING                                                */
+/*****************************************************************************/
+
+void parseJsonDocument(const ValueDescription & desc, void * obj,
+                       const std::string & filename,
+                       const char * start, size_t length)
+{
+    if (length >= TAPE_PARSING_MIN_LENGTH) {
+        JsonTape tape;
+        if (tape.index(start, length)) {
+            TapeJsonParsingContext context(filename, tape);
+            desc.parseJson(obj, context);
+            return;
+        }
+    }
+
+    StreamingJsonParsingContext context(filename, start, length);
+    desc.parseJson(obj, context);
+}
+
+} // namespace MLDB
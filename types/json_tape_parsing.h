@@ -0,0 +1,238 @@
+/** json_tape_parsing.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Two-stage parser for JSON documents that are held in memory.
+*/
+
+#pragma once
+
+#include "json_parsing.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* JSON TAPE                                                                 */
+/*****************************************************************************/
+
+/** Structural index and tape of a JSON document held in memory.
+
+    The document is indexed in two passes.  The first one scans the bytes,
+    eight at a time inside of strings, and records the offset of every
+    structural character ({}[]:,) and of the start and end of every string
+    and scalar.  The second one walks over those offsets, checks that they
+    nest properly, and lays the values out on a tape in document order.
+    Each entry on the tape knows where the value following it starts, so
+    any value can be skipped in constant time.
+
+    Nothing is decoded while indexing; strings and numbers are only
+    converted when they're asked for.
+*/
+
+struct JsonTape {
+    JsonTape();
+
+    enum Type: uint8_t {
+        OBJECT,           ///< Followed by its keys and values, alternating
+        ARRAY,            ///< Followed by its elements
+        STRING,           ///< String of ASCII characters with no escapes
+        STRING_UTF8,      ///< String with no escapes but other characters
+        STRING_ESCAPED,   ///< String with escapes
+        TRUE_VALUE,       ///< true
+        FALSE_VALUE,      ///< false
+        NULL_VALUE,       ///< null
+        INTEGER,          ///< Number with no fraction or exponent
+        NUMBER            ///< Number with a fraction or exponent
+    };
+
+    struct Entry {
+        uint32_t start;   ///< Offset of the first character of the value
+        uint32_t end;     ///< Offset just past its last character
+        uint32_t next;    ///< Tape index of the entry after this value
+        Type type;
+    };
+
+    /** Index the given document.  Returns false if it's not made up of
+        exactly one JSON value, surrounded by optional whitespace, or uses
+        something (NaN, Inf...) that only the streaming parser knows about.
+        In that case, the document should be parsed with the streaming
+        parser, which will also give a meaningful error message.
+
+        The tape keeps a pointer to the document, which must outlive it.
+        Calling this again reuses the memory from the previous document.
+    */
+    bool index(const char * start, size_t length);
+
+    const char * data;
+    size_t length;
+    std::vector<Entry> entries;
+
+private:
+    /// Offsets of the structurals and of the first character of each
+    /// string and scalar, from the first stage
+    std::vector<uint32_t> structurals;
+
+    /// For each string and scalar, in order, the offset just past its end
+    /// with flag bits saying what the first stage found in strings
+    std::vector<uint32_t> ends;
+
+    /// Objects and arrays that are still open while building the tape
+    std::vector<uint32_t> open;
+
+    bool findStructurals();
+    bool buildTape();
+};
+
+
+/*****************************************************************************/
+/* TAPE JSON PARSING CONTEXT                                                 */
+/*****************************************************************************/
+
+/** Parsing context that reads from a JsonTape, for in-memory documents.
+
+    It gives the same results and error messages as the
+    StreamingJsonParsingContext on the same document: the usual cases are
+    handled straight from the tape, and anything else (type mismatches,
+    integers that may overflow, malformed UTF-8...) is handed over to a
+    streaming parser positioned at the current value.
+
+    Only documents that could be indexed can be parsed; when index() on
+    the tape failed, use a StreamingJsonParsingContext instead.
+*/
+
+struct TapeJsonParsingContext: public JsonParsingContext {
+
+    /** Parse from the given tape, which must have been successfully
+        indexed and must outlive this object.
+    */
+    TapeJsonParsingContext(const std::string & filename,
+                           const JsonTape & tape,
+                           unsigned line = 1, unsigned col = 1);
+
+    ~TapeJsonParsingContext();
+
+    virtual void forEachMember(const std::function<void ()> & fn);
+
+    virtual void forEachElement(const std::function<void ()> & fn);
+
+    virtual void skip();
+
+    virtual int expectInt();
+
+    virtual unsigned int expectUnsignedInt();
+
+    virtual long expectLong();
+
+    virtual unsigned long expectUnsignedLong();
+
+    virtual long long expectLongLong();
+
+    virtual unsigned long long expectUnsignedLongLong();
+
+    virtual float expectFloat();
+
+    virtual double expectDouble();
+
+    virtual bool expectBool();
+
+    virtual void expectNull();
+
+    virtual bool matchUnsignedLongLong(unsigned long long & val);
+
+    virtual bool matchLongLong(long long & val);
+
+    virtual bool matchDouble(double & val);
+
+    virtual std::string expectStringAscii();
+
+    virtual ssize_t expectStringAscii(char * value, size_t maxLen);
+
+    virtual Utf8String expectStringUtf8();
+
+    virtual ssize_t expectStringUtf8(char * value, size_t maxLen);
+
+    virtual bool isObject() const;
+
+    virtual bool isString() const;
+
+    virtual bool isArray() const;
+
+    virtual bool isBool() const;
+
+    virtual bool isInt() const;
+
+    virtual bool isUnsigned() const;
+
+    virtual bool isNumber() const;
+
+    virtual bool isNull() const;
+
+    virtual void exception(const std::string & message) const;
+
+    virtual std::string getContext() const;
+
+    virtual Json::Value expectJson();
+
+    virtual std::string printCurrent();
+
+    virtual bool eof() const;
+
+private:
+    const JsonTape & tape;
+    std::string filename;
+    unsigned line;
+    unsigned col;
+
+    /// Tape index of the value we're looking at
+    size_t current;
+
+    /// Decoded member names, one per level of forEachMember().  A deque so
+    /// that the path can point into them while deeper levels are added.
+    std::deque<std::string> keys;
+    size_t depth;
+
+    /// Closing character of each object or array we're inside of
+    std::vector<char> closers;
+
+    /// Streaming parser over the whole document, for the slow paths.  It
+    /// only ever moves forward, so keeping track of lines costs O(n).
+    mutable std::unique_ptr<ParseContext> slowContext;
+    mutable std::unique_ptr<StreamingJsonParsingContext> slowParser;
+
+    StreamingJsonParsingContext & slowPath() const;
+    void finishSlowPath();
+    bool decodeString(bool ascii, std::string & result) const;
+    void expectKey(std::string & key);
+    bool fastInteger(long long & val, long long min, long long max,
+                     bool allowNegative);
+    bool fastDouble(double & val);
+    JsonTape::Type currentType() const;
+};
+
+
+/*****************************************************************************/
+/* IN-MEMORY DOCUMENT PARSING                                                */
+/*****************************************************************************/
+
+/** Documents at least this big are parsed with the tape parser by
+    parseJsonDocument().  Below it, the streaming parser is as fast.
+*/
+constexpr size_t TAPE_PARSING_MIN_LENGTH = 4096;
+
+/** Parse the JSON document in the given memory region into obj, which is
+    described by desc.  Large documents are parsed from a JsonTape; small
+    ones, and ones that can't be indexed, with a
+    StreamingJsonParsingContext.  Either way the result and the error
+    messages are the same.
+*/
+void parseJsonDocument(const ValueDescription & desc, void * obj,
+                       const std::string & filename,
+                       const char * start, size_t length);
+
+} // namespace MLDB
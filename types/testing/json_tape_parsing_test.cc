@@ -0,0 +1,219 @@
+/* json_tape_parsing_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the tape parser gives the same results as the streaming one.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/types/json_tape_parsing.h"
+#include "mldb/types/value_description.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/map_description.h"
+#include "mldb/ext/jsoncpp/json.h"
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/* Walk over a document the way the ExpressionValue and CellValue parsers
+   do, writing down what was found. */
+void walk(JsonParsingContext & context, std::ostream & out)
+{
+    if (context.isObject()) {
+        out << "{";
+        context.forEachMember([&] ()
+            {
+                out << context.fieldName() << "@" << context.printPath()
+                    << ":";
+                walk(context, out);
+                out << ",";
+            });
+        out << "}";
+    }
+    else if (context.isArray()) {
+        out << "[";
+        context.forEachElement([&] ()
+            {
+                out << context.fieldNumber() << ":";
+                walk(context, out);
+                out << ",";
+            });
+        out << "]";
+    }
+    else if (context.isNull()) {
+        context.expectNull();
+        out << "null";
+    }
+    else if (context.isString())
+        out << "s" << context.expectStringUtf8();
+    else if (context.isUnsigned())
+        out << "u" << context.expectUnsignedLongLong();
+    else if (context.isInt())
+        out << "i" << context.expectLongLong();
+    else if (context.isNumber())
+        out << "d" << context.expectDouble();
+    else if (context.isBool())
+        out << "b" << context.expectBool();
+    else context.exception("unknown value");
+}
+
+/* Expect an array of alternating ASCII strings and ints. */
+void alternating(JsonParsingContext & context, std::ostream & out)
+{
+    context.forEachElement([&] ()
+        {
+            if (context.fieldNumber() % 2)
+                out << context.expectInt() << ",";
+            else out << context.expectStringAscii() << ",";
+        });
+}
+
+template<typename Fn>
+std::string run(JsonParsingContext & context, Fn fn)
+{
+    std::ostringstream out;
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        fn(context, out);
+    } catch (const std::exception & exc) {
+        out << " exception " << exc.what();
+    }
+    return out.str();
+}
+
+void checkSame(const std::string & json)
+{
+    BOOST_TEST_CHECKPOINT(json);
+
+    JsonTape tape;
+    BOOST_REQUIRE(tape.index(json.c_str(), json.length()));
+
+    {
+        TapeJsonParsingContext tapeContext("test", tape);
+        StreamingJsonParsingContext streamingContext("test", json.c_str(),
+                                                     json.length());
+        BOOST_CHECK_EQUAL(tapeContext.expectJson().toStringNoNewLine(),
+                          streamingContext.expectJson().toStringNoNewLine());
+        BOOST_CHECK(tapeContext.eof());
+    }
+
+    for (auto fn: { walk, alternating }) {
+        TapeJsonParsingContext tapeContext("test", tape);
+        StreamingJsonParsingContext streamingContext("test", json.c_str(),
+                                                     json.length());
+        std::string fromTape = run(tapeContext, fn);
+        std::string fromStream = run(streamingContext, fn);
+
+        // On an error, the streaming parser may get one value further
+        // before noticing; only the error needs to be the same
+        auto pos = fromTape.find(" exception ");
+        if (pos != std::string::npos) {
+            auto pos2 = fromStream.find(" exception ");
+            BOOST_REQUIRE(pos2 != std::string::npos);
+            BOOST_CHECK_EQUAL(fromTape.substr(pos), fromStream.substr(pos2));
+        }
+        else BOOST_CHECK_EQUAL(fromTape, fromStream);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_tape_structure )
+{
+    std::string json = " {\"a\": [1, 2.5, \"x\\ny\"], \"b\": {}, \"c\": null} ";
+    JsonTape tape;
+    BOOST_REQUIRE(tape.index(json.c_str(), json.length()));
+
+    BOOST_REQUIRE_EQUAL(tape.entries.size(), 10);
+    BOOST_CHECK_EQUAL(tape.entries[0].type, JsonTape::OBJECT);
+    BOOST_CHECK_EQUAL(tape.entries[0].next, 10);
+    BOOST_CHECK_EQUAL(tape.entries[0].start, 1);
+    BOOST_CHECK_EQUAL(tape.entries[0].end, json.length() - 1);
+    BOOST_CHECK_EQUAL(tape.entries[1].type, JsonTape::STRING);
+    BOOST_CHECK_EQUAL(tape.entries[2].type, JsonTape::ARRAY);
+    BOOST_CHECK_EQUAL(tape.entries[2].next, 6);
+    BOOST_CHECK_EQUAL(tape.entries[3].type, JsonTape::INTEGER);
+    BOOST_CHECK_EQUAL(tape.entries[4].type, JsonTape::NUMBER);
+    BOOST_CHECK_EQUAL(tape.entries[5].type, JsonTape::STRING_ESCAPED);
+    BOOST_CHECK_EQUAL(tape.entries[7].type, JsonTape::OBJECT);
+    BOOST_CHECK_EQUAL(tape.entries[7].next, 8);
+    BOOST_CHECK_EQUAL(tape.entries[9].type, JsonTape::NULL_VALUE);
+}
+
+BOOST_AUTO_TEST_CASE( test_tape_rejects )
+{
+    // These are left to the streaming parser
+    for (std::string json: { "", "   ", "[1,]", "[1 2]", "{\"a\" 1}",
+                "{1:2}", "[1] 2", "[1]]", "[tru]", "NaN", "[-Inf]", "[.5]",
+                "[+1]", "[1.]", "[1e]", "\"abc", "[\"\\x\"]",
+                "[\"\\ud800\"]", "[1,\r2]" }) {
+        JsonTape tape;
+        BOOST_CHECK_MESSAGE(!tape.index(json.c_str(), json.length()),
+                            json);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_tape_matches_streaming )
+{
+    checkSame("{\"a\":1,\"b\":[true,false,null,-3,2.5,\"x\"],\"c\":{\"d\":\"e\"}}");
+    checkSame("  [ 1 , 2 ,\n 3 ]\r\n");
+    checkSame("[\"a\",1,\"b\",2.5,\"c\",\"x\"]");
+    checkSame("[\"a\",1,\"b\",-2147483648]");
+    checkSame("[\"a\u00e9\",1]");
+    checkSame("[\"\\u00e9\",1]");
+    checkSame("[\"tab\\tq\\\"\\\\\\/\", 1, \"\\u0000z\"]");
+    checkSame("[\"\\ud83d\\ude00\", \"\xf0\x9f\x98\x80\", \"\xff\xfe\"]");
+    checkSame("{\"k\\u00e9y\":{\"n\\\"ested\":[1,{\"z\":\"\\b\\f\\r\\n\"}]}}");
+    checkSame("[18446744073709551615, 18446744073709551616, "
+              "-9223372036854775808, -9223372036854775809, "
+              "12345678901234567890123]");
+    checkSame("[1.5e308, 1e400, -1e400, 01, -0, 1E5, 1e-5, -0.0]");
+    checkSame("{\"very\":{\"deep\":{\"path\":[1,2,{\"x\":[1,\"2\",3]}]}}}");
+    checkSame("[[],{},[{}],[[[]]]]");
+    checkSame("\"just a string\"");
+    checkSame("12");
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_json_document )
+{
+    // Big enough to go through the tape
+    std::vector<std::map<std::string, double> > rows;
+    for (unsigned i = 0;  i < 1000;  ++i)
+        rows.push_back({ { "x", i }, { "y\u00e9", i * 0.5 } });
+    std::string json = jsonEncodeStr(rows);
+    BOOST_REQUIRE_GE(json.length(), TAPE_PARSING_MIN_LENGTH);
+
+    auto decoded = jsonDecodeStr<std::vector<std::map<std::string, double> > >(json);
+    BOOST_CHECK(decoded == rows);
+
+    // Errors are the same as with the streaming parser
+    std::string bad = json;
+    bad.replace(bad.rfind("0.5"), 3, "\"z\"");
+
+    std::string tapeError, streamingError;
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        jsonDecodeStr<std::vector<std::map<std::string, double> > >(bad);
+    } catch (const std::exception & exc) {
+        tapeError = exc.what();
+    }
+
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        std::vector<std::map<std::string, double> > result;
+        auto desc = getDefaultDescriptionShared(&result);
+        StreamingJsonParsingContext context(bad, bad.c_str(), bad.length());
+        desc->parseJson(&result, context);
+    } catch (const std::exception & exc) {
+        streamingError = exc.what();
+    }
+
+    BOOST_CHECK_NE(tapeError, "");
+    BOOST_CHECK_EQUAL(tapeError, streamingError);
+}
@@ -8,5 +8,6 @@ $(eval $(call test,value_description_test,types arch value_description,boost))
 $(eval $(call test,periodic_utils_test,types,boost))
 $(eval $(call test,reader_test,jsoncpp arch types,boost))
 $(eval $(call test,json_parsing_test,types arch,boost))
+$(eval $(call test,json_tape_parsing_test,types arch value_description,boost))
 $(eval $(call test,any_test,any types arch,boost))
 $(eval $(call test,decode_uri_test,types,boost))
@@ -11,6 +11,7 @@ LIBVALUE_DESCRIPTION_SOURCES := \
 	basic_value_descriptions.cc \
 	libc_value_descriptions.cc \
 	json_parsing.cc \
+	json_tape_parsing.cc \
 	json_printing.cc \
 	dtoa.c \
 	meta_value_description.cc \
@@ -35,7 +36,7 @@ LIBTYPES_SOURCES := \
 	periodic_utils_value_descriptions.cc
 
 LIBTYPES_LINK := \
-	rt boost_locale boost_regex boost_date_time jsoncpp googleurl cityhash value_description
+	rt boost_locale boost_regex boost_date_time jsoncpp googleurl cityhash value_description base
 
 $(eval $(call set_compile_option,localdate.cc,-DLIB=\"$(LIB)\"))
 
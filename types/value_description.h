@@ -19,6 +19,7 @@
 #include "mldb/arch/demangle.h"
 #include "mldb/base/exc_assert.h"
 #include "json_parsing.h"
+#include "json_tape_parsing.h"
 #include "json_printing.h"
 #include "mldb/ext/jsoncpp/value.h"
 
@@ -488,8 +489,7 @@ T jsonDecodeStr(const std::string & json, T * = 0)
     T result;
 
     static auto desc = getDefaultDescriptionSharedT<T>();
-    StreamingJsonParsingContext context(json, json.c_str(), json.c_str() + json.size());
-    desc->parseJson(&result, context);
+    parseJsonDocument(*desc, &result, json, json.c_str(), json.size());
     return result;
 }
 
@@ -501,8 +501,8 @@ T jsonDecodeStr(const Utf8String & json, T * = 0)
     T result;
 
     static auto desc = getDefaultDescriptionSharedT<T>();
-    StreamingJsonParsingContext context(json.rawString(), json.rawData(), json.rawLength());
-    desc->parseJson(&result, context);
+    parseJsonDocument(*desc, &result, json.rawString(), json.rawData(),
+                      json.rawLength());
     return result;
 }
 
@@ -515,8 +515,7 @@ T jsonDecodeStr(const char * str, size_t len, T * = 0)
     T result;
 
     static auto desc = getDefaultDescriptionSharedT<T>();
-    StreamingJsonParsingContext context("<<JSON STR>>", str, len);
-    desc->parseJson(&result, context);
+    parseJsonDocument(*desc, &result, "<<JSON STR>>", str, len);
     return result;
 }
 
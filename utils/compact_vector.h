@@ -117,7 +117,7 @@ public:
 
     compact_vector & operator = (compact_vector && other)
     {
-        compact_vector new_me(other);
+        compact_vector new_me(std::move(other));
         swap(new_me);
         return *this;
     }
@@ -226,6 +226,16 @@ public:
         swap(new_me);
     }
 
+    void shrink_to_fit()
+    {
+        if (is_internal() || capacity() == size_) return;
+
+        // init() takes the internal representation if it fits
+        compact_vector new_me;
+        new_me.init_move(begin(), end(), size_);
+        swap(new_me);
+    }
+
     void resize(size_t new_size, const Data & new_element = Data())
     {
         if (size_ == new_size) return;
@@ -0,0 +1,652 @@
+/** flat_hash_map.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Open addressing hash map and set with inline storage.
+
+    The slots are divided into groups of 16, each with a control byte per
+    slot that holds either a marker (empty or deleted) or 7 bits of the
+    hash of the key in the slot.  A lookup compares the control bytes of a
+    whole group at once (with SSE2 where available), so that most probes
+    only touch one cache line of metadata and compare the key of the one
+    slot that is likely to match.  This is the design of Google's
+    SwissTable.
+
+    Differences from std::unordered_map:
+    - values move when the table grows, so iterators, pointers and
+      references are invalidated by any insertion;
+    - the hash is mixed before use, so identity hashes (like those of
+      integers or of RowHash) are fine;
+    - lookup of keys of another type is possible when the hash function
+      has an is_transparent member type, in which case the hash and
+      equality functions must accept both types.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace MLDB {
+
+namespace FlatHash {
+
+/// Control byte values.  Full slots are 0 to 127; markers are negative.
+enum : int8_t {
+    EMPTY = -128,
+    DELETED = -2
+};
+
+static constexpr size_t GROUP_SIZE = 16;
+
+/** The control bytes of a group, and matching on them.  Each match returns
+    a bitmask with bit i set if slot i of the group matches.
+*/
+struct Group {
+    explicit Group(const int8_t * ctrl)
+    {
+#if defined(__SSE2__)
+        bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#else
+        std::memcpy(bytes, ctrl, GROUP_SIZE);
+#endif
+    }
+
+    uint32_t match(int8_t h2) const
+    {
+#if defined(__SSE2__)
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), bytes));
+#else
+        uint32_t result = 0;
+        for (unsigned i = 0;  i < GROUP_SIZE;  ++i)
+            result |= uint32_t(bytes[i] == h2) << i;
+        return result;
+#endif
+    }
+
+    uint32_t matchEmpty() const
+    {
+        return match(EMPTY);
+    }
+
+    uint32_t matchEmptyOrDeleted() const
+    {
+#if defined(__SSE2__)
+        return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), bytes));
+#else
+        uint32_t result = 0;
+        for (unsigned i = 0;  i < GROUP_SIZE;  ++i)
+            result |= uint32_t(bytes[i] < -1) << i;
+        return result;
+#endif
+    }
+
+#if defined(__SSE2__)
+    __m128i bytes;
+#else
+    int8_t bytes[GROUP_SIZE];
+#endif
+};
+
+/// Mix the bits of a hash, so that both the low bits (which choose the
+/// group) and the top bits (which go in the control byte) depend on all
+/// of them.
+inline uint64_t mix(uint64_t h)
+{
+    h *= 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 32);
+}
+
+/// Equality that works between different types, for heterogeneous lookup
+struct Equal {
+    template<typename A, typename B>
+    bool operator () (const A & a, const B & b) const
+    {
+        return a == b;
+    }
+};
+
+struct SelectFirst {
+    template<typename T>
+    auto operator () (const T & val) const -> decltype(val.first) &
+    {
+        return val.first;
+    }
+};
+
+struct Identity {
+    template<typename T>
+    const T & operator () (const T & val) const
+    {
+        return val;
+    }
+};
+
+/// A group of empty control bytes, used by tables with no storage
+inline int8_t * emptyGroup()
+{
+    alignas(16) static const int8_t result[GROUP_SIZE] = {
+        EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+        EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
+    };
+    return const_cast<int8_t *>(result);
+}
+
+} // namespace FlatHash
+
+
+/*****************************************************************************/
+/* FLAT HASH TABLE                                                           */
+/*****************************************************************************/
+
+/** Container underlying FlatHashMap and FlatHashSet.  Value is what's
+    stored in each slot, and KeyOf extracts the key from it.
+*/
+
+template<typename Key, typename Value, typename KeyOf,
+         typename Hash, typename Eq>
+struct FlatHashTable {
+
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef size_t size_type;
+    typedef Hash hasher;
+    typedef Eq key_equal;
+
+    template<bool Const>
+    struct IteratorT {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::conditional<Const, const Value, Value>::type
+            value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type * pointer;
+        typedef value_type & reference;
+
+        IteratorT()
+            : table(nullptr), index(0)
+        {
+        }
+
+        // Allow conversion from iterator to const_iterator
+        template<bool OtherConst,
+                 typename = typename std::enable_if<Const || !OtherConst>::type>
+        IteratorT(const IteratorT<OtherConst> & other)
+            : table(other.table), index(other.index)
+        {
+        }
+
+        reference operator * () const { return table->slots_[index]; }
+        pointer operator -> () const { return table->slots_ + index; }
+
+        IteratorT & operator ++ ()
+        {
+            index = table->nextFull(index + 1);
+            return *this;
+        }
+
+        IteratorT operator ++ (int)
+        {
+            IteratorT result = *this;
+            ++*this;
+            return result;
+        }
+
+        template<bool OtherConst>
+        bool operator == (const IteratorT<OtherConst> & other) const
+        {
+            return index == other.index;
+        }
+
+        template<bool OtherConst>
+        bool operator != (const IteratorT<OtherConst> & other) const
+        {
+            return index != other.index;
+        }
+
+    private:
+        template<typename, typename, typename, typename, typename>
+        friend struct FlatHashTable;
+        template<bool> friend struct IteratorT;
+
+        IteratorT(const FlatHashTable * table, size_t index)
+            : table(const_cast<FlatHashTable *>(table)), index(index)
+        {
+        }
+
+        FlatHashTable * table;
+        size_t index;
+    };
+
+    typedef IteratorT<false> iterator;
+    typedef IteratorT<true> const_iterator;
+
+    FlatHashTable()
+        : ctrl_(FlatHash::emptyGroup()), slots_(nullptr),
+          capacity_(0), size_(0), growthLeft_(0)
+    {
+    }
+
+    FlatHashTable(const FlatHashTable & other)
+        : FlatHashTable()
+    {
+        reserve(other.size());
+        for (auto & v: other)
+            insert(v);
+    }
+
+    FlatHashTable(FlatHashTable && other) noexcept
+        : FlatHashTable()
+    {
+        swap(other);
+    }
+
+    template<typename It>
+    FlatHashTable(It first, It last)
+        : FlatHashTable()
+    {
+        insert(first, last);
+    }
+
+    FlatHashTable(std::initializer_list<Value> vals)
+        : FlatHashTable(vals.begin(), vals.end())
+    {
+    }
+
+    ~FlatHashTable()
+    {
+        destroy();
+    }
+
+    FlatHashTable & operator = (const FlatHashTable & other)
+    {
+        FlatHashTable newMe(other);
+        swap(newMe);
+        return *this;
+    }
+
+    FlatHashTable & operator = (FlatHashTable && other) noexcept
+    {
+        FlatHashTable newMe(std::move(other));
+        swap(newMe);
+        return *this;
+    }
+
+    void swap(FlatHashTable & other) noexcept
+    {
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growthLeft_, other.growthLeft_);
+        std::swap(hash_, other.hash_);
+        std::swap(eq_, other.eq_);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    iterator begin() { return iterator(this, nextFull(0)); }
+    iterator end() { return iterator(this, capacity_); }
+    const_iterator begin() const { return const_iterator(this, nextFull(0)); }
+    const_iterator end() const { return const_iterator(this, capacity_); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    void clear()
+    {
+        destroy();
+        ctrl_ = FlatHash::emptyGroup();
+        slots_ = nullptr;
+        capacity_ = size_ = growthLeft_ = 0;
+    }
+
+    /// Make sure that n elements fit without the table growing
+    void reserve(size_t n)
+    {
+        if (n <= size_ + growthLeft_)
+            return;
+        size_t newCapacity = FlatHash::GROUP_SIZE;
+        while (maxLoad(newCapacity) < n)
+            newCapacity *= 2;
+        rehash(newCapacity);
+    }
+
+    iterator find(const Key & key)
+    {
+        return iterator(this, findIndex(key));
+    }
+
+    const_iterator find(const Key & key) const
+    {
+        return const_iterator(this, findIndex(key));
+    }
+
+    size_t count(const Key & key) const
+    {
+        return findIndex(key) != capacity_;
+    }
+
+    template<typename K2, typename H = Hash,
+             typename = typename H::is_transparent>
+    iterator find(const K2 & key)
+    {
+        return iterator(this, findIndex(key));
+    }
+
+    template<typename K2, typename H = Hash,
+             typename = typename H::is_transparent>
+    const_iterator find(const K2 & key) const
+    {
+        return const_iterator(this, findIndex(key));
+    }
+
+    template<typename K2, typename H = Hash,
+             typename = typename H::is_transparent>
+    size_t count(const K2 & key) const
+    {
+        return findIndex(key) != capacity_;
+    }
+
+    std::pair<iterator, bool> insert(const Value & val)
+    {
+        return emplaceWithKey(KeyOf()(val), val);
+    }
+
+    std::pair<iterator, bool> insert(Value && val)
+    {
+        const Key & key = KeyOf()(val);
+        return emplaceWithKey(key, std::move(val));
+    }
+
+    template<typename It>
+    void insert(It first, It last)
+    {
+        for (; first != last;  ++first)
+            insert(*first);
+    }
+
+    /** Insert the value constructed from args if there is nothing with the
+        given key.  The arguments are not used if the key is already there.
+    */
+    template<typename... Args>
+    std::pair<iterator, bool>
+    emplaceWithKey(const Key & key, Args&&... args)
+    {
+        uint64_t h = hashOf(key);
+        size_t index = findIndex(key, h);
+        if (index != capacity_)
+            return { iterator(this, index), false };
+        if (growthLeft_ == 0)
+            grow();
+        index = findInsertSlot(h);
+        new (const_cast<void *>(static_cast<const void *>(slots_ + index)))
+            Value(std::forward<Args>(args)...);
+        if (ctrl_[index] == FlatHash::EMPTY)
+            --growthLeft_;
+        ctrl_[index] = h2(h);
+        ++size_;
+        return { iterator(this, index), true };
+    }
+
+    size_t erase(const Key & key)
+    {
+        size_t index = findIndex(key);
+        if (index == capacity_)
+            return 0;
+        eraseIndex(index);
+        return 1;
+    }
+
+    /// Erase the element, and return an iterator to the next one
+    iterator erase(const_iterator it)
+    {
+        eraseIndex(it.index);
+        return iterator(this, nextFull(it.index + 1));
+    }
+
+    const Hash & hash_function() const { return hash_; }
+    const Eq & key_eq() const { return eq_; }
+
+private:
+    int8_t * ctrl_;
+    Value * slots_;
+    size_t capacity_;    ///< Number of slots; zero or a power of two >= 16
+    size_t size_;        ///< Number of full slots
+    size_t growthLeft_;  ///< Empty slots that we can fill before growing
+    Hash hash_;
+    Eq eq_;
+
+    // Keep at least one eighth of the slots empty, so that probing
+    // sequences stay short and always end.
+    static size_t maxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    static int8_t h2(uint64_t h)
+    {
+        return h >> 57;
+    }
+
+    template<typename K>
+    uint64_t hashOf(const K & key) const
+    {
+        return FlatHash::mix(hash_(key));
+    }
+
+    size_t nextFull(size_t index) const
+    {
+        while (index < capacity_ && ctrl_[index] < 0)
+            ++index;
+        return index;
+    }
+
+    /** Return the index of the key, or capacity_ if it's not there.  The
+        groups are probed in a triangular sequence, which visits each of
+        them once as the number of groups is a power of two.  A group
+        with an empty slot ends the search, as an insertion would have
+        used it.
+    */
+    template<typename K>
+    size_t findIndex(const K & key, uint64_t h) const
+    {
+        if (capacity_ == 0)
+            return 0;
+        size_t groupMask = capacity_ / FlatHash::GROUP_SIZE - 1;
+        size_t group = h & groupMask;
+        int8_t tag = h2(h);
+        for (size_t step = 1;  ;  ++step) {
+            const int8_t * groupCtrl = ctrl_ + group * FlatHash::GROUP_SIZE;
+            FlatHash::Group g(groupCtrl);
+            for (uint32_t m = g.match(tag);  m;  m &= m - 1) {
+                size_t index = group * FlatHash::GROUP_SIZE
+                    + __builtin_ctz(m);
+                if (eq_(KeyOf()(slots_[index]), key))
+                    return index;
+            }
+            if (g.matchEmpty())
+                return capacity_;
+            group = (group + step) & groupMask;
+        }
+    }
+
+    template<typename K>
+    size_t findIndex(const K & key) const
+    {
+        return findIndex(key, hashOf(key));
+    }
+
+    /// Return the first empty or deleted slot in the probe sequence
+    size_t findInsertSlot(uint64_t h) const
+    {
+        size_t groupMask = capacity_ / FlatHash::GROUP_SIZE - 1;
+        size_t group = h & groupMask;
+        for (size_t step = 1;  ;  ++step) {
+            FlatHash::Group g(ctrl_ + group * FlatHash::GROUP_SIZE);
+            uint32_t m = g.matchEmptyOrDeleted();
+            if (m)
+                return group * FlatHash::GROUP_SIZE + __builtin_ctz(m);
+            group = (group + step) & groupMask;
+        }
+    }
+
+    void eraseIndex(size_t index)
+    {
+        slots_[index].~Value();
+        --size_;
+
+        // If the group still has an empty slot, it has never been full and
+        // so no probe sequence continues past it; the slot can be made
+        // empty again.  Otherwise, it needs to stay as a marker.
+        size_t group = index / FlatHash::GROUP_SIZE;
+        FlatHash::Group g(ctrl_ + group * FlatHash::GROUP_SIZE);
+        if (g.matchEmpty()) {
+            ctrl_[index] = FlatHash::EMPTY;
+            ++growthLeft_;
+        }
+        else ctrl_[index] = FlatHash::DELETED;
+    }
+
+    void grow()
+    {
+        if (capacity_ == 0)
+            rehash(FlatHash::GROUP_SIZE);
+        else if (size_ * 2 <= maxLoad(capacity_))
+            rehash(capacity_);  // mostly deleted markers; clean them up
+        else rehash(capacity_ * 2);
+    }
+
+    void rehash(size_t newCapacity)
+    {
+        std::unique_ptr<int8_t[]> newCtrl(new int8_t[newCapacity]);
+        std::memset(newCtrl.get(), FlatHash::EMPTY, newCapacity);
+        Value * newSlots
+            = static_cast<Value *>(::operator new(newCapacity * sizeof(Value)));
+
+        FlatHashTable newTable;
+        newTable.ctrl_ = newCtrl.release();
+        newTable.slots_ = newSlots;
+        newTable.capacity_ = newCapacity;
+        newTable.growthLeft_ = maxLoad(newCapacity);
+        newTable.hash_ = hash_;
+        newTable.eq_ = eq_;
+
+        for (size_t i = 0;  i < capacity_;  ++i) {
+            if (ctrl_[i] < 0)
+                continue;
+            uint64_t h = hashOf(KeyOf()(slots_[i]));
+            size_t index = newTable.findInsertSlot(h);
+            new (const_cast<void *>(static_cast<const void *>(newSlots + index)))
+                Value(std::move(const_cast<typename std::remove_const<Value>::type &>(slots_[i])));
+            newTable.ctrl_[index] = h2(h);
+            --newTable.growthLeft_;
+            ++newTable.size_;
+        }
+
+        swap(newTable);
+    }
+
+    void destroy()
+    {
+        if (capacity_ == 0)
+            return;
+        for (size_t i = 0;  i < capacity_;  ++i) {
+            if (ctrl_[i] >= 0)
+                slots_[i].~Value();
+        }
+        ::operator delete(const_cast<void *>(static_cast<const void *>(slots_)));
+        delete[] ctrl_;
+    }
+};
+
+
+/*****************************************************************************/
+/* FLAT HASH MAP                                                             */
+/*****************************************************************************/
+
+template<typename Key, typename Mapped,
+         typename Hash = std::hash<Key>,
+         typename Eq = FlatHash::Equal>
+struct FlatHashMap
+    : public FlatHashTable<Key, std::pair<const Key, Mapped>,
+                           FlatHash::SelectFirst, Hash, Eq> {
+    typedef FlatHashTable<Key, std::pair<const Key, Mapped>,
+                          FlatHash::SelectFirst, Hash, Eq> Base;
+    typedef Mapped mapped_type;
+
+    using Base::Base;
+
+    FlatHashMap() = default;
+
+    Mapped & operator [] (const Key & key)
+    {
+        return this->emplaceWithKey(key, std::piecewise_construct,
+                                    std::forward_as_tuple(key),
+                                    std::forward_as_tuple())
+            .first->second;
+    }
+
+    Mapped & at(const Key & key)
+    {
+        auto it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("FlatHashMap::at(): key not found");
+        return it->second;
+    }
+
+    const Mapped & at(const Key & key) const
+    {
+        auto it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("FlatHashMap::at(): key not found");
+        return it->second;
+    }
+
+    template<typename... Args>
+    std::pair<typename Base::iterator, bool>
+    emplace(const Key & key, Args&&... args)
+    {
+        return this->emplaceWithKey(key, std::piecewise_construct,
+                                    std::forward_as_tuple(key),
+                                    std::forward_as_tuple
+                                        (std::forward<Args>(args)...));
+    }
+};
+
+
+/*****************************************************************************/
+/* FLAT HASH SET                                                             */
+/*****************************************************************************/
+
+template<typename Key,
+         typename Hash = std::hash<Key>,
+         typename Eq = FlatHash::Equal>
+struct FlatHashSet
+    : public FlatHashTable<Key, const Key, FlatHash::Identity, Hash, Eq> {
+    typedef FlatHashTable<Key, const Key, FlatHash::Identity, Hash, Eq> Base;
+
+    using Base::Base;
+
+    FlatHashSet() = default;
+
+    template<typename... Args>
+    std::pair<typename Base::iterator, bool>
+    emplace(Args&&... args)
+    {
+        Key key(std::forward<Args>(args)...);
+        return this->emplaceWithKey(key, std::move(key));
+    }
+};
+
+} // namespace MLDB
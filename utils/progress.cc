@@ -110,5 +110,80 @@ operator () (const ProgressState & progress)
     return onJsonProgress(value);
 }
 
+constexpr unsigned ProgressCounter::NUM_SLOTS;
+
+uint64_t
+ProgressCounter::
+total() const
+{
+    uint64_t result = 0;
+    for (auto & slot: slots)
+        result += slot.value.load(std::memory_order_relaxed);
+    return result;
+}
+
+unsigned
+ProgressCounter::
+slotIndex()
+{
+    static std::atomic<unsigned> nextSlot(0);
+    static thread_local unsigned slot = nextSlot.fetch_add(1) % NUM_SLOTS;
+    return slot;
+}
+
+ProgressSampler::
+ProgressSampler(std::function<bool ()> onSample, double interval)
+    : onSample(std::move(onSample)), interval(interval)
+{
+    thread = std::thread([this] () { this->run(); });
+}
+
+ProgressSampler::
+~ProgressSampler()
+{
+    stop();
+}
+
+void
+ProgressSampler::
+stop()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+    }
+    stopCondition.notify_all();
+    thread.join();
+}
+
+void
+ProgressSampler::
+run()
+{
+    auto duration = std::chrono::duration<double>(interval);
+    bool lastSample = false;
+    while (!lastSample) {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            stopCondition.wait_for(guard, duration, [&] () { return stopping; });
+            lastSample = stopping;
+        }
+
+        // Exceptions can't escape from this thread; one from onSample
+        // stops the sampling like a false return would
+        bool keepGoing = false;
+        try {
+            keepGoing = onSample();
+        } catch (...) {
+        }
+        if (!keepGoing) {
+            cancelled_ = true;
+            return;
+        }
+    }
+}
+
 } // namespace MLDB
 
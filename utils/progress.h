@@ -6,8 +6,12 @@
  **/
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <functional>
 
@@ -64,6 +68,70 @@ DECLARE_STRUCTURE_DESCRIPTION(ProgressState);
 
 typedef std::function<bool(const ProgressState &)> ProgressFunc;
 
+/** Count of things done, added to by many threads at once.  Each thread
+    adds to a slot on a cache line of its own with a relaxed add, so that
+    counting never contends.  The total is the sum of the slots; it may
+    miss the most recent adds of other threads, which is fine for
+    reporting progress.
+*/
+struct ProgressCounter {
+    void add(uint64_t n = 1)
+    {
+        slots[slotIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t total() const;
+
+private:
+    static constexpr unsigned NUM_SLOTS = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value { 0 };
+    };
+
+    Slot slots[NUM_SLOTS];
+
+    /// Slot that the current thread adds to; threads take them in turn
+    static unsigned slotIndex();
+};
+
+/** Calls onSample from a thread of its own every interval seconds, and a
+    last time when it's stopped, until it's stopped or onSample returns
+    false.  Progress counted with a ProgressCounter is reported from
+    onSample, so that the threads doing the work never build the progress
+    object or take the lock of whoever is watching it.
+*/
+struct ProgressSampler {
+    ProgressSampler(std::function<bool ()> onSample,
+                    double interval = 0.25);
+
+    /// Stops it, if that hasn't been done already
+    ~ProgressSampler();
+
+    /** Stop sampling, after calling onSample a last time so that the final
+        count is reported.  Waits for a call running in the sampler's
+        thread to finish.
+    */
+    void stop();
+
+    /** Has onSample returned false? */
+    bool cancelled() const
+    {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void run();
+
+    std::function<bool ()> onSample;
+    double interval;
+    std::mutex mutex;
+    std::condition_variable stopCondition;
+    bool stopping = false;
+    std::atomic<bool> cancelled_ { false };
+    std::thread thread;
+};
+
 /* This is a temporary conversion helper to avoid 
    changing all the procedure run signature.
    TODO - MLDB-2110 - fix all the progress signature */
@@ -10,7 +10,8 @@ using namespace MLDB;
 
 void
 Benchmarks::
-collectBenchmark(const vector<string> & tags, double delta)
+collectBenchmark(const vector<string> & tags, double delta,
+                 uint64_t numOps)
     noexcept
 {
     Guard lock(dataLock_);
@@ -18,6 +19,7 @@ collectBenchmark(const vector<string> & tags, double delta)
     //         label.c_str(), delta);
     for (const string & tag: tags) {
         data_[tag] += delta;
+        ops_[tag] += numOps;
     }
 }
 
@@ -37,10 +39,46 @@ dumpTotals(ostream & out)
     out << result;
 }
 
+void
+Benchmarks::
+dumpJson(ostream & out)
+{
+    Guard lock(dataLock_);
+
+    auto quote = [] (const string & str)
+        {
+            string result("\"");
+            for (char c: str) {
+                if (c == '"' || c == '\\')
+                    result += '\\';
+                result += c;
+            }
+            return result + "\"";
+        };
+
+    string result("{");
+    for (const auto & entry: data_) {
+        if (result.size() > 1)
+            result += ",";
+        uint64_t numOps = ops_[entry.first];
+        result += "\n  " + quote(entry.first)
+            + ": { \"seconds\": " + to_string(entry.second)
+            + ", \"ops\": " + to_string(numOps);
+        if (numOps)
+            result += ", \"nsPerOp\": "
+                + to_string(entry.second * 1000000000.0 / numOps);
+        result += " }";
+    }
+    result += "\n}\n";
+
+    out << result;
+}
+
 void
 Benchmarks::
 clear()
 {
     Guard lock(dataLock_);
     data_.clear();
+    ops_.clear();
 }
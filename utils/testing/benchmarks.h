@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -34,10 +35,18 @@ struct Benchmark;
    deltas. */
 
 struct Benchmarks {
+    /* Add delta seconds to each of the tags, over which numOps operations
+       were done. */
     void collectBenchmark(const std::vector<std::string> & tags,
-                          double delta) noexcept;
+                          double delta, uint64_t numOps = 0) noexcept;
 
     void dumpTotals(std::ostream & ostream = std::cerr);
+
+    /* Dump the totals as a JSON object with one member per tag, holding
+       its "seconds", "ops" and "nsPerOp", for tools that track results
+       from run to run. */
+    void dumpJson(std::ostream & ostream);
+
     void clear();
 
     typedef std::mutex Lock;
@@ -45,6 +54,7 @@ struct Benchmarks {
 
     Lock dataLock_;
     std::map<std::string, double> data_;
+    std::map<std::string, uint64_t> ops_;
 };
 
 
@@ -63,6 +73,14 @@ struct Benchmark {
         : bInstance_(bInstance), tags_({tag}), start_(Date::now())
     {}
 
+    /* Benchmark of numOps operations, so that the time per operation can
+       be reported. */
+    Benchmark(Benchmarks & bInstance, const std::string & tag,
+              uint64_t numOps)
+        : bInstance_(bInstance), tags_({tag}), numOps_(numOps),
+          start_(Date::now())
+    {}
+
     Benchmark(Benchmarks & bInstance, const std::vector<std::string> & tags)
         : bInstance_(bInstance), tags_(tags), start_(Date::now())
     {}
@@ -80,11 +98,12 @@ struct Benchmark {
     void reportBm() noexcept
     {
         double delta = Date::now() - start_;
-        bInstance_.collectBenchmark(tags_, delta);
+        bInstance_.collectBenchmark(tags_, delta, numOps_);
     }
 
     Benchmarks & bInstance_;
     std::vector<std::string> tags_;
+    uint64_t numOps_ = 0;
     Date start_;
 };
 
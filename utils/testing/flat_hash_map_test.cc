@@ -0,0 +1,219 @@
+/* flat_hash_map_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test for the flat hash map and set.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/flat_hash_map.h"
+
+#include <boost/test/unit_test.hpp>
+#include <unordered_map>
+#include <random>
+#include <string>
+#include <memory>
+#include <iostream>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_empty )
+{
+    FlatHashMap<int, int> map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(map.size(), 0);
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(3) == map.end());
+    BOOST_CHECK_EQUAL(map.count(3), 0);
+    BOOST_CHECK_EQUAL(map.erase(3), 0);
+    BOOST_CHECK_THROW(map.at(3), std::out_of_range);
+    map.clear();
+    BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_insert_find )
+{
+    FlatHashMap<int, int> map;
+
+    // Sequential keys are the worst case for an identity hash
+    for (int i = 0;  i < 10000;  ++i) {
+        auto res = map.insert({i, i * 2});
+        BOOST_CHECK(res.second);
+        BOOST_CHECK_EQUAL(res.first->second, i * 2);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 10000);
+
+    for (int i = 0;  i < 10000;  ++i) {
+        auto it = map.find(i);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->first, i);
+        BOOST_CHECK_EQUAL(it->second, i * 2);
+    }
+    BOOST_CHECK(map.find(10000) == map.end());
+    BOOST_CHECK(map.find(-1) == map.end());
+
+    // Inserting again doesn't replace
+    auto res = map.insert({5, 0});
+    BOOST_CHECK(!res.second);
+    BOOST_CHECK_EQUAL(res.first->second, 10);
+
+    map[5] = 3;
+    BOOST_CHECK_EQUAL(map.at(5), 3);
+    BOOST_CHECK_EQUAL(map[20000], 0);
+    BOOST_CHECK_EQUAL(map.size(), 10001);
+
+    size_t n = 0;
+    for (auto & v: map) {
+        BOOST_CHECK_EQUAL(map.at(v.first), v.second);
+        ++n;
+    }
+    BOOST_CHECK_EQUAL(n, map.size());
+}
+
+BOOST_AUTO_TEST_CASE( test_erase )
+{
+    FlatHashMap<int, string> map;
+    for (int i = 0;  i < 1000;  ++i)
+        map.emplace(i, to_string(i));
+
+    for (int i = 0;  i < 1000;  i += 2)
+        BOOST_CHECK_EQUAL(map.erase(i), 1);
+    BOOST_CHECK_EQUAL(map.size(), 500);
+
+    for (int i = 0;  i < 1000;  ++i) {
+        BOOST_CHECK_EQUAL(map.count(i), i % 2);
+        if (i % 2)
+            BOOST_CHECK_EQUAL(map.at(i), to_string(i));
+    }
+
+    // Erase through iterators
+    for (auto it = map.begin();  it != map.end();) {
+        if (it->first % 3 == 0)
+            it = map.erase(it);
+        else ++it;
+    }
+    for (auto & v: map)
+        BOOST_CHECK(v.first % 2 == 1 && v.first % 3 != 0);
+    BOOST_CHECK_EQUAL(map.size(), 333);
+}
+
+BOOST_AUTO_TEST_CASE( test_churn_against_unordered_map )
+{
+    // Lots of inserts and erases in a table of stable size, where the
+    // deleted markers need to be cleaned up without the table growing
+    FlatHashMap<uint64_t, uint64_t> map;
+    std::unordered_map<uint64_t, uint64_t> ref;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint64_t> dist(0, 2000);
+
+    for (int i = 0;  i < 200000;  ++i) {
+        uint64_t k = dist(rng);
+        if (rng() % 2) {
+            map[k] = i;
+            ref[k] = i;
+        }
+        else {
+            BOOST_REQUIRE_EQUAL(map.erase(k), ref.erase(k));
+        }
+    }
+
+    BOOST_CHECK_EQUAL(map.size(), ref.size());
+    BOOST_CHECK_LE(map.capacity(), 8192);
+    for (auto & v: ref) {
+        auto it = map.find(v.first);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->second, v.second);
+    }
+    for (auto & v: map)
+        BOOST_CHECK_EQUAL(ref.at(v.first), v.second);
+}
+
+BOOST_AUTO_TEST_CASE( test_copy_move_destruct )
+{
+    auto counter = std::make_shared<int>(0);
+
+    {
+        FlatHashMap<string, std::shared_ptr<int> > map;
+        for (int i = 0;  i < 100;  ++i)
+            map[to_string(i)] = counter;
+        BOOST_CHECK_EQUAL(counter.use_count(), 101);
+
+        auto map2 = map;
+        BOOST_CHECK_EQUAL(counter.use_count(), 201);
+        BOOST_CHECK_EQUAL(map2.size(), 100);
+        BOOST_CHECK(map2.at("42") == counter);
+
+        auto map3 = std::move(map);
+        BOOST_CHECK_EQUAL(counter.use_count(), 201);
+        BOOST_CHECK(map.empty());
+        BOOST_CHECK_EQUAL(map3.size(), 100);
+
+        map2.clear();
+        BOOST_CHECK_EQUAL(counter.use_count(), 101);
+    }
+
+    BOOST_CHECK_EQUAL(counter.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_set )
+{
+    FlatHashSet<string> set = { "a", "b", "c", "a" };
+    BOOST_CHECK_EQUAL(set.size(), 3);
+    BOOST_CHECK_EQUAL(set.count("a"), 1);
+    BOOST_CHECK_EQUAL(set.count("d"), 0);
+
+    FlatHashSet<string> set2 = { "c", "d" };
+    set.insert(set2.begin(), set2.end());
+    BOOST_CHECK_EQUAL(set.size(), 4);
+
+    BOOST_CHECK(!set.emplace("d").second);
+    BOOST_CHECK(set.emplace("e").second);
+    BOOST_CHECK_EQUAL(set.size(), 5);
+}
+
+namespace {
+
+struct TransparentStringHash {
+    typedef void is_transparent;
+
+    size_t operator () (const std::string & s) const
+    {
+        return std::hash<std::string>()(s);
+    }
+
+    size_t operator () (const char * s) const
+    {
+        return std::hash<std::string>()(s);
+    }
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_heterogeneous_lookup )
+{
+    FlatHashMap<string, int, TransparentStringHash> map;
+    map["hello"] = 1;
+    map["world"] = 2;
+
+    const char * key = "world";
+    auto it = map.find(key);
+    BOOST_REQUIRE(it != map.end());
+    BOOST_CHECK_EQUAL(it->second, 2);
+    BOOST_CHECK_EQUAL(map.count("nothing"), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_reserve )
+{
+    FlatHashMap<int, int> map;
+    map.reserve(1000);
+    size_t capacity = map.capacity();
+    BOOST_CHECK_GE(capacity, 1000);
+    for (int i = 0;  i < 1000;  ++i)
+        map[i] = i;
+    BOOST_CHECK_EQUAL(map.capacity(), capacity);
+}
@@ -0,0 +1,66 @@
+/* progress_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of progress counting and sampling.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/progress.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_counter_and_sampler )
+{
+    ProgressCounter counter;
+    std::atomic<int> numSamples(0);
+    uint64_t lastSample = 0;
+
+    ProgressSampler sampler([&] ()
+                            {
+                                uint64_t total = counter.total();
+                                BOOST_CHECK_GE(total, lastSample);
+                                lastSample = total;
+                                ++numSamples;
+                                return true;
+                            },
+                            0.01);
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 8;  ++i) {
+        threads.emplace_back([&] ()
+                             {
+                                 for (unsigned j = 0;  j < 1000000;  ++j)
+                                     counter.add();
+                             });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    sampler.stop();
+
+    BOOST_CHECK_EQUAL(counter.total(), 8000000);
+    // The last sample is taken when it's stopped
+    BOOST_CHECK_EQUAL(lastSample, 8000000);
+    BOOST_CHECK_GE(numSamples.load(), 1);
+    BOOST_CHECK(!sampler.cancelled());
+
+    // Stopping again does nothing
+    int samples = numSamples;
+    sampler.stop();
+    BOOST_CHECK_EQUAL(numSamples.load(), samples);
+}
+
+BOOST_AUTO_TEST_CASE( test_sampler_cancelled )
+{
+    std::atomic<int> numSamples(0);
+    ProgressSampler sampler([&] () { ++numSamples;  return false; }, 0.001);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(sampler.cancelled());
+    BOOST_CHECK_EQUAL(numSamples.load(), 1);
+}
@@ -17,8 +17,10 @@ $(eval $(call test,command_expression_test,command_expression test_utils,boost))
 $(eval $(call test,config_test,config,boost))
 $(eval $(call test,logger_test,log,boost))
 $(eval $(call test,compact_vector_test,arch,boost))
+$(eval $(call test,flat_hash_map_test,,boost))
 $(eval $(call test,fixture_test,test_utils,boost))
 $(eval $(call test,print_utils_test,,boost))
+$(eval $(call test,progress_test,progress,boost))
 
 
 $(eval $(call program,runner_test_helper,utils))
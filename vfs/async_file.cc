@@ -0,0 +1,698 @@
+/* async_file.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Queued block reads and writes of local files.
+*/
+
+#include "async_file.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include <cstring>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define MLDB_HAS_IO_URING 1
+#  endif
+#endif
+
+#if MLDB_HAS_IO_URING
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#endif
+
+
+namespace MLDB {
+
+namespace {
+
+/// Read until len bytes or the end of the file.  Returns the number of
+/// bytes read, or -errno.
+ssize_t preadAll(int fd, char * data, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t res = ::pread(fd, data + done, len - done, offset + done);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            return -errno;
+        if (res == 0)
+            break;
+        done += res;
+    }
+    return done;
+}
+
+/// Write all of the len bytes.  Returns len, or -errno.
+ssize_t pwriteAll(int fd, const char * data, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t res = ::pwrite(fd, data + done, len - done, offset + done);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            return -errno;
+        done += res;
+    }
+    return done;
+}
+
+struct Block {
+    char * data = nullptr;
+    iovec iov;                  ///< Whole of data, for unregistered I/O
+    uint64_t offset = 0;
+    size_t length = 0;          ///< Number of bytes to transfer
+    ssize_t result = 0;         ///< Number of bytes transferred, or -errno
+    bool isWrite = false;
+    bool inFlight = false;
+};
+
+#if MLDB_HAS_IO_URING
+
+/** Submission and completion queues of an io_uring, mapped into our address
+    space.  Each entry's user_data is the index of its block.
+*/
+struct Ring {
+    int fd = -1;
+
+    unsigned * sqHead = nullptr;
+    unsigned * sqTail = nullptr;
+    unsigned * sqMask = nullptr;
+    unsigned * sqArray = nullptr;
+    io_uring_sqe * sqes = nullptr;
+
+    unsigned * cqHead = nullptr;
+    unsigned * cqTail = nullptr;
+    unsigned * cqMask = nullptr;
+    io_uring_cqe * cqes = nullptr;
+
+    void * sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void * cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+
+    bool buffersRegistered = false;
+    unsigned toSubmit = 0;          ///< Entries queued but not yet submitted
+
+    Ring(const Ring &) = delete;
+    void operator = (const Ring &) = delete;
+
+    Ring()
+    {
+    }
+
+    ~Ring()
+    {
+        if (sqes)
+            ::munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            ::munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            ::munmap(sqRing, sqRingSize);
+        if (fd != -1)
+            ::close(fd);
+    }
+
+    /** Set up the ring.  Returns false, leaving it closed, if the kernel
+        won't give us one.
+    */
+    bool open(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (fd == -1)
+            return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes
+            + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED)
+            return close();
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            cqRing = sqRing;
+        else {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED)
+                return close();
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void * sqesMem = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqesMem == MAP_FAILED)
+            return close();
+        sqes = (io_uring_sqe *)sqesMem;
+
+        char * sq = (char *)sqRing;
+        sqHead = (unsigned *)(sq + params.sq_off.head);
+        sqTail = (unsigned *)(sq + params.sq_off.tail);
+        sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned *)(sq + params.sq_off.array);
+
+        char * cq = (char *)cqRing;
+        cqHead = (unsigned *)(cq + params.cq_off.head);
+        cqTail = (unsigned *)(cq + params.cq_off.tail);
+        cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return sqes != nullptr;
+    }
+
+    /// Pin the blocks, so that the kernel doesn't have to for each transfer
+    void registerBuffers(std::vector<Block> & blocks)
+    {
+        std::vector<iovec> iovs;
+        for (auto & b: blocks)
+            iovs.push_back(b.iov);
+        buffersRegistered
+            = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                        iovs.data(), iovs.size()) == 0;
+    }
+
+    /// Queue the transfer of the block, which is submitted by the next
+    /// call to enter()
+    void push(int fileFd, Block & block, int index)
+    {
+        unsigned tail = *sqTail;
+        unsigned slot = tail & *sqMask;
+        io_uring_sqe & sqe = sqes[slot];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = fileFd;
+        sqe.off = block.offset;
+        sqe.user_data = index;
+        if (buffersRegistered) {
+            sqe.opcode = block.isWrite
+                ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe.addr = (uint64_t)block.data;
+            sqe.len = block.length;
+            sqe.buf_index = index;
+        }
+        else {
+            block.iov.iov_len = block.length;
+            sqe.opcode = block.isWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe.addr = (uint64_t)&block.iov;
+            sqe.len = 1;
+        }
+        sqArray[slot] = slot;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++toSubmit;
+    }
+
+    /// Submit what's been queued, and wait for minComplete completions
+    void enter(unsigned minComplete)
+    {
+        while (toSubmit || minComplete) {
+            unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+            int res = ::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                minComplete, flags, nullptr, 0);
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res == -1)
+                throw MLDB::Exception(errno, "io_uring_enter");
+            toSubmit -= res;
+            return;
+        }
+    }
+
+    /// Take the next completion, if there is one
+    bool reap(int & index, int & result)
+    {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            return false;
+        const io_uring_cqe & cqe = cqes[head & *cqMask];
+        index = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    bool close()
+    {
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            ::munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            ::munmap(sqRing, sqRingSize);
+        cqRing = sqRing = MAP_FAILED;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+};
+
+#endif // MLDB_HAS_IO_URING
+
+/** Probe for io_uring once; if the kernel or its seccomp filter refuses it,
+    there's no use asking again for each file.
+*/
+bool probeAsyncFileIo()
+{
+#if MLDB_HAS_IO_URING
+    Ring ring;
+    return ring.open(1);
+#else
+    return false;
+#endif
+}
+
+
+/** Fixed set of blocks of one file, each of which is either idle or being
+    read or written.  Without io_uring, a transfer is done as soon as it's
+    asked for.
+*/
+struct BlockQueue {
+    BlockQueue(int fd, size_t blockSize, int queueDepth)
+        : fd(fd), blocks(std::max(queueDepth, 1))
+    {
+        for (auto & b: blocks) {
+            void * mem = nullptr;
+            // Page aligned, so that the kernel can do direct transfers
+            if (posix_memalign(&mem, 4096, blockSize) != 0) {
+                freeBlocks();
+                throw MLDB::Exception("couldn't allocate file I/O blocks");
+            }
+            b.data = (char *)mem;
+            b.iov.iov_base = mem;
+            b.iov.iov_len = blockSize;
+        }
+
+#if MLDB_HAS_IO_URING
+        if (asyncFileIoAvailable() && ring.open(blocks.size()))
+            ring.registerBuffers(blocks);
+#endif
+    }
+
+    ~BlockQueue()
+    {
+        try {
+            waitAll();
+        } catch (...) {
+            // There's nothing we can do, and the ring is closed next
+        }
+        freeBlocks();
+    }
+
+    int fd;
+    std::vector<Block> blocks;
+#if MLDB_HAS_IO_URING
+    Ring ring;
+#endif
+
+    void read(int index, uint64_t offset, size_t length)
+    {
+        start(index, offset, length, false /* isWrite */);
+    }
+
+    void write(int index, uint64_t offset, size_t length)
+    {
+        start(index, offset, length, true /* isWrite */);
+    }
+
+    /// Wait for the transfer of the block, if it's in flight
+    void wait(int index)
+    {
+#if MLDB_HAS_IO_URING
+        Block & block = blocks[index];
+        if (!ring.isOpen())
+            return;
+        // Submitting is left to here, so that everything queued since
+        // the last wait goes in one system call
+        ring.enter(block.inFlight ? 1 : 0);
+        for (;;) {
+            int i, result;
+            while (ring.reap(i, result)) {
+                blocks[i].result = result;
+                blocks[i].inFlight = false;
+                finish(blocks[i]);
+            }
+            if (!block.inFlight)
+                return;
+            ring.enter(1);
+        }
+#endif
+    }
+
+    void waitAll()
+    {
+        for (unsigned i = 0;  i < blocks.size();  ++i)
+            wait(i);
+    }
+
+private:
+    void start(int index, uint64_t offset, size_t length, bool isWrite)
+    {
+        Block & block = blocks[index];
+        ExcAssert(!block.inFlight);
+        block.offset = offset;
+        block.length = length;
+        block.isWrite = isWrite;
+        block.result = 0;
+#if MLDB_HAS_IO_URING
+        if (ring.isOpen()) {
+            block.inFlight = true;
+            ring.push(fd, block, index);
+            return;
+        }
+#endif
+        finish(block);
+    }
+
+    /** Complete the part of the transfer that the kernel didn't do: all of
+        it without io_uring, or the rest after a short transfer.
+    */
+    void finish(Block & block)
+    {
+        if (block.result == -EAGAIN || block.result == -EINTR)
+            block.result = 0;
+        if (block.result < 0 || (size_t)block.result == block.length)
+            return;
+
+        size_t done = block.result;
+        ssize_t res = block.isWrite
+            ? pwriteAll(fd, block.data + done, block.length - done,
+                        block.offset + done)
+            : preadAll(fd, block.data + done, block.length - done,
+                       block.offset + done);
+        block.result = res < 0 ? res : done + res;
+    }
+
+    void freeBlocks()
+    {
+        for (auto & b: blocks)
+            ::free(b.data);
+    }
+};
+
+} // file scope
+
+
+bool asyncFileIoAvailable()
+{
+    static const bool result = probeAsyncFileIo();
+    return result;
+}
+
+
+/*****************************************************************************/
+/* ASYNC FILE READ BUF                                                       */
+/*****************************************************************************/
+
+constexpr size_t AsyncFileReadBuf::DEFAULT_BLOCK_SIZE;
+constexpr int AsyncFileReadBuf::DEFAULT_QUEUE_DEPTH;
+
+struct AsyncFileReadBuf::Itl {
+    Itl(const std::string & filename, size_t blockSize, int queueDepth)
+        : filename(filename), blockSize(blockSize),
+          fd(openFile(filename)), fileSize(getSize()),
+          queue(fd, blockSize, queueDepth)
+    {
+    }
+
+    ~Itl()
+    {
+        queue.waitAll();
+        ::close(fd);
+    }
+
+    static int openFile(const std::string & filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "couldn't open file " + filename);
+        return fd;
+    }
+
+    uint64_t getSize()
+    {
+        struct stat st;
+        if (::fstat(fd, &st) == -1) {
+            int err = errno;
+            ::close(fd);
+            throw MLDB::Exception(err, "couldn't stat file " + filename);
+        }
+        return st.st_size;
+    }
+
+    std::string filename;
+    size_t blockSize;
+    int fd;
+    uint64_t fileSize;
+    BlockQueue queue;
+
+    /// The blocks from head to head + numQueued - 1 (modulo the depth) are
+    /// being read, in order.  The one before them is in the get area.
+    int head = 0;
+    int numQueued = 0;
+    int current = -1;               ///< Block in the get area, if any
+    uint64_t nextOffset = 0;        ///< Where the next block to queue starts
+    uint64_t getAreaOffset = 0;     ///< Offset in the file of eback()
+
+    int depth() const
+    {
+        return queue.blocks.size();
+    }
+
+    void refill()
+    {
+        int maxQueued = depth() - (current == -1 ? 0 : 1);
+        while (numQueued < maxQueued && nextOffset < fileSize) {
+            size_t length = std::min<uint64_t>(blockSize, fileSize - nextOffset);
+            queue.read((head + numQueued) % depth(), nextOffset, length);
+            nextOffset += length;
+            ++numQueued;
+        }
+    }
+
+    /// Drop everything and start reading again from the offset
+    void restart(uint64_t offset)
+    {
+        queue.waitAll();
+        head = 0;
+        numQueued = 0;
+        current = -1;
+        nextOffset = getAreaOffset = offset;
+    }
+};
+
+AsyncFileReadBuf::
+AsyncFileReadBuf(const std::string & filename,
+                 size_t blockSize, int queueDepth)
+    : itl(new Itl(filename, blockSize, queueDepth))
+{
+}
+
+AsyncFileReadBuf::
+~AsyncFileReadBuf()
+{
+}
+
+AsyncFileReadBuf::int_type
+AsyncFileReadBuf::
+underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    Itl & i = *itl;
+
+    // Give back the block that's been consumed
+    if (i.current != -1) {
+        i.getAreaOffset += egptr() - eback();
+        i.current = -1;
+    }
+    setg(nullptr, nullptr, nullptr);
+
+    i.refill();
+    if (i.numQueued == 0)
+        return traits_type::eof();
+
+    int index = i.head;
+    i.head = (i.head + 1) % i.depth();
+    --i.numQueued;
+    i.queue.wait(index);
+    i.current = index;
+
+    const Block & block = i.queue.blocks[index];
+    if (block.result < 0)
+        throw MLDB::Exception(-block.result, "reading file " + i.filename);
+    if (block.result == 0)
+        return traits_type::eof();  // the file was truncated under us
+
+    i.getAreaOffset = block.offset;
+    setg(block.data, block.data, block.data + block.result);
+    return traits_type::to_int_type(*gptr());
+}
+
+AsyncFileReadBuf::pos_type
+AsyncFileReadBuf::
+seekoff(off_type off, std::ios_base::seekdir dir,
+        std::ios_base::openmode which)
+{
+    if (!(which & std::ios_base::in))
+        return pos_type(off_type(-1));
+
+    Itl & i = *itl;
+    off_type position = i.getAreaOffset + (gptr() - eback());
+    off_type target;
+    if (dir == std::ios_base::beg)
+        target = off;
+    else if (dir == std::ios_base::cur)
+        target = position + off;
+    else target = i.fileSize + off;
+
+    if (target < 0)
+        return pos_type(off_type(-1));
+
+    if (target >= (off_type)i.getAreaOffset
+        && target <= (off_type)(i.getAreaOffset + (egptr() - eback()))) {
+        setg(eback(), eback() + (target - i.getAreaOffset), egptr());
+        return pos_type(target);
+    }
+
+    setg(nullptr, nullptr, nullptr);
+    i.restart(target);
+    return pos_type(target);
+}
+
+AsyncFileReadBuf::pos_type
+AsyncFileReadBuf::
+seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+
+/*****************************************************************************/
+/* ASYNC FILE WRITE BUF                                                      */
+/*****************************************************************************/
+
+constexpr size_t AsyncFileWriteBuf::DEFAULT_BLOCK_SIZE;
+constexpr int AsyncFileWriteBuf::DEFAULT_QUEUE_DEPTH;
+
+struct AsyncFileWriteBuf::Itl {
+    Itl(const std::string & filename, size_t blockSize, int queueDepth)
+        : filename(filename), blockSize(blockSize),
+          fd(openFile(filename)),
+          queue(fd, blockSize, queueDepth)
+    {
+    }
+
+    ~Itl()
+    {
+        queue.waitAll();
+        ::close(fd);
+    }
+
+    static int openFile(const std::string & filename)
+    {
+        int fd = ::open(filename.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "couldn't open file " + filename);
+        return fd;
+    }
+
+    std::string filename;
+    size_t blockSize;
+    int fd;
+    BlockQueue queue;
+
+    int current = 0;            ///< Block in the put area
+    uint64_t writeOffset = 0;   ///< Where the put area goes in the file
+    int error = 0;              ///< errno of the first write that failed
+
+    /// Wait for the block to be written and take note of its error
+    void reap(int index)
+    {
+        queue.wait(index);
+        Block & block = queue.blocks[index];
+        if (block.result < 0 && !error)
+            error = -block.result;
+        block.result = 0;
+    }
+};
+
+AsyncFileWriteBuf::
+AsyncFileWriteBuf(const std::string & filename,
+                  size_t blockSize, int queueDepth)
+    : itl(new Itl(filename, blockSize, queueDepth))
+{
+    char * data = itl->queue.blocks[0].data;
+    setp(data, data + blockSize);
+}
+
+AsyncFileWriteBuf::
+~AsyncFileWriteBuf()
+{
+    try {
+        sync();
+    } catch (...) {
+    }
+}
+
+AsyncFileWriteBuf::int_type
+AsyncFileWriteBuf::
+overflow(int_type c)
+{
+    Itl & i = *itl;
+    if (i.error)
+        return traits_type::eof();
+
+    size_t length = pptr() - pbase();
+    if (length) {
+        i.queue.write(i.current, i.writeOffset, length);
+        i.writeOffset += length;
+        i.current = (i.current + 1) % i.queue.blocks.size();
+        i.reap(i.current);
+        char * data = i.queue.blocks[i.current].data;
+        setp(data, data + i.blockSize);
+        if (i.error)
+            return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int
+AsyncFileWriteBuf::
+sync()
+{
+    if (traits_type::eq_int_type(overflow(traits_type::eof()),
+                                 traits_type::eof()))
+        return -1;
+
+    Itl & i = *itl;
+    for (unsigned b = 0;  b < i.queue.blocks.size();  ++b)
+        i.reap(b);
+    return i.error ? -1 : 0;
+}
+
+} // namespace MLDB
@@ -0,0 +1,94 @@
+/* async_file.h                                                    -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Streambufs for local files that keep a queue of large block reads or
+   writes in flight, submitted through io_uring where the kernel has it and
+   done with pread and pwrite otherwise.
+*/
+
+#pragma once
+
+#include <streambuf>
+#include <memory>
+#include <string>
+
+
+namespace MLDB {
+
+/** Can io_uring be used in this process?  It can't on kernels older than
+    5.1, or where a seccomp filter blocks it, in which case the blocks are
+    read and written one after the other instead.
+*/
+bool asyncFileIoAvailable();
+
+
+/*****************************************************************************/
+/* ASYNC FILE READ BUF                                                       */
+/*****************************************************************************/
+
+/** Reads a regular file sequentially, with the next queueDepth blocks of
+    blockSize bytes being read while the current one is consumed.  The
+    blocks are registered with the kernel once so that it doesn't need to
+    map them for each read.
+
+    Seeking drops the blocks in flight, unless the new position is in the
+    block being read.
+*/
+
+struct AsyncFileReadBuf: public std::streambuf {
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+    static constexpr int DEFAULT_QUEUE_DEPTH = 8;
+
+    AsyncFileReadBuf(const std::string & filename,
+                     size_t blockSize = DEFAULT_BLOCK_SIZE,
+                     int queueDepth = DEFAULT_QUEUE_DEPTH);
+
+    virtual ~AsyncFileReadBuf();
+
+protected:
+    virtual int_type underflow();
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* ASYNC FILE WRITE BUF                                                      */
+/*****************************************************************************/
+
+/** Writes a regular file from the start, truncating it.  Each block is
+    written as soon as it is full while the next one is filled, with up to
+    queueDepth of them in flight.  sync() waits for all of them to be
+    written; it and the next overflow() fail once a write has.
+*/
+
+struct AsyncFileWriteBuf: public std::streambuf {
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+    static constexpr int DEFAULT_QUEUE_DEPTH = 4;
+
+    AsyncFileWriteBuf(const std::string & filename,
+                      size_t blockSize = DEFAULT_BLOCK_SIZE,
+                      int queueDepth = DEFAULT_QUEUE_DEPTH);
+
+    /** Waits for the writes in flight.  Their errors are lost; call sync()
+        (or close the stream) first to see them.
+    */
+    virtual ~AsyncFileWriteBuf();
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual int sync();
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -0,0 +1,206 @@
+/* bzip2.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Bzip2 decompressor.  Files written by pbzip2 (and other parallel
+   writers) are made of many small concatenated bzip2 streams, which are
+   found by their signature and decompressed in parallel.  Files made of a
+   single big stream are decompressed serially.
+*/
+
+#include "parallel_decompressor.h"
+#include "mldb/arch/exception.h"
+#include <bzlib.h>
+#include <cstring>
+
+using namespace std;
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* BZIP2 DECOMPRESSOR                                                        */
+/*****************************************************************************/
+
+namespace {
+
+/// Length of the signature of a stream: "BZh", block size and block magic
+constexpr size_t SIGNATURE_SIZE = 10;
+
+/// Magic number at the start of the first block of a stream
+const char BLOCK_MAGIC[6] = { 0x31, 0x41, 0x59, 0x26, 0x53, 0x59 };
+
+/** How far we look for the start of the next stream before giving up and
+    decompressing serially.  Streams with 900k blocks written by parallel
+    compressors are a bit less than 1MB.
+*/
+constexpr size_t MAX_STREAM_SEARCH = 4 * 1024 * 1024;
+
+bool isSignature(const char * p)
+{
+    return p[0] == 'B' && p[1] == 'Z' && p[2] == 'h'
+        && p[3] >= '1' && p[3] <= '9'
+        && std::memcmp(p + 4, BLOCK_MAGIC, 6) == 0;
+}
+
+} // file scope
+
+struct Bzip2Decompressor: public ParallelDecompressor {
+
+    Bzip2Decompressor()
+        : outData(new char[OUT_BUFFER_SIZE])
+    {
+        std::memset(&stream, 0, sizeof(stream));
+        int res = BZ2_bzDecompressInit(&stream, 0, 0);
+        if (res != BZ_OK)
+            throw Exception("Error initializing bzip2 decompressor: %d", res);
+    }
+
+    ~Bzip2Decompressor()
+    {
+        BZ2_bzDecompressEnd(&stream);
+    }
+
+    virtual BlockStatus findBlock(const char * data, size_t len,
+                                  size_t & blockLength,
+                                  size_t & decompressedSize) override
+    {
+        if (len < SIGNATURE_SIZE)
+            return BLOCK_NEED_MORE;
+        if (!isSignature(data))
+            return BLOCK_NONE;
+
+        // Look for the start of the next stream, continuing from where we
+        // left off last time
+        size_t start = std::max(scanned, (size_t)1);
+        for (size_t i = start;  i + SIGNATURE_SIZE <= len;  ++i) {
+            const char * p = (const char *)memchr(data + i, 'B', len - i);
+            if (!p)
+                break;
+            i = p - data;
+            if (i + SIGNATURE_SIZE > len)
+                break;
+            if (isSignature(p)) {
+                blockLength = i;
+                decompressedSize = 0;
+                scanned = 0;
+                return BLOCK_FOUND;
+            }
+        }
+
+        if (len >= MAX_STREAM_SEARCH)
+            return BLOCK_NONE;
+
+        scanned = len - SIGNATURE_SIZE + 1;
+        return BLOCK_NEED_MORE;
+    }
+
+    virtual std::string decompressBlock(const std::string & block,
+                                        size_t decompressedSize) const override
+    {
+        std::string result;
+        char buf[65536];
+
+        bz_stream blockStream;
+        std::memset(&blockStream, 0, sizeof(blockStream));
+        if (BZ2_bzDecompressInit(&blockStream, 0, 0) != BZ_OK)
+            throw Exception("Error initializing bzip2 decompressor");
+
+        blockStream.next_in = (char *)block.data();
+        blockStream.avail_in = block.size();
+
+        int res;
+        do {
+            blockStream.next_out = buf;
+            blockStream.avail_out = sizeof(buf);
+            res = BZ2_bzDecompress(&blockStream);
+            result.append(buf, sizeof(buf) - blockStream.avail_out);
+        } while (res == BZ_OK && blockStream.avail_out == 0);
+
+        BZ2_bzDecompressEnd(&blockStream);
+
+        if (res != BZ_STREAM_END || blockStream.avail_in != 0)
+            throw Exception("Error decompressing bzip2 block: %d", res);
+
+        return result;
+    }
+
+    virtual size_t decompressStream(const char * data, size_t len,
+                                    const OnData & onData) override
+    {
+        if (trailingGarbage)
+            return len;
+
+        stream.next_in = (char *)data;
+        stream.avail_in = len;
+
+        for (;;) {
+            if (stream.avail_in == 0 && !inStream)
+                break;
+            if (streamEnded) {
+                // Another stream follows, unless it's garbage, which is
+                // ignored as bzip2 does
+                if (*stream.next_in != 'B') {
+                    trailingGarbage = true;
+                    break;
+                }
+                BZ2_bzDecompressEnd(&stream);
+                char * nextIn = stream.next_in;
+                unsigned int availIn = stream.avail_in;
+                std::memset(&stream, 0, sizeof(stream));
+                int res = BZ2_bzDecompressInit(&stream, 0, 0);
+                if (res != BZ_OK)
+                    throw Exception("Error initializing bzip2 decompressor: %d",
+                                    res);
+                stream.next_in = nextIn;
+                stream.avail_in = availIn;
+                streamEnded = false;
+            }
+
+            inStream = true;
+            stream.next_out = outData.get();
+            stream.avail_out = OUT_BUFFER_SIZE;
+
+            int res = BZ2_bzDecompress(&stream);
+            if (res != BZ_OK && res != BZ_STREAM_END) {
+                throw Exception("Error decompressing bzip2 stream: %d", res);
+            }
+
+            size_t numOut = OUT_BUFFER_SIZE - stream.avail_out;
+            size_t written = 0;
+            while (written < numOut)
+                written += onData(outData.get() + written, numOut - written);
+
+            if (res == BZ_STREAM_END) {
+                streamEnded = true;
+                inStream = false;
+            }
+            else if (stream.avail_out != 0)
+                break;  // all input consumed and all output flushed
+        }
+
+        return len;
+    }
+
+    virtual size_t finishStream(const OnData & onData) override
+    {
+        if (inStream)
+            throw Exception("Truncated bzip2 stream");
+        return 0;
+    }
+
+    static constexpr size_t OUT_BUFFER_SIZE = 65536;
+
+    bz_stream stream;
+    std::unique_ptr<char[]> outData;
+    size_t scanned = 0;        ///< Bytes of the current block already searched
+    bool inStream = false;     ///< Part of a stream has been read
+    bool streamEnded = false;  ///< The last stream read is complete
+    bool trailingGarbage = false;  ///< Rest of the input is ignored
+};
+
+constexpr size_t Bzip2Decompressor::OUT_BUFFER_SIZE;
+
+static Decompressor::Register<Bzip2Decompressor>
+registerBzip2Decompressor("bzip2", {"bz2"});
+
+} // namespace MLDB
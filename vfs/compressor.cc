@@ -27,6 +27,12 @@ Compressor::
 {
 }
 
+void
+Compressor::
+setOptions(const std::map<std::string, std::string> & options)
+{
+}
+
 namespace {
 
 std::mutex mutex;
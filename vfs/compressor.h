@@ -18,6 +18,7 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include <map>
 
 namespace MLDB {
 
@@ -59,6 +60,12 @@ struct Compressor {
     */
     virtual size_t finish(const OnData & onData) = 0;
 
+    /** Set compressor specific options from the stream's options, before
+        any data is compressed.  Options that aren't known are ignored; the
+        default implementation ignores them all.
+    */
+    virtual void setOptions(const std::map<std::string, std::string> & options);
+
     /** Convert a filename to a compression scheme.  Returns the empty
         string if it isn't found.
     */
@@ -17,6 +17,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "compressor.h"
+#include "async_file.h"
 #include <fstream>
 #include <mutex>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -29,12 +30,16 @@
 #include <boost/lexical_cast.hpp>
 #include "mldb/arch/exception.h"
 #include <errno.h>
+#include <sys/stat.h>
 #include <sstream>
 #include <thread>
 #include <unordered_map>
 #include "ext/lzma/lzma.h"
 #include "lz4_filter.h"
 #include "fs_utils.h"
+#include "uri_cache.h"
+#include "mldb/base/metrics.h"
+#include "mldb/base/trace_events.h"
 
 
 using namespace std;
@@ -188,8 +193,8 @@ struct BoostDecompressor: public boost::iostreams::multichar_input_filter {
                 n -= numGenerated;
                 numWritten += numGenerated;
 
-                // Everything else gets buffered for next time
-                ExcAssertEqual(outbuf.size(), 0);
+                // Everything else gets buffered for next time.  Parallel
+                // decompressors can call us several times once we're full.
                 ExcAssertEqual(outbufPos, 0);
                 outbuf.append(data + numGenerated, dataLength - numGenerated);
 
@@ -325,7 +330,8 @@ void addCompression(streambuf & buf,
                     boost::iostreams::filtering_ostream & stream,
                     const std::string & resource,
                     const std::string & compression,
-                    int compressionLevel)
+                    int compressionLevel,
+                    const std::map<std::string, std::string> & options)
 {
     using namespace boost::iostreams;
 
@@ -366,7 +372,9 @@ void addCompression(streambuf & buf,
             = Compressor::create(compression, compressionLevel);
         if (!compressor)
             throw MLDB::Exception("unknown filter compression " + compression);
-        stream.push(BoostCompressor(compressor));
+        BoostCompressor filter(compressor);
+        compressor->setOptions(options);
+        stream.push(filter);
     }
     else {
         std::string compressionFromFilename
@@ -376,7 +384,9 @@ void addCompression(streambuf & buf,
                 = Compressor::create(compressionFromFilename, compressionLevel);
             if (!compressor)
                 throw MLDB::Exception("unknown filter compression " + compression);
-            stream.push(BoostCompressor(compressor));
+            BoostCompressor filter(compressor);
+            compressor->setOptions(options);
+            stream.push(filter);
         }
     }
 }
@@ -396,7 +406,8 @@ void addCompression(streambuf & buf,
     if (it != options.end())
         compressionLevel = boost::lexical_cast<int>(it->second);
     
-    addCompression(buf, stream, resource, compression, compressionLevel);
+    addCompression(buf, stream, resource, compression, compressionLevel,
+                   options);
 }
 
 
@@ -668,6 +679,23 @@ status() const
 }
 
 
+/** Count the objects opened for reading and their size, by scheme.  The
+    reads themselves go through whatever streambuf or memory mapping the
+    handler returned, so it's the size of what's opened that is counted.
+*/
+static void recordOpenForReading(const std::string & scheme,
+                                 const UriHandler & handler)
+{
+    MetricLabels labels{{"scheme", scheme}};
+    Metrics::counter("mldb_vfs_opened_for_reading_total",
+                     "Files opened for reading", labels).add();
+    if (handler.info && handler.info->size > 0) {
+        Metrics::counter("mldb_vfs_opened_for_reading_bytes_total",
+                         "Size of the files opened for reading", labels)
+            .add(handler.info->size);
+    }
+}
+
 /*****************************************************************************/
 /* FILTER_ISTREAM                                                            */
 /*****************************************************************************/
@@ -768,6 +796,8 @@ open(const std::string & uri,
 {
     exceptions(ios::badbit);
 
+    TraceSpan span("vfs", "open", uri);
+
     string scheme, resource;
     std::tie(scheme, resource) = getScheme(uri);
 
@@ -779,10 +809,16 @@ open(const std::string & uri,
         }
     };
     auto options = createOptions(mode, compression, -1);
-    UriHandler handler = handlerFactory(scheme, resource, mode,
-                                        options,
-                                        onException);
+    UriHandler handler;
+    if (mode == ios::in)
+        handler = openCachedUri(scheme, resource, options, handlerFactory,
+                                onException);
+    if (!handler.buf)
+        handler = handlerFactory(scheme, resource, mode,
+                                 options,
+                                 onException);
     
+    recordOpenForReading(scheme, handler);
     openFromHandler(handler, resource, options);
 }
 
@@ -802,6 +838,8 @@ open(const std::string & uri,
 {
     exceptions(ios::badbit);
 
+    TraceSpan span("vfs", "open", uri);
+
     string scheme, resource;
     std::tie(scheme, resource) = getScheme(uri);
 
@@ -812,7 +850,11 @@ open(const std::string & uri,
             this->deferredExcPtr = excPtr;
         }
     };
-    UriHandler handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    UriHandler handler = openCachedUri(scheme, resource, options,
+                                       handlerFactory, onException);
+    if (!handler.buf)
+        handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    recordOpenForReading(scheme, handler);
     openFromHandler(handler, resource, options);
 }
 
@@ -876,8 +918,10 @@ openFromStreambuf(std::streambuf * buf,
                      && (ends_with(resource, ".lz4")
                          || ends_with(resource, ".lz4~"))));
 
-    if (gzip) new_stream->push(gzip_decompressor());
-    else if (bzip2) new_stream->push(bzip2_decompressor());
+    if (gzip)
+        new_stream->push(BoostDecompressor(Decompressor::create("gzip")));
+    else if (bzip2)
+        new_stream->push(BoostDecompressor(Decompressor::create("bzip2")));
     else if (lzma) new_stream->push(lzma_decompressor());
     else if (lz4) new_stream->push(lz4_decompressor());
     else if (compression == "") {
@@ -1050,6 +1094,27 @@ getUriHandler(const std::string & scheme)
 }
 
 struct RegisterFileHandler {
+    /// Files smaller than this are read through a filebuf; there's
+    /// nothing to gain from queueing reads of them
+    static constexpr uint64_t MIN_ASYNC_READ_SIZE = 1 << 20;
+
+    static bool asyncIoAllowed(const std::map<std::string, std::string> & options)
+    {
+        auto it = options.find("asyncIo");
+        return it == options.end()
+            || (it->second != "false" && it->second != "0");
+    }
+
+    /// Block reads and writes need a regular file, that pread and pwrite
+    /// work on.  A file that doesn't exist yet will be one.
+    static bool isRegularFile(const std::string & resource, bool mustExist)
+    {
+        struct stat st;
+        if (::stat(resource.c_str(), &st) == -1)
+            return !mustExist && errno == ENOENT;
+        return S_ISREG(st.st_mode);
+    }
+
     static UriHandler
     getFileHandler(const std::string & scheme,
                    std::string resource,
@@ -1076,6 +1141,13 @@ struct RegisterFileHandler {
             // MLDB-1303 mmap fails on empty files - force filebuf interface
             // on empty files despite the mapped option
             if (!options.count("mapped") || !info.size) {
+                if (info.size >= MIN_ASYNC_READ_SIZE && asyncIoAllowed(options)
+                    && isRegularFile(resource, true /* mustExist */)) {
+                    shared_ptr<std::streambuf> buf
+                        (new AsyncFileReadBuf(resource));
+                    return UriHandler(buf.get(), buf, info);
+                }
+
                 shared_ptr<std::filebuf> buf(new std::filebuf);
                 buf->open(resource, ios_base::openmode(mode));
 
@@ -1104,6 +1176,16 @@ struct RegisterFileHandler {
             if (resource == "-")
                 return UriHandler(cout.rdbuf(), nullptr);
 
+            // Appending and updating write where the file says, so they
+            // can't have several writes in flight
+            bool truncates = !(mode & (ios::app | ios::in | ios::ate));
+            if (truncates && asyncIoAllowed(options)
+                && isRegularFile(resource, false /* mustExist */)) {
+                shared_ptr<std::streambuf> buf
+                    (new AsyncFileWriteBuf(resource));
+                return UriHandler(buf.get(), buf);
+            }
+
             shared_ptr<std::filebuf> buf(new std::filebuf);
             buf->open(resource, ios_base::openmode(mode));
 
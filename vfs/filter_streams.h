@@ -157,6 +157,8 @@ public:
         mode = comma separated list of out,append,create
         compression = string (gz, bz2, xz, ...)
         resource = string to be used in error messages
+        asyncIo = "false" to write local files through a plain filebuf
+                  rather than as a queue of block writes
     */
     void open(const std::string & uri,
               const std::map<std::string, std::string> & options);
@@ -210,6 +212,10 @@ public:
 
         - "mapped" (any value): if true, then the system will attempt to
           memory map the file.
+        - "asyncIo": for local files of at least a megabyte that aren't
+          mapped, a queue of large block reads is kept in flight (through
+          io_uring where available).  Set to "false" to read them through
+          a plain filebuf instead.
         - "compression": if not set, it will detect.  If set to "none", it
           will not decompress no matter what it finds.  Otherwise, it can
           be set to a compression scheme to force that scheme to be used.
@@ -9,10 +9,13 @@
 */
 
 #include <libgen.h>
+#include <fnmatch.h>
 
+#include <atomic>
 #include <memory>
 #include <map>
 #include <mutex>
+#include <vector>
 
 #include "boost/filesystem.hpp"
 #include "mldb/ext/googleurl/src/url_util.h"
@@ -21,6 +24,7 @@
 
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/base/scope.h"
+#include "mldb/base/parallel.h"
 #include "mldb/vfs/filter_streams_registry.h"
 
 #include <sys/types.h>
@@ -513,6 +517,245 @@ bool forEachUriObject(const std::string & urlPrefix,
         ->forEach(realUrl, onObject, onSubdir, delimiter, startAt);
 }
 
+/*****************************************************************************/
+/* GLOB EXPANSION                                                            */
+/*****************************************************************************/
+
+namespace {
+
+/// One level of a directory, as listed by forEachUriObject()
+struct UriListing {
+    struct Object {
+        std::string uri;
+        FsObjectInfo info;
+        OpenUriObject open;
+    };
+
+    std::vector<Object> objects;
+    std::vector<std::string> subdirs;  ///< Without the trailing '/'
+};
+
+/// Listings made by forEachUriObjectMatching(), kept for a few seconds
+struct UriListingCache {
+    std::mutex mutex;
+    double ttl = 10.0;
+    std::map<std::string,
+             std::pair<Date, std::shared_ptr<const UriListing> > > entries;
+
+    std::shared_ptr<const UriListing> get(const std::string & dir)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = entries.find(dir);
+        if (it == entries.end())
+            return nullptr;
+        if (it->second.first.secondsUntil(Date::now()) > ttl) {
+            entries.erase(it);
+            return nullptr;
+        }
+        return it->second.second;
+    }
+
+    void put(const std::string & dir, std::shared_ptr<const UriListing> listing)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (ttl <= 0)
+            return;
+
+        // Drop what has expired, so that the cache doesn't keep growing
+        Date now = Date::now();
+        for (auto it = entries.begin();  it != entries.end();) {
+            if (it->second.first.secondsUntil(now) > ttl)
+                it = entries.erase(it);
+            else ++it;
+        }
+
+        entries[dir] = { now, std::move(listing) };
+    }
+};
+
+UriListingCache & getUriListingCache()
+{
+    static UriListingCache * result = new UriListingCache();
+    return *result;
+}
+
+std::string uriBaseName(const std::string & uri)
+{
+    auto pos = uri.rfind('/');
+    return pos == string::npos ? uri : string(uri, pos + 1);
+}
+
+bool hasWildcards(const std::string & component)
+{
+    return component.find_first_of("*?[") != string::npos;
+}
+
+bool matchesComponent(const std::string & name, const std::string & component)
+{
+    return !name.empty()
+        && fnmatch(component.c_str(), name.c_str(), FNM_PERIOD) == 0;
+}
+
+/** List the objects and subdirectories directly under dir, which ends in
+    a '/', passing the objects to onObject as they are found.  Returns
+    false if onObject returned false, in which case the listing is
+    incomplete and isn't kept.
+*/
+bool listUriDirectory(const std::string & dir,
+                      const std::function<bool (const UriListing::Object &)>
+                          & onObject,
+                      std::vector<std::string> & subdirs)
+{
+    UriListingCache & cache = getUriListingCache();
+
+    if (auto cached = cache.get(dir)) {
+        for (auto & obj: cached->objects) {
+            if (!onObject(obj))
+                return false;
+        }
+        subdirs = cached->subdirs;
+        return true;
+    }
+
+    auto listing = std::make_shared<UriListing>();
+
+    auto onObject2 = [&] (const std::string & uri,
+                          const FsObjectInfo & info,
+                          const OpenUriObject & open,
+                          int depth)
+        {
+            listing->objects.push_back({ uri, info, open });
+            return onObject(listing->objects.back());
+        };
+
+    auto onSubdir = [&] (const std::string & dirName, int depth)
+        {
+            listing->subdirs.push_back(dirName);
+            return false;
+        };
+
+    if (!forEachUriObject(dir, onObject2, onSubdir))
+        return false;
+
+    subdirs = listing->subdirs;
+    cache.put(dir, std::move(listing));
+    return true;
+}
+
+} // file scope
+
+bool forEachUriObjectMatching(const std::string & uriPattern,
+                              const OnUriObject & onObject,
+                              int maxParallelism)
+{
+    // Split into the literal directory that the listing starts from and
+    // the components from the first one with a wildcard onwards
+    auto schemePos = uriPattern.find("://");
+    size_t pathStart = schemePos == string::npos ? 0 : schemePos + 3;
+    auto wildcardPos = uriPattern.find_first_of("*?[", pathStart);
+    auto dirEnd = uriPattern.rfind('/', wildcardPos);
+
+    string baseDir;
+    size_t componentsStart;
+    if (dirEnd != string::npos && dirEnd >= pathStart) {
+        baseDir = string(uriPattern, 0, dirEnd + 1);
+        componentsStart = dirEnd + 1;
+    }
+    else if (pathStart == 0) {
+        // A relative path such as "*.csv"
+        baseDir = "./";
+        componentsStart = 0;
+    }
+    else throw MLDB::Exception("URI pattern '%s' has no directory to list",
+                               uriPattern.c_str());
+
+    std::vector<std::string> components;
+    for (size_t pos = componentsStart;  pos < uriPattern.size();) {
+        auto end = uriPattern.find('/', pos);
+        if (end == string::npos)
+            end = uriPattern.size();
+        if (end > pos)
+            components.emplace_back(uriPattern, pos, end - pos);
+        pos = end + 1;
+    }
+
+    if (components.empty())
+        throw MLDB::Exception("URI pattern '%s' doesn't name any object",
+                              uriPattern.c_str());
+
+    std::mutex callbackMutex;
+    std::atomic<bool> stopped(false);
+
+    std::function<bool (const std::string &, size_t)> walk
+        = [&] (const std::string & dir, size_t n) -> bool
+        {
+            if (stopped.load())
+                return false;
+
+            const std::string & component = components[n];
+            bool last = n == components.size() - 1;
+
+            // Nothing to list to get into a literal subdirectory
+            if (!last && !hasWildcards(component))
+                return walk(dir + component + "/", n + 1);
+
+            auto onListed = [&] (const UriListing::Object & obj)
+                {
+                    if (!last || !matchesComponent(uriBaseName(obj.uri),
+                                                   component))
+                        return !stopped.load();
+
+                    std::unique_lock<std::mutex> guard(callbackMutex);
+                    if (stopped.load())
+                        return false;
+                    if (!onObject(obj.uri, obj.info, obj.open, n + 1)) {
+                        stopped = true;
+                        return false;
+                    }
+                    return true;
+                };
+
+            std::vector<std::string> subdirs;
+            if (!listUriDirectory(dir, onListed, subdirs))
+                return false;
+            if (last)
+                return true;
+
+            std::vector<std::string> matching;
+            for (auto & subdir: subdirs) {
+                if (matchesComponent(uriBaseName(subdir), component))
+                    matching.push_back(subdir + "/");
+            }
+
+            auto onSubdir = [&] (size_t i)
+                {
+                    return walk(matching[i], n + 1);
+                };
+
+            return parallelMapHaltable(0, matching.size(), onSubdir,
+                                       maxParallelism);
+        };
+
+    walk(baseDir, 0);
+    return !stopped.load();
+}
+
+void setUriListingCacheTtl(double seconds)
+{
+    UriListingCache & cache = getUriListingCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    cache.ttl = seconds;
+    if (seconds <= 0)
+        cache.entries.clear();
+}
+
+void clearUriListingCache()
+{
+    UriListingCache & cache = getUriListingCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    cache.entries.clear();
+}
+
 string
 baseName(const std::string & filename)
 {
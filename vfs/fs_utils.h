@@ -184,6 +184,40 @@ bool forEachUriObject(const std::string & uriPrefix,
                       const std::string & delimiter = "/",
                       const std::string & startAt = "");
 
+/** For each object matching the given glob pattern, call the callback.
+    The pattern is an URI where each path component may contain the
+    wildcards of fnmatch(3), for example
+    "s3://bucket/logs/2026-0[1-3]/part-*.gz"; as with the shell, they don't
+    match across a '/'.
+
+    The directories matched by a component are listed in parallel, with at
+    most maxParallelism listings in flight at once, and objects are passed
+    to the callback as soon as the page of the listing containing them
+    arrives, so that the caller can start on them while the rest is still
+    being listed.  The callback is never called by more than one thread at
+    a time, but it may be called from a thread other than the caller's;
+    objects under different directories come in no particular order.
+
+    Listings are kept for a short time (see setUriListingCacheTtl()), so
+    that expanding the same or an overlapping pattern again soon after
+    doesn't list the directories again.
+
+    Will return false if the result of an onObject call was false, true
+    otherwise.
+*/
+bool forEachUriObjectMatching(const std::string & uriPattern,
+                              const OnUriObject & onObject,
+                              int maxParallelism = 16);
+
+/** Set for how many seconds directory listings made by
+    forEachUriObjectMatching() are reused.  The default is 10 seconds; zero
+    disables the reuse.
+*/
+void setUriListingCacheTtl(double seconds);
+
+/// Forget all listings kept by forEachUriObjectMatching()
+void clearUriListingCache();
+
 
 // wrappers around "basename" and "dirname" from the libc
 std::string baseName(const std::string & filename);
@@ -0,0 +1,179 @@
+/* gzip.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Gzip decompressor.  Files written by bgzip (and other BGZF writers) are
+   made of small gzip members whose compressed size is in their header;
+   these are decompressed in parallel.  Other files are decompressed
+   serially, including those made of several concatenated members.
+*/
+
+#include "parallel_decompressor.h"
+#include "mldb/arch/exception.h"
+#include <zlib.h>
+#include <cstring>
+
+using namespace std;
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GZIP DECOMPRESSOR                                                         */
+/*****************************************************************************/
+
+namespace {
+
+/// Size of the header of a BGZF block, including the extra field
+constexpr size_t BGZF_HEADER_SIZE = 18;
+
+/// Window bits telling zlib to expect a gzip header
+constexpr int GZIP_WINDOW_BITS = 16 + MAX_WBITS;
+
+uint32_t readLE(const char * p, int nbytes)
+{
+    uint32_t result = 0;
+    for (int i = nbytes - 1;  i >= 0;  --i) {
+        result = (result << 8) | (unsigned char)p[i];
+    }
+    return result;
+}
+
+} // file scope
+
+struct GzipDecompressor: public ParallelDecompressor {
+
+    GzipDecompressor()
+        : outData(new char[OUT_BUFFER_SIZE])
+    {
+        std::memset(&stream, 0, sizeof(stream));
+        int res = inflateInit2(&stream, GZIP_WINDOW_BITS);
+        if (res != Z_OK)
+            throw Exception("Error initializing gzip decompressor: %d", res);
+    }
+
+    ~GzipDecompressor()
+    {
+        inflateEnd(&stream);
+    }
+
+    virtual BlockStatus findBlock(const char * data, size_t len,
+                                  size_t & blockLength,
+                                  size_t & decompressedSize) override
+    {
+        if (len < BGZF_HEADER_SIZE)
+            return BLOCK_NEED_MORE;
+
+        const unsigned char * p = (const unsigned char *)data;
+        if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4)
+            || readLE(data + 10, 2) != 6 || p[12] != 'B' || p[13] != 'C'
+            || readLE(data + 14, 2) != 2)
+            return BLOCK_NONE;
+
+        blockLength = readLE(data + 16, 2) + 1;
+        if (blockLength < BGZF_HEADER_SIZE + 8)
+            return BLOCK_NONE;
+        if (len < blockLength)
+            return BLOCK_NEED_MORE;
+
+        decompressedSize = readLE(data + blockLength - 4, 4);
+        return BLOCK_FOUND;
+    }
+
+    virtual std::string decompressBlock(const std::string & block,
+                                        size_t decompressedSize) const override
+    {
+        std::string result(decompressedSize, '\0');
+
+        z_stream blockStream;
+        std::memset(&blockStream, 0, sizeof(blockStream));
+        if (inflateInit2(&blockStream, GZIP_WINDOW_BITS) != Z_OK)
+            throw Exception("Error initializing gzip decompressor");
+
+        blockStream.next_in = (Bytef *)block.data();
+        blockStream.avail_in = block.size();
+        // Avoid a null pointer for empty blocks, which zlib rejects
+        char dummy;
+        blockStream.next_out = (Bytef *)(result.empty() ? &dummy : &result[0]);
+        blockStream.avail_out = result.size();
+
+        int res = inflate(&blockStream, Z_FINISH);
+        size_t totalOut = blockStream.total_out;
+        inflateEnd(&blockStream);
+
+        if (res != Z_STREAM_END || totalOut != decompressedSize)
+            throw Exception("Error decompressing gzip block: %d", res);
+
+        return result;
+    }
+
+    virtual size_t decompressStream(const char * data, size_t len,
+                                    const OnData & onData) override
+    {
+        if (trailingGarbage)
+            return len;
+
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = len;
+
+        for (;;) {
+            if (stream.avail_in == 0 && !inMember)
+                break;
+            if (memberEnded) {
+                // Another member follows, unless it's padding or garbage,
+                // which is ignored as gzip does
+                if (*stream.next_in != 0x1f) {
+                    trailingGarbage = true;
+                    break;
+                }
+                inflateReset(&stream);
+                memberEnded = false;
+            }
+
+            inMember = true;
+            stream.next_out = (Bytef *)outData.get();
+            stream.avail_out = OUT_BUFFER_SIZE;
+
+            int res = inflate(&stream, Z_NO_FLUSH);
+            if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR) {
+                throw Exception("Error decompressing gzip stream: %s",
+                                stream.msg ? stream.msg : "unknown error");
+            }
+
+            size_t numOut = OUT_BUFFER_SIZE - stream.avail_out;
+            size_t written = 0;
+            while (written < numOut)
+                written += onData(outData.get() + written, numOut - written);
+
+            if (res == Z_STREAM_END) {
+                memberEnded = true;
+                inMember = false;
+            }
+            else if (stream.avail_out != 0)
+                break;  // all input consumed and all output flushed
+        }
+
+        return len;
+    }
+
+    virtual size_t finishStream(const OnData & onData) override
+    {
+        if (inMember)
+            throw Exception("Truncated gzip stream");
+        return 0;
+    }
+
+    static constexpr size_t OUT_BUFFER_SIZE = 65536;
+
+    z_stream stream;
+    std::unique_ptr<char[]> outData;
+    bool inMember = false;     ///< Part of a member has been read
+    bool memberEnded = false;  ///< The last member read is complete
+    bool trailingGarbage = false;  ///< Rest of the input is ignored
+};
+
+constexpr size_t GzipDecompressor::OUT_BUFFER_SIZE;
+
+static Decompressor::Register<GzipDecompressor>
+registerGzipDecompressor("gzip", {"gz"});
+
+} // namespace MLDB
@@ -0,0 +1,135 @@
+/* parallel_decompressor.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Base class for decompressors of independently compressed blocks.
+*/
+
+#include "parallel_decompressor.h"
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+ParallelDecompressor::
+ParallelDecompressor()
+    : numThreads(std::max<int>(1, std::thread::hardware_concurrency())),
+      streaming(false)
+{
+}
+
+ParallelDecompressor::
+~ParallelDecompressor()
+{
+    // Let the blocks in flight finish, as they use our virtual methods
+    for (auto & b: blocks)
+        b.wait();
+}
+
+size_t
+ParallelDecompressor::
+decompress(const char * data, size_t len, const OnData & onData)
+{
+    if (streaming)
+        return decompressStream(data, len, onData);
+
+    pending.append(data, len);
+
+    size_t pos = 0;
+    while (pos < pending.size()) {
+        size_t blockLength = 0, decompressedSize = 0;
+        BlockStatus status = findBlock(pending.data() + pos,
+                                       pending.size() - pos,
+                                       blockLength, decompressedSize);
+        if (status == BLOCK_NEED_MORE)
+            break;
+
+        if (status == BLOCK_NONE) {
+            // Decompress the rest serially, after the blocks in flight
+            writeBlocks(onData, true /* waitForAll */);
+            streaming = true;
+            std::string rest(pending, pos);
+            pending = std::string();
+            decompressStream(rest.data(), rest.size(), onData);
+            return len;
+        }
+
+        submitBlock(onData, std::string(pending, pos, blockLength),
+                    decompressedSize);
+        pos += blockLength;
+    }
+
+    pending.erase(0, pos);
+    writeBlocks(onData, false /* waitForAll */);
+
+    return len;
+}
+
+size_t
+ParallelDecompressor::
+finish(const OnData & onData)
+{
+    size_t result = writeBlocks(onData, true /* waitForAll */);
+    if (!pending.empty()) {
+        // An incomplete or final block; let the stream decompressor deal
+        // with it
+        streaming = true;
+        std::string rest = std::move(pending);
+        pending = std::string();
+        result += decompressStream(rest.data(), rest.size(), onData);
+    }
+    return result + finishStream(onData);
+}
+
+void
+ParallelDecompressor::
+submitBlock(const OnData & onData, std::string block, size_t decompressedSize)
+{
+    // Bound the memory used by the blocks in flight
+    while (blocks.size() >= 2 * numThreads)
+        writeBlock(onData);
+
+    auto run = [this] (const std::string & block, size_t decompressedSize)
+        {
+            return this->decompressBlock(block, decompressedSize);
+        };
+
+    blocks.emplace_back(std::async(std::launch::async, run, std::move(block),
+                                   decompressedSize));
+}
+
+size_t
+ParallelDecompressor::
+writeBlock(const OnData & onData)
+{
+    std::string decompressed = blocks.front().get();
+    blocks.pop_front();
+    size_t written = 0;
+    while (written < decompressed.size()) {
+        written += onData(decompressed.data() + written,
+                          decompressed.size() - written);
+    }
+    return written;
+}
+
+size_t
+ParallelDecompressor::
+writeBlocks(const OnData & onData, bool waitForAll)
+{
+    size_t result = 0;
+    while (!blocks.empty()
+           && (waitForAll
+               || blocks.front().wait_for(std::chrono::seconds(0))
+                  == std::future_status::ready)) {
+        result += writeBlock(onData);
+    }
+    return result;
+}
+
+} // namespace MLDB
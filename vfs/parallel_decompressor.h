@@ -0,0 +1,81 @@
+/* parallel_decompressor.h                                         -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Base class for decompressors of formats made of independently compressed
+   blocks whose boundaries can be found without decompressing them, like
+   bgzip or pbzip2 output.  These blocks are decompressed in parallel.
+*/
+
+#pragma once
+
+#include "compressor.h"
+#include <deque>
+#include <future>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+/** Decompressor that splits its input into blocks, decompresses them on
+    other threads and outputs the result in order.  As soon as the input
+    isn't made of such blocks, the rest of it is passed to the (serial)
+    stream decompressor implemented by the derived class.
+*/
+
+struct ParallelDecompressor: public Decompressor {
+
+    ParallelDecompressor();
+
+    virtual ~ParallelDecompressor();
+
+    virtual size_t decompress(const char * data, size_t len,
+                              const OnData & onData) override;
+
+    virtual size_t finish(const OnData & onData) override;
+
+protected:
+    enum BlockStatus {
+        BLOCK_FOUND,      ///< Block found; its length has been set
+        BLOCK_NEED_MORE,  ///< Not enough data to tell
+        BLOCK_NONE        ///< Not a block; the rest must be streamed
+    };
+
+    /** Look for an independent block at the start of the given data.  If
+        one is found, set its length in bytes, and the size of its
+        decompressed data if known, otherwise 0.  The data always starts
+        at the same place until a block is found, and grows between calls.
+    */
+    virtual BlockStatus findBlock(const char * data, size_t len,
+                                  size_t & blockLength,
+                                  size_t & decompressedSize) = 0;
+
+    /** Decompress a whole block as returned by findBlock.  This is called
+        on another thread, and so must only use its arguments.
+    */
+    virtual std::string decompressBlock(const std::string & block,
+                                        size_t decompressedSize) const = 0;
+
+    /** Decompress data serially, once the input isn't made of blocks. */
+    virtual size_t decompressStream(const char * data, size_t len,
+                                    const OnData & onData) = 0;
+
+    /** Finish serial decompression. */
+    virtual size_t finishStream(const OnData & onData) = 0;
+
+private:
+    void submitBlock(const OnData & onData, std::string block,
+                     size_t decompressedSize);
+    size_t writeBlock(const OnData & onData);
+    size_t writeBlocks(const OnData & onData, bool waitForAll);
+
+    int numThreads;
+    bool streaming;  ///< Input isn't made of blocks
+    std::string pending;  ///< Input not yet making up a whole block
+    std::deque<std::future<std::string> > blocks;  ///< Blocks in flight
+};
+
+} // namespace MLDB
@@ -14,6 +14,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/async_file.h"
 #include "mldb/arch/exception.h"
 #include "mldb/arch/exception_handler.h"
 
@@ -192,6 +193,95 @@ BOOST_AUTO_TEST_CASE( test_compress_decompress_zstandard )
     test_compress_decompress(input_file, "zst", zstd_cmd, zstd_cmd + " -d");
 }
 
+/* Multi-threaded zstd compression writes independent blocks, which must
+   be readable both by our (parallel) decompressor and by the zstd tool. */
+BOOST_AUTO_TEST_CASE( test_compress_decompress_zstandard_threads )
+{
+    string input_file = "mldb/vfs/testing/filter_streams_test.cc";
+    string zstd_cmd = "./build/x86_64/bin/zstd";
+    string cmp_file = "build/x86_64/tmp/filter_streams_test-threads.zst";
+    string dec_file = "build/x86_64/tmp/filter_streams_test-threads";
+    fs::create_directories("build/x86_64/tmp");
+    FileCleanup cleanupCmp(cmp_file), cleanupDec(dec_file);
+
+    string input;
+    {
+        filter_istream in(input_file);
+        input = in.readAll();
+    }
+
+    // Several copies, so that there are many blocks
+    {
+        filter_ostream out(cmp_file,
+                           { { "compressionThreads", "4" },
+                             { "compressionBlockSize", "10000" } });
+        for (unsigned i = 0;  i < 20;  ++i)
+            out << input;
+        out.close();
+    }
+
+    string expected;
+    for (unsigned i = 0;  i < 20;  ++i)
+        expected += input;
+
+    {
+        filter_istream in(cmp_file);
+        BOOST_CHECK(in.readAll() == expected);
+    }
+
+    decompress_using_tool(cmp_file, dec_file, zstd_cmd + " -d");
+    {
+        filter_istream in(dec_file);
+        BOOST_CHECK(in.readAll() == expected);
+    }
+}
+
+/* Concatenated gzip members and bzip2 streams, as written by bgzip or
+   pbzip2, are decompressed as a whole.  The bzip2 ones are decompressed in
+   parallel. */
+BOOST_AUTO_TEST_CASE( test_decompress_concatenated_gz_bzip2 )
+{
+    string input_file = "mldb/vfs/testing/filter_streams_test.cc";
+    fs::create_directories("build/x86_64/tmp");
+
+    string input;
+    {
+        filter_istream in(input_file);
+        input = in.readAll();
+    }
+
+    string expected;
+    for (unsigned i = 0;  i < 10;  ++i)
+        expected += input;
+
+    for (string ext: { "gz", "bz2" }) {
+        string command = ext == "gz" ? "gzip" : "bzip2";
+        string cmp_file = "build/x86_64/tmp/filter_streams_test-concat." + ext;
+        FileCleanup cleanupCmp(cmp_file);
+        system("rm -f " + cmp_file);
+        for (unsigned i = 0;  i < 10;  ++i)
+            system(command + " -c " + input_file + " >> " + cmp_file);
+
+        {
+            filter_istream in(cmp_file);
+            BOOST_CHECK(in.readAll() == expected);
+        }
+
+        // A truncated file is an error, not a short read
+        system("head -c -100 " + cmp_file + " > " + cmp_file + ".trunc");
+        FileCleanup cleanupTrunc(cmp_file + ".trunc");
+        filter_istream in(cmp_file + ".trunc");
+        auto action = [&] ()
+            {
+                MLDB_TRACE_EXCEPTIONS(false);
+                string line;
+                for (;;)
+                    getline(in, line);
+            };
+        BOOST_CHECK_THROW(action(), MLDB::Exception);
+    }
+}
+
 BOOST_AUTO_TEST_CASE( test_open_failure )
 {
     filter_ostream stream;
@@ -609,3 +699,42 @@ BOOST_AUTO_TEST_CASE(test_empty_filter_stream_mapped)
     // but we can read it without failing
     BOOST_CHECK_EQUAL(stream.readAll(), "");
 }
+
+BOOST_AUTO_TEST_CASE(test_async_io_matches_filebuf)
+{
+    cerr << "async file I/O through io_uring: " << asyncFileIoAvailable()
+         << endl;
+
+    // Not a multiple of the block size, so that the last block is short
+    string data(5 * 1000 * 1000 + 123, 0);
+    for (size_t i = 0;  i < data.size();  ++i)
+        data[i] = i ^ (i >> 8) ^ (i >> 16);
+
+    string filename = "build/x86_64/tmp/async_io_test.bin";
+    FileCleanup cleanup(filename);
+
+    {
+        filter_ostream stream(filename);
+        for (size_t i = 0;  i < data.size();  i += 1001)
+            stream.write(data.data() + i, min<size_t>(1001, data.size() - i));
+        stream.close();
+    }
+
+    for (string asyncIo: { "true", "false" }) {
+        filter_istream stream(filename, { { "asyncIo", asyncIo } });
+        BOOST_CHECK_EQUAL(stream.readAll(), data);
+    }
+
+    // Seeking within the current block and outside of it
+    AsyncFileReadBuf buf(filename, 65536, 4);
+    std::istream stream(&buf);
+    string chunk(10, 0);
+    for (size_t offset: { size_t(4000000), size_t(4000005), size_t(12),
+                          data.size() - 10 }) {
+        stream.seekg(offset);
+        stream.read(&chunk[0], 10);
+        BOOST_CHECK_EQUAL(chunk, data.substr(offset, 10));
+        BOOST_CHECK_EQUAL(stream.tellg(), offset + 10);
+    }
+    BOOST_CHECK_EQUAL(stream.get(), EOF);
+}
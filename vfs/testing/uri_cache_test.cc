@@ -0,0 +1,190 @@
+/* uri_cache_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the read-through cache of remote objects.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/uri_cache.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/arch/exception.h"
+#include "mldb/jml/utils/guard.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <string.h>
+#include <mutex>
+
+using namespace std;
+namespace fs = boost::filesystem;
+using namespace ML;
+using namespace MLDB;
+
+
+/* A "cachetest" scheme serving objects from memory, which counts how many
+   times each of them is opened. */
+
+namespace {
+
+struct TestObject {
+    string contents;
+    string etag;
+    int numOpens = 0;
+};
+
+std::mutex objectsLock;
+map<string, TestObject> objects;
+
+TestObject & getObject(const string & resource)
+{
+    std::unique_lock<std::mutex> guard(objectsLock);
+    return objects[resource];
+}
+
+struct TestUrlFsHandler : public UrlFsHandler {
+    virtual FsObjectInfo getInfo(const Url & url) const
+    {
+        auto info = tryGetInfo(url);
+        if (!info)
+            throw MLDB::Exception("object not found: " + url.toString());
+        return info;
+    }
+
+    virtual FsObjectInfo tryGetInfo(const Url & url) const
+    {
+        std::unique_lock<std::mutex> guard(objectsLock);
+        FsObjectInfo info;
+        auto it = objects.find(string(url.original, strlen("cachetest://")));
+        if (it == objects.end())
+            return info;
+        info.exists = true;
+        info.etag = it->second.etag;
+        info.size = it->second.contents.size();
+        return info;
+    }
+
+    virtual void makeDirectory(const Url & url) const
+    {
+    }
+
+    virtual bool erase(const Url & url, bool throwException) const
+    {
+        return false;
+    }
+
+    virtual bool forEach(const Url & prefix,
+                         const OnUriObject & onObject,
+                         const OnUriSubdir & onSubdir,
+                         const std::string & delimiter,
+                         const std::string & startAt) const
+    {
+        return true;
+    }
+};
+
+UriHandler
+getTestHandler(const std::string & scheme,
+               const std::string & resource,
+               std::ios_base::openmode mode,
+               const std::map<std::string, std::string> & options,
+               const OnUriHandlerException & onException)
+{
+    std::unique_lock<std::mutex> guard(objectsLock);
+    TestObject & obj = objects.at(resource);
+    ++obj.numOpens;
+    auto buf = std::make_shared<std::stringbuf>(obj.contents, ios::in);
+    FsObjectInfo info;
+    info.exists = true;
+    info.etag = obj.etag;
+    info.size = obj.contents.size();
+    return UriHandler(buf.get(), buf, info);
+}
+
+struct AtInit {
+    AtInit()
+    {
+        registerUrlFsHandler("cachetest", new TestUrlFsHandler());
+        registerUriHandler("cachetest", getTestHandler);
+    }
+} atInit;
+
+string readAll(const string & uri)
+{
+    filter_istream stream(uri);
+    return stream.readAll();
+}
+
+size_t numFiles(const string & dir)
+{
+    return std::distance(fs::directory_iterator(dir),
+                         fs::directory_iterator());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_uri_cache )
+{
+    string dir = "build/x86_64/tmp/uri_cache_test";
+    fs::remove_all(dir);
+    Call_Guard guard([&] () { disableUriCache(); fs::remove_all(dir); });
+
+    string a1(500, 'a'), a2(500, 'A');
+    getObject("bucket/a.txt") = { a1, "etag1" };
+    getObject("bucket/b.txt") = { string(400, 'b'), "etag1" };
+
+    // Disabled: each open goes to the remote object
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/a.txt"), a1);
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/a.txt"), a1);
+    BOOST_CHECK_EQUAL(getObject("bucket/a.txt").numOpens, 2);
+
+    setUriCache(dir, 1500, { "cachetest" });
+
+    // Enabled: the first open downloads, the next ones are served locally
+    getObject("bucket/a.txt").numOpens = 0;
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/a.txt"), a1);
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/a.txt"), a1);
+    BOOST_CHECK_EQUAL(getObject("bucket/a.txt").numOpens, 1);
+    BOOST_CHECK_EQUAL(numFiles(dir), 1);
+
+    // The info is that of the remote object
+    {
+        filter_istream stream("cachetest://bucket/a.txt");
+        BOOST_CHECK_EQUAL(stream.info().etag, "etag1");
+    }
+
+    // A new version of the object is downloaded again
+    getObject("bucket/a.txt").contents = a2;
+    getObject("bucket/a.txt").etag = "etag2";
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/a.txt"), a2);
+    BOOST_CHECK_EQUAL(getObject("bucket/a.txt").numOpens, 2);
+
+    // Both versions fit in the cache with b, and the least recently used
+    // one goes when the size limit is reached
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/b.txt"), string(400, 'b'));
+    BOOST_CHECK_EQUAL(numFiles(dir), 3);
+    getObject("bucket/c.txt") = { string(200, 'c'), "etag1" };
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/c.txt"), string(200, 'c'));
+    BOOST_CHECK_EQUAL(numFiles(dir), 3);
+
+    // The others are still cached
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/b.txt"), string(400, 'b'));
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/a.txt"), a2);
+    BOOST_CHECK_EQUAL(getObject("bucket/a.txt").numOpens, 2);
+    BOOST_CHECK_EQUAL(getObject("bucket/b.txt").numOpens, 1);
+
+    // Objects bigger than the cache aren't cached
+    getObject("bucket/d.txt") = { string(2000, 'd'), "etag1" };
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/d.txt"), string(2000, 'd'));
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/d.txt"), string(2000, 'd'));
+    BOOST_CHECK_EQUAL(getObject("bucket/d.txt").numOpens, 2);
+
+    // Objects without any version information aren't cached
+    getObject("bucket/e.txt") = { "e", "" };
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/e.txt"), "e");
+    BOOST_CHECK_EQUAL(readAll("cachetest://bucket/e.txt"), "e");
+    BOOST_CHECK_EQUAL(getObject("bucket/e.txt").numOpens, 2);
+}
@@ -0,0 +1,212 @@
+/* uri_glob_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the expansion of glob patterns over URIs.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/arch/exception.h"
+#include "mldb/jml/utils/guard.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <mutex>
+#include <string.h>
+
+using namespace std;
+namespace fs = boost::filesystem;
+using namespace ML;
+using namespace MLDB;
+
+
+/* A "globtest" scheme with a flat set of keys, listed like an object store
+   with a delimiter, which counts how many listings are made. */
+
+namespace {
+
+std::mutex keysLock;
+set<string> keys;
+std::atomic<int> numListings(0);
+
+struct TestUrlFsHandler : public UrlFsHandler {
+    virtual FsObjectInfo getInfo(const Url & url) const
+    {
+        auto info = tryGetInfo(url);
+        if (!info)
+            throw MLDB::Exception("object not found: " + url.toString());
+        return info;
+    }
+
+    virtual FsObjectInfo tryGetInfo(const Url & url) const
+    {
+        std::unique_lock<std::mutex> guard(keysLock);
+        FsObjectInfo info;
+        info.exists = keys.count(string(url.original, strlen("globtest://")));
+        return info;
+    }
+
+    virtual void makeDirectory(const Url & url) const
+    {
+    }
+
+    virtual bool erase(const Url & url, bool throwException) const
+    {
+        return false;
+    }
+
+    virtual bool forEach(const Url & prefix,
+                         const OnUriObject & onObject,
+                         const OnUriSubdir & onSubdir,
+                         const std::string & delimiter,
+                         const std::string & startAt) const
+    {
+        ++numListings;
+        string dir(prefix.original, strlen("globtest://"));
+
+        std::unique_lock<std::mutex> guard(keysLock);
+        set<string> subdirs;
+        for (auto & key: keys) {
+            if (key.compare(0, dir.size(), dir) != 0)
+                continue;
+            auto pos = key.find(delimiter, dir.size());
+            if (pos != string::npos) {
+                subdirs.insert(string(key, 0, pos));
+                continue;
+            }
+            FsObjectInfo info;
+            info.exists = true;
+            if (!onObject("globtest://" + key, info, nullptr, 1))
+                return false;
+        }
+        for (auto & subdir: subdirs)
+            onSubdir("globtest://" + subdir, 1);
+        return true;
+    }
+};
+
+struct AtInit {
+    AtInit()
+    {
+        registerUrlFsHandler("globtest", new TestUrlFsHandler());
+    }
+} atInit;
+
+vector<string> expand(const string & pattern)
+{
+    vector<string> result;
+    auto onObject = [&] (const std::string & uri,
+                         const FsObjectInfo & info,
+                         const OpenUriObject & open,
+                         int depth)
+        {
+            result.push_back(uri);
+            return true;
+        };
+    forEachUriObjectMatching(pattern, onObject);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_glob_expansion )
+{
+    Call_Guard guard([&] () { clearUriListingCache(); });
+
+    keys = { "logs/2026/01/a.gz", "logs/2026/01/b.txt", "logs/2026/02/c.gz",
+             "logs/2026/02/sub/d.gz", "logs/2026/e.gz", "logs/2025/01/f.gz" };
+
+    auto found = expand("globtest://logs/2026/*/*.gz");
+    vector<string> expected = { "globtest://logs/2026/01/a.gz",
+                                "globtest://logs/2026/02/c.gz" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                  expected.begin(), expected.end());
+
+    found = expand("globtest://logs/202?/01/*");
+    expected = { "globtest://logs/2025/01/f.gz",
+                 "globtest://logs/2026/01/a.gz",
+                 "globtest://logs/2026/01/b.txt" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                  expected.begin(), expected.end());
+
+    // No wildcard: just the object
+    found = expand("globtest://logs/2026/e.gz");
+    BOOST_REQUIRE_EQUAL(found.size(), 1);
+    BOOST_CHECK_EQUAL(found[0], "globtest://logs/2026/e.gz");
+
+    BOOST_CHECK(expand("globtest://logs/2024/*/*.gz").empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_glob_listing_cache )
+{
+    Call_Guard guard([&] () { setUriListingCacheTtl(10); });
+
+    keys.clear();
+    for (int i = 0;  i < 20;  ++i)
+        keys.insert("data/part" + to_string(i) + "/x.csv");
+
+    clearUriListingCache();
+    numListings = 0;
+    BOOST_CHECK_EQUAL(expand("globtest://data/*/x.csv").size(), 20);
+    BOOST_CHECK_EQUAL(numListings, 21);
+
+    // The second expansion reuses the listings
+    BOOST_CHECK_EQUAL(expand("globtest://data/part1*/*").size(), 11);
+    BOOST_CHECK_EQUAL(numListings, 21);
+
+    // Not when the cache is disabled
+    setUriListingCacheTtl(0);
+    BOOST_CHECK_EQUAL(expand("globtest://data/*/x.csv").size(), 20);
+    BOOST_CHECK_EQUAL(numListings, 42);
+}
+
+BOOST_AUTO_TEST_CASE( test_glob_stop )
+{
+    Call_Guard guard([&] () { clearUriListingCache(); });
+
+    keys.clear();
+    for (int i = 0;  i < 100;  ++i)
+        keys.insert("stop/d" + to_string(i) + "/x");
+
+    std::atomic<int> numInCallback(0);
+    int numCalls = 0;
+    auto onObject = [&] (const std::string & uri,
+                         const FsObjectInfo & info,
+                         const OpenUriObject & open,
+                         int depth)
+        {
+            // Never called by two threads at once
+            BOOST_CHECK_EQUAL(++numInCallback, 1);
+            --numInCallback;
+            return ++numCalls < 10;
+        };
+
+    BOOST_CHECK(!forEachUriObjectMatching("globtest://stop/*/x", onObject));
+    BOOST_CHECK_EQUAL(numCalls, 10);
+}
+
+BOOST_AUTO_TEST_CASE( test_glob_local_files )
+{
+    string dir = "build/x86_64/tmp/uri_glob_test";
+    fs::remove_all(dir);
+    Call_Guard guard([&] () { clearUriListingCache(); fs::remove_all(dir); });
+
+    fs::create_directories(dir + "/a");
+    fs::create_directories(dir + "/b");
+    filter_ostream(dir + "/a/1.txt") << "1";
+    filter_ostream(dir + "/a/2.csv") << "2";
+    filter_ostream(dir + "/b/3.txt") << "3";
+
+    string base = "file://" + fs::absolute(dir).string();
+    auto found = expand(base + "/*/*.txt");
+    vector<string> expected = { base + "/a/1.txt", base + "/b/3.txt" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(found.begin(), found.end(),
+                                  expected.begin(), expected.end());
+}
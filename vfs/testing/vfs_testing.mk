@@ -3,3 +3,5 @@
 $(eval $(call test,filter_streams_test,vfs boost_filesystem boost_system,boost))
 
 $(TESTS)/filter_streams_test:	$(BIN)/lz4cli $(BIN)/zstd
+$(eval $(call test,uri_cache_test,vfs boost_filesystem boost_system,boost))
+$(eval $(call test,uri_glob_test,vfs boost_filesystem boost_system,boost))
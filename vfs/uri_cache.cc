@@ -0,0 +1,237 @@
+/** uri_cache.cc
+    Read-through local disk cache for remote objects.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "mldb/vfs/uri_cache.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/format.h"
+#include "mldb/ext/xxhash/xxhash.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const UriHandlerFactory &
+getUriHandler(const std::string & scheme);
+
+namespace {
+
+struct UriCacheConfig {
+    std::mutex mutex;
+    std::string directory;  ///< Empty when the cache is disabled
+    uint64_t maxBytes = 0;
+    std::set<std::string> schemes;
+};
+
+UriCacheConfig & getConfig()
+{
+    static UriCacheConfig config;
+    return config;
+}
+
+/// Used to make the names of partially downloaded files unique
+std::atomic<uint64_t> downloadNumber(0);
+
+const char * TMP_MARKER = ".tmp.";
+
+/** Name of the cache file for the given version of an object.  Any change
+    to the remote object changes at least one of its etag, modification
+    date or size, and so gives a new name.
+*/
+std::string getCacheFileName(const std::string & uri,
+                             const FsObjectInfo & info)
+{
+    std::string key = uri + '\n' + info.etag
+        + '\n' + info.lastModified.printIso8601()
+        + '\n' + std::to_string(info.size);
+    return MLDB::format("%016llx%016llx",
+                        (unsigned long long)XXH64(key.data(), key.size(), 0),
+                        (unsigned long long)XXH64(key.data(), key.size(), 1));
+}
+
+/** Remove the least recently used files of the cache until its total size
+    is no more than maxBytes.  The file named keep is never removed.
+    Access times are tracked with the modification time, which is updated
+    on each hit, as atime is often disabled.
+*/
+void evict(const std::string & directory, uint64_t maxBytes,
+           const std::string & keep)
+{
+    DIR * dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+
+    std::vector<std::tuple<double, uint64_t, std::string> > files;
+    uint64_t totalBytes = 0;
+
+    while (dirent * entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == ".." || name == keep
+            || name.find(TMP_MARKER) != string::npos)
+            continue;
+        struct stat st;
+        if (::stat((directory + "/" + name).c_str(), &st) == -1
+            || !S_ISREG(st.st_mode))
+            continue;
+        double mtime = st.st_mtim.tv_sec + 1e-9 * st.st_mtim.tv_nsec;
+        files.emplace_back(mtime, st.st_size, name);
+        totalBytes += st.st_size;
+    }
+    closedir(dir);
+
+    struct stat st;
+    if (::stat((directory + "/" + keep).c_str(), &st) != -1)
+        totalBytes += st.st_size;
+
+    std::sort(files.begin(), files.end());
+
+    for (auto & f: files) {
+        if (totalBytes <= maxBytes)
+            break;
+        if (::unlink((directory + "/" + std::get<2>(f)).c_str()) != -1)
+            totalBytes -= std::get<1>(f);
+    }
+}
+
+/** Download the object into the cache under the given path.  It's first
+    written into a temporary file that is renamed once complete, so that a
+    partial object is never visible in the cache.
+*/
+void download(const std::string & scheme,
+              const std::string & resource,
+              const std::map<std::string, std::string> & options,
+              const UriHandlerFactory & factory,
+              const OnUriHandlerException & onException,
+              const std::string & path)
+{
+    std::string tmpPath = path + TMP_MARKER + std::to_string(getpid())
+        + "." + std::to_string(downloadNumber++);
+
+    try {
+        UriHandler remote = factory(scheme, resource, ios::in, options,
+                                    onException);
+        std::ofstream out(tmpPath, ios::out | ios::binary | ios::trunc);
+        if (!out)
+            throw MLDB::Exception("couldn't create cache file %s: %s",
+                                  tmpPath.c_str(), strerror(errno));
+
+        char buffer[65536];
+        std::streamsize n;
+        while ((n = remote.buf->sgetn(buffer, sizeof(buffer))) > 0) {
+            out.write(buffer, n);
+        }
+        out.close();
+        if (!out)
+            throw MLDB::Exception("couldn't write cache file %s",
+                                  tmpPath.c_str());
+
+        if (::rename(tmpPath.c_str(), path.c_str()) == -1)
+            throw MLDB::Exception("couldn't rename cache file %s: %s",
+                                  tmpPath.c_str(), strerror(errno));
+    }
+    catch (...) {
+        ::unlink(tmpPath.c_str());
+        throw;
+    }
+}
+
+} // file scope
+
+std::set<std::string> getDefaultCachedUriSchemes()
+{
+    return { "http", "https", "s3", "azureblob", "sftp" };
+}
+
+void setUriCache(const std::string & directory,
+                 uint64_t maxBytes,
+                 const std::set<std::string> & schemes)
+{
+    if (directory.empty())
+        throw MLDB::Exception("setUriCache: empty cache directory");
+
+    boost::filesystem::create_directories(directory);
+
+    auto & config = getConfig();
+    std::unique_lock<std::mutex> guard(config.mutex);
+    config.directory = directory;
+    config.maxBytes = maxBytes;
+    config.schemes = schemes;
+}
+
+void disableUriCache()
+{
+    auto & config = getConfig();
+    std::unique_lock<std::mutex> guard(config.mutex);
+    config.directory.clear();
+}
+
+UriHandler
+openCachedUri(const std::string & scheme,
+              const std::string & resource,
+              const std::map<std::string, std::string> & options,
+              const UriHandlerFactory & factory,
+              const OnUriHandlerException & onException)
+{
+    std::string directory;
+    uint64_t maxBytes;
+    {
+        auto & config = getConfig();
+        std::unique_lock<std::mutex> guard(config.mutex);
+        if (config.directory.empty() || !config.schemes.count(scheme))
+            return UriHandler();
+        directory = config.directory;
+        maxBytes = config.maxBytes;
+    }
+
+    std::string uri = scheme + "://" + resource;
+    FsObjectInfo info = tryGetUriObjectInfo(uri);
+
+    // Without version information, we couldn't tell if the object changed
+    if (!info || (info.etag.empty() && info.lastModified == Date())
+        || info.size < 0 || (uint64_t)info.size > maxBytes)
+        return UriHandler();
+
+    std::string name = getCacheFileName(uri, info);
+    std::string path = directory + "/" + name;
+
+    if (::utimes(path.c_str(), nullptr) == -1) {
+        download(scheme, resource, options, factory, onException, path);
+
+        auto & config = getConfig();
+        std::unique_lock<std::mutex> guard(config.mutex);
+        evict(directory, maxBytes, name);
+    }
+
+    // Open the local copy with the file handler, so that options like
+    // "mapped" are supported, but keep the info of the remote object.
+    UriHandler local;
+    try {
+        local = getUriHandler("file")("file", path, ios::in, options,
+                                      onException);
+    } catch (const std::exception & exc) {
+        // Evicted by a concurrent open between the download and here
+        return UriHandler();
+    }
+
+    return UriHandler(local.buf, local.bufOwnership, info, local.options);
+}
+
+} // namespace MLDB
@@ -0,0 +1,56 @@
+/** uri_cache.h                                                    -*- C++ -*-
+    Read-through local disk cache for remote objects.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    When enabled, objects from remote schemes (s3, http, ...) opened for
+    reading are downloaded once into a local directory, keyed on their URI
+    and version (etag, modification date and size), and further opens are
+    served from the local copy.  The least recently used objects are evicted
+    once the cache grows above its maximum size.
+*/
+
+#pragma once
+
+#include "mldb/vfs/filter_streams_registry.h"
+#include <set>
+
+
+namespace MLDB {
+
+/** Schemes that are cached by default: http, https, s3, azureblob and
+    sftp.
+*/
+std::set<std::string> getDefaultCachedUriSchemes();
+
+/** Enable the read-through cache in the given local directory, which is
+    created if it doesn't exist.  maxBytes is the total size of the cached
+    objects above which the least recently used ones are evicted; objects
+    larger than that are never cached.
+*/
+void setUriCache(const std::string & directory,
+                 uint64_t maxBytes,
+                 const std::set<std::string> & schemes
+                     = getDefaultCachedUriSchemes());
+
+/** Disable the read-through cache.  The files already in the cache
+    directory are left in place.
+*/
+void disableUriCache();
+
+/** Open the given resource for reading through the cache.  If the cache
+    is disabled, the scheme isn't cached, or the object has no version
+    information that can be used to detect modifications, a handler with a
+    null buf is returned and the caller should open the object directly.
+    Otherwise, the object is downloaded with the given factory if it's not
+    already in the cache, and a handler reading the local copy is returned,
+    with the info of the remote object.
+*/
+UriHandler
+openCachedUri(const std::string & scheme,
+              const std::string & resource,
+              const std::map<std::string, std::string> & options,
+              const UriHandlerFactory & factory,
+              const OnUriHandlerException & onException);
+
+} // namespace MLDB
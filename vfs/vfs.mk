@@ -5,9 +5,14 @@ LIBVFS_SOURCES := \
         filter_streams.cc \
 	http_streambuf.cc \
 	compressor.cc \
-	zstandard.cc
+	zstandard.cc \
+	parallel_decompressor.cc \
+	gzip.cc \
+	bzip2.cc \
+	uri_cache.cc \
+	async_file.cc
 
-LIBVFS_LINK := arch boost_iostreams lzmapp types boost_filesystem http lz4 xxhash zstd
+LIBVFS_LINK := arch base boost_iostreams lzmapp types boost_filesystem http lz4 xxhash zstd z bz2
 
 $(eval $(call library,vfs,$(LIBVFS_SOURCES),$(LIBVFS_LINK)))
 
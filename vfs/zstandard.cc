@@ -4,18 +4,74 @@
    This file is part of MLDB. Copyright 2016 mldb.ai Inc. All rights reserved.
 
    Zstandard compressor and decompressors.
+
+   When compressing with more than one thread, the input is cut into blocks
+   which are compressed independently as separate zstd frames.  Each frame
+   is preceded by a skippable frame (which standard zstd decoders ignore)
+   giving its compressed and decompressed size, which allows the
+   decompressor to find the frame boundaries without decoding and so to
+   decompress the frames in parallel.
 */
 
+#define ZSTD_STATIC_LINKING_ONLY
+
 #include "compressor.h"
+#include "parallel_decompressor.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/ext/zstd/lib/zstd.h"
 #include <zlib.h>
 #include <iostream>
+#include <deque>
+#include <future>
+#include <thread>
+#include <cstring>
 
 using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/// Magic number of the skippable frames holding the block index
+constexpr uint32_t BLOCK_INDEX_MAGIC = 0x184D2A5E;
+
+/// Tag distinguishing our skippable frames from other ones
+const char BLOCK_INDEX_TAG[4] = { 'M', 'L', 'D', 'B' };
+
+/// Size of the payload of the index frame: tag, compressed, decompressed
+constexpr uint32_t BLOCK_INDEX_PAYLOAD = 4 + 8 + 8;
+
+/// Size of the whole index frame including its header
+constexpr size_t BLOCK_INDEX_SIZE = 4 + 4 + BLOCK_INDEX_PAYLOAD;
+
+void writeLE(char * p, uint64_t val, int nbytes)
+{
+    for (int i = 0;  i < nbytes;  ++i) {
+        p[i] = val & 0xff;
+        val >>= 8;
+    }
+}
+
+uint64_t readLE(const char * p, int nbytes)
+{
+    uint64_t result = 0;
+    for (int i = nbytes - 1;  i >= 0;  --i) {
+        result = (result << 8) | (unsigned char)p[i];
+    }
+    return result;
+}
+
+int getIntOption(const std::map<std::string, std::string> & options,
+                 const std::string & name, int def)
+{
+    auto it = options.find(name);
+    if (it == options.end())
+        return def;
+    return std::stoi(it->second);
+}
+
+} // file scope
+
 
 /*****************************************************************************/
 /* ZSTANDARD COMPRESSOR                                                      */
@@ -36,7 +92,7 @@ struct ZStandardCompressor: public Compressor {
     {
         open(level);
     }
-    
+
     ~ZStandardCompressor()
     {
         if (stream)
@@ -45,11 +101,63 @@ struct ZStandardCompressor: public Compressor {
 
     void open(int compressionLevel)
     {
+        this->compressionLevel = compressionLevel;
         ZSTD_initCStream(stream, compressionLevel);
     }
 
+    /** Options understood:
+        - compressionThreads: number of threads used to compress; 0 means
+          one per core.  With more than one, the output is made of
+          independent blocks which can be decompressed in parallel.
+        - compressionBlockSize: size of the input blocks in bytes when
+          compressing with more than one thread.
+        - compressionWindowLog: log2 of the window size, allowing matches
+          up to that distance.  Higher values improve compression of data
+          with long repeats, at a cost in memory.
+    */
+    virtual void setOptions(const std::map<std::string, std::string> & options)
+        override
+    {
+        numThreads = getIntOption(options, "compressionThreads", numThreads);
+        if (numThreads <= 0)
+            numThreads = std::max<int>(1, std::thread::hardware_concurrency());
+        blockSize = getIntOption(options, "compressionBlockSize", blockSize);
+        if (blockSize <= 0)
+            throw Exception("zstandard compressionBlockSize must be positive");
+        windowLog = getIntOption(options, "compressionWindowLog", windowLog);
+        if (windowLog != 0
+            && (windowLog < ZSTD_WINDOWLOG_MIN || windowLog > ZSTD_WINDOWLOG_MAX))
+            throw Exception("zstandard compressionWindowLog must be between "
+                            "%d and %d", ZSTD_WINDOWLOG_MIN, ZSTD_WINDOWLOG_MAX);
+
+        if (windowLog != 0 && numThreads == 1) {
+            // The size is unknown, which is signalled by a pledged size of
+            // zero without a content size in the frame header
+            ZSTD_parameters params = getParams(0);
+            params.fParams.contentSizeFlag = 0;
+            size_t res = ZSTD_initCStream_advanced(stream, nullptr, 0, params, 0);
+            if (ZSTD_isError(res)) {
+                throw Exception("Error initializing zstandard stream: %s",
+                                ZSTD_getErrorName(res));
+            }
+        }
+    }
+
     virtual size_t compress(const char * data, size_t len, const OnData & onData) override
     {
+        if (numThreads > 1) {
+            for (size_t done = 0;  done < len;) {
+                size_t toDo = std::min<size_t>(len - done,
+                                               blockSize - pending.size());
+                pending.append(data + done, toDo);
+                done += toDo;
+                if (pending.size() == blockSize)
+                    submitBlock(onData);
+            }
+            writeBlocks(onData, false /* waitForAll */);
+            return len;
+        }
+
         ZSTD_inBuffer inBuf{data, len, 0};
 
         while (inBuf.pos < inBuf.size) {
@@ -64,9 +172,17 @@ struct ZStandardCompressor: public Compressor {
 
         return len;
     }
-    
+
     virtual size_t flush(FlushLevel flushLevel, const OnData & onData) override
     {
+        if (numThreads > 1) {
+            if (flushLevel == FLUSH_NONE)
+                return 0;
+            if (!pending.empty())
+                submitBlock(onData);
+            return writeBlocks(onData, true /* waitForAll */);
+        }
+
         size_t result = 0;
         size_t bytesLeft = -1;
         while (bytesLeft != 0) {
@@ -79,6 +195,12 @@ struct ZStandardCompressor: public Compressor {
 
     virtual size_t finish(const OnData & onData) override
     {
+        if (numThreads > 1) {
+            if (!pending.empty() || numBlocks == 0)
+                submitBlock(onData);
+            return writeBlocks(onData, true /* waitForAll */);
+        }
+
         size_t result = 0;
         size_t bytesLeft = -1;
         while (bytesLeft != 0) {
@@ -98,11 +220,103 @@ struct ZStandardCompressor: public Compressor {
         }
         return written;
     }
-    
+
+    ZSTD_parameters getParams(size_t srcSize) const
+    {
+        ZSTD_parameters params = ZSTD_getParams(compressionLevel, srcSize, 0);
+        if (windowLog != 0)
+            params.cParams.windowLog = windowLog;
+        return params;
+    }
+
+    /** Compress one block into an index frame followed by a zstd frame. */
+    static std::string compressBlock(const std::string & block,
+                                     ZSTD_parameters params)
+    {
+        std::string result(BLOCK_INDEX_SIZE
+                           + ZSTD_compressBound(block.size()), '\0');
+
+        ZSTD_CCtx * context = ZSTD_createCCtx();
+        size_t res = ZSTD_compress_advanced(context,
+                                            &result[BLOCK_INDEX_SIZE],
+                                            result.size() - BLOCK_INDEX_SIZE,
+                                            block.data(), block.size(),
+                                            nullptr, 0, params);
+        ZSTD_freeCCtx(context);
+        if (ZSTD_isError(res)) {
+            throw Exception("Error compressing zstandard block: %s",
+                            ZSTD_getErrorName(res));
+        }
+
+        char * p = &result[0];
+        writeLE(p, BLOCK_INDEX_MAGIC, 4);
+        writeLE(p + 4, BLOCK_INDEX_PAYLOAD, 4);
+        std::memcpy(p + 8, BLOCK_INDEX_TAG, 4);
+        writeLE(p + 12, res, 8);
+        writeLE(p + 20, block.size(), 8);
+
+        result.resize(BLOCK_INDEX_SIZE + res);
+        return result;
+    }
+
+    /** Start compressing the pending data on another thread.  The number
+        of blocks in flight is limited to twice the number of threads, to
+        bound memory usage.
+    */
+    void submitBlock(const OnData & onData)
+    {
+        while (blocks.size() >= 2 * numThreads)
+            writeBlock(onData);
+
+        ZSTD_parameters params = getParams(pending.size());
+        blocks.emplace_back(std::async(std::launch::async,
+                                       compressBlock, std::move(pending),
+                                       params));
+        pending = std::string();
+        ++numBlocks;
+    }
+
+    /** Write out the oldest block, waiting for it to be compressed. */
+    size_t writeBlock(const OnData & onData)
+    {
+        std::string compressed = blocks.front().get();
+        blocks.pop_front();
+        size_t written = 0;
+        while (written < compressed.size()) {
+            written += onData(compressed.data() + written,
+                              compressed.size() - written);
+        }
+        return written;
+    }
+
+    /** Write out the blocks that are finished, in order.  If waitForAll is
+        true, wait for all of them.
+    */
+    size_t writeBlocks(const OnData & onData, bool waitForAll)
+    {
+        size_t result = 0;
+        while (!blocks.empty()
+               && (waitForAll
+                   || blocks.front().wait_for(std::chrono::seconds(0))
+                      == std::future_status::ready)) {
+            result += writeBlock(onData);
+        }
+        return result;
+    }
+
     ZSTD_CStream * stream = nullptr;
     size_t outDataSize = 0;
     std::unique_ptr<char[]> outData;
     ZSTD_outBuffer outBuf;
+
+    int compressionLevel = 0;
+    int numThreads = 1;
+    int blockSize = 4 * 1024 * 1024;
+    int windowLog = 0;  ///< 0 means choose from the compression level
+
+    std::string pending;  ///< Input waiting to make up a full block
+    std::deque<std::future<std::string> > blocks;  ///< Blocks in flight
+    size_t numBlocks = 0;  ///< Number of blocks submitted
 };
 
 static Compressor::Register<ZStandardCompressor>
@@ -113,7 +327,12 @@ registerZStandardCompressor("zstd", {"zst", "zstd"});
 /* ZSTANDARD DECOMPRESSOR                                                    */
 /*****************************************************************************/
 
-struct ZStandardDecompressor: public Decompressor {
+/** Decompresses both plain zstd streams, and the indexed blocks written by
+    the multi-threaded compressor, which are decompressed in parallel.
+    Plain streams may contain several concatenated frames.
+*/
+
+struct ZStandardDecompressor: public ParallelDecompressor {
 
     ZStandardDecompressor()
         : stream(ZSTD_createDStream()),
@@ -134,7 +353,44 @@ struct ZStandardDecompressor: public Decompressor {
     {
     }
 
-    virtual size_t decompress(const char * data, size_t len, const OnData & onData) override
+    virtual BlockStatus findBlock(const char * data, size_t len,
+                                  size_t & blockLength,
+                                  size_t & decompressedSize) override
+    {
+        if (len < 8)
+            return BLOCK_NEED_MORE;
+        if (readLE(data, 4) != BLOCK_INDEX_MAGIC
+            || readLE(data + 4, 4) != BLOCK_INDEX_PAYLOAD
+            || (len >= 12 && std::memcmp(data + 8, BLOCK_INDEX_TAG, 4) != 0))
+            return BLOCK_NONE;
+        if (len < BLOCK_INDEX_SIZE)
+            return BLOCK_NEED_MORE;
+
+        size_t compressedSize = readLE(data + 12, 8);
+        blockLength = BLOCK_INDEX_SIZE + compressedSize;
+        decompressedSize = readLE(data + 20, 8);
+        return len < blockLength ? BLOCK_NEED_MORE : BLOCK_FOUND;
+    }
+
+    virtual std::string decompressBlock(const std::string & block,
+                                        size_t decompressedSize) const override
+    {
+        std::string result(decompressedSize, '\0');
+        size_t res = ZSTD_decompress(&result[0], result.size(),
+                                     block.data() + BLOCK_INDEX_SIZE,
+                                     block.size() - BLOCK_INDEX_SIZE);
+        if (ZSTD_isError(res)) {
+            throw Exception("Error decompressing zstandard block: %s",
+                            ZSTD_getErrorName(res));
+        }
+        if (res != decompressedSize) {
+            throw Exception("Wrong size for decompressed zstandard block");
+        }
+        return result;
+    }
+
+    virtual size_t decompressStream(const char * data, size_t len,
+                                    const OnData & onData) override
     {
         ZSTD_inBuffer inBuf{data, len, 0};
 
@@ -146,16 +402,20 @@ struct ZStandardDecompressor: public Decompressor {
                                 ZSTD_getErrorName(res));
             }
             writeAll(onData);
+            frameInProgress = res != 0;
             if (res == 0 && inBuf.pos < inBuf.size) {
-                throw Exception("Extra bytes at end of decompressed zstandard stream");
+                // End of a frame; another one follows
+                ZSTD_initDStream(stream);
             }
         }
-        
+
         return len;
     }
-    
-    virtual size_t finish(const OnData & onData) override
+
+    virtual size_t finishStream(const OnData & onData) override
     {
+        if (frameInProgress)
+            throw Exception("Truncated zstandard stream");
         return 0;
     }
 
@@ -168,15 +428,15 @@ struct ZStandardDecompressor: public Decompressor {
         }
         return written;
     }
-    
+
     ZSTD_DStream * stream = nullptr;
     size_t outDataSize = 0;
     std::unique_ptr<char[]> outData;
     ZSTD_outBuffer outBuf;
+    bool frameInProgress = false;  ///< Part of a frame has been read
 };
 
 static Decompressor::Register<ZStandardDecompressor>
 registerZStandardDecompressor("zstd", {"zst", "zstd"});
 
 } // namespace MLDB
-
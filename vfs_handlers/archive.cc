@@ -13,6 +13,9 @@
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/arch/exception.h"
 #include <sstream>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
 
 // libarchive support
 #include <archive.h>
@@ -46,6 +49,29 @@ static ssize_t myread(struct archive *a, void *client_data, const void **buff)
     return data->stream.gcount();
 }
 
+/** Seek the stream, returning -1 instead of throwing if it can't, as is
+    the case for compressed streams. */
+static int64_t trySeek(std::streambuf * buf, int64_t offset,
+                       std::ios_base::seekdir dir)
+{
+    try {
+        return std::streamoff(buf->pubseekoff(offset, dir, ios::in));
+    } catch (...) {
+        return -1;
+    }
+}
+
+/** Skip over data that libarchive doesn't need, such as the contents of
+    members while listing, by seeking when the stream allows it. */
+static __LA_INT64_T myskip(struct archive *a, void *client_data,
+                           __LA_INT64_T request)
+{
+    ArchiveData * data = reinterpret_cast<ArchiveData *>(client_data);
+    if (!data->stream || trySeek(data->stream.rdbuf(), request, ios::cur) == -1)
+        return 0;  // libarchive will read through instead
+    return request;
+}
+
 static int myclose(struct archive *a, void *client_data)
 {
     ArchiveData * data = reinterpret_cast<ArchiveData *>(client_data);
@@ -64,7 +90,8 @@ static bool list_archive(std::streambuf * streambuf,
 
     archive_read_support_compression_all(a);
     archive_read_support_format_all(a);
-    archive_read_open(a, new ArchiveData(streambuf), NULL, myread, myclose);
+    archive_read_open2(a, new ArchiveData(streambuf), NULL, myread, myskip,
+                       myclose);
     while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
         string filename = archive_entry_pathname(entry);
 
@@ -76,6 +103,58 @@ static bool list_archive(std::streambuf * streambuf,
 }
 
 
+/** Return the info of the given regular file entry of an archive. */
+static std::shared_ptr<FsObjectInfo>
+getEntryInfo(struct archive_entry * entry)
+{
+    auto info = std::make_shared<FsObjectInfo>();
+    info->size
+        = archive_entry_size_is_set(entry) ?
+        archive_entry_size(entry) : -1;
+    info->exists = true;
+    if (archive_entry_mtime_is_set(entry)) {
+        info->lastModified = Date::fromSecondsSinceEpoch(archive_entry_mtime(entry) + 0.000000001 * archive_entry_mtime_nsec(entry));
+    }
+    else info->lastModified = Date::notADate();
+
+    info->ownerId = std::to_string(archive_entry_uid(entry));
+    const char * gname = archive_entry_gname(entry);
+    if (gname)
+        info->ownerName = gname;
+    //info.permissions = archive_entry_strmode(entry);
+    return info;
+}
+
+/** Extract the data of the entry that was just read from the archive. */
+static UriHandler
+extractEntry(struct archive * a, std::shared_ptr<FsObjectInfo> info)
+{
+    // For the moment, copy into a buffer and return
+    // a stringstream.  Streaming support later.
+                            
+    std::ostringstream stream;
+                            
+    size_t size = 0;
+    // This is a type exported by libarchive
+    __LA_INT64_T offset = 0;
+    const char * buff;
+    int r = archive_read_data_block(a, (const void **)&buff,
+                                    &size, &offset);
+          
+    while (r != ARCHIVE_EOF) {
+        if (r < ARCHIVE_OK)
+            throw MLDB::Exception("Error extracting file");
+        stream.write(buff, size);
+        r = archive_read_data_block
+            (a, (const void **)&buff,
+             &size, &offset);
+    }
+
+    std::shared_ptr<std::istream> result
+        (new std::istringstream(stream.str()));
+    return UriHandler(result->rdbuf(), result, info);
+}
+
 bool iterateArchive(std::streambuf * archive,
                     const OnUriObject & onObject)
 {
@@ -87,48 +166,11 @@ bool iterateArchive(std::streambuf * archive,
 
             switch (filetype) {
             case AE_IFREG: {
-                auto info = std::make_shared<FsObjectInfo>();
-                info->size
-                    = archive_entry_size_is_set(entry) ?
-                    archive_entry_size(entry) : -1;
-                info->exists = true;
-                if (archive_entry_mtime_is_set(entry)) {
-                    info->lastModified = Date::fromSecondsSinceEpoch(archive_entry_mtime(entry) + 0.000000001 * archive_entry_mtime_nsec(entry));
-                }
-                else info->lastModified = Date::notADate();
-
-                info->ownerId = std::to_string(archive_entry_uid(entry));
-                const char * gname = archive_entry_gname(entry);
-                if (gname)
-                    info->ownerName = gname;
-                //info.permissions = archive_entry_strmode(entry);
+                auto info = getEntryInfo(entry);
 
                 auto open = [=] (const std::map<std::string, std::string> & options)
                     {
-                        // For the moment, copy into a buffer and return
-                        // a stringstream.  Streaming support later.
-                            
-                        std::ostringstream stream;
-                            
-                        size_t size = 0;
-                        // This is a type exported by libarchive
-                        __LA_INT64_T offset = 0;
-                        const char * buff;
-                        int r = archive_read_data_block(a, (const void **)&buff,
-                                                        &size, &offset);
-          
-                        while (r != ARCHIVE_EOF) {
-                            if (r < ARCHIVE_OK)
-                                throw MLDB::Exception("Error extracting file");
-                            stream.write(buff, size);
-                            r = archive_read_data_block
-                                (a, (const void **)&buff,
-                                 &size, &offset);
-                        }
-
-                        std::shared_ptr<std::istream> result
-                        (new std::istringstream(stream.str()));
-                        return UriHandler(result->rdbuf(), result, info);
+                        return extractEntry(a, info);
                     };
 
                 return onObject(filename, *info, open, 1 /* depth */);
@@ -146,6 +188,213 @@ bool iterateArchive(std::streambuf * archive,
 }
 
 
+/*****************************************************************************/
+/* ARCHIVE INDEX                                                             */
+/*****************************************************************************/
+
+/** The regular files in an archive, with the offset of their header.
+    When libarchive reads the archive stream without decompressing it (tar,
+    zip, ...) and the stream can seek (local files, including the copies in
+    the URI cache), a member is read by seeking straight to its header
+    instead of reading the archive up to it.  Otherwise, the index only
+    saves listing the archive to find a member's info.
+*/
+struct ArchiveIndex {
+    struct Member {
+        std::string filename;
+        FsObjectInfo info;
+        int64_t headerOffset;
+    };
+
+    std::vector<Member> members;
+    std::unordered_map<std::string, size_t> byName;  ///< First of each name
+    bool seekable = true;
+
+    const Member * find(const std::string & filename) const
+    {
+        auto it = byName.find(filename);
+        if (it == byName.end())
+            return nullptr;
+        return &members[it->second];
+    }
+};
+
+static std::shared_ptr<const ArchiveIndex>
+buildArchiveIndex(const std::string & archiveUri)
+{
+    auto result = std::make_shared<ArchiveIndex>();
+
+    filter_istream stream(archiveUri);
+    result->seekable = trySeek(stream.rdbuf(), 0, ios::cur) != -1;
+
+    auto onEntry = [&] (const std::string & filename,
+                        struct archive * a,
+                        struct archive_entry * entry)
+        {
+            // Header offsets are in the decompressed data when libarchive
+            // had to add a decompression filter
+            if (archive_filter_count(a) > 1)
+                result->seekable = false;
+
+            if (archive_entry_filetype(entry) != AE_IFREG)
+                return true;
+
+            result->byName.emplace(filename, result->members.size());
+            result->members.push_back({ filename, *getEntryInfo(entry),
+                                        archive_read_header_position(a) });
+            return true;
+        };
+
+    list_archive(stream.rdbuf(), onEntry);
+
+    return result;
+}
+
+namespace {
+
+/// Number of archive indexes kept in memory
+constexpr size_t MAX_CACHED_INDEXES = 64;
+
+struct ArchiveIndexCache {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const ArchiveIndex> > indexes;
+    std::deque<std::string> order;  ///< Keys, oldest first
+};
+
+ArchiveIndexCache & getArchiveIndexCache()
+{
+    static ArchiveIndexCache cache;
+    return cache;
+}
+
+} // file scope
+
+/** Return the index of the given archive, which is built on first use
+    and kept for as long as the archive has the same version.
+*/
+static std::shared_ptr<const ArchiveIndex>
+getArchiveIndex(const std::string & archiveUri)
+{
+    FsObjectInfo info = tryGetUriObjectInfo(archiveUri);
+
+    // Without version information, we couldn't tell if the archive changed
+    if (!info || (info.etag.empty() && info.lastModified == Date()))
+        return buildArchiveIndex(archiveUri);
+
+    std::string key = archiveUri + '\n' + info.etag
+        + '\n' + info.lastModified.printIso8601()
+        + '\n' + std::to_string(info.size);
+
+    auto & cache = getArchiveIndexCache();
+    {
+        std::unique_lock<std::mutex> guard(cache.mutex);
+        auto it = cache.indexes.find(key);
+        if (it != cache.indexes.end())
+            return it->second;
+    }
+
+    // Built outside of the lock, so that archives are indexed in parallel
+    auto result = buildArchiveIndex(archiveUri);
+
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    if (cache.indexes.emplace(key, result).second) {
+        cache.order.push_back(key);
+        if (cache.order.size() > MAX_CACHED_INDEXES) {
+            cache.indexes.erase(cache.order.front());
+            cache.order.pop_front();
+        }
+    }
+    return result;
+}
+
+/** Extract the given member by reading the archive from the start.  This
+    returns a null handler if it isn't found.
+*/
+static UriHandler
+extractByListing(const std::string & archiveUri,
+                 const std::string & filename)
+{
+    filter_istream stream(archiveUri);
+
+    UriHandler result;
+    auto onEntry = [&] (const std::string & entryName,
+                        struct archive * a,
+                        struct archive_entry * entry)
+        {
+            if (entryName != filename
+                || archive_entry_filetype(entry) != AE_IFREG)
+                return true;
+            result = extractEntry(a, getEntryInfo(entry));
+            return false;
+        };
+
+    list_archive(stream.rdbuf(), onEntry);
+    return result;
+}
+
+/** Open the given member of an archive.  Each call opens the archive on
+    its own, so that members may be read from many threads at once.
+*/
+static UriHandler
+openArchiveMember(const std::string & archiveUri,
+                  const ArchiveIndex & index,
+                  const ArchiveIndex::Member & member)
+{
+    if (!index.seekable)
+        return extractByListing(archiveUri, member.filename);
+
+    filter_istream stream(archiveUri);
+    if (trySeek(stream.rdbuf(), member.headerOffset, ios::beg)
+        != member.headerOffset)
+        return extractByListing(archiveUri, member.filename);
+
+    UriHandler result;
+    auto info = std::make_shared<FsObjectInfo>(member.info);
+    auto onEntry = [&] (const std::string & filename,
+                        struct archive * a,
+                        struct archive_entry * entry)
+        {
+            if (filename == member.filename)
+                result = extractEntry(a, info);
+            return false;  // only the member's header is read
+        };
+
+    list_archive(stream.rdbuf(), onEntry);
+
+    // The archive changed under us without changing its version
+    if (!result.buf)
+        return extractByListing(archiveUri, member.filename);
+
+    return result;
+}
+
+/** Split an archive member URI ("archive+<archive uri>#<path>") into the
+    archive URI and the path of the member.
+*/
+static std::pair<std::string, std::string>
+splitArchiveMemberUri(Utf8String archiveSource, const char * action)
+{
+    if (!archiveSource.removePrefix("archive+"))
+        throw MLDB::Exception("archive URI '" + archiveSource.rawString()
+                              + "' doesn't start with 'archive+' when "
+                              + action);
+
+    // Look for the last # to get the filename
+    auto foundIt = archiveSource.end();
+    for (auto it = archiveSource.begin(), end = archiveSource.end();
+         it != end;  ++it)
+        if (*it == '#')
+            foundIt = it;
+        
+    if (foundIt == archiveSource.end())
+        throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
+
+    Utf8String archiveUri(archiveSource.begin(), foundIt);
+    Utf8String toExtractPath(std::next(foundIt), archiveSource.end());
+    return { archiveUri.rawString(), toExtractPath.rawString() };
+}
+
+
 struct ArchiveUrlFsHandler: UrlFsHandler {
 
     ArchiveUrlFsHandler()
@@ -162,38 +411,14 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
 
     virtual FsObjectInfo tryGetInfo(const Url & url) const
     {
-        Utf8String archiveSource(url.toDecodedString());
-        if (!archiveSource.removePrefix("archive+"))
-            throw MLDB::Exception("archive URI '" + url.toString() + "' doesn't start with 'archive+' when getting object info");
-
-        // Look for a # to get the filename
-        auto it = archiveSource.rfind('#');
-        if (it == archiveSource.end())
-            throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
-
-        Utf8String archiveUri(archiveSource.begin(), it);
-
-        // unused...
-        Utf8String toExtractPath(std::next(it), archiveSource.end());
-
-        FsObjectInfo result;
-
-        OnUriObject onObject = [&] (const std::string & archiveMemberUri,
-                                    const FsObjectInfo & info,
-                                    const OpenUriObject & open,
-                                    int depth)
-            {
-                if (url.toString() == archiveMemberUri) {
-                    result = info;
-                    return false;
-                }
-                return true;
-            };
-
-        this->forEach(Url("archive+" + archiveUri), onObject, {},
-                      "/" /* delimiter */, "" /* startAt */);
-        
-        return result;
+        auto split = splitArchiveMemberUri(url.toDecodedString(),
+                                           "getting object info");
+
+        auto index = getArchiveIndex(split.first);
+        auto member = index->find(split.second);
+        if (!member)
+            return FsObjectInfo();
+        return member->info;
     }
 
     virtual size_t getSize(const Url & url) const
@@ -229,18 +454,39 @@ struct ArchiveUrlFsHandler: UrlFsHandler {
         if (!archiveSource.removePrefix("archive+"))
             throw MLDB::Exception("archive URI '" + archiveSource.rawString() + "' doesn't start with 'archive+' when listing archive contents");
 
-        filter_istream archiveStream(archiveSource.rawString());
-
-        auto onObject2 = [&] (const std::string & object,
-                              const FsObjectInfo & info,
-                              const OpenUriObject & open,
-                              int depth)
-            {
-                return onObject(prefix.toString() + "#" + object, info, open, depth);
-            };
+        std::string archiveUri = archiveSource.rawString();
+        filter_istream archiveStream(archiveUri);
+
+        std::shared_ptr<const ArchiveIndex> index;
+        if (trySeek(archiveStream.rdbuf(), 0, ios::cur) != -1)
+            index = getArchiveIndex(archiveUri);
+
+        // Members that can't be read directly are given to the callback as
+        // the archive is read, so that it's only read once.
+        if (!index || !index->seekable) {
+            auto onObject2 = [&] (const std::string & object,
+                                  const FsObjectInfo & info,
+                                  const OpenUriObject & open,
+                                  int depth)
+                {
+                    return onObject(prefix.toString() + "#" + object, info, open, depth);
+                };
+
+            return iterateArchive(archiveStream.rdbuf(), onObject2);
+        }
 
+        // Otherwise, each can be opened on its own at any time
+        for (auto & member: index->members) {
+            auto open = [=] (const std::map<std::string, std::string> & options)
+                {
+                    return openArchiveMember(archiveUri, *index, member);
+                };
+            if (!onObject(prefix.toString() + "#" + member.filename,
+                          member.info, open, 1 /* depth */))
+                return false;
+        }
 
-        return iterateArchive(archiveStream.rdbuf(), onObject2);
+        return true;
     }
 };
 
@@ -260,60 +506,18 @@ struct RegisterArchiveHandler {
             throw MLDB::Exception("Only input is accepted for archives");
         }
 
-        Utf8String uri = scheme + "://" + resource;
-
-        cerr << "uri = " << uri << endl;
-
-        Utf8String archiveSource = uri;
-        if (!archiveSource.removePrefix("archive+"))
-            throw MLDB::Exception("archive URI '" + uri.rawString() + "' doesn't start with 'archive+' when opening archive member");
-
-        //cerr << "archiveSource = " << archiveSource << endl;
-
-        // Look for a # to get the filename
-        auto foundIt = archiveSource.end();
-        for (auto it = archiveSource.begin(), end = archiveSource.end();
-             it != end;  ++it)
-            if (*it == '#')
-                foundIt = it;
-        
-        if (foundIt == archiveSource.end())
-            throw MLDB::Exception("Extracting a file from an archive requires a # between archive URI and path within archive");
-
-        Utf8String archiveUri(archiveSource.begin(), foundIt);
-
-        //cerr << "archiveUri = " << archiveUri << endl;
-
-        // unused...
-        Utf8String toExtractPath(std::next(foundIt), archiveSource.end());
-
-        //cerr << "uri = " << uri << " archiveSource = " << archiveSource
-        //     << " archiveUri = " << archiveUri << " toExtractPath = "
-        //     << toExtractPath << endl;
-
-        UriHandler result;
-
-        OnUriObject onObject = [&] (const std::string & archiveMemberUri,
-                                    const FsObjectInfo & info,
-                                    const OpenUriObject & open,
-                                    int depth)
-            {
-                //cerr << "matching " << archiveMemberUri
-                //<< " against " << uri << endl;
-                if (uri.rawString() == archiveMemberUri) {
-                    result = open(options);
-                    return false;
-                }
-                return true;
-            };
+        auto split = splitArchiveMemberUri(scheme + "://" + resource,
+                                           "opening archive member");
+        const std::string & archiveUri = split.first;
+        const std::string & toExtractPath = split.second;
 
-        forEachUriObject("archive+" + archiveUri.rawString(), onObject, {},
-                         "/" /* delimiter */, "" /* startAt */);
-        if (!result.buf)
-            throw MLDB::Exception("Couldn't find resource " + toExtractPath.rawString()
-                                + " in archive " + archiveUri.rawString());
+        auto index = getArchiveIndex(archiveUri);
+        auto member = index->find(toExtractPath);
+        if (!member)
+            throw MLDB::Exception("Couldn't find resource " + toExtractPath
+                                + " in archive " + archiveUri);
         
-        return result;
+        return openArchiveMember(archiveUri, *index, *member);
     }
 
     RegisterArchiveHandler()
@@ -6,7 +6,9 @@
 
 #include <mutex>
 #include <boost/iostreams/stream_buffer.hpp>
+#include <deque>
 #include <fstream>
+#include <future>
 #include <thread>
 #include <unordered_map>
 
@@ -145,9 +147,46 @@ getObjectInfoFromCloudBlobProperties(const cloud_blob_properties & p)
 
 namespace MLDB {
 
+/* Parameters of the parallel transfers of a blob, which can be set with
+   the "num-requests" and "part-size" options. */
+struct AzureTransferParams {
+    AzureTransferParams()
+        : numRequests(8), partSize(4 * 1024 * 1024)
+    {
+    }
+
+    unsigned int numRequests; /* maximum number of concurrent ranged GETs
+                               * or Put Block requests */
+    size_t partSize; /* size of each ranged GET or uploaded block */
+
+    static AzureTransferParams
+    fromOptions(const std::map<std::string, std::string> & options)
+    {
+        AzureTransferParams result;
+        for (auto & opt: options) {
+            const string & name = opt.first;
+            const string & value = opt.second;
+            if (name == "num-requests") {
+                result.numRequests = std::stoi(value);
+            }
+            else if (name == "part-size") {
+                result.partSize = std::stoull(value);
+            }
+        }
+        if (result.numRequests == 0 || result.partSize == 0) {
+            throw MLDB::Exception("azureblob num-requests and part-size "
+                                  "must be positive");
+        }
+        return result;
+    }
+};
+
+/* Blobs are read with a window of ranged GETs running at the same time,
+   whose parts are returned in order. */
 struct AzureBlobStorageDownloadSource {
 
     AzureBlobStorageDownloadSource(cloud_blob & blob, FsObjectInfo info,
+                                   const AzureTransferParams & params,
                                    const OnUriHandlerException & onException)
     {
         impl.reset(new Impl());
@@ -155,6 +194,7 @@ struct AzureBlobStorageDownloadSource {
         impl->start();
         impl->onException = onException;
         impl->info = info;
+        impl->params = params;
     }
 
     typedef char char_type;
@@ -165,7 +205,7 @@ struct AzureBlobStorageDownloadSource {
     { };
     
     struct Impl {
-        Impl() : offset(0)
+        Impl() : requestedOffset(0), currentPartOffset(0)
         {
         }
 
@@ -177,11 +217,15 @@ struct AzureBlobStorageDownloadSource {
         cloud_blob blob;
 
         Date startDate;
-        string data;
-        uint64_t offset;
         FsObjectInfo info;
+        AzureTransferParams params;
         OnUriHandlerException onException;
 
+        uint64_t requestedOffset;        ///< End of the last part requested
+        std::deque<std::future<string> > parts;  ///< Parts in flight
+        string currentPart;              ///< Part being returned by read()
+        size_t currentPartOffset;        ///< Position in currentPart
+
         void start()
         {
             startDate = Date::now();
@@ -189,29 +233,73 @@ struct AzureBlobStorageDownloadSource {
 
         void stop()
         {
+            // The requests in flight use the blob; their errors no longer
+            // matter
+            for (auto & part: parts) {
+                part.wait();
+            }
+            parts.clear();
+        }
+
+        static string downloadRange(cloud_blob blob,
+                                    uint64_t offset, uint64_t length)
+        {
+            concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+            concurrency::streams::ostream outputStream(buffer);
+            blob.download_range_to_stream(outputStream, offset, length);
+            const auto & rawData = buffer.collection();
+            if (rawData.size() != length) {
+                throw MLDB::Exception("azureblob: got %zu bytes instead of "
+                                      "%zu at offset %zu",
+                                      (size_t)rawData.size(), (size_t)length,
+                                      (size_t)offset);
+            }
+            return string(rawData.cbegin(), rawData.cend());
+        }
+
+        /* Start ranged GETs until the read-ahead window is full.  Nothing
+           is requested until the first read, so that opening a blob only
+           to get its info costs no download. */
+        void ensureRequests()
+        {
+            while (parts.size() < params.numRequests
+                   && requestedOffset < info.size) {
+                uint64_t length = std::min<uint64_t>(params.partSize,
+                                                     info.size - requestedOffset);
+                parts.emplace_back(std::async(std::launch::async,
+                                              &Impl::downloadRange, blob,
+                                              requestedOffset, length));
+                requestedOffset += length;
+            }
         }
 
         std::streamsize read(char_type* s, std::streamsize n)
         {
-            uint64_t toRead = 0;
+            BOOST_STATIC_ASSERT(sizeof(char_type) == 1);
             try {
-                BOOST_STATIC_ASSERT(sizeof(char_type) == 1);
-                concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
-                concurrency::streams::ostream outputStream(buffer);
-                toRead = offset + n <= info.size ? n : info.size - offset;
-                if (toRead == 0) {
-                    return 0;
+                ensureRequests();
+                while (currentPartOffset == currentPart.size()) {
+                    if (parts.empty()) {
+                        return -1;
+                    }
+                    currentPart = parts.front().get();
+                    parts.pop_front();
+                    currentPartOffset = 0;
+                    ensureRequests();
                 }
-                blob.download_range_to_stream(outputStream, offset, toRead);
-                auto rawData = buffer.collection();
-                string data = string(rawData.cbegin(), rawData.cend());
-                offset += data.size();
-                strncpy(s, data.c_str(), toRead);
             }
             catch (...) {
-                onException(current_exception());
+                if (onException) {
+                    onException(current_exception());
+                }
+                throw;
             }
-            return toRead;
+
+            size_t toDo = std::min<size_t>(currentPart.size() - currentPartOffset, n);
+            const char * start = currentPart.data() + currentPartOffset;
+            std::copy(start, start + toDo, s);
+            currentPartOffset += toDo;
+            return toDo;
         }
     };
 
@@ -233,13 +321,21 @@ struct AzureBlobStorageDownloadSource {
     }
 };
 
+/* Blobs are written as block blobs: the data is cut into blocks that are
+   uploaded with several Put Block requests at the same time, and put
+   together in order with a Put Block List once the stream is closed. */
 struct AzureBlobStorageUploadSource {
-    AzureBlobStorageUploadSource(cloud_append_blob & blob,
+    AzureBlobStorageUploadSource(cloud_block_blob & blob,
+                                 const AzureTransferParams & params,
                                  OnUriHandlerException onException)
     {
         impl.reset(new Impl());
         impl->blob = blob;
-        impl->blob.create_or_replace();
+        // Like opening a file for writing, this truncates any existing
+        // blob, which may also be of another type that blocks can't be
+        // written to
+        impl->blob.delete_blob_if_exists();
+        impl->params = params;
         impl->onException = onException;
         impl->start();
     }
@@ -254,6 +350,7 @@ struct AzureBlobStorageUploadSource {
 
     struct Impl {
         Impl()
+            : offset(0)
         {
         }
 
@@ -267,26 +364,69 @@ struct AzureBlobStorageUploadSource {
         size_t offset;
 
         Date startDate;
-        cloud_append_blob blob;
+        cloud_block_blob blob;
+        AzureTransferParams params;
+
+        string current;                          ///< Block being filled
+        std::vector<block_list_item> blocks;     ///< Blocks, in order
+        std::deque<std::future<void> > uploads;  ///< Blocks in flight
 
         void start()
         {
             startDate = Date::now();
+            current.reserve(params.partSize);
         }
         
         void stop()
         {
+            for (auto & upload: uploads) {
+                upload.wait();
+            }
+            uploads.clear();
+        }
+
+        static void uploadBlock(cloud_block_blob blob,
+                                utility::string_t blockId,
+                                string data)
+        {
+            concurrency::streams::istream input =
+                concurrency::streams::bytestream::open_istream(std::move(data));
+            blob.upload_block(blockId, input, utility::string_t());
+            input.close().wait();
+        }
+
+        /* Upload the block being filled, once there is room for it in the
+           window of uploads. */
+        void uploadCurrent()
+        {
+            while (uploads.size() >= params.numRequests) {
+                uploads.front().get();
+                uploads.pop_front();
+            }
+
+            // Block ids must all be the same length
+            auto blockId = utility::conversions::to_base64(uint64_t(blocks.size()));
+            blocks.emplace_back(blockId);
+            uploads.emplace_back(std::async(std::launch::async,
+                                            &Impl::uploadBlock, blob,
+                                            blockId, std::move(current)));
+            current = string();
+            current.reserve(params.partSize);
         }
 
         std::streamsize write(const char_type* s, std::streamsize n)
         {
             try {
-                string str(s, n);
-                concurrency::streams::istream append_input_stream =
-                    concurrency::streams::bytestream::open_istream(
-                            utility::conversions::to_utf8string(_XPLATSTR(str)));
-                blob.append_block(append_input_stream, utility::string_t());
-                append_input_stream.close().wait();
+                std::streamsize done = 0;
+                while (done < n) {
+                    size_t toCopy = std::min<size_t>(n - done,
+                                                     params.partSize - current.size());
+                    current.append(s + done, toCopy);
+                    done += toCopy;
+                    if (current.size() == params.partSize) {
+                        uploadCurrent();
+                    }
+                }
 
                 offset += n;
             }
@@ -303,6 +443,20 @@ struct AzureBlobStorageUploadSource {
 
         void finish()
         {
+            try {
+                if (!current.empty()) {
+                    uploadCurrent();
+                }
+                while (!uploads.empty()) {
+                    uploads.front().get();
+                    uploads.pop_front();
+                }
+                blob.upload_block_list(blocks);
+            }
+            catch (...) {
+                onException(current_exception());
+            }
+
             stop();
 
             double elapsed = Date::now().secondsSince(startDate);
@@ -468,27 +622,29 @@ struct RegisterAzbsHandler {
     {
         auto blobInfo = AzureBlobInfo::fromPath(resource);
 
+        auto params = AzureTransferParams::fromOptions(options);
+
         if (mode == ios::in) {
             auto blob = getAzureBlobReference(blobInfo);
-            concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
-            concurrency::streams::ostream outputStream(buffer);
-            blob.download_to_stream(outputStream);
+            blob.download_attributes();
 
             auto info = make_shared<FsObjectInfo>(
                     getObjectInfoFromCloudBlobProperties(blob.properties()));
 
             std::unique_ptr<std::streambuf> result;
             result.reset(new boost::iostreams::stream_buffer<AzureBlobStorageDownloadSource>
-                         (AzureBlobStorageDownloadSource(blob, *info.get(), onException), 131072));
+                         (AzureBlobStorageDownloadSource(blob, *info.get(), params,
+                                                         onException), 131072));
             std::shared_ptr<std::streambuf> buf(result.release());
 
             return UriHandler(buf.get(), buf, info);
         }
         if (mode == ios::out) {
-            cloud_append_blob blob(getAzureBlobReference(blobInfo));
+            cloud_block_blob blob(getAzureBlobReference(blobInfo));
             std::unique_ptr<std::streambuf> result;
             result.reset(new boost::iostreams::stream_buffer<AzureBlobStorageUploadSource>
-                         (AzureBlobStorageUploadSource(blob, onException), 131072));
+                         (AzureBlobStorageUploadSource(blob, params, onException),
+                          131072));
             std::shared_ptr<std::streambuf> buf(result.release());
             return UriHandler(buf.get(), buf);
         }
@@ -572,12 +728,8 @@ struct AzbsUrlFsHandler : public UrlFsHandler {
                 OpenUriObject open = [=] (
                     const map<string, string> & options) -> UriHandler
                 {
-                    if (!options.empty()) {
-                        throw MLDB::Exception(
-                            "Options not accepted by azureblob");
-                    }
                     shared_ptr<std::istream> result(
-                        new filter_istream(uri));
+                        new filter_istream(uri, options));
                     auto info = getInfo(Url(uri));
                     return UriHandler(result->rdbuf(), result, info);
                 };
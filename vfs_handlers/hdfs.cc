@@ -5,6 +5,9 @@
    Copyright (c) 2015 mldb.ai inc.  All rights reserved.
 */
 
+#include <deque>
+#include <future>
+#include <limits>
 #include <memory>
 #include <string>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -23,14 +26,40 @@ using namespace MLDB;
 
 constexpr int DEFAULT_PORT(50070);
 
+/* Defaults for the read-ahead of downloads; both can be overridden with
+   the "num-requests" and "part-size" options. */
+constexpr unsigned DEFAULT_NUM_REQUESTS(16);
+constexpr size_t DEFAULT_PART_SIZE(16 * 1024 * 1024);
+
 namespace {
 
+/* Parameters controlling the read-ahead of a download. A value of 0 means
+   that the default is used. */
+struct HDFSDownloadParams {
+    HDFSDownloadParams()
+        : numRequests(0), partSize(0)
+    {
+    }
+
+    unsigned int numRequests; /* maximum number of concurrent positional
+                               * reads, ie the size of the read-ahead
+                               * window */
+    size_t partSize; /* size of each read; a part never straddles an HDFS
+                      * block boundary */
+};
+
 /****************************************************************************/
 /* HDFS SOURCE IMPL                                                         */
 /****************************************************************************/
 
+/* Files are read ahead with several positional reads running at the same
+   time, each of them within a single HDFS block, so that the blocks are
+   streamed from as many datanodes at once.  libhdfs already picks the
+   closest replica of each block. */
+
 struct HDFSSourceImpl {
-    HDFSSourceImpl(const string & urlStr, int mode);
+    HDFSSourceImpl(const string & urlStr, int mode,
+                   const HDFSDownloadParams & params = HDFSDownloadParams());
     ~HDFSSourceImpl();
 
     streamsize read(char * s, streamsize n);
@@ -39,14 +68,36 @@ struct HDFSSourceImpl {
 private:
     void cleanup() noexcept;
 
+    /* Start reading parts until the read-ahead window is full */
+    void ensureRequests();
+
+    /* Read the given range of the file, which may be called from any
+       thread */
+    string readRange(tOffset offset, size_t length) const;
+
     int mode_;
     hdfsFS fsHandle_;
     hdfsFile fileHandle_;
+
+    tOffset fileSize_;
+    tOffset blockSize_;
+    size_t partSize_;
+    unsigned numRequests_;
+    tOffset requestedOffset_;          ///< End of the last part requested
+    deque<future<string> > parts_;     ///< Parts in flight, in order
+    string currentPart_;               ///< Part being returned by read()
+    size_t currentPartOffset_;         ///< Position in currentPart_
 };
 
 HDFSSourceImpl::
-HDFSSourceImpl(const string & urlStr, int mode)
-    : mode_(mode)
+HDFSSourceImpl(const string & urlStr, int mode,
+               const HDFSDownloadParams & params)
+    : mode_(mode), fsHandle_(nullptr), fileHandle_(nullptr),
+      fileSize_(0), blockSize_(0),
+      partSize_(params.partSize > 0 ? params.partSize : DEFAULT_PART_SIZE),
+      numRequests_(params.numRequests > 0
+                   ? params.numRequests : DEFAULT_NUM_REQUESTS),
+      requestedOffset_(0), currentPartOffset_(0)
 {
     Url url(urlStr);
 
@@ -80,10 +131,24 @@ HDFSSourceImpl(const string & urlStr, int mode)
         throw MLDB::Exception("file does not exist");
     }
 
+    if ((mode & O_WRONLY) == 0) {
+        hdfsFileInfo * info = hdfsGetPathInfo(fsHandle_, filename.c_str());
+        if (!info) {
+            throw MLDB::Exception(errno, "hdfsGetPathInfo");
+        }
+        fileSize_ = info->mSize;
+        blockSize_ = info->mBlockSize;
+        hdfsFreeFileInfo(info, 1);
+    }
+
     fileHandle_ = hdfsOpenFile(fsHandle_, filename.c_str(), mode, 0,
                                0, 0);
     ExcAssert(fileHandle_ != nullptr);
 
+    if ((mode & O_WRONLY) == 0) {
+        ensureRequests();
+    }
+
     ok = true;
 }
 
@@ -99,16 +164,72 @@ read(char * s, streamsize n)
 {
     ExcAssert((mode_ & O_RDONLY) == O_RDONLY);
 
-    tSize readRes;
-    {
-        MLDB_TRACE_EXCEPTIONS(false);
-        readRes = hdfsRead(fsHandle_, fileHandle_, s, n);
+    while (currentPartOffset_ == currentPart_.size()) {
+        if (parts_.empty()) {
+            return -1;
+        }
+        currentPart_ = parts_.front().get();
+        parts_.pop_front();
+        currentPartOffset_ = 0;
+        ensureRequests();
     }
-    if (readRes == -1) {
-        throw MLDB::Exception(errno, "hdfsRead");
+
+    size_t toDo = min<size_t>(currentPart_.size() - currentPartOffset_, n);
+    const char * start = currentPart_.data() + currentPartOffset_;
+    std::copy(start, start + toDo, s);
+    currentPartOffset_ += toDo;
+
+    return toDo;
+}
+
+void
+HDFSSourceImpl::
+ensureRequests()
+{
+    while (parts_.size() < numRequests_ && requestedOffset_ < fileSize_) {
+        tOffset end = requestedOffset_ + partSize_;
+        if (blockSize_ > 0) {
+            tOffset blockEnd
+                = (requestedOffset_ / blockSize_ + 1) * blockSize_;
+            end = min(end, blockEnd);
+        }
+        end = min(end, fileSize_);
+
+        parts_.emplace_back(std::async(std::launch::async,
+                                       &HDFSSourceImpl::readRange, this,
+                                       requestedOffset_,
+                                       size_t(end - requestedOffset_)));
+        requestedOffset_ = end;
+    }
+}
+
+string
+HDFSSourceImpl::
+readRange(tOffset offset, size_t length)
+    const
+{
+    string result(length, '\0');
+    size_t done = 0;
+    while (done < length) {
+        size_t toRead = min<size_t>(length - done,
+                                    std::numeric_limits<tSize>::max());
+        tSize readRes;
+        {
+            MLDB_TRACE_EXCEPTIONS(false);
+            readRes = hdfsPread(fsHandle_, fileHandle_, offset + done,
+                                &result[done], toRead);
+        }
+        if (readRes == -1) {
+            throw MLDB::Exception(errno, "hdfsPread");
+        }
+        if (readRes == 0) {
+            throw MLDB::Exception("unexpected end of file reading hdfs file at "
+                                  "offset " + to_string(offset + done));
+        }
+        done += readRes;
     }
 
-    return readRes > 0 ? readRes : -1;
+    return result;
 }
 
 streamsize
@@ -130,6 +251,13 @@ HDFSSourceImpl::
 cleanup()
     noexcept
 {
+    /* The reads in flight need the handles, so they are waited for first;
+       their errors no longer matter. */
+    for (auto & part: parts_) {
+        part.wait();
+    }
+    parts_.clear();
+
     if (fileHandle_) {
         hdfsCloseFile(fsHandle_, fileHandle_);
         fileHandle_ = nullptr;
@@ -155,9 +283,9 @@ struct HDFSDlSource {
         boost::iostreams::closable_tag
     { };
 
-    HDFSDlSource(const string & urlStr)
+    HDFSDlSource(const string & urlStr, const HDFSDownloadParams & params)
     {
-        impl_.reset(new HDFSSourceImpl(urlStr, O_RDONLY));
+        impl_.reset(new HDFSSourceImpl(urlStr, O_RDONLY, params));
     }
 
     streamsize read(char* s, streamsize n)
@@ -256,7 +384,18 @@ struct RegisterHDFSHandler {
         string url = "hdfs://" + resource;
 
         if (mode == ios::in) {
-            result = new boost::iostreams::stream_buffer<HDFSDlSource>(HDFSDlSource(url), 131072);
+            HDFSDownloadParams params;
+            for (auto & opt: options) {
+                const string & name = opt.first;
+                const string & value = opt.second;
+                if (name == "num-requests") {
+                    params.numRequests = std::stoi(value);
+                }
+                else if (name == "part-size") {
+                    params.partSize = std::stoull(value);
+                }
+            }
+            result = new boost::iostreams::stream_buffer<HDFSDlSource>(HDFSDlSource(url, params), 131072);
         }
         else if (mode == ios::out) {
              result =
@@ -11,6 +11,7 @@
 #include <exception>
 #include <thread>
 #include <chrono>
+#include <mutex>
 #include <boost/iostreams/stream_buffer.hpp>
 #include "mldb/jml/utils/ring_buffer.h"
 #include "mldb/jml/utils/string_functions.h"
@@ -133,11 +134,27 @@ size_t getTotalSystemMemory()
     return pages * page_size;
 }
 
+/* Parameters controlling the read-ahead of a download. A value of 0 means
+   that the parameter is chosen automatically from the size of the
+   object. */
+struct S3DownloadParams {
+    S3DownloadParams()
+        : numRequests(0), partSize(0)
+    {
+    }
+
+    unsigned int numRequests; /* maximum number of concurrent ranged GETs,
+                               * ie the size of the read-ahead window */
+    size_t partSize; /* size of each ranged GET; fixed instead of ramping
+                      * up when set */
+};
+
 struct S3Downloader {
     S3Downloader(const S3Api * api,
                  const string & bucket,
                  const string & resource, // starts with "/", unescaped (buggy)
-                 ssize_t startOffset = 0, ssize_t endOffset = -1)
+                 ssize_t startOffset = 0, ssize_t endOffset = -1,
+                 const S3DownloadParams & params = S3DownloadParams())
         : api(api),
           bucket(bucket), resource(resource),
           offset(startOffset),
@@ -165,9 +182,12 @@ struct S3Downloader {
         maxChunkSize = api->bandwidthToServiceMbps * 3.0 * 1000000;
         size_t sysMemory = getTotalSystemMemory();
         maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
+        if (params.partSize > 0) {
+            baseChunkSize = maxChunkSize = params.partSize;
+        }
 
         /* The maximum number of concurrent requests is set depending on
-           the total size of the stream. */
+           the total size of the stream, unless it was given explicitly. */
         maxRqs = 1;
         if (fileInfo.size > 1024 * 1024)
             maxRqs = 5;
@@ -175,6 +195,9 @@ struct S3Downloader {
             maxRqs = 15;
         if (fileInfo.size > 256 * 1024 * 1024)
             maxRqs = 30;
+        if (params.numRequests > 0) {
+            maxRqs = params.numRequests;
+        }
         chunks.resize(maxRqs);
 
         /* Kick start the requests */
@@ -360,8 +383,8 @@ private:
     {
         size_t chunkSize = getChunkSize(currentRq);
         uint64_t end = requestedBytes + chunkSize;
-        if (end > fileInfo.size) {
-            end = fileInfo.size;
+        if (end > downloadSize) {
+            end = downloadSize;
             chunkSize = end - requestedBytes;
         }
 
@@ -466,14 +489,16 @@ private:
 /****************************************************************************/
 
 struct StreamingDownloadSource {
-    StreamingDownloadSource(const std::string & urlStr)
+    StreamingDownloadSource(const std::string & urlStr,
+                            const S3DownloadParams & params)
     {
         owner = getS3ApiForUri(urlStr);
 
         string bucket, resource;
         std::tie(bucket, resource) = S3Api::parseUri(urlStr);
         downloader.reset(new S3Downloader(owner.get(),
-                                          bucket, "/" + resource));
+                                          bucket, "/" + resource,
+                                          0, -1, params));
     }
 
     const FsObjectInfo & info()
@@ -513,10 +538,11 @@ private:
 
 
 std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
-makeStreamingDownload(const std::string & uri)
+makeStreamingDownload(const std::string & uri,
+                      const S3DownloadParams & params)
 {
     std::unique_ptr<std::streambuf> result;
-    StreamingDownloadSource source(uri);
+    StreamingDownloadSource source(uri, params);
     result.reset(new boost::iostreams::stream_buffer<StreamingDownloadSource>
                  (source,131072));
     return make_pair(std::move(result), source.info());
@@ -560,7 +586,8 @@ struct S3Uploader {
           closed(false),
           chunkSize(8 * 1024 * 1024), // start with 8MB and ramp up
           currentRq(0),
-          activeRqs(0)
+          activeRqs(0),
+          bufferedBytes(0)
     {
         /* Maximum chunk size is what we can do in 3 seconds, up to 1% of
            system memory. */
@@ -568,6 +595,14 @@ struct S3Uploader {
         size_t sysMemory = getTotalSystemMemory();
         maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
 
+        /* The parts being uploaded are held until they succeed, so that
+           they can be retried; by default, they can use up to 10% of
+           system memory. */
+        maxBufferedBytes = metadata.maxBufferedBytes;
+        if (maxBufferedBytes == 0) {
+            maxBufferedBytes = sysMemory / 10;
+        }
+
         try {
             S3Api::MultiPartUpload upload
               = api->obtainMultiPartUpload(bucket, resource, metadata,
@@ -625,7 +660,11 @@ struct S3Uploader {
         if (!force) {
             ExcAssert(current.size() > 0);
         }
-        while (activeRqs == metadata.numRequests) {
+        /* Wait for a free request slot, and for enough memory to be
+           released by the parts in flight for this one to fit. */
+        while (activeRqs == metadata.numRequests
+               || (activeRqs > 0
+                   && bufferedBytes + current.size() > maxBufferedBytes)) {
             ML::futex_wait(activeRqs, activeRqs);
         }
         if (excPtrHandler.hasException() && onException) {
@@ -633,34 +672,49 @@ struct S3Uploader {
         }
         excPtrHandler.rethrowIfSet();
 
-        unsigned int rqNbr(currentRq);
-        auto onResponse = [&, rqNbr] (S3Api::Response && response,
-                                      std::exception_ptr excPtr) {
-            this->handleResponse(rqNbr, std::move(response), excPtr);
-        };
-
         unsigned int partNumber = currentRq + 1;
-        if (etags.size() < partNumber) {
-            etags.resize(partNumber);
+        {
+            std::unique_lock<std::mutex> guard(etagsLock);
+            if (etags.size() < partNumber) {
+                etags.resize(partNumber);
+            }
         }
 
+        auto data = std::make_shared<std::string>(std::move(current));
+        current = string();
+        bufferedBytes += data->size();
         activeRqs++;
-        api->putAsync(onResponse, bucket, resource,
-                      MLDB::format("partNumber=%d&uploadId=%s",
-                                 partNumber, uploadId),
-                      {}, {}, current);
+        putPart(currentRq, data, 1);
 
         if (currentRq % 5 == 0 && chunkSize < maxChunkSize)
             chunkSize *= 2;
 
-        current.clear();
         currentRq = partNumber;
     }
 
+    void putPart(unsigned int rqNbr,
+                 const std::shared_ptr<std::string> & data,
+                 unsigned int attempt)
+    {
+        auto onResponse = [=] (S3Api::Response && response,
+                               std::exception_ptr excPtr) {
+            this->handleResponse(rqNbr, data, attempt,
+                                 std::move(response), excPtr);
+        };
+
+        api->putAsync(onResponse, bucket, resource,
+                      MLDB::format("partNumber=%d&uploadId=%s",
+                                 rqNbr + 1, uploadId),
+                      {}, {}, *data);
+    }
+
     void handleResponse(unsigned int rqNbr,
+                        const std::shared_ptr<std::string> & data,
+                        unsigned int attempt,
                         S3Api::Response && response,
                         std::exception_ptr excPtr)
     {
+        bool retry = false;
         try {
             if (excPtr) {
                 rethrow_exception(excPtr);
@@ -673,11 +727,33 @@ struct S3Uploader {
 
             string etag = response.getHeader("etag");
             ExcAssert(etag.size() > 0);
+            std::unique_lock<std::mutex> guard(etagsLock);
             etags[rqNbr] = etag;
         }
         catch (const std::exception & exc) {
-            excPtrHandler.takeCurrentException();
+            /* Only this part is uploaded again; the others are unaffected */
+            if (attempt < metadata.numPartAttempts
+                && !excPtrHandler.hasException()) {
+                cerr << "upload of part " << (rqNbr + 1) << " of " << resource
+                     << " failed (" << exc.what() << "); retrying" << endl;
+                retry = true;
+            }
+            else {
+                excPtrHandler.takeCurrentException();
+            }
         }
+
+        if (retry) {
+            try {
+                putPart(rqNbr, data, attempt + 1);
+                return;
+            }
+            catch (const std::exception & exc) {
+                excPtrHandler.takeCurrentException();
+            }
+        }
+
+        bufferedBytes -= data->size();
         activeRqs--;
         ML::futex_wake(activeRqs);
     }
@@ -723,6 +799,7 @@ private:
     OnUriHandlerException onException;
 
     size_t maxChunkSize;
+    size_t maxBufferedBytes; /* maximum size of the parts in flight */
     std::string uploadId;
 
     /* state variables, used between "start" and "stop" */
@@ -731,9 +808,11 @@ private:
 
     string current; /* current chunk data */
     size_t chunkSize; /* current chunk size */
+    std::mutex etagsLock; /* protects etags */
     std::vector<std::string> etags; /* etags of individual chunks */
     unsigned int currentRq;  /* number of done requests */
     atomic<unsigned int> activeRqs; /* number of pending http requests */
+    atomic<size_t> bufferedBytes; /* size of the parts in flight */
 };
 
 
@@ -812,9 +891,21 @@ struct RegisterS3Handler {
         string bucket(resource, 0, pos);
 
         if (mode == ios::in) {
+            S3DownloadParams params;
+            for (auto & opt: options) {
+                const string & name = opt.first;
+                const string & value = opt.second;
+                if (name == "num-requests") {
+                    params.numRequests = std::stoi(value);
+                }
+                else if (name == "part-size") {
+                    params.partSize = std::stoull(value);
+                }
+            }
+
             std::unique_ptr<std::streambuf> source;
             FsObjectInfo info;
-            auto dl = makeStreamingDownload("s3://" + resource);
+            auto dl = makeStreamingDownload("s3://" + resource, params);
             source = std::move(dl.first);
             info = std::move(dl.second);
             std::shared_ptr<std::streambuf> buf(source.release());
@@ -861,6 +952,12 @@ struct RegisterS3Handler {
                 {
                     md.numRequests = std::stoi(value);
                 }
+                else if (name == "max-buffered-bytes") {
+                    md.maxBufferedBytes = std::stoull(value);
+                }
+                else if (name == "part-attempts") {
+                    md.numPartAttempts = std::stoi(value);
+                }
                 else {
                     cerr << "warning: skipping unknown S3 option "
                          << name << "=" << value << endl;
@@ -27,6 +27,7 @@
 #include "mldb/base/exc_assert.h"
 #include "mldb/soa/credentials/credential_provider.h"
 #include <thread>
+#include <atomic>
 #include <unordered_map>
 
 
@@ -253,6 +254,7 @@ Directory(const std::string & path,
 SftpConnection::Directory::
 ~Directory()
 {
+    std::unique_lock<std::mutex> guard(owner->sessionMutex);
     libssh2_sftp_close(handle);
 }
 
@@ -266,10 +268,13 @@ ls() const
         LIBSSH2_SFTP_ATTRIBUTES attrs;
  
         /* loop until we fail */ 
-        int rc = libssh2_sftp_readdir_ex(handle, mem, sizeof(mem),
-
+        int rc;
+        {
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
+            rc = libssh2_sftp_readdir_ex(handle, mem, sizeof(mem),
                                          longentry, sizeof(longentry),
                                          &attrs);
+        }
         if(rc > 0) {
             /* rc is the length of the file name in the mem
                buffer */ 
@@ -316,10 +321,15 @@ forEachFile(const OnFile & onFile) const
         Attributes attrs;
  
         /* loop until we fail */ 
-        int rc = libssh2_sftp_readdir_ex(handle,
+        int rc;
+        {
+            // Not held during the callback, which may use the session
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
+            rc = libssh2_sftp_readdir_ex(handle,
                                          mem, sizeof(mem),
                                          longentry, sizeof(longentry),
                                          &attrs);
+        }
 
         if(rc > 0) {
             /* rc is the length of the file name in the mem
@@ -349,6 +359,7 @@ File(const std::string & path,
 SftpConnection::File::
 ~File()
 {
+    std::unique_lock<std::mutex> guard(owner->sessionMutex);
     libssh2_sftp_close(handle);
 }
 
@@ -357,6 +368,7 @@ SftpConnection::File::
 getAttr() const
 {
     Attributes result;
+    std::unique_lock<std::mutex> guard(owner->sessionMutex);
     int res = libssh2_sftp_fstat_ex(handle, &result, 0);
     if (res == -1)
         throw MLDB::Exception("getAttr(): " + owner->lastError());
@@ -386,9 +398,16 @@ downloadTo(const std::string & filename) const
     Date start = Date::now();
 
     for (;;) {
-        ssize_t numRead = libssh2_sftp_read(handle, buf, bufSize);
+        ssize_t numRead;
+        {
+            // libssh2 keeps as many read requests in flight as fit in the
+            // buffer, so a large one pipelines the transfer
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
+            numRead = libssh2_sftp_read(handle, buf, bufSize);
+        }
         //cerr << "read " << numRead << " bytes" << endl;
         if (numRead < 0) {
+            delete[] buf;
             throw MLDB::Exception("read(): " + owner->lastError());
         }
         if (numRead == 0) break;
@@ -472,6 +491,7 @@ SftpConnection::Directory
 SftpConnection::
 getDirectory(const std::string & path) const
 {
+    std::unique_lock<std::mutex> guard(sessionMutex);
     LIBSSH2_SFTP_HANDLE * handle
         = libssh2_sftp_opendir(sftp_session, path.c_str());
         
@@ -486,23 +506,60 @@ SftpConnection::File
 SftpConnection::
 openFile(const std::string & path)
 {
-    LIBSSH2_SFTP_HANDLE * handle
-        = libssh2_sftp_open_ex(sftp_session, path.c_str(),
-                               path.length(), LIBSSH2_FXF_READ, 0,
-                               LIBSSH2_SFTP_OPENFILE);
+    LIBSSH2_SFTP_HANDLE * handle;
+    {
+        std::unique_lock<std::mutex> guard(sessionMutex);
+        handle = libssh2_sftp_open_ex(sftp_session, path.c_str(),
+                                      path.length(), LIBSSH2_FXF_READ, 0,
+                                      LIBSSH2_SFTP_OPENFILE);
         
-    if (!handle) {
-        throw MLDB::Exception("couldn't open path: " + lastError());
+        if (!handle) {
+            throw MLDB::Exception("couldn't open path: " + lastError());
+        }
     }
 
     return File(path, handle, this);
 }
 
+void
+SftpConnection::
+downloadFiles(const std::vector<std::pair<std::string, std::string> > & files,
+              int maxParallelism)
+{
+    std::atomic<size_t> next(0);
+    std::mutex excLock;
+    std::exception_ptr exc;
+
+    auto work = [&] ()
+        {
+            for (size_t i = next++;  i < files.size();  i = next++) {
+                try {
+                    openFile(files[i].first).downloadTo(files[i].second);
+                } catch (...) {
+                    std::unique_lock<std::mutex> guard(excLock);
+                    if (!exc)
+                        exc = std::current_exception();
+                    next = files.size();
+                }
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (int i = 0;  i < std::max(maxParallelism, 1);  ++i)
+        threads.emplace_back(work);
+    for (auto & t: threads)
+        t.join();
+
+    if (exc)
+        std::rethrow_exception(exc);
+}
+
 bool
 SftpConnection::
 getAttributes(const std::string & path, Attributes & attrs)
     const
 {
+    std::unique_lock<std::mutex> guard(sessionMutex);
     int res = libssh2_sftp_stat_ex(sftp_session,
                                    path.c_str(), path.length(), LIBSSH2_SFTP_STAT,
                                    &attrs);
@@ -528,6 +585,7 @@ uploadFile(const char * start,
            const std::string & path)
 {
     /* Request a file via SFTP */ 
+    std::unique_lock<std::mutex> guard(sessionMutex);
     LIBSSH2_SFTP_HANDLE * handle =
         libssh2_sftp_open(sftp_session, path.c_str(),
                           LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
@@ -537,6 +595,7 @@ uploadFile(const char * start,
     if (!handle) {
         throw MLDB::Exception("couldn't open path: " + lastError());
     }
+    guard.unlock();
 
     Date started = Date::now();
 
@@ -549,12 +608,14 @@ uploadFile(const char * start,
         size_t toSend = std::min<size_t>(size - offset,
                                          1024 * 1024);
 
+        guard.lock();
         ssize_t rc = libssh2_sftp_write(handle,
                                         start + offset,
                                         toSend);
         
         if (rc == -1)
             throw MLDB::Exception("couldn't upload file: " + lastError());
+        guard.unlock();
 
         offset += rc;
         
@@ -584,6 +645,7 @@ uploadFile(const char * start,
         //     << " of " << size << endl;
     }
  
+    guard.lock();
     libssh2_sftp_close(handle);
 }
 
@@ -591,6 +653,7 @@ bool
 SftpConnection::
 isAlive() const
 {
+    std::unique_lock<std::mutex> guard(sessionMutex);
     LIBSSH2_CHANNEL * channel = libssh2_sftp_get_channel(sftp_session);
     int res = libssh2_channel_setenv_ex(channel,
                                         "MLDB_PING", // var name
@@ -604,14 +667,19 @@ isAlive() const
 struct SftpStreamingDownloadSource {
 
     SftpStreamingDownloadSource(const SftpConnection * owner,
-                                std::string path)
+                                std::string path,
+                                int numRequests)
     {
         impl.reset(new Impl());
         impl->owner = owner;
         impl->path = path;
+        impl->buffer.resize(std::max(numRequests, 1) * READ_REQUEST_SIZE);
         impl->start();
     }
 
+    /// Size of each read request, as used by OpenSSH
+    static constexpr size_t READ_REQUEST_SIZE = 32768;
+
     typedef char char_type;
     struct category
         : public boost::iostreams::input /*_seekable*/,
@@ -621,7 +689,7 @@ struct SftpStreamingDownloadSource {
     
     struct Impl {
         Impl()
-            : owner(0), offset(0), handle(0)
+            : owner(0), offset(0), handle(0), bufferStart(0), bufferEnd(0)
         {
         }
 
@@ -635,10 +703,18 @@ struct SftpStreamingDownloadSource {
         size_t offset;
         LIBSSH2_SFTP_HANDLE * handle;
 
+        // libssh2 keeps as many read requests in flight as fit in the
+        // buffer it reads into, so reads go through a buffer of the size
+        // of the window rather than straight into the caller's
+        std::vector<char> buffer;
+        size_t bufferStart;
+        size_t bufferEnd;
+
         Date startDate;
 
         void start()
         {
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
             handle
                 = libssh2_sftp_open_ex(owner->sftp_session, path.c_str(),
                                        path.length(), LIBSSH2_FXF_READ, 0,
@@ -652,19 +728,35 @@ struct SftpStreamingDownloadSource {
 
         void stop()
         {
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
             if (handle) libssh2_sftp_close(handle);
+            handle = 0;
         }
 
         std::streamsize read(char_type* s, std::streamsize n)
         {
             BOOST_STATIC_ASSERT(sizeof(char_type) == 1);
 
-            ssize_t numRead = libssh2_sftp_read(handle, s, n);
-            if (numRead < 0) {
-                throw MLDB::Exception("read(): " + owner->lastError());
+            if (bufferStart == bufferEnd) {
+                std::unique_lock<std::mutex> guard(owner->sessionMutex);
+                ssize_t numRead = libssh2_sftp_read(handle, buffer.data(),
+                                                    buffer.size());
+                if (numRead < 0) {
+                    throw MLDB::Exception("read(): " + owner->lastError());
+                }
+                if (numRead == 0) {
+                    return -1;
+                }
+                bufferStart = 0;
+                bufferEnd = numRead;
             }
-            
-            return numRead;
+
+            size_t toDo = std::min<size_t>(bufferEnd - bufferStart, n);
+            std::copy(buffer.data() + bufferStart,
+                      buffer.data() + bufferStart + toDo, s);
+            bufferStart += toDo;
+            offset += toDo;
+            return toDo;
         }
     };
 
@@ -740,6 +832,7 @@ struct SftpStreamingUploadSource {
         void start()
         {
             /* Request a file via SFTP */ 
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
             handle =
                 libssh2_sftp_open(owner->sftp_session, path.c_str(),
                                   LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
@@ -749,6 +842,7 @@ struct SftpStreamingUploadSource {
             if (!handle) {
                 auto excPtr = make_exception_ptr(
                     MLDB::Exception("couldn't open path: " + owner->lastError()));
+                guard.unlock();
                 onException(excPtr);
                 throw excPtr;
             }
@@ -758,7 +852,9 @@ struct SftpStreamingUploadSource {
         
         void stop()
         {
+            std::unique_lock<std::mutex> guard(owner->sessionMutex);
             if (handle) libssh2_sftp_close(handle);
+            handle = 0;
         }
 
         std::streamsize write(const char_type* s, std::streamsize n)
@@ -767,15 +863,18 @@ struct SftpStreamingUploadSource {
 
             while (done < n) {
 
+                std::unique_lock<std::mutex> guard(owner->sessionMutex);
                 ssize_t rc = libssh2_sftp_write(handle, s + done, n - done);
             
                 if (rc == -1) {
                     auto excPtr = make_exception_ptr(
                         MLDB::Exception("couldn't upload file: " + owner->lastError()));
+                    guard.unlock();
                     onException(excPtr);
                     throw excPtr;
                 }
             
+                guard.unlock();
                 offset += rc;
                 done += rc;
 
@@ -878,11 +977,12 @@ streamingDownload(const std::string & path) const
 
 std::unique_ptr<std::streambuf>
 SftpConnection::
-streamingDownloadStreambuf(const std::string & path) const
+streamingDownloadStreambuf(const std::string & path,
+                           int numRequests) const
 {
     std::unique_ptr<std::streambuf> result;
     result.reset(new boost::iostreams::stream_buffer<SftpStreamingDownloadSource>
-                 (SftpStreamingDownloadSource(this, path),
+                 (SftpStreamingDownloadSource(this, path, numRequests),
                   131072));
     return result;
 }
@@ -890,12 +990,14 @@ streamingDownloadStreambuf(const std::string & path) const
 int
 SftpConnection::
 unlink(const string & path) const {
+    std::unique_lock<std::mutex> guard(sessionMutex);
     return libssh2_sftp_unlink(sftp_session, path.c_str());
 }
 
 int
 SftpConnection::
 mkdir(const string & path) const {
+    std::unique_lock<std::mutex> guard(sessionMutex);
     return libssh2_sftp_mkdir(sftp_session, path.c_str(),
                               LIBSSH2_SFTP_S_IRWXU | LIBSSH2_SFTP_S_IRWXG |
                               LIBSSH2_SFTP_S_IRWXO);
@@ -974,8 +1076,15 @@ struct RegisterSftpHandler {
         const auto & connection = getSftpConnectionFromConnStr(connStr);
         string path = resource.substr(connStr.size());
         if (mode == ios::in) {
+            int numRequests = 64;
+            auto it = options.find("num-requests");
+            if (it != options.end()) {
+                numRequests = std::stoi(it->second);
+            }
+
             std::shared_ptr<std::streambuf> buf
-                (connection.streamingDownloadStreambuf(path).release());
+                (connection.streamingDownloadStreambuf(path, numRequests)
+                 .release());
 
             SftpConnection::Attributes attr;
             if (!connection.getAttributes(path, attr)) {
@@ -14,6 +14,8 @@
 #include <libssh2_sftp.h>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/arch/exception.h"
@@ -80,11 +82,20 @@ struct SshConnection : public SocketConnection {
 /* SFTP CONNECTION                                                           */
 /*****************************************************************************/
 
-/** An SFTP connection, built on top of the ssh connection. */
+/** An SFTP connection, built on top of the ssh connection.
+
+    A libssh2 session may only be used by one thread at a time, so every
+    call on the session or on the files opened through it takes the
+    session lock.  Several files can then be transferred at once over the
+    same connection, their requests interleaving on the session.
+*/
 
 struct SftpConnection : public SshConnection {
     LIBSSH2_SFTP *sftp_session;
 
+    /// Held during every libssh2 call on the session or its handles
+    mutable std::mutex sessionMutex;
+
     SftpConnection();
     SftpConnection(const SftpConnection & other) = delete;
 
@@ -144,6 +155,13 @@ struct SftpConnection : public SshConnection {
 
     File openFile(const std::string & path);
 
+    /** Download each (remote path, local filename) pair, with up to
+        maxParallelism files being transferred at once over the session.
+        Each file keeps its own window of read requests in flight.
+    */
+    void downloadFiles(const std::vector<std::pair<std::string, std::string> > & files,
+                       int maxParallelism = 4);
+
     void uploadFile(const char * start,
                     size_t size,
                     const std::string & path);
@@ -154,8 +172,14 @@ struct SftpConnection : public SshConnection {
     streamingUploadStreambuf(const std::string & path,
                              const OnUriHandlerException & onException) const;
 
+    /** Return a streambuf reading the given file.  Reads are pipelined:
+        up to numRequests read requests of 32KB are kept in flight, as
+        OpenSSH does, so that the transfer isn't bound by the round trip
+        time.
+    */
     std::unique_ptr<std::streambuf>
-    streamingDownloadStreambuf(const std::string & path) const;
+    streamingDownloadStreambuf(const std::string & path,
+                               int numRequests = 64) const;
 
     filter_ostream streamingUpload(const std::string & path) const;
     filter_istream streamingDownload(const std::string & path) const;
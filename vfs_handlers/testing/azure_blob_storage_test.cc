@@ -117,6 +117,37 @@ void test_azure_storage_write_and_erase()
     BOOST_REQUIRE(!objectInfo.exists);
 }
 
+void test_azure_storage_parallel_write_and_read()
+{
+    auto now = Date::now();
+    string outputUri =
+        "azureblob://publicelementai/private/subdirectory/parallel"
+        + to_string(now.secondsSinceEpoch()) + ".txt";
+
+    // Several blocks of one part each, with a partial one at the end
+    string outputStr;
+    for (int i = 0;  outputStr.size() < 3500000;  ++i) {
+        outputStr += "line " + to_string(i) + "\n";
+    }
+
+    filter_ostream w(outputUri, { { "part-size", "1000000" },
+                                  { "num-requests", "2" } });
+    w << outputStr;
+    w.close();
+
+    auto objectInfo = tryGetUriObjectInfo(outputUri);
+    BOOST_REQUIRE(objectInfo.exists);
+    BOOST_CHECK_EQUAL(objectInfo.size, outputStr.size());
+
+    filter_istream read(outputUri, { { "part-size", "300000" },
+                                     { "num-requests", "4" } });
+    auto res = read.readAll();
+    BOOST_REQUIRE_EQUAL(res.size(), outputStr.size());
+    BOOST_REQUIRE(res == outputStr);
+
+    eraseUriObject(outputUri);
+}
+
 void test_azure_file_crawler()
 {
     // for each uri
@@ -145,6 +176,7 @@ init_unit_test_suite( int argc, char* argv[] )
 
     auto azureTests = {&test_azure_storage_read,
                        &test_azure_storage_write_and_erase,
+                       &test_azure_storage_parallel_write_and_read,
                        &test_azure_file_crawler};
     if (azureRegistration.isRegistered()) {
         for (const auto & test: azureTests) {